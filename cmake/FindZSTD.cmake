@@ -0,0 +1,55 @@
+# - Check for the presence of ZSTD
+#
+# The following variables are set when ZSTD is found:
+#  HAVE_ZSTD       = Set to true, if all components of ZSTD
+#                          have been found.
+#  ZSTD_INCLUDES   = Include path for the header files of ZSTD
+#  ZSTD_LIBRARIES  = Link these to use ZSTD
+
+## -----------------------------------------------------------------------------
+## Check for the header files
+
+find_path (ZSTD_INCLUDES zstd.h
+  PATHS /usr/local/include /usr/include /sw/include
+  )
+
+## -----------------------------------------------------------------------------
+## Check for the library
+
+find_library (ZSTD_LIBRARIES NAMES zstd
+    PATHS ${CMAKE_EXTRA_LIBRARIES}
+  )
+
+## -----------------------------------------------------------------------------
+## Actions taken when all components have been found
+
+if (ZSTD_INCLUDES AND ZSTD_LIBRARIES)
+  set (HAVE_ZSTD TRUE)
+else (ZSTD_INCLUDES AND ZSTD_LIBRARIES)
+  if (NOT ZSTD_FIND_QUIETLY)
+    if (NOT ZSTD_INCLUDES)
+      message (STATUS "Unable to find ZSTD header files!")
+    endif (NOT ZSTD_INCLUDES)
+    if (NOT ZSTD_LIBRARIES)
+      message (STATUS "Unable to find ZSTD library files!")
+    endif (NOT ZSTD_LIBRARIES)
+  endif (NOT ZSTD_FIND_QUIETLY)
+endif (ZSTD_INCLUDES AND ZSTD_LIBRARIES)
+
+if (HAVE_ZSTD)
+  if (NOT ZSTD_FIND_QUIETLY)
+    message (STATUS "Found components for ZSTD")
+    message (STATUS "ZSTD_INCLUDES = ${ZSTD_INCLUDES}")
+    message (STATUS "ZSTD_LIBRARIES     = ${ZSTD_LIBRARIES}")
+  endif (NOT ZSTD_FIND_QUIETLY)
+else (HAVE_ZSTD)
+  if (ZSTD_FIND_REQUIRED)
+    message (FATAL_ERROR "Could not find ZSTD!")
+  endif (ZSTD_FIND_REQUIRED)
+endif (HAVE_ZSTD)
+
+mark_as_advanced (
+  HAVE_ZSTD
+  ZSTD_LIBRARIES
+  ZSTD_INCLUDES
+  )
@@ -10,11 +10,31 @@
 
 static Logger* defaultLogger = NULL;
 
+LogLevel _logger_maxLevel = LOGLEVEL_TRACE;
+
+// Cache the noisiest level that the default logger accepts, so that the logging
+// macros can skip disabled messages without formatting them or calling into the logger.
+static void _logger_updateMaxLevel() {
+    LogLevel maxLevel = LOGLEVEL_UNSET;
+    for (LogLevel level = LOGLEVEL_TRACE; level > LOGLEVEL_UNSET; level--) {
+        if (logger_isEnabled(defaultLogger, level)) {
+            maxLevel = level;
+            break;
+        }
+    }
+    // Errors are always logged, even if the logger says otherwise.
+    if (maxLevel < LOGLEVEL_ERROR) {
+        maxLevel = LOGLEVEL_ERROR;
+    }
+    __atomic_store_n(&_logger_maxLevel, maxLevel, __ATOMIC_RELAXED);
+}
+
 void logger_setDefault(Logger* logger) {
     if (defaultLogger != NULL) {
         defaultLogger->destroy(defaultLogger);
     }
     defaultLogger = logger;
+    _logger_updateMaxLevel();
 }
 
 Logger* logger_getDefault() { return defaultLogger; }
@@ -149,6 +169,9 @@ void logger_setLevel(Logger* logger, LogLevel level) {
     } else {
         logger->setLevel(logger, level);
     }
+    if (logger == defaultLogger) {
+        _logger_updateMaxLevel();
+    }
 }
 
 bool logger_isEnabled(Logger* logger, LogLevel level) {
@@ -18,16 +18,51 @@
 
 #include "lib/logger/log_level.h"
 
+/* The noisiest level that is compiled in, as the integer value of a LogLevel.
+ * Messages at noisier levels are removed by the preprocessor, so their
+ * arguments aren't evaluated. Errors and warnings are never compiled out.
+ * Set with the SHADOW_LOG_LEVEL_MAX cmake option. By default, trace messages
+ * are only compiled into debug builds. */
+#ifndef LOGGER_MAX_LEVEL
+#ifdef DEBUG
+#define LOGGER_MAX_LEVEL 5 /* LOGLEVEL_TRACE */
+#else
+#define LOGGER_MAX_LEVEL 4 /* LOGLEVEL_DEBUG */
+#endif
+#endif
+
+/* The noisiest level that the default logger currently accepts. Don't use
+ * directly; it's kept up to date by logger_setDefault and logger_setLevel. */
+extern LogLevel _logger_maxLevel;
+
+/* Whether the default logger might log a message at this level. This is only
+ * a cheap first check for the logging macros, and may return true for
+ * messages that the logger will still drop (e.g. due to per-host levels). */
+static inline bool logger_mayBeEnabled(LogLevel level) {
+    return level <= __atomic_load_n(&_logger_maxLevel, __ATOMIC_RELAXED);
+}
+
 /* convenience macros for logging messages at various levels */
 // clang-format off
 
+#define _logger_logIfEnabled(level, ...) \
+    (logger_mayBeEnabled(level) ? logger_log(logger_getDefault(), level, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__) : (void)0)
+
 #define panic(...)    { logger_log(logger_getDefault(), LOGLEVEL_ERROR, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); abort(); }
 #define error(...)      logger_log(logger_getDefault(), LOGLEVEL_ERROR, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define warning(...)    logger_log(logger_getDefault(), LOGLEVEL_WARNING, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define info(...)       logger_log(logger_getDefault(), LOGLEVEL_INFO, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define debug(...)      logger_log(logger_getDefault(), LOGLEVEL_DEBUG, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#ifdef DEBUG
-#define trace(...)      logger_log(logger_getDefault(), LOGLEVEL_TRACE, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
+#define warning(...)    _logger_logIfEnabled(LOGLEVEL_WARNING, __VA_ARGS__)
+#if LOGGER_MAX_LEVEL >= 3
+#define info(...)       _logger_logIfEnabled(LOGLEVEL_INFO, __VA_ARGS__)
+#else
+#define info(...)
+#endif
+#if LOGGER_MAX_LEVEL >= 4
+#define debug(...)      _logger_logIfEnabled(LOGLEVEL_DEBUG, __VA_ARGS__)
+#else
+#define debug(...)
+#endif
+#if LOGGER_MAX_LEVEL >= 5
+#define trace(...)      _logger_logIfEnabled(LOGLEVEL_TRACE, __VA_ARGS__)
 #else
 #define trace(...)
 #endif
@@ -8,23 +8,84 @@
 #include <sched.h>
 #include <unistd.h>
 
-BinarySpinningSem::BinarySpinningSem(ssize_t spin_max) : _thresh(spin_max) {
+// The moving average weights each new sample by 1/_kEmaWeight.
+static constexpr size_t _kEmaWeight = 8;
+// Fixed-point scale of the moving average.
+static constexpr size_t _kEmaScale = 16;
+// Spin for this multiple of the average number of spins a successful wait needs.
+static constexpr ssize_t _kBudgetFactor = 4;
+// Never spin less than this, unless spinning is disabled entirely.
+static constexpr ssize_t _kMinBudget = 64;
+// After this many waits in a row fail to spin, stop spinning.
+static constexpr unsigned _kMaxMisses = 8;
+// While not spinning, try spinning again after this many waits.
+static constexpr unsigned _kProbeInterval = 64;
+
+BinarySpinningSem::BinarySpinningSem(ssize_t spin_max)
+    : _thresh(spin_max), _budget(spin_max), _emaSpins(0), _misses(0), _waitsSinceProbe(0) {
     shadow_sem_init(&_semaphore, 1, 0);
 }
 
+void BinarySpinningSem::_updateBudget(bool spinSucceeded, ssize_t spins) {
+    if (spinSucceeded) {
+        _misses = 0;
+        _emaSpins = (_emaSpins * (_kEmaWeight - 1) + (size_t)spins * _kEmaScale) / _kEmaWeight;
+        ssize_t budget = (ssize_t)(_emaSpins / _kEmaScale) * _kBudgetFactor;
+        budget = budget < _kMinBudget ? _kMinBudget : budget;
+        _budget = budget > _thresh ? _thresh : budget;
+    } else if (++_misses >= _kMaxMisses) {
+        // The other side is likely not running; spinning only delays it further.
+        _budget = 0;
+        _waitsSinceProbe = 0;
+    } else {
+        // Give a longer wait another chance before giving up on spinning.
+        ssize_t budget = _budget * 2;
+        _budget = (budget > _thresh || budget <= 0) ? _thresh : budget;
+    }
+}
+
 void BinarySpinningSem::post() {
     shadow_sem_post(&_semaphore);
     sched_yield();
 }
 
-void BinarySpinningSem::wait(bool spin) {
-    if (spin) {
-        for (int i = 0; _thresh < 0 || i < _thresh; ++i) {
+static bool _shouldStopSpinning(const std::atomic<bool>* stop_spinning) {
+    return stop_spinning && stop_spinning->load(std::memory_order_relaxed);
+}
+
+void BinarySpinningSem::wait(bool spin, const std::atomic<bool>* stop_spinning) {
+    if (spin && _thresh < 0) {
+        // Spin without limit, as configured.
+        while (shadow_sem_trywait(&_semaphore) != 0) {
+            if (_shouldStopSpinning(stop_spinning)) {
+                shadow_sem_wait(&_semaphore);
+                return;
+            }
+        }
+        return;
+    }
+
+    if (spin && _thresh > 0 && _budget == 0 && ++_waitsSinceProbe >= _kProbeInterval) {
+        // Check whether spinning has started paying off again.
+        _budget = _kMinBudget > _thresh ? _thresh : _kMinBudget;
+        _misses = _kMaxMisses - 1;
+    }
+
+    if (spin && _budget > 0) {
+        for (ssize_t i = 0; i < _budget; ++i) {
             if (shadow_sem_trywait(&_semaphore) == 0) {
+                _updateBudget(true, i + 1);
+                return;
+            }
+            if (_shouldStopSpinning(stop_spinning)) {
+                // Not a miss; the poster told us that it won't post soon.
+                shadow_sem_wait(&_semaphore);
                 return;
             }
         }
+        _updateBudget(false, _budget);
     }
+
     shadow_sem_wait(&_semaphore);
 }
 
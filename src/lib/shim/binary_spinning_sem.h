@@ -15,6 +15,12 @@
  * spinning: the wait() caller will spin for a number of cycles --- if post()
  * is called during the spinning, then the waiting thread will immediately
  * resume. After thresh_ spins, falls back to a POSIX sem_t semaphore.
+ *
+ * Rather than always spinning up to thresh_, the waiter learns how long the
+ * other side usually takes to post, and spins for a small multiple of that.
+ * When spinning repeatedly fails, as it does when the other side is
+ * descheduled because there are more threads than cores, the waiter stops
+ * spinning and only occasionally tries again to see if things have changed.
  */
 class BinarySpinningSem {
   public:
@@ -58,6 +64,10 @@ class BinarySpinningSem {
      * instead of spinning.  This is useful when the caller knows other cores
      * will need to do work before the semaphore will become available.
      *
+     * If `stop_spinning` is non-NULL, the caller also stops spinning and
+     * blocks as soon as it becomes true, which lets the posting side tell it
+     * that the post won't come soon.
+     *
      * (rwails) !!IMPORTANT!!
      * See note in post(). Same call chain restriction applies for wait().
      *
@@ -65,7 +75,7 @@ class BinarySpinningSem {
      * unlikely that this function will be called by two threads in a correct
      * program.
      */
-    void wait(bool spin = true);
+    void wait(bool spin = true, const std::atomic<bool>* stop_spinning = nullptr);
 
     /*
      * Atomically check if the semaphore is available (has value one). If
@@ -86,6 +96,20 @@ class BinarySpinningSem {
     shadow_sem_t _semaphore;
 
     ssize_t _thresh;
+
+    // The rest is only ever accessed by the (single) waiting side.
+
+    // The number of spins to try in the next wait; at most _thresh.
+    ssize_t _budget;
+    // An exponential moving average of the number of spins that successful
+    // spinning waits took, scaled by _kEmaScale.
+    size_t _emaSpins;
+    // The number of waits in a row that spun for the whole budget and then blocked.
+    unsigned _misses;
+    // While not spinning, the number of waits since we last tried spinning.
+    unsigned _waitsSinceProbe;
+
+    void _updateBudget(bool spinSucceeded, ssize_t spins);
 };
 
 #endif // BINARY_SPINNING_SEM_H_
@@ -1,15 +1,22 @@
 #include "ipc.h"
 
 #include <assert.h>
+#include <atomic>
 #include <errno.h>
 #include <new>
 
 #include "lib/shim/binary_spinning_sem.h"
+#include "main/utility/tracepoint.h"
 
 struct IPCData {
-    IPCData(ssize_t spin_max) : xfer_ctrl_to_plugin(spin_max), xfer_ctrl_to_shadow(spin_max) {}
+    IPCData(ssize_t spin_max)
+        : xfer_ctrl_to_plugin(spin_max), xfer_ctrl_to_shadow(spin_max), plugin_should_block(false) {
+    }
     ShimEvent plugin_to_shadow, shadow_to_plugin;
     BinarySpinningSem xfer_ctrl_to_plugin, xfer_ctrl_to_shadow;
+    // Set by Shadow while the plugin is waiting for an event that won't come
+    // soon. Cleared by the plugin when the event arrives.
+    std::atomic<bool> plugin_should_block;
 };
 
 extern "C" {
@@ -19,23 +26,34 @@ void ipcData_init(IPCData* ipc_data, ssize_t spin_max) { new (ipc_data) IPCData(
 size_t ipcData_nbytes() { return sizeof(IPCData); }
 
 void shimevent_sendEventToShadow(struct IPCData* data, const ShimEvent* e) {
+    TRACEPOINT(shimevent_send_to_shadow, e->event_id);
     data->plugin_to_shadow = *e;
     data->xfer_ctrl_to_shadow.post();
 }
 
 void shimevent_sendEventToPlugin(struct IPCData* data, const ShimEvent* e) {
+    TRACEPOINT(shimevent_send_to_plugin, e->event_id);
     data->shadow_to_plugin = *e;
     data->xfer_ctrl_to_plugin.post();
 }
 
 void shimevent_recvEventFromShadow(struct IPCData* data, ShimEvent* e, bool spin) {
-    data->xfer_ctrl_to_plugin.wait(spin);
+    data->xfer_ctrl_to_plugin.wait(spin, &data->plugin_should_block);
+    // Shadow only sets this before it posts, so it can't be set again until
+    // after we answer this event.
+    data->plugin_should_block.store(false, std::memory_order_relaxed);
     *e = data->shadow_to_plugin;
+    TRACEPOINT(shimevent_recv_from_shadow, e->event_id);
 }
 
 void shimevent_recvEventFromPlugin(struct IPCData* data, ShimEvent* e) {
     data->xfer_ctrl_to_shadow.wait();
     *e = data->plugin_to_shadow;
+    TRACEPOINT(shimevent_recv_from_plugin, e->event_id);
+}
+
+void shimevent_tellPluginToBlock(struct IPCData* data) {
+    data->plugin_should_block.store(true, std::memory_order_relaxed);
 }
 
 int shimevent_tryRecvEventFromShadow(struct IPCData* data, ShimEvent* e) {
@@ -44,6 +62,7 @@ int shimevent_tryRecvEventFromShadow(struct IPCData* data, ShimEvent* e) {
         return rv;
     }
     *e = data->shadow_to_plugin;
+    TRACEPOINT(shimevent_recv_from_shadow, e->event_id);
     return 0;
 }
 
@@ -54,6 +73,7 @@ int shimevent_tryRecvEventFromPlugin(struct IPCData* data, ShimEvent* e) {
     }
 
     *e = data->plugin_to_shadow;
+    TRACEPOINT(shimevent_recv_from_plugin, e->event_id);
     return 0;
 }
 
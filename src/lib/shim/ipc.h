@@ -12,6 +12,15 @@
  * atomics that are not availble on all platforms in C's <stdatomic.h>.
  *
  * TODO: Port to rust.
+ *
+ * The channel holds exactly one event in each direction, and every event sent
+ * to Shadow is answered before the plugin thread continues. Syscalls can't be
+ * queued and completed later in a batch: the plugin needs each syscall's
+ * return value (and any error) before it can make its next call, and even
+ * syscalls that don't block, such as sendmsg or epoll_ctl, have results that
+ * depend on simulated state only Shadow knows. The way to avoid a round trip
+ * is to service a syscall entirely in the shim, as is done for the time
+ * syscalls with the state in ShimSharedMem.
  */
 
 #ifdef __cplusplus
@@ -29,6 +38,14 @@ void shimevent_sendEventToPlugin(struct IPCData *data, const ShimEvent* e);
 void shimevent_recvEventFromShadow(struct IPCData* data, ShimEvent* e, bool spin);
 void shimevent_recvEventFromPlugin(struct IPCData *data, ShimEvent* e);
 
+/*
+ * Tells the plugin, which must be waiting for an event from Shadow, that the
+ * event won't come soon. The plugin stops spinning and sleeps on the
+ * semaphore's futex until the event is sent, without another message being
+ * exchanged.
+ */
+void shimevent_tellPluginToBlock(struct IPCData* data);
+
 /*
  * If a message is ready, sets *e to it and returns 0. Otherwise returns -1
  * and sets errno to EAGAIN.
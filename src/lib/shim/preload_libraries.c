@@ -14,6 +14,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/statfs.h>
@@ -26,6 +27,7 @@
 #include "lib/logger/logger.h"
 #include "lib/shim/shim.h"
 #include "lib/shim/shim_event.h"
+#include "lib/shim/shim_hosts_table.h"
 
 // man 3 usleep
 int usleep(useconds_t usec) {
@@ -177,88 +179,72 @@ static void _getaddrinfo_appendv4(struct addrinfo** head,
     }
 }
 
-// Looks for matching IPv4 addresses in /etc/hosts and them to the list
-// specified by `head` and `tail`.
-static void _getaddrinfo_add_matching_hosts_ipv4(struct addrinfo** head,
-                                                 struct addrinfo** tail,
-                                                 const char* node, bool add_tcp,
-                                                 bool add_udp, bool add_raw,
-                                                 in_port_t port) {
-    // TODO: Parse hosts file once and keep it in an efficiently-searchable
-    // in-memory format.
-    GError* error = NULL;
-    gchar* hosts = NULL;
-    char* pattern = NULL;
-    GMatchInfo* match_info = NULL;
-    GRegex* regex = NULL;
-
-    trace("Reading /etc/hosts file");
-
-    g_file_get_contents("/etc/hosts", &hosts, NULL, &error);
-    if (error != NULL) {
-        panic("Reading /etc/hosts: %s", error->message);
-        goto out;
-    }
-    assert(hosts != NULL);
-
-    trace("Scanning /etc/hosts contents for name %s", node);
-
-    {
-        gchar* escaped_node = g_regex_escape_string(node, -1);
-        // Build a regex to match an IPv4 address entry for the given `node` in
-        // /etc/hosts. See HOSTS(5) for format specification.
-        int rv =
-            asprintf(&pattern, "^(\\d+\\.\\d+\\.\\d+\\.\\d+)[^#\n]*\\b%s\\b",
-                     escaped_node);
-        g_free(escaped_node);
-        if (rv < 0) {
-            panic("asprintf failed: %d", rv);
-            goto out;
+// Maps the table of host names that shadow publishes at the path in
+// SHADOW_HOSTS_TABLE (see lib/shim/shim_hosts_table.h) the first time it's
+// called. Returns NULL if the table isn't available.
+//
+// Shadow only creates the table once all of the hosts are registered, so we
+// never need to map it again. Shadow runs one thread of a process at a time,
+// so we don't need to synchronize this either.
+static ShimHostsTableHeader* _getaddrinfo_hosts_table() {
+    static ShimHostsTableHeader* table = NULL;
+    static bool initd = false;
+
+    if (initd) {
+        return table;
+    }
+    initd = true;
+
+    const char* path = getenv("SHADOW_HOSTS_TABLE");
+    if (path == NULL) {
+        warning("SHADOW_HOSTS_TABLE isn't set; resolving names with a syscall instead");
+        return NULL;
+    }
+
+    // Map the table natively where we can, since shadow doesn't need to know
+    // about it.
+    shim_disableInterposition();
+
+    void* mapping = MAP_FAILED;
+    struct stat st = {0};
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
         }
+        close(fd);
     }
-    trace("Node:%s -> regex:%s", node, pattern);
 
-    regex = g_regex_new(pattern, G_REGEX_MULTILINE, 0, &error);
-    if (error != NULL) {
-        panic("g_regex_new: %s", error->message);
-        goto out;
+    shim_enableInterposition();
+
+    if (mapping == MAP_FAILED) {
+        warning("Unable to map hosts table '%s'; resolving names with a syscall instead", path);
+    } else if (!shimhoststable_isValid(mapping, st.st_size)) {
+        warning("Bad hosts table '%s'; resolving names with a syscall instead", path);
+        munmap(mapping, st.st_size);
+    } else {
+        table = mapping;
+        trace("Mapped hosts table '%s' with %u names", path, table->num_names);
     }
-    assert(regex != NULL);
 
-    g_regex_match(regex, hosts, 0, &match_info);
-    // /etc/host.conf specifies whether to return all matching addresses or only
-    // the first. The recommended configuration is to only return the first. For
-    // now we hard-code that behavior.
-    if (g_match_info_matches(match_info)) {
-#ifdef DEBUG
-        {
-            gchar* matched_string = g_match_info_fetch(match_info, 0);
-            trace("Node:%s -> match:%s", node, matched_string);
-            g_free(matched_string);
-        }
-#endif
-        gchar* address_string = g_match_info_fetch(match_info, 1);
-        trace("Node:%s -> address string:%s", node, address_string);
-        assert(address_string != NULL);
-        uint32_t addr;
-        int rv = inet_pton(AF_INET, address_string, &addr);
-        if (rv != 1) {
-            panic("Bad address in /etc/hosts: %s\n", address_string);
-        } else {
-            _getaddrinfo_appendv4(
-                head, tail, add_tcp, add_udp, add_raw, addr, port);
-        }
-        g_free(address_string);
-    }
-out:
-    if (match_info != NULL)
-        g_match_info_free(match_info);
-    if (regex != NULL)
-        g_regex_unref(regex);
-    if (pattern != NULL)
-        free(pattern);
-    if (hosts != NULL)
-        g_free(hosts);
+    return table;
+}
+
+// Looks up the IPv4 address of `node` in the hosts table that shadow
+// publishes. Returns true if we found the address, false otherwise.
+static bool _getaddrinfo_lookup_hosts_table_ipv4(const char* node, uint32_t* addr) {
+    ShimHostsTableHeader* table = _getaddrinfo_hosts_table();
+    if (table == NULL) {
+        return false;
+    }
+
+    if (shimhoststable_lookup(table, node, addr)) {
+        trace("Found name %s in hosts table", node);
+        return true;
+    } else {
+        trace("Name %s not found in hosts table", node);
+        return false;
+    }
 }
 
 // Ask shadow to provide an ipv4 addr for a node using a custom syscall.
@@ -450,16 +436,13 @@ int getaddrinfo(const char* node, const char* service,
         // TODO: look for IPv6 addresses in /etc/hosts.
     }
     if (add_ipv4) {
-        // Try a Shadow syscall first to avoid scanning the /etc/hosts file.
+        // The hosts table has the same names as shadow's /etc/hosts, and lets
+        // us skip both parsing that file and making a syscall. Shadow can
+        // still resolve names that were registered after it wrote the table.
         uint32_t addr;
-        if (_syscall_hostname_to_addr_ipv4(node, &addr)) {
+        if (_getaddrinfo_lookup_hosts_table_ipv4(node, &addr) ||
+            _syscall_hostname_to_addr_ipv4(node, &addr)) {
             _getaddrinfo_appendv4(res, &tail, add_tcp, add_udp, add_raw, addr, port);
-        } else {
-            // Fall back to scanning /etc/hosts.
-            warning("shadow_hostname_to_addr_ipv4 syscall failed for name %s, falling back to less "
-                    "efficient scan of '/etc/hosts' file.",
-                    node);
-            _getaddrinfo_add_matching_hosts_ipv4(res, &tail, node, add_tcp, add_udp, add_raw, port);
         }
     }
 
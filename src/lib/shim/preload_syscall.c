@@ -87,6 +87,31 @@ long shadow_real_raw_syscall(long n, ...) {
     return rv;
 }
 
+// Signals Shadow sent this process that we still need to raise in this thread,
+// with bit (signo - 1) set for each.
+static ShimTlsVar _pending_signals_var = {0};
+
+static uint64_t* _pending_signals() {
+    return shimtlsvar_ptr(&_pending_signals_var, sizeof(uint64_t));
+}
+
+// Raise the signals natively, now that we're back on the plugin's stack with
+// interposition enabled, so that the kernel applies the plugin's mask and
+// dispositions and its handlers run like any other plugin code.
+static void _raise_pending_signals() {
+    uint64_t* pending = _pending_signals();
+    if (!*pending) {
+        return;
+    }
+    long pid = shadow_real_raw_syscall(SYS_getpid);
+    long tid = shadow_real_raw_syscall(SYS_gettid);
+    while (*pending) {
+        int sig = __builtin_ctzll(*pending) + 1;
+        *pending &= *pending - 1;
+        shadow_real_raw_syscall(SYS_tgkill, pid, tid, sig);
+    }
+}
+
 // Only called from asm, so need to tell compiler not to discard.
 __attribute__((used)) static SysCallReg _shadow_raw_syscall_event(const ShimEvent* syscall_event) {
 
@@ -98,35 +123,27 @@ __attribute__((used)) static SysCallReg _shadow_raw_syscall_event(const ShimEven
     shimevent_sendEventToShadow(ipc, syscall_event);
     SysCallReg rv = {0};
 
-    // By default we assume Shadow will return quickly, and so should spin
-    // rather than letting the OS block this thread.
-    bool spin = true;
     while (true) {
         trace("waiting for event on %p", ipc);
         ShimEvent res = {0};
-        shimevent_recvEventFromShadow(ipc, &res, spin);
+        // By default we assume Shadow will return quickly, and so should spin
+        // rather than letting the OS block this thread. Shadow tells us to stop
+        // spinning if the syscall blocks.
+        shimevent_recvEventFromShadow(ipc, &res, /* spin= */ true);
         trace("got response of type %d on %p", res.event_id, ipc);
 
-        // Reset spin-flag to true. (May have been set to false by a SHD_SHIM_EVENT_BLOCK in the
-        // previous iteration)
-        spin = true;
         switch (res.event_id) {
-            case SHD_SHIM_EVENT_BLOCK: {
-                // Loop again, this time relinquishing the CPU while waiting for the next message.
-                spin = false;
-                // Ack the message.
-                shimevent_sendEventToShadow(ipc, &res);
-                break;
-            }
             case SHD_SHIM_EVENT_SYSCALL_COMPLETE: {
                 // Use provided result.
                 SysCallReg rv = res.event_data.syscall_complete.retval;
                 shim_syscall_set_simtime_nanos(res.event_data.syscall_complete.simulation_nanos);
+                *_pending_signals() |= res.event_data.syscall_complete.pending_signals;
                 return rv;
             }
             case SHD_SHIM_EVENT_SYSCALL_DO_NATIVE: {
                 // Make the original syscall ourselves and use the result.
                 SysCallReg rv = res.event_data.syscall_complete.retval;
+                *_pending_signals() |= res.event_data.syscall_complete.pending_signals;
                 const SysCallReg* regs = syscall_event->event_data.syscall.syscall_args.args;
                 rv.as_i64 = shadow_real_raw_syscall(
                     syscall_event->event_data.syscall.syscall_args.number, regs[0].as_u64,
@@ -161,8 +178,16 @@ __attribute__((used)) static SysCallReg _shadow_raw_syscall_event(const ShimEven
                 break;
             case SHD_SHIM_EVENT_ADD_THREAD_REQ: {
                 shim_newThreadStart(&res.event_data.add_thread_req.ipc_block);
+                // Make the clone in the same round trip, rather than waiting
+                // for Shadow to ask for it.
+                const SysCallArgs* clone_args = &res.event_data.add_thread_req.clone_args;
+                const SysCallReg* regs = clone_args->args;
+                long clone_rv = shadow_real_raw_syscall(
+                    clone_args->number, regs[0].as_u64, regs[1].as_u64, regs[2].as_u64,
+                    regs[3].as_u64, regs[4].as_u64, regs[5].as_u64);
                 shimevent_sendEventToShadow(ipc, &(ShimEvent){
-                    .event_id=SHD_SHIM_EVENT_ADD_THREAD_PARENT_RES,
+                    .event_id = SHD_SHIM_EVENT_SYSCALL_COMPLETE,
+                    .event_data.syscall_complete.retval.as_i64 = clone_rv,
                 });
                 break;
             }
@@ -223,6 +248,7 @@ static long _vshadow_raw_syscall(long n, va_list args) {
                  "rax", "rdi", "rdx", "rcx", "rsi", "r8", "r9", "r10", "r11");
 
     shim_enableInterposition();
+    _raise_pending_signals();
 
     return retval.as_i64;
 }
@@ -233,7 +259,11 @@ long shadow_vraw_syscall(long n, va_list args) {
 
     long rv;
 
-    if (shim_use_syscall_handler() && shim_syscall(n, &rv, args)) {
+    if (shim_isNativeSyscall(n)) {
+        // Shadow would only have told us to make it natively.
+        trace("Making syscall %ld natively, as Shadow asked.", n);
+        rv = shadow_vreal_raw_syscall(n, args);
+    } else if (shim_use_syscall_handler() && shim_syscall(n, &rv, args)) {
         // No inter-process syscall needed, we handled it on the shim side! :)
         trace("Handled syscall %ld from the shim; we avoided inter-process overhead.", n);
         // rv was already set
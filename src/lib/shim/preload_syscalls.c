@@ -118,6 +118,7 @@ INTERPOSE(readv);
 INTERPOSE(recvfrom);
 INTERPOSE(renameat);
 INTERPOSE(renameat2);
+INTERPOSE(select);
 INTERPOSE(sendto);
 INTERPOSE(setsockopt);
 INTERPOSE(set_robust_list);
@@ -6,6 +6,7 @@
 #include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <pthread.h>
+#include <sched.h>
 #include <search.h>
 #include <stdalign.h>
 #include <stddef.h>
@@ -15,6 +16,7 @@
 #include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -27,6 +29,9 @@
 #include "lib/shim/shim_logger.h"
 #include "lib/shim/shim_syscall.h"
 #include "lib/shim/shim_tls.h"
+#include "lib/shim/shim_vdso.h"
+#include "lib/shim/shim_zygote.h"
+#include "main/host/tsc.h"
 
 // Whether Shadow is using preload-based interposition.
 static bool _using_interpose_preload = false;
@@ -37,6 +42,16 @@ static bool _using_interpose_ptrace = false;
 // Whether Shadow is using the shim-side syscall handler optimization.
 static bool _using_shim_syscall_handler = true;
 
+// Whether Shadow asked us to let the kernel merge identical pages across processes.
+static bool _using_ksm = false;
+
+// The timestamp counter that rdtsc and rdtscp read, when the shim emulates them.
+static Tsc _shim_tsc = {0};
+
+// The syscalls that Shadow asked us to make natively, without asking it.
+static long _shim_native_syscalls[SHIM_NATIVE_SYSCALLS_MAX];
+static int _shim_num_native_syscalls = 0;
+
 // This thread's IPC block, for communication with Shadow.
 static ShMemBlock* _shim_ipcDataBlk() {
     static ShimTlsVar v = {0};
@@ -146,6 +161,15 @@ bool shim_interpositionEnabled() {
 
 bool shim_use_syscall_handler() { return _using_shim_syscall_handler; }
 
+bool shim_isNativeSyscall(long n) {
+    for (int i = 0; i < _shim_num_native_syscalls; i++) {
+        if (_shim_native_syscalls[i] == n) {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Figure out what interposition mechanism we're using, based on environment
 // variables.  This is called before disabling interposition, so should be
 // careful not to make syscalls.
@@ -187,6 +211,20 @@ static void _set_use_shim_syscall_handler() {
     }
 }
 
+static void _set_use_shmem_hugepages() {
+    const char* shmem_hugepages_str = getenv("SHADOW_USE_SHMEM_HUGEPAGES");
+    if (shmem_hugepages_str && !strcmp(shmem_hugepages_str, "TRUE")) {
+        shmemallocator_setUseHugePages(true);
+    }
+}
+
+static void _set_use_ksm() {
+    const char* ksm_str = getenv("SHADOW_USE_KSM");
+    if (ksm_str && !strcmp(ksm_str, "TRUE")) {
+        _using_ksm = true;
+    }
+}
+
 static void _shim_parent_init_logging() {
     // Set logger start time from environment variable.
     {
@@ -251,6 +289,46 @@ static void _shim_parent_init_death_signal() {
     _verify_parent_pid_or_exit();
 }
 
+// Makes the r13 syscalls in the ShimInjectedSyscall array at r12, storing each result,
+// then sets the flag at r14 and traps. Shadow points a stopped ptrace'd thread here
+// and restores its registers afterwards, so it's never called, and clobbers whatever
+// it likes.
+__attribute__((visibility("hidden"))) extern const char _shim_injected_syscalls_stub[];
+__asm__(".pushsection .text\n"
+        ".globl _shim_injected_syscalls_stub\n"
+        ".hidden _shim_injected_syscalls_stub\n"
+        "_shim_injected_syscalls_stub:\n"
+        "1:\n"
+        "    test %r13, %r13\n"
+        "    jz 2f\n"
+        "    mov (%r12), %rax\n"
+        "    mov 8(%r12), %rdi\n"
+        "    mov 16(%r12), %rsi\n"
+        "    mov 24(%r12), %rdx\n"
+        "    mov 32(%r12), %r10\n"
+        "    mov 40(%r12), %r8\n"
+        "    mov 48(%r12), %r9\n"
+        "    syscall\n"
+        "    mov %rax, 56(%r12)\n"
+        "    add $64, %r12\n"
+        "    dec %r13\n"
+        "    jmp 1b\n"
+        "2:\n"
+        "    movq $1, (%r14)\n"
+        "    int3\n"
+        ".popsection\n");
+_Static_assert(offsetof(ShimInjectedSyscall, args.number) == 0, "stub layout");
+_Static_assert(offsetof(ShimInjectedSyscall, args.args) == 8, "stub layout");
+_Static_assert(offsetof(ShimInjectedSyscall, retval) == 56, "stub layout");
+_Static_assert(sizeof(ShimInjectedSyscall) == 64, "stub layout");
+
+// Tells Shadow where to find the stub and this thread's shared memory.
+static void _shim_init_injected_syscalls() {
+    ShimSharedMem* shmem = _shim_shared_mem();
+    shmem->plugin_addr = (uintptr_t)shmem;
+    shmem->injected_syscalls_stub = (uintptr_t)_shim_injected_syscalls_stub;
+}
+
 static void _shim_parent_init_shm() {
     assert(_using_interpose_ptrace);
 
@@ -262,6 +340,7 @@ static void _shim_parent_init_shm() {
 
     *_shim_shared_mem_blk() = shmemserializer_globalBlockDeserialize(&shm_blk_serialized);
     assert(_shim_shared_mem());
+    _shim_init_injected_syscalls();
 }
 
 static void _shim_child_init_shm() {
@@ -277,6 +356,7 @@ static void _shim_child_init_shm() {
 
     *_shim_shared_mem_blk() = shmemserializer_globalBlockDeserialize(&shm_blk_serialized);
     assert(_shim_shared_mem());
+    _shim_init_injected_syscalls();
 }
 
 static void _shim_parent_init_ipc() {
@@ -346,6 +426,24 @@ static void _shim_ipc_wait_for_start_event() {
     shim_syscall_set_simtime_nanos(event.event_data.start.simulation_nanos);
 }
 
+// Linux 6.4 and later.
+#ifndef PR_SET_MEMORY_MERGE
+#define PR_SET_MEMORY_MERGE 67
+#endif
+
+// Marks all of the process's private memory, including what it maps later, as
+// mergeable. Regions that Shadow's MemoryManager has remapped into shared memory
+// aren't eligible, so it leaves large anonymous mappings private when KSM is used.
+static void _shim_parent_init_ksm() {
+    if (!_using_ksm) {
+        return;
+    }
+    if (prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0) != 0) {
+        // Shadow still marks large anonymous mappings mergeable as they're made.
+        warning("prctl(PR_SET_MEMORY_MERGE): %s", strerror(errno));
+    }
+}
+
 static void _shim_parent_init_hybrid() {
     shim_disableInterposition();
 
@@ -356,6 +454,7 @@ static void _shim_parent_init_hybrid() {
     _shim_parent_init_ipc();
     _shim_parent_init_death_signal();
     _shim_ipc_wait_for_start_event();
+    _shim_parent_init_ksm();
 
     shim_enableInterposition();
 }
@@ -424,6 +523,25 @@ static void _handle_sigsys(int sig, siginfo_t* info, void* voidUcontext) {
     ctx->uc_mcontext.gregs[REG_RAX] = rv;
 }
 
+static void _shim_parent_init_native_syscalls() {
+    const char* numbers = getenv("SHADOW_NATIVE_SYSCALLS");
+    if (numbers == NULL) {
+        return;
+    }
+
+    char* end = NULL;
+    while (*numbers) {
+        if (_shim_num_native_syscalls == SHIM_NATIVE_SYSCALLS_MAX) {
+            panic("Too many syscalls in SHADOW_NATIVE_SYSCALLS");
+        }
+        _shim_native_syscalls[_shim_num_native_syscalls++] = strtol(numbers, &end, 10);
+        if (end == numbers || (*end != ',' && *end != '\0')) {
+            panic("Bad SHADOW_NATIVE_SYSCALLS: %s", getenv("SHADOW_NATIVE_SYSCALLS"));
+        }
+        numbers = *end ? end + 1 : end;
+    }
+}
+
 static void _shim_parent_init_seccomp() {
     // Install signal sigsys signal handler, which will receive syscalls that
     // get stopped by the seccomp filter. Shadow's emulation of signal-related
@@ -472,7 +590,7 @@ static void _shim_parent_init_seccomp() {
      * The best reference I've been able to find is a BSD man page:
      * https://www.freebsd.org/cgi/man.cgi?query=bpf&sektion=4&manpath=FreeBSD+4.7-RELEASE
      */
-    struct sock_filter filter[] = {
+    struct sock_filter head[] = {
         /* accumulator := syscall number */
         BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)),
 
@@ -484,7 +602,21 @@ static void _shim_parent_init_seccomp() {
          * would just add unnecessary overhead.  */
         BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_sched_yield, /*true-skip=*/0, /*false-skip=*/1),
         BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),
+    };
+
+    /* Allow the syscalls that Shadow asked us to make natively. Each check
+     * jumps over the ones after it, and over the jump that skips the allow. */
+    const int n_native = _shim_num_native_syscalls;
+    struct sock_filter native[n_native + 2];
+    for (int i = 0; i < n_native; i++) {
+        native[i] = (struct sock_filter)BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,
+                                                 _shim_native_syscalls[i],
+                                                 /*true-skip=*/n_native - i, /*false-skip=*/0);
+    }
+    native[n_native] = (struct sock_filter)BPF_JUMP(BPF_JMP + BPF_JA, 1, 0, 0);
+    native[n_native + 1] = (struct sock_filter)BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW);
 
+    struct sock_filter tail[] = {
         /* See if instruction pointer is within the shadow_vreal_raw_syscall fn. */
         /* accumulator := instruction_pointer */
         BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, instruction_pointer)),
@@ -526,6 +658,14 @@ static void _shim_parent_init_seccomp() {
         /* Trap to our syscall handler */
         BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_TRAP),
     };
+
+    const size_t n_head = sizeof(head) / sizeof(head[0]);
+    const size_t n_tail = sizeof(tail) / sizeof(tail[0]);
+    struct sock_filter filter[n_head + n_native + 2 + n_tail];
+    memcpy(filter, head, sizeof(head));
+    memcpy(&filter[n_head], native, sizeof(native));
+    memcpy(&filter[n_head + n_native + 2], tail, sizeof(tail));
+
     struct sock_fprog prog = {
         .len = (unsigned short)(sizeof(filter) / sizeof(filter[0])),
         .filter = filter,
@@ -542,18 +682,175 @@ static void _shim_parent_init_seccomp() {
     }
 }
 
+// Waits until the orphaned process has been adopted by Shadow, which is a child
+// subreaper when it uses zygotes.
+static void _shim_zygote_child_wait_for_reparent() {
+    const char* shadow_pid_str = getenv("SHADOW_PID");
+    assert(shadow_pid_str);
+    unsigned long long shadow_pid = 0;
+    assert(sscanf(shadow_pid_str, "%llu", &shadow_pid) == 1);
+
+    while (getppid() != shadow_pid) {
+        sched_yield();
+    }
+}
+
+// Applies the per-process values that Shadow sent with the request.
+static void _shim_zygote_child_init(const ShimZygoteRequest* request) {
+    unsetenv(SHIM_ZYGOTE_FD_ENV_VAR);
+    setenv("SHADOW_IPC_BLK", request->ipc_blk, 1);
+    setenv("SHADOW_LOG_FILE", request->log_file, 1);
+    if (chdir(request->working_dir) < 0) {
+        abort();
+    }
+    _shim_zygote_child_wait_for_reparent();
+}
+
+// If Shadow started this process as a zygote, serves its fork requests until
+// Shadow closes the socket. Only returns in the new processes, which then finish
+// initializing as if Shadow had exec'd them.
+static void _shim_parent_init_zygote() {
+    const char* fd_str = getenv(SHIM_ZYGOTE_FD_ENV_VAR);
+    if (fd_str == NULL) {
+        return;
+    }
+    int fd = atoi(fd_str);
+
+    // The zygote is Shadow's child, so it can exit with Shadow. The new processes
+    // set their own death signal once they've been reparented.
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0) {
+        abort();
+    }
+
+    while (true) {
+        ShimZygoteRequest request;
+        ssize_t n = recv(fd, &request, sizeof(request), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n == 0) {
+            // Shadow won't start any more processes from us.
+            _exit(0);
+        } else if (n != sizeof(request)) {
+            _exit(1);
+        }
+
+        // Fork twice so that the new process is orphaned and adopted by Shadow.
+        // Shadow then owns it like any process it exec'd: getppid() returns
+        // Shadow's pid, and Shadow can waitpid() for it.
+        pid_t middle = fork();
+        if (middle < 0) {
+            ShimZygoteReply reply = {.pid = -1, .error = errno};
+            send(fd, &reply, sizeof(reply), 0);
+            continue;
+        } else if (middle > 0) {
+            while (waitpid(middle, NULL, 0) < 0 && errno == EINTR) {
+            }
+            continue;
+        }
+
+        pid_t child = fork();
+        if (child != 0) {
+            ShimZygoteReply reply = {.pid = child, .error = child < 0 ? errno : 0};
+            send(fd, &reply, sizeof(reply), 0);
+            _exit(0);
+        }
+
+        close(fd);
+        _shim_zygote_child_init(&request);
+        return;
+    }
+}
+
+static void _handle_sigsegv(int sig, siginfo_t* info, void* voidUcontext) {
+    ucontext_t* ctx = (ucontext_t*)(voidUcontext);
+    greg_t* regs = ctx->uc_mcontext.gregs;
+
+    // A disabled timestamp counter makes rdtsc and rdtscp raise a general
+    // protection fault, which the kernel reports as SI_KERNEL. Other faults may
+    // have an unreadable instruction pointer, so don't look at it for them.
+    if (info->si_code == SI_KERNEL) {
+        const uint8_t* insn = (const uint8_t*)regs[REG_RIP];
+        if (isRdtsc(insn) || isRdtscp(insn)) {
+            uint64_t cycles = Tsc_nanosToCycles(&_shim_tsc, shim_syscall_get_simtime_nanos());
+            regs[REG_RDX] = cycles >> 32;
+            regs[REG_RAX] = cycles & 0xffffffff;
+            if (isRdtsc(insn)) {
+                regs[REG_RIP] += 2;
+            } else {
+                // The processor ID, which we don't emulate.
+                regs[REG_RCX] = 0;
+                regs[REG_RIP] += 3;
+            }
+            return;
+        }
+    }
+
+    // Not ours. Restore the default action, so that the instruction faults
+    // again when we return and the process dies as it would have without us.
+    shim_disableInterposition();
+    if (sigaction(SIGSEGV, &(struct sigaction){.sa_handler = SIG_DFL}, NULL) < 0) {
+        abort();
+    }
+    shim_enableInterposition();
+}
+
+static void _shim_parent_init_rdtsc() {
+    const char* hz = getenv("SHADOW_TSC_HZ");
+    if (hz == NULL) {
+        return;
+    }
+    _shim_tsc.cyclesPerSecond = strtoull(hz, NULL, 10);
+
+    // Like SIGSYS, Shadow's emulation of signal-related system calls prevents
+    // the virtual process from overriding this action later.
+    struct sigaction old_action;
+    if (sigaction(SIGSEGV,
+                  &(struct sigaction){
+                      .sa_sigaction = _handle_sigsegv,
+                      // SA_NODEFER: A signal handler of the plugin's may read the
+                      // timestamp counter too.
+                      // SA_SIGINFO: Required because we're specifying sa_sigaction.
+                      .sa_flags = SA_NODEFER | SA_SIGINFO,
+                  },
+                  &old_action) < 0) {
+        panic("sigaction: %s", strerror(errno));
+    }
+    if (old_action.sa_handler || old_action.sa_sigaction) {
+        warning("Overwrite handler for SIGSEGV (%p)", old_action.sa_handler
+                                                          ? (void*)old_action.sa_handler
+                                                          : (void*)old_action.sa_sigaction);
+    }
+
+    // Make rdtsc and rdtscp fault, so that the handler above can return
+    // simulated time instead of the host's counter. Threads and child processes
+    // inherit this.
+    if (prctl(PR_SET_TSC, PR_TSC_SIGSEGV, 0, 0, 0)) {
+        panic("prctl: %s", strerror(errno));
+    }
+}
+
 static void _shim_parent_init_preload() {
     shim_disableInterposition();
 
+    // Zygotes stop here, before anything that is specific to one process.
+    _shim_parent_init_zygote();
+
     // The shim logger internally disables interposition while logging, so we open the log
     // file with interposition disabled too to get a native file descriptor.
     _shim_parent_init_logging();
     _shim_parent_init_ipc();
     _shim_parent_init_death_signal();
     _shim_ipc_wait_for_start_event();
+    _shim_parent_init_ksm();
+    // The seccomp filter lets these through, so we need them first.
+    _shim_parent_init_native_syscalls();
     if (getenv("SHADOW_USE_SECCOMP") != NULL) {
         _shim_parent_init_seccomp();
     }
+    _shim_parent_init_rdtsc();
+    if (getenv("SHADOW_PATCH_VDSO") != NULL) {
+        shim_patch_vdso();
+    }
 
     shim_enableInterposition();
 }
@@ -600,6 +897,8 @@ __attribute__((constructor)) void _shim_load() {
         did_global_pre_init = true;
         _set_interpose_type();
         _set_use_shim_syscall_handler();
+        _set_use_shmem_hugepages();
+        _set_use_ksm();
     }
 
     // Now we can use thread-local storage.
@@ -663,6 +962,8 @@ __attribute__((destructor)) static void _shim_unload() {
     // this process to die and won't listen to the shim pipe anymore.
 }
 
+ShimSharedMem* shim_get_shared_mem() { return _shim_shared_mem(); }
+
 struct timespec* shim_get_shared_time_location() {
     if (_shim_shared_mem() == NULL) {
         return NULL;
@@ -10,8 +10,12 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include "lib/shim/shim_event.h"
 #include "main/shmem/shmem_allocator.h"
 
+// The most syscalls that Shadow may ask the shim to make natively.
+#define SHIM_NATIVE_SYSCALLS_MAX 64
+
 // Should be called by all syscall wrappers to ensure the shim is initialized.
 void shim_ensure_init();
 
@@ -33,12 +37,18 @@ bool shim_interpositionEnabled();
 // Whether we are using the shim-side syscall handler.
 bool shim_use_syscall_handler();
 
+// Whether Shadow asked for syscall `n` to be made natively, without asking it.
+bool shim_isNativeSyscall(long n);
+
 // Returns the shmem block used for IPC, which may be uninitialized.
 struct IPCData* shim_thisThreadEventIPC();
 
 // Return the location of the time object in shared memory, or NULL if unavailable.
 struct timespec* shim_get_shared_time_location();
 
+// Return the state that this thread shares with Shadow, or NULL if unavailable.
+ShimSharedMem* shim_get_shared_mem();
+
 // To be called in parent thread before making the `clone` syscall.
 // It sets up data for the new thread.
 void shim_newThreadStart(ShMemBlockSerialized* block);
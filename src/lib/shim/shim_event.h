@@ -6,11 +6,40 @@
 
 #include <arpa/inet.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
 #include <time.h>
 
 #include "main/host/syscall_types.h"
 #include "main/shmem/shmem_allocator.h"
 
+// The number of random bytes that Shadow keeps available to the shim.
+#define SHIM_SHARED_RANDOM_BYTES 1024
+
+// The number of log lines that the shim can buffer for Shadow between syscalls.
+#define SHIM_SHARED_LOG_RECORDS 32
+
+// A log line from the shim. Shadow logs it with its own logger, so that it gets
+// the thread's simulated time and is ordered with Shadow's lines.
+typedef struct _ShimLogRecord {
+    // A LogLevel. This header is also used from C++, which can't use log_level.h.
+    int level;
+    int lineNumber;
+    char fileName[32];
+    char functionName[64];
+    char message[200];
+} ShimLogRecord;
+
+// The most syscalls that Shadow can have a ptrace'd thread make with one stop.
+#define SHIM_INJECTED_SYSCALLS_MAX 64
+
+// A syscall that Shadow has a ptrace'd thread make natively, and its result. The shim's
+// stub depends on this layout.
+typedef struct _ShimInjectedSyscall {
+    SysCallArgs args;
+    SysCallReg retval;
+} ShimInjectedSyscall;
+
 // Shared state between Shadow and a plugin-thread. The shim-side code can modify
 // directly; synchronization is achieved via the Shadow/Plugin IPC mechanisms
 // (ptrace-stops and the shim IPC locking).
@@ -19,6 +48,34 @@ typedef struct _ShimSharedMem {
     bool ptrace_allow_native_syscalls;
     // Store the latest simulation time to avoid inter-process time syscalls.
     struct timespec sim_time;
+
+    // Process and thread state that never changes while the thread runs, so the
+    // shim can service getpid, getppid, gettid, and uname on its own.
+    pid_t pid;
+    pid_t ppid;
+    pid_t tid;
+    struct utsname utsname;
+
+    // Bytes from the host's deterministic random source for getrandom. The shim
+    // consumes bytes starting at random_pos, and Shadow refills the buffer
+    // before it resumes the thread.
+    size_t random_pos;
+    unsigned char random_bytes[SHIM_SHARED_RANDOM_BYTES];
+
+    // Log lines that the shim appended since Shadow last had control. Shadow logs
+    // and clears them when it handles the thread's next syscall.
+    size_t log_len;
+    ShimLogRecord log_records[SHIM_SHARED_LOG_RECORDS];
+
+    // The address of the shim's stub that makes the syscalls in injected_syscalls and then
+    // traps, and of this struct in the plugin, or 0 until the shim has set them. Shadow
+    // points a stopped ptrace'd thread at the stub to make native syscalls, instead of
+    // single-stepping a syscall instruction for each. The stub sets injected_syscalls_done
+    // just before it traps.
+    uintptr_t injected_syscalls_stub;
+    uintptr_t plugin_addr;
+    uint64_t injected_syscalls_done;
+    ShimInjectedSyscall injected_syscalls[SHIM_INJECTED_SYSCALLS_MAX];
 } ShimSharedMem;
 
 // Returns 0 on success. Non-zero and sets errno on failure.
@@ -47,9 +104,8 @@ typedef enum {
     SHD_SHIM_EVENT_CLONE_STRING_REQ = 9,
     SHD_SHIM_EVENT_SHMEM_COMPLETE = 6,
     SHD_SHIM_EVENT_WRITE_REQ = 7,
-    SHD_SHIM_EVENT_BLOCK = 10,
+    // Replied to with SHD_SHIM_EVENT_SYSCALL_COMPLETE, with the result of the clone.
     SHD_SHIM_EVENT_ADD_THREAD_REQ = 11,
-    SHD_SHIM_EVENT_ADD_THREAD_PARENT_RES = 12,
 } ShimEventID;
 
 typedef struct _ShimEvent {
@@ -78,6 +134,9 @@ typedef struct _ShimEvent {
             SysCallReg retval;
             // Update shim-side simulation clock
             uint64_t simulation_nanos;
+            // Signals for the shim to raise once the syscall returns, with
+            // bit (signo - 1) set for each. Also set for DO_NATIVE.
+            uint64_t pending_signals;
         } syscall_complete;
 
         struct {
@@ -87,7 +146,11 @@ typedef struct _ShimEvent {
         } shmem_blk;
 
         struct {
+            // For the new thread to use.
             ShMemBlockSerialized ipc_block;
+            // The clone syscall that creates the thread, which the shim makes
+            // as soon as it has set up the block.
+            SysCallArgs clone_args;
         } add_thread_req;
     } event_data;
 
@@ -0,0 +1,111 @@
+#ifndef SHD_SHIM_SHIM_HOSTS_TABLE_H_
+#define SHD_SHIM_SHIM_HOSTS_TABLE_H_
+
+// A read-only table of host names and their IPv4 addresses, which Shadow
+// writes to a file and the shim maps into memory to resolve names without
+// parsing /etc/hosts or making a syscall. This is a header-only library used
+// in both places.
+//
+// The file is laid out as:
+//
+//   ShimHostsTableHeader
+//   ShimHostsTableEntry[num_buckets]   open addressing with linear probing
+//   char[names_size]                   NUL-terminated names
+//
+// num_buckets is a power of two, and at least twice the number of names so
+// that probe sequences stay short. A bucket with a name_offset of 0 is empty;
+// the names always start with an unused NUL byte so that no name is at 0.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SHIM_HOSTS_TABLE_MAGIC 0x4c42545354534853ULL // "SHSTSTBL"
+#define SHIM_HOSTS_TABLE_VERSION 1
+
+typedef struct _ShimHostsTableHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_buckets;
+    uint32_t num_names;
+    uint32_t names_size;
+} ShimHostsTableHeader;
+
+typedef struct _ShimHostsTableEntry {
+    uint32_t hash;
+    // Offset of the name from the start of the names.
+    uint32_t name_offset;
+    uint32_t name_len;
+    // The address in network byte order.
+    uint32_t addr;
+} ShimHostsTableEntry;
+
+// FNV-1a, which is cheap and good enough for host names.
+static inline uint32_t shimhoststable_hash(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// The size of a table with the given number of buckets and size of names.
+static inline size_t shimhoststable_size(uint32_t num_buckets, uint32_t names_size) {
+    return sizeof(ShimHostsTableHeader) + num_buckets * sizeof(ShimHostsTableEntry) + names_size;
+}
+
+static inline ShimHostsTableEntry* shimhoststable_buckets(ShimHostsTableHeader* table) {
+    return (ShimHostsTableEntry*)(table + 1);
+}
+
+static inline char* shimhoststable_names(ShimHostsTableHeader* table) {
+    return (char*)(shimhoststable_buckets(table) + table->num_buckets);
+}
+
+// Whether the `size` bytes at `table` look like a table that we can index.
+static inline bool shimhoststable_isValid(const ShimHostsTableHeader* table, size_t size) {
+    return size >= sizeof(*table) && table->magic == SHIM_HOSTS_TABLE_MAGIC &&
+           table->version == SHIM_HOSTS_TABLE_VERSION && table->num_buckets > 0 &&
+           (table->num_buckets & (table->num_buckets - 1)) == 0 &&
+           table->num_names < table->num_buckets && table->names_size > 0 &&
+           size >= shimhoststable_size(table->num_buckets, table->names_size);
+}
+
+// Returns the bucket that holds `name`, or the empty bucket where it belongs
+// if it isn't in the table.
+static inline ShimHostsTableEntry* shimhoststable_find(ShimHostsTableHeader* table,
+                                                       const char* name, size_t len,
+                                                       uint32_t hash) {
+    ShimHostsTableEntry* buckets = shimhoststable_buckets(table);
+    const char* names = shimhoststable_names(table);
+    uint32_t mask = table->num_buckets - 1;
+
+    // there's always an empty bucket, so this terminates
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        ShimHostsTableEntry* entry = &buckets[i];
+        if (entry->name_offset == 0 ||
+            (entry->hash == hash && entry->name_len == len &&
+             entry->name_offset + len < table->names_size &&
+             memcmp(&names[entry->name_offset], name, len) == 0)) {
+            return entry;
+        }
+    }
+}
+
+// Looks up the IPv4 address of `name`. Returns true and sets `addr` (in
+// network byte order) if found.
+static inline bool shimhoststable_lookup(ShimHostsTableHeader* table, const char* name,
+                                         uint32_t* addr) {
+    size_t len = strlen(name);
+    ShimHostsTableEntry* entry =
+        shimhoststable_find(table, name, len, shimhoststable_hash(name, len));
+    if (entry->name_offset == 0) {
+        return false;
+    }
+    *addr = entry->addr;
+    return true;
+}
+
+#endif // SHD_SHIM_SHIM_HOSTS_TABLE_H_
@@ -32,26 +32,24 @@ static size_t _simulation_nanos_string(char* dst, size_t size) {
         dst, size, "%02d:%02d:%02d.%09" PRIu64, tm.tm_hour, tm.tm_min, tm.tm_sec, nanos);
 }
 
-void shimlogger_log(Logger* base, LogLevel level, const char* fileName, const char* functionName,
-                    const int lineNumber, const char* format, va_list vargs) {
-    if (!logger_isEnabled(base, level)) {
-        return;
-    }
-
-    static ShimTlsVar in_logger_var = {0};
-    bool* in_logger = shimtlsvar_ptr(&in_logger_var, sizeof(*in_logger));
+// Appends the line to the thread's buffer in ShimSharedMem, which must have room for it.
+static void _shimlogger_appendShared(ShimSharedMem* shmem, LogLevel level, const char* fileName,
+                                     const char* functionName, const int lineNumber,
+                                     const char* format, va_list vargs) {
+    ShimLogRecord* record = &shmem->log_records[shmem->log_len++];
+    record->level = level;
+    record->lineNumber = lineNumber;
+    snprintf(record->fileName, sizeof(record->fileName), "%s", logger_base_name(fileName));
+    snprintf(record->functionName, sizeof(record->functionName), "%s", functionName);
+    vsnprintf(record->message, sizeof(record->message), format, vargs);
+}
 
+static void _shimlogger_write(ShimLogger* logger, LogLevel level, const char* fileName,
+                              const char* functionName, const int lineNumber, const char* format,
+                              va_list vargs) {
     // Stack-allocated to avoid dynamic allocation.
     char buf[200];
     size_t offset = 0;
-    if (*in_logger) {
-        // Avoid recursion in logging around syscall handling.
-        return;
-    }
-    *in_logger = true;
-    shim_disableInterposition();
-
-    ShimLogger* logger = (ShimLogger*)base;
 
     // Keep appending to string. These functions all ensure NULL-byte termination.
 
@@ -86,6 +84,37 @@ void shimlogger_log(Logger* base, LogLevel level, const char* fileName, const ch
     if (logger->level == LOGLEVEL_TRACE || level == LOGLEVEL_ERROR) {
         fflush_unlocked(logger->file);
     }
+}
+
+void shimlogger_log(Logger* base, LogLevel level, const char* fileName, const char* functionName,
+                    const int lineNumber, const char* format, va_list vargs) {
+    if (!logger_isEnabled(base, level)) {
+        return;
+    }
+
+    static ShimTlsVar in_logger_var = {0};
+    bool* in_logger = shimtlsvar_ptr(&in_logger_var, sizeof(*in_logger));
+
+    if (*in_logger) {
+        // Avoid recursion in logging around syscall handling.
+        return;
+    }
+    *in_logger = true;
+    shim_disableInterposition();
+
+    ShimLogger* logger = (ShimLogger*)base;
+
+    // If Shadow shares memory with this thread, leave the line there for Shadow to log
+    // when it handles our next syscall, which saves a native write and keeps the line in
+    // order with Shadow's own. Errors are still written directly, since we may abort
+    // before Shadow gets control again.
+    ShimSharedMem* shmem = shim_get_shared_mem();
+    if (level != LOGLEVEL_ERROR && shmem && shmem->log_len < SHIM_SHARED_LOG_RECORDS) {
+        _shimlogger_appendShared(shmem, level, fileName, functionName, lineNumber, format, vargs);
+    } else {
+        _shimlogger_write(logger, level, fileName, functionName, lineNumber, format, vargs);
+    }
+
     shim_enableInterposition();
     *in_logger = false;
 }
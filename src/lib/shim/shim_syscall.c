@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <time.h>
@@ -123,6 +124,72 @@ bool shim_syscall(long syscall_num, long* rv, va_list args) {
             break;
         }
 
+        case SYS_getpid:
+        case SYS_getppid:
+        case SYS_gettid: {
+            ShimSharedMem* shmem = shim_get_shared_mem();
+            if (!shmem) {
+                return false;
+            }
+
+            trace("servicing syscall %ld from the shim", syscall_num);
+
+            if (syscall_num == SYS_getpid) {
+                *rv = shmem->pid;
+            } else if (syscall_num == SYS_getppid) {
+                *rv = shmem->ppid;
+            } else {
+                *rv = shmem->tid;
+            }
+
+            break;
+        }
+
+        case SYS_uname: {
+            ShimSharedMem* shmem = shim_get_shared_mem();
+            if (!shmem) {
+                return false;
+            }
+
+            trace("servicing syscall %ld:uname from the shim", syscall_num);
+
+            struct utsname* buf = va_arg(args, struct utsname*);
+
+            if (buf) {
+                *buf = shmem->utsname;
+                *rv = 0;
+            } else {
+                *rv = -EFAULT;
+            }
+
+            break;
+        }
+
+        case SYS_getrandom: {
+            ShimSharedMem* shmem = shim_get_shared_mem();
+            if (!shmem) {
+                return false;
+            }
+
+            void* buf = va_arg(args, void*);
+            size_t count = va_arg(args, size_t);
+
+            // Let Shadow handle requests that we don't have enough bytes for, and
+            // invalid buffers so that it reports the error.
+            size_t available = SHIM_SHARED_RANDOM_BYTES - shmem->random_pos;
+            if (!buf || count > available) {
+                return false;
+            }
+
+            trace("servicing syscall %ld:getrandom from the shim", syscall_num);
+
+            memcpy(buf, &shmem->random_bytes[shmem->random_pos], count);
+            shmem->random_pos += count;
+            *rv = (long)count;
+
+            break;
+        }
+
         default: {
             // the syscall was not handled
             return false;
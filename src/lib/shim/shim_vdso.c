@@ -0,0 +1,179 @@
+#include "lib/shim/shim_vdso.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/logger/logger.h"
+#include "lib/shim/preload_syscall.h"
+
+// `movabs $target, %rax; jmp *%rax`. rax is caller-saved, and the functions we
+// overwrite take their arguments in rdi and rsi.
+#define SHIM_VDSO_JUMP_LEN 12
+
+// The replacements return what the vDSO functions would: the raw syscall
+// result, with errors as negative errno values rather than in errno.
+
+static long _shim_vdso_clock_gettime(clockid_t clk_id, struct timespec* tp) {
+    return shadow_raw_syscall(SYS_clock_gettime, clk_id, tp);
+}
+
+static long _shim_vdso_gettimeofday(struct timeval* tv, struct timezone* tz) {
+    return shadow_raw_syscall(SYS_gettimeofday, tv, tz);
+}
+
+static long _shim_vdso_time(time_t* t) { return shadow_raw_syscall(SYS_time, t); }
+
+typedef struct _ShimVdsoPatch {
+    const char* name;
+    void* target;
+} ShimVdsoPatch;
+
+static const ShimVdsoPatch _shim_vdso_patches[] = {
+    {"__vdso_clock_gettime", _shim_vdso_clock_gettime},
+    {"__vdso_gettimeofday", _shim_vdso_gettimeofday},
+    {"__vdso_time", _shim_vdso_time},
+};
+
+typedef struct _ShimVdsoSymbols {
+    const Elf64_Sym* symtab;
+    Elf32_Word nsyms;
+    uintptr_t load_offset;
+} ShimVdsoSymbols;
+
+// Returns where the code at `fn` ends up if it starts with an unconditional
+// jump, as the vDSO's exported functions may be stubs that jump to the real
+// implementation, or NULL if it doesn't.
+static uint8_t* _shim_vdso_jump_target(uint8_t* fn) {
+    if (fn[0] == 0xe9) {
+        int32_t rel;
+        memcpy(&rel, &fn[1], sizeof(rel));
+        return fn + 5 + rel;
+    } else if (fn[0] == 0xeb) {
+        return fn + 2 + (int8_t)fn[1];
+    }
+    return NULL;
+}
+
+// Returns the size of the vDSO function that starts at `fn`, or 0 if no
+// symbol says where it ends.
+static size_t _shim_vdso_function_size(const ShimVdsoSymbols* syms, const uint8_t* fn) {
+    for (Elf32_Word i = 0; i < syms->nsyms; i++) {
+        const Elf64_Sym* sym = &syms->symtab[i];
+        if (ELF64_ST_TYPE(sym->st_info) == STT_FUNC && sym->st_shndx != SHN_UNDEF &&
+            (const uint8_t*)(sym->st_value + syms->load_offset) == fn) {
+            return sym->st_size;
+        }
+    }
+    return 0;
+}
+
+static void _shim_vdso_patch_function(int mem_fd, const ShimVdsoSymbols* syms, const char* name,
+                                      uint8_t* fn, size_t size, void* target) {
+    // A stub too small for our jump can be followed to the code it jumps to,
+    // as long as that's a function whose size we know, so that we don't
+    // overwrite whatever follows it.
+    uint8_t* jump_target;
+    if (size < SHIM_VDSO_JUMP_LEN && (jump_target = _shim_vdso_jump_target(fn))) {
+        size = _shim_vdso_function_size(syms, jump_target);
+        if (size == 0) {
+            warning("vDSO function %s jumps to code of unknown size; not patching it", name);
+            return;
+        }
+        fn = jump_target;
+    }
+    if (size < SHIM_VDSO_JUMP_LEN) {
+        warning("vDSO function %s is only %zu bytes; not patching it", name, size);
+        return;
+    }
+
+    uint8_t jump[SHIM_VDSO_JUMP_LEN] = {0x48, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xe0};
+    uint64_t addr = (uint64_t)target;
+    memcpy(&jump[2], &addr, sizeof(addr));
+
+    // Recent kernels don't let the vDSO be made writable with mprotect, but
+    // like a debugger we can still write through /proc/self/mem. The vDSO is a
+    // private mapping, so this makes a copy of the page that only this process
+    // sees.
+    if (pwrite(mem_fd, jump, sizeof(jump), (off_t)(uintptr_t)fn) != sizeof(jump)) {
+        warning("Writing to vDSO function %s: %s", name, strerror(errno));
+        return;
+    }
+    trace("Patched vDSO function %s at %p", name, fn);
+}
+
+void shim_patch_vdso() {
+    const uint8_t* base = (const uint8_t*)getauxval(AT_SYSINFO_EHDR);
+    if (!base) {
+        trace("No vDSO to patch");
+        return;
+    }
+
+    // Find where the vDSO was loaded relative to its link addresses, and its
+    // dynamic section. See the kernel's tools/testing/selftests/vDSO/parse_vdso.c.
+    const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)base;
+    const Elf64_Phdr* phdrs = (const Elf64_Phdr*)(base + ehdr->e_phoff);
+    uintptr_t load_offset = 0;
+    bool found_load = false;
+    const Elf64_Dyn* dyn = NULL;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && !found_load) {
+            load_offset = (uintptr_t)base + phdrs[i].p_offset - phdrs[i].p_vaddr;
+            found_load = true;
+        } else if (phdrs[i].p_type == PT_DYNAMIC) {
+            dyn = (const Elf64_Dyn*)(base + phdrs[i].p_offset);
+        }
+    }
+    if (!found_load || !dyn) {
+        warning("Couldn't find the vDSO's dynamic section; not patching it");
+        return;
+    }
+
+    const Elf64_Sym* symtab = NULL;
+    const char* strtab = NULL;
+    const Elf32_Word* hash = NULL;
+    for (; dyn->d_tag != DT_NULL; dyn++) {
+        switch (dyn->d_tag) {
+            case DT_SYMTAB: symtab = (const Elf64_Sym*)(dyn->d_un.d_ptr + load_offset); break;
+            case DT_STRTAB: strtab = (const char*)(dyn->d_un.d_ptr + load_offset); break;
+            case DT_HASH: hash = (const Elf32_Word*)(dyn->d_un.d_ptr + load_offset); break;
+        }
+    }
+    if (!symtab || !strtab || !hash) {
+        warning("Couldn't find the vDSO's symbol table; not patching it");
+        return;
+    }
+
+    int mem_fd = open("/proc/self/mem", O_RDWR | O_CLOEXEC);
+    if (mem_fd < 0) {
+        warning("open /proc/self/mem: %s; not patching the vDSO", strerror(errno));
+        return;
+    }
+
+    // The second word of the hash table is the number of symbols.
+    ShimVdsoSymbols syms = {.symtab = symtab, .nsyms = hash[1], .load_offset = load_offset};
+    for (Elf32_Word i = 0; i < syms.nsyms; i++) {
+        const Elf64_Sym* sym = &symtab[i];
+        if (ELF64_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_shndx == SHN_UNDEF) {
+            continue;
+        }
+        const char* name = strtab + sym->st_name;
+        for (size_t j = 0; j < sizeof(_shim_vdso_patches) / sizeof(_shim_vdso_patches[0]); j++) {
+            if (!strcmp(name, _shim_vdso_patches[j].name)) {
+                _shim_vdso_patch_function(mem_fd, &syms, name,
+                                          (uint8_t*)(sym->st_value + load_offset),
+                                          sym->st_size, _shim_vdso_patches[j].target);
+            }
+        }
+    }
+    close(mem_fd);
+}
@@ -0,0 +1,10 @@
+#ifndef SHD_SHIM_SHIM_VDSO_H_
+#define SHD_SHIM_SHIM_VDSO_H_
+
+// Overwrites the entries of the vDSO's clock_gettime, gettimeofday, and time
+// with jumps to the shim's own syscall path, so that programs that call the
+// vDSO directly rather than through libc still get simulated time. Must be
+// called while interposition is disabled, since it makes native syscalls.
+void shim_patch_vdso();
+
+#endif // SHD_SHIM_SHIM_VDSO_H_
@@ -0,0 +1,33 @@
+#ifndef SHD_SHIM_SHIM_ZYGOTE_H_
+#define SHD_SHIM_SHIM_ZYGOTE_H_
+
+// Communication between Shadow and a zygote: a plugin process that stops in the
+// shim's constructor, after the dynamic loader has loaded and relocated its
+// libraries, and forks a new process for each request it receives. This is a
+// header-only library used in both places.
+
+#include <limits.h>
+#include <sys/types.h>
+
+#include "main/shmem/shmem_allocator.h"
+
+// Names the zygote's end of its SOCK_SEQPACKET socket with Shadow.
+#define SHIM_ZYGOTE_FD_ENV_VAR "SHADOW_ZYGOTE_FD"
+
+// Sent by Shadow for each new process. The strings are NUL terminated, and
+// replace the per-process environment variables that the zygote was started
+// without.
+typedef struct _ShimZygoteRequest {
+    char ipc_blk[SHD_SHMEM_BLOCK_SERIALIZED_MAX_STRLEN];
+    char log_file[PATH_MAX];
+    char working_dir[PATH_MAX];
+} ShimZygoteRequest;
+
+// Sent back for each request. On success `pid` is the new process, which has
+// been reparented to Shadow. On failure `pid` is -1 and `error` is the errno.
+typedef struct _ShimZygoteReply {
+    pid_t pid;
+    int error;
+} ShimZygoteReply;
+
+#endif // SHD_SHIM_SHIM_ZYGOTE_H_
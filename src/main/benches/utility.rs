@@ -0,0 +1,205 @@
+//! Benchmarks for the data structures on Shadow's hot paths, with operation mixes
+//! like the ones plugins cause. Run with `cargo bench` from `src/main`; criterion
+//! saves each run's results and reports the change from the previous run.
+
+use std::sync::Arc;
+
+use atomic_refcell::AtomicRefCell;
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use rand::{Rng, SeedableRng};
+use rand_chacha::ChaCha8Rng;
+
+use shadow_rs::host::descriptor::descriptor_table::DescriptorTable;
+use shadow_rs::host::descriptor::pipe::{PipeFile, SharedBuf};
+use shadow_rs::host::descriptor::{CompatDescriptor, Descriptor, FileFlags, FileMode, PosixFile};
+use shadow_rs::utility::byte_queue::ByteQueue;
+use shadow_rs::utility::counter::Counter;
+use shadow_rs::utility::interval_map::IntervalMap;
+
+/// The size of the writes and reads of a program streaming through a pipe.
+const PIPE_CHUNK: usize = 8 * 1024;
+/// The size of a pipe's buffer in Linux, and so the most a writer gets ahead.
+const PIPE_CAPACITY: usize = 64 * 1024;
+
+fn byte_queue(c: &mut Criterion) {
+    let mut group = c.benchmark_group("byte_queue");
+    group.throughput(Throughput::Bytes(PIPE_CAPACITY as u64));
+
+    // fill the pipe, then drain it, one chunk at a time
+    group.bench_function("pipe_stream_8k", |b| {
+        let mut queue = ByteQueue::new(8192);
+        let src = vec![1u8; PIPE_CHUNK];
+        let mut dst = vec![0u8; PIPE_CHUNK];
+        b.iter(|| {
+            for _ in 0..PIPE_CAPACITY / PIPE_CHUNK {
+                queue.push(&src[..]).unwrap();
+            }
+            for _ in 0..PIPE_CAPACITY / PIPE_CHUNK {
+                queue.pop(&mut dst[..]).unwrap();
+            }
+            black_box(&dst);
+        })
+    });
+
+    // a reader that keeps up with the writer, so the queue stays short
+    group.bench_function("pipe_interleaved_8k", |b| {
+        let mut queue = ByteQueue::new(8192);
+        let src = vec![1u8; PIPE_CHUNK];
+        let mut dst = vec![0u8; PIPE_CHUNK];
+        b.iter(|| {
+            for _ in 0..PIPE_CAPACITY / PIPE_CHUNK {
+                queue.push(&src[..]).unwrap();
+                queue.pop(&mut dst[..]).unwrap();
+            }
+            black_box(&dst);
+        })
+    });
+
+    group.finish();
+}
+
+/// The mmap and munmap calls of glibc's malloc: mostly small arenas and
+/// large allocations that come and go, at page-aligned addresses in a region
+/// that is reused once they're freed.
+fn interval_map(c: &mut Criterion) {
+    const PAGE: usize = 4096;
+    const REGION_PAGES: usize = 1 << 16;
+    const OPS: usize = 1000;
+
+    let mut group = c.benchmark_group("interval_map");
+    group.throughput(Throughput::Elements(OPS as u64));
+
+    group.bench_function("mmap_munmap_churn", |b| {
+        let mut rng = ChaCha8Rng::seed_from_u64(1);
+        let mut map = IntervalMap::<u32>::new();
+        let mut live: Vec<std::ops::Range<usize>> = Vec::new();
+        b.iter(|| {
+            for i in 0..OPS {
+                if live.len() < 256 && (live.is_empty() || rng.gen_bool(0.5)) {
+                    // 1 to 64 pages, like malloc's mmap threshold and above
+                    let pages = rng.gen_range(1..=64);
+                    let start = rng.gen_range(0..REGION_PAGES - pages) * PAGE;
+                    let interval = start..start + pages * PAGE;
+                    black_box(map.insert(interval.clone(), i as u32));
+                    live.push(interval);
+                } else {
+                    let interval = live.swap_remove(rng.gen_range(0..live.len()));
+                    black_box(map.clear(interval));
+                }
+            }
+        })
+    });
+
+    group.bench_function("lookup", |b| {
+        let mut rng = ChaCha8Rng::seed_from_u64(2);
+        let mut map = IntervalMap::<u32>::new();
+        for i in 0..1000 {
+            let start = i * 16 * PAGE;
+            map.insert(start..start + 8 * PAGE, i as u32);
+        }
+        b.iter(|| {
+            for _ in 0..OPS {
+                black_box(map.get(rng.gen_range(0..1000 * 16 * PAGE)));
+            }
+        })
+    });
+
+    group.finish();
+}
+
+fn new_pipe_descriptor() -> CompatDescriptor {
+    let buffer = Arc::new(AtomicRefCell::new(SharedBuf::new()));
+    let file = PipeFile::new(buffer, FileMode::READ, FileFlags::empty());
+    CompatDescriptor::New(Descriptor::new(Arc::new(AtomicRefCell::new(
+        PosixFile::Pipe(file),
+    ))))
+}
+
+/// A server with many open connections that closes some and accepts others,
+/// so new descriptors reuse the lowest free index.
+fn descriptor_table(c: &mut Criterion) {
+    const OPEN: u32 = 4096;
+    const OPS: usize = 1000;
+
+    let mut group = c.benchmark_group("descriptor_table");
+    group.throughput(Throughput::Elements(OPS as u64));
+
+    group.bench_function("open_close_churn", |b| {
+        let mut rng = ChaCha8Rng::seed_from_u64(3);
+        let mut table = DescriptorTable::new();
+        for _ in 0..OPEN {
+            table.add(new_pipe_descriptor());
+        }
+        b.iter(|| {
+            for _ in 0..OPS {
+                let idx = rng.gen_range(0..OPEN);
+                let descriptor = table.remove(idx).unwrap();
+                black_box(table.add(descriptor));
+            }
+        })
+    });
+
+    group.bench_function("open_close_new", |b| {
+        b.iter_batched(
+            DescriptorTable::new,
+            |mut table| {
+                for _ in 0..OPS {
+                    let idx = table.add(new_pipe_descriptor());
+                    if idx % 4 == 3 {
+                        table.remove(idx - 1);
+                    }
+                }
+                table
+            },
+            BatchSize::SmallInput,
+        )
+    });
+
+    group.finish();
+}
+
+/// The syscall counters: a hit on one of a few dozen names for every syscall,
+/// and merging each host's counter into the total at the end.
+fn counter(c: &mut Criterion) {
+    const NAMES: [&str; 8] = [
+        "read",
+        "write",
+        "epoll_wait",
+        "clock_gettime",
+        "sendto",
+        "recvfrom",
+        "futex",
+        "nanosleep",
+    ];
+    const OPS: usize = 1000;
+
+    let mut group = c.benchmark_group("counter");
+    group.throughput(Throughput::Elements(OPS as u64));
+
+    group.bench_function("add_one", |b| {
+        let mut counter = Counter::new();
+        b.iter(|| {
+            for i in 0..OPS {
+                black_box(counter.add_one(NAMES[i % NAMES.len()]));
+            }
+        })
+    });
+
+    group.bench_function("add_counter", |b| {
+        let mut host = Counter::new();
+        for (i, name) in NAMES.iter().enumerate() {
+            host.add_value(name, i as i64);
+        }
+        let mut total = Counter::new();
+        b.iter(|| {
+            for _ in 0..OPS {
+                total.add_counter(&host);
+            }
+        })
+    });
+
+    group.finish();
+}
+
+criterion_group!(benches, byte_queue, interval_map, descriptor_table, counter);
+criterion_main!(benches);
@@ -10,6 +10,13 @@
 
 /* Warning, this file is autogenerated by cbindgen. Don't modify this manually. */
 
+typedef enum LogFormat {
+  // One line of text per message.
+  LOG_FORMAT_TEXT,
+  // Compact binary records, which the tools in `src/tools` can decode.
+  LOG_FORMAT_BINARY,
+} LogFormat;
+
 typedef enum InterposeMethod {
   // Attach to child using ptrace and use it to interpose syscalls etc.
   INTERPOSE_METHOD_PTRACE,
@@ -25,6 +32,12 @@ typedef enum QDiscMode {
   Q_DISC_MODE_ROUND_ROBIN,
 } QDiscMode;
 
+typedef enum TcpCongestionControl {
+  TCP_CONGESTION_CONTROL_RENO,
+  TCP_CONGESTION_CONTROL_CUBIC,
+  TCP_CONGESTION_CONTROL_BBR,
+} TcpCongestionControl;
+
 // Memory allocated by Shadow, in a remote address space.
 typedef struct AllocdMem_u8 AllocdMem_u8;
 
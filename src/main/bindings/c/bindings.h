@@ -49,6 +49,11 @@ typedef struct DescriptorTable DescriptorTable;
 
 typedef struct HostOptions HostOptions;
 
+// A counter keyed by small integer indices, such as syscall numbers or registered type
+// ids. Updating a value is an array access, so this is cheap enough to keep enabled on
+// hot paths.
+typedef struct IndexedCounter IndexedCounter;
+
 // A set of `n` logical processors
 typedef struct LogicalProcessors LogicalProcessors;
 
@@ -104,13 +109,17 @@ void rustlogger_log(LogLevel level,
 // `log` crate. The returned pointer is never deallocated, since loggers
 // registered with the `log` crate are required to live for the life of the
 // program.
-void shadow_logger_init(void);
+void shadow_logger_init(enum LogFormat format);
 
 // When disabled, the logger thread is notified to write each record as
 // soon as it's created.  The calling thread still isn't blocked on the
 // record actually being written, though.
 void shadow_logger_setEnableBuffering(int32_t buffering_enabled);
 
+// When enabled, records that are logged while a host is active are written to
+// `<hostname>.shadow.log` in the host's data directory instead of stdout.
+void shadow_logger_setUsePerHostFiles(int32_t enabled);
+
 struct LogicalProcessors *lps_new(int n);
 
 void lps_free(struct LogicalProcessors *lps);
@@ -166,12 +175,44 @@ unsigned int config_getSeed(const struct ConfigOptions *config);
 
 LogLevel config_getLogLevel(const struct ConfigOptions *config);
 
+enum LogFormat config_getLogFormat(const struct ConfigOptions *config);
+
 SimulationTime config_getHeartbeatInterval(const struct ConfigOptions *config);
 
 SimulationTime config_getRunahead(const struct ConfigOptions *config);
 
+SimulationTime config_getPauseAt(const struct ConfigOptions *config);
+
+bool config_getUsePerHostLookahead(const struct ConfigOptions *config);
+
+bool config_getUseDecoupledRounds(const struct ConfigOptions *config);
+
+uint32_t config_getHostRebalanceInterval(const struct ConfigOptions *config);
+
+bool config_getUseAdaptiveRunahead(const struct ConfigOptions *config);
+
+bool config_getUseCalendarEventQueues(const struct ConfigOptions *config);
+
+bool config_getUseWorkerBarrier(const struct ConfigOptions *config);
+
+bool config_getUsePathMatrix(const struct ConfigOptions *config);
+
+bool config_getUsePathMatrixCache(const struct ConfigOptions *config);
+
+char *config_getPathMatrixCacheDirectory(const struct ConfigOptions *config);
+
+bool config_getPrecomputePaths(const struct ConfigOptions *config);
+
 bool config_getUseCpuPinning(const struct ConfigOptions *config);
 
+bool config_getUseNumaPlacement(const struct ConfigOptions *config);
+
+bool config_getUseNodeCpuPinning(const struct ConfigOptions *config);
+
+bool config_getUseHostPartitioning(const struct ConfigOptions *config);
+
+char *config_getHostPartitioningCounts(const struct ConfigOptions *config);
+
 enum InterposeMethod config_getInterposeMethod(const struct ConfigOptions *config);
 
 bool config_getUseSchedFifo(const struct ConfigOptions *config);
@@ -182,14 +223,58 @@ bool config_getUseExplicitBlockMessage(const struct ConfigOptions *config);
 
 bool config_getUseSeccomp(const struct ConfigOptions *config);
 
+char *config_getNativeSyscalls(const struct ConfigOptions *config);
+
 bool config_getUseSyscallCounters(const struct ConfigOptions *config);
 
 bool config_getUseObjectCounters(const struct ConfigOptions *config);
 
+bool config_getUseProfiler(const struct ConfigOptions *config);
+
+bool config_getUsePreloadZygote(const struct ConfigOptions *config);
+
+bool config_getUseThreadOverlap(const struct ConfigOptions *config);
+
+bool config_getUsePipelinedWorkers(const struct ConfigOptions *config);
+
+bool config_getUseProcessPrelaunch(const struct ConfigOptions *config);
+
+bool config_getUseMissingPathCache(const struct ConfigOptions *config);
+
+bool config_getUseRoundStats(const struct ConfigOptions *config);
+
+bool config_getUseDeterminismDigest(const struct ConfigOptions *config);
+
+bool config_getUsePerHostLogFiles(const struct ConfigOptions *config);
+
 bool config_getUseMemoryManager(const struct ConfigOptions *config);
 
+bool config_getUseSharedFileCache(const struct ConfigOptions *config);
+
+bool config_getUseFastExit(const struct ConfigOptions *config);
+
+bool config_getUseFileWriteBehind(const struct ConfigOptions *config);
+
+bool config_getUseShmemHugepages(const struct ConfigOptions *config);
+
+bool config_getUseKsm(const struct ConfigOptions *config);
+
+SimulationTime config_getIdlePageoutThreshold(const struct ConfigOptions *config);
+
+SimulationTime config_getSpinSyscallDelay(const struct ConfigOptions *config);
+
+uint32_t config_getSpinSyscallLimit(const struct ConfigOptions *config);
+
 bool config_getUseShimSyscallHandler(const struct ConfigOptions *config);
 
+bool config_getUseShimRdtsc(const struct ConfigOptions *config);
+
+bool config_getUseVdsoPatching(const struct ConfigOptions *config);
+
+int32_t config_getPcapCompressionLevel(const struct ConfigOptions *config);
+
+uint32_t config_getPcapCompressionThreads(const struct ConfigOptions *config);
+
 int32_t config_getPreloadSpinMax(const struct ConfigOptions *config);
 
 uint32_t config_getParallelism(const struct ConfigOptions *config);
@@ -206,6 +291,8 @@ char *config_getDataDirectory(const struct ConfigOptions *config);
 
 char *config_getTemplateDirectory(const struct ConfigOptions *config);
 
+char *config_getControlSocket(const struct ConfigOptions *config);
+
 uint64_t config_getSocketRecvBuffer(const struct ConfigOptions *config);
 
 uint64_t config_getSocketSendBuffer(const struct ConfigOptions *config);
@@ -218,13 +305,33 @@ uint64_t config_getInterfaceBuffer(const struct ConfigOptions *config);
 
 enum QDiscMode config_getInterfaceQdisc(const struct ConfigOptions *config);
 
+bool config_getSocketLinuxDelayedAck(const struct ConfigOptions *config);
+
+bool config_getInterfaceSegmentationOffload(const struct ConfigOptions *config);
+
+bool config_getInterfaceReceiveBatching(const struct ConfigOptions *config);
+
+bool config_getUseDeferredWakeups(const struct ConfigOptions *config);
+
 bool config_getUseLegacyWorkingDir(const struct ConfigOptions *config);
 
 char *config_getNetworkGraph(const struct ConfigOptions *config);
 
 bool config_getUseShortestPath(const struct ConfigOptions *config);
 
-void config_iterHosts(const struct ConfigOptions *config,
+// Calls `f` with the time, source node id, target node id, latency in nanoseconds (or -1),
+// and packet loss (or -1) of each network change, sorted by time.
+void config_iterNetworkChanges(const struct ConfigOptions *config,
+                               void (*f)(SimulationTime, uint64_t, uint64_t, int64_t, double, void*),
+                               void *data);
+
+// Calls `f` with the source host name, destination host name, rate in bits per second,
+// start time, and stop time (or 0) of each background flow, in the order they're listed.
+void config_iterBackgroundFlows(const struct ConfigOptions *config,
+                                void (*f)(const char*, const char*, uint64_t, SimulationTime, SimulationTime, void*),
+                                void *data);
+
+bool config_iterHosts(const struct ConfigOptions *config,
                       void (*f)(const char*, const struct ConfigOptions*, const struct HostOptions*, void*),
                       void *data);
 
@@ -242,8 +349,12 @@ LogInfoFlags hostoptions_getHeartbeatLogInfo(const struct HostOptions *host);
 
 SimulationTime hostoptions_getHeartbeatInterval(const struct HostOptions *host);
 
+enum LogFormat hostoptions_getHeartbeatLogFormat(const struct HostOptions *host);
+
 char *hostoptions_getPcapDirectory(const struct HostOptions *host);
 
+uint32_t hostoptions_getPcapCaptureSize(const struct HostOptions *host);
+
 char *hostoptions_getIpAddressHint(const struct HostOptions *host);
 
 char *hostoptions_getCountryCodeHint(const struct HostOptions *host);
@@ -254,10 +365,36 @@ uint64_t hostoptions_getBandwidthDown(const struct HostOptions *host);
 
 uint64_t hostoptions_getBandwidthUp(const struct HostOptions *host);
 
+enum TcpCongestionControl hostoptions_getTcpCongestionControl(const struct HostOptions *host);
+
+// Returns 0 if the host's CPU shouldn't be modeled.
+uint32_t hostoptions_getCpuCores(const struct HostOptions *host);
+
 void hostoptions_iterProcesses(const struct HostOptions *host,
                                void (*f)(const struct ProcessOptions*, void*),
                                void *data);
 
+bool hostoptions_hasTrafficModel(const struct HostOptions *host);
+
+// Returns the port in host byte order.
+uint16_t hostoptions_getTrafficModelPort(const struct HostOptions *host);
+
+// Returns NULL if the traffic model has no peer, and serves streams instead.
+char *hostoptions_getTrafficModelPeer(const struct HostOptions *host);
+
+SimulationTime hostoptions_getTrafficModelStartTime(const struct HostOptions *host);
+
+uint32_t hostoptions_getTrafficModelNumStates(const struct HostOptions *host);
+
+void hostoptions_getTrafficModelState(const struct HostOptions *host,
+                                      uint32_t index,
+                                      uint64_t *send_bytes,
+                                      uint64_t *receive_bytes,
+                                      SimulationTime *pause);
+
+// Returns the relative weight of moving from state `from` to state `to`.
+double hostoptions_getTrafficModelWeight(const struct HostOptions *host, uint32_t from, uint32_t to);
+
 void processoptions_freeString(char *string);
 
 // Will return a NULL pointer if the path does not exist.
@@ -271,10 +408,14 @@ char *processoptions_getEnvironment(const struct ProcessOptions *proc);
 
 uint32_t processoptions_getQuantity(const struct ProcessOptions *proc);
 
+bool processoptions_getElidePayloads(const struct ProcessOptions *proc);
+
 SimulationTime processoptions_getStartTime(const struct ProcessOptions *proc);
 
 SimulationTime processoptions_getStopTime(const struct ProcessOptions *proc);
 
+bool processoptions_getTraceSyscalls(const struct ProcessOptions *proc);
+
 // Parses a string as bits-per-second. Returns '-1' on error.
 int64_t parse_bandwidth(const char *s);
 
@@ -286,15 +427,27 @@ void worker_newForThisThread(WorkerPool *worker_pool,
                              int32_t worker_id,
                              SimulationTime bootstrap_end_time);
 
+// Returns the id of the object type with the given name, registering it if it's new.
+uint32_t worker_registerObjectType(const char *name);
+
 // Returns NULL if there is no live Worker.
 struct Counter *_worker_objectAllocCounter(void);
 
 // Returns NULL if there is no live Worker.
 struct Counter *_worker_objectDeallocCounter(void);
 
+// Counts by object type id. Returns NULL if there is no live Worker.
+struct IndexedCounter *_worker_objectAllocCounts(void);
+
+// Counts by object type id. Returns NULL if there is no live Worker.
+struct IndexedCounter *_worker_objectDeallocCounts(void);
+
 // Returns NULL if there is no live Worker.
 struct Counter *_worker_syscallCounter(void);
 
+// Returns NULL if there is no live Worker.
+struct Counter *_worker_profileCounter(void);
+
 // ID of the current thread's Worker. Panics if the thread has no Worker.
 int32_t worker_threadID(void);
 
@@ -306,18 +459,10 @@ void worker_setActiveThread(Thread *thread);
 
 void worker_setRoundEndTime(SimulationTime t);
 
-SimulationTime _worker_getRoundEndTime(void);
-
 void worker_setCurrentTime(SimulationTime t);
 
-SimulationTime worker_getCurrentTime(void);
-
 void _worker_setLastEventTime(SimulationTime t);
 
-bool worker_isBootstrapActive(void);
-
-WorkerPool *_worker_pool(void);
-
 bool worker_isAlive(void);
 
 // Create an object that can be used to store all descriptors created by a
@@ -395,6 +540,25 @@ const struct PosixFileArc *compatdescriptor_newRefPosixFile(const struct CompatD
 // calling this function.
 void posixfile_drop(const struct PosixFileArc *file);
 
+// Copy up to `len` bytes starting `offset` bytes into the posix file without
+// removing them. Returns the number of bytes copied, or a negative errno.
+ssize_t posixfile_peek(const struct PosixFileArc *file, size_t offset, void *dst, size_t len);
+
+// Remove `len` bytes that were previously copied with `posixfile_peek()`.
+// Returns the number of bytes removed, or a negative errno.
+ssize_t posixfile_consume(const struct PosixFileArc *file, size_t len);
+
+// Write up to `len` bytes from shadow's memory to the posix file. Returns the
+// number of bytes written, or a negative errno.
+ssize_t posixfile_write(const struct PosixFileArc *file, const void *src, size_t len);
+
+// Whether the two posix files are backed by the same buffer, like the two
+// ends of a pipe.
+bool posixfile_sharesBuffer(const struct PosixFileArc *file, const struct PosixFileArc *other);
+
+// Get the file flags (such as `O_NONBLOCK`) of the posix file object.
+int posixfile_getFlags(const struct PosixFileArc *file);
+
 // Get the status of the posix file object.
 Status posixfile_getStatus(const struct PosixFileArc *file);
 
@@ -420,6 +584,16 @@ void allocdmem_free(Thread *thread, struct AllocdMem_u8 *allocd_mem);
 
 PluginPtr allocdmem_pluginPtr(const struct AllocdMem_u8 *allocd_mem);
 
+// Whether to map plugin memory into Shadow so that it can be backed by
+// transparent huge pages. Should be called before any MemoryManager is
+// created.
+void memorymanager_setUseHugePages(bool use_huge_pages);
+
+// Whether to leave large private anonymous plugin mappings out of shared
+// memory so that the kernel can merge their identical pages. Should be
+// called before any MemoryManager is created.
+void memorymanager_setUseKsm(bool use_ksm);
+
 // Initialize the MemoryMapper if it isn't already initialized. `thread` must
 // be running and ready to make native syscalls.
 void memorymanager_initMapperIfNeeded(struct MemoryManager *memory_manager, Thread *thread);
@@ -451,12 +625,37 @@ int32_t memorymanager_readPtr(const struct MemoryManager *memory_manager,
                               PluginPtr src,
                               uintptr_t n);
 
+// Copy `n` bytes from `src` to `dst`, both in this process's memory. The
+// regions must not overlap.
+int32_t memorymanager_copyPtr(struct MemoryManager *memory_manager,
+                              PluginPtr dst,
+                              PluginPtr src,
+                              uintptr_t n);
+
+// Copy the `count` regions starting at `srcs[i]` of length `lens[i]` from
+// this reader's memory into consecutive regions of `dst`, using as few
+// syscalls as possible.
+int32_t memorymanager_readPtrs(const struct MemoryManager *memory_manager,
+                               void *dst,
+                               const PluginPtr *srcs,
+                               const uintptr_t *lens,
+                               uintptr_t count);
+
 // Write data to this writer's memory.
 int32_t memorymanager_writePtr(struct MemoryManager *memory_manager,
                                PluginPtr dst,
                                const void *src,
                                uintptr_t n);
 
+// Copy consecutive regions of `src` into the `count` regions starting at
+// `dsts[i]` of length `lens[i]` in this writer's memory, using as few
+// syscalls as possible.
+int32_t memorymanager_writePtrs(struct MemoryManager *memory_manager,
+                                const PluginPtr *dsts,
+                                const uintptr_t *lens,
+                                uintptr_t count,
+                                const void *src);
+
 // Get a writable pointer to this writer's memory. Initial contents are unspecified.
 struct ProcessMemoryRefMut_u8 *memorymanager_getWritablePtr(struct MemoryManager *memory_manager,
                                                             PluginPtr plugin_src,
@@ -474,6 +673,10 @@ size_t memorymanagermut_sizeof(struct ProcessMemoryRefMut_u8 *memory_ref);
 // Write-back any previously returned writable memory, and free the writer.
 int32_t memorymanager_freeMutRefWithFlush(struct ProcessMemoryRefMut_u8 *mref);
 
+// Write-back the `count` writers in `mrefs` together, and free them.
+int32_t memorymanager_freeMutRefsWithFlush(struct ProcessMemoryRefMut_u8 *const *mrefs,
+                                           uintptr_t count);
+
 // Write-back any previously returned writable memory, and free the writer.
 void memorymanager_freeMutRefWithoutFlush(struct ProcessMemoryRefMut_u8 *mref);
 
@@ -540,6 +743,20 @@ void bytequeue_push(struct ByteQueue *bq, const unsigned char *src, size_t len);
 
 size_t bytequeue_pop(struct ByteQueue *bq, unsigned char *dst, size_t len);
 
+// Returns the first contiguous run of bytes in the queue and stores its
+// length in `len`, or returns NULL if the queue is empty. The bytes stay
+// in the queue until they are removed with `bytequeue_consume`.
+const unsigned char *bytequeue_peekReadable(struct ByteQueue *bq, size_t *len);
+
+void bytequeue_consume(struct ByteQueue *bq, size_t len);
+
+// Returns the unused space at the back of the queue and stores its
+// (non-zero) length in `len`. Must be followed by `bytequeue_commitWritten`
+// with the number of bytes that were written to it.
+unsigned char *bytequeue_reserveWritable(struct ByteQueue *bq, size_t *len);
+
+void bytequeue_commitWritten(struct ByteQueue *bq, size_t len);
+
 struct Counter *counter_new(void);
 
 void counter_free(struct Counter *counter_ptr);
@@ -550,15 +767,27 @@ int64_t counter_sub_value(struct Counter *counter, const char *id, int64_t value
 
 void counter_add_counter(struct Counter *counter, struct Counter *other);
 
+void counter_add_counter_with_prefix(struct Counter *counter,
+                                     struct Counter *other,
+                                     const char *prefix);
+
 void counter_sub_counter(struct Counter *counter, struct Counter *other);
 
 bool counter_equals_counter(const struct Counter *counter, const struct Counter *other);
 
+int64_t indexedcounter_add_value(struct IndexedCounter *counter, uintptr_t index, int64_t value);
+
 // Creates a new string representation of the counter, e.g., for logging.
 // The returned string must be free'd by passing it to counter_free_string.
 char *counter_alloc_string(struct Counter *counter);
 
-// Frees a string previously returned from counter_alloc_string.
+// Creates a new string with one `key value` line per key, in the folded stacks format
+// used by flame graph tools. The returned string must be free'd by passing it to
+// counter_free_string.
+char *counter_alloc_folded_string(struct Counter *counter);
+
+// Frees a string previously returned from counter_alloc_string or
+// counter_alloc_folded_string.
 void counter_free_string(struct Counter *counter, char *ptr);
 
 #endif /* main_bindings_h */
@@ -17,3 +17,4 @@
 #include "main/host/syscall_condition.h"
 #include "main/host/syscall_types.h"
 #include "main/host/thread.h"
+#include "main/utility/perf_timer.h"
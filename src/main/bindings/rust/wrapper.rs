@@ -8,6 +8,7 @@ pub const SchedulerPolicyType_SP_PARALLEL_HOST_STEAL: SchedulerPolicyType = 1;
 pub const SchedulerPolicyType_SP_PARALLEL_THREAD_SINGLE: SchedulerPolicyType = 2;
 pub const SchedulerPolicyType_SP_PARALLEL_THREAD_PERTHREAD: SchedulerPolicyType = 3;
 pub const SchedulerPolicyType_SP_PARALLEL_THREAD_PERHOST: SchedulerPolicyType = 4;
+pub const SchedulerPolicyType_SP_PARALLEL_HOST_STEAL_INBOX: SchedulerPolicyType = 5;
 pub type SchedulerPolicyType = ::std::os::raw::c_uint;
 pub type size_t = ::std::os::raw::c_ulong;
 pub type guint32 = ::std::os::raw::c_uint;
@@ -31,12 +32,6 @@ pub type gpointer = *mut ::std::os::raw::c_void;
 pub type gconstpointer = *const ::std::os::raw::c_void;
 pub type GQuark = guint32;
 pub type ssize_t = __ssize_t;
-#[repr(C)]
-#[derive(Debug, Copy, Clone)]
-pub struct _GTimer {
-    _unused: [u8; 0],
-}
-pub type GTimer = _GTimer;
 pub type sa_family_t = ::std::os::raw::c_ushort;
 pub type in_addr_t = u32;
 pub type in_port_t = u16;
@@ -49,6 +44,9 @@ pub const _LogLevel_LOGLEVEL_INFO: _LogLevel = 3;
 pub const _LogLevel_LOGLEVEL_DEBUG: _LogLevel = 4;
 pub const _LogLevel_LOGLEVEL_TRACE: _LogLevel = 5;
 pub type _LogLevel = i32;
+pub const LogFormat_LOG_FORMAT_TEXT: LogFormat = 0;
+pub const LogFormat_LOG_FORMAT_BINARY: LogFormat = 1;
+pub type LogFormat = ::std::os::raw::c_uint;
 pub const InterposeMethod_INTERPOSE_METHOD_PTRACE: InterposeMethod = 0;
 pub const InterposeMethod_INTERPOSE_METHOD_PRELOAD: InterposeMethod = 1;
 pub const InterposeMethod_INTERPOSE_METHOD_HYBRID: InterposeMethod = 2;
@@ -56,6 +54,10 @@ pub type InterposeMethod = ::std::os::raw::c_uint;
 pub const QDiscMode_Q_DISC_MODE_FIFO: QDiscMode = 0;
 pub const QDiscMode_Q_DISC_MODE_ROUND_ROBIN: QDiscMode = 1;
 pub type QDiscMode = ::std::os::raw::c_uint;
+pub const TcpCongestionControl_TCP_CONGESTION_CONTROL_RENO: TcpCongestionControl = 0;
+pub const TcpCongestionControl_TCP_CONGESTION_CONTROL_CUBIC: TcpCongestionControl = 1;
+pub const TcpCongestionControl_TCP_CONGESTION_CONTROL_BBR: TcpCongestionControl = 2;
+pub type TcpCongestionControl = ::std::os::raw::c_uint;
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
 pub struct ConfigOptions {
@@ -518,6 +520,18 @@ extern "C" {
 extern "C" {
     pub fn process_getWorkingDir(proc_: *mut Process) -> *const ::std::os::raw::c_char;
 }
+extern "C" {
+    pub fn process_setElidePayloads(proc_: *mut Process, elidePayloads: gboolean);
+}
+extern "C" {
+    pub fn process_isElidingPayloads(proc_: *mut Process) -> gboolean;
+}
+extern "C" {
+    pub fn process_startSyscallTrace(proc_: *mut Process);
+}
+extern "C" {
+    pub fn process_flushSyscallTrace(proc_: *mut Process);
+}
 extern "C" {
     pub fn process_addThread(proc_: *mut Process, thread: *mut Thread);
 }
@@ -527,6 +541,9 @@ extern "C" {
 extern "C" {
     pub fn process_isRunning(proc_: *mut Process) -> gboolean;
 }
+extern "C" {
+    pub fn process_getContinueCount(proc_: *mut Process) -> guint64;
+}
 extern "C" {
     pub fn process_getName(proc_: *mut Process) -> *const gchar;
 }
@@ -618,6 +635,14 @@ extern "C" {
         n: size_t,
     ) -> ::std::os::raw::c_int;
 }
+extern "C" {
+    pub fn process_copyPtr(
+        proc_: *mut Process,
+        dst: PluginVirtualPtr,
+        src: PluginVirtualPtr,
+        n: size_t,
+    ) -> ::std::os::raw::c_int;
+}
 extern "C" {
     pub fn process_getReadablePtr(
         proc_: *mut Process,
@@ -886,12 +911,17 @@ pub struct _HostParameters {
     pub sendBufSize: guint64,
     pub autotuneSendBuf: gboolean,
     pub interfaceBufSize: guint64,
+    pub tcpCongestionControl: TcpCongestionControl,
+    pub segmentationOffload: gboolean,
+    pub pcapCaptureSize: guint32,
+    pub heartbeatLogFormat: LogFormat,
+    pub cpuCores: guint,
 }
 #[test]
 fn bindgen_test_layout__HostParameters() {
     assert_eq!(
         ::std::mem::size_of::<_HostParameters>(),
-        160usize,
+        184usize,
         concat!("Size of: ", stringify!(_HostParameters))
     );
     assert_eq!(
@@ -1131,6 +1161,62 @@ fn bindgen_test_layout__HostParameters() {
             stringify!(interfaceBufSize)
         )
     );
+    assert_eq!(
+        unsafe {
+            &(*(::std::ptr::null::<_HostParameters>())).tcpCongestionControl as *const _ as usize
+        },
+        160usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_HostParameters),
+            "::",
+            stringify!(tcpCongestionControl)
+        )
+    );
+    assert_eq!(
+        unsafe {
+            &(*(::std::ptr::null::<_HostParameters>())).segmentationOffload as *const _ as usize
+        },
+        164usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_HostParameters),
+            "::",
+            stringify!(segmentationOffload)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_HostParameters>())).pcapCaptureSize as *const _ as usize },
+        168usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_HostParameters),
+            "::",
+            stringify!(pcapCaptureSize)
+        )
+    );
+    assert_eq!(
+        unsafe {
+            &(*(::std::ptr::null::<_HostParameters>())).heartbeatLogFormat as *const _ as usize
+        },
+        172usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_HostParameters),
+            "::",
+            stringify!(heartbeatLogFormat)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_HostParameters>())).cpuCores as *const _ as usize },
+        176usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_HostParameters),
+            "::",
+            stringify!(cpuCores)
+        )
+    );
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
@@ -1188,10 +1274,12 @@ extern "C" {
 extern "C" {
     pub fn host_unlock(host: *mut Host);
 }
+extern "C" {
+    pub fn host_registerAddresses(host: *mut Host, dns: *mut DNS);
+}
 extern "C" {
     pub fn host_setup(
         host: *mut Host,
-        dns: *mut DNS,
         topology: *mut Topology,
         rawCPUFreq: guint,
         hostRootPath: *const gchar,
@@ -1200,6 +1288,9 @@ extern "C" {
 extern "C" {
     pub fn host_boot(host: *mut Host);
 }
+extern "C" {
+    pub fn host_activate(host: *mut Host);
+}
 extern "C" {
     pub fn host_shutdown(host: *mut Host);
 }
@@ -1222,6 +1313,8 @@ extern "C" {
         pluginPath: *const gchar,
         envv: *mut *mut gchar,
         argv: *mut *mut gchar,
+        elidePayloads: gboolean,
+        traceSyscalls: gboolean,
     );
 }
 extern "C" {
@@ -1257,6 +1350,9 @@ extern "C" {
 extern "C" {
     pub fn host_getNextPacketPriority(host: *mut Host) -> gdouble;
 }
+extern "C" {
+    pub fn host_getLookahead(host: *mut Host) -> SimulationTime;
+}
 extern "C" {
     pub fn host_autotuneReceiveBuffer(host: *mut Host) -> gboolean;
 }
@@ -1295,6 +1391,7 @@ extern "C" {
         port: in_port_t,
         peerIP: in_addr_t,
         peerPort: in_port_t,
+        reusePort: gboolean,
     ) -> gboolean;
 }
 extern "C" {
@@ -1312,6 +1409,19 @@ extern "C" {
 extern "C" {
     pub fn host_getNativeTID(host: *mut Host, virtualPID: pid_t, virtualTID: pid_t) -> pid_t;
 }
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct _WorkerContext {
+    pub pool: *mut WorkerPool,
+    pub activeHost: *mut Host,
+    pub now: SimulationTime,
+    pub roundEndTime: SimulationTime,
+    pub bootstrapEndTime: SimulationTime,
+}
+pub type WorkerContext = _WorkerContext;
+extern "C" {
+    pub fn worker_getContext() -> *mut WorkerContext;
+}
 extern "C" {
     pub fn worker_newForThisThread(
         worker_pool: *mut WorkerPool,
@@ -1337,12 +1447,6 @@ extern "C" {
 extern "C" {
     pub fn worker_setCurrentTime(t: SimulationTime);
 }
-extern "C" {
-    pub fn worker_getCurrentTime() -> SimulationTime;
-}
-extern "C" {
-    pub fn worker_isBootstrapActive() -> bool;
-}
 extern "C" {
     pub fn worker_isAlive() -> bool;
 }
@@ -1419,6 +1523,9 @@ extern "C" {
 extern "C" {
     pub fn affinity_getGoodWorkerAffinity() -> ::std::os::raw::c_int;
 }
+extern "C" {
+    pub fn affinity_getCPUNode(cpu_num: ::std::os::raw::c_int) -> ::std::os::raw::c_int;
+}
 extern "C" {
     pub fn affinity_initPlatformInfo() -> ::std::os::raw::c_int;
 }
@@ -1435,6 +1542,69 @@ pub struct _Epoll {
     _unused: [u8; 0],
 }
 pub type Epoll = _Epoll;
+pub type PerfTimer = _PerfTimer;
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct _PerfTimer {
+    pub startCycles: u64,
+    pub elapsedCycles: u64,
+    pub running: bool,
+}
+#[test]
+fn bindgen_test_layout__PerfTimer() {
+    assert_eq!(
+        ::std::mem::size_of::<_PerfTimer>(),
+        24usize,
+        concat!("Size of: ", stringify!(_PerfTimer))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<_PerfTimer>(),
+        8usize,
+        concat!("Alignment of ", stringify!(_PerfTimer))
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_PerfTimer>())).startCycles as *const _ as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_PerfTimer),
+            "::",
+            stringify!(startCycles)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_PerfTimer>())).elapsedCycles as *const _ as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_PerfTimer),
+            "::",
+            stringify!(elapsedCycles)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_PerfTimer>())).running as *const _ as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_PerfTimer),
+            "::",
+            stringify!(running)
+        )
+    );
+}
+extern "C" {
+    pub fn perftimer_elapsed(timer: *const PerfTimer) -> f64;
+}
+extern "C" {
+    pub fn perftimer_getCyclesPerSecond() -> u64;
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct _PollMirror {
+    _unused: [u8; 0],
+}
+pub type PollMirror = _PollMirror;
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
 pub struct _SysCallHandler {
@@ -1444,11 +1614,16 @@ pub struct _SysCallHandler {
     pub timer: *mut Timer,
     pub epoll: *mut Epoll,
     pub blockedSyscallNR: ::std::os::raw::c_long,
-    pub perfTimer: *mut GTimer,
+    pub perfTimer: *mut PerfTimer,
     pub perfSecondsCurrent: gdouble,
     pub perfSecondsTotal: gdouble,
     pub numSyscalls: ::std::os::raw::c_long,
-    pub syscall_counter: *mut Counter,
+    pub syscall_counts: *mut guint64,
+    pub profile_counter: *mut Counter,
+    pub spinTime: SimulationTime,
+    pub spinCount: guint,
+    pub isSpinDelayed: bool,
+    pub pollMirror: *mut PollMirror,
     pub referenceCount: ::std::os::raw::c_int,
     pub magic: guint,
 }
@@ -1456,7 +1631,7 @@ pub struct _SysCallHandler {
 fn bindgen_test_layout__SysCallHandler() {
     assert_eq!(
         ::std::mem::size_of::<_SysCallHandler>(),
-        96usize,
+        128usize,
         concat!("Size of: ", stringify!(_SysCallHandler))
     );
     assert_eq!(
@@ -1571,18 +1746,68 @@ fn bindgen_test_layout__SysCallHandler() {
         )
     );
     assert_eq!(
-        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).syscall_counter as *const _ as usize },
+        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).syscall_counts as *const _ as usize },
         80usize,
         concat!(
             "Offset of field: ",
             stringify!(_SysCallHandler),
             "::",
-            stringify!(syscall_counter)
+            stringify!(syscall_counts)
         )
     );
     assert_eq!(
-        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).referenceCount as *const _ as usize },
+        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).profile_counter as *const _ as usize },
         88usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_SysCallHandler),
+            "::",
+            stringify!(profile_counter)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).spinTime as *const _ as usize },
+        96usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_SysCallHandler),
+            "::",
+            stringify!(spinTime)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).spinCount as *const _ as usize },
+        104usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_SysCallHandler),
+            "::",
+            stringify!(spinCount)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).isSpinDelayed as *const _ as usize },
+        108usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_SysCallHandler),
+            "::",
+            stringify!(isSpinDelayed)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).pollMirror as *const _ as usize },
+        112usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(_SysCallHandler),
+            "::",
+            stringify!(pollMirror)
+        )
+    );
+    assert_eq!(
+        unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).referenceCount as *const _ as usize },
+        120usize,
         concat!(
             "Offset of field: ",
             stringify!(_SysCallHandler),
@@ -1592,7 +1817,7 @@ fn bindgen_test_layout__SysCallHandler() {
     );
     assert_eq!(
         unsafe { &(*(::std::ptr::null::<_SysCallHandler>())).magic as *const _ as usize },
-        92usize,
+        124usize,
         concat!(
             "Offset of field: ",
             stringify!(_SysCallHandler),
@@ -0,0 +1,264 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/core/control_server.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "lib/logger/log_level.h"
+#include "lib/logger/logger.h"
+#include "main/utility/utility.h"
+
+/* how often we check the socket for new requests */
+#define CONTROL_SERVER_POLL_INTERVAL_USEC (100 * G_TIME_SPAN_MILLISECOND)
+/* how long we wait for a client to send its request or read our response */
+#define CONTROL_SERVER_CLIENT_TIMEOUT_SEC 1
+/* we only need the request line, so ignore anything past this */
+#define CONTROL_SERVER_MAX_REQUEST_SIZE 4096
+
+struct _ControlServer {
+    gchar* socketPath;
+    int listenFD;
+    gint64 lastPollTime;
+
+    ControlServerMetricsFunc metricsFunc;
+    gpointer metricsUserData;
+
+    MAGIC_DECLARE;
+};
+
+ControlServer* controlserver_new(const gchar* socketPath, ControlServerMetricsFunc metricsFunc,
+                                 gpointer userData) {
+    utility_assert(socketPath);
+    utility_assert(metricsFunc);
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        warning("Control socket path '%s' is longer than the %zu bytes that unix sockets allow",
+                socketPath, sizeof(addr.sun_path) - 1);
+        return NULL;
+    }
+    g_strlcpy(addr.sun_path, socketPath, sizeof(addr.sun_path));
+
+    /* remove a socket left over from an earlier run, but never some other kind of file */
+    struct stat st;
+    if (stat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socketPath);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        warning("Unable to create control socket: %s", g_strerror(errno));
+        return NULL;
+    }
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        warning("Unable to listen on control socket '%s': %s", socketPath, g_strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    ControlServer* server = g_new0(ControlServer, 1);
+    MAGIC_INIT(server);
+
+    server->socketPath = g_strdup(socketPath);
+    server->listenFD = fd;
+    server->metricsFunc = metricsFunc;
+    server->metricsUserData = userData;
+
+    info("Serving metrics and log level changes on control socket '%s'", socketPath);
+
+    return server;
+}
+
+void controlserver_free(ControlServer* server) {
+    MAGIC_ASSERT(server);
+
+    close(server->listenFD);
+    unlink(server->socketPath);
+    g_free(server->socketPath);
+
+    MAGIC_CLEAR(server);
+    g_free(server);
+}
+
+static void _controlserver_sendAll(int fd, const gchar* data, gsize length) {
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            debug("Unable to send control socket response: %s", g_strerror(errno));
+            return;
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+static void _controlserver_respond(int fd, guint status, const gchar* reason,
+                                   const gchar* contentType, const gchar* body, gsize bodyLength) {
+    gchar* header = g_strdup_printf("HTTP/1.0 %u %s\r\n"
+                                    "Content-Type: %s\r\n"
+                                    "Content-Length: %zu\r\n"
+                                    "Connection: close\r\n"
+                                    "\r\n",
+                                    status, reason, contentType, bodyLength);
+    _controlserver_sendAll(fd, header, strlen(header));
+    _controlserver_sendAll(fd, body, bodyLength);
+    g_free(header);
+}
+
+static void _controlserver_respondText(int fd, guint status, const gchar* reason,
+                                       const gchar* body) {
+    _controlserver_respond(fd, status, reason, "text/plain; charset=utf-8", body, strlen(body));
+}
+
+/* Returns the value of `key` in the query string, or NULL. The caller must free it. */
+static gchar* _controlserver_getQueryValue(const gchar* query, const gchar* key) {
+    gchar* value = NULL;
+    gchar** params = g_strsplit(query, "&", -1);
+
+    for (gint i = 0; params[i] != NULL && value == NULL; i++) {
+        gchar* sep = strchr(params[i], '=');
+        if (sep && strncmp(params[i], key, sep - params[i]) == 0 &&
+            strlen(key) == (gsize)(sep - params[i])) {
+            value = g_uri_unescape_string(sep + 1, NULL);
+        }
+    }
+
+    g_strfreev(params);
+    return value;
+}
+
+static void _controlserver_handleLogLevel(int fd, const gchar* query) {
+    gchar* levelStr = query ? _controlserver_getQueryValue(query, "level") : NULL;
+    LogLevel level = loglevel_fromStr(levelStr);
+
+    if (level == LOGLEVEL_UNSET) {
+        _controlserver_respondText(
+            fd, 400, "Bad Request",
+            "expected a level of error, warning, info, debug, or trace, e.g. '?level=debug'\n");
+    } else {
+        logger_setLevel(logger_getDefault(), level);
+        warning("Log level changed to %s by a control socket request", loglevel_toStr(level));
+
+        gchar* body = g_strdup_printf("log level set to %s\n", loglevel_toStr(level));
+        _controlserver_respondText(fd, 200, "OK", body);
+        g_free(body);
+    }
+
+    g_free(levelStr);
+}
+
+static void _controlserver_handleRequest(ControlServer* server, int fd, gchar* request) {
+    /* we only look at the request line, e.g. "GET /metrics HTTP/1.1" */
+    gchar* lineEnd = strpbrk(request, "\r\n");
+    if (lineEnd) {
+        *lineEnd = '\0';
+    }
+
+    gchar** parts = g_strsplit(request, " ", 3);
+    if (parts[0] == NULL || parts[1] == NULL) {
+        _controlserver_respondText(fd, 400, "Bad Request", "malformed request\n");
+        g_strfreev(parts);
+        return;
+    }
+
+    const gchar* method = parts[0];
+    gchar* path = parts[1];
+    gchar* query = strchr(path, '?');
+    if (query) {
+        *query++ = '\0';
+    }
+
+    if (g_str_equal(path, "/metrics")) {
+        if (g_str_equal(method, "GET")) {
+            GString* body = g_string_new(NULL);
+            server->metricsFunc(server->metricsUserData, body);
+            _controlserver_respond(
+                fd, 200, "OK", "text/plain; version=0.0.4; charset=utf-8", body->str, body->len);
+            g_string_free(body, TRUE);
+        } else {
+            _controlserver_respondText(fd, 405, "Method Not Allowed", "use GET\n");
+        }
+    } else if (g_str_equal(path, "/log-level")) {
+        if (g_str_equal(method, "POST") || g_str_equal(method, "PUT")) {
+            _controlserver_handleLogLevel(fd, query);
+        } else {
+            _controlserver_respondText(fd, 405, "Method Not Allowed", "use POST\n");
+        }
+    } else {
+        _controlserver_respondText(fd, 404, "Not Found", "try /metrics or /log-level\n");
+    }
+
+    g_strfreev(parts);
+}
+
+static void _controlserver_handleClient(ControlServer* server, int fd) {
+    /* the client is expected to send its whole request right away, so we don't need to
+     * juggle partial requests between polls */
+    struct timeval timeout = {.tv_sec = CONTROL_SERVER_CLIENT_TIMEOUT_SEC};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    gchar request[CONTROL_SERVER_MAX_REQUEST_SIZE + 1];
+    gsize length = 0;
+
+    while (length < CONTROL_SERVER_MAX_REQUEST_SIZE) {
+        ssize_t n = recv(fd, request + length, CONTROL_SERVER_MAX_REQUEST_SIZE - length, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+        length += n;
+        request[length] = '\0';
+
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+    request[length] = '\0';
+
+    if (length > 0) {
+        _controlserver_handleRequest(server, fd, request);
+    }
+}
+
+void controlserver_poll(ControlServer* server) {
+    MAGIC_ASSERT(server);
+
+    gint64 now = g_get_monotonic_time();
+    if (now - server->lastPollTime < CONTROL_SERVER_POLL_INTERVAL_USEC) {
+        return;
+    }
+    server->lastPollTime = now;
+
+    while (TRUE) {
+        int fd = accept4(server->listenFD, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                warning("Unable to accept control socket connection: %s", g_strerror(errno));
+            }
+            return;
+        }
+
+        _controlserver_handleClient(server, fd);
+        close(fd);
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_CONTROL_SERVER_H_
+#define SHD_CONTROL_SERVER_H_
+
+#include <glib.h>
+
+/* Serves metrics and accepts log level changes over a Unix socket while the simulation
+ * runs. Requests use a small subset of HTTP/1.0, so that tools such as
+ * `curl --unix-socket` can be used as clients:
+ *
+ *   GET /metrics                   the metrics, in the Prometheus text format
+ *   POST /log-level?level=<level>  change the log level of the default logger
+ *
+ * The server doesn't use its own thread; requests are only answered when the owner calls
+ * controlserver_poll(). */
+typedef struct _ControlServer ControlServer;
+
+/* Appends the current metrics in the Prometheus text format to `out`. */
+typedef void (*ControlServerMetricsFunc)(gpointer userData, GString* out);
+
+/* Listens on a new Unix socket at `socketPath`. Returns NULL and logs a warning if the
+ * socket can't be created. */
+ControlServer* controlserver_new(const gchar* socketPath, ControlServerMetricsFunc metricsFunc,
+                                 gpointer userData);
+/* Stops listening and removes the socket. */
+void controlserver_free(ControlServer* server);
+
+/* Answers any requests that are waiting, without blocking if there are none. To keep this
+ * cheap enough to call after every scheduling round, the socket is only checked if some
+ * time has passed since the last check. */
+void controlserver_poll(ControlServer* server);
+
+#endif /* SHD_CONTROL_SERVER_H_ */
@@ -49,6 +49,19 @@ struct _Controller {
     SimulationTime minJumpTime;
     SimulationTime nextMinJumpTime;
 
+    /* with per-host lookahead, the largest lookahead of any host */
+    gboolean usePerHostLookahead;
+    SimulationTime maxLookahead;
+
+    /* if set, rounds may run until the earliest time that a packet could reach another host */
+    gboolean useAdaptiveRunahead;
+
+    /* the scheduled changes to the network graph edges (TopologyEdgeChange) and the
+     * times at which they're made, sorted by time, and the next one to make */
+    GArray* networkChanges;
+    GArray* networkChangeTimes;
+    guint nextNetworkChange;
+
     /* start of current window of execution */
     SimulationTime executeWindowStart;
     /* end of current window of execution (start + min_time_jump) */
@@ -91,6 +104,11 @@ Controller* controller_new(ConfigOptions* config) {
     controller->random = random_new(config_getSeed(config));
 
     controller->minJumpTimeConfig = config_getRunahead(config);
+    controller->usePerHostLookahead = config_getUsePerHostLookahead(config);
+    controller->useAdaptiveRunahead = config_getUseAdaptiveRunahead(config);
+
+    controller->networkChanges = g_array_new(FALSE, FALSE, sizeof(TopologyEdgeChange));
+    controller->networkChangeTimes = g_array_new(FALSE, FALSE, sizeof(SimulationTime));
 
     /* these are only avail in glib >= 2.30
      * setup signal handlers for gracefully handling shutdowns */
@@ -115,6 +133,8 @@ void controller_free(Controller* controller) {
     if (controller->random) {
         random_free(controller->random);
     }
+    g_array_free(controller->networkChanges, TRUE);
+    g_array_free(controller->networkChangeTimes, TRUE);
 
     MAGIC_CLEAR(controller);
     g_free(controller);
@@ -152,6 +172,47 @@ void controller_updateMinTimeJump(Controller* controller, gdouble minPathLatency
     }
 }
 
+void controller_updateMaxLookahead(Controller* controller, SimulationTime lookahead) {
+    MAGIC_ASSERT(controller);
+    if (lookahead > controller->maxLookahead) {
+        controller->maxLookahead = lookahead;
+        debug("updated maximum host lookahead to %" G_GUINT64_FORMAT " nanoseconds",
+              controller->maxLookahead);
+    }
+}
+
+/* Returns the directory where the path matrix and the topology's validation marker are
+ * saved for later simulations, or NULL if they shouldn't be. */
+static gchar* _controller_getPathCacheDirectory(Controller* controller) {
+    if (!config_getUsePathMatrixCache(controller->config)) {
+        return NULL;
+    }
+
+    /* the data directory is recreated every run, so keep saved paths beside it unless
+     * the user shares a directory between simulations */
+    gchar* cacheDirectory = NULL;
+    char* configuredDirectory = config_getPathMatrixCacheDirectory(controller->config);
+    if (configuredDirectory) {
+        cacheDirectory = g_strdup(configuredDirectory);
+        config_freeString(configuredDirectory);
+    } else {
+        char* dataDirectory = config_getDataDirectory(controller->config);
+        gchar* dataPath = NULL;
+        if (g_path_is_absolute(dataDirectory)) {
+            dataPath = g_strdup(dataDirectory);
+        } else {
+            gchar* cwdPath = g_get_current_dir();
+            dataPath = g_build_filename(cwdPath, dataDirectory, NULL);
+            g_free(cwdPath);
+        }
+        cacheDirectory = g_path_get_dirname(dataPath);
+        g_free(dataPath);
+        config_freeString(dataDirectory);
+    }
+
+    return cacheDirectory;
+}
+
 static gboolean _controller_loadTopology(Controller* controller) {
     MAGIC_ASSERT(controller);
 
@@ -170,8 +231,12 @@ static gboolean _controller_loadTopology(Controller* controller) {
     config_freeString(topologyString);
 
     /* initialize global routing model */
-    controller->topology = topology_new(temporaryFilename, config_getUseShortestPath(controller->config));
+    gchar* cacheDirectory = _controller_getPathCacheDirectory(controller);
+    controller->topology =
+        topology_new(temporaryFilename, config_getUseShortestPath(controller->config),
+                     config_getParallelism(controller->config), cacheDirectory);
     g_unlink(temporaryFilename);
+    g_free(cacheDirectory);
 
     if (!controller->topology) {
         error("fatal error loading topology at path '%s', check your syntax and try again",
@@ -187,6 +252,84 @@ static gboolean _controller_loadTopology(Controller* controller) {
     return TRUE;
 }
 
+static void _controller_registerNetworkChangeCallback(SimulationTime time, uint64_t source,
+                                                     uint64_t target, int64_t latencyNs,
+                                                     double packetLoss, void* _controller) {
+    Controller* controller = _controller;
+    MAGIC_ASSERT(controller);
+
+    TopologyEdgeChange change = {
+        .srcVertexID = (gint64)source,
+        .dstVertexID = (gint64)target,
+        .latencyNs = latencyNs,
+        .packetLoss = packetLoss,
+    };
+    g_array_append_val(controller->networkChanges, change);
+    g_array_append_val(controller->networkChangeTimes, time);
+}
+
+static gboolean _controller_loadNetworkChanges(Controller* controller) {
+    MAGIC_ASSERT(controller);
+
+    config_iterNetworkChanges(
+        controller->config, _controller_registerNetworkChangeCallback, controller);
+
+    guint nChanges = controller->networkChanges->len;
+    if (nChanges == 0) {
+        return TRUE;
+    }
+
+    /* these let hosts run ahead using the path latencies at the start of the simulation */
+    if (controller->usePerHostLookahead || config_getUseDecoupledRounds(controller->config) ||
+        controller->useAdaptiveRunahead) {
+        error("Network changes can't be used with per-host lookahead, decoupled rounds, or "
+              "adaptive runahead");
+        return FALSE;
+    }
+
+    for (guint i = 0; i < nChanges; i++) {
+        TopologyEdgeChange* change =
+            &g_array_index(controller->networkChanges, TopologyEdgeChange, i);
+        if (!topology_isValidEdgeChange(controller->topology, change)) {
+            error("Network change %u names the edge between nodes %" G_GINT64_FORMAT
+                  " and %" G_GINT64_FORMAT ", which isn't in the network graph, or has a "
+                  "packet loss above 1",
+                  i, change->srcVertexID, change->dstVertexID);
+            return FALSE;
+        }
+    }
+
+    info("loaded %u network changes", nChanges);
+    return TRUE;
+}
+
+/* makes the network changes that are due by time, while no worker uses the topology */
+static void _controller_applyNetworkChanges(Controller* controller, SimulationTime time) {
+    MAGIC_ASSERT(controller);
+
+    guint first = controller->nextNetworkChange;
+    guint last = first;
+    while (last < controller->networkChangeTimes->len &&
+           g_array_index(controller->networkChangeTimes, SimulationTime, last) <= time) {
+        last++;
+    }
+
+    if (last == first) {
+        return;
+    }
+    controller->nextNetworkChange = last;
+
+    topology_applyEdgeChanges(controller->topology,
+                              &g_array_index(controller->networkChanges, TopologyEdgeChange, first),
+                              last - first);
+
+    /* faster paths lower the time jump starting with the next round */
+    gdouble minPathLatency = topology_getMinimumPathLatency(controller->topology);
+    if (minPathLatency > 0) {
+        controller_updateMinTimeJump(controller, minPathLatency);
+    }
+}
+
 static void _controller_initializeTimeWindows(Controller* controller) {
     MAGIC_ASSERT(controller);
 
@@ -221,7 +364,8 @@ static void _controller_registerArgCallback(const char* arg, void* _argArray) {
 
 typedef struct _ProcessCallbackArgs {
     Controller* controller;
-    const char* hostname;
+    /* the templates of the host's processes, one entry per process instance */
+    GPtrArray* templates;
 } ProcessCallbackArgs;
 
 static void _controller_registerProcessCallback(const ProcessOptions* proc, void* _callbackArgs) {
@@ -249,17 +393,51 @@ static void _controller_registerProcessCallback(const ProcessOptions* proc, void
 
     char* environment = processoptions_getEnvironment(proc);
 
+    ManagerProcessTemplate* processTemplate = manager_newProcessTemplate(
+        callbackArgs->controller->manager, plugin, processoptions_getStartTime(proc),
+        processoptions_getStopTime(proc), argv, environment,
+        processoptions_getElidePayloads(proc), processoptions_getTraceSyscalls(proc));
+
+    /* the array holds one reference per instance */
     for (guint64 i = 0; i < quantity; i++) {
-        manager_addNewVirtualProcess(callbackArgs->controller->manager, callbackArgs->hostname,
-                                     plugin, processoptions_getStartTime(proc),
-                                     processoptions_getStopTime(proc), argv, environment);
+        manager_refProcessTemplate(processTemplate);
+        g_ptr_array_add(callbackArgs->templates, processTemplate);
     }
+    manager_unrefProcessTemplate(processTemplate);
 
     processoptions_freeString(environment);
     processoptions_freeString(plugin);
     g_strfreev(argv);
 }
 
+static TrafficModelParameters* _controller_newTrafficModelParameters(const HostOptions* host) {
+    TrafficModelParameters* params = g_new0(TrafficModelParameters, 1);
+    params->port = htons(hostoptions_getTrafficModelPort(host));
+
+    char* peer = hostoptions_getTrafficModelPeer(host);
+    if (peer) {
+        params->peerHostname = g_strdup(peer);
+        hostoptions_freeString(peer);
+    }
+
+    params->startTime = hostoptions_getTrafficModelStartTime(host);
+    params->nStates = hostoptions_getTrafficModelNumStates(host);
+    params->states = g_new0(TrafficModelStateParameters, params->nStates);
+
+    for (guint i = 0; i < params->nStates; i++) {
+        TrafficModelStateParameters* state = &params->states[i];
+        hostoptions_getTrafficModelState(
+            host, i, &state->sendBytes, &state->receiveBytes, &state->pause);
+
+        state->nextWeights = g_new0(gdouble, params->nStates);
+        for (guint j = 0; j < params->nStates; j++) {
+            state->nextWeights[j] = hostoptions_getTrafficModelWeight(host, i, j);
+        }
+    }
+
+    return params;
+}
+
 static void _controller_registerHostCallback(const char* name, const ConfigOptions* config,
                                              const HostOptions* host, void* _controller) {
     Controller* controller = _controller;
@@ -271,6 +449,13 @@ static void _controller_registerHostCallback(const char* name, const ConfigOptio
 
     guint64 quantity = hostoptions_getQuantity(host);
 
+    /* the processes are the same on every instance of the host, so build them once */
+    ProcessCallbackArgs processArgs;
+    processArgs.controller = controller;
+    processArgs.templates =
+        g_ptr_array_new_with_free_func((GDestroyNotify)manager_unrefProcessTemplate);
+    hostoptions_iterProcesses(host, _controller_registerProcessCallback, (void*)&processArgs);
+
     for (guint64 i = 0; i < quantity; i++) {
         HostParameters* params = g_new0(HostParameters, 1);
 
@@ -281,19 +466,24 @@ static void _controller_registerHostCallback(const char* name, const ConfigOptio
         params->hostname = hostnameBuffer->str;
 
         params->cpuFrequency = MAX(0, managerCpuFreq);
-        params->cpuThreshold = 0;
+        /* the CPU is only modeled if it has cores, and then any delay holds back events */
+        params->cpuCores = hostoptions_getCpuCores(host);
+        params->cpuThreshold = params->cpuCores > 0 ? 1 : 0;
         params->cpuPrecision = 200;
 
         params->logLevel = hostoptions_getLogLevel(host);
         params->heartbeatLogLevel = hostoptions_getHeartbeatLogLevel(host);
         params->heartbeatLogInfo = hostoptions_getHeartbeatLogInfo(host);
         params->heartbeatInterval = hostoptions_getHeartbeatInterval(host);
+        params->heartbeatLogFormat = hostoptions_getHeartbeatLogFormat(host);
 
         params->pcapDir = hostoptions_getPcapDirectory(host);
+        params->pcapCaptureSize = hostoptions_getPcapCaptureSize(host);
 
         params->ipHint = hostoptions_getIpAddressHint(host);
         params->countrycodeHint = hostoptions_getCountryCodeHint(host);
         params->citycodeHint = hostoptions_getCityCodeHint(host);
+        params->tcpCongestionControl = hostoptions_getTcpCongestionControl(host);
 
         /* shadow uses values in KiB/s, but the config uses b/s */
         /* TODO: use bits or bytes everywhere within Shadow (see also:
@@ -308,15 +498,20 @@ static void _controller_registerHostCallback(const char* name, const ConfigOptio
         params->autotuneRecvBuf = config_getSocketRecvAutotune(config);
         params->interfaceBufSize = config_getInterfaceBuffer(config);
         params->qdisc = config_getInterfaceQdisc(config);
+        params->segmentationOffload = config_getInterfaceSegmentationOffload(config);
 
         manager_addNewVirtualHost(controller->manager, params);
 
-        ProcessCallbackArgs processArgs;
-        processArgs.controller = controller;
-        processArgs.hostname = hostnameBuffer->str;
-
         /* now handle each virtual process the host will run */
-        hostoptions_iterProcesses(host, _controller_registerProcessCallback, (void*)&processArgs);
+        for (guint j = 0; j < processArgs.templates->len; j++) {
+            manager_addNewVirtualProcess(controller->manager, hostnameBuffer->str, i + 1,
+                                         g_ptr_array_index(processArgs.templates, j));
+        }
+
+        if (hostoptions_hasTrafficModel(host)) {
+            manager_addNewTrafficModel(controller->manager, hostnameBuffer->str,
+                                       _controller_newTrafficModelParameters(host));
+        }
 
         /* cleanup for next pass through the loop */
         g_string_free(hostnameBuffer, TRUE);
@@ -328,11 +523,60 @@ static void _controller_registerHostCallback(const char* name, const ConfigOptio
 
         g_free(params);
     }
+
+    g_ptr_array_unref(processArgs.templates);
+}
+
+typedef struct _BackgroundFlowCallbackArgs BackgroundFlowCallbackArgs;
+struct _BackgroundFlowCallbackArgs {
+    Controller* controller;
+    gboolean success;
+};
+
+static void _controller_registerBackgroundFlowCallback(const char* source, const char* destination,
+                                                       uint64_t rateBitsPerSec,
+                                                       SimulationTime startTime,
+                                                       SimulationTime stopTime, void* _args) {
+    BackgroundFlowCallbackArgs* args = _args;
+    MAGIC_ASSERT(args->controller);
+
+    if (!args->success) {
+        return;
+    }
+
+    if (g_strcmp0(source, destination) == 0 || (stopTime != 0 && stopTime <= startTime)) {
+        error("Background flow from '%s' to '%s' must be between different hosts, and stop "
+              "after it starts",
+              source, destination);
+        args->success = FALSE;
+        return;
+    }
+
+    /* shadow uses values in KiB/s, but the config uses b/s */
+    if (!manager_addBackgroundFlow(args->controller->manager, source, destination,
+                                   rateBitsPerSec / (8 * 1024), startTime, stopTime)) {
+        error("Background flow from '%s' to '%s' names a host that doesn't exist", source,
+              destination);
+        args->success = FALSE;
+    }
+}
+
+static gboolean _controller_loadBackgroundFlows(Controller* controller) {
+    MAGIC_ASSERT(controller);
+
+    BackgroundFlowCallbackArgs args = {.controller = controller, .success = TRUE};
+    config_iterBackgroundFlows(
+        controller->config, _controller_registerBackgroundFlowCallback, &args);
+
+    if (args.success) {
+        manager_applyBackgroundFlows(controller->manager);
+    }
+    return args.success;
 }
 
-static void _controller_registerHosts(Controller* controller) {
+static gboolean _controller_registerHosts(Controller* controller) {
     MAGIC_ASSERT(controller);
-    config_iterHosts(controller->config, _controller_registerHostCallback, (void*)controller);
+    return config_iterHosts(controller->config, _controller_registerHostCallback, (void*)controller);
 }
 
 gint controller_run(Controller* controller) {
@@ -345,6 +589,10 @@ gint controller_run(Controller* controller) {
         return 1;
     }
 
+    if (!_controller_loadNetworkChanges(controller)) {
+        return 1;
+    }
+
     _controller_initializeTimeWindows(controller);
 
     /* the controller will be responsible for distributing the actions to the managers so that
@@ -362,7 +610,33 @@ gint controller_run(Controller* controller) {
 
     /* register the components needed by each manager.
      * this must be done after managers are available so we can send them messages */
-    _controller_registerHosts(controller);
+    if (!_controller_registerHosts(controller)) {
+        error("unable to register the hosts");
+        return 1;
+    }
+    manager_setupHosts(controller->manager);
+
+    /* the flows need the bandwidth of the hosts' interfaces */
+    if (!_controller_loadBackgroundFlows(controller)) {
+        return 1;
+    }
+
+    /* now that all hosts are attached, compute their paths up front if requested */
+    if (config_getUsePathMatrix(controller->config)) {
+        gchar* cacheDirectory = _controller_getPathCacheDirectory(controller);
+        topology_computePathMatrix(controller->topology,
+                                   config_getParallelism(controller->config), cacheDirectory);
+        g_free(cacheDirectory);
+
+        /* the path cache would normally report this as paths are computed */
+        gdouble minPathLatency = topology_getMinimumPathLatency(controller->topology);
+        if (minPathLatency > 0) {
+            controller_updateMinTimeJump(controller, minPathLatency);
+        }
+    }
+
+    /* the first round starts at time 0 */
+    _controller_applyNetworkChanges(controller, 0);
 
     info("running simulation");
 
@@ -389,6 +663,7 @@ gint controller_run(Controller* controller) {
 
 gboolean controller_managerFinishedCurrentRound(Controller* controller,
                                                 SimulationTime minNextEventTime,
+                                                SimulationTime minNextSendTime,
                                                 SimulationTime* executeWindowStart,
                                                 SimulationTime* executeWindowEnd) {
     MAGIC_ASSERT(controller);
@@ -397,12 +672,29 @@ gboolean controller_managerFinishedCurrentRound(Controller* controller,
     /* TODO: once we get multiple managers, we have to block them here
      * until they have all notified us that they are finished */
 
+    /* the next round starts at the next event, so it must see the changes made by then */
+    _controller_applyNetworkChanges(controller, minNextEventTime);
+
     /* update our detected min jump time */
     controller->minJumpTime = controller->nextMinJumpTime;
 
     /* update the next interval window based on next event times */
     SimulationTime newStart = minNextEventTime;
-    SimulationTime newEnd = minNextEventTime + _controller_getMinTimeJump(controller);
+    SimulationTime jump = _controller_getMinTimeJump(controller);
+
+    /* with per-host lookahead, the window is long enough for the host with the
+     * largest lookahead, and the scheduler stops every other host earlier */
+    if (controller->usePerHostLookahead && controller->maxLookahead > jump) {
+        jump = controller->maxLookahead;
+    }
+
+    SimulationTime newEnd = minNextEventTime + jump;
+
+    /* nothing sent during the round can reach another host before this, so the round may
+     * run until then even if some faster path was used before */
+    if (controller->useAdaptiveRunahead && minNextSendTime > newEnd) {
+        newEnd = minNextSendTime;
+    }
 
     /* update the new window end as one interval past the new window start,
      * making sure we dont run over the experiment end time */
@@ -410,6 +702,16 @@ gboolean controller_managerFinishedCurrentRound(Controller* controller,
         newEnd = controller->endTime;
     }
 
+    /* end the round when the next network change is due, so that no later event runs with
+     * the old paths */
+    if (controller->nextNetworkChange < controller->networkChangeTimes->len) {
+        SimulationTime changeTime = g_array_index(
+            controller->networkChangeTimes, SimulationTime, controller->nextNetworkChange);
+        if (newEnd > changeTime) {
+            newEnd = changeTime;
+        }
+    }
+
     /* finally, set the new values */
     controller->executeWindowStart = newStart;
     controller->executeWindowEnd = newEnd;
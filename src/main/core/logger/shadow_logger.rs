@@ -1,15 +1,19 @@
+use crate::core::support::configuration::LogFormat;
 use crate::core::support::simulation_time::SimulationTime;
 use crate::core::worker::Worker;
-use crate::host::host::HostInfo;
-use crossbeam::queue::ArrayQueue;
+use crate::host::host::{HostId, HostInfo};
+use crossbeam::queue::SegQueue;
 use log::{Level, Log, Metadata, Record, SetLoggerError};
 use log_bindings as c_log;
-use once_cell::sync::Lazy;
+use once_cell::sync::{Lazy, OnceCell};
 use std::cell::RefCell;
+use std::collections::HashMap;
 use std::convert::TryFrom;
+use std::io::Write;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
 use std::sync::mpsc::{Receiver, Sender};
 use std::sync::Arc;
-use std::sync::{Mutex, RwLock};
+use std::sync::Mutex;
 use std::time::Duration;
 
 /// Trigger an asynchronous flush when this many lines are queued.
@@ -78,8 +82,79 @@ fn test_time_parts() {
     );
 }
 
+/// Written once at the start of binary log output. Followed by a little-endian `u32` version.
+const BINARY_LOG_MAGIC: &[u8; 8] = b"SHADOWLG";
+const BINARY_LOG_VERSION: u32 = 1;
+
+/// Binary log entry that assigns an id to a string: `u32` id, `u32` length, then the UTF-8 bytes.
+const BINARY_LOG_TAG_STRING: u8 = 1;
+/// Binary log entry for a log record: `u64` wall time in microseconds, `u64` sim time in
+/// nanoseconds (`u64::MAX` if none), `u8` level (1 is error, 5 is trace), then `u32` ids of the
+/// thread name, host, file name, a `u32` line (0 if none), the `u32` id of the module path, and
+/// finally a `u32` length followed by the UTF-8 message. All integers are little-endian, and id 0
+/// is used for fields that aren't available.
+const BINARY_LOG_TAG_RECORD: u8 = 2;
+
+#[cfg(test)]
+#[test]
+fn test_binary_log_interning() {
+    let host = Arc::new(HostInfo {
+        id: HostId::from(7),
+        name: "peer".to_string(),
+        default_ip: std::net::IpAddr::V4(std::net::Ipv4Addr::new(11, 0, 0, 1)),
+        log_level: None,
+    });
+    let record = |message: &str| ShadowLogRecord {
+        level: Level::Debug,
+        file: Some("src/main/host/host.rs"),
+        module_path: Some("shadow_rs::host::host"),
+        line: Some(12),
+        message: message.to_string(),
+        wall_time: Duration::from_micros(5),
+        sim_time: None,
+        thread_name: Arc::from("worker-0"),
+        host_info: Some(Arc::clone(&host)),
+    };
+
+    let mut state = BinaryLogState::new();
+    let mut first = Vec::new();
+    state.write_record(&mut first, &record("one")).unwrap();
+    let mut second = Vec::new();
+    state.write_record(&mut second, &record("two")).unwrap();
+
+    // the header and the four strings are only written with the first record
+    let header_len = BINARY_LOG_MAGIC.len() + 4;
+    let strings_len: usize = [
+        "worker-0",
+        "peer:11.0.0.1",
+        "host.rs",
+        "shadow_rs::host::host",
+    ]
+    .iter()
+    .map(|s| 9 + s.len())
+    .sum();
+    let record_len = 1 + 8 + 8 + 1 + 4 * 6 + 3;
+    assert_eq!(first.len(), header_len + strings_len + record_len);
+    assert_eq!(second.len(), record_len);
+    assert_eq!(&first[..8], BINARY_LOG_MAGIC);
+
+    assert_eq!(second[0], BINARY_LOG_TAG_RECORD);
+    assert_eq!(&second[1..9], &5u64.to_le_bytes());
+    assert_eq!(&second[9..17], &u64::MAX.to_le_bytes());
+    assert_eq!(second[17], 4);
+    // thread, host, file, and module ids in the order they were assigned
+    assert_eq!(&second[18..22], &1u32.to_le_bytes());
+    assert_eq!(&second[22..26], &2u32.to_le_bytes());
+    assert_eq!(&second[26..30], &3u32.to_le_bytes());
+    assert_eq!(&second[30..34], &12u32.to_le_bytes());
+    assert_eq!(&second[34..38], &4u32.to_le_bytes());
+    assert_eq!(&second[38..42], &3u32.to_le_bytes());
+    assert_eq!(&second[42..], b"two");
+}
+
 /// Initialize the Shadow logger.
-pub fn init() -> Result<(), SetLoggerError> {
+pub fn init(format: LogFormat) -> Result<(), SetLoggerError> {
+    SHADOW_LOGGER.format.set(format).unwrap();
     log::set_logger(&*SHADOW_LOGGER)?;
 
     // Start the thread that will receive log records and flush them to output.
@@ -119,24 +194,183 @@ pub struct ShadowLogger {
     // it locked for as long as it's running.
     command_receiver: Mutex<Receiver<LoggerCommand>>,
 
-    // A lock-free queue for individual log records. We don't put the records
-    // themselves in the `command_sender`, because `Sender` doesn't support
-    // getting the queue length. Conversely we don't put commands in this queue
-    // because it doesn't support blocking operations.
+    // The lock-free queues of log records, one for each thread that has
+    // logged. Each thread only pushes to its own queue (see THREAD_RECORDS), so
+    // logging threads don't contend with each other, only with the logger
+    // thread that pops from them. We don't put the records themselves in the
+    // `command_sender`, because `Sender` doesn't support getting the queue
+    // length. Conversely we don't put commands in these queues because they
+    // don't support blocking operations.
     //
-    // The size is roughly SYNC_FLUSH_QD_LINES_THRESHOLD *
-    // size_of<ShadowLogRecord>; we might want to consider SegQueue (which grows
-    // and shrinks dynamically) instead if we ever make SYNC_FLUSH_QD_LINES_THRESHOLD very
-    // large.
-    records: ArrayQueue<ShadowLogRecord>,
+    // The first queue is shared by threads whose thread-locals are already
+    // gone. Queues of threads that have exited are removed once they're empty.
+    records: Mutex<Vec<Arc<SegQueue<ShadowLogRecord>>>>,
+
+    // The total number of records in `records`.
+    queued: AtomicUsize,
 
     // When false, sends a (still-asynchronous) flush command to the logger
     // thread every time a record is pushed into `records`.
-    buffering_enabled: RwLock<bool>,
+    buffering_enabled: AtomicBool,
+
+    // How records are written to stdout. Set once when the logger is initialized.
+    format: OnceCell<LogFormat>,
+
+    // The strings that have been given ids in the binary output. Only locked
+    // while flushing, and always after the stdout lock.
+    binary_state: Mutex<BinaryLogState>,
+
+    // When true, records that are logged while a host is active are written to the host's
+    // log file by the logging thread, instead of being queued for stdout.
+    per_host_files: AtomicBool,
+
+    // The log file of each host that has logged while `per_host_files` is enabled. Logging
+    // threads look files up in THREAD_HOST_FILES first, so this is only locked when a
+    // thread first logs for a host, and while flushing.
+    host_files: Mutex<HostLogFiles>,
+}
+
+type HostLogFiles = HashMap<HostId, Arc<Mutex<HostLogFile>>>;
+
+/// A host's log file. Only the worker thread that's running the host writes to it, so the
+/// lock is normally uncontended.
+struct HostLogFile {
+    writer: std::io::BufWriter<std::fs::File>,
+    // Set when the records are written in the binary format.
+    binary_state: Option<BinaryLogState>,
+}
+
+impl HostLogFile {
+    fn create(path: &std::path::Path, format: Option<&LogFormat>) -> std::io::Result<Self> {
+        Ok(Self {
+            writer: std::io::BufWriter::new(std::fs::File::create(path)?),
+            binary_state: match format {
+                Some(LogFormat::Binary) => Some(BinaryLogState::new()),
+                _ => None,
+            },
+        })
+    }
+
+    fn write_record(&mut self, record: &ShadowLogRecord) -> std::io::Result<()> {
+        match &mut self.binary_state {
+            Some(state) => state.write_record(&mut self.writer, record),
+            None => ShadowLogger::write_text_record(&mut self.writer, record),
+        }
+    }
+}
+
+/// Tracks which strings have already been written to the binary log, so that each one is
+/// only written once and records can refer to it by id.
+struct BinaryLogState {
+    wrote_header: bool,
+    strings: HashMap<String, u32>,
+    hosts: HashMap<HostId, u32>,
+    next_id: u32,
+}
+
+impl BinaryLogState {
+    fn new() -> Self {
+        Self {
+            wrote_header: false,
+            strings: HashMap::new(),
+            hosts: HashMap::new(),
+            // id 0 means that the field isn't available
+            next_id: 1,
+        }
+    }
+
+    fn write_string_entry(writer: &mut impl Write, id: u32, string: &str) -> std::io::Result<()> {
+        writer.write_all(&[BINARY_LOG_TAG_STRING])?;
+        writer.write_all(&id.to_le_bytes())?;
+        writer.write_all(&u32::try_from(string.len()).unwrap().to_le_bytes())?;
+        writer.write_all(string.as_bytes())
+    }
+
+    /// Returns the id of the string, first writing it out if it doesn't have an id yet.
+    fn intern_string(&mut self, writer: &mut impl Write, string: &str) -> std::io::Result<u32> {
+        if let Some(id) = self.strings.get(string) {
+            return Ok(*id);
+        }
+
+        let id = self.next_id;
+        self.next_id += 1;
+        Self::write_string_entry(writer, id, string)?;
+        self.strings.insert(string.to_string(), id);
+        Ok(id)
+    }
+
+    /// Returns the id of the host's "name:ip" string, first writing it out if needed.
+    fn intern_host(&mut self, writer: &mut impl Write, host: &HostInfo) -> std::io::Result<u32> {
+        if let Some(id) = self.hosts.get(&host.id) {
+            return Ok(*id);
+        }
+
+        let id = self.next_id;
+        self.next_id += 1;
+        Self::write_string_entry(writer, id, &format!("{}:{}", host.name, host.default_ip))?;
+        self.hosts.insert(host.id, id);
+        Ok(id)
+    }
+
+    fn write_record(
+        &mut self,
+        writer: &mut impl Write,
+        record: &ShadowLogRecord,
+    ) -> std::io::Result<()> {
+        if !self.wrote_header {
+            writer.write_all(BINARY_LOG_MAGIC)?;
+            writer.write_all(&BINARY_LOG_VERSION.to_le_bytes())?;
+            self.wrote_header = true;
+        }
+
+        // any new strings must be written before the record that uses them
+        let thread_id = self.intern_string(writer, &record.thread_name)?;
+        let host_id = match &record.host_info {
+            Some(host) => self.intern_host(writer, host)?,
+            None => 0,
+        };
+        let file_id = match record.file_name() {
+            Some(file) => self.intern_string(writer, file)?,
+            None => 0,
+        };
+        let module_id = match record.module_path {
+            Some(module) => self.intern_string(writer, module)?,
+            None => 0,
+        };
+
+        let wall_time = u64::try_from(record.wall_time.as_micros()).unwrap_or(u64::MAX);
+        let sim_time = record
+            .sim_time
+            .map(|t| u64::try_from(t.as_nanos()).unwrap_or(u64::MAX - 1))
+            .unwrap_or(u64::MAX);
+
+        let mut header = [0u8; 1 + 8 + 8 + 1 + 4 * 6];
+        let mut pos = 0;
+        let mut put = |bytes: &[u8]| {
+            header[pos..(pos + bytes.len())].copy_from_slice(bytes);
+            pos += bytes.len();
+        };
+        put(&[BINARY_LOG_TAG_RECORD]);
+        put(&wall_time.to_le_bytes());
+        put(&sim_time.to_le_bytes());
+        put(&[record.level as u8]);
+        put(&thread_id.to_le_bytes());
+        put(&host_id.to_le_bytes());
+        put(&file_id.to_le_bytes());
+        put(&record.line.unwrap_or(0).to_le_bytes());
+        put(&module_id.to_le_bytes());
+        put(&u32::try_from(record.message.len()).unwrap().to_le_bytes());
+        debug_assert_eq!(pos, header.len());
+
+        writer.write_all(&header)?;
+        writer.write_all(record.message.as_bytes())
+    }
 }
 
 thread_local!(static SENDER: RefCell<Option<Sender<LoggerCommand>>> = RefCell::new(None));
-thread_local!(static THREAD_NAME: Lazy<String> = Lazy::new(|| { get_thread_name() }));
+thread_local!(static THREAD_NAME: Lazy<Arc<str>> = Lazy::new(|| { get_thread_name().into() }));
+thread_local!(static THREAD_RECORDS: RefCell<Option<Arc<SegQueue<ShadowLogRecord>>>> = RefCell::new(None));
+thread_local!(static THREAD_HOST_FILES: RefCell<HostLogFiles> = RefCell::new(HashMap::new()));
 
 fn get_thread_name() -> String {
     let mut thread_name = Vec::<i8>::with_capacity(16);
@@ -171,10 +405,15 @@ impl ShadowLogger {
     fn new() -> ShadowLogger {
         let (sender, receiver) = std::sync::mpsc::channel();
         let logger = ShadowLogger {
-            records: ArrayQueue::new(SYNC_FLUSH_QD_LINES_THRESHOLD),
+            records: Mutex::new(vec![Arc::new(SegQueue::new())]),
+            queued: AtomicUsize::new(0),
             command_sender: Mutex::new(sender),
             command_receiver: Mutex::new(receiver),
-            buffering_enabled: RwLock::new(false),
+            buffering_enabled: AtomicBool::new(false),
+            format: OnceCell::new(),
+            binary_state: Mutex::new(BinaryLogState::new()),
+            per_host_files: AtomicBool::new(false),
+            host_files: Mutex::new(HashMap::new()),
         };
         logger
     }
@@ -201,86 +440,61 @@ impl ShadowLogger {
     // self.records. If `done_sender` is provided, it's notified after the flush
     // has completed.
     fn flush_records(&self, done_sender: Option<Sender<()>>) -> std::io::Result<()> {
-        use std::io::Write;
-
-        // Only flush records that are already in the queue, not ones that
+        // Only flush records that are already in the queues, not ones that
         // arrive while we're flushing. Otherwise callers who perform a
         // synchronous flush (whether this flush operation or another one that
         // arrives while we're flushing) will be left waiting longer than
         // necessary. Also keeps us from holding the stdout lock indefinitely.
-        let mut toflush = self.records.len();
+        let mut toflush = Vec::new();
+        {
+            let mut queues = self.records.lock().unwrap();
+            for queue in queues.iter() {
+                for _ in 0..queue.len() {
+                    match queue.pop() {
+                        Some(r) => toflush.push(r),
+                        // This can happen if another thread panics while the
+                        // logging thread is flushing. In that case both threads
+                        // will be consuming from the queues.
+                        None => break,
+                    }
+                }
+            }
+            // Forget the queues of threads that have exited, other than the shared first one.
+            let mut index = 0;
+            queues.retain(|queue| {
+                index += 1;
+                index == 1 || Arc::strong_count(queue) > 1 || !queue.is_empty()
+            });
+        }
+        self.queued.fetch_sub(toflush.len(), Ordering::Relaxed);
+
+        // Each queue is in the order its thread logged, so a stable sort merges
+        // them into the order the records were created in.
+        toflush.sort_by_key(|record| record.wall_time);
 
         let stdout_unlocked = std::io::stdout();
         let stdout_locked = stdout_unlocked.lock();
         let mut stdout = std::io::BufWriter::new(stdout_locked);
-        while toflush > 0 {
-            let record = match self.records.pop() {
-                Some(r) => r,
-                None => {
-                    // This can happen if another thread panics while the
-                    // logging thread is flushing. In that case both threads
-                    // will be consuming from the queue.
-                    break;
-                }
-            };
-            toflush -= 1;
-            {
-                let parts = TimeParts::from_nanos(record.wall_time.as_nanos());
-                write!(
-                    stdout,
-                    "{:02}:{:02}:{:02}.{:06}",
-                    parts.hours,
-                    parts.mins,
-                    parts.secs,
-                    parts.nanos / 1000
-                )?;
-            }
-            write!(stdout, " [{}]", record.thread_name)?;
-            if let Some(sim_time) = record.sim_time {
-                let parts = TimeParts::from_nanos(sim_time.as_nanos());
-                write!(
-                    stdout,
-                    " {:02}:{:02}:{:02}.{:09}",
-                    parts.hours, parts.mins, parts.secs, parts.nanos
-                )?;
-            } else {
-                write!(stdout, " n/a")?;
-            }
-            write!(stdout, " [{level}]", level = record.level)?;
-            if let Some(host) = record.host_info {
-                write!(
-                    stdout,
-                    " [{hostname}:{ip}]",
-                    hostname = host.name,
-                    ip = host.default_ip,
-                )?;
-            } else {
-                write!(stdout, " [n/a]",)?;
-            }
-            write!(
-                stdout,
-                " [{file}:",
-                file = record
-                    .file
-                    .map(|f| if let Some(sep_pos) = f.rfind('/') {
-                        &f[(sep_pos + 1)..]
-                    } else {
-                        f
-                    })
-                    .unwrap_or("n/a"),
-            )?;
-            if let Some(line) = record.line {
-                write!(stdout, "{line}", line = line)?;
-            } else {
-                write!(stdout, "n/a")?;
+
+        let mut binary_state = match self.format.get() {
+            Some(LogFormat::Binary) => Some(self.binary_state.lock().unwrap()),
+            _ => None,
+        };
+
+        for record in &toflush {
+            match &mut binary_state {
+                Some(state) => state.write_record(&mut stdout, record)?,
+                None => Self::write_text_record(&mut stdout, record)?,
             }
-            write!(
-                stdout,
-                "] [{module}] {msg}\n",
-                module = record.module_path.unwrap_or("n/a"),
-                msg = record.message
-            )?;
         }
+        // Make sure the records are written before notifying the caller.
+        stdout.flush()?;
+
+        let host_files: Vec<_> = self.host_files.lock().unwrap().values().cloned().collect();
+        for file in host_files {
+            file.lock().unwrap().writer.flush()?;
+        }
+
         if let Some(done_sender) = done_sender {
             // We can't log from this thread without risking deadlock, so in the
             // unlikely case that the calling thread has gone away, just print
@@ -296,12 +510,134 @@ impl ShadowLogger {
         Ok(())
     }
 
+    fn write_text_record(stdout: &mut impl Write, record: &ShadowLogRecord) -> std::io::Result<()> {
+        {
+            let parts = TimeParts::from_nanos(record.wall_time.as_nanos());
+            write!(
+                stdout,
+                "{:02}:{:02}:{:02}.{:06}",
+                parts.hours,
+                parts.mins,
+                parts.secs,
+                parts.nanos / 1000
+            )?;
+        }
+        write!(stdout, " [{}]", record.thread_name)?;
+        if let Some(sim_time) = record.sim_time {
+            let parts = TimeParts::from_nanos(sim_time.as_nanos());
+            write!(
+                stdout,
+                " {:02}:{:02}:{:02}.{:09}",
+                parts.hours, parts.mins, parts.secs, parts.nanos
+            )?;
+        } else {
+            write!(stdout, " n/a")?;
+        }
+        write!(stdout, " [{level}]", level = record.level)?;
+        if let Some(host) = &record.host_info {
+            write!(
+                stdout,
+                " [{hostname}:{ip}]",
+                hostname = host.name,
+                ip = host.default_ip,
+            )?;
+        } else {
+            write!(stdout, " [n/a]",)?;
+        }
+        write!(
+            stdout,
+            " [{file}:",
+            file = record.file_name().unwrap_or("n/a"),
+        )?;
+        if let Some(line) = record.line {
+            write!(stdout, "{line}", line = line)?;
+        } else {
+            write!(stdout, "n/a")?;
+        }
+        write!(
+            stdout,
+            "] [{module}] {msg}\n",
+            module = record.module_path.unwrap_or("n/a"),
+            msg = record.message
+        )
+    }
+
     /// When disabled, the logger thread is notified to write each record as
     /// soon as it's created.  The calling thread still isn't blocked on the
     /// record actually being written, though.
     pub fn set_buffering_enabled(&self, buffering_enabled: bool) {
-        let mut writer = self.buffering_enabled.write().unwrap();
-        *writer = buffering_enabled;
+        self.buffering_enabled
+            .store(buffering_enabled, Ordering::Relaxed);
+    }
+
+    /// When enabled, records that are logged while a host is active are written to
+    /// `<hostname>.shadow.log` in the host's data directory instead of stdout.
+    pub fn set_per_host_files_enabled(&self, enabled: bool) {
+        self.per_host_files.store(enabled, Ordering::Relaxed);
+    }
+
+    // Returns the log file of the active host, opening it if this is the first record for
+    // the host. Returns None if the file can't be opened.
+    fn host_file(&self, host: &HostInfo) -> Option<Arc<Mutex<HostLogFile>>> {
+        let cached = THREAD_HOST_FILES
+            .try_with(|files| files.borrow().get(&host.id).cloned())
+            .ok()
+            .flatten();
+        if cached.is_some() {
+            return cached;
+        }
+
+        let file = {
+            let mut files = self.host_files.lock().unwrap();
+            match files.get(&host.id) {
+                Some(file) => Arc::clone(file),
+                None => {
+                    let dir = Worker::active_host_data_path()?;
+                    let path = dir.join(format!("{}.shadow.log", host.name));
+                    let file = match HostLogFile::create(&path, self.format.get()) {
+                        Ok(file) => Arc::new(Mutex::new(file)),
+                        Err(e) => {
+                            // We can't log from here without recursing.
+                            eprintln!("WARNING: Couldn't create log file {:?}: {}", path, e);
+                            return None;
+                        }
+                    };
+                    files.insert(host.id, Arc::clone(&file));
+                    file
+                }
+            }
+        };
+
+        THREAD_HOST_FILES
+            .try_with(|files| files.borrow_mut().insert(host.id, Arc::clone(&file)))
+            .ok();
+        Some(file)
+    }
+
+    // Push a record to the current thread's queue, registering the queue if
+    // this is the first record from the thread.
+    fn push_record(&self, record: ShadowLogRecord) {
+        // Count the record first so that a concurrent flush can't make the count negative.
+        self.queued.fetch_add(1, Ordering::Relaxed);
+
+        let mut record = Some(record);
+
+        THREAD_RECORDS
+            .try_with(|thread_records| {
+                let mut thread_records = thread_records.borrow_mut();
+                let queue = thread_records.get_or_insert_with(|| {
+                    let queue = Arc::new(SegQueue::new());
+                    self.records.lock().unwrap().push(Arc::clone(&queue));
+                    queue
+                });
+                queue.push(record.take().unwrap());
+            })
+            .ok();
+
+        // The thread is exiting and its thread-locals are gone.
+        if let Some(record) = record {
+            self.records.lock().unwrap()[0].push(record);
+        }
     }
 
     // Send a flush command to the logger thread.
@@ -365,7 +701,7 @@ impl Log for ShadowLogger {
 
         let host_info = Worker::with_active_host_info(|host| host.clone());
 
-        let mut shadowrecord = ShadowLogRecord {
+        let shadowrecord = ShadowLogRecord {
             level: record.level(),
             file: record.file_static(),
             module_path: record.module_path_static(),
@@ -377,22 +713,29 @@ impl Log for ShadowLogger {
 
             sim_time: Worker::current_time(),
             thread_name: THREAD_NAME
-                .try_with(|name| (*name).clone())
-                .unwrap_or_else(|_| get_thread_name()),
+                .try_with(|name| Arc::clone(&**name))
+                .unwrap_or_else(|_| get_thread_name().into()),
             host_info,
         };
 
-        loop {
-            match self.records.push(shadowrecord) {
-                Ok(()) => break,
-                Err(r) => {
-                    // Queue is full. Flush it and try again.
-                    shadowrecord = r;
-                    self.flush_sync();
+        if self.per_host_files.load(Ordering::Relaxed) {
+            let host_file = match &shadowrecord.host_info {
+                Some(host) => self.host_file(host),
+                None => None,
+            };
+            if let Some(host_file) = host_file {
+                // Release the lock before unwrapping; the panic handler flushes the files.
+                let res = host_file.lock().unwrap().write_record(&shadowrecord);
+                res.unwrap();
+                // Errors also go to stdout, so that they aren't missed.
+                if record.level() != Level::Error {
+                    return;
                 }
             }
         }
 
+        self.push_record(shadowrecord);
+
         if record.level() == Level::Error {
             // Unlike in Shadow's C code, we don't abort the program on Error
             // logs. In Rust the same purpose is filled with `panic` and
@@ -400,8 +743,11 @@ impl Log for ShadowLogger {
             //
             // Flush *synchronously*, since we're likely about to crash one way or another.
             self.flush_sync();
-        } else if self.records.len() > ASYNC_FLUSH_QD_LINES_THRESHOLD
-            || !*self.buffering_enabled.read().unwrap()
+        } else if self.queued.load(Ordering::Relaxed) > SYNC_FLUSH_QD_LINES_THRESHOLD {
+            // Records are coming in faster than they can be flushed.
+            self.flush_sync();
+        } else if self.queued.load(Ordering::Relaxed) > ASYNC_FLUSH_QD_LINES_THRESHOLD
+            || !self.buffering_enabled.load(Ordering::Relaxed)
         {
             self.flush_async();
         }
@@ -421,10 +767,20 @@ struct ShadowLogRecord {
     wall_time: Duration,
 
     sim_time: Option<SimulationTime>,
-    thread_name: String,
+    thread_name: Arc<str>,
     host_info: Option<Arc<HostInfo>>,
 }
 
+impl ShadowLogRecord {
+    /// The name of the source file, without its directory.
+    fn file_name(&self) -> Option<&'static str> {
+        self.file.map(|f| match f.rfind('/') {
+            Some(sep_pos) => &f[(sep_pos + 1)..],
+            None => f,
+        })
+    }
+}
+
 enum LoggerCommand {
     // Flush; takes an optional one-shot channel to notify that the flush has completed.
     Flush(Option<Sender<()>>),
@@ -438,8 +794,8 @@ mod export {
     /// registered with the `log` crate are required to live for the life of the
     /// program.
     #[no_mangle]
-    pub unsafe extern "C" fn shadow_logger_init() -> () {
-        init().unwrap()
+    pub unsafe extern "C" fn shadow_logger_init(format: LogFormat) -> () {
+        init(format).unwrap()
     }
 
     /// When disabled, the logger thread is notified to write each record as
@@ -449,4 +805,11 @@ mod export {
     pub unsafe extern "C" fn shadow_logger_setEnableBuffering(buffering_enabled: i32) {
         SHADOW_LOGGER.set_buffering_enabled(buffering_enabled != 0)
     }
+
+    /// When enabled, records that are logged while a host is active are written to
+    /// `<hostname>.shadow.log` in the host's data directory instead of stdout.
+    #[no_mangle]
+    pub unsafe extern "C" fn shadow_logger_setUsePerHostFiles(enabled: i32) {
+        SHADOW_LOGGER.set_per_host_files_enabled(enabled != 0)
+    }
 }
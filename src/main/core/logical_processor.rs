@@ -6,8 +6,10 @@
 use crate::cshadow;
 use crate::utility::notnull::*;
 use crossbeam::queue::SegQueue;
+use rand::Rng;
 use std::convert::TryFrom;
 use std::convert::TryInto;
+use std::sync::atomic::{AtomicUsize, Ordering};
 use std::time::Duration;
 
 #[cfg(feature = "perf_timers")]
@@ -16,38 +18,74 @@ use {crate::utility::perf_timer::PerfTimer, std::sync::Mutex};
 /// A set of `n` logical processors
 pub struct LogicalProcessors {
     lps: Vec<LogicalProcessor>,
+    /// The number of workers in all of the `ready_workers` queues, so that
+    /// logical processors can stop looking for work without scanning every
+    /// queue once the last worker of a task has started.
+    n_ready: AtomicUsize,
 }
 
 impl LogicalProcessors {
     pub fn new(n: usize) -> Self {
         let mut lps = Vec::new();
         for _ in 0..n {
+            let cpu_id = unsafe { cshadow::affinity_getGoodWorkerAffinity() };
             lps.push(LogicalProcessor {
-                cpu_id: unsafe { cshadow::affinity_getGoodWorkerAffinity() },
+                cpu_id,
+                node: unsafe { cshadow::affinity_getCPUNode(cpu_id) },
                 ready_workers: SegQueue::new(),
                 done_workers: SegQueue::new(),
                 #[cfg(feature = "perf_timers")]
                 idle_timer: Mutex::new(PerfTimer::new()),
             });
         }
-        Self { lps }
+        Self {
+            lps,
+            n_ready: AtomicUsize::new(0),
+        }
     }
 
     /// Add a worker to be run on `lpi`.
     pub fn ready_push(&self, lpi: usize, worker: usize) {
         self.lps[lpi].ready_workers.push(worker);
+        self.n_ready.fetch_add(1, Ordering::Relaxed);
     }
 
     /// Get a worker ID to run on `lpi`. Returns None if there are no more
     /// workers to run.
     pub fn pop_worker_to_run_on(&self, lpi: usize) -> Option<usize> {
-        for i in 0..self.lps.len() {
-            // Start with workers that last ran on `lpi`; if none are available
-            // steal from another in round-robin order.
-            let from_lpi = (lpi + i) % self.lps.len();
-            let from_lp = &self.lps[from_lpi];
-            if let Some(worker) = from_lp.ready_workers.pop() {
-                return Some(worker);
+        // Workers are only made ready in between tasks, so once the count
+        // reaches zero there's nothing left to find.
+        if self.n_ready.load(Ordering::Relaxed) == 0 {
+            return None;
+        }
+
+        // Start with workers that last ran on `lpi`.
+        if let Some(worker) = self.lps[lpi].ready_workers.pop() {
+            self.n_ready.fetch_sub(1, Ordering::Relaxed);
+            return Some(worker);
+        }
+
+        // If none are available steal from another, first from the logical
+        // processors on the same NUMA node so that workers (and the memory of
+        // their hosts) stay on their node when possible. Start at a random
+        // victim so that idle logical processors don't all contend on the same
+        // queues.
+        let node = self.lps[lpi].node;
+        let start = rand::thread_rng().gen_range(0..self.lps.len());
+        for &same_node in &[true, false] {
+            for i in 0..self.lps.len() {
+                let from_lpi = (start + i) % self.lps.len();
+                let from_lp = &self.lps[from_lpi];
+                if from_lpi == lpi || (from_lp.node == node) != same_node {
+                    continue;
+                }
+                if let Some(worker) = from_lp.ready_workers.pop() {
+                    self.n_ready.fetch_sub(1, Ordering::Relaxed);
+                    return Some(worker);
+                }
+                if self.n_ready.load(Ordering::Relaxed) == 0 {
+                    return None;
+                }
             }
         }
         return None;
@@ -62,9 +100,12 @@ impl LogicalProcessors {
     /// Call after finishing running a task on all workers to mark all workers ready
     /// to run again.
     pub fn finish_task(&mut self) {
+        let mut n_ready = 0;
         for lp in &mut self.lps {
             std::mem::swap(&mut lp.ready_workers, &mut lp.done_workers);
+            n_ready += lp.ready_workers.len();
         }
+        *self.n_ready.get_mut() = n_ready;
     }
 
     /// Returns the cpu id that should be used with the `affinity_*` module to
@@ -99,6 +140,7 @@ impl LogicalProcessors {
 
 pub struct LogicalProcessor {
     cpu_id: libc::c_int,
+    node: libc::c_int,
     ready_workers: SegQueue<usize>,
     done_workers: SegQueue<usize>,
     #[cfg(feature = "perf_timers")]
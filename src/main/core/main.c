@@ -217,9 +217,10 @@ gint main_runShadow(gint argc, gchar* argv[]) {
     LogLevel logLevel = config_getLogLevel(config);
 
     /* start up the logging subsystem to handle all future messages */
-    shadow_logger_init();
+    shadow_logger_init(config_getLogFormat(config));
     logger_setDefault(rustlogger_new(logLevel));
     logger_setLevel(logger_getDefault(), logLevel);
+    shadow_logger_setUsePerHostFiles(config_getUsePerHostLogFiles(config));
 
     /* disable buffering during startup so that we see every message immediately in the terminal */
     shadow_logger_setEnableBuffering(FALSE);
@@ -231,9 +232,6 @@ gint main_runShadow(gint argc, gchar* argv[]) {
     }
 #endif
 
-    // before we run the simluation, clean up any orphaned shared memory
-    shmemcleanup_tryCleanup();
-
     if (config_getUseCpuPinning(config)) {
         int rc = affinity_initPlatformInfo();
         if (rc) {
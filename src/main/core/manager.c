@@ -10,21 +10,30 @@
 #include <link.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/resource.h>
+#include <unistd.h>
 
 #include "lib/logger/logger.h"
 #include "main/bindings/c/bindings.h"
+#include "main/core/control_server.h"
 #include "main/core/controller.h"
 #include "main/core/manager.h"
 #include "main/core/scheduler/scheduler.h"
 #include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/definitions.h"
+#include "main/core/worker.h"
+#include "main/host/descriptor/file_cache.h"
 #include "main/host/host.h"
 #include "main/host/network_interface.h"
 #include "main/routing/address.h"
 #include "main/routing/dns.h"
+#include "main/routing/fluid_flows.h"
 #include "main/routing/topology.h"
+#include "main/shmem/shmem_allocator.h"
 #include "main/utility/random.h"
 #include "main/utility/utility.h"
 
@@ -42,6 +51,9 @@ struct _Manager {
 
     /* manager random source, init from controller random, used to init host randoms */
     Random* random;
+
+    /* background flows that were added but not applied to the hosts yet */
+    FluidFlows* backgroundFlows;
     guint rawFrequencyKHz;
 
     /* global object counters, we collect counts from workers at end of sim */
@@ -51,17 +63,44 @@ struct _Manager {
     // Global syscall counter, we collect counts from workers at end of sim
     Counter* syscall_counter;
 
+    // Global profiled times, collected from workers at end of sim if the profiler is enabled
+    Counter* profile_counter;
+
     /* the parallel event/host/thread scheduler */
     Scheduler* scheduler;
 
+    /* hosts that were added but aren't set up yet, in the order they were added,
+     * and the same hosts by ID; see manager_setupHosts() */
+    GPtrArray* pendingHosts;
+    GHashTable* pendingHostsByID;
+    /* the index of the next pending host for a worker to set up */
+    guint nextPendingHost;
+    /* our resident memory before the first pending host was created */
+    guint64 residentBytesBeforeHosts;
+
     GMutex lock;
     GMutex pluginInitLock;
 
     /* We will not enter plugin context when set. Used when destroying threads */
     gboolean forceShadowContext;
 
-    /* the last time we logged heartbeat information */
+    /* the last time we logged heartbeat information. workers may read it while the
+     * manager thread writes it, so both use atomic operations */
     SimulationTime simClockLastHeartbeat;
+    /* the wall clock time of the last heartbeat, in microseconds */
+    gint64 wallClockLastHeartbeat;
+    /* the wall clock time at which the simulation started running, in microseconds */
+    gint64 wallClockRunStart;
+
+    /* the simulated time at which to stop for a checkpoint, or 0 if we won't */
+    SimulationTime pauseTime;
+
+    /* the execution window of the round that is running, or that last ran */
+    SimulationTime windowStart;
+    SimulationTime windowEnd;
+
+    /* answers requests on the control socket in between rounds; NULL if disabled */
+    ControlServer* controlServer;
 
     guint numPluginErrors;
 
@@ -69,6 +108,9 @@ struct _Manager {
     gchar* dataPath;
     gchar* hostsPath;
 
+    /* shares the contents of read-only files in the data directory; NULL if disabled */
+    FileCache* fileCache;
+
     gchar* preloadShimPath;
 
     MAGIC_DECLARE;
@@ -160,6 +202,26 @@ static guint _manager_nextRandomUInt(Manager* manager) {
     return r;
 }
 
+/* where the kernel reports how much samepage merging it has done */
+#define MANAGER_KSM_DIR "/sys/kernel/mm/ksm"
+
+/* returns the value of one of the kernel's samepage merging counters, or 0 if it's
+ * unavailable */
+static guint64 _manager_readKsmCounter(const gchar* name) {
+    gchar* path = g_strdup_printf(MANAGER_KSM_DIR "/%s", name);
+    FILE* file = fopen(path, "r");
+    g_free(path);
+    if (!file) {
+        return 0;
+    }
+
+    unsigned long long value = 0;
+    int n = fscanf(file, "%llu", &value);
+    fclose(file);
+
+    return n == 1 ? (guint64)value : 0;
+}
+
 Manager* manager_new(Controller* controller, ConfigOptions* config, SimulationTime endTime,
                      SimulationTime unlimBWEndTime, guint randomSeed) {
     if (globalmanager != NULL) {
@@ -178,6 +240,15 @@ Manager* manager_new(Controller* controller, ConfigOptions* config, SimulationTi
     manager->random = random_new(randomSeed);
     manager->bootstrapEndTime = unlimBWEndTime;
 
+    /* must be set before the first shared memory is allocated or mapped */
+    shmemallocator_setUseHugePages(config_getUseShmemHugepages(config));
+    memorymanager_setUseHugePages(config_getUseShmemHugepages(config));
+    memorymanager_setUseKsm(config_getUseKsm(config));
+    if (config_getUseKsm(config) && _manager_readKsmCounter("run") != 1) {
+        warning("kernel samepage merging is enabled, but the kernel isn't merging pages; "
+                "write 1 to " MANAGER_KSM_DIR "/run to start it");
+    }
+
     manager->rawFrequencyKHz = utility_getRawCPUFrequency(CONFIG_CPU_MAX_FREQ_FILE);
     if (manager->rawFrequencyKHz == 0) {
         debug("unable to read '%s' for copying", CONFIG_CPU_MAX_FREQ_FILE);
@@ -200,6 +271,11 @@ Manager* manager_new(Controller* controller, ConfigOptions* config, SimulationTi
     manager->scheduler =
         scheduler_new(manager, policy, nWorkers, schedulerSeed, endTime);
 
+    manager->pendingHosts = g_ptr_array_new();
+    manager->pendingHostsByID = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    manager->pauseTime = config_getPauseAt(config);
+
     manager->cwdPath = g_get_current_dir();
 
     char* dataDirectory = config_getDataDirectory(config);
@@ -249,9 +325,29 @@ Manager* manager_new(Controller* controller, ConfigOptions* config, SimulationTi
     /* now make sure the hosts path exists, as it may not have been in the template */
     g_mkdir_with_parents(manager->hostsPath, 0775);
 
+    if (config_getUseSharedFileCache(config)) {
+        manager->fileCache = filecache_new(manager->dataPath);
+    }
+
     return manager;
 }
 
+static void _manager_writeProfile(Manager* manager) {
+    gchar* path = g_build_filename(manager->dataPath, "profile.folded", NULL);
+    char* str = counter_alloc_folded_string(manager->profile_counter);
+
+    GError* error = NULL;
+    if (g_file_set_contents(path, str, strlen(str), &error)) {
+        info("Wrote profiled times in nanoseconds to '%s'", path);
+    } else {
+        warning("Unable to write profiled times to '%s': %s", path, error->message);
+        g_error_free(error);
+    }
+
+    counter_free_string(manager->profile_counter, str);
+    g_free(path);
+}
+
 gint manager_free(Manager* manager) {
     MAGIC_ASSERT(manager);
     gint returnCode = (manager->numPluginErrors > 0) ? -1 : 0;
@@ -266,6 +362,18 @@ gint manager_free(Manager* manager) {
         scheduler_unref(manager->scheduler);
     }
 
+    /* manager_setupHosts() already freed the pending hosts themselves */
+    g_ptr_array_free(manager->pendingHosts, TRUE);
+    g_hash_table_destroy(manager->pendingHostsByID);
+
+    if (config_getUseShmemHugepages(manager->config)) {
+        shmemallocator_logHugePageCoverage(shmemallocator_getGlobal());
+    }
+
+    if (manager->fileCache) {
+        filecache_free(manager->fileCache);
+    }
+
     if (manager->syscall_counter) {
         char* str = counter_alloc_string(manager->syscall_counter);
         info("Global syscall counts: %s", str);
@@ -273,6 +381,13 @@ gint manager_free(Manager* manager) {
         counter_free(manager->syscall_counter);
     }
 
+    if (manager->profile_counter) {
+        if (config_getUseProfiler(manager->config)) {
+            _manager_writeProfile(manager);
+        }
+        counter_free(manager->profile_counter);
+    }
+
     if (manager->object_counter_alloc && manager->object_counter_dealloc) {
         char* str = counter_alloc_string(manager->object_counter_alloc);
         info("Global allocated object counts: %s", str);
@@ -336,17 +451,88 @@ guint manager_getRawCPUFrequency(Manager* manager) {
     return freq;
 }
 
+/* the parts of a process that are the same on every host that runs it. a host with a
+ * quantity shares one template between all of its instances, so the arguments and
+ * the environment are only built once. */
+struct _ManagerProcessTemplate {
+    gint referenceCount;
+    gchar* pluginPath;
+    gchar* pluginName;
+    SimulationTime startTime;
+    SimulationTime stopTime;
+    gchar** argv;
+    /* TRUE if any argument needs a per-host substitution */
+    gboolean hasSubstitutions;
+    gchar** envv;
+    gboolean elidePayloads;
+    gboolean traceSyscalls;
+};
+
+/* a process to add to a host once the host is set up */
+typedef struct _ManagerPendingProcess ManagerPendingProcess;
+struct _ManagerPendingProcess {
+    ManagerProcessTemplate* processTemplate;
+    guint64 hostIndex;
+};
+
+typedef struct _ManagerPendingHost ManagerPendingHost;
+struct _ManagerPendingHost {
+    Host* host;
+    /* the ManagerPendingProcess objects, in the order they were added */
+    GQueue* processes;
+};
+
+static void _manager_freePendingProcess(ManagerPendingProcess* proc) {
+    manager_unrefProcessTemplate(proc->processTemplate);
+    g_free(proc);
+}
+
+static void _manager_freePendingHost(ManagerPendingHost* pending) {
+    g_queue_free_full(pending->processes, (GDestroyNotify)_manager_freePendingProcess);
+    g_free(pending);
+}
+
+/* returns our resident set size, or 0 if it's unavailable */
+static guint64 _manager_getResidentBytes() {
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+
+    unsigned long long sizePages = 0, residentPages = 0;
+    int n = fscanf(file, "%llu %llu", &sizePages, &residentPages);
+    fclose(file);
+
+    if (n != 2) {
+        return 0;
+    }
+    return (guint64)residentPages * (guint64)sysconf(_SC_PAGESIZE);
+}
+
 void manager_addNewVirtualHost(Manager* manager, HostParameters* params) {
     MAGIC_ASSERT(manager);
 
+    if (manager->pendingHosts->len == 0) {
+        manager->residentBytesBeforeHosts = _manager_getResidentBytes();
+    }
+
     /* quarks are unique per manager process, so do the conversion here */
     params->id = g_quark_from_string(params->hostname);
     params->nodeSeed = _manager_nextRandomUInt(manager);
 
     Host* host = host_new(params);
-    host_setup(host, manager_getDNS(manager), manager_getTopology(manager),
-               manager_getRawCPUFrequency(manager), manager_getHostsRootPath(manager));
+
+    /* addresses are assigned sequentially, so do this here in the order that hosts are
+     * added, and leave the rest of the setup to the workers in manager_setupHosts() */
+    host_registerAddresses(host, manager_getDNS(manager));
     scheduler_addHost(manager->scheduler, host);
+
+    ManagerPendingHost* pending = g_new0(ManagerPendingHost, 1);
+    pending->host = host;
+    pending->processes = g_queue_new();
+
+    g_ptr_array_add(manager->pendingHosts, pending);
+    g_hash_table_insert(manager->pendingHostsByID, GUINT_TO_POINTER(params->id), pending);
 }
 
 static gchar** _manager_generateEnvv(Manager* manager, InterposeMethod interposeMethod,
@@ -431,33 +617,244 @@ static gchar** _manager_generateEnvv(Manager* manager, InterposeMethod interpose
     return envv;
 }
 
-void manager_addNewVirtualProcess(Manager* manager, const gchar* hostName, gchar* pluginPath,
-                                  SimulationTime startTime, SimulationTime stopTime, gchar** argv,
-                                  char* environment) {
+ManagerProcessTemplate* manager_newProcessTemplate(Manager* manager, const gchar* pluginPath,
+                                                   SimulationTime startTime,
+                                                   SimulationTime stopTime, gchar** argv,
+                                                   const gchar* environment,
+                                                   gboolean elidePayloads,
+                                                   gboolean traceSyscalls) {
+    MAGIC_ASSERT(manager);
+
+    ManagerProcessTemplate* processTemplate = g_new0(ManagerProcessTemplate, 1);
+    processTemplate->referenceCount = 1;
+    processTemplate->pluginPath = g_strdup(pluginPath);
+    processTemplate->pluginName = g_path_get_basename(pluginPath);
+    if (processTemplate->pluginName == NULL) {
+        utility_panic("Could not get basename of plugin path");
+    }
+    processTemplate->startTime = startTime;
+    processTemplate->stopTime = stopTime;
+    processTemplate->argv = g_strdupv(argv);
+    processTemplate->elidePayloads = elidePayloads;
+    processTemplate->traceSyscalls = traceSyscalls;
+
+    for (gint i = 0; argv[i] != NULL; i++) {
+        if (strstr(argv[i], "{hostname}") || strstr(argv[i], "{index}")) {
+            processTemplate->hasSubstitutions = TRUE;
+            break;
+        }
+    }
+
+    processTemplate->envv = _manager_generateEnvv(
+        manager, config_getInterposeMethod(manager->config), manager->preloadShimPath,
+        environment);
+
+    return processTemplate;
+}
+
+void manager_refProcessTemplate(ManagerProcessTemplate* processTemplate) {
+    utility_assert(processTemplate);
+    g_atomic_int_inc(&processTemplate->referenceCount);
+}
+
+void manager_unrefProcessTemplate(ManagerProcessTemplate* processTemplate) {
+    utility_assert(processTemplate);
+    if (g_atomic_int_dec_and_test(&processTemplate->referenceCount)) {
+        g_free(processTemplate->pluginPath);
+        g_free(processTemplate->pluginName);
+        g_strfreev(processTemplate->argv);
+        g_strfreev(processTemplate->envv);
+        g_free(processTemplate);
+    }
+}
+
+static gchar* _manager_replaceAll(const gchar* str, const gchar* pattern,
+                                  const gchar* replacement) {
+    gchar** parts = g_strsplit(str, pattern, -1);
+    gchar* result = g_strjoinv(replacement, parts);
+    g_strfreev(parts);
+    return result;
+}
+
+/* returns a copy of the template's arguments with the per-host values filled in */
+static gchar** _manager_substituteArgs(ManagerProcessTemplate* processTemplate,
+                                       const gchar* hostName, guint64 hostIndex) {
+    gchar* indexStr = g_strdup_printf("%" G_GUINT64_FORMAT, hostIndex);
+
+    guint argc = g_strv_length(processTemplate->argv);
+    gchar** argv = g_new0(gchar*, argc + 1);
+
+    for (guint i = 0; i < argc; i++) {
+        gchar* withHostname =
+            _manager_replaceAll(processTemplate->argv[i], "{hostname}", hostName);
+        argv[i] = _manager_replaceAll(withHostname, "{index}", indexStr);
+        g_free(withHostname);
+    }
+
+    g_free(indexStr);
+    return argv;
+}
+
+static void _manager_addProcessToHost(Manager* manager, Host* host,
+                                      ManagerProcessTemplate* processTemplate, guint64 hostIndex) {
+    MAGIC_ASSERT(manager);
+
+    InterposeMethod interposeMethod = config_getInterposeMethod(manager->config);
+
+    /* the process takes ownership of the environment and adds to it, so it gets a copy */
+    gchar** envv = g_strdupv(processTemplate->envv);
+
+    /* the process copies the arguments, so we only need our own copy if they differ
+     * from the template's */
+    gchar** argv = processTemplate->argv;
+    if (processTemplate->hasSubstitutions) {
+        argv = _manager_substituteArgs(processTemplate, host_getName(host), hostIndex);
+    }
+
+    host_continueExecutionTimer(host);
+
+    host_addApplication(host, processTemplate->startTime, processTemplate->stopTime,
+                        interposeMethod, processTemplate->pluginName,
+                        processTemplate->pluginPath, envv, argv,
+                        processTemplate->elidePayloads, processTemplate->traceSyscalls);
+
+    host_stopExecutionTimer(host);
+
+    if (argv != processTemplate->argv) {
+        g_strfreev(argv);
+    }
+}
+
+void manager_addNewVirtualProcess(Manager* manager, const gchar* hostName, guint64 hostIndex,
+                                  ManagerProcessTemplate* processTemplate) {
     MAGIC_ASSERT(manager);
 
     /* quarks are unique per process, so do the conversion here */
     GQuark hostID = g_quark_from_string(hostName);
 
-    InterposeMethod interposeMethod = config_getInterposeMethod(manager->config);
+    /* processes need the host's data directory, so wait until the host is set up */
+    ManagerPendingHost* pending =
+        g_hash_table_lookup(manager->pendingHostsByID, GUINT_TO_POINTER(hostID));
+    if (pending) {
+        ManagerPendingProcess* proc = g_new0(ManagerPendingProcess, 1);
+        manager_refProcessTemplate(processTemplate);
+        proc->processTemplate = processTemplate;
+        proc->hostIndex = hostIndex;
+        g_queue_push_tail(pending->processes, proc);
+        return;
+    }
 
-    /* ownership is passed to the host/process below, so we don't free these */
-    gchar** envv = _manager_generateEnvv(
-        manager, interposeMethod, manager->preloadShimPath, environment);
+    Host* host = scheduler_getHost(manager->scheduler, hostID);
+    _manager_addProcessToHost(manager, host, processTemplate, hostIndex);
+}
+
+void manager_addNewTrafficModel(Manager* manager, const gchar* hostName,
+                                TrafficModelParameters* params) {
+    MAGIC_ASSERT(manager);
 
+    /* unlike processes, the model doesn't need the host to be set up first */
+    GQuark hostID = g_quark_from_string(hostName);
     Host* host = scheduler_getHost(manager->scheduler, hostID);
-    host_continueExecutionTimer(host);
+    host_addTrafficModel(host, params);
+}
 
-    gchar* pluginName = g_path_get_basename(pluginPath);
-    if (pluginName == NULL) {
-        utility_panic("Could not get basename of plugin path");
+gboolean manager_addBackgroundFlow(Manager* manager, const gchar* sourceName,
+                                   const gchar* destinationName, guint64 rateKiBps,
+                                   SimulationTime startTime, SimulationTime stopTime) {
+    MAGIC_ASSERT(manager);
+
+    Host* source = scheduler_getHost(manager->scheduler, g_quark_try_string(sourceName));
+    Host* destination =
+        scheduler_getHost(manager->scheduler, g_quark_try_string(destinationName));
+    if (!source || !destination) {
+        return FALSE;
     }
 
-    host_addApplication(
-        host, startTime, stopTime, interposeMethod, pluginName, pluginPath, envv, argv);
-    g_free(pluginName);
+    if (!manager->backgroundFlows) {
+        manager->backgroundFlows = fluidflows_new();
+    }
+    fluidflows_add(manager->backgroundFlows, source, destination, rateKiBps, startTime, stopTime);
+    return TRUE;
+}
 
-    host_stopExecutionTimer(host);
+void manager_applyBackgroundFlows(Manager* manager) {
+    MAGIC_ASSERT(manager);
+
+    if (manager->backgroundFlows) {
+        fluidflows_apply(manager->backgroundFlows);
+        fluidflows_free(manager->backgroundFlows);
+        manager->backgroundFlows = NULL;
+    }
+}
+
+static void _manager_setupHostsWorkerTaskFn(void* voidManager) {
+    Manager* manager = voidManager;
+    MAGIC_ASSERT(manager);
+
+    Topology* topology = manager_getTopology(manager);
+    guint rawCPUFreq = manager_getRawCPUFrequency(manager);
+    const gchar* hostsRootPath = manager_getHostsRootPath(manager);
+
+    /* each worker takes hosts from the shared list until none are left. the setup of
+     * each host only depends on the host's own random source, so the order doesn't
+     * affect the simulation. */
+    while (TRUE) {
+        guint i = __atomic_fetch_add(&manager->nextPendingHost, 1, __ATOMIC_RELAXED);
+        if (i >= manager->pendingHosts->len) {
+            break;
+        }
+
+        ManagerPendingHost* pending = g_ptr_array_index(manager->pendingHosts, i);
+        host_setup(pending->host, topology, rawCPUFreq, hostsRootPath);
+
+        ManagerPendingProcess* proc = NULL;
+        while ((proc = g_queue_pop_head(pending->processes)) != NULL) {
+            _manager_addProcessToHost(
+                manager, pending->host, proc->processTemplate, proc->hostIndex);
+            _manager_freePendingProcess(proc);
+        }
+    }
+}
+
+void manager_setupHosts(Manager* manager) {
+    MAGIC_ASSERT(manager);
+
+    guint nHosts = manager->pendingHosts->len;
+    info("setting up %u hosts", nHosts);
+
+    /* the workers set up the hosts and their processes in parallel. this happens before
+     * the scheduler starts, so the workers aren't doing anything else. */
+    WorkerPool* pool = scheduler_getWorkerPool(manager->scheduler);
+    manager->nextPendingHost = 0;
+    workerpool_startTaskFn(pool, _manager_setupHostsWorkerTaskFn, manager);
+    workerpool_awaitTaskFn(pool);
+
+    for (guint i = 0; i < nHosts; i++) {
+        ManagerPendingHost* pending = g_ptr_array_index(manager->pendingHosts, i);
+        controller_updateMaxLookahead(manager->controller, host_getLookahead(pending->host));
+        _manager_freePendingHost(pending);
+    }
+
+    g_ptr_array_set_size(manager->pendingHosts, 0);
+    g_hash_table_remove_all(manager->pendingHostsByID);
+
+    info("%u hosts are set up", nHosts);
+
+    /* this includes the processes' state in shadow, but not the plugins, which haven't
+     * been launched yet */
+    guint64 residentBytes = _manager_getResidentBytes();
+    if (nHosts > 0 && residentBytes > manager->residentBytesBeforeHosts &&
+        manager->residentBytesBeforeHosts > 0) {
+        guint64 hostBytes = residentBytes - manager->residentBytesBeforeHosts;
+        info("hosts use %" G_GUINT64_FORMAT " bytes of shadow's memory, about %" G_GUINT64_FORMAT
+             " bytes per host",
+             hostBytes, hostBytes / nHosts);
+    }
+}
+
+FileCache* manager_getFileCache(Manager* manager) {
+    MAGIC_ASSERT(manager);
+    return manager->fileCache;
 }
 
 DNS* manager_getDNS(Manager* manager) {
@@ -512,13 +909,62 @@ void manager_updateMinTimeJump(Manager* manager, gdouble minPathLatency) {
     _manager_unlock(manager);
 }
 
+/* the state of the simulation that we log in each heartbeat */
+typedef struct _ManagerHeartbeat ManagerHeartbeat;
+struct _ManagerHeartbeat {
+    /* simulated seconds per wall clock second since the last heartbeat */
+    gdouble realTimeFactor;
+    gint64 numPendingEvents;
+    gint64 numLivePackets;
+    gint64 numLivePayloads;
+    gint64 livePayloadBytes;
+    gsize numCachedPaths;
+    ShMemAllocatorStats shmem;
+};
+
+/* Collects the heartbeat from counters that the subsystems keep up to date, so it's cheap
+ * to call while the workers are running. */
+static ManagerHeartbeat _manager_collectHeartbeat(Manager* manager, SimulationTime simClockNow,
+                                                  gint64 wallClockNow) {
+    WorkerPool* pool = scheduler_getWorkerPool(manager->scheduler);
+    Topology* topology = manager_getTopology(manager);
+
+    gdouble simSeconds =
+        ((gdouble)(simClockNow - manager->simClockLastHeartbeat)) / SIMTIME_ONE_SECOND;
+    gdouble wallSeconds =
+        ((gdouble)(wallClockNow - manager->wallClockLastHeartbeat)) / G_USEC_PER_SEC;
+
+    return (ManagerHeartbeat){
+        .realTimeFactor = wallSeconds > 0 ? simSeconds / wallSeconds : 0,
+        .numPendingEvents = workerpool_getGauge(pool, WORKER_GAUGE_EVENTS),
+        .numLivePackets = workerpool_getGauge(pool, WORKER_GAUGE_PACKETS),
+        .numLivePayloads = workerpool_getGauge(pool, WORKER_GAUGE_PAYLOADS),
+        .livePayloadBytes = workerpool_getGauge(pool, WORKER_GAUGE_PAYLOAD_BYTES),
+        .numCachedPaths = topology ? topology_getNumCachedPaths(topology) : 0,
+        .shmem = shmemallocator_getStats(shmemallocator_getGlobal()),
+    };
+}
+
 static void _manager_heartbeat(Manager* manager, SimulationTime simClockNow) {
     MAGIC_ASSERT(manager);
 
     SimulationTime heartbeatInterval = config_getHeartbeatInterval(manager->config);
 
     if (simClockNow > (manager->simClockLastHeartbeat + heartbeatInterval)) {
-        manager->simClockLastHeartbeat = simClockNow;
+        gint64 wallClockNow = g_get_monotonic_time();
+        ManagerHeartbeat heartbeat = _manager_collectHeartbeat(manager, simClockNow, wallClockNow);
+        __atomic_store_n(&manager->simClockLastHeartbeat, simClockNow, __ATOMIC_RELAXED);
+        manager->wallClockLastHeartbeat = wallClockNow;
+
+        info("manager heartbeat at simtime %" G_GUINT64_FORMAT ": realtime-factor=%f "
+             "pending-events=%" G_GINT64_FORMAT " live-packets=%" G_GINT64_FORMAT
+             " live-payloads=%" G_GINT64_FORMAT " live-payload-bytes=%" G_GINT64_FORMAT
+             " cached-paths=%zu shmem-pools=%zu shmem-pool-bytes=%zu shmem-used-bytes=%zu "
+             "shmem-big-bytes=%zu",
+             simClockNow, heartbeat.realTimeFactor, heartbeat.numPendingEvents,
+             heartbeat.numLivePackets, heartbeat.numLivePayloads, heartbeat.livePayloadBytes,
+             heartbeat.numCachedPaths, heartbeat.shmem.npools, heartbeat.shmem.pool_nbytes,
+             heartbeat.shmem.little_alloc_nbytes, heartbeat.shmem.big_alloc_nbytes);
 
         struct rusage resources;
         if (!getrusage(RUSAGE_SELF, &resources)) {
@@ -537,7 +983,184 @@ static void _manager_heartbeat(Manager* manager, SimulationTime simClockNow) {
             warning("unable to print process resources usage: error %i in getrusage: %s", errno,
                     g_strerror(errno));
         }
+
+        if (config_getUseKsm(manager->config)) {
+            /* the counters cover every process on the machine, but the plugins usually dominate */
+            guint64 pagesShared = _manager_readKsmCounter("pages_shared");
+            guint64 pagesSharing = _manager_readKsmCounter("pages_sharing");
+            info("kernel samepage merging at simtime %" G_GUINT64_FORMAT
+                 ": pages-shared=%" G_GUINT64_FORMAT " pages-sharing=%" G_GUINT64_FORMAT
+                 " saved-bytes=%" G_GUINT64_FORMAT,
+                 simClockNow, pagesShared, pagesSharing,
+                 pagesSharing * (guint64)sysconf(_SC_PAGESIZE));
+        }
+    }
+}
+
+/* the number of hosts, by the number of events they created, in the metrics */
+#define MANAGER_METRICS_TOP_HOSTS 10
+
+typedef struct _ManagerTopHosts ManagerTopHosts;
+struct _ManagerTopHosts {
+    Host* hosts[MANAGER_METRICS_TOP_HOSTS];
+    guint64 numEvents[MANAGER_METRICS_TOP_HOSTS];
+    guint length;
+};
+
+static void _manager_addTopHost(Host* host, ManagerTopHosts* top) {
+    guint64 numEvents = host_getNumEventsCreated(host);
+
+    if (top->length == MANAGER_METRICS_TOP_HOSTS &&
+        numEvents <= top->numEvents[MANAGER_METRICS_TOP_HOSTS - 1]) {
+        return;
+    }
+
+    /* insert into the sorted list, dropping the last host if it's full */
+    guint i = MIN(top->length, MANAGER_METRICS_TOP_HOSTS - 1);
+    while (i > 0 && top->numEvents[i - 1] < numEvents) {
+        top->hosts[i] = top->hosts[i - 1];
+        top->numEvents[i] = top->numEvents[i - 1];
+        i--;
     }
+    top->hosts[i] = host;
+    top->numEvents[i] = numEvents;
+    top->length = MIN(top->length + 1, MANAGER_METRICS_TOP_HOSTS);
+}
+
+static void _manager_appendMetricHeader(GString* out, const gchar* name, const gchar* type,
+                                        const gchar* help) {
+    g_string_append_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void _manager_appendMetric(GString* out, const gchar* name, const gchar* type,
+                                  const gchar* help, gdouble value) {
+    _manager_appendMetricHeader(out, name, type, help);
+    g_string_append_printf(out, "%s %.17g\n", name, value);
+}
+
+/* Appends the metrics for the control socket. Called from the manager thread in between
+ * rounds, so we can read the state of the workers and hosts. */
+static void _manager_appendMetrics(gpointer voidManager, GString* out) {
+    Manager* manager = voidManager;
+    MAGIC_ASSERT(manager);
+
+    gint64 wallClockNow = g_get_monotonic_time();
+    gdouble wallSeconds = ((gdouble)(wallClockNow - manager->wallClockRunStart)) / G_USEC_PER_SEC;
+    gdouble simSeconds = ((gdouble)manager->windowStart) / SIMTIME_ONE_SECOND;
+
+    _manager_appendMetric(out, "shadow_window_start_seconds", "gauge",
+                          "Simulated time at the start of the current scheduling window.",
+                          simSeconds);
+    _manager_appendMetric(out, "shadow_window_end_seconds", "gauge",
+                          "Simulated time at the end of the current scheduling window.",
+                          ((gdouble)manager->windowEnd) / SIMTIME_ONE_SECOND);
+    _manager_appendMetric(out, "shadow_run_seconds", "counter",
+                          "Wall clock time since the simulation started running.", wallSeconds);
+    _manager_appendMetric(out, "shadow_realtime_factor", "gauge",
+                          "Simulated seconds per wall clock second since the simulation "
+                          "started running.",
+                          wallSeconds > 0 ? simSeconds / wallSeconds : 0);
+
+    Scheduler* scheduler = manager->scheduler;
+    _manager_appendMetric(out, "shadow_rounds_total", "counter",
+                          "Scheduling rounds that have finished.",
+                          scheduler_getNumRounds(scheduler));
+    _manager_appendMetric(out, "shadow_round_seconds_total", "counter",
+                          "Wall clock time spent running scheduling rounds.",
+                          ((gdouble)scheduler_getRoundNanos(scheduler)) / SIMTIME_ONE_SECOND);
+
+    WorkerPool* pool = scheduler_getWorkerPool(scheduler);
+    guint nWorkers = workerpool_getNWorkers(pool);
+
+    _manager_appendMetricHeader(out, "shadow_worker_busy_seconds_total", "counter",
+                                "Wall clock time that each worker spent running events. Divide "
+                                "by shadow_round_seconds_total for the worker's utilization.");
+    for (guint i = 0; i < nWorkers; i++) {
+        guint64 numEvents = 0, busyNanos = 0;
+        scheduler_getWorkerTotals(scheduler, i, &numEvents, &busyNanos);
+        g_string_append_printf(out, "shadow_worker_busy_seconds_total{worker=\"%u\"} %.17g\n",
+                               i, ((gdouble)busyNanos) / SIMTIME_ONE_SECOND);
+    }
+    _manager_appendMetricHeader(
+        out, "shadow_worker_events_total", "counter", "Events that each worker ran.");
+    for (guint i = 0; i < nWorkers; i++) {
+        guint64 numEvents = 0, busyNanos = 0;
+        scheduler_getWorkerTotals(scheduler, i, &numEvents, &busyNanos);
+        g_string_append_printf(out,
+                               "shadow_worker_events_total{worker=\"%u\"} %" G_GUINT64_FORMAT
+                               "\n",
+                               i, numEvents);
+    }
+
+    ManagerTopHosts top = {0};
+    scheduler_foreachHost(scheduler, (GFunc)_manager_addTopHost, &top);
+    _manager_appendMetricHeader(out, "shadow_host_events_total", "counter",
+                                "Events created by the hosts that created the most events.");
+    for (guint i = 0; i < top.length; i++) {
+        g_string_append_printf(out,
+                               "shadow_host_events_total{host=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                               host_getName(top.hosts[i]), top.numEvents[i]);
+    }
+
+    ManagerHeartbeat heartbeat =
+        _manager_collectHeartbeat(manager, manager->windowStart, wallClockNow);
+    _manager_appendMetric(out, "shadow_pending_events", "gauge", "Events that are queued to run.",
+                          heartbeat.numPendingEvents);
+    _manager_appendMetric(out, "shadow_live_packets", "gauge", "Packets that haven't been freed.",
+                          heartbeat.numLivePackets);
+    _manager_appendMetric(out, "shadow_live_payloads", "gauge",
+                          "Packet payloads that haven't been freed.", heartbeat.numLivePayloads);
+    _manager_appendMetric(out, "shadow_live_payload_bytes", "gauge",
+                          "Bytes of packet payloads that haven't been freed.",
+                          heartbeat.livePayloadBytes);
+    _manager_appendMetric(out, "shadow_cached_paths", "gauge",
+                          "Paths between network vertices that are cached.",
+                          heartbeat.numCachedPaths);
+    _manager_appendMetric(out, "shadow_shmem_pool_bytes", "gauge",
+                          "Shared memory mapped for pools of small blocks.",
+                          heartbeat.shmem.pool_nbytes);
+    _manager_appendMetric(out, "shadow_shmem_used_bytes", "gauge",
+                          "Shared memory allocated from the pools of small blocks.",
+                          heartbeat.shmem.little_alloc_nbytes);
+    _manager_appendMetric(out, "shadow_shmem_big_bytes", "gauge",
+                          "Shared memory mapped for large blocks.",
+                          heartbeat.shmem.big_alloc_nbytes);
+
+    struct rusage resources;
+    if (!getrusage(RUSAGE_SELF, &resources)) {
+        _manager_appendMetric(out, "shadow_max_rss_bytes", "gauge",
+                              "Maximum resident set size of the shadow process.",
+                              ((gdouble)resources.ru_maxrss) * 1024);
+    }
+}
+
+/* Stops the whole shadow process until it receives SIGCONT, so that it can be checkpointed
+ * from outside. Called between rounds, when the workers are waiting for the next round
+ * and every plugin is blocked waiting for shadow. */
+static void _manager_pauseForCheckpoint(Manager* manager, SimulationTime simClockNow) {
+    MAGIC_ASSERT(manager);
+
+    if (config_getInterposeMethod(manager->config) != INTERPOSE_METHOD_PRELOAD) {
+        warning("plugins may still be traced by shadow, which prevents most tools from "
+                "checkpointing them; use the preload interpose method for checkpointing");
+    }
+
+    info("pausing at simulated time %f seconds; send SIGCONT to process %d to continue",
+         ((gdouble)simClockNow) / SIMTIME_ONE_SECOND, (gint)getpid());
+    logger_flush(logger_getDefault());
+
+    gint64 wallClockPauseStart = g_get_monotonic_time();
+    if (raise(SIGSTOP) != 0) {
+        warning("unable to stop for the checkpoint: %s", g_strerror(errno));
+        return;
+    }
+
+    /* don't count the pause in the heartbeat's wall clock times */
+    gint64 pausedMicros = g_get_monotonic_time() - wallClockPauseStart;
+    manager->wallClockRunStart += pausedMicros;
+    manager->wallClockLastHeartbeat += pausedMicros;
+
+    info("continuing after pausing for %f seconds", ((gdouble)pausedMicros) / G_USEC_PER_SEC);
 }
 
 void manager_run(Manager* manager) {
@@ -549,9 +1172,20 @@ void manager_run(Manager* manager) {
     gboolean keepRunning = TRUE;
 
     scheduler_start(manager->scheduler);
+    manager->wallClockRunStart = g_get_monotonic_time();
+    manager->wallClockLastHeartbeat = manager->wallClockRunStart;
+
+    char* controlSocketPath = config_getControlSocket(manager->config);
+    if (controlSocketPath) {
+        manager->controlServer =
+            controlserver_new(controlSocketPath, _manager_appendMetrics, manager);
+        config_freeString(controlSocketPath);
+    }
 
     while (keepRunning) {
         /* release the workers and run next round */
+        manager->windowStart = windowStart;
+        manager->windowEnd = windowEnd;
         scheduler_continueNextRound(manager->scheduler, windowStart, windowEnd);
 
         /* do some idle processing here if needed */
@@ -562,6 +1196,20 @@ void manager_run(Manager* manager) {
          */
         minNextEventTime = scheduler_awaitNextRound(manager->scheduler);
 
+        /* the workers may have started more rounds on their own */
+        windowStart = manager->windowStart;
+        windowEnd = manager->windowEnd;
+
+        /* the workers are idle, so we can look at their state to answer requests */
+        if (manager->controlServer) {
+            controlserver_poll(manager->controlServer);
+        }
+
+        if (manager->pauseTime != 0 && windowEnd >= manager->pauseTime) {
+            manager->pauseTime = 0;
+            _manager_pauseForCheckpoint(manager, windowEnd);
+        }
+
         /* we are in control now, the workers are waiting for the next round */
         debug("finished execution window [%" G_GUINT64_FORMAT "--%" G_GUINT64_FORMAT
               "] next event at %" G_GUINT64_FORMAT,
@@ -570,12 +1218,48 @@ void manager_run(Manager* manager) {
         /* notify controller that we finished this round, and the time of our
          * next event in order to fast-forward our execute window if possible */
         keepRunning = controller_managerFinishedCurrentRound(
-            manager->controller, minNextEventTime, &windowStart, &windowEnd);
+            manager->controller, minNextEventTime, scheduler_getNextSendTime(manager->scheduler),
+            &windowStart, &windowEnd);
     }
 
+    g_clear_pointer(&manager->controlServer, controlserver_free);
+
     scheduler_finish(manager->scheduler);
 }
 
+gboolean manager_tryContinueNextRound(Manager* manager, SimulationTime minNextEventTime,
+                                      SimulationTime* windowStart, SimulationTime* windowEnd) {
+    MAGIC_ASSERT(manager);
+
+    /* these need the manager thread, which does them in between rounds */
+    if (manager->controlServer ||
+        (manager->pauseTime != 0 && manager->windowEnd >= manager->pauseTime)) {
+        return FALSE;
+    }
+
+    debug("finished execution window [%" G_GUINT64_FORMAT "--%" G_GUINT64_FORMAT
+          "] next event at %" G_GUINT64_FORMAT,
+          manager->windowStart, manager->windowEnd, minNextEventTime);
+
+    _manager_lock(manager);
+    gboolean keepRunning = controller_managerFinishedCurrentRound(
+        manager->controller, minNextEventTime, scheduler_getNextSendTime(manager->scheduler),
+        windowStart, windowEnd);
+    _manager_unlock(manager);
+
+    /* the manager thread logs the heartbeat when it starts the round */
+    SimulationTime heartbeatInterval = config_getHeartbeatInterval(manager->config);
+    SimulationTime lastHeartbeat =
+        __atomic_load_n(&manager->simClockLastHeartbeat, __ATOMIC_RELAXED);
+    if (!keepRunning || *windowStart > lastHeartbeat + heartbeatInterval) {
+        return FALSE;
+    }
+
+    manager->windowStart = *windowStart;
+    manager->windowEnd = *windowEnd;
+    return TRUE;
+}
+
 void manager_incrementPluginError(Manager* manager) {
     MAGIC_ASSERT(manager);
     _manager_lock(manager);
@@ -588,6 +1272,11 @@ const gchar* manager_getHostsRootPath(Manager* manager) {
     return manager->hostsPath;
 }
 
+const gchar* manager_getDataPath(Manager* manager) {
+    MAGIC_ASSERT(manager);
+    return manager->dataPath;
+}
+
 static void _manager_increment_object_counts(Manager* manager, Counter** mgr_obj_counts,
                                              const char* obj_name) {
     _manager_lock(manager);
@@ -656,6 +1345,22 @@ void manager_add_syscall_counts_global(Counter* syscall_counts) {
     }
 }
 
+void manager_add_profile_counts(Manager* manager, Counter* profile_counts) {
+    MAGIC_ASSERT(manager);
+    _manager_lock(manager);
+    if (!manager->profile_counter) {
+        manager->profile_counter = counter_new();
+    }
+    counter_add_counter(manager->profile_counter, profile_counts);
+    _manager_unlock(manager);
+}
+
+void manager_add_profile_counts_global(Counter* profile_counts) {
+    if (globalmanager) {
+        manager_add_profile_counts(globalmanager, profile_counts);
+    }
+}
+
 SimulationTime manager_getBootstrapEndTime(Manager* manager) {
     MAGIC_ASSERT(manager);
     return manager->bootstrapEndTime;
@@ -28,10 +28,13 @@
 #include "main/core/controller.h"
 #include "main/core/support/definitions.h"
 #include "main/host/host_parameters.h"
+#include "main/host/descriptor/file_cache.h"
+#include "main/host/traffic_model_types.h"
 #include "main/routing/dns.h"
 #include "main/routing/topology.h"
 
 typedef struct _Manager Manager;
+typedef struct _ManagerProcessTemplate ManagerProcessTemplate;
 
 Manager* manager_new(Controller* controller, ConfigOptions* config, SimulationTime endTime,
                      SimulationTime bootstrapEndTime, guint randomSeed);
@@ -40,6 +43,8 @@ gint manager_free(Manager* manager);
 gboolean manager_isForced(Manager* manager);
 guint manager_getRawCPUFrequency(Manager* manager);
 DNS* manager_getDNS(Manager* manager);
+/* Returns NULL if the file cache is disabled. */
+FileCache* manager_getFileCache(Manager* manager);
 Topology* manager_getTopology(Manager* manager);
 guint32 manager_getNodeBandwidthUp(Manager* manager, GQuark nodeID, in_addr_t ip);
 guint32 manager_getNodeBandwidthDown(Manager* manager, GQuark nodeID, in_addr_t ip);
@@ -49,19 +54,51 @@ SimulationTime manager_getBootstrapEndTime(Manager* manager);
 
 void manager_incrementPluginError(Manager* manager);
 const gchar* manager_getHostsRootPath(Manager* manager);
+const gchar* manager_getDataPath(Manager* manager);
 
 void manager_updateMinTimeJump(Manager* manager, gdouble minPathLatency);
 
 void manager_run(Manager*);
+/* Called by the last worker to finish a round, while the other workers wait, when
+ * the workers start rounds without the manager thread. Returns TRUE with the next
+ * window if the workers can start it right away, or FALSE if the manager thread
+ * has to do something in between the rounds first. */
+gboolean manager_tryContinueNextRound(Manager* manager, SimulationTime minNextEventTime,
+                                      SimulationTime* windowStart, SimulationTime* windowEnd);
 gboolean manager_schedulerIsRunning(Manager* manager);
 
 /* info received from controller to set up the simulation */
 void manager_addNewProgram(Manager* manager, const gchar* name, const gchar* path,
                            const gchar* startSymbol);
 void manager_addNewVirtualHost(Manager* manager, HostParameters* params);
-void manager_addNewVirtualProcess(Manager* manager, const gchar* hostName, gchar* pluginName,
-                                  SimulationTime startTime, SimulationTime stopTime, gchar** argv,
-                                  char* environment);
+/* A process that can be added to many hosts. The arguments and environment are built
+ * once, and any "{hostname}" or "{index}" in the arguments is replaced when the process
+ * is added to a host. The template starts with one reference. */
+ManagerProcessTemplate* manager_newProcessTemplate(Manager* manager, const gchar* pluginPath,
+                                                   SimulationTime startTime,
+                                                   SimulationTime stopTime, gchar** argv,
+                                                   const gchar* environment,
+                                                   gboolean elidePayloads,
+                                                   gboolean traceSyscalls);
+void manager_refProcessTemplate(ManagerProcessTemplate* processTemplate);
+void manager_unrefProcessTemplate(ManagerProcessTemplate* processTemplate);
+/* hostIndex is the host's number within its group, used for "{index}" */
+void manager_addNewVirtualProcess(Manager* manager, const gchar* hostName, guint64 hostIndex,
+                                  ManagerProcessTemplate* processTemplate);
+/* Takes ownership of params. */
+void manager_addNewTrafficModel(Manager* manager, const gchar* hostName,
+                                TrafficModelParameters* params);
+/* Sets up the hosts that were added since the last call, and adds their processes, using
+ * the worker threads. Must be called before the scheduler starts. */
+void manager_setupHosts(Manager* manager);
+/* Adds a background flow between two hosts that are already set up. Returns FALSE if
+ * either host doesn't exist. A stopTime of 0 means that the flow never stops. */
+gboolean manager_addBackgroundFlow(Manager* manager, const gchar* sourceName,
+                                   const gchar* destinationName, guint64 rateKiBps,
+                                   SimulationTime startTime, SimulationTime stopTime);
+/* Hands the hosts the bandwidth that the background flows take from them. Must be
+ * called before the scheduler starts. */
+void manager_applyBackgroundFlows(Manager* manager);
 
 // Increment a global counter for the allocation of the object with the given name.
 // This should be paired with an increment of the dealloc counter with the
@@ -83,4 +120,9 @@ void manager_add_syscall_counts(Manager* manager, Counter* syscall_counts);
 // Add the given syscall counts, used when the worker is no longer alive.
 void manager_add_syscall_counts_global(Counter* syscall_counts);
 
+// Add the given profiled times into a global manager counter.
+void manager_add_profile_counts(Manager* manager, Counter* profile_counts);
+// Add the given profiled times, used when the worker is no longer alive.
+void manager_add_profile_counts_global(Counter* profile_counts);
+
 #endif /* SHD_MANAGER_H_ */
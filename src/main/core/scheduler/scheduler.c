@@ -6,14 +6,19 @@
 
 /* manages the scheduling of events and hosts to threads,
  * following one of several scheduling policies */
+#include <errno.h>
 #include <glib.h>
 #include <math.h>
 #include <pthread.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "lib/logger/logger.h"
 #include "main/bindings/c/bindings.h"
+#include "main/core/manager.h"
 #include "main/core/scheduler/scheduler.h"
 #include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/config_handlers.h"
@@ -21,13 +26,72 @@
 #include "main/core/work/event.h"
 #include "main/core/worker.h"
 #include "main/host/host.h"
+#include "main/routing/address.h"
+#include "main/routing/dns.h"
+#include "main/routing/topology.h"
 #include "main/utility/count_down_latch.h"
 #include "main/utility/random.h"
+#include "main/utility/tracepoint.h"
+#include "main/utility/tree_barrier.h"
 #include "main/utility/utility.h"
 
 static int _parallelism;
 ADD_CONFIG_HANDLER(config_getParallelism, _parallelism)
 
+static bool _usePerHostLookahead = false;
+ADD_CONFIG_HANDLER(config_getUsePerHostLookahead, _usePerHostLookahead)
+
+static bool _useDecoupledRounds = false;
+ADD_CONFIG_HANDLER(config_getUseDecoupledRounds, _useDecoupledRounds)
+
+static bool _usePipelinedWorkers = false;
+ADD_CONFIG_HANDLER(config_getUsePipelinedWorkers, _usePipelinedWorkers)
+
+static bool _precomputePaths = false;
+ADD_CONFIG_HANDLER(config_getPrecomputePaths, _precomputePaths)
+
+static bool _useRoundStats = false;
+ADD_CONFIG_HANDLER(config_getUseRoundStats, _useRoundStats)
+
+static bool _useDeterminismDigest = false;
+ADD_CONFIG_HANDLER(config_getUseDeterminismDigest, _useDeterminismDigest)
+
+static bool _useNUMAPlacement = false;
+ADD_CONFIG_HANDLER(config_getUseNumaPlacement, _useNUMAPlacement)
+
+static bool _useHostPartitioning = false;
+ADD_CONFIG_HANDLER(config_getUseHostPartitioning, _useHostPartitioning)
+
+static bool _useWorkerBarrier = false;
+ADD_CONFIG_HANDLER(config_getUseWorkerBarrier, _useWorkerBarrier)
+
+static guint _hostRebalanceInterval = 0;
+ADD_CONFIG_HANDLER(config_getHostRebalanceInterval, _hostRebalanceInterval)
+
+static bool _useAdaptiveRunahead = false;
+ADD_CONFIG_HANDLER(config_getUseAdaptiveRunahead, _useAdaptiveRunahead)
+
+/* we only build the table of hosts by IP address if it would have at most this many
+ * entries per host, and otherwise fall back to the hash tables */
+#define IP_TABLE_MAX_ENTRIES_PER_HOST 4
+
+#define ROUND_STATS_FILE_NAME "round-stats.csv"
+#define ROUND_DIGESTS_FILE_NAME "determinism-digest.csv"
+#define HOST_DIGESTS_FILE_NAME "determinism-host-digests.csv"
+#define PATH_PACKET_COUNTS_FILE_NAME "path-packet-counts.txt"
+
+/* what one worker did during the current round. each worker only writes its own entry while
+ * running the round, and the scheduler thread only reads them in between rounds. */
+typedef struct _SchedulerWorkerRoundStats SchedulerWorkerRoundStats;
+struct _SchedulerWorkerRoundStats {
+    guint64 numEvents;
+    guint64 numStolenHosts;
+    /* wall time spent popping and running events */
+    guint64 busyNanos;
+    /* the sum of the hashes that host_digestEvent returned for the events */
+    guint64 digest;
+};
+
 struct _Scheduler {
     // Unowned back-pointer.
     Manager* manager;
@@ -44,6 +108,13 @@ struct _Scheduler {
     /* we store the hosts here */
     GHashTable* hostIDToHostMap;
 
+    /* the hosts by IP address, indexed by the host byte order address minus
+     * ipTableBase, or NULL if the addresses are too sparse. built when the scheduler
+     * starts and read-only after that. */
+    SchedulerIPEntry* ipTable;
+    guint32 ipTableBase;
+    guint32 ipTableSize;
+
     /* used to randomize host-to-thread assignment */
     Random* random;
 
@@ -51,15 +122,63 @@ struct _Scheduler {
     gboolean isRunning;
     SimulationTime endTime;
     struct {
+        SimulationTime startTime;
         SimulationTime endTime;
         SimulationTime minNextEventTime;
+        /* with adaptive runahead, the earliest time that a packet sent in the next
+         * round could reach another host */
+        SimulationTime minNextSendTime;
+        /* set when the workers should hand control back to the manager thread
+         * instead of starting the next round themselves */
+        gboolean returnToManager;
+        /* set when some host's heartbeat is due at the start of the round, so the
+         * workers collect the heartbeats before running it */
+        gboolean heartbeatDue;
+        /* set when the policy moved hosts between the workers after the last round, so
+         * each worker detaches from the plugins of the hosts it lost before running it */
+        gboolean hostsMoved;
     } currentRound;
 
+    /* if set, the workers wait for each other at the end of each round, and the last
+     * to finish starts the next round unless the manager thread has work to do */
+    TreeBarrier* roundBarrier;
+
+    /* per-round telemetry, which is cheap enough to always collect */
+    struct {
+        /* arrays of size nWorkers, for the current round and for all rounds */
+        SchedulerWorkerRoundStats* workers;
+        SchedulerWorkerRoundStats* workerTotals;
+        guint nWorkers;
+        /* wall time at which the current round was started */
+        guint64 startNanos;
+        /* the time series of all rounds, if enabled */
+        FILE* file;
+        /* the digest of the events of each round, and of all rounds so far, if enabled */
+        FILE* digestFile;
+        guint64 digest;
+        /* totals over all rounds, for the summary */
+        guint64 numRounds;
+        guint64 numEvents;
+        guint64 numStolenHosts;
+        guint64 numIdleWorkers;
+        guint64 windowNanos;
+        guint64 roundNanos;
+        guint64 awaitNanos;
+        guint64 busyNanos;
+        guint64 maxBusyNanos;
+    } roundStats;
+
     /* for memory management */
     gint referenceCount;
     MAGIC_DECLARE;
 };
 
+static guint64 _scheduler_nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (guint64)now.tv_sec * SIMTIME_ONE_SECOND + (guint64)now.tv_nsec;
+}
+
 static void _scheduler_startHostsWorkerTaskFn(void* voidScheduler) {
     Scheduler* scheduler = voidScheduler;
     MAGIC_ASSERT(scheduler);
@@ -74,23 +193,96 @@ static void _scheduler_startHostsWorkerTaskFn(void* voidScheduler) {
     }
 }
 
-static void _scheduler_runEventsWorkerTaskFn(void* voidScheduler) {
+static void _scheduler_heartbeatWorkerTaskFn(void* voidScheduler) {
+    Scheduler* scheduler = voidScheduler;
+    MAGIC_ASSERT(scheduler);
+
+    GQueue* myHosts = NULL;
+    if (scheduler->policy->getAssignedHosts) {
+        myHosts = scheduler->policy->getAssignedHosts(scheduler->policy);
+    }
+    worker_heartbeatHosts(myHosts, scheduler->currentRound.startTime);
+}
+
+static void _scheduler_detachMovedHostsWorkerTaskFn(void* voidScheduler) {
     Scheduler* scheduler = voidScheduler;
+    MAGIC_ASSERT(scheduler);
+    scheduler->policy->detachMovedHosts(scheduler->policy);
+}
 
-    // Reset the round end time before starting the new round.
-    worker_setRoundEndTime(scheduler->currentRound.endTime);
+static void _scheduler_precomputePathsWorkerTaskFn(void* voidScheduler) {
+    // Each worker takes source vertices from a shared list until none are left.
+    topology_precomputePaths(worker_getTopology());
+}
+
+static void _scheduler_runRound(Scheduler* scheduler) {
+    guint64 startNanos = _scheduler_nowNanos();
+
+    // Reset the round end time before starting the new round. With per-host
+    // lookahead or decoupled rounds, hosts stop at different times, so
+    // scheduler_push() does the filtering for the next round's min time instead.
+    if (scheduler->policy->usePerHostLookahead || scheduler->policy->useDecoupledRounds) {
+        worker_setRoundEndTime(scheduler->currentRound.startTime);
+    } else {
+        worker_setRoundEndTime(scheduler->currentRound.endTime);
+    }
 
+    guint64 numEvents = 0;
+    guint64 digest = 0;
     Event* event = NULL;
     while ((event = scheduler->policy->pop(
                 scheduler->policy, scheduler->currentRound.endTime)) != NULL) {
+        TRACEPOINT(scheduler_pop, host_getID(event_getHost(event)), event_getTime(event));
+        if (_useDeterminismDigest) {
+            digest += host_digestEvent(event_getHost(event), event_getTime(event),
+                                       event_getSrcHostID(event), event_getSrcHostEventID(event));
+        }
         worker_runEvent(event);
+        numEvents++;
+    }
+
+    if (scheduler->policy->useDecoupledRounds) {
+        // Decoupled rounds also need to know which host has the earliest event.
+        Host* minQHost = NULL;
+        SimulationTime otherMinQTime = SIMTIME_MAX;
+        SimulationTime minQTime =
+            scheduler->policy->getNextHostTime(scheduler->policy, &minQHost, &otherMinQTime);
+        worker_setMinEventTimeNextRoundForHost(minQHost, minQTime);
+        worker_setMinEventTimeNextRoundForHost(NULL, otherMinQTime);
+    } else {
+        // Gets the time of the event at the head of the event queue right now.
+        SimulationTime minQTime = scheduler->policy->getNextTime(scheduler->policy);
+
+        // We'll compute the global min time across all workers.
+        worker_setMinEventTimeNextRound(minQTime);
+    }
+
+    if (_useAdaptiveRunahead) {
+        worker_setMinSendTimeNextRound(scheduler->policy->getNextSendTime(scheduler->policy));
     }
 
-    // Gets the time of the event at the head of the event queue right now.
-    SimulationTime minQTime = scheduler->policy->getNextTime(scheduler->policy);
+    // No need to lock: only this worker writes to its entry during the round.
+    SchedulerWorkerRoundStats* stats = &scheduler->roundStats.workers[worker_threadID()];
+    stats->numEvents = numEvents;
+    stats->numStolenHosts = scheduler->policy->takeStolenHostCount
+                                ? scheduler->policy->takeStolenHostCount(scheduler->policy)
+                                : 0;
+    stats->busyNanos = _scheduler_nowNanos() - startNanos;
+    stats->digest = digest;
+}
+
+static void _scheduler_runEventsWorkerTaskFn(void* voidScheduler) {
+    _scheduler_runRound(voidScheduler);
+}
+
+static void _scheduler_killProcessesTaskFn(void* voidScheduler) {
+    Scheduler* scheduler = voidScheduler;
 
-    // We'll compute the global min time across all workers.
-    worker_setMinEventTimeNextRound(minQTime);
+    GQueue* myHosts = NULL;
+    if (scheduler->policy->getAssignedHosts) {
+        myHosts = scheduler->policy->getAssignedHosts(scheduler->policy);
+    }
+    worker_killHostProcesses(myHosts);
 }
 
 static void _scheduler_finishTaskFn(void* voidScheduler) {
@@ -114,6 +306,10 @@ static void _scheduler_finishTaskFn(void* voidScheduler) {
     worker_finish(myHosts);
 }
 
+static void _scheduler_flushPathPacketCountsTaskFn(void* voidScheduler) {
+    worker_flushPathPacketCounts();
+}
+
 Scheduler* scheduler_new(Manager* manager, SchedulerPolicyType policyType,
                          guint nWorkers, guint schedulerSeed,
                          SimulationTime endTime) {
@@ -129,12 +325,27 @@ Scheduler* scheduler_new(Manager* manager, SchedulerPolicyType policyType,
     scheduler->workerPool = workerpool_new(manager, scheduler, /*nThreads=*/nWorkers,
                                            /*nParallel=*/_parallelism);
 
+    if (_useWorkerBarrier) {
+        if (nWorkers > _parallelism) {
+            // Workers that share a logical processor run one after the other, so
+            // they can't all wait for each other at the same time.
+            warning("Ignoring experimental.use_worker_barrier, which needs a logical "
+                    "processor for each worker thread");
+        } else {
+            scheduler->roundBarrier = treebarrier_new(nWorkers);
+        }
+    }
+
     scheduler->endTime = endTime;
     scheduler->currentRound.endTime = scheduler->endTime;// default to one single round
     scheduler->currentRound.minNextEventTime = SIMTIME_MAX;
 
     scheduler->hostIDToHostMap = g_hash_table_new(g_direct_hash, g_direct_equal);
 
+    scheduler->roundStats.nWorkers = nWorkers;
+    scheduler->roundStats.workers = g_new0(SchedulerWorkerRoundStats, nWorkers);
+    scheduler->roundStats.workerTotals = g_new0(SchedulerWorkerRoundStats, nWorkers);
+
     scheduler->random = random_new(schedulerSeed);
 
     utility_assert(nWorkers >= 1);
@@ -146,7 +357,8 @@ Scheduler* scheduler_new(Manager* manager, SchedulerPolicyType policyType,
             scheduler->policy = schedulerpolicyhostsingle_new();
             break;
         }
-        case SP_PARALLEL_HOST_STEAL: {
+        case SP_PARALLEL_HOST_STEAL:
+        case SP_PARALLEL_HOST_STEAL_INBOX: {
             if (nWorkers > _parallelism) {
                 // Proceeding will cause the scheduler to deadlock, since the
                 // work stealing scheduler threads spin-wait for each-other to
@@ -155,7 +367,11 @@ Scheduler* scheduler_new(Manager* manager, SchedulerPolicyType policyType,
                       "--parallelism");
                 exit(1);
             }
-            scheduler->policy = schedulerpolicyhoststeal_new();
+            if (scheduler->policyType == SP_PARALLEL_HOST_STEAL_INBOX) {
+                scheduler->policy = schedulerpolicyhoststealinbox_new();
+            } else {
+                scheduler->policy = schedulerpolicyhoststeal_new();
+            }
             break;
         }
         case SP_PARALLEL_THREAD_SINGLE: {
@@ -173,6 +389,62 @@ Scheduler* scheduler_new(Manager* manager, SchedulerPolicyType policyType,
     }
     utility_assert(scheduler->policy);
 
+    if (_usePerHostLookahead) {
+        if (scheduler->policyType != SP_PARALLEL_HOST_SINGLE &&
+            scheduler->policyType != SP_PARALLEL_HOST_STEAL &&
+            scheduler->policyType != SP_PARALLEL_HOST_STEAL_INBOX) {
+            // The thread-based policies pop events from several hosts at once
+            // against a single barrier, so they can't respect per-host barriers.
+            error("Per-host lookahead is only supported by the host and steal scheduler "
+                  "policies");
+            exit(1);
+        }
+        scheduler->policy->usePerHostLookahead = TRUE;
+    }
+
+    if (_useDecoupledRounds) {
+        if (scheduler->policy->getNextHostTime == NULL) {
+            error("Decoupled rounds are only supported by the host and steal scheduler policies");
+            exit(1);
+        }
+        if (_usePerHostLookahead) {
+            // Per-host lookahead lengthens the round past the shortest path latency,
+            // which the decoupled host barriers rely on.
+            error("Decoupled rounds can't be used with per-host lookahead");
+            exit(1);
+        }
+        scheduler->policy->useDecoupledRounds = TRUE;
+    }
+
+    if (_useAdaptiveRunahead) {
+        if (scheduler->policy->getNextSendTime == NULL) {
+            error("Adaptive runahead is only supported by the host scheduler policy");
+            exit(1);
+        }
+        if (_usePerHostLookahead || _useDecoupledRounds) {
+            // Both end hosts' rounds at their own barriers, which assume that the
+            // round is no longer than the minimum path latency.
+            error("Adaptive runahead can't be used with per-host lookahead or decoupled rounds");
+            exit(1);
+        }
+    }
+
+    if (_hostRebalanceInterval > 0) {
+        if (scheduler->policy->rebalance == NULL) {
+            error("Host rebalancing is only supported by the host scheduler policy");
+            exit(1);
+        }
+        scheduler->policy->useRebalancing = TRUE;
+    }
+
+    if (_usePipelinedWorkers) {
+        if (scheduler->policyType != SP_PARALLEL_HOST_SINGLE) {
+            error("Pipelined workers are only supported by the host scheduler policy");
+            exit(1);
+        }
+        scheduler->policy->usePipelinedWorkers = TRUE;
+    }
+
     /* make sure our ref count is set before starting the threads */
     scheduler->referenceCount = 1;
 
@@ -206,6 +478,17 @@ static void _scheduler_free(Scheduler* scheduler) {
 
     info("%d worker threads finished", workerpool_getNWorkers(scheduler->workerPool));
     workerpool_free(scheduler->workerPool);
+    g_clear_pointer(&scheduler->roundBarrier, treebarrier_free);
+    g_free(scheduler->ipTable);
+
+    if (scheduler->roundStats.file) {
+        fclose(scheduler->roundStats.file);
+    }
+    if (scheduler->roundStats.digestFile) {
+        fclose(scheduler->roundStats.digestFile);
+    }
+    g_free(scheduler->roundStats.workers);
+    g_free(scheduler->roundStats.workerTotals);
 
     MAGIC_CLEAR(scheduler);
     g_free(scheduler);
@@ -249,7 +532,23 @@ gboolean scheduler_push(Scheduler* scheduler, Event* event, Host* sender, Host*
     // Store the minimum time of events that we are pushing between hosts. The
     // push operation may adjust the event time, so make sure we call this after
     // the push.
-    worker_setMinEventTimeNextRound(event_getTime(event));
+    SimulationTime pushedTime = event_getTime(event);
+    TRACEPOINT(scheduler_push, sender ? host_getID(sender) : 0, host_getID(receiver), pushedTime);
+    if ((scheduler->policy->usePerHostLookahead || scheduler->policy->useDecoupledRounds) &&
+        pushedTime < schedulerpolicy_getHostBarrier(
+                         scheduler->policy, receiver, scheduler->currentRound.endTime)) {
+        // The receiver will run this event during *this* round.
+        return TRUE;
+    }
+    worker_setMinEventTimeNextRoundForHost(receiver, pushedTime);
+
+    // Events for this round are run by the receiver's worker before it reports its hosts'
+    // next send time, but it may have done so already for this one.
+    if (_useAdaptiveRunahead && pushedTime >= scheduler->currentRound.endTime) {
+        SimulationTime sendLatency = host_getSendLatency(receiver);
+        worker_setMinSendTimeNextRound(
+            (pushedTime < SIMTIME_MAX - sendLatency) ? pushedTime + sendLatency : SIMTIME_MAX);
+    }
 
     return TRUE;
 }
@@ -271,6 +570,79 @@ Host* scheduler_getHost(Scheduler* scheduler, GQuark hostID) {
     return (Host*) g_hash_table_lookup(scheduler->hostIDToHostMap, GUINT_TO_POINTER((guint)hostID));
 }
 
+static gboolean _scheduler_lookupIPSlow(Scheduler* scheduler, in_addr_t ip,
+                                        SchedulerIPEntry* entryOut) {
+    Address* address = dns_resolveIPToAddress(manager_getDNS(scheduler->manager), ip);
+    if (!address) {
+        return FALSE;
+    }
+    Host* host = scheduler_getHost(scheduler, (GQuark)address_getID(address));
+    if (!host) {
+        return FALSE;
+    }
+
+    *entryOut = (SchedulerIPEntry){
+        .host = host,
+        .address = address,
+        .vertexIndex =
+            topology_getAttachedVertex(manager_getTopology(scheduler->manager), address),
+    };
+    return TRUE;
+}
+
+gboolean scheduler_lookupIP(Scheduler* scheduler, in_addr_t ip, SchedulerIPEntry* entryOut) {
+    MAGIC_ASSERT(scheduler);
+    utility_assert(entryOut);
+
+    /* addresses below the base wrap around to large offsets */
+    guint32 offset = ntohl(ip) - scheduler->ipTableBase;
+    if (scheduler->ipTable && offset < scheduler->ipTableSize &&
+        scheduler->ipTable[offset].host) {
+        *entryOut = scheduler->ipTable[offset];
+        return TRUE;
+    }
+
+    return _scheduler_lookupIPSlow(scheduler, ip, entryOut);
+}
+
+static void _scheduler_buildIPTable(Scheduler* scheduler) {
+    guint nHosts = g_hash_table_size(scheduler->hostIDToHostMap);
+    if (nHosts == 0) {
+        return;
+    }
+
+    /* shadow assigns addresses from a counter, so they're usually dense */
+    guint32 minIP = G_MAXUINT32, maxIP = 0;
+    GHashTableIter iter;
+    gpointer value = NULL;
+    g_hash_table_iter_init(&iter, scheduler->hostIDToHostMap);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        guint32 ip = ntohl(host_getDefaultIP(value));
+        minIP = MIN(minIP, ip);
+        maxIP = MAX(maxIP, ip);
+    }
+
+    guint64 size = (guint64)maxIP - minIP + 1;
+    if (size > (guint64)nHosts * IP_TABLE_MAX_ENTRIES_PER_HOST) {
+        info("host addresses span %" G_GUINT64_FORMAT " addresses for %u hosts, so we'll look "
+             "them up in the hash tables",
+             size, nHosts);
+        return;
+    }
+
+    scheduler->ipTable = g_new0(SchedulerIPEntry, size);
+    scheduler->ipTableBase = minIP;
+    scheduler->ipTableSize = (guint32)size;
+
+    g_hash_table_iter_init(&iter, scheduler->hostIDToHostMap);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        SchedulerIPEntry entry = {0};
+        if (_scheduler_lookupIPSlow(scheduler, host_getDefaultIP(value), &entry)) {
+            scheduler->ipTable[ntohl(host_getDefaultIP(value)) - minIP] = entry;
+        }
+    }
+}
+
 static void _scheduler_appendHostToQueue(gpointer uintKey, Host* host, GQueue* allHosts) {
     g_queue_push_tail(allHosts, host);
 }
@@ -326,6 +698,252 @@ static void _scheduler_assignHostsToThread(Scheduler* scheduler, GQueue* hosts,
     }
 }
 
+static gint _scheduler_compareHostVertex(Host* a, Host* b, Topology* topology) {
+    gint vertexA = topology_getAttachedVertex(topology, host_getDefaultAddress(a));
+    gint vertexB = topology_getAttachedVertex(topology, host_getDefaultAddress(b));
+    return (vertexA > vertexB) - (vertexA < vertexB);
+}
+
+/* Splits the hosts among the NUMA nodes of the workers' CPUs, in proportion to the number
+ * of workers on each node, and then assigns each node's hosts evenly to its workers. The
+ * hosts are grouped by the vertex they're attached to, so that hosts with the shortest paths
+ * between them, which tend to exchange the most packets, land on the same node. Returns
+ * FALSE without assigning any hosts if the workers are all on one node. */
+static gboolean _scheduler_assignHostsByNode(Scheduler* scheduler, GQueue* hosts) {
+    MAGIC_ASSERT(scheduler);
+
+    int nWorkers = workerpool_getNWorkers(scheduler->workerPool);
+
+    /* node -> GArray of worker IDs, and the nodes in order of their first worker */
+    GHashTable* nodeWorkers =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+    GArray* nodes = g_array_new(FALSE, FALSE, sizeof(int));
+    for (int workeri = 0; workeri < nWorkers; workeri++) {
+        int node = workerpool_getNode(scheduler->workerPool, workeri);
+        GArray* workers = g_hash_table_lookup(nodeWorkers, GINT_TO_POINTER(node));
+        if (!workers) {
+            workers = g_array_new(FALSE, FALSE, sizeof(int));
+            g_hash_table_insert(nodeWorkers, GINT_TO_POINTER(node), workers);
+            g_array_append_val(nodes, node);
+        }
+        g_array_append_val(workers, workeri);
+    }
+
+    if (nodes->len < 2) {
+        g_array_free(nodes, TRUE);
+        g_hash_table_destroy(nodeWorkers);
+        return FALSE;
+    }
+
+    /* the hosts were shuffled, and the sort is stable, so hosts on the same vertex are still
+     * in random order */
+    Topology* topology = manager_getTopology(scheduler->manager);
+    g_queue_sort(hosts, (GCompareDataFunc)_scheduler_compareHostVertex, topology);
+
+    guint nHosts = g_queue_get_length(hosts);
+    int workersBefore = 0;
+    for (guint nodei = 0; nodei < nodes->len; nodei++) {
+        int node = g_array_index(nodes, int, nodei);
+        GArray* workers = g_hash_table_lookup(nodeWorkers, GINT_TO_POINTER(node));
+
+        /* the node's contiguous share of the sorted hosts */
+        guint start = (guint)((guint64)nHosts * workersBefore / nWorkers);
+        workersBefore += workers->len;
+        guint end = (guint)((guint64)nHosts * workersBefore / nWorkers);
+
+        info("assigning %u hosts to the %u workers on NUMA node %d", end - start, workers->len,
+             node);
+
+        for (guint i = 0; i < end - start; i++) {
+            int workeri = g_array_index(workers, int, i % workers->len);
+            pthread_t nextThread = workerpool_getThread(scheduler->workerPool, workeri);
+            _scheduler_assignHostsToThread(scheduler, hosts, nextThread, 1);
+        }
+    }
+    utility_assert(g_queue_is_empty(hosts));
+
+    g_array_free(nodes, TRUE);
+    g_hash_table_destroy(nodeWorkers);
+    return TRUE;
+}
+
+/* the hosts attached to one vertex of the network graph, for the host partitioner */
+typedef struct _SchedulerPartitionVertex SchedulerPartitionVertex;
+struct _SchedulerPartitionVertex {
+    gint64 id;
+    /* the vertex's hosts that are not assigned yet */
+    GQueue* hosts;
+    /* vertex id -> packets exchanged with that vertex, as gdouble* */
+    GHashTable* neighbors;
+    gdouble totalPackets;
+    /* packets exchanged with the vertices in the partition being filled */
+    gdouble gain;
+};
+
+static void _scheduler_freePartitionVertex(SchedulerPartitionVertex* vertex) {
+    g_queue_free(vertex->hosts);
+    g_hash_table_destroy(vertex->neighbors);
+    g_free(vertex);
+}
+
+static gint _scheduler_comparePartitionVertices(gconstpointer a, gconstpointer b) {
+    const SchedulerPartitionVertex* va = *(SchedulerPartitionVertex* const*)a;
+    const SchedulerPartitionVertex* vb = *(SchedulerPartitionVertex* const*)b;
+    return (va->id > vb->id) - (va->id < vb->id);
+}
+
+static void _scheduler_addPartitionWeight(SchedulerPartitionVertex* vertex, gint64 neighborID,
+                                          gdouble packets) {
+    gdouble* weight = g_hash_table_lookup(vertex->neighbors, &neighborID);
+    if (!weight) {
+        gint64* key = g_new(gint64, 1);
+        *key = neighborID;
+        weight = g_new0(gdouble, 1);
+        g_hash_table_insert(vertex->neighbors, key, weight);
+    }
+    *weight += packets;
+    vertex->totalPackets += packets;
+}
+
+/* Reads the packet counts that an earlier run wrote with topology_writePathPacketCounts, and
+ * adds them to the vertices as edge weights. Paths from a vertex to itself don't matter to the
+ * partition, since a vertex is only split when it has more hosts than a partition. */
+static void _scheduler_readPartitionCounts(GHashTable* vertices, const gchar* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        warning("Unable to open packet count file '%s', partitioning hosts without it: %s", path,
+                g_strerror(errno));
+        return;
+    }
+
+    gint64 srcID = 0, dstID = 0;
+    guint64 packets = 0;
+    guint nPaths = 0;
+    while (fscanf(file, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GUINT64_FORMAT, &srcID,
+                  &dstID, &packets) == 3) {
+        SchedulerPartitionVertex* src = g_hash_table_lookup(vertices, &srcID);
+        SchedulerPartitionVertex* dst = g_hash_table_lookup(vertices, &dstID);
+        if (src && dst && src != dst) {
+            _scheduler_addPartitionWeight(src, dstID, (gdouble)packets);
+            _scheduler_addPartitionWeight(dst, srcID, (gdouble)packets);
+            nPaths++;
+        }
+    }
+    fclose(file);
+
+    info("Read the packet counts of %u paths between hosts from '%s'", nPaths, path);
+}
+
+/* Assigns the hosts to the workers so that hosts on vertices that exchange many packets share
+ * a worker, which avoids pushing their events across workers. Each worker gets the same number
+ * of hosts, give or take one. The partitions are grown one at a time like the graph growing
+ * of METIS: starting from the busiest unassigned vertex, it repeatedly adds the vertex that
+ * exchanged the most packets with the partition so far, splitting a vertex between partitions
+ * when it has more hosts than fit. The packet counts come from an earlier run; without them,
+ * the hosts are only grouped by the vertex they're attached to. */
+static void _scheduler_assignHostsByPartition(Scheduler* scheduler, GQueue* hosts) {
+    MAGIC_ASSERT(scheduler);
+
+    Topology* topology = manager_getTopology(scheduler->manager);
+    int nWorkers = workerpool_getNWorkers(scheduler->workerPool);
+    guint nHosts = g_queue_get_length(hosts);
+
+    /* group the hosts by vertex; they were shuffled, so each vertex's hosts are in random order */
+    GHashTable* vertices = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                                 (GDestroyNotify)_scheduler_freePartitionVertex);
+    GPtrArray* vertexList = g_ptr_array_new();
+    Host* host = NULL;
+    while ((host = g_queue_pop_head(hosts)) != NULL) {
+        gint64 id = topology_getAttachedVertexID(topology, host_getDefaultAddress(host));
+        SchedulerPartitionVertex* vertex = g_hash_table_lookup(vertices, &id);
+        if (!vertex) {
+            vertex = g_new0(SchedulerPartitionVertex, 1);
+            vertex->id = id;
+            vertex->hosts = g_queue_new();
+            vertex->neighbors = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+            g_hash_table_insert(vertices, &vertex->id, vertex);
+            g_ptr_array_add(vertexList, vertex);
+        }
+        g_queue_push_tail(vertex->hosts, host);
+    }
+
+    char* countsPath = config_getHostPartitioningCounts(manager_getConfig(scheduler->manager));
+    if (countsPath) {
+        _scheduler_readPartitionCounts(vertices, countsPath);
+        config_freeString(countsPath);
+    }
+
+    /* the hash table order isn't deterministic, but the ids are */
+    g_ptr_array_sort(vertexList, _scheduler_comparePartitionVertices);
+
+    /* keep consecutive partitions, which were grown next to each other, on the same NUMA node */
+    int workerOrder[nWorkers];
+    for (int workeri = 0; workeri < nWorkers; workeri++) {
+        /* insertion sort by node, keeping the workers of a node in order */
+        int node = _useNUMAPlacement ? workerpool_getNode(scheduler->workerPool, workeri) : 0;
+        int j = workeri;
+        while (_useNUMAPlacement && j > 0 &&
+               workerpool_getNode(scheduler->workerPool, workerOrder[j - 1]) > node) {
+            workerOrder[j] = workerOrder[j - 1];
+            j--;
+        }
+        workerOrder[j] = workeri;
+    }
+
+    SchedulerPartitionVertex* carried = NULL;
+    for (int part = 0; part < nWorkers; part++) {
+        guint start = (guint)((guint64)nHosts * part / nWorkers);
+        guint end = (guint)((guint64)nHosts * (part + 1) / nWorkers);
+        guint remaining = end - start;
+        pthread_t thread = workerpool_getThread(scheduler->workerPool, workerOrder[part]);
+
+        for (guint i = 0; i < vertexList->len; i++) {
+            ((SchedulerPartitionVertex*)g_ptr_array_index(vertexList, i))->gain = 0;
+        }
+
+        while (remaining > 0) {
+            /* finish a vertex that the last partition split first, then prefer the vertex with
+             * the most packets to the partition, and then the busiest vertex overall */
+            SchedulerPartitionVertex* next = NULL;
+            if (carried && !g_queue_is_empty(carried->hosts)) {
+                next = carried;
+            } else {
+                for (guint i = 0; i < vertexList->len; i++) {
+                    SchedulerPartitionVertex* vertex = g_ptr_array_index(vertexList, i);
+                    if (g_queue_is_empty(vertex->hosts)) {
+                        continue;
+                    }
+                    if (!next || vertex->gain > next->gain ||
+                        (vertex->gain == next->gain && vertex->totalPackets > next->totalPackets)) {
+                        next = vertex;
+                    }
+                }
+            }
+            utility_assert(next);
+
+            while (remaining > 0 && !g_queue_is_empty(next->hosts)) {
+                scheduler->policy->addHost(scheduler->policy, g_queue_pop_head(next->hosts),
+                                           thread);
+                remaining--;
+            }
+            carried = next;
+
+            GHashTableIter iter;
+            gpointer key = NULL, value = NULL;
+            g_hash_table_iter_init(&iter, next->neighbors);
+            while (g_hash_table_iter_next(&iter, &key, &value)) {
+                SchedulerPartitionVertex* neighbor = g_hash_table_lookup(vertices, key);
+                if (neighbor) {
+                    neighbor->gain += *(gdouble*)value;
+                }
+            }
+        }
+    }
+
+    g_ptr_array_free(vertexList, TRUE);
+    g_hash_table_destroy(vertices);
+}
+
 static void _scheduler_assignHosts(Scheduler* scheduler) {
     MAGIC_ASSERT(scheduler);
 
@@ -339,6 +957,12 @@ static void _scheduler_assignHosts(Scheduler* scheduler) {
     /* we need to shuffle the list of hosts to make sure they are randomly assigned */
     _scheduler_shuffleQueue(scheduler, hosts);
 
+    if (_useHostPartitioning) {
+        _scheduler_assignHostsByPartition(scheduler, hosts);
+    } else if (_useNUMAPlacement) {
+        _scheduler_assignHostsByNode(scheduler, hosts);
+    }
+
     /* now that our host order has been randomized, assign them evenly to worker threads */
     int workeri = 0;
     while (!g_queue_is_empty(hosts)) {
@@ -388,57 +1012,435 @@ SchedulerPolicyType scheduler_getPolicy(Scheduler* scheduler) {
     return scheduler->policyType;
 }
 
+SimulationTime scheduler_getHostRoundEndTime(Scheduler* scheduler, Host* host) {
+    MAGIC_ASSERT(scheduler);
+    return schedulerpolicy_getHostBarrier(
+        scheduler->policy, host, scheduler->currentRound.endTime);
+}
+
+SimulationTime scheduler_getNextSendTime(Scheduler* scheduler) {
+    MAGIC_ASSERT(scheduler);
+    return scheduler->currentRound.minNextSendTime;
+}
+
 gboolean scheduler_isRunning(Scheduler* scheduler) {
     MAGIC_ASSERT(scheduler);
     return scheduler->isRunning;
 }
 
+guint64 scheduler_getNumRounds(Scheduler* scheduler) {
+    MAGIC_ASSERT(scheduler);
+    return scheduler->roundStats.numRounds;
+}
+
+guint64 scheduler_getRoundNanos(Scheduler* scheduler) {
+    MAGIC_ASSERT(scheduler);
+    return scheduler->roundStats.roundNanos;
+}
+
+void scheduler_getWorkerTotals(Scheduler* scheduler, guint workerID, guint64* numEvents,
+                               guint64* busyNanos) {
+    MAGIC_ASSERT(scheduler);
+    utility_assert(workerID < scheduler->roundStats.nWorkers);
+    SchedulerWorkerRoundStats* totals = &scheduler->roundStats.workerTotals[workerID];
+    *numEvents = totals->numEvents;
+    *busyNanos = totals->busyNanos;
+}
+
+void scheduler_foreachHost(Scheduler* scheduler, GFunc func, gpointer userData) {
+    MAGIC_ASSERT(scheduler);
+    GHashTableIter iter;
+    gpointer host = NULL;
+    g_hash_table_iter_init(&iter, scheduler->hostIDToHostMap);
+    while (g_hash_table_iter_next(&iter, NULL, &host)) {
+        func(host, userData);
+    }
+}
+
+WorkerPool* scheduler_getWorkerPool(Scheduler* scheduler) {
+    MAGIC_ASSERT(scheduler);
+    return scheduler->workerPool;
+}
+
+static void _scheduler_openRoundStatsFile(Scheduler* scheduler) {
+    gchar* path =
+        g_build_filename(manager_getDataPath(scheduler->manager), ROUND_STATS_FILE_NAME, NULL);
+    FILE* file = fopen(path, "w");
+
+    if (!file) {
+        warning("Unable to open round statistics file '%s': %s", path, g_strerror(errno));
+        g_free(path);
+        return;
+    }
+
+    info("Writing statistics about each scheduling round to '%s'", path);
+    g_free(path);
+
+    fprintf(file, "round,window-start-nanoseconds,window-end-nanoseconds,round-nanoseconds,"
+                  "await-nanoseconds,events-count,stolen-hosts-count");
+    for (guint i = 0; i < scheduler->roundStats.nWorkers; i++) {
+        fprintf(file, ",worker%u-events-count,worker%u-busy-nanoseconds", i, i);
+    }
+    fprintf(file, "\n");
+
+    scheduler->roundStats.file = file;
+}
+
+static void _scheduler_openDigestFile(Scheduler* scheduler) {
+    gchar* path =
+        g_build_filename(manager_getDataPath(scheduler->manager), ROUND_DIGESTS_FILE_NAME, NULL);
+    FILE* file = fopen(path, "w");
+
+    if (!file) {
+        warning("Unable to open determinism digest file '%s': %s", path, g_strerror(errno));
+        g_free(path);
+        return;
+    }
+
+    info("Writing a digest of the events of each scheduling round to '%s'", path);
+    g_free(path);
+
+    fprintf(file, "round,window-start-nanoseconds,window-end-nanoseconds,events-count,"
+                  "round-digest,digest\n");
+
+    scheduler->roundStats.digestFile = file;
+}
+
+static gint _scheduler_compareHostNames(gconstpointer a, gconstpointer b) {
+    return g_strcmp0(host_getName(*(Host**)a), host_getName(*(Host**)b));
+}
+
+/* Writes the digest of every host's events, sorted by host name so that the files of
+ * two runs can be compared line by line. */
+static void _scheduler_writeHostDigests(Scheduler* scheduler) {
+    gchar* path =
+        g_build_filename(manager_getDataPath(scheduler->manager), HOST_DIGESTS_FILE_NAME, NULL);
+    FILE* file = fopen(path, "w");
+
+    if (!file) {
+        warning("Unable to open host digest file '%s': %s", path, g_strerror(errno));
+        g_free(path);
+        return;
+    }
+
+    GPtrArray* hosts = g_ptr_array_sized_new(g_hash_table_size(scheduler->hostIDToHostMap));
+    scheduler_foreachHost(scheduler, (GFunc)g_ptr_array_add, hosts);
+    g_ptr_array_sort(hosts, _scheduler_compareHostNames);
+
+    fprintf(file, "hostname,digest\n");
+    for (guint i = 0; i < hosts->len; i++) {
+        Host* host = g_ptr_array_index(hosts, i);
+        fprintf(file, "%s,%016" G_GINT64_MODIFIER "x\n", host_getName(host),
+                host_getEventDigest(host));
+    }
+
+    g_ptr_array_unref(hosts);
+    fclose(file);
+
+    info("Wrote the digest of each host's events to '%s'", path);
+    g_free(path);
+}
+
+/* Adds the stats that the workers collected during the round that just finished to the
+ * totals, and to the time series if enabled. Called by the scheduler thread while the
+ * workers are idle, or by the last worker to finish the round while the others wait. */
+static void _scheduler_recordRound(Scheduler* scheduler, guint64 roundNanos, guint64 awaitNanos) {
+    guint64 numEvents = 0, numStolenHosts = 0, maxBusyNanos = 0, digest = 0;
+
+    for (guint i = 0; i < scheduler->roundStats.nWorkers; i++) {
+        SchedulerWorkerRoundStats* stats = &scheduler->roundStats.workers[i];
+        numEvents += stats->numEvents;
+        digest += stats->digest;
+        numStolenHosts += stats->numStolenHosts;
+        scheduler->roundStats.busyNanos += stats->busyNanos;
+        maxBusyNanos = MAX(maxBusyNanos, stats->busyNanos);
+        if (stats->numEvents == 0) {
+            scheduler->roundStats.numIdleWorkers++;
+        }
+
+        SchedulerWorkerRoundStats* totals = &scheduler->roundStats.workerTotals[i];
+        totals->numEvents += stats->numEvents;
+        totals->numStolenHosts += stats->numStolenHosts;
+        totals->busyNanos += stats->busyNanos;
+    }
+
+    SimulationTime windowStart = scheduler->currentRound.startTime;
+    SimulationTime windowEnd = scheduler->currentRound.endTime;
+
+    TRACEPOINT(round_end, windowStart, windowEnd, numEvents, roundNanos);
+
+    if (scheduler->roundStats.file) {
+        FILE* file = scheduler->roundStats.file;
+        fprintf(file,
+                "%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+                ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+                ",%" G_GUINT64_FORMAT,
+                scheduler->roundStats.numRounds, windowStart, windowEnd, roundNanos, awaitNanos,
+                numEvents, numStolenHosts);
+        for (guint i = 0; i < scheduler->roundStats.nWorkers; i++) {
+            SchedulerWorkerRoundStats* stats = &scheduler->roundStats.workers[i];
+            fprintf(file, ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT, stats->numEvents,
+                    stats->busyNanos);
+        }
+        fprintf(file, "\n");
+    }
+
+    /* rounds without events don't depend on the events, so they don't change the digest */
+    if (scheduler->roundStats.digestFile && numEvents > 0) {
+        scheduler->roundStats.digest ^= digest;
+        scheduler->roundStats.digest *= 0x100000001B3ULL;
+        fprintf(scheduler->roundStats.digestFile,
+                "%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+                ",%" G_GUINT64_FORMAT ",%016" G_GINT64_MODIFIER "x,%016" G_GINT64_MODIFIER "x\n",
+                scheduler->roundStats.numRounds, windowStart, windowEnd, numEvents, digest,
+                scheduler->roundStats.digest);
+    }
+
+    scheduler->roundStats.numRounds++;
+    scheduler->roundStats.numEvents += numEvents;
+    scheduler->roundStats.numStolenHosts += numStolenHosts;
+    scheduler->roundStats.windowNanos += windowEnd - windowStart;
+    scheduler->roundStats.roundNanos += roundNanos;
+    scheduler->roundStats.awaitNanos += awaitNanos;
+    scheduler->roundStats.maxBusyNanos += maxBusyNanos;
+
+    memset(scheduler->roundStats.workers, 0,
+           scheduler->roundStats.nWorkers * sizeof(SchedulerWorkerRoundStats));
+}
+
+static void _scheduler_logRoundStats(Scheduler* scheduler) {
+    guint64 numRounds = scheduler->roundStats.numRounds;
+    if (numRounds == 0) {
+        return;
+    }
+
+    /* workers share the logical processors, so this is the most time they could be busy */
+    guint nParallel = MIN((guint)_parallelism, scheduler->roundStats.nWorkers);
+    gdouble roundNanos = MAX(scheduler->roundStats.roundNanos, 1);
+
+    info("Ran %" G_GUINT64_FORMAT " scheduling rounds with a mean window of %f milliseconds. "
+         "Workers ran %" G_GUINT64_FORMAT " events and stole %" G_GUINT64_FORMAT " hosts, "
+         "and %f workers were idle per round. Workers were busy for %.1f%% of the "
+         "available time, and the busiest worker of each round for %.1f%% of the round "
+         "time. Waited %f seconds for rounds to finish.",
+         numRounds,
+         ((gdouble)scheduler->roundStats.windowNanos) / numRounds / SIMTIME_ONE_MILLISECOND,
+         scheduler->roundStats.numEvents, scheduler->roundStats.numStolenHosts,
+         ((gdouble)scheduler->roundStats.numIdleWorkers) / numRounds,
+         100.0 * scheduler->roundStats.busyNanos / (roundNanos * nParallel),
+         100.0 * scheduler->roundStats.maxBusyNanos / roundNanos,
+         ((gdouble)scheduler->roundStats.awaitNanos) / SIMTIME_ONE_SECOND);
+}
+
 void scheduler_start(Scheduler* scheduler) {
     /* Called by the scheduler thread. */
 
+    if (_useRoundStats) {
+        _scheduler_openRoundStatsFile(scheduler);
+    }
+    if (_useDeterminismDigest) {
+        _scheduler_openDigestFile(scheduler);
+    }
+
     _scheduler_assignHosts(scheduler);
+    _scheduler_buildIPTable(scheduler);
 
     g_mutex_lock(&scheduler->globalLock);
     scheduler->isRunning = TRUE;
     g_mutex_unlock(&scheduler->globalLock);
 
+    if (_precomputePaths) {
+        // Fill the path cache now, so that the workers don't all queue up
+        // behind the topology lock while computing paths in the first rounds.
+        Topology* topology = manager_getTopology(scheduler->manager);
+        topology_startPrecomputingPaths(topology);
+        workerpool_startTaskFn(scheduler->workerPool,
+                               _scheduler_precomputePathsWorkerTaskFn, scheduler);
+        workerpool_awaitTaskFn(scheduler->workerPool);
+        topology_finishPrecomputingPaths(topology);
+    }
+
     workerpool_startTaskFn(scheduler->workerPool,
                            _scheduler_startHostsWorkerTaskFn, scheduler);
     workerpool_awaitTaskFn(scheduler->workerPool);
 }
 
-void scheduler_continueNextRound(Scheduler* scheduler, SimulationTime windowStart, SimulationTime windowEnd) {
-    /* Called by the scheduler thread. */
+static void _scheduler_setRound(Scheduler* scheduler, SimulationTime windowStart,
+                               SimulationTime windowEnd) {
+    /* end the round at the next heartbeat, so the heartbeats only count what happened
+     * before their time. if it's due now, we don't know the one after it yet. */
+    SimulationTime nextHeartbeat = workerpool_getNextHeartbeatTime(scheduler->workerPool);
+    gboolean heartbeatDue = windowStart >= nextHeartbeat;
+    if (!heartbeatDue && nextHeartbeat < windowEnd) {
+        windowEnd = nextHeartbeat;
+    }
 
     g_mutex_lock(&scheduler->globalLock);
+    scheduler->currentRound.heartbeatDue = heartbeatDue;
+    scheduler->currentRound.startTime = windowStart;
     scheduler->currentRound.endTime = windowEnd;
+    scheduler->policy->windowStart = windowStart;
+    if (windowStart != scheduler->currentRound.minNextEventTime) {
+        // The earliest host we found isn't what this round starts from, e.g. in
+        // the first round, so hold every host to the window start.
+        scheduler->policy->windowStartHost = NULL;
+    }
     scheduler->currentRound.minNextEventTime = SIMTIME_MAX;
     g_mutex_unlock(&scheduler->globalLock);
 
-    workerpool_startTaskFn(scheduler->workerPool,
-                           _scheduler_runEventsWorkerTaskFn, scheduler);
+    TRACEPOINT(round_begin, windowStart, windowEnd);
+    scheduler->roundStats.startNanos = _scheduler_nowNanos();
+}
+
+/* Lets the policy move hosts between the workers every _hostRebalanceInterval rounds.
+ * Called after recording the round, while the workers are idle. */
+static void _scheduler_maybeRebalance(Scheduler* scheduler) {
+    scheduler->currentRound.hostsMoved =
+        scheduler->policy->useRebalancing &&
+        scheduler->roundStats.numRounds % _hostRebalanceInterval == 0 &&
+        scheduler->policy->rebalance(scheduler->policy);
+}
+
+/* Called by the last worker to finish the round, while the others wait for it. */
+static void _scheduler_finishRoundFn(gpointer voidScheduler) {
+    Scheduler* scheduler = voidScheduler;
+
+    // The manager thread didn't wait for this round.
+    _scheduler_recordRound(scheduler, _scheduler_nowNanos() - scheduler->roundStats.startNanos, 0);
+    _scheduler_maybeRebalance(scheduler);
+
+    scheduler->currentRound.minNextEventTime = workerpool_getGlobalNextEventTime(
+        scheduler->workerPool, &scheduler->policy->windowStartHost,
+        &scheduler->policy->windowStartOtherTime);
+    scheduler->currentRound.minNextSendTime =
+        workerpool_getGlobalNextSendTime(scheduler->workerPool);
+
+    SimulationTime windowStart = 0, windowEnd = 0;
+    if (manager_tryContinueNextRound(scheduler->manager,
+                                     scheduler->currentRound.minNextEventTime, &windowStart,
+                                     &windowEnd)) {
+        _scheduler_setRound(scheduler, windowStart, windowEnd);
+        scheduler->currentRound.returnToManager = FALSE;
+    } else {
+        scheduler->currentRound.returnToManager = TRUE;
+    }
+}
+
+/* Runs rounds until the manager thread has work to do in between them, so that
+ * the workers don't need to wake it up and wait for it to wake them at the end
+ * of every round. */
+static void _scheduler_runRoundsWorkerTaskFn(void* voidScheduler) {
+    Scheduler* scheduler = voidScheduler;
+    do {
+        _scheduler_runRound(scheduler);
+        treebarrier_await(
+            scheduler->roundBarrier, worker_threadID(), _scheduler_finishRoundFn, scheduler);
+
+        if (scheduler->currentRound.hostsMoved) {
+            /* only we can detach from the plugins of the hosts we lost */
+            _scheduler_detachMovedHostsWorkerTaskFn(scheduler);
+        }
+
+        if (!scheduler->currentRound.returnToManager &&
+            (scheduler->currentRound.heartbeatDue || scheduler->currentRound.hostsMoved)) {
+            if (scheduler->currentRound.heartbeatDue) {
+                _scheduler_heartbeatWorkerTaskFn(scheduler);
+            }
+            /* other workers may run our hosts once the round starts */
+            treebarrier_await(scheduler->roundBarrier, worker_threadID(), NULL, NULL);
+        }
+    } while (!scheduler->currentRound.returnToManager);
+}
+
+void scheduler_continueNextRound(Scheduler* scheduler, SimulationTime windowStart, SimulationTime windowEnd) {
+    /* Called by the scheduler thread. */
+
+    _scheduler_setRound(scheduler, windowStart, windowEnd);
+
+    if (scheduler->currentRound.heartbeatDue) {
+        workerpool_startTaskFn(scheduler->workerPool, _scheduler_heartbeatWorkerTaskFn, scheduler);
+        workerpool_awaitTaskFn(scheduler->workerPool);
+    }
+
+    if (scheduler->roundBarrier) {
+        workerpool_startTaskFn(scheduler->workerPool, _scheduler_runRoundsWorkerTaskFn, scheduler);
+    } else {
+        workerpool_startTaskFn(scheduler->workerPool,
+                               _scheduler_runEventsWorkerTaskFn, scheduler);
+    }
 }
 
 SimulationTime scheduler_awaitNextRound(Scheduler* scheduler) {
     /* Called by the scheduler thread. */
 
     // Await completion of _scheduler_runEventsWorkerTaskFn
+    guint64 awaitStartNanos = _scheduler_nowNanos();
     workerpool_awaitTaskFn(scheduler->workerPool);
+    guint64 awaitEndNanos = _scheduler_nowNanos();
+
+    if (scheduler->roundBarrier) {
+        // The last worker to finish the round already recorded it and found the
+        // min next event time.
+        return scheduler->currentRound.minNextEventTime;
+    }
+
+    _scheduler_recordRound(scheduler, awaitEndNanos - scheduler->roundStats.startNanos,
+                           awaitEndNanos - awaitStartNanos);
+    _scheduler_maybeRebalance(scheduler);
+
+    if (scheduler->currentRound.hostsMoved) {
+        /* only the worker that ran a host can detach from its plugins */
+        workerpool_startTaskFn(
+            scheduler->workerPool, _scheduler_detachMovedHostsWorkerTaskFn, scheduler);
+        workerpool_awaitTaskFn(scheduler->workerPool);
+    }
 
     // Workers are done running the round and waiting to get woken up, so we can
     // safely read memory without a lock to compute the min next event time.
-    scheduler->currentRound.minNextEventTime =
-        workerpool_getGlobalNextEventTime(scheduler->workerPool);
+    scheduler->currentRound.minNextEventTime = workerpool_getGlobalNextEventTime(
+        scheduler->workerPool, &scheduler->policy->windowStartHost,
+        &scheduler->policy->windowStartOtherTime);
+    scheduler->currentRound.minNextSendTime =
+        workerpool_getGlobalNextSendTime(scheduler->workerPool);
 
     return scheduler->currentRound.minNextEventTime;
 }
 
 void scheduler_finish(Scheduler* scheduler) {
+    _scheduler_logRoundStats(scheduler);
+    if (scheduler->roundStats.file) {
+        fflush(scheduler->roundStats.file);
+    }
+    if (scheduler->roundStats.digestFile) {
+        fflush(scheduler->roundStats.digestFile);
+        _scheduler_writeHostDigests(scheduler);
+    }
+
+    /* the workers count the packets sent on each path locally until now */
+    workerpool_startTaskFn(
+        scheduler->workerPool, _scheduler_flushPathPacketCountsTaskFn, scheduler);
+    workerpool_awaitTaskFn(scheduler->workerPool);
+
+    /* save the traffic between the hosts' vertices, to partition the hosts of the next run */
+    if (_useHostPartitioning) {
+        gchar* path = g_build_filename(
+            manager_getDataPath(scheduler->manager), PATH_PACKET_COUNTS_FILE_NAME, NULL);
+        if (topology_writePathPacketCounts(manager_getTopology(scheduler->manager), path)) {
+            info("Wrote the packet counts of the paths between hosts to '%s'", path);
+        }
+        g_free(path);
+    }
+
     /* make sure when the workers wake up they know we are done */
     g_mutex_lock(&scheduler->globalLock);
     scheduler->isRunning = FALSE;
     g_mutex_unlock(&scheduler->globalLock);
 
+    /* kill every plugin process first, so that the kernel tears them all down at once
+     * and the workers don't wait for each process to exit before killing the next */
+    workerpool_startTaskFn(scheduler->workerPool, _scheduler_killProcessesTaskFn, scheduler);
+    workerpool_awaitTaskFn(scheduler->workerPool);
+
     workerpool_startTaskFn(scheduler->workerPool, _scheduler_finishTaskFn,
                            scheduler);
     workerpool_awaitTaskFn(scheduler->workerPool);
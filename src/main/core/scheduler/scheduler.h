@@ -8,14 +8,26 @@
 #define SHD_SCHEDULER_H_
 
 #include <glib.h>
+#include <netinet/in.h>
 
 #include "main/core/manager.h"
 #include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/definitions.h"
 #include "main/core/work/event.h"
 #include "main/host/host.h"
+#include "main/routing/address.h"
 
 typedef struct _Scheduler Scheduler;
+typedef struct _WorkerPool WorkerPool;
+
+/* What sending a packet needs to know about a host with a given IP address. */
+typedef struct _SchedulerIPEntry SchedulerIPEntry;
+struct _SchedulerIPEntry {
+    Host* host;
+    Address* address;
+    /* where the host is attached to the topology */
+    gint vertexIndex;
+};
 
 Scheduler* scheduler_new(Manager* manager, SchedulerPolicyType policyType,
                          guint nWorkers, guint schedulerSeed,
@@ -36,7 +48,28 @@ Event* scheduler_pop(Scheduler*);
 
 void scheduler_addHost(Scheduler*, Host*);
 Host* scheduler_getHost(Scheduler*, GQuark);
+/* Looks up the host with the network byte order address ip, and returns FALSE if there
+ * isn't one. Once the scheduler has started, this is a single array lookup for the
+ * addresses that shadow assigned. */
+gboolean scheduler_lookupIP(Scheduler*, in_addr_t ip, SchedulerIPEntry* entryOut);
 SchedulerPolicyType scheduler_getPolicy(Scheduler*);
+/* Returns the end of the current round for host. It doesn't run an event at or after
+ * this time until the next round starts. */
+SimulationTime scheduler_getHostRoundEndTime(Scheduler*, Host*);
+/* With adaptive runahead, returns the earliest time that a packet sent in the next round
+ * could reach another host. Only call between rounds. */
+SimulationTime scheduler_getNextSendTime(Scheduler*);
 gboolean scheduler_isRunning(Scheduler* scheduler);
+WorkerPool* scheduler_getWorkerPool(Scheduler* scheduler);
+
+/* Totals over all of the rounds that have finished. Only call from the scheduler thread. */
+guint64 scheduler_getNumRounds(Scheduler* scheduler);
+guint64 scheduler_getRoundNanos(Scheduler* scheduler);
+void scheduler_getWorkerTotals(Scheduler* scheduler, guint workerID, guint64* numEvents,
+                               guint64* busyNanos);
+
+/* Calls func(host, userData) for every host. Only call from the scheduler thread while the
+ * workers are idle. */
+void scheduler_foreachHost(Scheduler* scheduler, GFunc func, gpointer userData);
 
 #endif /* SHD_SCHEDULER_H_ */
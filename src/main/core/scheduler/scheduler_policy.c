@@ -0,0 +1,42 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/core/scheduler/scheduler_policy.h"
+
+#include <glib.h>
+
+#include "main/core/support/definitions.h"
+#include "main/host/host.h"
+
+/* Every other host's events during the round are at or after the earliest pending
+ * event of the other hosts, or after the round barrier if they were sent during
+ * the round, since no packet arrives sooner than the round length. So nothing can
+ * arrive at host before the earlier of the two plus the host's lookahead. */
+static SimulationTime _schedulerpolicy_getDecoupledBarrier(SchedulerPolicy* policy, Host* host,
+                                                           SimulationTime barrier) {
+    SimulationTime othersTime =
+        (host == policy->windowStartHost) ? policy->windowStartOtherTime : policy->windowStart;
+    SimulationTime safeTime = MIN(othersTime, barrier);
+    SimulationTime lookahead = host_getLookahead(host);
+    if (safeTime >= SIMTIME_MAX - lookahead) {
+        return SIMTIME_MAX;
+    }
+    return MAX(barrier, safeTime + lookahead);
+}
+
+SimulationTime schedulerpolicy_getHostBarrier(SchedulerPolicy* policy, Host* host,
+                                              SimulationTime barrier) {
+    if (policy->useDecoupledRounds) {
+        return _schedulerpolicy_getDecoupledBarrier(policy, host, barrier);
+    }
+    if (!policy->usePerHostLookahead || barrier <= policy->windowStart) {
+        return barrier;
+    }
+    SimulationTime lookahead = host_getLookahead(host);
+    if (lookahead >= barrier - policy->windowStart) {
+        return barrier;
+    }
+    return policy->windowStart + lookahead;
+}
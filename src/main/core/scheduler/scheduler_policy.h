@@ -17,6 +17,12 @@ typedef GQueue* (*SchedulerPolicyGetHostsFunc)(SchedulerPolicy*);
 typedef void (*SchedulerPolicyPushFunc)(SchedulerPolicy*, Event*, Host*, Host*, SimulationTime);
 typedef Event* (*SchedulerPolicyPopFunc)(SchedulerPolicy*, SimulationTime);
 typedef SimulationTime (*SchedulerPolicyGetNextTimeFunc)(SchedulerPolicy*);
+typedef SimulationTime (*SchedulerPolicyGetNextHostTimeFunc)(SchedulerPolicy*, Host**,
+                                                            SimulationTime*);
+typedef gsize (*SchedulerPolicyTakeStolenHostCountFunc)(SchedulerPolicy*);
+typedef gboolean (*SchedulerPolicyRebalanceFunc)(SchedulerPolicy*);
+typedef void (*SchedulerPolicyDetachMovedHostsFunc)(SchedulerPolicy*);
+typedef SimulationTime (*SchedulerPolicyGetNextSendTimeFunc)(SchedulerPolicy*);
 typedef void (*SchedulerPolicyFreeFunc)(SchedulerPolicy*);
 
 struct _SchedulerPolicy {
@@ -28,13 +34,72 @@ struct _SchedulerPolicy {
     SchedulerPolicyPushFunc push;
     SchedulerPolicyPopFunc pop;
     SchedulerPolicyGetNextTimeFunc getNextTime;
+    /* optional; like getNextTime, but also returns the host of that event and the
+     * earliest next event time of the calling thread's other hosts */
+    SchedulerPolicyGetNextHostTimeFunc getNextHostTime;
+    /* optional; returns the number of hosts that the calling thread stole from other
+     * threads since it last called this */
+    SchedulerPolicyTakeStolenHostCountFunc takeStolenHostCount;
+    /* optional; moves hosts between threads according to how long they ran since the last
+     * call. only called between rounds, while no thread is running events. returns TRUE if
+     * it moved any host, in which case every thread must call detachMovedHosts before the
+     * next round starts. */
+    SchedulerPolicyRebalanceFunc rebalance;
+    /* required with rebalance; detaches the calling thread from the plugins of the hosts
+     * that the last rebalance moved away from it, since only the thread that attached to a
+     * plugin with ptrace can detach from it */
+    SchedulerPolicyDetachMovedHostsFunc detachMovedHosts;
+    /* optional; returns the earliest time that a packet from one of the calling thread's
+     * hosts could reach another host: the minimum over the hosts of their next event
+     * time plus their send latency */
+    SchedulerPolicyGetNextSendTimeFunc getNextSendTime;
     SchedulerPolicyFreeFunc free;
+    /* if set, each host may only run events until the start of the current
+     * round plus its own lookahead, rather than until the round barrier */
+    gboolean usePerHostLookahead;
+    SimulationTime windowStart;
+    /* if set, each host may run events past the round barrier, until the earliest
+     * time that another host could still send it an event */
+    gboolean useDecoupledRounds;
+    /* the host with the earliest event at the start of the round, or NULL if it's
+     * unknown, and the earliest next event time of all other hosts */
+    Host* windowStartHost;
+    SimulationTime windowStartOtherTime;
+    /* if set, the policy measures how long each host runs, for rebalance */
+    gboolean useRebalancing;
+    /* if set, the policy runs other hosts while a host waits for its plugin to make its
+     * next syscall; see host_isWaitingForPlugin() */
+    gboolean usePipelinedWorkers;
     MAGIC_DECLARE;
 };
 
+/* Adds the next event time of host to a running minimum, keeping track of the host
+ * with the earliest event and of the earliest time of every other host. host may be
+ * NULL if it's unknown, in which case the time counts against all hosts. */
+static inline void schedulerpolicy_addNextTime(SimulationTime* minTime, Host** minHost,
+                                               SimulationTime* otherMinTime, Host* host,
+                                               SimulationTime time) {
+    if (host != NULL && host == *minHost) {
+        *minTime = MIN(*minTime, time);
+    } else if (time < *minTime) {
+        /* the old earliest time is now the earliest of the other hosts */
+        *otherMinTime = *minTime;
+        *minTime = time;
+        *minHost = host;
+    } else {
+        *otherMinTime = MIN(*otherMinTime, time);
+    }
+}
+
+/* Returns the time before which events at host may run during the current
+ * round. This is never later than the round barrier, unless rounds are decoupled. */
+SimulationTime schedulerpolicy_getHostBarrier(SchedulerPolicy* policy, Host* host,
+                                              SimulationTime barrier);
+
 SchedulerPolicy* schedulerpolicyglobalsingle_new();
 SchedulerPolicy* schedulerpolicyhostsingle_new();
 SchedulerPolicy* schedulerpolicyhoststeal_new();
+SchedulerPolicy* schedulerpolicyhoststealinbox_new();
 SchedulerPolicy* schedulerpolicythreadsingle_new();
 SchedulerPolicy* schedulerpolicythreadperthread_new();
 SchedulerPolicy* schedulerpolicythreadperhost_new();
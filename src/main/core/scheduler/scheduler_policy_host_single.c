@@ -6,36 +6,80 @@
 #include <glib.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 #include "lib/logger/logger.h"
 #include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/definitions.h"
 #include "main/core/work/event.h"
+#include "main/core/work/event_queue.h"
+#include "main/core/worker.h"
 #include "main/host/host.h"
-#include "main/utility/priority_queue.h"
+#include "main/utility/perf_timer.h"
 #include "main/utility/utility.h"
 
+typedef struct _HostSingleThreadData HostSingleThreadData;
+
 typedef struct _HostSingleQueueData HostSingleQueueData;
 struct _HostSingleQueueData {
     GMutex lock;
-    PriorityQueue* pq;
+    EventQueue* pq;
     SimulationTime lastEventTime;
     gsize nPushed;
     gsize nPopped;
+    Host* host;
+    /* the thread that runs this host */
+    HostSingleThreadData* owner;
+    /* the next event time that the owner has ordered this host by, or 0 while the owner
+     * is running the host. written by the owner while holding lock. */
+    SimulationTime activeTime;
+    /* our index in the owner's activeHosts heap, if we are in it */
+    guint activeIndex;
+    /* set while we are in the owner's wokenHosts. protected by lock. */
+    gboolean isWoken;
+    /* wall time that the owner spent running our events since the last rebalance */
+    guint64 busyNanos;
+    /* set once the last rebalance moved us, until our previous owner detached from our
+     * plugins. only accessed between rounds. */
+    gboolean isMoved;
 };
 
-typedef struct _HostSingleThreadData HostSingleThreadData;
 struct _HostSingleThreadData {
-    /* used to cache getHosts() result for memory management as needed */
+    /* all hosts that have been assigned to this worker */
     GQueue* allHosts;
-    /* all hosts that have been assigned to this worker for event processing but not yet processed this round */
-    GQueue* unprocessedHosts;
-    /* during each round, hosts whose events have been processed are moved from unprocessedHosts to here */
-    GQueue* processedHosts;
+    /* a min-heap of the queue data of our hosts, ordered by their activeTime, so that
+     * each round only needs to visit the hosts that have events before the barrier.
+     * holds every host other than runningHost and the deferredHosts. */
+    GPtrArray* activeHosts;
+    /* hosts whose next event is before the barrier, but which can't run it until a later
+     * round because of their own host barrier. they go back into activeHosts next round. */
+    GPtrArray* deferredHosts;
+    /* hosts that were sent an event earlier than their activeTime, so that we need to
+     * move them up in activeHosts. protected by wokenLock. */
+    GPtrArray* wokenHosts;
+    GMutex wokenLock;
+    /* with pipelined workers, the hosts that we set aside in this round while their
+     * plugin runs, in the order that we did so. they are still running, so nobody
+     * needs to wake them. */
+    GPtrArray* waitingHosts;
+    /* the host we are running events for, which is in none of the above */
+    HostSingleQueueData* runningHost;
+    /* the largest lookahead of our hosts, which bounds how far past the round barrier
+     * any of them may run with decoupled rounds */
+    SimulationTime maxLookahead;
+    /* the smallest send latency of our hosts */
+    SimulationTime minSendLatency;
     SimulationTime currentBarrier;
+    /* when we last returned an event of runningHost, or 0 if we weren't running one */
+    guint64 lastPopNanos;
+    /* the sum of our hosts' busyNanos, while rebalancing */
+    guint64 busyNanos;
+    /* hosts that the last rebalance moved away from us. we may still be attached to their
+     * plugins, and to blocked threads of theirs that we kept attached. */
+    GQueue* movedHosts;
 #ifdef USE_PERF_TIMERS
-    GTimer* pushIdleTime;
-    GTimer* popIdleTime;
+    PerfTimer pushIdleTime;
+    PerfTimer popIdleTime;
 #endif
 };
 
@@ -47,27 +91,24 @@ struct _HostSinglePolicyData {
     MAGIC_DECLARE;
 };
 
-typedef struct _HostSingleSearchState HostSingleSearchState;
-struct _HostSingleSearchState {
-    HostSinglePolicyData* data;
-    SimulationTime nextEventTime;
-};
-
 static HostSingleThreadData* _hostsinglethreaddata_new() {
     HostSingleThreadData* tdata = g_new0(HostSingleThreadData, 1);
 
-    tdata->unprocessedHosts = g_queue_new();
-    tdata->processedHosts = g_queue_new();
+    tdata->allHosts = g_queue_new();
+    tdata->minSendLatency = SIMTIME_MAX;
+    tdata->activeHosts = g_ptr_array_new();
+    tdata->deferredHosts = g_ptr_array_new();
+    tdata->wokenHosts = g_ptr_array_new();
+    g_mutex_init(&(tdata->wokenLock));
+    tdata->waitingHosts = g_ptr_array_new();
+    tdata->movedHosts = g_queue_new();
 
 #ifdef USE_PERF_TIMERS
-    /* Create new timers to track thread idle times. The timers start in a 'started' state,
-     * so we want to stop them immediately so we can continue/stop later around blocking code
-     * to collect total elapsed idle time in the scheduling process throughout the entire
-     * runtime of the program. */
-    tdata->pushIdleTime = g_timer_new();
-    g_timer_stop(tdata->pushIdleTime);
-    tdata->popIdleTime = g_timer_new();
-    g_timer_stop(tdata->popIdleTime);
+    /* Track thread idle times. The timers start stopped, and we continue/stop them around
+     * blocking code to collect total elapsed idle time in the scheduling process throughout
+     * the entire runtime of the program. */
+    tdata->pushIdleTime = PERFTIMER_INIT;
+    tdata->popIdleTime = PERFTIMER_INIT;
 #endif
     return tdata;
 }
@@ -77,24 +118,16 @@ static void _hostsinglethreaddata_free(HostSingleThreadData* tdata) {
         if(tdata->allHosts) {
             g_queue_free(tdata->allHosts);
         }
-        if(tdata->unprocessedHosts) {
-            g_queue_free(tdata->unprocessedHosts);
-        }
-        if(tdata->processedHosts) {
-            g_queue_free(tdata->processedHosts);
-        }
+        g_ptr_array_free(tdata->activeHosts, TRUE);
+        g_ptr_array_free(tdata->deferredHosts, TRUE);
+        g_ptr_array_free(tdata->wokenHosts, TRUE);
+        g_mutex_clear(&(tdata->wokenLock));
+        g_ptr_array_free(tdata->waitingHosts, TRUE);
+        g_queue_free(tdata->movedHosts);
 
 #ifdef USE_PERF_TIMERS
-        gdouble totalPushWaitTime = 0.0;
-        if(tdata->pushIdleTime) {
-            totalPushWaitTime = g_timer_elapsed(tdata->pushIdleTime, NULL);
-            g_timer_destroy(tdata->pushIdleTime);
-        }
-        gdouble totalPopWaitTime = 0.0;
-        if(tdata->popIdleTime) {
-            totalPopWaitTime = g_timer_elapsed(tdata->popIdleTime, NULL);
-            g_timer_destroy(tdata->popIdleTime);
-        }
+        gdouble totalPushWaitTime = perftimer_elapsed(&tdata->pushIdleTime);
+        gdouble totalPopWaitTime = perftimer_elapsed(&tdata->popIdleTime);
 
         info("scheduler thread data destroyed, total push wait time was %f seconds, "
              "total pop wait time was %f seconds",
@@ -104,11 +137,13 @@ static void _hostsinglethreaddata_free(HostSingleThreadData* tdata) {
     }
 }
 
-static HostSingleQueueData* _hostsinglequeuedata_new() {
+static HostSingleQueueData* _hostsinglequeuedata_new(Host* host) {
     HostSingleQueueData* qdata = g_new0(HostSingleQueueData, 1);
 
     g_mutex_init(&(qdata->lock));
-    qdata->pq = priorityqueue_new((GCompareDataFunc)event_compare, NULL, (GDestroyNotify)event_unref);
+    qdata->pq = eventqueue_new();
+    qdata->host = host;
+    qdata->activeTime = SIMTIME_MAX;
 
     return qdata;
 }
@@ -116,21 +151,140 @@ static HostSingleQueueData* _hostsinglequeuedata_new() {
 static void _hostsinglequeuedata_free(HostSingleQueueData* qdata) {
     if(qdata) {
         if(qdata->pq) {
-            priorityqueue_free(qdata->pq);
+            eventqueue_free(qdata->pq);
         }
         g_mutex_clear(&(qdata->lock));
         g_free(qdata);
     }
 }
 
+static guint64 _hostsingle_nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (guint64)now.tv_sec * SIMTIME_ONE_SECOND + (guint64)now.tv_nsec;
+}
+
+static SimulationTime _hostsinglequeuedata_peekTime(HostSingleQueueData* qdata) {
+    Event* event = eventqueue_peek(qdata->pq);
+    return (event != NULL) ? event_getTime(event) : SIMTIME_MAX;
+}
+
+static gboolean _hostsinglethreaddata_isEarlier(HostSingleThreadData* tdata, guint i, guint j) {
+    HostSingleQueueData* qi = g_ptr_array_index(tdata->activeHosts, i);
+    HostSingleQueueData* qj = g_ptr_array_index(tdata->activeHosts, j);
+    return qi->activeTime < qj->activeTime;
+}
+
+static void _hostsinglethreaddata_swap(HostSingleThreadData* tdata, guint i, guint j) {
+    HostSingleQueueData* qi = g_ptr_array_index(tdata->activeHosts, i);
+    HostSingleQueueData* qj = g_ptr_array_index(tdata->activeHosts, j);
+    tdata->activeHosts->pdata[i] = qj;
+    tdata->activeHosts->pdata[j] = qi;
+    qj->activeIndex = i;
+    qi->activeIndex = j;
+}
+
+/* restores the heap order around index after the activeTime there changed */
+static void _hostsinglethreaddata_sift(HostSingleThreadData* tdata, guint index) {
+    while(index > 0 && _hostsinglethreaddata_isEarlier(tdata, index, (index - 1) / 2)) {
+        _hostsinglethreaddata_swap(tdata, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+
+    guint child;
+    while((child = 2 * index + 1) < tdata->activeHosts->len) {
+        if(child + 1 < tdata->activeHosts->len &&
+           _hostsinglethreaddata_isEarlier(tdata, child + 1, child)) {
+            child++;
+        }
+        if(!_hostsinglethreaddata_isEarlier(tdata, child, index)) {
+            break;
+        }
+        _hostsinglethreaddata_swap(tdata, index, child);
+        index = child;
+    }
+}
+
+static void _hostsinglethreaddata_addActive(HostSingleThreadData* tdata,
+                                            HostSingleQueueData* qdata) {
+    qdata->activeIndex = tdata->activeHosts->len;
+    g_ptr_array_add(tdata->activeHosts, qdata);
+    _hostsinglethreaddata_sift(tdata, qdata->activeIndex);
+}
+
+static void _hostsinglethreaddata_removeActive(HostSingleThreadData* tdata,
+                                               HostSingleQueueData* qdata) {
+    guint index = qdata->activeIndex;
+    utility_assert(g_ptr_array_index(tdata->activeHosts, index) == qdata);
+    _hostsinglethreaddata_swap(tdata, index, tdata->activeHosts->len - 1);
+    g_ptr_array_remove_index(tdata->activeHosts, tdata->activeHosts->len - 1);
+    if(index < tdata->activeHosts->len) {
+        _hostsinglethreaddata_sift(tdata, index);
+    }
+}
+
+static HostSingleQueueData* _hostsinglethreaddata_removeEarliest(HostSingleThreadData* tdata) {
+    HostSingleQueueData* qdata = g_ptr_array_index(tdata->activeHosts, 0);
+    _hostsinglethreaddata_removeActive(tdata, qdata);
+    return qdata;
+}
+
+/* whether one of the hosts in activeHosts has an event before limit */
+static gboolean _hostsinglethreaddata_hasActiveBefore(HostSingleThreadData* tdata,
+                                                      SimulationTime limit) {
+    return tdata->activeHosts->len > 0 &&
+           ((HostSingleQueueData*)g_ptr_array_index(tdata->activeHosts, 0))->activeTime < limit;
+}
+
+/* takes the first of the waitingHosts whose plugin has made its next syscall, or if
+ * there's none and mustTake is set, the one that has waited the longest */
+static HostSingleQueueData* _hostsinglethreaddata_takeWaitingHost(HostSingleThreadData* tdata,
+                                                                  gboolean mustTake) {
+    for(guint i = 0; i < tdata->waitingHosts->len; i++) {
+        HostSingleQueueData* qdata = g_ptr_array_index(tdata->waitingHosts, i);
+        if(!host_isWaitingForPlugin(qdata->host)) {
+            return g_ptr_array_remove_index(tdata->waitingHosts, i);
+        }
+    }
+    if(mustTake && tdata->waitingHosts->len > 0) {
+        return g_ptr_array_remove_index(tdata->waitingHosts, 0);
+    }
+    return NULL;
+}
+
+/* brings activeHosts up to date with the events that were pushed since we last did this.
+ * must be called by the owning thread while it is not running a host. */
+static void _hostsinglethreaddata_refreshActive(HostSingleThreadData* tdata) {
+    utility_assert(tdata->runningHost == NULL);
+
+    for(guint i = 0; i < tdata->deferredHosts->len; i++) {
+        _hostsinglethreaddata_addActive(tdata, g_ptr_array_index(tdata->deferredHosts, i));
+    }
+    g_ptr_array_set_size(tdata->deferredHosts, 0);
+
+    g_mutex_lock(&(tdata->wokenLock));
+    for(guint i = 0; i < tdata->wokenHosts->len; i++) {
+        HostSingleQueueData* qdata = g_ptr_array_index(tdata->wokenHosts, i);
+        g_mutex_lock(&(qdata->lock));
+        qdata->isWoken = FALSE;
+        qdata->activeTime = _hostsinglequeuedata_peekTime(qdata);
+        g_mutex_unlock(&(qdata->lock));
+        _hostsinglethreaddata_sift(tdata, qdata->activeIndex);
+    }
+    g_ptr_array_set_size(tdata->wokenHosts, 0);
+    g_mutex_unlock(&(tdata->wokenLock));
+}
+
 /* this must be run synchronously, or the call must be protected by locks */
 static void _schedulerpolicyhostsingle_addHost(SchedulerPolicy* policy, Host* host, pthread_t randomThread) {
     MAGIC_ASSERT(policy);
     HostSinglePolicyData* data = policy->data;
 
     /* each host has its own queue */
-    if(!g_hash_table_lookup(data->hostToQueueDataMap, host)) {
-        g_hash_table_replace(data->hostToQueueDataMap, host, _hostsinglequeuedata_new());
+    HostSingleQueueData* qdata = g_hash_table_lookup(data->hostToQueueDataMap, host);
+    if(!qdata) {
+        qdata = _hostsinglequeuedata_new(host);
+        g_hash_table_replace(data->hostToQueueDataMap, host, qdata);
     }
 
     /* each thread keeps track of the hosts it needs to run */
@@ -140,16 +294,21 @@ static void _schedulerpolicyhostsingle_addHost(SchedulerPolicy* policy, Host* ho
         tdata = _hostsinglethreaddata_new();
         g_hash_table_replace(data->threadToThreadDataMap, GUINT_TO_POINTER(assignedThread), tdata);
     }
-    g_queue_push_tail(tdata->unprocessedHosts, host);
+    utility_assert(qdata->owner == NULL);
+    qdata->owner = tdata;
+    g_queue_push_tail(tdata->allHosts, host);
+    tdata->maxLookahead = MAX(tdata->maxLookahead, host_getLookahead(host));
+    tdata->minSendLatency = MIN(tdata->minSendLatency, host_getSendLatency(host));
+
+    g_mutex_lock(&(qdata->lock));
+    qdata->activeTime = _hostsinglequeuedata_peekTime(qdata);
+    g_mutex_unlock(&(qdata->lock));
+    _hostsinglethreaddata_addActive(tdata, qdata);
 
     /* finally, store the host-to-thread mapping */
     g_hash_table_replace(data->hostToThreadMap, host, GUINT_TO_POINTER(assignedThread));
 }
 
-static void concat_queue_iter(Host* hostItem, GQueue* userQueue) {
-    g_queue_push_tail(userQueue, hostItem);
-}
-
 static GQueue* _schedulerpolicyhostsingle_getHosts(SchedulerPolicy* policy) {
     MAGIC_ASSERT(policy);
     HostSinglePolicyData* data = policy->data;
@@ -157,17 +316,6 @@ static GQueue* _schedulerpolicyhostsingle_getHosts(SchedulerPolicy* policy) {
     if(!tdata) {
         return NULL;
     }
-    if(g_queue_is_empty(tdata->unprocessedHosts)) {
-        return tdata->processedHosts;
-    }
-    if(g_queue_is_empty(tdata->processedHosts)) {
-        return tdata->unprocessedHosts;
-    }
-    if(tdata->allHosts) {
-        g_queue_free(tdata->allHosts);
-    }
-    tdata->allHosts = g_queue_copy(tdata->processedHosts);
-    g_queue_foreach(tdata->unprocessedHosts, (GFunc)concat_queue_iter, tdata->allHosts);
     return tdata->allHosts;
 }
 
@@ -183,6 +331,7 @@ static void _schedulerpolicyhostsingle_push(SchedulerPolicy* policy, Event* even
      * moving on to the next host, so we must adjust the time whenever the srcHost and
      * dstHost are not the same. */
     SimulationTime eventTime = event_getTime(event);
+    barrier = schedulerpolicy_getHostBarrier(policy, dstHost, barrier);
 
     if(srcHost != dstHost && eventTime < barrier) {
         event_setTime(event, barrier);
@@ -198,25 +347,33 @@ static void _schedulerpolicyhostsingle_push(SchedulerPolicy* policy, Event* even
     HostSingleQueueData* qdata = g_hash_table_lookup(data->hostToQueueDataMap, dstHost);
     utility_assert(qdata);
 
-#ifdef USE_PERF_TIMERS
-    /* tracking idle time spent waiting for the destination queue lock */
-    if(tdata) {
-        g_timer_continue(tdata->pushIdleTime);
-    }
-#endif
-    g_mutex_lock(&(qdata->lock));
-#ifdef USE_PERF_TIMERS
-    if(tdata) {
-        g_timer_stop(tdata->pushIdleTime);
+    {
+        /* tracking idle time spent waiting for the destination queue lock */
+        PERFTIMER_SCOPE(tdata ? &tdata->pushIdleTime : NULL);
+        g_mutex_lock(&(qdata->lock));
     }
-#endif
 
     /* 'deliver' the event to the destination queue */
-    priorityqueue_push(qdata->pq, event);
+    eventqueue_push(qdata->pq, event);
     qdata->nPushed++;
 
+    /* make sure the owner looks at the host before the event is due. this is never needed
+     * in the current round: other hosts' events are delayed to the barrier, and the owner
+     * is running the host if it sent the event to itself. */
+    gboolean needsWake = event_getTime(event) < qdata->activeTime && !qdata->isWoken;
+    if(needsWake) {
+        qdata->isWoken = TRUE;
+    }
+
     /* release the destination queue lock */
     g_mutex_unlock(&(qdata->lock));
+
+    if(needsWake) {
+        utility_assert(qdata->owner);
+        g_mutex_lock(&(qdata->owner->wokenLock));
+        g_ptr_array_add(qdata->owner->wokenHosts, qdata);
+        g_mutex_unlock(&(qdata->owner->wokenLock));
+    }
 }
 
 static Event* _schedulerpolicyhostsingle_pop(SchedulerPolicy* policy, SimulationTime barrier) {
@@ -231,93 +388,316 @@ static Event* _schedulerpolicyhostsingle_pop(SchedulerPolicy* policy, Simulation
         return NULL;
     }
 
+    /* charge the event that we returned last to its host */
+    guint64 nowNanos = 0;
+    if(policy->useRebalancing) {
+        nowNanos = _hostsingle_nowNanos();
+        if(tdata->runningHost != NULL && tdata->lastPopNanos != 0) {
+            tdata->runningHost->busyNanos += nowNanos - tdata->lastPopNanos;
+        }
+        tdata->lastPopNanos = 0;
+    }
+
     if(barrier > tdata->currentBarrier) {
         tdata->currentBarrier = barrier;
+        _hostsinglethreaddata_refreshActive(tdata);
+    }
 
-        /* make sure all of the hosts that were processed last time get processed in the next round */
-        if(g_queue_is_empty(tdata->unprocessedHosts) && !g_queue_is_empty(tdata->processedHosts)) {
-            GQueue* swap = tdata->unprocessedHosts;
-            tdata->unprocessedHosts = tdata->processedHosts;
-            tdata->processedHosts = swap;
-        } else {
-            while(!g_queue_is_empty(tdata->processedHosts)) {
-                g_queue_push_tail(tdata->unprocessedHosts, g_queue_pop_head(tdata->processedHosts));
+    /* hosts may not run events at or after their host barrier, which is never after the
+     * round barrier unless rounds are decoupled, and then not by more than their lookahead */
+    SimulationTime limit = barrier;
+    if(policy->useDecoupledRounds) {
+        limit = (barrier < SIMTIME_MAX - tdata->maxLookahead) ? barrier + tdata->maxLookahead
+                                                               : SIMTIME_MAX;
+    }
+
+    while(tdata->runningHost != NULL || tdata->activeHosts->len > 0 ||
+          tdata->waitingHosts->len > 0) {
+        if(tdata->runningHost == NULL) {
+            /* go back to a host whose plugin is ready first, and only wait for a plugin
+             * once there's nothing else to run */
+            gboolean hasActive = _hostsinglethreaddata_hasActiveBefore(tdata, limit);
+            tdata->runningHost = _hostsinglethreaddata_takeWaitingHost(tdata, !hasActive);
+            if(tdata->runningHost == NULL) {
+                if(!hasActive) {
+                    /* none of our hosts have anything to do this round */
+                    break;
+                }
+                tdata->runningHost = _hostsinglethreaddata_removeEarliest(tdata);
             }
         }
-    }
 
-    while(!g_queue_is_empty(tdata->unprocessedHosts)) {
-        Host* host = g_queue_peek_head(tdata->unprocessedHosts);
-        HostSingleQueueData* qdata = g_hash_table_lookup(data->hostToQueueDataMap, host);
-        utility_assert(qdata);
+        HostSingleQueueData* qdata = tdata->runningHost;
+        Host* host = qdata->host;
+
+        /* the host's next event would block until its plugin makes its next syscall, so
+         * run the events of another host in the meantime. the host's own events still run
+         * in order, and other hosts can't send it events for this round, so this doesn't
+         * change the simulation. */
+        if(policy->usePipelinedWorkers && _hostsinglethreaddata_hasActiveBefore(tdata, limit) &&
+           host_isWaitingForPlugin(host)) {
+            g_ptr_array_add(tdata->waitingHosts, qdata);
+            tdata->runningHost = NULL;
+            continue;
+        }
 
-#ifdef USE_PERF_TIMERS
-        /* tracking idle time spent waiting for the host queue lock */
-        g_timer_continue(tdata->popIdleTime);
-#endif
-        g_mutex_lock(&(qdata->lock));
-#ifdef USE_PERF_TIMERS
-        g_timer_stop(tdata->popIdleTime);
-#endif
+        {
+            /* tracking idle time spent waiting for the host queue lock */
+            PERFTIMER_SCOPE(&tdata->popIdleTime);
+            g_mutex_lock(&(qdata->lock));
+        }
 
-        Event* nextEvent = priorityqueue_peek(qdata->pq);
-        SimulationTime eventTime = (nextEvent != NULL) ? event_getTime(nextEvent) : SIMTIME_INVALID;
+        Event* nextEvent = eventqueue_peek(qdata->pq);
+        SimulationTime eventTime = (nextEvent != NULL) ? event_getTime(nextEvent) : SIMTIME_MAX;
+        SimulationTime hostBarrier = schedulerpolicy_getHostBarrier(policy, host, barrier);
 
-        if(nextEvent != NULL && eventTime < barrier) {
+        if(nextEvent != NULL && eventTime < hostBarrier) {
             utility_assert(eventTime >= qdata->lastEventTime);
             qdata->lastEventTime = eventTime;
-            nextEvent = priorityqueue_pop(qdata->pq);
+            nextEvent = eventqueue_pop(qdata->pq);
             qdata->nPopped++;
+            /* nobody needs to wake the host while we are running it */
+            qdata->activeTime = 0;
         } else {
             nextEvent = NULL;
+            qdata->activeTime = eventTime;
         }
 
         g_mutex_unlock(&(qdata->lock));
 
         if(nextEvent != NULL) {
+            tdata->lastPopNanos = nowNanos;
             return nextEvent;
         }
-        /* this host is done, store it in the processed queue and then
-         * try the next host if we still have more */
-        g_queue_push_tail(tdata->processedHosts, g_queue_pop_head(tdata->unprocessedHosts));
+
+        /* this host is done for this round. if it still has an event that another host
+         * could run this round, keep it aside so that we don't pick it again. */
+        tdata->runningHost = NULL;
+        if(eventTime < limit) {
+            g_ptr_array_add(tdata->deferredHosts, qdata);
+        } else {
+            _hostsinglethreaddata_addActive(tdata, qdata);
+        }
     }
 
     /* if we make it here, all hosts for this thread have no more events before barrier */
     return NULL;
 }
 
-static void _schedulerpolicyhostsingle_findMinTime(Host* host, HostSingleSearchState* state) {
-    HostSingleQueueData* qdata = g_hash_table_lookup(state->data->hostToQueueDataMap, host);
-    utility_assert(qdata);
+static SimulationTime
+_schedulerpolicyhostsingle_getNextHostTime(SchedulerPolicy* policy, Host** nextEventHost,
+                                           SimulationTime* otherNextEventTime) {
+    MAGIC_ASSERT(policy);
+    HostSinglePolicyData* data = policy->data;
 
-    g_mutex_lock(&(qdata->lock));
-    Event* event = priorityqueue_peek(qdata->pq);
-    g_mutex_unlock(&(qdata->lock));
+    SimulationTime nextEventTime = SIMTIME_MAX;
+    *nextEventHost = NULL;
+    *otherNextEventTime = SIMTIME_MAX;
 
-    if(event != NULL) {
-        state->nextEventTime = MIN(state->nextEventTime, event_getTime(event));
+    HostSingleThreadData* tdata = g_hash_table_lookup(data->threadToThreadDataMap, GUINT_TO_POINTER(pthread_self()));
+    if(tdata && tdata->runningHost == NULL) {
+        /* the earliest host is at the top of the heap, and the next earliest of the others
+         * is one of its children */
+        _hostsinglethreaddata_refreshActive(tdata);
+        for(guint i = 0; i < MIN(3, tdata->activeHosts->len); i++) {
+            HostSingleQueueData* qdata = g_ptr_array_index(tdata->activeHosts, i);
+            if(qdata->activeTime != SIMTIME_MAX) {
+                schedulerpolicy_addNextTime(&nextEventTime, nextEventHost, otherNextEventTime,
+                                            qdata->host, qdata->activeTime);
+            }
+        }
     }
+    debug("next event at time %" G_GUINT64_FORMAT, nextEventTime);
+
+    return nextEventTime;
+}
+
+static SimulationTime _schedulerpolicyhostsingle_getNextSendTime(SchedulerPolicy* policy) {
+    MAGIC_ASSERT(policy);
+    HostSinglePolicyData* data = policy->data;
+
+    SimulationTime nextSendTime = SIMTIME_MAX;
+
+    HostSingleThreadData* tdata = g_hash_table_lookup(data->threadToThreadDataMap, GUINT_TO_POINTER(pthread_self()));
+    if(!tdata || tdata->runningHost != NULL) {
+        return nextSendTime;
+    }
+    _hostsinglethreaddata_refreshActive(tdata);
+
+    /* walk the heap from the top, skipping the subtrees whose earliest host couldn't beat
+     * the best time so far even with the smallest send latency of our hosts. usually only
+     * the hosts with events near the earliest one get visited. */
+    GArray* stack = g_array_new(FALSE, FALSE, sizeof(guint));
+    if(tdata->activeHosts->len > 0) {
+        guint root = 0;
+        g_array_append_val(stack, root);
+    }
+    while(stack->len > 0) {
+        guint index = g_array_index(stack, guint, stack->len - 1);
+        g_array_set_size(stack, stack->len - 1);
+
+        HostSingleQueueData* qdata = g_ptr_array_index(tdata->activeHosts, index);
+        if(qdata->activeTime >= SIMTIME_MAX - tdata->minSendLatency ||
+           qdata->activeTime + tdata->minSendLatency >= nextSendTime) {
+            continue;
+        }
+
+        SimulationTime sendLatency = host_getSendLatency(qdata->host);
+        if(qdata->activeTime < SIMTIME_MAX - sendLatency) {
+            nextSendTime = MIN(nextSendTime, qdata->activeTime + sendLatency);
+        }
+
+        for(guint child = 2 * index + 1; child <= 2 * index + 2; child++) {
+            if(child < tdata->activeHosts->len) {
+                g_array_append_val(stack, child);
+            }
+        }
+    }
+    g_array_free(stack, TRUE);
+
+    return nextSendTime;
 }
 
 static SimulationTime _schedulerpolicyhostsingle_getNextTime(SchedulerPolicy* policy) {
+    Host* nextEventHost = NULL;
+    SimulationTime otherNextEventTime = SIMTIME_MAX;
+    return _schedulerpolicyhostsingle_getNextHostTime(policy, &nextEventHost, &otherNextEventTime);
+}
+
+/* moves one of busiest's hosts to idlest if that makes the busier of the two less busy,
+ * choosing the host whose busy time is closest to half of the difference between them.
+ * returns FALSE if no host would help. */
+static gboolean _schedulerpolicyhostsingle_moveHost(HostSinglePolicyData* data,
+                                                    HostSingleThreadData* busiest,
+                                                    HostSingleThreadData* idlest,
+                                                    pthread_t idlestThread) {
+    guint64 half = (busiest->busyNanos - idlest->busyNanos) / 2;
+    HostSingleQueueData* best = NULL;
+    guint64 bestDistance = G_MAXUINT64;
+
+    for(GList* link = busiest->allHosts->head; link != NULL; link = link->next) {
+        HostSingleQueueData* qdata = g_hash_table_lookup(data->hostToQueueDataMap, link->data);
+        if(qdata->busyNanos == 0 || qdata->busyNanos >= 2 * half) {
+            continue;
+        }
+        guint64 distance =
+            (qdata->busyNanos > half) ? qdata->busyNanos - half : half - qdata->busyNanos;
+        if(distance < bestDistance) {
+            best = qdata;
+            bestDistance = distance;
+        }
+    }
+
+    if(best == NULL) {
+        return FALSE;
+    }
+
+    /* only the thread that ran the host since the last rebalance can be attached to it,
+     * and that's the thread we first move it away from */
+    if(!best->isMoved) {
+        g_queue_push_tail(busiest->movedHosts, best->host);
+        best->isMoved = TRUE;
+    }
+
+    _hostsinglethreaddata_removeActive(busiest, best);
+    g_queue_remove(busiest->allHosts, best->host);
+    busiest->busyNanos -= best->busyNanos;
+
+    best->owner = idlest;
+    g_queue_push_tail(idlest->allHosts, best->host);
+    _hostsinglethreaddata_addActive(idlest, best);
+    idlest->busyNanos += best->busyNanos;
+    idlest->maxLookahead = MAX(idlest->maxLookahead, host_getLookahead(best->host));
+    idlest->minSendLatency = MIN(idlest->minSendLatency, host_getSendLatency(best->host));
+
+    g_hash_table_replace(data->hostToThreadMap, best->host, GUINT_TO_POINTER(idlestThread));
+    return TRUE;
+}
+
+/* must be called while no thread is running events, e.g. between rounds */
+static gboolean _schedulerpolicyhostsingle_rebalance(SchedulerPolicy* policy) {
     MAGIC_ASSERT(policy);
     HostSinglePolicyData* data = policy->data;
 
-    /* set up state that we need for the foreach queue iterator */
-    HostSingleSearchState searchState;
-    memset(&searchState, 0, sizeof(HostSingleSearchState));
-    searchState.data = data;
-    searchState.nextEventTime = SIMTIME_MAX;
+    guint nThreads = g_hash_table_size(data->threadToThreadDataMap);
+    pthread_t* threads = g_new0(pthread_t, nThreads);
+    HostSingleThreadData** tdatas = g_new0(HostSingleThreadData*, nThreads);
+
+    GHashTableIter iter;
+    gpointer key, value;
+    guint i = 0;
+    g_hash_table_iter_init(&iter, data->threadToThreadDataMap);
+    while(g_hash_table_iter_next(&iter, &key, &value)) {
+        threads[i] = GPOINTER_TO_UINT(key);
+        tdatas[i] = value;
+        tdatas[i]->busyNanos = 0;
+        /* put the woken and deferred hosts back into the heap, so that we can move them */
+        _hostsinglethreaddata_refreshActive(tdatas[i]);
+        i++;
+    }
+
+    g_hash_table_iter_init(&iter, data->hostToQueueDataMap);
+    while(g_hash_table_iter_next(&iter, NULL, &value)) {
+        HostSingleQueueData* qdata = value;
+        qdata->owner->busyNanos += qdata->busyNanos;
+    }
 
+    /* each move narrows the gap between the busiest and the idlest thread. stop once they
+     * are within 10% of each other, since the next epoch won't repeat this one exactly. */
+    guint nMoved = 0;
+    guint maxMoves = g_hash_table_size(data->hostToQueueDataMap);
+    while(nThreads > 1 && nMoved < maxMoves) {
+        guint busiest = 0, idlest = 0;
+        for(i = 1; i < nThreads; i++) {
+            if(tdatas[i]->busyNanos > tdatas[busiest]->busyNanos) {
+                busiest = i;
+            }
+            if(tdatas[i]->busyNanos < tdatas[idlest]->busyNanos) {
+                idlest = i;
+            }
+        }
+
+        guint64 gap = tdatas[busiest]->busyNanos - tdatas[idlest]->busyNanos;
+        if(gap <= tdatas[busiest]->busyNanos / 10 ||
+           !_schedulerpolicyhostsingle_moveHost(
+               data, tdatas[busiest], tdatas[idlest], threads[idlest])) {
+            break;
+        }
+        nMoved++;
+    }
+
+    debug("moved %u hosts between %u threads", nMoved, nThreads);
+
+    g_hash_table_iter_init(&iter, data->hostToQueueDataMap);
+    while(g_hash_table_iter_next(&iter, NULL, &value)) {
+        ((HostSingleQueueData*)value)->busyNanos = 0;
+    }
+
+    g_free(threads);
+    g_free(tdatas);
+    return nMoved > 0;
+}
+
+/* must be called by every thread after a rebalance that moved hosts, before the next round */
+static void _schedulerpolicyhostsingle_detachMovedHosts(SchedulerPolicy* policy) {
+    MAGIC_ASSERT(policy);
+    HostSinglePolicyData* data = policy->data;
     HostSingleThreadData* tdata = g_hash_table_lookup(data->threadToThreadDataMap, GUINT_TO_POINTER(pthread_self()));
-    if(tdata) {
-        /* make sure we get all hosts, which are probably held in the processedHosts queue between rounds */
-        g_queue_foreach(tdata->unprocessedHosts, (GFunc)_schedulerpolicyhostsingle_findMinTime, &searchState);
-        g_queue_foreach(tdata->processedHosts, (GFunc)_schedulerpolicyhostsingle_findMinTime, &searchState);
+    if(!tdata) {
+        return;
     }
-    debug("next event at time %" G_GUINT64_FORMAT, searchState.nextEventTime);
 
-    return searchState.nextEventTime;
+    Host* host;
+    while((host = g_queue_pop_head(tdata->movedHosts)) != NULL) {
+        HostSingleQueueData* qdata = g_hash_table_lookup(data->hostToQueueDataMap, host);
+        qdata->isMoved = FALSE;
+
+        /* this also forgets the host's blocked threads that we kept attached, so that we
+         * never touch them again once the new owner runs the host */
+        worker_setActiveHost(host);
+        host_detachAllPlugins(host);
+        worker_setActiveHost(NULL);
+    }
 }
 
 static void _schedulerpolicyhostsingle_free(SchedulerPolicy* policy) {
@@ -346,6 +726,10 @@ SchedulerPolicy* schedulerpolicyhostsingle_new() {
     policy->push = _schedulerpolicyhostsingle_push;
     policy->pop = _schedulerpolicyhostsingle_pop;
     policy->getNextTime = _schedulerpolicyhostsingle_getNextTime;
+    policy->getNextHostTime = _schedulerpolicyhostsingle_getNextHostTime;
+    policy->rebalance = _schedulerpolicyhostsingle_rebalance;
+    policy->detachMovedHosts = _schedulerpolicyhostsingle_detachMovedHosts;
+    policy->getNextSendTime = _schedulerpolicyhostsingle_getNextSendTime;
     policy->free = _schedulerpolicyhostsingle_free;
 
     policy->type = SP_PARALLEL_HOST_SINGLE;
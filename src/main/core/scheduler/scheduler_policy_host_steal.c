@@ -10,23 +10,42 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 
 #include "lib/logger/logger.h"
 #include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/definitions.h"
 #include "main/core/work/event.h"
+#include "main/core/work/event_queue.h"
 #include "main/core/worker.h"
 #include "main/host/host.h"
-#include "main/utility/priority_queue.h"
+#include "main/utility/mpsc_queue.h"
+#include "main/utility/perf_timer.h"
 #include "main/utility/utility.h"
 
 typedef struct _HostStealQueueData HostStealQueueData;
 struct _HostStealQueueData {
     GMutex lock;
-    PriorityQueue* pq;
+    EventQueue* pq;
+    /* only used by the inbox variant of this policy. events pushed from other hosts are
+     * queued here without locking, and moved into pq by the thread that runs the host */
+    MPSCQueue* inbox;
     SimulationTime lastEventTime;
     gsize nPushed;
     gsize nPopped;
+    /* the time of the earliest event in pq when the thread running the host last looked at
+     * it, or SIMTIME_MAX. only accessed by that thread. */
+    SimulationTime queuedTime;
+    /* the earliest time of the events pushed since then, or SIMTIME_MAX. together with
+     * queuedTime, this tells us when the host next has work without locking its queue. */
+    SimulationTime pushedTime;
+    /* when the thread running the host started running it this round */
+    guint64 runStartNanos;
+    /* the events and wall time that running the host took in recent rounds, as moving
+     * averages. only accessed by the thread that is running the host, or between rounds
+     * by the thread that owns it. */
+    gdouble avgRoundEvents;
+    gdouble avgRoundNanos;
 };
 
 typedef struct _HostStealThreadData HostStealThreadData;
@@ -43,11 +62,17 @@ struct _HostStealThreadData {
     Host* runningHost;
     SimulationTime currentBarrier;
 #ifdef USE_PERF_TIMERS
-    GTimer* pushIdleTime;
-    GTimer* popIdleTime;
+    PerfTimer pushIdleTime;
+    PerfTimer popIdleTime;
 #endif
+    /* the estimated cost in nanoseconds of the hosts in unprocessedHosts. written while
+     * holding this thread's lock, and read without it by threads choosing whom to steal from */
+    gint64 unprocessedNanos;
     /* which worker thread this is */
     guint tnumber;
+    /* the number of hosts this thread stole from other threads since the last call to
+     * takeStolenHostCount(). only accessed by this thread, while holding its lock */
+    gsize nStolenHosts;
     GMutex lock;
     atomic_bool isStealable;
 };
@@ -60,13 +85,24 @@ struct _HostStealPolicyData {
     GHashTable* threadToThreadDataMap;
     GHashTable* hostToThreadMap;
     GRWLock lock;
+    /* the largest lookahead of all hosts, which bounds how far past the round barrier any
+     * of them may run with decoupled rounds */
+    SimulationTime maxLookahead;
+    /* if true, pushes between hosts go through each host's lock-free inbox, and only the
+     * thread running a host ever touches the host's pq, so we never lock the queue data */
+    gboolean useInbox;
     MAGIC_DECLARE;
 };
 
+/* the weight of the newest round in a host's moving averages */
+#define HOST_COST_WEIGHT 0.5
+
 typedef struct _HostStealSearchState HostStealSearchState;
 struct _HostStealSearchState {
     HostStealPolicyData* data;
     SimulationTime nextEventTime;
+    Host* nextEventHost;
+    SimulationTime otherNextEventTime;
 };
 
 static HostStealThreadData* _hoststealthreaddata_new() {
@@ -76,14 +112,11 @@ static HostStealThreadData* _hoststealthreaddata_new() {
     tdata->processedHosts = g_queue_new();
 
 #ifdef USE_PERF_TIMERS
-    /* Create new timers to track thread idle times. The timers start in a 'started' state,
-     * so we want to stop them immediately so we can continue/stop later around blocking code
-     * to collect total elapsed idle time in the scheduling process throughout the entire
-     * runtime of the program. */
-    tdata->pushIdleTime = g_timer_new();
-    g_timer_stop(tdata->pushIdleTime);
-    tdata->popIdleTime = g_timer_new();
-    g_timer_stop(tdata->popIdleTime);
+    /* Track thread idle times. The timers start stopped, and we continue/stop them around
+     * blocking code to collect total elapsed idle time in the scheduling process throughout
+     * the entire runtime of the program. */
+    tdata->pushIdleTime = PERFTIMER_INIT;
+    tdata->popIdleTime = PERFTIMER_INIT;
 #endif
     g_mutex_init(&(tdata->lock));
     tdata->runningHost = NULL;
@@ -105,16 +138,8 @@ static void _hoststealthreaddata_free(HostStealThreadData* tdata) {
         }
 
 #ifdef USE_PERF_TIMERS
-        gdouble totalPushWaitTime = 0.0;
-        if(tdata->pushIdleTime) {
-            totalPushWaitTime = g_timer_elapsed(tdata->pushIdleTime, NULL);
-            g_timer_destroy(tdata->pushIdleTime);
-        }
-        gdouble totalPopWaitTime = 0.0;
-        if(tdata->popIdleTime) {
-            totalPopWaitTime = g_timer_elapsed(tdata->popIdleTime, NULL);
-            g_timer_destroy(tdata->popIdleTime);
-        }
+        gdouble totalPushWaitTime = perftimer_elapsed(&tdata->pushIdleTime);
+        gdouble totalPopWaitTime = perftimer_elapsed(&tdata->popIdleTime);
 
         info("scheduler thread data destroyed, total push wait time was %f seconds, "
              "total pop wait time was %f seconds",
@@ -124,25 +149,96 @@ static void _hoststealthreaddata_free(HostStealThreadData* tdata) {
     }
 }
 
-static HostStealQueueData* _hoststealqueuedata_new() {
+static HostStealQueueData* _hoststealqueuedata_new(gboolean useInbox) {
     HostStealQueueData* qdata = g_new0(HostStealQueueData, 1);
 
     g_mutex_init(&(qdata->lock));
-    qdata->pq = priorityqueue_new((GCompareDataFunc)event_compare, NULL, (GDestroyNotify)event_unref);
+    qdata->pq = eventqueue_new();
+    qdata->queuedTime = SIMTIME_MAX;
+    qdata->pushedTime = SIMTIME_MAX;
+    if(useInbox) {
+        qdata->inbox = mpscqueue_new((GDestroyNotify)event_unref);
+    }
 
     return qdata;
 }
 
 static void _hoststealqueuedata_free(HostStealQueueData* qdata) {
     if(qdata) {
+        if(qdata->inbox) {
+            mpscqueue_free(qdata->inbox);
+        }
         if(qdata->pq) {
-            priorityqueue_free(qdata->pq);
+            eventqueue_free(qdata->pq);
         }
         g_mutex_clear(&(qdata->lock));
         g_free(qdata);
     }
 }
 
+static guint64 _hoststealqueuedata_nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (guint64)now.tv_sec * SIMTIME_ONE_SECOND + (guint64)now.tv_nsec;
+}
+
+/* the expected wall time of running the host for one round, based on the previous rounds */
+static gint64 _hoststealqueuedata_getCost(HostStealQueueData* qdata) {
+    return (gint64)qdata->avgRoundNanos;
+}
+
+static void _hoststealqueuedata_startRound(HostStealQueueData* qdata) {
+    qdata->runStartNanos = _hoststealqueuedata_nowNanos();
+    qdata->avgRoundEvents *= (1 - HOST_COST_WEIGHT);
+}
+
+static void _hoststealqueuedata_finishRound(HostStealQueueData* qdata) {
+    gdouble elapsed = (gdouble)(_hoststealqueuedata_nowNanos() - qdata->runStartNanos);
+    qdata->avgRoundNanos = HOST_COST_WEIGHT * elapsed + (1 - HOST_COST_WEIGHT) * qdata->avgRoundNanos;
+}
+
+/* the host can't have an event before this time. only the thread that last ran the host
+ * may call this, when no thread is running it. */
+static SimulationTime _hoststealqueuedata_getNextTime(HostStealQueueData* qdata) {
+    return MIN(qdata->queuedTime, __atomic_load_n(&qdata->pushedTime, __ATOMIC_SEQ_CST));
+}
+
+/* must be called after the event at time is in pq or the inbox */
+static void _hoststealqueuedata_notePush(HostStealQueueData* qdata, SimulationTime time) {
+    SimulationTime old = __atomic_load_n(&qdata->pushedTime, __ATOMIC_RELAXED);
+    while(time < old && !__atomic_compare_exchange_n(&qdata->pushedTime, &old, time, FALSE,
+                                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* a round in which the host had nothing to do */
+static void _hoststealqueuedata_skipRound(HostStealQueueData* qdata) {
+    qdata->avgRoundEvents *= (1 - HOST_COST_WEIGHT);
+    qdata->avgRoundNanos *= (1 - HOST_COST_WEIGHT);
+}
+
+static void _hoststealqueuedata_pushFromInbox(Event* event, HostStealQueueData* qdata) {
+    eventqueue_push(qdata->pq, event);
+    qdata->nPushed++;
+}
+
+/* the queue lock is only needed when other threads may push directly into the pq */
+static void _hoststealqueuedata_lock(HostStealPolicyData* data, HostStealQueueData* qdata) {
+    if(data->useInbox) {
+        /* must only be called by the thread that is running (or owns) the host. move all
+         * events that other hosts sent us into the private pq so that they are ordered. */
+        mpscqueue_drain(qdata->inbox, (GFunc)_hoststealqueuedata_pushFromInbox, qdata);
+    } else {
+        g_mutex_lock(&(qdata->lock));
+    }
+}
+
+static void _hoststealqueuedata_unlock(HostStealPolicyData* data, HostStealQueueData* qdata) {
+    if(!data->useInbox) {
+        g_mutex_unlock(&(qdata->lock));
+    }
+}
+
 /* this must be run synchronously, or the thread must be protected by locks */
 static void _schedulerpolicyhoststeal_addHost(SchedulerPolicy* policy, Host* host, pthread_t randomThread) {
     MAGIC_ASSERT(policy);
@@ -153,7 +249,8 @@ static void _schedulerpolicyhoststeal_addHost(SchedulerPolicy* policy, Host* hos
      */
     if(!g_hash_table_lookup(data->hostToQueueDataMap, host)) {
         g_rw_lock_writer_lock(&data->lock);
-        g_hash_table_replace(data->hostToQueueDataMap, host, _hoststealqueuedata_new());
+        g_hash_table_replace(data->hostToQueueDataMap, host, _hoststealqueuedata_new(data->useInbox));
+        data->maxLookahead = MAX(data->maxLookahead, host_getLookahead(host));
         g_rw_lock_writer_unlock(&data->lock);
     }
 
@@ -208,6 +305,7 @@ static void _schedulerpolicyhoststeal_migrateHost(SchedulerPolicy* policy, Host*
 //        host_migrate(host, &oldThread, &newThread);
         trace("Migrating host %s from thread %u to thread %u", host_getName(host), tdata->tnumber,
               tdataNew->tnumber);
+        tdataNew->nStolenHosts++;
     }
     _schedulerpolicyhoststeal_addHost(policy, host, newThread);
 }
@@ -251,6 +349,7 @@ static void _schedulerpolicyhoststeal_push(SchedulerPolicy* policy, Event* event
      * moving on to the next host, so we must adjust the time whenever the srcHost and
      * dstHost are not the same. */
     SimulationTime eventTime = event_getTime(event);
+    barrier = schedulerpolicy_getHostBarrier(policy, dstHost, barrier);
 
     if(srcHost != dstHost && eventTime < barrier) {
         event_setTime(event, barrier);
@@ -268,23 +367,35 @@ static void _schedulerpolicyhoststeal_push(SchedulerPolicy* policy, Event* event
     g_rw_lock_reader_unlock(&data->lock);
     utility_assert(qdata);
 
-    /* tracking idle time spent waiting for the destination queue lock */
-    if(tdata) {
-#ifdef USE_PERF_TIMERS
-        g_timer_continue(tdata->pushIdleTime);
-#endif
-        g_mutex_lock(&(tdata->lock));
+    if(data->useInbox) {
+        if(srcHost != dstHost) {
+            /* 'deliver' the event without blocking the thread that's running dstHost. the
+             * event time is at or after the barrier, so it is not needed until next round. */
+            SimulationTime time = event_getTime(event);
+            mpscqueue_push(qdata->inbox, event);
+            _hoststealqueuedata_notePush(qdata, time);
+        } else {
+            /* we are running the host, so nobody else is using its private pq */
+            eventqueue_push(qdata->pq, event);
+            qdata->nPushed++;
+            _hoststealqueuedata_notePush(qdata, event_getTime(event));
+        }
+        return;
     }
-    g_mutex_lock(&(qdata->lock));
-#ifdef USE_PERF_TIMERS
-    if(tdata) {
-        g_timer_stop(tdata->pushIdleTime);
+
+    {
+        /* tracking idle time spent waiting for the destination queue lock */
+        PERFTIMER_SCOPE(tdata ? &tdata->pushIdleTime : NULL);
+        if(tdata) {
+            g_mutex_lock(&(tdata->lock));
+        }
+        g_mutex_lock(&(qdata->lock));
     }
-#endif
 
     /* 'deliver' the event to the destination queue */
-    priorityqueue_push(qdata->pq, event);
+    eventqueue_push(qdata->pq, event);
     qdata->nPushed++;
+    _hoststealqueuedata_notePush(qdata, event_getTime(event));
 
     /* release the destination queue lock */
     g_mutex_unlock(&(qdata->lock));
@@ -293,18 +404,112 @@ static void _schedulerpolicyhoststeal_push(SchedulerPolicy* policy, Event* event
     }
 }
 
-static Event* _schedulerpolicyhoststeal_popFromThread(SchedulerPolicy* policy, HostStealThreadData* tdata, GQueue* assignedHosts, SimulationTime barrier) {
+typedef struct _HostStealHostCost HostStealHostCost;
+struct _HostStealHostCost {
+    Host* host;
+    gint64 nanos;
+    gdouble events;
+};
+
+static gint _schedulerpolicyhoststeal_compareCost(gconstpointer a, gconstpointer b) {
+    const HostStealHostCost* ca = a;
+    const HostStealHostCost* cb = b;
+    /* descending, and by events when there's no timing yet */
+    if(ca->nanos != cb->nanos) {
+        return ca->nanos < cb->nanos ? 1 : -1;
+    }
+    return (ca->events < cb->events) - (ca->events > cb->events);
+}
+
+/* moves the hosts in tdata's unprocessedHosts that have nothing to do before the barrier
+ * straight to its processedHosts, so that we don't lock their queues or detach their
+ * plugins. must be called by tdata's thread while holding its lock, at the start of the
+ * round. */
+static void _schedulerpolicyhoststeal_skipIdleHosts(SchedulerPolicy* policy,
+                                                    HostStealPolicyData* data,
+                                                    HostStealThreadData* tdata,
+                                                    SimulationTime barrier) {
+    g_rw_lock_reader_lock(&data->lock);
+
+    /* hosts may not run events at or after their host barrier, which is never after the
+     * round barrier unless rounds are decoupled, and then not by more than their lookahead */
+    SimulationTime limit = barrier;
+    if(policy->useDecoupledRounds) {
+        limit = (barrier < SIMTIME_MAX - data->maxLookahead) ? barrier + data->maxLookahead
+                                                              : SIMTIME_MAX;
+    }
+
+    guint n = g_queue_get_length(tdata->unprocessedHosts);
+    for(guint i = 0; i < n; i++) {
+        Host* host = g_queue_pop_head(tdata->unprocessedHosts);
+        HostStealQueueData* qdata = g_hash_table_lookup(data->hostToQueueDataMap, host);
+        utility_assert(qdata);
+        if(_hoststealqueuedata_getNextTime(qdata) < limit) {
+            g_queue_push_tail(tdata->unprocessedHosts, host);
+        } else {
+            _hoststealqueuedata_skipRound(qdata);
+            g_queue_push_tail(tdata->processedHosts, host);
+        }
+    }
+
+    g_rw_lock_reader_unlock(&data->lock);
+}
+
+/* orders tdata's unprocessedHosts longest-first, and sets its unprocessedNanos. must be called
+ * by tdata's thread while holding its lock, before others can steal from it this round. */
+static void _schedulerpolicyhoststeal_sortByCost(HostStealPolicyData* data, HostStealThreadData* tdata) {
+    guint n = g_queue_get_length(tdata->unprocessedHosts);
+    if(n == 0) {
+        __atomic_store_n(&tdata->unprocessedNanos, 0, __ATOMIC_RELAXED);
+        return;
+    }
+
+    HostStealHostCost* costs = g_new(HostStealHostCost, n);
+    gint64 total = 0;
+
+    g_rw_lock_reader_lock(&data->lock);
+    for(guint i = 0; i < n; i++) {
+        Host* host = g_queue_pop_head(tdata->unprocessedHosts);
+        HostStealQueueData* qdata = g_hash_table_lookup(data->hostToQueueDataMap, host);
+        utility_assert(qdata);
+        costs[i] = (HostStealHostCost){
+            .host = host,
+            .nanos = _hoststealqueuedata_getCost(qdata),
+            .events = qdata->avgRoundEvents,
+        };
+        total += costs[i].nanos;
+    }
+    g_rw_lock_reader_unlock(&data->lock);
+
+    /* stable, so hosts without any history yet keep their order */
+    g_qsort_with_data(costs, n, sizeof(HostStealHostCost),
+                      (GCompareDataFunc)_schedulerpolicyhoststeal_compareCost, NULL);
+
+    for(guint i = 0; i < n; i++) {
+        g_queue_push_tail(tdata->unprocessedHosts, costs[i].host);
+    }
+    g_free(costs);
+
+    __atomic_store_n(&tdata->unprocessedNanos, total, __ATOMIC_RELAXED);
+}
+
+/* runs the hosts in ownerTdata's unprocessedHosts on tdata's thread; ownerTdata is tdata itself
+ * unless tdata is stealing. both threads' locks must be held. */
+static Event* _schedulerpolicyhoststeal_popFromThread(SchedulerPolicy* policy, HostStealThreadData* tdata, HostStealThreadData* ownerTdata, SimulationTime barrier) {
     /* if there is no tdata, that means this thread didn't get any hosts assigned to it */
     if(!tdata) {
         return NULL;
     }
 
     HostStealPolicyData* data = policy->data;
+    GQueue* assignedHosts = ownerTdata->unprocessedHosts;
 
     while(!g_queue_is_empty(assignedHosts) || tdata->runningHost) {
+        gboolean isStarting = FALSE;
         /* if there's no running host, we completed the last assignment and need a new one */
         if(!tdata->runningHost) {
             tdata->runningHost = g_queue_pop_head(assignedHosts);
+            isStarting = TRUE;
         }
         Host* host = tdata->runningHost;
         g_rw_lock_reader_lock(&data->lock);
@@ -312,15 +517,26 @@ static Event* _schedulerpolicyhoststeal_popFromThread(SchedulerPolicy* policy, H
         g_rw_lock_reader_unlock(&data->lock);
         utility_assert(qdata);
 
-        g_mutex_lock(&(qdata->lock));
-        Event* nextEvent = priorityqueue_peek(qdata->pq);
+        if(isStarting) {
+            __atomic_fetch_sub(&ownerTdata->unprocessedNanos, _hoststealqueuedata_getCost(qdata),
+                               __ATOMIC_RELAXED);
+            _hoststealqueuedata_startRound(qdata);
+        }
+
+        /* from here on, pushedTime only covers the events that we won't see in pq */
+        __atomic_store_n(&qdata->pushedTime, SIMTIME_MAX, __ATOMIC_SEQ_CST);
+        _hoststealqueuedata_lock(data, qdata);
+        Event* nextEvent = eventqueue_peek(qdata->pq);
         SimulationTime eventTime = (nextEvent != NULL) ? event_getTime(nextEvent) : SIMTIME_INVALID;
+        SimulationTime hostBarrier = schedulerpolicy_getHostBarrier(policy, host, barrier);
+        qdata->queuedTime = (nextEvent != NULL) ? eventTime : SIMTIME_MAX;
 
-        if(nextEvent != NULL && eventTime < barrier) {
+        if(nextEvent != NULL && eventTime < hostBarrier) {
             utility_assert(eventTime >= qdata->lastEventTime);
             qdata->lastEventTime = eventTime;
-            nextEvent = priorityqueue_pop(qdata->pq);
+            nextEvent = eventqueue_pop(qdata->pq);
             qdata->nPopped++;
+            qdata->avgRoundEvents += HOST_COST_WEIGHT;
             /* migrate iff a migration is needed */
             _schedulerpolicyhoststeal_migrateHost(policy, host, pthread_self());
         } else {
@@ -329,6 +545,7 @@ static Event* _schedulerpolicyhoststeal_popFromThread(SchedulerPolicy* policy, H
 
         if(nextEvent == NULL) {
             /* no more events on the runningHost, mark it as NULL so we get a new one */
+            _hoststealqueuedata_finishRound(qdata);
             g_queue_push_tail(tdata->processedHosts, host);
             /* detach all ptrace attachments for this host so it can be stolen next round */
             worker_setActiveHost(host);
@@ -337,7 +554,7 @@ static Event* _schedulerpolicyhoststeal_popFromThread(SchedulerPolicy* policy, H
             tdata->runningHost = NULL;
         }
 
-        g_mutex_unlock(&(qdata->lock));
+        _hoststealqueuedata_unlock(data, qdata);
 
         if(nextEvent != NULL) {
             return nextEvent;
@@ -364,13 +581,10 @@ static Event* _schedulerpolicyhoststeal_pop(SchedulerPolicy* policy, SimulationT
     }
 
     /* we only need to lock this thread's lock, since it's our own queue */
-#ifdef USE_PERF_TIMERS
-    g_timer_continue(tdata->popIdleTime);
-#endif
-    g_mutex_lock(&(tdata->lock));
-#ifdef USE_PERF_TIMERS
-    g_timer_stop(tdata->popIdleTime);
-#endif
+    {
+        PERFTIMER_SCOPE(&tdata->popIdleTime);
+        g_mutex_lock(&(tdata->lock));
+    }
 
     if(barrier > tdata->currentBarrier) {
         tdata->currentBarrier = barrier;
@@ -386,11 +600,18 @@ static Event* _schedulerpolicyhoststeal_pop(SchedulerPolicy* policy, SimulationT
             }
         }
 
+        /* unless they have nothing to do this round */
+        _schedulerpolicyhoststeal_skipIdleHosts(policy, data, tdata, barrier);
+
+        /* run (and let others steal) the most expensive hosts first, so that a heavy host
+         * doesn't start late and hold up the end of the round */
+        _schedulerpolicyhoststeal_sortByCost(data, tdata);
+
         /* we are now ready for other threads to steal our workload */
         atomic_store_explicit(&tdata->isStealable, true, memory_order_release);
     }
     /* attempt to get an event from this thread's queue */
-    Event* nextEvent = _schedulerpolicyhoststeal_popFromThread(policy, tdata, tdata->unprocessedHosts, barrier);
+    Event* nextEvent = _schedulerpolicyhoststeal_popFromThread(policy, tdata, tdata, barrier);
     g_mutex_unlock(&(tdata->lock));
     if(nextEvent != NULL) {
         return nextEvent;
@@ -402,11 +623,34 @@ static Event* _schedulerpolicyhoststeal_pop(SchedulerPolicy* policy, SimulationT
     g_rw_lock_reader_lock(&data->lock);
     guint i, n = data->threadCount;
     g_rw_lock_reader_unlock(&data->lock);
+    if(n < 2) {
+        return NULL;
+    }
+
+    /* try the threads with the most expected work left first, in round-robin order among
+     * equals. the estimates are read without locks, so they may be slightly out of date. */
+    HostStealThreadData* victims[n - 1];
+    gint64 victimNanos[n - 1];
+    g_rw_lock_reader_lock(&data->lock);
     for(i = 1; i < n; i++) {
-        guint stolenTnumber = (i + tdata->tnumber) % n;
-        g_rw_lock_reader_lock(&data->lock);
-        HostStealThreadData* stolenTdata = g_array_index(data->threadList, HostStealThreadData*, stolenTnumber);
-        g_rw_lock_reader_unlock(&data->lock);
+        HostStealThreadData* victim =
+            g_array_index(data->threadList, HostStealThreadData*, (i + tdata->tnumber) % n);
+        gint64 nanos = __atomic_load_n(&victim->unprocessedNanos, __ATOMIC_RELAXED);
+        /* insertion sort, descending; there are only as many entries as workers */
+        guint j = i - 1;
+        while(j > 0 && victimNanos[j - 1] < nanos) {
+            victims[j] = victims[j - 1];
+            victimNanos[j] = victimNanos[j - 1];
+            j--;
+        }
+        victims[j] = victim;
+        victimNanos[j] = nanos;
+    }
+    g_rw_lock_reader_unlock(&data->lock);
+
+    for(i = 0; i < n - 1; i++) {
+        HostStealThreadData* stolenTdata = victims[i];
+        guint stolenTnumber = stolenTdata->tnumber;
 
         // We only need to spin if the other thread has not yet initialized for
         // this round.
@@ -450,23 +694,20 @@ static Event* _schedulerpolicyhoststeal_pop(SchedulerPolicy* policy, SimulationT
          * what we just stole. But we also need to do this in a well-ordered manner, to
          * prevent deadlocks. To do this, we always lock the lock with the smaller thread
          * number first. */
-#ifdef USE_PERF_TIMERS
-        g_timer_continue(tdata->popIdleTime);
-#endif
-        if(tdata->tnumber < stolenTnumber) {
-            g_mutex_lock(&(tdata->lock));
-            g_mutex_lock(&(stolenTdata->lock));
-        } else {
-            g_mutex_lock(&(stolenTdata->lock));
-            g_mutex_lock(&(tdata->lock));
+        {
+            PERFTIMER_SCOPE(&tdata->popIdleTime);
+            if(tdata->tnumber < stolenTnumber) {
+                g_mutex_lock(&(tdata->lock));
+                g_mutex_lock(&(stolenTdata->lock));
+            } else {
+                g_mutex_lock(&(stolenTdata->lock));
+                g_mutex_lock(&(tdata->lock));
+            }
         }
-#ifdef USE_PERF_TIMERS
-        g_timer_stop(tdata->popIdleTime);
-#endif
 
         /* attempt to get event from the other thread's queue, likely moving a host from its
          * unprocessedHosts into this threads runningHost (and eventually processedHosts) */
-        nextEvent = _schedulerpolicyhoststeal_popFromThread(policy, tdata, stolenTdata->unprocessedHosts, barrier);
+        nextEvent = _schedulerpolicyhoststeal_popFromThread(policy, tdata, stolenTdata, barrier);
 
         /* must unlock in reverse order of locking */
         if(tdata->tnumber < stolenTnumber) {
@@ -484,22 +725,45 @@ static Event* _schedulerpolicyhoststeal_pop(SchedulerPolicy* policy, SimulationT
     return nextEvent;
 }
 
+static gsize _schedulerpolicyhoststeal_takeStolenHostCount(SchedulerPolicy* policy) {
+    MAGIC_ASSERT(policy);
+    HostStealPolicyData* data = policy->data;
+
+    g_rw_lock_reader_lock(&data->lock);
+    HostStealThreadData* tdata = g_hash_table_lookup(data->threadToThreadDataMap, GUINT_TO_POINTER(pthread_self()));
+    g_rw_lock_reader_unlock(&data->lock);
+
+    if (!tdata) {
+        return 0;
+    }
+
+    g_mutex_lock(&(tdata->lock));
+    gsize nStolenHosts = tdata->nStolenHosts;
+    tdata->nStolenHosts = 0;
+    g_mutex_unlock(&(tdata->lock));
+
+    return nStolenHosts;
+}
+
 static void _schedulerpolicyhoststeal_findMinTime(Host* host, HostStealSearchState* state) {
     g_rw_lock_reader_lock(&state->data->lock);
     HostStealQueueData* qdata = g_hash_table_lookup(state->data->hostToQueueDataMap, host);
     g_rw_lock_reader_unlock(&state->data->lock);
     utility_assert(qdata);
 
-    g_mutex_lock(&(qdata->lock));
-    Event* event = priorityqueue_peek(qdata->pq);
-    g_mutex_unlock(&(qdata->lock));
+    /* this host is in this thread's processedHosts, so no other thread will run it until
+     * the next round, and we don't need to lock its queue */
+    SimulationTime time = _hoststealqueuedata_getNextTime(qdata);
 
-    if(event != NULL) {
-        state->nextEventTime = MIN(state->nextEventTime, event_getTime(event));
+    if(time != SIMTIME_MAX) {
+        schedulerpolicy_addNextTime(&state->nextEventTime, &state->nextEventHost,
+                                    &state->otherNextEventTime, host, time);
     }
 }
 
-static SimulationTime _schedulerpolicyhoststeal_getNextTime(SchedulerPolicy* policy) {
+static SimulationTime
+_schedulerpolicyhoststeal_getNextHostTime(SchedulerPolicy* policy, Host** nextEventHost,
+                                          SimulationTime* otherNextEventTime) {
     MAGIC_ASSERT(policy);
     HostStealPolicyData* data = policy->data;
 
@@ -508,6 +772,7 @@ static SimulationTime _schedulerpolicyhoststeal_getNextTime(SchedulerPolicy* pol
     memset(&searchState, 0, sizeof(HostStealSearchState));
     searchState.data = data;
     searchState.nextEventTime = SIMTIME_MAX;
+    searchState.otherNextEventTime = SIMTIME_MAX;
 
     g_rw_lock_reader_lock(&data->lock);
     HostStealThreadData* tdata = g_hash_table_lookup(data->threadToThreadDataMap, GUINT_TO_POINTER(pthread_self()));
@@ -520,9 +785,17 @@ static SimulationTime _schedulerpolicyhoststeal_getNextTime(SchedulerPolicy* pol
 
     debug("next event at time %" G_GUINT64_FORMAT, searchState.nextEventTime);
 
+    *nextEventHost = searchState.nextEventHost;
+    *otherNextEventTime = searchState.otherNextEventTime;
     return searchState.nextEventTime;
 }
 
+static SimulationTime _schedulerpolicyhoststeal_getNextTime(SchedulerPolicy* policy) {
+    Host* nextEventHost = NULL;
+    SimulationTime otherNextEventTime = SIMTIME_MAX;
+    return _schedulerpolicyhoststeal_getNextHostTime(policy, &nextEventHost, &otherNextEventTime);
+}
+
 static void _schedulerpolicyhoststeal_free(SchedulerPolicy* policy) {
     MAGIC_ASSERT(policy);
     HostStealPolicyData* data = policy->data;
@@ -537,8 +810,9 @@ static void _schedulerpolicyhoststeal_free(SchedulerPolicy* policy) {
     g_free(policy);
 }
 
-SchedulerPolicy* schedulerpolicyhoststeal_new() {
+static SchedulerPolicy* _schedulerpolicyhoststeal_new(gboolean useInbox) {
     HostStealPolicyData* data = g_new0(HostStealPolicyData, 1);
+    data->useInbox = useInbox;
     data->threadList = g_array_new(FALSE, FALSE, sizeof(HostStealThreadData*));
     data->hostToQueueDataMap = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_hoststealqueuedata_free);
     data->threadToThreadDataMap = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_hoststealthreaddata_free);
@@ -552,11 +826,17 @@ SchedulerPolicy* schedulerpolicyhoststeal_new() {
     policy->push = _schedulerpolicyhoststeal_push;
     policy->pop = _schedulerpolicyhoststeal_pop;
     policy->getNextTime = _schedulerpolicyhoststeal_getNextTime;
+    policy->getNextHostTime = _schedulerpolicyhoststeal_getNextHostTime;
+    policy->takeStolenHostCount = _schedulerpolicyhoststeal_takeStolenHostCount;
     policy->free = _schedulerpolicyhoststeal_free;
 
-    policy->type = SP_PARALLEL_HOST_STEAL;
+    policy->type = useInbox ? SP_PARALLEL_HOST_STEAL_INBOX : SP_PARALLEL_HOST_STEAL;
     policy->data = data;
     policy->referenceCount = 1;
 
     return policy;
 }
+
+SchedulerPolicy* schedulerpolicyhoststeal_new() { return _schedulerpolicyhoststeal_new(FALSE); }
+
+SchedulerPolicy* schedulerpolicyhoststealinbox_new() { return _schedulerpolicyhoststeal_new(TRUE); }
@@ -11,13 +11,13 @@
 #include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/definitions.h"
 #include "main/core/work/event.h"
+#include "main/core/work/event_queue.h"
 #include "main/host/host.h"
-#include "main/utility/priority_queue.h"
 #include "main/utility/utility.h"
 
 typedef struct _ThreadPerHostQueueData ThreadPerHostQueueData;
 struct _ThreadPerHostQueueData {
-    PriorityQueue* pq;
+    EventQueue* pq;
     SimulationTime lastEventTime;
     gsize nPushed;
     gsize nPopped;
@@ -44,7 +44,7 @@ struct _ThreadPerHostPolicyData {
 static ThreadPerHostQueueData* _threadperhostqueuedata_new() {
     ThreadPerHostQueueData* qdata = g_new0(ThreadPerHostQueueData, 1);
 
-    qdata->pq = priorityqueue_new((GCompareDataFunc)event_compare, NULL, (GDestroyNotify)event_unref);
+    qdata->pq = eventqueue_new();
 
     return qdata;
 }
@@ -52,7 +52,7 @@ static ThreadPerHostQueueData* _threadperhostqueuedata_new() {
 static void _threadperhostqueuedata_free(ThreadPerHostQueueData* qdata) {
     if(qdata) {
         if(qdata->pq) {
-            priorityqueue_free(qdata->pq);
+            eventqueue_free(qdata->pq);
         }
         g_free(qdata);
     }
@@ -60,7 +60,7 @@ static void _threadperhostqueuedata_free(ThreadPerHostQueueData* qdata) {
 
 static ThreadPerHostThreadData* _threadperhostthreaddata_new() {
     ThreadPerHostThreadData* tdata = g_new0(ThreadPerHostThreadData, 1);
-    tdata->hostToPQueueMap = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)priorityqueue_free);
+    tdata->hostToPQueueMap = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)eventqueue_free);
     tdata->qdata = _threadperhostqueuedata_new();
     tdata->assignedHosts = g_queue_new();
     g_mutex_init(&(tdata->lock));
@@ -131,7 +131,7 @@ static void _schedulerpolicythreadperhost_push(SchedulerPolicy* policy, Event* e
 
     pthread_t self = pthread_self();
     if(pthread_equal(dstThread, self)) {
-        priorityqueue_push(tdata->qdata->pq, event);
+        eventqueue_push(tdata->qdata->pq, event);
         tdata->qdata->nPushed++;
     } else {
         /* we need to lock this if srcThread != pthread_self */
@@ -140,14 +140,14 @@ static void _schedulerpolicythreadperhost_push(SchedulerPolicy* policy, Event* e
         }
 
         /* now make sure we have a mailbox for the source and create one if needed */
-        PriorityQueue* futureEvents = g_hash_table_lookup(tdata->hostToPQueueMap, srcHost);
+        EventQueue* futureEvents = g_hash_table_lookup(tdata->hostToPQueueMap, srcHost);
         if(!futureEvents) {
-            futureEvents = priorityqueue_new((GCompareDataFunc)event_compare, NULL, (GDestroyNotify)event_unref);
+            futureEvents = eventqueue_new();
             g_hash_table_replace(tdata->hostToPQueueMap, srcHost, futureEvents);
         }
 
         /* 'deliver' the event there */
-        priorityqueue_push(futureEvents, event);
+        eventqueue_push(futureEvents, event);
 
         if(!pthread_equal(srcThread, self)) {
             g_mutex_unlock(&(tdata->lock));
@@ -167,13 +167,13 @@ static Event* _schedulerpolicythreadperhost_pop(SchedulerPolicy* policy, Simulat
         return NULL;
     }
 
-    Event* nextEvent = priorityqueue_peek(tdata->qdata->pq);
+    Event* nextEvent = eventqueue_peek(tdata->qdata->pq);
     SimulationTime eventTime = (nextEvent != NULL) ? event_getTime(nextEvent) : SIMTIME_INVALID;
 
     if(nextEvent && eventTime < barrier) {
         utility_assert(eventTime >= tdata->qdata->lastEventTime);
         tdata->qdata->lastEventTime = eventTime;
-        nextEvent = priorityqueue_pop(tdata->qdata->pq);
+        nextEvent = eventqueue_pop(tdata->qdata->pq);
         tdata->qdata->nPopped++;
     } else {
         /* if we make it here, all hosts for this thread have no more events before barrier */
@@ -195,11 +195,11 @@ static SimulationTime _schedulerpolicythreadperhost_getNextTime(SchedulerPolicy*
         GList* values = g_hash_table_get_values(tdata->hostToPQueueMap);
         GList* item = values;
         while(item) {
-            PriorityQueue* futureEvents = item->data;
+            EventQueue* futureEvents = item->data;
 
-            while(!priorityqueue_isEmpty(futureEvents)) {
-                Event* event = priorityqueue_pop(futureEvents);
-                priorityqueue_push(tdata->qdata->pq, event);
+            while(!eventqueue_isEmpty(futureEvents)) {
+                Event* event = eventqueue_pop(futureEvents);
+                eventqueue_push(tdata->qdata->pq, event);
                 tdata->qdata->nPushed++;
             }
 
@@ -209,7 +209,7 @@ static SimulationTime _schedulerpolicythreadperhost_getNextTime(SchedulerPolicy*
             g_list_free(values);
         }
 
-        Event* nextEvent = priorityqueue_peek(tdata->qdata->pq);
+        Event* nextEvent = eventqueue_peek(tdata->qdata->pq);
         if(nextEvent != NULL) {
             nextTime = MIN(nextTime, event_getTime(nextEvent));
         }
@@ -11,15 +11,18 @@
 #include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/definitions.h"
 #include "main/core/work/event.h"
+#include "main/core/work/event_queue.h"
 #include "main/host/host.h"
-#include "main/utility/priority_queue.h"
+#include "main/utility/mpsc_queue.h"
 #include "main/utility/utility.h"
 
 typedef struct _ThreadSingleThreadData ThreadSingleThreadData;
 struct _ThreadSingleThreadData {
     GQueue* assignedHosts2;
-    GMutex lock;
-    PriorityQueue* pq;
+    /* only accessed by the thread that owns this data */
+    EventQueue* pq;
+    /* events pushed by other threads, which the owner moves into pq before reading it */
+    MPSCQueue* inbox;
     SimulationTime lastEventTime;
     gsize nPushed;
     gsize nPopped;
@@ -34,8 +37,8 @@ struct _ThreadSinglePolicyData {
 
 static ThreadSingleThreadData* _threadsinglethreaddata_new() {
     ThreadSingleThreadData* tdata = g_new0(ThreadSingleThreadData, 1);
-    g_mutex_init(&(tdata->lock));
-    tdata->pq = priorityqueue_new((GCompareDataFunc)event_compare, NULL, (GDestroyNotify)event_unref);
+    tdata->pq = eventqueue_new();
+    tdata->inbox = mpscqueue_new((GDestroyNotify)event_unref);
     tdata->assignedHosts2 = g_queue_new();
     return tdata;
 }
@@ -46,13 +49,25 @@ static void _threadsinglethreaddata_free(ThreadSingleThreadData* tdata) {
             g_queue_free(tdata->assignedHosts2);
         }
         if(tdata->pq) {
-            priorityqueue_free(tdata->pq);
+            eventqueue_free(tdata->pq);
+        }
+        if(tdata->inbox) {
+            mpscqueue_free(tdata->inbox);
         }
-        g_mutex_clear(&(tdata->lock));
         g_free(tdata);
     }
 }
 
+static void _threadsinglethreaddata_pushFromInbox(Event* event, ThreadSingleThreadData* tdata) {
+    eventqueue_push(tdata->pq, event);
+    tdata->nPushed++;
+}
+
+/* must only be called by the thread that owns tdata */
+static void _threadsinglethreaddata_drainInbox(ThreadSingleThreadData* tdata) {
+    mpscqueue_drain(tdata->inbox, (GFunc)_threadsinglethreaddata_pushFromInbox, tdata);
+}
+
 /* this must be run synchronously, or the call must be protected by locks */
 static void _schedulerpolicythreadsingle_addHost(SchedulerPolicy* policy, Host* host, pthread_t randomThread) {
     MAGIC_ASSERT(policy);
@@ -101,11 +116,14 @@ static void _schedulerpolicythreadsingle_push(SchedulerPolicy* policy, Event* ev
     ThreadSingleThreadData* tdata = g_hash_table_lookup(data->threadToThreadDataMap, GUINT_TO_POINTER(dstThread));
     utility_assert(tdata);
 
-    /* 'deliver' the event there */
-    g_mutex_lock(&(tdata->lock));
-    priorityqueue_push(tdata->pq, event);
-    tdata->nPushed++;
-    g_mutex_unlock(&(tdata->lock));
+    /* 'deliver' the event there. other threads' events are delayed to at least the barrier,
+     * so the owner doesn't need them until it drains its inbox when it next reads its queue. */
+    if(pthread_equal(dstThread, pthread_self())) {
+        eventqueue_push(tdata->pq, event);
+        tdata->nPushed++;
+    } else {
+        mpscqueue_push(tdata->inbox, event);
+    }
 }
 
 static Event* _schedulerpolicythreadsingle_pop(SchedulerPolicy* policy, SimulationTime barrier) {
@@ -120,23 +138,21 @@ static Event* _schedulerpolicythreadsingle_pop(SchedulerPolicy* policy, Simulati
         return NULL;
     }
 
-    g_mutex_lock(&(tdata->lock));
+    _threadsinglethreaddata_drainInbox(tdata);
 
-    Event* nextEvent = priorityqueue_peek(tdata->pq);
+    Event* nextEvent = eventqueue_peek(tdata->pq);
     SimulationTime eventTime = (nextEvent != NULL) ? event_getTime(nextEvent) : SIMTIME_INVALID;
 
     if(nextEvent && eventTime < barrier) {
         utility_assert(eventTime >= tdata->lastEventTime);
         tdata->lastEventTime = eventTime;
-        nextEvent = priorityqueue_pop(tdata->pq);
+        nextEvent = eventqueue_pop(tdata->pq);
         tdata->nPopped++;
     } else {
         /* if we make it here, all hosts for this thread have no more events before barrier */
         nextEvent = NULL;
     }
 
-    g_mutex_unlock(&(tdata->lock));
-
     return nextEvent;
 }
 
@@ -148,9 +164,8 @@ static SimulationTime _schedulerpolicythreadsingle_getNextTime(SchedulerPolicy*
 
     ThreadSingleThreadData* tdata = g_hash_table_lookup(data->threadToThreadDataMap, GUINT_TO_POINTER(pthread_self()));
     if(tdata) {
-        g_mutex_lock(&(tdata->lock));
-        Event* event = priorityqueue_peek(tdata->pq);
-        g_mutex_unlock(&(tdata->lock));
+        _threadsinglethreaddata_drainInbox(tdata);
+        Event* event = eventqueue_peek(tdata->pq);
         if(event != NULL) {
             nextTime = MIN(nextTime, event_getTime(event));
         }
@@ -21,6 +21,10 @@ typedef enum {
     /* every thread has a locked pqueue for every host, each thread inserts into its one
      * assigned host queue and max queue contention is 2 threads at any time */
     SP_PARALLEL_THREAD_PERHOST,
+    /* SP_PARALLEL_HOST_STEAL, but events sent between hosts are pushed into a lock-free
+     * per-host inbox that is drained by the thread running the host, so a push never
+     * contends on the destination host's lock */
+    SP_PARALLEL_HOST_STEAL_INBOX,
 } SchedulerPolicyType;
 
 #endif /* SHD_SCHEDULER_POLICY_TYPE_H_ */
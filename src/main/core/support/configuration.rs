@@ -1,5 +1,6 @@
-use std::collections::BTreeMap;
+use std::collections::{BTreeMap, HashSet};
 use std::ffi::{CStr, CString, OsStr, OsString};
+use std::io::{BufRead, BufReader};
 use std::os::unix::ffi::OsStrExt;
 
 use clap::ArgEnum;
@@ -33,7 +34,7 @@ pub struct CliOptions {
     #[clap(long, short = 'g')]
     gdb: bool,
 
-    /// Exit after running shared memory cleanup routine
+    /// Exit after removing the shared memory files that older versions of Shadow left behind
     #[clap(long, exclusive(true))]
     shm_cleanup: bool,
 
@@ -73,7 +74,14 @@ pub struct ConfigFileOptions {
     experimental: ExperimentalOptions,
 
     // we use a BTreeMap so that the hosts are sorted by their hostname (useful for determinism)
+    #[serde(default)]
     hosts: BTreeMap<String, HostOptions>,
+
+    /// Path to a file of additional hosts, with one or more hosts on each line in the same
+    /// format as the `hosts` section (for example JSON objects). The file is read one line at
+    /// a time while the hosts are created, so it's never loaded into memory as a whole
+    #[serde(default)]
+    hosts_file: Option<String>,
 }
 
 /// Shadow configuration options after processing command-line and configuration file options.
@@ -85,8 +93,13 @@ pub struct ConfigOptions {
 
     experimental: ExperimentalOptions,
 
+    // needed for the hosts in the hosts file, which are not read until the hosts are created
+    host_defaults: HostDefaultOptions,
+
     // we use a BTreeMap so that the hosts are sorted by their hostname (useful for determinism)
     hosts: BTreeMap<String, HostOptions>,
+
+    hosts_file: Option<String>,
 }
 
 impl ConfigOptions {
@@ -111,8 +124,68 @@ impl ConfigOptions {
             general: config_file.general,
             network: config_file.network,
             experimental: config_file.experimental,
+            host_defaults: config_file.host_defaults,
             hosts: config_file.hosts,
+            hosts_file: config_file.hosts_file,
+        }
+    }
+
+    /// Calls `f` for each host in the `hosts` section, sorted by name, and then for each host
+    /// in the hosts file in the order they appear. The hosts file is parsed one line at a time.
+    fn for_each_host(&self, mut f: impl FnMut(&str, &HostOptions)) -> Result<(), String> {
+        for (name, host) in &self.hosts {
+            host.check()
+                .map_err(|e| format!("Invalid host {:?}: {}", name, e))?;
+            f(name, host);
+        }
+
+        let path = match &self.hosts_file {
+            Some(x) => x,
+            None => return Ok(()),
+        };
+
+        let file = std::fs::File::open(path)
+            .map_err(|e| format!("Could not open hosts file {:?}: {}", path, e))?;
+
+        // only the names are kept, to check that each host is defined once
+        let mut names: HashSet<String> = self.hosts.keys().cloned().collect();
+
+        for (i, line) in BufReader::new(file).lines().enumerate() {
+            let line =
+                line.map_err(|e| format!("Could not read hosts file {:?}: {}", path, e))?;
+            let line = line.trim();
+            if line.is_empty() || line.starts_with('#') {
+                continue;
+            }
+
+            let hosts: BTreeMap<String, HostOptions> = serde_yaml::from_str(line).map_err(|e| {
+                format!("Could not parse line {} of hosts file {:?}: {}", i + 1, path, e)
+            })?;
+
+            for (name, mut host) in hosts {
+                if !names.insert(name.clone()) {
+                    return Err(format!(
+                        "Host {:?} on line {} of hosts file {:?} is defined more than once",
+                        name,
+                        i + 1,
+                        path
+                    ));
+                }
+                host.check().map_err(|e| {
+                    format!(
+                        "Invalid host {:?} on line {} of hosts file {:?}: {}",
+                        name,
+                        i + 1,
+                        path,
+                        e
+                    )
+                })?;
+                host.options = host.options.with_defaults(self.host_defaults.clone());
+                f(&name, &host);
+            }
         }
+
+        Ok(())
     }
 }
 
@@ -206,6 +279,17 @@ struct NetworkOptions {
     #[clap(long, value_name = "bool")]
     #[clap(about = NETWORK_HELP.get("use_shortest_path").unwrap())]
     use_shortest_path: Option<bool>,
+
+    /// Changes to the latency and packet loss of the network graph edges at given simulated times
+    #[clap(skip)]
+    #[serde(default)]
+    changes: Option<Vec<NetworkChangeOptions>>,
+
+    /// Aggregate background traffic between hosts that takes a share of their bandwidth
+    /// without sending any packets
+    #[clap(skip)]
+    #[serde(default)]
+    background_flows: Option<Vec<BackgroundFlowOptions>>,
 }
 
 impl NetworkOptions {
@@ -239,7 +323,7 @@ pub struct ExperimentalOptions {
     #[clap(about = EXP_HELP.get("use_o_n_waitpid_workarounds").unwrap())]
     use_o_n_waitpid_workarounds: Option<bool>,
 
-    /// Send message to plugin telling it to stop spinning when a syscall blocks
+    /// Tell the plugin to stop spinning and sleep when a syscall blocks
     #[clap(long, value_name = "bool")]
     #[clap(about = EXP_HELP.get("use_explicit_block_message").unwrap())]
     use_explicit_block_message: Option<bool>,
@@ -249,6 +333,12 @@ pub struct ExperimentalOptions {
     #[clap(about = EXP_HELP.get("use_seccomp").unwrap())]
     use_seccomp: Option<bool>,
 
+    /// Comma-separated names of syscalls that preload-mode plugins make directly in the kernel,
+    /// without asking Shadow. Only syscalls that Shadow would execute natively anyway are allowed
+    #[clap(long, value_name = "syscalls")]
+    #[clap(about = EXP_HELP.get("native_syscalls").unwrap())]
+    native_syscalls: Option<String>,
+
     /// Count the number of occurrences for individual syscalls
     #[clap(long, value_name = "bool")]
     #[clap(about = EXP_HELP.get("use_syscall_counters").unwrap())]
@@ -259,6 +349,89 @@ pub struct ExperimentalOptions {
     #[clap(about = EXP_HELP.get("use_object_counters").unwrap())]
     use_object_counters: Option<bool>,
 
+    /// Don't free the hosts at the end of the simulation, and let the exit release their
+    /// memory instead. Has no effect when use_object_counters is enabled
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_fast_exit").unwrap())]
+    use_fast_exit: Option<bool>,
+
+    /// Measure the time spent handling each syscall and waiting for plugins, and write it to
+    /// 'profile.folded' in the data directory
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_profiler").unwrap())]
+    use_profiler: Option<bool>,
+
+    /// Start one native process per distinct plugin and fork new processes from it, rather
+    /// than exec'ing each process from scratch (preload interposition only)
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_preload_zygote").unwrap())]
+    use_preload_zygote: Option<bool>,
+
+    /// Let the other threads of a multi-threaded process run while Shadow handles one
+    /// thread's syscall, collecting each thread's next syscall after the host's other events
+    /// at that time
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_thread_overlap").unwrap())]
+    use_thread_overlap: Option<bool>,
+
+    /// While a host's plugin runs between syscalls, run the events of the worker's other
+    /// hosts instead of waiting for it
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_pipelined_workers").unwrap())]
+    use_pipelined_workers: Option<bool>,
+
+    /// Fork and exec each host's processes when the host boots, in parallel on the worker
+    /// threads, rather than one at a time when each process starts
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_process_prelaunch").unwrap())]
+    use_process_prelaunch: Option<bool>,
+
+    /// Remember the paths that each process failed to find, and fail lookups of them again
+    /// without asking the OS until the process may have created a file
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_missing_path_cache").unwrap())]
+    use_missing_path_cache: Option<bool>,
+
+    /// Write statistics about each scheduling round to 'round-stats.csv' in the data directory
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_round_stats").unwrap())]
+    use_round_stats: Option<bool>,
+
+    /// Write a digest of the events that run in each scheduling round, and of the events of
+    /// each host, to compare the determinism of two runs without comparing their logs
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_determinism_digest").unwrap())]
+    use_determinism_digest: Option<bool>,
+
+    /// Write the log messages of each host to a file in the host's data directory instead of
+    /// stdout, from the worker thread that logs them
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_per_host_log_files").unwrap())]
+    use_per_host_log_files: Option<bool>,
+
+    /// Path of a Unix socket on which to serve metrics in the Prometheus format and accept
+    /// log level changes while the simulation runs
+    #[clap(long, value_name = "path")]
+    #[clap(about = EXP_HELP.get("control_socket").unwrap())]
+    control_socket: Option<String>,
+
+    /// Stop the Shadow process with SIGSTOP once the simulation reaches this time, so that
+    /// an external tool such as CRIU can checkpoint it. Shadow continues on SIGCONT
+    #[clap(long, value_name = "seconds")]
+    #[clap(about = EXP_HELP.get("pause_at").unwrap())]
+    pause_at: Option<units::Time<units::TimePrefix>>,
+
+    /// Compress the pcap files with zstd at this level, from 1 to 19, or don't compress them
+    /// if 0. Needs Shadow built with zstd support
+    #[clap(long, value_name = "level")]
+    #[clap(about = EXP_HELP.get("pcap_compression_level").unwrap())]
+    pcap_compression_level: Option<i32>,
+
+    /// The number of threads that compress the pcap files of all hosts
+    #[clap(long, value_name = "threads")]
+    #[clap(about = EXP_HELP.get("pcap_compression_threads").unwrap())]
+    pcap_compression_threads: Option<u32>,
+
     /// Max number of iterations to busy-wait on IPC semaphore before blocking
     #[clap(long, value_name = "iterations")]
     #[clap(about = EXP_HELP.get("preload_spin_max").unwrap())]
@@ -270,16 +443,97 @@ pub struct ExperimentalOptions {
     #[clap(about = EXP_HELP.get("use_memory_manager").unwrap())]
     use_memory_manager: Option<bool>,
 
+    /// Serve reads of files in the data directory that are opened read-only from a single
+    /// in-memory copy shared by all hosts, instead of reading them from the OS each time
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_shared_file_cache").unwrap())]
+    use_shared_file_cache: Option<bool>,
+
+    /// Buffer the writes to regular files that plugins open for writing, and write them in large
+    /// chunks on a background thread instead of blocking a worker thread on each write
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_file_write_behind").unwrap())]
+    use_file_write_behind: Option<bool>,
+
+    /// Map shared memory so that it can be backed by transparent huge pages, reducing TLB misses
+    /// when Shadow accesses the memory of many plugin processes
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_shmem_hugepages").unwrap())]
+    use_shmem_hugepages: Option<bool>,
+
+    /// Let the kernel merge identical pages of plugin memory across processes (KSM), trading
+    /// slower access to large anonymous mappings for a smaller memory footprint
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_ksm").unwrap())]
+    use_ksm: Option<bool>,
+
+    /// Page out the memory of processes whose threads are all blocked for at least this long, and
+    /// read it back in when they next run. Unset to never page out processes
+    #[clap(long, value_name = "seconds")]
+    #[clap(about = EXP_HELP.get("idle_pageout_threshold").unwrap())]
+    idle_pageout_threshold: Option<units::Time<units::TimePrefix>>,
+
+    /// Block a thread for this long when it makes `spin_syscall_limit` syscalls in a row at the
+    /// same simulated time that found nothing to do, such as polls that returned no events.
+    /// Unset to never delay spinning threads
+    #[clap(long, value_name = "seconds")]
+    #[clap(about = EXP_HELP.get("spin_syscall_delay").unwrap())]
+    spin_syscall_delay: Option<units::Time<units::TimePrefix>>,
+
+    /// The number of syscalls in a row that find nothing to do at the same simulated time after
+    /// which a thread is considered to be spinning
+    #[clap(long, value_name = "N")]
+    #[clap(about = EXP_HELP.get("spin_syscall_limit").unwrap())]
+    spin_syscall_limit: Option<u32>,
+
     /// Use shim-side syscall handler to force hot-path syscalls to be handled via an inter-process syscall with Shadow
     #[clap(long, value_name = "bool")]
     #[clap(about = EXP_HELP.get("use_shim_syscall_handler").unwrap())]
     use_shim_syscall_handler: Option<bool>,
 
+    /// Emulate the rdtsc and rdtscp instructions in the shim when using the preload interpose
+    /// method, instead of letting plugins read the real timestamp counter
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_shim_rdtsc").unwrap())]
+    use_shim_rdtsc: Option<bool>,
+
+    /// Overwrite the vDSO's time functions in preload-mode plugins with jumps to the shim, so
+    /// that programs that call the vDSO directly rather than through libc get simulated time
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_vdso_patching").unwrap())]
+    use_vdso_patching: Option<bool>,
+
     /// Pin each thread and any processes it executes to the same logical CPU Core to improve cache affinity
     #[clap(long, value_name = "bool")]
     #[clap(about = EXP_HELP.get("use_cpu_pinning").unwrap())]
     use_cpu_pinning: Option<bool>,
 
+    /// When using CPU pinning on a machine with several NUMA nodes, split the hosts among the
+    /// nodes by their network locality, and keep each host's worker threads and processes on its node
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_numa_placement").unwrap())]
+    use_numa_placement: Option<bool>,
+
+    /// When using CPU pinning, pin managed processes to all of the CPUs in their worker's NUMA
+    /// node rather than to the worker's CPU, so that they're only re-pinned when their host moves
+    /// to a worker on another node
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_node_cpu_pinning").unwrap())]
+    use_node_cpu_pinning: Option<bool>,
+
+    /// Assign hosts to worker threads by partitioning the network graph, so that hosts on
+    /// vertices that exchange many packets share a worker, and write the packet counts of the
+    /// paths to 'path-packet-counts.txt' in the data directory
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_host_partitioning").unwrap())]
+    use_host_partitioning: Option<bool>,
+
+    /// Path of a 'path-packet-counts.txt' file from an earlier run, to weight the partitioning
+    /// of `use_host_partitioning`
+    #[clap(long, value_name = "path")]
+    #[clap(about = EXP_HELP.get("host_partitioning_counts").unwrap())]
+    host_partitioning_counts: Option<String>,
+
     /// Which interposition method to use
     #[clap(long, value_name = "method")]
     #[clap(about = EXP_HELP.get("interpose_method").unwrap())]
@@ -290,6 +544,72 @@ pub struct ExperimentalOptions {
     #[clap(about = EXP_HELP.get("runahead").unwrap())]
     runahead: Option<units::Time<units::TimePrefix>>,
 
+    /// Let each host run ahead by the minimum latency of its own incoming network paths instead of
+    /// by the global minimum path latency. Only supported by the "host" and "steal" scheduler policies
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_per_host_lookahead").unwrap())]
+    use_per_host_lookahead: Option<bool>,
+
+    /// Let each host run past the end of the round, until the earliest time that another host
+    /// could still send it an event. Only supported by the "host" and "steal" scheduler policies
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_decoupled_rounds").unwrap())]
+    use_decoupled_rounds: Option<bool>,
+
+    /// Every this many scheduling rounds, move hosts from the worker threads that spent the most
+    /// time running events since the last rebalancing to the ones that spent the least. 0 never
+    /// moves hosts. Only supported by the "host" scheduler policy
+    #[clap(long, value_name = "N")]
+    #[clap(about = EXP_HELP.get("host_rebalance_interval").unwrap())]
+    host_rebalance_interval: Option<u32>,
+
+    /// Extend each round until the earliest time that a packet could reach another host, from
+    /// each host's next event time and the latency of its fastest outgoing edge, when that is
+    /// later than the end from the minimum path latency. Only supported by the "host" scheduler
+    /// policy
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_adaptive_runahead").unwrap())]
+    use_adaptive_runahead: Option<bool>,
+
+    /// Keep each host's events in a calendar queue, whose buckets are sized from the gaps
+    /// between the events that it runs, instead of in a binary heap
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_calendar_event_queues").unwrap())]
+    use_calendar_event_queues: Option<bool>,
+
+    /// Have the worker threads wait for each other at the end of each round, and let the last
+    /// one to finish start the next round, instead of waking the main thread to do it. Needs a
+    /// logical processor for each worker thread
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_worker_barrier").unwrap())]
+    use_worker_barrier: Option<bool>,
+
+    /// Compute the paths between all hosts' network graph nodes in parallel before the simulation
+    /// starts, and store them in a dense matrix that can be read without locking
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_path_matrix").unwrap())]
+    use_path_matrix: Option<bool>,
+
+    /// Save the path matrix to a file beside the data directory, keyed by a checksum of the
+    /// network graph and the routing options, and load it instead of recomputing it in later
+    /// simulations
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_path_matrix_cache").unwrap())]
+    use_path_matrix_cache: Option<bool>,
+
+    /// The directory that `use_path_matrix_cache` saves the path matrix to and loads it from,
+    /// instead of the directory that contains the data directory. Simulations of the same graph
+    /// that share the directory share one copy of the matrix in memory
+    #[clap(long, value_name = "path")]
+    #[clap(about = EXP_HELP.get("path_matrix_cache_directory").unwrap())]
+    path_matrix_cache_directory: Option<String>,
+
+    /// Compute the paths between all hosts' network graph nodes on the worker threads before
+    /// the simulation starts, instead of computing them lazily when they are first needed
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("precompute_paths").unwrap())]
+    precompute_paths: Option<bool>,
+
     /// The event scheduler's policy for thread synchronization
     #[clap(long, value_name = "policy")]
     #[clap(about = EXP_HELP.get("scheduler_policy").unwrap())]
@@ -315,6 +635,11 @@ pub struct ExperimentalOptions {
     #[clap(about = EXP_HELP.get("socket_recv_autotune").unwrap())]
     socket_recv_autotune: Option<bool>,
 
+    /// Delay TCP ACKs like Linux does, acknowledging every second segment or after 40 ms
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("socket_linux_delayed_ack").unwrap())]
+    socket_linux_delayed_ack: Option<bool>,
+
     /// Size of the interface receive buffer that accepts incoming packets
     #[clap(long, value_name = "bytes")]
     #[clap(about = EXP_HELP.get("interface_buffer").unwrap())]
@@ -325,6 +650,23 @@ pub struct ExperimentalOptions {
     #[clap(about = EXP_HELP.get("interface_qdisc").unwrap())]
     interface_qdisc: Option<QDiscMode>,
 
+    /// Send consecutive TCP segments through the network interfaces and routers as a single packet
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("interface_segmentation_offload").unwrap())]
+    interface_segmentation_offload: Option<bool>,
+
+    /// Process the packets that arrive at a network interface together, and notify each socket
+    /// once about its combined status changes
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("interface_receive_batching").unwrap())]
+    interface_receive_batching: Option<bool>,
+
+    /// Continue the threads that an event wakes once the event is done, instead of in events of
+    /// their own
+    #[clap(long, value_name = "bool")]
+    #[clap(about = EXP_HELP.get("use_deferred_wakeups").unwrap())]
+    use_deferred_wakeups: Option<bool>,
+
     /// Create N worker threads. Note though, that `--parallelism` of them will
     /// be allowed to run simultaneously. If unset, will create a thread for
     /// each simulated Host. This is to work around limitations in ptrace, and
@@ -337,6 +679,11 @@ pub struct ExperimentalOptions {
     #[clap(long, value_name = "bool")]
     #[clap(about = EXP_HELP.get("use_legacy_working_dir").unwrap())]
     use_legacy_working_dir: Option<bool>,
+
+    /// Format of the log messages written on stdout
+    #[clap(long, value_name = "format")]
+    #[clap(about = EXP_HELP.get("log_format").unwrap())]
+    log_format: Option<LogFormat>,
 }
 
 impl ExperimentalOptions {
@@ -354,23 +701,66 @@ impl Default for ExperimentalOptions {
             use_o_n_waitpid_workarounds: Some(false),
             use_explicit_block_message: Some(false),
             use_seccomp: None,
+            native_syscalls: None,
             use_syscall_counters: Some(false),
             use_object_counters: Some(true),
+            use_fast_exit: Some(false),
+            use_profiler: Some(false),
+            use_preload_zygote: Some(false),
+            use_thread_overlap: Some(false),
+            use_pipelined_workers: Some(false),
+            use_process_prelaunch: Some(false),
+            use_missing_path_cache: Some(false),
+            use_round_stats: Some(false),
+            use_determinism_digest: Some(false),
+            use_per_host_log_files: Some(false),
+            control_socket: None,
+            pause_at: None,
+            pcap_compression_level: Some(0),
+            pcap_compression_threads: Some(2),
             preload_spin_max: Some(0),
             use_memory_manager: Some(true),
+            use_shared_file_cache: Some(false),
+            use_file_write_behind: Some(false),
+            use_shmem_hugepages: Some(false),
+            use_ksm: Some(false),
+            idle_pageout_threshold: None,
+            spin_syscall_delay: None,
+            spin_syscall_limit: Some(1000),
             use_shim_syscall_handler: Some(true),
+            use_shim_rdtsc: Some(false),
+            use_vdso_patching: Some(false),
             use_cpu_pinning: Some(true),
+            use_numa_placement: Some(false),
+            use_node_cpu_pinning: Some(false),
+            use_host_partitioning: Some(false),
+            host_partitioning_counts: None,
             interpose_method: Some(InterposeMethod::Ptrace),
             runahead: None,
+            use_per_host_lookahead: Some(false),
+            use_decoupled_rounds: Some(false),
+            host_rebalance_interval: Some(0),
+            use_adaptive_runahead: Some(false),
+            use_calendar_event_queues: Some(false),
+            use_worker_barrier: Some(false),
+            use_path_matrix: Some(false),
+            use_path_matrix_cache: Some(false),
+            path_matrix_cache_directory: None,
+            precompute_paths: Some(false),
             scheduler_policy: Some(SchedulerPolicy::Host),
             socket_send_buffer: Some(units::Bytes::new(131_072, units::SiPrefixUpper::Base)),
             socket_send_autotune: Some(true),
             socket_recv_buffer: Some(units::Bytes::new(174_760, units::SiPrefixUpper::Base)),
             socket_recv_autotune: Some(true),
+            socket_linux_delayed_ack: Some(false),
             interface_buffer: Some(units::Bytes::new(1_024_000, units::SiPrefixUpper::Base)),
             interface_qdisc: Some(QDiscMode::Fifo),
+            interface_segmentation_offload: Some(false),
+            interface_receive_batching: Some(false),
+            use_deferred_wakeups: Some(false),
             worker_threads: None,
             use_legacy_working_dir: Some(false),
+            log_format: Some(LogFormat::Text),
         }
     }
 }
@@ -409,11 +799,23 @@ pub struct HostDefaultOptions {
     #[clap(about = HOST_HELP.get("heartbeat_interval").unwrap())]
     heartbeat_interval: Option<units::Time<units::TimePrefixUpper>>,
 
+    /// Format of the host's heartbeat statistics: "text" logs them as heartbeat messages, and
+    /// "binary" writes them to a 'heartbeat.bin' file in the host directory
+    #[clap(long = "host-heartbeat-log-format", name = "host-heartbeat-log-format")]
+    #[clap(value_name = "format")]
+    #[clap(about = HOST_HELP.get("heartbeat_log_format").unwrap())]
+    heartbeat_log_format: Option<LogFormat>,
+
     /// Where to save the pcap files (relative to the host directory)
     #[clap(long, value_name = "path")]
     #[clap(about = HOST_HELP.get("pcap_directory").unwrap())]
     pcap_directory: Option<String>,
 
+    /// How much data to capture per packet (header and payload) if pcap logging is enabled
+    #[clap(long, value_name = "bytes")]
+    #[clap(about = HOST_HELP.get("pcap_capture_size").unwrap())]
+    pcap_capture_size: Option<units::Bytes<units::SiPrefixUpper>>,
+
     /// IPv4 address hint for Shadow's name and routing system (ex: "100.0.0.1")
     #[clap(long, value_name = "ip")]
     #[clap(about = HOST_HELP.get("ip_address_hint").unwrap())]
@@ -428,6 +830,17 @@ pub struct HostDefaultOptions {
     #[clap(long, value_name = "city")]
     #[clap(about = HOST_HELP.get("city_code_hint").unwrap())]
     city_code_hint: Option<String>,
+
+    /// TCP congestion control algorithm used by the host's sockets
+    #[clap(long, value_name = "algorithm")]
+    #[clap(about = HOST_HELP.get("tcp_congestion_control").unwrap())]
+    tcp_congestion_control: Option<TcpCongestionControl>,
+
+    /// Number of CPU cores to model for the host, whose processes are delayed while all of them
+    /// are busy. The host's CPU isn't modeled if unset.
+    #[clap(long, value_name = "cores")]
+    #[clap(about = HOST_HELP.get("cpu_cores").unwrap())]
+    cpu_cores: Option<u32>,
 }
 
 impl HostDefaultOptions {
@@ -437,10 +850,14 @@ impl HostDefaultOptions {
             heartbeat_log_level: None,
             heartbeat_log_info: None,
             heartbeat_interval: None,
+            heartbeat_log_format: None,
             pcap_directory: None,
+            pcap_capture_size: None,
             ip_address_hint: None,
             country_code_hint: None,
             city_code_hint: None,
+            tcp_congestion_control: None,
+            cpu_cores: None,
         }
     }
 
@@ -458,10 +875,14 @@ impl Default for HostDefaultOptions {
             heartbeat_log_level: Some(LogLevel::Info),
             heartbeat_log_info: Some(std::array::IntoIter::new([LogInfoFlag::Node]).collect()),
             heartbeat_interval: Some(units::Time::new(1, units::TimePrefixUpper::Sec)),
+            heartbeat_log_format: Some(LogFormat::Text),
             pcap_directory: None,
+            pcap_capture_size: Some(units::Bytes::new(65535, units::SiPrefixUpper::Base)),
             ip_address_hint: None,
             country_code_hint: None,
             city_code_hint: None,
+            tcp_congestion_control: Some(TcpCongestionControl::Reno),
+            cpu_cores: None,
         }
     }
 }
@@ -475,6 +896,11 @@ pub struct ProcessOptions {
     #[serde(default = "default_args_empty")]
     args: ProcessArgs,
 
+    /// Don't store the payloads of the packets that the process sends, only their lengths.
+    /// Receivers read zeros in place of the bytes that were sent
+    #[serde(default)]
+    elide_payloads: bool,
+
     /// Environment variables passed when executing this process. Multiple variables can be
     /// specified by using a semicolon separator (ex: `ENV_A=1;ENV_B=2`)
     #[serde(default)]
@@ -491,13 +917,102 @@ pub struct ProcessOptions {
     /// The simulated time at which to send a SIGKILL signal to the process
     #[serde(default)]
     stop_time: Option<units::Time<units::TimePrefixUpper>>,
+
+    /// Record each syscall that the process makes in a binary file in the host's data directory
+    #[serde(default)]
+    trace_syscalls: bool,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
+#[serde(deny_unknown_fields)]
+pub struct TrafficModelOptions {
+    /// Port that the streams connect to on the peer, or that the host listens on if it has no
+    /// peer
+    port: u16,
+
+    /// Host that the streams are opened to. Without a peer, the host serves the streams that
+    /// other hosts' traffic models open to its port
+    #[serde(default)]
+    peer: Option<String>,
+
+    /// The simulated time at which the host opens its first stream or starts listening
+    #[serde(default)]
+    start_time: units::Time<units::TimePrefixUpper>,
+
+    /// States of the Markov chain that chooses the streams, starting in the first
+    #[serde(default)]
+    states: Vec<TrafficModelStateOptions>,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
+#[serde(deny_unknown_fields)]
+pub struct TrafficModelStateOptions {
+    /// Name that the transitions of the states refer to
+    name: String,
+
+    /// Bytes that each stream sends to the peer
+    #[serde(default)]
+    send: units::Bytes<units::SiPrefixUpper>,
+
+    /// Bytes that the peer sends back on each stream
+    #[serde(default)]
+    receive: units::Bytes<units::SiPrefixUpper>,
+
+    /// Time to wait after each stream before moving to the next state
+    #[serde(default)]
+    pause: units::Time<units::TimePrefix>,
+
+    /// Relative weights of the states to move to after the pause. With no weights, the model
+    /// stays in this state
+    #[serde(default)]
+    next: BTreeMap<String, f64>,
+}
+
+impl TrafficModelOptions {
+    fn state_index(&self, name: &str) -> Option<usize> {
+        self.states.iter().position(|x| x.name == name)
+    }
+
+    fn check(&self) -> Result<(), String> {
+        if self.peer.is_some() && self.states.is_empty() {
+            return Err("a traffic model with a peer needs at least one state".to_string());
+        }
+        for state in &self.states {
+            if self.states.iter().filter(|x| x.name == state.name).count() > 1 {
+                return Err(format!(
+                    "traffic model state {:?} is defined more than once",
+                    state.name
+                ));
+            }
+            for (name, weight) in &state.next {
+                if self.state_index(name).is_none() {
+                    return Err(format!(
+                        "traffic model state {:?} moves to unknown state {:?}",
+                        state.name, name
+                    ));
+                }
+                if !(*weight >= 0.0 && weight.is_finite()) {
+                    return Err(format!(
+                        "traffic model state {:?} has invalid weight {} for state {:?}",
+                        state.name, weight, name
+                    ));
+                }
+            }
+        }
+        Ok(())
+    }
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
 #[serde(deny_unknown_fields)]
 pub struct HostOptions {
+    #[serde(default)]
     processes: Vec<ProcessOptions>,
 
+    /// Traffic that Shadow generates on the host itself, without running a process
+    #[serde(default)]
+    traffic_model: Option<TrafficModelOptions>,
+
     /// Number of hosts to start
     #[serde(default)]
     quantity: Quantity,
@@ -514,6 +1029,15 @@ pub struct HostOptions {
     options: HostDefaultOptions,
 }
 
+impl HostOptions {
+    fn check(&self) -> Result<(), String> {
+        match &self.traffic_model {
+            Some(x) => x.check(),
+            None => Ok(()),
+        }
+    }
+}
+
 #[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
 #[serde(rename_all = "lowercase")]
 pub enum LogLevel {
@@ -544,6 +1068,24 @@ impl LogLevel {
     }
 }
 
+#[derive(Debug, Clone, Copy, Hash, PartialEq, Eq, ArgEnum, Serialize, Deserialize, JsonSchema)]
+#[serde(rename_all = "lowercase")]
+#[repr(C)]
+pub enum LogFormat {
+    /// One line of text per message.
+    Text,
+    /// Compact binary records, which the tools in `src/tools` can decode.
+    Binary,
+}
+
+impl std::str::FromStr for LogFormat {
+    type Err = serde_yaml::Error;
+
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        serde_yaml::from_str(s)
+    }
+}
+
 #[derive(Debug, Clone, Copy, Hash, PartialEq, Eq, Serialize, Deserialize, JsonSchema)]
 #[serde(rename_all = "lowercase")]
 #[repr(C)]
@@ -573,6 +1115,7 @@ pub enum SchedulerPolicy {
     Thread,
     ThreadXThread,
     ThreadXHost,
+    StealInbox,
 }
 
 impl std::str::FromStr for SchedulerPolicy {
@@ -591,6 +1134,7 @@ impl SchedulerPolicy {
             Self::Thread => c::SchedulerPolicyType_SP_PARALLEL_THREAD_SINGLE,
             Self::ThreadXThread => c::SchedulerPolicyType_SP_PARALLEL_THREAD_PERTHREAD,
             Self::ThreadXHost => c::SchedulerPolicyType_SP_PARALLEL_THREAD_PERHOST,
+            Self::StealInbox => c::SchedulerPolicyType_SP_PARALLEL_HOST_STEAL_INBOX,
         }
     }
 }
@@ -650,6 +1194,23 @@ impl std::str::FromStr for QDiscMode {
     }
 }
 
+#[derive(Debug, Clone, Copy, Hash, PartialEq, Eq, ArgEnum, Serialize, Deserialize, JsonSchema)]
+#[serde(rename_all = "lowercase")]
+#[repr(C)]
+pub enum TcpCongestionControl {
+    Reno,
+    Cubic,
+    Bbr,
+}
+
+impl std::str::FromStr for TcpCongestionControl {
+    type Err = serde_yaml::Error;
+
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        serde_yaml::from_str(s)
+    }
+}
+
 #[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
 #[serde(rename_all = "lowercase")]
 enum CustomGraph {
@@ -665,6 +1226,48 @@ enum GraphOptions {
     OneGbitSwitch,
 }
 
+#[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
+#[serde(deny_unknown_fields)]
+pub struct NetworkChangeOptions {
+    /// The simulated time at which the edge changes
+    time: units::Time<units::TimePrefix>,
+
+    /// The id of the edge's source node
+    source: u64,
+
+    /// The id of the edge's target node
+    target: u64,
+
+    /// The new latency of the edge, if it changes
+    #[serde(default)]
+    latency: Option<units::Time<units::TimePrefix>>,
+
+    /// The new packet loss of the edge, if it changes
+    #[serde(default)]
+    packet_loss: Option<f32>,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
+#[serde(deny_unknown_fields)]
+pub struct BackgroundFlowOptions {
+    /// The host that the flow sends from
+    source: String,
+
+    /// The host that the flow sends to
+    destination: String,
+
+    /// The rate that the flow would send at if nothing held it back
+    rate: units::BitsPerSec<units::SiPrefixUpper>,
+
+    /// The simulated time at which the flow starts
+    #[serde(default)]
+    start_time: units::Time<units::TimePrefix>,
+
+    /// The simulated time at which the flow stops, if it stops
+    #[serde(default)]
+    stop_time: Option<units::Time<units::TimePrefix>>,
+}
+
 #[derive(Debug, Clone, Serialize, Deserialize, JsonSchema)]
 pub struct Quantity(u32);
 
@@ -1065,6 +1668,13 @@ mod export {
         config.general.log_level.as_ref().unwrap().to_c_loglevel()
     }
 
+    #[no_mangle]
+    pub extern "C" fn config_getLogFormat(config: *const ConfigOptions) -> LogFormat {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.log_format.unwrap()
+    }
+
     #[no_mangle]
     pub extern "C" fn config_getHeartbeatInterval(
         config: *const ConfigOptions,
@@ -1094,102 +1704,399 @@ mod export {
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseCpuPinning(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getPauseAt(config: *const ConfigOptions) -> c::SimulationTime {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_cpu_pinning.unwrap()
+        match config.experimental.pause_at {
+            Some(x) => x.convert(units::TimePrefix::Nano).unwrap().value() * SIMTIME_ONE_NANOSECOND,
+            // shadow uses a value of 0 as "not set" instead of SIMTIME_INVALID
+            None => 0,
+        }
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getInterposeMethod(config: *const ConfigOptions) -> InterposeMethod {
+    pub extern "C" fn config_getUsePerHostLookahead(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.interpose_method.unwrap()
+        config.experimental.use_per_host_lookahead.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseSchedFifo(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getUseDecoupledRounds(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_sched_fifo.unwrap()
+        config.experimental.use_decoupled_rounds.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseOnWaitpidWorkarounds(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getHostRebalanceInterval(config: *const ConfigOptions) -> u32 {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_o_n_waitpid_workarounds.unwrap()
+        config.experimental.host_rebalance_interval.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseExplicitBlockMessage(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getUseAdaptiveRunahead(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_explicit_block_message.unwrap()
+        config.experimental.use_adaptive_runahead.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseSeccomp(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getUseCalendarEventQueues(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        match config.experimental.use_seccomp {
-            Some(b) => b,
-            None => config_getInterposeMethod(config) == InterposeMethod::Preload,
-        }
+        config.experimental.use_calendar_event_queues.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseSyscallCounters(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getUseWorkerBarrier(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_syscall_counters.unwrap()
+        config.experimental.use_worker_barrier.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseObjectCounters(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getUsePathMatrix(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_object_counters.unwrap()
+        config.experimental.use_path_matrix.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseMemoryManager(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getUsePathMatrixCache(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_memory_manager.unwrap()
+        config.experimental.use_path_matrix_cache.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getUseShimSyscallHandler(config: *const ConfigOptions) -> bool {
+    pub extern "C" fn config_getPathMatrixCacheDirectory(
+        config: *const ConfigOptions,
+    ) -> *mut libc::c_char {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.use_shim_syscall_handler.unwrap()
+
+        match config.experimental.path_matrix_cache_directory {
+            Some(ref x) => {
+                let x = tilde_expansion(x);
+                CString::into_raw(CString::new(x.to_str().unwrap()).unwrap())
+            }
+            None => std::ptr::null_mut(),
+        }
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getPreloadSpinMax(config: *const ConfigOptions) -> i32 {
+    pub extern "C" fn config_getPrecomputePaths(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.experimental.preload_spin_max.unwrap()
+        config.experimental.precompute_paths.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getParallelism(config: *const ConfigOptions) -> NonZeroU32 {
+    pub extern "C" fn config_getUseCpuPinning(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config.general.parallelism.unwrap()
+        config.experimental.use_cpu_pinning.unwrap()
     }
 
     #[no_mangle]
-    pub extern "C" fn config_getStopTime(config: *const ConfigOptions) -> c::SimulationTime {
+    pub extern "C" fn config_getUseNumaPlacement(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
-        config
-            .general
-            .stop_time
-            .unwrap()
-            .convert(units::TimePrefixUpper::Sec)
-            .unwrap()
+        config.experimental.use_numa_placement.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseNodeCpuPinning(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_node_cpu_pinning.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseHostPartitioning(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_host_partitioning.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getHostPartitioningCounts(
+        config: *const ConfigOptions,
+    ) -> *mut libc::c_char {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        match config.experimental.host_partitioning_counts {
+            Some(ref x) => {
+                let x = tilde_expansion(x);
+                CString::into_raw(CString::new(x.to_str().unwrap()).unwrap())
+            }
+            None => std::ptr::null_mut(),
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getInterposeMethod(config: *const ConfigOptions) -> InterposeMethod {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.interpose_method.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseSchedFifo(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_sched_fifo.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseOnWaitpidWorkarounds(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_o_n_waitpid_workarounds.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseExplicitBlockMessage(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_explicit_block_message.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseSeccomp(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        match config.experimental.use_seccomp {
+            Some(b) => b,
+            None => config_getInterposeMethod(config) == InterposeMethod::Preload,
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getNativeSyscalls(config: *const ConfigOptions) -> *mut libc::c_char {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        match config.experimental.native_syscalls {
+            Some(ref x) => CString::into_raw(CString::new(x.as_str()).unwrap()),
+            None => std::ptr::null_mut(),
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseSyscallCounters(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_syscall_counters.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseObjectCounters(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_object_counters.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseProfiler(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_profiler.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUsePreloadZygote(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_preload_zygote.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseThreadOverlap(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_thread_overlap.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUsePipelinedWorkers(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_pipelined_workers.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseProcessPrelaunch(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_process_prelaunch.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseMissingPathCache(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_missing_path_cache.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseRoundStats(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_round_stats.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseDeterminismDigest(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_determinism_digest.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUsePerHostLogFiles(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_per_host_log_files.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseMemoryManager(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_memory_manager.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseSharedFileCache(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_shared_file_cache.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseFastExit(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_fast_exit.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseFileWriteBehind(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_file_write_behind.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseShmemHugepages(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_shmem_hugepages.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseKsm(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_ksm.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getIdlePageoutThreshold(
+        config: *const ConfigOptions,
+    ) -> c::SimulationTime {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        match config.experimental.idle_pageout_threshold {
+            Some(x) => x.convert(units::TimePrefix::Nano).unwrap().value() * SIMTIME_ONE_NANOSECOND,
+            // shadow uses a value of 0 as "not set" instead of SIMTIME_INVALID
+            None => 0,
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getSpinSyscallDelay(
+        config: *const ConfigOptions,
+    ) -> c::SimulationTime {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        match config.experimental.spin_syscall_delay {
+            Some(x) => x.convert(units::TimePrefix::Nano).unwrap().value() * SIMTIME_ONE_NANOSECOND,
+            // shadow uses a value of 0 as "not set" instead of SIMTIME_INVALID
+            None => 0,
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getSpinSyscallLimit(config: *const ConfigOptions) -> u32 {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.spin_syscall_limit.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseShimSyscallHandler(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_shim_syscall_handler.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseShimRdtsc(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_shim_rdtsc.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseVdsoPatching(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.use_vdso_patching.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getPcapCompressionLevel(config: *const ConfigOptions) -> i32 {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.pcap_compression_level.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getPcapCompressionThreads(config: *const ConfigOptions) -> u32 {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.pcap_compression_threads.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getPreloadSpinMax(config: *const ConfigOptions) -> i32 {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.experimental.preload_spin_max.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getParallelism(config: *const ConfigOptions) -> NonZeroU32 {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config.general.parallelism.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getStopTime(config: *const ConfigOptions) -> c::SimulationTime {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+        config
+            .general
+            .stop_time
+            .unwrap()
+            .convert(units::TimePrefixUpper::Sec)
+            .unwrap()
             .value()
             * SIMTIME_ONE_SECOND
     }
@@ -1264,6 +2171,20 @@ mod export {
         }
     }
 
+    #[no_mangle]
+    pub extern "C" fn config_getControlSocket(config: *const ConfigOptions) -> *mut libc::c_char {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        match config.experimental.control_socket {
+            Some(ref x) => {
+                let x = tilde_expansion(x);
+                CString::into_raw(CString::new(x.to_str().unwrap()).unwrap())
+            }
+            None => std::ptr::null_mut(),
+        }
+    }
+
     #[no_mangle]
     pub extern "C" fn config_getSocketRecvBuffer(config: *const ConfigOptions) -> u64 {
         assert!(!config.is_null());
@@ -1330,6 +2251,38 @@ mod export {
         config.experimental.interface_qdisc.unwrap()
     }
 
+    #[no_mangle]
+    pub extern "C" fn config_getSocketLinuxDelayedAck(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        config.experimental.socket_linux_delayed_ack.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getInterfaceSegmentationOffload(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        config.experimental.interface_segmentation_offload.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getInterfaceReceiveBatching(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        config.experimental.interface_receive_batching.unwrap()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn config_getUseDeferredWakeups(config: *const ConfigOptions) -> bool {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        config.experimental.use_deferred_wakeups.unwrap()
+    }
+
     #[no_mangle]
     pub extern "C" fn config_getUseLegacyWorkingDir(config: *const ConfigOptions) -> bool {
         assert!(!config.is_null());
@@ -1359,6 +2312,88 @@ mod export {
         config.network.use_shortest_path.unwrap()
     }
 
+    /// Calls `f` with the time, source node id, target node id, latency in nanoseconds (or -1),
+    /// and packet loss (or -1) of each network change, sorted by time.
+    #[no_mangle]
+    pub extern "C" fn config_iterNetworkChanges(
+        config: *const ConfigOptions,
+        f: unsafe extern "C" fn(c::SimulationTime, u64, u64, i64, f64, *mut libc::c_void),
+        data: *mut libc::c_void,
+    ) {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        let to_nanos = |x: &units::Time<units::TimePrefix>| {
+            x.convert(units::TimePrefix::Nano).unwrap().value()
+        };
+
+        let mut changes: Vec<&NetworkChangeOptions> =
+            config.network.changes.iter().flatten().collect();
+        // a stable sort, so changes at the same time are applied in the order they're listed
+        changes.sort_by_key(|x| to_nanos(&x.time));
+
+        for change in changes {
+            let time = to_nanos(&change.time) * SIMTIME_ONE_NANOSECOND;
+            let latency = change.latency.map(|x| to_nanos(&x) as i64).unwrap_or(-1);
+            let packet_loss = change.packet_loss.map(|x| x as f64).unwrap_or(-1.0);
+            unsafe {
+                f(
+                    time,
+                    change.source,
+                    change.target,
+                    latency,
+                    packet_loss,
+                    data,
+                )
+            };
+        }
+    }
+
+    /// Calls `f` with the source host name, destination host name, rate in bits per second,
+    /// start time, and stop time (or 0) of each background flow, in the order they're listed.
+    #[no_mangle]
+    pub extern "C" fn config_iterBackgroundFlows(
+        config: *const ConfigOptions,
+        f: unsafe extern "C" fn(
+            *const libc::c_char,
+            *const libc::c_char,
+            u64,
+            c::SimulationTime,
+            c::SimulationTime,
+            *mut libc::c_void,
+        ),
+        data: *mut libc::c_void,
+    ) {
+        assert!(!config.is_null());
+        let config = unsafe { &*config };
+
+        let to_time = |x: &units::Time<units::TimePrefix>| {
+            x.convert(units::TimePrefix::Nano).unwrap().value() * SIMTIME_ONE_NANOSECOND
+        };
+
+        for flow in config.network.background_flows.iter().flatten() {
+            // bind the strings to local variables so they're not dropped before f() runs
+            let source = CString::new(flow.source.clone()).unwrap();
+            let destination = CString::new(flow.destination.clone()).unwrap();
+            let rate = flow
+                .rate
+                .convert(units::SiPrefixUpper::Base)
+                .unwrap()
+                .value();
+            let stop_time = flow.stop_time.as_ref().map(to_time).unwrap_or(0);
+            unsafe {
+                f(
+                    source.as_c_str().as_ptr(),
+                    destination.as_c_str().as_ptr(),
+                    rate,
+                    to_time(&flow.start_time),
+                    stop_time,
+                    data,
+                )
+            };
+        }
+    }
+
     #[no_mangle]
     pub extern "C" fn config_iterHosts(
         config: *const ConfigOptions,
@@ -1369,13 +2404,13 @@ mod export {
             *mut libc::c_void,
         ),
         data: *mut libc::c_void,
-    ) {
+    ) -> bool {
         assert!(!config.is_null());
         let config = unsafe { &*config };
 
-        for (name, host) in &config.hosts {
+        let result = config.for_each_host(|name, host| {
             // bind the string to a local variable so it's not dropped before f() runs
-            let name = CString::new(name.clone()).unwrap();
+            let name = CString::new(name).unwrap();
             unsafe {
                 f(
                     name.as_c_str().as_ptr(),
@@ -1384,6 +2419,14 @@ mod export {
                     data,
                 )
             };
+        });
+
+        match result {
+            Ok(()) => true,
+            Err(e) => {
+                eprintln!("{}", e);
+                false
+            }
         }
     }
 
@@ -1392,11 +2435,10 @@ mod export {
         assert!(!config.is_null());
         let config = unsafe { &*config };
 
-        config
-            .hosts
-            .iter()
-            .map(|(_, host)| hostoptions_getQuantity(host))
-            .sum()
+        let mut n_hosts = 0;
+        // any errors in the hosts file are reported when the hosts are created
+        let _ = config.for_each_host(|_, host| n_hosts += hostoptions_getQuantity(host));
+        n_hosts
     }
 
     #[no_mangle]
@@ -1468,6 +2510,14 @@ mod export {
             * SIMTIME_ONE_SECOND
     }
 
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getHeartbeatLogFormat(host: *const HostOptions) -> LogFormat {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        host.options.heartbeat_log_format.unwrap()
+    }
+
     #[no_mangle]
     pub extern "C" fn hostoptions_getPcapDirectory(host: *const HostOptions) -> *mut libc::c_char {
         assert!(!host.is_null());
@@ -1482,6 +2532,22 @@ mod export {
         }
     }
 
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getPcapCaptureSize(host: *const HostOptions) -> u32 {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        let size = host
+            .options
+            .pcap_capture_size
+            .unwrap()
+            .convert(units::SiPrefixUpper::Base)
+            .unwrap()
+            .value();
+
+        std::cmp::min(size, u32::MAX as u64) as u32
+    }
+
     #[no_mangle]
     pub extern "C" fn hostoptions_getIpAddressHint(host: *const HostOptions) -> *mut libc::c_char {
         assert!(!host.is_null());
@@ -1539,6 +2605,25 @@ mod export {
         }
     }
 
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getTcpCongestionControl(
+        host: *const HostOptions,
+    ) -> TcpCongestionControl {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        host.options.tcp_congestion_control.unwrap()
+    }
+
+    /// Returns 0 if the host's CPU shouldn't be modeled.
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getCpuCores(host: *const HostOptions) -> u32 {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        host.options.cpu_cores.unwrap_or(0)
+    }
+
     #[no_mangle]
     pub extern "C" fn hostoptions_iterProcesses(
         host: *const HostOptions,
@@ -1553,6 +2638,110 @@ mod export {
         }
     }
 
+    #[no_mangle]
+    pub extern "C" fn hostoptions_hasTrafficModel(host: *const HostOptions) -> bool {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        host.traffic_model.is_some()
+    }
+
+    /// Returns the port in host byte order.
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getTrafficModelPort(host: *const HostOptions) -> u16 {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        host.traffic_model.as_ref().unwrap().port
+    }
+
+    /// Returns NULL if the traffic model has no peer, and serves streams instead.
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getTrafficModelPeer(
+        host: *const HostOptions,
+    ) -> *mut libc::c_char {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        match &host.traffic_model.as_ref().unwrap().peer {
+            Some(x) => CString::into_raw(CString::new(x.clone()).unwrap()),
+            None => std::ptr::null_mut(),
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getTrafficModelStartTime(
+        host: *const HostOptions,
+    ) -> c::SimulationTime {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        host.traffic_model
+            .as_ref()
+            .unwrap()
+            .start_time
+            .convert(units::TimePrefixUpper::Sec)
+            .unwrap()
+            .value()
+            * SIMTIME_ONE_SECOND
+    }
+
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getTrafficModelNumStates(host: *const HostOptions) -> u32 {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        host.traffic_model.as_ref().unwrap().states.len() as u32
+    }
+
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getTrafficModelState(
+        host: *const HostOptions,
+        index: u32,
+        send_bytes: *mut u64,
+        receive_bytes: *mut u64,
+        pause: *mut c::SimulationTime,
+    ) {
+        assert!(!host.is_null());
+        assert!(!send_bytes.is_null() && !receive_bytes.is_null() && !pause.is_null());
+        let host = unsafe { &*host };
+
+        let state = &host.traffic_model.as_ref().unwrap().states[index as usize];
+        unsafe {
+            *send_bytes = state
+                .send
+                .convert(units::SiPrefixUpper::Base)
+                .unwrap()
+                .value();
+            *receive_bytes = state
+                .receive
+                .convert(units::SiPrefixUpper::Base)
+                .unwrap()
+                .value();
+            *pause = state
+                .pause
+                .convert(units::TimePrefix::Nano)
+                .unwrap()
+                .value()
+                * SIMTIME_ONE_NANOSECOND;
+        }
+    }
+
+    /// Returns the relative weight of moving from state `from` to state `to`.
+    #[no_mangle]
+    pub extern "C" fn hostoptions_getTrafficModelWeight(
+        host: *const HostOptions,
+        from: u32,
+        to: u32,
+    ) -> f64 {
+        assert!(!host.is_null());
+        let host = unsafe { &*host };
+
+        let model = host.traffic_model.as_ref().unwrap();
+        let to = &model.states[to as usize].name;
+        *model.states[from as usize].next.get(to).unwrap_or(&0.0)
+    }
+
     #[no_mangle]
     pub extern "C" fn processoptions_freeString(string: *mut libc::c_char) {
         if !string.is_null() {
@@ -1617,6 +2806,14 @@ mod export {
         *proc.quantity
     }
 
+    #[no_mangle]
+    pub extern "C" fn processoptions_getElidePayloads(proc: *const ProcessOptions) -> bool {
+        assert!(!proc.is_null());
+        let proc = unsafe { &*proc };
+
+        proc.elide_payloads
+    }
+
     #[no_mangle]
     pub extern "C" fn processoptions_getStartTime(
         proc: *const ProcessOptions,
@@ -1642,4 +2839,12 @@ mod export {
             None => 0,
         }
     }
+
+    #[no_mangle]
+    pub extern "C" fn processoptions_getTraceSyscalls(proc: *const ProcessOptions) -> bool {
+        assert!(!proc.is_null());
+        let proc = unsafe { &*proc };
+
+        proc.trace_syscalls
+    }
 }
@@ -11,6 +11,7 @@
 // TODO put into a shd-types.h file
 typedef struct _Process Process;
 typedef struct _Host Host;
+typedef struct _Thread Thread;
 
 /**
  * Simulation time in nanoseconds. Allows for a consistent representation
@@ -126,6 +127,8 @@ typedef guint64 EmulatedTime;
  */
 #define CONFIG_TCP_DELACK_MIN (NET_TCP_HZ / 25)
 #define CONFIG_TCP_DELACK_MAX (NET_TCP_HZ / 5)
+/* quick ACKs at the start of a connection, TCP_MAX_QUICKACKS from net/tcp.h */
+#define CONFIG_TCP_MAX_QUICKACKS 16
 
 /**
  * Minimum size of the send buffer per socket when TCP-autotuning is used.
@@ -11,41 +11,100 @@
 #include "main/core/worker.h"
 #include "main/host/cpu.h"
 #include "main/host/host.h"
+#include "main/host/syscall_condition.h"
 #include "main/host/tracker.h"
+#include "main/utility/object_pool.h"
 #include "main/utility/utility.h"
 
 struct _Event {
     Host* srcHost;
     Host* dstHost;
+    /* NULL unless the event runs a shared task instead of its own callback */
     Task* task;
+    TaskCallbackFunc callback;
+    gpointer callbackObject;
+    gpointer callbackArgument;
+    TaskObjectFreeFunc objectFree;
+    TaskArgumentFreeFunc argumentFree;
+    /* storage for the callback object of event_newWithInlineObject */
+    union {
+        guint8 bytes[EVENT_INLINE_OBJECT_SIZE];
+        gpointer align;
+    } inlineObject;
     SimulationTime time;
     guint64 srcHostEventID;
     gint referenceCount;
     MAGIC_DECLARE;
 };
 
-Event* event_new_(Task* task, SimulationTime time, gpointer srcHost, gpointer dstHost) {
-    utility_assert(task != NULL);
-    Event* event = g_new0(Event, 1);
+static ObjectPool _eventPool = OBJECTPOOL_INIT(Event);
+
+static Event* _event_new(SimulationTime time, gpointer srcHost, gpointer dstHost) {
+    Event* event = objectpool_alloc0(&_eventPool);
     MAGIC_INIT(event);
 
     event->srcHost = (Host*)srcHost;
     event->dstHost = (Host*)dstHost;
-    event->task = task;
-    task_ref(event->task);
     event->time = time;
     event->srcHostEventID = host_getNewEventID(srcHost);
     event->referenceCount = 1;
 
     worker_count_allocation(Event);
+    worker_addGauge(WORKER_GAUGE_EVENTS, 1);
+    return event;
+}
+
+Event* event_new_(Task* task, SimulationTime time, gpointer srcHost, gpointer dstHost) {
+    utility_assert(task != NULL);
+    Event* event = _event_new(time, srcHost, dstHost);
+    event->task = task;
+    task_ref(event->task);
+    return event;
+}
+
+Event* event_newWithCallback(TaskCallbackFunc callback, gpointer callbackObject,
+                             gpointer callbackArgument, TaskObjectFreeFunc objectFree,
+                             TaskArgumentFreeFunc argumentFree, SimulationTime time,
+                             gpointer srcHost, gpointer dstHost) {
+    utility_assert(callback != NULL);
+    Event* event = _event_new(time, srcHost, dstHost);
+    event->callback = callback;
+    event->callbackObject = callbackObject;
+    event->callbackArgument = callbackArgument;
+    event->objectFree = objectFree;
+    event->argumentFree = argumentFree;
+    return event;
+}
+
+Event* event_newWithInlineObject(TaskCallbackFunc callback, TaskObjectFreeFunc objectClear,
+                                 SimulationTime time, gpointer srcHost, gpointer dstHost) {
+    Event* event =
+        event_newWithCallback(callback, NULL, NULL, objectClear, NULL, time, srcHost, dstHost);
+    event->callbackObject = &event->inlineObject;
     return event;
 }
 
+gpointer event_getInlineObject(Event* event) {
+    MAGIC_ASSERT(event);
+    utility_assert(event->callbackObject == &event->inlineObject);
+    return event->callbackObject;
+}
+
 static void _event_free(Event* event) {
-    task_unref(event->task);
+    if (event->task) {
+        task_unref(event->task);
+    } else {
+        if (event->objectFree && event->callbackObject) {
+            event->objectFree(event->callbackObject);
+        }
+        if (event->argumentFree && event->callbackArgument) {
+            event->argumentFree(event->callbackArgument);
+        }
+    }
     MAGIC_CLEAR(event);
-    g_free(event);
+    objectpool_free(&_eventPool, event);
     worker_count_deallocation(Event);
+    worker_addGauge(WORKER_GAUGE_EVENTS, -1);
 }
 
 void event_ref(Event* event) {
@@ -78,12 +137,24 @@ void event_execute(Event* event) {
         /* track the event delay time */
         tracker_addVirtualProcessingDelay(host_getTracker(event->dstHost), cpuDelay);
 
-        /* this event is delayed due to cpu, so reschedule it to ourselves */
-        worker_scheduleTask(event->task, event->dstHost, cpuDelay);
+        /* this event is delayed due to cpu, so reschedule it to ourselves. it is ordered
+         * like a new event that the host created now. */
+        event_ref(event);
+        event->srcHost = event->dstHost;
+        event->srcHostEventID = host_getNewEventID(event->dstHost);
+        event->time = worker_getCurrentTime() + cpuDelay;
+        worker_scheduleEvent(event, event->dstHost);
     } else {
         /* cpu is not blocked, its ok to execute the event */
         host_continueExecutionTimer(event->dstHost);
-        task_execute(event->task, event->dstHost);
+        /* the threads that the event wakes continue once it's done */
+        syscallcondition_beginDeferredSignals();
+        if (event->task) {
+            task_execute(event->task, event->dstHost);
+        } else {
+            event->callback(event->dstHost, event->callbackObject, event->callbackArgument);
+        }
+        syscallcondition_endDeferredSignals(event->dstHost);
         host_stopExecutionTimer(event->dstHost);
     }
 
@@ -106,6 +177,21 @@ void event_setTime(Event* event, SimulationTime time) {
     event->time = time;
 }
 
+guint event_getDstHostID(Event* event) {
+    MAGIC_ASSERT(event);
+    return host_getID(event->dstHost);
+}
+
+guint event_getSrcHostID(Event* event) {
+    MAGIC_ASSERT(event);
+    return host_getID(event->srcHost);
+}
+
+guint64 event_getSrcHostEventID(Event* event) {
+    MAGIC_ASSERT(event);
+    return event->srcHostEventID;
+}
+
 gint event_compare(const Event* a, const Event* b, gpointer userData) {
     MAGIC_ASSERT(a);
     MAGIC_ASSERT(b);
@@ -16,7 +16,23 @@
  * (These are packets sent between hosts on the same machine.) */
 typedef struct _Event Event;
 
+/* The number of bytes of callback object that an event can hold itself. */
+#define EVENT_INLINE_OBJECT_SIZE 24
+
 Event* event_new_(Task* task, SimulationTime time, gpointer srcHost, gpointer dstHost);
+/* Like event_new_, but the event holds the callback and its object and argument itself,
+ * instead of referencing a separate task. The free functions are called when the event is
+ * freed, like a task's. Use this unless the task is shared with other events. */
+Event* event_newWithCallback(TaskCallbackFunc callback, gpointer callbackObject,
+                             gpointer callbackArgument, TaskObjectFreeFunc objectFree,
+                             TaskArgumentFreeFunc argumentFree, SimulationTime time,
+                             gpointer srcHost, gpointer dstHost);
+/* Like event_newWithCallback, but the callback object is EVENT_INLINE_OBJECT_SIZE zeroed
+ * bytes inside the event, which the caller fills in through event_getInlineObject.
+ * objectClear is called on them when the event is freed, and must not free them. */
+Event* event_newWithInlineObject(TaskCallbackFunc callback, TaskObjectFreeFunc objectClear,
+                                 SimulationTime time, gpointer srcHost, gpointer dstHost);
+gpointer event_getInlineObject(Event* event);
 void event_ref(Event* event);
 void event_unref(Event* event);
 
@@ -27,4 +43,9 @@ gpointer event_getHost(Event* event);
 SimulationTime event_getTime(Event* event);
 void event_setTime(Event* event, SimulationTime time);
 
+/* The ids that order events with equal times, in the same way as event_compare. */
+guint event_getDstHostID(Event* event);
+guint event_getSrcHostID(Event* event);
+guint64 event_getSrcHostEventID(Event* event);
+
 #endif /* SHD_EVENT_H_ */
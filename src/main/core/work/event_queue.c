@@ -0,0 +1,469 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/core/work/event_queue.h"
+
+#include <stdbool.h>
+
+#include "main/bindings/c/bindings.h"
+#include "main/core/support/config_handlers.h"
+#include "main/core/support/definitions.h"
+#include "main/utility/utility.h"
+
+static bool _useCalendarQueues = false;
+ADD_CONFIG_HANDLER(config_getUseCalendarEventQueues, _useCalendarQueues)
+
+/* each node has this many children. a wider heap is shallower, so a pop sifts through
+ * fewer levels, and the children of a node share one or two cache lines. */
+#define EVENTQUEUE_ARITY 4
+#define EVENTQUEUE_INITIAL_SIZE 64
+
+/* calendar queues never have fewer buckets than this, and keep between half and twice as
+ * many events as buckets */
+#define EVENTQUEUE_MIN_BUCKETS 16
+/* the weight of the newest gap between popped events in the moving average that sizes
+ * the buckets */
+#define EVENTQUEUE_GAP_WEIGHT 0.05
+/* the end of a bucket list, or an unknown node */
+#define EVENTQUEUE_NONE G_MAXUINT
+
+typedef struct _EventQueueEntry EventQueueEntry;
+struct _EventQueueEntry {
+    SimulationTime time;
+    guint64 srcHostEventID;
+    guint dstHostID;
+    guint srcHostID;
+    Event* event;
+};
+
+/* an entry in a calendar queue bucket, which is a list sorted in event order */
+typedef struct _EventQueueNode EventQueueNode;
+struct _EventQueueNode {
+    EventQueueEntry entry;
+    guint next;
+};
+
+/* the list of events in a calendar queue bucket */
+typedef struct _EventQueueBucket EventQueueBucket;
+struct _EventQueueBucket {
+    guint head;
+    guint tail;
+};
+
+/* A calendar queue (Brown, 1988): a year of nBuckets days of width nanoseconds each,
+ * where an event goes in the bucket of its day of the year. We look for the next event
+ * by walking the days from the current one, which is fast while the buckets are about
+ * as wide as the gaps between the events. */
+typedef struct _EventQueueCalendar EventQueueCalendar;
+struct _EventQueueCalendar {
+    EventQueueBucket* buckets;
+    guint nBuckets;
+    SimulationTime width;
+    /* the current day: every queued event is at or after dayStart */
+    guint day;
+    SimulationTime dayStart;
+    /* the nodes of all of the lists, and a list of the unused ones */
+    EventQueueNode* nodes;
+    guint nodesCapacity;
+    guint freeNodes;
+    /* the node of the next event, if we know it */
+    guint nextNode;
+    /* a moving average of the gaps between popped events, and the last one's time */
+    gdouble avgGap;
+    SimulationTime lastPopTime;
+    /* how many events we popped since we last sized the buckets */
+    guint nPopsSinceResize;
+};
+
+struct _EventQueue {
+    EventQueueEntry* heap;
+    gsize length;
+    gsize capacity;
+    /* if set, the events are in the calendar instead of the heap */
+    gboolean isCalendar;
+    EventQueueCalendar calendar;
+    MAGIC_DECLARE;
+};
+
+static void _eventqueue_initCalendar(EventQueueCalendar* calendar) {
+    calendar->nBuckets = EVENTQUEUE_MIN_BUCKETS;
+    calendar->buckets = g_new(EventQueueBucket, calendar->nBuckets);
+    for (guint i = 0; i < calendar->nBuckets; i++) {
+        calendar->buckets[i] = (EventQueueBucket){EVENTQUEUE_NONE, EVENTQUEUE_NONE};
+    }
+    calendar->width = SIMTIME_ONE_MICROSECOND;
+    calendar->freeNodes = EVENTQUEUE_NONE;
+    calendar->nextNode = EVENTQUEUE_NONE;
+    calendar->lastPopTime = SIMTIME_INVALID;
+}
+
+EventQueue* eventqueue_new(void) {
+    EventQueue* queue = g_new0(EventQueue, 1);
+    MAGIC_INIT(queue);
+
+    if (_useCalendarQueues) {
+        queue->isCalendar = TRUE;
+        _eventqueue_initCalendar(&queue->calendar);
+    } else {
+        queue->capacity = EVENTQUEUE_INITIAL_SIZE;
+        queue->heap = g_new(EventQueueEntry, queue->capacity);
+    }
+
+    return queue;
+}
+
+void eventqueue_free(EventQueue* queue) {
+    MAGIC_ASSERT(queue);
+
+    if (queue->isCalendar) {
+        EventQueueCalendar* calendar = &queue->calendar;
+        for (guint i = 0; i < calendar->nBuckets; i++) {
+            for (guint node = calendar->buckets[i].head; node != EVENTQUEUE_NONE;
+                 node = calendar->nodes[node].next) {
+                event_unref(calendar->nodes[node].entry.event);
+            }
+        }
+        g_free(calendar->buckets);
+        g_free(calendar->nodes);
+    } else {
+        for (gsize i = 0; i < queue->length; i++) {
+            event_unref(queue->heap[i].event);
+        }
+        g_free(queue->heap);
+    }
+
+    MAGIC_CLEAR(queue);
+    g_free(queue);
+}
+
+gsize eventqueue_getLength(EventQueue* queue) {
+    MAGIC_ASSERT(queue);
+    return queue->length;
+}
+
+gboolean eventqueue_isEmpty(EventQueue* queue) {
+    MAGIC_ASSERT(queue);
+    return queue->length == 0;
+}
+
+/* must match the order of event_compare */
+static inline gboolean _eventqueue_isBefore(const EventQueueEntry* a, const EventQueueEntry* b) {
+    if (a->time != b->time) {
+        return a->time < b->time;
+    } else if (a->dstHostID != b->dstHostID) {
+        return a->dstHostID < b->dstHostID;
+    } else if (a->srcHostID != b->srcHostID) {
+        return a->srcHostID < b->srcHostID;
+    } else {
+        return a->srcHostEventID < b->srcHostEventID;
+    }
+}
+
+static inline guint _eventqueue_getBucket(EventQueueCalendar* calendar, SimulationTime time) {
+    return (guint)((time / calendar->width) & (calendar->nBuckets - 1));
+}
+
+/* makes the day of time the current day */
+static void _eventqueue_setDay(EventQueueCalendar* calendar, SimulationTime time) {
+    calendar->day = _eventqueue_getBucket(calendar, time);
+    calendar->dayStart = time - time % calendar->width;
+}
+
+/* links the node into its bucket's list, in event order */
+static void _eventqueue_link(EventQueueCalendar* calendar, guint node) {
+    const EventQueueEntry* entry = &calendar->nodes[node].entry;
+    EventQueueBucket* bucket = &calendar->buckets[_eventqueue_getBucket(calendar, entry->time)];
+
+    /* events usually come after the others of their bucket, such as those at the same
+     * time, so check the tail before walking the list */
+    guint* link = NULL;
+    if (bucket->tail == EVENTQUEUE_NONE ||
+        !_eventqueue_isBefore(entry, &calendar->nodes[bucket->tail].entry)) {
+        link = (bucket->tail == EVENTQUEUE_NONE) ? &bucket->head
+                                                 : &calendar->nodes[bucket->tail].next;
+        bucket->tail = node;
+    } else {
+        link = &bucket->head;
+        while (!_eventqueue_isBefore(entry, &calendar->nodes[*link].entry)) {
+            link = &calendar->nodes[*link].next;
+        }
+    }
+    calendar->nodes[node].next = *link;
+    *link = node;
+}
+
+/* spreads the events over nBuckets buckets, sized from the gaps between the events that
+ * we popped recently, or from the spread of the queued events if we haven't popped any */
+static void _eventqueue_resize(EventQueue* queue, guint nBuckets) {
+    EventQueueCalendar* calendar = &queue->calendar;
+
+    /* unlink every node, keeping a list of them in the free list's link */
+    guint all = EVENTQUEUE_NONE;
+    SimulationTime minTime = SIMTIME_MAX, maxTime = 0;
+    for (guint i = 0; i < calendar->nBuckets; i++) {
+        guint node = calendar->buckets[i].head;
+        while (node != EVENTQUEUE_NONE) {
+            guint next = calendar->nodes[node].next;
+            SimulationTime time = calendar->nodes[node].entry.time;
+            minTime = MIN(minTime, time);
+            maxTime = MAX(maxTime, time);
+            calendar->nodes[node].next = all;
+            all = node;
+            node = next;
+        }
+    }
+
+    /* Brown found a few times the average gap to work best */
+    gdouble gap = calendar->avgGap;
+    if (gap <= 0 && queue->length > 1) {
+        gap = (gdouble)(maxTime - minTime) / (queue->length - 1);
+    }
+    calendar->width = MAX(1, (SimulationTime)(3 * gap));
+
+    calendar->nBuckets = nBuckets;
+    calendar->buckets = g_renew(EventQueueBucket, calendar->buckets, nBuckets);
+    for (guint i = 0; i < nBuckets; i++) {
+        calendar->buckets[i] = (EventQueueBucket){EVENTQUEUE_NONE, EVENTQUEUE_NONE};
+    }
+    while (all != EVENTQUEUE_NONE) {
+        guint next = calendar->nodes[all].next;
+        _eventqueue_link(calendar, all);
+        all = next;
+    }
+
+    _eventqueue_setDay(calendar, (minTime != SIMTIME_MAX) ? minTime : calendar->dayStart);
+    calendar->nextNode = EVENTQUEUE_NONE;
+    calendar->nPopsSinceResize = 0;
+}
+
+/* if the buckets are more than twice too wide or too narrow for the events that we have
+ * been running */
+static gboolean _eventqueue_isMissized(EventQueueCalendar* calendar) {
+    gdouble width = 3 * calendar->avgGap;
+    return width > 0 && (width > 2 * calendar->width || 2 * width < calendar->width);
+}
+
+static void _eventqueue_pushCalendar(EventQueue* queue, const EventQueueEntry* entry) {
+    EventQueueCalendar* calendar = &queue->calendar;
+
+    if (calendar->freeNodes == EVENTQUEUE_NONE) {
+        guint oldCapacity = calendar->nodesCapacity;
+        calendar->nodesCapacity = MAX(EVENTQUEUE_INITIAL_SIZE, 2 * oldCapacity);
+        calendar->nodes = g_renew(EventQueueNode, calendar->nodes, calendar->nodesCapacity);
+        for (guint i = calendar->nodesCapacity; i > oldCapacity; i--) {
+            calendar->nodes[i - 1].next = calendar->freeNodes;
+            calendar->freeNodes = i - 1;
+        }
+    }
+
+    guint node = calendar->freeNodes;
+    calendar->freeNodes = calendar->nodes[node].next;
+    calendar->nodes[node].entry = *entry;
+    _eventqueue_link(calendar, node);
+    queue->length++;
+
+    if (queue->length == 1 || entry->time < calendar->dayStart) {
+        _eventqueue_setDay(calendar, entry->time);
+    }
+    if (calendar->nextNode != EVENTQUEUE_NONE &&
+        _eventqueue_isBefore(entry, &calendar->nodes[calendar->nextNode].entry)) {
+        calendar->nextNode = node;
+    }
+
+    if (queue->length > 2 * calendar->nBuckets) {
+        _eventqueue_resize(queue, 2 * calendar->nBuckets);
+    }
+}
+
+/* finds the next event, which is at the head of its bucket's list */
+static guint _eventqueue_findCalendar(EventQueue* queue) {
+    EventQueueCalendar* calendar = &queue->calendar;
+
+    if (queue->length == 0 || calendar->nextNode != EVENTQUEUE_NONE) {
+        return calendar->nextNode;
+    }
+
+    /* walk the days of the coming year */
+    guint day = calendar->day;
+    SimulationTime dayStart = calendar->dayStart;
+    for (guint i = 0; i < calendar->nBuckets; i++) {
+        guint node = calendar->buckets[day].head;
+        SimulationTime dayEnd =
+            (dayStart < SIMTIME_MAX - calendar->width) ? dayStart + calendar->width : SIMTIME_MAX;
+        if (node != EVENTQUEUE_NONE && calendar->nodes[node].entry.time < dayEnd) {
+            calendar->day = day;
+            calendar->dayStart = dayStart;
+            calendar->nextNode = node;
+            return node;
+        }
+        day = (day + 1) & (calendar->nBuckets - 1);
+        dayStart = dayEnd;
+    }
+
+    /* nothing this year. that's expected if the events are sparse, but if it's because the
+     * buckets are too narrow, fix them first. */
+    if (_eventqueue_isMissized(calendar)) {
+        _eventqueue_resize(queue, calendar->nBuckets);
+        return _eventqueue_findCalendar(queue);
+    }
+
+    /* otherwise jump straight to the earliest event */
+    guint next = EVENTQUEUE_NONE;
+    for (guint i = 0; i < calendar->nBuckets; i++) {
+        guint node = calendar->buckets[i].head;
+        if (node != EVENTQUEUE_NONE &&
+            (next == EVENTQUEUE_NONE ||
+             _eventqueue_isBefore(&calendar->nodes[node].entry, &calendar->nodes[next].entry))) {
+            next = node;
+        }
+    }
+    utility_assert(next != EVENTQUEUE_NONE);
+    _eventqueue_setDay(calendar, calendar->nodes[next].entry.time);
+    calendar->nextNode = next;
+    return next;
+}
+
+static Event* _eventqueue_popCalendar(EventQueue* queue) {
+    EventQueueCalendar* calendar = &queue->calendar;
+
+    guint node = _eventqueue_findCalendar(queue);
+    if (node == EVENTQUEUE_NONE) {
+        return NULL;
+    }
+
+    const EventQueueEntry* entry = &calendar->nodes[node].entry;
+    EventQueueBucket* bucket = &calendar->buckets[_eventqueue_getBucket(calendar, entry->time)];
+    utility_assert(bucket->head == node);
+    bucket->head = calendar->nodes[node].next;
+    if (bucket->head == EVENTQUEUE_NONE) {
+        bucket->tail = EVENTQUEUE_NONE;
+    }
+
+    if (calendar->lastPopTime != SIMTIME_INVALID && entry->time > calendar->lastPopTime) {
+        gdouble gap = (gdouble)(entry->time - calendar->lastPopTime);
+        calendar->avgGap = (calendar->avgGap > 0)
+                               ? EVENTQUEUE_GAP_WEIGHT * gap +
+                                     (1 - EVENTQUEUE_GAP_WEIGHT) * calendar->avgGap
+                               : gap;
+    }
+    calendar->lastPopTime = entry->time;
+
+    Event* event = entry->event;
+    calendar->nodes[node].next = calendar->freeNodes;
+    calendar->freeNodes = node;
+    calendar->nextNode = EVENTQUEUE_NONE;
+    queue->length--;
+
+    if (calendar->nBuckets > EVENTQUEUE_MIN_BUCKETS && queue->length < calendar->nBuckets / 2) {
+        _eventqueue_resize(queue, calendar->nBuckets / 2);
+    } else if (++calendar->nPopsSinceResize >= calendar->nBuckets &&
+               _eventqueue_isMissized(calendar)) {
+        /* the number of events hasn't changed much, but their spacing has. checking only
+         * once per nBuckets pops keeps the cost of resizing constant per pop. */
+        _eventqueue_resize(queue, calendar->nBuckets);
+    }
+
+    return event;
+}
+
+void eventqueue_push(EventQueue* queue, Event* event) {
+    MAGIC_ASSERT(queue);
+    utility_assert(event);
+
+    if (queue->isCalendar) {
+        EventQueueEntry entry = {
+            .time = event_getTime(event),
+            .srcHostEventID = event_getSrcHostEventID(event),
+            .dstHostID = event_getDstHostID(event),
+            .srcHostID = event_getSrcHostID(event),
+            .event = event,
+        };
+        _eventqueue_pushCalendar(queue, &entry);
+        return;
+    }
+
+    if (queue->length >= queue->capacity) {
+        queue->capacity *= 2;
+        queue->heap = g_renew(EventQueueEntry, queue->heap, queue->capacity);
+    }
+
+    EventQueueEntry entry = {
+        .time = event_getTime(event),
+        .srcHostEventID = event_getSrcHostEventID(event),
+        .dstHostID = event_getDstHostID(event),
+        .srcHostID = event_getSrcHostID(event),
+        .event = event,
+    };
+
+    /* move parents down until we find the slot for the new entry */
+    gsize index = queue->length++;
+    while (index > 0) {
+        gsize parent = (index - 1) / EVENTQUEUE_ARITY;
+        if (!_eventqueue_isBefore(&entry, &queue->heap[parent])) {
+            break;
+        }
+        queue->heap[index] = queue->heap[parent];
+        index = parent;
+    }
+    queue->heap[index] = entry;
+}
+
+Event* eventqueue_peek(EventQueue* queue) {
+    MAGIC_ASSERT(queue);
+    if (queue->isCalendar) {
+        guint node = _eventqueue_findCalendar(queue);
+        return (node != EVENTQUEUE_NONE) ? queue->calendar.nodes[node].entry.event : NULL;
+    }
+    return queue->length > 0 ? queue->heap[0].event : NULL;
+}
+
+Event* eventqueue_pop(EventQueue* queue) {
+    MAGIC_ASSERT(queue);
+
+    if (queue->isCalendar) {
+        return _eventqueue_popCalendar(queue);
+    }
+
+    if (queue->length == 0) {
+        return NULL;
+    }
+
+    Event* event = queue->heap[0].event;
+    EventQueueEntry last = queue->heap[--queue->length];
+
+    /* move the smallest children up until we find the slot for the last entry */
+    gsize index = 0;
+    while (TRUE) {
+        gsize firstChild = index * EVENTQUEUE_ARITY + 1;
+        if (firstChild >= queue->length) {
+            break;
+        }
+
+        gsize endChild = MIN(firstChild + EVENTQUEUE_ARITY, queue->length);
+        gsize minChild = firstChild;
+        for (gsize child = firstChild + 1; child < endChild; child++) {
+            if (_eventqueue_isBefore(&queue->heap[child], &queue->heap[minChild])) {
+                minChild = child;
+            }
+        }
+
+        if (!_eventqueue_isBefore(&queue->heap[minChild], &last)) {
+            break;
+        }
+        queue->heap[index] = queue->heap[minChild];
+        index = minChild;
+    }
+    if (queue->length > 0) {
+        queue->heap[index] = last;
+    }
+
+    /* give back memory after a burst of events */
+    if (queue->capacity > EVENTQUEUE_INITIAL_SIZE && queue->length * 4 < queue->capacity) {
+        queue->capacity /= 2;
+        queue->heap = g_renew(EventQueueEntry, queue->heap, queue->capacity);
+    }
+
+    return event;
+}
@@ -0,0 +1,34 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_EVENT_QUEUE_H_
+#define SHD_EVENT_QUEUE_H_
+
+#include <glib.h>
+
+#include "main/core/work/event.h"
+
+/* A priority queue of events, ordered in the same way as event_compare. The sort keys
+ * are copied into the queue when an event is pushed, so the queue never dereferences
+ * the events that it holds while reordering them, and an event's time must not be
+ * changed while it is queued. The queue owns a reference to each event that it holds.
+ * Unlike PriorityQueue, an event must not be pushed again while it is still queued. */
+typedef struct _EventQueue EventQueue;
+
+EventQueue* eventqueue_new(void);
+void eventqueue_free(EventQueue* queue);
+
+gsize eventqueue_getLength(EventQueue* queue);
+gboolean eventqueue_isEmpty(EventQueue* queue);
+
+/* takes ownership of the caller's reference to the event */
+void eventqueue_push(EventQueue* queue, Event* event);
+/* returns the next event without removing it, or NULL if the queue is empty */
+Event* eventqueue_peek(EventQueue* queue);
+/* removes the next event and returns its reference to the caller, or NULL if the queue
+ * is empty */
+Event* eventqueue_pop(EventQueue* queue);
+
+#endif /* SHD_EVENT_QUEUE_H_ */
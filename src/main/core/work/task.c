@@ -7,6 +7,7 @@
 
 #include "main/core/support/definitions.h"
 #include "main/core/worker.h"
+#include "main/utility/object_pool.h"
 #include "main/utility/utility.h"
 
 struct _Task {
@@ -19,12 +20,14 @@ struct _Task {
     MAGIC_DECLARE;
 };
 
+static ObjectPool _taskPool = OBJECTPOOL_INIT(Task);
+
 
 Task* task_new(TaskCallbackFunc callback, gpointer callbackObject, gpointer callbackArgument,
         TaskObjectFreeFunc objectFree, TaskArgumentFreeFunc argumentFree) {
     utility_assert(callback != NULL);
 
-    Task* task = g_new0(Task, 1);
+    Task* task = objectpool_alloc0(&_taskPool);
 
     task->execute = callback;
     task->callbackObject = callbackObject;
@@ -47,7 +50,7 @@ static void _task_free(Task* task) {
         task->argumentFree(task->callbackArgument);
     }
     MAGIC_CLEAR(task);
-    g_free(task);
+    objectpool_free(&_taskPool, task);
     worker_count_deallocation(Task);
 }
 
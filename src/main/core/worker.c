@@ -22,11 +22,13 @@
 #include "main/bindings/c/bindings.h"
 #include "main/core/manager.h"
 #include "main/core/scheduler/scheduler.h"
+#include "main/core/scheduler/scheduler_policy.h"
 #include "main/core/support/config_handlers.h"
 #include "main/core/support/definitions.h"
 #include "main/core/work/event.h"
 #include "main/core/work/task.h"
 #include "main/host/affinity.h"
+#include "main/host/descriptor/descriptor.h"
 #include "main/host/host.h"
 #include "main/host/process.h"
 #include "main/routing/address.h"
@@ -36,17 +38,45 @@
 #include "main/routing/topology.h"
 #include "main/utility/count_down_latch.h"
 #include "main/utility/random.h"
+#include "main/utility/tracepoint.h"
 #include "main/utility/utility.h"
 
 // Allow turning off object counting at run-time.
 static bool _use_object_counters = true;
 ADD_CONFIG_HANDLER(config_getUseObjectCounters, _use_object_counters)
 
+static bool _use_fast_exit = false;
+ADD_CONFIG_HANDLER(config_getUseFastExit, _use_fast_exit)
+
+static bool _receiveBatching = false;
+ADD_CONFIG_HANDLER(config_getInterfaceReceiveBatching, _receiveBatching)
+
+__thread WorkerContext _workerContext = {
+    .pool = NULL,
+    .activeHost = NULL,
+    .now = SIMTIME_INVALID,
+    .roundEndTime = SIMTIME_INVALID,
+    .bootstrapEndTime = SIMTIME_INVALID,
+};
+
 static void* _worker_run(void* voidWorker);
+static void _worker_killHostProcesses(Host* host, void* _unused);
 static void _worker_freeHostProcesses(Host* host, void* _unused);
 static void _worker_shutdownHost(Host* host, void* _unused);
+static void _worker_flushHost(Host* host, void* _unused);
 static void _workerpool_setLogicalProcessorIdx(WorkerPool* workerpool, int workerID, int cpuId);
 
+// One worker's gauges, padded to a cache line so that workers don't slow each other down
+// when updating their own gauges.
+typedef struct _WorkerGauges WorkerGauges;
+struct _WorkerGauges {
+    gint64 values[8];
+};
+G_STATIC_ASSERT(WORKER_GAUGE_COUNT <= G_N_ELEMENTS(((WorkerGauges*)NULL)->values));
+
+// Gauge updates from threads that aren't workers, such as while the manager sets up hosts.
+static gint64 _globalGauges[WORKER_GAUGE_COUNT] = {0};
+
 struct _WorkerPool {
     /* Unowned pointer to the object that communicates with the controller
      * process */
@@ -118,6 +148,23 @@ struct _WorkerPool {
     // without using any locks. Computing the global minimum then only requires
     // a linear scan of O(num_lps) instead of O(num_workers).
     SimulationTime* minEventTimes;
+    // Also of size lps_n(logicalProcessors): the host of each lp's min event
+    // time, or NULL if it's unknown, and the min event time of all other hosts.
+    Host** minEventHosts;
+    SimulationTime* otherMinEventTimes;
+    // Also of size lps_n(logicalProcessors): the earliest time that a packet sent by
+    // one of the hosts with events on the lp could reach another host.
+    SimulationTime* minSendTimes;
+
+    // Array of size nWorkers: the earliest heartbeat of the hosts that each worker
+    // activated or last collected the heartbeats of. The hosts' trackers have no
+    // events of their own; see worker_heartbeatHosts.
+    SimulationTime* nextHeartbeatTimes;
+
+    // Array of size nWorkers. Each worker only writes to its own entry, using
+    // relaxed atomic loads and stores so that the manager can read them while
+    // the workers run.
+    WorkerGauges* gauges;
 
     MAGIC_DECLARE;
 };
@@ -147,15 +194,26 @@ WorkerPool* workerpool_new(Manager* manager, Scheduler* scheduler, int nWorkers,
         .joined = FALSE,
         .logicalProcessors = lps_new(nLogicalProcessors),
         .minEventTimes = g_new(SimulationTime, nLogicalProcessors),
+        .minEventHosts = g_new0(Host*, nLogicalProcessors),
+        .otherMinEventTimes = g_new(SimulationTime, nLogicalProcessors),
+        .minSendTimes = g_new(SimulationTime, nLogicalProcessors),
         .workerBeginSems = g_new0(sem_t, nWorkers),
         .workerThreads = g_new0(pthread_t, nWorkers),
         .workerLogicalProcessorIdxs = g_new0(int, nWorkers),
         .workerNativeThreadIDs = g_new0(pid_t, nWorkers),
+        .gauges = g_new0(WorkerGauges, nWorkers),
+        .nextHeartbeatTimes = g_new(SimulationTime, nWorkers),
     };
     MAGIC_INIT(pool);
 
+    for (int i = 0; i < nWorkers; ++i) {
+        pool->nextHeartbeatTimes[i] = SIMTIME_MAX;
+    }
+
     for (int i = 0; i < nLogicalProcessors; ++i) {
         pool->minEventTimes[i] = SIMTIME_MAX;
+        pool->otherMinEventTimes[i] = SIMTIME_MAX;
+        pool->minSendTimes[i] = SIMTIME_MAX;
     }
 
     for (int threadID = 0; threadID < nWorkers; ++threadID) {
@@ -277,6 +335,11 @@ void workerpool_free(WorkerPool* pool) {
 
     g_clear_pointer(&pool->logicalProcessors, lps_free);
     g_clear_pointer(&pool->minEventTimes, g_free);
+    g_clear_pointer(&pool->minEventHosts, g_free);
+    g_clear_pointer(&pool->otherMinEventTimes, g_free);
+    g_clear_pointer(&pool->minSendTimes, g_free);
+    g_clear_pointer(&pool->gauges, g_free);
+    g_clear_pointer(&pool->nextHeartbeatTimes, g_free);
 
     MAGIC_CLEAR(pool);
 }
@@ -313,6 +376,13 @@ int workerpool_getNWorkers(WorkerPool* pool) {
     return pool->nWorkers;
 }
 
+int workerpool_getNode(WorkerPool* pool, int threadId) {
+    MAGIC_ASSERT(pool);
+    utility_assert(threadId < pool->nWorkers);
+    int lpi = pool->workerLogicalProcessorIdxs[threadId];
+    return affinity_getCPUNode(lps_cpuId(pool->logicalProcessors, lpi));
+}
+
 static void _workerpool_setLogicalProcessorIdx(WorkerPool* workerPool, int workerID,
                                                int logicalProcessorIdx) {
     MAGIC_ASSERT(workerPool);
@@ -329,25 +399,79 @@ static void _workerpool_setLogicalProcessorIdx(WorkerPool* workerPool, int worke
     affinity_setProcessAffinity(workerPool->workerNativeThreadIDs[workerID], newCpuId, oldCpuId);
 }
 
-SimulationTime workerpool_getGlobalNextEventTime(WorkerPool* workerPool) {
+SimulationTime workerpool_getGlobalNextEventTime(WorkerPool* workerPool, Host** minHost,
+                                                SimulationTime* otherMinTime) {
     MAGIC_ASSERT(workerPool);
 
     // Compute the min time for next round, and reset for the following round.
     // This is called by a single thread in-between rounds while the workers
     // are idle, so let's not do anything too expensive here.
     SimulationTime minTime = SIMTIME_MAX;
+    *minHost = NULL;
+    *otherMinTime = SIMTIME_MAX;
 
     for (int i = 0; i < lps_n(workerPool->logicalProcessors); ++i) {
-        if (workerPool->minEventTimes[i] < minTime) {
-            minTime = workerPool->minEventTimes[i];
-        }
+        schedulerpolicy_addNextTime(&minTime, minHost, otherMinTime,
+                                    workerPool->minEventHosts[i], workerPool->minEventTimes[i]);
+        *otherMinTime = MIN(*otherMinTime, workerPool->otherMinEventTimes[i]);
         workerPool->minEventTimes[i] = SIMTIME_MAX;
+        workerPool->minEventHosts[i] = NULL;
+        workerPool->otherMinEventTimes[i] = SIMTIME_MAX;
+    }
+
+    return minTime;
+}
+
+SimulationTime workerpool_getGlobalNextSendTime(WorkerPool* workerPool) {
+    MAGIC_ASSERT(workerPool);
+
+    SimulationTime minTime = SIMTIME_MAX;
+    for (int i = 0; i < lps_n(workerPool->logicalProcessors); ++i) {
+        minTime = MIN(minTime, workerPool->minSendTimes[i]);
+        workerPool->minSendTimes[i] = SIMTIME_MAX;
     }
+    return minTime;
+}
+
+SimulationTime workerpool_getNextHeartbeatTime(WorkerPool* workerPool) {
+    MAGIC_ASSERT(workerPool);
 
+    SimulationTime minTime = SIMTIME_MAX;
+    for (int i = 0; i < workerPool->nWorkers; ++i) {
+        minTime = MIN(minTime, workerPool->nextHeartbeatTimes[i]);
+    }
     return minTime;
 }
 
+gint64 workerpool_getGauge(WorkerPool* workerPool, WorkerGauge gauge) {
+    MAGIC_ASSERT(workerPool);
+    utility_assert(gauge < WORKER_GAUGE_COUNT);
+
+    gint64 value = __atomic_load_n(&_globalGauges[gauge], __ATOMIC_RELAXED);
+    for (int i = 0; i < workerPool->nWorkers; ++i) {
+        value += __atomic_load_n(&workerPool->gauges[i].values[gauge], __ATOMIC_RELAXED);
+    }
+    return value;
+}
+
+void worker_addGauge(WorkerGauge gauge, gint64 delta) {
+    utility_assert(gauge < WORKER_GAUGE_COUNT);
+
+    if (!worker_isAlive()) {
+        __atomic_fetch_add(&_globalGauges[gauge], delta, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // No need for a read-modify-write: only this worker writes to its entry.
+    gint64* value = &_worker_pool()->gauges[worker_threadID()].values[gauge];
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + delta, __ATOMIC_RELAXED);
+}
+
 void worker_setMinEventTimeNextRound(SimulationTime simtime) {
+    worker_setMinEventTimeNextRoundForHost(NULL, simtime);
+}
+
+void worker_setMinEventTimeNextRoundForHost(Host* host, SimulationTime simtime) {
     // If the event will be executed during *this* round, it should not
     // be considered while computing the start time of the *next* round.
     if (simtime < _worker_getRoundEndTime()) {
@@ -357,9 +481,22 @@ void worker_setMinEventTimeNextRound(SimulationTime simtime) {
     // No need to lock: worker is the only one running on lpi right now.
     WorkerPool* pool = _worker_pool();
     int lpi = pool->workerLogicalProcessorIdxs[worker_threadID()];
-    if (simtime < pool->minEventTimes[lpi]) {
-        pool->minEventTimes[lpi] = simtime;
-    }
+    schedulerpolicy_addNextTime(&pool->minEventTimes[lpi], &pool->minEventHosts[lpi],
+                                &pool->otherMinEventTimes[lpi], host, simtime);
+}
+
+void worker_setMinSendTimeNextRound(SimulationTime simtime) {
+    // No need to lock: worker is the only one running on lpi right now.
+    WorkerPool* pool = _worker_pool();
+    int lpi = pool->workerLogicalProcessorIdxs[worker_threadID()];
+    pool->minSendTimes[lpi] = MIN(pool->minSendTimes[lpi], simtime);
+}
+
+void worker_updateNextHeartbeatTime(SimulationTime simtime) {
+    // No need to lock: only this worker writes its entry, and only the scheduler
+    // reads it, between rounds.
+    SimulationTime* nextTime = &_worker_pool()->nextHeartbeatTimes[worker_threadID()];
+    *nextTime = MIN(*nextTime, simtime);
 }
 
 int worker_getAffinity() {
@@ -369,6 +506,8 @@ int worker_getAffinity() {
 
 DNS* worker_getDNS() { return manager_getDNS(_worker_pool()->manager); }
 
+FileCache* worker_getFileCache() { return manager_getFileCache(_worker_pool()->manager); }
+
 Address* worker_resolveIPToAddress(in_addr_t ip) {
     DNS* dns = worker_getDNS();
     return dns_resolveIPToAddress(dns, ip);
@@ -471,13 +610,26 @@ void worker_runEvent(Event* event) {
     worker_setCurrentTime(SIMTIME_INVALID);
 }
 
+void worker_killHostProcesses(GQueue* hosts) {
+    if (hosts) {
+        g_queue_foreach(hosts, (GFunc)_worker_killHostProcesses, NULL);
+    }
+}
+
 void worker_finish(GQueue* hosts) {
     if (hosts) {
         guint nHosts = g_queue_get_length(hosts);
         info("starting to shut down %u hosts", nHosts);
         g_queue_foreach(hosts, (GFunc)_worker_freeHostProcesses, NULL);
-        g_queue_foreach(hosts, (GFunc)_worker_shutdownHost, NULL);
-        info("%u hosts are shut down", nHosts);
+
+        /* the object counters need every object to be freed to find leaks */
+        if (_use_fast_exit && !_use_object_counters) {
+            g_queue_foreach(hosts, (GFunc)_worker_flushHost, NULL);
+            info("%u hosts are shut down, leaving their memory to be released at exit", nHosts);
+        } else {
+            g_queue_foreach(hosts, (GFunc)_worker_shutdownHost, NULL);
+            info("%u hosts are shut down", nHosts);
+        }
     }
 
     /* cleanup is all done, send counters to manager */
@@ -489,6 +641,21 @@ void worker_finish(GQueue* hosts) {
 
     // Send syscall counts to manager
     manager_add_syscall_counts(pool->manager, _worker_syscallCounter());
+
+    // Send profiled times to manager
+    manager_add_profile_counts(pool->manager, _worker_profileCounter());
+}
+
+gboolean worker_scheduleEvent(Event* event, Host* host) {
+    utility_assert(event);
+    utility_assert(host);
+
+    if (!manager_schedulerIsRunning(_worker_pool()->manager)) {
+        event_unref(event);
+        return FALSE;
+    }
+
+    return scheduler_push(_worker_pool()->scheduler, event, host, host);
 }
 
 gboolean worker_scheduleTask(Task* task, Host* host, SimulationTime nanoDelay) {
@@ -506,12 +673,168 @@ gboolean worker_scheduleTask(Task* task, Host* host, SimulationTime nanoDelay) {
     return scheduler_push(_worker_pool()->scheduler, event, host, host);
 }
 
-static void _worker_runDeliverPacketTask(Host* host, gpointer voidPacket, gpointer userData) {
-    Packet* packet = voidPacket;
-    in_addr_t ip = packet_getDestinationIP(packet);
-    Router* router = host_getUpstreamRouter(host, ip);
-    utility_assert(router != NULL);
-    router_enqueue(router, host, packet);
+gboolean worker_scheduleCallback(TaskCallbackFunc callback, gpointer callbackObject,
+                                 gpointer callbackArgument, TaskObjectFreeFunc objectFree,
+                                 TaskArgumentFreeFunc argumentFree, Host* host,
+                                 SimulationTime nanoDelay) {
+    utility_assert(host);
+
+    if (!manager_schedulerIsRunning(_worker_pool()->manager)) {
+        if (objectFree && callbackObject) {
+            objectFree(callbackObject);
+        }
+        if (argumentFree && callbackArgument) {
+            argumentFree(callbackArgument);
+        }
+        return FALSE;
+    }
+
+    SimulationTime clock_now = worker_getCurrentTime();
+    utility_assert(clock_now != SIMTIME_INVALID);
+
+    Event* event = event_newWithCallback(callback, callbackObject, callbackArgument, objectFree,
+                                         argumentFree, clock_now + nanoDelay, host, host);
+    return worker_scheduleEvent(event, host);
+}
+
+/* Packets that one host sends to another at the same time and with the same delivery
+ * time are delivered by a single event. Events are ordered by time, then destination,
+ * then source, then push order, so the packets in a batch would have been executed
+ * back-to-back anyway, and batching them saves an event, a task, and a scheduler push
+ * for every packet after the first. */
+typedef struct _PacketBatch PacketBatch;
+struct _PacketBatch {
+    GQueue packets;
+};
+/* the batch is held by its event */
+G_STATIC_ASSERT(sizeof(PacketBatch) <= EVENT_INLINE_OBJECT_SIZE);
+
+/* The last batch that was pushed from this thread. Batches are only cached if they will
+ * be delivered in a later round, and are only appended to while their source host is
+ * still at the time they were created, which must be in the current round. So the
+ * destination can't have executed a cached batch yet. Hosts never return to an earlier
+ * time, so a stale entry never matches. */
+typedef struct _PacketBatchCache PacketBatchCache;
+struct _PacketBatchCache {
+    Host* srcHost;
+    Host* dstHost;
+    SimulationTime sendTime;
+    SimulationTime deliverTime;
+    PacketBatch* batch;
+};
+static __thread PacketBatchCache _packetBatchCache = {0};
+
+static void _worker_clearPacketBatch(PacketBatch* batch) {
+    Packet* packet = NULL;
+    while ((packet = g_queue_pop_head(&batch->packets)) != NULL) {
+        packet_unref(packet);
+    }
+}
+
+static void _worker_runDeliverPacketBatchTask(Host* host, gpointer voidBatch, gpointer userData) {
+    PacketBatch* batch = voidBatch;
+    Packet* packet = NULL;
+
+    host_activate(host);
+
+    /* the packets arrive together, so the sockets that they make readable can hear about
+     * it together too */
+    if (_receiveBatching) {
+        descriptor_beginStatusBatch();
+    }
+
+    while ((packet = g_queue_pop_head(&batch->packets)) != NULL) {
+        in_addr_t ip = packet_getDestinationIP(packet);
+        Router* router = host_getUpstreamRouter(host, ip);
+        utility_assert(router != NULL);
+        router_enqueue(router, host, packet);
+        packet_unref(packet);
+    }
+
+    if (_receiveBatching) {
+        descriptor_endStatusBatch();
+    }
+}
+
+/* The paths that this thread sent packets on recently, in a direct-mapped table keyed
+ * by the source and destination addresses. Clients mostly talk to a few servers, so
+ * this saves looking up the endpoints and their path for most packets. Entries are
+ * looked up again once the topology's epoch changes, since scheduled network changes
+ * update the paths. The packet counts are added to the topology when an entry is
+ * replaced, or when the simulation finishes. */
+#define PATH_MEMO_SIZE 256
+typedef struct _PathMemoEntry PathMemoEntry;
+struct _PathMemoEntry {
+    /* network byte order, or 0 if the entry is unused */
+    in_addr_t srcIP;
+    in_addr_t dstIP;
+    SchedulerIPEntry src;
+    SchedulerIPEntry dst;
+    /* the path's latency, and its reliability as a threshold for random_rand, converted
+     * once when the entry is filled rather than for every packet */
+    SimulationTime latency;
+    guint32 reliabilityThreshold;
+    /* the topology epoch when we looked up the path */
+    guint epoch;
+    /* packets sent on the path that we haven't added to the topology yet */
+    guint64 packetCount;
+};
+static __thread PathMemoEntry _pathMemo[PATH_MEMO_SIZE];
+/* we index it with the top 8 bits of a 32-bit hash */
+G_STATIC_ASSERT(PATH_MEMO_SIZE == 1 << 8);
+
+static void _worker_flushPathMemoEntry(PathMemoEntry* entry) {
+    if (entry->packetCount > 0) {
+        topology_addPathPacketCountAt(worker_getTopology(), entry->src.address,
+                                      entry->src.vertexIndex, entry->dst.address,
+                                      entry->dst.vertexIndex, entry->packetCount);
+        entry->packetCount = 0;
+    }
+}
+
+void worker_flushPathPacketCounts(void) {
+    for (gint i = 0; i < PATH_MEMO_SIZE; i++) {
+        _worker_flushPathMemoEntry(&_pathMemo[i]);
+    }
+}
+
+static PathMemoEntry* _worker_getPathMemoEntry(in_addr_t srcIP, in_addr_t dstIP) {
+    guint32 hash = (ntohl(srcIP) * 0x9E3779B1u) ^ ntohl(dstIP);
+    hash ^= hash >> 16;
+    PathMemoEntry* entry = &_pathMemo[(hash * 0x85EBCA6Bu) >> 24];
+
+    guint epoch = topology_getEpoch(worker_getTopology());
+    if (entry->srcIP == srcIP && entry->dstIP == dstIP && entry->epoch == epoch) {
+        return entry;
+    }
+
+    Scheduler* scheduler = _worker_pool()->scheduler;
+    SchedulerIPEntry src, dst;
+    if (!scheduler_lookupIP(scheduler, srcIP, &src) ||
+        !scheduler_lookupIP(scheduler, dstIP, &dst)) {
+        utility_panic("unable to schedule packet because of null addresses");
+        return NULL;
+    }
+
+    gdouble latency = 0, reliability = 0;
+    if (!topology_getPathAt(worker_getTopology(), src.address, src.vertexIndex, dst.address,
+                            dst.vertexIndex, &latency, &reliability)) {
+        utility_panic("unable to find path between node %s and node %s",
+                      address_toString(src.address), address_toString(dst.address));
+        return NULL;
+    }
+
+    _worker_flushPathMemoEntry(entry);
+    *entry = (PathMemoEntry){
+        .srcIP = srcIP,
+        .dstIP = dstIP,
+        .src = src,
+        .dst = dst,
+        .latency = (SimulationTime)ceil(latency * SIMTIME_ONE_MILLISECOND),
+        .reliabilityThreshold = random_getThreshold(reliability),
+        .epoch = epoch,
+    };
+    return entry;
 }
 
 void worker_sendPacket(Host* srcHost, Packet* packet) {
@@ -522,56 +845,91 @@ void worker_sendPacket(Host* srcHost, Packet* packet) {
         return;
     }
 
-    in_addr_t srcIP = packet_getSourceIP(packet);
-    in_addr_t dstIP = packet_getDestinationIP(packet);
+    PathMemoEntry* path =
+        _worker_getPathMemoEntry(packet_getSourceIP(packet), packet_getDestinationIP(packet));
 
-    Address* srcAddress = worker_resolveIPToAddress(srcIP);
-    Address* dstAddress = worker_resolveIPToAddress(dstIP);
-
-    if (!srcAddress || !dstAddress) {
-        utility_panic("unable to schedule packet because of null addresses");
-        return;
-    }
+    TRACEPOINT(worker_send_packet, host_getID(srcHost), packet_getSourceIP(packet),
+               packet_getDestinationIP(packet), packet_getTotalSize(packet));
 
     gboolean bootstrapping = worker_isBootstrapActive();
 
-    /* check if network reliability forces us to 'drop' the packet */
-    gdouble reliability = topology_getReliability(worker_getTopology(), srcAddress, dstAddress);
+    /* check if network reliability forces us to 'drop' the packet. the segments of
+     * a super-packet are dropped independently, as if each was sent on its own. */
     Random* random = host_getRandom(srcHost);
-    gdouble chance = random_nextDouble(random);
-
-    /* don't drop control packets with length 0, otherwise congestion
-     * control has problems responding to packet loss */
-    if (bootstrapping || chance <= reliability || packet_getPayloadLength(packet) == 0) {
-        /* the sender's packet will make it through, find latency */
-        gdouble latency = topology_getLatency(worker_getTopology(), srcAddress, dstAddress);
-        SimulationTime delay = (SimulationTime)ceil(latency * SIMTIME_ONE_MILLISECOND);
-        SimulationTime deliverTime = worker_getCurrentTime() + delay;
 
-        topology_incrementPathPacketCounter(worker_getTopology(), srcAddress, dstAddress);
+    /* the packetCopy starts with 1 ref, which will be held by the packet batch
+     * and unreffed after the packet is delivered. */
+    Packet* packetCopy = NULL;
+    guint nSegments = packet_getNumSegments(packet);
+
+    for (guint i = 0; i < nSegments; i++) {
+        Packet* segment = packet_getSegment(packet, i);
+        guint32 chance = (guint32)random_rand(random);
+
+        /* don't drop control packets with length 0, otherwise congestion
+         * control has problems responding to packet loss */
+        if (bootstrapping || chance <= path->reliabilityThreshold ||
+            packet_getPayloadLength(segment) == 0) {
+            path->packetCount++;
+            packet_addDeliveryStatus(segment, PDS_INET_SENT);
+
+            Packet* segmentCopy = packet_copy(segment);
+            if (!packetCopy) {
+                packetCopy = segmentCopy;
+            } else {
+                packet_appendSegment(packetCopy, segmentCopy);
+                packet_unref(segmentCopy);
+            }
+        } else {
+            packet_addDeliveryStatus(segment, PDS_INET_DROPPED);
+        }
+    }
 
-        /* TODO this should change for sending to remote manager (on a different machine)
-         * this is the only place where tasks are sent between separate hosts */
+    if (!packetCopy) {
+        return;
+    }
 
-        Scheduler* scheduler = _worker_pool()->scheduler;
-        GQuark dstID = (GQuark)address_getID(dstAddress);
-        Host* dstHost = scheduler_getHost(scheduler, dstID);
-        utility_assert(dstHost);
+    /* the sender's packet will make it through */
+    SimulationTime deliverTime = worker_getCurrentTime() + path->latency;
 
-        packet_addDeliveryStatus(packet, PDS_INET_SENT);
+    /* TODO this should change for sending to remote manager (on a different machine)
+     * this is the only place where tasks are sent between separate hosts */
 
-        /* the packetCopy starts with 1 ref, which will be held by the packet task
-         * and unreffed after the task is finished executing. */
-        Packet* packetCopy = packet_copy(packet);
+    Scheduler* scheduler = _worker_pool()->scheduler;
+    Host* dstHost = path->dst.host;
+    utility_assert(dstHost);
 
-        Task* packetTask = task_new(
-            _worker_runDeliverPacketTask, packetCopy, NULL, (TaskObjectFreeFunc)packet_unref, NULL);
-        Event* packetEvent = event_new_(packetTask, deliverTime, srcHost, dstHost);
-        task_unref(packetTask);
+    PacketBatchCache* cache = &_packetBatchCache;
+    SimulationTime now = worker_getCurrentTime();
+    if (cache->batch && cache->srcHost == srcHost && cache->dstHost == dstHost &&
+        cache->sendTime == now && cache->deliverTime == deliverTime) {
+        g_queue_push_tail(&cache->batch->packets, packetCopy);
+        return;
+    }
 
-        scheduler_push(scheduler, packetEvent, srcHost, dstHost);
+    Event* packetEvent =
+        event_newWithInlineObject(_worker_runDeliverPacketBatchTask,
+                                  (TaskObjectFreeFunc)_worker_clearPacketBatch, deliverTime,
+                                  srcHost, dstHost);
+    PacketBatch* batch = event_getInlineObject(packetEvent);
+    g_queue_init(&batch->packets);
+    g_queue_push_tail(&batch->packets, packetCopy);
+
+    /* the event and batch may be freed as soon as they are pushed, unless they
+     * can't run until the next round */
+    gboolean canCache = srcHost != dstHost &&
+                        deliverTime >= scheduler_getHostRoundEndTime(scheduler, dstHost);
+
+    if (scheduler_push(scheduler, packetEvent, srcHost, dstHost) && canCache) {
+        *cache = (PacketBatchCache){
+            .srcHost = srcHost,
+            .dstHost = dstHost,
+            .sendTime = now,
+            .deliverTime = deliverTime,
+            .batch = batch,
+        };
     } else {
-        packet_addDeliveryStatus(packet, PDS_INET_DROPPED);
+        cache->batch = NULL;
     }
 }
 
@@ -587,6 +945,29 @@ static void _worker_bootHost(Host* host, void* _unused) {
 
 void worker_bootHosts(GQueue* hosts) { g_queue_foreach(hosts, (GFunc)_worker_bootHost, NULL); }
 
+void worker_heartbeatHosts(GQueue* hosts, SimulationTime time) {
+    // Every worker collects the heartbeats of all of its hosts, so this replaces the
+    // times that the worker learned of while running other workers' hosts.
+    SimulationTime nextTime = SIMTIME_MAX;
+
+    if (hosts) {
+        for (GList* link = hosts->head; link; link = link->next) {
+            Host* host = link->data;
+            worker_setActiveHost(host);
+            nextTime = MIN(nextTime, host_heartbeatIfDue(host, time));
+            worker_setActiveHost(NULL);
+        }
+    }
+
+    _worker_pool()->nextHeartbeatTimes[worker_threadID()] = nextTime;
+}
+
+static void _worker_killHostProcesses(Host* host, void* _unused) {
+    worker_setActiveHost(host);
+    host_killAllApplications(host);
+    worker_setActiveHost(NULL);
+}
+
 static void _worker_freeHostProcesses(Host* host, void* _unused) {
     worker_setActiveHost(host);
     host_continueExecutionTimer(host);
@@ -602,9 +983,17 @@ static void _worker_shutdownHost(Host* host, void* _unused) {
     host_unref(host);
 }
 
+static void _worker_flushHost(Host* host, void* _unused) {
+    worker_setActiveHost(host);
+    host_flush(host);
+    worker_setActiveHost(NULL);
+}
+
 /* The emulated time starts at January 1st, 2000. This time should be used
  * in any places where time is returned to the application, to handle code
  * that assumes the world is in a relatively recent time. */
+WorkerContext* worker_getContext() { return &_workerContext; }
+
 EmulatedTime worker_getEmulatedTime() {
     return (EmulatedTime)(worker_getCurrentTime() + EMULATED_TIME_OFFSET);
 }
@@ -629,28 +1018,38 @@ gboolean worker_isFiltered(LogLevel level) { return !logger_isEnabled(logger_get
 
 void worker_incrementPluginError() { manager_incrementPluginError(_worker_pool()->manager); }
 
-void __worker_increment_object_alloc_counter(const char* object_name) {
+static guint32 _worker_getObjectTypeID(guint32* cachedTypeID, const char* object_name) {
+    // The cache holds the id plus one, so that 0 means the type isn't registered yet.
+    guint32 cached = __atomic_load_n(cachedTypeID, __ATOMIC_RELAXED);
+    if (cached == 0) {
+        cached = worker_registerObjectType(object_name) + 1;
+        __atomic_store_n(cachedTypeID, cached, __ATOMIC_RELAXED);
+    }
+    return cached - 1;
+}
+
+void __worker_increment_object_alloc_counter(guint32* cachedTypeID, const char* object_name) {
     // If disabled, we never create the counter (and never send it to the manager).
     if (!_use_object_counters) {
         return;
     }
-    Counter* counter = _worker_objectAllocCounter();
+    IndexedCounter* counter = _worker_objectAllocCounts();
     if (counter) {
-        counter_add_value(counter, object_name, 1);
+        indexedcounter_add_value(counter, _worker_getObjectTypeID(cachedTypeID, object_name), 1);
     } else {
         // No live worker; fall back to the shared manager counter.
         manager_increment_object_alloc_counter_global(object_name);
     }
 }
 
-void __worker_increment_object_dealloc_counter(const char* object_name) {
+void __worker_increment_object_dealloc_counter(guint32* cachedTypeID, const char* object_name) {
     // If disabled, we never create the counter (and never send it to the manager).
     if (!_use_object_counters) {
         return;
     }
-    Counter* counter = _worker_objectDeallocCounter();
+    IndexedCounter* counter = _worker_objectDeallocCounts();
     if (counter) {
-        counter_add_value(counter, object_name, 1);
+        indexedcounter_add_value(counter, _worker_getObjectTypeID(cachedTypeID, object_name), 1);
     } else {
         // No live worker; fall back to the shared manager counter.
         manager_increment_object_dealloc_counter_global(object_name);
@@ -665,4 +1064,17 @@ void worker_add_syscall_counts(Counter* syscall_counts) {
         // No live worker; fall back to the shared manager counter.
         manager_add_syscall_counts_global(syscall_counts);
     }
+}
+
+void worker_add_profile_counts(Counter* profile_counts, const char* prefix) {
+    Counter* counter = _worker_profileCounter();
+    if (counter) {
+        counter_add_counter_with_prefix(counter, profile_counts, prefix);
+    } else {
+        // No live worker; fall back to the shared manager counter.
+        Counter* prefixed = counter_new();
+        counter_add_counter_with_prefix(prefixed, profile_counts, prefix);
+        manager_add_profile_counts_global(prefixed);
+        counter_free(prefixed);
+    }
 }
\ No newline at end of file
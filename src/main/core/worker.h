@@ -16,6 +16,15 @@ typedef struct _WorkerPool WorkerPool;
 // Task to be executed on a worker thread.
 typedef void (*WorkerPoolTaskFn)(void*);
 
+// Kinds of objects whose live counts are reported in the manager's heartbeat.
+typedef enum _WorkerGauge {
+    WORKER_GAUGE_EVENTS,
+    WORKER_GAUGE_PACKETS,
+    WORKER_GAUGE_PAYLOADS,
+    WORKER_GAUGE_PAYLOAD_BYTES,
+    WORKER_GAUGE_COUNT,
+} WorkerGauge;
+
 #include "lib/logger/log_level.h"
 #include "main/core/manager.h"
 #include "main/core/scheduler/scheduler.h"
@@ -32,10 +41,48 @@ typedef void (*WorkerPoolTaskFn)(void*);
 
 #include "main/bindings/c/bindings.h"
 
+// The parts of the thread's Worker state that are read on hot paths, kept in a plain C
+// thread-local so that reading them is a single load instead of a call into Rust. The
+// Rust Worker owns the state and writes it through the pointer from worker_getContext().
+typedef struct _WorkerContext WorkerContext;
+struct _WorkerContext {
+    // NULL if there is no live Worker on this thread.
+    WorkerPool* pool;
+    // NULL if no host is active.
+    Host* activeHost;
+    // SIMTIME_INVALID if no event is executing.
+    SimulationTime now;
+    SimulationTime roundEndTime;
+    SimulationTime bootstrapEndTime;
+};
+
+extern __thread WorkerContext _workerContext;
+
+// Returns this thread's context, for Rust, which can't access C thread-locals directly.
+WorkerContext* worker_getContext(void);
+
+static inline SimulationTime worker_getCurrentTime() { return _workerContext.now; }
+
+static inline SimulationTime _worker_getRoundEndTime() { return _workerContext.roundEndTime; }
+
+static inline bool worker_isBootstrapActive() {
+    return _workerContext.now < _workerContext.bootstrapEndTime;
+}
+
+static inline Host* worker_getActiveHost() { return _workerContext.activeHost; }
+
+static inline WorkerPool* _worker_pool() { return _workerContext.pool; }
+
 // To be called by scheduler. Consumes `event`
 void worker_runEvent(Event* event);
+// To be called by worker thread, on every worker before any of them calls
+// worker_finish(), so that all of the plugin processes die at the same time.
+void worker_killHostProcesses(GQueue* hosts);
 // To be called by worker thread
 void worker_finish(GQueue* hosts);
+// To be called by worker thread. Adds the path packet counts that this thread has
+// only counted locally so far to the topology.
+void worker_flushPathPacketCounts(void);
 
 // Create a workerpool with `nThreads` threads, allowing up to `nConcurrent` to
 // run at a time.
@@ -52,36 +99,79 @@ int workerpool_getNWorkers(WorkerPool* pool);
 void workerpool_joinAll(WorkerPool* pool);
 void workerpool_free(WorkerPool* pool);
 pthread_t workerpool_getThread(WorkerPool* pool, int threadId);
+// Returns the NUMA node of the logical processor that the thread last ran on,
+// or AFFINITY_UNINIT if CPU pinning is disabled.
+int workerpool_getNode(WorkerPool* pool, int threadId);
 
 // Compute the global min event time across all workers. We dynamically compute
 // the minimum time that we'll need for the next event round as the minimum of
 // i.) all events pushed by all workers during this round, and
 // ii.) the next queued event for all worker at the point when they stop
 // executing events.
+// Also returns the host of that event, or NULL if it's unknown, and the min
+// event time of all other hosts.
 //
 // This func is not thread safe, so only call from the scheduler thread when the
 // workers are idle.
-SimulationTime workerpool_getGlobalNextEventTime(WorkerPool* workerPool);
+SimulationTime workerpool_getGlobalNextEventTime(WorkerPool* workerPool, Host** minHost,
+                                                SimulationTime* otherMinTime);
+
+// Returns the earliest time that a packet sent during the next round could reach
+// another host, as reported with worker_setMinSendTimeNextRound, and resets it. Not
+// thread safe, like workerpool_getGlobalNextEventTime.
+SimulationTime workerpool_getGlobalNextSendTime(WorkerPool* workerPool);
+
+// Returns the time of the earliest host heartbeat that the workers know of, or
+// SIMTIME_MAX if there's none. Not thread safe, like
+// workerpool_getGlobalNextEventTime.
+SimulationTime workerpool_getNextHeartbeatTime(WorkerPool* workerPool);
+
+// Returns the sum of the gauge over all workers. Can be called from the scheduler thread
+// while the workers are running, in which case the value may be slightly out of date.
+gint64 workerpool_getGauge(WorkerPool* workerPool, WorkerGauge gauge);
+
+// Adds `delta`, which may be negative, to the gauge. Objects may be freed by a different
+// worker than the one that created them, so only the sum over all workers is meaningful.
+void worker_addGauge(WorkerGauge gauge, gint64 delta);
 
 // The worker either pushed an event or finished executing its events and is
 // reporting the min time of events in their event queue.
 void worker_setMinEventTimeNextRound(SimulationTime simtime);
 
+// Like worker_setMinEventTimeNextRound, for an event at host.
+void worker_setMinEventTimeNextRoundForHost(Host* host, SimulationTime simtime);
+
+// A packet sent by one of the worker's hosts, or by the receiver of an event that it
+// pushed, could reach another host as early as the time.
+void worker_setMinSendTimeNextRound(SimulationTime simtime);
+
+// A host's next heartbeat is due at the time, so a round should start then.
+void worker_updateNextHeartbeatTime(SimulationTime simtime);
+
 // When a new scheduling round starts, set the end time of the new round.
 void worker_setRoundEndTime(SimulationTime newRoundEndTime);
 
 int worker_getAffinity();
 DNS* worker_getDNS();
+FileCache* worker_getFileCache();
 Topology* worker_getTopology();
 const ConfigOptions* worker_getConfig();
 gboolean worker_scheduleTask(Task* task, Host* host, SimulationTime nanoDelay);
+// Like worker_scheduleTask, but without a separate task: the event calls callback itself,
+// and the free functions are called when it is freed, or right away if it can't be
+// scheduled. Use this unless the task is shared.
+gboolean worker_scheduleCallback(TaskCallbackFunc callback, gpointer callbackObject,
+                                 gpointer callbackArgument, TaskObjectFreeFunc objectFree,
+                                 TaskArgumentFreeFunc argumentFree, Host* host,
+                                 SimulationTime nanoDelay);
+// Pushes the event for host, which must be both its source and destination. Consumes
+// the caller's reference to the event.
+gboolean worker_scheduleEvent(Event* event, Host* host);
 void worker_sendPacket(Host* src, Packet* packet);
 bool worker_isAlive(void);
 
-SimulationTime worker_getCurrentTime();
 EmulatedTime worker_getEmulatedTime();
 
-bool worker_isBootstrapActive(void);
 guint32 worker_getNodeBandwidthUp(GQuark nodeID, in_addr_t ip);
 guint32 worker_getNodeBandwidthDown(GQuark nodeID, in_addr_t ip);
 
@@ -91,6 +181,9 @@ void worker_setCurrentTime(SimulationTime time);
 gboolean worker_isFiltered(LogLevel level);
 
 void worker_bootHosts(GQueue* hosts);
+// To be called by worker thread between rounds, on every worker. Logs the heartbeats
+// of the hosts that are due at or before the time.
+void worker_heartbeatHosts(GQueue* hosts, SimulationTime time);
 void worker_freeHosts(GQueue* hosts);
 
 void worker_incrementPluginError();
@@ -99,24 +192,38 @@ Address* worker_resolveIPToAddress(in_addr_t ip);
 Address* worker_resolveNameToAddress(const gchar* name);
 
 // Implementation for counting allocated objects. Do not use this function directly.
-// Use worker_count_allocation instead from the call site.
-void __worker_increment_object_alloc_counter(const char* object_name);
+// Use worker_count_allocation instead from the call site. `cachedTypeID` caches the
+// registered id of the object type at the call site, so that we only look up the
+// name once.
+void __worker_increment_object_alloc_counter(guint32* cachedTypeID, const char* object_name);
 
 // Implementation for counting deallocated objects. Do not use this function directly.
 // Use worker_count_deallocation instead from the call site.
-void __worker_increment_object_dealloc_counter(const char* object_name);
+void __worker_increment_object_dealloc_counter(guint32* cachedTypeID, const char* object_name);
 
 // Increment a counter for the allocation of the object with the given name.
 // This should be paired with an increment of the dealloc counter with the
 // same name, otherwise we print a warning that a memory leak was detected.
-#define worker_count_allocation(type) __worker_increment_object_alloc_counter(#type)
+#define worker_count_allocation(type)                                                              \
+    do {                                                                                           \
+        static guint32 _objectTypeID = 0;                                                          \
+        __worker_increment_object_alloc_counter(&_objectTypeID, #type);                            \
+    } while (0)
 
 // Increment a counter for the deallocation of the object with the given name.
 // This should be paired with an increment of the alloc counter with the
 // same name, otherwise we print a warning that a memory leak was detected.
-#define worker_count_deallocation(type) __worker_increment_object_dealloc_counter(#type)
+#define worker_count_deallocation(type)                                                            \
+    do {                                                                                           \
+        static guint32 _objectTypeID = 0;                                                          \
+        __worker_increment_object_dealloc_counter(&_objectTypeID, #type);                          \
+    } while (0)
 
 // Aggregate the given syscall counts in a worker syscall counter.
 void worker_add_syscall_counts(Counter* syscall_counts);
 
+// Aggregate the given profiled times in a worker profile counter, with `prefix`
+// prepended to each key.
+void worker_add_profile_counts(Counter* profile_counts, const char* prefix);
+
 #endif /* SHD_WORKER_H_ */
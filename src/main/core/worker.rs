@@ -1,4 +1,5 @@
 use nix::unistd::Pid;
+use once_cell::sync::Lazy;
 use once_cell::unsync::OnceCell;
 
 use crate::core::support::simulation_time::SimulationTime;
@@ -9,10 +10,10 @@ use crate::host::process::Process;
 use crate::host::process::ProcessId;
 use crate::host::thread::ThreadId;
 use crate::host::thread::{CThread, Thread};
-use crate::utility::counter::Counter;
+use crate::utility::counter::{Counter, IndexedCounter};
 use crate::utility::notnull::*;
 use std::cell::RefCell;
-use std::sync::Arc;
+use std::sync::{Arc, Mutex};
 
 #[derive(Copy, Clone, Debug)]
 pub struct WorkerThreadID(u32);
@@ -29,9 +30,7 @@ struct ThreadInfo {
 }
 
 struct Clock {
-    now: Option<SimulationTime>,
     last: Option<SimulationTime>,
-    barrier: Option<SimulationTime>,
 }
 
 /// Worker context, containing 'global' information for the current thread.
@@ -50,18 +49,30 @@ pub struct Worker {
     active_thread_info: Option<ThreadInfo>,
 
     clock: Clock,
-    bootstrap_end_time: SimulationTime,
 
     // A counter for all syscalls made by processes freed by this worker.
     syscall_counter: Counter,
+    // Profiled time, in nanoseconds, for processes freed by this worker.
+    profile_counter: Counter,
     // A counter for objects allocated by this worker.
     object_alloc_counter: Counter,
     // A counter for objects deallocated by this worker.
     object_dealloc_counter: Counter,
-
-    worker_pool: *mut cshadow::WorkerPool,
+    // Allocations and deallocations by registered object type id, which are moved to the
+    // counters above when they're requested.
+    object_alloc_counts: IndexedCounter,
+    object_dealloc_counts: IndexedCounter,
+
+    // This thread's C `WorkerContext`, which holds the current and round end times, the
+    // active Host, and the worker pool, so that C can read them without calling into Rust.
+    // Only this thread may access it.
+    context: *mut cshadow::WorkerContext,
 }
 
+// The names of the object types that we count, indexed by their type id. Shared by all
+// workers so that each type has the same id on every thread.
+static OBJECT_TYPE_NAMES: Lazy<Mutex<Vec<String>>> = Lazy::new(|| Mutex::new(Vec::new()));
+
 std::thread_local! {
     // Initialized when the worker thread starts running. No shared ownership
     // or access from outside of the current thread.
@@ -75,22 +86,29 @@ impl Worker {
         worker_id: WorkerThreadID,
         bootstrap_end_time: SimulationTime,
     ) {
+        let context = notnull_mut(unsafe { cshadow::worker_getContext() });
+        unsafe {
+            (*context).pool = notnull_mut(worker_pool);
+            (*context).activeHost = std::ptr::null_mut();
+            (*context).now = SimulationTime::to_c_simtime(None);
+            (*context).roundEndTime = SimulationTime::to_c_simtime(None);
+            (*context).bootstrapEndTime = SimulationTime::to_c_simtime(Some(bootstrap_end_time));
+        }
+
         WORKER.with(|worker| {
             let res = worker.set(RefCell::new(Self {
                 worker_id,
                 active_host_info: None,
                 active_process_info: None,
                 active_thread_info: None,
-                clock: Clock {
-                    now: None,
-                    last: None,
-                    barrier: None,
-                },
-                bootstrap_end_time,
+                clock: Clock { last: None },
                 object_alloc_counter: Counter::new(),
                 object_dealloc_counter: Counter::new(),
+                object_alloc_counts: IndexedCounter::new(),
+                object_dealloc_counts: IndexedCounter::new(),
                 syscall_counter: Counter::new(),
-                worker_pool: notnull_mut(worker_pool),
+                profile_counter: Counter::new(),
+                context,
             }));
             assert!(res.is_ok(), "Worker already initialized");
         });
@@ -107,13 +125,22 @@ impl Worker {
     /// Set the currently-active Host.
     pub fn set_active_host(host: &Host) {
         let info = host.info().clone();
-        let old = Worker::with_mut(|w| w.active_host_info.replace(info)).unwrap();
+        let ptr = host.chost();
+        let old = Worker::with_mut(|w| {
+            w.context_mut().activeHost = ptr;
+            w.active_host_info.replace(info)
+        })
+        .unwrap();
         debug_assert!(old.is_none());
     }
 
     /// Clear the currently-active Host.
     pub fn clear_active_host() {
-        let old = Worker::with_mut(|w| w.active_host_info.take()).unwrap();
+        let old = Worker::with_mut(|w| {
+            w.context_mut().activeHost = std::ptr::null_mut();
+            w.active_host_info.take()
+        })
+        .unwrap();
         debug_assert!(old.is_some());
     }
 
@@ -168,6 +195,24 @@ impl Worker {
         Worker::with(|w| w.worker_id)
     }
 
+    /// The data directory of the currently-active Host, if any.
+    pub fn active_host_data_path() -> Option<std::path::PathBuf> {
+        use std::os::unix::ffi::OsStrExt;
+        Worker::with(|w| {
+            let host = w.context().activeHost;
+            if host.is_null() {
+                return None;
+            }
+            let path = unsafe { cshadow::host_getDataPath(host) };
+            if path.is_null() {
+                return None;
+            }
+            let path = unsafe { std::ffi::CStr::from_ptr(path) };
+            Some(std::ffi::OsStr::from_bytes(path.to_bytes()).into())
+        })
+        .flatten()
+    }
+
     pub fn active_process_native_pid() -> Option<nix::unistd::Pid> {
         Worker::with(|w| w.active_process_info.as_ref().map(|p| p.native_pid)).flatten()
     }
@@ -181,23 +226,30 @@ impl Worker {
     }
 
     fn set_round_end_time(t: SimulationTime) {
-        Worker::with_mut(|w| w.clock.barrier.replace(t)).unwrap();
-    }
-
-    fn round_end_time() -> Option<SimulationTime> {
-        Worker::with(|w| w.clock.barrier).flatten()
+        Worker::with_mut(|w| w.context_mut().roundEndTime = SimulationTime::to_c_simtime(Some(t)))
+            .unwrap();
     }
 
     fn set_current_time(t: SimulationTime) {
-        Worker::with_mut(|w| w.clock.now.replace(t)).unwrap();
+        Worker::with_mut(|w| w.context_mut().now = SimulationTime::to_c_simtime(Some(t))).unwrap();
     }
 
     fn clear_current_time() {
-        Worker::with_mut(|w| w.clock.now.take());
+        Worker::with_mut(|w| w.context_mut().now = SimulationTime::to_c_simtime(None));
     }
 
     pub fn current_time() -> Option<SimulationTime> {
-        Worker::with(|w| w.clock.now).flatten()
+        Worker::with(|w| SimulationTime::from_c_simtime(w.context().now)).flatten()
+    }
+
+    fn context(&self) -> &cshadow::WorkerContext {
+        // SAFETY: the context is a thread-local of the thread that owns this Worker.
+        unsafe { &*self.context }
+    }
+
+    fn context_mut(&mut self) -> &mut cshadow::WorkerContext {
+        // SAFETY: as in `context`.
+        unsafe { &mut *self.context }
     }
 
     fn set_last_event_time(t: SimulationTime) {
@@ -250,17 +302,59 @@ mod export {
         }
     }
 
+    /// Returns the id of the object type with the given name, registering it if it's new.
+    #[no_mangle]
+    pub extern "C" fn worker_registerObjectType(name: *const libc::c_char) -> u32 {
+        assert!(!name.is_null());
+        let name = unsafe { std::ffi::CStr::from_ptr(name) }.to_string_lossy();
+
+        let mut names = OBJECT_TYPE_NAMES.lock().unwrap();
+        let id = match names.iter().position(|x| *x == name) {
+            Some(id) => id,
+            None => {
+                names.push(name.into_owned());
+                names.len() - 1
+            }
+        };
+        id.try_into().unwrap()
+    }
+
+    fn drain_object_counts(counts: &mut IndexedCounter, counter: &mut Counter) {
+        let names = OBJECT_TYPE_NAMES.lock().unwrap();
+        counts.drain_into(counter, |id| &names[id]);
+    }
+
     /// Returns NULL if there is no live Worker.
     #[no_mangle]
     pub extern "C" fn _worker_objectAllocCounter() -> *mut Counter {
-        Worker::with_mut(|w| &mut w.object_alloc_counter as *mut Counter)
-            .unwrap_or(std::ptr::null_mut())
+        Worker::with_mut(|w| {
+            drain_object_counts(&mut w.object_alloc_counts, &mut w.object_alloc_counter);
+            &mut w.object_alloc_counter as *mut Counter
+        })
+        .unwrap_or(std::ptr::null_mut())
     }
 
     /// Returns NULL if there is no live Worker.
     #[no_mangle]
     pub extern "C" fn _worker_objectDeallocCounter() -> *mut Counter {
-        Worker::with_mut(|w| &mut w.object_dealloc_counter as *mut Counter)
+        Worker::with_mut(|w| {
+            drain_object_counts(&mut w.object_dealloc_counts, &mut w.object_dealloc_counter);
+            &mut w.object_dealloc_counter as *mut Counter
+        })
+        .unwrap_or(std::ptr::null_mut())
+    }
+
+    /// Counts by object type id. Returns NULL if there is no live Worker.
+    #[no_mangle]
+    pub extern "C" fn _worker_objectAllocCounts() -> *mut IndexedCounter {
+        Worker::with_mut(|w| &mut w.object_alloc_counts as *mut IndexedCounter)
+            .unwrap_or(std::ptr::null_mut())
+    }
+
+    /// Counts by object type id. Returns NULL if there is no live Worker.
+    #[no_mangle]
+    pub extern "C" fn _worker_objectDeallocCounts() -> *mut IndexedCounter {
+        Worker::with_mut(|w| &mut w.object_dealloc_counts as *mut IndexedCounter)
             .unwrap_or(std::ptr::null_mut())
     }
 
@@ -270,6 +364,12 @@ mod export {
         Worker::with_mut(|w| &mut w.syscall_counter as *mut Counter).unwrap_or(std::ptr::null_mut())
     }
 
+    /// Returns NULL if there is no live Worker.
+    #[no_mangle]
+    pub extern "C" fn _worker_profileCounter() -> *mut Counter {
+        Worker::with_mut(|w| &mut w.profile_counter as *mut Counter).unwrap_or(std::ptr::null_mut())
+    }
+
     /// ID of the current thread's Worker. Panics if the thread has no Worker.
     #[no_mangle]
     pub extern "C" fn worker_threadID() -> i32 {
@@ -311,11 +411,6 @@ mod export {
         Worker::set_round_end_time(SimulationTime::from_c_simtime(t).unwrap());
     }
 
-    #[no_mangle]
-    pub extern "C" fn _worker_getRoundEndTime() -> cshadow::SimulationTime {
-        SimulationTime::to_c_simtime(Worker::round_end_time())
-    }
-
     #[no_mangle]
     pub extern "C" fn worker_setCurrentTime(t: cshadow::SimulationTime) {
         if let Some(t) = SimulationTime::from_c_simtime(t) {
@@ -325,26 +420,11 @@ mod export {
         }
     }
 
-    #[no_mangle]
-    pub extern "C" fn worker_getCurrentTime() -> cshadow::SimulationTime {
-        SimulationTime::to_c_simtime(Worker::current_time())
-    }
-
     #[no_mangle]
     pub extern "C" fn _worker_setLastEventTime(t: cshadow::SimulationTime) {
         Worker::set_last_event_time(SimulationTime::from_c_simtime(t).unwrap());
     }
 
-    #[no_mangle]
-    pub extern "C" fn worker_isBootstrapActive() -> bool {
-        Worker::with(|w| w.clock.now.unwrap() < w.bootstrap_end_time).unwrap()
-    }
-
-    #[no_mangle]
-    pub extern "C" fn _worker_pool() -> *mut cshadow::WorkerPool {
-        Worker::with_mut(|w| w.worker_pool).unwrap()
-    }
-
     #[no_mangle]
     pub extern "C" fn worker_isAlive() -> bool {
         Worker::is_alive()
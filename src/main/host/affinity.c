@@ -186,6 +186,22 @@ int affinity_getGoodWorkerAffinity() {
     return p_best_cpu->logical_cpu_num;
 }
 
+int affinity_getCPUNode(int cpu_num) {
+
+    if (!_affinity_enabled || cpu_num == AFFINITY_UNINIT) {
+        return AFFINITY_UNINIT;
+    }
+
+    for (size_t idx = 0; idx < _global_platform_info.n_cpus; ++idx) {
+        const CPUInfo* p_info = &_global_platform_info.p_cpus[idx];
+        if (p_info->logical_cpu_num == cpu_num) {
+            return p_info->node;
+        }
+    }
+
+    return AFFINITY_UNINIT;
+}
+
 /*
  * Read the output of the lscpu command, allocates a buffer, and sets contents
  * to point to the buffer.
@@ -370,14 +386,13 @@ int affinity_initPlatformInfo() {
     return 0;
 }
 
-int affinity_setProcessAffinity(pid_t pid, int new_cpu_num, int old_cpu_num) {
-    assert(pid >= 0);
-
-    // We can short-circuit if there's no work to do.
-    if (!_affinity_enabled || new_cpu_num == AFFINITY_UNINIT || new_cpu_num == old_cpu_num) {
-        return old_cpu_num;
-    }
-
+/*
+ * Sets the affinity of pid to new_cpu_num, or to every CPU in its node if
+ * whole_node is true. Returns the new CPU number on success, and old_cpu_num
+ * otherwise.
+ */
+static int _affinity_setProcessCPUs(pid_t pid, int new_cpu_num, int old_cpu_num,
+                                    bool whole_node) {
     cpu_set_t* cpu_set = NULL;
     bool set_affinity_suceeded = false;
     int retval = new_cpu_num;
@@ -390,8 +405,19 @@ int affinity_setProcessAffinity(pid_t pid, int new_cpu_num, int old_cpu_num) {
 
         // Clear the CPU set
         CPU_ZERO_S(cpu_set_size, cpu_set);
-        // And then add the new_cpu_num as the only element of the set
-        CPU_SET_S(new_cpu_num, cpu_set_size, cpu_set);
+
+        if (whole_node) {
+            int node = affinity_getCPUNode(new_cpu_num);
+            for (size_t idx = 0; idx < _global_platform_info.n_cpus; ++idx) {
+                const CPUInfo* p_info = &_global_platform_info.p_cpus[idx];
+                if (p_info->node == node) {
+                    CPU_SET_S(p_info->logical_cpu_num, cpu_set_size, cpu_set);
+                }
+            }
+        } else {
+            // Add the new_cpu_num as the only element of the set
+            CPU_SET_S(new_cpu_num, cpu_set_size, cpu_set);
+        }
 
         int rc = sched_setaffinity(pid, cpu_set_size, cpu_set);
 
@@ -410,3 +436,27 @@ int affinity_setProcessAffinity(pid_t pid, int new_cpu_num, int old_cpu_num) {
 
     return retval;
 }
+
+int affinity_setProcessAffinity(pid_t pid, int new_cpu_num, int old_cpu_num) {
+    assert(pid >= 0);
+
+    // We can short-circuit if there's no work to do.
+    if (!_affinity_enabled || new_cpu_num == AFFINITY_UNINIT || new_cpu_num == old_cpu_num) {
+        return old_cpu_num;
+    }
+
+    return _affinity_setProcessCPUs(pid, new_cpu_num, old_cpu_num, false);
+}
+
+int affinity_setProcessNodeAffinity(pid_t pid, int new_cpu_num, int old_cpu_num) {
+    assert(pid >= 0);
+
+    // We can short-circuit if the process is already pinned to the new CPU's node.
+    if (!_affinity_enabled || new_cpu_num == AFFINITY_UNINIT ||
+        (old_cpu_num != AFFINITY_UNINIT &&
+         affinity_getCPUNode(new_cpu_num) == affinity_getCPUNode(old_cpu_num))) {
+        return old_cpu_num;
+    }
+
+    return _affinity_setProcessCPUs(pid, new_cpu_num, old_cpu_num, true);
+}
@@ -20,6 +20,14 @@ enum { AFFINITY_UNINIT = -1 };
  */
 int affinity_getGoodWorkerAffinity();
 
+/*
+ * Returns the NUMA node of the given logical CPU, or AFFINITY_UNINIT if CPU
+ * pinning is not enabled or the CPU is unknown.
+ *
+ * THREAD SAFETY: Thread-safe after affinity_initPlatformInfo() returns.
+ */
+int affinity_getCPUNode(int cpu_num);
+
 /*
  * Try to parse platform CPU orientation information from the host machine.
  *
@@ -50,6 +58,15 @@ int affinity_initPlatformInfo();
  */
 int affinity_setProcessAffinity(pid_t pid, int new_cpu_num, int old_cpu_num);
 
+/*
+ * Like affinity_setProcessAffinity, but allows the process to run on any CPU in
+ * new_cpu_num's NUMA node. Short-circuits if old_cpu_num is in the same node,
+ * so the process is only re-pinned when it moves to another node.
+ *
+ * THREAD SAFETY: thread-safe.
+ */
+int affinity_setProcessNodeAffinity(pid_t pid, int new_cpu_num, int old_cpu_num);
+
 /*
  * Helper function. Same semantics as affinity_setProcessAffinity but sets the
  * affinity of the calling thread/process.
@@ -0,0 +1,157 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "main/host/bound_socket_table.h"
+#include "main/utility/utility.h"
+
+#define BOUNDSOCKETTABLE_MIN_CAPACITY 16
+
+typedef struct _BoundSocketSlot BoundSocketSlot;
+struct _BoundSocketSlot {
+    BoundSocketKey key;
+    /* NULL if the slot is empty */
+    gpointer value;
+};
+
+struct _BoundSocketTable {
+    /* a power of two number of slots, using linear probing */
+    BoundSocketSlot* slots;
+    guint capacity;
+    guint length;
+    GDestroyNotify valueFreeFunc;
+};
+
+static inline gboolean _boundsocketkey_equals(const BoundSocketKey* a, const BoundSocketKey* b) {
+    return a->localIP == b->localIP && a->peerIP == b->peerIP && a->localPort == b->localPort &&
+           a->peerPort == b->peerPort && a->protocol == b->protocol;
+}
+
+static inline guint _boundsockettable_index(const BoundSocketTable* table,
+                                            const BoundSocketKey* key) {
+    return (guint)boundsocketkey_hash(key) & (table->capacity - 1);
+}
+
+/* returns the slot holding key, or the empty slot where it would be inserted.
+ * the table must have slots. */
+static BoundSocketSlot* _boundsockettable_find(const BoundSocketTable* table,
+                                               const BoundSocketKey* key) {
+    guint index = _boundsockettable_index(table, key);
+    while (table->slots[index].value && !_boundsocketkey_equals(&table->slots[index].key, key)) {
+        index = (index + 1) & (table->capacity - 1);
+    }
+    return &table->slots[index];
+}
+
+static void _boundsockettable_resize(BoundSocketTable* table, guint capacity) {
+    BoundSocketSlot* oldSlots = table->slots;
+    guint oldCapacity = table->capacity;
+
+    table->slots = g_new0(BoundSocketSlot, capacity);
+    table->capacity = capacity;
+
+    for (guint i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i].value) {
+            *_boundsockettable_find(table, &oldSlots[i].key) = oldSlots[i];
+        }
+    }
+
+    g_free(oldSlots);
+}
+
+BoundSocketTable* boundsockettable_new(GDestroyNotify valueFreeFunc) {
+    BoundSocketTable* table = g_new0(BoundSocketTable, 1);
+    /* most interfaces never have a bound socket, so the slots are allocated by the
+     * first insert */
+    table->valueFreeFunc = valueFreeFunc;
+    return table;
+}
+
+void boundsockettable_free(BoundSocketTable* table) {
+    utility_assert(table);
+
+    if (table->valueFreeFunc) {
+        for (guint i = 0; i < table->capacity; i++) {
+            if (table->slots[i].value) {
+                table->valueFreeFunc(table->slots[i].value);
+            }
+        }
+    }
+
+    g_free(table->slots);
+    g_free(table);
+}
+
+gpointer boundsockettable_lookup(const BoundSocketTable* table, const BoundSocketKey* key) {
+    utility_assert(table);
+    if (table->length == 0) {
+        return NULL;
+    }
+    return _boundsockettable_find(table, key)->value;
+}
+
+void boundsockettable_insert(BoundSocketTable* table, const BoundSocketKey* key, gpointer value) {
+    utility_assert(table);
+    utility_assert(value);
+
+    /* keep the load factor at or below 3/4 */
+    if (table->capacity == 0) {
+        _boundsockettable_resize(table, BOUNDSOCKETTABLE_MIN_CAPACITY);
+    } else if ((table->length + 1) * 4 > table->capacity * 3) {
+        utility_assert(table->capacity <= G_MAXUINT / 2);
+        _boundsockettable_resize(table, table->capacity * 2);
+    }
+
+    BoundSocketSlot* slot = _boundsockettable_find(table, key);
+    utility_assert(!slot->value);
+
+    slot->key = *key;
+    slot->value = value;
+    table->length++;
+}
+
+gboolean boundsockettable_remove(BoundSocketTable* table, const BoundSocketKey* key) {
+    utility_assert(table);
+
+    if (table->length == 0) {
+        return FALSE;
+    }
+
+    BoundSocketSlot* slot = _boundsockettable_find(table, key);
+    if (!slot->value) {
+        return FALSE;
+    }
+
+    gpointer value = slot->value;
+    guint mask = table->capacity - 1;
+    guint hole = (guint)(slot - table->slots);
+
+    /* shift later entries of the probe sequence back into the hole, so that
+     * lookups never need tombstones */
+    for (guint index = (hole + 1) & mask; table->slots[index].value; index = (index + 1) & mask) {
+        guint home = _boundsockettable_index(table, &table->slots[index].key);
+        /* move the entry unless its home lies cyclically in (hole, index] */
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+            table->slots[hole] = table->slots[index];
+            hole = index;
+        }
+    }
+
+    memset(&table->slots[hole], 0, sizeof(BoundSocketSlot));
+    table->length--;
+
+    if (table->valueFreeFunc) {
+        table->valueFreeFunc(value);
+    }
+
+    return TRUE;
+}
+
+guint boundsockettable_getLength(const BoundSocketTable* table) {
+    utility_assert(table);
+    return table->length;
+}
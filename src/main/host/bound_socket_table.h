@@ -0,0 +1,71 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_BOUND_SOCKET_TABLE_H_
+#define SHD_BOUND_SOCKET_TABLE_H_
+
+#include <glib.h>
+#include <netinet/in.h>
+
+#include "main/host/protocol.h"
+
+/* Identifies the socket that packets are delivered to. Sockets that accept
+ * packets from any peer, such as listening sockets, use a peer address and port
+ * of 0. Addresses and ports are in network order. */
+typedef struct _BoundSocketKey BoundSocketKey;
+struct _BoundSocketKey {
+    in_addr_t localIP;
+    in_addr_t peerIP;
+    in_port_t localPort;
+    in_port_t peerPort;
+    guint32 protocol;
+};
+
+static inline BoundSocketKey boundsocketkey_new(ProtocolType protocol, in_addr_t localIP,
+                                                in_port_t localPort, in_addr_t peerIP,
+                                                in_port_t peerPort) {
+    return (BoundSocketKey){
+        .localIP = localIP,
+        .peerIP = peerIP,
+        .localPort = localPort,
+        .peerPort = peerPort,
+        .protocol = (guint32)protocol,
+    };
+}
+
+/* Mixes every field of key, so that nearby ports don't cluster. */
+static inline guint64 boundsocketkey_hash(const BoundSocketKey* key) {
+    guint64 h = ((guint64)key->localIP << 32) | key->peerIP;
+    h ^= ((guint64)key->localPort << 48) | ((guint64)key->peerPort << 32) | key->protocol;
+
+    /* the murmur3 finalizer */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/* An open-addressing hash table from bound socket keys to non-NULL values.
+ * Lookups don't allocate, and the keys are stored inline. */
+typedef struct _BoundSocketTable BoundSocketTable;
+
+BoundSocketTable* boundsockettable_new(GDestroyNotify valueFreeFunc);
+/* Calls valueFreeFunc on every value still in the table. */
+void boundsockettable_free(BoundSocketTable* table);
+
+/* Returns the value stored for key, or NULL if there is none. */
+gpointer boundsockettable_lookup(const BoundSocketTable* table, const BoundSocketKey* key);
+/* Stores value for key, which must not already be in the table. */
+void boundsockettable_insert(BoundSocketTable* table, const BoundSocketKey* key, gpointer value);
+/* Removes key and calls valueFreeFunc on its value. Returns FALSE if the key
+ * was not in the table. */
+gboolean boundsockettable_remove(BoundSocketTable* table, const BoundSocketKey* key);
+/* Returns the number of keys in the table. */
+guint boundsockettable_getLength(const BoundSocketTable* table);
+
+#endif /* SHD_BOUND_SOCKET_TABLE_H_ */
@@ -8,6 +8,7 @@
 
 #include <glib.h>
 #include <stddef.h>
+#include <time.h>
 
 #include "lib/logger/logger.h"
 #include "main/utility/utility.h"
@@ -19,11 +20,14 @@ struct _CPU {
     SimulationTime threshold;
     SimulationTime precision;
     SimulationTime now;
-    SimulationTime timeCPUAvailable;
+    /* when each core will have finished the work it's been given so far */
+    SimulationTime* timeCoreAvailable;
+    guint numCores;
     MAGIC_DECLARE;
 };
 
-CPU* cpu_new(guint64 frequencyKHz, guint64 rawFrequencyKHz, guint64 threshold, guint64 precision) {
+CPU* cpu_new(guint64 frequencyKHz, guint64 rawFrequencyKHz, guint numCores, guint64 threshold,
+             guint64 precision) {
     utility_assert(frequencyKHz > 0);
     utility_assert(rawFrequencyKHz > 0);
     CPU* cpu = g_new0(CPU, 1);
@@ -32,7 +36,10 @@ CPU* cpu_new(guint64 frequencyKHz, guint64 rawFrequencyKHz, guint64 threshold, g
     cpu->frequencyKHz = frequencyKHz;
     cpu->threshold = threshold > 0 ? (threshold * SIMTIME_ONE_MICROSECOND) : SIMTIME_INVALID;
     cpu->precision = precision > 0 ? (precision * SIMTIME_ONE_MICROSECOND) : SIMTIME_INVALID;
-    cpu->timeCPUAvailable = cpu->now = 0;
+    cpu->now = 0;
+
+    cpu->numCores = MAX(numCores, 1);
+    cpu->timeCoreAvailable = g_new0(SimulationTime, cpu->numCores);
 
     cpu->rawFrequencyKHz = rawFrequencyKHz;
     cpu->frequencyRatio = (gdouble)((gdouble)cpu->rawFrequencyKHz) / ((gdouble)cpu->frequencyKHz);
@@ -42,17 +49,38 @@ CPU* cpu_new(guint64 frequencyKHz, guint64 rawFrequencyKHz, guint64 threshold, g
 
 void cpu_free(CPU* cpu) {
     MAGIC_ASSERT(cpu);
+    g_free(cpu->timeCoreAvailable);
     MAGIC_CLEAR(cpu);
     g_free(cpu);
 }
 
+/* the core that will be free soonest, which is where new work goes */
+static guint _cpu_getEarliestCore(CPU* cpu) {
+    guint earliest = 0;
+    for (guint i = 1; i < cpu->numCores; i++) {
+        if (cpu->timeCoreAvailable[i] < cpu->timeCoreAvailable[earliest]) {
+            earliest = i;
+        }
+    }
+    return earliest;
+}
+
+gboolean cpu_isEnabled(CPU* cpu) {
+    MAGIC_ASSERT(cpu);
+    return cpu->threshold != SIMTIME_INVALID;
+}
+
 SimulationTime cpu_getDelay(CPU* cpu) {
     MAGIC_ASSERT(cpu);
 
-    /* we only have delay if we've crossed the threshold */
-    SimulationTime builtUpDelay = cpu->timeCPUAvailable - cpu->now;
-    if(builtUpDelay > cpu->threshold) {
-        return builtUpDelay;
+    /* the host can run again as soon as any core is free, but we only have delay if
+     * we've crossed the threshold */
+    SimulationTime timeCPUAvailable = cpu->timeCoreAvailable[_cpu_getEarliestCore(cpu)];
+    if (timeCPUAvailable > cpu->now) {
+        SimulationTime builtUpDelay = timeCPUAvailable - cpu->now;
+        if (builtUpDelay > cpu->threshold) {
+            return builtUpDelay;
+        }
     }
     return 0;
 }
@@ -69,10 +97,24 @@ gboolean cpu_isBlocked(CPU* cpu) {
 void cpu_updateTime(CPU* cpu, SimulationTime now) {
     MAGIC_ASSERT(cpu);
     cpu->now = now;
-    /* the time available is now if we have no delay, otherwise no change
-     * this is important so that our delay is added from now or into the future
-     */
-    cpu->timeCPUAvailable = (SimulationTime) MAX(cpu->timeCPUAvailable, now);
+}
+
+static guint64 _cpu_nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (guint64)now.tv_sec * SIMTIME_ONE_SECOND + (guint64)now.tv_nsec;
+}
+
+guint64 cpu_startTimer(CPU* cpu) {
+    MAGIC_ASSERT(cpu);
+    return cpu_isEnabled(cpu) ? _cpu_nowNanos() : 0;
+}
+
+void cpu_stopTimer(CPU* cpu, guint64 start) {
+    MAGIC_ASSERT(cpu);
+    if (start != 0) {
+        cpu_addDelay(cpu, _cpu_nowNanos() - start);
+    }
 }
 
 void cpu_addDelay(CPU* cpu, SimulationTime delay) {
@@ -96,5 +138,8 @@ void cpu_addDelay(CPU* cpu, SimulationTime delay) {
         }
     }
 
-    cpu->timeCPUAvailable += adjustedDelay;
+    /* the delay is added from now or into the future, on the core that's free soonest */
+    guint core = _cpu_getEarliestCore(cpu);
+    cpu->timeCoreAvailable[core] =
+        (SimulationTime)MAX(cpu->timeCoreAvailable[core], cpu->now) + adjustedDelay;
 }
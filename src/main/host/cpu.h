@@ -13,12 +13,23 @@
 
 typedef struct _CPU CPU;
 
-CPU* cpu_new(guint64 frequencyKHz, guint64 rawFrequencyKHz, guint64 threshold, guint64 precision);
+/* A host's CPU, with numCores cores that each run one piece of the host's work at a
+ * time. Work is added as a delay, and the host is blocked while every core is busy
+ * for more than threshold microseconds past the current time. A threshold of 0
+ * disables the model, so the host is never blocked. */
+CPU* cpu_new(guint64 frequencyKHz, guint64 rawFrequencyKHz, guint numCores, guint64 threshold,
+             guint64 precision);
 void cpu_free(CPU* cpu);
 
+gboolean cpu_isEnabled(CPU* cpu);
 gboolean cpu_isBlocked(CPU* cpu);
 void cpu_updateTime(CPU* cpu, SimulationTime now);
 void cpu_addDelay(CPU* cpu, SimulationTime delay);
 SimulationTime cpu_getDelay(CPU* cpu);
 
+/* Returns a start time to pass to cpu_stopTimer, or 0 if the model is disabled. */
+guint64 cpu_startTimer(CPU* cpu);
+/* Adds the real time since `start` as a delay, e.g. the time a plugin ran for. */
+void cpu_stopTimer(CPU* cpu, guint64 start);
+
 #endif /* SHD_CPU_H_ */
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "main/bindings/c/bindings.h"
 #include "main/core/support/definitions.h"
@@ -17,6 +18,8 @@
 #include "main/host/descriptor/descriptor_types.h"
 #include "main/host/descriptor/transport.h"
 #include "main/host/host.h"
+#include "main/host/process.h"
+#include "main/host/thread.h"
 #include "main/utility/utility.h"
 
 struct _Channel {
@@ -29,6 +32,22 @@ struct _Channel {
     gsize bufferSize;
     gsize bufferLength;
 
+    /* for sockets that keep message boundaries (SOCK_DGRAM and SOCK_SEQPACKET), the
+     * length of each message in the buffer in the order they were written; NULL for
+     * byte streams */
+    GQueue* messageLengths;
+
+    /* a thread that is blocked reading from us, whose buffer our link copies into
+     * directly instead of through our buffer */
+    struct {
+        Thread* thread;
+        PluginVirtualPtr buffer;
+        gsize nBytes;
+        /* set once data was copied into the buffer, until the thread reads it */
+        gboolean isFilled;
+        gsize numFilled;
+    } blockedReader;
+
     MAGIC_DECLARE;
 };
 
@@ -38,6 +57,25 @@ static Channel* _channel_fromLegacyDescriptor(LegacyDescriptor* descriptor) {
     return (Channel*)descriptor;
 }
 
+static gboolean _channel_hasBufferedData(Channel* channel) {
+    if (channel->messageLengths) {
+        /* zero-length messages are still readable */
+        return !g_queue_is_empty(channel->messageLengths);
+    }
+    return channel->bufferLength > 0;
+}
+
+static gboolean _channel_hasReadableData(Channel* channel) {
+    return channel->blockedReader.isFilled || _channel_hasBufferedData(channel);
+}
+
+static void _channel_clearBlockedReader(Channel* channel) {
+    if (channel->blockedReader.thread) {
+        thread_unref(channel->blockedReader.thread);
+    }
+    memset(&channel->blockedReader, 0, sizeof(channel->blockedReader));
+}
+
 static gboolean channel_close(LegacyDescriptor* descriptor, Host* host) {
     Channel* channel = _channel_fromLegacyDescriptor(descriptor);
     MAGIC_ASSERT(channel);
@@ -53,6 +91,8 @@ static gboolean channel_close(LegacyDescriptor* descriptor, Host* host) {
         channel->linkedChannel = NULL;
     }
 
+    _channel_clearBlockedReader(channel);
+
     /* host can stop monitoring us for changes */
     return TRUE;
 }
@@ -62,6 +102,10 @@ static void channel_free(LegacyDescriptor* descriptor) {
     MAGIC_ASSERT(channel);
 
     bytequeue_free(channel->buffer);
+    if (channel->messageLengths) {
+        g_queue_free(channel->messageLengths);
+    }
+    _channel_clearBlockedReader(channel);
 
     descriptor_clear((LegacyDescriptor*)channel);
     MAGIC_CLEAR(channel);
@@ -70,35 +114,143 @@ static void channel_free(LegacyDescriptor* descriptor) {
     worker_count_deallocation(Channel);
 }
 
-static gssize channel_linkedWrite(Channel* channel, Thread* thread, PluginVirtualPtr buffer,
-                                  gsize nBytes) {
-    MAGIC_ASSERT(channel);
-    /* our linked channel is trying to send us data, make sure we can read it */
-    utility_assert(!(channel->type & CT_WRITEONLY));
+/* Copies data that our link is writing straight into the buffer of the thread that is
+ * blocked reading from us, so that it doesn't pass through our buffer. Returns the number
+ * of bytes of the write that were consumed, or -1 if none were and the data must go
+ * through our buffer instead. */
+static gssize _channel_writeToBlockedReader(Channel* channel, Thread* thread,
+                                            PluginVirtualPtr buffer, gsize nBytes) {
+    Thread* reader = channel->blockedReader.thread;
+
+    /* older data must be read first */
+    if (!reader || _channel_hasReadableData(channel)) {
+        return -1;
+    }
+
+    if (!thread_isRunning(reader)) {
+        /* it exited while waiting */
+        _channel_clearBlockedReader(channel);
+        return -1;
+    }
+
+    Process* writerProcess = thread_getProcess(thread);
+    Process* readerProcess = thread_getProcess(reader);
+    gsize copyLength = MIN(nBytes, channel->blockedReader.nBytes);
+    int result = 0;
+
+    if (copyLength > 0) {
+        if (readerProcess == writerProcess) {
+            result = process_copyPtr(
+                readerProcess, channel->blockedReader.buffer, buffer, copyLength);
+        } else {
+            const void* src = process_getReadablePtr(writerProcess, buffer, copyLength);
+            result = src ? process_writePtr(
+                               readerProcess, channel->blockedReader.buffer, src, copyLength)
+                         : -EFAULT;
+        }
+    }
 
+    if (result != 0) {
+        /* the reader will copy from our buffer when it runs again instead */
+        _channel_clearBlockedReader(channel);
+        return -1;
+    }
+
+    channel->blockedReader.isFilled = TRUE;
+    channel->blockedReader.numFilled = copyLength;
+
+    /* the part of a message that doesn't fit in the reader's buffer is discarded */
+    return channel->messageLengths ? (gssize)nBytes : (gssize)copyLength;
+}
+
+static gssize _channel_writeToBuffer(Channel* channel, Thread* thread, PluginVirtualPtr buffer,
+                                     gsize nBytes) {
     gsize available = channel->bufferSize - channel->bufferLength;
+    Process* process = thread_getProcess(thread);
+
+    if (channel->messageLengths) {
+        /* messages are never split */
+        if (available < nBytes) {
+            return (gssize)-EWOULDBLOCK;
+        }
+
+        if (nBytes > 0) {
+            const unsigned char* src = process_getReadablePtr(process, buffer, nBytes);
+            if (!src) {
+                return -EFAULT;
+            }
+            bytequeue_push(channel->buffer, src, nBytes);
+        }
+
+        g_queue_push_tail(channel->messageLengths, GSIZE_TO_POINTER(nBytes));
+        channel->bufferLength += nBytes;
+        return (gssize)nBytes;
+    }
+
     if(available == 0) {
         /* we have no space */
         return (gssize)-EWOULDBLOCK;
     }
 
-    // TODO: Add an interface to bytequeue that would allow us to use
-    // worker_readPtr to read directly into its storage, saving a potential copy
-    // inside worker_getReadablePtr. e.g. one that accepts a read callback.
     gsize copyLength = MIN(nBytes, available);
-    const void* readablePtr = process_getReadablePtr(thread_getProcess(thread), buffer, copyLength);
-    if (!readablePtr) {
+    gsize numCopied = 0;
+
+    /* accept some data from the other end of the pipe, reading it from the plugin
+     * directly into the buffer storage */
+    while (numCopied < copyLength) {
+        size_t spaceLength = 0;
+        unsigned char* space = bytequeue_reserveWritable(channel->buffer, &spaceLength);
+        size_t chunkLength = MIN(spaceLength, copyLength - numCopied);
+
+        PluginVirtualPtr src = {.val = buffer.val + numCopied};
+        if (process_readPtr(process, space, src, chunkLength) != 0) {
+            bytequeue_commitWritten(channel->buffer, 0);
+            break;
+        }
+
+        bytequeue_commitWritten(channel->buffer, chunkLength);
+        numCopied += chunkLength;
+    }
+
+    if (numCopied == 0) {
         return -EFAULT;
     }
 
-    /* accept some data from the other end of the pipe */
-    bytequeue_push(channel->buffer, readablePtr, copyLength);
-    channel->bufferLength += copyLength;
+    channel->bufferLength += numCopied;
+    return (gssize)numCopied;
+}
 
-    /* we just got some data in our buffer */
-    descriptor_adjustStatus((LegacyDescriptor*)channel, STATUS_DESCRIPTOR_READABLE, TRUE);
+static gssize channel_linkedWrite(Channel* channel, Thread* thread, PluginVirtualPtr buffer,
+                                  gsize nBytes) {
+    MAGIC_ASSERT(channel);
+    /* our linked channel is trying to send us data, make sure we can read it */
+    utility_assert(!(channel->type & CT_WRITEONLY));
 
-    return copyLength;
+    if (channel->messageLengths && nBytes > channel->bufferSize) {
+        /* the message could never fit in our buffer */
+        return (gssize)-EMSGSIZE;
+    }
+
+    gssize numDirect = _channel_writeToBlockedReader(channel, thread, buffer, nBytes);
+    gssize result = 0;
+
+    if (numDirect < 0) {
+        result = _channel_writeToBuffer(channel, thread, buffer, nBytes);
+    } else if ((gsize)numDirect < nBytes) {
+        /* the reader's buffer is full, so buffer what we can of the rest of the stream */
+        PluginVirtualPtr rest = {.val = buffer.val + numDirect};
+        gssize numBuffered = _channel_writeToBuffer(channel, thread, rest, nBytes - numDirect);
+        result = numDirect + MAX(numBuffered, 0);
+    } else {
+        result = numDirect;
+    }
+
+    if (result >= 0) {
+        /* we just got some data */
+        descriptor_adjustStatus((LegacyDescriptor*)channel, STATUS_DESCRIPTOR_READABLE, TRUE);
+    }
+
+    return result;
 }
 
 static gssize channel_sendUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
@@ -110,30 +262,77 @@ static gssize channel_sendUserData(Transport* transport, Thread* thread, PluginV
 
     /* Zero-size writes of pipes aren't very clearly specified. The pipe(2)
      * documentation for O_DIRECT indicates that a size-zero write is a no-op
-     * with O_DIRECT; experimentally they are also a no-op without it. */
-    if (nBytes == 0) {
+     * with O_DIRECT; experimentally they are also a no-op without it. Sockets
+     * that keep message boundaries send an empty message. */
+    if (nBytes == 0 && !channel->messageLengths) {
         return 0;
     }
 
     gssize result = 0;
 
     if(channel->linkedChannel) {
-        if (nBytes > 0) {
-            result = channel_linkedWrite(channel->linkedChannel, thread, buffer, nBytes);
-        }
+        result = channel_linkedWrite(channel->linkedChannel, thread, buffer, nBytes);
     } else {
         /* the other end closed or doesn't exist */
         result = -EPIPE;
     }
 
-    /* our end cant write anymore if they returned error */
-    if(result <= (gssize)0) {
+    /* our end cant write anymore if they are full or gone */
+    if (result == -EWOULDBLOCK || result == -EPIPE) {
         descriptor_adjustStatus((LegacyDescriptor*)channel, STATUS_DESCRIPTOR_WRITABLE, FALSE);
     }
 
     return result;
 }
 
+/* Copies up to nBytes from our buffer into the plugin, returning the number of bytes
+ * copied. A message is always removed from the buffer in full. */
+static gssize _channel_readFromBuffer(Channel* channel, Thread* thread, PluginVirtualPtr buffer,
+                                      gsize nBytes) {
+    gsize available = channel->bufferLength;
+    if (channel->messageLengths) {
+        available = GPOINTER_TO_SIZE(g_queue_peek_head(channel->messageLengths));
+    }
+
+    gsize copyLength = MIN(nBytes, available);
+    gsize numCopied = 0;
+    Process* process = thread_getProcess(thread);
+
+    /* accept some data from the other end of the pipe, writing it from the buffer
+     * storage directly into the plugin */
+    while (numCopied < copyLength) {
+        size_t readableLength = 0;
+        const unsigned char* readable = bytequeue_peekReadable(channel->buffer, &readableLength);
+        utility_assert(readable != NULL);
+        size_t chunkLength = MIN(readableLength, copyLength - numCopied);
+
+        PluginVirtualPtr dst = {.val = buffer.val + numCopied};
+        if (process_writePtr(process, dst, readable, chunkLength) != 0) {
+            break;
+        }
+
+        bytequeue_consume(channel->buffer, chunkLength);
+        numCopied += chunkLength;
+    }
+
+    if (channel->messageLengths) {
+        /* the rest of the message is discarded, as is all of it if we couldn't copy it */
+        bytequeue_consume(channel->buffer, available - numCopied);
+        g_queue_pop_head(channel->messageLengths);
+        channel->bufferLength -= available;
+        if (numCopied < copyLength) {
+            return -EFAULT;
+        }
+    } else {
+        if (numCopied == 0) {
+            return -EFAULT;
+        }
+        channel->bufferLength -= numCopied;
+    }
+
+    return (gssize)numCopied;
+}
+
 static gssize channel_receiveUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
                                       gsize nBytes, in_addr_t* ip, in_port_t* port) {
     Channel* channel = _channel_fromLegacyDescriptor((LegacyDescriptor*)transport);
@@ -147,37 +346,53 @@ static gssize channel_receiveUserData(Transport* transport, Thread* thread, Plug
         return 0;
     }
 
-    gsize available = channel->bufferLength;
-    if(available == 0) {
-        /* we have no data */
-        if(!channel->linkedChannel) {
-            /* the other end closed (EOF) */
-            return (gssize)0;
-        } else {
-            /* blocking on read */
+    gssize result = 0;
+    Thread* reader = channel->blockedReader.thread;
+
+    if (reader == thread && channel->blockedReader.isFilled &&
+        channel->blockedReader.buffer.val == buffer.val &&
+        channel->blockedReader.nBytes == nBytes) {
+        /* we already copied data into this read's buffer while it was blocked */
+        result = (gssize)channel->blockedReader.numFilled;
+        _channel_clearBlockedReader(channel);
+    } else {
+        if (reader && (reader == thread || !thread_isRunning(reader))) {
+            /* the reader isn't blocked anymore */
+            _channel_clearBlockedReader(channel);
+        }
+
+        if (!_channel_hasReadableData(channel)) {
+            /* we have no data */
+            if (!channel->linkedChannel) {
+                /* the other end closed (EOF) */
+                return (gssize)0;
+            } else {
+                /* blocking on read */
+                return (gssize)-EWOULDBLOCK;
+            }
+        }
+
+        if (channel->blockedReader.isFilled && !_channel_hasBufferedData(channel)) {
+            /* the only data is reserved for the blocked reader */
             return (gssize)-EWOULDBLOCK;
         }
-    }
 
-    // TODO: Use `worker_writePtr` to write directly into the process's memory,
-    // saving a potential copy in worker_getWritablePtr. e.g. add an interface
-    // to bytequeue that takes a `write` callback.
-    gsize copyLength = MIN(nBytes, available);
-    void* writableBuf = process_getWriteablePtr(thread_getProcess(thread), buffer, copyLength);
-    if (!writableBuf) {
-        return -EFAULT;
+        result = _channel_readFromBuffer(channel, thread, buffer, nBytes);
     }
 
-    /* accept some data from the other end of the pipe */
-    gsize numCopied = bytequeue_pop(channel->buffer, writableBuf, copyLength);
-    channel->bufferLength -= numCopied;
-
-    /* we are no longer readable if we have nothing left */
-    if(channel->bufferLength <= 0) {
+    /* we are no longer readable if we have nothing left (a message is consumed
+     * even if we couldn't copy it) */
+    if (!_channel_hasReadableData(channel)) {
         descriptor_adjustStatus((LegacyDescriptor*)channel, STATUS_DESCRIPTOR_READABLE, FALSE);
     }
 
-    return (gssize)numCopied;
+    /* the other end has space to write again */
+    if (channel->linkedChannel && channel->bufferLength < channel->bufferSize) {
+        descriptor_adjustStatus(
+            (LegacyDescriptor*)channel->linkedChannel, STATUS_DESCRIPTOR_WRITABLE, TRUE);
+    }
+
+    return result;
 }
 
 TransportFunctionTable channel_functions = {
@@ -219,6 +434,35 @@ void channel_setLinkedChannel(Channel* channel, Channel* linkedChannel) {
     }
 }
 
+void channel_setPreserveMessageBoundaries(Channel* channel) {
+    MAGIC_ASSERT(channel);
+    utility_assert(channel->bufferLength == 0);
+
+    if (!channel->messageLengths) {
+        channel->messageLengths = g_queue_new();
+    }
+}
+
+gboolean channel_preservesMessageBoundaries(Channel* channel) {
+    MAGIC_ASSERT(channel);
+    return channel->messageLengths != NULL;
+}
+
+void channel_setBlockedReader(Channel* channel, Thread* thread, PluginVirtualPtr buffer,
+                              gsize nBytes) {
+    MAGIC_ASSERT(channel);
+
+    /* only one reader can be first in line, and only while there's nothing to read */
+    if (channel->blockedReader.thread || _channel_hasReadableData(channel) || nBytes == 0) {
+        return;
+    }
+
+    thread_ref(thread);
+    channel->blockedReader.thread = thread;
+    channel->blockedReader.buffer = buffer;
+    channel->blockedReader.nBytes = nBytes;
+}
+
 Channel* channel_getLinkedChannel(Channel* channel) {
     MAGIC_ASSERT(channel);
     return channel->linkedChannel;
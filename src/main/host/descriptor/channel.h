@@ -11,6 +11,9 @@
 
 #include <glib.h>
 
+#include "main/host/syscall_types.h"
+#include "main/host/thread.h"
+
 typedef enum _ChannelType ChannelType;
 enum _ChannelType {
     CT_NONE, CT_READONLY, CT_WRITEONLY,
@@ -22,4 +25,18 @@ Channel* channel_new(ChannelType type, LegacyDescriptorType dtype);
 void channel_setLinkedChannel(Channel* channel, Channel* linkedChannel);
 Channel* channel_getLinkedChannel(Channel* channel);
 
+/* Makes the channel keep the boundaries between the messages written to it, as
+ * SOCK_DGRAM and SOCK_SEQPACKET sockets do: each write is queued whole or not at
+ * all, and each read returns at most one message. Call before writing to it. */
+void channel_setPreserveMessageBoundaries(Channel* channel);
+gboolean channel_preservesMessageBoundaries(Channel* channel);
+
+/* Tells the channel that thread is about to block reading up to nBytes into
+ * buffer. Until the thread reads again, the next write by the linked channel is
+ * copied straight from the writer's memory into that buffer, and the thread's
+ * next read of the same buffer returns it. Ignored if the channel has data or
+ * another reader is already waiting. */
+void channel_setBlockedReader(Channel* channel, Thread* thread, PluginVirtualPtr buffer,
+                              gsize nBytes);
+
 #endif /* SHD_CHANNEL_H_ */
@@ -10,6 +10,7 @@
 #include "lib/logger/logger.h"
 #include "main/bindings/c/bindings-opaque.h"
 #include "main/host/descriptor/socket.h"
+#include "main/host/descriptor/tcp.h"
 #include "main/utility/tagged_ptr.h"
 
 static void compatsockettypes_assertValid(CompatSocketTypes type) {
@@ -149,3 +150,34 @@ Packet* compatsocket_pullOutPacket(const CompatSocket* socket, Host* host) {
 
     utility_panic("Invalid CompatSocket type");
 }
+
+bool compatsocket_isReusePort(const CompatSocket* socket) {
+    switch (socket->type) {
+        case CST_LEGACY_SOCKET: return socket_isReusePort(socket->object.as_legacy_socket);
+        case CST_NONE: utility_panic("Unexpected CompatSocket type");
+    }
+
+    utility_panic("Invalid CompatSocket type");
+}
+
+bool compatsocket_hasChild(const CompatSocket* socket, in_addr_t peerIP, in_port_t peerPort) {
+    switch (socket->type) {
+        case CST_LEGACY_SOCKET: {
+            Socket* legacySocket = socket->object.as_legacy_socket;
+            return descriptor_getType((LegacyDescriptor*)legacySocket) == DT_TCPSOCKET &&
+                   tcp_hasChild((TCP*)legacySocket, peerIP, peerPort);
+        }
+        case CST_NONE: utility_panic("Unexpected CompatSocket type");
+    }
+
+    utility_panic("Invalid CompatSocket type");
+}
+
+SocketQueueLink* compatsocket_getQueueLinks(const CompatSocket* socket) {
+    switch (socket->type) {
+        case CST_LEGACY_SOCKET: return socket_getQueueLinks(socket->object.as_legacy_socket);
+        case CST_NONE: utility_panic("Unexpected CompatSocket type");
+    }
+
+    utility_panic("Invalid CompatSocket type");
+}
@@ -45,5 +45,10 @@ bool compatsocket_getSocketName(const CompatSocket* socket, in_addr_t* ip, in_po
 const Packet* compatsocket_peekNextOutPacket(const CompatSocket* socket);
 void compatsocket_pushInPacket(const CompatSocket* socket, Host* host, Packet* packet);
 Packet* compatsocket_pullOutPacket(const CompatSocket* socket, Host* host);
+bool compatsocket_isReusePort(const CompatSocket* socket);
+/* returns true if the socket is a listener that accepted a connection from the peer */
+bool compatsocket_hasChild(const CompatSocket* socket, in_addr_t peerIP, in_port_t peerPort);
+/* returns the SOCKET_MAX_QUEUE_LINKS interface queue links of the socket */
+SocketQueueLink* compatsocket_getQueueLinks(const CompatSocket* socket);
 
 #endif /* SRC_MAIN_HOST_DESCRIPTOR_COMPAT_SOCKET_H_ */
@@ -27,8 +27,9 @@ void descriptor_init(LegacyDescriptor* descriptor, LegacyDescriptorType type,
     descriptor->funcTable = funcTable;
     descriptor->type = type;
     descriptor->handle = -1;
-    descriptor->listeners = g_hash_table_new_full(
-        g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)statuslistener_unref);
+    /* allocated when the first listener is added */
+    descriptor->listeners = NULL;
+    descriptor->notifyDepth = 0;
     descriptor->referenceCount = 1;
 
     trace("Descriptor %i has been initialized now", descriptor->handle);
@@ -39,7 +40,13 @@ void descriptor_init(LegacyDescriptor* descriptor, LegacyDescriptorType type,
 void descriptor_clear(LegacyDescriptor* descriptor) {
     MAGIC_ASSERT(descriptor);
     if (descriptor->listeners) {
-        g_hash_table_destroy(descriptor->listeners);
+        for (guint i = 0; i < descriptor->listeners->len; i++) {
+            StatusListener* listener = g_ptr_array_index(descriptor->listeners, i);
+            if (listener) {
+                statuslistener_unref(listener);
+            }
+        }
+        g_ptr_array_free(descriptor->listeners, TRUE);
     }
     MAGIC_CLEAR(descriptor);
 }
@@ -147,13 +154,107 @@ static gchar* _descriptor_statusToString(Status ds) {
 }
 #endif
 
-static void _descriptor_handleStatusChange(LegacyDescriptor* descriptor, Status oldStatus) {
-    MAGIC_ASSERT(descriptor);
+static gint _descriptor_findListener(LegacyDescriptor* descriptor, StatusListener* listener) {
+    if (!descriptor->listeners) {
+        return -1;
+    }
+    for (guint i = 0; i < descriptor->listeners->len; i++) {
+        if (g_ptr_array_index(descriptor->listeners, i) == listener) {
+            return i;
+        }
+    }
+    return -1;
+}
 
+/* Drops the NULL slots left by listeners that were removed during a notification,
+ * keeping the others in the order they were added. */
+static void _descriptor_compactListeners(LegacyDescriptor* descriptor) {
+    GPtrArray* listeners = descriptor->listeners;
+    guint kept = 0;
+    for (guint i = 0; i < listeners->len; i++) {
+        StatusListener* listener = g_ptr_array_index(listeners, i);
+        if (listener) {
+            listeners->pdata[kept++] = listener;
+        }
+    }
+    g_ptr_array_set_size(listeners, kept);
+}
+
+/* A descriptor whose listeners haven't heard about its status changes yet, because they
+ * happened during a status batch. */
+typedef struct _PendingStatusChange PendingStatusChange;
+struct _PendingStatusChange {
+    LegacyDescriptor* descriptor;
+    /* the status before the first change in the batch */
+    Status oldStatus;
+};
+
+/* How many status batches are open on this thread. */
+static __thread guint _statusBatchDepth = 0;
+/* The descriptors with pending changes, in the order they first changed. */
+static __thread GArray* _pendingStatusChanges = NULL;
+/* Holds the descriptors in _pendingStatusChanges, to add each one only once. */
+static __thread GHashTable* _pendingStatusDescriptors = NULL;
+
+static void _descriptor_notifyListeners(LegacyDescriptor* descriptor, Status oldStatus) {
     /* Identify which bits changed, if any. */
     Status statusesChanged = descriptor->status ^ oldStatus;
 
-    if (!statusesChanged) {
+    if (!statusesChanged || !descriptor->listeners || descriptor->listeners->len == 0) {
+        return;
+    }
+
+    /* Tell our listeners there was some activity on this descriptor. The
+     * onStatusChanged callback may add or remove listeners, so we iterate the
+     * array in place by index: while we are notifying, removed listeners only
+     * leave a NULL slot behind, and listeners added after we started are past
+     * the end we read here and don't hear about this change. */
+    guint numListeners = descriptor->listeners->len;
+    descriptor->notifyDepth++;
+
+    for (guint i = 0; statusesChanged && i < numListeners; i++) {
+        StatusListener* listener = g_ptr_array_index(descriptor->listeners, i);
+
+        /* Call only if the listener wasn't removed by an earlier callback. */
+        if (listener) {
+            statuslistener_onStatusChanged(listener, descriptor->status, statusesChanged);
+        }
+
+        /* The above callback may have changes status again,
+         * so make sure we consider the latest status state. */
+        statusesChanged = descriptor->status ^ oldStatus;
+    }
+
+    /* A callback may have notified again on this descriptor, so only the
+     * outermost notification may move the listeners. */
+    if (--descriptor->notifyDepth == 0) {
+        _descriptor_compactListeners(descriptor);
+    }
+}
+
+/* Remembers the status that the descriptor had before its first change in the current
+ * batch, so that its listeners hear about the combined change when the batch ends. */
+static void _descriptor_deferStatusChange(LegacyDescriptor* descriptor, Status oldStatus) {
+    if (!_pendingStatusChanges) {
+        _pendingStatusChanges = g_array_new(FALSE, FALSE, sizeof(PendingStatusChange));
+        _pendingStatusDescriptors = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
+    if (!g_hash_table_add(_pendingStatusDescriptors, descriptor)) {
+        /* already pending with its status from before the batch */
+        return;
+    }
+
+    /* keep the descriptor alive until its listeners are notified */
+    descriptor_ref(descriptor);
+    PendingStatusChange change = {.descriptor = descriptor, .oldStatus = oldStatus};
+    g_array_append_val(_pendingStatusChanges, change);
+}
+
+static void _descriptor_handleStatusChange(LegacyDescriptor* descriptor, Status oldStatus) {
+    MAGIC_ASSERT(descriptor);
+
+    if (descriptor->status == oldStatus) {
         return;
     }
 
@@ -165,29 +266,42 @@ static void _descriptor_handleStatusChange(LegacyDescriptor* descriptor, Status
     g_free(after);
 #endif
 
-    /* Tell our listeners there was some activity on this descriptor.
-     * We can't use an iterator here, because the listener table may
-     * be modified in the body of the while loop below, in the onStatusChanged
-     * callback. Instead we get a list of the keys and do lookups on those.*/
-    GList* listenerList = g_hash_table_get_keys(descriptor->listeners);
+    if (!descriptor->listeners || descriptor->listeners->len == 0) {
+        return;
+    }
 
-    /* Iterate the listeners. */
-    GList* item = g_list_first(listenerList);
-    while (statusesChanged && item) {
-        StatusListener* listener = item->data;
+    if (_statusBatchDepth > 0) {
+        _descriptor_deferStatusChange(descriptor, oldStatus);
+    } else {
+        _descriptor_notifyListeners(descriptor, oldStatus);
+    }
+}
 
-        /* Call only if the listener is still in the table. */
-        if (g_hash_table_contains(descriptor->listeners, listener)) {
-            statuslistener_onStatusChanged(listener, descriptor->status, statusesChanged);
-        }
+void descriptor_beginStatusBatch() { _statusBatchDepth++; }
 
-        /* The above callback may have changes status again,
-         * so make sure we consider the latest status state. */
-        statusesChanged = descriptor->status ^ oldStatus;
-        item = g_list_next(item);
+void descriptor_endStatusBatch() {
+    utility_assert(_statusBatchDepth > 0);
+    if (--_statusBatchDepth > 0 || !_pendingStatusChanges) {
+        return;
     }
 
-    g_list_free(listenerList);
+    /* The listeners may change statuses again while we notify them, and since the batch
+     * is over, they hear about those changes right away. Each descriptor still gets
+     * notified about the change from its status before the batch, if its status differs
+     * from that now. */
+    while (_pendingStatusChanges->len > 0) {
+        GArray* changes = _pendingStatusChanges;
+        _pendingStatusChanges = g_array_new(FALSE, FALSE, sizeof(PendingStatusChange));
+        g_hash_table_remove_all(_pendingStatusDescriptors);
+
+        for (guint i = 0; i < changes->len; i++) {
+            PendingStatusChange* change = &g_array_index(changes, PendingStatusChange, i);
+            _descriptor_notifyListeners(change->descriptor, change->oldStatus);
+            descriptor_unref(change->descriptor);
+        }
+
+        g_array_free(changes, TRUE);
+    }
 }
 
 void descriptor_adjustStatus(LegacyDescriptor* descriptor, Status status, gboolean doSetBits) {
@@ -215,15 +329,31 @@ Status descriptor_getStatus(LegacyDescriptor* descriptor) {
 
 void descriptor_addListener(LegacyDescriptor* descriptor, StatusListener* listener) {
     MAGIC_ASSERT(descriptor);
+    /* Adding a listener twice has no effect. */
+    if (_descriptor_findListener(descriptor, listener) >= 0) {
+        return;
+    }
+    if (!descriptor->listeners) {
+        descriptor->listeners = g_ptr_array_new();
+    }
     /* We are storing a listener instance, so count the ref. */
     statuslistener_ref(listener);
-    g_hash_table_insert(descriptor->listeners, listener, listener);
+    g_ptr_array_add(descriptor->listeners, listener);
 }
 
 void descriptor_removeListener(LegacyDescriptor* descriptor, StatusListener* listener) {
     MAGIC_ASSERT(descriptor);
-    /* This will automatically call descriptorlistener_unref on the instance. */
-    g_hash_table_remove(descriptor->listeners, listener);
+    gint index = _descriptor_findListener(descriptor, listener);
+    if (index < 0) {
+        return;
+    }
+    if (descriptor->notifyDepth > 0) {
+        /* A notification is iterating the array, so leave the others in place. */
+        g_ptr_array_index(descriptor->listeners, index) = NULL;
+    } else {
+        g_ptr_array_remove_index(descriptor->listeners, index);
+    }
+    statuslistener_unref(listener);
 }
 
 gint descriptor_getFlags(LegacyDescriptor* descriptor) {
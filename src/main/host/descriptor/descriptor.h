@@ -64,6 +64,13 @@ void descriptor_removeFlags(LegacyDescriptor* descriptor, gint flags);
  */
 void descriptor_adjustStatus(LegacyDescriptor* descriptor, Status status, gboolean doSetBits);
 
+/* Defers the listener notifications of descriptor_adjustStatus on this thread until the
+ * matching descriptor_endStatusBatch. When the outermost batch ends, each descriptor whose
+ * status changed notifies its listeners once, about all the bits that differ from its status
+ * before the batch; bits that flipped and flipped back are not reported. Batches nest. */
+void descriptor_beginStatusBatch();
+void descriptor_endStatusBatch();
+
 /* Gets the current status of the descriptor. */
 Status descriptor_getStatus(LegacyDescriptor* descriptor);
 
@@ -2,84 +2,106 @@ use super::CompatDescriptor;
 use crate::cshadow;
 use crate::utility::notnull::*;
 use log::*;
-use std::collections::{BTreeSet, HashMap};
 use std::convert::TryInto;
 
+/// A set of indices that can find its lowest unused index quickly. Each bit of
+/// `used` marks an index in use, and each bit of `full` marks a word of `used`
+/// that has no unused index left, so finding the lowest unused index scans one
+/// bit per 4096 indices.
+struct IndexBitmap {
+    used: Vec<u64>,
+    full: Vec<u64>,
+}
+
+impl IndexBitmap {
+    pub fn new() -> Self {
+        IndexBitmap {
+            used: Vec::new(),
+            full: Vec::new(),
+        }
+    }
+
+    /// The lowest index that is not in use. Indices at or beyond the end of the
+    /// bitmap are never in use.
+    pub fn lowest_unused(&self) -> u32 {
+        for (i, full) in self.full.iter().enumerate() {
+            if *full != u64::MAX {
+                let word = i * 64 + (!*full).trailing_zeros() as usize;
+                if word < self.used.len() {
+                    return (word * 64 + (!self.used[word]).trailing_zeros() as usize)
+                        .try_into()
+                        .unwrap();
+                }
+                break;
+            }
+        }
+        (self.used.len() * 64).try_into().unwrap()
+    }
+
+    pub fn set(&mut self, idx: u32, in_use: bool) {
+        let idx = idx as usize;
+        let word = idx / 64;
+
+        if word >= self.used.len() {
+            if !in_use {
+                return;
+            }
+            self.used.resize(word + 1, 0);
+            self.full.resize(word / 64 + 1, 0);
+        }
+
+        if in_use {
+            self.used[word] |= 1 << (idx % 64);
+        } else {
+            self.used[word] &= !(1 << (idx % 64));
+        }
+
+        if self.used[word] == u64::MAX {
+            self.full[word / 64] |= 1 << (word % 64);
+        } else {
+            self.full[word / 64] &= !(1 << (word % 64));
+        }
+    }
+}
+
 /// Table of (file) descriptors. Typically owned by a Process.
 pub struct DescriptorTable {
-    descriptors: HashMap<u32, CompatDescriptor>,
+    // Indexed directly by the descriptor index, since they are small and dense.
+    descriptors: Vec<Option<CompatDescriptor>>,
 
-    // Indices less than `next_index` known to be available.
-    available_indices: BTreeSet<u32>,
-
-    // Lowest index not in `available_indices` that *might* be available. We still need to verify
-    // availability in `descriptors`, though.
-    next_index: u32,
+    // The indices that hold a descriptor.
+    used_indices: IndexBitmap,
 }
 
 impl DescriptorTable {
     pub fn new() -> Self {
         DescriptorTable {
-            descriptors: HashMap::new(),
-            available_indices: BTreeSet::new(),
-            next_index: 0,
+            descriptors: Vec::new(),
+            used_indices: IndexBitmap::new(),
         }
     }
 
     /// Add the descriptor at an unused index, and return the index.
-    pub fn add(&mut self, mut descriptor: CompatDescriptor) -> u32 {
-        let idx = if let Some(idx) = self.available_indices.iter().next() {
-            // Un-borrow from `available_indices`.
-            let idx = *idx;
-            // Take from `available_indices`
-            trace!("Reusing available index {}", idx);
-            self.available_indices.remove(&idx);
-            idx
-        } else {
-            // Skip past any indexes that are in use. This can happen after
-            // calling `set` with a value greater than `next_index`.
-            while self.descriptors.contains_key(&self.next_index) {
-                trace!("Skipping past in-use index {}", self.next_index);
-                self.next_index += 1;
-            }
-            // Take the next index.
-            let idx = self.next_index;
-            trace!("Using index {}", idx);
-            self.next_index += 1;
-            idx
-        };
-
-        descriptor.set_handle(idx);
-        let prev = self.descriptors.insert(idx, descriptor);
+    pub fn add(&mut self, descriptor: CompatDescriptor) -> u32 {
+        let idx = self.used_indices.lowest_unused();
+        trace!("Using index {}", idx);
+
+        let prev = self.set(idx, descriptor);
         debug_assert!(prev.is_none(), "Already a descriptor at {}", idx);
 
         idx
     }
 
-    // Call after inserting to `available_indices`, to free any that are contiguous
-    // with `next_index`.
-    fn trim_tail(&mut self) {
-        loop {
-            let last_in_available = match self.available_indices.iter().next_back() {
-                Some(i) => *i,
-                None => break,
-            };
-            if (last_in_available + 1) == self.next_index {
-                // Last entry in available_indices is adjacent to next_index.
-                // We can merge them, freeing an entry in `available_indices`.
-                self.next_index -= 1;
-                self.available_indices.remove(&last_in_available);
-            } else {
-                break;
-            }
-        }
-    }
-
     /// Remove the descriptor at the given index and return it.
     pub fn remove(&mut self, idx: u32) -> Option<CompatDescriptor> {
-        let mut maybe_descriptor = self.descriptors.remove(&idx);
-        self.available_indices.insert(idx);
-        self.trim_tail();
+        let mut maybe_descriptor = self.descriptors.get_mut(idx as usize)?.take();
+        self.used_indices.set(idx, false);
+
+        // Don't keep empty slots at the end around.
+        while let Some(None) = self.descriptors.last() {
+            self.descriptors.pop();
+        }
+
         if let Some(descriptor) = &mut maybe_descriptor {
             descriptor.set_handle(0);
         }
@@ -87,8 +109,9 @@ impl DescriptorTable {
     }
 
     /// Get the descriptor at `idx`, if any.
+    #[inline]
     pub fn get(&self, idx: u32) -> Option<&CompatDescriptor> {
-        self.descriptors.get(&idx)
+        self.descriptors.get(idx as usize)?.as_ref()
     }
 
     /// Insert a descriptor at `index`. If a descriptor is already present at
@@ -100,13 +123,13 @@ impl DescriptorTable {
     ) -> Option<CompatDescriptor> {
         descriptor.set_handle(index);
 
-        // We ensure the index is no longer in `self.available_indices`. We *don't* ensure
-        // `self.next_index` is > `index`, since that'd require adding the indices in between to
-        // `self.available_indices`. It uses less memory and is no more expensive to iterate when
-        // *using* `self.available_indices` instead.
-        self.available_indices.remove(&index);
+        let slot = index as usize;
+        if slot >= self.descriptors.len() {
+            self.descriptors.resize_with(slot + 1, || None);
+        }
+        self.used_indices.set(index, true);
 
-        if let Some(mut prev) = self.descriptors.insert(index, descriptor) {
+        if let Some(mut prev) = self.descriptors[slot].replace(descriptor) {
             trace!("Overwriting index {}", index);
             prev.set_handle(0);
             Some(prev)
@@ -116,13 +139,18 @@ impl DescriptorTable {
         }
     }
 
+    /// The stored descriptors, in index order.
+    fn iter_mut(&mut self) -> impl Iterator<Item = &mut CompatDescriptor> {
+        self.descriptors.iter_mut().filter_map(|x| x.as_mut())
+    }
+
     /// This is a helper function that handles some corner cases where some
     /// descriptors are linked to each other and we must remove that link in
     /// order to ensure that the reference count reaches zero and they are properly
     /// freed. Otherwise the circular reference will prevent the free operation.
     /// TODO: remove this once the TCP layer is better designed.
     pub fn shutdown_helper(&mut self) {
-        for descriptor in self.descriptors.values() {
+        for descriptor in self.iter_mut() {
             match descriptor {
                 CompatDescriptor::New(_) => continue,
                 CompatDescriptor::Legacy(d) => unsafe {
@@ -159,7 +187,7 @@ mod export {
     ) {
         let table = unsafe { table.as_mut().unwrap() };
 
-        for desc in table.descriptors.values_mut() {
+        for desc in table.iter_mut() {
             unsafe { f(desc as *mut _, data) };
         }
     }
@@ -206,14 +234,11 @@ mod export {
         index: c_int,
     ) -> *const CompatDescriptor {
         let table = unsafe { table.as_ref().unwrap() };
-        let index: u32 = match index.try_into() {
-            Ok(i) => i,
-            Err(e) => {
-                debug!("Bad descriptor idx {}: {:?}", index, e);
-                return std::ptr::null();
-            }
-        };
-        match table.get(index) {
+        if index < 0 {
+            debug!("Bad descriptor idx {}", index);
+            return std::ptr::null();
+        }
+        match table.get(index as u32) {
             Some(d) => d as *const CompatDescriptor,
             None => std::ptr::null(),
         }
@@ -246,3 +271,38 @@ mod export {
         table.shutdown_helper();
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_index_bitmap() {
+        let mut bitmap = IndexBitmap::new();
+        assert_eq!(bitmap.lowest_unused(), 0);
+
+        for i in 0..5000 {
+            assert_eq!(bitmap.lowest_unused(), i);
+            bitmap.set(i, true);
+        }
+        assert_eq!(bitmap.lowest_unused(), 5000);
+
+        bitmap.set(4097, false);
+        bitmap.set(70, false);
+        assert_eq!(bitmap.lowest_unused(), 70);
+        bitmap.set(70, true);
+        assert_eq!(bitmap.lowest_unused(), 4097);
+        bitmap.set(3, false);
+        assert_eq!(bitmap.lowest_unused(), 3);
+
+        // indices past the end are unused, and clearing them is a no-op
+        bitmap.set(100_000, false);
+        bitmap.set(3, true);
+        bitmap.set(4097, true);
+        assert_eq!(bitmap.lowest_unused(), 5000);
+
+        // setting a far index doesn't use the indices before it
+        bitmap.set(20_000, true);
+        assert_eq!(bitmap.lowest_unused(), 5000);
+    }
+}
@@ -51,7 +51,11 @@ struct _LegacyDescriptor {
     gint handle;
     LegacyDescriptorType type;
     Status status;
-    GHashTable* listeners;
+    /* How many status change notifications are iterating the listeners. While
+     * non-zero, removed listeners leave a NULL slot rather than moving the others. */
+    guint notifyDepth;
+    /* StatusListeners in the order they were added, or NULL if none were ever added. */
+    GPtrArray* listeners;
     gint referenceCount;
     gint flags;
     // Since this structure is shared with Rust, we should always include the magic struct
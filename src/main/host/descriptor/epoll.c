@@ -87,6 +87,10 @@ struct _EpollWatch {
     /* The last time we reported an event on this watch.
      * This is used to ensure fairness across watches when reporting events. */
     SimulationTime last_reported_event_time;
+    /* links into the epoll ready list, which holds a reference to the watch */
+    EpollWatch* readyPrev;
+    EpollWatch* readyNext;
+    gboolean isInReadyList;
     gint referenceCount;
     MAGIC_DECLARE;
 };
@@ -108,8 +112,12 @@ struct _Epoll {
     /* holds the wrappers for the descriptors we are watching for events */
     GHashTable* watching;
 
-    /* holds the descriptors that we are watching that have events */
-    GHashTable* ready;
+    /* an intrusive list of the watches that have events, in the order in which they
+     * should be reported. watches that stay ready after being reported move to the back,
+     * so that events are reported fairly across watches. */
+    EpollWatch* readyHead;
+    EpollWatch* readyTail;
+    guint readyLength;
 
     /* A counter for sorting watches, for guaranteeing determinism when reporting events. */
     uint64_t watch_id_counter;
@@ -228,6 +236,60 @@ static void _epollwatch_unref(EpollWatch* watch) {
     }
 }
 
+static void _epoll_pushReady(Epoll* epoll, EpollWatch* watch) {
+    utility_assert(!watch->isInReadyList);
+
+    watch->readyPrev = epoll->readyTail;
+    watch->readyNext = NULL;
+    if (epoll->readyTail) {
+        epoll->readyTail->readyNext = watch;
+    } else {
+        epoll->readyHead = watch;
+    }
+    epoll->readyTail = watch;
+    watch->isInReadyList = TRUE;
+    epoll->readyLength++;
+}
+
+static void _epoll_unlinkReady(Epoll* epoll, EpollWatch* watch) {
+    utility_assert(watch->isInReadyList);
+
+    if (watch->readyPrev) {
+        watch->readyPrev->readyNext = watch->readyNext;
+    } else {
+        epoll->readyHead = watch->readyNext;
+    }
+    if (watch->readyNext) {
+        watch->readyNext->readyPrev = watch->readyPrev;
+    } else {
+        epoll->readyTail = watch->readyPrev;
+    }
+    watch->readyPrev = NULL;
+    watch->readyNext = NULL;
+    watch->isInReadyList = FALSE;
+    epoll->readyLength--;
+}
+
+static void _epoll_addReady(Epoll* epoll, EpollWatch* watch) {
+    if (!watch->isInReadyList) {
+        _epollwatch_ref(watch);
+        _epoll_pushReady(epoll, watch);
+    }
+}
+
+static void _epoll_removeReady(Epoll* epoll, EpollWatch* watch) {
+    if (watch->isInReadyList) {
+        _epoll_unlinkReady(epoll, watch);
+        _epollwatch_unref(watch);
+    }
+}
+
+static void _epoll_clearReady(Epoll* epoll) {
+    while (epoll->readyHead) {
+        _epoll_removeReady(epoll, epoll->readyHead);
+    }
+}
+
 static Epoll* _epoll_fromLegacyDescriptor(LegacyDescriptor* descriptor) {
     utility_assert(descriptor_getType(descriptor) == DT_EPOLL);
     return (Epoll*)descriptor;
@@ -239,8 +301,8 @@ static void _epoll_free(LegacyDescriptor* descriptor) {
     MAGIC_ASSERT(epoll);
 
     /* this unrefs all of the remaining watches */
+    _epoll_clearReady(epoll);
     g_hash_table_destroy(epoll->watching);
-    g_hash_table_destroy(epoll->ready);
 
     descriptor_clear((LegacyDescriptor*)epoll);
     MAGIC_CLEAR(epoll);
@@ -292,7 +354,7 @@ void epoll_reset(Epoll* epoll) {
     MAGIC_ASSERT(epoll);
     epoll_clearWatchListeners(epoll);
     // Removing will also unref previously stored descriptors
-    g_hash_table_remove_all(epoll->ready);
+    _epoll_clearReady(epoll);
     g_hash_table_remove_all(epoll->watching);
 }
 
@@ -314,7 +376,6 @@ Epoll* epoll_new() {
 
     /* allocate backend needed for managing events for this descriptor */
     epoll->watching = g_hash_table_new_full(_epollkey_hash, _epollkey_equal, g_free, (GDestroyNotify)_epollwatch_unref);
-    epoll->ready = g_hash_table_new_full(_epollkey_hash, _epollkey_equal, g_free, (GDestroyNotify)_epollwatch_unref);
 
     /* the epoll descriptor itself is always able to be epolled */
     descriptor_adjustStatus(&(epoll->super), STATUS_DESCRIPTOR_ACTIVE, TRUE);
@@ -368,6 +429,22 @@ static void _epollwatch_updateStatus(EpollWatch* watch) {
     }
 }
 
+/* The statuses that can change what the watch reports. Busy sockets flip the statuses
+ * that the watch isn't waiting for on nearly every packet, and skipping those saves
+ * us a callback each time. */
+static Status _epollwatch_getMonitorStatus(EpollWatch* watch) {
+    MAGIC_ASSERT(watch);
+
+    Status status = STATUS_DESCRIPTOR_ACTIVE | STATUS_DESCRIPTOR_CLOSED;
+    if (watch->event.events & EPOLLIN) {
+        status |= STATUS_DESCRIPTOR_READABLE;
+    }
+    if (watch->event.events & EPOLLOUT) {
+        status |= STATUS_DESCRIPTOR_WRITABLE;
+    }
+    return status;
+}
+
 static gboolean _epollwatch_isReady(EpollWatch* watch) {
     MAGIC_ASSERT(watch);
 
@@ -481,15 +558,11 @@ gint epoll_control(Epoll* epoll, gint operation, int fd, const CompatDescriptor*
             gpointer new_key = _epollkey_new(key.fd, key.objectPtr);
             g_hash_table_replace(epoll->watching, new_key, watch);
 
-            /* It's added, so we need to listen for changes. Here we listen for
-             * all statuses, because epoll will filter what it needs.
+            /* It's added, so we need to listen for changes to the statuses it can report.
              * TODO: lean more heavily on statuslistener and simplify epoll.
              */
-            statuslistener_setMonitorStatus(watch->listener,
-                                            STATUS_DESCRIPTOR_ACTIVE | STATUS_DESCRIPTOR_CLOSED |
-                                                STATUS_DESCRIPTOR_READABLE |
-                                                STATUS_DESCRIPTOR_WRITABLE,
-                                            SLF_ALWAYS);
+            statuslistener_setMonitorStatus(
+                watch->listener, _epollwatch_getMonitorStatus(watch), SLF_ALWAYS);
             if (watch->watchType == EWT_LEGACY_DESCRIPTOR) {
                 descriptor_addListener(watch->watchObject.as_descriptor, watch->listener);
             } else if (watch->watchType == EWT_POSIX_FILE) {
@@ -513,6 +586,8 @@ gint epoll_control(Epoll* epoll, gint operation, int fd, const CompatDescriptor*
 
             /* the user set new events */
             watch->event = *event;
+            statuslistener_setMonitorStatus(
+                watch->listener, _epollwatch_getMonitorStatus(watch), SLF_ALWAYS);
             /* we would need to report the new event again if in ET or ONESHOT modes */
             watch->flags &= ~EWF_EDGETRIGGER_REPORTED;
             watch->flags &= ~EWF_ONESHOT_REPORTED;
@@ -540,8 +615,8 @@ gint epoll_control(Epoll* epoll, gint operation, int fd, const CompatDescriptor*
                 posixfile_removeListener(watch->watchObject.as_file, watch->listener);
             }
 
-            /* unref gets called on the watch when it is removed from these tables */
-            g_hash_table_remove(epoll->ready, &key);
+            /* unref gets called on the watch when it is removed from the list and table */
+            _epoll_removeReady(epoll, watch);
             g_hash_table_remove(epoll->watching, &key);
             /* if that was the last watch, this epoll is not readable to its parents */
             _epoll_descriptorStatusChanged(epoll, NULL);
@@ -560,7 +635,7 @@ gint epoll_control(Epoll* epoll, gint operation, int fd, const CompatDescriptor*
 
 guint epoll_getNumReadyEvents(Epoll* epoll) {
     MAGIC_ASSERT(epoll);
-    return g_hash_table_size(epoll->ready);
+    return epoll->readyLength;
 }
 
 gint epoll_getEvents(Epoll* epoll, struct epoll_event* eventArray, gint eventArrayLength, gint* nEvents) {
@@ -571,33 +646,15 @@ gint epoll_getEvents(Epoll* epoll, struct epoll_event* eventArray, gint eventArr
      * overflow. the number of actual events is returned in nEvents. */
     gint eventIndex = 0;
 
-    /*
-     * We need to guarantee that the events are returned in a deterministic order when the
-     * simulation is run multiple times, so we cannot use hash table iterator.
-     * Using a list here has some potential performance implications:
-     * - O(n) to loop the hash table and create the list of values
-     * - O(n) to sort the list
-     * - O(n) for our iteration of the list
-     * We think that the ready list is typically small and so 3*O(n) will be small in practice.
-     * If this turns out not to be the case, we could consider maintaining a sorted object of the
-     * ready watch values alongside the epoll->ready hash table instead, which may allow us
-     * to improve the performance of this function. One option is to use binary trees, e.g.,
-     * https://developer.gnome.org/glib/2.68/glib-Balanced-Binary-Trees.html
-     * We should test the performance before and after such a change.
-     */
-    GList* ready_list = g_hash_table_get_values(epoll->ready);
-    GList* next_item = NULL;
-
-    /* Prepare the list for deterministic iteration. */
-    if (ready_list != NULL) {
-        ready_list = g_list_sort(ready_list, _epollwatch_compare);
-        next_item = g_list_first(ready_list);
-    }
+    /* Visit each watch that was ready on entry at most once, since the ones that stay
+     * ready are moved to the back of the list as we go. The ready list order only depends
+     * on the order of status changes, so the reported events are deterministic. */
+    guint numToVisit = epoll->readyLength;
 
-    /* Iterate the list. */
-    while ((next_item != NULL) && (eventIndex < eventArrayLength)) {
-        EpollWatch* watch = next_item->data;
+    while (numToVisit > 0 && eventIndex < eventArrayLength) {
+        EpollWatch* watch = epoll->readyHead;
         MAGIC_ASSERT(watch);
+        numToVisit--;
 
         if(_epollwatch_isReady(watch)) {
             /* report the event */
@@ -634,12 +691,14 @@ gint epoll_getEvents(Epoll* epoll, struct epoll_event* eventArray, gint eventArr
             }
         }
 
-        next_item = g_list_next(next_item);
-    }
-
-    /* Cleanup just the list but not the list values, which are owned by the hash table. */
-    if (ready_list) {
-        g_list_free(ready_list);
+        if (_epollwatch_isReady(watch)) {
+            /* level-triggered watches stay armed, but go behind the others */
+            _epoll_unlinkReady(epoll, watch);
+            _epoll_pushReady(epoll, watch);
+        } else {
+            /* it's added back when its status changes */
+            _epoll_removeReady(epoll, watch);
+        }
     }
 
     *nEvents = eventIndex;
@@ -668,16 +727,20 @@ static void _epoll_descriptorStatusChanged(Epoll* epoll, const EpollKey* key) {
             /* update the status for the child watch fd */
             _epollwatch_updateStatus(watch);
 
-            /* check if its ready (has an event to report) now */
-            if (_epollwatch_isReady(watch)) {
-                if (!g_hash_table_contains(epoll->ready, key)) {
-                    _epollwatch_ref(watch);
-                    gpointer keyCopy = _epollkey_new(key->fd, key->objectPtr);
-                    g_hash_table_replace(epoll->ready, keyCopy, watch);
-                }
+            /* check if its ready (has an event to report) now. an edge-triggered watch
+             * that is already in the list keeps its place, so repeated edges before the
+             * events are collected are reported once. */
+            gboolean isReady = _epollwatch_isReady(watch);
+            if (isReady == watch->isInReadyList) {
+                /* nothing changed that our parents could see */
+                return;
+            }
+
+            if (isReady) {
+                _epoll_addReady(epoll, watch);
             } else {
-                /* this calls unref on the watch if its in the table */
-                g_hash_table_remove(epoll->ready, key);
+                /* this calls unref on the watch if its in the list */
+                _epoll_removeReady(epoll, watch);
             }
         }
     }
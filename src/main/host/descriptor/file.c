@@ -24,8 +24,12 @@
 #include <unistd.h>
 
 #include "lib/logger/logger.h"
+#include "main/bindings/c/bindings.h"
+#include "main/core/support/config_handlers.h"
 #include "main/core/worker.h"
 #include "main/host/descriptor/descriptor.h"
+#include "main/host/descriptor/file_cache.h"
+#include "main/host/descriptor/file_writer.h"
 #include "main/host/host.h"
 #include "main/host/syscall/kernel_types.h"
 #include "main/routing/dns.h"
@@ -34,6 +38,11 @@
 
 #define OSFILE_INVALID -1
 
+// Buffer the writes to regular files and write them on an I/O thread, instead of
+// blocking the worker on each one.
+static bool _use_file_write_behind = false;
+ADD_CONFIG_HANDLER(config_getUseFileWriteBehind, _use_file_write_behind)
+
 typedef enum _FileType FileType;
 enum _FileType {
     FILE_TYPE_NOTSET,
@@ -54,6 +63,13 @@ struct _File {
         mode_t mode;
         char* abspath;
     } osfile;
+    /* Set if reads are served from the shared file cache. Those reads don't move
+     * the position of the OS-backed file, so we track the position here. */
+    FileCacheEntry* cached;
+    off_t cachedPosition;
+    /* Set if writes are buffered and written behind. Writes must be flushed
+     * before anything else touches the OS-backed file. */
+    FileWriter* writer;
     MAGIC_DECLARE;
 };
 
@@ -79,13 +95,58 @@ static inline int _file_getFD(File* file) {
     return descriptor_getHandle(&file->super);
 }
 
+/* Also waits for any buffered writes to reach the OS-backed file, so that the
+ * caller sees them. */
 static inline int _file_getOSBackedFD(File* file) {
     MAGIC_ASSERT(file);
+    if (file->writer) {
+        filewriter_flush(file->writer);
+    }
     return file->osfile.fd;
 }
 int file_getOSBackedFD(File* file) { return _file_getOSBackedFD(file); }
 
+const char* file_getAbsolutePath(File* file) {
+    MAGIC_ASSERT(file);
+    return file->osfile.abspath;
+}
+
+/* Stop serving reads from the cache, e.g. because the position of the
+ * OS-backed file must be shared with another file. */
+static void _file_uncache(File* file) {
+    if (!file->cached) {
+        return;
+    }
+
+    if (file->osfile.fd != OSFILE_INVALID) {
+        lseek(file->osfile.fd, file->cachedPosition, SEEK_SET);
+    }
+
+    filecacheentry_unref(file->cached);
+    file->cached = NULL;
+}
+
+/* Stop buffering writes, e.g. because another file will write to the same
+ * OS-backed file. */
+static void _file_stopWriteBehind(File* file) {
+    if (!file->writer) {
+        return;
+    }
+
+    filewriter_free(file->writer);
+    file->writer = NULL;
+}
+
 static void _file_closeHelper(File* file) {
+    if (file) {
+        _file_stopWriteBehind(file);
+    }
+
+    if (file && file->cached) {
+        filecacheentry_unref(file->cached);
+        file->cached = NULL;
+    }
+
     if (file && file->osfile.fd != OSFILE_INVALID) {
         trace("On file %i, closing os-backed file %i", _file_getFD(file),
               _file_getOSBackedFD(file));
@@ -154,6 +215,11 @@ File* file_dup(File* file, int* dupError) {
 
     int newFd;
 
+    // the dup shares the file position, which cached reads wouldn't update, and
+    // writes through it could overtake our buffered ones
+    _file_uncache(file);
+    _file_stopWriteBehind(file);
+
     // only dup the os fd if it's valid
     if (file->osfile.fd >= 0) {
         newFd = dup(file->osfile.fd);
@@ -325,6 +391,25 @@ int file_openat(File* file, File* dir, const char* pathname, int flags, mode_t m
     trace("File %i opened os-backed file %i at absolute path %s",
           _file_getFD(file), _file_getOSBackedFD(file), file->osfile.abspath);
 
+    /* Read-only files may be shared by many hosts, so serve them from memory. */
+    FileCache* cache = worker_getFileCache();
+    if (cache && file->type == FILE_TYPE_REGULAR && (flags & O_ACCMODE) == O_RDONLY &&
+        !(flags & (O_PATH | O_DIRECTORY | O_TRUNC))) {
+        file->cached = filecache_get(cache, osfd, abspath);
+        file->cachedPosition = 0;
+        if (file->cached) {
+            trace("File %i reads are served from the file cache", _file_getFD(file));
+        }
+    }
+
+    /* Writes to synchronous files must reach the disk before they return. */
+    if (_use_file_write_behind && file->type == FILE_TYPE_REGULAR &&
+        (flags & O_ACCMODE) != O_RDONLY &&
+        !(flags & (O_PATH | O_DIRECTORY | O_SYNC | O_DSYNC | O_DIRECT))) {
+        file->writer = filewriter_new(osfd);
+        trace("File %i writes are written behind", _file_getFD(file));
+    }
+
     /* The os-backed file is now ready. */
     descriptor_adjustStatus(&file->super, STATUS_DESCRIPTOR_ACTIVE, TRUE);
 
@@ -369,6 +454,12 @@ ssize_t file_read(File* file, Host* host, void* buf, size_t bufSize) {
         return (ssize_t)bufSize;
     }
 
+    if (file->cached) {
+        gsize result = filecacheentry_pread(file->cached, buf, bufSize, file->cachedPosition);
+        file->cachedPosition += result;
+        return (ssize_t)result;
+    }
+
     trace("File %i will read %zu bytes from os-backed file %i at path '%s'",
           _file_getFD(file), bufSize, _file_getOSBackedFD(file),
           file->osfile.abspath);
@@ -391,6 +482,13 @@ ssize_t file_pread(File* file, Host* host, void* buf, size_t bufSize, off_t offs
         return (ssize_t)bufSize;
     }
 
+    if (file->cached) {
+        if (offset < 0) {
+            return -EINVAL;
+        }
+        return (ssize_t)filecacheentry_pread(file->cached, buf, bufSize, offset);
+    }
+
     trace("File %i will pread %zu bytes from os-backed file %i at path '%s'",
           _file_getFD(file), bufSize, _file_getOSBackedFD(file),
           file->osfile.abspath);
@@ -412,6 +510,13 @@ ssize_t file_preadv(File* file, Host* host, const struct iovec* iov, int iovcnt,
         return (ssize_t)_file_readvRandomBytes(file, host, iov, iovcnt);
     }
 
+    if (file->cached) {
+        if (offset < 0) {
+            return -EINVAL;
+        }
+        return (ssize_t)filecacheentry_preadv(file->cached, iov, iovcnt, offset);
+    }
+
     trace("File %i will preadv %d vector items from os-backed file %i at path "
           "'%s'",
           _file_getFD(file), iovcnt, _file_getOSBackedFD(file), file->osfile.abspath);
@@ -435,6 +540,18 @@ ssize_t file_preadv2(File* file, Host* host, const struct iovec* iov, int iovcnt
         return (ssize_t)_file_readvRandomBytes(file, host, iov, iovcnt);
     }
 
+    if (file->cached && offset == -1) {
+        /* use and update the file position */
+        gsize result = filecacheentry_preadv(file->cached, iov, iovcnt, file->cachedPosition);
+        file->cachedPosition += result;
+        return (ssize_t)result;
+    } else if (file->cached) {
+        if (offset < 0) {
+            return -EINVAL;
+        }
+        return (ssize_t)filecacheentry_preadv(file->cached, iov, iovcnt, offset);
+    }
+
     trace("File %i will preadv2 %d vector items from os-backed file %i at path "
           "'%s'",
           _file_getFD(file), iovcnt, _file_getOSBackedFD(file),
@@ -451,6 +568,13 @@ ssize_t file_preadv2(File* file, Host* host, const struct iovec* iov, int iovcnt
 ssize_t file_write(File* file, const void* buf, size_t bufSize) {
     MAGIC_ASSERT(file);
 
+    if (file->writer) {
+        /* don't flush the earlier writes; the I/O thread writes them in order */
+        trace("File %i will buffer %zu bytes for os-backed file %i at path '%s'",
+              _file_getFD(file), bufSize, file->osfile.fd, file->osfile.abspath);
+        return filewriter_write(file->writer, buf, bufSize);
+    }
+
     if (!_file_getOSBackedFD(file)) {
         return -EBADF;
     }
@@ -559,6 +683,14 @@ int file_fsync(File* file) {
     trace("File %i fsync os-backed file %i", _file_getFD(file),
           _file_getOSBackedFD(file));
 
+    /* report the writes that failed in the background, as the kernel would */
+    if (file->writer) {
+        int error = filewriter_takeError(file->writer);
+        if (error) {
+            return error;
+        }
+    }
+
     int result = fsync(_file_getOSBackedFD(file));
     return (result < 0) ? -errno : result;
 }
@@ -744,7 +876,17 @@ off_t file_lseek(File* file, off_t offset, int whence) {
     trace("File %i lseek os-backed file %i", _file_getFD(file),
           _file_getOSBackedFD(file));
 
+    if (file->cached) {
+        /* let the OS handle SEEK_CUR and friends from the position we tracked */
+        if (lseek(_file_getOSBackedFD(file), file->cachedPosition, SEEK_SET) < 0) {
+            return -errno;
+        }
+    }
+
     ssize_t result = lseek(_file_getOSBackedFD(file), offset, whence);
+    if (result >= 0 && file->cached) {
+        file->cachedPosition = result;
+    }
     return (result < 0) ? -errno : result;
 }
 
@@ -804,6 +946,11 @@ int file_fcntl(File* file, unsigned long command, void* arg) {
     trace("File %i fcntl os-backed file %i", _file_getFD(file),
           _file_getOSBackedFD(file));
 
+    /* the file may become synchronous */
+    if (command == F_SETFL) {
+        _file_stopWriteBehind(file);
+    }
+
     int result = fcntl(_file_getOSBackedFD(file), command, arg);
     return (result < 0) ? -errno : result;
 }
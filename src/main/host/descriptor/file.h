@@ -58,6 +58,9 @@ mode_t file_getMode(File* file);
 /* Returns the linux-backed fd that shadow uses to perform the file operations.  */
 int file_getOSBackedFD(File* file);
 
+/* Returns the absolute path that the file was opened at, or NULL if it isn't open. */
+const char* file_getAbsolutePath(File* file);
+
 // ****************************************
 // Operations that require a non-null File*
 // ****************************************
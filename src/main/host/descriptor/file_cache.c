@@ -0,0 +1,233 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/host/descriptor/file_cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib/logger/logger.h"
+#include "main/core/support/definitions.h"
+#include "main/utility/utility.h"
+
+struct _FileCacheEntry {
+    /* identifies the file */
+    dev_t dev;
+    ino_t ino;
+    /* used to detect that the file was modified after we mapped it */
+    off_t size;
+    struct timespec mtime;
+
+    /* NULL if the file is empty */
+    const gchar* data;
+
+    gint referenceCount;
+    MAGIC_DECLARE;
+};
+
+struct _FileCache {
+    /* canonical path of the directory whose files we cache, without a trailing '/' */
+    gchar* rootPath;
+
+    /* the most recently mapped entry for each file, each holding a reference */
+    GHashTable* entries;
+    GMutex lock;
+
+    /* statistics that we log when the cache is freed */
+    guint64 numMapped;
+    guint64 numReused;
+    guint64 bytesMapped;
+
+    MAGIC_DECLARE;
+};
+
+static guint _filecacheentry_hash(gconstpointer key) {
+    const FileCacheEntry* entry = key;
+    guint64 ino = (guint64)entry->ino;
+    return (guint)(ino ^ (ino >> 32)) ^ (guint)entry->dev;
+}
+
+static gboolean _filecacheentry_equal(gconstpointer a, gconstpointer b) {
+    const FileCacheEntry* entryA = a;
+    const FileCacheEntry* entryB = b;
+    return entryA->dev == entryB->dev && entryA->ino == entryB->ino;
+}
+
+static gboolean _filecacheentry_isCurrent(const FileCacheEntry* entry, const struct stat* st) {
+    return entry->size == st->st_size && entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+           entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static FileCacheEntry* _filecacheentry_new(int osfd, const struct stat* st) {
+    const gchar* data = NULL;
+
+    if (st->st_size > 0) {
+        void* mapped = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, osfd, 0);
+        if (mapped == MAP_FAILED) {
+            debug("Unable to map file for the file cache: %s", strerror(errno));
+            return NULL;
+        }
+        data = mapped;
+    }
+
+    FileCacheEntry* entry = g_new0(FileCacheEntry, 1);
+    MAGIC_INIT(entry);
+
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = st->st_mtim;
+    entry->data = data;
+    entry->referenceCount = 1;
+
+    return entry;
+}
+
+static void _filecacheentry_free(FileCacheEntry* entry) {
+    MAGIC_ASSERT(entry);
+
+    if (entry->data) {
+        munmap((void*)entry->data, entry->size);
+    }
+
+    MAGIC_CLEAR(entry);
+    g_free(entry);
+}
+
+void filecacheentry_ref(FileCacheEntry* entry) {
+    MAGIC_ASSERT(entry);
+    g_atomic_int_inc(&entry->referenceCount);
+}
+
+void filecacheentry_unref(FileCacheEntry* entry) {
+    MAGIC_ASSERT(entry);
+    if (g_atomic_int_dec_and_test(&entry->referenceCount)) {
+        _filecacheentry_free(entry);
+    }
+}
+
+gsize filecacheentry_getLength(const FileCacheEntry* entry) {
+    MAGIC_ASSERT(entry);
+    return (gsize)entry->size;
+}
+
+gsize filecacheentry_pread(const FileCacheEntry* entry, void* buf, gsize bufSize, off_t offset) {
+    MAGIC_ASSERT(entry);
+
+    if (offset < 0 || offset >= entry->size) {
+        return 0;
+    }
+
+    gsize length = MIN(bufSize, (gsize)(entry->size - offset));
+    memcpy(buf, entry->data + offset, length);
+    return length;
+}
+
+gsize filecacheentry_preadv(const FileCacheEntry* entry, const struct iovec* iov, int iovcnt,
+                            off_t offset) {
+    MAGIC_ASSERT(entry);
+
+    gsize total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        gsize length = filecacheentry_pread(entry, iov[i].iov_base, iov[i].iov_len, offset + total);
+        total += length;
+        if (length < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+FileCache* filecache_new(const gchar* rootPath) {
+    utility_assert(rootPath);
+
+    char* canonicalRoot = realpath(rootPath, NULL);
+    if (!canonicalRoot) {
+        warning("Not caching files: unable to resolve '%s': %s", rootPath, strerror(errno));
+        return NULL;
+    }
+
+    FileCache* cache = g_new0(FileCache, 1);
+    MAGIC_INIT(cache);
+
+    cache->rootPath = g_strdup(canonicalRoot);
+    free(canonicalRoot);
+
+    /* entries are their own keys; the table holds a reference to each value */
+    cache->entries = g_hash_table_new_full(_filecacheentry_hash, _filecacheentry_equal, NULL,
+                                           (GDestroyNotify)filecacheentry_unref);
+    g_mutex_init(&cache->lock);
+
+    return cache;
+}
+
+void filecache_free(FileCache* cache) {
+    MAGIC_ASSERT(cache);
+
+    info("File cache mapped %" G_GUINT64_FORMAT " files (%" G_GUINT64_FORMAT
+         " bytes) under '%s' and reused them for %" G_GUINT64_FORMAT " other opens",
+         cache->numMapped, cache->bytesMapped, cache->rootPath, cache->numReused);
+
+    g_hash_table_destroy(cache->entries);
+    g_mutex_clear(&cache->lock);
+    g_free(cache->rootPath);
+
+    MAGIC_CLEAR(cache);
+    g_free(cache);
+}
+
+static gboolean _filecache_isUnderRoot(FileCache* cache, const char* abspath) {
+    /* resolve symlinks and ".." so that the file is really under the root */
+    char* canonicalPath = realpath(abspath, NULL);
+    if (!canonicalPath) {
+        return FALSE;
+    }
+
+    gsize rootLength = strlen(cache->rootPath);
+    gboolean isUnderRoot = strncmp(canonicalPath, cache->rootPath, rootLength) == 0 &&
+                           canonicalPath[rootLength] == '/';
+
+    free(canonicalPath);
+    return isUnderRoot;
+}
+
+FileCacheEntry* filecache_get(FileCache* cache, int osfd, const char* abspath) {
+    MAGIC_ASSERT(cache);
+
+    struct stat st = {0};
+    if (fstat(osfd, &st) != 0 || !S_ISREG(st.st_mode) || !_filecache_isUnderRoot(cache, abspath)) {
+        return NULL;
+    }
+
+    FileCacheEntry key = {.dev = st.st_dev, .ino = st.st_ino};
+
+    g_mutex_lock(&cache->lock);
+
+    FileCacheEntry* entry = g_hash_table_lookup(cache->entries, &key);
+
+    if (entry && _filecacheentry_isCurrent(entry, &st)) {
+        cache->numReused++;
+    } else {
+        /* replacing a stale entry drops the table's reference, but any files that
+         * are still open keep the old contents mapped */
+        entry = _filecacheentry_new(osfd, &st);
+        if (entry) {
+            g_hash_table_replace(cache->entries, entry, entry);
+            cache->numMapped++;
+            cache->bytesMapped += (guint64)st.st_size;
+        }
+    }
+
+    if (entry) {
+        filecacheentry_ref(entry);
+    }
+
+    g_mutex_unlock(&cache->lock);
+
+    return entry;
+}
@@ -0,0 +1,42 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SRC_MAIN_HOST_DESCRIPTOR_FILE_CACHE_H_
+#define SRC_MAIN_HOST_DESCRIPTOR_FILE_CACHE_H_
+
+#include <glib.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* A read-only cache of the regular files under a root directory, shared by all
+ * hosts. Each file is mapped into Shadow's memory once, and reads of files that
+ * are opened read-only are served from the mapping instead of from the OS. The
+ * cache can be used from any worker thread. */
+typedef struct _FileCache FileCache;
+
+/* The mapped contents of one file, as they were when it was first opened. */
+typedef struct _FileCacheEntry FileCacheEntry;
+
+FileCache* filecache_new(const gchar* rootPath);
+/* Frees the cache. Entries that are still referenced stay valid until they
+ * are unreferenced. */
+void filecache_free(FileCache* cache);
+
+/* Returns a new reference to the cached contents of the file at abspath that
+ * is open at osfd, or NULL if the file isn't cached. Files are mapped when they
+ * are first opened, and are mapped again if they were modified since. */
+FileCacheEntry* filecache_get(FileCache* cache, int osfd, const char* abspath);
+
+void filecacheentry_ref(FileCacheEntry* entry);
+void filecacheentry_unref(FileCacheEntry* entry);
+
+gsize filecacheentry_getLength(const FileCacheEntry* entry);
+
+/* Like pread() and preadv() on the cached file. Never fails. */
+gsize filecacheentry_pread(const FileCacheEntry* entry, void* buf, gsize bufSize, off_t offset);
+gsize filecacheentry_preadv(const FileCacheEntry* entry, const struct iovec* iov, int iovcnt,
+                            off_t offset);
+
+#endif /* SRC_MAIN_HOST_DESCRIPTOR_FILE_CACHE_H_ */
@@ -0,0 +1,182 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/host/descriptor/file_writer.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "lib/logger/logger.h"
+#include "main/core/support/definitions.h"
+#include "main/utility/utility.h"
+
+/* buffers are handed to the I/O thread once they're this large */
+#define FILE_WRITER_CHUNK_SIZE (64 * 1024)
+/* writers wait for the I/O thread once they have this much that isn't written yet,
+ * so that a slow filesystem can't make the buffers grow without bound */
+#define FILE_WRITER_MAX_IN_FLIGHT (16 * FILE_WRITER_CHUNK_SIZE)
+
+struct _FileWriter {
+    int osfd;
+    /* the writes that we haven't handed to the I/O thread yet */
+    GByteArray* buffer;
+
+    /* protected by _fileWriterLock */
+    gsize inFlightBytes;
+    gint error;
+
+    MAGIC_DECLARE;
+};
+
+typedef struct _FileWriterChunk FileWriterChunk;
+struct _FileWriterChunk {
+    FileWriter* writer;
+    GByteArray* data;
+};
+
+/* the I/O thread and its queue of chunks are shared by all writers */
+static GOnce _fileWriterOnce = G_ONCE_INIT;
+static GAsyncQueue* _fileWriterQueue = NULL;
+static GMutex _fileWriterLock;
+/* signalled when the I/O thread has written a chunk */
+static GCond _fileWriterWritten;
+
+static gint _filewriter_writeAll(int osfd, const guint8* data, gsize len) {
+    while (len > 0) {
+        ssize_t n = write(osfd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static gpointer _filewriter_runIOThread(gpointer unused) {
+    while (TRUE) {
+        FileWriterChunk* chunk = g_async_queue_pop(_fileWriterQueue);
+        FileWriter* writer = chunk->writer;
+
+        gint error = _filewriter_writeAll(writer->osfd, chunk->data->data, chunk->data->len);
+        if (error) {
+            warning("unable to write %u buffered bytes to os-backed file %i: %s",
+                    chunk->data->len, writer->osfd, g_strerror(-error));
+        }
+
+        g_mutex_lock(&_fileWriterLock);
+        writer->inFlightBytes -= chunk->data->len;
+        if (error && !writer->error) {
+            writer->error = error;
+        }
+        g_cond_broadcast(&_fileWriterWritten);
+        g_mutex_unlock(&_fileWriterLock);
+
+        g_byte_array_free(chunk->data, TRUE);
+        g_free(chunk);
+    }
+    return NULL;
+}
+
+static gpointer _filewriter_startIOThread(gpointer unused) {
+    _fileWriterQueue = g_async_queue_new();
+    /* the thread runs until shadow exits */
+    g_thread_unref(g_thread_new("file-writer", _filewriter_runIOThread, NULL));
+    return NULL;
+}
+
+FileWriter* filewriter_new(int osfd) {
+    g_once(&_fileWriterOnce, _filewriter_startIOThread, NULL);
+
+    FileWriter* writer = g_new0(FileWriter, 1);
+    MAGIC_INIT(writer);
+
+    writer->osfd = osfd;
+    writer->buffer = g_byte_array_sized_new(FILE_WRITER_CHUNK_SIZE);
+
+    return writer;
+}
+
+void filewriter_free(FileWriter* writer) {
+    MAGIC_ASSERT(writer);
+
+    filewriter_flush(writer);
+    gint error = filewriter_takeError(writer);
+    if (error) {
+        debug("dropping the error of a buffered write to os-backed file %i: %s", writer->osfd,
+              g_strerror(-error));
+    }
+
+    g_byte_array_free(writer->buffer, TRUE);
+
+    MAGIC_CLEAR(writer);
+    g_free(writer);
+}
+
+/* Hands the buffer to the I/O thread. */
+static void _filewriter_submit(FileWriter* writer) {
+    if (writer->buffer->len == 0) {
+        return;
+    }
+
+    FileWriterChunk* chunk = g_new0(FileWriterChunk, 1);
+    chunk->writer = writer;
+    chunk->data = writer->buffer;
+    writer->buffer = g_byte_array_sized_new(FILE_WRITER_CHUNK_SIZE);
+
+    g_mutex_lock(&_fileWriterLock);
+    writer->inFlightBytes += chunk->data->len;
+    g_mutex_unlock(&_fileWriterLock);
+
+    g_async_queue_push(_fileWriterQueue, chunk);
+}
+
+gssize filewriter_write(FileWriter* writer, const void* buf, gsize bufSize) {
+    MAGIC_ASSERT(writer);
+
+    g_mutex_lock(&_fileWriterLock);
+    while (writer->inFlightBytes > FILE_WRITER_MAX_IN_FLIGHT) {
+        g_cond_wait(&_fileWriterWritten, &_fileWriterLock);
+    }
+    g_mutex_unlock(&_fileWriterLock);
+
+    gint error = filewriter_takeError(writer);
+    if (error) {
+        return error;
+    }
+
+    g_byte_array_append(writer->buffer, buf, bufSize);
+    if (writer->buffer->len >= FILE_WRITER_CHUNK_SIZE) {
+        _filewriter_submit(writer);
+    }
+
+    return bufSize;
+}
+
+void filewriter_flush(FileWriter* writer) {
+    MAGIC_ASSERT(writer);
+
+    _filewriter_submit(writer);
+
+    g_mutex_lock(&_fileWriterLock);
+    while (writer->inFlightBytes > 0) {
+        g_cond_wait(&_fileWriterWritten, &_fileWriterLock);
+    }
+    g_mutex_unlock(&_fileWriterLock);
+}
+
+gint filewriter_takeError(FileWriter* writer) {
+    MAGIC_ASSERT(writer);
+
+    g_mutex_lock(&_fileWriterLock);
+    gint error = writer->error;
+    writer->error = 0;
+    g_mutex_unlock(&_fileWriterLock);
+
+    return error;
+}
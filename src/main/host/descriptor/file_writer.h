@@ -0,0 +1,36 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SRC_MAIN_HOST_DESCRIPTOR_FILE_WRITER_H_
+#define SRC_MAIN_HOST_DESCRIPTOR_FILE_WRITER_H_
+
+#include <glib.h>
+
+/* Buffers the writes to one OS file and writes them behind the caller's back in
+ * large chunks, on an I/O thread that all writers share, so that worker threads
+ * don't wait for the filesystem on every write. The chunks of a writer are
+ * written in order. Callers must flush the writer before doing anything else
+ * with the OS file, so that it sees the earlier writes. */
+typedef struct _FileWriter FileWriter;
+
+/* The writer doesn't own osfd, which must stay open until the writer is freed. */
+FileWriter* filewriter_new(int osfd);
+/* Flushes the writer first. */
+void filewriter_free(FileWriter* writer);
+
+/* Copies the bytes into the buffer, and hands the buffer to the I/O thread once
+ * it's large enough. Returns bufSize, or the negative errno of an earlier write
+ * that failed in the background, in which case nothing is buffered. */
+gssize filewriter_write(FileWriter* writer, const void* buf, gsize bufSize);
+
+/* Waits until the I/O thread has written everything that was written to the
+ * writer. */
+void filewriter_flush(FileWriter* writer);
+
+/* Returns the negative errno of a write that failed in the background since
+ * this was last called, or 0. */
+gint filewriter_takeError(FileWriter* writer);
+
+#endif /* SRC_MAIN_HOST_DESCRIPTOR_FILE_WRITER_H_ */
@@ -4,7 +4,7 @@ use std::sync::Arc;
 
 use crate::cshadow as c;
 use crate::host::syscall_types::SyscallResult;
-use crate::utility::event_queue::{EventQueue, EventSource, Handle};
+use crate::utility::event_queue::{EventQueue, Handle, ListenerSet};
 
 pub mod descriptor_table;
 pub mod pipe;
@@ -116,65 +116,48 @@ impl LegacyStatusListener {
     }
 }
 
+impl Clone for LegacyStatusListener {
+    fn clone(&self) -> Self {
+        Self::new(self.ptr())
+    }
+}
+
 impl Drop for LegacyStatusListener {
     fn drop(&mut self) {
         unsafe { c::statuslistener_unref(self.0.ptr()) };
     }
 }
 
-/// Stores event listener handles so that `c::StatusListener` objects can subscribe to events.
-struct LegacyListenerHelper {
-    handle_map: std::collections::HashMap<usize, Handle<(FileStatus, FileStatus)>>,
-}
+type StatusListenerFn = Arc<dyn Fn(FileStatus, FileStatus, &mut EventQueue) + Send + Sync>;
 
-impl LegacyListenerHelper {
-    fn new() -> Self {
-        Self {
-            handle_map: std::collections::HashMap::new(),
-        }
-    }
-
-    fn add_listener(
-        &mut self,
-        ptr: *mut c::StatusListener,
-        event_source: &mut EventSource<(FileStatus, FileStatus)>,
-    ) {
-        assert!(!ptr.is_null());
-
-        // if it's already listening, don't add a second time
-        if self.handle_map.contains_key(&(ptr as usize)) {
-            return;
-        }
-
-        // this will ref the pointer and unref it when the closure is dropped
-        let ptr_wrapper = LegacyStatusListener::new(ptr);
-
-        let handle = event_source.add_listener(move |(status, changed), _event_queue| unsafe {
-            c::statuslistener_onStatusChanged(ptr_wrapper.ptr(), status.into(), changed.into())
-        });
+/// The callback of a status listener. `c::StatusListener` objects are stored and called directly
+/// rather than wrapped in a closure.
+enum StatusCallback {
+    Fn {
+        monitoring: FileStatus,
+        filter: NewStatusListenerFilter,
+        notify_fn: StatusListenerFn,
+    },
+    Legacy(LegacyStatusListener),
+}
 
-        // use a usize as the key so we don't accidentally deref the pointer
-        self.handle_map.insert(ptr as usize, handle);
-    }
+/// A listener registered with a `StatusEventSource`.
+pub struct StatusListenerEntry(StatusCallback);
 
-    fn remove_listener(&mut self, ptr: *mut c::StatusListener) {
-        assert!(!ptr.is_null());
-        self.handle_map.remove(&(ptr as usize));
-    }
-}
+/// Stops a status listener when dropped.
+pub type StatusListenerHandle = Handle<StatusListenerEntry>;
 
 /// A specified event source that passes a status and the changed bits to the function, but only if
-/// the monitored bits have changed and if the change the filter is satisfied.
+/// the monitored bits have changed and if the change the filter is satisfied. Notifying the
+/// listeners queues one event per listener without allocating.
 struct StatusEventSource {
-    inner: EventSource<(FileStatus, FileStatus)>,
-    legacy_helper: LegacyListenerHelper,
+    listeners: Arc<AtomicRefCell<ListenerSet<StatusListenerEntry>>>,
 }
 
 impl StatusEventSource {
     pub fn new() -> Self {
         Self {
-            inner: EventSource::new(),
-            legacy_helper: LegacyListenerHelper::new(),
+            listeners: ListenerSet::new_shared(),
         }
     }
 
@@ -183,39 +166,42 @@ impl StatusEventSource {
         monitoring: FileStatus,
         filter: NewStatusListenerFilter,
         notify_fn: impl Fn(FileStatus, FileStatus, &mut EventQueue) + Send + Sync + 'static,
-    ) -> Handle<(FileStatus, FileStatus)> {
-        self.inner
-            .add_listener(move |(status, changed), event_queue| {
-                // true if any of the bits we're monitoring have changed
-                let flipped = monitoring.intersects(changed);
-
-                // true if any of the bits we're monitoring are set
-                let on = monitoring.intersects(status);
-
-                let notify = match filter {
-                    // at least one monitored bit is on, and at least one has changed
-                    NewStatusListenerFilter::OffToOn => flipped && on,
-                    // all monitored bits are off, and at least one has changed
-                    NewStatusListenerFilter::OnToOff => flipped && !on,
-                    // at least one monitored bit has changed
-                    NewStatusListenerFilter::Always => flipped,
-                    NewStatusListenerFilter::Never => false,
-                };
-
-                if !notify {
-                    return;
-                }
-
-                (notify_fn)(status, changed, event_queue)
-            })
+    ) -> StatusListenerHandle {
+        ListenerSet::add(
+            &self.listeners,
+            StatusListenerEntry(StatusCallback::Fn {
+                monitoring,
+                filter,
+                notify_fn: Arc::new(notify_fn),
+            }),
+        )
     }
 
     pub fn add_legacy_listener(&mut self, ptr: *mut c::StatusListener) {
-        self.legacy_helper.add_listener(ptr, &mut self.inner);
+        assert!(!ptr.is_null());
+        let mut listeners = self.listeners.borrow_mut();
+
+        // if it's already listening, don't add a second time
+        let is_listening = listeners.iter().any(|l| match &l.0 {
+            StatusCallback::Legacy(legacy) => legacy.ptr() == ptr,
+            _ => false,
+        });
+        if is_listening {
+            return;
+        }
+
+        // this will ref the pointer and unref it when the listener is removed
+        listeners.add_unhandled(StatusListenerEntry(StatusCallback::Legacy(
+            LegacyStatusListener::new(ptr),
+        )));
     }
 
     pub fn remove_legacy_listener(&mut self, ptr: *mut c::StatusListener) {
-        self.legacy_helper.remove_listener(ptr);
+        assert!(!ptr.is_null());
+        self.listeners.borrow_mut().retain(|l| match &l.0 {
+            StatusCallback::Legacy(legacy) => legacy.ptr() != ptr,
+            _ => true,
+        });
     }
 
     pub fn notify_listeners(
@@ -224,7 +210,49 @@ impl StatusEventSource {
         changed: FileStatus,
         event_queue: &mut EventQueue,
     ) {
-        self.inner.notify_listeners((status, changed), event_queue)
+        for l in self.listeners.borrow().iter() {
+            match &l.0 {
+                StatusCallback::Fn {
+                    monitoring,
+                    filter,
+                    notify_fn,
+                } => {
+                    // true if any of the bits we're monitoring have changed
+                    let flipped = monitoring.intersects(changed);
+
+                    // true if any of the bits we're monitoring are set
+                    let on = monitoring.intersects(status);
+
+                    let notify = match filter {
+                        // at least one monitored bit is on, and at least one has changed
+                        NewStatusListenerFilter::OffToOn => flipped && on,
+                        // all monitored bits are off, and at least one has changed
+                        NewStatusListenerFilter::OnToOff => flipped && !on,
+                        // at least one monitored bit has changed
+                        NewStatusListenerFilter::Always => flipped,
+                        NewStatusListenerFilter::Never => false,
+                    };
+
+                    if !notify {
+                        continue;
+                    }
+
+                    let notify_fn = Arc::clone(notify_fn);
+                    event_queue.add(move |event_queue| (notify_fn)(status, changed, event_queue));
+                }
+                StatusCallback::Legacy(legacy) => {
+                    // the C listener applies its own filter
+                    let legacy = legacy.clone();
+                    event_queue.add(move |_event_queue| unsafe {
+                        c::statuslistener_onStatusChanged(
+                            legacy.ptr(),
+                            status.into(),
+                            changed.into(),
+                        )
+                    });
+                }
+            }
+        }
     }
 }
 
@@ -272,6 +300,24 @@ impl PosixFile {
         }
     }
 
+    pub fn peek(&self, bytes: &mut [u8], offset: usize) -> SyscallResult {
+        match self {
+            Self::Pipe(f) => f.peek(bytes, offset),
+        }
+    }
+
+    pub fn consume(&mut self, num: usize, event_queue: &mut EventQueue) -> SyscallResult {
+        match self {
+            Self::Pipe(f) => f.consume(num, event_queue),
+        }
+    }
+
+    pub fn shares_buffer(&self, other: &PosixFile) -> bool {
+        match (self, other) {
+            (Self::Pipe(a), Self::Pipe(b)) => a.shares_buffer(b),
+        }
+    }
+
     pub fn status(&self) -> FileStatus {
         match self {
             Self::Pipe(f) => f.status(),
@@ -432,6 +478,8 @@ impl CompatDescriptor {
 mod export {
     use super::*;
 
+    use crate::host::syscall_types::SyscallError;
+
     /// An opaque type used when passing `*const AtomicRefCell<File>` to C.
     pub enum PosixFileArc {}
 
@@ -517,6 +565,102 @@ mod export {
         unsafe { Arc::from_raw(file as *const AtomicRefCell<PosixFile>) };
     }
 
+    /// Converts the result of a posix file operation to the number of bytes
+    /// or a negative errno.
+    fn result_to_ssize(result: SyscallResult) -> libc::ssize_t {
+        match result {
+            Ok(num) => i64::from(num) as libc::ssize_t,
+            Err(SyscallError::Errno(errno)) => -(errno as libc::ssize_t),
+            Err(e) => panic!("Unexpected result from a posix file: {:?}", e),
+        }
+    }
+
+    /// Copy up to `len` bytes starting `offset` bytes into the posix file without
+    /// removing them. Returns the number of bytes copied, or a negative errno.
+    #[no_mangle]
+    pub extern "C" fn posixfile_peek(
+        file: *const PosixFileArc,
+        offset: libc::size_t,
+        dst: *mut libc::c_void,
+        len: libc::size_t,
+    ) -> libc::ssize_t {
+        assert!(!file.is_null());
+        assert!(!dst.is_null() || len == 0);
+
+        let file = file as *const AtomicRefCell<PosixFile>;
+        let file = unsafe { &*file };
+        let dst = unsafe { std::slice::from_raw_parts_mut(dst as *mut u8, len) };
+
+        result_to_ssize(file.borrow().peek(dst, offset))
+    }
+
+    /// Remove `len` bytes that were previously copied with `posixfile_peek()`.
+    /// Returns the number of bytes removed, or a negative errno.
+    #[no_mangle]
+    pub extern "C" fn posixfile_consume(
+        file: *const PosixFileArc,
+        len: libc::size_t,
+    ) -> libc::ssize_t {
+        assert!(!file.is_null());
+
+        let file = file as *const AtomicRefCell<PosixFile>;
+        let file = unsafe { &*file };
+
+        result_to_ssize(EventQueue::queue_and_run(|event_queue| {
+            file.borrow_mut().consume(len, event_queue)
+        }))
+    }
+
+    /// Write up to `len` bytes from shadow's memory to the posix file. Returns the
+    /// number of bytes written, or a negative errno.
+    #[no_mangle]
+    pub extern "C" fn posixfile_write(
+        file: *const PosixFileArc,
+        src: *const libc::c_void,
+        len: libc::size_t,
+    ) -> libc::ssize_t {
+        assert!(!file.is_null());
+        assert!(!src.is_null() || len == 0);
+
+        let file = file as *const AtomicRefCell<PosixFile>;
+        let file = unsafe { &*file };
+        let src = unsafe { std::slice::from_raw_parts(src as *const u8, len) };
+
+        result_to_ssize(EventQueue::queue_and_run(|event_queue| {
+            file.borrow_mut()
+                .write(std::io::Cursor::new(src), 0, event_queue)
+        }))
+    }
+
+    /// Whether the two posix files are backed by the same buffer, like the two
+    /// ends of a pipe.
+    #[no_mangle]
+    pub extern "C" fn posixfile_sharesBuffer(
+        file: *const PosixFileArc,
+        other: *const PosixFileArc,
+    ) -> bool {
+        assert!(!file.is_null());
+        assert!(!other.is_null());
+
+        let file = file as *const AtomicRefCell<PosixFile>;
+        let file = unsafe { &*file };
+        let other = other as *const AtomicRefCell<PosixFile>;
+        let other = unsafe { &*other };
+
+        file.borrow().shares_buffer(&other.borrow())
+    }
+
+    /// Get the file flags (such as `O_NONBLOCK`) of the posix file object.
+    #[no_mangle]
+    pub extern "C" fn posixfile_getFlags(file: *const PosixFileArc) -> libc::c_int {
+        assert!(!file.is_null());
+
+        let file = file as *const AtomicRefCell<PosixFile>;
+        let file = unsafe { &*file };
+
+        file.borrow().get_flags().bits()
+    }
+
     /// Get the status of the posix file object.
     #[allow(unused_variables)]
     #[no_mangle]
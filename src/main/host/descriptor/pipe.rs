@@ -4,10 +4,11 @@ use std::sync::Arc;
 use crate::cshadow as c;
 use crate::host::descriptor::{
     FileFlags, FileMode, FileStatus, NewStatusListenerFilter, PosixFile, StatusEventSource,
+    StatusListenerHandle,
 };
 use crate::host::syscall_types::SyscallResult;
 use crate::utility::byte_queue::ByteQueue;
-use crate::utility::event_queue::{EventQueue, Handle};
+use crate::utility::event_queue::EventQueue;
 use crate::utility::stream_len::StreamLen;
 
 pub struct PipeFile {
@@ -17,7 +18,7 @@ pub struct PipeFile {
     mode: FileMode,
     flags: FileFlags,
     // we only store this so that the handle is dropped when we are
-    _buffer_event_handle: Option<Handle<(FileStatus, FileStatus)>>,
+    _buffer_event_handle: Option<StatusListenerHandle>,
 }
 
 impl PipeFile {
@@ -118,6 +119,41 @@ impl PipeFile {
         }
     }
 
+    /// Copies bytes starting `offset` bytes into the pipe without removing
+    /// them. Used by `splice` and `tee`, which only remove the bytes that the
+    /// destination accepted (if any).
+    pub fn peek(&self, bytes: &mut [u8], offset: usize) -> SyscallResult {
+        // if the file is not open for reading, return EBADF
+        if !self.mode.contains(FileMode::READ) {
+            return Err(nix::errno::Errno::EBADF.into());
+        }
+
+        let num_peeked = self.buffer.borrow().peek(bytes, offset);
+
+        if num_peeked == 0 && !bytes.is_empty() {
+            Err(nix::errno::EWOULDBLOCK.into())
+        } else {
+            Ok(num_peeked.into())
+        }
+    }
+
+    /// Removes `num` bytes that were previously returned by
+    /// [`PipeFile::peek`].
+    pub fn consume(&mut self, num: usize, event_queue: &mut EventQueue) -> SyscallResult {
+        // if the file is not open for reading, return EBADF
+        if !self.mode.contains(FileMode::READ) {
+            return Err(nix::errno::Errno::EBADF.into());
+        }
+
+        self.buffer.borrow_mut().consume(num, event_queue)
+    }
+
+    /// Whether `other` is an end of the same pipe, such as its read end and
+    /// write end. `tee` can't copy a pipe into itself.
+    pub fn shares_buffer(&self, other: &PipeFile) -> bool {
+        Arc::ptr_eq(&self.buffer, &other.buffer)
+    }
+
     pub fn enable_notifications(arc: &Arc<AtomicRefCell<PosixFile>>) {
         // we remove some of these later in this function
         let monitoring = FileStatus::READABLE | FileStatus::WRITABLE;
@@ -156,7 +192,7 @@ impl PipeFile {
         monitoring: FileStatus,
         filter: NewStatusListenerFilter,
         notify_fn: impl Fn(FileStatus, FileStatus, &mut EventQueue) + Send + Sync + 'static,
-    ) -> Handle<(FileStatus, FileStatus)> {
+    ) -> StatusListenerHandle {
         self.event_source
             .add_listener(monitoring, filter, notify_fn)
     }
@@ -244,16 +280,42 @@ impl SharedBuf {
         event_queue: &mut EventQueue,
     ) -> SyscallResult {
         let num = self.queue.pop(bytes)?;
+        self.refresh_status(event_queue);
 
-        // readable if not empty
-        self.adjust_status(FileStatus::READABLE, !self.is_empty(), event_queue);
+        Ok(num.into())
+    }
 
-        // writable if space is available
-        self.adjust_status(
-            FileStatus::WRITABLE,
-            self.space_available() > 0,
-            event_queue,
-        );
+    /// Copies bytes starting `offset` bytes into the buffer, without removing
+    /// them. Returns the number of bytes copied.
+    pub fn peek(&self, bytes: &mut [u8], offset: usize) -> usize {
+        let mut skip = offset;
+        let mut copied = 0;
+
+        for slice in self.queue.readable_slices() {
+            if copied == bytes.len() {
+                break;
+            }
+            if skip >= slice.len() {
+                skip -= slice.len();
+                continue;
+            }
+
+            let slice = &slice[skip..];
+            skip = 0;
+
+            let num = std::cmp::min(slice.len(), bytes.len() - copied);
+            bytes[copied..copied + num].copy_from_slice(&slice[..num]);
+            copied += num;
+        }
+
+        copied
+    }
+
+    /// Removes `num` bytes from the front of the buffer.
+    pub fn consume(&mut self, num: usize, event_queue: &mut EventQueue) -> SyscallResult {
+        let num = std::cmp::min(num, self.queue.len());
+        self.queue.consume(num);
+        self.refresh_status(event_queue);
 
         Ok(num.into())
     }
@@ -264,13 +326,7 @@ impl SharedBuf {
         event_queue: &mut EventQueue,
     ) -> SyscallResult {
         let written = self.queue.push(bytes.take(self.space_available() as u64))?;
-
-        self.adjust_status(FileStatus::READABLE, !self.is_empty(), event_queue);
-        self.adjust_status(
-            FileStatus::WRITABLE,
-            self.space_available() > 0,
-            event_queue,
-        );
+        self.refresh_status(event_queue);
 
         Ok(written.into())
     }
@@ -280,7 +336,7 @@ impl SharedBuf {
         monitoring: FileStatus,
         filter: NewStatusListenerFilter,
         notify_fn: impl Fn(FileStatus, FileStatus, &mut EventQueue) + Send + Sync + 'static,
-    ) -> Handle<(FileStatus, FileStatus)> {
+    ) -> StatusListenerHandle {
         self.event_source
             .add_listener(monitoring, filter, notify_fn)
     }
@@ -289,6 +345,18 @@ impl SharedBuf {
         self.status
     }
 
+    fn refresh_status(&mut self, event_queue: &mut EventQueue) {
+        // readable if not empty
+        self.adjust_status(FileStatus::READABLE, !self.is_empty(), event_queue);
+
+        // writable if space is available
+        self.adjust_status(
+            FileStatus::WRITABLE,
+            self.space_available() > 0,
+            event_queue,
+        );
+    }
+
     fn adjust_status(
         &mut self,
         status: FileStatus,
@@ -45,20 +45,9 @@ static void _socket_free(LegacyDescriptor* descriptor) {
         g_free(socket->unixPath);
     }
 
-    while(g_queue_get_length(socket->inputBuffer) > 0) {
-        packet_unref(g_queue_pop_head(socket->inputBuffer));
-    }
-    g_queue_free(socket->inputBuffer);
-
-    while(g_queue_get_length(socket->outputBuffer) > 0) {
-        packet_unref(g_queue_pop_head(socket->outputBuffer));
-    }
-    g_queue_free(socket->outputBuffer);
-
-    while(g_queue_get_length(socket->outputControlBuffer) > 0) {
-        packet_unref(g_queue_pop_head(socket->outputControlBuffer));
-    }
-    g_queue_free(socket->outputControlBuffer);
+    packetqueue_clear(&socket->inputBuffer);
+    packetqueue_clear(&socket->outputBuffer);
+    packetqueue_clear(&socket->outputControlBuffer);
 
     // TODO: assertion errors will occur if the subclass uses the socket
     // during the free call. This could be fixed by making all descriptor types
@@ -110,10 +99,10 @@ void socket_init(Socket* socket, Host* host, SocketFunctionTable* vtable, Legacy
     socket->vtable = vtable;
 
     socket->protocol = type == DT_TCPSOCKET ? PTCP : type == DT_UDPSOCKET ? PUDP : PLOCAL;
-    socket->inputBuffer = g_queue_new();
+    socket->inputBuffer = (PacketQueue)PACKET_QUEUE_INIT;
     socket->inputBufferSize = receiveBufferSize;
-    socket->outputBuffer = g_queue_new();
-    socket->outputControlBuffer = g_queue_new();
+    socket->outputBuffer = (PacketQueue)PACKET_QUEUE_INIT;
+    socket->outputControlBuffer = (PacketQueue)PACKET_QUEUE_INIT;
     socket->outputBufferSize = sendBufferSize;
 
     Tracker* tracker = host_getTracker(host);
@@ -167,16 +156,21 @@ Packet* socket_pullOutPacket(Socket* socket, Host* host) {
 
 Packet* socket_peekNextOutPacket(const Socket* socket) {
     MAGIC_ASSERT(socket);
-    if(!g_queue_is_empty(socket->outputControlBuffer)) {
-        return g_queue_peek_head(socket->outputControlBuffer);
+    if(!packetqueue_isEmpty(&socket->outputControlBuffer)) {
+        return packetqueue_peek(&socket->outputControlBuffer);
     } else {
-        return g_queue_peek_head(socket->outputBuffer);
+        return packetqueue_peek(&socket->outputBuffer);
     }
 }
 
 Packet* socket_peekNextInPacket(const Socket* socket) {
     MAGIC_ASSERT(socket);
-    return g_queue_peek_head(socket->inputBuffer);
+    return packetqueue_peek(&socket->inputBuffer);
+}
+
+SocketQueueLink* socket_getQueueLinks(Socket* socket) {
+    MAGIC_ASSERT(socket);
+    return socket->queueLinks;
 }
 
 gboolean socket_getPeerName(Socket* socket, in_addr_t* ip, in_port_t* port) {
@@ -337,9 +331,14 @@ gboolean socket_addToInputBuffer(Socket* socket, Host* host, Packet* packet) {
         return FALSE;
     }
 
-    /* add to our queue */
-    g_queue_push_tail(socket->inputBuffer, packet);
-    packet_ref(packet);
+    /* add to our queue, which holds its own reference.
+     * a packet can only be in one queue, so queue a copy if it's already in one. */
+    if(packet_isQueued(packet)) {
+        packet = packet_copy(packet);
+    } else {
+        packet_ref(packet);
+    }
+    packetqueue_push(&socket->inputBuffer, packet);
     socket->inputBufferLength += length;
     packet_addDeliveryStatus(packet, PDS_RCV_SOCKET_BUFFERED);
 
@@ -360,7 +359,7 @@ Packet* socket_removeFromInputBuffer(Socket* socket, Host* host) {
     MAGIC_ASSERT(socket);
 
     /* see if we have any packets */
-    Packet* packet = g_queue_pop_head(socket->inputBuffer);
+    Packet* packet = packetqueue_pop(&socket->inputBuffer);
     if(packet) {
         /* just removed a packet */
         guint length = packet_getPayloadLength(packet);
@@ -407,12 +406,21 @@ gboolean socket_addToOutputBuffer(Socket* socket, Host* host, Packet* packet) {
         return FALSE;
     }
 
+    /* a packet can only be in one queue, so if TCP retransmits a packet that is still
+     * waiting in our buffer, queue a copy of it instead. the queued original keeps its
+     * own reference. */
+    if(packet_isQueued(packet)) {
+        Packet* copy = packet_copy(packet);
+        packet_unref(packet);
+        packet = copy;
+    }
+
     /* add to our queue */
     if(packet_getPriority(packet) == 0.0f) {
         /* control packets get sent first */
-        g_queue_push_tail(socket->outputControlBuffer, packet);
+        packetqueue_push(&socket->outputControlBuffer, packet);
     } else {
-        g_queue_push_tail(socket->outputBuffer, packet);
+        packetqueue_push(&socket->outputBuffer, packet);
     }
 
     socket->outputBufferLength += length;
@@ -441,8 +449,9 @@ Packet* socket_removeFromOutputBuffer(Socket* socket, Host* host) {
     MAGIC_ASSERT(socket);
 
     /* see if we have any packets */
-    Packet* packet = !g_queue_is_empty(socket->outputControlBuffer) ?
-            g_queue_pop_head(socket->outputControlBuffer) : g_queue_pop_head(socket->outputBuffer);
+    Packet* packet = !packetqueue_isEmpty(&socket->outputControlBuffer)
+                         ? packetqueue_pop(&socket->outputControlBuffer)
+                         : packetqueue_pop(&socket->outputBuffer);
 
     if(packet) {
         /* just removed a packet */
@@ -489,3 +498,23 @@ gchar* socket_getUnixPath(Socket* socket) {
     MAGIC_ASSERT(socket);
     return socket->unixPath;
 }
+
+gboolean socket_isReusePort(Socket* socket) {
+    MAGIC_ASSERT(socket);
+    return (socket->flags & SF_REUSE_PORT) ? TRUE : FALSE;
+}
+
+void socket_setReusePort(Socket* socket, gboolean reusePort) {
+    MAGIC_ASSERT(socket);
+    socket->flags = reusePort ? (socket->flags | SF_REUSE_PORT) : (socket->flags & ~SF_REUSE_PORT);
+}
+
+gboolean socket_isHostOwned(Socket* socket) {
+    MAGIC_ASSERT(socket);
+    return (socket->flags & SF_HOST_OWNED) ? TRUE : FALSE;
+}
+
+void socket_setHostOwned(Socket* socket, gboolean hostOwned) {
+    MAGIC_ASSERT(socket);
+    socket->flags = hostOwned ? (socket->flags | SF_HOST_OWNED) : (socket->flags & ~SF_HOST_OWNED);
+}
@@ -9,6 +9,7 @@
 
 #include <glib.h>
 #include <netinet/in.h>
+#include <stdint.h>
 #include <sys/un.h>
 
 #include "main/core/support/definitions.h"
@@ -38,11 +39,28 @@ struct _SocketFunctionTable {
     MAGIC_DECLARE_ALWAYS;
 };
 
+/* A socket waits in the send queue of each network interface that it has packets
+ * for, which is at most the loopback and the ethernet interface. */
+#define SOCKET_MAX_QUEUE_LINKS 2
+
+/* Tracks the socket in a network interface send queue without allocating. */
+typedef struct _SocketQueueLink SocketQueueLink;
+struct _SocketQueueLink {
+    /* the queue holding the socket, or NULL if this link is unused */
+    const void* queue;
+    /* the next socket in a round-robin queue, as a tagged CompatSocket */
+    uintptr_t next;
+    /* the position of the socket in a fifo queue heap */
+    guint index;
+};
+
 enum SocketFlags {
     SF_NONE = 0,
     SF_BOUND = 1 << 0,
     SF_UNIX = 1 << 1,
     SF_UNIX_BOUND = 1 << 2,
+    SF_REUSE_PORT = 1 << 3,
+    SF_HOST_OWNED = 1 << 4,
 };
 
 struct _Socket {
@@ -63,18 +81,21 @@ struct _Socket {
     gchar* unixPath;
 
     /* buffering packets readable by user */
-    GQueue* inputBuffer;
+    PacketQueue inputBuffer;
     gsize inputBufferSize;
     gsize inputBufferSizePending;
     gsize inputBufferLength;
 
     /* buffering packets ready to send */
-    GQueue* outputBuffer;
-    GQueue* outputControlBuffer;
+    PacketQueue outputBuffer;
+    PacketQueue outputControlBuffer;
     gsize outputBufferSize;
     gsize outputBufferSizePending;
     gsize outputBufferLength;
 
+    /* links for the interface queues of sockets that want to send */
+    SocketQueueLink queueLinks[SOCKET_MAX_QUEUE_LINKS];
+
     MAGIC_DECLARE_ALWAYS;
 };
 
@@ -86,6 +107,7 @@ void socket_dropPacket(Socket* socket, Host* host, Packet* packet);
 Packet* socket_pullOutPacket(Socket* socket, Host* host);
 Packet* socket_peekNextOutPacket(const Socket* socket);
 Packet* socket_peekNextInPacket(const Socket* socket);
+SocketQueueLink* socket_getQueueLinks(Socket* socket);
 
 gsize socket_getInputBufferSize(Socket* socket);
 void socket_setInputBufferSize(Socket* socket, gsize newSize);
@@ -118,4 +140,14 @@ void socket_setUnix(Socket* socket, gboolean isUnixSocket);
 void socket_setUnixPath(Socket* socket, const gchar* path, gboolean isBound);
 gchar* socket_getUnixPath(Socket* socket);
 
+/* Whether the socket may bind to the same address and port as other sockets that
+ * set SO_REUSEPORT, which then share the packets sent there. */
+gboolean socket_isReusePort(Socket* socket);
+void socket_setReusePort(Socket* socket, gboolean reusePort);
+
+/* Whether the socket belongs to the host's traffic model rather than to a process.
+ * Children that a host-owned server accepts are host-owned too. */
+gboolean socket_isHostOwned(Socket* socket);
+void socket_setHostOwned(Socket* socket, gboolean hostOwned);
+
 #endif /* SHD_SOCKET_H_ */
@@ -26,16 +26,23 @@
 #include "main/host/descriptor/descriptor.h"
 #include "main/host/descriptor/socket.h"
 #include "main/host/descriptor/tcp_cong.h"
+#include "main/host/descriptor/tcp_cong_bbr.h"
+#include "main/host/descriptor/tcp_cong_cubic.h"
 #include "main/host/descriptor/tcp_cong_reno.h"
 #include "main/host/descriptor/tcp_retransmit_tally.h"
+#include "main/host/bound_socket_table.h"
 #include "main/host/descriptor/transport.h"
 #include "main/host/host.h"
 #include "main/host/network_interface.h"
 #include "main/host/protocol.h"
+#include "main/host/timer_wheel.h"
 #include "main/host/tracker.h"
+#include "main/host/traffic_model.h"
 #include "main/routing/address.h"
 #include "main/routing/packet.h"
 #include "main/utility/priority_queue.h"
+#include "main/utility/seq_ring.h"
+#include "main/utility/tracepoint.h"
 #include "main/utility/utility.h"
 
 enum TCPState {
@@ -90,19 +97,26 @@ enum TCPReceiveState {
 typedef struct _TCPChild TCPChild;
 struct _TCPChild {
     enum TCPChildState state;
-    guint key; /* hash(peerIP, peerPort) */
+    /* the peer's address and port, which the parent finds us by */
+    BoundSocketKey key;
     TCP* parent;
+    /* links into the parent's accept queue while we are TCPCS_PENDING */
+    TCP* pendingPrev;
+    TCP* pendingNext;
     MAGIC_DECLARE;
 };
 
 typedef struct _TCPServer TCPServer;
 struct _TCPServer {
-    /* all children of this server */
-    GHashTable* children;
-    /* pending children to accept in order. */
-    GQueue *pending;
-    /* maximum number of pending connections (capped at SOMAXCONN = 128) */
-    gint pendingMaxLength;
+    /* all children of this server, which the table holds a reference to */
+    BoundSocketTable* children;
+    /* pending children to accept in order, linked through their TCPChild */
+    TCP* pendingHead;
+    TCP* pendingTail;
+    guint pendingLength;
+    /* the listen backlog, capped at SOMAXCONN. like Linux, we accept new connections
+     * until more than this many are pending. */
+    guint pendingMaxLength;
     /* IP and port of the last peer trying to connect to us */
     in_addr_t lastPeerIP;
     in_port_t lastPeerPort;
@@ -142,7 +156,6 @@ struct _TCP {
         guint32 lastAcknowledgment;
         guint32 lastSequence;
         gboolean windowUpdatePending;
-        GList* lastSelectiveACKs;
     } receive;
 
     /* sequence numbers we track for outgoing packets */
@@ -165,22 +178,27 @@ struct _TCP {
         guint32 packetsSent;
         /* total number of quick acknowledgments sent */
         guint32 numQuickACKsSent;
-        gboolean delayedACKIsScheduled;
+        /* sends the ACK for the packets received since it was scheduled */
+        TimerWheelEntry delayedACKTimer;
         guint32 delayedACKCounter;
-        /* list of selective ACKs, packets received after a missing packet */
-        GList* selectiveACKs;
+        /* delay ACKs like Linux rather than for a fixed time */
+        gboolean linuxDelayedACKs;
+        /* selective ACKs, packets received after a missing packet. holds sorted,
+         * non-overlapping and non-adjacent PacketTCPSackBlocks */
+        GArray* selectiveACKs;
     } send;
 
     struct {
-        /* TCP provides reliable transport, keep track of packets until they are acked */
-        GHashTable* queue;
+        /* TCP provides reliable transport, keep track of packets until they are acked.
+         * indexed by sequence number, so clearing acked packets is cheap */
+        SeqRing* queue;
         /* track amount of queued application data */
         gsize queueLength;
         /* retransmission timeout value (rto), in milliseconds */
         gint timeout;
-        /* when the scheduled timer events will expire; empty if no retransmit is scheduled */
-        PriorityQueue* scheduledTimerExpirations;
-        /* our updated expiration time, to determine if previous events are still valid */
+        /* fires at desiredTimerExpiration when the timer is running */
+        TimerWheelEntry timer;
+        /* when the retransmit timer expires, or 0 if it is not running */
         SimulationTime desiredTimerExpiration;
         /* number of times we backed off due to congestion */
         guint backoffCount;
@@ -197,6 +215,10 @@ struct _TCP {
         gsize bytesCopied;
         SimulationTime lastAdjustment;
         gsize space;
+        /* the speeds of the host's default interface in KiBps, which never change, so we
+         * look them up once rather than every time we autotune. 0 until then. */
+        guint32 speedUpKiBps;
+        guint32 speedDownKiBps;
     } autotune;
 
     /* congestion object for implementing different types of congestion control (aimd, reno, cubic) */
@@ -207,6 +229,9 @@ struct _TCP {
       gint rttVariance;
     } timing;
 
+    /* finishes closing the connection after the TIME-WAIT period */
+    TimerWheelEntry closeTimer;
+
     /* TODO: these should probably be stamped when the network interface sends
      * instead of when the tcp layer sends down to the socket layer */
     struct {
@@ -261,6 +286,33 @@ static TCP* _tcp_fromLegacyDescriptor(LegacyDescriptor* descriptor) {
     return (TCP*)descriptor;
 }
 
+/* Registers a child that the server parent just multiplexed with whatever owns the
+ * parent, which takes the child's initial reference. */
+static void _tcp_registerChild(TCP* parent, TCP* child, Host* host) {
+    if (socket_isHostOwned(&parent->super)) {
+        socket_setHostOwned(&child->super, TRUE);
+        trafficmodel_registerSocket(host_getTrafficModel(host), child);
+    } else {
+        process_registerLegacyDescriptor(
+            descriptor_getOwnerProcess((LegacyDescriptor*)parent), (LegacyDescriptor*)child);
+    }
+}
+
+/* Drops the owner's reference, which will unbind from the network interface and
+ * free the socket once nothing else refers to it. */
+static void _tcp_deregister(TCP* tcp, Host* host) {
+    if (socket_isHostOwned(&tcp->super)) {
+        TrafficModel* model = host_getTrafficModel(host);
+        /* the model may already be gone if the host is shutting down */
+        if (model) {
+            trafficmodel_deregisterSocket(model, tcp);
+        }
+    } else {
+        LegacyDescriptor* desc = (LegacyDescriptor*)tcp;
+        process_deregisterLegacyDescriptor(descriptor_getOwnerProcess(desc), desc);
+    }
+}
+
 static TCPChild* _tcpchild_new(TCP* tcp, TCP* parent, in_addr_t peerIP, in_port_t peerPort) {
     MAGIC_ASSERT(tcp);
     MAGIC_ASSERT(parent);
@@ -268,8 +320,8 @@ static TCPChild* _tcpchild_new(TCP* tcp, TCP* parent, in_addr_t peerIP, in_port_
     TCPChild* child = g_new0(TCPChild, 1);
     MAGIC_INIT(child);
 
-    /* my parent can find me by my key */
-    child->key = utility_ipPortHash(peerIP, peerPort);
+    /* my parent can find me by my key. all of its children share its local address. */
+    child->key = boundsocketkey_new(PTCP, 0, 0, peerIP, peerPort);
 
     descriptor_ref(parent);
     child->parent = parent;
@@ -299,40 +351,106 @@ static void _tcpchild_free(TCPChild* child) {
     g_free(child);
 }
 
+/* like listen() in Linux, which treats a negative backlog as a large one */
+static guint _tcpserver_clampBacklog(gint backlog) {
+    return (guint)backlog > SOMAXCONN ? SOMAXCONN : (guint)backlog;
+}
+
 static TCPServer* _tcpserver_new(gint backlog) {
     TCPServer* server = g_new0(TCPServer, 1);
     MAGIC_INIT(server);
 
-    server->children = g_hash_table_new_full(g_int_hash, g_int_equal, NULL, (GDestroyNotify) descriptor_unref);
-    server->pending = g_queue_new();
-    server->pendingMaxLength = backlog;
+    server->children = boundsockettable_new((GDestroyNotify)descriptor_unref);
+    server->pendingMaxLength = _tcpserver_clampBacklog(backlog);
 
     return server;
 }
 
+/* Unrefs all children. The table is detached first, so children that are freed
+ * as a result don't try to remove themselves from it. */
+static void _tcpserver_clearChildren(TCPServer* server) {
+    BoundSocketTable* children = server->children;
+    server->children = NULL;
+    if (children) {
+        boundsockettable_free(children);
+    }
+}
+
 static void _tcpserver_free(TCPServer* server) {
     MAGIC_ASSERT(server);
 
-    /* no need to destroy children in this queue */
-    g_queue_free(server->pending);
-    /* this will unref all children */
-    if(server->children) {
-        g_hash_table_destroy(server->children);
-    }
+    /* the pending children hold a reference to us, so they must all be gone */
+    utility_assert(server->pendingLength == 0);
+    _tcpserver_clearChildren(server);
 
     MAGIC_CLEAR(server);
     g_free(server);
 }
 
+static guint _tcpserver_getNumChildren(TCPServer* server) {
+    MAGIC_ASSERT(server);
+    return server->children ? boundsockettable_getLength(server->children) : 0;
+}
+
+/* Removes the server's reference to tcp, unless another child for the same peer
+ * has already replaced it. */
+static void _tcpserver_removeChild(TCPServer* server, TCP* tcp) {
+    MAGIC_ASSERT(server);
+    if (server->children && boundsockettable_lookup(server->children, &tcp->child->key) == tcp) {
+        boundsockettable_remove(server->children, &tcp->child->key);
+    }
+}
+
+static gboolean _tcpserver_isAcceptQueueFull(TCPServer* server) {
+    MAGIC_ASSERT(server);
+    return server->pendingLength > server->pendingMaxLength;
+}
+
+static void _tcpserver_pushPending(TCPServer* server, TCP* tcp) {
+    MAGIC_ASSERT(server);
+    utility_assert(tcp->child->state != TCPCS_PENDING);
+
+    tcp->child->state = TCPCS_PENDING;
+    tcp->child->pendingPrev = server->pendingTail;
+    tcp->child->pendingNext = NULL;
+    if (server->pendingTail) {
+        server->pendingTail->child->pendingNext = tcp;
+    } else {
+        server->pendingHead = tcp;
+    }
+    server->pendingTail = tcp;
+    server->pendingLength++;
+}
+
+/* Unlinks tcp from the accept queue, leaving its state for the caller to set. */
+static void _tcpserver_removePending(TCPServer* server, TCP* tcp) {
+    MAGIC_ASSERT(server);
+    utility_assert(tcp->child->state == TCPCS_PENDING);
+
+    TCPChild* child = tcp->child;
+    if (child->pendingPrev) {
+        child->pendingPrev->child->pendingNext = child->pendingNext;
+    } else {
+        server->pendingHead = child->pendingNext;
+    }
+    if (child->pendingNext) {
+        child->pendingNext->child->pendingPrev = child->pendingPrev;
+    } else {
+        server->pendingTail = child->pendingPrev;
+    }
+    child->pendingPrev = NULL;
+    child->pendingNext = NULL;
+    server->pendingLength--;
+}
+
 struct TCPCong_ *tcp_cong(TCP *tcp) {
     return &tcp->cong;
 }
 
 void tcp_clearAllChildrenIfServer(TCP* tcp) {
     MAGIC_ASSERT(tcp);
-    if(tcp->server && tcp->server->children) {
-        g_hash_table_destroy(tcp->server->children);
-        tcp->server->children = NULL;
+    if(tcp->server) {
+        _tcpserver_clearChildren(tcp->server);
     }
 }
 
@@ -410,17 +528,22 @@ static guint _tcp_calculateRTT(TCP* tcp, Host* host) {
 }
 
 static gsize _tcp_computeRTTMEM(TCP* tcp, Host* host, gboolean isRMEM) {
-    Address* address = host_getDefaultAddress(host);
-    in_addr_t ip = (in_addr_t)address_toNetworkIP(address);
+    if (tcp->autotune.speedUpKiBps == 0 && tcp->autotune.speedDownKiBps == 0) {
+        Address* address = host_getDefaultAddress(host);
+        in_addr_t ip = (in_addr_t)address_toNetworkIP(address);
+
+        NetworkInterface* interface = host_lookupInterface(host, ip);
+        g_assert(interface);
 
-    NetworkInterface* interface = host_lookupInterface(host, ip);
-    g_assert(interface);
+        tcp->autotune.speedUpKiBps = networkinterface_getSpeedUpKiBps(interface);
+        tcp->autotune.speedDownKiBps = networkinterface_getSpeedDownKiBps(interface);
+    }
 
     gsize bw_KiBps = 0;
     if(isRMEM) {
-        bw_KiBps = (gsize)networkinterface_getSpeedDownKiBps(interface);
+        bw_KiBps = (gsize)tcp->autotune.speedDownKiBps;
     } else {
-        bw_KiBps = (gsize)networkinterface_getSpeedUpKiBps(interface);
+        bw_KiBps = (gsize)tcp->autotune.speedUpKiBps;
     }
 
     gsize bw_Bps = bw_KiBps * 1024;
@@ -604,7 +727,7 @@ void tcp_disableReceiveBufferAutotuning(TCP* tcp) {
 }
 
 // XXX declaration
-static void _tcp_runCloseTimerExpiredTask(Host* host, gpointer tcp, gpointer userData);
+static void _tcp_runCloseTimerExpired(Host* host, gpointer tcp);
 static void _tcp_clearRetransmit(TCP* tcp, guint sequence);
 
 static void _tcp_setState(TCP* tcp, Host* host, enum TCPState state) {
@@ -650,28 +773,21 @@ static void _tcp_setState(TCP* tcp, Host* host, enum TCPState state) {
              * servers have to wait for all children to close.
              * children need to notify their parents when closing.
              */
-            if(!tcp->server || g_hash_table_size(tcp->server->children) <= 0) {
+            if(!tcp->server || _tcpserver_getNumChildren(tcp->server) == 0) {
                 if(tcp->child && tcp->child->parent) {
                     TCP* parent = tcp->child->parent;
                     utility_assert(parent->server);
 
-                    /* tell my server to stop accepting packets for me
-                     * this will destroy the child and NULL out tcp->child */
-                    g_hash_table_remove(parent->server->children, &(tcp->child->key));
+                    /* tell my server to stop accepting packets for me */
+                    _tcpserver_removeChild(parent->server, tcp);
 
                     /* if i was the server's last child and its waiting to close, close it */
-                    if((parent->state == TCPS_CLOSED) && (g_hash_table_size(parent->server->children) <= 0)) {
-                        /* this will unbind from the network interface and free socket */
-                        LegacyDescriptor* parentDesc = (LegacyDescriptor*)parent;
-                        process_deregisterLegacyDescriptor(
-                            descriptor_getOwnerProcess(parentDesc), parentDesc);
+                    if((parent->state == TCPS_CLOSED) && (_tcpserver_getNumChildren(parent->server) == 0)) {
+                        _tcp_deregister(parent, host);
                     }
                 }
 
-                /* this will unbind from the network interface and free socket */
-                LegacyDescriptor* desc = (LegacyDescriptor*)tcp;
-                process_deregisterLegacyDescriptor(
-                    descriptor_getOwnerProcess(desc), desc);
+                _tcp_deregister(tcp, host);
             }
             break;
         }
@@ -680,10 +796,7 @@ static void _tcp_setState(TCP* tcp, Host* host, enum TCPState state) {
             break;
         }
         case TCPS_TIMEWAIT: {
-            /* schedule a close timer self-event to finish out the closing process */
-            descriptor_ref(tcp);
-            Task* closeTask =
-                task_new(_tcp_runCloseTimerExpiredTask, tcp, NULL, descriptor_unref, NULL);
+            /* schedule a close timer to finish out the closing process */
             SimulationTime delay = CONFIG_TCPCLOSETIMER_DELAY;
 
             /* if a child of a server initiated the close, close more quickly */
@@ -691,8 +804,8 @@ static void _tcp_setState(TCP* tcp, Host* host, enum TCPState state) {
                 delay = SIMTIME_ONE_SECOND;
             }
 
-            worker_scheduleTask(closeTask, host, delay);
-            task_unref(closeTask);
+            timerwheel_schedule(
+                host_getTimerWheel(host), &tcp->closeTimer, worker_getCurrentTime() + delay);
             break;
         }
         default:
@@ -700,7 +813,7 @@ static void _tcp_setState(TCP* tcp, Host* host, enum TCPState state) {
     }
 }
 
-static void _tcp_runCloseTimerExpiredTask(Host* host, gpointer voidTcp, gpointer userData) {
+static void _tcp_runCloseTimerExpired(Host* host, gpointer voidTcp) {
     TCP* tcp = voidTcp;
     MAGIC_ASSERT(tcp);
     _tcp_setState(tcp, host, TCPS_CLOSED);
@@ -726,6 +839,11 @@ gsize tcp_getNotSentBytes(TCP* tcp) {
     return tcp->throttledOutputLength;
 }
 
+guint32 tcp_getNumPacketsInFlight(TCP* tcp) {
+    MAGIC_ASSERT(tcp);
+    return tcp->send.next - tcp->send.unacked;
+}
+
 static gsize _tcp_getBufferSpaceOut(TCP* tcp) {
     MAGIC_ASSERT(tcp);
     /* account for throttled and retransmission buffer */
@@ -850,15 +968,18 @@ static Packet* _tcp_createPacketWithoutPayload(TCP* tcp, Host* host, enum Protoc
     return packet;
 }
 
+/* Creates a packet whose payload is payloadLength bytes starting at offset into
+ * the plugin's buffers described by iov. */
 static Packet* _tcp_createDataPacket(TCP* tcp, Thread* thread, enum ProtocolTCPFlags flags,
-                                     PluginVirtualPtr payload, gsize payloadLength) {
+                                     const struct iovec* iov, size_t iovlen, gsize offset,
+                                     gsize payloadLength) {
     MAGIC_ASSERT(tcp);
 
     Host* host = thread_getHost(thread);
     bool isEmpty = payloadLength == 0;
     Packet* packet = _tcp_createPacketWithoutPayload(tcp, host, flags, isEmpty);
     if (!isEmpty) {
-        packet_setPayload(packet, thread, payload, payloadLength);
+        packet_setPayloadFromIov(packet, thread, iov, iovlen, offset, payloadLength);
     }
     return packet;
 }
@@ -892,13 +1013,12 @@ static void _tcp_sendControlPacket(TCP* tcp, Host* host, enum ProtocolTCPFlags f
 static void _tcp_addRetransmit(TCP* tcp, Packet* packet) {
     MAGIC_ASSERT(tcp);
 
-    PacketTCPHeader* header = packet_getTCPHeader(packet);
-    gpointer key = GINT_TO_POINTER(header->sequence);
+    const PacketTCPHeader* header = packet_getTCPHeader(packet);
 
     /* if it is already in the queue, it won't consume another packet reference */
-    if(g_hash_table_lookup(tcp->retransmit.queue, key) == NULL) {
+    if(seqring_get(tcp->retransmit.queue, header->sequence) == NULL) {
         /* its not in the queue yet */
-        g_hash_table_insert(tcp->retransmit.queue, key, packet);
+        seqring_insert(tcp->retransmit.queue, header->sequence, packet);
         packet_ref(packet);
 
         packet_addDeliveryStatus(packet, PDS_SND_TCP_ENQUEUE_RETRANSMIT);
@@ -910,113 +1030,30 @@ static void _tcp_addRetransmit(TCP* tcp, Packet* packet) {
     }
 }
 
-static gint _tcp_compare_sequence(gconstpointer ptr_1, gconstpointer ptr_2, gpointer user_data) {
-    const guint seq_1 = GPOINTER_TO_INT(ptr_1);
-    const guint seq_2 = GPOINTER_TO_INT(ptr_2);
-    return (seq_1 < seq_2) ? -1 : (seq_1 > seq_2) ? 1 : 0;
-}
-
-/* remove all packets with a sequence number less than the sequence parameter */
-static void _tcp_clearRetransmit(TCP* tcp, guint sequence) {
-    MAGIC_ASSERT(tcp);
-
-    // Clear the retrans packets in a deterministic order
-    GQueue* keys_sorted = g_queue_new();
-    GHashTableIter iter;
-    gpointer key;
-
-    // First get the keys that need to be removed
-    g_hash_table_iter_init(&iter, tcp->retransmit.queue);
+static void _tcp_dequeueRetransmit(gpointer data, gpointer userData) {
+    Packet* ackedPacket = data;
+    TCP* tcp = userData;
 
-    while (g_hash_table_iter_next(&iter, &key, NULL)) {
-        guint ackedSequence = GPOINTER_TO_INT(key);
-        if(ackedSequence < sequence) {
-            g_queue_insert_sorted(keys_sorted, key, _tcp_compare_sequence, NULL);
-        }
-    }
-
-    // Now remove the packets in order
-    while (g_queue_get_length(keys_sorted) > 0) {
-        key = g_queue_pop_head(keys_sorted);
-        Packet* ackedPacket = g_hash_table_lookup(tcp->retransmit.queue, key);
-        if (ackedPacket) {
-            tcp->retransmit.queueLength -= packet_getPayloadLength(ackedPacket);
-            packet_addDeliveryStatus(ackedPacket, PDS_SND_TCP_DEQUEUE_RETRANSMIT);
-            g_hash_table_remove(tcp->retransmit.queue, key);
-        }
-    }
-
-    // Cleanup
-    g_queue_free(keys_sorted);
-
-    if(_tcp_getBufferSpaceOut(tcp) > 0) {
-        descriptor_adjustStatus((LegacyDescriptor*)tcp, STATUS_DESCRIPTOR_WRITABLE, TRUE);
-    }
+    tcp->retransmit.queueLength -= packet_getPayloadLength(ackedPacket);
+    packet_addDeliveryStatus(ackedPacket, PDS_SND_TCP_DEQUEUE_RETRANSMIT);
+    packet_unref(ackedPacket);
 }
 
 /* Remove packets in the half-open interval [begin, end) */
 static void _tcp_clearRetransmitRange(TCP* tcp, guint begin, guint end) {
     MAGIC_ASSERT(tcp);
 
-
-    for (uint32_t seq = begin; seq < end; ++seq) {
-        Packet *packet = g_hash_table_lookup(tcp->retransmit.queue,
-                                             GINT_TO_POINTER(seq));
-
-        if (packet != NULL) {
-            tcp->retransmit.queueLength -= packet_getPayloadLength(packet);
-            packet_addDeliveryStatus(packet, PDS_SND_TCP_DEQUEUE_RETRANSMIT);
-            bool success = g_hash_table_remove(tcp->retransmit.queue,
-                                               GINT_TO_POINTER(seq));
-            utility_assert(success);
-        }
-    }
+    /* the ring visits the packets in sequence order, so this is deterministic */
+    seqring_stealRange(tcp->retransmit.queue, begin, end, _tcp_dequeueRetransmit, tcp);
 
     if(_tcp_getBufferSpaceOut(tcp) > 0) {
         descriptor_adjustStatus((LegacyDescriptor*)tcp, STATUS_DESCRIPTOR_WRITABLE, TRUE);
     }
 }
 
-// XXX forward declaration
-static void _tcp_runRetransmitTimerExpiredTask(Host* host, gpointer /*TCP*/ tcp,
-                                               gpointer /*Thread*/ thread);
-
-static void _tcp_scheduleRetransmitTimer(TCP* tcp, Host* host, SimulationTime now,
-                                         SimulationTime delay) {
-    MAGIC_ASSERT(tcp);
-
-    SimulationTime* expireTimePtr = g_new0(SimulationTime, 1);
-    *expireTimePtr = now + delay;
-    gboolean success = priorityqueue_push(tcp->retransmit.scheduledTimerExpirations, expireTimePtr);
-
-    if(success) {
-        descriptor_ref(tcp);
-        Task* retexpTask =
-            task_new(_tcp_runRetransmitTimerExpiredTask, tcp, NULL, descriptor_unref, NULL);
-        worker_scheduleTask(retexpTask, host, delay);
-        task_unref(retexpTask);
-
-        trace("%s retransmit timer scheduled for %"G_GUINT64_FORMAT" ns",
-                tcp->super.boundString, *expireTimePtr);
-    } else {
-        warning("%s could not schedule a retransmit timer for %"G_GUINT64_FORMAT" ns",
-                tcp->super.boundString, *expireTimePtr);
-        g_free(expireTimePtr);
-    }
-}
-
-static void _tcp_scheduleRetransmitTimerIfNeeded(TCP* tcp, Host* host, SimulationTime now) {
-    /* logic for scheduling retransmission events. we only need to schedule one if
-     * we have no events that will allow us to schedule one later. */
-    SimulationTime* nextTimePtr = priorityqueue_peek(tcp->retransmit.scheduledTimerExpirations);
-    if(nextTimePtr && *nextTimePtr <= tcp->retransmit.desiredTimerExpiration) {
-        /* another event will fire before the RTO expires, check again then */
-        return;
-    }
-
-    /* no existing timer will expire as early as desired */
-    SimulationTime delay = tcp->retransmit.desiredTimerExpiration - now;
-    _tcp_scheduleRetransmitTimer(tcp, host, now, delay);
+/* remove all packets with a sequence number less than the sequence parameter */
+static void _tcp_clearRetransmit(TCP* tcp, guint sequence) {
+    _tcp_clearRetransmitRange(tcp, 0, sequence);
 }
 
 static void _tcp_setRetransmitTimer(TCP* tcp, Host* host, SimulationTime now) {
@@ -1027,14 +1064,18 @@ static void _tcp_setRetransmitTimer(TCP* tcp, Host* host, SimulationTime now) {
     SimulationTime delay = tcp->retransmit.timeout * SIMTIME_ONE_MILLISECOND;
     tcp->retransmit.desiredTimerExpiration = now + delay;
 
-    _tcp_scheduleRetransmitTimerIfNeeded(tcp, host, now);
+    /* this replaces the previous expiration if the timer was already running */
+    timerwheel_schedule(host_getTimerWheel(host), &tcp->retransmit.timer,
+                        tcp->retransmit.desiredTimerExpiration);
+
+    trace("%s retransmit timer scheduled for %"G_GUINT64_FORMAT" ns",
+            tcp->super.boundString, tcp->retransmit.desiredTimerExpiration);
 }
 
 static void _tcp_stopRetransmitTimer(TCP* tcp) {
     MAGIC_ASSERT(tcp);
-    /* we want to stop the timer. since there may be an event already scheduled,
-     * lets mark our desired time as 0 so we know to cancel when the event fires. */
     tcp->retransmit.desiredTimerExpiration = 0;
+    timerwheel_cancel(&tcp->retransmit.timer);
 
     trace("%s retransmit timer disabled", tcp->super.boundString);
 }
@@ -1054,6 +1095,10 @@ static void _tcp_updateRTTEstimate(TCP* tcp, Host* host, SimulationTime timestam
     SimulationTime now = worker_getCurrentTime();
     gint rtt = (gint)((now - timestamp) / SIMTIME_ONE_MILLISECOND);
 
+    if (tcp->cong.hooks->tcp_cong_rtt_sample_ev && now > timestamp) {
+        tcp->cong.hooks->tcp_cong_rtt_sample_ev(tcp, now - timestamp);
+    }
+
     if(rtt <= 0) {
         rtt = 1;
     }
@@ -1087,7 +1132,7 @@ static void _tcp_updateRTTEstimate(TCP* tcp, Host* host, SimulationTime timestam
 static void _tcp_retransmitPacket(TCP* tcp, Host* host, gint sequence) {
     MAGIC_ASSERT(tcp);
 
-    Packet* packet = g_hash_table_lookup(tcp->retransmit.queue, GINT_TO_POINTER(sequence));
+    Packet* packet = seqring_get(tcp->retransmit.queue, sequence);
     /* if packet wasn't found is was most likely retransmitted from a previous SACK
      * but has yet to be received/acknowledged by the receiver */
     if(!packet) {
@@ -1095,19 +1140,22 @@ static void _tcp_retransmitPacket(TCP* tcp, Host* host, gint sequence) {
         return;
     }
 
-    PacketTCPHeader* hdr = packet_getTCPHeader(packet);
+    const PacketTCPHeader* hdr = packet_getTCPHeader(packet);
 
     trace("retransmitting packet %d", sequence);
     // fprintf(stderr, "R- retransmitting packet %d with ts %llu\n", sequence, hdr.timestampValue);
 
     /* remove from queue and update length and status.
      * calling steal means that the packet ref count is not decremented */
-    g_hash_table_steal(tcp->retransmit.queue, GINT_TO_POINTER(sequence));
+    seqring_steal(tcp->retransmit.queue, sequence);
 
     /* update queue length and status */
     tcp->retransmit.queueLength -= packet_getPayloadLength(packet);
     packet_addDeliveryStatus(packet, PDS_SND_TCP_DEQUEUE_RETRANSMIT);
 
+    TRACEPOINT(tcp_retransmit, host_getID(host), sequence, packet_getPayloadLength(packet),
+               tcp->info.retransmitCount + 1);
+
     if(_tcp_getBufferSpaceOut(tcp) > 0) {
         descriptor_adjustStatus((LegacyDescriptor*)tcp, STATUS_DESCRIPTOR_WRITABLE, TRUE);
     }
@@ -1153,14 +1201,16 @@ void tcp_networkInterfaceIsAboutToSendPacket(TCP* tcp, Host* host, Packet* packe
     SimulationTime now = worker_getCurrentTime();
 
     /* update TCP header to our current advertised window and acknowledgment and timestamps */
-    packet_updateTCP(packet, tcp->receive.next, tcp->send.selectiveACKs, tcp->receive.window, now, tcp->receive.lastTimestamp);
+    packet_updateTCP(packet, tcp->receive.next, (PacketTCPSackBlock*)tcp->send.selectiveACKs->data,
+                     tcp->send.selectiveACKs->len, tcp->receive.window, now,
+                     tcp->receive.lastTimestamp);
 
     /* keep track of the last things we sent them */
     tcp->send.lastAcknowledgment = tcp->receive.next;
     tcp->send.lastWindow = tcp->receive.window;
     tcp->info.lastAckSent = now;
 
-    PacketTCPHeader* header = packet_getTCPHeader(packet);
+    const PacketTCPHeader* header = packet_getTCPHeader(packet);
 
     if(header->flags & PTCP_ACK) {
         /* we are sending an ACK already, so we may not need any delayed ACK */
@@ -1230,7 +1280,7 @@ static void _tcp_flush(TCP* tcp, Host* host) {
         }
 
         guint length = packet_getPayloadLength(packet);
-        PacketTCPHeader* header = packet_getTCPHeader(packet);
+        const PacketTCPHeader* header = packet_getTCPHeader(packet);
 
         if(length > 0) {
             /* we cant send it if our window is too small */
@@ -1270,7 +1320,7 @@ static void _tcp_flush(TCP* tcp, Host* host) {
     while(!priorityqueue_isEmpty(tcp->unorderedInput)) {
         Packet* packet = priorityqueue_peek(tcp->unorderedInput);
 
-        PacketTCPHeader* header = packet_getTCPHeader(packet);
+        const PacketTCPHeader* header = packet_getTCPHeader(packet);
 
         _rswlog(tcp, "I just received packet %d\n", header->sequence);
         if(header->sequence == tcp->receive.next) {
@@ -1337,15 +1387,11 @@ static void _tcp_flush(TCP* tcp, Host* host) {
     }
 }
 
-static void _tcp_runRetransmitTimerExpiredTask(Host* host, gpointer voidTcp, gpointer unused) {
+static void _tcp_runRetransmitTimerExpired(Host* host, gpointer voidTcp) {
     TCP* tcp = voidTcp;
     MAGIC_ASSERT(tcp);
 
-    /* a timer expired, update our timer tracking state */
     SimulationTime now = worker_getCurrentTime();
-    SimulationTime* scheduledTimerExpirationPtr = priorityqueue_pop(tcp->retransmit.scheduledTimerExpirations);
-    utility_assert(scheduledTimerExpirationPtr);
-    g_free(scheduledTimerExpirationPtr);
 
     trace("%s a scheduled retransmit timer expired", tcp->super.boundString);
 
@@ -1356,20 +1402,14 @@ static void _tcp_runRetransmitTimerExpiredTask(Host* host, gpointer voidTcp, gpo
         return;
     }
 
-    if(g_hash_table_size(tcp->retransmit.queue) == 0) {
+    if(seqring_isEmpty(tcp->retransmit.queue)) {
         _tcp_stopRetransmitTimer(tcp);
         return;
     }
 
-    /* if the timer should be off or was reset, ignore this event */
-    if(tcp->retransmit.desiredTimerExpiration == 0) {
-        return;
-    } else if(tcp->retransmit.desiredTimerExpiration > now) {
-        /* the timer was reset after this event was scheduled, check if we need to
-         * schedule another event, or if we can do it when the next event fires instead */
-        _tcp_scheduleRetransmitTimerIfNeeded(tcp, host, now);
-        return;
-    }
+    /* the wheel only runs the timer once the time it was last scheduled for has
+     * passed, which is later than desired if our cpu was busy */
+    utility_assert(tcp->retransmit.desiredTimerExpiration <= now);
 
     /* rfc 6298, section 5.4-5.7 (http://tools.ietf.org/html/rfc6298)
      * if we get here, this is a valid timer expiration and we need to do a retransmission
@@ -1573,10 +1613,16 @@ void tcp_enterServerMode(TCP* tcp, Host* host, gint backlog) {
     _tcp_setState(tcp, host, TCPS_LISTEN);
 }
 
-gint tcp_acceptServerPeer(TCP* tcp, Host* host, in_addr_t* ip, in_port_t* port,
-                          gint* acceptedHandle) {
+void tcp_updateServerBacklog(TCP* tcp, gint backlog) {
     MAGIC_ASSERT(tcp);
-    utility_assert(acceptedHandle);
+    utility_assert(tcp->server);
+    tcp->server->pendingMaxLength = _tcpserver_clampBacklog(backlog);
+}
+
+gint tcp_acceptServerChild(TCP* tcp, TCP** child) {
+    MAGIC_ASSERT(tcp);
+    utility_assert(child);
+    *child = NULL;
 
     /* make sure we are listening and bound to an ip and port */
     if(tcp->state != TCPS_LISTEN || !(tcp->super.flags & SF_BOUND)) {
@@ -1589,7 +1635,7 @@ gint tcp_acceptServerPeer(TCP* tcp, Host* host, in_addr_t* ip, in_port_t* port,
     }
 
     /* if there are no pending connection ready to accept, dont block waiting */
-    if(g_queue_get_length(tcp->server->pending) <= 0) {
+    if(tcp->server->pendingLength == 0) {
         /* listen sockets should have no data, and should not be readable if no pending conns */
         utility_assert(socket_getInputBufferLength(&tcp->super) == 0);
         descriptor_adjustStatus(&(tcp->super.super.super), STATUS_DESCRIPTOR_READABLE, FALSE);
@@ -1597,12 +1643,16 @@ gint tcp_acceptServerPeer(TCP* tcp, Host* host, in_addr_t* ip, in_port_t* port,
     }
 
     /* double check the pending child before its accepted */
-    TCP* tcpChild = g_queue_pop_head(tcp->server->pending);
-    if(!tcpChild) {
-        return -ECONNABORTED;
-    }
-
+    TCP* tcpChild = tcp->server->pendingHead;
     MAGIC_ASSERT(tcpChild);
+    MAGIC_ASSERT(tcpChild->child);
+    _tcpserver_removePending(tcp->server, tcpChild);
+
+    /* child now gets "accepted" */
+    tcpChild->child->state = TCPCS_ACCEPTED;
+
+    *child = tcpChild;
+
     if(tcpChild->error == TCPE_CONNECTION_RESET) {
         return -ECONNABORTED;
     }
@@ -1610,21 +1660,31 @@ gint tcp_acceptServerPeer(TCP* tcp, Host* host, in_addr_t* ip, in_port_t* port,
     /* better have a peer if we are established */
     utility_assert(tcpChild->super.peerIP && tcpChild->super.peerPort);
 
-    /* child now gets "accepted" */
-    MAGIC_ASSERT(tcpChild->child);
-    tcpChild->child->state = TCPCS_ACCEPTED;
-
     /* update child descriptor status */
     descriptor_adjustStatus(&(tcpChild->super.super.super),
                             STATUS_DESCRIPTOR_ACTIVE | STATUS_DESCRIPTOR_WRITABLE, TRUE);
 
     /* update server descriptor status */
-    if(g_queue_get_length(tcp->server->pending) > 0) {
+    if(tcp->server->pendingLength > 0) {
         descriptor_adjustStatus(&(tcp->super.super.super), STATUS_DESCRIPTOR_READABLE, TRUE);
     } else {
         descriptor_adjustStatus(&(tcp->super.super.super), STATUS_DESCRIPTOR_READABLE, FALSE);
     }
 
+    return 0;
+}
+
+gint tcp_acceptServerPeer(TCP* tcp, Host* host, in_addr_t* ip, in_port_t* port,
+                          gint* acceptedHandle) {
+    MAGIC_ASSERT(tcp);
+    utility_assert(acceptedHandle);
+
+    TCP* tcpChild = NULL;
+    gint result = tcp_acceptServerChild(tcp, &tcpChild);
+    if (result != 0) {
+        return result;
+    }
+
     *acceptedHandle = tcpChild->super.super.super.handle;
     utility_assert(ip);
     *ip = tcpChild->super.peerIP;
@@ -1645,8 +1705,10 @@ static TCP* _tcp_getSourceTCP(TCP* tcp, in_addr_t ip, in_port_t port) {
         MAGIC_ASSERT(tcp->server);
 
         /* children are multiplexed based on remote ip and port */
-        guint childKey = utility_ipPortHash(ip, port);
-        TCP* tcpChild = g_hash_table_lookup(tcp->server->children, &childKey);
+        BoundSocketKey childKey = boundsocketkey_new(PTCP, 0, 0, ip, port);
+        TCP* tcpChild = tcp->server->children
+                            ? boundsockettable_lookup(tcp->server->children, &childKey)
+                            : NULL;
 
         if(tcpChild) {
             return tcpChild;
@@ -1656,22 +1718,67 @@ static TCP* _tcp_getSourceTCP(TCP* tcp, in_addr_t ip, in_port_t port) {
     return tcp;
 }
 
-static GList* _tcp_removeSacks(GList* selectiveACKs, gint sequence) {
-    GList *unacked = NULL;
-    if(selectiveACKs) {
-        GList *iter = selectiveACKs;
-        while(iter) {
-            gint sackSequence = GPOINTER_TO_INT(iter->data);
+gboolean tcp_hasChild(TCP* tcp, in_addr_t peerIP, in_port_t peerPort) {
+    MAGIC_ASSERT(tcp);
+    return _tcp_getSourceTCP(tcp, peerIP, peerPort) != tcp;
+}
+
+/* Returns the index of the first block in selectiveACKs whose end is at least sequence,
+ * i.e., the first block that could contain or be adjacent to sequence. */
+static guint _tcp_findSack(GArray* selectiveACKs, guint sequence) {
+    guint low = 0;
+    guint high = selectiveACKs->len;
+    while(low < high) {
+        guint mid = low + (high - low) / 2;
+        if(g_array_index(selectiveACKs, PacketTCPSackBlock, mid).end < sequence) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
 
-            if(sackSequence > sequence) {
-                unacked = g_list_append(unacked, iter->data);
-            }
+static void _tcp_addSack(GArray* selectiveACKs, guint sequence) {
+    guint index = _tcp_findSack(selectiveACKs, sequence);
+
+    if(index < selectiveACKs->len) {
+        PacketTCPSackBlock* block = &g_array_index(selectiveACKs, PacketTCPSackBlock, index);
 
-            iter = g_list_next(iter);
+        if(block->begin <= sequence && sequence < block->end) {
+            /* already sacked */
+            return;
+        } else if(sequence == block->end) {
+            /* extend the block, and merge it with the next if that closed a hole */
+            block->end++;
+            if(index + 1 < selectiveACKs->len) {
+                PacketTCPSackBlock* next = &g_array_index(selectiveACKs, PacketTCPSackBlock, index + 1);
+                if(next->begin == block->end) {
+                    block->end = next->end;
+                    g_array_remove_index(selectiveACKs, index + 1);
+                }
+            }
+            return;
+        } else if(sequence + 1 == block->begin) {
+            block->begin--;
+            return;
         }
-        g_list_free(selectiveACKs);
     }
-    return unacked;
+
+    PacketTCPSackBlock block = {.begin = sequence, .end = sequence + 1};
+    g_array_insert_val(selectiveACKs, index, block);
+}
+
+/* Removes the blocks at or below sequence, and the block that starts just after it. */
+static void _tcp_clearSacks(GArray* selectiveACKs, guint sequence) {
+    guint n = 0;
+    while(n < selectiveACKs->len &&
+          g_array_index(selectiveACKs, PacketTCPSackBlock, n).begin <= sequence + 1) {
+        n++;
+    }
+    if(n > 0) {
+        g_array_remove_range(selectiveACKs, 0, n);
+    }
 }
 
 TCPProcessFlags _tcp_dataProcessing(TCP* tcp, Packet* packet, PacketTCPHeader *header) {
@@ -1701,27 +1808,10 @@ TCPProcessFlags _tcp_dataProcessing(TCP* tcp, Packet* packet, PacketTCPHeader *h
 
         /* SACK: if not next packet, one was dropped and we need to include this in the selective ACKs */
         if(!isNextPacket && packetFits) {
-            tcp->send.selectiveACKs = g_list_append(tcp->send.selectiveACKs, GINT_TO_POINTER(header->sequence));
-        } else if(tcp->send.selectiveACKs && g_list_length(tcp->send.selectiveACKs) > 0) {
-            /* find the first gap in SACKs and remove everything before it */
-            GList *iter = g_list_first(tcp->send.selectiveACKs);
-            GList *next = g_list_next(iter);
-
-            gint firstSequence = GPOINTER_TO_INT(iter->data);
-            if(firstSequence <= header->sequence + 1) {
-                while(next) {
-                    gint currSequence = GPOINTER_TO_INT(iter->data);
-                    gint nextSequence = GPOINTER_TO_INT(next->data);
-                    /* check for a gap in sequences */
-                    if(currSequence + 1 < nextSequence && currSequence > header->sequence) {
-                        break;
-                    }
-                    iter = next;
-                    next = g_list_next(iter);
-                }
-
-                tcp->send.selectiveACKs = _tcp_removeSacks(tcp->send.selectiveACKs, GPOINTER_TO_INT(iter->data));
-            }
+            _tcp_addSack(tcp->send.selectiveACKs, header->sequence);
+        } else {
+            /* everything up to and including the first block past this packet can go */
+            _tcp_clearSacks(tcp->send.selectiveACKs, header->sequence);
         }
 
         Status s = descriptor_getStatus((LegacyDescriptor*)tcp);
@@ -1743,7 +1833,7 @@ TCPProcessFlags _tcp_dataProcessing(TCP* tcp, Packet* packet, PacketTCPHeader *h
     return flags;
 }
 
-TCPProcessFlags _tcp_ackProcessing(TCP* tcp, Host* host, Packet* packet, PacketTCPHeader* header) {
+TCPProcessFlags _tcp_ackProcessing(TCP* tcp, Host* host, Packet* packet, const PacketTCPHeader* header) {
     MAGIC_ASSERT(tcp);
 
     trace("processing acks");
@@ -1853,10 +1943,9 @@ static void _tcp_logCongestionInfo(TCP* tcp) {
           tcp->super.super.super.handle);
 }
 
-static void _tcp_sendACKTaskCallback(Host* host, gpointer voidTcp, gpointer userData) {
+static void _tcp_runDelayedACKTimerExpired(Host* host, gpointer voidTcp) {
     TCP* tcp = voidTcp;
     MAGIC_ASSERT(tcp);
-    tcp->send.delayedACKIsScheduled = FALSE;
     if(tcp->send.delayedACKCounter > 0) {
         trace("sending a delayed ACK now");
         _tcp_sendControlPacket(tcp, host, PTCP_ACK);
@@ -1866,6 +1955,31 @@ static void _tcp_sendACKTaskCallback(Host* host, gpointer voidTcp, gpointer user
     }
 }
 
+/* Like Linux, sends quick ACKs at the start of the connection, and after that ACKs
+ * every second segment, or the first one after CONFIG_TCP_DELACK_MIN. An ACK that is
+ * due is sent at the end of the current time rather than right away, so segments
+ * that arrive together are all covered by one stretch ACK, as with GRO. */
+static void _tcp_scheduleLinuxDelayedACK(TCP* tcp, Host* host) {
+    MAGIC_ASSERT(tcp);
+
+    TimerWheel* wheel = host_getTimerWheel(host);
+    SimulationTime now = worker_getCurrentTime();
+    gboolean isScheduled = timerwheelentry_isScheduled(&tcp->send.delayedACKTimer);
+
+    if (tcp->send.numQuickACKsSent < CONFIG_TCP_MAX_QUICKACKS) {
+        if (!isScheduled) {
+            timerwheel_schedule(wheel, &tcp->send.delayedACKTimer, now);
+            tcp->send.numQuickACKsSent++;
+        }
+    } else if (tcp->send.delayedACKCounter >= 2) {
+        /* this moves the timer up if it was waiting for the delay */
+        timerwheel_schedule(wheel, &tcp->send.delayedACKTimer, now);
+    } else if (!isScheduled) {
+        timerwheel_schedule(wheel, &tcp->send.delayedACKTimer,
+                            now + CONFIG_TCP_DELACK_MIN * SIMTIME_ONE_MILLISECOND);
+    }
+}
+
 /* return TRUE if the packet should be retransmitted */
 static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
     TCP* tcp = _tcp_fromLegacyDescriptor((LegacyDescriptor*)socket);
@@ -1879,7 +1993,7 @@ static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
 
     /* now we have the true TCP for the packet */
     MAGIC_ASSERT(tcp);
-    PacketTCPHeader* header = packet_getTCPHeader(packet);
+    const PacketTCPHeader* header = packet_getTCPHeader(packet);
 
     /* if packet is reset, don't process */
     if(header->flags & PTCP_RST) {
@@ -1919,6 +2033,14 @@ static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
             /* receive SYN, send SYNACK, move to SYNRECEIVED */
             if(header->flags & PTCP_SYN) {
                 MAGIC_ASSERT(tcp->server);
+
+                /* like Linux, drop the SYN while the accept queue is full. the peer will
+                 * retransmit it. */
+                if (_tcpserver_isAcceptQueueFull(tcp->server)) {
+                    trace("%s: accept queue is full, dropping SYN", tcp->super.boundString);
+                    break;
+                }
+
                 flags |= TCP_PF_PROCESSED;
 
                 /* we need to multiplex a new child */
@@ -1926,17 +2048,16 @@ static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
                 guint64 sendBufSize = host_getConfiguredSendBufSize(host);
 
                 TCP* multiplexed = tcp_new(host, recvBufSize, sendBufSize);
-                process_registerLegacyDescriptor(
-                    descriptor_getOwnerProcess((LegacyDescriptor*)tcp),
-                    (LegacyDescriptor*)multiplexed);
+                _tcp_registerChild(tcp, multiplexed, host);
 
                 multiplexed->child = _tcpchild_new(multiplexed, tcp, header->sourceIP, header->sourcePort);
-                utility_assert(g_hash_table_lookup(tcp->server->children, &(multiplexed->child->key)) == NULL);
+                utility_assert(tcp->server->children);
 
                 /* multiplexed TCP was initialized with a ref of 1, which the host table consumes.
                  * so we need another ref for the children table */
                 descriptor_ref(multiplexed);
-                g_hash_table_replace(tcp->server->children, &(multiplexed->child->key), multiplexed);
+                boundsockettable_insert(
+                    tcp->server->children, &(multiplexed->child->key), multiplexed);
 
                 multiplexed->receive.start = header->sequence;
                 multiplexed->receive.next = multiplexed->receive.start + 1;
@@ -1993,8 +2114,7 @@ static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
 
                 /* if this is a child, mark it accordingly */
                 if(tcp->child) {
-                    tcp->child->state = TCPCS_PENDING;
-                    g_queue_push_tail(tcp->child->parent->server->pending, tcp);
+                    _tcpserver_pushPending(tcp->child->parent->server, tcp);
                     /* user should accept new child from parent */
                     descriptor_adjustStatus(
                         &(tcp->child->parent->super.super.super), STATUS_DESCRIPTOR_READABLE, TRUE);
@@ -2120,14 +2240,14 @@ static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
         return;
     }
 
-    GList* selectiveACKs = packet_copyTCPSelectiveACKs(packet);
-
-    if (selectiveACKs) {
-       retransmit_tally_mark_sacked(tcp->retransmit.tally, selectiveACKs);
-    }
-
-    if(selectiveACKs) {
-        g_list_free(selectiveACKs);
+    if(header->nSelectiveACKs > 0) {
+        uint32_t selectiveACKs[2 * PACKET_TCP_MAX_SACK_BLOCKS];
+        for(guint i = 0; i < header->nSelectiveACKs; i++) {
+            selectiveACKs[2 * i] = header->selectiveACKs[i].begin;
+            selectiveACKs[2 * i + 1] = header->selectiveACKs[i].end;
+        }
+        retransmit_tally_mark_sacked(
+            tcp->retransmit.tally, selectiveACKs, header->nSelectiveACKs);
     }
 
     /* update the last time stamp value (RFC 1323) */
@@ -2173,16 +2293,15 @@ static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
             /* just send the response now */
             trace("sending ACK control packet now");
             _tcp_sendControlPacket(tcp, host, responseFlags);
+        } else if (tcp->send.linuxDelayedACKs) {
+            trace("waiting for delayed ACK control packet");
+            tcp->send.delayedACKCounter++;
+            _tcp_scheduleLinuxDelayedACK(tcp, host);
         } else {
             trace("waiting for delayed ACK control packet");
-            if(tcp->send.delayedACKIsScheduled == FALSE) {
-                /* we need to send an ACK, lets schedule a task so we don't send an ACK
+            if(!timerwheelentry_isScheduled(&tcp->send.delayedACKTimer)) {
+                /* we need to send an ACK, lets schedule a timer so we don't send an ACK
                  * for all packets that are received during this same simtime receiving round. */
-                Task* sendACKTask =
-                    task_new(_tcp_sendACKTaskCallback, tcp, NULL, descriptor_unref, NULL);
-                /* taks holds a ref to tcp */
-                descriptor_ref(tcp);
-
                 /* figure out what we should use as delay */
                 SimulationTime delay = 0;
                 /* "quick acknowledgments" happen at the beginning of a connection */
@@ -2194,10 +2313,8 @@ static void _tcp_processPacket(Socket* socket, Host* host, Packet* packet) {
                     delay = 5*SIMTIME_ONE_MILLISECOND;
                 }
 
-                worker_scheduleTask(sendACKTask, host, delay);
-                task_unref(sendACKTask);
-
-                tcp->send.delayedACKIsScheduled = TRUE;
+                timerwheel_schedule(host_getTimerWheel(host), &tcp->send.delayedACKTimer,
+                                    worker_getCurrentTime() + delay);
             }
             tcp->send.delayedACKCounter++;
         }
@@ -2238,9 +2355,11 @@ static void _tcp_endOfFileSignalled(TCP* tcp, enum TCPFlags flags) {
     }
 }
 
-static gssize _tcp_sendUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
-                                gsize nBytes, in_addr_t ip, in_port_t port) {
-    TCP* tcp = _tcp_fromLegacyDescriptor((LegacyDescriptor*)transport);
+/* Buffers up to nBytes of data for sending. The data comes from the plugin
+ * buffers described by iov if thread is non-NULL, and from shadowBuffer
+ * otherwise. */
+static gssize _tcp_sendData(TCP* tcp, Host* host, Thread* thread, const struct iovec* iov,
+                            size_t iovlen, const void* shadowBuffer, gsize nBytes) {
     MAGIC_ASSERT(tcp);
 
     /* return 0 to signal close, if necessary */
@@ -2264,13 +2383,33 @@ static gssize _tcp_sendUserData(Transport* transport, Thread* thread, PluginVirt
     gsize maxPacketLength = CONFIG_MTU - CONFIG_HEADER_SIZE_TCPIPETH;
     gsize bytesCopied = 0;
 
+    /* when the plugin's data spans several segments, read all of it at once and let
+     * the segments share it, rather than reading from the plugin once per segment */
+    Payload* bulkPayload = NULL;
+    if (thread && remaining > maxPacketLength) {
+        bulkPayload = payload_newFromIov(thread, iov, iovlen, 0, remaining);
+        if (!bulkPayload) {
+            return -EFAULT;
+        }
+    }
+
     /* create as many packets as needed */
     while(remaining > 0) {
         gsize copyLength = MIN(maxPacketLength, remaining);
 
         /* use helper to create the packet */
-        Packet* packet = _tcp_createDataPacket(
-            tcp, thread, PTCP_ACK, (PluginVirtualPtr){.val = buffer.val + bytesCopied}, copyLength);
+        Packet* packet = NULL;
+        if (bulkPayload) {
+            packet = _tcp_createPacketWithoutPayload(tcp, host, PTCP_ACK, /*isEmpty=*/false);
+            packet_setPayloadSlice(packet, host, bulkPayload, bytesCopied, copyLength);
+        } else if (thread) {
+            packet = _tcp_createDataPacket(
+                tcp, thread, PTCP_ACK, iov, iovlen, bytesCopied, copyLength);
+        } else {
+            packet = _tcp_createPacketWithoutPayload(tcp, host, PTCP_ACK, /*isEmpty=*/false);
+            packet_setPayloadFromShadow(
+                packet, host, (const gchar*)shadowBuffer + bytesCopied, copyLength);
+        }
         if(copyLength > 0) {
             /* we are sending more user data */
             tcp->send.end++;
@@ -2286,14 +2425,35 @@ static gssize _tcp_sendUserData(Transport* transport, Thread* thread, PluginVirt
         bytesCopied += copyLength;
     }
 
+    if (bulkPayload) {
+        /* the packets hold their own refs */
+        payload_unref(bulkPayload);
+    }
+
     trace("%s <-> %s: sending %"G_GSIZE_FORMAT" user bytes", tcp->super.boundString, tcp->super.peerString, bytesCopied);
 
     /* now flush as much as possible out to socket */
-    _tcp_flush(tcp, thread_getHost(thread));
+    _tcp_flush(tcp, host);
 
     return (gssize)(bytesCopied == 0 && nBytes != 0 ? -EWOULDBLOCK : bytesCopied);
 }
 
+static gssize _tcp_sendUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
+                                gsize nBytes, in_addr_t ip, in_port_t port) {
+    TCP* tcp = _tcp_fromLegacyDescriptor((LegacyDescriptor*)transport);
+    struct iovec iov = {.iov_base = (void*)buffer.val, .iov_len = nBytes};
+    return _tcp_sendData(tcp, thread_getHost(thread), thread, &iov, 1, NULL, nBytes);
+}
+
+gssize tcp_sendUserDataIov(TCP* tcp, Thread* thread, const struct iovec* iov, size_t iovlen,
+                           gsize nBytes) {
+    return _tcp_sendData(tcp, thread_getHost(thread), thread, iov, iovlen, NULL, nBytes);
+}
+
+gssize tcp_sendShadowData(TCP* tcp, Host* host, const void* buffer, gsize nBytes) {
+    return _tcp_sendData(tcp, host, NULL, NULL, 0, buffer, nBytes);
+}
+
 static void _tcp_sendWindowUpdate(Host* host, gpointer voidTcp, gpointer data) {
     TCP* tcp = voidTcp;
     MAGIC_ASSERT(tcp);
@@ -2307,13 +2467,12 @@ static void _tcp_sendWindowUpdate(Host* host, gpointer voidTcp, gpointer data) {
     tcp->receive.windowUpdatePending = FALSE;
 }
 
-static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
-                                   gsize nBytes, in_addr_t* ip, in_port_t* port) {
-    TCP* tcp = _tcp_fromLegacyDescriptor((LegacyDescriptor*)transport);
+/* Copies received data into the plugin's buffer, or into shadowBuffer if thread is
+ * NULL, like _tcp_sendData does when sending. */
+static gssize _tcp_receiveData(TCP* tcp, Host* host, Thread* thread, PluginVirtualPtr buffer,
+                               void* shadowBuffer, gsize nBytes) {
     MAGIC_ASSERT(tcp);
 
-    Host* host = thread_getHost(thread);
-
     /*
      * TODO
      * We call descriptor_adjustStatus too many times here, to handle the readable
@@ -2336,11 +2495,27 @@ static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginV
         return -EWOULDBLOCK;
     }
 
-    if (buffer.val == 0 && nBytes > 0) {
+    if ((thread ? buffer.val == 0 : shadowBuffer == NULL) && nBytes > 0) {
         debug("Can't recv >0 bytes into NULL buffer on socket");
         return -EFAULT;
     }
 
+    /* gather the queued segments into the plugin's buffer with a single transfer,
+     * rather than writing to the plugin once per segment */
+    gsize available = socket_getInputBufferLength(&tcp->super);
+    if (tcp->partialUserDataPacket) {
+        available += packet_getPayloadLength(tcp->partialUserDataPacket) - tcp->partialOffset;
+    }
+    gsize copyTotal = MIN(nBytes, available);
+    gchar* dst = NULL;
+    if (copyTotal > 0) {
+        dst = thread ? process_getWriteablePtr(thread_getProcess(thread), buffer, copyTotal)
+                     : shadowBuffer;
+        if (!dst) {
+            return -EFAULT;
+        }
+    }
+
     /* check if we have a partial packet waiting to get finished */
     if(remaining > 0 && tcp->partialUserDataPacket) {
         guint partialLength = packet_getPayloadLength(tcp->partialUserDataPacket);
@@ -2348,12 +2523,8 @@ static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginV
         utility_assert(partialBytes > 0);
 
         copyLength = MIN(partialBytes, remaining);
-        gssize bytesCopied = packet_copyPayload(
-            tcp->partialUserDataPacket, thread, tcp->partialOffset, buffer, copyLength);
-        if (bytesCopied < 0) {
-            // Error writing to PluginVirtualPtr
-            return bytesCopied;
-        }
+        gsize bytesCopied = packet_copyPayloadShadow(
+            tcp->partialUserDataPacket, tcp->partialOffset, dst, copyLength);
         totalCopied += bytesCopied;
         remaining -= bytesCopied;
         offset += bytesCopied;
@@ -2379,30 +2550,19 @@ static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginV
 
         /* get the next buffered packet - we'll always need it.
          * this could mark the socket as unreadable if this is its last packet.*/
-        const Packet* nextPacket = socket_peekNextInPacket((Socket*)tcp);
-        if (!nextPacket) {
+        Packet* packet = socket_removeFromInputBuffer((Socket*)tcp, host);
+        if (!packet) {
             /* no more packets or partial packets */
             break;
         }
 
-        guint packetLength = packet_getPayloadLength(nextPacket);
+        guint packetLength = packet_getPayloadLength(packet);
         copyLength = MIN(packetLength, remaining);
-        gssize bytesCopied = packet_copyPayload(
-            nextPacket, thread, 0, (PluginVirtualPtr){.val = buffer.val + offset}, copyLength);
-        if (bytesCopied < 0) {
-            // Error writing to PluginVirtualPtr
-            if (totalCopied > 0) {
-                warning("Returning error %s, but already copied %lu bytes which will be lost",
-                        g_strerror(-bytesCopied), totalCopied);
-            }
-            return bytesCopied;
-        }
+        gsize bytesCopied = packet_copyPayloadShadow(packet, 0, dst + offset, copyLength);
         totalCopied += bytesCopied;
         remaining -= bytesCopied;
         offset += bytesCopied;
 
-        Packet* packet = socket_removeFromInputBuffer((Socket*)tcp, host);
-
         if(bytesCopied < packetLength) {
             /* we were only able to read part of this packet */
             tcp->partialUserDataPacket = packet;
@@ -2414,6 +2574,7 @@ static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginV
         packet_addDeliveryStatus(packet, PDS_RCV_SOCKET_DELIVERED);
         packet_unref(packet);
     }
+    utility_assert(totalCopied == copyTotal);
 
     bool more_readable_data = false;
 
@@ -2462,9 +2623,7 @@ static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginV
          * make sure we don't send multiple events when read is called many times per instant */
         descriptor_ref(tcp);
 
-        Task* updateWindowTask = task_new(_tcp_sendWindowUpdate, tcp, NULL, descriptor_unref, NULL);
-        worker_scheduleTask(updateWindowTask, thread_getHost(thread), 1);
-        task_unref(updateWindowTask);
+        worker_scheduleCallback(_tcp_sendWindowUpdate, tcp, NULL, descriptor_unref, NULL, host, 1);
 
         tcp->receive.windowUpdatePending = TRUE;
     }
@@ -2481,14 +2640,27 @@ static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginV
     return totalCopied;
 }
 
+static gssize _tcp_receiveUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
+                                   gsize nBytes, in_addr_t* ip, in_port_t* port) {
+    TCP* tcp = _tcp_fromLegacyDescriptor((LegacyDescriptor*)transport);
+    return _tcp_receiveData(tcp, thread_getHost(thread), thread, buffer, NULL, nBytes);
+}
+
+gssize tcp_receiveShadowData(TCP* tcp, Host* host, void* buffer, gsize nBytes) {
+    return _tcp_receiveData(tcp, host, NULL, (PluginVirtualPtr){.val = 0}, buffer, nBytes);
+}
+
 static void _tcp_free(LegacyDescriptor* descriptor) {
     TCP* tcp = _tcp_fromLegacyDescriptor(descriptor);
     MAGIC_ASSERT(tcp);
 
     priorityqueue_free(tcp->throttledOutput);
     priorityqueue_free(tcp->unorderedInput);
-    g_hash_table_destroy(tcp->retransmit.queue);
-    priorityqueue_free(tcp->retransmit.scheduledTimerExpirations);
+    seqring_free(tcp->retransmit.queue);
+    /* scheduled timers hold a reference, so none of them can still be running */
+    utility_assert(!timerwheelentry_isScheduled(&tcp->retransmit.timer));
+    utility_assert(!timerwheelentry_isScheduled(&tcp->send.delayedACKTimer));
+    utility_assert(!timerwheelentry_isScheduled(&tcp->closeTimer));
 
     if (tcp->partialUserDataPacket != NULL) {
         packet_unref(tcp->partialUserDataPacket);
@@ -2502,8 +2674,11 @@ static void _tcp_free(LegacyDescriptor* descriptor) {
         MAGIC_ASSERT(tcp->child->parent->server);
 
         /* remove parents reference to child, if it exists */
-        if(tcp->child->parent->server->children) {
-            g_hash_table_remove(tcp->child->parent->server->children, &(tcp->child->key));
+        _tcpserver_removeChild(tcp->child->parent->server, tcp);
+
+        /* a child that was never accepted must leave the accept queue */
+        if (tcp->child->state == TCPCS_PENDING) {
+            _tcpserver_removePending(tcp->child->parent->server, tcp);
         }
 
         _tcpchild_free(tcp->child);
@@ -2515,6 +2690,7 @@ static void _tcp_free(LegacyDescriptor* descriptor) {
 
     tcp->cong.hooks->tcp_cong_delete(tcp);
     retransmit_tally_destroy(tcp->retransmit.tally);
+    g_array_free(tcp->send.selectiveACKs, TRUE);
 
     descriptor_clear((LegacyDescriptor*)tcp);
     MAGIC_CLEAR(tcp);
@@ -2622,9 +2798,12 @@ TCP* tcp_new(Host* host, guint receiveBufferSize, guint sendBufferSize) {
     guint32 initial_window = 10;
     gint tcpSSThresh = 0;
 
-    /* in the future we'd like to support more congestion control types
-     * and allow it to be set as a host option */
-    tcp_cong_reno_init(tcp);
+    switch (host_getTcpCongestionControl(host)) {
+        case TCP_CONGESTION_CONTROL_RENO: tcp_cong_reno_init(tcp); break;
+        case TCP_CONGESTION_CONTROL_CUBIC: tcp_cong_cubic_init(tcp); break;
+        case TCP_CONGESTION_CONTROL_BBR: tcp_cong_bbr_init(tcp); break;
+        default: utility_panic("Unknown TCP congestion control algorithm");
+    }
 
     tcp->send.window = initial_window;
     tcp->send.lastWindow = initial_window;
@@ -2644,18 +2823,24 @@ TCP* tcp_new(Host* host, guint receiveBufferSize, guint sendBufferSize) {
     tcp->receive.lastAcknowledgment = initialSequenceNumber;
 
     tcp->autotune.isEnabled = TRUE;
+    tcp->send.linuxDelayedACKs = config_getSocketLinuxDelayedAck(config);
 
     tcp->throttledOutput =
             priorityqueue_new((GCompareDataFunc)packet_compareTCPSequence, NULL, (GDestroyNotify)packet_unref);
     tcp->unorderedInput =
             priorityqueue_new((GCompareDataFunc)packet_compareTCPSequence, NULL, (GDestroyNotify)packet_unref);
-    tcp->retransmit.queue =
-            g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)packet_unref);
+    tcp->retransmit.queue = seqring_new((GDestroyNotify)packet_unref);
 
     retransmit_tally_init(&tcp->retransmit.tally);
-
-    tcp->retransmit.scheduledTimerExpirations =
-            priorityqueue_new((GCompareDataFunc)utility_simulationTimeCompare, NULL, g_free);
+    tcp->send.selectiveACKs = g_array_new(FALSE, FALSE, sizeof(PacketTCPSackBlock));
+
+    /* while scheduled, each timer holds a reference to us */
+    timerwheelentry_init(&tcp->retransmit.timer, _tcp_runRetransmitTimerExpired, tcp,
+                         descriptor_ref, descriptor_unref);
+    timerwheelentry_init(&tcp->send.delayedACKTimer, _tcp_runDelayedACKTimerExpired, tcp,
+                         descriptor_ref, descriptor_unref);
+    timerwheelentry_init(&tcp->closeTimer, _tcp_runCloseTimerExpired, tcp, descriptor_ref,
+                         descriptor_unref);
 
     /* initialize tcp retransmission timeout */
     _tcp_setRetransmitTimeout(tcp, CONFIG_TCP_RTO_INIT);
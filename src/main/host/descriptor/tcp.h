@@ -10,9 +10,11 @@
 #include <glib.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
 #include "main/core/support/definitions.h"
+#include "main/host/thread.h"
 #include "main/routing/packet.minimal.h"
 
 #define TCP_MIN_CWND 10
@@ -34,11 +36,6 @@ enum TCPProcessFlags {
     TCP_PF_RWND_UPDATED = 1 << 5,
 };
 
-typedef enum _TCPCongestionType TCPCongestionType;
-enum _TCPCongestionType {
-    TCP_CC_UNKNOWN, TCP_CC_AIMD, TCP_CC_RENO, TCP_CC_CUBIC,
-};
-
 TCP* tcp_new(Host* host, guint receiveBufferSize, guint sendBufferSize);
 
 // clang-format off
@@ -63,8 +60,14 @@ gint tcp_getConnectionError(TCP* tcp);
 
 void tcp_getInfo(TCP* tcp, struct tcp_info *tcpinfo);
 void tcp_enterServerMode(TCP* tcp, Host* host, gint backlog);
+/* Changes the backlog of a socket that is already listening. */
+void tcp_updateServerBacklog(TCP* tcp, gint backlog);
 gint tcp_acceptServerPeer(TCP* tcp, Host* host, in_addr_t* ip, in_port_t* port,
                           gint* acceptedHandle);
+/* Takes the next child off the accept queue, for servers that aren't owned by a
+ * process. The child is returned even if it was reset before it was accepted, in
+ * which case this returns -ECONNABORTED. */
+gint tcp_acceptServerChild(TCP* tcp, TCP** child);
 
 struct TCPCong_ *tcp_cong(TCP *tcp);
 
@@ -73,17 +76,32 @@ void tcp_clearAllChildrenIfServer(TCP* tcp);
 gsize tcp_getOutputBufferLength(TCP* tcp);
 gsize tcp_getInputBufferLength(TCP* tcp);
 gsize tcp_getNotSentBytes(TCP* tcp);
+/* Packets that were sent but are not yet cumulatively acknowledged. */
+guint32 tcp_getNumPacketsInFlight(TCP* tcp);
 
 void tcp_disableSendBufferAutotuning(TCP* tcp);
 void tcp_disableReceiveBufferAutotuning(TCP* tcp);
 
 gboolean tcp_isValidListener(TCP* tcp);
 gboolean tcp_isListeningAllowed(TCP* tcp);
+/* Returns TRUE if tcp is a server with a child connected to the peer. */
+gboolean tcp_hasChild(TCP* tcp, in_addr_t peerIP, in_port_t peerPort);
 
 gint tcp_shutdown(TCP* tcp, Host* host, gint how);
 
-void tcp_networkInterfaceIsAboutToSendPacket(TCP* tcp, Host* host, Packet* packet);
+/* Buffers up to nBytes of data that is already in Shadow's memory for sending,
+ * like a send() from the plugin would. Returns the number of bytes accepted,
+ * or a negative errno. */
+gssize tcp_sendShadowData(TCP* tcp, Host* host, const void* buffer, gsize nBytes);
+/* Reads up to nBytes of received data into a buffer in Shadow's memory, like a
+ * recv() from the plugin would. Returns the number of bytes read, 0 at EOF, or a
+ * negative errno. */
+gssize tcp_receiveShadowData(TCP* tcp, Host* host, void* buffer, gsize nBytes);
+/* Like a send() from the plugin, for the first nBytes of the plugin's buffers
+ * described by iov. Each segment is gathered straight from those buffers. */
+gssize tcp_sendUserDataIov(TCP* tcp, Thread* thread, const struct iovec* iov, size_t iovlen,
+                           gsize nBytes);
 
-TCPCongestionType tcpCongestion_getType(const gchar* type);
+void tcp_networkInterfaceIsAboutToSendPacket(TCP* tcp, Host* host, Packet* packet);
 
 #endif /* SHD_TCP_H_ */
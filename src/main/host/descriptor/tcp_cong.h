@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 
+#include "main/core/support/definitions.h"
 #include "main/host/descriptor/tcp.h"
 
 // congestion event hooks
@@ -13,6 +14,8 @@ typedef bool (*TCPCongFastRecovery)(TCP *tcp);
 typedef void (*TCPCongNewAckEv)(TCP *tcp, guint32 n);
 typedef void (*TCPCongTimeoutEv)(TCP *tcp);
 typedef guint32 (*TCPCongSSThresh)(TCP *tcp);
+// optional, may be NULL
+typedef void (*TCPCongRTTSampleEv)(TCP *tcp, SimulationTime rtt);
 
 typedef struct TCPCongHooks_ {
     TCPCongDelete tcp_cong_delete;
@@ -21,6 +24,7 @@ typedef struct TCPCongHooks_ {
     TCPCongNewAckEv tcp_cong_new_ack_ev;
     TCPCongTimeoutEv tcp_cong_timeout_ev;
     TCPCongSSThresh tcp_cong_ssthresh;
+    TCPCongRTTSampleEv tcp_cong_rtt_sample_ev;
 } TCPCongHooks;
 
 typedef struct TCPCong_ {
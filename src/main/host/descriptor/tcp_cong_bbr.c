@@ -0,0 +1,297 @@
+#include "main/host/descriptor/tcp_cong_bbr.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lib/logger/logger.h"
+#include "main/core/worker.h"
+#include "main/host/descriptor/descriptor.h"
+#include "main/host/descriptor/tcp.h"
+#include "main/host/descriptor/tcp_cong.h"
+
+/*
+ * A cwnd-only approximation of BBR v1. We don't have a pacer, so instead of
+ * pacing at pacing_gain * btl_bw we use the gain to scale the congestion window
+ * that we allow around the estimated bandwidth-delay product. Windows are
+ * counted in packets, same as the other algorithms.
+ */
+
+/* rounds over which we keep the maximum delivery rate */
+#define BBR_BW_FILTER_ROUNDS 10
+#define BBR_MIN_RTT_WINDOW (10 * SIMTIME_ONE_SECOND)
+#define BBR_PROBE_RTT_DURATION (200 * SIMTIME_ONE_MILLISECOND)
+#define BBR_MIN_CWND 4
+#define BBR_INITIAL_CWND 10
+/* startup ends when the bandwidth didn't grow by 25% for 3 rounds */
+#define BBR_FULL_BW_THRESHOLD 1.25
+#define BBR_FULL_BW_ROUNDS 3
+#define BBR_HIGH_GAIN 2.885
+#define BBR_CWND_GAIN 2.0
+
+typedef enum BBRMode_ {
+    BBR_STARTUP,
+    BBR_DRAIN,
+    BBR_PROBE_BW,
+    BBR_PROBE_RTT,
+} BBRMode;
+
+static const double bbr_probe_bw_gains_[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+#define BBR_PROBE_BW_CYCLE_LEN (sizeof(bbr_probe_bw_gains_) / sizeof(bbr_probe_bw_gains_[0]))
+
+typedef struct CABBR_ {
+
+    BBRMode mode;
+
+    /* total packets acked, and the value it must reach to end this round */
+    guint64 delivered;
+    guint64 next_round_delivered;
+    guint64 round_count;
+    guint64 round_start_delivered;
+    SimulationTime round_start_time;
+
+    /* per-round delivery rates in packets per second; the max is btl_bw */
+    double bw_samples[BBR_BW_FILTER_ROUNDS];
+    double btl_bw;
+
+    SimulationTime min_rtt;
+    SimulationTime min_rtt_stamp;
+
+    /* full pipe detection */
+    double full_bw;
+    guint32 full_bw_count;
+    bool filled_pipe;
+
+    guint32 cycle_index;
+    SimulationTime cycle_stamp;
+
+    SimulationTime probe_rtt_done_stamp;
+    bool probe_rtt_round_done;
+
+    /* the cwnd to restore after probe rtt */
+    guint32 prior_cwnd;
+
+} CABBR;
+
+/* HELPERS *******************************************************/
+
+static inline guint32 bbr_bdp_(CABBR *bbr, double gain) {
+    if (bbr->min_rtt == 0 || bbr->btl_bw == 0) {
+        return BBR_INITIAL_CWND;
+    }
+    double bdp = bbr->btl_bw * ((double)bbr->min_rtt / SIMTIME_ONE_SECOND);
+    return MAX((guint32)(gain * bdp), BBR_MIN_CWND);
+}
+
+static inline void bbr_save_cwnd_(TCP *tcp, CABBR *bbr) {
+    if (bbr->mode != BBR_PROBE_RTT) {
+        bbr->prior_cwnd = tcp_cong(tcp)->cwnd;
+    } else {
+        bbr->prior_cwnd = MAX(bbr->prior_cwnd, tcp_cong(tcp)->cwnd);
+    }
+}
+
+static void bbr_enter_probe_bw_(CABBR *bbr, SimulationTime now) {
+    bbr->mode = BBR_PROBE_BW;
+    /* start anywhere but the draining phase, like linux does */
+    bbr->cycle_index = (guint32)(bbr->round_count % (BBR_PROBE_BW_CYCLE_LEN - 1));
+    if (bbr->cycle_index >= 1) {
+        bbr->cycle_index++;
+    }
+    bbr->cycle_stamp = now;
+}
+
+/* returns true if this ack ended a round */
+static bool bbr_update_round_(TCP *tcp, CABBR *bbr, guint32 n, SimulationTime now) {
+    bbr->delivered += n;
+
+    if (bbr->delivered < bbr->next_round_delivered) {
+        return false;
+    }
+
+    SimulationTime elapsed = now - bbr->round_start_time;
+    if (bbr->round_start_time != 0 && elapsed > 0) {
+        double rate = (double)(bbr->delivered - bbr->round_start_delivered) /
+                      ((double)elapsed / SIMTIME_ONE_SECOND);
+
+        bbr->bw_samples[bbr->round_count % BBR_BW_FILTER_ROUNDS] = rate;
+        bbr->btl_bw = 0;
+        for (int i = 0; i < BBR_BW_FILTER_ROUNDS; i++) {
+            bbr->btl_bw = MAX(bbr->btl_bw, bbr->bw_samples[i]);
+        }
+    }
+
+    bbr->round_count++;
+    bbr->round_start_delivered = bbr->delivered;
+    bbr->round_start_time = now;
+    bbr->next_round_delivered = bbr->delivered + tcp_getNumPacketsInFlight(tcp);
+    return true;
+}
+
+static void bbr_check_full_pipe_(CABBR *bbr) {
+    if (bbr->filled_pipe) {
+        return;
+    }
+    if (bbr->btl_bw >= bbr->full_bw * BBR_FULL_BW_THRESHOLD) {
+        bbr->full_bw = bbr->btl_bw;
+        bbr->full_bw_count = 0;
+        return;
+    }
+    if (++bbr->full_bw_count >= BBR_FULL_BW_ROUNDS) {
+        bbr->filled_pipe = true;
+    }
+}
+
+static void bbr_update_probe_rtt_(TCP *tcp, CABBR *bbr, bool round_start, SimulationTime now) {
+    if (bbr->mode != BBR_PROBE_RTT && bbr->min_rtt != 0 &&
+        now > bbr->min_rtt_stamp + BBR_MIN_RTT_WINDOW) {
+        debug("[CONG] fd %i transition_to_probe_rtt", ((LegacyDescriptor*)tcp)->handle);
+        bbr_save_cwnd_(tcp, bbr);
+        bbr->mode = BBR_PROBE_RTT;
+        bbr->probe_rtt_done_stamp = 0;
+    }
+
+    if (bbr->mode != BBR_PROBE_RTT) {
+        return;
+    }
+
+    if (bbr->probe_rtt_done_stamp == 0) {
+        if (tcp_getNumPacketsInFlight(tcp) <= BBR_MIN_CWND) {
+            bbr->probe_rtt_done_stamp = now + BBR_PROBE_RTT_DURATION;
+            bbr->probe_rtt_round_done = false;
+        }
+        return;
+    }
+
+    if (round_start) {
+        bbr->probe_rtt_round_done = true;
+    }
+    if (bbr->probe_rtt_round_done && now >= bbr->probe_rtt_done_stamp) {
+        bbr->min_rtt_stamp = now;
+        tcp_cong(tcp)->cwnd = MAX(tcp_cong(tcp)->cwnd, bbr->prior_cwnd);
+        if (bbr->filled_pipe) {
+            bbr_enter_probe_bw_(bbr, now);
+        } else {
+            bbr->mode = BBR_STARTUP;
+        }
+    }
+}
+
+static void bbr_update_mode_(TCP *tcp, CABBR *bbr, SimulationTime now) {
+    switch (bbr->mode) {
+        case BBR_STARTUP:
+            if (bbr->filled_pipe) {
+                debug("[CONG] fd %i transition_to_drain", ((LegacyDescriptor*)tcp)->handle);
+                bbr->mode = BBR_DRAIN;
+            }
+            break;
+        case BBR_DRAIN:
+            if (tcp_getNumPacketsInFlight(tcp) <= bbr_bdp_(bbr, 1)) {
+                debug("[CONG] fd %i transition_to_probe_bw", ((LegacyDescriptor*)tcp)->handle);
+                bbr_enter_probe_bw_(bbr, now);
+            }
+            break;
+        case BBR_PROBE_BW:
+            if (bbr->min_rtt != 0 && now - bbr->cycle_stamp > bbr->min_rtt) {
+                bbr->cycle_index = (bbr->cycle_index + 1) % BBR_PROBE_BW_CYCLE_LEN;
+                bbr->cycle_stamp = now;
+            }
+            break;
+        case BBR_PROBE_RTT: break;
+    }
+}
+
+static void bbr_set_cwnd_(TCP *tcp, CABBR *bbr, guint32 n) {
+    guint32 cwnd = tcp_cong(tcp)->cwnd;
+
+    switch (bbr->mode) {
+        case BBR_STARTUP:
+            /* grow like slow start while below the target */
+            if (cwnd < bbr_bdp_(bbr, BBR_HIGH_GAIN)) {
+                cwnd += n;
+            }
+            break;
+        case BBR_DRAIN:
+            cwnd = MIN(cwnd, bbr_bdp_(bbr, BBR_CWND_GAIN));
+            break;
+        case BBR_PROBE_BW: {
+            guint32 target =
+                bbr_bdp_(bbr, BBR_CWND_GAIN * bbr_probe_bw_gains_[bbr->cycle_index]);
+            /* approach the target from below by at most the acked packets */
+            cwnd = (cwnd < target) ? MIN(cwnd + n, target) : target;
+            break;
+        }
+        case BBR_PROBE_RTT: cwnd = BBR_MIN_CWND; break;
+    }
+
+    tcp_cong(tcp)->cwnd = MAX(cwnd, BBR_MIN_CWND);
+}
+
+/*******************************************************************/
+
+static void tcp_cong_bbr_delete_(TCP *tcp) {
+    free(tcp_cong(tcp)->ca);
+}
+
+/* bbr doesn't treat loss as a congestion signal, retransmission is up to tcp */
+static void tcp_cong_bbr_duplicate_ack_ev_(TCP *tcp) {}
+
+static bool tcp_cong_bbr_fast_recovery_(TCP *tcp) {
+    return false;
+}
+
+static void tcp_cong_bbr_new_ack_ev_(TCP *tcp, guint32 n) {
+    CABBR *bbr = tcp_cong(tcp)->ca;
+    SimulationTime now = worker_getCurrentTime();
+
+    bool round_start = bbr_update_round_(tcp, bbr, n, now);
+    if (round_start) {
+        bbr_check_full_pipe_(bbr);
+    }
+    bbr_update_mode_(tcp, bbr, now);
+    bbr_update_probe_rtt_(tcp, bbr, round_start, now);
+    bbr_set_cwnd_(tcp, bbr, n);
+}
+
+static void tcp_cong_bbr_timeout_ev_(TCP *tcp) {
+    /* the window grows back towards the bdp as acks arrive */
+    tcp_cong(tcp)->cwnd = BBR_MIN_CWND;
+    debug("[CONG] fd %i timeout, cwnd reset", ((LegacyDescriptor*)tcp)->handle);
+}
+
+static guint32 tcp_cong_bbr_ssthresh_(TCP *tcp) {
+    /* there is no slow start threshold */
+    return INT32_MAX;
+}
+
+static void tcp_cong_bbr_rtt_sample_ev_(TCP *tcp, SimulationTime rtt) {
+    CABBR *bbr = tcp_cong(tcp)->ca;
+    SimulationTime now = worker_getCurrentTime();
+
+    if (bbr->min_rtt == 0 || rtt <= bbr->min_rtt ||
+        now > bbr->min_rtt_stamp + BBR_MIN_RTT_WINDOW) {
+        bbr->min_rtt = rtt;
+        bbr->min_rtt_stamp = now;
+    }
+}
+
+static const struct TCPCongHooks_ bbr_hooks_ = {
+    .tcp_cong_delete = tcp_cong_bbr_delete_,
+    .tcp_cong_duplicate_ack_ev = tcp_cong_bbr_duplicate_ack_ev_,
+    .tcp_cong_fast_recovery = tcp_cong_bbr_fast_recovery_,
+    .tcp_cong_new_ack_ev = tcp_cong_bbr_new_ack_ev_,
+    .tcp_cong_timeout_ev = tcp_cong_bbr_timeout_ev_,
+    .tcp_cong_ssthresh = tcp_cong_bbr_ssthresh_,
+    .tcp_cong_rtt_sample_ev = tcp_cong_bbr_rtt_sample_ev_
+};
+
+void tcp_cong_bbr_init(TCP *tcp) {
+    CABBR *bbr = malloc(sizeof(CABBR));
+    *bbr = (CABBR){0};
+    bbr->mode = BBR_STARTUP;
+
+    tcp_cong(tcp)->cwnd = BBR_INITIAL_CWND;
+    tcp_cong(tcp)->hooks = (TCPCongHooks*)&bbr_hooks_;
+    tcp_cong(tcp)->ca = bbr;
+}
@@ -0,0 +1,9 @@
+#ifndef SHD_TCP_CONG_BBR_H_
+#define SHD_TCP_CONG_BBR_H_
+
+#include "main/host/descriptor/tcp.h"
+#include "main/host/descriptor/tcp_cong.h"
+
+void tcp_cong_bbr_init(TCP *tcp);
+
+#endif // SHD_TCP_CONG_BBR_H_
@@ -0,0 +1,210 @@
+#include "main/host/descriptor/tcp_cong_cubic.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lib/logger/logger.h"
+#include "main/core/worker.h"
+#include "main/host/descriptor/descriptor.h"
+#include "main/host/descriptor/tcp.h"
+#include "main/host/descriptor/tcp_cong.h"
+#include "main/host/descriptor/tcp_cong_cubic_window.h"
+
+/* like reno, this is where we restart from after a timeout */
+#define CUBIC_RESTART_WINDOW 10
+
+typedef struct CACubic_ {
+
+    const TCPCongHooks *state_hooks;
+
+    size_t duplicate_ack_n;
+
+    guint32 ssthresh;
+
+    CubicWindow window;
+
+} CACubic;
+
+/*
+ * Prototype these to avoid circular refs.
+ */
+static inline const struct TCPCongHooks_ *slow_start_hooks_();
+static inline const struct TCPCongHooks_ *fast_recovery_hooks_();
+static inline const struct TCPCongHooks_ *cong_avoid_hooks_();
+
+/* HELPERS *******************************************************/
+
+static inline void multiplicative_decrease(TCP *tcp, CACubic *cubic) {
+    cubic->ssthresh = cubicwindow_onLoss(&cubic->window, tcp_cong(tcp)->cwnd);
+}
+
+/*
+ * Pass in a non-zero value for n to ack n packets during the transition.
+ */
+static inline void transition_to_cong_avoid(TCP *tcp, CACubic *cubic, guint32 n) {
+    cubicwindow_resetEpoch(&cubic->window);
+    cubic->state_hooks = cong_avoid_hooks_();
+    cubic->state_hooks->tcp_cong_new_ack_ev(tcp, n);
+    debug("[CONG] fd %i transition_to_cong_avoid", ((LegacyDescriptor*)tcp)->handle);
+}
+
+/* SLOW START *******************************************************/
+
+static void ca_cubic_slow_start_duplicate_ack_ev_(TCP *tcp) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+    cubic->duplicate_ack_n++;
+
+    if (cubic->duplicate_ack_n == 3) { // transition to fast recovery
+
+        trace("[CONG-AVOID] three duplicate acks");
+        debug("[CONG] fd %i three duplicate acks transition_to_fast_recovery",
+              ((LegacyDescriptor*)tcp)->handle);
+
+        multiplicative_decrease(tcp, cubic);
+        tcp_cong(tcp)->cwnd = cubic->ssthresh + 3;
+
+        cubic->state_hooks = fast_recovery_hooks_();
+    }
+}
+
+static void ca_cubic_slow_start_new_ack_ev_(TCP *tcp, guint32 n) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+
+    cubic->duplicate_ack_n = 0;
+
+    guint32 new_cwnd = tcp_cong(tcp)->cwnd;
+    new_cwnd += n;
+
+    if (new_cwnd >= cubic->ssthresh) { // transition to cong avoid
+        guint32 nleft = new_cwnd - cubic->ssthresh;
+        tcp_cong(tcp)->cwnd = cubic->ssthresh;
+        transition_to_cong_avoid(tcp, cubic, nleft);
+    } else {
+        tcp_cong(tcp)->cwnd = new_cwnd;
+    }
+}
+
+/* FAST RECOVERY *******************************************************/
+
+static void ca_cubic_fast_recovery_duplicate_ack_ev_(TCP *tcp) {
+    tcp_cong(tcp)->cwnd += 1;
+}
+
+static void ca_cubic_fast_recovery_new_ack_ev_(TCP *tcp, guint32 n) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+
+    cubic->duplicate_ack_n = 0;
+    tcp_cong(tcp)->cwnd = cubic->ssthresh;
+
+    transition_to_cong_avoid(tcp, cubic, n);
+}
+
+/* CONG AVOID *******************************************************/
+
+static void ca_cubic_cong_avoid_new_ack_ev_(TCP *tcp, guint32 n) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+    cubic->duplicate_ack_n = 0;
+
+    tcp_cong(tcp)->cwnd +=
+        cubicwindow_onAck(&cubic->window, tcp_cong(tcp)->cwnd, n, worker_getCurrentTime());
+}
+
+/*******************************************************************/
+
+static void ca_cubic_init_(TCP *tcp, CACubic *cubic) {
+    *cubic = (CACubic){0};
+    cubic->ssthresh = INT32_MAX;
+    cubic->state_hooks = slow_start_hooks_();
+}
+
+static void tcp_cong_cubic_delete_(TCP *tcp) {
+    free(tcp_cong(tcp)->ca);
+}
+
+static void tcp_cong_cubic_duplicate_ack_ev_(TCP *tcp) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+    cubic->state_hooks->tcp_cong_duplicate_ack_ev(tcp);
+}
+
+static bool tcp_cong_cubic_fast_recovery_(TCP *tcp) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+    return cubic->state_hooks == fast_recovery_hooks_();
+}
+
+static void tcp_cong_cubic_new_ack_ev_(TCP *tcp, guint32 n) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+    cubic->state_hooks->tcp_cong_new_ack_ev(tcp, n);
+}
+
+static void tcp_cong_cubic_timeout_ev_(TCP *tcp) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+
+    cubic->duplicate_ack_n = 0;
+    multiplicative_decrease(tcp, cubic);
+    tcp_cong(tcp)->cwnd = CUBIC_RESTART_WINDOW;
+
+    // transition to slow start
+    cubic->state_hooks = slow_start_hooks_();
+    debug("[CONG] fd %i transition_to_slow_start", ((LegacyDescriptor*)tcp)->handle);
+}
+
+static guint32 tcp_cong_cubic_ssthresh_(TCP *tcp) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+    return cubic->ssthresh;
+}
+
+static void tcp_cong_cubic_rtt_sample_ev_(TCP *tcp, SimulationTime rtt) {
+    CACubic *cubic = tcp_cong(tcp)->ca;
+    if (cubic->window.min_rtt == 0 || rtt < cubic->window.min_rtt) {
+        cubic->window.min_rtt = rtt;
+    }
+}
+
+static const struct TCPCongHooks_ cubic_hooks_ = {
+    .tcp_cong_delete = tcp_cong_cubic_delete_,
+    .tcp_cong_duplicate_ack_ev = tcp_cong_cubic_duplicate_ack_ev_,
+    .tcp_cong_fast_recovery = tcp_cong_cubic_fast_recovery_,
+    .tcp_cong_new_ack_ev = tcp_cong_cubic_new_ack_ev_,
+    .tcp_cong_timeout_ev = tcp_cong_cubic_timeout_ev_,
+    .tcp_cong_ssthresh = tcp_cong_cubic_ssthresh_,
+    .tcp_cong_rtt_sample_ev = tcp_cong_cubic_rtt_sample_ev_
+};
+
+void tcp_cong_cubic_init(TCP *tcp) {
+    CACubic *cubic = malloc(sizeof(CACubic));
+    ca_cubic_init_(tcp, cubic);
+
+    tcp_cong(tcp)->cwnd = 1;
+    tcp_cong(tcp)->hooks = (TCPCongHooks*)&cubic_hooks_;
+    tcp_cong(tcp)->ca = cubic;
+}
+
+static const struct TCPCongHooks_ slow_start_hooks__ = {
+    .tcp_cong_duplicate_ack_ev = ca_cubic_slow_start_duplicate_ack_ev_,
+    .tcp_cong_new_ack_ev = ca_cubic_slow_start_new_ack_ev_,
+};
+
+static const struct TCPCongHooks_ fast_recovery_hooks__ = {
+    .tcp_cong_duplicate_ack_ev = ca_cubic_fast_recovery_duplicate_ack_ev_,
+    .tcp_cong_new_ack_ev = ca_cubic_fast_recovery_new_ack_ev_,
+};
+
+/* slow start and cong avoidance have the same dupl act behavior */
+static const struct TCPCongHooks_ cong_avoid_hooks__ = {
+    .tcp_cong_duplicate_ack_ev = ca_cubic_slow_start_duplicate_ack_ev_,
+    .tcp_cong_new_ack_ev = ca_cubic_cong_avoid_new_ack_ev_,
+};
+
+static inline const struct TCPCongHooks_ *slow_start_hooks_() {
+    return &slow_start_hooks__;
+}
+
+static inline const struct TCPCongHooks_ *fast_recovery_hooks_() {
+    return &fast_recovery_hooks__;
+}
+
+static inline const struct TCPCongHooks_ *cong_avoid_hooks_() {
+    return &cong_avoid_hooks__;
+}
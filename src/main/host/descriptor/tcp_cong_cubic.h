@@ -0,0 +1,9 @@
+#ifndef SHD_TCP_CONG_CUBIC_H_
+#define SHD_TCP_CONG_CUBIC_H_
+
+#include "main/host/descriptor/tcp.h"
+#include "main/host/descriptor/tcp_cong.h"
+
+void tcp_cong_cubic_init(TCP *tcp);
+
+#endif // SHD_TCP_CONG_CUBIC_H_
@@ -0,0 +1,84 @@
+#include "main/host/descriptor/tcp_cong_cubic_window.h"
+
+#include <glib.h>
+
+#define RTT (100 * SIMTIME_ONE_MILLISECOND)
+
+/* Acks a full window every rtt, starting at start, until the window reaches limit or
+ * rounds rtts have passed. Returns the window. */
+static guint32 _ackRounds(CubicWindow* w, guint32 cwnd, SimulationTime start, int rounds,
+                          guint32 limit) {
+    for (int i = 0; i < rounds && cwnd < limit; i++) {
+        SimulationTime now = start + i * RTT;
+        guint32 acked = cwnd;
+        /* ack the window a packet at a time, spread over the rtt */
+        for (guint32 j = 0; j < acked; j++) {
+            cwnd += cubicwindow_onAck(w, cwnd, 1, now + j * (RTT / acked));
+        }
+    }
+    return cwnd;
+}
+
+static void growthIsConcaveThenConvex() {
+    CubicWindow w = {.min_rtt = RTT};
+    guint32 cwnd = 100;
+    guint32 ssthresh = cubicwindow_onLoss(&w, cwnd);
+    g_assert_cmpuint(ssthresh, ==, 70);
+    cwnd = ssthresh;
+
+    /* K = cbrt(30 / 0.4) ~= 4.2 seconds, so the window approaches w_max slowly around then */
+    SimulationTime start = SIMTIME_ONE_SECOND;
+    guint32 at_k = _ackRounds(&w, cwnd, start, 42, G_MAXUINT32);
+    g_assert_cmpuint(at_k, >, 90);
+    g_assert_cmpuint(at_k, <=, 101);
+
+    /* and it grows past w_max faster and faster afterwards */
+    guint32 later = _ackRounds(&w, at_k, start + 42 * RTT, 30, G_MAXUINT32);
+    g_assert_cmpuint(later, >, at_k + 10);
+}
+
+static void growthIsAtMostHalfTheAckedPackets() {
+    CubicWindow w = {.min_rtt = RTT, .w_max = 10000};
+    guint32 cwnd = 10;
+
+    /* far below the curve, the window still grows by at most one packet every two acks */
+    guint32 growth = cubicwindow_onAck(&w, cwnd, 1, SIMTIME_ONE_SECOND);
+    growth += cubicwindow_onAck(&w, cwnd, 100, SIMTIME_ONE_SECOND + 100 * SIMTIME_ONE_SECOND);
+    g_assert_cmpuint(growth, <=, 51);
+}
+
+static void idleConnectionRestartsTheCurve() {
+    CubicWindow w = {.min_rtt = RTT};
+    guint32 cwnd = _ackRounds(&w, 50, SIMTIME_ONE_SECOND, 10, G_MAXUINT32);
+
+    /* an hour without acks */
+    SimulationTime now = SIMTIME_ONE_SECOND + 10 * RTT + 3600 * SIMTIME_ONE_SECOND;
+    guint32 growth = 0;
+    for (int i = 0; i < 10; i++) {
+        growth += cubicwindow_onAck(&w, cwnd + growth, 1, now + i);
+    }
+
+    /* the curve starts over at the current window instead of an hour along it */
+    g_assert_cmpuint(w.epoch_start, ==, now);
+    g_assert_cmpuint(growth, <=, 1);
+}
+
+static void noGrowthWithoutAcks() {
+    CubicWindow w = {.min_rtt = RTT};
+    g_assert_cmpuint(cubicwindow_onAck(&w, 10, 0, SIMTIME_ONE_SECOND), ==, 0);
+    g_assert_cmpuint(w.epoch_start, ==, 0);
+}
+
+int main(int argc, char* argv[]) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions();
+
+    g_test_add_func("/tcp_cong_cubic/growthIsConcaveThenConvex", growthIsConcaveThenConvex);
+    g_test_add_func(
+        "/tcp_cong_cubic/growthIsAtMostHalfTheAckedPackets", growthIsAtMostHalfTheAckedPackets);
+    g_test_add_func(
+        "/tcp_cong_cubic/idleConnectionRestartsTheCurve", idleConnectionRestartsTheCurve);
+    g_test_add_func("/tcp_cong_cubic/noGrowthWithoutAcks", noGrowthWithoutAcks);
+
+    return g_test_run();
+}
@@ -0,0 +1,82 @@
+#include "main/host/descriptor/tcp_cong_cubic_window.h"
+
+#include <math.h>
+
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+#define CUBIC_MIN_SSTHRESH 2
+/* Like linux's bictcp_update, the window never grows by more than one packet for every
+ * two acked, however far the curve is above it */
+#define CUBIC_MIN_CNT 2.0
+/* Without acks for this long, or two minimum rtts if that's longer, the connection was
+ * idle, and the curve restarts from the current window rather than jumping ahead by the
+ * idle time. This is linux's minimum retransmission timeout. */
+#define CUBIC_MIN_IDLE_TIME (200 * SIMTIME_ONE_MILLISECOND)
+
+void cubicwindow_resetEpoch(CubicWindow *w) {
+    w->epoch_start = 0;
+    w->cong_avoid_nacked = 0;
+}
+
+guint32 cubicwindow_onLoss(CubicWindow *w, guint32 cwnd) {
+    /* fast convergence: release bandwidth to newer flows */
+    if (cwnd < w->w_last_max) {
+        w->w_last_max = cwnd;
+        w->w_max = cwnd * (1.0 + CUBIC_BETA) / 2.0;
+    } else {
+        w->w_last_max = cwnd;
+        w->w_max = cwnd;
+    }
+
+    w->epoch_start = 0;
+    return MAX((guint32)(cwnd * CUBIC_BETA), CUBIC_MIN_SSTHRESH);
+}
+
+guint32 cubicwindow_onAck(CubicWindow *w, guint32 packets, guint32 n, SimulationTime now) {
+    if (n == 0) {
+        return 0;
+    }
+
+    SimulationTime idle_time = MAX(2 * w->min_rtt, CUBIC_MIN_IDLE_TIME);
+    if (w->epoch_start != 0 && w->last_ack_time != 0 && now - w->last_ack_time > idle_time) {
+        cubicwindow_resetEpoch(w);
+    }
+    w->last_ack_time = now;
+
+    double cwnd = MAX(packets, 1);
+
+    if (w->epoch_start == 0) {
+        w->epoch_start = now;
+        if (cwnd < w->w_max) {
+            w->k = cbrt((w->w_max - cwnd) / CUBIC_C);
+            w->origin_point = w->w_max;
+        } else {
+            w->k = 0;
+            w->origin_point = cwnd;
+        }
+        w->w_est = cwnd;
+    }
+
+    /* the window we want one rtt from now */
+    double t = (double)(now - w->epoch_start + w->min_rtt) / SIMTIME_ONE_SECOND;
+    double target = w->origin_point + CUBIC_C * pow(t - w->k, 3);
+
+    /* number of acked packets needed to grow the window by one */
+    double cnt = (target > cwnd) ? cwnd / (target - cwnd) : 100 * cwnd;
+
+    /* never be slower than standard tcp would be */
+    w->w_est += (3.0 * (1.0 - CUBIC_BETA) / (1.0 + CUBIC_BETA)) * (n / cwnd);
+    if (w->w_est > cwnd) {
+        cnt = MIN(cnt, cwnd / (w->w_est - cwnd));
+    }
+
+    cnt = MAX(cnt, CUBIC_MIN_CNT);
+
+    guint32 growth = 0;
+    w->cong_avoid_nacked += n;
+    while (w->cong_avoid_nacked >= cnt) {
+        w->cong_avoid_nacked -= cnt;
+        growth++;
+    }
+    return growth;
+}
@@ -0,0 +1,40 @@
+#ifndef SHD_TCP_CONG_CUBIC_WINDOW_H_
+#define SHD_TCP_CONG_CUBIC_WINDOW_H_
+
+#include <glib.h>
+
+#include "main/core/support/definitions.h"
+
+/* The window growth function of CUBIC (RFC 8312), kept apart from the TCP state so that
+ * it can be tested on its own. Windows are counted in packets. A zeroed CubicWindow
+ * starts a new epoch with the first ack. */
+typedef struct CubicWindow_ {
+    /* the window before the last reduction, and the one before that */
+    double w_max;
+    double w_last_max;
+    /* the start of the current congestion avoidance epoch, or 0 */
+    SimulationTime epoch_start;
+    /* the time it takes to grow back to origin_point, in seconds */
+    double k;
+    double origin_point;
+    /* the window standard tcp would have, for the tcp-friendly region */
+    double w_est;
+    /* acked packets not yet turned into window growth */
+    double cong_avoid_nacked;
+    /* when the last ack arrived, to notice that the connection was idle */
+    SimulationTime last_ack_time;
+    SimulationTime min_rtt;
+} CubicWindow;
+
+/* Starts a new epoch with the next ack, e.g. when the window was restarted. */
+void cubicwindow_resetEpoch(CubicWindow *w);
+
+/* Records a reduction of the window from cwnd after a loss, and returns the new
+ * slow start threshold (RFC 8312, section 4.5 and 4.6). */
+guint32 cubicwindow_onLoss(CubicWindow *w, guint32 cwnd);
+
+/* Returns how many packets a window of the given number of packets grows by when n more
+ * packets are acked at now, in congestion avoidance (RFC 8312, section 4.1 to 4.4). */
+guint32 cubicwindow_onAck(CubicWindow *w, guint32 packets, guint32 n, SimulationTime now);
+
+#endif // SHD_TCP_CONG_CUBIC_WINDOW_H_
@@ -13,11 +13,11 @@
 
 #include "lib/logger/logger.h"
 #include "main/core/support/definitions.h"
-#include "main/core/work/task.h"
 #include "main/core/worker.h"
 #include "main/host/descriptor/descriptor.h"
 #include "main/host/descriptor/descriptor_types.h"
 #include "main/host/host.h"
+#include "main/host/timer_wheel.h"
 #include "main/utility/utility.h"
 
 struct _Timer {
@@ -30,12 +30,11 @@ struct _Timer {
     /* number of expires that happened since the timer was last set */
     guint64 expireCountSinceLastSet;
 
-    /* expire ids are used internally to cancel events that fire after
-     * they have become invalid because the user reset the timer */
-    guint nextExpireID;
-    guint minValidExpireID;
+    /* runs the expiration on the host's timer wheel, which shares one scheduler
+     * event among all of the host's timers that expire at the same time. the
+     * entry is reused every time the timer is armed. */
+    TimerWheelEntry expireTimer;
 
-    guint numEventsScheduled;
     gboolean isClosed;
 
     MAGIC_DECLARE;
@@ -51,6 +50,7 @@ static gboolean _timer_close(LegacyDescriptor* descriptor, Host* host) {
     MAGIC_ASSERT(timer);
     trace("timer fd %i closing now", timer->super.handle);
     timer->isClosed = TRUE;
+    timerwheel_cancel(&timer->expireTimer);
     descriptor_adjustStatus(&(timer->super), STATUS_DESCRIPTOR_ACTIVE, FALSE);
     if (timer->super.handle > 0) {
         return TRUE; // deregister from process
@@ -62,6 +62,8 @@ static gboolean _timer_close(LegacyDescriptor* descriptor, Host* host) {
 static void _timer_free(LegacyDescriptor* descriptor) {
     Timer* timer = _timer_fromLegacyDescriptor(descriptor);
     MAGIC_ASSERT(timer);
+    /* the wheel holds a reference while the timer is scheduled */
+    utility_assert(!timerwheelentry_isScheduled(&timer->expireTimer));
     descriptor_clear((LegacyDescriptor*)timer);
     MAGIC_CLEAR(timer);
     g_free(timer);
@@ -71,11 +73,15 @@ static void _timer_free(LegacyDescriptor* descriptor) {
 static DescriptorFunctionTable _timerFunctions = {
     _timer_close, _timer_free, MAGIC_VALUE};
 
+static void _timer_expire(Host* host, gpointer voidTimer);
+
 Timer* timer_new() {
     Timer* timer = g_new0(Timer, 1);
     MAGIC_INIT(timer);
 
     descriptor_init(&(timer->super), DT_TIMER, &_timerFunctions);
+    timerwheelentry_init(
+        &timer->expireTimer, _timer_expire, timer, descriptor_ref, descriptor_unref);
     descriptor_adjustStatus(&(timer->super), STATUS_DESCRIPTOR_ACTIVE, TRUE);
 
     worker_count_allocation(Timer);
@@ -135,7 +141,7 @@ static void _timer_disarm(Timer* timer) {
     MAGIC_ASSERT(timer);
     timer->nextExpireTime = 0;
     timer->expireInterval = 0;
-    timer->minValidExpireID = timer->nextExpireID;
+    timerwheel_cancel(&timer->expireTimer);
     trace("timer fd %i disarmed", timer->super.handle);
 }
 
@@ -197,73 +203,45 @@ static void _timer_setCurrentInterval(Timer* timer, const struct timespec* confi
     timer->expireInterval = _timer_timespecToSimTime(config, FALSE);
 }
 
-static void _timer_expire(Host* host, gpointer voidTimer, gpointer data);
-
-static void _timer_scheduleNewExpireEvent(Timer* timer, Host* host) {
+static void _timer_scheduleExpireEvent(Timer* timer, Host* host) {
     MAGIC_ASSERT(timer);
 
-    /* callback to our own node */
-    gpointer next = GUINT_TO_POINTER(timer->nextExpireID);
-
-    /* ref the timer storage in the callback event */
-    descriptor_ref(timer);
-    Task* task = task_new(_timer_expire, timer, next, descriptor_unref, NULL);
-
-    SimulationTime delay = timer->nextExpireTime - worker_getCurrentTime();
+    trace("Scheduling timer expiration for %" G_GUINT64_FORMAT " nanoseconds",
+          timer->nextExpireTime - worker_getCurrentTime());
 
-    /* if the user set a super long delay, let's call back sooner to check if they closed
-     * or disarmed the timer in the meantime. This prevents queueing the task indefinitely. */
-    delay = MIN(delay, SIMTIME_ONE_SECOND);
-
-    trace("Scheduling timer expiration task for %"G_GUINT64_FORMAT" nanoseconds", delay);
-    worker_scheduleTask(task, host, delay);
-    task_unref(task);
-
-    timer->nextExpireID++;
-    timer->numEventsScheduled++;
+    /* this replaces the previous expiration if the timer was already scheduled */
+    timerwheel_schedule(host_getTimerWheel(host), &timer->expireTimer, timer->nextExpireTime);
 }
 
-static void _timer_expire(Host* host, gpointer voidTimer, gpointer data) {
+static void _timer_expire(Host* host, gpointer voidTimer) {
     Timer* timer = voidTimer;
     MAGIC_ASSERT(timer);
 
-    /* this is a task callback event */
-
-    guint expireID = GPOINTER_TO_UINT(data);
-    trace("timer fd %i expire check; isClosed=%i expireID=%u minValidExpireID=%u",
-          timer->super.handle, timer->isClosed, expireID,
-          timer->minValidExpireID);
-
-    timer->numEventsScheduled--;
-
-    /* make sure the timer has not been reset since we scheduled this expiration event */
-    if(!timer->isClosed && expireID >= timer->minValidExpireID) {
-        /* check if it actually expired on this callback check */
-        if(timer->nextExpireTime <= worker_getCurrentTime()) {
-            /* if a one-time (non-periodic) timer already expired before they
-             * started listening for the event with epoll, the event is reported
-             * immediately on the next epoll_wait call. this behavior was
-             * verified on linux. */
-            timer->expireCountSinceLastSet++;
-            descriptor_adjustStatus(&(timer->super), STATUS_DESCRIPTOR_READABLE, TRUE);
-
-            if(timer->expireInterval > 0) {
-                SimulationTime now = worker_getCurrentTime();
-                timer->nextExpireTime += timer->expireInterval;
-                if(timer->nextExpireTime < now) {
-                    /* for some reason we looped the interval. expire again immediately
-                     * to keep the periodic timer going. */
-                    timer->nextExpireTime = now;
-                }
-                _timer_scheduleNewExpireEvent(timer, host);
-            } else {
-                /* the timer is now disarmed */
-                _timer_disarm(timer);
-            }
-        } else {
-            /* it didn't expire yet, check again in another second */
-            _timer_scheduleNewExpireEvent(timer, host);
+    /* this is a timer wheel callback, which runs exactly at the expiration time.
+     * disarming or closing the timer cancels it, so it is still armed. */
+    trace("timer fd %i expired", timer->super.handle);
+    utility_assert(!timer->isClosed);
+    utility_assert(timer->nextExpireTime <= worker_getCurrentTime());
+
+    /* if a one-time (non-periodic) timer already expired before they
+     * started listening for the event with epoll, the event is reported
+     * immediately on the next epoll_wait call. this behavior was
+     * verified on linux. */
+    timer->expireCountSinceLastSet++;
+    descriptor_adjustStatus(&(timer->super), STATUS_DESCRIPTOR_READABLE, TRUE);
+
+    if(timer->expireInterval > 0) {
+        SimulationTime now = worker_getCurrentTime();
+        timer->nextExpireTime += timer->expireInterval;
+        if(timer->nextExpireTime < now) {
+            /* for some reason we looped the interval. expire again immediately
+             * to keep the periodic timer going. */
+            timer->nextExpireTime = now;
         }
+        _timer_scheduleExpireEvent(timer, host);
+    } else {
+        /* the timer is now disarmed */
+        _timer_disarm(timer);
     }
 }
 
@@ -279,7 +257,7 @@ static void _timer_arm(Timer* timer, Host* host, const struct itimerspec* config
 
     SimulationTime now = worker_getCurrentTime();
     if(timer->nextExpireTime >= now) {
-        _timer_scheduleNewExpireEvent(timer, host);
+        _timer_scheduleExpireEvent(timer, host);
         trace("timer fd %i armed to expire in %"G_GUINT64_FORMAT" nanos",
                 timer->super.handle, timer->nextExpireTime - now);
     }
@@ -370,3 +348,8 @@ guint64 timer_getExpirationCount(Timer* timer) {
     MAGIC_ASSERT(timer);
     return timer->expireCountSinceLastSet;
 }
+
+SimulationTime timer_getNextExpireTime(Timer* timer) {
+    MAGIC_ASSERT(timer);
+    return timer->nextExpireTime;
+}
@@ -25,4 +25,8 @@ gint timer_close(Timer* timer);
  * since the last time the timer was set. */
 guint64 timer_getExpirationCount(Timer* timer);
 
+/* Returns the absolute time at which the timer will next expire, or 0 if it's
+ * disarmed. */
+SimulationTime timer_getNextExpireTime(Timer* timer);
+
 #endif /* SHD_TIMER_H_ */
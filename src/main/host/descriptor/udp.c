@@ -23,6 +23,11 @@
 #include "main/routing/packet.h"
 #include "main/utility/utility.h"
 
+/* Linux charges each queued datagram its buffer overhead as well as its payload,
+ * so that small or empty datagrams can't queue without limit. We bound the
+ * number of queued datagrams the same way. */
+#define UDP_DATAGRAM_OVERHEAD 256
+
 enum UDPState {
     UDPS_CLOSED, UDPS_ESTABLISHED,
 };
@@ -88,9 +93,13 @@ static void _udp_processPacket(Socket* socket, Host* host, Packet* packet) {
     UDP* udp = _udp_fromLegacyDescriptor((LegacyDescriptor*)socket);
     MAGIC_ASSERT(udp);
 
-    /* UDP packet can be buffered immediately */
-    if (!socket_addToInputBuffer((Socket*)udp, host, packet)) {
+    gsize maxDatagrams = MAX(1, socket_getInputBufferSize(socket) / UDP_DATAGRAM_OVERHEAD);
+
+    /* UDP packet can be buffered immediately, if there's room */
+    if (socket->inputBuffer.length >= maxDatagrams ||
+        !socket_addToInputBuffer((Socket*)udp, host, packet)) {
         packet_addDeliveryStatus(packet, PDS_RCV_SOCKET_DROPPED);
+        tracker_addSocketInputDrop(host_getTracker(host), ((LegacyDescriptor*)udp)->handle);
     }
 }
 
@@ -106,9 +115,8 @@ static void _udp_dropPacket(Socket* socket, Host* host, Packet* packet) {
  * ip and port parameters. this function assumes that the socket is already
  * bound to a local port, no matter if that happened explicitly or implicitly.
  */
-static gssize _udp_sendUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
-                                gsize nBytes, in_addr_t ip, in_port_t port) {
-    UDP* udp = _udp_fromLegacyDescriptor((LegacyDescriptor*)transport);
+gssize udp_sendUserDataIov(UDP* udp, Thread* thread, const struct iovec* iov, size_t iovlen,
+                           gsize nBytes, in_addr_t ip, in_port_t port) {
     MAGIC_ASSERT(udp);
 
     const gsize maxPacketLength = CONFIG_DATAGRAM_MAX_SIZE;
@@ -144,7 +152,7 @@ static gssize _udp_sendUserData(Transport* transport, Thread* thread, PluginVirt
 
     /* create the UDP packet */
     Packet* packet = packet_new(host);
-    packet_setPayload(packet, thread, buffer, nBytes);
+    packet_setPayloadFromIov(packet, thread, iov, iovlen, 0, nBytes);
     packet_setUDP(packet, PUDP_NONE, sourceIP, sourcePort, destinationIP, destinationPort);
     packet_addDeliveryStatus(packet, PDS_SND_CREATED);
 
@@ -169,28 +177,34 @@ static gssize _udp_sendUserData(Transport* transport, Thread* thread, PluginVirt
     return bytes_sent;
 }
 
-static gssize _udp_receiveUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
-                                   gsize nBytes, in_addr_t* ip, in_port_t* port) {
+static gssize _udp_sendUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
+                                gsize nBytes, in_addr_t ip, in_port_t port) {
     UDP* udp = _udp_fromLegacyDescriptor((LegacyDescriptor*)transport);
-    MAGIC_ASSERT(udp);
-
-    if (socket_peekNextInPacket(&(udp->super)) == NULL) {
-        return -EWOULDBLOCK;
-    }
+    struct iovec iov = {.iov_base = (void*)buffer.val, .iov_len = nBytes};
+    return udp_sendUserDataIov(udp, thread, &iov, 1, nBytes, ip, port);
+}
 
-    if (buffer.val == 0 && nBytes > 0) {
-        return -EFAULT;
-    }
+gssize udp_receiveUserDataIov(UDP* udp, Thread* thread, const struct iovec* iov, size_t iovlen,
+                              in_addr_t* ip, in_port_t* port) {
+    MAGIC_ASSERT(udp);
 
     const Packet* nextPacket = socket_peekNextInPacket((Socket*)udp);
     if (!nextPacket) {
         return -EWOULDBLOCK;
     }
 
-    /* copy lesser of requested and available amount to application buffer */
+    gsize nBytes = 0;
+    for (size_t i = 0; i < iovlen; i++) {
+        if (!iov[i].iov_base && iov[i].iov_len > 0) {
+            return -EFAULT;
+        }
+        nBytes += iov[i].iov_len;
+    }
+
+    /* copy lesser of requested and available amount to application buffers */
     guint packetLength = packet_getPayloadLength(nextPacket);
     gsize copyLength = MIN(nBytes, packetLength);
-    gssize bytesCopied = packet_copyPayload(nextPacket, thread, 0, buffer, copyLength);
+    gssize bytesCopied = packet_copyPayloadIov(nextPacket, thread, 0, iov, iovlen);
     if (bytesCopied < 0) {
         // Error writing to PluginVirtualPtr
         return bytesCopied;
@@ -217,6 +231,23 @@ static gssize _udp_receiveUserData(Transport* transport, Thread* thread, PluginV
     return bytesCopied;
 }
 
+static gssize _udp_receiveUserData(Transport* transport, Thread* thread, PluginVirtualPtr buffer,
+                                   gsize nBytes, in_addr_t* ip, in_port_t* port) {
+    UDP* udp = _udp_fromLegacyDescriptor((LegacyDescriptor*)transport);
+    MAGIC_ASSERT(udp);
+
+    if (socket_peekNextInPacket(&(udp->super)) == NULL) {
+        return -EWOULDBLOCK;
+    }
+
+    if (buffer.val == 0 && nBytes > 0) {
+        return -EFAULT;
+    }
+
+    struct iovec iov = {.iov_base = (void*)buffer.val, .iov_len = nBytes};
+    return udp_receiveUserDataIov(udp, thread, &iov, 1, ip, port);
+}
+
 static void _udp_free(LegacyDescriptor* descriptor) {
     UDP* udp = _udp_fromLegacyDescriptor(descriptor);
     MAGIC_ASSERT(udp);
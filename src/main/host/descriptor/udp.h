@@ -8,12 +8,24 @@
 #define SHD_UDP_H_
 
 #include <glib.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
 
 #include "main/core/support/definitions.h"
+#include "main/host/thread.h"
 
 typedef struct _UDP UDP;
 
 UDP* udp_new(Host* host, guint receiveBufferSize, guint sendBufferSize);
 gint udp_shutdown(UDP* udp, gint how);
 
+/* Sends the first nBytes of the plugin's buffers described by iov as a single
+ * datagram, as a send() of one buffer holding them would. */
+gssize udp_sendUserDataIov(UDP* udp, Thread* thread, const struct iovec* iov, size_t iovlen,
+                           gsize nBytes, in_addr_t ip, in_port_t port);
+/* Receives the next datagram, scattering it across the plugin's buffers
+ * described by iov. Bytes that don't fit are discarded, as with one buffer. */
+gssize udp_receiveUserDataIov(UDP* udp, Thread* thread, const struct iovec* iov, size_t iovlen,
+                              in_addr_t* ip, in_port_t* port);
+
 #endif /* SHD_UDP_H_ */
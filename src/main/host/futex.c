@@ -7,7 +7,9 @@
 
 #include <errno.h>
 #include <glib.h>
+#include <linux/futex.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include "lib/logger/logger.h"
 #include "main/core/support/definitions.h"
@@ -15,13 +17,32 @@
 #include "main/host/syscall_types.h"
 #include "main/utility/utility.h"
 
+/* Waiters are kept in a list rather than a hash table so that they are woken
+ * in FIFO order, and so that a wakeup doesn't need to copy the set of waiters. */
+typedef struct _FutexWaiter FutexWaiter;
+struct _FutexWaiter {
+    StatusListener* listener;
+    // Only wakeups that share a bit with this bitset wake this waiter
+    uint32_t bitset;
+    // Whether a wakeup has already been performed on the listener
+    bool woken;
+    FutexWaiter* prev;
+    FutexWaiter* next;
+};
+
 struct _Futex {
     // The unique physical address that is used to refer to this futex
     PluginPhysicalPtr word;
-    // Listeners waiting for wakups on this futex
-    // The key is a listener of type StatusListener*, the value is a boolean that indicates
-    // whether or not a wakeup has already been performed on the listener.
-    GHashTable* listeners;
+    // Listeners waiting for wakups on this futex, in the order they started waiting
+    FutexWaiter* head;
+    FutexWaiter* tail;
+    unsigned int numWaiters;
+    // Unused waiter nodes, so that repeated waits on the same futex don't allocate
+    FutexWaiter* freeWaiters;
+    // The bitset that is given to the next waiter
+    uint32_t nextWaitBitset;
+    // The next futex in the same bucket of the futex table
+    Futex* tableNext;
     // Manage references
     int referenceCount;
     MAGIC_DECLARE;
@@ -30,8 +51,7 @@ struct _Futex {
 Futex* futex_new(PluginPhysicalPtr word) {
     Futex* futex = malloc(sizeof(*futex));
     *futex = (Futex){.word = word,
-                     .listeners = g_hash_table_new_full(
-                         g_direct_hash, g_direct_equal, (GDestroyNotify)statuslistener_unref, NULL),
+                     .nextWaitBitset = FUTEX_BITSET_MATCH_ANY,
                      .referenceCount = 1,
                      MAGIC_INITIALIZER};
 
@@ -42,6 +62,19 @@ Futex* futex_new(PluginPhysicalPtr word) {
 
 static void _futex_free(Futex* futex) {
     MAGIC_ASSERT(futex);
+
+    while (futex->head) {
+        FutexWaiter* waiter = futex->head;
+        futex->head = waiter->next;
+        statuslistener_unref(waiter->listener);
+        free(waiter);
+    }
+    while (futex->freeWaiters) {
+        FutexWaiter* waiter = futex->freeWaiters;
+        futex->freeWaiters = waiter->next;
+        free(waiter);
+    }
+
     MAGIC_CLEAR(futex);
     free(futex);
     worker_count_deallocation(Futex);
@@ -67,58 +100,105 @@ PluginPhysicalPtr futex_getAddress(Futex* futex) {
     return futex->word;
 }
 
-unsigned int futex_wake(Futex* futex, unsigned int numWakeups) {
+unsigned int futex_wakeBitset(Futex* futex, unsigned int numWakeups, uint32_t bitset) {
     MAGIC_ASSERT(futex);
 
-    // We cannot use an iterator here, in case the hash table is modified
-    // in the status changed callback.
-    GList* listenerList = g_hash_table_get_keys(futex->listeners);
-
-    // Iterate the listeners and perform the requested number of wakeups if we can.
-    GList* item = g_list_first(listenerList);
     unsigned int numWoken = 0;
+    FutexWaiter* waiter = futex->head;
 
-    while (item && (numWoken < numWakeups)) {
-        StatusListener* listener = item->data;
-
-        // Only call if the listener is still valid
-        if (g_hash_table_contains(futex->listeners, listener)) {
-            // If this listener was already woken up, skip it this time
-            bool did_wakeup =
-                (bool)GPOINTER_TO_UINT(g_hash_table_lookup(futex->listeners, listener));
-            if (!did_wakeup) {
-                // Tell the status listener to unblock the thread waiting on the futex
-                statuslistener_onStatusChanged(listener, STATUS_FUTEX_WAKEUP, STATUS_FUTEX_WAKEUP);
-
-                // Track that we did a wakeup on this listener without destroying the listener
-                g_hash_table_steal(futex->listeners, listener);
-                g_hash_table_insert(futex->listeners, listener, GUINT_TO_POINTER(true));
-
-                // Count the wake-up
-                numWoken++;
-            }
+    while (waiter && (numWoken < numWakeups)) {
+        // The status callback only schedules a task, but don't rely on waiter staying valid
+        FutexWaiter* next = waiter->next;
+
+        // If this listener was already woken up, skip it this time
+        if (!waiter->woken && (waiter->bitset & bitset)) {
+            // Track that we did a wakeup on this listener without destroying the listener
+            waiter->woken = true;
+
+            // Tell the status listener to unblock the thread waiting on the futex
+            statuslistener_onStatusChanged(
+                waiter->listener, STATUS_FUTEX_WAKEUP, STATUS_FUTEX_WAKEUP);
+
+            // Count the wake-up
+            numWoken++;
         }
 
-        item = g_list_next(item);
+        waiter = next;
     }
 
-    g_list_free(listenerList);
     return numWoken;
 }
 
+unsigned int futex_wake(Futex* futex, unsigned int numWakeups) {
+    return futex_wakeBitset(futex, numWakeups, FUTEX_BITSET_MATCH_ANY);
+}
+
+void futex_setWaitBitset(Futex* futex, uint32_t bitset) {
+    MAGIC_ASSERT(futex);
+    futex->nextWaitBitset = bitset;
+}
+
 void futex_addListener(Futex* futex, StatusListener* listener) {
     MAGIC_ASSERT(futex);
     utility_assert(listener);
+
+    FutexWaiter* waiter = futex->freeWaiters;
+    if (waiter) {
+        futex->freeWaiters = waiter->next;
+    } else {
+        waiter = malloc(sizeof(*waiter));
+    }
+
     statuslistener_ref(listener);
-    g_hash_table_insert(futex->listeners, listener, GUINT_TO_POINTER(false));
+    *waiter = (FutexWaiter){
+        .listener = listener, .bitset = futex->nextWaitBitset, .prev = futex->tail};
+    futex->nextWaitBitset = FUTEX_BITSET_MATCH_ANY;
+
+    if (futex->tail) {
+        futex->tail->next = waiter;
+    } else {
+        futex->head = waiter;
+    }
+    futex->tail = waiter;
+    futex->numWaiters++;
 }
 
 void futex_removeListener(Futex* futex, StatusListener* listener) {
     MAGIC_ASSERT(futex);
-    g_hash_table_remove(futex->listeners, listener); // Will unref the listener
+
+    FutexWaiter* waiter = futex->head;
+    while (waiter && waiter->listener != listener) {
+        waiter = waiter->next;
+    }
+    if (!waiter) {
+        return;
+    }
+
+    if (waiter->prev) {
+        waiter->prev->next = waiter->next;
+    } else {
+        futex->head = waiter->next;
+    }
+    if (waiter->next) {
+        waiter->next->prev = waiter->prev;
+    } else {
+        futex->tail = waiter->prev;
+    }
+    futex->numWaiters--;
+
+    statuslistener_unref(waiter->listener);
+
+    waiter->listener = NULL;
+    waiter->next = futex->freeWaiters;
+    futex->freeWaiters = waiter;
 }
 
 unsigned int futex_getListenerCount(Futex* futex) {
     MAGIC_ASSERT(futex);
-    return g_hash_table_size(futex->listeners);
+    return futex->numWaiters;
+}
+
+Futex** futex_getTableLink(Futex* futex) {
+    MAGIC_ASSERT(futex);
+    return &futex->tableNext;
 }
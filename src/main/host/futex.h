@@ -30,9 +30,16 @@ void futex_unref_func(void* futex);
 PluginPhysicalPtr futex_getAddress(Futex* futex);
 
 // Wakeup at most the given number of listener threads waiting on this futex; return the number of
-// threads that were woken up.
+// threads that were woken up. Waiters are woken in the order in which they started waiting.
 unsigned int futex_wake(Futex* futex, unsigned int numWakeups);
 
+// Like futex_wake, but only wakes waiters whose bitset shares a bit with the given bitset.
+unsigned int futex_wakeBitset(Futex* futex, unsigned int numWakeups, uint32_t bitset);
+
+// Set the bitset of the next listener that is added, used for FUTEX_WAIT_BITSET. The bitset is
+// reset to match any wakeup after a listener is added.
+void futex_setWaitBitset(Futex* futex, uint32_t bitset);
+
 // Add a listener that will be notified when a wakup occurs
 void futex_addListener(Futex* futex, StatusListener* listener);
 
@@ -42,4 +49,7 @@ void futex_removeListener(Futex* futex, StatusListener* listener);
 // Return the number of listers currently awaiting a wakeup
 unsigned int futex_getListenerCount(Futex* futex);
 
+// The link that the futex table uses to chain the futexes in one bucket.
+Futex** futex_getTableLink(Futex* futex);
+
 #endif /* SRC_MAIN_HOST_FUTEX_H_ */
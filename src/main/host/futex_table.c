@@ -7,6 +7,8 @@
 
 #include <glib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "main/core/worker.h"
@@ -14,17 +16,41 @@
 #include "main/host/syscall_types.h"
 #include "main/utility/utility.h"
 
+/* Futexes are chained in a fixed number of buckets. A host usually only has a
+ * handful of futexes that are in use at once, so the chains stay short. */
+#define FUTEXTABLE_NUM_BUCKETS 256
+
 struct _FutexTable {
     /* All futexes that we are tracking. Each futex has a unique physical address associated with it
-     * when it is stored in our table, which we refer to as a table index or table indices. Maps
-     * PluginPhysicalPtr to Futex*. */
-    GHashTable* futexes;
+     * when it is stored in our table, which we refer to as a table index or table indices. Each
+     * bucket is a list of futexes linked through futex_getTableLink(), and the table holds a
+     * reference to each of them. */
+    Futex* buckets[FUTEXTABLE_NUM_BUCKETS];
+    unsigned int numFutexes;
 
     /* Memory accounting. */
     int referenceCount;
     MAGIC_DECLARE;
 };
 
+static inline unsigned int _futextable_bucket(PluginPhysicalPtr ptr) {
+    /* futex words are at least 4-byte aligned, and often in the same page */
+    uint64_t h = ptr.val >> 2;
+    h ^= h >> 17;
+    h *= 0xed5ad4bbU;
+    h ^= h >> 11;
+    return (unsigned int)(h % FUTEXTABLE_NUM_BUCKETS);
+}
+
+/* Returns the link that points to the futex at ptr, or the NULL link at the end of its bucket. */
+static Futex** _futextable_find(FutexTable* table, PluginPhysicalPtr ptr) {
+    Futex** link = &table->buckets[_futextable_bucket(ptr)];
+    while (*link && futex_getAddress(*link).val != ptr.val) {
+        link = futex_getTableLink(*link);
+    }
+    return link;
+}
+
 FutexTable* futextable_new() {
     FutexTable* table = malloc(sizeof(FutexTable));
 
@@ -37,8 +63,14 @@ FutexTable* futextable_new() {
 static void _futextable_free(FutexTable* table) {
     MAGIC_ASSERT(table);
 
-    if (table->futexes) {
-        g_hash_table_destroy(table->futexes);
+    for (int i = 0; i < FUTEXTABLE_NUM_BUCKETS; i++) {
+        Futex* futex = table->buckets[i];
+        while (futex) {
+            Futex* next = *futex_getTableLink(futex);
+            *futex_getTableLink(futex) = NULL;
+            futex_unref(futex);
+            futex = next;
+        }
     }
 
     MAGIC_CLEAR(table);
@@ -63,18 +95,14 @@ void futextable_unref(FutexTable* table) {
 bool futextable_add(FutexTable* table, Futex* futex) {
     MAGIC_ASSERT(table);
 
-    PluginPhysicalPtr ptr = futex_getAddress(futex);
-    gpointer index = GUINT_TO_POINTER(ptr.val);
+    Futex** link = _futextable_find(table, futex_getAddress(futex));
 
-    if (!table->futexes) {
-        table->futexes =
-            g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, futex_unref_func);
-    }
-
-    if (g_hash_table_contains(table->futexes, index)) {
+    if (*link) {
         return false;
     } else {
-        g_hash_table_insert(table->futexes, index, futex);
+        utility_assert(*futex_getTableLink(futex) == NULL);
+        *link = futex;
+        table->numFutexes++;
         return true;
     }
 }
@@ -82,11 +110,13 @@ bool futextable_add(FutexTable* table, Futex* futex) {
 bool futextable_remove(FutexTable* table, Futex* futex) {
     MAGIC_ASSERT(table);
 
-    PluginPhysicalPtr ptr = futex_getAddress(futex);
-    gpointer index = GUINT_TO_POINTER(ptr.val);
+    Futex** link = _futextable_find(table, futex_getAddress(futex));
 
-    if (table->futexes && g_hash_table_contains(table->futexes, index)) {
-        g_hash_table_remove(table->futexes, index);
+    if (*link == futex) {
+        *link = *futex_getTableLink(futex);
+        *futex_getTableLink(futex) = NULL;
+        table->numFutexes--;
+        futex_unref(futex);
         return true;
     } else {
         return false;
@@ -95,12 +125,10 @@ bool futextable_remove(FutexTable* table, Futex* futex) {
 
 Futex* futextable_get(FutexTable* table, PluginPhysicalPtr ptr) {
     MAGIC_ASSERT(table);
+    return *_futextable_find(table, ptr);
+}
 
-    gpointer index = GUINT_TO_POINTER(ptr.val);
-
-    if (table->futexes) {
-        return g_hash_table_lookup(table->futexes, index);
-    } else {
-        return NULL;
-    }
+unsigned int futextable_getSize(FutexTable* table) {
+    MAGIC_ASSERT(table);
+    return table->numFutexes;
 }
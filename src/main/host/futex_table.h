@@ -48,4 +48,7 @@ bool futextable_remove(FutexTable* table, Futex* futex);
  * storing a futex at the given address. */
 Futex* futextable_get(FutexTable* table, PluginPhysicalPtr ptr);
 
+/* Returns the number of futexes stored in the table. */
+unsigned int futextable_getSize(FutexTable* table);
+
 #endif /* SRC_MAIN_HOST_FUTEX_TABLE_H_ */
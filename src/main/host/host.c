@@ -19,6 +19,8 @@
 
 #include "lib/logger/log_level.h"
 #include "lib/logger/logger.h"
+#include "main/bindings/c/bindings.h"
+#include "main/core/support/config_handlers.h"
 #include "main/core/support/definitions.h"
 #include "main/core/worker.h"
 #include "main/host/cpu.h"
@@ -37,15 +39,22 @@
 #include "main/host/network_interface.h"
 #include "main/host/process.h"
 #include "main/host/protocol.h"
+#include "main/host/thread_preload.h"
+#include "main/host/timer_wheel.h"
 #include "main/host/tracker.h"
+#include "main/host/traffic_model.h"
 #include "main/routing/address.h"
 #include "main/routing/dns.h"
 #include "main/routing/packet.h"
 #include "main/routing/router.h"
 #include "main/routing/topology.h"
+#include "main/utility/perf_timer.h"
 #include "main/utility/random.h"
 #include "main/utility/utility.h"
 
+static SimulationTime _runahead = 0;
+ADD_CONFIG_HANDLER(config_getRunahead, _runahead)
+
 struct _Host {
     /* general node lock. nothing that belongs to the node should be touched
      * unless holding this lock. everything following this falls under the lock. */
@@ -58,34 +67,56 @@ struct _Host {
 
     GHashTable* interfaces;
     Address* defaultAddress;
+    /* only held between host_registerAddresses() and host_setup() */
+    Address* loopbackAddress;
     CPU* cpu;
 
     /* the virtual processes this host is running */
     GQueue* processes;
+    /* the processes, keyed by their virtual pid */
+    GHashTable* processesByID;
+    /* the threads of the processes that haven't been reaped, keyed by their virtual
+     * tid, which is unique on the host */
+    GHashTable* threadsByID;
+    /* the threads that we let run their plugin until its next syscall, and that a task
+     * will collect */
+    GQueue* detachedThreads;
+    /* generates traffic without a process, if the host has one */
+    TrafficModel* trafficModel;
 
     /* a statistics tracker for in/out bytes, CPU, memory, etc. */
     Tracker* tracker;
+    /* TRUE once a process started or a packet arrived; see host_activate() */
+    gboolean isActive;
 
     /* virtual process and event id counter */
     guint processIDCounter;
     guint64 eventIDCounter;
     guint64 packetIDCounter;
 
-    /* map path to ports for unix sockets */
-    GHashTable* unixPathToPortMap;
+    /* a hash of every event that the host has run, in order */
+    guint64 eventDigest;
 
     /* map address to futex objects */
     FutexTable* futexTable;
 
+    /* internal timers, such as those of our TCP sockets */
+    TimerWheel* timerWheel; /* created on first use */
+
     /* track the order in which the application sent us application data */
     gdouble packetPriorityCounter;
 
     /* random stream */
     Random* random;
 
+    /* lower bound on the delay of events that other hosts send to us */
+    SimulationTime lookahead;
+    /* lower bound on the delay of packets that we send to other hosts */
+    SimulationTime sendLatency;
+
 #ifdef USE_PERF_TIMERS
     /* track the time spent executing this host */
-    GTimer* executionTimer;
+    PerfTimer executionTimer;
 #endif
 
     gchar* dataDirPath;
@@ -102,9 +133,8 @@ Host* host_new(HostParameters* params) {
     MAGIC_INIT(host);
 
 #ifdef USE_PERF_TIMERS
-    /* start tracking execution time for this host.
-     * creating the timer automatically starts it. */
-    host->executionTimer = g_timer_new();
+    /* start tracking execution time for this host */
+    perftimer_start(&host->executionTimer);
 #endif
 
     /* first copy the entire struct of params */
@@ -124,11 +154,11 @@ Host* host_new(HostParameters* params) {
     host->interfaces = g_hash_table_new_full(g_direct_hash, g_direct_equal,
             NULL, (GDestroyNotify) networkinterface_free);
 
-    /* TODO: deprecated, used to support UNIX sockets. */
-    host->unixPathToPortMap = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-
     /* applications this node will run */
     host->processes = g_queue_new();
+    host->processesByID = g_hash_table_new(g_direct_hash, g_direct_equal);
+    host->threadsByID = g_hash_table_new(g_direct_hash, g_direct_equal);
+    host->detachedThreads = g_queue_new();
 
     info("Created host id '%u' name '%s'", (guint)host->params.id,
          g_quark_to_string(host->params.id));
@@ -138,7 +168,7 @@ Host* host_new(HostParameters* params) {
 
 #ifdef USE_PERF_TIMERS
     /* we go back to the manager setup process here, so stop counting this host execution */
-    g_timer_stop(host->executionTimer);
+    perftimer_stop(&host->executionTimer);
 #endif
 
     worker_count_allocation(Host);
@@ -146,23 +176,55 @@ Host* host_new(HostParameters* params) {
     return host;
 }
 
-/* this function is called by manager before the workers exist */
-void host_setup(Host* host, DNS* dns, Topology* topology, guint rawCPUFreq, const gchar* hostRootPath) {
+static SimulationTime _host_computeLookahead(gdouble minLatencyMS) {
+    /* round down so that the lookahead never exceeds the real packet delay */
+    SimulationTime lookahead = (minLatencyMS > 0) ? (SimulationTime)floor(minLatencyMS * SIMTIME_ONE_MILLISECOND) : 0;
+
+    /* the runahead option overrides the computed latencies as a lower bound */
+    if (_runahead > 0 && lookahead < _runahead) {
+        lookahead = _runahead;
+    }
+
+    /* a zero lookahead would keep this host from ever running an event */
+    if (lookahead == 0) {
+        lookahead = SIMTIME_ONE_NANOSECOND;
+    }
+
+    return lookahead;
+}
+
+/* this function is called by manager before the simulation starts, in the order
+ * that the hosts were configured */
+void host_registerAddresses(Host* host, DNS* dns) {
     MAGIC_ASSERT(host);
+    utility_assert(!host->defaultAddress);
 
     /* get unique virtual address identifiers for each network interface */
-    Address* loopbackAddress = dns_register(dns, host->params.id, host->params.hostname, "127.0.0.1");
-    Address* ethernetAddress = dns_register(dns, host->params.id, host->params.hostname, host->params.ipHint);
-    host->defaultAddress = ethernetAddress;
-    address_ref(host->defaultAddress);
+    host->loopbackAddress =
+        dns_register(dns, host->params.id, host->params.hostname, "127.0.0.1");
+    host->defaultAddress =
+        dns_register(dns, host->params.id, host->params.hostname, host->params.ipHint);
+}
+
+/* this function is called by manager before the simulation starts, possibly from a worker
+ * thread that is setting up other hosts at the same time */
+void host_setup(Host* host, Topology* topology, guint rawCPUFreq, const gchar* hostRootPath) {
+    MAGIC_ASSERT(host);
+    utility_assert(host->defaultAddress && host->loopbackAddress);
+
+    Address* loopbackAddress = host->loopbackAddress;
+    Address* ethernetAddress = host->defaultAddress;
+    host->loopbackAddress = NULL;
+    address_ref(ethernetAddress);
 
     if(!host->dataDirPath) {
         host->dataDirPath = g_build_filename(hostRootPath, host->params.hostname, NULL);
         g_mkdir_with_parents(host->dataDirPath, 0775);
     }
 
-    host->random = random_new(host->params.nodeSeed);
-    host->cpu = cpu_new(host->params.cpuFrequency, (guint64)rawCPUFreq, host->params.cpuThreshold, host->params.cpuPrecision);
+    host->random = random_newStream(host->params.nodeSeed, host->params.id);
+    host->cpu = cpu_new(host->params.cpuFrequency, (guint64)rawCPUFreq, host->params.cpuCores,
+                        host->params.cpuThreshold, host->params.cpuPrecision);
 
     // Table to track futexes used by processes/threads
     host->futexTable = futextable_new();
@@ -173,6 +235,13 @@ void host_setup(Host* host, DNS* dns, Topology* topology, guint rawCPUFreq, cons
                     host->params.citycodeHint, host->params.countrycodeHint, &bwDownKiBps,
                     &bwUpKiBps);
 
+    /* packets from other hosts take at least this long to reach us */
+    host->lookahead =
+        _host_computeLookahead(topology_getMinIncomingLatency(topology, ethernetAddress));
+    /* and packets that we send take at least this long to reach other hosts */
+    host->sendLatency =
+        _host_computeLookahead(topology_getMinOutgoingLatency(topology, ethernetAddress));
+
     /* prefer assigned bandwidth if available */
     if(host->params.requestedBWDownKiBps) {
         bwDownKiBps = host->params.requestedBWDownKiBps;
@@ -184,10 +253,12 @@ void host_setup(Host* host, DNS* dns, Topology* topology, guint rawCPUFreq, cons
     /* virtual addresses and interfaces for managing network I/O */
     NetworkInterface* loopback =
         networkinterface_new(host, loopbackAddress, G_MAXUINT32, G_MAXUINT32, host->params.pcapDir,
-                             host->params.qdisc, host->params.interfaceBufSize);
+                             host->params.pcapCaptureSize, host->params.qdisc,
+                             host->params.segmentationOffload, host->params.interfaceBufSize);
     NetworkInterface* ethernet =
         networkinterface_new(host, ethernetAddress, bwDownKiBps, bwUpKiBps, host->params.pcapDir,
-                             host->params.qdisc, host->params.interfaceBufSize);
+                             host->params.pcapCaptureSize, host->params.qdisc,
+                             host->params.segmentationOffload, host->params.interfaceBufSize);
 
     g_hash_table_replace(host->interfaces, GUINT_TO_POINTER((guint)address_toNetworkIP(ethernetAddress)), ethernet);
     g_hash_table_replace(host->interfaces, GUINT_TO_POINTER((guint)htonl(INADDR_LOOPBACK)), loopback);
@@ -225,14 +296,29 @@ static void _host_free(Host* host) {
  * of this function, then host_free would never actually get called. */
 void host_shutdown(Host* host) {
 #ifdef USE_PERF_TIMERS
-    g_timer_continue(host->executionTimer);
+    perftimer_continue(&host->executionTimer);
 #endif
 
     debug("shutting down host %s", host->params.hostname);
 
+    /* release the descriptor references still held by pending timers */
+    if(host->timerWheel) {
+        timerwheel_free(host->timerWheel);
+        host->timerWheel = NULL;
+    }
+
     if(host->processes) {
         g_queue_free(host->processes);
     }
+    if (host->processesByID) {
+        g_hash_table_destroy(host->processesByID);
+    }
+    if (host->threadsByID) {
+        g_hash_table_destroy(host->threadsByID);
+    }
+    if (host->detachedThreads) {
+        g_queue_free(host->detachedThreads);
+    }
 
     if(host->defaultAddress) {
         topology_detach(worker_getTopology(), host->defaultAddress);
@@ -247,10 +333,6 @@ void host_shutdown(Host* host) {
         router_unref(host->router);
     }
 
-    if(host->unixPathToPortMap) {
-        g_hash_table_destroy(host->unixPathToPortMap);
-    }
-
     if (host->futexTable) {
         futextable_unref(host->futexTable);
     }
@@ -278,8 +360,7 @@ void host_shutdown(Host* host) {
     }
 
 #ifdef USE_PERF_TIMERS
-    gdouble totalExecutionTime = g_timer_elapsed(host->executionTimer, NULL);
-    g_timer_destroy(host->executionTimer);
+    gdouble totalExecutionTime = perftimer_elapsed(&host->executionTimer);
     info("host '%s' has been shut down, total execution time was %f seconds", host->params.hostname,
          totalExecutionTime);
 #else
@@ -287,9 +368,27 @@ void host_shutdown(Host* host) {
 #endif
 
     if(host->defaultAddress) address_unref(host->defaultAddress);
+    if(host->loopbackAddress) address_unref(host->loopbackAddress);
     if(host->params.hostname) g_free(host->params.hostname);
 }
 
+void host_flush(Host* host) {
+    MAGIC_ASSERT(host);
+
+    if (host->interfaces) {
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, host->interfaces);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            networkinterface_flush(value);
+        }
+    }
+
+    if (host->processes) {
+        g_queue_foreach(host->processes, (GFunc)process_flushSyscallTrace, NULL);
+    }
+}
+
 void host_ref(Host* host) {
     MAGIC_ASSERT(host);
     (host->referenceCount)++;
@@ -318,13 +417,13 @@ void host_unlock(Host* host) {
 /* resumes the execution timer for this host */
 void host_continueExecutionTimer(Host* host) {
     MAGIC_ASSERT(host);
-    g_timer_continue(host->executionTimer);
+    perftimer_continue(&host->executionTimer);
 }
 
 /* stops the execution timer for this host */
 void host_stopExecutionTimer(Host* host) {
     MAGIC_ASSERT(host);
-    g_timer_stop(host->executionTimer);
+    perftimer_stop(&host->executionTimer);
 }
 #endif
 
@@ -337,9 +436,10 @@ GQuark host_getID(Host* host) {
 void host_boot(Host* host) {
     MAGIC_ASSERT(host);
 
-    /* must be done after the default IP exists so tracker_heartbeat works */
+    /* the heartbeats don't start until the host is activated */
     host->tracker = tracker_new(host, host->params.heartbeatInterval,
-                                host->params.heartbeatLogLevel, host->params.heartbeatLogInfo);
+                                host->params.heartbeatLogLevel, host->params.heartbeatLogInfo,
+                                host->params.heartbeatLogFormat);
 
     /* start refilling the token buckets for all interfaces */
     GHashTableIter iter;
@@ -353,6 +453,34 @@ void host_boot(Host* host) {
 
     /* scheduling the starting and stopping of our virtual processes */
     g_queue_foreach(host->processes, (GFunc)process_schedule, NULL);
+    if (host->trafficModel) {
+        trafficmodel_schedule(host->trafficModel);
+    }
+}
+
+/* Many hosts in large simulations are idle for a long time before their first process
+ * starts, so we don't run periodic tasks for them until there is something to do. */
+void host_activate(Host* host) {
+    MAGIC_ASSERT(host);
+
+    if (host->isActive) {
+        return;
+    }
+    host->isActive = TRUE;
+
+    debug("activating host '%s'", host->params.hostname);
+
+    /* must be done after the default IP exists so tracker_heartbeat works */
+    tracker_start(host->tracker, host);
+}
+
+SimulationTime host_heartbeatIfDue(Host* host, SimulationTime time) {
+    MAGIC_ASSERT(host);
+
+    if (!host->isActive) {
+        return SIMTIME_MAX;
+    }
+    return tracker_heartbeatIfDue(host->tracker, host, time);
 }
 
 void host_detachAllPlugins(Host* host) {
@@ -365,11 +493,44 @@ guint host_getNewProcessID(Host* host) {
     return host->processIDCounter++;
 }
 
+guint64 host_getNumEventsCreated(Host* host) {
+    MAGIC_ASSERT(host);
+    return host->eventIDCounter;
+}
+
 guint64 host_getNewEventID(Host* host) {
     MAGIC_ASSERT(host);
     return host->eventIDCounter++;
 }
 
+static guint64 _host_mixDigest(guint64 digest, guint64 value) {
+    guint64 z = digest ^ (value + 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+guint64 host_digestEvent(Host* host, SimulationTime time, guint srcHostID,
+                         guint64 srcHostEventID) {
+    MAGIC_ASSERT(host);
+
+    guint64 digest = host->eventDigest;
+    digest = _host_mixDigest(digest, time);
+    digest = _host_mixDigest(digest, srcHostID);
+    digest = _host_mixDigest(digest, srcHostEventID);
+    /* the ids that the host's earlier events used up */
+    digest = _host_mixDigest(digest, host->eventIDCounter);
+    digest = _host_mixDigest(digest, host->packetIDCounter);
+    host->eventDigest = digest;
+
+    return _host_mixDigest(digest, host->params.id);
+}
+
+guint64 host_getEventDigest(Host* host) {
+    MAGIC_ASSERT(host);
+    return host->eventDigest;
+}
+
 guint64 host_getNewPacketID(Host* host) {
     MAGIC_ASSERT(host);
     return host->packetIDCounter++;
@@ -377,7 +538,8 @@ guint64 host_getNewPacketID(Host* host) {
 
 void host_addApplication(Host* host, SimulationTime startTime, SimulationTime stopTime,
                          InterposeMethod interposeMethod, const gchar* pluginName,
-                         const gchar* pluginPath, gchar** envv, gchar** argv) {
+                         const gchar* pluginPath, gchar** envv, gchar** argv,
+                         gboolean elidePayloads, gboolean traceSyscalls) {
     MAGIC_ASSERT(host);
     guint processID = host_getNewProcessID(host);
     Process* proc = process_new(host,
@@ -390,7 +552,28 @@ void host_addApplication(Host* host, SimulationTime startTime, SimulationTime st
                                 pluginPath,
                                 envv,
                                 argv);
+    process_setElidePayloads(proc, elidePayloads);
+    if (traceSyscalls) {
+        process_startSyscallTrace(proc);
+    }
     g_queue_push_tail(host->processes, proc);
+    g_hash_table_insert(host->processesByID, GUINT_TO_POINTER(processID), proc);
+}
+
+void host_addTrafficModel(Host* host, TrafficModelParameters* params) {
+    MAGIC_ASSERT(host);
+    utility_assert(!host->trafficModel);
+    host->trafficModel = trafficmodel_new(host, params);
+}
+
+TrafficModel* host_getTrafficModel(Host* host) {
+    MAGIC_ASSERT(host);
+    return host->trafficModel;
+}
+
+void host_killAllApplications(Host* host) {
+    MAGIC_ASSERT(host);
+    g_queue_foreach(host->processes, (GFunc)process_kill, NULL);
 }
 
 void host_freeAllApplications(Host* host) {
@@ -401,9 +584,25 @@ void host_freeAllApplications(Host* host) {
         process_stop(proc);
         process_unref(proc);
     }
+    if (host->trafficModel) {
+        /* its sockets look for it while they are freed, so it must be gone by then */
+        TrafficModel* model = host->trafficModel;
+        host->trafficModel = NULL;
+        trafficmodel_free(model);
+    }
     trace("done freeing application for host '%s'", host->params.hostname);
 }
 
+SimulationTime host_getLookahead(Host* host) {
+    MAGIC_ASSERT(host);
+    return host->lookahead;
+}
+
+SimulationTime host_getSendLatency(Host* host) {
+    MAGIC_ASSERT(host);
+    return host->sendLatency;
+}
+
 gint host_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
     const Host* na = a;
     const Host* nb = b;
@@ -526,6 +725,11 @@ guint64 host_getConfiguredSendBufSize(Host* host) {
     return host->params.sendBufSize;
 }
 
+TcpCongestionControl host_getTcpCongestionControl(Host* host) {
+    MAGIC_ASSERT(host);
+    return host->params.tcpCongestionControl;
+}
+
 gboolean host_doesInterfaceExist(Host* host, in_addr_t interfaceIP) {
     MAGIC_ASSERT(host);
 
@@ -547,7 +751,7 @@ gboolean host_doesInterfaceExist(Host* host, in_addr_t interfaceIP) {
 
 gboolean host_isInterfaceAvailable(Host* host, ProtocolType type,
                                    in_addr_t interfaceIP, in_port_t port,
-                                   in_addr_t peerIP, in_port_t peerPort) {
+                                   in_addr_t peerIP, in_port_t peerPort, gboolean reusePort) {
     MAGIC_ASSERT(host);
 
     gboolean isAvailable = FALSE;
@@ -560,7 +764,8 @@ gboolean host_isInterfaceAvailable(Host* host, ProtocolType type,
 
         while(g_hash_table_iter_next(&iter, &key, &value)) {
             NetworkInterface* interface = value;
-            isAvailable = !networkinterface_isAssociated(interface, type, port, peerIP, peerPort);
+            isAvailable = !networkinterface_isAssociated(
+                interface, type, port, peerIP, peerPort, reusePort);
 
             /* as soon as one is taken, break out to return FALSE */
             if(!isAvailable) {
@@ -569,7 +774,8 @@ gboolean host_isInterfaceAvailable(Host* host, ProtocolType type,
         }
     } else {
         NetworkInterface* interface = host_lookupInterface(host, interfaceIP);
-        isAvailable = !networkinterface_isAssociated(interface, type, port, peerIP, peerPort);
+        isAvailable =
+            !networkinterface_isAssociated(interface, type, port, peerIP, peerPort, reusePort);
     }
 
     return isAvailable;
@@ -589,37 +795,79 @@ static in_port_t _host_getRandomPort(Host* host) {
     return htons(randomHostPort);
 }
 
+/* Returns a port that no socket of the protocol is bound to on the interface, or on
+ * every interface for INADDR_ANY, starting the search from a random port. Returns 0
+ * if there's none. */
+static in_port_t _host_getRandomFreeUnusedPort(Host* host, ProtocolType type,
+                                               in_addr_t interfaceIP) {
+    in_port_t start = _host_getRandomPort(host);
+
+    if (interfaceIP != htonl(INADDR_ANY)) {
+        NetworkInterface* interface = host_lookupInterface(host, interfaceIP);
+        return networkinterface_findUnusedPort(interface, type, start);
+    }
+
+    /* each interface moves the candidate forward to its next unused port, until all of
+     * the interfaces agree on it. the candidate never passes a port that is unused
+     * everywhere, so we can stop once it has moved through the whole range. */
+    guint numPorts = UINT16_MAX - MIN_RANDOM_PORT + 1;
+    guint distance = 0;
+    guint numAgreeing = 0;
+    in_port_t candidate = start;
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, host->interfaces);
+
+    while (numAgreeing < g_hash_table_size(host->interfaces)) {
+        if (!g_hash_table_iter_next(&iter, &key, &value)) {
+            g_hash_table_iter_init(&iter, host->interfaces);
+            continue;
+        }
+
+        in_port_t next = networkinterface_findUnusedPort(value, type, candidate);
+        if (next == 0) {
+            return 0;
+        } else if (next == candidate) {
+            numAgreeing++;
+            continue;
+        }
+
+        distance += (ntohs(next) + numPorts - ntohs(candidate)) % numPorts;
+        if (distance >= numPorts) {
+            return 0;
+        }
+        candidate = next;
+        /* the interface that moved the candidate agrees with it */
+        numAgreeing = 1;
+    }
+
+    return candidate;
+}
+
 in_port_t host_getRandomFreePort(Host* host, ProtocolType type,
                                  in_addr_t interfaceIP, in_addr_t peerIP,
                                  in_port_t peerPort) {
     MAGIC_ASSERT(host);
 
-    /* we need a random port that is free everywhere we need it to be.
-     * we have two modes here: first we just try grabbing a random port until we
-     * get a free one. if we cannot find one fast enough, then as a fallback we
-     * do an inefficient linear search that is guaranteed to succeed or fail. */
-
-    /* if choosing randomly doesn't succeed within 10 tries, then we have already
-     * allocated a lot of ports (>90% on average). then we fall back to linear search. */
-    for(guint i = 0; i < 10; i++) {
-        in_port_t randomPort = _host_getRandomPort(host);
-
-        /* this will check all interfaces in the case of INADDR_ANY */
-        if (host_isInterfaceAvailable(
-                host, type, interfaceIP, randomPort, peerIP, peerPort)) {
-            return randomPort;
-        }
+    /* we need a random port that is free everywhere we need it to be. the interfaces
+     * track which ports are unused, so we start from a random port and take the next
+     * one that is unused everywhere. ports that are only used for other peers are
+     * skipped by this; we only take them in the linear search below, when every port
+     * is in use somewhere. */
+    in_port_t port = _host_getRandomFreeUnusedPort(host, type, interfaceIP);
+    if (port != 0) {
+        return port;
     }
 
-    /* now if we tried too many times and still don't have a port, fall back
-     * to a linear search to make sure we get a free port if we have one.
+    /* fall back to a linear search to make sure we get a free port if we have one.
      * but start from a random port instead of the min. */
     in_port_t start = _host_getRandomPort(host);
     in_port_t next = (start == UINT16_MAX) ? MIN_RANDOM_PORT : start + 1;
     while(next != start) {
         /* this will check all interfaces in the case of INADDR_ANY */
         if (host_isInterfaceAvailable(
-                host, type, interfaceIP, next, peerIP, peerPort)) {
+                host, type, interfaceIP, next, peerIP, peerPort, FALSE)) {
             return next;
         }
         next = (next == UINT16_MAX) ? MIN_RANDOM_PORT : next + 1;
@@ -653,23 +901,63 @@ const gchar* host_getDataPath(Host* host) {
 
 FutexTable* host_getFutexTable(Host* host) { return host->futexTable; }
 
+TimerWheel* host_getTimerWheel(Host* host) {
+    MAGIC_ASSERT(host);
+    /* most hosts in large simulations never use a timer, so don't create it until needed */
+    if (!host->timerWheel) {
+        host->timerWheel = timerwheel_new(host);
+    }
+    return host->timerWheel;
+}
+
 pid_t host_getNativeTID(Host* host, pid_t virtualPID, pid_t virtualTID) {
     MAGIC_ASSERT(host);
 
-    // TODO: once we have a process table, we can do a constant time lookup instead
-    GList* current = g_queue_peek_head_link(host->processes);
-    pid_t nativeTID = 0;
+    // A process's leader thread has the same tid as the process's pid.
+    pid_t tid = virtualTID > 0 ? virtualTID : virtualPID;
+    if (tid <= 0) {
+        return 0;
+    }
 
-    while (current != NULL) {
-        Process* proc = current->data;
-        nativeTID = process_findNativeTID(proc, virtualPID, virtualTID);
+    Thread* thread = g_hash_table_lookup(host->threadsByID, GINT_TO_POINTER(tid));
+    if (thread == NULL || (virtualPID > 0 && thread_getProcessId(thread) != virtualPID)) {
+        return 0; // no process/thread has the given virtual PID/TID
+    }
 
-        if (nativeTID > 0) {
-            break;
-        }
+    return thread_getNativeTid(thread);
+}
 
-        current = current->next;
-    }
+Process* host_getProcess(Host* host, pid_t virtualPID) {
+    MAGIC_ASSERT(host);
+    return g_hash_table_lookup(host->processesByID, GINT_TO_POINTER(virtualPID));
+}
 
-    return nativeTID; // 0 if no process/thread has the given virtual PID/TID
+void host_addThread(Host* host, Thread* thread) {
+    MAGIC_ASSERT(host);
+    g_hash_table_insert(host->threadsByID, GINT_TO_POINTER(thread_getID(thread)), thread);
+}
+
+void host_removeThread(Host* host, Thread* thread) {
+    MAGIC_ASSERT(host);
+    g_hash_table_remove(host->threadsByID, GINT_TO_POINTER(thread_getID(thread)));
+}
+
+void host_addDetachedThread(Host* host, Thread* thread) {
+    MAGIC_ASSERT(host);
+    g_queue_push_tail(host->detachedThreads, thread);
+}
+
+void host_removeDetachedThread(Host* host, Thread* thread) {
+    MAGIC_ASSERT(host);
+    g_queue_remove(host->detachedThreads, thread);
+}
+
+gboolean host_isWaitingForPlugin(Host* host) {
+    MAGIC_ASSERT(host);
+    for (GList* link = host->detachedThreads->head; link != NULL; link = link->next) {
+        if (!threadpreload_pollEvent(link->data)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
 }
@@ -23,7 +23,9 @@
 #include "main/host/futex_table.h"
 #include "main/host/host_parameters.h"
 #include "main/host/network_interface.h"
+#include "main/host/timer_wheel.h"
 #include "main/host/tracker_types.h"
+#include "main/host/traffic_model_types.h"
 #include "main/routing/address.h"
 #include "main/routing/dns.h"
 #include "main/routing/router.h"
@@ -46,17 +48,45 @@ void host_stopExecutionTimer(Host* host);
 #define host_stopExecutionTimer(host)
 #endif
 
-void host_setup(Host* host, DNS* dns, Topology* topology, guint rawCPUFreq, const gchar* hostRootPath);
+/* Assigns the host's addresses. Must be called for each host in a deterministic
+ * order, since addresses are assigned sequentially. */
+void host_registerAddresses(Host* host, DNS* dns);
+/* Sets up everything else. Hosts may be set up in any order, and concurrently. */
+void host_setup(Host* host, Topology* topology, guint rawCPUFreq, const gchar* hostRootPath);
 void host_boot(Host* host);
+/* Starts the host's periodic tasks, if they haven't started yet. Called when the first
+ * process starts or the first packet arrives. */
+void host_activate(Host* host);
+/* Logs the host's heartbeats that are due at or before the time, and returns the time
+ * of its next one, or SIMTIME_MAX if the host isn't active yet. */
+SimulationTime host_heartbeatIfDue(Host* host, SimulationTime time);
 void host_shutdown(Host* host);
+/* Writes out the host's buffered output, for when the host won't be shut down. */
+void host_flush(Host* host);
 
 guint host_getNewProcessID(Host* host);
 guint64 host_getNewEventID(Host* host);
 guint64 host_getNewPacketID(Host* host);
+/* Folds the event that the host is about to run into its digest of the events it has
+ * run, and returns a hash of the new digest and the host's ID. Adding up the hashes of
+ * any set of events gives the same total in any order. */
+guint64 host_digestEvent(Host* host, SimulationTime time, guint srcHostID,
+                         guint64 srcHostEventID);
+guint64 host_getEventDigest(Host* host);
+/* Returns the number of events that this host has created. */
+guint64 host_getNumEventsCreated(Host* host);
 void host_addApplication(Host* host, SimulationTime startTime, SimulationTime stopTime,
                          InterposeMethod interposeMethod, const gchar* pluginName,
-                         const gchar* pluginPath, gchar** envv, gchar** argv);
+                         const gchar* pluginPath, gchar** envv, gchar** argv,
+                         gboolean elidePayloads, gboolean traceSyscalls);
+/* Takes ownership of params. A host has at most one traffic model. */
+void host_addTrafficModel(Host* host, TrafficModelParameters* params);
+/* Returns NULL if the host has no traffic model, or it has already been freed. */
+TrafficModel* host_getTrafficModel(Host* host);
 void host_detachAllPlugins(Host* host);
+/* Kills the native processes of all of the host's applications, without waiting
+ * for them; host_freeAllApplications() reaps them. */
+void host_killAllApplications(Host* host);
 void host_freeAllApplications(Host* host);
 
 gint host_compare(gconstpointer a, gconstpointer b, gpointer user_data);
@@ -68,11 +98,15 @@ Address* host_getDefaultAddress(Host* host);
 in_addr_t host_getDefaultIP(Host* host);
 Random* host_getRandom(Host* host);
 gdouble host_getNextPacketPriority(Host* host);
+SimulationTime host_getLookahead(Host* host);
+/* A lower bound on the delay of the packets that the host sends to other hosts. */
+SimulationTime host_getSendLatency(Host* host);
 
 gboolean host_autotuneReceiveBuffer(Host* host);
 gboolean host_autotuneSendBuffer(Host* host);
 guint64 host_getConfiguredRecvBufSize(Host* host);
 guint64 host_getConfiguredSendBufSize(Host* host);
+TcpCongestionControl host_getTcpCongestionControl(Host* host);
 
 NetworkInterface* host_lookupInterface(Host* host, in_addr_t handle);
 Router* host_getUpstreamRouter(Host* host, in_addr_t handle);
@@ -85,9 +119,11 @@ LogLevel host_getLogLevel(Host* host);
 const gchar* host_getDataPath(Host* host);
 
 gboolean host_doesInterfaceExist(Host* host, in_addr_t interfaceIP);
+/* If reusePort is TRUE, the port may already be shared by sockets that set
+ * SO_REUSEPORT. */
 gboolean host_isInterfaceAvailable(Host* host, ProtocolType type,
                                    in_addr_t interfaceIP, in_port_t port,
-                                   in_addr_t peerIP, in_port_t peerPort);
+                                   in_addr_t peerIP, in_port_t peerPort, gboolean reusePort);
 void host_associateInterface(Host* host, const CompatSocket* socket, in_addr_t bindAddress);
 void host_disassociateInterface(Host* host, const CompatSocket* socket);
 in_port_t host_getRandomFreePort(Host* host, ProtocolType type,
@@ -95,8 +131,27 @@ in_port_t host_getRandomFreePort(Host* host, ProtocolType type,
                                  in_port_t peerPort);
 
 FutexTable* host_getFutexTable(Host* host);
+TimerWheel* host_getTimerWheel(Host* host);
 
 // converts a virtual (shadow) tid into the native tid
 pid_t host_getNativeTID(Host* host, pid_t virtualPID, pid_t virtualTID);
 
+// returns the process with the given virtual (shadow) pid, or NULL if there's none
+Process* host_getProcess(Host* host, pid_t virtualPID);
+
+// adds the thread to and removes it from the table that the lookups above use. To be
+// called by the thread's process when it adds or reaps the thread.
+void host_addThread(Host* host, Thread* thread);
+void host_removeThread(Host* host, Thread* thread);
+
+// adds the thread to and removes it from the threads whose plugin is running until its
+// next syscall, while the worker handles other events. To be called by the thread.
+void host_addDetachedThread(Host* host, Thread* thread);
+void host_removeDetachedThread(Host* host, Thread* thread);
+
+// returns whether one of the host's detached threads is still running its plugin, so
+// that the next of its events would have to wait for the plugin's next syscall. Doesn't
+// block.
+gboolean host_isWaitingForPlugin(Host* host);
+
 #endif /* SHD_HOST_H_ */
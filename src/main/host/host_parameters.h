@@ -10,6 +10,7 @@
 #include <glib.h>
 
 #include "lib/logger/log_level.h"
+#include "main/bindings/c/bindings-opaque.h"
 #include "main/core/support/definitions.h"
 #include "main/host/tracker_types.h"
 
@@ -37,6 +38,11 @@ struct _HostParameters {
     guint64 sendBufSize;
     gboolean autotuneSendBuf;
     guint64 interfaceBufSize;
+    TcpCongestionControl tcpCongestionControl;
+    gboolean segmentationOffload;
+    guint32 pcapCaptureSize;
+    LogFormat heartbeatLogFormat;
+    guint cpuCores;
 };
 
 #endif
\ No newline at end of file
@@ -7,6 +7,10 @@ use log::*;
 use nix::{errno::Errno, unistd::Pid};
 use std::fmt::Debug;
 
+// The kernel rejects `process_vm_readv` and `process_vm_writev` calls with
+// more than this many iovecs on either side (UIO_MAXIOV).
+const MAX_IOVECS: usize = 1024;
+
 /// A utility for copying data to and from a process's memory.
 #[derive(Debug, Clone)]
 pub struct MemoryCopier {
@@ -106,6 +110,30 @@ impl MemoryCopier {
         Ok(())
     }
 
+    /// Copy each of `srcs` into the corresponding buffer in `dsts`, using as
+    /// few `process_vm_readv` calls as possible. Fails with EFAULT if any of
+    /// the regions couldn't be read completely.
+    /// SAFETY: A mutable reference to the process memory must not exist.
+    pub unsafe fn copy_from_ptrs(
+        &self,
+        dsts: &mut [&mut [u8]],
+        srcs: &[TypedPluginPtr<u8>],
+    ) -> Result<(), Errno> {
+        assert_eq!(dsts.len(), srcs.len());
+        for (dsts, srcs) in dsts.chunks_mut(MAX_IOVECS).zip(srcs.chunks(MAX_IOVECS)) {
+            let toread: usize = srcs.iter().map(|src| src.len()).sum();
+            let bytes_read = unsafe { self.readv_ptrs(dsts, srcs)? };
+            if bytes_read != toread {
+                warn!(
+                    "Tried to read {} bytes but only got {}",
+                    toread, bytes_read
+                );
+                return Err(Errno::EFAULT);
+            }
+        }
+        Ok(())
+    }
+
     // Low level helper for reading directly from `srcs` to `dsts`.
     // Returns the number of bytes read. Panics if the
     // MemoryManager's process isn't currently active.
@@ -179,11 +207,57 @@ impl MemoryCopier {
 
         let towrite = src.len();
         trace!("write_ptr writing {} bytes", towrite);
-        let local = [nix::sys::uio::IoVec::from_slice(src)];
-        let remote = [nix::sys::uio::RemoteIoVec {
-            base: usize::from(dst.ptr()),
-            len: towrite,
-        }];
+        let nwritten = unsafe { self.writev_ptrs(&[dst], &[src])? };
+        // There shouldn't be any partial writes with a single remote iovec.
+        assert_eq!(nwritten, towrite);
+        Ok(())
+    }
+
+    /// Copy each buffer in `srcs` into the corresponding region in `dsts`,
+    /// using as few `process_vm_writev` calls as possible. Fails with EFAULT
+    /// if any of the regions couldn't be written completely.
+    /// SAFETY: A reference to the process memory must not exist.
+    pub unsafe fn copy_to_ptrs(
+        &self,
+        dsts: &[TypedPluginPtr<u8>],
+        srcs: &[&[u8]],
+    ) -> Result<(), Errno> {
+        assert_eq!(dsts.len(), srcs.len());
+        for (dsts, srcs) in dsts.chunks(MAX_IOVECS).zip(srcs.chunks(MAX_IOVECS)) {
+            let towrite: usize = dsts.iter().map(|dst| dst.len()).sum();
+            trace!("write_ptrs writing {} bytes to {} ptrs", towrite, dsts.len());
+            let nwritten = unsafe { self.writev_ptrs(dsts, srcs)? };
+            if nwritten != towrite {
+                warn!(
+                    "Tried to write {} bytes but only wrote {}",
+                    towrite, nwritten
+                );
+                return Err(Errno::EFAULT);
+            }
+        }
+        Ok(())
+    }
+
+    // Low level helper for writing directly from `srcs` to `dsts`.
+    // Returns the number of bytes written. Panics if the
+    // MemoryManager's process isn't currently active.
+    /// SAFETY: A reference to the process memory must not exist.
+    unsafe fn writev_ptrs(
+        &self,
+        dsts: &[TypedPluginPtr<u8>],
+        srcs: &[&[u8]],
+    ) -> Result<usize, Errno> {
+        let local: Vec<_> = srcs
+            .iter()
+            .map(|src| nix::sys::uio::IoVec::from_slice(*src))
+            .collect();
+        let remote: Vec<_> = dsts
+            .iter()
+            .map(|dst| nix::sys::uio::RemoteIoVec {
+                base: usize::from(dst.ptr()),
+                len: dst.len(),
+            })
+            .collect();
 
         // While the documentation for process_vm_writev says to use the pid, in
         // practice it needs to be the tid of a still-running thread. i.e. using the
@@ -196,8 +270,7 @@ impl MemoryCopier {
 
         let nwritten = nix::sys::uio::process_vm_writev(active_tid, &local, &remote)
             .map_err(|e| e.as_errno().unwrap())?;
-        // There shouldn't be any partial writes with a single remote iovec.
-        assert_eq!(nwritten, towrite);
-        Ok(())
+
+        Ok(nwritten)
     }
 }
@@ -9,19 +9,45 @@ use crate::utility::proc_maps::{MappingPath, Sharing};
 use log::*;
 use nix::unistd::Pid;
 use nix::{fcntl, sys};
-use std::cell::RefCell;
+use std::cell::{Cell, RefCell};
 use std::collections::HashMap;
+use std::ffi::CString;
 use std::fmt::Debug;
 use std::fs::File;
-use std::fs::OpenOptions;
 use std::os::raw::c_void;
-use std::os::unix::io::AsRawFd;
+use std::os::unix::io::{AsRawFd, FromRawFd};
 use std::path::PathBuf;
 use std::process;
+use std::sync::atomic::{AtomicBool, Ordering};
 
 const HEAP_PROT: i32 = libc::PROT_READ | libc::PROT_WRITE;
 const STACK_PROT: i32 = libc::PROT_READ | libc::PROT_WRITE;
 
+// Size of a transparent huge page on the architectures we support.
+const HUGE_PAGE_SIZE: usize = 2 << 20;
+
+// Whether to map the shared memory file into Shadow so that it can be backed by transparent huge
+// pages. Set once from the configuration before any plugins are started.
+static USE_HUGE_PAGES: AtomicBool = AtomicBool::new(false);
+
+pub fn set_use_huge_pages(use_huge_pages: bool) {
+    USE_HUGE_PAGES.store(use_huge_pages, Ordering::Relaxed);
+}
+
+// Whether to leave large private anonymous mappings in the plugin instead of remapping them into
+// the shared memory file, so that the kernel can merge their identical pages across processes.
+// Set once from the configuration before any plugins are started.
+static USE_KSM: AtomicBool = AtomicBool::new(false);
+
+// Private anonymous mappings at least this long are left mergeable when `USE_KSM` is set. Smaller
+// ones are remapped as usual, since they're more likely to hold hot data such as malloc arenas
+// that Shadow reads on every syscall.
+const KSM_MIN_MAPPING_LEN: usize = 2 << 20;
+
+pub fn set_use_ksm(use_ksm: bool) {
+    USE_KSM.store(use_ksm, Ordering::Relaxed);
+}
+
 // Represents a region of plugin memory.
 #[derive(Clone, Debug)]
 struct Region {
@@ -33,6 +59,30 @@ struct Region {
     original_path: Option<proc_maps::MappingPath>,
 }
 
+// Why an access to plugin memory couldn't be served from a region mapped into Shadow.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+enum MissReason {
+    Unaligned,
+    NoRegion,
+    NotMapped,
+    CrossesRegion,
+}
+
+// The plugin addresses of the region that the last access hit, and where it's mapped into Shadow.
+#[derive(Copy, Clone, Debug)]
+struct LastHit {
+    start: usize,
+    end: usize,
+    shadow_base: *mut c_void,
+}
+
+// Count and total size of the accesses that missed for a given kind of region and reason.
+#[derive(Copy, Clone, Debug, Default)]
+struct MissCount {
+    accesses: u64,
+    bytes: u64,
+}
+
 #[allow(dead_code)]
 fn log_regions<It: Iterator<Item = (Interval, Region)>>(level: log::Level, regions: It) {
     if log::log_enabled!(level) {
@@ -68,7 +118,12 @@ pub struct MemoryMapper {
     shm_file: ShmFile,
     regions: IntervalMap<Region>,
 
-    misses_by_path: RefCell<HashMap<String, u32>>,
+    misses: RefCell<HashMap<(String, MissReason), MissCount>>,
+
+    /// The mapped region that the last access was in. Syscall handlers mostly access the same
+    /// stack or heap region over and over, so this usually saves looking it up in `regions`.
+    /// Cleared by each of the `handle_*` methods, since they may move or unmap the region.
+    last_hit: Cell<Option<LastHit>>,
 
     /// The bounds of the heap. Note that before the plugin's first `brk` syscall this will be a
     /// zero-sized interval (though in the case of thread-preload that'll have already happened
@@ -112,6 +167,9 @@ impl ShmFile {
 
     /// Map the given interval of the file into shadow's address space.
     fn mmap_into_shadow(&self, interval: &Interval, prot: i32) -> *mut c_void {
+        if USE_HUGE_PAGES.load(Ordering::Relaxed) && interval.len() >= HUGE_PAGE_SIZE {
+            return self.mmap_into_shadow_huge(interval, prot);
+        }
         unsafe {
             sys::mman::mmap(
                 std::ptr::null_mut(),
@@ -125,6 +183,59 @@ impl ShmFile {
         .unwrap()
     }
 
+    /// Like `mmap_into_shadow`, but places the mapping so that its address is congruent to its
+    /// file offset modulo the huge page size, and marks it as eligible for transparent huge pages.
+    /// The kernel can only back the parts of a shared mapping where both are huge page aligned.
+    /// The plugin's mappings already satisfy this, since they're at the same address as their
+    /// offset in the file.
+    fn mmap_into_shadow_huge(&self, interval: &Interval, prot: i32) -> *mut c_void {
+        // Reserve enough address space to contain the mapping at the right alignment.
+        let reserved_len = interval.len() + HUGE_PAGE_SIZE;
+        let reserved = unsafe {
+            sys::mman::mmap(
+                std::ptr::null_mut(),
+                reserved_len,
+                sys::mman::ProtFlags::PROT_NONE,
+                sys::mman::MapFlags::MAP_PRIVATE
+                    | sys::mman::MapFlags::MAP_ANONYMOUS
+                    | sys::mman::MapFlags::MAP_NORESERVE,
+                -1,
+                0,
+            )
+        }
+        .unwrap() as usize;
+
+        let misalignment = (interval.start.wrapping_sub(reserved)) % HUGE_PAGE_SIZE;
+        let start = reserved + misalignment;
+        let ptr = unsafe {
+            sys::mman::mmap(
+                start as *mut c_void,
+                interval.len(),
+                sys::mman::ProtFlags::from_bits(prot).unwrap(),
+                sys::mman::MapFlags::MAP_SHARED | sys::mman::MapFlags::MAP_FIXED,
+                self.shm_file.as_raw_fd(),
+                interval.start as i64,
+            )
+        }
+        .unwrap();
+
+        // Give back the unused parts of the reservation.
+        if start > reserved {
+            unsafe { sys::mman::munmap(reserved as *mut c_void, start - reserved) }
+                .unwrap_or_else(|e| warn!("munmap: {}", e));
+        }
+        let end = start + interval.len();
+        if reserved + reserved_len > end {
+            unsafe { sys::mman::munmap(end as *mut c_void, reserved + reserved_len - end) }
+                .unwrap_or_else(|e| warn!("munmap: {}", e));
+        }
+
+        unsafe { sys::mman::madvise(ptr, interval.len(), sys::mman::MmapAdvise::MADV_HUGEPAGE) }
+            .unwrap_or_else(|e| debug!("madvise(MADV_HUGEPAGE): {}", e));
+
+        ptr
+    }
+
     /// Copy data from the plugin's address space into the file. `interval` must be contained within
     /// `region_interval`. It can be the whole region, but notably for the stack we only copy in
     /// the part of the stack that's already allocated and initialized.
@@ -172,7 +283,36 @@ impl ShmFile {
     }
 }
 
-/// Get the current mapped regions of the process.
+/// Sums how many bytes of Shadow's mappings starting at `starts` are backed by huge pages.
+fn huge_page_bytes(starts: &std::collections::HashSet<usize>) -> usize {
+    let smaps = match std::fs::read_to_string("/proc/self/smaps") {
+        Ok(s) => s,
+        Err(e) => {
+            warn!("reading /proc/self/smaps: {}", e);
+            return 0;
+        }
+    };
+
+    let mut total = 0;
+    let mut in_mapping = false;
+    for line in smaps.lines() {
+        let mut fields = line.split_whitespace();
+        let first = fields.next().unwrap_or("");
+        if let Some((start, _end)) = first.split_once('-') {
+            // The header line of a mapping.
+            in_mapping = usize::from_str_radix(start, 16)
+                .map(|start| starts.contains(&start))
+                .unwrap_or(false);
+        } else if in_mapping && first == "ShmemPmdMapped:" {
+            let kb: usize = fields.next().and_then(|kb| kb.parse().ok()).unwrap_or(0);
+            total += kb * 1024;
+        }
+    }
+    total
+}
+
+/// Get the current mapped regions of the process. This is only read when the MemoryMapper is
+/// created; after that the syscall handlers keep the regions up to date.
 fn get_regions(pid: Pid) -> IntervalMap<Region> {
     let mut regions = IntervalMap::new();
     for mapping in proc_maps::mappings_for_pid(pid.as_raw()).unwrap() {
@@ -245,6 +385,43 @@ fn get_heap(
     heap_interval
 }
 
+/// Remaps the private anonymous regions that already existed before the MemoryMapper was
+/// created, such as thread stacks and malloc arenas allocated during early initialization and the
+/// zero-filled tail of the loaded binaries' data segments. Regions created after this point are
+/// remapped as they're created, in `MemoryMapper::handle_mmap_result`.
+///
+/// Only readable and writable regions are remapped, since those are the only ones we can copy the
+/// current contents of and that hold data Shadow needs to access.
+fn map_anonymous_regions(
+    memory_manager: &MemoryManager,
+    thread: &mut dyn Thread,
+    shm_file: &mut ShmFile,
+    regions: &mut IntervalMap<Region>,
+) {
+    let to_map: Vec<(Interval, Region)> = regions
+        .iter()
+        .filter(|(_i, r)| {
+            matches!(r.original_path, None | Some(MappingPath::ThreadStack(_)))
+                && r.sharing == Sharing::Private
+                && r.prot == (libc::PROT_READ | libc::PROT_WRITE)
+                && r.shadow_base.is_null()
+        })
+        .map(|(i, r)| (i, r.clone()))
+        .collect();
+
+    for (interval, mut region) in to_map {
+        trace!("Remapping existing anonymous region {:x?}", interval);
+        shm_file.alloc(&interval);
+        region.shadow_base = shm_file.mmap_into_shadow(&interval, region.prot);
+        shm_file.copy_into_file(memory_manager, &interval, &region, &interval);
+        shm_file.mmap_into_plugin(thread, &interval, region.prot);
+
+        let mutations = regions.insert(interval, region);
+        // Should have overwritten the old region and not affected any others.
+        debug_assert_eq!(mutations.len(), 1);
+    }
+}
+
 /// Finds where the stack is located and maps the region bounding the maximum
 /// stack size.
 fn map_stack(
@@ -303,16 +480,38 @@ fn map_stack(
 
 impl Drop for MemoryMapper {
     fn drop(&mut self) {
-        let misses = self.misses_by_path.borrow();
+        let misses = self.misses.borrow();
         if misses.is_empty() {
             debug!("MemoryManager misses: None");
         } else {
             debug!("MemoryManager misses: (consider extending MemoryManager to remap regions with a high miss count)");
-            for (path, count) in misses.iter() {
-                debug!("\t{} in {}", count, path);
+            let mut misses: Vec<_> = misses.iter().collect();
+            misses.sort_by(|a, b| b.1.accesses.cmp(&a.1.accesses));
+            for ((path, reason), count) in misses {
+                debug!(
+                    "\t{} accesses ({} bytes) in {} ({:?})",
+                    count.accesses, count.bytes, path, reason
+                );
             }
         }
 
+        if USE_HUGE_PAGES.load(Ordering::Relaxed) && log_enabled!(Level::Debug) {
+            let mapped: Vec<(usize, usize)> = self
+                .regions
+                .iter()
+                .filter(|(_i, r)| !r.shadow_base.is_null())
+                .map(|(i, r)| (r.shadow_base as usize, i.len()))
+                .collect();
+            let total: usize = mapped.iter().map(|(_, len)| len).sum();
+            let starts: std::collections::HashSet<usize> =
+                mapped.iter().map(|(start, _)| *start).collect();
+            let huge = huge_page_bytes(&starts);
+            debug!(
+                "MemoryManager huge page coverage: {} of {} mapped bytes",
+                huge, total
+            );
+        }
+
         // Mappings are no longer valid. Clear out our map, and unmap those regions from Shadow's
         // address space.
         let mutations = self.regions.clear(std::usize::MIN..std::usize::MAX);
@@ -331,29 +530,25 @@ impl MemoryMapper {
     pub fn new(memory_manager: &mut MemoryManager, thread: &mut impl Thread) -> MemoryMapper {
         let memory_copier = MemoryCopier::new(thread.system_pid());
 
-        let shm_path = format!(
-            "/dev/shm/shadow_memory_manager_{}_{}_{}",
+        let shm_name = format!(
+            "shadow_memory_manager_{}_{}_{}",
             process::id(),
             u32::from(thread.host_id()),
             u32::from(thread.process_id())
         );
-        let shm_file = OpenOptions::new()
-            .read(true)
-            .write(true)
-            .create_new(true)
-            .open(&shm_path)
-            .unwrap();
-
-        // We don't need the file anymore in the file system. Unlinking it now
-        // ensures that it will be removed when there are no more open file
-        // descriptors to it.
-        match std::fs::remove_file(&shm_path) {
-            Ok(_) => (),
-            Err(e) => warn!("removing '{}': {}", shm_path, e),
-        }
+        let shm_name = CString::new(shm_name).unwrap();
+
+        // An anonymous file, which is removed once there are no more open
+        // file descriptors to it.
+        let shm_file = unsafe {
+            File::from_raw_fd(
+                sys::memfd::memfd_create(&shm_name, sys::memfd::MemFdCreateFlag::MFD_CLOEXEC)
+                    .unwrap(),
+            )
+        };
 
-        // The file can no longer be accessed by its original path, but *can*
-        // be accessed via the file-descriptor link in /proc.
+        // The file has no path, but *can* be accessed via the file-descriptor
+        // link in /proc.
         let shm_path = format!("/proc/{}/fd/{}\0", process::id(), shm_file.as_raw_fd());
 
         let shm_plugin_fd = {
@@ -381,12 +576,14 @@ impl MemoryMapper {
         let mut regions = get_regions(memory_manager.pid);
         let heap = get_heap(&mut shm_file, thread, memory_manager, &mut regions);
         map_stack(memory_manager, thread, &mut shm_file, &mut regions);
+        map_anonymous_regions(memory_manager, thread, &mut shm_file, &mut regions);
 
         MemoryMapper {
             memory_copier,
             shm_file,
             regions,
-            misses_by_path: RefCell::new(HashMap::new()),
+            misses: RefCell::new(HashMap::new()),
+            last_hit: Cell::new(None),
             heap,
         }
     }
@@ -490,7 +687,7 @@ impl MemoryMapper {
     /// Executes the actual mmap operation in the plugin, updates the MemoryManager's understanding of
     /// the plugin's address space, and in some cases remaps the given region into the
     /// MemoryManager's shared memory file for fast access. Currently only private anonymous
-    /// mappings are remapped.
+    /// mappings are remapped, except for large ones when kernel samepage merging is enabled.
     #[allow(clippy::too_many_arguments)]
     pub fn handle_mmap_result(
         &mut self,
@@ -500,6 +697,7 @@ impl MemoryMapper {
         flags: i32,
         fd: i32,
     ) {
+        self.last_hit.set(None);
         trace!(
             "Handling mmap result for {:x}..+{}",
             usize::from(ptr.ptr()),
@@ -538,7 +736,18 @@ impl MemoryMapper {
         let mutations = self.regions.clear(interval.clone());
         self.unmap_mutations(mutations);
 
-        if is_anonymous && sharing == Sharing::Private {
+        if is_anonymous
+            && sharing == Sharing::Private
+            && USE_KSM.load(Ordering::Relaxed)
+            && interval.len() >= KSM_MIN_MAPPING_LEN
+        {
+            // Pages in the shared memory file can't be merged, so leave the mapping private and
+            // let Shadow access it through the MemoryCopier. The shim already asks for every
+            // mapping to be mergeable on kernels that support it; this covers older ones.
+            thread
+                .native_madvise(ptr.ptr(), ptr.len(), libc::MADV_MERGEABLE)
+                .unwrap_or_else(|e| debug!("madvise(MADV_MERGEABLE): {}", e));
+        } else if is_anonymous && sharing == Sharing::Private {
             // Overwrite the freshly mapped region with a region from the shared mem file and map
             // it. In principle we might be able to avoid doing the first mmap above in this case,
             // but doing so lets the OS decide if it's a legal mapping, and where to put it.
@@ -563,6 +772,7 @@ impl MemoryMapper {
     /// Executes the actual mmap operation in the plugin, updates the MemoryManager's understanding of
     /// the plugin's address space, and unmaps the affected memory from Shadow if it was mapped in.
     pub fn handle_munmap_result(&mut self, addr: PluginPtr, length: usize) {
+        self.last_hit.set(None);
         trace!("handle_munmap_result({:?}, {})", addr, length);
         if length == 0 {
             return;
@@ -589,6 +799,7 @@ impl MemoryMapper {
         flags: i32,
         new_address: PluginPtr,
     ) -> SyscallResult {
+        self.last_hit.set(None);
         let new_address =
             thread.native_mremap(old_address, old_size, new_size, flags, new_address)?;
         let old_interval = usize::from(old_address)..(usize::from(old_address) + old_size);
@@ -709,6 +920,7 @@ impl MemoryMapper {
     /// pointers. (Rust won't allow mutable methods such as this one to be called with outstanding
     /// borrowed references).
     pub fn handle_brk(&mut self, thread: &mut impl Thread, ptr: PluginPtr) -> SyscallResult {
+        self.last_hit.set(None);
         let requested_brk = usize::from(ptr);
 
         // On error, brk syscall returns current brk (end of heap). The only errors we specifically
@@ -833,6 +1045,7 @@ impl MemoryMapper {
         size: usize,
         prot: i32,
     ) -> SyscallResult {
+        self.last_hit.set(None);
         trace!("mprotect({:?}, {}, {:?})", addr, size, prot);
         thread.native_mprotect(addr, size, prot)?;
         let protflags = sys::mman::ProtFlags::from_bits(prot).unwrap();
@@ -951,56 +1164,82 @@ impl MemoryMapper {
         Ok(0.into())
     }
 
-    // Get a raw pointer to the plugin's memory, if it's been remapped into Shadow.
-    // Panics if called with zero-length `src`.
-    fn get_mapped_ptr<T: Pod + Debug>(&self, src: TypedPluginPtr<T>) -> Option<*mut T> {
+    // Get a raw pointer to the bytes of the plugin's memory, if it's been remapped into Shadow.
+    // `src` doesn't need to be aligned for `T`. Panics if called with zero-length `src`.
+    fn get_mapped_bytes<T: Pod + Debug>(
+        &self,
+        src: TypedPluginPtr<T>,
+    ) -> Result<*mut u8, MissReason> {
         assert!(src.len() > 0);
 
-        if usize::from(src.ptr()) % std::mem::align_of::<T>() != 0 {
-            // Creating a reference from an unaligned pointer is undefined
-            // behavior in Rust.  Instead of accessing such pointers directly,
-            // we fall back the memory *copier*, which will use a safely aligned
-            // intermediate buffer.
-            trace!("Can't map unaligned pointer {:?}", src);
-            return None;
+        let start = usize::from(src.ptr());
+        let end = start + src.len() * std::mem::size_of::<T>();
+
+        if let Some(hit) = self.last_hit.get() {
+            if hit.start <= start && end <= hit.end {
+                // Base pointer + offset won't wrap around, by construction.
+                return Ok(unsafe { hit.shadow_base.add(start - hit.start) } as *mut u8);
+            }
         }
 
-        let (interval, region) = match self.regions.get(usize::from(src.ptr())) {
+        let (interval, region) = match self.regions.get(start) {
             Some((i, r)) => (i, r),
             None => {
                 warn!("src {:?} isn't in any mapped region", src);
-                return None;
+                return Err(MissReason::NoRegion);
             }
         };
         let shadow_base = if region.shadow_base.is_null() {
             trace!("src {:?} isn't mapped into Shadow", src);
-            return None;
+            return Err(MissReason::NotMapped);
         } else {
             region.shadow_base
         };
 
-        if !interval.contains(&(usize::from(src.slice(src.len()..src.len()).ptr()) - 1)) {
+        if end > interval.end {
             // End isn't in the region.
             trace!(
                 "src {:?} mapped into Shadow, but extends beyond mapped region.",
                 src
             );
-            return None;
+            return Err(MissReason::CrossesRegion);
         }
 
-        let offset = usize::from(src.ptr()) - interval.start;
+        self.last_hit.set(Some(LastHit {
+            start: interval.start,
+            end: interval.end,
+            shadow_base,
+        }));
+
+        let offset = start - interval.start;
         // Base pointer + offset won't wrap around, by construction.
-        let ptr = unsafe { shadow_base.add(offset) } as *mut T;
+        Ok(unsafe { shadow_base.add(offset) } as *mut u8)
+    }
 
-        Some(ptr)
+    // Get a raw pointer to the plugin's memory, if it's been remapped into Shadow.
+    // Panics if called with zero-length `src`.
+    fn get_mapped_ptr<T: Pod + Debug>(&self, src: TypedPluginPtr<T>) -> Result<*mut T, MissReason> {
+        if usize::from(src.ptr()) % std::mem::align_of::<T>() != 0 {
+            // Creating a reference from an unaligned pointer is undefined
+            // behavior in Rust.  Instead of accessing such pointers directly,
+            // callers can copy the bytes from `get_bytes_ref`, or we fall back
+            // to the memory *copier*, which will use a safely aligned
+            // intermediate buffer.
+            trace!("Can't map unaligned pointer {:?}", src);
+            return Err(MissReason::Unaligned);
+        }
+
+        Ok(self.get_mapped_bytes(src)? as *mut T)
     }
 
     fn get_mapped_ptr_and_count<T: Pod + Debug>(&self, src: TypedPluginPtr<T>) -> Option<*mut T> {
-        let res = self.get_mapped_ptr(src);
-        if res.is_none() {
-            self.inc_misses(src);
+        match self.get_mapped_ptr(src) {
+            Ok(ptr) => Some(ptr),
+            Err(reason) => {
+                self.inc_misses(src, reason);
+                None
+            }
         }
-        res
     }
 
     pub unsafe fn get_ref<T: Debug + Pod>(&self, src: TypedPluginPtr<T>) -> Option<&[T]> {
@@ -1019,15 +1258,62 @@ impl MemoryMapper {
         Some(unsafe { std::slice::from_raw_parts_mut(notnull_mut_debug(ptr), src.len()) })
     }
 
-    /// Counts accesses where we had to fall back to the thread's (slow) apis.
-    fn inc_misses<T: Debug + Pod>(&self, src: TypedPluginPtr<T>) {
+    /// Like `get_ref`, but views the memory as bytes, so that `src` doesn't need to be aligned for
+    /// `T`. Values can be read out of it with unaligned copies, such as `copy_from_slice` into a
+    /// buffer of `T`.
+    pub unsafe fn get_bytes_ref<T: Debug + Pod>(&self, src: TypedPluginPtr<T>) -> Option<&[u8]> {
+        if src.len() == 0 {
+            return Some(&[]);
+        }
+        let ptr = match self.get_mapped_bytes(src) {
+            Ok(ptr) => ptr,
+            Err(reason) => {
+                self.inc_misses(src, reason);
+                return None;
+            }
+        };
+        let len = src.len() * std::mem::size_of::<T>();
+        Some(unsafe { std::slice::from_raw_parts(notnull_debug(ptr), len) })
+    }
+
+    /// Like `get_mut`, but views the memory as bytes, so that `src` doesn't need to be aligned for
+    /// `T`.
+    pub unsafe fn get_bytes_mut<T: Debug + Pod>(
+        &self,
+        src: TypedPluginPtr<T>,
+    ) -> Option<&mut [u8]> {
+        if src.len() == 0 {
+            return Some(&mut []);
+        }
+        let ptr = match self.get_mapped_bytes(src) {
+            Ok(ptr) => ptr,
+            Err(reason) => {
+                self.inc_misses(src, reason);
+                return None;
+            }
+        };
+        let len = src.len() * std::mem::size_of::<T>();
+        Some(unsafe { std::slice::from_raw_parts_mut(notnull_mut_debug(ptr), len) })
+    }
+
+    /// Counts accesses where we had to fall back to the thread's (slow) apis, by the kind of
+    /// region accessed and the reason it couldn't be accessed directly.
+    fn inc_misses<T: Debug + Pod>(&self, src: TypedPluginPtr<T>, reason: MissReason) {
         let key = match self.regions.get(usize::from(src.ptr())) {
-            Some((_, original_path)) => format!("{:?}", original_path),
+            Some((_, Region {
+                original_path: Some(path),
+                ..
+            })) => format!("{:?}", path),
+            Some((_, Region {
+                original_path: None,
+                ..
+            })) => "anonymous".to_string(),
             None => "not found".to_string(),
         };
-        let mut misses = self.misses_by_path.borrow_mut();
-        let counter = misses.entry(key).or_insert(0);
-        *counter += 1;
+        let mut misses = self.misses.borrow_mut();
+        let counter = misses.entry((key, reason)).or_default();
+        counter.accesses += 1;
+        counter.bytes += (src.len() * std::mem::size_of::<T>()) as u64;
     }
 }
 
@@ -231,6 +231,35 @@ impl<'a, T: Debug + Pod> ProcessMemoryRefMut<'a, T> {
         Ok(())
     }
 
+    /// Like calling `flush` on each of `refs`, but writes back the contents
+    /// of all of the copied ones with as few `process_vm_writev` calls as
+    /// possible. The references must all be to the same process's memory.
+    pub fn flush_all(mut refs: Vec<Self>) -> Result<(), Errno> {
+        let res = {
+            let mut copier = None;
+            let mut dsts = Vec::new();
+            let mut srcs = Vec::new();
+            for mref in &refs {
+                if let CopiedOrMappedMut::Copied(c, ptr, v) = &mref.copied_or_mapped {
+                    copier = Some(c);
+                    dsts.push(ptr.cast_u8());
+                    srcs.push(pod::to_u8_slice(&v[..]));
+                }
+            }
+            match copier {
+                Some(copier) => {
+                    trace!("Flushing {} refs", dsts.len());
+                    unsafe { copier.copy_to_ptrs(&dsts, &srcs) }
+                }
+                None => Ok(()),
+            }
+        };
+        for mref in &mut refs {
+            mref.dirty = false;
+        }
+        res
+    }
+
     /// Disposes of the reference *without* writing back the contents.
     /// This should be used instead of `flush` if and only if the contents
     /// of this reference hasn't been overwritten.
@@ -276,6 +305,11 @@ fn page_size() -> usize {
     unsafe { libc::sysconf(libc::_SC_PAGESIZE) as usize }
 }
 
+/// Whether `ptr` is aligned for `T`, so that it can be referenced as a `&[T]`.
+fn is_aligned<T>(ptr: TypedPluginPtr<T>) -> bool {
+    usize::from(ptr.ptr()) % std::mem::align_of::<T>() == 0
+}
+
 /// Provides accessors for reading and writing another process's memory.
 /// When in use, any operation that touches that process's memory must go
 /// through the MemoryManager to ensure soundness. See MemoryManager::new.
@@ -343,13 +377,50 @@ impl MemoryManager {
         unsafe { mm.get_mut(ptr) }
     }
 
+    // Internal helper for viewing memory as bytes via the `memory_mapper`,
+    // which works even if `ptr` isn't aligned for `T`. Calling methods should
+    // fall back to the `memory_copier` on failure.
+    fn mapped_bytes<T: Pod + Debug>(&self, ptr: TypedPluginPtr<T>) -> Option<&[u8]> {
+        let mm = self.memory_mapper.as_ref()?;
+        // SAFETY: No mutable refs to process memory exist by preconditions of
+        // MemoryManager::new + we have a reference.
+        unsafe { mm.get_bytes_ref(ptr) }
+    }
+
+    // Internal helper for viewing memory as bytes via the `memory_mapper`,
+    // which works even if `ptr` isn't aligned for `T`. Calling methods should
+    // fall back to the `memory_copier` on failure.
+    fn mapped_bytes_mut<T: Pod + Debug>(&mut self, ptr: TypedPluginPtr<T>) -> Option<&mut [u8]> {
+        let mm = self.memory_mapper.as_ref()?;
+        // SAFETY: No other refs to process memory exist by preconditions of
+        // MemoryManager::new + we have an exclusive reference.
+        unsafe { mm.get_bytes_mut(ptr) }
+    }
+
+    // Internal helper for reading memory that we can't reference because
+    // `ptr` isn't aligned for `T`, e.g. a packed sockaddr. If it's mapped into
+    // Shadow, copies it into a local buffer without any syscalls.
+    fn mapped_unaligned_clone<T: Pod + Debug>(&self, ptr: TypedPluginPtr<T>) -> Option<Vec<T>> {
+        if is_aligned(ptr) {
+            return None;
+        }
+        let src = self.mapped_bytes(ptr)?;
+        let mut v = Vec::with_capacity(ptr.len());
+        // SAFETY: any values are valid for Pod, and we overwrite them all.
+        unsafe { v.set_len(ptr.len()) };
+        pod::to_u8_slice_mut(&mut v[..]).copy_from_slice(src);
+        Some(v)
+    }
+
     /// Returns a reference to the given memory, copying to a local buffer if
-    /// the memory isn't mapped into Shadow.
+    /// the memory isn't mapped into Shadow, or isn't aligned for `T`.
     pub fn memory_ref<'a, T: Pod + Debug>(
         &'a self,
         ptr: TypedPluginPtr<T>,
     ) -> Result<ProcessMemoryRef<'a, T>, Errno> {
-        if let Some(mref) = self.mapped_ref(ptr) {
+        if let Some(v) = self.mapped_unaligned_clone(ptr) {
+            Ok(ProcessMemoryRef::new_copied(v))
+        } else if let Some(mref) = self.mapped_ref(ptr) {
             Ok(ProcessMemoryRef::new_mapped(mref))
         } else {
             Ok(ProcessMemoryRef::new_copied(unsafe {
@@ -373,7 +444,9 @@ impl MemoryManager {
         // TODO: Implement and use MemoryMapper::memory_ref_prefix if and
         // when we're confident that the MemoryMapper always knows about all
         // mapped regions and merges adjacent regions.
-        if let Some(mref) = self.mapped_ref(ptr) {
+        if let Some(v) = self.mapped_unaligned_clone(ptr) {
+            Ok(ProcessMemoryRef::new_copied(v))
+        } else if let Some(mref) = self.mapped_ref(ptr) {
             Ok(ProcessMemoryRef::new_mapped(mref))
         } else {
             Ok(ProcessMemoryRef::new_copied(unsafe {
@@ -416,13 +489,45 @@ impl MemoryManager {
         dst: &mut [T],
         src: TypedPluginPtr<T>,
     ) -> Result<(), Errno> {
-        if let Some(src) = self.mapped_ref(src) {
-            dst.copy_from_slice(src);
+        // Copying bytes works whether or not `src` is aligned.
+        if let Some(src) = self.mapped_bytes(src) {
+            pod::to_u8_slice_mut(dst).copy_from_slice(src);
             return Ok(());
         }
         unsafe { self.memory_copier.copy_from_ptr(dst, src) }
     }
 
+    /// Gathers the memory at each of `srcs` into consecutive regions of `dst`,
+    /// whose length must be the sum of the lengths of `srcs`. Regions that
+    /// aren't mapped into Shadow are all copied with a single vectored read,
+    /// rather than one read per region.
+    pub fn copy_from_ptrs(&self, dst: &mut [u8], srcs: &[TypedPluginPtr<u8>]) -> Result<(), Errno> {
+        assert_eq!(dst.len(), srcs.iter().map(|src| src.len()).sum::<usize>());
+
+        let mut unmapped_dsts = Vec::new();
+        let mut unmapped_srcs = Vec::new();
+        let mut rest = dst;
+        for src in srcs {
+            let (dst, suffix) = rest.split_at_mut(src.len());
+            rest = suffix;
+            match self.mapped_ref(*src) {
+                Some(mapped) => dst.copy_from_slice(mapped),
+                None => {
+                    unmapped_dsts.push(dst);
+                    unmapped_srcs.push(*src);
+                }
+            }
+        }
+
+        if unmapped_srcs.is_empty() {
+            return Ok(());
+        }
+        unsafe {
+            self.memory_copier
+                .copy_from_ptrs(&mut unmapped_dsts, &unmapped_srcs)
+        }
+    }
+
     // Copies memory from the beginning of the given pointer to the last address
     // in the pointer that's accessible. Not exposed as a public interface
     // because this is generally only useful for strings, and
@@ -432,9 +537,9 @@ impl MemoryManager {
         buf: &mut [T],
         ptr: TypedPluginPtr<T>,
     ) -> Result<usize, Errno> {
-        if let Some(src) = self.mapped_ref(ptr) {
-            buf.copy_from_slice(src);
-            return Ok(src.len());
+        if let Some(src) = self.mapped_bytes(ptr) {
+            pod::to_u8_slice_mut(buf).copy_from_slice(src);
+            return Ok(ptr.len());
         }
         unsafe { self.memory_copier.copy_prefix_from_ptr(buf, ptr) }
     }
@@ -473,7 +578,10 @@ impl MemoryManager {
         // borrow.
         let pid = self.pid;
 
-        if let Some(mref) = self.mapped_mut(ptr) {
+        if let Some(v) = self.mapped_unaligned_clone(ptr) {
+            // Still written back with the copier when flushed.
+            Ok(ProcessMemoryRefMut::new_copied(MemoryCopier::new(pid), ptr, v))
+        } else if let Some(mref) = self.mapped_mut(ptr) {
             Ok(ProcessMemoryRefMut::new_mapped(mref))
         } else {
             let copier = MemoryCopier::new(pid);
@@ -525,8 +633,8 @@ impl MemoryManager {
         dst: TypedPluginPtr<T>,
         src: &[T],
     ) -> Result<(), Errno> {
-        if let Some(dst) = self.mapped_mut(dst) {
-            dst.copy_from_slice(src);
+        if let Some(dst) = self.mapped_bytes_mut(dst) {
+            dst.copy_from_slice(pod::to_u8_slice(src));
             return Ok(());
         }
         // SAFETY: No other refs to process memory exist by preconditions of
@@ -534,7 +642,67 @@ impl MemoryManager {
         unsafe { self.memory_copier.copy_to_ptr(dst, src) }
     }
 
+    /// Scatters consecutive regions of `src` into each of `dsts`. The length
+    /// of `src` must be the sum of the lengths of `dsts`. Regions that aren't
+    /// mapped into Shadow are all copied with a single vectored write, rather
+    /// than one write per region.
+    pub fn copy_to_ptrs(&mut self, dsts: &[TypedPluginPtr<u8>], src: &[u8]) -> Result<(), Errno> {
+        assert_eq!(src.len(), dsts.iter().map(|dst| dst.len()).sum::<usize>());
+
+        let mut unmapped_dsts = Vec::new();
+        let mut unmapped_srcs = Vec::new();
+        let mut rest = src;
+        for dst in dsts {
+            let (src, suffix) = rest.split_at(dst.len());
+            rest = suffix;
+            match self.mapped_mut(*dst) {
+                Some(mapped) => mapped.copy_from_slice(src),
+                None => {
+                    unmapped_dsts.push(*dst);
+                    unmapped_srcs.push(src);
+                }
+            }
+        }
+
+        if unmapped_dsts.is_empty() {
+            return Ok(());
+        }
+        // SAFETY: No other refs to process memory exist by preconditions of
+        // MemoryManager::new + we have an exclusive reference.
+        unsafe {
+            self.memory_copier
+                .copy_to_ptrs(&unmapped_dsts, &unmapped_srcs)
+        }
+    }
+
     /// Which process's address space this MemoryManager manages.
+    /// Copies the memory at `src` to `dst`, which must be the same length and must not overlap.
+    /// When `src` is mapped into Shadow this is a single copy.
+    pub fn copy_within_ptr(
+        &mut self,
+        dst: TypedPluginPtr<u8>,
+        src: TypedPluginPtr<u8>,
+    ) -> Result<(), Errno> {
+        assert_eq!(dst.len(), src.len());
+
+        let dst_start = usize::from(dst.ptr());
+        let src_start = usize::from(src.ptr());
+        if dst_start < src_start + src.len() && src_start < dst_start + dst.len() {
+            return Err(Errno::EINVAL);
+        }
+
+        if let Some(mapped) = self.mapped_ref(src) {
+            // SAFETY: the mapping stays valid while we copy, and the regions don't overlap, so
+            // this doesn't alias the mutable borrow of `dst`.
+            let mapped = unsafe { std::slice::from_raw_parts(mapped.as_ptr(), mapped.len()) };
+            return self.copy_to_ptr(dst, mapped);
+        }
+
+        let mut buf = vec![0u8; src.len()];
+        self.copy_from_ptr(&mut buf, src)?;
+        self.copy_to_ptr(dst, &buf)
+    }
+
     pub fn pid(&self) -> Pid {
         self.pid
     }
@@ -762,6 +930,22 @@ mod export {
         unsafe { allocd_mem.as_ref().unwrap().ptr().ptr().into() }
     }
 
+    /// Whether to map plugin memory into Shadow so that it can be backed by
+    /// transparent huge pages. Should be called before any MemoryManager is
+    /// created.
+    #[no_mangle]
+    pub extern "C" fn memorymanager_setUseHugePages(use_huge_pages: bool) {
+        memory_mapper::set_use_huge_pages(use_huge_pages);
+    }
+
+    /// Whether to leave large private anonymous plugin mappings out of shared
+    /// memory so that the kernel can merge their identical pages. Should be
+    /// called before any MemoryManager is created.
+    #[no_mangle]
+    pub extern "C" fn memorymanager_setUseKsm(use_ksm: bool) {
+        memory_mapper::set_use_ksm(use_ksm);
+    }
+
     /// Initialize the MemoryMapper if it isn't already initialized. `thread` must
     /// be running and ready to make native syscalls.
     #[no_mangle]
@@ -891,6 +1075,93 @@ mod export {
         }
     }
 
+    /// Copy `n` bytes from `src` to `dst`, both in this process's memory. The
+    /// regions must not overlap.
+    #[no_mangle]
+    pub unsafe extern "C" fn memorymanager_copyPtr(
+        memory_manager: *mut MemoryManager,
+        dst: c::PluginPtr,
+        src: c::PluginPtr,
+        n: usize,
+    ) -> i32 {
+        let memory_manager = unsafe { memory_manager.as_mut().unwrap() };
+        let dst = TypedPluginPtr::new(dst.into(), n);
+        let src = TypedPluginPtr::new(src.into(), n);
+        match memory_manager.copy_within_ptr(dst, src) {
+            Ok(_) => 0,
+            Err(e) => {
+                trace!("Couldn't copy {:?} into {:?}: {:?}", src, dst, e);
+                -(e as i32)
+            }
+        }
+    }
+
+    /// Copy the `count` regions starting at `srcs[i]` of length `lens[i]` from
+    /// this reader's memory into consecutive regions of `dst`, using as few
+    /// syscalls as possible.
+    #[no_mangle]
+    pub unsafe extern "C" fn memorymanager_readPtrs(
+        memory_manager: *const MemoryManager,
+        dst: *mut c_void,
+        srcs: *const c::PluginPtr,
+        lens: *const usize,
+        count: usize,
+    ) -> i32 {
+        let memory_manager = unsafe { memory_manager.as_ref().unwrap() };
+        if count == 0 {
+            return 0;
+        }
+        let srcs = unsafe { std::slice::from_raw_parts(notnull_debug(srcs), count) };
+        let lens = unsafe { std::slice::from_raw_parts(notnull_debug(lens), count) };
+        let srcs: Vec<_> = srcs
+            .iter()
+            .zip(lens)
+            .map(|(src, len)| TypedPluginPtr::<u8>::new((*src).into(), *len))
+            .collect();
+        let n = lens.iter().sum();
+        let dst = unsafe { std::slice::from_raw_parts_mut(notnull_mut_debug(dst) as *mut u8, n) };
+        match memory_manager.copy_from_ptrs(dst, &srcs) {
+            Ok(_) => 0,
+            Err(e) => {
+                trace!("Couldn't read {:?} into {:?}: {:?}", srcs, dst, e);
+                -(e as i32)
+            }
+        }
+    }
+
+    /// Copy consecutive regions of `src` into the `count` regions starting at
+    /// `dsts[i]` of length `lens[i]` in this writer's memory, using as few
+    /// syscalls as possible.
+    #[no_mangle]
+    pub unsafe extern "C" fn memorymanager_writePtrs(
+        memory_manager: *mut MemoryManager,
+        dsts: *const c::PluginPtr,
+        lens: *const usize,
+        count: usize,
+        src: *const c_void,
+    ) -> i32 {
+        let memory_manager = unsafe { memory_manager.as_mut().unwrap() };
+        if count == 0 {
+            return 0;
+        }
+        let dsts = unsafe { std::slice::from_raw_parts(notnull_debug(dsts), count) };
+        let lens = unsafe { std::slice::from_raw_parts(notnull_debug(lens), count) };
+        let dsts: Vec<_> = dsts
+            .iter()
+            .zip(lens)
+            .map(|(dst, len)| TypedPluginPtr::<u8>::new((*dst).into(), *len))
+            .collect();
+        let n = lens.iter().sum();
+        let src = unsafe { std::slice::from_raw_parts(notnull_debug(src) as *const u8, n) };
+        match memory_manager.copy_to_ptrs(&dsts, src) {
+            Ok(_) => 0,
+            Err(e) => {
+                trace!("Couldn't write {:?} into {:?}: {:?}", src, dsts, e);
+                -(e as i32)
+            }
+        }
+    }
+
     /// Get a writable pointer to this writer's memory. Initial contents are unspecified.
     #[no_mangle]
     pub unsafe extern "C" fn memorymanager_getWritablePtr<'a>(
@@ -959,6 +1230,30 @@ mod export {
         }
     }
 
+    /// Write-back the `count` writers in `mrefs` together, and free them.
+    #[no_mangle]
+    pub unsafe extern "C" fn memorymanager_freeMutRefsWithFlush<'a>(
+        mrefs: *const *mut ProcessMemoryRefMut<'a, u8>,
+        count: usize,
+    ) -> i32 {
+        if count == 0 {
+            return 0;
+        }
+        let mrefs = unsafe { std::slice::from_raw_parts(notnull_debug(mrefs), count) };
+        let mrefs: Vec<_> = mrefs
+            .iter()
+            .map(|mref| *unsafe { Box::from_raw(notnull_mut_debug(*mref)) })
+            .collect();
+        // No way to safely recover here if the flush fails.
+        match ProcessMemoryRefMut::flush_all(mrefs) {
+            Ok(()) => 0,
+            Err(e) => {
+                warn!("Failed to flush writes");
+                -(e as i32)
+            }
+        }
+    }
+
     /// Write-back any previously returned writable memory, and free the writer.
     #[no_mangle]
     pub unsafe extern "C" fn memorymanager_freeMutRefWithoutFlush<'a>(
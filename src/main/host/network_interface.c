@@ -9,16 +9,19 @@
 #include <stddef.h>
 
 #include "lib/logger/logger.h"
+#include "main/core/support/config_handlers.h"
 #include "main/core/support/definitions.h"
 #include "main/core/work/task.h"
 #include "main/core/worker.h"
 #include "main/host/descriptor/compat_socket.h"
 #include "main/host/descriptor/descriptor.h"
 #include "main/host/descriptor/socket.h"
+#include "main/host/bound_socket_table.h"
 #include "main/host/descriptor/tcp.h"
 #include "main/host/host.h"
 #include "main/host/network_interface.h"
 #include "main/host/network_queuing_disciplines.h"
+#include "main/host/port_bitmap.h"
 #include "main/host/protocol.h"
 #include "main/host/tracker.h"
 #include "main/routing/address.h"
@@ -26,10 +29,19 @@
 #include "main/routing/packet.h"
 #include "main/routing/router.h"
 #include "main/utility/pcap_writer.h"
-#include "main/utility/priority_queue.h"
 #include "main/utility/tagged_ptr.h"
 #include "main/utility/utility.h"
 
+static bool _receiveBatching = false;
+ADD_CONFIG_HANDLER(config_getInterfaceReceiveBatching, _receiveBatching)
+
+typedef struct _NetworkInterfaceBackgroundLoad NetworkInterfaceBackgroundLoad;
+struct _NetworkInterfaceBackgroundLoad {
+    SimulationTime time;
+    guint64 upKiBps;
+    guint64 downKiBps;
+};
+
 typedef struct _NetworkInterfaceTokenBucket NetworkInterfaceTokenBucket;
 struct _NetworkInterfaceTokenBucket {
     /* The maximum number of bytes the bucket can hold */
@@ -38,6 +50,11 @@ struct _NetworkInterfaceTokenBucket {
     guint64 bytesRemaining;
     /* The number of bytes that get added to the bucket every millisecond */
     guint64 bytesRefill;
+    /* The refill when no background flows take a share of the bandwidth */
+    guint64 bytesRefillConfigured;
+    /* The number of refill intervals since we started refilling whose refill
+     * has been added to the bucket */
+    guint64 refillsApplied;
 };
 
 struct _NetworkInterface {
@@ -45,15 +62,32 @@ struct _NetworkInterface {
      * May be NULL for loopback interfaces. */
     Router* router;
 
+    /* If this is the host's 127.0.0.1 interface, whose bandwidth is unlimited. */
+    gboolean isLoopback;
+
     /* The queuing discipline used by this interface to schedule the
      * sending of packets from sockets. */
     QDiscMode qdisc;
 
+    /* If we coalesce the consecutive data packets of a TCP socket into
+     * super-packets of up to NETWORKINTERFACE_MAX_SUPER_PACKET_PAYLOAD bytes. */
+    gboolean segmentationOffload;
+
+    /* Segments of a received super-packet that the receive token bucket did not
+     * yet allow us to hand to their socket. */
+    GQueue receiveSegments;
+
     /* The address associated with this interface */
     Address* address;
 
     /* (protocol,port)-to-socket bindings. Stores CompatSocket objects as tagged pointers. */
-    GHashTable* boundSockets;
+    BoundSocketTable* boundSockets;
+    /* Bindings shared by sockets that set SO_REUSEPORT. Stores a GPtrArray of the sockets,
+     * as tagged pointers in the order that they were bound. */
+    BoundSocketTable* reusePortGroups;
+    /* The local ports that the bindings use, so free ports can be found quickly. */
+    PortBitmap* tcpPorts;
+    PortBitmap* udpPorts;
 
     /* Transports wanting to send data out. */
     RrSocketQueue rrQueue;
@@ -67,23 +101,34 @@ struct _NetworkInterface {
      * packets that do not conform to incoming rate limits are dropped. */
     NetworkInterfaceTokenBucket receiveBucket;
 
-    /* Store the time we started refilling our token buckets. This is used to
-     * help us compute when refills should occur following an idle period. */
+    /* Store the time we started refilling our token buckets. The buckets are
+     * refilled at the start of every refill interval since then. */
     SimulationTime timeStartedRefillingBuckets;
+    gboolean isRefilling;
 
-    /* If we have scheduled a refill task but it has not yet executed. */
-    gboolean isRefillPending;
+    /* The bandwidth taken by background flows from the times they change, in the
+     * order of those times, or NULL if there are none. */
+    GArray* backgroundLoads;
+
+    /* The earliest time at which we scheduled a wakeup task to continue
+     * sending or receiving once the buckets allow it, or 0 if none. */
+    SimulationTime nextWakeupTime;
 
     /* To support capturing incoming and outgoing packets */
     PCapWriter* pcap;
+    /* reused to hold the captured part of each packet's payload */
+    guchar* pcapPayload;
+    guint pcapPayloadLength;
 
     MAGIC_DECLARE;
 };
 
+/* the largest amount of data that a single TCP send can hand to the NIC */
+#define NETWORKINTERFACE_MAX_SUPER_PACKET_PAYLOAD 65536
+
 /* forward declarations */
 static void _networkinterface_sendPackets(NetworkInterface* interface, Host* src);
-static void _networkinterface_refillTokenBucketsCB(Host* host, gpointer interface,
-                                                   gpointer userData);
+static void _networkinterface_wakeupCB(Host* host, gpointer interface, gpointer userData);
 
 static void _compatsocket_unrefTaggedVoid(void* taggedSocketPtr) {
     utility_assert(taggedSocketPtr != NULL);
@@ -105,12 +150,34 @@ static inline guint64 _networkinterface_getCapacityFactor() {
     return (guint64) 1;
 }
 
-static void _networkinterface_refillTokenBucket(NetworkInterfaceTokenBucket* bucket) {
+/* Rather than running a task every refill interval, we add all of the refills
+ * that are due since the last time we used the bucket. This gives the same
+ * tokens at the same times as refilling on every interval would. */
+static void _networkinterface_refillTokenBucket(NetworkInterface* interface,
+                                                NetworkInterfaceTokenBucket* bucket) {
+    if (!interface->isRefilling) {
+        return;
+    }
+
+    SimulationTime now = worker_getCurrentTime();
+    SimulationTime elapsed = now - interface->timeStartedRefillingBuckets;
+
+    /* the first refill happens when we start refilling */
+    guint64 refillsDue = (guint64)(elapsed / _networkinterface_getRefillInterval()) + 1;
+    if (refillsDue <= bucket->refillsApplied) {
+        return;
+    }
+
+    guint64 numRefills = refillsDue - bucket->refillsApplied;
+    bucket->refillsApplied = refillsDue;
+
     /* We have room to add more tokens. */
-    bucket->bytesRemaining += bucket->bytesRefill;
-    /* Make sure we stay within capacity. */
-    if(bucket->bytesRemaining > bucket->bytesCapacity) {
+    guint64 room = bucket->bytesCapacity - bucket->bytesRemaining;
+    if (bucket->bytesRefill > 0 && numRefills > room / bucket->bytesRefill) {
+        /* Make sure we stay within capacity. */
         bucket->bytesRemaining = bucket->bytesCapacity;
+    } else {
+        bucket->bytesRemaining += numRefills * bucket->bytesRefill;
     }
 }
 
@@ -124,56 +191,45 @@ _networkinterface_consumeTokenBucket(NetworkInterfaceTokenBucket* bucket,
     }
 }
 
-static void _networkinterface_scheduleRefillTask(NetworkInterface* interface, Host* host,
-                                                 TaskCallbackFunc func, SimulationTime delay) {
-    Task* refillTask = task_new(func, interface, NULL, NULL, NULL);
-    worker_scheduleTask(refillTask, host, delay);
-    task_unref(refillTask);
-    interface->isRefillPending = TRUE;
-}
+/* Schedules a task at the refill that will let us use the bucket again, for
+ * when packets are waiting on it. */
+static void _networkinterface_scheduleWakeup(NetworkInterface* interface, Host* host,
+                                             NetworkInterfaceTokenBucket* bucket) {
+    utility_assert(interface->isRefilling);
+    utility_assert(bucket->bytesRemaining < CONFIG_MTU);
 
-static void _networkinterface_scheduleNextRefill(NetworkInterface* interface, Host* host) {
-    SimulationTime now = worker_getCurrentTime();
-    SimulationTime interval = _networkinterface_getRefillInterval();
+    if (bucket->bytesRefill == 0) {
+        /* the bucket will never allow another packet */
+        return;
+    }
 
-    /* This computes the time that the next refill should have occurred if we
-     * were to always call the refill function every interval, even though in
-     * practice we stop scheduling refill tasks once we notice we are idle. */
-    SimulationTime offset = now - interface->timeStartedRefillingBuckets;
-    SimulationTime relTimeSincelastRefill = offset % interval;
-    SimulationTime relTimeUntilNextRefill = interval - relTimeSincelastRefill;
+    guint64 bytesNeeded = CONFIG_MTU - bucket->bytesRemaining;
+    guint64 numRefills = (bytesNeeded + bucket->bytesRefill - 1) / bucket->bytesRefill;
+    SimulationTime wakeupTime = interface->timeStartedRefillingBuckets +
+                                (bucket->refillsApplied + numRefills - 1) *
+                                    _networkinterface_getRefillInterval();
 
-    /* call back when we need the next refill */
-    _networkinterface_scheduleRefillTask(
-        interface, host, _networkinterface_refillTokenBucketsCB, relTimeUntilNextRefill);
-}
+    /* an earlier wakeup will check again and schedule another if needed */
+    if (interface->nextWakeupTime != 0 && interface->nextWakeupTime <= wakeupTime) {
+        return;
+    }
 
-static gboolean _networkinterface_isRefillNeeded(NetworkInterface* interface) {
-    gboolean sendNeedsRefill = interface->sendBucket.bytesRemaining <
-                               interface->sendBucket.bytesCapacity;
-    gboolean receiveNeedsRefill = interface->receiveBucket.bytesRemaining <
-                                  interface->receiveBucket.bytesCapacity;
-    return (sendNeedsRefill || receiveNeedsRefill) &&
-           !interface->isRefillPending;
-}
+    SimulationTime now = worker_getCurrentTime();
+    utility_assert(wakeupTime > now);
 
-static void _networkinterface_scheduleNextRefillIfNeeded(NetworkInterface* interface, Host* host) {
-    if (_networkinterface_isRefillNeeded(interface)) {
-        _networkinterface_scheduleNextRefill(interface, host);
-    }
+    worker_scheduleCallback(_networkinterface_wakeupCB, interface, NULL, NULL, NULL, host,
+                            wakeupTime - now);
+    interface->nextWakeupTime = wakeupTime;
 }
 
-static void _networkinterface_refillTokenBucketsCB(Host* host, gpointer voidInterface,
-                                                   gpointer userData) {
+static void _networkinterface_wakeupCB(Host* host, gpointer voidInterface, gpointer userData) {
     NetworkInterface* interface = voidInterface;
     MAGIC_ASSERT(interface);
 
-    /* We no longer have an outstanding event in the event queue. */
-    interface->isRefillPending = FALSE;
-
-    /* Refill the token buckets. */
-    _networkinterface_refillTokenBucket(&interface->receiveBucket);
-    _networkinterface_refillTokenBucket(&interface->sendBucket);
+    if (interface->nextWakeupTime <= worker_getCurrentTime()) {
+        /* We no longer have an outstanding event in the event queue. */
+        interface->nextWakeupTime = 0;
+    }
 
     /* the refill may have caused us to be able to receive and send again.
      * we only receive packets from an upstream router if we have one (i.e.,
@@ -182,15 +238,89 @@ static void _networkinterface_refillTokenBucketsCB(Host* host, gpointer voidInte
         networkinterface_receivePackets(interface, host);
     }
     _networkinterface_sendPackets(interface, host);
+}
+
+static void _networkinterface_setBucketLoad(NetworkInterfaceTokenBucket* bucket,
+                                            guint64 loadKiBps) {
+    SimulationTime timeFactor = SIMTIME_ONE_SECOND / _networkinterface_getRefillInterval();
+    guint64 bytesLoad = MIN(loadKiBps * 1024 / timeFactor, bucket->bytesRefillConfigured);
+
+    bucket->bytesRefill = bucket->bytesRefillConfigured - bytesLoad;
+    bucket->bytesCapacity =
+        (bucket->bytesRefill * _networkinterface_getCapacityFactor()) + CONFIG_MTU;
+    bucket->bytesRemaining = MIN(bucket->bytesRemaining, bucket->bytesCapacity);
+}
+
+static void _networkinterface_applyBackgroundLoad(NetworkInterface* interface,
+                                                  NetworkInterfaceBackgroundLoad* load) {
+    /* the refills that were due before the change still use the old rates */
+    _networkinterface_refillTokenBucket(interface, &interface->sendBucket);
+    _networkinterface_refillTokenBucket(interface, &interface->receiveBucket);
+
+    _networkinterface_setBucketLoad(&interface->sendBucket, load->upKiBps);
+    _networkinterface_setBucketLoad(&interface->receiveBucket, load->downKiBps);
+
+    trace("interface %s background flows now use %" G_GUINT64_FORMAT " KiB/s up and "
+          "%" G_GUINT64_FORMAT " KiB/s down",
+          address_toString(interface->address), load->upKiBps, load->downKiBps);
+}
+
+static void _networkinterface_applyBackgroundLoadCB(Host* host, gpointer voidInterface,
+                                                    gpointer voidIndex) {
+    NetworkInterface* interface = voidInterface;
+    MAGIC_ASSERT(interface);
 
-    _networkinterface_scheduleNextRefillIfNeeded(interface, host);
+    NetworkInterfaceBackgroundLoad* load = &g_array_index(
+        interface->backgroundLoads, NetworkInterfaceBackgroundLoad, GPOINTER_TO_UINT(voidIndex));
+    _networkinterface_applyBackgroundLoad(interface, load);
+
+    /* packets waiting on the buckets may be able to go sooner or later than we planned */
+    _networkinterface_wakeupCB(host, interface, NULL);
+}
+
+void networkinterface_addBackgroundLoad(NetworkInterface* interface, SimulationTime time,
+                                        guint64 upKiBps, guint64 downKiBps) {
+    MAGIC_ASSERT(interface);
+    utility_assert(!interface->isRefilling);
+
+    if (!interface->backgroundLoads) {
+        interface->backgroundLoads =
+            g_array_new(FALSE, FALSE, sizeof(NetworkInterfaceBackgroundLoad));
+    }
+
+    NetworkInterfaceBackgroundLoad load = {
+        .time = time, .upKiBps = upKiBps, .downKiBps = downKiBps};
+    utility_assert(interface->backgroundLoads->len == 0 ||
+                   g_array_index(interface->backgroundLoads, NetworkInterfaceBackgroundLoad,
+                                 interface->backgroundLoads->len - 1)
+                           .time < time);
+    g_array_append_val(interface->backgroundLoads, load);
 }
 
 void networkinterface_startRefillingTokenBuckets(NetworkInterface* interface, Host* host) {
     MAGIC_ASSERT(interface);
 
     interface->timeStartedRefillingBuckets = worker_getCurrentTime();
-    _networkinterface_refillTokenBucketsCB(host, interface, NULL);
+    interface->isRefilling = TRUE;
+
+    /* the loads only change when background flows start or stop, so we schedule a task
+     * for each change rather than checking them as we refill */
+    for (guint i = 0; interface->backgroundLoads && i < interface->backgroundLoads->len; i++) {
+        NetworkInterfaceBackgroundLoad* load =
+            &g_array_index(interface->backgroundLoads, NetworkInterfaceBackgroundLoad, i);
+        SimulationTime now = worker_getCurrentTime();
+
+        if (load->time <= now) {
+            _networkinterface_setBucketLoad(&interface->sendBucket, load->upKiBps);
+            _networkinterface_setBucketLoad(&interface->receiveBucket, load->downKiBps);
+        } else {
+            worker_scheduleCallback(_networkinterface_applyBackgroundLoadCB, interface,
+                                    GUINT_TO_POINTER(i), NULL, NULL, host, load->time - now);
+        }
+    }
+
+    /* the first refill happens now */
+    _networkinterface_wakeupCB(host, interface, NULL);
 }
 
 static void _networkinterface_setupTokenBuckets(NetworkInterface* interface,
@@ -207,6 +337,8 @@ static void _networkinterface_setupTokenBuckets(NetworkInterface* interface,
 
     interface->receiveBucket.bytesRefill = bytesPerIntervalReceive;
     interface->sendBucket.bytesRefill = bytesPerIntervalSend;
+    interface->receiveBucket.bytesRefillConfigured = bytesPerIntervalReceive;
+    interface->sendBucket.bytesRefillConfigured = bytesPerIntervalSend;
 
     /* the CONFIG_MTU parts make sure we don't lose any partial bytes we had left
      * from last round when we do the refill. */
@@ -237,7 +369,8 @@ guint32 networkinterface_getSpeedUpKiBps(NetworkInterface* interface) {
 
     SimulationTime timeFactor =
         SIMTIME_ONE_SECOND / _networkinterface_getRefillInterval();
-    guint64 bytesPerSecond = ((guint64)interface->sendBucket.bytesRefill) * ((guint64)timeFactor);
+    guint64 bytesPerSecond =
+        ((guint64)interface->sendBucket.bytesRefillConfigured) * ((guint64)timeFactor);
     guint64 kibPerSecond = bytesPerSecond / 1024;
 
     return (guint32)kibPerSecond;
@@ -248,27 +381,23 @@ guint32 networkinterface_getSpeedDownKiBps(NetworkInterface* interface) {
 
     SimulationTime timeFactor =
         SIMTIME_ONE_SECOND / _networkinterface_getRefillInterval();
-    guint64 bytesPerSecond = ((guint64)interface->receiveBucket.bytesRefill) * ((guint64)timeFactor);
+    guint64 bytesPerSecond =
+        ((guint64)interface->receiveBucket.bytesRefillConfigured) * ((guint64)timeFactor);
     guint64 kibPerSecond = bytesPerSecond / 1024;
 
     return (guint32)kibPerSecond;
 }
 
-static gchar* _networkinterface_getAssociationKey(NetworkInterface* interface,
-        ProtocolType type, in_port_t port, in_addr_t peerAddr, in_port_t peerPort) {
+static BoundSocketKey _networkinterface_getAssociationKey(NetworkInterface* interface,
+                                                          ProtocolType type, in_port_t port,
+                                                          in_addr_t peerAddr, in_port_t peerPort) {
     MAGIC_ASSERT(interface);
-
-    GString* strBuffer = g_string_new(NULL);
-    g_string_printf(strBuffer,
-            "%s|%"G_GUINT32_FORMAT":%"G_GUINT16_FORMAT"|%"G_GUINT32_FORMAT":%"G_GUINT16_FORMAT,
-            protocol_toString(type),
-            (guint)address_toNetworkIP(interface->address),
-            port, peerAddr, peerPort);
-
-    return g_string_free(strBuffer, FALSE);
+    return boundsocketkey_new(
+        type, address_toNetworkIP(interface->address), port, peerAddr, peerPort);
 }
 
-static gchar* _networkinterface_socketToAssociationKey(NetworkInterface* interface, const CompatSocket* socket) {
+static BoundSocketKey _networkinterface_socketToAssociationKey(NetworkInterface* interface,
+                                                              const CompatSocket* socket) {
     MAGIC_ASSERT(interface);
 
     ProtocolType type = compatsocket_getProtocol(socket);
@@ -281,103 +410,158 @@ static gchar* _networkinterface_socketToAssociationKey(NetworkInterface* interfa
     in_port_t boundPort = 0;
     compatsocket_getSocketName(socket, &boundIP, &boundPort);
 
-    gchar* key = _networkinterface_getAssociationKey(interface, type, boundPort, peerIP, peerPort);
-    return key;
+    return _networkinterface_getAssociationKey(interface, type, boundPort, peerIP, peerPort);
+}
+
+static void _networkinterface_traceKey(const char* action, const BoundSocketKey* key) {
+    trace("%s socket key %s|%" G_GUINT32_FORMAT ":%" G_GUINT16_FORMAT "|%" G_GUINT32_FORMAT
+          ":%" G_GUINT16_FORMAT,
+          action, protocol_toString((ProtocolType)key->protocol), (guint)key->localIP,
+          key->localPort, (guint)key->peerIP, key->peerPort);
+}
+
+static gboolean _networkinterface_isKeyAssociated(NetworkInterface* interface,
+                                                  const BoundSocketKey* key, gboolean reusePort) {
+    if (boundsockettable_lookup(interface->boundSockets, key)) {
+        return TRUE;
+    }
+    /* another socket that sets SO_REUSEPORT may join the group */
+    return !reusePort && boundsockettable_lookup(interface->reusePortGroups, key) != NULL;
+}
+
+static PortBitmap* _networkinterface_getPortBitmap(NetworkInterface* interface,
+                                                  ProtocolType type) {
+    switch (type) {
+        case PTCP: return interface->tcpPorts;
+        case PUDP: return interface->udpPorts;
+        default: return NULL;
+    }
 }
 
 gboolean networkinterface_isAssociated(NetworkInterface* interface, ProtocolType type,
-        in_port_t port, in_addr_t peerAddr, in_port_t peerPort) {
+                                       in_port_t port, in_addr_t peerAddr, in_port_t peerPort,
+                                       gboolean reusePort) {
     MAGIC_ASSERT(interface);
 
-    gboolean isFound = FALSE;
-
     /* we need to check the general key too (ie the ones listening sockets use) */
-    gchar* general = _networkinterface_getAssociationKey(interface, type, port, 0, 0);
-    if(g_hash_table_contains(interface->boundSockets, general)) {
-        isFound = TRUE;
+    BoundSocketKey general = _networkinterface_getAssociationKey(interface, type, port, 0, 0);
+    if (_networkinterface_isKeyAssociated(interface, &general, reusePort)) {
+        return TRUE;
     }
-    g_free(general);
 
-    if(!isFound) {
-        gchar* specific = _networkinterface_getAssociationKey(interface, type, port, peerAddr, peerPort);
-        if(g_hash_table_contains(interface->boundSockets, specific)) {
-            isFound = TRUE;
-        }
-        g_free(specific);
+    BoundSocketKey specific =
+        _networkinterface_getAssociationKey(interface, type, port, peerAddr, peerPort);
+    return _networkinterface_isKeyAssociated(interface, &specific, reusePort);
+}
+
+in_port_t networkinterface_findUnusedPort(NetworkInterface* interface, ProtocolType type,
+                                          in_port_t start) {
+    MAGIC_ASSERT(interface);
+
+    PortBitmap* ports = _networkinterface_getPortBitmap(interface, type);
+    if (!ports) {
+        return 0;
     }
 
-    return isFound;
+    return htons(portbitmap_findUnused(ports, ntohs(start), MIN_RANDOM_PORT));
 }
 
 void networkinterface_associate(NetworkInterface* interface, const CompatSocket* socket) {
     MAGIC_ASSERT(interface);
 
-    gchar* key = _networkinterface_socketToAssociationKey(interface, socket);
+    BoundSocketKey key = _networkinterface_socketToAssociationKey(interface, socket);
 
     /* make sure there is no collision */
-    utility_assert(!g_hash_table_contains(interface->boundSockets, key));
+    utility_assert(!boundsockettable_lookup(interface->boundSockets, &key));
 
     /* need to store our own reference to the socket object */
     CompatSocket newSocketRef = compatsocket_refAs(socket);
+    void* taggedSocket = (void*)compatsocket_toTagged(&newSocketRef);
+
+    /* insert to our storage */
+    if (compatsocket_isReusePort(socket)) {
+        GPtrArray* group = boundsockettable_lookup(interface->reusePortGroups, &key);
+        if (!group) {
+            group = g_ptr_array_new_with_free_func(_compatsocket_unrefTaggedVoid);
+            boundsockettable_insert(interface->reusePortGroups, &key, group);
+        }
+        g_ptr_array_add(group, taggedSocket);
+    } else {
+        utility_assert(!boundsockettable_lookup(interface->reusePortGroups, &key));
+        boundsockettable_insert(interface->boundSockets, &key, taggedSocket);
+    }
 
-    /* insert to our storage, key is now owned by table */
-    g_hash_table_replace(interface->boundSockets, key, (void*)compatsocket_toTagged(&newSocketRef));
+    PortBitmap* ports = _networkinterface_getPortBitmap(interface, key.protocol);
+    if (ports) {
+        portbitmap_ref(ports, ntohs(key.localPort));
+    }
 
-    trace("associated socket key %s", key);
+    _networkinterface_traceKey("associated", &key);
 }
 
 void networkinterface_disassociate(NetworkInterface* interface, const CompatSocket* socket) {
     MAGIC_ASSERT(interface);
 
-    gchar* key = _networkinterface_socketToAssociationKey(interface, socket);
+    BoundSocketKey key = _networkinterface_socketToAssociationKey(interface, socket);
 
-    /* we will no longer receive packets for this port, this unrefs descriptor */
-    g_hash_table_remove(interface->boundSockets, key);
+    /* we will no longer receive packets for this port, this unrefs descriptor. the socket
+     * may have changed SO_REUSEPORT since it was associated, so look for it in both. */
+    gboolean wasAssociated = FALSE;
+    GPtrArray* group = boundsockettable_lookup(interface->reusePortGroups, &key);
+    if (group && g_ptr_array_remove(group, (void*)compatsocket_toTagged(socket))) {
+        if (group->len == 0) {
+            boundsockettable_remove(interface->reusePortGroups, &key);
+        }
+        wasAssociated = TRUE;
+    } else {
+        wasAssociated = boundsockettable_remove(interface->boundSockets, &key);
+    }
+
+    PortBitmap* ports = _networkinterface_getPortBitmap(interface, key.protocol);
+    if (ports && wasAssociated) {
+        portbitmap_unref(ports, ntohs(key.localPort));
+    }
 
-    trace("disassociated socket key %s", key);
-    g_free(key);
+    _networkinterface_traceKey("disassociated", &key);
 }
 
 static void _networkinterface_capturePacket(NetworkInterface* interface, Packet* packet) {
-    PCapPacket* pcapPacket = g_new0(PCapPacket, 1);
+    PCapPacket pcapPacket = {0};
 
-    pcapPacket->headerSize = packet_getHeaderSize(packet);
-    pcapPacket->payloadLength = packet_getPayloadLength(packet);
+    pcapPacket.headerSize = packet_getHeaderSize(packet);
+    pcapPacket.payloadLength = packet_getPayloadLength(packet);
 
-    if(pcapPacket->payloadLength > 0) {
-        pcapPacket->payload = g_new0(guchar, pcapPacket->payloadLength);
-        packet_copyPayloadShadow(packet, 0, pcapPacket->payload, pcapPacket->payloadLength);
+    /* only copy the part of the payload that the writer will save */
+    if (pcapPacket.payloadLength > 0 && interface->pcapPayload) {
+        pcapPacket.payload = interface->pcapPayload;
+        pcapPacket.capturedPayloadLength = packet_copyPayloadShadow(
+            packet, 0, interface->pcapPayload,
+            MIN(pcapPacket.payloadLength, interface->pcapPayloadLength));
     }
 
-    PacketTCPHeader* tcpHeader = packet_getTCPHeader(packet);
+    const PacketTCPHeader* tcpHeader = packet_getTCPHeader(packet);
 
-    pcapPacket->srcIP = tcpHeader->sourceIP;
-    pcapPacket->dstIP = tcpHeader->destinationIP;
-    pcapPacket->srcPort = tcpHeader->sourcePort;
-    pcapPacket->dstPort = tcpHeader->destinationPort;
+    pcapPacket.srcIP = tcpHeader->sourceIP;
+    pcapPacket.dstIP = tcpHeader->destinationIP;
+    pcapPacket.srcPort = tcpHeader->sourcePort;
+    pcapPacket.dstPort = tcpHeader->destinationPort;
 
-    if(tcpHeader->flags & PTCP_RST) pcapPacket->rstFlag = TRUE;
-    if(tcpHeader->flags & PTCP_SYN) pcapPacket->synFlag = TRUE;
-    if(tcpHeader->flags & PTCP_ACK) pcapPacket->ackFlag = TRUE;
-    if(tcpHeader->flags & PTCP_FIN) pcapPacket->finFlag = TRUE;
+    if(tcpHeader->flags & PTCP_RST) pcapPacket.rstFlag = TRUE;
+    if(tcpHeader->flags & PTCP_SYN) pcapPacket.synFlag = TRUE;
+    if(tcpHeader->flags & PTCP_ACK) pcapPacket.ackFlag = TRUE;
+    if(tcpHeader->flags & PTCP_FIN) pcapPacket.finFlag = TRUE;
 
-    pcapPacket->seq = (guint32)tcpHeader->sequence;
-    pcapPacket->win = (guint16)tcpHeader->window;
+    pcapPacket.seq = (guint32)tcpHeader->sequence;
+    pcapPacket.win = (guint16)tcpHeader->window;
     if(tcpHeader->flags & PTCP_ACK) {
-        pcapPacket->ack = (guint32)tcpHeader->acknowledgment;
+        pcapPacket.ack = (guint32)tcpHeader->acknowledgment;
     }
 
-    pcapwriter_writePacket(interface->pcap, pcapPacket);
-
-    if(pcapPacket->payloadLength > 0) {
-        g_free(pcapPacket->payload);
-    }
-
-    g_free(pcapPacket);
+    pcapwriter_writePacket(interface->pcap, &pcapPacket);
 }
 
-static CompatSocket _boundsockets_lookup(GHashTable* table, gchar* key) {
-    void* ptr = g_hash_table_lookup(table, key);
+static CompatSocket _boundsockets_lookup(BoundSocketTable* table, const BoundSocketKey* key) {
+    void* ptr = boundsockettable_lookup(table, key);
 
     if (ptr == NULL) {
         CompatSocket compatSocket = {0};
@@ -388,6 +572,44 @@ static CompatSocket _boundsockets_lookup(GHashTable* table, gchar* key) {
     return compatsocket_fromTagged((uintptr_t)ptr);
 }
 
+/* Returns the socket of the SO_REUSEPORT group that receives the packets of flow. Flows
+ * are spread over the group by a hash of their addresses, so a flow keeps going to the
+ * same socket while the group doesn't change. A TCP listener receives the packets of
+ * the connections it accepted, so those stay with it even if the group has changed. */
+static CompatSocket _networkinterface_selectReusePortSocket(GPtrArray* group,
+                                                            const BoundSocketKey* flow) {
+    utility_assert(group->len > 0);
+
+    guint64 hash = boundsocketkey_hash(flow) & G_MAXUINT32;
+    guint index = (guint)((hash * group->len) >> 32);
+    CompatSocket socket = compatsocket_fromTagged((uintptr_t)g_ptr_array_index(group, index));
+
+    if (flow->protocol == PTCP && group->len > 1 &&
+        !compatsocket_hasChild(&socket, flow->peerIP, flow->peerPort)) {
+        for (guint i = 0; i < group->len; i++) {
+            CompatSocket other = compatsocket_fromTagged((uintptr_t)g_ptr_array_index(group, i));
+            if (compatsocket_hasChild(&other, flow->peerIP, flow->peerPort)) {
+                return other;
+            }
+        }
+    }
+
+    return socket;
+}
+
+static CompatSocket _networkinterface_lookupSocket(NetworkInterface* interface,
+                                                   const BoundSocketKey* key,
+                                                   const BoundSocketKey* flow) {
+    CompatSocket socket = _boundsockets_lookup(interface->boundSockets, key);
+    if (socket.type == CST_NONE) {
+        GPtrArray* group = boundsockettable_lookup(interface->reusePortGroups, key);
+        if (group) {
+            socket = _networkinterface_selectReusePortSocket(group, flow);
+        }
+    }
+    return socket;
+}
+
 static void _networkinterface_receivePacket(Host* host, NetworkInterface* interface,
                                             Packet* packet) {
     MAGIC_ASSERT(interface);
@@ -402,22 +624,18 @@ static void _networkinterface_receivePacket(Host* host, NetworkInterface* interf
     ProtocolType ptype = packet_getProtocol(packet);
     in_port_t bindPort = packet_getDestinationPort(packet);
 
-    /* the first check is for servers who don't associate with specific destinations */
-    gchar* key = _networkinterface_getAssociationKey(interface, ptype, bindPort, 0, 0);
-    trace("looking for socket associated with general key %s", key);
+    in_addr_t peerIP = packet_getSourceIP(packet);
+    in_port_t peerPort = packet_getSourcePort(packet);
+    BoundSocketKey flow =
+        _networkinterface_getAssociationKey(interface, ptype, bindPort, peerIP, peerPort);
 
-    CompatSocket socket = _boundsockets_lookup(interface->boundSockets, key);
-    g_free(key);
+    /* the first check is for servers who don't associate with specific destinations */
+    BoundSocketKey key = _networkinterface_getAssociationKey(interface, ptype, bindPort, 0, 0);
+    CompatSocket socket = _networkinterface_lookupSocket(interface, &key, &flow);
 
     if (socket.type == CST_NONE) {
         /* now check the destination-specific key */
-        in_addr_t peerIP = packet_getSourceIP(packet);
-        in_port_t peerPort = packet_getSourcePort(packet);
-
-        key = _networkinterface_getAssociationKey(interface, ptype, bindPort, peerIP, peerPort);
-        trace("looking for socket associated with specific key %s", key);
-        socket = _boundsockets_lookup(interface->boundSockets, key);
-        g_free(key);
+        socket = _networkinterface_lookupSocket(interface, &flow, &flow);
     }
 
     /* if the socket closed, just drop the packet */
@@ -442,7 +660,27 @@ static void _networkinterface_receivePacket(Host* host, NetworkInterface* interf
 
 static void _networkinterface_receivePacketTask(Host* host, gpointer voidInterface,
                                                 gpointer voidPacket) {
-    _networkinterface_receivePacket(host, voidInterface, voidPacket);
+    Packet* packet = voidPacket;
+
+    /* loopback doesn't consume bandwidth, so all segments are received now. They
+     * may also be a batch of the packets that a socket sent at once. */
+    GQueue segments = G_QUEUE_INIT;
+    packet_stealSegments(packet, &segments);
+
+    if (_receiveBatching) {
+        descriptor_beginStatusBatch();
+    }
+
+    _networkinterface_receivePacket(host, voidInterface, packet);
+
+    while ((packet = g_queue_pop_head(&segments)) != NULL) {
+        _networkinterface_receivePacket(host, voidInterface, packet);
+        packet_unref(packet);
+    }
+
+    if (_receiveBatching) {
+        descriptor_endStatusBatch();
+    }
 }
 
 void networkinterface_receivePackets(NetworkInterface* interface, Host* host) {
@@ -458,13 +696,28 @@ void networkinterface_receivePackets(NetworkInterface* interface, Host* host) {
     /* get the bootstrapping mode */
     gboolean bootstrapping = worker_isBootstrapActive();
 
+    _networkinterface_refillTokenBucket(interface, &interface->receiveBucket);
+
+    /* the sockets hear about their status changes once the pass is done */
+    if (_receiveBatching) {
+        descriptor_beginStatusBatch();
+    }
+
     while(bootstrapping || interface->receiveBucket.bytesRemaining >= CONFIG_MTU) {
-        /* we are now the owner of the packet reference from the router */
-        Packet* packet = router_dequeue(interface->router);
+        /* we are now the owner of the packet reference from the router, or of
+         * the segment reference left over from a previous super-packet */
+        Packet* packet = g_queue_pop_head(&interface->receiveSegments);
+        if(!packet) {
+            packet = router_dequeue(interface->router);
+        }
         if(!packet) {
             break;
         }
 
+        /* split super-packets so that each segment is charged to the token
+         * bucket and handed to the socket on its own */
+        packet_stealSegments(packet, &interface->receiveSegments);
+
         guint64 length = (guint64)(packet_getPayloadLength(packet) + packet_getHeaderSize(packet));
 
         _networkinterface_receivePacket(host, interface, packet);
@@ -476,9 +729,18 @@ void networkinterface_receivePackets(NetworkInterface* interface, Host* host) {
         if(!bootstrapping) {
             _networkinterface_consumeTokenBucket(&interface->receiveBucket,
                                                  length);
-            _networkinterface_scheduleNextRefillIfNeeded(interface, host);
         }
     }
+
+    if (_receiveBatching) {
+        descriptor_endStatusBatch();
+    }
+
+    /* if packets are still waiting, continue when the bucket allows it */
+    if(interface->receiveBucket.bytesRemaining < CONFIG_MTU && interface->isRefilling &&
+       (!g_queue_is_empty(&interface->receiveSegments) || router_peek(interface->router))) {
+        _networkinterface_scheduleWakeup(interface, host, &interface->receiveBucket);
+    }
 }
 
 static void _networkinterface_updatePacketHeader(Host* host, const CompatSocket* socket,
@@ -494,6 +756,44 @@ static void _networkinterface_updatePacketHeader(Host* host, const CompatSocket*
     }
 }
 
+/* With segmentation offload, the packets that a TCP socket has queued behind a
+ * data packet leave the interface with it as a single super-packet. Each
+ * segment is still charged to the send token bucket, so we only append one if
+ * it could have been sent on its own right after the previous one. */
+static void _networkinterface_appendSegments(NetworkInterface* interface, Host* host,
+                                             const CompatSocket* socket, Packet* packet) {
+    if (!interface->segmentationOffload || socket->type != CST_LEGACY_SOCKET ||
+        descriptor_getType((LegacyDescriptor*)socket->object.as_legacy_socket) !=
+            DT_TCPSOCKET ||
+        packet_getPayloadLength(packet) == 0) {
+        return;
+    }
+
+    gboolean bootstrapping = worker_isBootstrapActive();
+    guint64 totalSize = packet_getTotalSize(packet);
+    guint totalPayload = packet_getPayloadLength(packet);
+
+    while (bootstrapping || interface->sendBucket.bytesRemaining >= totalSize + CONFIG_MTU) {
+        Packet* next = (Packet*)compatsocket_peekNextOutPacket(socket);
+        if (!next || packet_getPayloadLength(next) == 0 ||
+            totalPayload + packet_getPayloadLength(next) >
+                NETWORKINTERFACE_MAX_SUPER_PACKET_PAYLOAD ||
+            packet_getDestinationIP(next) != packet_getDestinationIP(packet)) {
+            break;
+        }
+
+        next = compatsocket_pullOutPacket(socket, host);
+        _networkinterface_updatePacketHeader(host, socket, next);
+        packet_appendSegment(packet, next);
+
+        totalSize += packet_getPayloadLength(next) + packet_getHeaderSize(next);
+        totalPayload += packet_getPayloadLength(next);
+
+        /* the super-packet holds the ref now */
+        packet_unref(next);
+    }
+}
+
 /* round robin queuing discipline ($ man tc)*/
 static Packet* _networkinterface_selectRoundRobin(NetworkInterface* interface, Host* host,
                                                   gint* socketHandle) {
@@ -516,6 +816,7 @@ static Packet* _networkinterface_selectRoundRobin(NetworkInterface* interface, H
 
         if (packet) {
             _networkinterface_updatePacketHeader(host, &socket, packet);
+            _networkinterface_appendSegments(interface, host, &socket, packet);
         }
 
         if (compatsocket_peekNextOutPacket(&socket)) {
@@ -554,6 +855,7 @@ static Packet* _networkinterface_selectFirstInFirstOut(NetworkInterface* interfa
 
         if (packet) {
             _networkinterface_updatePacketHeader(host, &socket, packet);
+            _networkinterface_appendSegments(interface, host, &socket, packet);
         }
 
         if (compatsocket_peekNextOutPacket(&socket)) {
@@ -573,6 +875,8 @@ static void _networkinterface_sendPackets(NetworkInterface* interface, Host* src
 
     gboolean bootstrapping = worker_isBootstrapActive();
 
+    _networkinterface_refillTokenBucket(interface, &interface->sendBucket);
+
     /* loop until we find a socket that has something to send */
     while(interface->sendBucket.bytesRemaining >= CONFIG_MTU) {
         gint socketHandle = -1;
@@ -594,17 +898,18 @@ static void _networkinterface_sendPackets(NetworkInterface* interface, Host* src
             break;
         }
 
-        packet_addDeliveryStatus(packet, PDS_SND_INTERFACE_SENT);
+        guint nSegments = packet_getNumSegments(packet);
+        for(guint i = 0; i < nSegments; i++) {
+            packet_addDeliveryStatus(packet_getSegment(packet, i), PDS_SND_INTERFACE_SENT);
+        }
 
         /* now actually send the packet somewhere */
         if(address_toNetworkIP(interface->address) == packet_getDestinationIP(packet)) {
             /* packet will arrive on our own interface, so it doesn't need to
              * go through the upstream router and does not consume bandwidth. */
             packet_ref(packet);
-            Task* packetTask = task_new(_networkinterface_receivePacketTask, interface, packet,
-                                        NULL, packet_unrefTaskFreeFunc);
-            worker_scheduleTask(packetTask, src, 1);
-            task_unref(packetTask);
+            worker_scheduleCallback(_networkinterface_receivePacketTask, interface, packet, NULL,
+                                    packet_unrefTaskFreeFunc, src, 1);
         } else {
             /* let the upstream router send to remote with appropriate delays.
              * if we get here we are not loopback and should have been assigned a router. */
@@ -614,20 +919,69 @@ static void _networkinterface_sendPackets(NetworkInterface* interface, Host* src
 
         /* successfully sent, calculate how long it took to 'send' this packet */
         if(!bootstrapping) {
-            guint length = packet_getPayloadLength(packet) + packet_getHeaderSize(packet);
+            guint64 length = packet_getTotalSize(packet);
             _networkinterface_consumeTokenBucket(&interface->sendBucket,
                                                  length);
-            _networkinterface_scheduleNextRefillIfNeeded(interface, src);
         }
 
-        tracker_addOutputBytes(host_getTracker(src), packet, socketHandle);
-        if(interface->pcap) {
-            _networkinterface_capturePacket(interface, packet);
+        for(guint i = 0; i < nSegments; i++) {
+            Packet* segment = packet_getSegment(packet, i);
+            tracker_addOutputBytes(host_getTracker(src), segment, socketHandle);
+            if(interface->pcap) {
+                _networkinterface_capturePacket(interface, segment);
+            }
         }
 
         /* sending side is done with its ref */
         packet_unref(packet);
     }
+
+    /* if sockets are still waiting to send, continue when the bucket allows it */
+    gboolean isSocketWaiting = interface->qdisc == Q_DISC_MODE_ROUND_ROBIN
+                                   ? !rrsocketqueue_isEmpty(&interface->rrQueue)
+                                   : !fifosocketqueue_isEmpty(&interface->fifoQueue);
+    if(interface->sendBucket.bytesRemaining < CONFIG_MTU && interface->isRefilling &&
+       isSocketWaiting) {
+        _networkinterface_scheduleWakeup(interface, src, &interface->sendBucket);
+    }
+}
+
+/* The loopback interface has no router and unlimited bandwidth, so the queuing
+ * discipline and token buckets would send the socket's packets right away anyway.
+ * We skip them and hand all of the packets to a single receive task. */
+static void _networkinterface_sendLoopbackPackets(NetworkInterface* interface, Host* host,
+                                                  const CompatSocket* socket) {
+    gint socketHandle = -1;
+    if (socket->type == CST_LEGACY_SOCKET) {
+        socketHandle =
+            *descriptor_getHandleReference((LegacyDescriptor*)socket->object.as_legacy_socket);
+    }
+
+    /* the packets after the first are received as its segments */
+    Packet* batch = NULL;
+    Packet* packet;
+    while ((packet = compatsocket_pullOutPacket(socket, host)) != NULL) {
+        _networkinterface_updatePacketHeader(host, socket, packet);
+        packet_addDeliveryStatus(packet, PDS_SND_INTERFACE_SENT);
+
+        tracker_addOutputBytes(host_getTracker(host), packet, socketHandle);
+        if (interface->pcap) {
+            _networkinterface_capturePacket(interface, packet);
+        }
+
+        if (batch) {
+            packet_appendSegment(batch, packet);
+            packet_unref(packet);
+        } else {
+            batch = packet;
+        }
+    }
+
+    if (batch) {
+        /* the event takes over our ref */
+        worker_scheduleCallback(_networkinterface_receivePacketTask, interface, batch, NULL,
+                                packet_unrefTaskFreeFunc, host, 1);
+    }
 }
 
 void networkinterface_wantsSend(NetworkInterface* interface, Host* host,
@@ -639,6 +993,11 @@ void networkinterface_wantsSend(NetworkInterface* interface, Host* host,
         return;
     }
 
+    if (interface->isLoopback) {
+        _networkinterface_sendLoopbackPackets(interface, host, socket);
+        return;
+    }
+
     /* track the new socket for sending if not already tracking */
     switch (interface->qdisc) {
         case Q_DISC_MODE_ROUND_ROBIN: {
@@ -679,17 +1038,21 @@ Router* networkinterface_getRouter(NetworkInterface* interface) {
 }
 
 NetworkInterface* networkinterface_new(Host* host, Address* address, guint64 bwDownKiBps,
-                                       guint64 bwUpKiBps, gchar* pcapDir, QDiscMode qdisc,
+                                       guint64 bwUpKiBps, gchar* pcapDir, guint32 pcapCaptureSize,
+                                       QDiscMode qdisc, gboolean segmentationOffload,
                                        guint64 interfaceReceiveLength) {
     NetworkInterface* interface = g_new0(NetworkInterface, 1);
     MAGIC_INIT(interface);
 
     interface->address = address;
     address_ref(interface->address);
+    interface->isLoopback = address_toNetworkIP(address) == htonl(INADDR_LOOPBACK);
 
     /* incoming packets get passed along to sockets */
-    interface->boundSockets =
-        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _compatsocket_unrefTaggedVoid);
+    interface->boundSockets = boundsockettable_new(_compatsocket_unrefTaggedVoid);
+    interface->reusePortGroups = boundsockettable_new((GDestroyNotify)g_ptr_array_unref);
+    interface->tcpPorts = portbitmap_new();
+    interface->udpPorts = portbitmap_new();
 
     /* sockets tell us when they want to start sending */
     rrsocketqueue_init(&interface->rrQueue);
@@ -697,14 +1060,21 @@ NetworkInterface* networkinterface_new(Host* host, Address* address, guint64 bwD
 
     /* parse queuing discipline */
     interface->qdisc = qdisc;
+    interface->segmentationOffload = segmentationOffload;
+    g_queue_init(&interface->receiveSegments);
 
     if(pcapDir != NULL) {
         GString* filename = g_string_new(NULL);
         g_string_printf(filename, "%s-%s",
                 address_toHostName(interface->address),
                 address_toHostIPString(interface->address));
-        interface->pcap = pcapwriter_new(host, pcapDir, filename->str);
+        interface->pcap = pcapwriter_new(host, pcapDir, filename->str, pcapCaptureSize);
         g_string_free(filename, TRUE);
+
+        interface->pcapPayloadLength = pcapwriter_getMaxPayloadLength(interface->pcap);
+        if (interface->pcapPayloadLength > 0) {
+            interface->pcapPayload = g_malloc(interface->pcapPayloadLength);
+        }
     }
 
     /* set size and refill rates for token buckets */
@@ -726,7 +1096,15 @@ void networkinterface_free(NetworkInterface* interface) {
     rrsocketqueue_destroy(&interface->rrQueue, compatsocket_unref);
     fifosocketqueue_destroy(&interface->fifoQueue, compatsocket_unref);
 
-    g_hash_table_destroy(interface->boundSockets);
+    Packet* segment = NULL;
+    while ((segment = g_queue_pop_head(&interface->receiveSegments)) != NULL) {
+        packet_unref(segment);
+    }
+
+    boundsockettable_free(interface->boundSockets);
+    boundsockettable_free(interface->reusePortGroups);
+    portbitmap_free(interface->tcpPorts);
+    portbitmap_free(interface->udpPorts);
 
     if(interface->router) {
         router_unref(interface->router);
@@ -738,6 +1116,11 @@ void networkinterface_free(NetworkInterface* interface) {
     if(interface->pcap) {
         pcapwriter_free(interface->pcap);
     }
+    g_free(interface->pcapPayload);
+
+    if (interface->backgroundLoads) {
+        g_array_free(interface->backgroundLoads, TRUE);
+    }
 
     MAGIC_CLEAR(interface);
     g_free(interface);
@@ -745,3 +1128,8 @@ void networkinterface_free(NetworkInterface* interface) {
     worker_count_deallocation(NetworkInterface);
 }
 
+void networkinterface_flush(NetworkInterface* interface) {
+    MAGIC_ASSERT(interface);
+    pcapwriter_flush(interface->pcap);
+}
+
@@ -20,16 +20,28 @@
 typedef struct _NetworkInterface NetworkInterface;
 
 NetworkInterface* networkinterface_new(Host* host, Address* address, guint64 bwDownKiBps,
-                                       guint64 bwUpKiBps, gchar* pcapDir, QDiscMode qdisc,
+                                       guint64 bwUpKiBps, gchar* pcapDir, guint32 pcapCaptureSize,
+                                       QDiscMode qdisc, gboolean segmentationOffload,
                                        guint64 interfaceReceiveLength);
 void networkinterface_free(NetworkInterface* interface);
+/* Writes out any buffered output, for when the interface won't be freed. */
+void networkinterface_flush(NetworkInterface* interface);
 
 Address* networkinterface_getAddress(NetworkInterface* interface);
 guint32 networkinterface_getSpeedUpKiBps(NetworkInterface* interface);
 guint32 networkinterface_getSpeedDownKiBps(NetworkInterface* interface);
 
+/* Returns TRUE if a socket is bound to the port for the peer. If reusePort is TRUE,
+ * ports that are only shared by sockets that set SO_REUSEPORT don't count. */
 gboolean networkinterface_isAssociated(NetworkInterface* interface, ProtocolType type,
-        in_port_t port, in_addr_t peerAddr, in_port_t peerPort);
+                                       in_port_t port, in_addr_t peerAddr, in_port_t peerPort,
+                                       gboolean reusePort);
+
+/* Returns the first port at or after start (wrapping around to MIN_RANDOM_PORT) that
+ * no socket of the protocol is bound to, or 0 if there's none. Ports are in network
+ * order. Only the ports of PTCP and PUDP are tracked, so other protocols get 0. */
+in_port_t networkinterface_findUnusedPort(NetworkInterface* interface, ProtocolType type,
+                                          in_port_t start);
 
 void networkinterface_associate(NetworkInterface* interface, const CompatSocket* socket);
 void networkinterface_disassociate(NetworkInterface* interface, const CompatSocket* socket);
@@ -38,6 +50,11 @@ void networkinterface_wantsSend(NetworkInterface* interface, Host* host,
                                 const CompatSocket* socket);
 void networkinterface_sent(NetworkInterface* interface);
 
+/* From the given time, background flows take the given bandwidth from the interface's
+ * token buckets, until a later load is applied. Loads must be added in the order of
+ * their times, before the buckets start refilling. */
+void networkinterface_addBackgroundLoad(NetworkInterface* interface, SimulationTime time,
+                                        guint64 upKiBps, guint64 downKiBps);
 void networkinterface_startRefillingTokenBuckets(NetworkInterface* interface, Host* host);
 
 void networkinterface_setRouter(NetworkInterface* interface, Router* router);
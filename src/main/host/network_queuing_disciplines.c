@@ -7,70 +7,116 @@
 
 #include <glib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "main/host/descriptor/compat_socket.h"
 #include "main/routing/packet.h"
-#include "main/utility/priority_queue.h"
 #include "main/utility/utility.h"
 
+#define FIFOSOCKETQUEUE_MIN_CAPACITY 16
+
+/* returns the link that tracks the socket in queue, or NULL if it's not in the queue */
+static SocketQueueLink* _socketqueue_getLink(const void* queue, const CompatSocket* socket) {
+    SocketQueueLink* links = compatsocket_getQueueLinks(socket);
+    for (int i = 0; i < SOCKET_MAX_QUEUE_LINKS; i++) {
+        if (links[i].queue == queue) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+static SocketQueueLink* _socketqueue_addLink(const void* queue, const CompatSocket* socket) {
+    utility_assert(_socketqueue_getLink(queue, socket) == NULL);
+
+    SocketQueueLink* link = _socketqueue_getLink(NULL, socket);
+    if (link == NULL) {
+        utility_panic("Socket is already in %d queues", SOCKET_MAX_QUEUE_LINKS);
+    }
+
+    link->queue = queue;
+    return link;
+}
+
+static void _socketqueue_removeLink(SocketQueueLink* link) {
+    memset(link, 0, sizeof(SocketQueueLink));
+}
+
 void rrsocketqueue_init(RrSocketQueue* self) {
     utility_assert(self != NULL);
-    utility_assert(self->queue == NULL);
-    self->queue = g_queue_new();
+    self->head = 0;
+    self->tail = 0;
 }
 
 void rrsocketqueue_destroy(RrSocketQueue* self, void (*fn_processItem)(const CompatSocket*)) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
 
-    if (fn_processItem != NULL) {
-        while (!rrsocketqueue_isEmpty(self)) {
-            CompatSocket socket = {0};
-            bool found = rrsocketqueue_pop(self, &socket);
+    /* the sockets need to be unlinked even if there is nothing to process */
+    while (!rrsocketqueue_isEmpty(self)) {
+        CompatSocket socket = {0};
+        bool found = rrsocketqueue_pop(self, &socket);
 
-            utility_assert(found);
-            if (!found) {
-                continue;
-            }
+        utility_assert(found);
+        if (!found) {
+            continue;
+        }
 
+        if (fn_processItem != NULL) {
             fn_processItem(&socket);
         }
     }
-
-    g_queue_free(self->queue);
-    self->queue = NULL;
 }
 
 bool rrsocketqueue_isEmpty(RrSocketQueue* self) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
-    return g_queue_is_empty(self->queue);
+    return self->head == 0;
 }
 
 bool rrsocketqueue_pop(RrSocketQueue* self, CompatSocket* socket) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
 
-    uintptr_t taggedSocket = (uintptr_t)g_queue_pop_head(self->queue);
-    if (taggedSocket == 0) {
+    if (self->head == 0) {
         return false;
     }
 
-    *socket = compatsocket_fromTagged(taggedSocket);
+    *socket = compatsocket_fromTagged(self->head);
+
+    SocketQueueLink* link = _socketqueue_getLink(self, socket);
+    utility_assert(link != NULL);
+
+    self->head = link->next;
+    if (self->head == 0) {
+        self->tail = 0;
+    }
+
+    _socketqueue_removeLink(link);
     return true;
 }
 
 void rrsocketqueue_push(RrSocketQueue* self, const CompatSocket* socket) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
     utility_assert(socket->type != CST_NONE);
-    g_queue_push_tail(self->queue, (void*)compatsocket_toTagged(socket));
+
+    SocketQueueLink* link = _socketqueue_addLink(self, socket);
+    link->next = 0;
+
+    uintptr_t taggedSocket = compatsocket_toTagged(socket);
+
+    if (self->tail != 0) {
+        CompatSocket tail = compatsocket_fromTagged(self->tail);
+        SocketQueueLink* tailLink = _socketqueue_getLink(self, &tail);
+        utility_assert(tailLink != NULL);
+        tailLink->next = taggedSocket;
+    } else {
+        self->head = taggedSocket;
+    }
+
+    self->tail = taggedSocket;
 }
 
 bool rrsocketqueue_find(RrSocketQueue* self, const CompatSocket* socket) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
-    return g_queue_find(self->queue, (void*)compatsocket_toTagged(socket));
+    return _socketqueue_getLink(self, socket) != NULL;
 }
 
 static gint _compareSocket(const CompatSocket* sa, const CompatSocket* sb) {
@@ -91,69 +137,128 @@ static gint _compareSocket(const CompatSocket* sa, const CompatSocket* sb) {
     return packet_getPriority(pa) > packet_getPriority(pb) ? +1 : -1;
 }
 
-static gint _compareSocketTagged(uintptr_t sa_tagged, uintptr_t sb_tagged, gpointer userData) {
-    CompatSocket sa = compatsocket_fromTagged(sa_tagged);
-    CompatSocket sb = compatsocket_fromTagged(sb_tagged);
+static gboolean _fifosocketqueue_isSmaller(FifoSocketQueue* self, guint i, guint j) {
+    CompatSocket sa = compatsocket_fromTagged(self->heap[i]);
+    CompatSocket sb = compatsocket_fromTagged(self->heap[j]);
+    return _compareSocket(&sa, &sb) < 0;
+}
+
+/* stores the socket at index i of the heap, and remembers that index in its link */
+static void _fifosocketqueue_set(FifoSocketQueue* self, guint i, uintptr_t taggedSocket) {
+    self->heap[i] = taggedSocket;
 
-    return _compareSocket(&sa, &sb);
+    CompatSocket socket = compatsocket_fromTagged(taggedSocket);
+    SocketQueueLink* link = _socketqueue_getLink(self, &socket);
+    utility_assert(link != NULL);
+    link->index = i;
+}
+
+static void _fifosocketqueue_swap(FifoSocketQueue* self, guint i, guint j) {
+    uintptr_t si = self->heap[i];
+    _fifosocketqueue_set(self, i, self->heap[j]);
+    _fifosocketqueue_set(self, j, si);
+}
+
+static void _fifosocketqueue_heapifyUp(FifoSocketQueue* self, guint index) {
+    while ((index > 0) && _fifosocketqueue_isSmaller(self, index, (index - 1) / 2)) {
+        _fifosocketqueue_swap(self, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
+
+static void _fifosocketqueue_heapifyDown(FifoSocketQueue* self, guint index) {
+    guint child;
+    while ((child = 2 * index + 1) < self->length) {
+        if ((child + 1 < self->length) && _fifosocketqueue_isSmaller(self, child + 1, child)) {
+            child = child + 1;
+        }
+        if (_fifosocketqueue_isSmaller(self, child, index)) {
+            _fifosocketqueue_swap(self, index, child);
+            index = child;
+        } else {
+            break;
+        }
+    }
 }
 
 void fifosocketqueue_init(FifoSocketQueue* self) {
     utility_assert(self != NULL);
-    utility_assert(self->queue == NULL);
-    self->queue = priorityqueue_new((GCompareDataFunc)_compareSocketTagged, NULL, NULL);
+    utility_assert(self->heap == NULL);
+    self->heap = g_new(uintptr_t, FIFOSOCKETQUEUE_MIN_CAPACITY);
+    self->length = 0;
+    self->capacity = FIFOSOCKETQUEUE_MIN_CAPACITY;
 }
 
 void fifosocketqueue_destroy(FifoSocketQueue* self, void (*fn_processItem)(const CompatSocket*)) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
+    utility_assert(self->heap != NULL);
 
-    if (fn_processItem != NULL) {
-        while (!fifosocketqueue_isEmpty(self)) {
-            CompatSocket socket = {0};
-            bool found = fifosocketqueue_pop(self, &socket);
+    /* the sockets need to be unlinked even if there is nothing to process */
+    while (!fifosocketqueue_isEmpty(self)) {
+        CompatSocket socket = {0};
+        bool found = fifosocketqueue_pop(self, &socket);
 
-            utility_assert(found);
-            if (!found) {
-                continue;
-            }
+        utility_assert(found);
+        if (!found) {
+            continue;
+        }
 
+        if (fn_processItem != NULL) {
             fn_processItem(&socket);
         }
     }
 
-    priorityqueue_free(self->queue);
-    self->queue = NULL;
+    g_free(self->heap);
+    self->heap = NULL;
+    self->capacity = 0;
 }
 
 bool fifosocketqueue_isEmpty(FifoSocketQueue* self) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
-    return priorityqueue_isEmpty(self->queue);
+    utility_assert(self->heap != NULL);
+    return self->length == 0;
 }
 
 bool fifosocketqueue_pop(FifoSocketQueue* self, CompatSocket* socket) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
+    utility_assert(self->heap != NULL);
 
-    uintptr_t taggedSocket = (uintptr_t)priorityqueue_pop(self->queue);
-    if (taggedSocket == 0) {
+    if (self->length == 0) {
         return false;
     }
 
-    *socket = compatsocket_fromTagged(taggedSocket);
+    *socket = compatsocket_fromTagged(self->heap[0]);
+
+    _fifosocketqueue_swap(self, 0, self->length - 1);
+    self->length--;
+
+    SocketQueueLink* link = _socketqueue_getLink(self, socket);
+    utility_assert(link != NULL);
+    _socketqueue_removeLink(link);
+
+    _fifosocketqueue_heapifyDown(self, 0);
     return true;
 }
 
 void fifosocketqueue_push(FifoSocketQueue* self, const CompatSocket* socket) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
+    utility_assert(self->heap != NULL);
     utility_assert(socket->type != CST_NONE);
-    priorityqueue_push(self->queue, (void*)compatsocket_toTagged(socket));
+
+    if (self->length == self->capacity) {
+        self->capacity *= 2;
+        self->heap = g_renew(uintptr_t, self->heap, self->capacity);
+    }
+
+    _socketqueue_addLink(self, socket);
+
+    guint index = self->length++;
+    _fifosocketqueue_set(self, index, compatsocket_toTagged(socket));
+    _fifosocketqueue_heapifyUp(self, index);
 }
 
 bool fifosocketqueue_find(FifoSocketQueue* self, const CompatSocket* socket) {
     utility_assert(self != NULL);
-    utility_assert(self->queue != NULL);
-    return priorityqueue_find(self->queue, (void*)compatsocket_toTagged(socket));
+    utility_assert(self->heap != NULL);
+    return _socketqueue_getLink(self, socket) != NULL;
 }
@@ -10,18 +10,26 @@
 #include <stdbool.h>
 
 #include "main/host/descriptor/compat_socket.h"
-#include "main/utility/priority_queue.h"
+
+/* The socket queues link the sockets through their SocketQueueLinks, so a socket can
+ * be in at most SOCKET_MAX_QUEUE_LINKS queues at once and at most once per queue. */
 
 /* A round-robin socket queue. */
 typedef struct _RrSocketQueue RrSocketQueue;
 struct _RrSocketQueue {
-    GQueue* queue;
+    /* tagged CompatSockets, or 0 if the queue is empty */
+    uintptr_t head;
+    uintptr_t tail;
 };
 
 /* A first-in-first-out socket queue. */
 typedef struct _FifoSocketQueue FifoSocketQueue;
 struct _FifoSocketQueue {
-    PriorityQueue* queue;
+    /* a binary min-heap of tagged CompatSockets, ordered by the priority of their next
+     * packet */
+    uintptr_t* heap;
+    guint length;
+    guint capacity;
 };
 
 void rrsocketqueue_init(RrSocketQueue* self);
@@ -0,0 +1,153 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/host/port_bitmap.h"
+
+#include "main/core/support/definitions.h"
+#include "main/utility/utility.h"
+
+/* the ports are split into chunks, whose bits are only allocated while one of
+ * their ports is in use */
+#define PORT_BITMAP_CHUNK_BITS 1024
+#define PORT_BITMAP_NUM_CHUNKS ((G_MAXUINT16 + 1) / PORT_BITMAP_CHUNK_BITS)
+#define PORT_BITMAP_CHUNK_WORDS (PORT_BITMAP_CHUNK_BITS / 64)
+
+struct _PortBitmap {
+    guint64* chunks[PORT_BITMAP_NUM_CHUNKS];
+    /* the number of used ports in each chunk */
+    guint16 numUsed[PORT_BITMAP_NUM_CHUNKS];
+    /* a bit for each chunk whose ports are all used, so searches can skip it */
+    guint64 fullChunks;
+    /* port to the number of sockets bound to it beyond the first, for the few
+     * ports that have more than one. NULL until there is one. */
+    GHashTable* extraRefs;
+    MAGIC_DECLARE;
+};
+
+G_STATIC_ASSERT(PORT_BITMAP_NUM_CHUNKS == 64);
+
+PortBitmap* portbitmap_new() {
+    PortBitmap* bitmap = g_new0(PortBitmap, 1);
+    MAGIC_INIT(bitmap);
+    return bitmap;
+}
+
+void portbitmap_free(PortBitmap* bitmap) {
+    MAGIC_ASSERT(bitmap);
+
+    for (guint c = 0; c < PORT_BITMAP_NUM_CHUNKS; c++) {
+        g_free(bitmap->chunks[c]);
+    }
+    if (bitmap->extraRefs) {
+        g_hash_table_destroy(bitmap->extraRefs);
+    }
+
+    MAGIC_CLEAR(bitmap);
+    g_free(bitmap);
+}
+
+gboolean portbitmap_isUsed(PortBitmap* bitmap, guint16 port) {
+    MAGIC_ASSERT(bitmap);
+    guint64* chunk = bitmap->chunks[port / PORT_BITMAP_CHUNK_BITS];
+    guint bit = port % PORT_BITMAP_CHUNK_BITS;
+    return chunk && (chunk[bit / 64] & (1ULL << (bit % 64)));
+}
+
+void portbitmap_ref(PortBitmap* bitmap, guint16 port) {
+    MAGIC_ASSERT(bitmap);
+
+    if (portbitmap_isUsed(bitmap, port)) {
+        if (!bitmap->extraRefs) {
+            bitmap->extraRefs = g_hash_table_new(g_direct_hash, g_direct_equal);
+        }
+        gpointer key = GUINT_TO_POINTER(port);
+        guint numExtra = GPOINTER_TO_UINT(g_hash_table_lookup(bitmap->extraRefs, key));
+        g_hash_table_insert(bitmap->extraRefs, key, GUINT_TO_POINTER(numExtra + 1));
+        return;
+    }
+
+    guint c = port / PORT_BITMAP_CHUNK_BITS;
+    guint bit = port % PORT_BITMAP_CHUNK_BITS;
+    if (!bitmap->chunks[c]) {
+        bitmap->chunks[c] = g_new0(guint64, PORT_BITMAP_CHUNK_WORDS);
+    }
+    bitmap->chunks[c][bit / 64] |= 1ULL << (bit % 64);
+
+    if (++bitmap->numUsed[c] == PORT_BITMAP_CHUNK_BITS) {
+        bitmap->fullChunks |= 1ULL << c;
+    }
+}
+
+void portbitmap_unref(PortBitmap* bitmap, guint16 port) {
+    MAGIC_ASSERT(bitmap);
+    utility_assert(portbitmap_isUsed(bitmap, port));
+
+    if (bitmap->extraRefs) {
+        gpointer key = GUINT_TO_POINTER(port);
+        guint numExtra = GPOINTER_TO_UINT(g_hash_table_lookup(bitmap->extraRefs, key));
+        if (numExtra > 1) {
+            g_hash_table_insert(bitmap->extraRefs, key, GUINT_TO_POINTER(numExtra - 1));
+            return;
+        } else if (numExtra == 1) {
+            g_hash_table_remove(bitmap->extraRefs, key);
+            return;
+        }
+    }
+
+    guint c = port / PORT_BITMAP_CHUNK_BITS;
+    guint bit = port % PORT_BITMAP_CHUNK_BITS;
+    bitmap->chunks[c][bit / 64] &= ~(1ULL << (bit % 64));
+    bitmap->fullChunks &= ~(1ULL << c);
+
+    if (--bitmap->numUsed[c] == 0) {
+        g_free(bitmap->chunks[c]);
+        bitmap->chunks[c] = NULL;
+    }
+}
+
+/* Returns the first unused port from first to last, inclusive, or 0 if there's none. */
+static guint16 _portbitmap_findUnusedInRange(PortBitmap* bitmap, guint first, guint last) {
+    for (guint c = first / PORT_BITMAP_CHUNK_BITS; c <= last / PORT_BITMAP_CHUNK_BITS; c++) {
+        if (bitmap->fullChunks & (1ULL << c)) {
+            continue;
+        }
+
+        guint chunkStart = c * PORT_BITMAP_CHUNK_BITS;
+        guint from = MAX(first, chunkStart);
+        if (!bitmap->chunks[c]) {
+            return (guint16)from;
+        }
+
+        guint to = MIN(last, chunkStart + PORT_BITMAP_CHUNK_BITS - 1);
+        for (guint w = (from - chunkStart) / 64; w <= (to - chunkStart) / 64; w++) {
+            guint64 unused = ~bitmap->chunks[c][w];
+
+            /* ignore the ports outside of the range */
+            guint wordStart = chunkStart + w * 64;
+            if (from > wordStart) {
+                unused &= ~0ULL << (from - wordStart);
+            }
+            if (to < wordStart + 63) {
+                unused &= ~0ULL >> (wordStart + 63 - to);
+            }
+
+            if (unused) {
+                return (guint16)(wordStart + __builtin_ctzll(unused));
+            }
+        }
+    }
+    return 0;
+}
+
+guint16 portbitmap_findUnused(PortBitmap* bitmap, guint16 start, guint16 minPort) {
+    MAGIC_ASSERT(bitmap);
+    utility_assert(minPort > 0 && start >= minPort);
+
+    guint16 port = _portbitmap_findUnusedInRange(bitmap, start, G_MAXUINT16);
+    if (port == 0 && start > minPort) {
+        port = _portbitmap_findUnusedInRange(bitmap, minPort, start - 1);
+    }
+    return port;
+}
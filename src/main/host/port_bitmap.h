@@ -0,0 +1,32 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_PORT_BITMAP_H_
+#define SHD_PORT_BITMAP_H_
+
+#include <glib.h>
+
+/* Tracks which ports have at least one socket bound to them, so that unused
+ * ports can be found without probing them one at a time. A port may be bound by
+ * several sockets, e.g. a server and the sockets it accepted. Memory is only
+ * allocated for the ranges of ports that are in use. Ports are in host order. */
+typedef struct _PortBitmap PortBitmap;
+
+PortBitmap* portbitmap_new();
+void portbitmap_free(PortBitmap* bitmap);
+
+/* Counts one more socket that is bound to the port. */
+void portbitmap_ref(PortBitmap* bitmap, guint16 port);
+/* Counts one fewer socket that is bound to the port, which must be in use. */
+void portbitmap_unref(PortBitmap* bitmap, guint16 port);
+
+gboolean portbitmap_isUsed(PortBitmap* bitmap, guint16 port);
+
+/* Returns the first unused port at or after start, wrapping around from the
+ * highest port to minPort, or 0 if all of the ports from minPort are used.
+ * start must not be less than minPort, and minPort must not be 0. */
+guint16 portbitmap_findUnused(PortBitmap* bitmap, guint16 start, guint16 minPort);
+
+#endif /* SHD_PORT_BITMAP_H_ */
@@ -23,7 +23,11 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/un.h>
@@ -57,6 +61,7 @@
 #include "main/host/tracker.h"
 #include "main/routing/address.h"
 #include "main/routing/dns.h"
+#include "main/utility/perf_timer.h"
 #include "main/utility/random.h"
 #include "main/utility/utility.h"
 
@@ -68,16 +73,59 @@
 static bool _use_shim_syscall_handler = true;
 ADD_CONFIG_HANDLER(config_getUseShimSyscallHandler, _use_shim_syscall_handler)
 
+// Whether the shim should map the shared memory it uses so that it can be
+// backed by transparent huge pages. Passed to the shim through the environment.
+static bool _use_shmem_hugepages = false;
+ADD_CONFIG_HANDLER(config_getUseShmemHugepages, _use_shmem_hugepages)
+
+// Whether the shim should ask the kernel to merge identical pages of the process's
+// private memory with those of other processes. Passed to the shim through the environment.
+static bool _use_ksm = false;
+ADD_CONFIG_HANDLER(config_getUseKsm, _use_ksm)
+
+// Page out the memory of processes whose threads are all blocked until at least this
+// far in the future, and prefetch it when they next run. 0 disables it.
+static SimulationTime _idle_pageout_threshold = 0;
+ADD_CONFIG_HANDLER(config_getIdlePageoutThreshold, _idle_pageout_threshold)
+
 // Shadow 1.x did not adjust the plugins working directories, but Shadow now runs each plugin with
 // the working directory of the host data path. Using the legacy working directory is useful when
 // running the same experiment in multiple versions of Shadow for performacne comparison purposes.
 static bool _use_legacy_working_dir = false;
 ADD_CONFIG_HANDLER(config_getUseLegacyWorkingDir, _use_legacy_working_dir)
 
+// Fork and exec the native processes when their hosts boot, which the workers do in
+// parallel, instead of one at a time when each process starts. The plugin doesn't run
+// main() until the process starts.
+static bool _use_process_prelaunch = false;
+ADD_CONFIG_HANDLER(config_getUseProcessPrelaunch, _use_process_prelaunch)
+
+// Remember the paths that the process looked up and didn't find, so that repeated
+// probes for them don't need a syscall.
+static bool _use_missing_path_cache = false;
+ADD_CONFIG_HANDLER(config_getUseMissingPathCache, _use_missing_path_cache)
+
+// The most paths that we remember as missing for each process. We forget them all
+// when there are more, which is simpler than evicting the least recently used.
+#define PROCESS_MISSING_PATHS_MAX 4096
+
 static gchar* _process_outputFileName(Process* proc, const char* type);
 static void _process_check(Process* proc);
 static void _disassociateCompatDescriptor(CompatDescriptor* compatDesc, Host* host);
 
+// A pending writer, and the plugin memory it will write back.
+typedef struct _ProcessMemoryMutRef {
+    ProcessMemoryRefMut_u8* ref;
+    uint64_t start;
+    size_t len;
+} ProcessMemoryMutRef;
+
+// The IPC block of a thread that has exited, and the native thread that used it.
+typedef struct _ProcessThreadBlock {
+    ShMemBlock blk;
+    pid_t nativeTid;
+} ProcessThreadBlock;
+
 struct _Process {
     /* Host owning this process */
     Host* host;
@@ -106,7 +154,7 @@ struct _Process {
 
 #ifdef USE_PERF_TIMERS
     /* timer that tracks the amount of CPU time we spend on plugin execution and processing */
-    GTimer* cpuDelayTimer;
+    PerfTimer cpuDelayTimer;
     gdouble totalRunTime;
 #endif
 
@@ -117,6 +165,10 @@ struct _Process {
     /* absolute path to the process's working directory */
     char* workingDir;
 
+    /* the set of paths that lookups by the process found to not exist, if
+     * missing paths are being cached */
+    GHashTable* missingPaths;
+
     /* vector of argument strings passed to exec */
     gchar** argv;
     /* vector of environment variables passed to exec */
@@ -125,6 +177,10 @@ struct _Process {
     gint returnCode;
     gboolean didLogReturnCode;
 
+    /* TRUE if the native process was launched when the host booted, and the
+     * process hasn't started running main() yet */
+    gboolean isPrelaunched;
+
     // int thread_id -> Thread*.
     GHashTable* threads;
 
@@ -141,10 +197,35 @@ struct _Process {
     /* Native pid of the process */
     pid_t nativePid;
 
-    // Pending MemoryReaders and MemoryWriters
-    ProcessMemoryRefMut_u8* memoryMutRef;
+    /* True if we asked the kernel to page out the process's memory since it last ran */
+    bool isPagedOut;
+
+    /* The number of times that a thread of the process has been continued, so that copies
+     * of its memory can tell whether it could have changed since they were made. */
+    guint64 continueCount;
+
+    // Pending MemoryReaders and MemoryWriters. The writers cover disjoint regions.
+    GArray* memoryMutRefs;
     GArray* memoryRefs;
 
+    // IPC blocks of exited threads, to reuse for new threads.
+    GArray* threadBlocks;
+
+    /* Signals for the shim to raise, as a mask of (1 << (signo - 1)) */
+    guint64 pendingSignals;
+
+    /* ITIMER_REAL: when it next expires (0 if disarmed), and its period. The
+     * generation invalidates expiration tasks scheduled before a change. */
+    SimulationTime realTimerExpiration;
+    SimulationTime realTimerInterval;
+    guint realTimerGeneration;
+
+    /* TRUE if the payloads of the packets that the process sends aren't stored */
+    gboolean elidePayloads;
+
+    /* where the syscall handler records the process's syscalls, or NULL */
+    FILE* syscallTraceFile;
+
     gint referenceCount;
     MAGIC_DECLARE;
 };
@@ -166,11 +247,78 @@ const gchar* process_getPluginName(Process* proc) {
     return proc->plugin.exeName->str;
 }
 
+void process_setElidePayloads(Process* proc, gboolean elidePayloads) {
+    MAGIC_ASSERT(proc);
+    proc->elidePayloads = elidePayloads;
+}
+
+gboolean process_isElidingPayloads(Process* proc) {
+    MAGIC_ASSERT(proc);
+    return proc->elidePayloads;
+}
+
+void process_startSyscallTrace(Process* proc) {
+    MAGIC_ASSERT(proc);
+    if (proc->syscallTraceFile) {
+        return;
+    }
+
+    gchar* fileName = _process_outputFileName(proc, "syscalls.bin");
+    proc->syscallTraceFile = syscallhandler_openTraceFile(fileName);
+    g_free(fileName);
+}
+
+FILE* process_getSyscallTraceFile(Process* proc) {
+    MAGIC_ASSERT(proc);
+    return proc->syscallTraceFile;
+}
+
+void process_flushSyscallTrace(Process* proc) {
+    MAGIC_ASSERT(proc);
+    if (proc->syscallTraceFile) {
+        fflush(proc->syscallTraceFile);
+    }
+}
+
 const char* process_getWorkingDir(Process* proc) {
     MAGIC_ASSERT(proc);
     return proc->workingDir;
 }
 
+guint process_getNumThreads(Process* proc) {
+    MAGIC_ASSERT(proc);
+    return g_hash_table_size(proc->threads);
+}
+
+bool process_cachesMissingPaths(Process* proc) {
+    MAGIC_ASSERT(proc);
+    return proc->missingPaths != NULL;
+}
+
+bool process_isKnownMissingPath(Process* proc, const char* path) {
+    MAGIC_ASSERT(proc);
+    return proc->missingPaths && g_hash_table_contains(proc->missingPaths, path);
+}
+
+void process_addMissingPath(Process* proc, const char* path) {
+    MAGIC_ASSERT(proc);
+    if (!proc->missingPaths) {
+        return;
+    }
+    if (g_hash_table_size(proc->missingPaths) >= PROCESS_MISSING_PATHS_MAX) {
+        g_hash_table_remove_all(proc->missingPaths);
+    }
+    g_hash_table_add(proc->missingPaths, g_strdup(path));
+}
+
+void process_forgetMissingPaths(Process* proc) {
+    MAGIC_ASSERT(proc);
+    if (proc->missingPaths && g_hash_table_size(proc->missingPaths) > 0) {
+        trace("forgetting %u missing paths", g_hash_table_size(proc->missingPaths));
+        g_hash_table_remove_all(proc->missingPaths);
+    }
+}
+
 guint process_getProcessID(Process* proc) {
     MAGIC_ASSERT(proc);
     return proc->processID;
@@ -277,6 +425,7 @@ static void _process_handleProcessExit(Process* proc) {
         thread_handleProcessExit(thread);
         utility_assert(!thread_isRunning(thread));
         _process_reapThread(proc, thread);
+        host_removeThread(proc->host, thread);
 
         // Must be last, since it unrefs the thread.
         g_hash_table_iter_remove(&iter);
@@ -300,7 +449,6 @@ static void _process_terminate_threads(Process* proc) {
 #ifdef USE_PERF_TIMERS
 static void _process_handleTimerResult(Process* proc, gdouble elapsedTimeSec) {
     SimulationTime delay = (SimulationTime) (elapsedTimeSec * SIMTIME_ONE_SECOND);
-    cpu_addDelay(host_getCPU(proc->host), delay);
     tracker_addProcessingTime(host_getTracker(proc->host), delay);
     proc->totalRunTime += elapsedTimeSec;
 }
@@ -420,6 +568,7 @@ static void _process_check_thread(Process* proc, Thread* thread) {
     debug("thread %d in process '%s' exited with code %d", thread_getID(thread),
           process_getName(proc), returnCode);
     _process_reapThread(proc, thread);
+    host_removeThread(proc->host, thread);
     g_hash_table_remove(proc->threads, GUINT_TO_POINTER(thread_getID(thread)));
     _process_check(proc);
 }
@@ -457,14 +606,10 @@ static File* _process_openStdIOFileHelper(Process* proc, int fd, gchar* fileName
     return stdfile;
 }
 
-static void _process_start(Process* proc) {
+/* forks and execs the native process, which will wait to be continued */
+static Thread* _process_launch(Process* proc) {
     MAGIC_ASSERT(proc);
 
-    /* dont do anything if we are already running */
-    if(process_isRunning(proc)) {
-        return;
-    }
-
     // Set up stdin
     _process_openStdIOFileHelper(proc, STDIN_FILENO, "/dev/null");
 
@@ -497,6 +642,7 @@ static void _process_start(Process* proc) {
     }
 
     g_hash_table_insert(proc->threads, GUINT_TO_POINTER(tid), mainThread);
+    host_addThread(proc->host, mainThread);
 
     info("starting process '%s'", process_getName(proc));
 
@@ -506,9 +652,16 @@ static void _process_start(Process* proc) {
 
 #ifdef USE_PERF_TIMERS
     /* time how long we execute the program */
-    g_timer_start(proc->cpuDelayTimer);
+    perftimer_start(&proc->cpuDelayTimer);
 #endif
 
+    /* the shim resolves names with a table that it maps, instead of parsing /etc/hosts */
+    gchar* hostsTablePath = dns_getHostsTablePath(worker_getDNS());
+    if (hostsTablePath) {
+        proc->envv = g_environ_setenv(proc->envv, "SHADOW_HOSTS_TABLE", hostsTablePath, TRUE);
+        free(hostsTablePath);
+    }
+
     proc->plugin.isExecuting = TRUE;
     /* exec the process */
     thread_run(mainThread, proc->argv, proc->envv, proc->workingDir);
@@ -516,7 +669,7 @@ static void _process_start(Process* proc) {
     proc->memoryManager = memorymanager_new(proc->nativePid);
 
 #ifdef USE_PERF_TIMERS
-    gdouble elapsed = g_timer_elapsed(proc->cpuDelayTimer, NULL);
+    gdouble elapsed = perftimer_elapsed(&proc->cpuDelayTimer);
     _process_handleTimerResult(proc, elapsed);
     info("process '%s' started in %f seconds", process_getName(proc), elapsed);
 #else
@@ -526,6 +679,32 @@ static void _process_start(Process* proc) {
     worker_setActiveProcess(NULL);
     worker_setActiveThread(NULL);
 
+    return mainThread;
+}
+
+static void _process_start(Process* proc) {
+    MAGIC_ASSERT(proc);
+
+    host_activate(proc->host);
+
+    Thread* mainThread = NULL;
+
+    if (proc->isPrelaunched) {
+        proc->isPrelaunched = FALSE;
+        /* the process may have been stopped before it started */
+        if (!process_isRunning(proc)) {
+            return;
+        }
+        // tid of first thread of a process is equal to the pid.
+        mainThread = g_hash_table_lookup(proc->threads, GUINT_TO_POINTER(proc->processID));
+    } else {
+        /* dont do anything if we are already running */
+        if (process_isRunning(proc)) {
+            return;
+        }
+        mainThread = _process_launch(proc);
+    }
+
     /* call main and run until blocked */
     process_continue(proc, mainThread);
 }
@@ -549,14 +728,13 @@ static void _start_thread_task_free_thread(gpointer data) {
 void process_addThread(Process* proc, Thread* thread) {
     MAGIC_ASSERT(proc);
     g_hash_table_insert(proc->threads, GUINT_TO_POINTER(thread_getID(thread)), thread);
+    host_addThread(proc->host, thread);
 
     // Schedule thread to start.
     thread_ref(thread);
     process_ref(proc);
-    Task* task = task_new(_start_thread_task, proc, thread, _start_thread_task_free_process,
-                          _start_thread_task_free_thread);
-    worker_scheduleTask(task, proc->host, 0);
-    task_unref(task);
+    worker_scheduleCallback(_start_thread_task, proc, thread, _start_thread_task_free_process,
+                            _start_thread_task_free_thread, proc->host, 0);
 }
 
 void process_markAsExiting(Process* proc) {
@@ -565,6 +743,98 @@ void process_markAsExiting(Process* proc) {
     proc->isExiting = true;
 }
 
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+/* Has the native process give the kernel the advice about each of its mappings. The
+ * mappings are advised one at a time, since madvise(2) stops at the first one that
+ * it can't apply the advice to, such as the vDSO, but with one batch of native
+ * syscalls. `thread` must be blocked. */
+static void _process_adviseMemory(Process* proc, Thread* thread, int advice) {
+    gchar* mapsPath = g_strdup_printf("/proc/%d/maps", proc->nativePid);
+    FILE* maps = fopen(mapsPath, "r");
+    g_free(mapsPath);
+    if (!maps) {
+        debug("unable to read the mappings of process '%s': %s", process_getName(proc),
+              g_strerror(errno));
+        return;
+    }
+
+    GArray* calls = g_array_new(FALSE, TRUE, sizeof(SysCallArgs));
+    char* line = NULL;
+    size_t lineLen = 0;
+    while (getline(&line, &lineLen, maps) >= 0) {
+        unsigned long start = 0, end = 0;
+        if (sscanf(line, "%lx-%lx", &start, &end) != 2 || strstr(line, "[v")) {
+            /* [vdso], [vvar], and [vsyscall] can't be paged */
+            continue;
+        }
+        SysCallArgs call = {
+            .number = SYS_madvise,
+            .args = {{.as_u64 = start}, {.as_u64 = end - start}, {.as_i64 = advice}},
+        };
+        g_array_append_val(calls, call);
+    }
+
+    free(line);
+    fclose(maps);
+
+    long* results = g_new(long, calls->len);
+    thread_nativeSyscalls(thread, (SysCallArgs*)calls->data, results, calls->len);
+    for (guint i = 0; i < calls->len; i++) {
+        if (results[i] < 0) {
+            const SysCallArgs* call = &g_array_index(calls, SysCallArgs, i);
+            trace("madvise(%lx, %lu, %d) in process '%s': %s", (unsigned long)call->args[0].as_u64,
+                  (unsigned long)call->args[1].as_u64, advice, process_getName(proc),
+                  g_strerror(-results[i]));
+        }
+    }
+
+    g_free(results);
+    g_array_free(calls, TRUE);
+}
+
+/* Returns the earliest time that a thread of the process is known to wake up, or
+ * SIMTIME_INVALID if they're all waiting for something other than a timeout. Returns 0
+ * if a thread isn't blocked. */
+static SimulationTime _process_getWakeupTime(Process* proc) {
+    SimulationTime wakeupTime = SIMTIME_INVALID;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, proc->threads);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        SysCallCondition* cond = thread_getSysCallCondition(value);
+        if (!cond) {
+            return 0;
+        }
+        wakeupTime = MIN(wakeupTime, syscallcondition_getWakeupTime(cond));
+    }
+
+    return wakeupTime;
+}
+
+/* Pages out the process's memory if it will stay idle for long enough. The wakeup
+ * time is only a lower bound, since a descriptor may also wake the process, in which
+ * case it faults its pages back in as it runs. */
+static void _process_pageOutIfIdle(Process* proc, Thread* thread) {
+    if (_idle_pageout_threshold == 0 || proc->isPagedOut || !process_isRunning(proc) ||
+        !thread_isRunning(thread)) {
+        return;
+    }
+
+    SimulationTime wakeupTime = _process_getWakeupTime(proc);
+    SimulationTime now = worker_getCurrentTime();
+    if (wakeupTime != SIMTIME_INVALID && wakeupTime < now + _idle_pageout_threshold) {
+        return;
+    }
+
+    debug("paging out idle process '%s'", process_getName(proc));
+    _process_adviseMemory(proc, thread, MADV_PAGEOUT);
+    proc->isPagedOut = true;
+}
+
 void process_continue(Process* proc, Thread* thread) {
     MAGIC_ASSERT(proc);
     trace("Continuing thread %d in process %d", thread_getID(thread), proc->processID);
@@ -582,15 +852,22 @@ void process_continue(Process* proc, Thread* thread) {
 
 #ifdef USE_PERF_TIMERS
     /* time how long we execute the program */
-    g_timer_start(proc->cpuDelayTimer);
+    perftimer_start(&proc->cpuDelayTimer);
 #endif
 
+    if (proc->isPagedOut) {
+        /* read the memory back in one go, rather than a page fault at a time */
+        _process_adviseMemory(proc, thread, MADV_WILLNEED);
+        proc->isPagedOut = false;
+    }
+
+    proc->continueCount++;
     proc->plugin.isExecuting = TRUE;
     thread_resume(thread);
     proc->plugin.isExecuting = FALSE;
 
 #ifdef USE_PERF_TIMERS
-    gdouble elapsed = g_timer_elapsed(proc->cpuDelayTimer, NULL);
+    gdouble elapsed = perftimer_elapsed(&proc->cpuDelayTimer);
     _process_handleTimerResult(proc, elapsed);
     info("process '%s' ran for %f seconds", process_getName(proc), elapsed);
 #else
@@ -602,6 +879,7 @@ void process_continue(Process* proc, Thread* thread) {
         // whole process exit; normal thread cleanup would likely fail.
         _process_handleProcessExit(proc);
     } else {
+        _process_pageOutIfIdle(proc, thread);
         _process_check_thread(proc, thread);
     }
 
@@ -618,7 +896,7 @@ void process_stop(Process* proc) {
 
 #ifdef USE_PERF_TIMERS
     /* time how long we execute the program */
-    g_timer_start(proc->cpuDelayTimer);
+    perftimer_start(&proc->cpuDelayTimer);
 #endif
 
     proc->plugin.isExecuting = TRUE;
@@ -626,7 +904,7 @@ void process_stop(Process* proc) {
     proc->plugin.isExecuting = FALSE;
 
 #ifdef USE_PERF_TIMERS
-    gdouble elapsed = g_timer_elapsed(proc->cpuDelayTimer, NULL);
+    gdouble elapsed = perftimer_elapsed(&proc->cpuDelayTimer);
     _process_handleTimerResult(proc, elapsed);
 #endif
 
@@ -644,6 +922,14 @@ void process_stop(Process* proc) {
     _process_check(proc);
 }
 
+void process_kill(Process* proc) {
+    MAGIC_ASSERT(proc);
+
+    if (process_isRunning(proc) && kill(proc->nativePid, SIGKILL)) {
+        warning("kill(pid=%d) error %d: %s", proc->nativePid, errno, g_strerror(errno));
+    }
+}
+
 static void _process_runStartTask(Host* host, gpointer proc, gpointer nothing) {
     _process_start(proc);
 }
@@ -658,21 +944,22 @@ void process_schedule(Process* proc, gpointer nothing) {
     SimulationTime now = worker_getCurrentTime();
 
     if(proc->stopTime == 0 || proc->startTime < proc->stopTime) {
+        if (_use_process_prelaunch && !process_isRunning(proc)) {
+            _process_launch(proc);
+            proc->isPrelaunched = TRUE;
+        }
+
         SimulationTime startDelay = proc->startTime <= now ? 1 : proc->startTime - now;
         process_ref(proc);
-        Task* startProcessTask =
-            task_new(_process_runStartTask, proc, NULL, (TaskObjectFreeFunc)process_unref, NULL);
-        worker_scheduleTask(startProcessTask, proc->host, startDelay);
-        task_unref(startProcessTask);
+        worker_scheduleCallback(_process_runStartTask, proc, NULL,
+                                (TaskObjectFreeFunc)process_unref, NULL, proc->host, startDelay);
     }
 
     if(proc->stopTime > 0 && proc->stopTime > proc->startTime) {
         SimulationTime stopDelay = proc->stopTime <= now ? 1 : proc->stopTime - now;
         process_ref(proc);
-        Task* stopProcessTask =
-            task_new(_process_runStopTask, proc, NULL, (TaskObjectFreeFunc)process_unref, NULL);
-        worker_scheduleTask(stopProcessTask, proc->host, stopDelay);
-        task_unref(stopProcessTask);
+        worker_scheduleCallback(_process_runStopTask, proc, NULL, (TaskObjectFreeFunc)process_unref,
+                                NULL, proc->host, stopDelay);
     }
 }
 
@@ -698,6 +985,11 @@ gboolean process_isRunning(Process* proc) {
     return !proc->isExiting && g_hash_table_size(proc->threads) > 0;
 }
 
+guint64 process_getContinueCount(Process* proc) {
+    MAGIC_ASSERT(proc);
+    return proc->continueCount;
+}
+
 static void _thread_gpointer_unref(gpointer data) { thread_unref(data); }
 
 Process* process_new(Host* host, guint processID, SimulationTime startTime, SimulationTime stopTime,
@@ -723,10 +1015,6 @@ Process* process_new(Host* host, guint processID, SimulationTime startTime, Simu
             proc->plugin.exeName ? proc->plugin.exeName->str : "NULL",
             proc->processID);
 
-#ifdef USE_PERF_TIMERS
-    proc->cpuDelayTimer = g_timer_new();
-#endif
-
     proc->startTime = startTime;
     proc->stopTime = stopTime;
 
@@ -740,6 +1028,10 @@ Process* process_new(Host* host, guint processID, SimulationTime startTime, Simu
         proc->workingDir = realpath(host_getDataPath(host), NULL);
     }
 
+    if (_use_missing_path_cache) {
+        proc->missingPaths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
     if (proc->workingDir == NULL) {
         utility_panic(
             "Could not allocate memory for the process' working directory, or directory did not "
@@ -757,6 +1049,14 @@ Process* process_new(Host* host, guint processID, SimulationTime startTime, Simu
         envv = g_environ_setenv(envv, "SHADOW_DISABLE_SHIM_SYSCALL", "TRUE", TRUE);
     }
 
+    if (_use_shmem_hugepages) {
+        envv = g_environ_setenv(envv, "SHADOW_USE_SHMEM_HUGEPAGES", "TRUE", TRUE);
+    }
+
+    if (_use_ksm) {
+        envv = g_environ_setenv(envv, "SHADOW_USE_KSM", "TRUE", TRUE);
+    }
+
     /* save args and env */
     proc->argv = g_strdupv(argv);
     proc->envv = envv;
@@ -769,8 +1069,9 @@ Process* process_new(Host* host, guint processID, SimulationTime startTime, Simu
     proc->referenceCount = 1;
     proc->isExiting = false;
 
-    proc->memoryMutRef = NULL;
+    proc->memoryMutRefs = g_array_new(FALSE, FALSE, sizeof(ProcessMemoryMutRef));
     proc->memoryRefs = g_array_new(FALSE, FALSE, sizeof(ProcessMemoryRef_u8*));
+    proc->threadBlocks = g_array_new(FALSE, FALSE, sizeof(ProcessThreadBlock));
 
     worker_count_allocation(Process);
 
@@ -782,12 +1083,18 @@ static void _process_free(Process* proc) {
 
     process_freePtrsWithoutFlushing(proc);
     g_array_free(proc->memoryRefs, false);
+    g_array_free(proc->memoryMutRefs, true);
 
     _process_terminate_threads(proc);
     if (proc->threads) {
         g_hash_table_destroy(proc->threads);
         proc->threads = NULL;
     }
+    /* the threads returned their blocks above, and the native process is gone */
+    for (guint i = 0; i < proc->threadBlocks->len; i++) {
+        shmemallocator_globalFree(&g_array_index(proc->threadBlocks, ProcessThreadBlock, i).blk);
+    }
+    g_array_free(proc->threadBlocks, true);
     if(proc->plugin.exePath) {
         g_string_free(proc->plugin.exePath, TRUE);
     }
@@ -804,6 +1111,9 @@ static void _process_free(Process* proc) {
     if (proc->workingDir) {
         free(proc->workingDir);
     }
+    if (proc->missingPaths) {
+        g_hash_table_destroy(proc->missingPaths);
+    }
 
     if(proc->argv) {
         g_strfreev(proc->argv);
@@ -812,9 +1122,9 @@ static void _process_free(Process* proc) {
         g_strfreev(proc->envv);
     }
 
-#ifdef USE_PERF_TIMERS
-    g_timer_destroy(proc->cpuDelayTimer);
-#endif
+    if (proc->syscallTraceFile) {
+        fclose(proc->syscallTraceFile);
+    }
 
     /* Free the stdio files before the descriptor table.
      * Closing the descriptors will remove them from the table and the table
@@ -877,6 +1187,126 @@ uint32_t process_getHostId(const Process* proc) {
     return host_getID(proc->host);
 }
 
+ShMemBlock process_takeThreadBlock(Process* proc, size_t nbytes) {
+    MAGIC_ASSERT(proc);
+
+    for (guint i = 0; i < proc->threadBlocks->len; i++) {
+        ProcessThreadBlock* entry = &g_array_index(proc->threadBlocks, ProcessThreadBlock, i);
+        utility_assert(entry->blk.nbytes == nbytes);
+
+        /* The native thread may still be on its way out after it told us it was exiting,
+         * and it uses its block until then. A thread id that was reused since only makes
+         * us wait longer. */
+        if (entry->nativeTid > 0 &&
+            !(syscall(SYS_tgkill, proc->nativePid, entry->nativeTid, 0) < 0 && errno == ESRCH)) {
+            continue;
+        }
+
+        ShMemBlock blk = entry->blk;
+        g_array_remove_index_fast(proc->threadBlocks, i);
+        return blk;
+    }
+
+    return shmemallocator_globalAlloc(nbytes);
+}
+
+void process_returnThreadBlock(Process* proc, ShMemBlock blk, pid_t nativeTid) {
+    MAGIC_ASSERT(proc);
+    ProcessThreadBlock entry = {.blk = blk, .nativeTid = nativeTid};
+    g_array_append_val(proc->threadBlocks, entry);
+}
+
+void process_signal(Process* proc, int sig, bool interrupt) {
+    MAGIC_ASSERT(proc);
+    utility_assert(sig > 0 && sig <= 64);
+    utility_assert(proc->interposeMethod == INTERPOSE_METHOD_PRELOAD);
+
+    trace("signal %d pending for process %d", sig, proc->processID);
+    proc->pendingSignals |= (guint64)1 << (sig - 1);
+    if (!interrupt) {
+        return;
+    }
+
+    /* interrupt one blocked thread, which gets the signal with its EINTR. The
+     * others see it at their next syscall. */
+    Thread* leader = _process_threadLeader(proc);
+    if (leader && thread_interrupt(leader)) {
+        return;
+    }
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, proc->threads);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (thread_interrupt(value)) {
+            return;
+        }
+    }
+}
+
+bool process_hasPendingSignals(Process* proc) {
+    MAGIC_ASSERT(proc);
+    return proc->pendingSignals != 0;
+}
+
+guint64 process_takePendingSignals(Process* proc) {
+    MAGIC_ASSERT(proc);
+    guint64 signals = proc->pendingSignals;
+    proc->pendingSignals = 0;
+    return signals;
+}
+
+static void _process_scheduleRealTimer(Process* proc);
+
+static void _process_realTimerExpired(Host* host, gpointer procPtr, gpointer generation) {
+    Process* proc = procPtr;
+    MAGIC_ASSERT(proc);
+
+    if (GPOINTER_TO_UINT(generation) != proc->realTimerGeneration || !process_isRunning(proc)) {
+        return;
+    }
+
+    if (proc->realTimerInterval > 0) {
+        proc->realTimerExpiration += proc->realTimerInterval;
+        _process_scheduleRealTimer(proc);
+    } else {
+        proc->realTimerExpiration = 0;
+    }
+    process_signal(proc, SIGALRM, true);
+}
+
+static void _process_scheduleRealTimer(Process* proc) {
+    SimulationTime now = worker_getCurrentTime();
+    SimulationTime delay =
+        proc->realTimerExpiration > now ? proc->realTimerExpiration - now : 0;
+
+    process_ref(proc);
+    worker_scheduleCallback(_process_realTimerExpired, proc,
+                            GUINT_TO_POINTER(proc->realTimerGeneration),
+                            (TaskObjectFreeFunc)process_unref, NULL, proc->host, delay);
+}
+
+void process_getRealTimer(Process* proc, SimulationTime* value, SimulationTime* interval) {
+    MAGIC_ASSERT(proc);
+    SimulationTime now = worker_getCurrentTime();
+    *value = proc->realTimerExpiration > now ? proc->realTimerExpiration - now : 0;
+    if (proc->realTimerExpiration > 0 && *value == 0) {
+        /* expiring now, but not yet delivered */
+        *value = 1;
+    }
+    *interval = proc->realTimerInterval;
+}
+
+void process_setRealTimer(Process* proc, SimulationTime value, SimulationTime interval) {
+    MAGIC_ASSERT(proc);
+
+    proc->realTimerGeneration++;
+    proc->realTimerInterval = interval;
+    proc->realTimerExpiration = value > 0 ? worker_getCurrentTime() + value : 0;
+    if (proc->realTimerExpiration > 0) {
+        _process_scheduleRealTimer(proc);
+    }
+}
+
 InterposeMethod process_getInterposeMethod(Process* proc) {
     MAGIC_ASSERT(proc);
     return proc->interposeMethod;
@@ -920,7 +1350,7 @@ int process_readPtr(Process* proc, void* dst, PluginVirtualPtr src, size_t n) {
     MAGIC_ASSERT(proc);
 
     // Disallow additional references while there's a mutable reference.
-    utility_assert(!proc->memoryMutRef);
+    utility_assert(proc->memoryMutRefs->len == 0);
 
     return memorymanager_readPtr(proc->memoryManager, dst, src, n);
 }
@@ -929,17 +1359,48 @@ int process_writePtr(Process* proc, PluginVirtualPtr dst, const void* src, size_
     MAGIC_ASSERT(proc);
 
     // Disallow additional references when trying to get a mutable reference.
-    utility_assert(!proc->memoryMutRef);
+    utility_assert(proc->memoryMutRefs->len == 0);
     utility_assert(proc->memoryRefs->len == 0);
 
     return memorymanager_writePtr(proc->memoryManager, dst, src, n);
 }
 
+int process_copyPtr(Process* proc, PluginVirtualPtr dst, PluginVirtualPtr src, size_t n) {
+    MAGIC_ASSERT(proc);
+
+    // Disallow additional references when trying to get a mutable reference.
+    utility_assert(proc->memoryMutRefs->len == 0);
+    utility_assert(proc->memoryRefs->len == 0);
+
+    return memorymanager_copyPtr(proc->memoryManager, dst, src, n);
+}
+
+int process_readPtrs(Process* proc, void* dst, const PluginVirtualPtr* srcs, const size_t* lens,
+                     size_t count) {
+    MAGIC_ASSERT(proc);
+
+    // Disallow additional references while there's a mutable reference.
+    utility_assert(proc->memoryMutRefs->len == 0);
+
+    return memorymanager_readPtrs(proc->memoryManager, dst, srcs, lens, count);
+}
+
+int process_writePtrs(Process* proc, const PluginVirtualPtr* dsts, const size_t* lens,
+                      size_t count, const void* src) {
+    MAGIC_ASSERT(proc);
+
+    // Disallow additional references when trying to get a mutable reference.
+    utility_assert(proc->memoryMutRefs->len == 0);
+    utility_assert(proc->memoryRefs->len == 0);
+
+    return memorymanager_writePtrs(proc->memoryManager, dsts, lens, count, src);
+}
+
 const void* process_getReadablePtr(Process* proc, PluginPtr plugin_src, size_t n) {
     MAGIC_ASSERT(proc);
 
     // Disallow additional references while there's a mutable reference.
-    utility_assert(!proc->memoryMutRef);
+    utility_assert(proc->memoryMutRefs->len == 0);
 
     ProcessMemoryRef_u8* ref = memorymanager_getReadablePtr(proc->memoryManager, plugin_src, n);
     if (!ref) {
@@ -955,7 +1416,7 @@ int process_getReadableString(Process* proc, PluginPtr plugin_src, size_t n, con
     MAGIC_ASSERT(proc);
 
     // Disallow additional references while there's a mutable reference.
-    utility_assert(!proc->memoryMutRef);
+    utility_assert(proc->memoryMutRefs->len == 0);
 
     ProcessMemoryRef_u8* ref =
         memorymanager_getReadablePtrPrefix(proc->memoryManager, plugin_src, n);
@@ -987,11 +1448,32 @@ ssize_t process_readString(Process* proc, char* str, PluginVirtualPtr src, size_
     MAGIC_ASSERT(proc);
 
     // Disallow additional references while there's a mutable reference.
-    utility_assert(!proc->memoryMutRef);
+    utility_assert(proc->memoryMutRefs->len == 0);
 
     return memorymanager_readString(proc->memoryManager, src, str, n);
 }
 
+// Whether [plugin_src, plugin_src + n) is clear of the regions of the pending writers, so
+// that a writer of it doesn't alias theirs.
+static bool _process_isWritableRegionFree(Process* proc, PluginPtr plugin_src, size_t n) {
+    for (guint i = 0; i < proc->memoryMutRefs->len; i++) {
+        const ProcessMemoryMutRef* mref =
+            &g_array_index(proc->memoryMutRefs, ProcessMemoryMutRef, i);
+        if (plugin_src.val < mref->start + mref->len && mref->start < plugin_src.val + n) {
+            warning("Can't write %zu bytes at %p, which overlap another pending write", n,
+                    (void*)plugin_src.val);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void _process_addMutRef(Process* proc, ProcessMemoryRefMut_u8* ref, PluginPtr plugin_src,
+                               size_t n) {
+    ProcessMemoryMutRef mref = {.ref = ref, .start = plugin_src.val, .len = n};
+    g_array_append_val(proc->memoryMutRefs, mref);
+}
+
 // Returns a writable pointer corresponding to the named region. The initial
 // contents of the returned memory are unspecified.
 //
@@ -999,16 +1481,18 @@ ssize_t process_readString(Process* proc, char* str, PluginVirtualPtr src, size_
 void* process_getWriteablePtr(Process* proc, PluginPtr plugin_src, size_t n) {
     MAGIC_ASSERT(proc);
 
-    // Disallow additional references when trying to get a mutable reference.
-    utility_assert(!proc->memoryMutRef);
+    // Disallow readers when trying to get a mutable reference, and writers of the same memory.
     utility_assert(proc->memoryRefs->len == 0);
+    if (!_process_isWritableRegionFree(proc, plugin_src, n)) {
+        return NULL;
+    }
 
     ProcessMemoryRefMut_u8* ref = memorymanager_getWritablePtr(proc->memoryManager, plugin_src, n);
     if (!ref) {
         return NULL;
     }
 
-    proc->memoryMutRef = ref;
+    _process_addMutRef(proc, ref, plugin_src, n);
     return memorymanagermut_ptr(ref);
 }
 
@@ -1019,16 +1503,18 @@ void* process_getWriteablePtr(Process* proc, PluginPtr plugin_src, size_t n) {
 void* process_getMutablePtr(Process* proc, PluginPtr plugin_src, size_t n) {
     MAGIC_ASSERT(proc);
 
-    // Disallow additional references when trying to get a mutable reference.
-    utility_assert(!proc->memoryMutRef);
+    // Disallow readers when trying to get a mutable reference, and writers of the same memory.
     utility_assert(proc->memoryRefs->len == 0);
+    if (!_process_isWritableRegionFree(proc, plugin_src, n)) {
+        return NULL;
+    }
 
     ProcessMemoryRefMut_u8* ref = memorymanager_getMutablePtr(proc->memoryManager, plugin_src, n);
     if (!ref) {
         return NULL;
     }
 
-    proc->memoryMutRef = ref;
+    _process_addMutRef(proc, ref, plugin_src, n);
     return memorymanagermut_ptr(ref);
 }
 
@@ -1051,11 +1537,19 @@ void process_flushPtrs(Process* proc) {
 
     _process_freeReaders(proc);
 
-    // Flush and free any writers
-    if (proc->memoryMutRef) {
-        memorymanager_freeMutRefWithFlush(proc->memoryMutRef);
-        proc->memoryMutRef = NULL;
+    // Flush all of the writers together, then free them
+    guint count = proc->memoryMutRefs->len;
+    if (count == 1) {
+        memorymanager_freeMutRefWithFlush(
+            g_array_index(proc->memoryMutRefs, ProcessMemoryMutRef, 0).ref);
+    } else if (count > 1) {
+        ProcessMemoryRefMut_u8** refs = g_newa(ProcessMemoryRefMut_u8*, count);
+        for (guint i = 0; i < count; i++) {
+            refs[i] = g_array_index(proc->memoryMutRefs, ProcessMemoryMutRef, i).ref;
+        }
+        memorymanager_freeMutRefsWithFlush(refs, count);
     }
+    g_array_set_size(proc->memoryMutRefs, 0);
 }
 
 void process_freePtrsWithoutFlushing(Process* proc) {
@@ -1063,12 +1557,13 @@ void process_freePtrsWithoutFlushing(Process* proc) {
 
     _process_freeReaders(proc);
 
-    // Flush and free any writers
-    if (proc->memoryMutRef) {
+    // Free any writers
+    for (guint i = 0; i < proc->memoryMutRefs->len; i++) {
         trace("Discarding plugin ptr without writing back.");
-        memorymanager_freeMutRefWithoutFlush(proc->memoryMutRef);
-        proc->memoryMutRef = NULL;
+        memorymanager_freeMutRefWithoutFlush(
+            g_array_index(proc->memoryMutRefs, ProcessMemoryMutRef, i).ref);
     }
+    g_array_set_size(proc->memoryMutRefs, 0);
 }
 
 // ******************************************************
@@ -36,6 +36,7 @@
 #include "main/host/syscall_handler.h"
 #include "main/host/syscall_types.h"
 #include "main/host/thread.h"
+#include "main/shmem/shmem_allocator.h"
 
 Process* process_new(Host* host, guint processID, SimulationTime startTime, SimulationTime stopTime,
                      InterposeMethod interposeMethod, const gchar* hostName,
@@ -46,10 +47,41 @@ void process_unref(Process* proc);
 void process_schedule(Process* proc, gpointer nothing);
 void process_continue(Process* proc, Thread* thread);
 void process_stop(Process* proc);
+/* Sends SIGKILL to the native process without waiting for it to exit, so that many
+ * processes can be torn down by the kernel at once before they're stopped. */
+void process_kill(Process* proc);
 void process_detachPlugin(gpointer procptr, gpointer nothing);
 
 const char* process_getWorkingDir(Process* proc);
 
+// Returns the number of threads in the process that haven't been reaped.
+guint process_getNumThreads(Process* proc);
+
+/* Whether the process remembers the paths that it looked up and didn't find.
+ * Only lookups that follow symlinks are remembered, since a dangling symlink
+ * exists only when it isn't followed. */
+bool process_cachesMissingPaths(Process* proc);
+/* Returns true if a lookup of the absolute path found nothing, and nothing
+ * that could have created it has happened since. */
+bool process_isKnownMissingPath(Process* proc, const char* path);
+void process_addMissingPath(Process* proc, const char* path);
+/* To be called when the process makes a syscall that may create a path. */
+void process_forgetMissingPaths(Process* proc);
+
+/* If set, the payloads of the packets that the process sends only keep their length,
+ * and receivers read zeros in place of the bytes that were sent. */
+void process_setElidePayloads(Process* proc, gboolean elidePayloads);
+gboolean process_isElidingPayloads(Process* proc);
+
+/* Records each syscall that the process makes from now on in the binary file
+ * "<process name>.syscalls.bin" in the host's data directory. */
+void process_startSyscallTrace(Process* proc);
+/* Returns NULL unless the process's syscalls are being recorded. */
+FILE* process_getSyscallTraceFile(Process* proc);
+/* Writes out the buffered syscall records, so the file is complete even if the
+ * process is never freed. */
+void process_flushSyscallTrace(Process* proc);
+
 // Adds a new thread to the process and schedules it to run.
 // Intended for use by `clone`.
 void process_addThread(Process* proc, Thread* thread);
@@ -63,6 +95,10 @@ void process_markAsExiting(Process* proc);
 
 gboolean process_isRunning(Process* proc);
 
+/* Returns the number of times that a thread of the process has been continued. Plugin memory
+ * can only change when this goes up, or when Shadow writes to it. */
+guint64 process_getContinueCount(Process* proc);
+
 /* Returns the name of the process from an internal buffer.
  * The returned pointer will become invalid when the process
  * is freed and therefore should not be persistently stored
@@ -109,6 +145,13 @@ PluginPhysicalPtr process_getPhysicalAddress(Process* proc, PluginVirtualPtr vPt
 // the specified range couldn't be accessed. Always succeeds with n==0.
 int process_readPtr(Process* proc, void* dst, PluginVirtualPtr src, size_t n);
 
+// Gather the `count` plugin regions starting at `srcs[i]` of length `lens[i]`
+// into consecutive regions of `dst`. Regions that aren't mapped into shadow
+// are all copied with a single syscall. Returns 0 on success or -EFAULT if any
+// of the regions couldn't be accessed.
+int process_readPtrs(Process* proc, void* dst, const PluginVirtualPtr* srcs, const size_t* lens,
+                     size_t count);
+
 // Make the data starting at plugin_src, and extending until the first NULL
 // byte, up at most `n` bytes, available in shadow's address space.
 //
@@ -135,6 +178,19 @@ ssize_t process_readString(Process* proc, char* str, PluginVirtualPtr src, size_
 // the specified range couldn't be accessed. The write is flushed immediately.
 int process_writePtr(Process* proc, PluginVirtualPtr dst, const void* src, size_t n);
 
+// Copy `n` bytes from `src` to `dst`, both in the process's memory, without
+// copying through an intermediate buffer when `src` is mapped into shadow. The
+// regions must not overlap. Returns 0 on success or a negative errno. The write
+// is flushed immediately.
+int process_copyPtr(Process* proc, PluginVirtualPtr dst, PluginVirtualPtr src, size_t n);
+
+// Scatter consecutive regions of `src` into the `count` plugin regions starting
+// at `dsts[i]` of length `lens[i]`. Regions that aren't mapped into shadow are
+// all copied with a single syscall. Returns 0 on success or -EFAULT if any of
+// the regions couldn't be accessed. The write is flushed immediately.
+int process_writePtrs(Process* proc, const PluginVirtualPtr* dsts, const size_t* lens,
+                      size_t count, const void* src);
+
 // Make the data at plugin_src available in shadow's address space.
 //
 // The returned pointer is read-only, and is automatically invalidated when the
@@ -145,6 +201,9 @@ const void* process_getReadablePtr(Process* proc, PluginPtr plugin_src, size_t n
 // contents of the returned memory are unspecified.
 //
 // The returned pointer is automatically invalidated when the plugin runs again.
+// Several writable pointers may be held at once, as long as their regions don't
+// overlap; NULL is returned for a region that overlaps one already held. Their
+// contents are written back together, with as few syscalls as possible.
 //
 // CAUTION: if the unspecified contents aren't overwritten, and the pointer
 // isn't explicitly freed via `process_freePtrsWithoutFlushing`, those unspecified contents may
@@ -155,6 +214,7 @@ void* process_getWriteablePtr(Process* proc, PluginPtr plugin_src, size_t n);
 // the data at the given address needs to be both read and written.
 //
 // The returned pointer is automatically invalidated when the plugin runs again.
+// It may be held along with other writable pointers, as for `process_getWriteablePtr`.
 void* process_getMutablePtr(Process* proc, PluginPtr plugin_src, size_t n);
 
 // Flushes and invalidates all previously returned readable/writable plugin
@@ -174,6 +234,30 @@ void process_setMemoryManager(Process* proc, MemoryManager* memoryManager);
 
 uint32_t process_getHostId(const Process* proc);
 
+// Returns a block for a new thread's IPC with the shim, reusing the block of a
+// thread that has exited if one is free. Every block is `nbytes`.
+ShMemBlock process_takeThreadBlock(Process* proc, size_t nbytes);
+// Gives back the IPC block of a thread that has exited. It isn't reused until
+// the native thread `nativeTid` is gone, or right away if it's 0.
+void process_returnThreadBlock(Process* proc, ShMemBlock blk, pid_t nativeTid);
+
+// Marks `sig` pending, and if `interrupt`, interrupts a thread that is blocked
+// in a syscall with EINTR. A process signalling itself already has a thread
+// that's about to get a syscall result, and shouldn't interrupt another. The
+// shim raises pending signals in the thread that gets the next syscall result,
+// so this is only for processes that use preload interposition.
+void process_signal(Process* proc, int sig, bool interrupt);
+bool process_hasPendingSignals(Process* proc);
+// Returns the pending signals as a mask of (1 << (signo - 1)), and clears them.
+guint64 process_takePendingSignals(Process* proc);
+
+// The time until the process's ITIMER_REAL next sends SIGALRM, or 0 if it's
+// disarmed, and the period it rearms with.
+void process_getRealTimer(Process* proc, SimulationTime* value, SimulationTime* interval);
+// Arms ITIMER_REAL to send SIGALRM after `value`, then every `interval` if it
+// isn't 0, replacing any earlier setting. A `value` of 0 disarms it.
+void process_setRealTimer(Process* proc, SimulationTime value, SimulationTime interval);
+
 // Returns the interpose method used by this process.
 InterposeMethod process_getInterposeMethod(Process* proc);
 
@@ -4,9 +4,14 @@
  * See LICENSE for licensing information
  */
 
+#include <sys/syscall.h>
+
+#include "lib/logger/logger.h"
+#include "lib/shim/shim.h"
 #include "main/bindings/c/bindings.h"
 #include "main/core/support/config_handlers.h"
 #include "main/host/shimipc.h"
+#include "main/host/syscall_handler.h"
 
 static bool _useExplicitBlockMessage = true;
 ADD_CONFIG_HANDLER(config_getUseExplicitBlockMessage, _useExplicitBlockMessage)
@@ -16,6 +21,54 @@ static bool _useSeccomp = true;
 ADD_CONFIG_HANDLER(config_getUseSeccomp, _useSeccomp)
 bool shimipc_getUseSeccomp() { return _useSeccomp; }
 
+static bool _useShimRdtsc = false;
+ADD_CONFIG_HANDLER(config_getUseShimRdtsc, _useShimRdtsc)
+bool shimipc_getUseShimRdtsc() { return _useShimRdtsc; }
+
+static bool _useVdsoPatching = false;
+ADD_CONFIG_HANDLER(config_getUseVdsoPatching, _useVdsoPatching)
+bool shimipc_getUseVdsoPatching() { return _useVdsoPatching; }
+
+// Turns the configured syscall names into the comma-separated numbers that the shim reads.
+static gchar* _shimipc_resolveNativeSyscalls(const ConfigOptions* config) {
+    char* names = config_getNativeSyscalls(config);
+    if (!names) {
+        return NULL;
+    }
+
+    GString* numbers = g_string_new(NULL);
+    gchar** tokens = g_strsplit(names, ",", -1);
+    guint count = 0;
+    for (gchar** name = tokens; *name; name++) {
+        g_strstrip(*name);
+        if (!**name) {
+            continue;
+        }
+
+        // Shadow never sees these calls, so it must have nothing to emulate for them. A thread
+        // that exits without telling Shadow would never be reaped.
+        long number = syscallhandler_getNumber(*name);
+        if (number < 0 || number == SYS_exit ||
+            !(syscallhandler_getFlags(number) & SYSCALL_FLAG_NATIVE)) {
+            panic("Syscall '%s' in native_syscalls isn't one that shadow executes natively",
+                  *name);
+        }
+        if (++count > SHIM_NATIVE_SYSCALLS_MAX) {
+            panic("native_syscalls lists more than %d syscalls", SHIM_NATIVE_SYSCALLS_MAX);
+        }
+
+        g_string_append_printf(numbers, "%s%ld", numbers->len ? "," : "", number);
+    }
+    g_strfreev(tokens);
+    config_freeString(names);
+
+    return g_string_free(numbers, count == 0);
+}
+
+static gchar* _nativeSyscalls = NULL;
+ADD_CONFIG_HANDLER(_shimipc_resolveNativeSyscalls, _nativeSyscalls)
+const gchar* shimipc_getNativeSyscalls() { return _nativeSyscalls; }
+
 static int _spinMax = -1;
 ADD_CONFIG_HANDLER(config_getPreloadSpinMax, _spinMax)
 
@@ -8,6 +8,7 @@
  * Shadow glue/helpers for communicating with the shim.
  */
 
+#include <glib.h>
 #include <stdbool.h>
 #include <sys/types.h>
 
@@ -21,4 +22,16 @@ ssize_t shimipc_spinMax();
 
 // Whether to use a seccomp filter in the shim to catch syscalls that would
 // otherwise not be interposed.
-bool shimipc_getUseSeccomp();
\ No newline at end of file
+bool shimipc_getUseSeccomp();
+
+// Whether the shim emulates rdtsc and rdtscp in preload mode, by making them
+// fault and handling the resulting SIGSEGV.
+bool shimipc_getUseShimRdtsc();
+
+// Whether the shim overwrites the vDSO's time functions in preload mode, so
+// that they return simulated time.
+bool shimipc_getUseVdsoPatching();
+
+// The comma-separated numbers of the syscalls that the shim makes natively in
+// preload mode, without asking Shadow, or NULL if there are none.
+const gchar* shimipc_getNativeSyscalls();
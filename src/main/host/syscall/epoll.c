@@ -130,13 +130,9 @@ SysCallReturn syscallhandler_epoll_ctl(SysCallHandler* sys,
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errorCode};
 }
 
-SysCallReturn syscallhandler_epoll_wait(SysCallHandler* sys,
-                                        const SysCallArgs* args) {
-    gint epfd = args->args[0].as_i64;
-    PluginPtr eventsPtr = args->args[1].as_ptr; // struct epoll_event*
-    gint maxevents = args->args[2].as_i64;
-    gint timeout_ms = args->args[3].as_i64;
-
+static SysCallReturn _syscallhandler_epollWaitHelper(SysCallHandler* sys, gint epfd,
+                                                     PluginPtr eventsPtr, gint maxevents,
+                                                     gint timeout_ms) {
     /* Check input args. */
     if (maxevents <= 0) {
         trace("Maxevents %i is not greater than 0.", maxevents);
@@ -197,7 +193,8 @@ SysCallReturn syscallhandler_epoll_wait(SysCallHandler* sys,
 
             return (SysCallReturn){
                 .state = SYSCALL_BLOCK,
-                .cond = syscallcondition_new(trigger, (timeout_ms > 0) ? sys->timer : NULL)};
+                .cond = syscallcondition_newForThread(
+                    sys->thread, trigger, (timeout_ms > 0) ? sys->timer : NULL)};
         }
     }
 
@@ -216,3 +213,23 @@ SysCallReturn syscallhandler_epoll_wait(SysCallHandler* sys,
     /* Return the number of events that are ready. */
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = nEvents};
 }
+
+SysCallReturn syscallhandler_epoll_wait(SysCallHandler* sys,
+                                        const SysCallArgs* args) {
+    gint epfd = args->args[0].as_i64;
+    PluginPtr eventsPtr = args->args[1].as_ptr; // struct epoll_event*
+    gint maxevents = args->args[2].as_i64;
+    gint timeout_ms = args->args[3].as_i64;
+
+    return _syscallhandler_epollWaitHelper(sys, epfd, eventsPtr, maxevents, timeout_ms);
+}
+
+SysCallReturn syscallhandler_epoll_pwait(SysCallHandler* sys, const SysCallArgs* args) {
+    gint epfd = args->args[0].as_i64;
+    PluginPtr eventsPtr = args->args[1].as_ptr; // struct epoll_event*
+    gint maxevents = args->args[2].as_i64;
+    gint timeout_ms = args->args[3].as_i64;
+    /* The signal mask is ignored, as in ppoll and pselect6. */
+
+    return _syscallhandler_epollWaitHelper(sys, epfd, eventsPtr, maxevents, timeout_ms);
+}
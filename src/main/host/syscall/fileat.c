@@ -69,6 +69,36 @@ static int _syscallhandler_validateDirAndPathnameHelper(
     return process_getReadableString(sys->process, pathnamePtr, PATH_MAX, pathname_out, NULL);
 }
 
+/* Returns the absolute path that a lookup of pathname relative to dir_desc is
+ * remembered under if it doesn't exist, or NULL if the lookup shouldn't be
+ * remembered. workingDir is the directory that relative paths are resolved in
+ * when dir_desc is NULL, or NULL if they aren't resolved in the process's working
+ * directory. The caller must free the returned path. */
+static char* _syscallhandler_getMissingPathKey(SysCallHandler* sys, File* dir_desc,
+                                               const char* pathname, const char* workingDir) {
+    if (!process_cachesMissingPaths(sys->process) || pathname[0] == '\0') {
+        return NULL;
+    }
+
+    if (pathname[0] == '/') {
+        return g_strdup(pathname);
+    }
+
+    const char* prefix = dir_desc ? file_getAbsolutePath(dir_desc) : workingDir;
+    return prefix ? g_strconcat(prefix, "/", pathname, NULL) : NULL;
+}
+
+/* Returns the lookup's result, and remembers the path if it didn't exist. */
+static int _syscallhandler_checkMissingPath(SysCallHandler* sys, char* key, int result) {
+    if (key) {
+        if (result == -ENOENT) {
+            process_addMissingPath(sys->process, key);
+        }
+        g_free(key);
+    }
+    return result;
+}
+
 static SysCallReturn
 _syscallhandler_renameatHelper(SysCallHandler* sys, int olddirfd,
                                PluginPtr oldpathPtr, int newdirfd,
@@ -122,6 +152,18 @@ SysCallReturn syscallhandler_openat(SysCallHandler* sys,
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
     }
 
+    /* Lookups that can create the file are never skipped. */
+    char* key = NULL;
+    if (!(flags & (O_CREAT | O_NOFOLLOW))) {
+        key = _syscallhandler_getMissingPathKey(
+            sys, dir_desc, pathname, process_getWorkingDir(sys->process));
+    }
+    if (key && process_isKnownMissingPath(sys->process, key)) {
+        trace("openat path '%s' is known to not exist", key);
+        g_free(key);
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOENT};
+    }
+
     /* Create the new descriptor for this file. */
     File* file_desc = file_new();
     int handle =
@@ -135,6 +177,7 @@ SysCallReturn syscallhandler_openat(SysCallHandler* sys,
     } else {
         utility_assert(errcode == handle);
     }
+    errcode = _syscallhandler_checkMissingPath(sys, key, errcode);
 
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
 }
@@ -168,12 +211,22 @@ SysCallReturn syscallhandler_newfstatat(SysCallHandler* sys,
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
     }
 
+    /* Relative paths are resolved in shadow's working directory, not the process's. */
+    char* key = (flags & AT_SYMLINK_NOFOLLOW)
+                    ? NULL
+                    : _syscallhandler_getMissingPathKey(sys, dir_desc, pathname, NULL);
+    if (key && process_isKnownMissingPath(sys->process, key)) {
+        g_free(key);
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOENT};
+    }
+
     /* Get some memory in which to return the result. */
     struct stat* buf = process_getWriteablePtr(sys->process, bufPtr, sizeof(*buf));
 
     return (SysCallReturn){
         .state = SYSCALL_DONE,
-        .retval.as_i64 = file_fstatat(dir_desc, pathname, buf, flags)};
+        .retval.as_i64 = _syscallhandler_checkMissingPath(
+            sys, key, file_fstatat(dir_desc, pathname, buf, flags))};
 }
 
 SysCallReturn syscallhandler_fchownat(SysCallHandler* sys,
@@ -293,9 +346,18 @@ SysCallReturn syscallhandler_faccessat(SysCallHandler* sys,
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
     }
 
+    char* key = (flags & AT_SYMLINK_NOFOLLOW)
+                    ? NULL
+                    : _syscallhandler_getMissingPathKey(sys, dir_desc, pathname, NULL);
+    if (key && process_isKnownMissingPath(sys->process, key)) {
+        g_free(key);
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOENT};
+    }
+
     return (SysCallReturn){
         .state = SYSCALL_DONE,
-        .retval.as_i64 = file_faccessat(dir_desc, pathname, mode, flags)};
+        .retval.as_i64 = _syscallhandler_checkMissingPath(
+            sys, key, file_faccessat(dir_desc, pathname, mode, flags))};
 }
 
 SysCallReturn syscallhandler_mkdirat(SysCallHandler* sys,
@@ -498,14 +560,24 @@ SysCallReturn syscallhandler_statx(SysCallHandler* sys,
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
     }
 
+    char* key = (flags & AT_SYMLINK_NOFOLLOW)
+                    ? NULL
+                    : _syscallhandler_getMissingPathKey(sys, dir_desc, pathname, NULL);
+    if (key && process_isKnownMissingPath(sys->process, key)) {
+        g_free(key);
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOENT};
+    }
+
     /* Get the path string from the plugin. */
     struct statx* statxbuf = process_getWriteablePtr(sys->process, statxbufPtr, sizeof(*statxbuf));
     if (!statxbuf) {
+        g_free(key);
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
     }
 
     return (SysCallReturn){
         .state = SYSCALL_DONE,
-        .retval.as_i64 = file_statx(dir_desc, pathname, flags, mask, statxbuf)};
+        .retval.as_i64 = _syscallhandler_checkMissingPath(
+            sys, key, file_statx(dir_desc, pathname, flags, mask, statxbuf))};
 }
 #endif
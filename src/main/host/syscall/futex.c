@@ -19,13 +19,17 @@
 #include "main/host/syscall_condition.h"
 #include "main/utility/utility.h"
 
+/* Futexes that nobody is waiting on are kept in the table for the next wait, as
+ * long as the table holds at most this many futexes. */
+#define FUTEX_MAX_RETAINED 64
+
 ///////////////////////////////////////////////////////////
 // Helpers
 ///////////////////////////////////////////////////////////
 
 static SysCallReturn _syscallhandler_futexWaitHelper(SysCallHandler* sys, PluginPtr futexVPtr,
                                                      int expectedVal, PluginPtr timeoutVPtr,
-                                                     TimeoutType type) {
+                                                     TimeoutType type, uint32_t bitset) {
     // This is a new wait operation on the futex for this thread.
     // Check if a timeout was given in the syscall args.
     const struct timespec* timeout;
@@ -83,7 +87,7 @@ static SysCallReturn _syscallhandler_futexWaitHelper(SysCallHandler* sys, Plugin
         }
 
         // Dynamically clean up the futex if needed
-        if (futex_getListenerCount(futex) == 0) {
+        if (futex_getListenerCount(futex) == 0 && futextable_getSize(ftable) > FUTEX_MAX_RETAINED) {
             trace("Dynamically freed a futex object for futex addr %p", (void*)futexPPtr.val);
             bool success = futextable_remove(ftable, futex);
             utility_assert(success);
@@ -102,17 +106,19 @@ static SysCallReturn _syscallhandler_futexWaitHelper(SysCallHandler* sys, Plugin
 
     // Now we need to block until another thread does a wake on the futex.
     trace("Futex blocking for wakeup %s timeout", timeout ? "with" : "without");
+    futex_setWaitBitset(futex, bitset);
     Trigger trigger =
         (Trigger){.type = TRIGGER_FUTEX, .object = futex, .status = STATUS_FUTEX_WAKEUP};
     if (timeout) {
         _syscallhandler_setListenTimeout(sys, timeout, type);
     }
     return (SysCallReturn){
-        .state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, timeout ? sys->timer : NULL)};
+        .state = SYSCALL_BLOCK,
+        .cond = syscallcondition_newForThread(sys->thread, trigger, timeout ? sys->timer : NULL)};
 }
 
-static SysCallReturn _syscallhandler_futexWakeHelper(SysCallHandler* sys, PluginPtr futexVPtr,
-                                                     int numWakeups) {
+static int _syscallhandler_futexWake(SysCallHandler* sys, PluginPtr futexVPtr, int numWakeups,
+                                     uint32_t bitset) {
     // Convert the virtual ptr to a physical ptr that can uniquely identify the futex
     PluginPhysicalPtr futexPPtr = process_getPhysicalAddress(sys->process, futexVPtr);
 
@@ -125,10 +131,105 @@ static SysCallReturn _syscallhandler_futexWakeHelper(SysCallHandler* sys, Plugin
     int numWoken = 0;
     if (futex && numWakeups > 0) {
         trace("Futex trying to perform %i wakeups", numWakeups);
-        numWoken = futex_wake(futex, (unsigned int)numWakeups);
+        numWoken = futex_wakeBitset(futex, (unsigned int)numWakeups, bitset);
         trace("Futex was able to perform %i/%i wakeups", numWoken, numWakeups);
     }
 
+    return numWoken;
+}
+
+static SysCallReturn _syscallhandler_futexWakeHelper(SysCallHandler* sys, PluginPtr futexVPtr,
+                                                     int numWakeups, uint32_t bitset) {
+    int numWoken = _syscallhandler_futexWake(sys, futexVPtr, numWakeups, bitset);
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = numWoken};
+}
+
+/* Applies the operation encoded in encodedOp to the futex word at futex2VPtr, wakes up to
+ * numWakeups waiters on futexVPtr, and if the old value of the second word passes the encoded
+ * comparison, also wakes up to numWakeups2 waiters on futex2VPtr. See FUTEX_WAKE_OP in
+ * `man 2 futex`. */
+static SysCallReturn _syscallhandler_futexWakeOpHelper(SysCallHandler* sys, PluginPtr futexVPtr,
+                                                       int numWakeups, PluginPtr futex2VPtr,
+                                                       int numWakeups2, int encodedOp) {
+    int op = (encodedOp >> 28) & 7;
+    int cmp = (encodedOp >> 24) & 15;
+    // Both arguments are signed 12-bit values
+    int oparg = (int)((uint32_t)encodedOp << 8) >> 20;
+    int cmparg = (int)((uint32_t)encodedOp << 20) >> 20;
+
+    if (op & FUTEX_OP_OPARG_SHIFT) {
+        op &= ~FUTEX_OP_OPARG_SHIFT;
+        oparg = 1 << (oparg & 31);
+    }
+
+    if (!futex2VPtr.val) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+    }
+    int* futex2Val = process_getMutablePtr(sys->process, futex2VPtr, sizeof(int));
+    if (!futex2Val) {
+        warning("Couldn't read futex address %p", (void*)futex2VPtr.val);
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+    }
+
+    // Shadow doesn't run the plugin while we update the word, so this is atomic
+    int oldVal = *futex2Val;
+    switch (op) {
+        case FUTEX_OP_SET: *futex2Val = oparg; break;
+        case FUTEX_OP_ADD: *futex2Val = (int)((uint32_t)oldVal + (uint32_t)oparg); break;
+        case FUTEX_OP_OR: *futex2Val = oldVal | oparg; break;
+        case FUTEX_OP_ANDN: *futex2Val = oldVal & ~oparg; break;
+        case FUTEX_OP_XOR: *futex2Val = oldVal ^ oparg; break;
+        default:
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOSYS};
+    }
+
+    bool cmpResult = false;
+    switch (cmp) {
+        case FUTEX_OP_CMP_EQ: cmpResult = oldVal == cmparg; break;
+        case FUTEX_OP_CMP_NE: cmpResult = oldVal != cmparg; break;
+        case FUTEX_OP_CMP_LT: cmpResult = oldVal < cmparg; break;
+        case FUTEX_OP_CMP_LE: cmpResult = oldVal <= cmparg; break;
+        case FUTEX_OP_CMP_GT: cmpResult = oldVal > cmparg; break;
+        case FUTEX_OP_CMP_GE: cmpResult = oldVal >= cmparg; break;
+        default:
+            // The kernel has already changed the word when it rejects the comparison
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOSYS};
+    }
+
+    int numWoken = _syscallhandler_futexWake(sys, futexVPtr, numWakeups, FUTEX_BITSET_MATCH_ANY);
+    if (cmpResult) {
+        numWoken +=
+            _syscallhandler_futexWake(sys, futex2VPtr, numWakeups2, FUTEX_BITSET_MATCH_ANY);
+    }
+
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = numWoken};
+}
+
+/* Wakes up to numWakeups waiters on futexVPtr, and "requeues" up to numRequeues more. Waiters
+ * refer to the futex they block on until they return, so instead of moving the remaining
+ * waiters to the second futex we wake them as well. Futex users must already handle spurious
+ * wakeups, and will wait again on the second futex if they need to. */
+static SysCallReturn _syscallhandler_futexRequeueHelper(SysCallHandler* sys, PluginPtr futexVPtr,
+                                                        int numWakeups, int numRequeues,
+                                                        bool compare, int expectedVal) {
+    if (compare) {
+        const int* futexVal = process_getReadablePtr(sys->process, futexVPtr, sizeof(int));
+        if (!futexVal) {
+            warning("Couldn't read futex address %p", (void*)futexVPtr.val);
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+        }
+        if (*futexVal != expectedVal) {
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EAGAIN};
+        }
+    }
+
+    if (numWakeups < 0 || numRequeues < 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
+    }
+
+    int numWoken = _syscallhandler_futexWake(sys, futexVPtr, numWakeups, FUTEX_BITSET_MATCH_ANY);
+    numWoken += _syscallhandler_futexWake(sys, futexVPtr, numRequeues, FUTEX_BITSET_MATCH_ANY);
+
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = numWoken};
 }
 
@@ -167,35 +268,49 @@ SysCallReturn syscallhandler_futex(SysCallHandler* sys, const SysCallArgs* args)
         case FUTEX_WAIT: {
             trace("Handling FUTEX_WAIT operation %i", operation);
             return _syscallhandler_futexWaitHelper(
-                sys, uaddrptr, val, timeoutptr, TIMEOUT_RELATIVE);
+                sys, uaddrptr, val, timeoutptr, TIMEOUT_RELATIVE, FUTEX_BITSET_MATCH_ANY);
         }
 
         case FUTEX_WAKE: {
             trace("Handling FUTEX_WAKE operation %i", operation);
-            return _syscallhandler_futexWakeHelper(sys, uaddrptr, val);
+            return _syscallhandler_futexWakeHelper(sys, uaddrptr, val, FUTEX_BITSET_MATCH_ANY);
         }
 
         case FUTEX_WAIT_BITSET: {
             trace("Handling FUTEX_WAIT_BITSET operation %i bitset %d", operation, val3);
-            if (val3 == FUTEX_BITSET_MATCH_ANY) {
-                return _syscallhandler_futexWaitHelper(
-                    sys, uaddrptr, val, timeoutptr, TIMEOUT_ABSOLUTE);
+            if (val3 == 0) {
+                return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
             }
-            // Other bitsets not yet handled.
-            break;
+            return _syscallhandler_futexWaitHelper(
+                sys, uaddrptr, val, timeoutptr, TIMEOUT_ABSOLUTE, (uint32_t)val3);
         }
         case FUTEX_WAKE_BITSET: {
             trace("Handling FUTEX_WAKE_BITSET operation %i bitset %d", operation, val3);
-            if (val3 == FUTEX_BITSET_MATCH_ANY) {
-                return _syscallhandler_futexWakeHelper(sys, uaddrptr, val);
+            if (val3 == 0) {
+                return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
             }
-            // Other bitsets not yet handled.
-            break;
+            return _syscallhandler_futexWakeHelper(sys, uaddrptr, val, (uint32_t)val3);
+        }
+
+        case FUTEX_WAKE_OP: {
+            trace("Handling FUTEX_WAKE_OP operation %i op %d", operation, val3);
+            // The timeout argument holds the second number of wakeups
+            return _syscallhandler_futexWakeOpHelper(
+                sys, uaddrptr, val, uaddr2ptr, (int)timeoutptr.val, val3);
+        }
+
+        case FUTEX_REQUEUE: {
+            trace("Handling FUTEX_REQUEUE operation %i", operation);
+            return _syscallhandler_futexRequeueHelper(
+                sys, uaddrptr, val, (int)timeoutptr.val, false, 0);
+        }
+        case FUTEX_CMP_REQUEUE: {
+            trace("Handling FUTEX_CMP_REQUEUE operation %i", operation);
+            return _syscallhandler_futexRequeueHelper(
+                sys, uaddrptr, val, (int)timeoutptr.val, true, val3);
         }
 
         case FUTEX_FD:
-        case FUTEX_REQUEUE:
-        case FUTEX_WAKE_OP:
         case FUTEX_LOCK_PI:
         case FUTEX_TRYLOCK_PI:
         case FUTEX_UNLOCK_PI:
@@ -8,6 +8,9 @@
 #include <errno.h>
 #include <poll.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/select.h>
 
 #include "lib/logger/logger.h"
 #include "main/host/descriptor/descriptor.h"
@@ -20,7 +23,29 @@
 #include "main/host/syscall_condition.h"
 
 #define NANOS_PER_MILLISEC 1000000
+#define NANOS_PER_MICROSEC 1000
 #define MILLIS_PER_SEC 1000
+#define MICROS_PER_SEC 1000000
+
+// The kernel reads and writes the fd sets of select as arrays of unsigned longs
+#define SELECT_BITS_PER_WORD (8 * sizeof(unsigned long))
+
+// The pollfd array of a poll that blocked. The plugin can't change it while the poll is blocked,
+// unless another of its threads runs, so the poll uses this copy when it's run again after waking
+// up instead of reading the array again, which takes a syscall when the array isn't mapped into
+// Shadow. The revents are written back to the plugin once the poll is done.
+struct _PollMirror {
+    PluginPtr fds_ptr;
+    nfds_t nfds;
+    // The continue count of the process when the poll blocked
+    guint64 continueCount;
+    struct pollfd fds[];
+};
+
+// The events that make a fd ready in each of the sets of select
+#define SELECT_READ_EVENTS (POLLIN | POLLHUP | POLLERR)
+#define SELECT_WRITE_EVENTS (POLLOUT | POLLERR)
+#define SELECT_EXCEPT_EVENTS (POLLPRI)
 
 ///////////////////////////////////////////////////////////
 // Helpers
@@ -120,11 +145,12 @@ static void _syscallhandler_registerPollFDs(SysCallHandler* sys, struct pollfd*
     }
 }
 
-static SysCallReturn _syscallhandler_pollHelper(SysCallHandler* sys, PluginPtr fds_ptr, nfds_t nfds,
-                                                const struct timespec* timeout) {
-    // Get the pollfd struct in our memory so we can read from and write to it.
-    struct pollfd* fds = process_getMutablePtr(sys->process, fds_ptr, nfds * sizeof(*fds));
-
+// Checks the fds in Shadow's memory, and blocks until one of them is ready or the timeout
+// passes. This is shared by poll and select, which differ only in how they describe the fds.
+// The revents are only meaningful once the syscall is done, since a blocked syscall is run again
+// from the start when it's woken up.
+static SysCallReturn _syscallhandler_pollFDsHelper(SysCallHandler* sys, struct pollfd* fds,
+                                                   nfds_t nfds, const struct timespec* timeout) {
     // Check if any of the fds have events now
     int num_ready = _syscallhandler_getPollEvents(sys, fds, nfds);
 
@@ -156,7 +182,8 @@ static SysCallReturn _syscallhandler_pollHelper(SysCallHandler* sys, PluginPtr f
             // We either use our timer as a timeout, or no timeout
             return (SysCallReturn){
                 .state = SYSCALL_BLOCK,
-                .cond = syscallcondition_new(trigger, need_timer ? sys->timer : NULL)};
+                .cond = syscallcondition_newForThread(
+                    sys->thread, trigger, need_timer ? sys->timer : NULL)};
         }
     }
 
@@ -168,6 +195,69 @@ done:
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = num_ready};
 }
 
+// Returns the mirror of the pollfd array if it's still the same as the plugin's, or NULL.
+static PollMirror* _syscallhandler_getPollMirror(SysCallHandler* sys, PluginPtr fds_ptr,
+                                                 nfds_t nfds) {
+    PollMirror* mirror = sys->pollMirror;
+    if (!mirror || !_syscallhandler_wasBlocked(sys) || mirror->fds_ptr.val != fds_ptr.val ||
+        mirror->nfds != nfds) {
+        return NULL;
+    }
+
+    // Continuing the blocked thread to run the poll again counts once. Any more means that
+    // another thread of the process ran, and may have changed the array.
+    if (process_getContinueCount(sys->process) != mirror->continueCount + 1) {
+        return NULL;
+    }
+
+    return mirror;
+}
+
+// Copies the pollfd array of a poll that's about to block, for when it's run again.
+static void _syscallhandler_setPollMirror(SysCallHandler* sys, PluginPtr fds_ptr,
+                                          const struct pollfd* fds, nfds_t nfds) {
+    PollMirror* mirror = sys->pollMirror;
+    if (!mirror || mirror->nfds != nfds) {
+        g_free(mirror);
+        mirror = g_malloc(sizeof(*mirror) + nfds * sizeof(*fds));
+        sys->pollMirror = mirror;
+    }
+
+    if (mirror->fds != fds) {
+        memcpy(mirror->fds, fds, nfds * sizeof(*fds));
+    }
+    mirror->fds_ptr = fds_ptr;
+    mirror->nfds = nfds;
+    mirror->continueCount = process_getContinueCount(sys->process);
+}
+
+static void _syscallhandler_clearPollMirror(SysCallHandler* sys) {
+    g_free(sys->pollMirror);
+    sys->pollMirror = NULL;
+}
+
+static SysCallReturn _syscallhandler_pollHelper(SysCallHandler* sys, PluginPtr fds_ptr, nfds_t nfds,
+                                                const struct timespec* timeout) {
+    PollMirror* mirror = _syscallhandler_getPollMirror(sys, fds_ptr, nfds);
+
+    // Get the pollfd struct in our memory so we can read from and write to it.
+    struct pollfd* fds = mirror ? mirror->fds
+                                : process_getMutablePtr(sys->process, fds_ptr, nfds * sizeof(*fds));
+    SysCallReturn ret = _syscallhandler_pollFDsHelper(sys, fds, nfds, timeout);
+
+    if (ret.state == SYSCALL_BLOCK) {
+        _syscallhandler_setPollMirror(sys, fds_ptr, fds, nfds);
+        return ret;
+    }
+
+    // The mutable pointer is flushed after the syscall, but the mirror is ours to write back
+    if (mirror && process_writePtr(sys->process, fds_ptr, fds, nfds * sizeof(*fds)) != 0) {
+        ret.retval.as_i64 = -EFAULT;
+    }
+    _syscallhandler_clearPollMirror(sys);
+    return ret;
+}
+
 static int _syscallhandler_checkPollArgs(PluginPtr fds_ptr, nfds_t nfds) {
     if (nfds > INT_MAX) {
         trace("nfds was out of range [0, INT_MAX], returning EINVAL");
@@ -180,6 +270,136 @@ static int _syscallhandler_checkPollArgs(PluginPtr fds_ptr, nfds_t nfds) {
     }
 }
 
+static bool _syscallhandler_isFDSet(const unsigned long* set, int fd) {
+    return set && (set[fd / SELECT_BITS_PER_WORD] & (1UL << (fd % SELECT_BITS_PER_WORD)));
+}
+
+static void _syscallhandler_setFD(unsigned long* set, int fd) {
+    set[fd / SELECT_BITS_PER_WORD] |= 1UL << (fd % SELECT_BITS_PER_WORD);
+}
+
+// Reads a fd set of select into a new buffer, which is NULL if set_ptr is.
+static int _syscallhandler_readFDSet(SysCallHandler* sys, PluginPtr set_ptr, size_t set_len,
+                                     unsigned long** set) {
+    *set = NULL;
+    if (!set_ptr.val) {
+        return 0;
+    }
+
+    *set = g_malloc(set_len);
+    if (process_readPtr(sys->process, *set, set_ptr, set_len) != 0) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+static SysCallReturn _syscallhandler_selectHelper(SysCallHandler* sys, int nfds,
+                                                  PluginPtr readfds_ptr, PluginPtr writefds_ptr,
+                                                  PluginPtr exceptfds_ptr,
+                                                  const struct timespec* timeout) {
+    struct rlimit nofile = {0};
+    if (nfds < 0 || (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur != RLIM_INFINITY &&
+                     (rlim_t)nfds > nofile.rlim_cur)) {
+        trace("nfds %d was negative or above the open file limit, returning EINVAL", nfds);
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
+    }
+
+    size_t set_len =
+        ((nfds + SELECT_BITS_PER_WORD - 1) / SELECT_BITS_PER_WORD) * sizeof(unsigned long);
+    unsigned long *readfds = NULL, *writefds = NULL, *exceptfds = NULL;
+    struct pollfd* fds = NULL;
+    nfds_t num_fds = 0;
+    SysCallReturn ret = {.state = SYSCALL_DONE};
+
+    int result = _syscallhandler_readFDSet(sys, readfds_ptr, set_len, &readfds);
+    if (result == 0) {
+        result = _syscallhandler_readFDSet(sys, writefds_ptr, set_len, &writefds);
+    }
+    if (result == 0) {
+        result = _syscallhandler_readFDSet(sys, exceptfds_ptr, set_len, &exceptfds);
+    }
+    if (result != 0) {
+        goto done;
+    }
+
+    // Describe the fds in the sets the way poll does, so that we can use the same helpers
+    fds = g_new(struct pollfd, MAX(nfds, 1));
+    for (int fd = 0; fd < nfds; fd++) {
+        short events = 0;
+        if (_syscallhandler_isFDSet(readfds, fd)) {
+            events |= POLLIN;
+        }
+        if (_syscallhandler_isFDSet(writefds, fd)) {
+            events |= POLLOUT;
+        }
+        if (_syscallhandler_isFDSet(exceptfds, fd)) {
+            events |= POLLPRI;
+        }
+        if (!events) {
+            continue;
+        }
+
+        // Unlike poll, select fails if any of the fds are not open
+        if (!process_getRegisteredCompatDescriptor(sys->process, fd)) {
+            trace("fd %d in the sets is not open, returning EBADF", fd);
+            result = -EBADF;
+            goto done;
+        }
+
+        fds[num_fds++] = (struct pollfd){.fd = fd, .events = events};
+    }
+
+    ret = _syscallhandler_pollFDsHelper(sys, fds, num_fds, timeout);
+    if (ret.state != SYSCALL_DONE) {
+        goto done;
+    }
+
+    // Replace the sets with the fds that are ready, counting each time a fd is set
+    for (size_t i = 0; readfds && i < set_len / sizeof(unsigned long); i++) {
+        readfds[i] = 0;
+    }
+    for (size_t i = 0; writefds && i < set_len / sizeof(unsigned long); i++) {
+        writefds[i] = 0;
+    }
+    for (size_t i = 0; exceptfds && i < set_len / sizeof(unsigned long); i++) {
+        exceptfds[i] = 0;
+    }
+
+    for (nfds_t i = 0; i < num_fds; i++) {
+        const struct pollfd* pfd = &fds[i];
+        if (readfds && (pfd->events & POLLIN) && (pfd->revents & SELECT_READ_EVENTS)) {
+            _syscallhandler_setFD(readfds, pfd->fd);
+            result++;
+        }
+        if (writefds && (pfd->events & POLLOUT) && (pfd->revents & SELECT_WRITE_EVENTS)) {
+            _syscallhandler_setFD(writefds, pfd->fd);
+            result++;
+        }
+        if (exceptfds && (pfd->events & POLLPRI) && (pfd->revents & SELECT_EXCEPT_EVENTS)) {
+            _syscallhandler_setFD(exceptfds, pfd->fd);
+            result++;
+        }
+    }
+
+    trace("select returning %d ready fds", result);
+
+    if ((readfds && process_writePtr(sys->process, readfds_ptr, readfds, set_len) != 0) ||
+        (writefds && process_writePtr(sys->process, writefds_ptr, writefds, set_len) != 0) ||
+        (exceptfds && process_writePtr(sys->process, exceptfds_ptr, exceptfds, set_len) != 0)) {
+        result = -EFAULT;
+    }
+
+done:
+    g_free(fds);
+    g_free(readfds);
+    g_free(writefds);
+    g_free(exceptfds);
+    if (ret.state == SYSCALL_DONE) {
+        ret.retval.as_i64 = result;
+    }
+    return ret;
+}
+
 ///////////////////////////////////////////////////////////
 // System Calls
 ///////////////////////////////////////////////////////////
@@ -243,4 +463,66 @@ SysCallReturn syscallhandler_ppoll(SysCallHandler* sys, const SysCallArgs* args)
 
     return _syscallhandler_pollHelper(
         sys, fds_ptr, nfds, ts_timeout_ptr.val ? &ts_timeout_val : NULL);
-}
\ No newline at end of file
+}
+
+SysCallReturn syscallhandler_select(SysCallHandler* sys, const SysCallArgs* args) {
+    int nfds = args->args[0].as_i64;
+    PluginPtr readfds_ptr = args->args[1].as_ptr;   // fd_set*
+    PluginPtr writefds_ptr = args->args[2].as_ptr;  // fd_set*
+    PluginPtr exceptfds_ptr = args->args[3].as_ptr; // fd_set*
+    PluginPtr timeout_ptr = args->args[4].as_ptr;   // struct timeval*
+
+    trace("select was called with nfds=%d and timeout_ptr=%p", nfds, (void*)timeout_ptr.val);
+
+    // Linux updates the timeout with the time that was left, which we don't do. Programs
+    // that want portable behavior can't rely on it.
+    struct timeval tv_timeout_val;
+    struct timespec ts_timeout_val;
+
+    if (timeout_ptr.val) {
+        if (process_readPtr(sys->process, &tv_timeout_val, timeout_ptr, sizeof(tv_timeout_val)) !=
+            0) {
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+        }
+
+        if (tv_timeout_val.tv_sec < 0 || tv_timeout_val.tv_usec < 0 ||
+            tv_timeout_val.tv_usec >= MICROS_PER_SEC) {
+            trace("invalid timeout given in timeval arg, returning EINVAL");
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
+        }
+
+        ts_timeout_val = (struct timespec){
+            .tv_sec = tv_timeout_val.tv_sec, .tv_nsec = tv_timeout_val.tv_usec * NANOS_PER_MICROSEC};
+    }
+
+    return _syscallhandler_selectHelper(sys, nfds, readfds_ptr, writefds_ptr, exceptfds_ptr,
+                                        timeout_ptr.val ? &ts_timeout_val : NULL);
+}
+
+SysCallReturn syscallhandler_pselect6(SysCallHandler* sys, const SysCallArgs* args) {
+    int nfds = args->args[0].as_i64;
+    PluginPtr readfds_ptr = args->args[1].as_ptr;   // fd_set*
+    PluginPtr writefds_ptr = args->args[2].as_ptr;  // fd_set*
+    PluginPtr exceptfds_ptr = args->args[3].as_ptr; // fd_set*
+    PluginPtr timeout_ptr = args->args[4].as_ptr;   // const struct timespec*
+    // The sixth argument holds the signal mask, which we ignore as in ppoll
+
+    trace("pselect6 was called with nfds=%d and timeout_ptr=%p", nfds, (void*)timeout_ptr.val);
+
+    struct timespec ts_timeout_val;
+
+    if (timeout_ptr.val) {
+        if (process_readPtr(sys->process, &ts_timeout_val, timeout_ptr, sizeof(ts_timeout_val)) !=
+            0) {
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+        }
+
+        if (ts_timeout_val.tv_sec < 0 || ts_timeout_val.tv_nsec < 0) {
+            trace("negative timeout given in timespec arg, returning EINVAL");
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
+        }
+    }
+
+    return _syscallhandler_selectHelper(sys, nfds, readfds_ptr, writefds_ptr, exceptfds_ptr,
+                                        timeout_ptr.val ? &ts_timeout_val : NULL);
+}
@@ -10,5 +10,7 @@
 
 SYSCALL_HANDLER(poll);
 SYSCALL_HANDLER(ppoll);
+SYSCALL_HANDLER(pselect6);
+SYSCALL_HANDLER(select);
 
 #endif /* SRC_MAIN_HOST_SYSCALL_POLL_H_ */
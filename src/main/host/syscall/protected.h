@@ -20,6 +20,7 @@
 #include "main/host/syscall_handler.h"
 #include "main/host/syscall_types.h"
 #include "main/host/thread.h"
+#include "main/utility/perf_timer.h"
 #include "main/utility/utility.h"
 
 typedef enum {
@@ -27,6 +28,8 @@ typedef enum {
     TIMEOUT_RELATIVE,
 } TimeoutType;
 
+typedef struct _PollMirror PollMirror;
+
 struct _SysCallHandler {
     /* We store pointers to the host, process, and thread that the syscall
      * handler is associated with. We typically need to makes calls into
@@ -55,7 +58,7 @@ struct _SysCallHandler {
     // https://github.com/shadow/shadow/issues/1158
     //#ifdef USE_PERF_TIMERS
     /* Used to track the time elapsed while handling a syscall. */
-    GTimer* perfTimer;
+    PerfTimer* perfTimer;
     /* The cumulative time consumed while handling the current syscall.
      * This includes the time from previous calls that ended up blocking. */
     gdouble perfSecondsCurrent;
@@ -64,8 +67,20 @@ struct _SysCallHandler {
     //#endif
     /* The total number of syscalls that we have handled. */
     long numSyscalls;
-    // A counter for individual syscalls
-    Counter* syscall_counter;
+    // The number of times each syscall was made, indexed by syscall number
+    guint64* syscall_counts;
+    // Profiled time in nanoseconds, keyed by folded stack frames
+    Counter* profile_counter;
+
+    /* The simulated time of the syscalls that the thread made in a row without finding
+     * anything to do, and their number. Used to detect threads that busy-wait. */
+    SimulationTime spinTime;
+    guint spinCount;
+    /* If the thread is blocked on a delay that we added because it was spinning. */
+    bool isSpinDelayed;
+    /* A copy of the pollfd array of the poll that's blocked, so that the poll needn't read it
+     * from the plugin again when it's run again after waking up, or NULL. */
+    PollMirror* pollMirror;
 
     int referenceCount;
 
@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <sys/syscall.h>
+#include <sys/time.h>
 
 #include "lib/logger/logger.h"
 #include "main/host/host.h"
@@ -84,6 +85,41 @@ static SysCallReturn _syscallhandler_killHelper(SysCallHandler* sys, pid_t pid,
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -error};
 }
 
+// In preload mode the shim raises signals for processes on this host when they get their next
+// syscall result, so that handlers run as plugin code rather than inside the shim while it waits
+// for us. Returns false for signals that must still be sent natively.
+static bool _syscallhandler_signalInShim(SysCallHandler* sys, Process* target, int sig) {
+    if (!target || process_getInterposeMethod(target) != INTERPOSE_METHOD_PRELOAD) {
+        return false;
+    }
+    // 0 only checks for the process, and the shim relies on its own SIGSYS handler.
+    if (sig <= 0 || sig > 64 || sig == SIGKILL || sig == SIGSTOP || sig == SIGCONT ||
+        sig == SIGSYS) {
+        return false;
+    }
+    process_signal(target, sig, target != sys->process);
+    return true;
+}
+
+static SimulationTime _syscallhandler_timevalToSimTime(const struct timeval* tv) {
+    return tv->tv_sec * SIMTIME_ONE_SECOND + tv->tv_usec * SIMTIME_ONE_MICROSECOND;
+}
+
+static struct timeval _syscallhandler_simTimeToTimeval(SimulationTime t) {
+    return (struct timeval){.tv_sec = t / SIMTIME_ONE_SECOND,
+                            .tv_usec = (t % SIMTIME_ONE_SECOND) / SIMTIME_ONE_MICROSECOND};
+}
+
+// The real-time interval timer sends SIGALRM through the shim, so it's only available in preload
+// mode.
+static bool _syscallhandler_realTimerSupported(SysCallHandler* sys, const char* name) {
+    if (process_getInterposeMethod(sys->process) != INTERPOSE_METHOD_PRELOAD) {
+        warning("%s is only supported with the preload interpose method", name);
+        return false;
+    }
+    return true;
+}
+
 ///////////////////////////////////////////////////////////
 // System Calls
 ///////////////////////////////////////////////////////////
@@ -112,6 +148,10 @@ SysCallReturn syscallhandler_kill(SysCallHandler* sys, const SysCallArgs* args)
         }
     }
 
+    if (pid > 0 && _syscallhandler_signalInShim(sys, host_getProcess(sys->host, pid), sig)) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = 0};
+    }
+
     trace("translated virtual pid %i to native pid %i", pid, native_pid);
     return _syscallhandler_killHelper(sys, native_pid, 0, sig, SYS_kill);
 }
@@ -134,6 +174,11 @@ SysCallReturn syscallhandler_tgkill(SysCallHandler* sys, const SysCallArgs* args
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ESRCH};
     }
 
+    // The shim raises it in whichever thread of the process next gets a syscall result.
+    if (_syscallhandler_signalInShim(sys, host_getProcess(sys->host, tgid), sig)) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = 0};
+    }
+
     trace("translated virtual tgid %i to native tgid %i and virtual tid %i to native tid %i", tgid,
           native_tgid, tid, native_tid);
     return _syscallhandler_killHelper(sys, native_tgid, native_tid, sig, SYS_tgkill);
@@ -162,6 +207,13 @@ static SysCallReturn _rt_sigaction(SysCallHandler* sys, int signum, PluginPtr ac
                                    PluginPtr oldActPtr, size_t masksize) {
     utility_assert(sys);
 
+    if (actPtr.val && signum == SIGSEGV && shimipc_getUseShimRdtsc() &&
+        process_getInterposeMethod(sys->process) == INTERPOSE_METHOD_PRELOAD) {
+        // This would overwrite the shim's SIGSEGV handler, which emulates rdtsc.
+        warning("Ignoring `sigaction` for SIGSEGV");
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval = 0};
+    }
+
     if (!shimipc_getUseSeccomp()) {
         // No special handling needed.
         return (SysCallReturn){.state = SYSCALL_NATIVE};
@@ -308,3 +360,81 @@ SysCallReturn syscallhandler_rt_sigprocmask(SysCallHandler* sys, const SysCallAr
     return _rt_sigprocmask(sys, /*how=*/(int)args->args[0].as_i64, /*setPtr=*/args->args[1].as_ptr,
                            /*oldSetPtr=*/args->args[2].as_ptr, /*sigsetsize=*/args->args[3].as_u64);
 }
+
+SysCallReturn syscallhandler_getitimer(SysCallHandler* sys, const SysCallArgs* args) {
+    utility_assert(sys && args);
+    int which = args->args[0].as_i64;
+    PluginPtr currValuePtr = args->args[1].as_ptr; // struct itimerval*
+
+    if (which != ITIMER_REAL || !_syscallhandler_realTimerSupported(sys, "getitimer")) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOSYS};
+    }
+
+    SimulationTime value, interval;
+    process_getRealTimer(sys->process, &value, &interval);
+    struct itimerval currValue = {.it_value = _syscallhandler_simTimeToTimeval(value),
+                                  .it_interval = _syscallhandler_simTimeToTimeval(interval)};
+
+    int rv = process_writePtr(sys->process, currValuePtr, &currValue, sizeof(currValue));
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = rv};
+}
+
+SysCallReturn syscallhandler_setitimer(SysCallHandler* sys, const SysCallArgs* args) {
+    utility_assert(sys && args);
+    int which = args->args[0].as_i64;
+    PluginPtr newValuePtr = args->args[1].as_ptr; // const struct itimerval*
+    PluginPtr oldValuePtr = args->args[2].as_ptr; // struct itimerval*
+
+    if (which != ITIMER_REAL || !_syscallhandler_realTimerSupported(sys, "setitimer")) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOSYS};
+    }
+
+    // Like Linux, treat a NULL new value as disarming the timer.
+    struct itimerval newValue = {0};
+    if (newValuePtr.val) {
+        int rv = process_readPtr(sys->process, &newValue, newValuePtr, sizeof(newValue));
+        if (rv < 0) {
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = rv};
+        }
+    }
+    if (newValue.it_value.tv_sec < 0 || newValue.it_value.tv_usec < 0 ||
+        newValue.it_value.tv_usec >= 1000000 || newValue.it_interval.tv_sec < 0 ||
+        newValue.it_interval.tv_usec < 0 || newValue.it_interval.tv_usec >= 1000000) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
+    }
+
+    if (oldValuePtr.val) {
+        SimulationTime value, interval;
+        process_getRealTimer(sys->process, &value, &interval);
+        struct itimerval oldValue = {.it_value = _syscallhandler_simTimeToTimeval(value),
+                                     .it_interval = _syscallhandler_simTimeToTimeval(interval)};
+        int rv = process_writePtr(sys->process, oldValuePtr, &oldValue, sizeof(oldValue));
+        if (rv < 0) {
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = rv};
+        }
+    }
+
+    process_setRealTimer(sys->process, _syscallhandler_timevalToSimTime(&newValue.it_value),
+                         _syscallhandler_timevalToSimTime(&newValue.it_interval));
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = 0};
+}
+
+SysCallReturn syscallhandler_alarm(SysCallHandler* sys, const SysCallArgs* args) {
+    utility_assert(sys && args);
+    unsigned int seconds = args->args[0].as_u64;
+
+    if (!_syscallhandler_realTimerSupported(sys, "alarm")) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOSYS};
+    }
+
+    SimulationTime value, interval;
+    process_getRealTimer(sys->process, &value, &interval);
+    process_setRealTimer(sys->process, seconds * SIMTIME_ONE_SECOND, 0);
+
+    // The seconds that were left, rounded to the nearest, but at least 1 if the timer was armed.
+    guint64 remaining = (value + SIMTIME_ONE_SECOND / 2) / SIMTIME_ONE_SECOND;
+    if (value > 0 && remaining == 0) {
+        remaining = 1;
+    }
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_u64 = remaining};
+}
@@ -13,5 +13,8 @@ SYSCALL_HANDLER(tgkill);
 SYSCALL_HANDLER(tkill);
 SYSCALL_HANDLER(rt_sigaction);
 SYSCALL_HANDLER(rt_sigprocmask);
+SYSCALL_HANDLER(getitimer);
+SYSCALL_HANDLER(setitimer);
+SYSCALL_HANDLER(alarm);
 
 #endif
@@ -8,9 +8,13 @@
 #include <errno.h>
 #include <glib.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "lib/logger/logger.h"
 #include "main/core/worker.h"
@@ -27,6 +31,18 @@
 #include "main/host/syscall_handler.h"
 #include "main/host/thread.h"
 
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+/* The most datagrams that one UDP_SEGMENT send is split into, as in Linux. */
+#ifndef UDP_MAX_SEGMENTS
+#define UDP_MAX_SEGMENTS 64
+#endif
+
+/* The most control message data that we read from a msghdr. */
+#define SYSCALL_MSG_CONTROL_MAX_SIZE 1024
+
 ///////////////////////////////////////////////////////////
 // Private Helpers
 ///////////////////////////////////////////////////////////
@@ -204,7 +220,9 @@ static SysCallReturn _syscallhandler_acceptHelper(SysCallHandler* sys,
         trace("Listening socket %i waiting for acceptable connection.", sockfd);
         Trigger trigger = (Trigger){
             .type = TRIGGER_DESCRIPTOR, .object = desc, .status = STATUS_DESCRIPTOR_READABLE};
-        return (SysCallReturn){.state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+        return (SysCallReturn){
+            .state = SYSCALL_BLOCK,
+            .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
     } else if (errcode < 0) {
         trace("TCP error when accepting connection on socket %i", sockfd);
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
@@ -259,6 +277,9 @@ static int _syscallhandler_bindHelper(SysCallHandler* sys, Socket* socket_desc,
     /* Each protocol type gets its own ephemeral port mapping. */
     ProtocolType ptype = socket_getProtocol(socket_desc);
 
+    /* Only a port they chose can be shared with SO_REUSEPORT. */
+    gboolean reusePort = port != 0 && socket_isReusePort(socket_desc);
+
     /* Get a free ephemeral port if they didn't specify one. */
     if (port == 0) {
         port =
@@ -274,7 +295,7 @@ static int _syscallhandler_bindHelper(SysCallHandler* sys, Socket* socket_desc,
 
     /* Make sure the port is available at this address for this protocol. */
     if (!host_isInterfaceAvailable(
-            sys->host, ptype, addr, port, peerAddr, peerPort)) {
+            sys->host, ptype, addr, port, peerAddr, peerPort, reusePort)) {
         debug("the provided address and port %u are not available", ntohs(port));
         return -EADDRINUSE;
     }
@@ -328,6 +349,15 @@ static int _syscallhandler_getSocketOptHelper(SysCallHandler* sys, Socket* sock,
             *optlen = num_bytes;
             return 0;
         }
+#ifdef SO_REUSEPORT
+        case SO_REUSEPORT: {
+            int reusePort = socket_isReusePort(sock) ? 1 : 0;
+            int num_bytes = MIN(*optlen, sizeof(reusePort));
+            memcpy(optval, &reusePort, num_bytes);
+            *optlen = num_bytes;
+            return 0;
+        }
+#endif
         case SO_ERROR: {
             int error = 0;
             if (descriptor_getType((LegacyDescriptor*)sock) == DT_TCPSOCKET) {
@@ -406,8 +436,9 @@ static int _syscallhandler_setSocketOptHelper(SysCallHandler* sys, Socket* sock,
         }
 #ifdef SO_REUSEPORT
         case SO_REUSEPORT: {
-            // TODO implement this, tgen uses it
-            trace("setsockopt SO_REUSEPORT not yet implemented");
+            // like Linux, this only affects binds that happen after it's set
+            const int* val = process_getReadablePtr(sys->process, optvalPtr, sizeof(int));
+            socket_setReusePort(sock, *val != 0);
             return 0;
         }
 #endif
@@ -432,11 +463,15 @@ static int _syscallhandler_setSocketOptHelper(SysCallHandler* sys, Socket* sock,
 // Protected helpers
 ///////////////////////////////////////////////////////////
 
-SysCallReturn _syscallhandler_recvfromHelper(SysCallHandler* sys, int sockfd,
-                                             PluginPtr bufPtr, size_t bufSize,
-                                             int flags, PluginPtr srcAddrPtr,
-                                             PluginPtr addrlenPtr) {
-    trace("trying to recv %zu bytes on socket %i", bufSize, sockfd);
+SysCallReturn _syscallhandler_recvIovHelper(SysCallHandler* sys, int sockfd,
+                                            const struct iovec* iov, size_t iovlen, int flags,
+                                            PluginPtr srcAddrPtr, PluginPtr addrlenPtr) {
+    size_t bufSize = 0;
+    for (size_t i = 0; i < iovlen; i++) {
+        bufSize += iov[i].iov_len;
+    }
+
+    trace("trying to recv %zu bytes into %zu buffers on socket %i", bufSize, iovlen, sockfd);
 
     /* Get and validate the socket. */
     Socket* socket_desc = NULL;
@@ -490,8 +525,19 @@ SysCallReturn _syscallhandler_recvfromHelper(SysCallHandler* sys, int sockfd,
             sizeNeeded = MIN(sizeNeeded, CONFIG_DATAGRAM_MAX_SIZE + 1);
         }
 
-        retval = transport_receiveUserData((Transport*)socket_desc, sys->thread, bufPtr, sizeNeeded,
-                                           &inet_addr.sin_addr.s_addr, &inet_addr.sin_port);
+        if (descriptor_getType(desc) == DT_UDPSOCKET) {
+            /* a datagram is at most the max size, so it can't overflow the buffers */
+            retval = udp_receiveUserDataIov((UDP*)socket_desc, sys->thread, iov, iovlen,
+                                            &inet_addr.sin_addr.s_addr, &inet_addr.sin_port);
+        } else if (iovlen == 1) {
+            PluginPtr bufPtr = (PluginPtr){.val = (uint64_t)iov[0].iov_base};
+            retval = transport_receiveUserData((Transport*)socket_desc, sys->thread, bufPtr,
+                                               sizeNeeded, &inet_addr.sin_addr.s_addr,
+                                               &inet_addr.sin_port);
+        } else {
+            warning("Scattering into more than one buffer isn't supported on socket %i", sockfd);
+            retval = -ENOTSUP;
+        }
 
         trace("recv returned %zd", retval);
     }
@@ -499,10 +545,18 @@ SysCallReturn _syscallhandler_recvfromHelper(SysCallHandler* sys, int sockfd,
     bool nonblocking_mode = descriptor_getFlags(desc) & O_NONBLOCK || flags & MSG_DONTWAIT;
     if (retval == -EWOULDBLOCK && !nonblocking_mode) {
         trace("recv would block on socket %i", sockfd);
+        if (descriptor_getType(desc) == DT_UNIXSOCKET && iovlen == 1) {
+            /* let the other end write straight into our buffer while we wait */
+            PluginPtr bufPtr = (PluginPtr){.val = (uint64_t)iov[0].iov_base};
+            channel_setBlockedReader((Channel*)desc, sys->thread, bufPtr, bufSize);
+        }
+
         /* We need to block until the descriptor is ready to read. */
         Trigger trigger = (Trigger){
             .type = TRIGGER_DESCRIPTOR, .object = desc, .status = STATUS_DESCRIPTOR_READABLE};
-        return (SysCallReturn){.state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+        return (SysCallReturn){
+            .state = SYSCALL_BLOCK,
+            .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
     }
 
     /* check if they wanted to know where we got the data from */
@@ -516,11 +570,23 @@ SysCallReturn _syscallhandler_recvfromHelper(SysCallHandler* sys, int sockfd,
         .state = SYSCALL_DONE, .retval.as_i64 = (int64_t)retval};
 }
 
-SysCallReturn _syscallhandler_sendtoHelper(SysCallHandler* sys, int sockfd,
-                                           PluginPtr bufPtr, size_t bufSize,
-                                           int flags, PluginPtr destAddrPtr,
-                                           socklen_t addrlen) {
-    trace("trying to send %zu bytes on socket %i", bufSize, sockfd);
+SysCallReturn _syscallhandler_recvfromHelper(SysCallHandler* sys, int sockfd,
+                                             PluginPtr bufPtr, size_t bufSize,
+                                             int flags, PluginPtr srcAddrPtr,
+                                             PluginPtr addrlenPtr) {
+    struct iovec iov = {.iov_base = (void*)bufPtr.val, .iov_len = bufSize};
+    return _syscallhandler_recvIovHelper(sys, sockfd, &iov, 1, flags, srcAddrPtr, addrlenPtr);
+}
+
+SysCallReturn _syscallhandler_sendIovHelper(SysCallHandler* sys, int sockfd,
+                                            const struct iovec* iov, size_t iovlen, int flags,
+                                            PluginPtr destAddrPtr, socklen_t addrlen) {
+    size_t bufSize = 0;
+    for (size_t i = 0; i < iovlen; i++) {
+        bufSize += iov[i].iov_len;
+    }
+
+    trace("trying to send %zu bytes from %zu buffers on socket %i", bufSize, iovlen, sockfd);
 
     /* Get and validate the socket. */
     Socket* socket_desc = NULL;
@@ -530,10 +596,19 @@ SysCallReturn _syscallhandler_sendtoHelper(SysCallHandler* sys, int sockfd,
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
     }
 
-    /* Need non-NULL buffer. */
-    if (!bufPtr.val) {
-        debug("Can't send from NULL buffer on socket %i", sockfd);
-        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+    /* Need non-NULL buffers. */
+    for (size_t i = 0; i < iovlen; i++) {
+        if (!iov[i].iov_base && iov[i].iov_len > 0) {
+            debug("Can't send from NULL buffer on socket %i", sockfd);
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+        }
+    }
+
+    if (descriptor_getType((LegacyDescriptor*)socket_desc) == DT_UNIXSOCKET &&
+        destAddrPtr.val) {
+        /* our unix sockets are always connected with socketpair() */
+        debug("Can't send to an address on connected unix socket %i", sockfd);
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EISCONN};
     }
 
     /* TODO: when we support AF_UNIX this could be sockaddr_un */
@@ -647,8 +722,19 @@ SysCallReturn _syscallhandler_sendtoHelper(SysCallHandler* sys, int sockfd,
             sizeNeeded = MIN(sizeNeeded, CONFIG_DATAGRAM_MAX_SIZE + 1);
         }
 
-        retval = transport_sendUserData(
-            (Transport*)socket_desc, sys->thread, bufPtr, sizeNeeded, dest_ip, dest_port);
+        if (descriptor_getType(desc) == DT_TCPSOCKET) {
+            retval = tcp_sendUserDataIov((TCP*)socket_desc, sys->thread, iov, iovlen, sizeNeeded);
+        } else if (descriptor_getType(desc) == DT_UDPSOCKET) {
+            retval = udp_sendUserDataIov(
+                (UDP*)socket_desc, sys->thread, iov, iovlen, sizeNeeded, dest_ip, dest_port);
+        } else if (iovlen == 1) {
+            PluginPtr bufPtr = (PluginPtr){.val = (uint64_t)iov[0].iov_base};
+            retval = transport_sendUserData(
+                (Transport*)socket_desc, sys->thread, bufPtr, sizeNeeded, dest_ip, dest_port);
+        } else {
+            warning("Gathering from more than one buffer isn't supported on socket %i", sockfd);
+            retval = -ENOTSUP;
+        }
 
         trace("send returned %zd", retval);
     }
@@ -659,7 +745,9 @@ SysCallReturn _syscallhandler_sendtoHelper(SysCallHandler* sys, int sockfd,
             /* We need to block until the descriptor is ready to write. */
             Trigger trigger = (Trigger){
                 .type = TRIGGER_DESCRIPTOR, .object = desc, .status = STATUS_DESCRIPTOR_WRITABLE};
-            return (SysCallReturn){.state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+            return (SysCallReturn){
+                .state = SYSCALL_BLOCK,
+                .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
         } else {
             /* We attempted to write 0 bytes, so no need to block or return EWOULDBLOCK. */
             retval = 0;
@@ -670,6 +758,400 @@ SysCallReturn _syscallhandler_sendtoHelper(SysCallHandler* sys, int sockfd,
         .state = SYSCALL_DONE, .retval.as_i64 = (int64_t)retval};
 }
 
+SysCallReturn _syscallhandler_sendtoHelper(SysCallHandler* sys, int sockfd,
+                                           PluginPtr bufPtr, size_t bufSize,
+                                           int flags, PluginPtr destAddrPtr,
+                                           socklen_t addrlen) {
+    struct iovec iov = {.iov_base = (void*)bufPtr.val, .iov_len = bufSize};
+    return _syscallhandler_sendIovHelper(sys, sockfd, &iov, 1, flags, destAddrPtr, addrlen);
+}
+
+///////////////////////////////////////////////////////////
+// Message helpers
+///////////////////////////////////////////////////////////
+
+/* Whether each send on the socket is one message that must come from a single
+ * buffer, rather than part of a byte stream. */
+static bool _syscallhandler_isMessageSocket(SysCallHandler* sys, int sockfd) {
+    LegacyDescriptor* desc = process_getRegisteredLegacyDescriptor(sys->process, sockfd);
+    if (!desc) {
+        return false;
+    }
+
+    LegacyDescriptorType type = descriptor_getType(desc);
+    return type == DT_UDPSOCKET ||
+           (type == DT_UNIXSOCKET && channel_preservesMessageBoundaries((Channel*)desc));
+}
+
+/* Copies the iovec array of msg from the plugin into a new array, which the
+ * caller must free. */
+static int _syscallhandler_readMsgIov(SysCallHandler* sys, const struct msghdr* msg,
+                                      struct iovec** iov_out) {
+    *iov_out = NULL;
+
+    if (msg->msg_iovlen == 0) {
+        return 0;
+    } else if (msg->msg_iovlen > UIO_MAXIOV) {
+        return -EMSGSIZE;
+    } else if (!msg->msg_iov) {
+        return -EFAULT;
+    }
+
+    PluginPtr iovPtr = (PluginPtr){.val = (uint64_t)msg->msg_iov};
+    struct iovec* iov = malloc(msg->msg_iovlen * sizeof(*iov));
+    if (process_readPtr(sys->process, iov, iovPtr, msg->msg_iovlen * sizeof(*iov)) != 0) {
+        free(iov);
+        return -EFAULT;
+    }
+
+    *iov_out = iov;
+    return 0;
+}
+
+/* Gets the one buffer that holds a message's data. Unix sockets don't yet
+ * gather a message from, or scatter it to, more than one non-empty buffer. */
+static int _syscallhandler_getMsgBuffer(const struct iovec* iov, size_t iovlen, PluginPtr* bufPtr,
+                                        size_t* bufSize) {
+    *bufPtr = (PluginPtr){0};
+    *bufSize = 0;
+
+    for (size_t i = 0; i < iovlen; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        if (*bufSize > 0) {
+            warning("Messages split across more than one iovec are not yet supported");
+            return -ENOTSUP;
+        }
+        *bufPtr = (PluginPtr){.val = (uint64_t)iov[i].iov_base};
+        *bufSize = iov[i].iov_len;
+    }
+
+    return 0;
+}
+
+/* Gets the segment size of a UDP_SEGMENT control message, leaving it unchanged
+ * if there isn't one. */
+static int _syscallhandler_readSegmentSize(SysCallHandler* sys, const struct msghdr* msg,
+                                           uint16_t* segmentSize) {
+    if (!msg->msg_control || msg->msg_controllen == 0) {
+        return 0;
+    } else if (msg->msg_controllen > SYSCALL_MSG_CONTROL_MAX_SIZE) {
+        return -ENOBUFS;
+    }
+
+    union {
+        struct cmsghdr align;
+        char buf[SYSCALL_MSG_CONTROL_MAX_SIZE];
+    } control;
+
+    PluginPtr controlPtr = (PluginPtr){.val = (uint64_t)msg->msg_control};
+    if (process_readPtr(sys->process, control.buf, controlPtr, msg->msg_controllen) != 0) {
+        return -EFAULT;
+    }
+
+    struct msghdr local = {.msg_control = control.buf, .msg_controllen = msg->msg_controllen};
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&local); cmsg; cmsg = CMSG_NXTHDR(&local, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_SEGMENT) {
+            if (cmsg->cmsg_len != CMSG_LEN(sizeof(*segmentSize))) {
+                return -EINVAL;
+            }
+            memcpy(segmentSize, CMSG_DATA(cmsg), sizeof(*segmentSize));
+        } else {
+            warning("Ignoring unsupported control message with level %d and type %d",
+                    cmsg->cmsg_level, cmsg->cmsg_type);
+        }
+    }
+
+    return 0;
+}
+
+/* Fills out with the parts of iov that hold the len bytes starting at offset,
+ * and returns how many entries it used. out must have room for iovlen entries. */
+static size_t _syscallhandler_sliceIov(const struct iovec* iov, size_t iovlen, size_t offset,
+                                       size_t len, struct iovec* out) {
+    size_t outlen = 0;
+    for (size_t i = 0; i < iovlen && len > 0; i++) {
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+        size_t sliceLen = MIN(iov[i].iov_len - offset, len);
+        out[outlen++] = (struct iovec){.iov_base = (char*)iov[i].iov_base + offset,
+                                       .iov_len = sliceLen};
+        len -= sliceLen;
+        offset = 0;
+    }
+    return outlen;
+}
+
+/* Sends the buffers as datagrams of segmentSize bytes (the last may be shorter),
+ * as with UDP generic segmentation offload. Only the first one may block. */
+static SysCallReturn _syscallhandler_sendSegmentsHelper(SysCallHandler* sys, int sockfd,
+                                                        const struct iovec* iov, size_t iovlen,
+                                                        int flags, PluginPtr destAddrPtr,
+                                                        socklen_t addrlen, size_t segmentSize) {
+    size_t bufSize = 0;
+    for (size_t i = 0; i < iovlen; i++) {
+        bufSize += iov[i].iov_len;
+    }
+
+    if (segmentSize == 0 || bufSize <= segmentSize) {
+        return _syscallhandler_sendIovHelper(
+            sys, sockfd, iov, iovlen, flags, destAddrPtr, addrlen);
+    }
+
+    if ((bufSize + segmentSize - 1) / segmentSize > UDP_MAX_SEGMENTS) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINVAL};
+    }
+
+    size_t numSent = 0;
+    SysCallReturn scr = {0};
+    struct iovec* segmentIov = malloc(iovlen * sizeof(*segmentIov));
+
+    while (numSent < bufSize) {
+        size_t segmentLength = MIN(segmentSize, bufSize - numSent);
+        size_t segmentIovlen =
+            _syscallhandler_sliceIov(iov, iovlen, numSent, segmentLength, segmentIov);
+        int segmentFlags = (numSent > 0) ? (flags | MSG_DONTWAIT) : flags;
+
+        scr = _syscallhandler_sendIovHelper(
+            sys, sockfd, segmentIov, segmentIovlen, segmentFlags, destAddrPtr, addrlen);
+        if (scr.state != SYSCALL_DONE || scr.retval.as_i64 < 0) {
+            break;
+        }
+
+        numSent += (size_t)scr.retval.as_i64;
+    }
+
+    free(segmentIov);
+
+    if (numSent > 0) {
+        /* report the datagrams that we sent; the error will happen again on the next send */
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = numSent};
+    }
+
+    return scr;
+}
+
+/* Sends the message at msgPtr, as sendmsg() does. */
+static SysCallReturn _syscallhandler_sendmsgHelper(SysCallHandler* sys, int sockfd,
+                                                   PluginPtr msgPtr, int flags) {
+    struct msghdr msg;
+    if (process_readPtr(sys->process, &msg, msgPtr, sizeof(msg)) != 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+    }
+
+    uint16_t segmentSize = 0;
+    int errcode = _syscallhandler_readSegmentSize(sys, &msg, &segmentSize);
+    if (errcode < 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+    }
+
+    struct iovec* iov = NULL;
+    errcode = _syscallhandler_readMsgIov(sys, &msg, &iov);
+    if (errcode < 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+    }
+
+    PluginPtr destAddrPtr = (PluginPtr){.val = (uint64_t)msg.msg_name};
+    socklen_t addrlen = msg.msg_name ? msg.msg_namelen : 0;
+    SysCallReturn scr = {0};
+
+    LegacyDescriptor* desc = process_getRegisteredLegacyDescriptor(sys->process, sockfd);
+    LegacyDescriptorType type = desc ? descriptor_getType(desc) : DT_NONE;
+
+    if (type == DT_TCPSOCKET || type == DT_UDPSOCKET) {
+        /* gather the whole message straight into the packets; only UDP sockets segment it */
+        scr = _syscallhandler_sendSegmentsHelper(sys, sockfd, iov, msg.msg_iovlen, flags,
+                                                 destAddrPtr, addrlen,
+                                                 type == DT_UDPSOCKET ? segmentSize : 0);
+    } else if (_syscallhandler_isMessageSocket(sys, sockfd)) {
+        PluginPtr bufPtr;
+        size_t bufSize;
+        errcode = _syscallhandler_getMsgBuffer(iov, msg.msg_iovlen, &bufPtr, &bufSize);
+
+        if (errcode < 0) {
+            scr = (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+        } else {
+            /* an empty message still needs a valid buffer */
+            if (!bufPtr.val) {
+                bufPtr = msgPtr;
+            }
+            scr = _syscallhandler_sendtoHelper(
+                sys, sockfd, bufPtr, bufSize, flags, destAddrPtr, addrlen);
+        }
+    } else {
+        /* send each buffer in turn, like writev() */
+        size_t numSent = 0;
+        scr = (SysCallReturn){
+            .state = SYSCALL_DONE,
+            .retval.as_i64 = _syscallhandler_validateSocketHelper(sys, sockfd, NULL)};
+
+        for (size_t i = 0; i < msg.msg_iovlen; i++) {
+            if (iov[i].iov_len == 0) {
+                continue;
+            }
+
+            PluginPtr bufPtr = (PluginPtr){.val = (uint64_t)iov[i].iov_base};
+            int bufFlags = (numSent > 0) ? (flags | MSG_DONTWAIT) : flags;
+
+            scr = _syscallhandler_sendtoHelper(
+                sys, sockfd, bufPtr, iov[i].iov_len, bufFlags, destAddrPtr, addrlen);
+            if (scr.state != SYSCALL_DONE || scr.retval.as_i64 < 0) {
+                break;
+            }
+
+            numSent += (size_t)scr.retval.as_i64;
+            if ((size_t)scr.retval.as_i64 < iov[i].iov_len) {
+                break;
+            }
+        }
+
+        if (numSent > 0) {
+            scr = (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = numSent};
+        }
+    }
+
+    free(iov);
+    return scr;
+}
+
+/* Receives into the message at msgPtr, as recvmsg() does. */
+static SysCallReturn _syscallhandler_recvmsgHelper(SysCallHandler* sys, int sockfd,
+                                                   PluginPtr msgPtr, int flags) {
+    struct msghdr msg;
+    if (process_readPtr(sys->process, &msg, msgPtr, sizeof(msg)) != 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+    }
+
+    struct iovec* iov = NULL;
+    int errcode = _syscallhandler_readMsgIov(sys, &msg, &iov);
+    if (errcode < 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+    }
+
+    /* the source address length is returned in the plugin's msghdr */
+    PluginPtr srcAddrPtr = (PluginPtr){.val = (uint64_t)msg.msg_name};
+    PluginPtr addrlenPtr = (PluginPtr){0};
+    if (srcAddrPtr.val) {
+        addrlenPtr.val = msgPtr.val + offsetof(struct msghdr, msg_namelen);
+    }
+
+    SysCallReturn scr = {0};
+    LegacyDescriptor* desc = process_getRegisteredLegacyDescriptor(sys->process, sockfd);
+
+    if (desc && descriptor_getType(desc) == DT_UDPSOCKET) {
+        /* scatter the datagram straight from its packet */
+        scr = _syscallhandler_recvIovHelper(
+            sys, sockfd, iov, msg.msg_iovlen, flags, srcAddrPtr, addrlenPtr);
+    } else if (_syscallhandler_isMessageSocket(sys, sockfd)) {
+        PluginPtr bufPtr;
+        size_t bufSize;
+        errcode = _syscallhandler_getMsgBuffer(iov, msg.msg_iovlen, &bufPtr, &bufSize);
+
+        if (errcode < 0) {
+            scr = (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+        } else {
+            scr = _syscallhandler_recvfromHelper(
+                sys, sockfd, bufPtr, bufSize, flags, srcAddrPtr, addrlenPtr);
+        }
+    } else {
+        /* receive into each buffer in turn, like readv() */
+        size_t numReceived = 0;
+        scr = (SysCallReturn){
+            .state = SYSCALL_DONE,
+            .retval.as_i64 = _syscallhandler_validateSocketHelper(sys, sockfd, NULL)};
+
+        for (size_t i = 0; i < msg.msg_iovlen; i++) {
+            if (iov[i].iov_len == 0) {
+                continue;
+            }
+
+            PluginPtr bufPtr = (PluginPtr){.val = (uint64_t)iov[i].iov_base};
+            int bufFlags = (numReceived > 0) ? (flags | MSG_DONTWAIT) : flags;
+
+            scr = _syscallhandler_recvfromHelper(sys, sockfd, bufPtr, iov[i].iov_len, bufFlags,
+                                                 numReceived > 0 ? (PluginPtr){0} : srcAddrPtr,
+                                                 numReceived > 0 ? (PluginPtr){0} : addrlenPtr);
+            if (scr.state != SYSCALL_DONE || scr.retval.as_i64 <= 0) {
+                break;
+            }
+
+            numReceived += (size_t)scr.retval.as_i64;
+            if ((size_t)scr.retval.as_i64 < iov[i].iov_len) {
+                break;
+            }
+        }
+
+        if (numReceived > 0) {
+            scr = (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = numReceived};
+        }
+    }
+
+    free(iov);
+
+    if (scr.state == SYSCALL_DONE && scr.retval.as_i64 >= 0) {
+        /* we don't return any control messages or flags */
+        size_t zero = 0;
+        int msgFlags = 0;
+        PluginPtr controllenPtr = {.val = msgPtr.val + offsetof(struct msghdr, msg_controllen)};
+        PluginPtr flagsPtr = {.val = msgPtr.val + offsetof(struct msghdr, msg_flags)};
+
+        if (process_writePtr(sys->process, controllenPtr, &zero, sizeof(msg.msg_controllen)) !=
+                0 ||
+            process_writePtr(sys->process, flagsPtr, &msgFlags, sizeof(msg.msg_flags)) != 0) {
+            return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+        }
+    }
+
+    return scr;
+}
+
+/* Transfers each message of the mmsghdr array at msgvecPtr in turn, using
+ * function, and stores each message's length in the array. Only the first
+ * message may block. Returns the number of messages transferred. */
+static SysCallReturn _syscallhandler_mmsgHelper(
+    SysCallHandler* sys, int sockfd, PluginPtr msgvecPtr, unsigned int vlen, int flags,
+    SysCallReturn (*function)(SysCallHandler*, int, PluginPtr, int)) {
+    vlen = MIN(vlen, UIO_MAXIOV);
+
+    unsigned int numMessages = 0;
+
+    for (; numMessages < vlen; numMessages++) {
+        PluginPtr mmsgPtr = {.val = msgvecPtr.val + numMessages * sizeof(struct mmsghdr)};
+        PluginPtr msgPtr = {.val = mmsgPtr.val + offsetof(struct mmsghdr, msg_hdr)};
+        PluginPtr lenPtr = {.val = mmsgPtr.val + offsetof(struct mmsghdr, msg_len)};
+        int msgFlags = (numMessages > 0) ? (flags | MSG_DONTWAIT) : flags;
+
+        SysCallReturn scr = function(sys, sockfd, msgPtr, msgFlags);
+
+        if (scr.state != SYSCALL_DONE || scr.retval.as_i64 < 0) {
+            if (numMessages == 0) {
+                return scr;
+            }
+            if (scr.state == SYSCALL_BLOCK) {
+                syscallcondition_unref(scr.cond);
+            }
+            /* the error will happen again on the next call */
+            break;
+        }
+
+        /* the message's buffers may still be referenced */
+        process_flushPtrs(sys->process);
+
+        unsigned int len = (unsigned int)scr.retval.as_i64;
+        if (process_writePtr(sys->process, lenPtr, &len, sizeof(len)) != 0) {
+            if (numMessages == 0) {
+                return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+            }
+            break;
+        }
+    }
+
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = numMessages};
+}
+
 ///////////////////////////////////////////////////////////
 // System Calls
 ///////////////////////////////////////////////////////////
@@ -848,7 +1330,8 @@ SysCallReturn syscallhandler_connect(SysCallHandler* sys,
                           .object = desc,
                           .status = STATUS_DESCRIPTOR_ACTIVE | STATUS_DESCRIPTOR_WRITABLE};
             return (SysCallReturn){
-                .state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+                .state = SYSCALL_BLOCK,
+                .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
         } else if (_syscallhandler_wasBlocked(sys) && errcode == -EISCONN) {
             /* It was EINPROGRESS, but is now a successful blocking connect. */
             errcode = 0;
@@ -1018,7 +1501,12 @@ SysCallReturn syscallhandler_getsockopt(SysCallHandler* sys,
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
     }
 
+    /* Both are written back together when the syscall completes. */
     void* optval = process_getWriteablePtr(sys->process, optvalPtr, optlen);
+    socklen_t* optlenOut = process_getWriteablePtr(sys->process, optlenPtr, sizeof(*optlenOut));
+    if (!optval || !optlenOut) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
+    }
 
     errcode = 0;
     switch (level) {
@@ -1043,10 +1531,7 @@ SysCallReturn syscallhandler_getsockopt(SysCallHandler* sys,
             break;
     }
 
-    process_flushPtrs(sys->process);
-    if (process_writePtr(sys->process, optlenPtr, &optlen, sizeof(optlen)) != 0) {
-        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EFAULT};
-    }
+    *optlenOut = optlen;
 
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
 }
@@ -1074,11 +1559,10 @@ SysCallReturn syscallhandler_listen(SysCallHandler* sys,
             .state = SYSCALL_DONE, .retval.as_i64 = -EOPNOTSUPP};
     }
 
-    /* if we are already listening, just return 0.
-     * linux may actually update the backlog to the new backlog passed into this
-     * function, but we currently do not make use of the backlog. */
+    /* if we are already listening, just update the backlog like linux does. */
     if (tcp_isValidListener(tcp_desc)) {
         trace("Socket %i already set up as a listener", sockfd);
+        tcp_updateServerBacklog(tcp_desc, backlog);
         return (SysCallReturn){.state = SYSCALL_DONE};
     }
 
@@ -1098,6 +1582,29 @@ SysCallReturn syscallhandler_listen(SysCallHandler* sys,
     return (SysCallReturn){.state = SYSCALL_DONE};
 }
 
+SysCallReturn syscallhandler_recvmmsg(SysCallHandler* sys, const SysCallArgs* args) {
+    int sockfd = args->args[0].as_i64;
+    PluginPtr msgvecPtr = args->args[1].as_ptr; // struct mmsghdr*
+    unsigned int vlen = args->args[2].as_u64;
+    int flags = args->args[3].as_i64;
+    PluginPtr timeoutPtr = args->args[4].as_ptr; // struct timespec*
+
+    /* Linux only checks the timeout after receiving each message, and we
+     * return once no more messages are ready (as with MSG_WAITFORONE), so the
+     * timeout never expires first. */
+    if (timeoutPtr.val) {
+        trace("Ignoring recvmmsg() timeout");
+    }
+
+    return _syscallhandler_mmsgHelper(
+        sys, sockfd, msgvecPtr, vlen, flags & ~MSG_WAITFORONE, _syscallhandler_recvmsgHelper);
+}
+
+SysCallReturn syscallhandler_recvmsg(SysCallHandler* sys, const SysCallArgs* args) {
+    return _syscallhandler_recvmsgHelper(
+        sys, args->args[0].as_i64, args->args[1].as_ptr, args->args[2].as_i64);
+}
+
 SysCallReturn syscallhandler_recvfrom(SysCallHandler* sys,
                                       const SysCallArgs* args) {
     return _syscallhandler_recvfromHelper(
@@ -1105,6 +1612,17 @@ SysCallReturn syscallhandler_recvfrom(SysCallHandler* sys,
         args->args[3].as_i64, args->args[4].as_ptr, args->args[5].as_ptr);
 }
 
+SysCallReturn syscallhandler_sendmmsg(SysCallHandler* sys, const SysCallArgs* args) {
+    return _syscallhandler_mmsgHelper(sys, args->args[0].as_i64, args->args[1].as_ptr,
+                                      args->args[2].as_u64, args->args[3].as_i64,
+                                      _syscallhandler_sendmsgHelper);
+}
+
+SysCallReturn syscallhandler_sendmsg(SysCallHandler* sys, const SysCallArgs* args) {
+    return _syscallhandler_sendmsgHelper(
+        sys, args->args[0].as_i64, args->args[1].as_ptr, args->args[2].as_i64);
+}
+
 SysCallReturn syscallhandler_sendto(SysCallHandler* sys,
                                     const SysCallArgs* args) {
     return _syscallhandler_sendtoHelper(
@@ -1290,8 +1808,10 @@ SysCallReturn syscallhandler_socketpair(SysCallHandler* sys, const SysCallArgs*
 
     /* The below are warnings so the Shadow user knows that we don't support
      * everything that Linux supports. */
-    if (type_no_flags != SOCK_STREAM && type_no_flags != SOCK_DGRAM) {
-        warning("unsupported socket type \"%i\", we only support SOCK_STREAM and SOCK_DGRAM",
+    if (type_no_flags != SOCK_STREAM && type_no_flags != SOCK_DGRAM &&
+        type_no_flags != SOCK_SEQPACKET) {
+        warning("unsupported socket type \"%i\", we only support SOCK_STREAM, SOCK_DGRAM, and "
+                "SOCK_SEQPACKET",
                 type_no_flags);
         return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EPROTONOSUPPORT};
     } else if (protocol != 0) {
@@ -1306,6 +1826,11 @@ SysCallReturn syscallhandler_socketpair(SysCallHandler* sys, const SysCallArgs*
     channel_setLinkedChannel(socketA, socketB);
     channel_setLinkedChannel(socketB, socketA);
 
+    if (type_no_flags != SOCK_STREAM) {
+        channel_setPreserveMessageBoundaries(socketA);
+        channel_setPreserveMessageBoundaries(socketB);
+    }
+
     /* Set any options that were given. */
     if (type & SOCK_NONBLOCK) {
         descriptor_addFlags((LegacyDescriptor*)socketA, O_NONBLOCK);
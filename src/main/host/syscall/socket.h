@@ -6,6 +6,8 @@
 #ifndef SRC_MAIN_HOST_SYSCALL_SOCKET_H_
 #define SRC_MAIN_HOST_SYSCALL_SOCKET_H_
 
+#include <sys/uio.h>
+
 #include "main/host/syscall/protected.h"
 
 SYSCALL_HANDLER(accept);
@@ -17,6 +19,10 @@ SYSCALL_HANDLER(getsockname);
 SYSCALL_HANDLER(getsockopt);
 SYSCALL_HANDLER(listen);
 SYSCALL_HANDLER(recvfrom);
+SYSCALL_HANDLER(recvmmsg);
+SYSCALL_HANDLER(recvmsg);
+SYSCALL_HANDLER(sendmmsg);
+SYSCALL_HANDLER(sendmsg);
 SYSCALL_HANDLER(sendto);
 SYSCALL_HANDLER(setsockopt);
 SYSCALL_HANDLER(shutdown);
@@ -35,4 +41,17 @@ SysCallReturn _syscallhandler_sendtoHelper(SysCallHandler* sys, int sockfd,
                                            int flags, PluginPtr destAddrPtr,
                                            socklen_t addrlen);
 
+/* Protected helper to allow recvmsg() to receive into all of its buffers at
+ * once. UDP scatters each datagram straight from its packet. */
+SysCallReturn _syscallhandler_recvIovHelper(SysCallHandler* sys, int sockfd,
+                                            const struct iovec* iov, size_t iovlen, int flags,
+                                            PluginPtr srcAddrPtr, PluginPtr addrlenPtr);
+
+/* Protected helper to allow writev(sockfd) and sendmsg() to send from all of
+ * their buffers at once. TCP and UDP gather the buffers straight into their
+ * packets, so a UDP datagram may span several buffers. */
+SysCallReturn _syscallhandler_sendIovHelper(SysCallHandler* sys, int sockfd,
+                                            const struct iovec* iov, size_t iovlen, int flags,
+                                            PluginPtr destAddrPtr, socklen_t addrlen);
+
 #endif /* SRC_MAIN_HOST_SYSCALL_SOCKET_H_ */
@@ -0,0 +1,436 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/host/syscall/splice.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "lib/logger/logger.h"
+#include "main/bindings/c/bindings.h"
+#include "main/host/descriptor/descriptor.h"
+#include "main/host/descriptor/file.h"
+#include "main/host/descriptor/tcp.h"
+#include "main/host/process.h"
+#include "main/host/syscall/protected.h"
+#include "main/host/syscall_condition.h"
+#include "main/host/thread.h"
+
+/* The most data we move in one syscall. TCP won't accept more than this in
+ * one send anyway. */
+#define SPLICE_BUFSIZE 65536
+
+typedef enum _SpliceEndType SpliceEndType;
+enum _SpliceEndType {
+    SPLICE_END_FILE,
+    SPLICE_END_PIPE,
+    SPLICE_END_TCP,
+};
+
+/* One side of a transfer. The data never leaves Shadow, so the plugin doesn't
+ * need to read it into its own memory and write it back to us. */
+typedef struct _SpliceEnd SpliceEnd;
+struct _SpliceEnd {
+    SpliceEndType type;
+    const CompatDescriptor* compatDesc;
+    /* set for files and sockets */
+    LegacyDescriptor* desc;
+    /* set for pipes; borrowed from compatDesc */
+    const PosixFileArc* pipe;
+};
+
+///////////////////////////////////////////////////////////
+// Helpers
+///////////////////////////////////////////////////////////
+
+static int _syscallhandler_getSpliceEnd(SysCallHandler* sys, int fd, SpliceEnd* end) {
+    if (fd < 0) {
+        return -EBADF;
+    }
+
+    const CompatDescriptor* compatDesc = process_getRegisteredCompatDescriptor(sys->process, fd);
+    if (!compatDesc) {
+        return -EBADF;
+    }
+
+    *end = (SpliceEnd){.compatDesc = compatDesc};
+
+    LegacyDescriptor* desc = compatdescriptor_asLegacy(compatDesc);
+    if (!desc) {
+        /* pipes are the only new-style descriptors */
+        end->type = SPLICE_END_PIPE;
+        end->pipe = compatdescriptor_borrowPosixFile(compatDesc);
+        return 0;
+    }
+
+    int errcode = _syscallhandler_validateDescriptor(desc, DT_NONE);
+    if (errcode != 0) {
+        return errcode;
+    }
+
+    end->desc = desc;
+
+    switch (descriptor_getType(desc)) {
+        case DT_FILE: end->type = SPLICE_END_FILE; return 0;
+        case DT_TCPSOCKET: end->type = SPLICE_END_TCP; return 0;
+        default:
+            /* we don't (yet) move data through other types of descriptors */
+            debug("descriptor %i can't be used to splice data", fd);
+            return -EINVAL;
+    }
+}
+
+/* Same rules as sendto() on a TCP socket. */
+static int _syscallhandler_checkTCPSendable(TCP* tcp) {
+    int errcode = tcp_getConnectionError(tcp);
+
+    if (errcode > 0) {
+        return -ENOTCONN;
+    } else if (errcode == -EALREADY) {
+        /* wait for the connection to be established */
+        return -EWOULDBLOCK;
+    } else if (errcode == -EISCONN || errcode == 0) {
+        return 0;
+    }
+    return errcode;
+}
+
+static bool _syscallhandler_isSpliceEndNonblocking(const SpliceEnd* end, bool spliceNonblock) {
+    switch (end->type) {
+        case SPLICE_END_PIPE:
+            return spliceNonblock || (posixfile_getFlags(end->pipe) & O_NONBLOCK);
+        case SPLICE_END_TCP: return descriptor_getFlags(end->desc) & O_NONBLOCK;
+        case SPLICE_END_FILE: return true;
+    }
+    return true;
+}
+
+/* Copies up to len bytes of data out of the input, without removing it. */
+static ssize_t _syscallhandler_spliceRead(SysCallHandler* sys, const SpliceEnd* in, off_t offset,
+                                          void* buf, size_t len) {
+    switch (in->type) {
+        case SPLICE_END_FILE: return file_pread((File*)in->desc, sys->host, buf, len, offset);
+        case SPLICE_END_PIPE: return posixfile_peek(in->pipe, (size_t)offset, buf, len);
+        case SPLICE_END_TCP: return -EINVAL;
+    }
+    return -EINVAL;
+}
+
+static ssize_t _syscallhandler_spliceWrite(SysCallHandler* sys, const SpliceEnd* out,
+                                           off_t* offset, const void* buf, size_t len) {
+    switch (out->type) {
+        case SPLICE_END_FILE:
+            if (offset) {
+                return file_pwrite((File*)out->desc, buf, len, *offset);
+            }
+            return file_write((File*)out->desc, buf, len);
+        case SPLICE_END_PIPE: return posixfile_write(out->pipe, buf, len);
+        case SPLICE_END_TCP: return tcp_sendShadowData((TCP*)out->desc, sys->host, buf, len);
+    }
+    return -EINVAL;
+}
+
+/* Moves up to len bytes from in to out. Input is only advanced past (or, for
+ * pipes, removed) once the output accepted it, and not at all for tee. If
+ * nothing was moved, blockedOn is set to the end that we would need to wait
+ * for. Returns the number of bytes moved or a negative errno. */
+static ssize_t _syscallhandler_spliceHelper(SysCallHandler* sys, const SpliceEnd* in,
+                                            off_t* inOffset, const SpliceEnd* out,
+                                            off_t* outOffset, size_t len, bool consumeInput,
+                                            const SpliceEnd** blockedOn) {
+    *blockedOn = NULL;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    if (out->type == SPLICE_END_TCP) {
+        int errcode = _syscallhandler_checkTCPSendable((TCP*)out->desc);
+        if (errcode == -EWOULDBLOCK) {
+            *blockedOn = out;
+        }
+        if (errcode != 0) {
+            return errcode;
+        }
+    }
+
+    /* files are read from the given offset, or their file position */
+    off_t readPos = 0;
+    if (in->type == SPLICE_END_FILE) {
+        readPos = inOffset ? *inOffset : file_lseek((File*)in->desc, 0, SEEK_CUR);
+        if (readPos < 0) {
+            return readPos;
+        }
+    }
+
+    size_t bufSize = MIN(len, SPLICE_BUFSIZE);
+    void* buf = g_malloc(bufSize);
+
+    ssize_t result = 0;
+    size_t total = 0;
+
+    while (total < len) {
+        size_t chunk = MIN(len - total, bufSize);
+
+        /* pipes we don't consume from are read past what we've already copied */
+        off_t peekOffset = (in->type == SPLICE_END_PIPE) ? (consumeInput ? 0 : total) : readPos;
+
+        ssize_t numRead = _syscallhandler_spliceRead(sys, in, peekOffset, buf, chunk);
+        if (numRead <= 0) {
+            if (numRead == -EWOULDBLOCK) {
+                *blockedOn = in;
+            }
+            result = numRead;
+            break;
+        }
+
+        ssize_t numWritten = _syscallhandler_spliceWrite(sys, out, outOffset, buf, numRead);
+        if (numWritten <= 0) {
+            if (numWritten == -EWOULDBLOCK) {
+                *blockedOn = out;
+            }
+            result = numWritten;
+            break;
+        }
+
+        if (in->type == SPLICE_END_FILE) {
+            readPos += numWritten;
+        } else if (consumeInput) {
+            posixfile_consume(in->pipe, numWritten);
+        }
+        if (outOffset) {
+            *outOffset += numWritten;
+        }
+
+        total += numWritten;
+
+        if (numWritten < numRead || (size_t)numRead < chunk) {
+            /* the output is full or the input is drained */
+            break;
+        }
+    }
+
+    g_free(buf);
+
+    if (in->type == SPLICE_END_FILE) {
+        if (inOffset) {
+            *inOffset = readPos;
+        } else if (total > 0) {
+            file_lseek((File*)in->desc, readPos, SEEK_SET);
+        }
+    }
+
+    trace("moved %zu of %zu bytes", total, len);
+
+    if (total > 0) {
+        *blockedOn = NULL;
+        return (ssize_t)total;
+    }
+    return result;
+}
+
+static SysCallReturn _syscallhandler_blockOnSpliceEnd(SysCallHandler* sys, const SpliceEnd* end,
+                                                      bool isInput) {
+    Trigger trigger = {0};
+
+    if (end->type == SPLICE_END_PIPE) {
+        /* the condition drops this reference when it's freed */
+        trigger = (Trigger){.type = TRIGGER_POSIX_FILE,
+                            .object.as_file = compatdescriptor_newRefPosixFile(end->compatDesc),
+                            .status = isInput ? STATUS_DESCRIPTOR_READABLE
+                                              : STATUS_DESCRIPTOR_WRITABLE};
+    } else {
+        trigger = (Trigger){.type = TRIGGER_DESCRIPTOR,
+                            .object.as_descriptor = end->desc,
+                            .status = STATUS_DESCRIPTOR_WRITABLE};
+    }
+
+    return (SysCallReturn){
+        .state = SYSCALL_BLOCK, .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
+}
+
+/* Like a write, moving data to a pipe or socket that nothing reads from raises SIGPIPE. */
+static void _syscallhandler_raiseSIGPIPE(SysCallHandler* sys) {
+    if (process_getInterposeMethod(sys->process) == INTERPOSE_METHOD_PRELOAD) {
+        /* the shim raises it when the thread gets the syscall result */
+        process_signal(sys->process, SIGPIPE, false);
+    } else {
+        thread_nativeSyscall(sys->thread, SYS_tgkill, process_getNativePid(sys->process),
+                             thread_getNativeTid(sys->thread), SIGPIPE);
+    }
+}
+
+static SysCallReturn _syscallhandler_spliceFinish(SysCallHandler* sys, const SpliceEnd* in,
+                                                  ssize_t result, const SpliceEnd* blockedOn,
+                                                  bool spliceNonblock) {
+    if (result == -EPIPE) {
+        _syscallhandler_raiseSIGPIPE(sys);
+    }
+
+    if (result == -EWOULDBLOCK && blockedOn &&
+        !_syscallhandler_isSpliceEndNonblocking(blockedOn, spliceNonblock)) {
+        return _syscallhandler_blockOnSpliceEnd(sys, blockedOn, blockedOn == in);
+    }
+
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = (int64_t)result};
+}
+
+static int _syscallhandler_readOffset(SysCallHandler* sys, PluginPtr offsetPtr, off_t* offset) {
+    if (!offsetPtr.val) {
+        return 0;
+    }
+    if (process_readPtr(sys->process, offset, offsetPtr, sizeof(*offset)) != 0) {
+        return -EFAULT;
+    }
+    if (*offset < 0) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int _syscallhandler_writeOffset(SysCallHandler* sys, PluginPtr offsetPtr, off_t offset) {
+    if (!offsetPtr.val) {
+        return 0;
+    }
+    if (process_writePtr(sys->process, offsetPtr, &offset, sizeof(offset)) != 0) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////
+// System Calls
+///////////////////////////////////////////////////////////
+
+SysCallReturn syscallhandler_sendfile(SysCallHandler* sys, const SysCallArgs* args) {
+    int outFd = args->args[0].as_i64;
+    int inFd = args->args[1].as_i64;
+    PluginPtr offsetPtr = args->args[2].as_ptr; // off_t*
+    size_t count = args->args[3].as_u64;
+
+    trace("trying to sendfile %zu bytes from fd %i to fd %i", count, inFd, outFd);
+
+    SpliceEnd in = {0}, out = {0};
+    int errcode = _syscallhandler_getSpliceEnd(sys, inFd, &in);
+    if (errcode == 0) {
+        errcode = _syscallhandler_getSpliceEnd(sys, outFd, &out);
+    }
+    if (errcode == 0 && in.type != SPLICE_END_FILE) {
+        /* the input must support mmap-like operations */
+        errcode = -EINVAL;
+    }
+
+    off_t offset = 0;
+    if (errcode == 0) {
+        errcode = _syscallhandler_readOffset(sys, offsetPtr, &offset);
+    }
+    if (errcode != 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+    }
+
+    const SpliceEnd* blockedOn = NULL;
+    ssize_t result = _syscallhandler_spliceHelper(
+        sys, &in, offsetPtr.val ? &offset : NULL, &out, NULL, count, true, &blockedOn);
+
+    if (result > 0) {
+        errcode = _syscallhandler_writeOffset(sys, offsetPtr, offset);
+        if (errcode != 0) {
+            result = errcode;
+        }
+    }
+
+    return _syscallhandler_spliceFinish(sys, &in, result, blockedOn, false);
+}
+
+SysCallReturn syscallhandler_splice(SysCallHandler* sys, const SysCallArgs* args) {
+    int inFd = args->args[0].as_i64;
+    PluginPtr inOffsetPtr = args->args[1].as_ptr; // off64_t*
+    int outFd = args->args[2].as_i64;
+    PluginPtr outOffsetPtr = args->args[3].as_ptr; // off64_t*
+    size_t len = args->args[4].as_u64;
+    unsigned int flags = args->args[5].as_u64;
+
+    trace("trying to splice %zu bytes from fd %i to fd %i", len, inFd, outFd);
+
+    SpliceEnd in = {0}, out = {0};
+    int errcode = _syscallhandler_getSpliceEnd(sys, inFd, &in);
+    if (errcode == 0) {
+        errcode = _syscallhandler_getSpliceEnd(sys, outFd, &out);
+    }
+    if (errcode == 0 && in.type != SPLICE_END_PIPE && out.type != SPLICE_END_PIPE) {
+        /* one of the descriptors must be a pipe */
+        errcode = -EINVAL;
+    }
+    if (errcode == 0 && in.type == SPLICE_END_TCP) {
+        /* we can't move data out of a socket without going through the plugin */
+        warning("splicing from a socket is not supported");
+        errcode = -EINVAL;
+    }
+    if (errcode == 0 && ((in.type == SPLICE_END_PIPE && inOffsetPtr.val) ||
+                         (out.type != SPLICE_END_FILE && outOffsetPtr.val))) {
+        errcode = -ESPIPE;
+    }
+
+    off_t inOffset = 0, outOffset = 0;
+    if (errcode == 0) {
+        errcode = _syscallhandler_readOffset(sys, inOffsetPtr, &inOffset);
+    }
+    if (errcode == 0) {
+        errcode = _syscallhandler_readOffset(sys, outOffsetPtr, &outOffset);
+    }
+    if (errcode != 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+    }
+
+    const SpliceEnd* blockedOn = NULL;
+    ssize_t result = _syscallhandler_spliceHelper(
+        sys, &in, inOffsetPtr.val ? &inOffset : NULL, &out, outOffsetPtr.val ? &outOffset : NULL,
+        len, true, &blockedOn);
+
+    if (result > 0) {
+        errcode = _syscallhandler_writeOffset(sys, inOffsetPtr, inOffset);
+        if (errcode == 0) {
+            errcode = _syscallhandler_writeOffset(sys, outOffsetPtr, outOffset);
+        }
+        if (errcode != 0) {
+            result = errcode;
+        }
+    }
+
+    return _syscallhandler_spliceFinish(sys, &in, result, blockedOn, flags & SPLICE_F_NONBLOCK);
+}
+
+SysCallReturn syscallhandler_tee(SysCallHandler* sys, const SysCallArgs* args) {
+    int inFd = args->args[0].as_i64;
+    int outFd = args->args[1].as_i64;
+    size_t len = args->args[2].as_u64;
+    unsigned int flags = args->args[3].as_u64;
+
+    trace("trying to tee %zu bytes from fd %i to fd %i", len, inFd, outFd);
+
+    SpliceEnd in = {0}, out = {0};
+    int errcode = _syscallhandler_getSpliceEnd(sys, inFd, &in);
+    if (errcode == 0) {
+        errcode = _syscallhandler_getSpliceEnd(sys, outFd, &out);
+    }
+    if (errcode == 0 && (in.type != SPLICE_END_PIPE || out.type != SPLICE_END_PIPE ||
+                         posixfile_sharesBuffer(in.pipe, out.pipe))) {
+        /* both descriptors must be different pipes, not two ends of one pipe */
+        errcode = -EINVAL;
+    }
+    if (errcode != 0) {
+        return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = errcode};
+    }
+
+    const SpliceEnd* blockedOn = NULL;
+    ssize_t result = _syscallhandler_spliceHelper(sys, &in, NULL, &out, NULL, len, false, &blockedOn);
+
+    return _syscallhandler_spliceFinish(sys, &in, result, blockedOn, flags & SPLICE_F_NONBLOCK);
+}
@@ -0,0 +1,15 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SRC_MAIN_HOST_SYSCALL_SPLICE_H_
+#define SRC_MAIN_HOST_SYSCALL_SPLICE_H_
+
+#include "main/host/syscall/protected.h"
+
+SYSCALL_HANDLER(sendfile);
+SYSCALL_HANDLER(splice);
+SYSCALL_HANDLER(tee);
+
+#endif /* SRC_MAIN_HOST_SYSCALL_SPLICE_H_ */
@@ -57,7 +57,8 @@ SysCallReturn syscallhandler_nanosleep(SysCallHandler* sys,
 
         /* Block the thread, unblock when the timer expires. */
         return (SysCallReturn){
-            .state = SYSCALL_BLOCK, .cond = syscallcondition_new((Trigger){0}, sys->timer)};
+            .state = SYSCALL_BLOCK,
+            .cond = syscallcondition_newForThread(sys->thread, (Trigger){0}, sys->timer)};
     }
 
     /* If needed, verify that the timer expired correctly. */
@@ -26,7 +26,7 @@ static int _syscallhandler_validateVecParams(SysCallHandler* sys, int fd,
                                              PluginPtr iovPtr,
                                              unsigned long iovlen, off_t offset,
                                              LegacyDescriptor** desc_out,
-                                             const struct iovec** iov_out) {
+                                             struct iovec** iov_out) {
     /* Get the descriptor. */
     LegacyDescriptor* desc = process_getRegisteredLegacyDescriptor(sys->process, fd);
     if (!desc) {
@@ -50,8 +50,13 @@ static int _syscallhandler_validateVecParams(SysCallHandler* sys, int fd,
         return -ESPIPE;
     }
 
-    /* Get the vector of pointers. */
-    const struct iovec* iov = process_getReadablePtr(sys->process, iovPtr, iovlen * sizeof(*iov));
+    /* Get a copy of the vector of pointers. We copy it rather than holding a
+     * reference so that we are still allowed to write plugin memory. */
+    struct iovec* iov = malloc(iovlen * sizeof(*iov));
+    if (process_readPtr(sys->process, iov, iovPtr, iovlen * sizeof(*iov)) != 0) {
+        free(iov);
+        return -EFAULT;
+    }
 
     /* Check that all of the buf pointers are valid. */
     for (unsigned long i = 0; i < iovlen; i++) {
@@ -60,11 +65,13 @@ static int _syscallhandler_validateVecParams(SysCallHandler* sys, int fd,
 
         if (!bufPtr.val) {
             debug("Invalid NULL pointer in iovec[%ld]", i);
+            free(iov);
             return -EFAULT;
         }
 
         if (!bufSize) {
             debug("Invalid size 0 in iovec[%ld]", i);
+            free(iov);
             return -EINVAL;
         }
     }
@@ -74,10 +81,32 @@ static int _syscallhandler_validateVecParams(SysCallHandler* sys, int fd,
     }
     if (iov_out) {
         *iov_out = iov;
+    } else {
+        free(iov);
     }
     return 0;
 }
 
+/* Splits the plugin buffers in `iov` into the arrays of pointers and lengths
+ * expected by the vectored process memory accessors, and returns the total
+ * number of bytes they cover. The caller must free the arrays. */
+static size_t _syscallhandler_splitVec(const struct iovec* iov, unsigned long iovlen,
+                                       PluginPtr** ptrs_out, size_t** lens_out) {
+    PluginPtr* ptrs = malloc(iovlen * sizeof(*ptrs));
+    size_t* lens = malloc(iovlen * sizeof(*lens));
+    size_t total = 0;
+
+    for (unsigned long i = 0; i < iovlen; i++) {
+        ptrs[i] = (PluginPtr){.val = (uint64_t)iov[i].iov_base};
+        lens[i] = iov[i].iov_len;
+        total += lens[i];
+    }
+
+    *ptrs_out = ptrs;
+    *lens_out = lens;
+    return total;
+}
+
 static SysCallReturn
 _syscallhandler_readvHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
                             unsigned long iovlen, unsigned long pos_l,
@@ -90,7 +119,7 @@ _syscallhandler_readvHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
           fd, (void*)iovPtr.val, iovlen, pos_l, pos_h, offset, flags);
 
     LegacyDescriptor* desc = NULL;
-    const struct iovec* iov;
+    struct iovec* iov = NULL;
     int errcode = _syscallhandler_validateVecParams(
         sys, fd, iovPtr, iovlen, offset, &desc, &iov);
     if (errcode < 0 || iovlen == 0) {
@@ -104,16 +133,19 @@ _syscallhandler_readvHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
 
     /* Now we can perform the write operations. */
     if (dType == DT_FILE) {
-        /* For files, we read all of the buffers from the plugin and then
-         * let file pwritev handle it. */
+        /* For files, we let file preadv fill one local buffer and then
+         * scatter it to all of the plugin buffers at once. */
+        PluginPtr* bufPtrs = NULL;
+        size_t* bufSizes = NULL;
+        size_t totalSize = _syscallhandler_splitVec(iov, iovlen, &bufPtrs, &bufSizes);
+        char* buffer = malloc(totalSize);
         struct iovec* buffersv = malloc(iovlen * sizeof(*iov));
 
+        size_t bufOffset = 0;
         for (unsigned long i = 0; i < iovlen; i++) {
-            PluginPtr bufPtr = (PluginPtr){.val = (uint64_t)iov[i].iov_base};
-            size_t bufSize = iov[i].iov_len;
-
-            buffersv[i].iov_base = process_getWriteablePtr(sys->process, bufPtr, bufSize);
-            buffersv[i].iov_len = bufSize;
+            buffersv[i].iov_base = buffer + bufOffset;
+            buffersv[i].iov_len = bufSizes[i];
+            bufOffset += bufSizes[i];
         }
 
 #ifdef SYS_preadv2
@@ -125,7 +157,36 @@ _syscallhandler_readvHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
         result = file_preadv((File*)desc, sys->host, buffersv, iovlen, offset);
 #endif
 
+        if (result > 0) {
+            /* Only write back the buffers (and the part of the last one)
+             * that were filled. */
+            size_t remaining = (size_t)result;
+            unsigned long nFilled = 0;
+            while (nFilled < iovlen && remaining > 0) {
+                if (bufSizes[nFilled] > remaining) {
+                    bufSizes[nFilled] = remaining;
+                }
+                remaining -= bufSizes[nFilled];
+                nFilled++;
+            }
+
+            int writeErr = process_writePtrs(sys->process, bufPtrs, bufSizes, nFilled, buffer);
+            if (writeErr != 0) {
+                result = writeErr;
+            }
+        }
+
         free(buffersv);
+        free(buffer);
+        free(bufSizes);
+        free(bufPtrs);
+    } else if (dType == DT_UDPSOCKET) {
+        /* A datagram is scattered across all of the buffers straight from its
+         * packet, rather than each buffer taking a datagram of its own. */
+        SysCallReturn scr = _syscallhandler_recvIovHelper(
+            sys, fd, iov, iovlen, 0, (PluginPtr){0}, (PluginPtr){0});
+        free(iov);
+        return scr;
     } else {
         /* For non-files, we only read one buffer at a time to avoid
          * unnecessary data transfer between the plugin and Shadow. */
@@ -146,8 +207,12 @@ _syscallhandler_readvHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
                         (Transport*)desc, sys->thread, bufPtr, bufSize, NULL, NULL);
                     break;
                 }
-                case DT_TCPSOCKET:
                 case DT_UDPSOCKET: {
+                    /* Handled above. */
+                    utility_assert(0);
+                    break;
+                }
+                case DT_TCPSOCKET: {
                     SysCallReturn scr = _syscallhandler_recvfromHelper(
                         sys, fd, bufPtr, bufSize, 0, (PluginPtr){0},
                         (PluginPtr){0});
@@ -177,6 +242,8 @@ _syscallhandler_readvHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
         }
     }
 
+    free(iov);
+
     if (result == -EWOULDBLOCK && !(descriptor_getFlags(desc) & O_NONBLOCK)) {
         /* Blocking for file io will lock up the plugin because we don't
          * yet have a way to wait on file descriptors. */
@@ -189,7 +256,9 @@ _syscallhandler_readvHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
         /* We need to block until the descriptor is ready to write. */
         Trigger trigger = (Trigger){
             .type = TRIGGER_DESCRIPTOR, .object = desc, .status = STATUS_DESCRIPTOR_READABLE};
-        return (SysCallReturn){.state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+        return (SysCallReturn){
+            .state = SYSCALL_BLOCK,
+            .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
     }
 
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = result};
@@ -207,7 +276,7 @@ _syscallhandler_writevHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
           fd, (void*)iovPtr.val, iovlen, pos_l, pos_h, offset, flags);
 
     LegacyDescriptor* desc = NULL;
-    const struct iovec* iov;
+    struct iovec* iov = NULL;
     int errcode = _syscallhandler_validateVecParams(
         sys, fd, iovPtr, iovlen, offset, &desc, &iov);
     if (errcode < 0 || iovlen == 0) {
@@ -221,28 +290,44 @@ _syscallhandler_writevHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
 
     /* Now we can perform the write operations. */
     if (dType == DT_FILE) {
-        /* For files, we read all of the buffers from the plugin and then
-         * let file pwritev handle it. */
+        /* For files, we gather all of the buffers from the plugin into one
+         * local buffer at once and then let file pwritev handle it. */
+        PluginPtr* bufPtrs = NULL;
+        size_t* bufSizes = NULL;
+        size_t totalSize = _syscallhandler_splitVec(iov, iovlen, &bufPtrs, &bufSizes);
+        char* buffer = malloc(totalSize);
         struct iovec* buffersv = malloc(iovlen * sizeof(*iov));
 
+        size_t bufOffset = 0;
         for (unsigned long i = 0; i < iovlen; i++) {
-            PluginPtr bufPtr = (PluginPtr){.val = (uint64_t)iov[i].iov_base};
-            size_t bufSize = iov[i].iov_len;
-
-            buffersv[i].iov_base = (void*)process_getReadablePtr(sys->process, bufPtr, bufSize);
-            buffersv[i].iov_len = bufSize;
+            buffersv[i].iov_base = buffer + bufOffset;
+            buffersv[i].iov_len = bufSizes[i];
+            bufOffset += bufSizes[i];
         }
 
+        result = process_readPtrs(sys->process, buffer, bufPtrs, bufSizes, iovlen);
+        if (result == 0) {
 #ifdef SYS_pwritev2
-        result = file_pwritev2((File*)desc, buffersv, iovlen, offset, flags);
+            result = file_pwritev2((File*)desc, buffersv, iovlen, offset, flags);
 #else
-        if (flags) {
-            warning("Ignoring flags");
-        }
-        result = file_pwritev((File*)desc, buffersv, iovlen, offset);
+            if (flags) {
+                warning("Ignoring flags");
+            }
+            result = file_pwritev((File*)desc, buffersv, iovlen, offset);
 #endif
+        }
 
         free(buffersv);
+        free(buffer);
+        free(bufSizes);
+        free(bufPtrs);
+    } else if (dType == DT_TCPSOCKET || dType == DT_UDPSOCKET) {
+        /* Sockets gather all of the buffers straight into their packets, so
+         * a UDP datagram holds them all, and they handle blocking themselves. */
+        SysCallReturn scr =
+            _syscallhandler_sendIovHelper(sys, fd, iov, iovlen, 0, (PluginPtr){0}, 0);
+        free(iov);
+        return scr;
     } else {
         /* For non-files, we only read one buffer at a time to avoid
          * unnecessary data transfer between the plugin and Shadow. */
@@ -265,9 +350,8 @@ _syscallhandler_writevHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
                 }
                 case DT_TCPSOCKET:
                 case DT_UDPSOCKET: {
-                    SysCallReturn scr = _syscallhandler_sendtoHelper(
-                        sys, fd, bufPtr, bufSize, 0, (PluginPtr){0}, 0);
-                    result = scr.retval.as_i64;
+                    /* Handled above. */
+                    utility_assert(0);
                     break;
                 }
                 case DT_TIMER:
@@ -293,6 +377,8 @@ _syscallhandler_writevHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
         }
     }
 
+    free(iov);
+
     if (result == -EWOULDBLOCK && !(descriptor_getFlags(desc) & O_NONBLOCK)) {
         /* Blocking for file io will lock up the plugin because we don't
          * yet have a way to wait on file descriptors. */
@@ -305,7 +391,9 @@ _syscallhandler_writevHelper(SysCallHandler* sys, int fd, PluginPtr iovPtr,
         /* We need to block until the descriptor is ready to write. */
         Trigger trigger = (Trigger){
             .type = TRIGGER_DESCRIPTOR, .object = desc, .status = STATUS_DESCRIPTOR_WRITABLE};
-        return (SysCallReturn){.state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+        return (SysCallReturn){
+            .state = SYSCALL_BLOCK,
+            .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
     }
 
     return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = result};
@@ -98,7 +98,7 @@ static SysCallReturn _syscallhandler_readHelper(SysCallHandler* sys, int fd,
     }
 
     /* Divert io on sockets to socket handler to pick up special checks. */
-    if (dType == DT_TCPSOCKET || dType == DT_UDPSOCKET) {
+    if (dType == DT_TCPSOCKET || dType == DT_UDPSOCKET || dType == DT_UNIXSOCKET) {
         return _syscallhandler_recvfromHelper(
             sys, fd, bufPtr, bufSize, 0, (PluginPtr){0}, (PluginPtr){0});
     }
@@ -144,10 +144,10 @@ static SysCallReturn _syscallhandler_readHelper(SysCallHandler* sys, int fd,
             break;
         case DT_TCPSOCKET:
         case DT_UDPSOCKET:
+        case DT_UNIXSOCKET:
             // We already diverted these to the socket handler above.
             utility_assert(0);
             break;
-        case DT_UNIXSOCKET:
         case DT_EPOLL:
         default:
             warning("write() not yet implemented for descriptor type %i",
@@ -168,7 +168,9 @@ static SysCallReturn _syscallhandler_readHelper(SysCallHandler* sys, int fd,
         /* We need to block until the descriptor is ready to read. */
         Trigger trigger = (Trigger){
             .type = TRIGGER_DESCRIPTOR, .object = desc, .status = STATUS_DESCRIPTOR_READABLE};
-        return (SysCallReturn){.state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+        return (SysCallReturn){
+            .state = SYSCALL_BLOCK,
+            .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
     }
 
     return (SysCallReturn){
@@ -196,7 +198,7 @@ static SysCallReturn _syscallhandler_writeHelper(SysCallHandler* sys, int fd,
     }
 
     /* Divert io on sockets to socket handler to pick up special checks. */
-    if (dType == DT_TCPSOCKET || dType == DT_UDPSOCKET) {
+    if (dType == DT_TCPSOCKET || dType == DT_UDPSOCKET || dType == DT_UNIXSOCKET) {
         return _syscallhandler_sendtoHelper(
             sys, fd, bufPtr, bufSize, 0, (PluginPtr){0}, 0);
     }
@@ -238,10 +240,10 @@ static SysCallReturn _syscallhandler_writeHelper(SysCallHandler* sys, int fd,
             break;
         case DT_TCPSOCKET:
         case DT_UDPSOCKET:
+        case DT_UNIXSOCKET:
             // We already diverted these to the socket handler above.
             utility_assert(0);
             break;
-        case DT_UNIXSOCKET:
         case DT_EPOLL:
         default:
             warning("write(%d) not yet implemented for descriptor type %i", fd, (int)dType);
@@ -261,7 +263,9 @@ static SysCallReturn _syscallhandler_writeHelper(SysCallHandler* sys, int fd,
         /* We need to block until the descriptor is ready to write. */
         Trigger trigger = (Trigger){
             .type = TRIGGER_DESCRIPTOR, .object = desc, .status = STATUS_DESCRIPTOR_WRITABLE};
-        return (SysCallReturn){.state = SYSCALL_BLOCK, .cond = syscallcondition_new(trigger, NULL)};
+        return (SysCallReturn){
+            .state = SYSCALL_BLOCK,
+            .cond = syscallcondition_newForThread(sys->thread, trigger, NULL)};
     }
 
     return (SysCallReturn){
@@ -380,10 +384,15 @@ SysCallReturn syscallhandler_getpid(SysCallHandler* sys,
         .state = SYSCALL_DONE, .retval.as_i64 = (int64_t)pid};
 }
 
-SysCallReturn syscallhandler_getppid(SysCallHandler* sys, const SysCallArgs* args) {
+pid_t syscallhandler_getppidValue(void) {
     // We can't handle this natively in the plugin if we want determinism
     // Just return a constant
-    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = 1};
+    return 1;
+}
+
+SysCallReturn syscallhandler_getppid(SysCallHandler* sys, const SysCallArgs* args) {
+    return (SysCallReturn){
+        .state = SYSCALL_DONE, .retval.as_i64 = (int64_t)syscallhandler_getppidValue()};
 }
 
 SysCallReturn syscallhandler_set_tid_address(SysCallHandler* sys, const SysCallArgs* args) {
@@ -402,14 +411,17 @@ SysCallReturn syscallhandler_uname(SysCallHandler* sys,
     }
 
     buf = process_getWriteablePtr(sys->process, args->args[0].as_ptr, sizeof(*buf));
+    syscallhandler_fillUtsname(sys->host, buf);
+
+    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = 0};
+}
 
-    const gchar* hostname = host_getName(sys->host);
+void syscallhandler_fillUtsname(Host* host, struct utsname* buf) {
+    const gchar* hostname = host_getName(host);
 
     snprintf(buf->sysname, _UTSNAME_SYSNAME_LENGTH, "shadowsys");
     snprintf(buf->nodename, _UTSNAME_NODENAME_LENGTH, "%s", hostname);
     snprintf(buf->release, _UTSNAME_RELEASE_LENGTH, "shadowrelease");
     snprintf(buf->version, _UTSNAME_VERSION_LENGTH, "shadowversion");
     snprintf(buf->machine, _UTSNAME_MACHINE_LENGTH, "shadowmachine");
-
-    return (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = 0};
 }
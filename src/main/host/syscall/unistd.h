@@ -6,6 +6,9 @@
 #ifndef SRC_MAIN_HOST_SYSCALL_UNISTD_H_
 #define SRC_MAIN_HOST_SYSCALL_UNISTD_H_
 
+#include <sys/types.h>
+#include <sys/utsname.h>
+
 #include "main/host/syscall/protected.h"
 
 SYSCALL_HANDLER(close);
@@ -22,4 +25,9 @@ SYSCALL_HANDLER(set_tid_address);
 SYSCALL_HANDLER(uname);
 SYSCALL_HANDLER(write);
 
+/* The values returned by getppid and uname, which the shim may also return
+ * without making a syscall. */
+pid_t syscallhandler_getppidValue(void);
+void syscallhandler_fillUtsname(Host* host, struct utsname* buf);
+
 #endif /* SRC_MAIN_HOST_SYSCALL_UNISTD_H_ */
@@ -9,66 +9,82 @@
 #include <stdlib.h>
 
 #include "lib/logger/logger.h"
+#include "main/core/support/config_handlers.h"
 #include "main/core/worker.h"
 #include "main/host/descriptor/descriptor.h"
 #include "main/host/descriptor/descriptor_types.h"
+#include "main/host/cpu.h"
 #include "main/host/futex.h"
+#include "main/host/host.h"
 #include "main/host/process.h"
 #include "main/host/status_listener.h"
 #include "main/host/thread.h"
 #include "main/utility/utility.h"
 
+static bool _useDeferredWakeups = false;
+ADD_CONFIG_HANDLER(config_getUseDeferredWakeups, _useDeferredWakeups)
+
+/* If we are running an event whose signals are deferred until it finishes. */
+static __thread bool _deferringSignals = false;
+/* The conditions with deferred signals, each holding a reference. */
+static __thread GQueue _deferredSignals = G_QUEUE_INIT;
+
 struct _SysCallCondition {
     // Specifies how the condition will signal when a status is reached
     Trigger trigger;
     // Non-null if the condition will signal upon a timeout firing
     Timer* timeout;
-    // Non-null if we are listening for status updates on a trigger object
+    // Listens for status updates on the trigger object. Kept for reuse until we are freed.
     StatusListener* triggerListener;
-    // Non-null if we are listening for status updates on the timeout
+    // Listens for status updates on the timeout. Kept for reuse until we are freed.
     StatusListener* timeoutListener;
+    // If the listeners are currently attached to their objects
+    bool triggerListening;
+    bool timeoutListening;
     // The process waiting for the signal
     Process* proc;
     // The thread waiting for the signal
     Thread* thread;
-    // If a task to deliver a signal has been scheduled
+    // If a task to deliver a signal has been scheduled, or the signal was deferred
     bool signalPending;
+    // If the deferred signal is for the timeout
+    bool signalIsTimeout;
     // Memory tracking
     gint referenceCount;
     MAGIC_DECLARE;
 };
 
-SysCallCondition* syscallcondition_new(Trigger trigger, Timer* timeout) {
-    SysCallCondition* cond = malloc(sizeof(*cond));
+/* Takes references to the trigger object and timeout. */
+static void _syscallcondition_setTrigger(SysCallCondition* cond, Trigger trigger,
+                                         Timer* timeout) {
+    MAGIC_ASSERT(cond);
 
-    *cond = (SysCallCondition){
-        .timeout = timeout, .trigger = trigger, .referenceCount = 1, MAGIC_INITIALIZER};
+    cond->trigger = trigger;
+    cond->timeout = timeout;
 
     /* We now hold refs to these objects. */
     if (cond->timeout) {
         descriptor_ref(cond->timeout);
     }
 
-    worker_count_allocation(SysCallCondition);
-
     if (cond->trigger.object.as_pointer) {
         switch (cond->trigger.type) {
             case TRIGGER_DESCRIPTOR: {
                 descriptor_ref(cond->trigger.object.as_descriptor);
-                return cond;
+                return;
             }
             case TRIGGER_POSIX_FILE: {
                 /* The file represents an Arc, so the reference count is fine;
                  * Just need to remember to drop it later.
                  */
-                return cond;
+                return;
             }
             case TRIGGER_FUTEX: {
                 futex_ref(cond->trigger.object.as_futex);
-                return cond;
+                return;
             }
             case TRIGGER_NONE: {
-                return cond;
+                return;
             }
             // No default, forcing a compiler warning if not kept up to date
         }
@@ -76,26 +92,74 @@ SysCallCondition* syscallcondition_new(Trigger trigger, Timer* timeout) {
         // Log panic if we get a non-enumerator at run-time.
         utility_panic("Unhandled enumerator %d", cond->trigger.type);
     }
+}
+
+/* Drops the references taken in _syscallcondition_setTrigger. */
+static void _syscallcondition_clearTrigger(SysCallCondition* cond) {
+    MAGIC_ASSERT(cond);
+
+    if (cond->timeout) {
+        descriptor_unref(cond->timeout);
+        cond->timeout = NULL;
+    }
+    if (cond->trigger.object.as_pointer) {
+        switch (cond->trigger.type) {
+            case TRIGGER_DESCRIPTOR: {
+                descriptor_unref(cond->trigger.object.as_descriptor);
+                break;
+            }
+            case TRIGGER_POSIX_FILE: {
+                posixfile_drop(cond->trigger.object.as_file);
+                break;
+            }
+            case TRIGGER_FUTEX: {
+                futex_unref(cond->trigger.object.as_futex);
+                break;
+            }
+            case TRIGGER_NONE: {
+                break;
+            }
+            default: {
+                warning("Unhandled enumerator %d", cond->trigger.type);
+                break;
+            }
+        }
+    }
+    cond->trigger = (Trigger){0};
+}
+
+SysCallCondition* syscallcondition_new(Trigger trigger, Timer* timeout) {
+    SysCallCondition* cond = malloc(sizeof(*cond));
+
+    *cond = (SysCallCondition){.referenceCount = 1, MAGIC_INITIALIZER};
+    _syscallcondition_setTrigger(cond, trigger, timeout);
+
+    worker_count_allocation(SysCallCondition);
+    return cond;
+}
+
+SysCallCondition* syscallcondition_newForThread(Thread* thread, Trigger trigger, Timer* timeout) {
+    SysCallCondition* cond = thread_takeSpareSysCallCondition(thread);
+    if (!cond) {
+        return syscallcondition_new(trigger, timeout);
+    }
 
+    syscallcondition_reset(cond, trigger, timeout);
     return cond;
 }
 
 static void _syscallcondition_cleanupListeners(SysCallCondition* cond) {
     MAGIC_ASSERT(cond);
 
-    /* Destroy the listeners, which will also unref and free cond. */
-    if (cond->timeout && cond->timeoutListener) {
+    /* Detach the listeners, but keep them for the next wait. */
+    if (cond->timeoutListening) {
         descriptor_removeListener(
             (LegacyDescriptor*)cond->timeout, cond->timeoutListener);
         statuslistener_setMonitorStatus(cond->timeoutListener, STATUS_NONE, SLF_NEVER);
+        cond->timeoutListening = false;
     }
 
-    if (cond->timeoutListener) {
-        statuslistener_unref(cond->timeoutListener);
-        cond->timeoutListener = NULL;
-    }
-
-    if (cond->trigger.object.as_pointer && cond->triggerListener) {
+    if (cond->triggerListening) {
         switch (cond->trigger.type) {
             case TRIGGER_DESCRIPTOR: {
                 descriptor_removeListener(
@@ -120,11 +184,7 @@ static void _syscallcondition_cleanupListeners(SysCallCondition* cond) {
         }
 
         statuslistener_setMonitorStatus(cond->triggerListener, STATUS_NONE, SLF_NEVER);
-    }
-
-    if (cond->triggerListener) {
-        statuslistener_unref(cond->triggerListener);
-        cond->triggerListener = NULL;
+        cond->triggerListening = false;
     }
 }
 
@@ -148,31 +208,13 @@ static void _syscallcondition_free(SysCallCondition* cond) {
     _syscallcondition_cleanupListeners(cond);
     _syscallcondition_cleanupProc(cond);
 
-    if (cond->timeout) {
-        descriptor_unref(cond->timeout);
+    _syscallcondition_clearTrigger(cond);
+
+    if (cond->timeoutListener) {
+        statuslistener_unref(cond->timeoutListener);
     }
-    if (cond->trigger.object.as_pointer) {
-        switch (cond->trigger.type) {
-            case TRIGGER_DESCRIPTOR: {
-                descriptor_unref(cond->trigger.object.as_descriptor);
-                break;
-            }
-            case TRIGGER_POSIX_FILE: {
-                posixfile_drop(cond->trigger.object.as_file);
-                break;
-            }
-            case TRIGGER_FUTEX: {
-                futex_unref(cond->trigger.object.as_futex);
-                break;
-            }
-            case TRIGGER_NONE: {
-                break;
-            }
-            default: {
-                warning("Unhandled enumerator %d", cond->trigger.type);
-                break;
-            }
-        }
+    if (cond->triggerListener) {
+        statuslistener_unref(cond->triggerListener);
     }
 
     MAGIC_CLEAR(cond);
@@ -198,6 +240,21 @@ static void _syscallcondition_unrefcb(void* cond_ptr) {
     syscallcondition_unref(cond_ptr);
 }
 
+bool syscallcondition_isReusable(SysCallCondition* cond) {
+    MAGIC_ASSERT(cond);
+    /* Pending signal tasks hold references, and a waiting condition holds the process. */
+    return cond->referenceCount == 1 && !cond->proc;
+}
+
+void syscallcondition_reset(SysCallCondition* cond, Trigger trigger, Timer* timeout) {
+    MAGIC_ASSERT(cond);
+    utility_assert(syscallcondition_isReusable(cond));
+
+    _syscallcondition_clearTrigger(cond);
+    _syscallcondition_setTrigger(cond, trigger, timeout);
+    cond->signalPending = false;
+}
+
 #ifdef DEBUG
 static void _syscallcondition_logListeningState(SysCallCondition* cond,
                                                 const char* listenVerb) {
@@ -283,6 +340,40 @@ static bool _syscallcondition_statusIsValid(SysCallCondition* cond) {
     return false;
 }
 
+static void _syscallcondition_startListening(SysCallCondition* cond);
+
+/* Whether the trigger object already has every status bit we are waiting for, so that
+ * we don't need to listen for it. Partial matches don't count: e.g. connect() waits for
+ * ACTIVE|WRITABLE on a socket that is already active, and needs to see WRITABLE turn on. */
+static bool _syscallcondition_isSatisfied(SysCallCondition* cond) {
+    MAGIC_ASSERT(cond);
+
+    if (!cond->trigger.object.as_pointer || !cond->trigger.status) {
+        return false;
+    }
+
+    Status status = STATUS_NONE;
+    switch (cond->trigger.type) {
+        case TRIGGER_DESCRIPTOR: {
+            status = descriptor_getStatus(cond->trigger.object.as_descriptor);
+            break;
+        }
+        case TRIGGER_POSIX_FILE: {
+            status = posixfile_getStatus(cond->trigger.object.as_file);
+            break;
+        }
+        // Futex wakeups are events, not statuses
+        case TRIGGER_FUTEX:
+        case TRIGGER_NONE: return false;
+        default: {
+            utility_panic("Unhandled enumerator %d", cond->trigger.type);
+            return false;
+        }
+    }
+
+    return (status & cond->trigger.status) == cond->trigger.status;
+}
+
 static void _syscallcondition_signal(Host* host, void* obj, void* arg) {
     SysCallCondition* cond = obj;
     bool wasTimeout = (bool)arg;
@@ -303,6 +394,10 @@ static void _syscallcondition_signal(Host* host, void* obj, void* arg) {
 
         /* Deliver the signal to notify the process to continue. */
         process_continue(cond->proc, cond->thread);
+    } else if (cond->proc && !cond->triggerListening) {
+        /* The status was satisfied when we started waiting, so we skipped the listeners,
+         * but it changed again before we could signal. Wait for it the usual way. */
+        _syscallcondition_startListening(cond);
     }
 }
 
@@ -310,22 +405,59 @@ static void _syscallcondition_scheduleSignalTask(SysCallCondition* cond,
                                                  bool wasTimeout) {
     MAGIC_ASSERT(cond);
 
+    if (_deferringSignals) {
+        /* The event that triggered our listener is still running, and signals the
+         * thread when it finishes. */
+        syscallcondition_ref(cond);
+        g_queue_push_tail(&_deferredSignals, cond);
+        cond->signalIsTimeout = wasTimeout;
+        cond->signalPending = true;
+        return;
+    }
+
     /* We deliver the signal via a task, to make sure whatever
      * code triggered our listener finishes its logic first before
      * we tell the process to run the plugin and potentially change
      * the state of the trigger object again. */
-    Task* signalTask =
-        task_new(_syscallcondition_signal, cond, (void*)wasTimeout,
-                 _syscallcondition_unrefcb, NULL);
-    worker_scheduleTask(
-        signalTask, thread_getHost(cond->thread), 0); // Call without moving time forward
-
     syscallcondition_ref(cond);
-    task_unref(signalTask);
+    worker_scheduleCallback(_syscallcondition_signal, cond, (void*)wasTimeout,
+                            _syscallcondition_unrefcb, NULL, thread_getHost(cond->thread),
+                            0); // Call without moving time forward
 
     cond->signalPending = true;
 }
 
+void syscallcondition_beginDeferredSignals() {
+    utility_assert(!_deferringSignals);
+    _deferringSignals = _useDeferredWakeups;
+}
+
+void syscallcondition_endDeferredSignals(Host* host) {
+    if (!_deferringSignals) {
+        return;
+    }
+
+    /* Signals that the threads we continue cause are deferred behind the others. */
+    SysCallCondition* cond = NULL;
+    while ((cond = g_queue_pop_head(&_deferredSignals)) != NULL) {
+        MAGIC_ASSERT(cond);
+
+        if (cpu_isBlocked(host_getCPU(host))) {
+            /* The threads we continued used up the CPU, so the rest wait for it like the
+             * signal tasks that they would have been. */
+            _deferringSignals = false;
+            _syscallcondition_scheduleSignalTask(cond, cond->signalIsTimeout);
+            _deferringSignals = true;
+        } else {
+            _syscallcondition_signal(host, cond, (void*)cond->signalIsTimeout);
+        }
+
+        syscallcondition_unref(cond);
+    }
+
+    _deferringSignals = false;
+}
+
 static void _syscallcondition_notifyStatusChanged(void* obj, void* arg) {
     SysCallCondition* cond = obj;
     MAGIC_ASSERT(cond);
@@ -354,27 +486,18 @@ static void _syscallcondition_notifyTimeoutExpired(void* obj, void* arg) {
     }
 }
 
-void syscallcondition_waitNonblock(SysCallCondition* cond, Process* proc,
-                                   Thread* thread) {
+/* Attach our listeners to the timeout and trigger object. */
+static void _syscallcondition_startListening(SysCallCondition* cond) {
     MAGIC_ASSERT(cond);
-    utility_assert(proc);
-    utility_assert(thread);
 
-    /* Update the reference counts. */
-    syscallcondition_cancel(cond);
-    cond->proc = proc;
-    process_ref(proc);
-    cond->thread = thread;
-    thread_ref(thread);
-
-    /* Now set up the listeners. */
-    if (cond->timeout && !cond->timeoutListener) {
-        /* The timer is used for timeouts. */
-        cond->timeoutListener = statuslistener_new(
-            _syscallcondition_notifyTimeoutExpired, cond, _syscallcondition_unrefcb, NULL, NULL);
-
-        /* The listener holds refs to the thread condition. */
-        syscallcondition_ref(cond);
+    if (cond->timeout && !cond->timeoutListening) {
+        /* The timer is used for timeouts. The listener doesn't hold a reference to us
+         * because we detach it before we are freed. */
+        if (!cond->timeoutListener) {
+            cond->timeoutListener = statuslistener_new(
+                _syscallcondition_notifyTimeoutExpired, cond, NULL, NULL, NULL);
+        }
+        cond->timeoutListening = true;
 
         /* The timer is readable when it expires */
         statuslistener_setMonitorStatus(
@@ -385,13 +508,13 @@ void syscallcondition_waitNonblock(SysCallCondition* cond, Process* proc,
             (LegacyDescriptor*)cond->timeout, cond->timeoutListener);
     }
 
-    if (cond->trigger.object.as_pointer && !cond->triggerListener) {
+    if (cond->trigger.object.as_pointer && !cond->triggerListening) {
         /* We listen for status change on the trigger object. */
-        cond->triggerListener = statuslistener_new(
-            _syscallcondition_notifyStatusChanged, cond, _syscallcondition_unrefcb, NULL, NULL);
-
-        /* The listener holds refs to the thread condition. */
-        syscallcondition_ref(cond);
+        if (!cond->triggerListener) {
+            cond->triggerListener = statuslistener_new(
+                _syscallcondition_notifyStatusChanged, cond, NULL, NULL, NULL);
+        }
+        cond->triggerListening = true;
 
         switch (cond->trigger.type) {
             case TRIGGER_DESCRIPTOR: {
@@ -430,12 +553,56 @@ void syscallcondition_waitNonblock(SysCallCondition* cond, Process* proc,
             }
         }
     }
+}
+
+void syscallcondition_waitNonblock(SysCallCondition* cond, Process* proc,
+                                   Thread* thread) {
+    MAGIC_ASSERT(cond);
+    utility_assert(proc);
+    utility_assert(thread);
+
+    /* Update the reference counts. */
+    syscallcondition_cancel(cond);
+    cond->proc = proc;
+    process_ref(proc);
+    cond->thread = thread;
+    thread_ref(thread);
+
+    if (_syscallcondition_isSatisfied(cond)) {
+        /* Fast path: signal right away without registering any listeners. */
+#ifdef DEBUG
+        _syscallcondition_logListeningState(cond, "already satisfied, not");
+#endif
+        _syscallcondition_scheduleSignalTask(cond, false);
+        return;
+    }
+
+    _syscallcondition_startListening(cond);
 
 #ifdef DEBUG
     _syscallcondition_logListeningState(cond, "started");
 #endif
 }
 
+void syscallcondition_wakeup(SysCallCondition* cond) {
+    MAGIC_ASSERT(cond);
+    if (cond->proc && !cond->signalPending) {
+        _syscallcondition_scheduleSignalTask(cond, true);
+    }
+}
+
+SimulationTime syscallcondition_getWakeupTime(SysCallCondition* cond) {
+    MAGIC_ASSERT(cond);
+    if (cond->signalPending) {
+        return worker_getCurrentTime();
+    }
+    if (!cond->timeout) {
+        return SIMTIME_INVALID;
+    }
+    SimulationTime expireTime = timer_getNextExpireTime(cond->timeout);
+    return expireTime == 0 ? SIMTIME_INVALID : expireTime;
+}
+
 void syscallcondition_cancel(SysCallCondition* cond) {
     MAGIC_ASSERT(cond);
     _syscallcondition_cleanupListeners(cond);
@@ -6,6 +6,8 @@
 #ifndef SRC_MAIN_HOST_SYSCALL_CONDITION_H_
 #define SRC_MAIN_HOST_SYSCALL_CONDITION_H_
 
+#include <stdbool.h>
+
 #include "main/host/descriptor/descriptor_types.h"
 #include "main/host/descriptor/timer.h"
 #include "main/host/futex.h"
@@ -47,6 +49,20 @@ struct _Trigger {
  * The condition starts with a reference count of 1. */
 SysCallCondition* syscallcondition_new(Trigger trigger, Timer* timeout);
 
+/* Like syscallcondition_new(), but reuses the condition that the thread last
+ * blocked on if nothing else references it any more, along with its listeners.
+ * Syscall handlers should use this, since a thread waits on one condition at a
+ * time. */
+SysCallCondition* syscallcondition_newForThread(Thread* thread, Trigger trigger, Timer* timeout);
+
+/* Returns true if the caller holds the only reference to the condition and it
+ * isn't waiting, so that it may be reset. */
+bool syscallcondition_isReusable(SysCallCondition* cond);
+
+/* Replace the trigger and timeout of a reusable condition, as if it was newly
+ * created with them. */
+void syscallcondition_reset(SysCallCondition* cond, Trigger trigger, Timer* timeout);
+
 /* Increment the reference count on the given condition. */
 void syscallcondition_ref(SysCallCondition* cond);
 
@@ -61,6 +77,23 @@ void syscallcondition_unref(SysCallCondition* cond);
 void syscallcondition_waitNonblock(SysCallCondition* cond, Process* proc,
                                    Thread* thread);
 
+/* Notify the waiting process and thread to continue, as if the timeout had
+ * expired, unless they're already about to be. */
+void syscallcondition_wakeup(SysCallCondition* cond);
+
+/* Returns the earliest time at which the waiting thread is known to be
+ * notified: now if a signal is already pending, or when the timeout expires.
+ * Returns SIMTIME_INVALID if only the trigger object can notify it. */
+SimulationTime syscallcondition_getWakeupTime(SysCallCondition* cond);
+
+/* Until the matching syscallcondition_endDeferredSignals, signal the conditions of this
+ * worker thread when the end is reached instead of scheduling a task for each one, if the
+ * use_deferred_wakeups option is on. Used around the execution of an event, so that the
+ * threads that it wakes continue once it's done, with one signal per condition however
+ * many of the objects they wait for changed. */
+void syscallcondition_beginDeferredSignals();
+void syscallcondition_endDeferredSignals(Host* host);
+
 /* Deactivate the condition by deregistering any open listeners and
  * clearing any references to the process an thread given in wait(). */
 void syscallcondition_cancel(SysCallCondition* cond);
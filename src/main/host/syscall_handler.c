@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <glib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
@@ -38,16 +39,19 @@
 #include "main/host/syscall/shadow.h"
 #include "main/host/syscall/signal.h"
 #include "main/host/syscall/socket.h"
+#include "main/host/syscall/splice.h"
 #include "main/host/syscall/sysinfo.h"
 #include "main/host/syscall/time.h"
 #include "main/host/syscall/timerfd.h"
 #include "main/host/syscall/uio.h"
 #include "main/host/syscall/unistd.h"
 #include "main/host/syscall_handler.h"
+#include "main/host/syscall_condition.h"
 #include "main/host/syscall_numbers.h"
 #include "main/host/syscall_types.h"
 #include "main/host/thread.h"
 #include "main/utility/syscall.h"
+#include "main/utility/tracepoint.h"
 
 static bool _useMM = true;
 ADD_CONFIG_HANDLER(config_getUseMemoryManager, _useMM)
@@ -55,6 +59,320 @@ ADD_CONFIG_HANDLER(config_getUseMemoryManager, _useMM)
 static bool _countSyscalls = false;
 ADD_CONFIG_HANDLER(config_getUseSyscallCounters, _countSyscalls)
 
+static bool _useProfiler = false;
+ADD_CONFIG_HANDLER(config_getUseProfiler, _useProfiler)
+
+static SimulationTime _spinSyscallDelay = 0;
+ADD_CONFIG_HANDLER(config_getSpinSyscallDelay, _spinSyscallDelay)
+
+static guint _spinSyscallLimit = 0;
+ADD_CONFIG_HANDLER(config_getSpinSyscallLimit, _spinSyscallLimit)
+
+/* Processes with `trace_syscalls` set write a record of each syscall that they make to
+ * a file in the host's data directory. The file starts with SYSCALL_TRACE_FILE_MAGIC and
+ * a guint32 version, followed by records of SYSCALL_TRACE_RECORD_FIELDS guint64 fields:
+ * the simulated time, the wall time that shadow spent handling the call in nanoseconds,
+ * the thread ID, the syscall number, the 6 arguments, the result, and the outcome. The
+ * outcome is a SysCallReturnState, plus SYSCALL_TRACE_RESUMED if the call had blocked
+ * before, or SYSCALL_TRACE_INTERRUPTED for a blocked call that a signal interrupted.
+ * Values are in host byte order. src/tools/shadow-syscall-decode.py decodes the file. */
+#define SYSCALL_TRACE_FILE_MAGIC "SHADOWSC"
+#define SYSCALL_TRACE_FILE_VERSION 1
+#define SYSCALL_TRACE_FILE_BUFFER_SIZE (256 * 1024)
+#define SYSCALL_TRACE_RECORD_FIELDS 12
+#define SYSCALL_TRACE_RESUMED (1 << 8)
+#define SYSCALL_TRACE_INTERRUPTED (1 << 9)
+
+// Syscalls are dispatched and counted by number, and are only given their names when the
+// counts are reported. This covers the native syscalls as well as the shadow-specific ones.
+#define SYSCALL_TABLE_SIZE (SYS_shadow_max + 1)
+
+#define HANDLE_ENTRY(s, f, flags) [SYS_##s] = {#s, f, (flags)}
+#define HANDLE(s) HANDLE_ENTRY(s, syscallhandler_##s, 0)
+// Handled entirely from shadow's own state, without blocking or touching plugin memory.
+#define HANDLE_LOCAL(s)                                                                            \
+    HANDLE_ENTRY(s, syscallhandler_##s, SYSCALL_FLAG_NEVER_BLOCKS | SYSCALL_FLAG_NO_PLUGIN_MEMORY)
+#define NATIVE(s) HANDLE_ENTRY(s, NULL, SYSCALL_FLAG_NATIVE)
+#define UNSUPPORTED(s) HANDLE_ENTRY(s, NULL, SYSCALL_FLAG_UNSUPPORTED)
+
+#ifdef USE_C_SYSCALLS
+#define HANDLE_RUST(s) HANDLE(s)
+#else
+#define HANDLE_RUST(s) HANDLE_ENTRY(s, rustsyscallhandler_##s, 0)
+#endif
+
+typedef SysCallReturn (*SysCallHandlerFunc)(SysCallHandler* sys, const SysCallArgs* args);
+
+typedef struct _SysCallTableEntry {
+    // NULL for syscalls we've never heard of
+    const char* name;
+    // NULL unless shadow handles the syscall
+    SysCallHandlerFunc handler;
+    SysCallFlags flags;
+} SysCallTableEntry;
+
+// Indexed by syscall number; the entries for unknown syscalls are all zero.
+static const SysCallTableEntry _syscallTable[SYSCALL_TABLE_SIZE] = {
+    HANDLE(accept),
+    HANDLE(accept4),
+    HANDLE_LOCAL(alarm),
+    HANDLE(bind),
+    HANDLE(brk),
+    HANDLE(clock_gettime),
+    HANDLE(clone),
+    HANDLE_RUST(close),
+    HANDLE(connect),
+    HANDLE(creat),
+    HANDLE_RUST(dup),
+    HANDLE_LOCAL(epoll_create),
+    HANDLE_LOCAL(epoll_create1),
+    HANDLE(epoll_ctl),
+    HANDLE(epoll_pwait),
+    HANDLE(epoll_wait),
+    HANDLE_LOCAL(eventfd),
+    HANDLE_LOCAL(eventfd2),
+    HANDLE(execve),
+    HANDLE(exit_group),
+    HANDLE(faccessat),
+    HANDLE_LOCAL(fadvise64),
+    HANDLE_LOCAL(fallocate),
+    HANDLE_LOCAL(fchmod),
+    HANDLE(fchmodat),
+    HANDLE_LOCAL(fchown),
+    HANDLE(fchownat),
+    HANDLE(fcntl),
+#ifdef SYS_fcntl64
+    HANDLE(fcntl64),
+#endif
+    HANDLE_LOCAL(fdatasync),
+    HANDLE(fgetxattr),
+    HANDLE(flistxattr),
+    HANDLE(flock),
+    HANDLE(fremovexattr),
+    HANDLE(fsetxattr),
+    HANDLE(fstat),
+    HANDLE(fstatfs),
+    HANDLE_LOCAL(fsync),
+    HANDLE_LOCAL(ftruncate),
+    HANDLE(futex),
+    HANDLE(futimesat),
+    HANDLE(getdents),
+    HANDLE(getdents64),
+    HANDLE(getitimer),
+    HANDLE(getpeername),
+    HANDLE_LOCAL(getpid),
+    HANDLE_LOCAL(getppid),
+    HANDLE_LOCAL(gettid),
+    HANDLE(getrandom),
+    HANDLE(get_robust_list),
+    HANDLE(getsockname),
+    HANDLE(getsockopt),
+    HANDLE(gettimeofday),
+    HANDLE(ioctl),
+    HANDLE(kill),
+    HANDLE(linkat),
+    HANDLE_LOCAL(listen),
+    HANDLE_LOCAL(lseek),
+    HANDLE(mkdirat),
+    HANDLE(mknodat),
+    HANDLE(mmap),
+#ifdef SYS_mmap2
+    HANDLE(mmap2),
+#endif
+    HANDLE(mprotect),
+    HANDLE(mremap),
+    HANDLE(munmap),
+    HANDLE(nanosleep),
+    HANDLE(newfstatat),
+    HANDLE(open),
+    HANDLE(openat),
+    HANDLE_RUST(pipe),
+    HANDLE_RUST(pipe2),
+    HANDLE(poll),
+    HANDLE(ppoll),
+    HANDLE(prctl),
+    HANDLE_RUST(pread64),
+    HANDLE(preadv),
+#ifdef SYS_preadv2
+    HANDLE(preadv2),
+#endif
+#ifdef SYS_prlimit
+    HANDLE(prlimit),
+#endif
+#ifdef SYS_prlimit64
+    HANDLE(prlimit64),
+#endif
+    HANDLE(pselect6),
+    HANDLE_RUST(pwrite64),
+    HANDLE(pwritev),
+#ifdef SYS_pwritev2
+    HANDLE(pwritev2),
+#endif
+    HANDLE_RUST(read),
+    HANDLE_LOCAL(readahead),
+    HANDLE(readlinkat),
+    HANDLE(readv),
+    HANDLE(recvfrom),
+    HANDLE(recvmmsg),
+    HANDLE(recvmsg),
+    HANDLE(renameat),
+    HANDLE(renameat2),
+#ifdef SYS_select
+    HANDLE(select),
+#endif
+    HANDLE(shadow_set_ptrace_allow_native_syscalls),
+    HANDLE(shadow_get_ipc_blk),
+    HANDLE(shadow_get_shm_blk),
+    HANDLE(shadow_hostname_to_addr_ipv4),
+    HANDLE(sendfile),
+    HANDLE(sendmmsg),
+    HANDLE(sendmsg),
+    HANDLE(sendto),
+    HANDLE(setitimer),
+    HANDLE(setsockopt),
+#ifdef SYS_sigaction
+    // Superseded by rt_sigaction in Linux 2.2
+    UNSUPPORTED(sigaction),
+#endif
+    HANDLE(rt_sigaction),
+#ifdef SYS_signal
+    // Superseded by sigaction in glibc 2.0
+    UNSUPPORTED(signal),
+#endif
+#ifdef SYS_sigprocmask
+    // Superseded by rt_sigprocmask in Linux 2.2
+    UNSUPPORTED(sigprocmask),
+#endif
+    HANDLE(rt_sigprocmask),
+    HANDLE_LOCAL(set_robust_list),
+    HANDLE(set_tid_address),
+    HANDLE_LOCAL(shutdown),
+    HANDLE_LOCAL(socket),
+    HANDLE(socketpair),
+    HANDLE(splice),
+#ifdef SYS_statx
+    HANDLE(statx),
+#endif
+    HANDLE(symlinkat),
+    HANDLE_LOCAL(sync_file_range),
+    HANDLE_LOCAL(syncfs),
+    HANDLE(sysinfo),
+    HANDLE(tee),
+    HANDLE(tgkill),
+    HANDLE(time),
+    HANDLE_LOCAL(timerfd_create),
+    HANDLE(timerfd_gettime),
+    HANDLE(timerfd_settime),
+    HANDLE(tkill),
+    HANDLE(uname),
+    HANDLE(unlinkat),
+    HANDLE(utimensat),
+    HANDLE_RUST(write),
+    HANDLE(writev),
+
+    // **************************************
+    // Not handled (yet):
+    // **************************************
+    // NATIVE(chdir);
+    // NATIVE(fchdir);
+    // NATIVE(io_getevents);
+    // NATIVE(waitid);
+    // NATIVE(msync);
+
+    //// operations on pids (shadow overrides pids)
+    // NATIVE(sched_getaffinity);
+    // NATIVE(sched_setaffinity);
+
+    //// operations on file descriptors
+    // NATIVE(dup2);
+    // NATIVE(dup3);
+
+    //// copying data between various types of fds
+    // NATIVE(copy_file_range);
+    // NATIVE(vmsplice);
+
+    // ***************************************
+    // We think we don't need to handle these
+    // (because the plugin can natively):
+    // ***************************************
+    NATIVE(access),
+    NATIVE(arch_prctl),
+    NATIVE(chmod),
+    NATIVE(chown),
+    NATIVE(exit),
+    NATIVE(getcwd),
+    NATIVE(geteuid),
+    NATIVE(getegid),
+    NATIVE(getgid),
+    NATIVE(getresgid),
+    NATIVE(getresuid),
+    NATIVE(getrlimit),
+    NATIVE(getuid),
+    NATIVE(getxattr),
+    NATIVE(lchown),
+    NATIVE(lgetxattr),
+    NATIVE(link),
+    NATIVE(listxattr),
+    NATIVE(llistxattr),
+    NATIVE(lremovexattr),
+    NATIVE(lsetxattr),
+    NATIVE(lstat),
+    NATIVE(madvise),
+    NATIVE(mkdir),
+    NATIVE(mknod),
+    NATIVE(readlink),
+    NATIVE(removexattr),
+    NATIVE(rename),
+    NATIVE(rmdir),
+    NATIVE(rt_sigreturn),
+    NATIVE(setfsgid),
+    NATIVE(setfsuid),
+    NATIVE(setgid),
+    NATIVE(setregid),
+    NATIVE(setresgid),
+    NATIVE(setresuid),
+    NATIVE(setreuid),
+    NATIVE(setrlimit),
+    NATIVE(setuid),
+    NATIVE(setxattr),
+    NATIVE(stat),
+#ifdef SYS_stat64
+    NATIVE(stat64),
+#endif
+    NATIVE(statfs),
+    NATIVE(sigaltstack),
+    NATIVE(symlink),
+    NATIVE(truncate),
+    NATIVE(unlink),
+    NATIVE(utime),
+    NATIVE(utimes),
+};
+
+#undef UNSUPPORTED
+#undef NATIVE
+#undef HANDLE_RUST
+#undef HANDLE_LOCAL
+#undef HANDLE
+#undef HANDLE_ENTRY
+
+static inline const SysCallTableEntry* _syscallhandler_lookup(long number) {
+    static const SysCallTableEntry unknown = {0};
+    return (number >= 0 && number < SYSCALL_TABLE_SIZE) ? &_syscallTable[number] : &unknown;
+}
+
+SysCallFlags syscallhandler_getFlags(long number) {
+    return _syscallhandler_lookup(number)->flags;
+}
+
+long syscallhandler_getNumber(const char* name) {
+    for (long i = 0; i < SYSCALL_TABLE_SIZE; i++) {
+        if (_syscallTable[i].name && !strcmp(_syscallTable[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 SysCallHandler* syscallhandler_new(Host* host, Process* process,
                                    Thread* thread) {
     utility_assert(host);
@@ -79,12 +397,16 @@ SysCallHandler* syscallhandler_new(Host* host, Process* process,
         .epoll = epoll_new(),
 #ifdef USE_PERF_TIMERS
         // Used to track syscall handler performance
-        .perfTimer = g_timer_new(),
+        .perfTimer = g_new0(PerfTimer, 1),
 #endif
     };
 
     if (_countSyscalls) {
-        sys->syscall_counter = counter_new();
+        sys->syscall_counts = g_new0(guint64, SYSCALL_TABLE_SIZE);
+    }
+
+    if (_useProfiler) {
+        sys->profile_counter = counter_new();
     }
 
     MAGIC_INIT(sys);
@@ -106,18 +428,45 @@ static void _syscallhandler_free(SysCallHandler* sys) {
     info("handled %li syscalls", sys->numSyscalls);
 #endif
 
-    if (_countSyscalls && sys->syscall_counter) {
+    if (_countSyscalls && sys->syscall_counts) {
+        // Name the counts now that we're done counting
+        Counter* counter = counter_new();
+        for (int i = 0; i < SYSCALL_TABLE_SIZE; i++) {
+            if (sys->syscall_counts[i] > 0) {
+                const char* name = _syscallTable[i].name;
+                utility_assert(name);
+                counter_add_value(counter, name, sys->syscall_counts[i]);
+            }
+        }
+
         // Log the plugin thread specific counts
-        char* str = counter_alloc_string(sys->syscall_counter);
+        char* str = counter_alloc_string(counter);
         info("Thread %d (%s) syscall counts: %s", thread_getID(sys->thread),
              process_getPluginName(sys->process), str);
-        counter_free_string(sys->syscall_counter, str);
+        counter_free_string(counter, str);
 
         // Add up the counts at the worker level
-        worker_add_syscall_counts(sys->syscall_counter);
+        worker_add_syscall_counts(counter);
 
         // Cleanup
-        counter_free(sys->syscall_counter);
+        counter_free(counter);
+        g_free(sys->syscall_counts);
+    }
+
+    if (sys->profile_counter) {
+        // Add up the times at the worker level, under this thread's host and process
+        gchar* prefix = g_strdup_printf(
+            "%s;%s;", host_getName(sys->host), process_getPluginName(sys->process));
+        worker_add_profile_counts(sys->profile_counter, prefix);
+        g_free(prefix);
+
+        counter_free(sys->profile_counter);
+    }
+
+    if (sys->timer) {
+        // Release the host's timer wheel reference if a timeout is still pending
+        descriptor_close(sys->timer, sys->host);
+        descriptor_unref(sys->timer);
     }
 
     if (sys->host) {
@@ -130,15 +479,15 @@ static void _syscallhandler_free(SysCallHandler* sys) {
         thread_unref(sys->thread);
     }
 
-    if (sys->timer) {
-        descriptor_unref(sys->timer);
-    }
     if (sys->epoll) {
         descriptor_unref(sys->epoll);
     }
+    if (sys->pollMirror) {
+        g_free(sys->pollMirror);
+    }
 #ifdef USE_PERF_TIMERS
     if (sys->perfTimer) {
-        g_timer_destroy(sys->perfTimer);
+        g_free(sys->perfTimer);
     }
 #endif
 
@@ -161,8 +510,69 @@ void syscallhandler_unref(SysCallHandler* sys) {
     }
 }
 
-static void _syscallhandler_pre_syscall(SysCallHandler* sys, long number,
-                                        const char* name) {
+static guint64 _syscallhandler_nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (guint64)now.tv_sec * SIMTIME_ONE_SECOND + (guint64)now.tv_nsec;
+}
+
+FILE* syscallhandler_openTraceFile(const gchar* path) {
+    FILE* file = fopen(path, "we");
+    if (!file) {
+        warning("Unable to open syscall trace file '%s': %s", path, g_strerror(errno));
+        return NULL;
+    }
+
+    /* records are small and frequent, so let stdio collect them into large writes */
+    setvbuf(file, NULL, _IOFBF, SYSCALL_TRACE_FILE_BUFFER_SIZE);
+
+    guint32 version = SYSCALL_TRACE_FILE_VERSION;
+    fwrite(SYSCALL_TRACE_FILE_MAGIC, 1, strlen(SYSCALL_TRACE_FILE_MAGIC), file);
+    fwrite(&version, sizeof(version), 1, file);
+
+    return file;
+}
+
+static void _syscallhandler_writeTrace(SysCallHandler* sys, FILE* file, const SysCallArgs* args,
+                                       const SysCallReturn* scr, gboolean wasBlocked,
+                                       gboolean wasInterrupted, guint64 start) {
+    guint64 fields[SYSCALL_TRACE_RECORD_FIELDS];
+    guint64* cursor = fields;
+
+    *cursor++ = worker_getCurrentTime();
+    *cursor++ = _syscallhandler_nowNanos() - start;
+    *cursor++ = (guint64)thread_getID(sys->thread);
+    *cursor++ = (guint64)args->number;
+    for (int i = 0; i < 6; i++) {
+        *cursor++ = args->args[i].as_u64;
+    }
+    *cursor++ = scr->state == SYSCALL_DONE ? scr->retval.as_u64 : 0;
+    *cursor++ = (guint64)scr->state | (wasBlocked ? SYSCALL_TRACE_RESUMED : 0) |
+                (wasInterrupted ? SYSCALL_TRACE_INTERRUPTED : 0);
+
+    if (fwrite(fields, sizeof(*fields), SYSCALL_TRACE_RECORD_FIELDS, file) !=
+        SYSCALL_TRACE_RECORD_FIELDS) {
+        warning("error writing to syscall trace file");
+    }
+}
+
+guint64 syscallhandler_profileStart(SysCallHandler* sys) {
+    if (!sys || !sys->profile_counter) {
+        return 0;
+    }
+    MAGIC_ASSERT(sys);
+    return _syscallhandler_nowNanos();
+}
+
+void syscallhandler_profileStop(SysCallHandler* sys, const char* frame, guint64 start) {
+    if (start != 0 && sys && sys->profile_counter) {
+        MAGIC_ASSERT(sys);
+        counter_add_value(sys->profile_counter, frame, _syscallhandler_nowNanos() - start);
+    }
+}
+
+static guint64 _syscallhandler_pre_syscall(SysCallHandler* sys, long number,
+                                           const char* name) {
     trace("SYSCALL_HANDLER_PRE(%s,pid=%u): handling syscall %ld %s%s",
           process_getPluginName(sys->process),
           thread_getID(sys->thread), number, name,
@@ -171,21 +581,32 @@ static void _syscallhandler_pre_syscall(SysCallHandler* sys, long number,
     // Count the frequency of each syscall, but only on the initial call.
     // This avoids double counting in the case where the initial call blocked at first,
     // but then later became unblocked and is now being handled again here.
-    if (sys->syscall_counter && !_syscallhandler_wasBlocked(sys)) {
-        counter_add_value(sys->syscall_counter, name, 1);
+    if (sys->syscall_counts && !_syscallhandler_wasBlocked(sys) && number >= 0 &&
+        number < SYSCALL_TABLE_SIZE) {
+        sys->syscall_counts[number]++;
     }
 
 #ifdef USE_PERF_TIMERS
     /* Track elapsed time during this syscall by marking the start time. */
-    g_timer_start(sys->perfTimer);
+    perftimer_start(sys->perfTimer);
 #endif
+
+    return syscallhandler_profileStart(sys);
 }
 
 static void _syscallhandler_post_syscall(SysCallHandler* sys, long number,
-                                         const char* name, SysCallReturn* scr) {
+                                         const char* name, SysCallReturn* scr,
+                                         guint64 profileStart) {
+    if (profileStart != 0) {
+        /* blocked syscalls add the time of each attempt to handle them */
+        gchar frame[64];
+        g_snprintf(frame, sizeof(frame), "shadow;%s", name);
+        syscallhandler_profileStop(sys, frame, profileStart);
+    }
+
 #ifdef USE_PERF_TIMERS
     /* Add the cumulative elapsed seconds and num syscalls. */
-    sys->perfSecondsCurrent += g_timer_elapsed(sys->perfTimer, NULL);
+    sys->perfSecondsCurrent += perftimer_elapsed(sys->perfTimer);
 #endif
 
     trace("SYSCALL_HANDLER_POST(%s,pid=%u): syscall %ld %s result: state=%s%s "
@@ -212,38 +633,96 @@ static void _syscallhandler_post_syscall(SysCallHandler* sys, long number,
     }
 }
 
+/* Whether the syscall may create a path, which the process may have remembered as
+ * missing. Includes the syscalls that the plugin executes natively. */
+static bool _syscallhandler_mayCreatePath(const SysCallArgs* args) {
+    switch (args->number) {
+        case SYS_open: return (args->args[1].as_i64 & O_CREAT) != 0;
+        case SYS_openat: return (args->args[2].as_i64 & O_CREAT) != 0;
+        case SYS_creat:
+        case SYS_link:
+        case SYS_linkat:
+        case SYS_mkdir:
+        case SYS_mkdirat:
+        case SYS_mknod:
+        case SYS_mknodat:
+        case SYS_rename:
+        case SYS_renameat:
+        case SYS_renameat2:
+        case SYS_symlink:
+        case SYS_symlinkat: return true;
+        default: return false;
+    }
+}
+
+/* Whether the completed syscall found nothing to do, as the syscalls of a thread that
+ * busy-waits do: a poll that returned no events, or a call that failed with EAGAIN. */
+static bool _syscallhandler_foundNothing(const SysCallArgs* args, const SysCallReturn* scr) {
+    if (scr->state != SYSCALL_DONE) {
+        return false;
+    }
+    switch (args->number) {
+        case SYS_epoll_pwait:
+        case SYS_epoll_wait:
+        case SYS_poll:
+        case SYS_ppoll:
+        case SYS_pselect6:
+#ifdef SYS_select
+        case SYS_select:
+#endif
+            return scr->retval.as_i64 == 0;
+        default: return scr->retval.as_i64 == -EAGAIN;
+    }
+}
+
+/* Counts the syscalls that the thread makes in a row at the same simulated time without
+ * finding anything to do. Reading the time doesn't end the run, since busy-waiting
+ * threads often check it between their polls. */
+static void _syscallhandler_countSpin(SysCallHandler* sys, const SysCallArgs* args,
+                                      const SysCallReturn* scr) {
+    switch (args->number) {
+        case SYS_clock_gettime:
+        case SYS_gettimeofday:
+        case SYS_time: return;
+        default: break;
+    }
+
+    SimulationTime now = worker_getCurrentTime();
+    if (!_syscallhandler_foundNothing(args, scr)) {
+        sys->spinCount = 0;
+    } else if (sys->spinTime != now) {
+        sys->spinTime = now;
+        sys->spinCount = 1;
+    } else {
+        sys->spinCount++;
+    }
+}
+
+/* Blocks the spinning thread for _spinSyscallDelay, after which the syscall is handled
+ * as usual. Until then, the thread's CPU time goes to the other threads and hosts. */
+static SysCallReturn _syscallhandler_delaySpin(SysCallHandler* sys, long number) {
+    trace("thread %d made %u syscalls in a row that found nothing to do; delaying "
+          "syscall %ld by %" G_GUINT64_FORMAT " ns",
+          thread_getID(sys->thread), sys->spinCount, number, _spinSyscallDelay);
+
+    sys->spinCount = 0;
+    sys->isSpinDelayed = true;
+
+    struct timespec delay = {
+        .tv_sec = _spinSyscallDelay / SIMTIME_ONE_SECOND,
+        .tv_nsec = _spinSyscallDelay % SIMTIME_ONE_SECOND,
+    };
+    _syscallhandler_setListenTimeout(sys, &delay, TIMEOUT_RELATIVE);
+
+    return (SysCallReturn){
+        .state = SYSCALL_BLOCK,
+        .cond = syscallcondition_newForThread(sys->thread, (Trigger){0}, sys->timer)};
+}
+
 ///////////////////////////////////////////////////////////
 // Single public API function for calling Shadow syscalls
 ///////////////////////////////////////////////////////////
 
-#define HANDLE(s)                                                              \
-    case SYS_##s:                                                              \
-        _syscallhandler_pre_syscall(sys, args->number, #s);                    \
-        scr = syscallhandler_##s(sys, args);                                   \
-        _syscallhandler_post_syscall(sys, args->number, #s, &scr);             \
-        break
-#define NATIVE(s)                                                              \
-    case SYS_##s:                                                              \
-        trace("native syscall %ld " #s, args->number);                         \
-        scr = (SysCallReturn){.state = SYSCALL_NATIVE};                        \
-        break
-#define UNSUPPORTED(s)                                                                             \
-    case SYS_##s:                                                                                  \
-        error("Returning error ENOSYS for explicitly unsupported syscall %ld " #s, args->number);  \
-        scr = (SysCallReturn){.state = -ENOSYS};                                                   \
-        break
-
-#ifdef USE_C_SYSCALLS
-#define HANDLE_RUST(s) HANDLE(s)
-#else
-#define HANDLE_RUST(s)                                                         \
-    case SYS_##s:                                                              \
-        _syscallhandler_pre_syscall(sys, args->number, #s);                    \
-        scr = rustsyscallhandler_##s(sys, args);                               \
-        _syscallhandler_post_syscall(sys, args->number, #s, &scr);             \
-        break
-#endif
-
 SysCallReturn syscallhandler_make_syscall(SysCallHandler* sys,
                                           const SysCallArgs* args) {
     MAGIC_ASSERT(sys);
@@ -258,6 +737,14 @@ SysCallReturn syscallhandler_make_syscall(SysCallHandler* sys,
     }
     SysCallReturn scr;
 
+    TRACEPOINT(syscall_enter, host_getID(sys->host), process_getProcessID(sys->process),
+               thread_getID(sys->thread), args->number);
+
+    FILE* traceFile = process_getSyscallTraceFile(sys->process);
+    guint64 traceStart = traceFile ? _syscallhandler_nowNanos() : 0;
+    gboolean wasBlocked = _syscallhandler_wasBlocked(sys);
+    gboolean wasInterrupted = FALSE;
+
     /* Make sure that we either don't have a blocked syscall,
      * or if we blocked a syscall, then that same syscall
      * should be executed again when it becomes unblocked. */
@@ -267,247 +754,54 @@ SysCallReturn syscallhandler_make_syscall(SysCallHandler* sys,
                       sys->blockedSyscallNR, args->number);
     }
 
-    switch (args->number) {
-        HANDLE(accept);
-        HANDLE(accept4);
-        HANDLE(bind);
-        HANDLE(brk);
-        HANDLE(clock_gettime);
-        HANDLE(clone);
-        HANDLE_RUST(close);
-        HANDLE(connect);
-        HANDLE(creat);
-        HANDLE_RUST(dup);
-        HANDLE(epoll_create);
-        HANDLE(epoll_create1);
-        HANDLE(epoll_ctl);
-        HANDLE(epoll_wait);
-        HANDLE(eventfd);
-        HANDLE(eventfd2);
-        HANDLE(execve);
-        HANDLE(exit_group);
-        HANDLE(faccessat);
-        HANDLE(fadvise64);
-        HANDLE(fallocate);
-        HANDLE(fchmod);
-        HANDLE(fchmodat);
-        HANDLE(fchown);
-        HANDLE(fchownat);
-        HANDLE(fcntl);
-#ifdef SYS_fcntl64
-        HANDLE(fcntl64);
-#endif
-        HANDLE(fdatasync);
-        HANDLE(fgetxattr);
-        HANDLE(flistxattr);
-        HANDLE(flock);
-        HANDLE(fremovexattr);
-        HANDLE(fsetxattr);
-        HANDLE(fstat);
-        HANDLE(fstatfs);
-        HANDLE(fsync);
-        HANDLE(ftruncate);
-        HANDLE(futex);
-        HANDLE(futimesat);
-        HANDLE(getdents);
-        HANDLE(getdents64);
-        HANDLE(getpeername);
-        HANDLE(getpid);
-        HANDLE(getppid);
-        HANDLE(gettid);
-        HANDLE(getrandom);
-        HANDLE(get_robust_list);
-        HANDLE(getsockname);
-        HANDLE(getsockopt);
-        HANDLE(gettimeofday);
-        HANDLE(ioctl);
-        HANDLE(kill);
-        HANDLE(linkat);
-        HANDLE(listen);
-        HANDLE(lseek);
-        HANDLE(mkdirat);
-        HANDLE(mknodat);
-        HANDLE(mmap);
-#ifdef SYS_mmap2
-        HANDLE(mmap2);
-#endif
-        HANDLE(mprotect);
-        HANDLE(mremap);
-        HANDLE(munmap);
-        HANDLE(nanosleep);
-        HANDLE(newfstatat);
-        HANDLE(open);
-        HANDLE(openat);
-        HANDLE_RUST(pipe);
-        HANDLE_RUST(pipe2);
-        HANDLE(poll);
-        HANDLE(ppoll);
-        HANDLE(prctl);
-        HANDLE_RUST(pread64);
-        HANDLE(preadv);
-#ifdef SYS_preadv2
-        HANDLE(preadv2);
-#endif
-#ifdef SYS_prlimit
-        HANDLE(prlimit);
-#endif
-#ifdef SYS_prlimit64
-        HANDLE(prlimit64);
-#endif
-        HANDLE_RUST(pwrite64);
-        HANDLE(pwritev);
-#ifdef SYS_pwritev2
-        HANDLE(pwritev2);
-#endif
-        HANDLE_RUST(read);
-        HANDLE(readahead);
-        HANDLE(readlinkat);
-        HANDLE(readv);
-        HANDLE(recvfrom);
-        HANDLE(renameat);
-        HANDLE(renameat2);
-        HANDLE(shadow_set_ptrace_allow_native_syscalls);
-        HANDLE(shadow_get_ipc_blk);
-        HANDLE(shadow_get_shm_blk);
-        HANDLE(shadow_hostname_to_addr_ipv4);
-        HANDLE(sendto);
-        HANDLE(setsockopt);
-#ifdef SYS_sigaction
-        // Superseded by rt_sigaction in Linux 2.2
-        UNSUPPORTED(sigaction);
-#endif
-        HANDLE(rt_sigaction);
-#ifdef SYS_signal
-        // Superseded by sigaction in glibc 2.0
-        UNSUPPORTED(signal);
-#endif
-#ifdef SYS_sigprocmask
-        // Superseded by rt_sigprocmask in Linux 2.2
-        UNSUPPORTED(sigprocmask);
-#endif
-        HANDLE(rt_sigprocmask);
-        HANDLE(set_robust_list);
-        HANDLE(set_tid_address);
-        HANDLE(shutdown);
-        HANDLE(socket);
-        HANDLE(socketpair);
-#ifdef SYS_statx
-        HANDLE(statx);
-#endif
-        HANDLE(symlinkat);
-        HANDLE(sync_file_range);
-        HANDLE(syncfs);
-        HANDLE(sysinfo);
-        HANDLE(tgkill);
-        HANDLE(time);
-        HANDLE(timerfd_create);
-        HANDLE(timerfd_gettime);
-        HANDLE(timerfd_settime);
-        HANDLE(tkill);
-        HANDLE(uname);
-        HANDLE(unlinkat);
-        HANDLE(utimensat);
-        HANDLE_RUST(write);
-        HANDLE(writev);
-
-        // **************************************
-        // Not handled (yet):
-        // **************************************
-        // NATIVE(chdir);
-        // NATIVE(fchdir);
-        // NATIVE(io_getevents);
-        // NATIVE(waitid);
-        // NATIVE(msync);
-
-        //// operations on pids (shadow overrides pids)
-        // NATIVE(sched_getaffinity);
-        // NATIVE(sched_setaffinity);
-
-        //// operations on file descriptors
-        // NATIVE(dup2);
-        // NATIVE(dup3);
-        // NATIVE(select);
-        // NATIVE(pselect6);
-
-        //// copying data between various types of fds
-        // NATIVE(copy_file_range);
-        // NATIVE(sendfile);
-        // NATIVE(splice);
-        // NATIVE(vmsplice);
-        // NATIVE(tee);
-
-        //// additional socket io
-        // NATIVE(recvmsg);
-        // NATIVE(sendmsg);
-        // NATIVE(recvmmsg);
-        // NATIVE(sendmmsg);
-
-        // ***************************************
-        // We think we don't need to handle these
-        // (because the plugin can natively):
-        // ***************************************
-        NATIVE(access);
-        NATIVE(arch_prctl);
-        NATIVE(chmod);
-        NATIVE(chown);
-        NATIVE(exit);
-        NATIVE(getcwd);
-        NATIVE(geteuid);
-        NATIVE(getegid);
-        NATIVE(getgid);
-        NATIVE(getresgid);
-        NATIVE(getresuid);
-        NATIVE(getrlimit);
-        NATIVE(getuid);
-        NATIVE(getxattr);
-        NATIVE(lchown);
-        NATIVE(lgetxattr);
-        NATIVE(link);
-        NATIVE(listxattr);
-        NATIVE(llistxattr);
-        NATIVE(lremovexattr);
-        NATIVE(lsetxattr);
-        NATIVE(lstat);
-        NATIVE(madvise);
-        NATIVE(mkdir);
-        NATIVE(mknod);
-        NATIVE(readlink);
-        NATIVE(removexattr);
-        NATIVE(rename);
-        NATIVE(rmdir);
-        NATIVE(rt_sigreturn);
-        NATIVE(setfsgid);
-        NATIVE(setfsuid);
-        NATIVE(setgid);
-        NATIVE(setregid);
-        NATIVE(setresgid);
-        NATIVE(setresuid);
-        NATIVE(setreuid);
-        NATIVE(setrlimit);
-        NATIVE(setuid);
-        NATIVE(setxattr);
-        NATIVE(stat);
-#ifdef SYS_stat64
-        NATIVE(stat64);
-#endif
-        NATIVE(statfs);
-        NATIVE(sigaltstack);
-        NATIVE(symlink);
-        NATIVE(truncate);
-        NATIVE(unlink);
-        NATIVE(utime);
-        NATIVE(utimes);
-
-        default:
-            warning(
-                "Detected unsupported syscall %ld called from thread %i in process %s on host %s",
+    const SysCallTableEntry* entry = _syscallhandler_lookup(args->number);
+
+    if (sys->isSpinDelayed) {
+        /* The delay that we added is over, so the syscall is handled as a new one. */
+        sys->isSpinDelayed = false;
+        _syscallhandler_setListenTimeout(sys, NULL, TIMEOUT_RELATIVE);
+        sys->blockedSyscallNR = -1;
+        wasBlocked = FALSE;
+    }
+
+    if (process_cachesMissingPaths(sys->process) && _syscallhandler_mayCreatePath(args)) {
+        process_forgetMissingPaths(sys->process);
+    }
+
+    if (_spinSyscallDelay > 0 && sys->spinCount >= _spinSyscallLimit &&
+        sys->spinTime == worker_getCurrentTime()) {
+        scr = _syscallhandler_delaySpin(sys, args->number);
+    } else if (wasBlocked && process_hasPendingSignals(sys->process)) {
+        // A signal interrupted the blocked syscall. The shim raises it when it gets the result.
+        trace("syscall %ld %s interrupted by a signal", args->number, entry->name);
+        scr = (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -EINTR};
+        wasInterrupted = TRUE;
+    } else if (entry->handler) {
+        guint64 start = _syscallhandler_pre_syscall(sys, args->number, entry->name);
+        scr = entry->handler(sys, args);
+        _syscallhandler_post_syscall(sys, args->number, entry->name, &scr, start);
+    } else if (entry->flags & SYSCALL_FLAG_NATIVE) {
+        trace("native syscall %ld %s", args->number, entry->name);
+        scr = (SysCallReturn){.state = SYSCALL_NATIVE};
+    } else if (entry->flags & SYSCALL_FLAG_UNSUPPORTED) {
+        error("Returning error ENOSYS for explicitly unsupported syscall %ld %s", args->number,
+              entry->name);
+        scr = (SysCallReturn){.state = -ENOSYS};
+    } else {
+        warning("Detected unsupported syscall %ld called from thread %i in process %s on host %s",
                 args->number, thread_getID(sys->thread), process_getName(sys->process),
                 host_getName(sys->host));
-            error("Returning error %i (ENOSYS) for unsupported syscall %li, which may result in "
-                  "unusual behavior",
-                  ENOSYS, args->number);
-            scr = (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOSYS};
-            break;
+        error("Returning error %i (ENOSYS) for unsupported syscall %li, which may result in "
+              "unusual behavior",
+              ENOSYS, args->number);
+        scr = (SysCallReturn){.state = SYSCALL_DONE, .retval.as_i64 = -ENOSYS};
+    }
+
+    utility_assert(!(entry->flags & SYSCALL_FLAG_NEVER_BLOCKS) || scr.state != SYSCALL_BLOCK ||
+                   sys->isSpinDelayed);
+
+    if (_spinSyscallDelay > 0 && !sys->isSpinDelayed) {
+        _syscallhandler_countSpin(sys, args, &scr);
     }
 
     if (scr.state == SYSCALL_BLOCK) {
@@ -521,13 +815,20 @@ SysCallReturn syscallhandler_make_syscall(SysCallHandler* sys,
         sys->blockedSyscallNR = -1;
     }
 
-    if (!(scr.state == SYSCALL_DONE && syscall_rawReturnValueToErrno(scr.retval.as_i64) == 0)) {
+    if (!(entry->flags & SYSCALL_FLAG_NO_PLUGIN_MEMORY) &&
+        !(scr.state == SYSCALL_DONE && syscall_rawReturnValueToErrno(scr.retval.as_i64) == 0)) {
         // The syscall didn't complete successfully; don't write back pointers.
         trace("Syscall didn't complete successfully; discarding plugin ptrs without writing back.");
         process_freePtrsWithoutFlushing(sys->process);
     }
 
+    if (traceFile) {
+        _syscallhandler_writeTrace(
+            sys, traceFile, args, &scr, wasBlocked, wasInterrupted, traceStart);
+    }
+
+    TRACEPOINT(syscall_exit, host_getID(sys->host), process_getProcessID(sys->process),
+               thread_getID(sys->thread), args->number, scr.state, scr.retval.as_i64);
+
     return scr;
 }
-#undef NATIVE
-#undef HANDLE
@@ -7,6 +7,7 @@
 #define SRC_MAIN_HOST_SHD_SYSCALL_HANDLER_H_
 
 #include <glib.h>
+#include <stdio.h>
 #include <sys/time.h>
 
 typedef struct _SysCallHandler SysCallHandler;
@@ -16,11 +17,38 @@ typedef struct _SysCallHandler SysCallHandler;
 #include "main/host/syscall_types.h"
 #include "main/host/thread.h"
 
+/* What callers may assume about a syscall number, so that they can skip work. */
+typedef enum {
+    /* the handler never returns SYSCALL_BLOCK */
+    SYSCALL_FLAG_NEVER_BLOCKS = 1 << 0,
+    /* the handler never reads or writes plugin memory */
+    SYSCALL_FLAG_NO_PLUGIN_MEMORY = 1 << 1,
+    /* shadow lets the plugin execute the syscall natively */
+    SYSCALL_FLAG_NATIVE = 1 << 2,
+    /* shadow knows of the syscall but always fails it with ENOSYS */
+    SYSCALL_FLAG_UNSUPPORTED = 1 << 3,
+} SysCallFlags;
+
 SysCallHandler* syscallhandler_new(Host* host, Process* process,
                                    Thread* thread);
 void syscallhandler_ref(SysCallHandler* sys);
 void syscallhandler_unref(SysCallHandler* sys);
 SysCallReturn syscallhandler_make_syscall(SysCallHandler* sys,
                                           const SysCallArgs* args);
+/* Returns the flags of syscall `number`, which are 0 for syscalls shadow doesn't know. */
+SysCallFlags syscallhandler_getFlags(long number);
+/* Returns the number of the syscall called `name` in shadow's table, or -1 if there's none. */
+long syscallhandler_getNumber(const char* name);
+
+/* Returns a start time to pass to syscallhandler_profileStop, or 0 if the
+ * profiler is disabled. `sys` may be NULL, in which case nothing is profiled. */
+guint64 syscallhandler_profileStart(SysCallHandler* sys);
+/* Adds the time since `start` to the profiled time of `frame`, which is a
+ * ';'-separated list of stack frames below the host and process frames. */
+void syscallhandler_profileStop(SysCallHandler* sys, const char* frame, guint64 start);
+
+/* Creates a file for syscallhandler_make_syscall to write a binary record of each
+ * syscall of a process to, or returns NULL if it can't be created. */
+FILE* syscallhandler_openTraceFile(const gchar* path);
 
 #endif /* SRC_MAIN_HOST_SHD_SYSCALL_HANDLER_H_ */
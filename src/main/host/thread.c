@@ -16,6 +16,7 @@
 
 #include "lib/logger/logger.h"
 #include "lib/shim/shim_event.h"
+#include "main/core/support/config_handlers.h"
 #include "main/core/worker.h"
 #include "main/host/affinity.h"
 #include "main/host/syscall_condition.h"
@@ -23,6 +24,9 @@
 #include "main/host/thread_protected.h"
 #include "main/utility/syscall.h"
 
+static bool _useNodeCpuPinning = false;
+ADD_CONFIG_HANDLER(config_getUseNodeCpuPinning, _useNodeCpuPinning)
+
 Thread thread_create(Host* host, Process* process, int threadID, int type_id,
                      ThreadMethods methods) {
     Thread thread = {.type_id = type_id,
@@ -46,17 +50,29 @@ static void _thread_cleanupSysCallCondition(Thread* thread) {
     MAGIC_ASSERT(thread);
     if (thread->cond) {
         syscallcondition_cancel(thread->cond);
-        syscallcondition_unref(thread->cond);
+        if (!thread->spareCond && syscallcondition_isReusable(thread->cond)) {
+            // Keep it for our next blocking syscall, but don't keep the trigger alive
+            syscallcondition_reset(thread->cond, (Trigger){0}, NULL);
+            thread->spareCond = thread->cond;
+        } else {
+            syscallcondition_unref(thread->cond);
+        }
         thread->cond = NULL;
     }
 }
 
 /*
- * Helper function. Sets the thread's CPU affinity to the worker's affinity.
+ * Helper function. Sets the thread's CPU affinity to the worker's affinity, or to the
+ * worker's NUMA node.
  */
 static void _thread_syncAffinityWithWorker(Thread *thread) {
-    thread->affinity =
-        affinity_setProcessAffinity(thread->nativeTid, worker_getAffinity(), thread->affinity);
+    if (_useNodeCpuPinning) {
+        thread->affinity = affinity_setProcessNodeAffinity(
+            thread->nativeTid, worker_getAffinity(), thread->affinity);
+    } else {
+        thread->affinity =
+            affinity_setProcessAffinity(thread->nativeTid, worker_getAffinity(), thread->affinity);
+    }
 }
 
 void thread_ref(Thread* thread) {
@@ -70,6 +86,10 @@ void thread_unref(Thread* thread) {
     utility_assert(thread->referenceCount >= 0);
     if(thread->referenceCount == 0) {
         _thread_cleanupSysCallCondition(thread);
+        if (thread->spareCond) {
+            syscallcondition_unref(thread->spareCond);
+            thread->spareCond = NULL;
+        }
         thread->methods.free(thread);
         if (thread->process) {
             process_unref(thread->process);
@@ -151,6 +171,20 @@ long thread_nativeSyscall(Thread* thread, long n, ...) {
     return rv;
 }
 
+void thread_nativeSyscalls(Thread* thread, const SysCallArgs* calls, long* results, size_t n) {
+    MAGIC_ASSERT(thread);
+    if (thread->methods.nativeSyscalls) {
+        thread->methods.nativeSyscalls(thread, calls, results, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const SysCallReg* args = calls[i].args;
+        results[i] =
+            thread_nativeSyscall(thread, calls[i].number, args[0].as_i64, args[1].as_i64,
+                                 args[2].as_i64, args[3].as_i64, args[4].as_i64, args[5].as_i64);
+    }
+}
+
 int thread_getID(Thread* thread) {
     MAGIC_ASSERT(thread);
     return thread->tid;
@@ -188,6 +222,22 @@ SysCallCondition* thread_getSysCallCondition(Thread* thread) {
     return thread->cond;
 }
 
+bool thread_interrupt(Thread* thread) {
+    MAGIC_ASSERT(thread);
+    if (!thread->cond) {
+        return false;
+    }
+    syscallcondition_wakeup(thread->cond);
+    return true;
+}
+
+SysCallCondition* thread_takeSpareSysCallCondition(Thread* thread) {
+    MAGIC_ASSERT(thread);
+    SysCallCondition* cond = thread->spareCond;
+    thread->spareCond = NULL;
+    return cond;
+}
+
 PluginVirtualPtr thread_getTidAddress(Thread* thread) {
     MAGIC_ASSERT(thread);
     return thread->tidAddress;
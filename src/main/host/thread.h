@@ -36,6 +36,11 @@ int thread_getReturnCode(Thread* thread);
 // You can map to a corresponding errno value with syscall_rawReturnValueToErrno.
 long thread_nativeSyscall(Thread* thread, long n, ...);
 
+// Like thread_nativeSyscall, for the `n` syscalls in `calls`, which are made in order.
+// Sets results[i] to the return value of calls[i]. Use this when none of the syscalls
+// depend on the result of an earlier one, since some threads can make them all at once.
+void thread_nativeSyscalls(Thread* thread, const SysCallArgs* calls, long* results, size_t n);
+
 bool thread_isRunning(Thread* thread);
 
 uint32_t thread_getProcessId(Thread* thread);
@@ -78,4 +83,16 @@ Host* thread_getHost(Thread* thread);
 // Get the syscallhandler for this thread.
 SysCallHandler* thread_getSysCallHandler(Thread* thread);
 
+// Returns the condition that the thread is blocked on, or NULL if it isn't blocked.
+SysCallCondition* thread_getSysCallCondition(Thread* thread);
+
+// Returns the condition that this thread last blocked on, without a trigger or
+// timeout, or NULL if there is none we can reuse. The caller takes the
+// thread's reference. See syscallcondition_newForThread().
+SysCallCondition* thread_takeSpareSysCallCondition(Thread* thread);
+
+// If the thread is blocked in a syscall, wakes it as if the syscall's condition
+// had timed out, and returns true.
+bool thread_interrupt(Thread* thread);
+
 #endif /* SRC_MAIN_HOST_SHD_THREAD_H_ */
@@ -8,6 +8,7 @@
 #include <sched.h>
 #include <search.h>
 #include <sys/prctl.h>
+#include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -16,13 +17,44 @@
 #include "lib/logger/logger.h"
 #include "lib/shim/ipc.h"
 #include "lib/shim/shim_event.h"
+#include "lib/shim/shim_zygote.h"
+#include "main/core/support/config_handlers.h"
+#include "main/core/work/task.h"
 #include "main/core/worker.h"
+#include "main/host/cpu.h"
+#include "main/host/host.h"
 #include "main/host/shimipc.h"
+#include "main/host/syscall_handler.h"
 #include "main/host/thread_protected.h"
+#include "main/host/tsc.h"
 #include "main/shmem/shmem_allocator.h"
 
 #define THREADPRELOAD_TYPE_ID 13357
 
+static bool _usePreloadZygote = false;
+ADD_CONFIG_HANDLER(config_getUsePreloadZygote, _usePreloadZygote)
+
+static bool _useThreadOverlap = false;
+ADD_CONFIG_HANDLER(config_getUseThreadOverlap, _useThreadOverlap)
+
+static bool _usePipelinedWorkers = false;
+ADD_CONFIG_HANDLER(config_getUsePipelinedWorkers, _usePipelinedWorkers)
+
+/* a plugin process that stops in the shim once its libraries are loaded, and forks
+ * the processes that have the same arguments and environment as it, apart from the
+ * per-process values in ShimZygoteRequest */
+typedef struct _ThreadPreloadZygote {
+    /* serializes the requests, since the zygote serves one at a time */
+    GMutex lock;
+    /* our end of the zygote's socket, or -1 if the zygote isn't usable */
+    int fd;
+    pid_t pid;
+} ThreadPreloadZygote;
+
+/* the zygotes, keyed by their arguments and environment */
+static GHashTable* _zygotes = NULL;
+static GMutex _zygotesLock;
+
 struct _ThreadPreload {
     Thread base;
 
@@ -34,6 +66,12 @@ struct _ThreadPreload {
     /* holds the event id for the most recent call from the plugin/shim */
     ShimEvent currentEvent;
 
+    /* we sent the plugin the result of its last syscall without waiting for its
+     * next event, which a task will collect */
+    bool isDetached;
+    /* while detached, we already received the plugin's next event into currentEvent */
+    bool hasNextEvent;
+
     /* Typed pointer to ipc_blk.p */
     struct IPCData* ipc_data;
 };
@@ -64,6 +102,10 @@ void threadpreload_free(Thread* base) {
         syscallhandler_unref(thread->base.sys);
     }
 
+    if (thread->ipc_blk.p) {
+        process_returnThreadBlock(thread->base.process, thread->ipc_blk, thread->base.nativeTid);
+    }
+
     worker_count_deallocation(ThreadPreload);
 }
 
@@ -81,8 +123,10 @@ static gchar** _add_shadow_pid_to_env(gchar** envp) {
     return envp;
 }
 
+/* inheritFd is a close-on-exec descriptor to pass to the new process, or -1 */
 static pid_t _threadpreload_fork_exec(ThreadPreload* thread, const char* file, char* const argv[],
-                                      char* const envp[], const char* workingDir) {
+                                      char* const envp[], const char* workingDir,
+                                      int inheritFd) {
     // vfork has superior performance to fork with large workloads.
     pid_t pid = vfork();
 
@@ -104,6 +148,11 @@ static pid_t _threadpreload_fork_exec(ThreadPreload* thread, const char* file, c
                 die_after_vfork();
             }
 
+            // The child has its own copy of the descriptor table
+            if (inheritFd >= 0 && fcntl(inheritFd, F_SETFD, 0) < 0) {
+                die_after_vfork();
+            }
+
             int rc = execvpe(file, argv, envp);
             if (rc == -1) {
                 die_after_vfork();
@@ -118,10 +167,120 @@ static pid_t _threadpreload_fork_exec(ThreadPreload* thread, const char* file, c
     }
 }
 
+static ThreadPreloadZygote* _threadpreload_newZygote(gchar** argv, gchar** envv,
+                                                     const char* workingDir) {
+    ThreadPreloadZygote* zygote = g_new0(ThreadPreloadZygote, 1);
+    g_mutex_init(&zygote->lock);
+    zygote->fd = -1;
+
+    /* message boundaries let the zygote read whole requests */
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        warning("socketpair: %s", g_strerror(errno));
+        return zygote;
+    }
+
+    gchar* fdStr = g_strdup_printf("%d", fds[1]);
+    gchar** myenvv = g_environ_setenv(g_strdupv(envv), SHIM_ZYGOTE_FD_ENV_VAR, fdStr, TRUE);
+    g_free(fdStr);
+
+    zygote->pid = _threadpreload_fork_exec(NULL, argv[0], argv, myenvv, workingDir, fds[1]);
+    zygote->fd = fds[0];
+    close(fds[1]);
+    g_strfreev(myenvv);
+
+    info("started zygote %d for %s", zygote->pid, argv[0]);
+    return zygote;
+}
+
+/* returns the zygote for processes with these arguments and environment, starting it
+ * if this is the first such process */
+static ThreadPreloadZygote* _threadpreload_getZygote(gchar** argv, gchar** envv,
+                                                     const char* workingDir) {
+    /* the zygote gets the environment that its processes have in common */
+    gchar** zygoteEnvv = g_strdupv(envv);
+    zygoteEnvv = g_environ_unsetenv(zygoteEnvv, "SHADOW_IPC_BLK");
+    zygoteEnvv = g_environ_unsetenv(zygoteEnvv, "SHADOW_LOG_FILE");
+
+    gchar* argStr = g_strjoinv("\n", argv);
+    gchar* envStr = g_strjoinv("\n", zygoteEnvv);
+    gchar* key = g_strconcat(argStr, "\n\n", envStr, NULL);
+    g_free(argStr);
+    g_free(envStr);
+
+    g_mutex_lock(&_zygotesLock);
+
+    if (_zygotes == NULL) {
+        _zygotes = g_hash_table_new(g_str_hash, g_str_equal);
+
+        /* the zygotes orphan the processes they fork, so that we adopt them and they
+         * look like any other process we started */
+        if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0) {
+            utility_panic("prctl: %s", g_strerror(errno));
+        }
+    }
+
+    ThreadPreloadZygote* zygote = g_hash_table_lookup(_zygotes, key);
+    if (zygote == NULL) {
+        zygote = _threadpreload_newZygote(argv, zygoteEnvv, workingDir);
+        /* the table keeps the key */
+        g_hash_table_insert(_zygotes, key, zygote);
+        key = NULL;
+    }
+
+    g_mutex_unlock(&_zygotesLock);
+
+    g_free(key);
+    g_strfreev(zygoteEnvv);
+    return zygote;
+}
+
+/* returns the pid of the new process, or -1 if the zygote couldn't start it */
+static pid_t _threadpreload_forkFromZygote(ThreadPreloadZygote* zygote, const char* ipcBlk,
+                                           const char* logFile, const char* workingDir) {
+    ShimZygoteRequest request = {0};
+    if (logFile == NULL || strlen(ipcBlk) >= sizeof(request.ipc_blk) ||
+        strlen(logFile) >= sizeof(request.log_file) ||
+        strlen(workingDir) >= sizeof(request.working_dir)) {
+        return -1;
+    }
+    strcpy(request.ipc_blk, ipcBlk);
+    strcpy(request.log_file, logFile);
+    strcpy(request.working_dir, workingDir);
+
+    ShimZygoteReply reply = {.pid = -1};
+
+    g_mutex_lock(&zygote->lock);
+
+    if (zygote->fd >= 0) {
+        if (send(zygote->fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request) ||
+            recv(zygote->fd, &reply, sizeof(reply), 0) != sizeof(reply)) {
+            /* the zygote exited, e.g. because the plugin failed to load */
+            warning("zygote %d is not responding, so processes will be exec'd instead",
+                    zygote->pid);
+            close(zygote->fd);
+            zygote->fd = -1;
+            reply.pid = -1;
+        } else if (reply.pid < 0) {
+            warning("zygote %d could not fork: %s", zygote->pid, g_strerror(reply.error));
+        }
+    }
+
+    g_mutex_unlock(&zygote->lock);
+
+    return reply.pid;
+}
+
 static void _threadpreload_cleanup(ThreadPreload* thread) {
     trace("child %d exited", thread->base.nativePid);
     thread->isRunning = 0;
 
+    if (thread->isDetached) {
+        host_removeDetachedThread(thread->base.host, _threadPreloadToThread(thread));
+        thread->isDetached = false;
+        thread->hasNextEvent = false;
+    }
+
     if (thread->base.sys) {
         syscallhandler_unref(thread->base.sys);
         thread->base.sys = NULL;
@@ -152,6 +311,24 @@ pid_t threadpreload_run(Thread* base, gchar** argv, gchar** envv, const char* wo
         myenvv = g_environ_setenv(myenvv, "SHADOW_USE_SECCOMP", "", TRUE);
     }
 
+    /* Tell the shim which syscalls to make without asking us */
+    if (shimipc_getNativeSyscalls()) {
+        myenvv = g_environ_setenv(myenvv, "SHADOW_NATIVE_SYSCALLS", shimipc_getNativeSyscalls(),
+                                  TRUE);
+    }
+
+    /* Tell the shim whether to redirect the vDSO's time functions to itself */
+    if (shimipc_getUseVdsoPatching()) {
+        myenvv = g_environ_setenv(myenvv, "SHADOW_PATCH_VDSO", "", TRUE);
+    }
+
+    /* Tell the shim to emulate the timestamp counter, and at what frequency */
+    if (shimipc_getUseShimRdtsc()) {
+        gchar* tscHz = g_strdup_printf("%lu", TSC_EMULATED_CYCLES_PER_SECOND);
+        myenvv = g_environ_setenv(myenvv, "SHADOW_TSC_HZ", tscHz, TRUE);
+        g_free(tscHz);
+    }
+
     // set shadow's PID in the env so the child can run get_ppid
     myenvv = _add_shadow_pid_to_env(myenvv);
 
@@ -162,7 +339,15 @@ pid_t threadpreload_run(Thread* base, gchar** argv, gchar** envv, const char* wo
     g_free(envStr);
     g_free(argStr);
 
-    pid_t child_pid = _threadpreload_fork_exec(thread, argv[0], argv, myenvv, workingDir);
+    pid_t child_pid = -1;
+    if (_usePreloadZygote) {
+        ThreadPreloadZygote* zygote = _threadpreload_getZygote(argv, myenvv, workingDir);
+        child_pid = _threadpreload_forkFromZygote(
+            zygote, ipc_blk_buf, g_environ_getenv(myenvv, "SHADOW_LOG_FILE"), workingDir);
+    }
+    if (child_pid < 0) {
+        child_pid = _threadpreload_fork_exec(thread, argv[0], argv, myenvv, workingDir, -1);
+    }
 
     /* cleanup the dupd env*/
     if (myenvv) {
@@ -181,7 +366,18 @@ pid_t threadpreload_run(Thread* base, gchar** argv, gchar** envv, const char* wo
 static inline void _threadpreload_waitForNextEvent(ThreadPreload* thread) {
     MAGIC_ASSERT(_threadPreloadToThread(thread));
     utility_assert(thread->ipc_data);
+    if (thread->hasNextEvent) {
+        // threadpreload_pollEvent received it while the worker ran other hosts' events
+        thread->hasNextEvent = false;
+        trace("already received shim_event %d", thread->currentEvent.event_id);
+        return;
+    }
+    // The plugin runs until it sends its next event, so attribute the wait to it.
+    guint64 profileStart = syscallhandler_profileStart(thread->base.sys);
+    guint64 cpuStart = cpu_startTimer(host_getCPU(thread->base.host));
     shimevent_recvEventFromPlugin(thread->ipc_data, &thread->currentEvent);
+    cpu_stopTimer(host_getCPU(thread->base.host), cpuStart);
+    syscallhandler_profileStop(thread->base.sys, "plugin", profileStart);
     trace("received shim_event %d", thread->currentEvent.event_id);
 }
 
@@ -197,6 +393,34 @@ static ShMemBlock* _threadpreload_getShMBlock(Thread* base) {
     return NULL;
 }
 
+static void _threadpreload_collectTask(Host* host, gpointer callbackObject,
+                                       gpointer callbackArgument) {
+    Thread* base = callbackObject;
+    ThreadPreload* thread = _threadToThreadPreload(base);
+    // The thread may have already been continued, or killed with its process.
+    if (thread->isDetached && thread->isRunning) {
+        process_continue(base->process, base);
+    }
+}
+
+static void _threadpreload_collectTaskFree(gpointer data) { thread_unref(data); }
+
+/* Lets the plugin run until its next syscall while the worker runs the host's other
+ * events at this time, such as the other threads of the process. The thread's next
+ * syscall is handled by a task after them, so syscalls are still handled one at a
+ * time and in a deterministic order. With pipelined workers, the scheduler may also
+ * run other hosts' events until the plugin's next event arrives. */
+static void _threadpreload_detach(ThreadPreload* thread) {
+    Thread* base = _threadPreloadToThread(thread);
+    trace("detaching from thread %d until its next syscall", thread_getID(base));
+    thread->isDetached = true;
+    host_addDetachedThread(base->host, base);
+
+    thread_ref(base);
+    worker_scheduleCallback(_threadpreload_collectTask, base, NULL, _threadpreload_collectTaskFree,
+                            NULL, base->host, 0);
+}
+
 SysCallCondition* threadpreload_resume(Thread* base) {
     ThreadPreload* thread = _threadToThreadPreload(base);
 
@@ -205,6 +429,13 @@ SysCallCondition* threadpreload_resume(Thread* base) {
     // Flush any pending writes, e.g. from a previous thread that exited without flushing.
     process_flushPtrs(thread->base.process);
 
+    if (thread->isDetached) {
+        // The plugin ran while we handled other events; collect the event it sent since.
+        thread->isDetached = false;
+        host_removeDetachedThread(base->host, base);
+        _threadpreload_waitForNextEvent(thread);
+    }
+
     while (true) {
         switch (thread->currentEvent.event_id) {
             case SHD_SHIM_EVENT_START: {
@@ -235,21 +466,22 @@ SysCallCondition* threadpreload_resume(Thread* base) {
                     return NULL;
                 }
 
-                SysCallReturn result = syscallhandler_make_syscall(
-                    thread->base.sys, &thread->currentEvent.event_data.syscall.syscall_args);
+                const SysCallArgs* args = &thread->currentEvent.event_data.syscall.syscall_args;
+                SysCallReturn result = syscallhandler_make_syscall(thread->base.sys, args);
 
                 // Flush any writes the syscallhandler made.
-                process_flushPtrs(thread->base.process);
+                if (!(syscallhandler_getFlags(args->number) & SYSCALL_FLAG_NO_PLUGIN_MEMORY)) {
+                    process_flushPtrs(thread->base.process);
+                }
 
                 if (result.state == SYSCALL_BLOCK) {
                     if (shimipc_sendExplicitBlockMessageEnabled()) {
-                        trace("Sending block message to plugin");
+                        trace("Telling plugin to block");
                         // thread is blocked on simulation progress. Tell it to
                         // stop spinning so that releases its CPU core for the next
-                        // thread to be run.
-                        ShimEvent block_event = {.event_id = SHD_SHIM_EVENT_BLOCK};
-                        shimevent_sendEventToPlugin(thread->ipc_data, &block_event);
-                        shimevent_recvEventFromPlugin(thread->ipc_data, &block_event);
+                        // thread to be run. It sleeps on the IPC futex until we send
+                        // the syscall's result, so this needs no reply.
+                        shimevent_tellPluginToBlock(thread->ipc_data);
                     }
 
                     return result.cond;
@@ -261,18 +493,33 @@ SysCallCondition* threadpreload_resume(Thread* base) {
                     shim_result = (ShimEvent){
                         .event_id = SHD_SHIM_EVENT_SYSCALL_COMPLETE,
                         .event_data = {
-                            .syscall_complete = {.retval = result.retval,
-                                                 .simulation_nanos = worker_getEmulatedTime(),
-                                                 },
+                            .syscall_complete =
+                                {
+                                    .retval = result.retval,
+                                    .simulation_nanos = worker_getEmulatedTime(),
+                                    .pending_signals =
+                                        process_takePendingSignals(thread->base.process),
+                                },
 
                         }};
                 } else if (result.state == SYSCALL_NATIVE) {
                     // Tell the shim to make the syscall itself
                     shim_result = (ShimEvent){
                         .event_id = SHD_SHIM_EVENT_SYSCALL_DO_NATIVE,
+                        .event_data.syscall_complete.pending_signals =
+                            process_takePendingSignals(thread->base.process),
                     };
                 }
                 shimevent_sendEventToPlugin(thread->ipc_data, &shim_result);
+
+                // With pipelined workers, the worker can run other hosts' events while the
+                // plugin runs; see host_isWaitingForPlugin.
+                if ((_useThreadOverlap && process_getNumThreads(thread->base.process) > 1) ||
+                    _usePipelinedWorkers) {
+                    // No condition, but the thread is still running, so it isn't reaped.
+                    _threadpreload_detach(thread);
+                    return NULL;
+                }
                 break;
             }
             case SHD_SHIM_EVENT_SYSCALL_COMPLETE: {
@@ -312,6 +559,18 @@ void threadpreload_handleProcessExit(Thread* base) {
     _threadpreload_cleanup(thread);
 }
 
+bool threadpreload_pollEvent(Thread* base) {
+    ThreadPreload* thread = _threadToThreadPreload(base);
+    utility_assert(thread->isDetached);
+
+    if (!thread->hasNextEvent &&
+        shimevent_tryRecvEventFromPlugin(thread->ipc_data, &thread->currentEvent) == 0) {
+        trace("received shim_event %d while detached", thread->currentEvent.event_id);
+        thread->hasNextEvent = true;
+    }
+    return thread->hasNextEvent;
+}
+
 int threadpreload_getReturnCode(Thread* base) {
     ThreadPreload* thread = _threadToThreadPreload(base);
     return thread->returnCode;
@@ -361,27 +620,31 @@ static int _threadpreload_clone(Thread* base, unsigned long flags, PluginPtr chi
 
     *childp = threadpreload_new(base->host, base->process, host_getNewProcessID(base->host));
     ThreadPreload* child = _threadToThreadPreload(*childp);
-    child->ipc_blk = shmemallocator_globalAlloc(ipcData_nbytes());
+    child->ipc_blk = process_takeThreadBlock(base->process, ipcData_nbytes());
     utility_assert(child->ipc_blk.p);
     child->ipc_data = child->ipc_blk.p;
     ipcData_init(child->ipc_data, shimipc_spinMax());
     ShMemBlockSerialized ipc_blk_serial = shmemallocator_globalBlockSerialize(&child->ipc_blk);
 
-    // Send an IPC block for the new thread to use.
+    // Send an IPC block for the new thread to use, and have the shim create the new managed
+    // thread with it, in one round trip.
     shimevent_sendEventToPlugin(thread->ipc_data, &(ShimEvent){
         .event_id = SHD_SHIM_EVENT_ADD_THREAD_REQ,
         .event_data.add_thread_req = {
             .ipc_block = ipc_blk_serial,
+            .clone_args = {.number = SYS_clone,
+                           .args = {{.as_u64 = flags},
+                                    {.as_u64 = child_stack.val},
+                                    {.as_u64 = ptid.val},
+                                    {.as_u64 = ctid.val},
+                                    {.as_u64 = newtls}}},
         }
     });
-    {
-        ShimEvent res;
-        shimevent_recvEventFromPlugin(thread->ipc_data, &res);
-        utility_assert(res.event_id == SHD_SHIM_EVENT_ADD_THREAD_PARENT_RES);
-    }
+    ShimEvent res;
+    shimevent_recvEventFromPlugin(thread->ipc_data, &res);
+    utility_assert(res.event_id == SHD_SHIM_EVENT_SYSCALL_COMPLETE);
 
-    // Create the new managed thread.
-    pid_t childNativeTid = thread_nativeSyscall(base, SYS_clone, flags, child_stack, ptid, ctid, newtls);
+    pid_t childNativeTid = res.event_data.syscall_complete.retval.as_i64;
     if (childNativeTid < 0) {
         trace("native clone failed %d(%s)", childNativeTid, strerror(-childNativeTid));
         thread_unref(*childp);
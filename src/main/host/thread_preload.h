@@ -9,4 +9,8 @@ typedef struct _ThreadPreload ThreadPreload;
 
 Thread* threadpreload_new(Host* host, Process* process, gint threadID);
 
+// Returns whether the detached thread's plugin has sent its next event, receiving it
+// without blocking if it has. The event is handled when a task collects the thread.
+bool threadpreload_pollEvent(Thread* thread);
+
 #endif // SRC_MAIN_HOST_SHD_THREAD_PRELOAD_H_
@@ -24,6 +24,8 @@ typedef struct _ThreadMethods {
     bool (*isRunning)(Thread* thread);
     void (*free)(Thread* thread);
     long (*nativeSyscall)(Thread* thread, long n, va_list args);
+    // Optional. If NULL, thread_nativeSyscalls makes one syscall at a time.
+    void (*nativeSyscalls)(Thread* thread, const SysCallArgs* calls, long* results, size_t n);
     int (*clone)(Thread* thread, unsigned long flags, PluginPtr child_stack, PluginPtr ptid,
                  PluginPtr ctid, unsigned long newtls, Thread** child);
     ShMemBlock* (*getIPCBlock)(Thread* thread);
@@ -50,6 +52,8 @@ struct _Thread {
 
     // Non-null if blocked by a syscall.
     SysCallCondition* cond;
+    // Our previous condition, kept for the next blocking syscall.
+    SysCallCondition* spareCond;
 
     // Value storing the current CPU affinity of the thread (more preceisely,
     // of the native thread backing this thread object). This value will be set
@@ -3,6 +3,8 @@
 #include <errno.h>
 #include <glib.h>
 #include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
 #include <sys/prctl.h>
 #include <sys/ptrace.h>
 #include <sys/syscall.h>
@@ -20,11 +22,16 @@
 #include "main/bindings/c/bindings.h"
 #include "main/core/support/config_handlers.h"
 #include "main/core/worker.h"
+#include "main/host/cpu.h"
+#include "main/host/host.h"
 #include "main/host/shimipc.h"
+#include "main/host/syscall/unistd.h"
+#include "main/host/syscall_handler.h"
 #include "main/host/syscall_numbers.h"
 #include "main/host/thread_protected.h"
 #include "main/host/tsc.h"
 #include "main/utility/fork_proxy.h"
+#include "main/utility/random.h"
 
 #define THREADPTRACE_TYPE_ID 3024
 
@@ -47,6 +54,17 @@
 static bool _useONWaitpidWorkarounds = true;
 ADD_CONFIG_HANDLER(config_getUseOnWaitpidWorkarounds, _useONWaitpidWorkarounds)
 
+// Detaching every time a plugin thread blocks makes a thread that blocks often,
+// but only briefly, pay for a detach and re-attach each time. Instead we keep
+// up to this many blocked threads attached to each worker thread, and only
+// detach the least recently blocked one when another thread blocks. This still
+// bounds the length of the worker thread's tracee list.
+#define THREADPTRACE_MAX_IDLE_ATTACHED 16
+
+// The blocked threads that this worker thread is still attached to, least
+// recently blocked first.
+static __thread GQueue _idleAttached = G_QUEUE_INIT;
+
 // Because of <https://github.com/shadow/shadow/issues/1134> we also always use __WNOTHREAD when
 // calling waitpid. Otherwise if the target task isn't waitable yet, the kernel will move onto
 // checking its siblings children.
@@ -60,6 +78,10 @@ static char SYSCALL_INSTRUCTION[] __attribute__((unused)) = {0x0f, 0x05};
 // Number of times to do a non-blocking wait while waiting for traced thread.
 #define THREADPTRACE_MAX_SPIN 8096
 
+// Once a thread's shim is handling its syscalls, the number of times that we poll the shim
+// IPC channel for each non-blocking `waitpid`.
+#define THREADPTRACE_SHIM_POLLS_PER_WAITPID 64
+
 typedef enum {
     // Doesn't exist yet.
     THREAD_PTRACE_CHILD_STATE_NONE = 0,
@@ -232,6 +254,11 @@ typedef struct _ThreadPtrace {
 
     // Enable syscall handling via IPC.
     bool enableIpc;
+
+    // Whether we've received a shim event from the thread since it started or last exec'd,
+    // i.e. its shim is loaded and sending us the syscalls that it intercepts. Ptrace then
+    // only catches what the shim can't, so we check for ptrace stops less often.
+    bool shimActive;
 } ThreadPtrace;
 
 static struct IPCData* _threadptrace_ipcData(ThreadPtrace* thread) {
@@ -250,6 +277,7 @@ static ShimSharedMem* _threadptrace_sharedMem(ThreadPtrace* thread) {
 static void _threadptrace_ensureStopped(ThreadPtrace* thread);
 static void _threadptrace_doAttach(ThreadPtrace* thread);
 static void _threadptrace_doDetach(ThreadPtrace* thread);
+static long _threadptrace_stepNativeSyscall(ThreadPtrace* thread, const SysCallArgs* args);
 
 static ThreadPtrace* _threadToThreadPtrace(Thread* thread) {
     utility_assert(thread->type_id == THREADPTRACE_TYPE_ID);
@@ -400,8 +428,11 @@ static void _threadptrace_enterStateTraceMe(ThreadPtrace* thread) {
 }
 
 static void _threadptrace_enterStateExecve(ThreadPtrace* thread) {
-    // Previous cached address is no longer valid.
+    // Previous cached addresses are no longer valid.
     thread->syscall_rip = 0;
+    _threadptrace_sharedMem(thread)->injected_syscalls_stub = 0;
+    // The new executable may not load the shim, e.g. if it's statically linked.
+    thread->shimActive = false;
 }
 
 static void _threadptrace_getregs(ThreadPtrace* thread) {
@@ -600,6 +631,8 @@ static StopReason _threadptrace_hybridSpin(ThreadPtrace* thread) {
     StopReason event_stop = {
         .type = STOPREASON_SHIM_EVENT,
     };
+    // Shim polls since the last `waitpid`.
+    int polls = 0;
 
     // There's no obvious way to have a maximum spin threshold here, since we
     // can't know ahead of time whether to block on waiting for shim IPC or on
@@ -619,9 +652,17 @@ static StopReason _threadptrace_hybridSpin(ThreadPtrace* thread) {
         if (thread->enableIpc && shimevent_tryRecvEventFromPlugin(
                                      _threadptrace_ipcData(thread), &event_stop.shim_event) == 0) {
             trace("Got shim stop");
+            thread->shimActive = true;
             return event_stop;
         }
 
+        // Once the shim is active most stops are shim events, so don't pay for a `waitpid`
+        // on every iteration. Ptrace stops still get handled, just slightly later.
+        if (thread->shimActive && ++polls < THREADPTRACE_SHIM_POLLS_PER_WAITPID) {
+            continue;
+        }
+        polls = 0;
+
         // TODO: We lose a bit of efficiency here due to `waitpid` being
         // substantially slower than `shimevent_tryRecvEventFromPlugin`, even
         // with `WNOHANG`.  If a shim event comes in while we're executing
@@ -666,6 +707,7 @@ static StopReason _threadptrace_hybridSpin(ThreadPtrace* thread) {
                 thread->ipc_syscall.stopped = true;
                 thread->ipc_syscall.pendingStop = ptraceStopReason;
                 thread->ipc_syscall.havePendingStop = true;
+                thread->shimActive = true;
 
                 return event_stop;
             }
@@ -675,7 +717,12 @@ static StopReason _threadptrace_hybridSpin(ThreadPtrace* thread) {
 }
 
 static void _threadptrace_nextChildState(ThreadPtrace* thread) {
+    // The plugin runs until its next stop, so attribute the wait to it.
+    guint64 profileStart = syscallhandler_profileStart(thread->base.sys);
+    guint64 cpuStart = cpu_startTimer(host_getCPU(thread->base.host));
     StopReason reason = _threadptrace_hybridSpin(thread);
+    cpu_stopTimer(host_getCPU(thread->base.host), cpuStart);
+    syscallhandler_profileStop(thread->base.sys, "plugin", profileStart);
     _threadptrace_updateChildState(thread, reason);
 }
 
@@ -779,10 +826,32 @@ static ShMemBlock* _threadptrace_getShMBlock(Thread* base) {
     return &thread->shimSharedMemBlock;
 }
 
+// Logs the lines that the shim buffered since we last had control. The thread's
+// simulated time hasn't changed since then, so they get the time the shim saw.
+static void _threadptrace_drainSharedLog(ThreadPtrace* thread) {
+    ShimSharedMem* shmem = _threadptrace_sharedMem(thread);
+    // The plugin can write to the buffer, so don't trust it.
+    size_t len = MIN(shmem->log_len, SHIM_SHARED_LOG_RECORDS);
+    for (size_t i = 0; i < len; i++) {
+        ShimLogRecord* record = &shmem->log_records[i];
+        record->fileName[sizeof(record->fileName) - 1] = '\0';
+        record->functionName[sizeof(record->functionName) - 1] = '\0';
+        record->message[sizeof(record->message) - 1] = '\0';
+        if (logger_mayBeEnabled(record->level)) {
+            logger_log(logger_getDefault(), record->level, record->fileName,
+                       record->functionName, record->lineNumber, "[shd-shim] %s",
+                       record->message);
+        }
+    }
+    shmem->log_len = 0;
+}
+
 static SysCallReturn _threadptrace_handleSyscall(ThreadPtrace* thread, SysCallArgs* args) {
     utility_assert(thread->childState == THREAD_PTRACE_CHILD_STATE_SYSCALL ||
                    thread->childState == THREAD_PTRACE_CHILD_STATE_IPC_SYSCALL);
 
+    _threadptrace_drainSharedLog(thread);
+
     if (!syscall_num_is_shadow(args->number) &&
         _threadptrace_sharedMem(thread)->ptrace_allow_native_syscalls) {
         if (args->number == SYS_brk) {
@@ -872,9 +941,28 @@ static void _threadptrace_doDetach(ThreadPtrace* thread) {
 
 void threadptrace_detach(Thread* base) {
     ThreadPtrace* thread = _threadToThreadPtrace(base);
+    g_queue_remove(&_idleAttached, thread);
     _threadptrace_doDetach(thread);
 }
 
+// Called when `thread` blocks, instead of detaching from it right away.
+static void _threadptrace_deferDetach(ThreadPtrace* thread) {
+    g_queue_push_tail(&_idleAttached, thread);
+
+    while (g_queue_get_length(&_idleAttached) > THREADPTRACE_MAX_IDLE_ATTACHED) {
+        ThreadPtrace* oldest = g_queue_pop_head(&_idleAttached);
+        if (oldest->childState != THREAD_PTRACE_CHILD_STATE_SYSCALL &&
+            oldest->childState != THREAD_PTRACE_CHILD_STATE_IPC_SYSCALL) {
+            // e.g. it exited while blocked; there's nothing left to detach.
+            continue;
+        }
+
+        worker_setActiveProcess(oldest->base.process);
+        _threadptrace_doDetach(oldest);
+        worker_setActiveProcess(thread->base.process);
+    }
+}
+
 static SysCallCondition* _threadptrace_resumeIpcSyscall(ThreadPtrace* thread, bool* changedState) {
     SysCallReturn ret = syscallhandler_make_syscall(thread->base.sys, &thread->syscall_args);
     switch (ret.state) {
@@ -953,13 +1041,12 @@ static SysCallCondition* _threadptrace_resumeSyscall(ThreadPtrace* thread, bool*
             break;
         case SYSCALL_NATIVE: {
             // Have the plugin execute the original syscall
-            SysCallArgs* args = &thread->syscall_args;
-            thread_nativeSyscall(_threadPtraceToThread(thread), args->number, args->args[0],
-                                 args->args[1], args->args[2], args->args[3], args->args[4],
-                                 args->args[5]);
-            // The syscall should have left us in exactly the state from
+            // This has to step through the original syscall instruction, rather than use
+            // the shim's stub, so that the thread is left in exactly the state from
             // which we want to resume execution. In particular we DON'T want
             // to restore the old instruction pointer after executing an execve syscall.
+            _threadptrace_ensureStopped(thread);
+            _threadptrace_stepNativeSyscall(thread, &thread->syscall_args);
             thread->regs.valid = false;
             thread->regs.dirty = false;
 
@@ -980,15 +1067,49 @@ static void _threadptrace_setSharedTime(ThreadPtrace* thread) {
     _threadptrace_sharedMem(thread)->sim_time.tv_nsec = now % SIMTIME_ONE_SECOND;
 }
 
+static void _threadptrace_initSharedState(ThreadPtrace* thread) {
+    ShimSharedMem* shmem = _threadptrace_sharedMem(thread);
+    shmem->pid = (pid_t)process_getProcessID(thread->base.process);
+    shmem->ppid = syscallhandler_getppidValue();
+    shmem->tid = (pid_t)thread_getID(_threadPtraceToThread(thread));
+    syscallhandler_fillUtsname(thread->base.host, &shmem->utsname);
+
+    // Start with no random bytes, so none are drawn from the host's random source
+    // until the thread first runs.
+    shmem->random_pos = SHIM_SHARED_RANDOM_BYTES;
+}
+
+// Tops up the random bytes that the shim consumed since the thread last ran. We only
+// draw from the host's random source once half of the buffer has been used, and
+// always at the same points in the thread's execution, so runs stay deterministic.
+static void _threadptrace_refillSharedRandom(ThreadPtrace* thread) {
+    ShimSharedMem* shmem = _threadptrace_sharedMem(thread);
+    utility_assert(shmem->random_pos <= SHIM_SHARED_RANDOM_BYTES);
+
+    if (shmem->random_pos < SHIM_SHARED_RANDOM_BYTES / 2) {
+        return;
+    }
+
+    size_t unused = SHIM_SHARED_RANDOM_BYTES - shmem->random_pos;
+    memmove(shmem->random_bytes, &shmem->random_bytes[shmem->random_pos], unused);
+    random_nextNBytes(host_getRandom(thread->base.host), &shmem->random_bytes[unused],
+                      SHIM_SHARED_RANDOM_BYTES - unused);
+    shmem->random_pos = 0;
+}
+
 SysCallCondition* threadptrace_resume(Thread* base) {
     ThreadPtrace* thread = _threadToThreadPtrace(base);
 
+    // If we deferred detaching when it last blocked we may still be attached.
+    g_queue_remove(&_idleAttached, thread);
+
     if (thread->needAttachment) {
         _threadptrace_doAttach(thread);
     }
 
-    // Make sure the shim has the latest time before we resume
+    // Make sure the shim has the latest time and random bytes before we resume
     _threadptrace_setSharedTime(thread);
+    _threadptrace_refillSharedRandom(thread);
 
     // Try to flush any buffers left from the previous thread. In particular if
     // the previous thread exited, we might not have been able to flush its
@@ -1009,7 +1130,7 @@ SysCallCondition* threadptrace_resume(Thread* base) {
                     if (_useONWaitpidWorkarounds) {
                         // Keep inactive plugins off worker thread's tracee
                         // list.
-                        _threadptrace_doDetach(thread);
+                        _threadptrace_deferDetach(thread);
                     }
                     return condition;
                 }
@@ -1022,7 +1143,7 @@ SysCallCondition* threadptrace_resume(Thread* base) {
                     if (_useONWaitpidWorkarounds) {
                         // Keep inactive plugins off worker thread's tracee
                         // list.
-                        _threadptrace_doDetach(thread);
+                        _threadptrace_deferDetach(thread);
                     }
                     return condition;
                 }
@@ -1031,6 +1152,7 @@ SysCallCondition* threadptrace_resume(Thread* base) {
             case THREAD_PTRACE_CHILD_STATE_EXECVE: trace("THREAD_PTRACE_CHILD_STATE_EXECVE"); break;
             case THREAD_PTRACE_CHILD_STATE_EXITED:
                 trace("THREAD_PTRACE_CHILD_STATE_EXITED");
+                _threadptrace_drainSharedLog(thread);
                 return NULL;
             case THREAD_PTRACE_CHILD_STATE_SIGNALLED:
                 trace("THREAD_PTRACE_CHILD_STATE_SIGNALLED");
@@ -1134,6 +1256,9 @@ void threadptrace_free(Thread* base) {
     trace("threadptrace_free");
     ThreadPtrace* thread = _threadToThreadPtrace(base);
 
+    // Don't try to detach from it later.
+    g_queue_remove(&_idleAttached, thread);
+
     if (thread->base.sys) {
         syscallhandler_unref(thread->base.sys);
     }
@@ -1191,11 +1316,9 @@ static void _threadptrace_ensureStopped(ThreadPtrace* thread) {
     }
 }
 
-static long threadptrace_nativeSyscall(Thread* base, long n, va_list args) {
-    ThreadPtrace* thread = _threadToThreadPtrace(base);
-    trace("threadptrace_nativeSyscall %ld", n);
-    _threadptrace_ensureStopped(thread);
-
+// Makes the syscall in the thread by pointing it at the syscall instruction that it last
+// stopped at and single-stepping through it. The thread must be stopped.
+static long _threadptrace_stepNativeSyscall(ThreadPtrace* thread, const SysCallArgs* args) {
     // The last ptrace stop was just before executing a syscall instruction.
     // We'll use that to execute the desired syscall, and then restore the
     // original state.
@@ -1204,13 +1327,13 @@ static long threadptrace_nativeSyscall(Thread* base, long n, va_list args) {
     // Set up arguments to syscall.
     _threadptrace_getregs(thread);
     struct user_regs_struct regs = thread->regs.value;
-    regs.rax = n;
-    regs.rdi = va_arg(args, long);
-    regs.rsi = va_arg(args, long);
-    regs.rdx = va_arg(args, long);
-    regs.r10 = va_arg(args, long);
-    regs.r8 = va_arg(args, long);
-    regs.r9 = va_arg(args, long);
+    regs.rax = args->number;
+    regs.rdi = args->args[0].as_u64;
+    regs.rsi = args->args[1].as_u64;
+    regs.rdx = args->args[2].as_u64;
+    regs.r10 = args->args[3].as_u64;
+    regs.r8 = args->args[4].as_u64;
+    regs.r9 = args->args[5].as_u64;
 
     // Jump to a syscall instruction. Alternatively we could overwrite
     // the next instruction with a syscall instruction, but this avoids
@@ -1270,6 +1393,114 @@ static long threadptrace_nativeSyscall(Thread* base, long n, va_list args) {
     return regs.rax;
 }
 
+// Makes the first `n` syscalls in the shared injected_syscalls by pointing the thread at
+// the shim's stub, which makes them all and then traps, so that they only cost one stop.
+// The thread must be stopped. Returns false if it stopped running before they finished.
+static bool _threadptrace_runInjectedSyscalls(ThreadPtrace* thread, size_t n) {
+    ShimSharedMem* shmem = _threadptrace_sharedMem(thread);
+    utility_assert(shmem->injected_syscalls_stub);
+    utility_assert(n <= SHIM_INJECTED_SYSCALLS_MAX);
+
+    _threadptrace_getregs(thread);
+    struct user_regs_struct regs = thread->regs.value;
+    regs.rip = shmem->injected_syscalls_stub;
+    regs.r12 = shmem->plugin_addr + offsetof(ShimSharedMem, injected_syscalls);
+    regs.r13 = n;
+    regs.r14 = shmem->plugin_addr + offsetof(ShimSharedMem, injected_syscalls_done);
+    shmem->injected_syscalls_done = 0;
+
+    trace("threadptrace running %zu injected syscalls at rip=0x%llx", n, regs.rip);
+    if (ptrace(PTRACE_SETREGS, thread->base.nativeTid, 0, &regs) < 0) {
+        utility_panic("ptrace: %s", g_strerror(errno));
+        abort();
+    }
+    // We're altering the child's actual register state, so we need to restore it from thread->regs
+    // later.
+    thread->regs.dirty = true;
+
+    // Without PTRACE_SYSEMU the kernel makes the syscalls itself. Other stops are handled as
+    // when single-stepping in _threadptrace_stepNativeSyscall.
+    while (!__atomic_load_n(&shmem->injected_syscalls_done, __ATOMIC_ACQUIRE)) {
+        if (ptrace(PTRACE_CONT, thread->base.nativeTid, 0, 0) < 0) {
+            utility_panic("ptrace %d: %s", thread->base.nativeTid, g_strerror(errno));
+            abort();
+        }
+        int wstatus;
+        if (_waitpid_spin(thread->base.nativeTid, &wstatus, 0) < 0) {
+            utility_panic("waitpid: %s", g_strerror(errno));
+            abort();
+        }
+        StopReason reason = _getStopReason(wstatus);
+        if (reason.type == STOPREASON_SIGNAL &&
+            (reason.signal.signal == SIGSTOP || reason.signal.signal == SIGTRAP)) {
+            // The stub's trap, if it set the flag.
+            continue;
+        }
+        trace("Executing injected syscalls changed child state");
+        _threadptrace_updateChildState(thread, reason);
+        if (!threadptrace_isRunning(&thread->base)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static long threadptrace_nativeSyscall(Thread* base, long n, va_list args) {
+    ThreadPtrace* thread = _threadToThreadPtrace(base);
+    trace("threadptrace_nativeSyscall %ld", n);
+    _threadptrace_ensureStopped(thread);
+
+    SysCallArgs call = {.number = n};
+    for (int i = 0; i < 6; ++i) {
+        call.args[i].as_i64 = va_arg(args, int64_t);
+    }
+
+    ShimSharedMem* shmem = _threadptrace_sharedMem(thread);
+    if (!shmem->injected_syscalls_stub) {
+        return _threadptrace_stepNativeSyscall(thread, &call);
+    }
+
+    shmem->injected_syscalls[0].args = call;
+    if (!_threadptrace_runInjectedSyscalls(thread, 1)) {
+        return -ECHILD;
+    }
+    long rv = shmem->injected_syscalls[0].retval.as_i64;
+    trace("Native syscall result %ld (%s)", rv, strerror(-rv));
+    return rv;
+}
+
+static void threadptrace_nativeSyscalls(Thread* base, const SysCallArgs* calls, long* results,
+                                        size_t n) {
+    ThreadPtrace* thread = _threadToThreadPtrace(base);
+    trace("threadptrace_nativeSyscalls %zu", n);
+    _threadptrace_ensureStopped(thread);
+
+    ShimSharedMem* shmem = _threadptrace_sharedMem(thread);
+    size_t done = 0;
+    while (done < n) {
+        if (!shmem->injected_syscalls_stub) {
+            results[done] = _threadptrace_stepNativeSyscall(thread, &calls[done]);
+            done++;
+            continue;
+        }
+
+        size_t batch = MIN(n - done, SHIM_INJECTED_SYSCALLS_MAX);
+        for (size_t i = 0; i < batch; i++) {
+            shmem->injected_syscalls[i].args = calls[done + i];
+        }
+        if (!_threadptrace_runInjectedSyscalls(thread, batch)) {
+            for (; done < n; done++) {
+                results[done] = -ECHILD;
+            }
+            return;
+        }
+        for (size_t i = 0; i < batch; i++) {
+            results[done + i] = shmem->injected_syscalls[i].retval.as_i64;
+        }
+        done += batch;
+    }
+}
+
 int threadptrace_clone(Thread* base, unsigned long flags, PluginPtr child_stack, PluginPtr ptid,
                        PluginPtr ctid, unsigned long newtls, Thread** childp) {
     ThreadPtrace* thread = _threadToThreadPtrace(base);
@@ -1349,12 +1580,12 @@ Thread* threadptraceonly_new(Host* host, Process* process, int threadID) {
                                   .isRunning = threadptrace_isRunning,
                                   .free = threadptrace_free,
                                   .nativeSyscall = threadptrace_nativeSyscall,
+                                  .nativeSyscalls = threadptrace_nativeSyscalls,
                                   .clone = threadptrace_clone,
                                   .getIPCBlock = _threadptrace_getIPCBlock,
                                   .getShMBlock = _threadptrace_getShMBlock,
                               }),
-        // FIXME: This should the emulated CPU's frequency
-        .tsc = {.cyclesPerSecond = 2000000000UL},
+        .tsc = {.cyclesPerSecond = TSC_EMULATED_CYCLES_PER_SECOND},
         .childState = THREAD_PTRACE_CHILD_STATE_NONE,
     };
     thread->base.sys = syscallhandler_new(host, process, _threadPtraceToThread(thread));
@@ -1363,6 +1594,7 @@ Thread* threadptraceonly_new(Host* host, Process* process, int threadID) {
     thread->shimSharedMemBlock = shmemallocator_globalAlloc(sizeof(ShimSharedMem));
     *_threadptrace_sharedMem(thread) = (ShimSharedMem){.ptrace_allow_native_syscalls = false};
     _threadptrace_setSharedTime(thread);
+    _threadptrace_initSharedState(thread);
 
     worker_count_allocation(ThreadPtrace);
 
@@ -0,0 +1,420 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/host/timer_wheel.h"
+
+#include <glib.h>
+
+#include "main/core/work/task.h"
+#include "main/core/worker.h"
+#include "main/utility/utility.h"
+
+/* the wheel resolution; timers still expire at their exact times, this only
+ * controls which slot they are stored in */
+#define TIMERWHEEL_TICK SIMTIME_ONE_MILLISECOND
+#define TIMERWHEEL_SLOT_BITS 6
+#define TIMERWHEEL_NUM_SLOTS (1 << TIMERWHEEL_SLOT_BITS)
+#define TIMERWHEEL_SLOT_MASK (TIMERWHEEL_NUM_SLOTS - 1)
+/* with 1 ms ticks the levels span about 64 ms, 4 s, 4 m, and 4.6 h each */
+#define TIMERWHEEL_NUM_LEVELS 4
+
+/* an object reference that a cancelled timer still has to release */
+typedef struct _TimerWheelRelease TimerWheelRelease;
+struct _TimerWheelRelease {
+    GDestroyNotify objectUnref;
+    gpointer object;
+};
+
+struct _TimerWheel {
+    Host* host;
+
+    /* level L holds the timers whose (tick >> (L * TIMERWHEEL_SLOT_BITS)) is less
+     * than TIMERWHEEL_NUM_SLOTS away from that of the current tick */
+    TimerWheelEntry* slots[TIMERWHEEL_NUM_LEVELS][TIMERWHEEL_NUM_SLOTS];
+    guint levelLength[TIMERWHEEL_NUM_LEVELS];
+    /* timers that are too far out for the highest level */
+    TimerWheelEntry* overflow;
+    /* timers that have expired and are waiting for their turn to run */
+    TimerWheelEntry* expired;
+
+    /* every timer that expires before this tick has already run */
+    guint64 currentTick;
+    guint64 orderCounter;
+    /* the time we are running timers for, or SIMTIME_INVALID */
+    SimulationTime advancingTime;
+    /* the times of our pending scheduler events, earliest first */
+    GQueue* pendingEventTimes;
+    /* TimerWheelReleases of cancelled timers. the object that cancels a timer is
+     * usually in the middle of using itself, so we wait until our next event. */
+    GArray* released;
+
+    MAGIC_DECLARE;
+};
+
+static void _timerwheel_runTask(Host* host, gpointer voidWheel, gpointer unused);
+
+static void _timerwheel_push(TimerWheelEntry** list, TimerWheelEntry* entry) {
+    entry->prev = NULL;
+    entry->next = *list;
+    if (*list) {
+        (*list)->prev = entry;
+    }
+    *list = entry;
+    entry->list = list;
+}
+
+/* returns the level of the slot holding list, or -1 if it is not a slot */
+static gint _timerwheel_getLevel(TimerWheel* wheel, TimerWheelEntry** list) {
+    TimerWheelEntry** first = &wheel->slots[0][0];
+    TimerWheelEntry** last = &wheel->slots[TIMERWHEEL_NUM_LEVELS - 1][TIMERWHEEL_SLOT_MASK];
+    if (list < first || list > last) {
+        return -1;
+    }
+    return (gint)((list - first) / TIMERWHEEL_NUM_SLOTS);
+}
+
+static void _timerwheel_unlink(TimerWheel* wheel, TimerWheelEntry* entry) {
+    utility_assert(entry->list);
+
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        *entry->list = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+
+    gint level = _timerwheel_getLevel(wheel, entry->list);
+    if (level >= 0) {
+        wheel->levelLength[level]--;
+    }
+
+    entry->list = NULL;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+/* stores the entry in the slot for its expiration time, relative to the current tick */
+static void _timerwheel_place(TimerWheel* wheel, TimerWheelEntry* entry) {
+    guint64 tick = MAX(entry->expireTime / TIMERWHEEL_TICK, wheel->currentTick);
+
+    for (gint level = 0; level < TIMERWHEEL_NUM_LEVELS; level++) {
+        guint shift = level * TIMERWHEEL_SLOT_BITS;
+        if ((tick >> shift) - (wheel->currentTick >> shift) < TIMERWHEEL_NUM_SLOTS) {
+            guint slot = (tick >> shift) & TIMERWHEEL_SLOT_MASK;
+            _timerwheel_push(&wheel->slots[level][slot], entry);
+            wheel->levelLength[level]++;
+            return;
+        }
+    }
+
+    _timerwheel_push(&wheel->overflow, entry);
+}
+
+/* re-place every entry on the list, which drops them to lower levels. overflow
+ * entries may land back on the overflow list, so detach them all first. */
+static void _timerwheel_replaceAll(TimerWheel* wheel, TimerWheelEntry** list) {
+    TimerWheelEntry* detached = NULL;
+    while (*list) {
+        TimerWheelEntry* entry = *list;
+        _timerwheel_unlink(wheel, entry);
+        _timerwheel_push(&detached, entry);
+    }
+
+    while (detached) {
+        TimerWheelEntry* entry = detached;
+        _timerwheel_unlink(wheel, entry);
+        _timerwheel_place(wheel, entry);
+    }
+}
+
+/* called when the current tick moves into a new slot of level 0 */
+static void _timerwheel_cascade(TimerWheel* wheel) {
+    for (gint level = TIMERWHEEL_NUM_LEVELS - 1; level > 0; level--) {
+        guint shift = level * TIMERWHEEL_SLOT_BITS;
+        if ((wheel->currentTick & ((G_GUINT64_CONSTANT(1) << shift) - 1)) != 0) {
+            continue;
+        }
+
+        if (level == TIMERWHEEL_NUM_LEVELS - 1) {
+            _timerwheel_replaceAll(wheel, &wheel->overflow);
+        }
+
+        guint slot = (wheel->currentTick >> shift) & TIMERWHEEL_SLOT_MASK;
+        _timerwheel_replaceAll(wheel, &wheel->slots[level][slot]);
+    }
+}
+
+static gint _timerwheel_compareEntries(gconstpointer a, gconstpointer b) {
+    const TimerWheelEntry* entryA = *(const TimerWheelEntry* const*)a;
+    const TimerWheelEntry* entryB = *(const TimerWheelEntry* const*)b;
+    if (entryA->expireTime != entryB->expireTime) {
+        return entryA->expireTime < entryB->expireTime ? -1 : 1;
+    }
+    return entryA->order < entryB->order ? -1 : entryA->order > entryB->order ? 1 : 0;
+}
+
+/* moves the timers of the current tick that expire by now to the expired list
+ * in the order they should run, and returns how many there were */
+static guint _timerwheel_collectExpired(TimerWheel* wheel, SimulationTime now) {
+    TimerWheelEntry** slot = &wheel->slots[0][wheel->currentTick & TIMERWHEEL_SLOT_MASK];
+
+    GPtrArray* expired = NULL;
+    for (TimerWheelEntry* entry = *slot; entry != NULL; entry = entry->next) {
+        if (entry->expireTime <= now) {
+            if (!expired) {
+                expired = g_ptr_array_new();
+            }
+            g_ptr_array_add(expired, entry);
+        }
+    }
+
+    if (!expired) {
+        return 0;
+    }
+
+    g_ptr_array_sort(expired, _timerwheel_compareEntries);
+
+    /* push in reverse so that the earliest ends up at the head */
+    guint count = expired->len;
+    for (guint i = count; i > 0; i--) {
+        TimerWheelEntry* entry = g_ptr_array_index(expired, i - 1);
+        _timerwheel_unlink(wheel, entry);
+        _timerwheel_push(&wheel->expired, entry);
+    }
+
+    g_ptr_array_free(expired, TRUE);
+    return count;
+}
+
+static void _timerwheel_runExpired(TimerWheel* wheel) {
+    /* a timer may cancel or reschedule the others, which removes them from this list */
+    while (wheel->expired) {
+        TimerWheelEntry* entry = wheel->expired;
+        _timerwheel_unlink(wheel, entry);
+        entry->wheel = NULL;
+
+        entry->func(wheel->host, entry->object);
+
+        /* this may free the object and the entry along with it */
+        if (entry->objectUnref) {
+            entry->objectUnref(entry->object);
+        }
+    }
+}
+
+/* runs all of the timers that expire at or before now */
+static void _timerwheel_advance(TimerWheel* wheel, SimulationTime now) {
+    guint64 nowTick = now / TIMERWHEEL_TICK;
+    wheel->advancingTime = now;
+
+    while (TRUE) {
+        if (_timerwheel_collectExpired(wheel, now) > 0) {
+            _timerwheel_runExpired(wheel);
+            /* the timers may have scheduled new ones in this tick */
+            continue;
+        }
+
+        if (wheel->currentTick >= nowTick) {
+            break;
+        }
+
+        if (wheel->levelLength[0] == 0) {
+            /* nothing in level 0, so skip to the next slot of level 1 */
+            wheel->currentTick = MIN(nowTick, (wheel->currentTick | TIMERWHEEL_SLOT_MASK) + 1);
+        } else {
+            wheel->currentTick++;
+        }
+
+        if ((wheel->currentTick & TIMERWHEEL_SLOT_MASK) == 0) {
+            _timerwheel_cascade(wheel);
+        }
+    }
+
+    wheel->advancingTime = SIMTIME_INVALID;
+}
+
+static SimulationTime _timerwheel_getListMinExpireTime(TimerWheelEntry* list) {
+    SimulationTime min = SIMTIME_INVALID;
+    for (TimerWheelEntry* entry = list; entry != NULL; entry = entry->next) {
+        min = MIN(min, entry->expireTime);
+    }
+    return min;
+}
+
+/* returns the expiration time of the earliest timer, or SIMTIME_INVALID if none */
+static SimulationTime _timerwheel_getNextExpireTime(TimerWheel* wheel) {
+    SimulationTime next = _timerwheel_getListMinExpireTime(wheel->overflow);
+
+    for (gint level = 0; level < TIMERWHEEL_NUM_LEVELS; level++) {
+        if (wheel->levelLength[level] == 0) {
+            continue;
+        }
+
+        /* slots are in time order starting from the current one */
+        guint shift = level * TIMERWHEEL_SLOT_BITS;
+        guint current = (wheel->currentTick >> shift) & TIMERWHEEL_SLOT_MASK;
+        for (guint i = 0; i < TIMERWHEEL_NUM_SLOTS; i++) {
+            TimerWheelEntry* list = wheel->slots[level][(current + i) & TIMERWHEEL_SLOT_MASK];
+            if (list) {
+                next = MIN(next, _timerwheel_getListMinExpireTime(list));
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+/* makes sure a scheduler event will run the wheel no later than expireTime */
+static void _timerwheel_postEventIfNeeded(TimerWheel* wheel, SimulationTime expireTime) {
+    if (expireTime == SIMTIME_INVALID) {
+        return;
+    }
+
+    /* timers that expire while we are advancing run before the advance returns */
+    if (wheel->advancingTime != SIMTIME_INVALID && expireTime <= wheel->advancingTime) {
+        return;
+    }
+
+    SimulationTime* earliest = g_queue_peek_head(wheel->pendingEventTimes);
+    if (earliest && *earliest <= expireTime) {
+        return;
+    }
+
+    SimulationTime now = worker_getCurrentTime();
+    SimulationTime delay = expireTime > now ? expireTime - now : 0;
+
+    worker_scheduleCallback(_timerwheel_runTask, wheel, NULL, NULL, NULL, wheel->host, delay);
+
+    /* this is earlier than all other pending events, so the queue stays sorted */
+    SimulationTime* eventTime = g_new(SimulationTime, 1);
+    *eventTime = now + delay;
+    g_queue_push_head(wheel->pendingEventTimes, eventTime);
+}
+
+static void _timerwheel_releaseCancelled(TimerWheel* wheel) {
+    /* releasing may cancel more timers, which appends to the array */
+    for (guint i = 0; i < wheel->released->len; i++) {
+        TimerWheelRelease release = g_array_index(wheel->released, TimerWheelRelease, i);
+        release.objectUnref(release.object);
+    }
+    g_array_set_size(wheel->released, 0);
+}
+
+static void _timerwheel_runTask(Host* host, gpointer voidWheel, gpointer unused) {
+    TimerWheel* wheel = voidWheel;
+    MAGIC_ASSERT(wheel);
+
+    _timerwheel_releaseCancelled(wheel);
+
+    SimulationTime now = worker_getCurrentTime();
+
+    while (!g_queue_is_empty(wheel->pendingEventTimes) &&
+           *(SimulationTime*)g_queue_peek_head(wheel->pendingEventTimes) <= now) {
+        g_free(g_queue_pop_head(wheel->pendingEventTimes));
+    }
+
+    _timerwheel_advance(wheel, now);
+    _timerwheel_postEventIfNeeded(wheel, _timerwheel_getNextExpireTime(wheel));
+}
+
+TimerWheel* timerwheel_new(Host* host) {
+    TimerWheel* wheel = g_new0(TimerWheel, 1);
+    MAGIC_INIT(wheel);
+
+    wheel->host = host;
+    wheel->advancingTime = SIMTIME_INVALID;
+    wheel->pendingEventTimes = g_queue_new();
+    wheel->released = g_array_new(FALSE, FALSE, sizeof(TimerWheelRelease));
+
+    return wheel;
+}
+
+static void _timerwheel_cancelAll(TimerWheelEntry** list) {
+    while (*list) {
+        timerwheel_cancel(*list);
+    }
+}
+
+void timerwheel_free(TimerWheel* wheel) {
+    MAGIC_ASSERT(wheel);
+
+    for (gint level = 0; level < TIMERWHEEL_NUM_LEVELS; level++) {
+        for (gint slot = 0; slot < TIMERWHEEL_NUM_SLOTS; slot++) {
+            _timerwheel_cancelAll(&wheel->slots[level][slot]);
+        }
+    }
+    _timerwheel_cancelAll(&wheel->overflow);
+    _timerwheel_cancelAll(&wheel->expired);
+    _timerwheel_releaseCancelled(wheel);
+    g_array_free(wheel->released, TRUE);
+
+    g_queue_free_full(wheel->pendingEventTimes, g_free);
+
+    MAGIC_CLEAR(wheel);
+    g_free(wheel);
+}
+
+void timerwheelentry_init(TimerWheelEntry* entry, TimerWheelFunc func, gpointer object,
+                          void (*objectRef)(gpointer object), GDestroyNotify objectUnref) {
+    utility_assert(entry);
+    utility_assert(func);
+
+    *entry = (TimerWheelEntry){
+        .func = func,
+        .object = object,
+        .objectRef = objectRef,
+        .objectUnref = objectUnref,
+    };
+}
+
+void timerwheel_schedule(TimerWheel* wheel, TimerWheelEntry* entry, SimulationTime expireTime) {
+    MAGIC_ASSERT(wheel);
+    utility_assert(entry && entry->func);
+    utility_assert(expireTime != SIMTIME_INVALID);
+
+    if (entry->list) {
+        /* rescheduling, we already hold a reference */
+        utility_assert(entry->wheel == wheel);
+        _timerwheel_unlink(wheel, entry);
+    } else {
+        if (entry->objectRef) {
+            entry->objectRef(entry->object);
+        }
+        entry->wheel = wheel;
+    }
+
+    entry->expireTime = expireTime;
+    entry->order = wheel->orderCounter++;
+    _timerwheel_place(wheel, entry);
+
+    _timerwheel_postEventIfNeeded(wheel, expireTime);
+}
+
+void timerwheel_cancel(TimerWheelEntry* entry) {
+    utility_assert(entry);
+
+    if (!entry->list) {
+        return;
+    }
+
+    TimerWheel* wheel = entry->wheel;
+    MAGIC_ASSERT(wheel);
+
+    _timerwheel_unlink(wheel, entry);
+    entry->wheel = NULL;
+
+    if (entry->objectUnref) {
+        TimerWheelRelease release = {.objectUnref = entry->objectUnref, .object = entry->object};
+        g_array_append_val(wheel->released, release);
+    }
+}
+
+gboolean timerwheelentry_isScheduled(const TimerWheelEntry* entry) {
+    utility_assert(entry);
+    return entry->list != NULL;
+}
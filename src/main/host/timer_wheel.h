@@ -0,0 +1,60 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SRC_MAIN_HOST_TIMER_WHEEL_H_
+#define SRC_MAIN_HOST_TIMER_WHEEL_H_
+
+#include <glib.h>
+
+#include "main/core/support/definitions.h"
+
+/* A hierarchical timer wheel that owns the internal timers of a host, such as
+ * the TCP retransmit, close and delayed ACK timers. Scheduling, rescheduling
+ * and cancelling a timer are O(1) and never touch the host's event queue. The
+ * wheel itself keeps at most one scheduler event pending for its earliest
+ * timer, and only posts another if a new timer must expire before that one.
+ * Timers expire at exactly their scheduled time, in the order of their
+ * expiration times and then in the order in which they were scheduled. */
+typedef struct _TimerWheel TimerWheel;
+
+/* Called with the host and the entry's object when the timer expires. */
+typedef void (*TimerWheelFunc)(Host* host, gpointer object);
+
+/* A timer that is embedded in the object that owns it. The fields are private
+ * to the wheel; use timerwheelentry_init before the first schedule. */
+typedef struct _TimerWheelEntry TimerWheelEntry;
+struct _TimerWheelEntry {
+    TimerWheelFunc func;
+    gpointer object;
+    /* the wheel holds a reference to the object while the timer is scheduled */
+    void (*objectRef)(gpointer object);
+    GDestroyNotify objectUnref;
+
+    TimerWheel* wheel;
+    SimulationTime expireTime;
+    guint64 order;
+    /* the list that holds this entry while scheduled, or NULL */
+    TimerWheelEntry** list;
+    TimerWheelEntry* prev;
+    TimerWheelEntry* next;
+};
+
+TimerWheel* timerwheel_new(Host* host);
+/* Cancels every scheduled timer, releasing the wheel's object references. */
+void timerwheel_free(TimerWheel* wheel);
+
+void timerwheelentry_init(TimerWheelEntry* entry, TimerWheelFunc func, gpointer object,
+                          void (*objectRef)(gpointer object), GDestroyNotify objectUnref);
+
+/* Schedules the timer to expire at the absolute time expireTime, replacing its
+ * previous expiration time if it was already scheduled. */
+void timerwheel_schedule(TimerWheel* wheel, TimerWheelEntry* entry, SimulationTime expireTime);
+/* Stops the timer if it is scheduled. The caller is usually the object itself,
+ * so the wheel waits until its next scheduler event to release the object. */
+void timerwheel_cancel(TimerWheelEntry* entry);
+
+gboolean timerwheelentry_isScheduled(const TimerWheelEntry* entry);
+
+#endif /* SRC_MAIN_HOST_TIMER_WHEEL_H_ */
@@ -7,20 +7,43 @@
 /* a packet is a 'data' packet if it has a payload attached, and a 'control' packet otherwise.
  * each packet is either a 'normal' packet or a 'retransmitted' packet. */
 #include <glib.h>
+#include <arpa/inet.h>
+#include <errno.h>
 #include <netinet/in.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "lib/logger/log_level.h"
 #include "lib/logger/logger.h"
 #include "main/core/support/definitions.h"
-#include "main/core/work/task.h"
 #include "main/core/worker.h"
+#include "main/host/host.h"
 #include "main/host/protocol.h"
 #include "main/host/tracker.h"
 #include "main/routing/address.h"
 #include "main/routing/packet.h"
 #include "main/utility/utility.h"
 
+/* In the binary format, the heartbeat statistics are written to this file in the
+ * host's data directory instead of being logged. The file starts with
+ * HEARTBEAT_FILE_MAGIC and a guint32 version, followed by records that each
+ * have a guint32 record type, a guint32 field count, and that many guint64
+ * fields. Values are in host byte order. src/tools/shadow-heartbeat-decode.py
+ * lists the fields of each record type. */
+#define HEARTBEAT_FILE_NAME "heartbeat.bin"
+#define HEARTBEAT_FILE_MAGIC "SHADOWHB"
+#define HEARTBEAT_FILE_VERSION 2
+#define HEARTBEAT_FILE_BUFFER_SIZE (1024 * 1024)
+
+typedef enum {
+    HEARTBEAT_RECORD_NODE = 1,
+    HEARTBEAT_RECORD_SOCKET = 2,
+    HEARTBEAT_RECORD_RAM = 3,
+} HeartbeatRecordType;
+
+/* the number of fields that each set of counters adds to a record */
+#define HEARTBEAT_COUNTER_FIELDS 12
+
 typedef struct {
     gsize control;
     gsize controlRetransmit;
@@ -52,6 +75,10 @@ struct _Tracker {
     SimulationTime interval;
     LogLevel loglevel;
     LogInfoFlags loginfo;
+    LogFormat format;
+
+    /* if set, we write binary records here instead of logging the statistics */
+    FILE* heartbeatFile;
 
     gboolean didLogNodeHeader;
     gboolean didLogRAMHeader;
@@ -68,7 +95,9 @@ struct _Tracker {
     IFaceCounters local;
     IFaceCounters remote;
 
-    GHashTable* allocatedLocations;
+    /* the callers pass the size of each allocation when it's freed, so we only need
+     * to count the allocations, not remember them */
+    guint numAllocations;
     gsize allocatedBytesTotal;
     gsize allocatedBytesLastInterval;
     gsize deallocatedBytesLastInterval;
@@ -77,6 +106,9 @@ struct _Tracker {
     GHashTable* socketStats;
 
     SimulationTime lastHeartbeat;
+    /* the workers collect the heartbeat once a round starts at or after this time;
+     * SIMTIME_MAX until the tracker is started */
+    SimulationTime nextHeartbeat;
 
     MAGIC_DECLARE;
 };
@@ -94,6 +126,8 @@ struct _SocketStats {
     gsize inputBufferLength;
     gsize outputBufferSize;
     gsize outputBufferLength;
+    /* datagrams dropped because the input buffer was full, since the last heartbeat */
+    gsize inputDropped;
 
     IFaceCounters local;
     IFaceCounters remote;
@@ -125,36 +159,76 @@ static void _socketstats_free(SocketStats* ss) {
     }
 }
 
-Tracker* tracker_new(Host* host, SimulationTime interval, LogLevel loglevel, LogInfoFlags loginfo) {
+static FILE* _tracker_openHeartbeatFile(Host* host) {
+    gchar* path = g_build_filename(host_getDataPath(host), HEARTBEAT_FILE_NAME, NULL);
+    FILE* file = fopen(path, "w");
+
+    if (!file) {
+        warning("Unable to open heartbeat file '%s', logging heartbeats instead: %s", path,
+                g_strerror(errno));
+        g_free(path);
+        return NULL;
+    }
+
+    g_free(path);
+
+    /* records are small and frequent, so let stdio collect them into large writes */
+    setvbuf(file, NULL, _IOFBF, HEARTBEAT_FILE_BUFFER_SIZE);
+
+    guint32 version = HEARTBEAT_FILE_VERSION;
+    fwrite(HEARTBEAT_FILE_MAGIC, 1, strlen(HEARTBEAT_FILE_MAGIC), file);
+    fwrite(&version, sizeof(version), 1, file);
+
+    return file;
+}
+
+Tracker* tracker_new(Host* host, SimulationTime interval, LogLevel loglevel, LogInfoFlags loginfo,
+                     LogFormat format) {
     Tracker* tracker = g_new0(Tracker, 1);
     MAGIC_INIT(tracker);
 
     tracker->interval = interval;
     tracker->loglevel = loglevel;
     tracker->loginfo = loginfo;
+    tracker->format = format;
+    tracker->nextHeartbeat = SIMTIME_MAX;
 
-    tracker->allocatedLocations = g_hash_table_new(g_direct_hash, g_direct_equal);
     tracker->socketStats = g_hash_table_new_full(g_int_hash, g_int_equal, NULL, (GDestroyNotify)_socketstats_free);
 
-    /* send an alive message, and start periodic heartbeats */
-    tracker_heartbeat(tracker, host);
-
     return tracker;
 }
 
-static void _tracker_freeAllocatedLocations(gpointer key, gpointer value, gpointer userData) {
-    if(key) {
-        g_free(key);
+void tracker_start(Tracker* tracker, Host* host) {
+    MAGIC_ASSERT(tracker);
+
+    if (tracker->format == LOG_FORMAT_BINARY && tracker->loginfo != LOG_INFO_FLAGS_NONE) {
+        tracker->heartbeatFile = _tracker_openHeartbeatFile(host);
+    }
+
+    /* keep the heartbeats on multiples of the interval, as if we had started at time 0 */
+    SimulationTime now = worker_getCurrentTime();
+    SimulationTime sinceLastInterval = now % tracker->interval;
+
+    if (sinceLastInterval == 0) {
+        /* send an alive message, and start periodic heartbeats */
+        tracker_heartbeat(tracker, host);
+    } else {
+        tracker->lastHeartbeat = now - sinceLastInterval;
+        tracker->nextHeartbeat = tracker->lastHeartbeat + tracker->interval;
     }
+
+    worker_updateNextHeartbeatTime(tracker->nextHeartbeat);
 }
 
 void tracker_free(Tracker* tracker) {
     MAGIC_ASSERT(tracker);
 
-    g_hash_table_foreach(tracker->allocatedLocations, _tracker_freeAllocatedLocations, NULL);
-    g_hash_table_destroy(tracker->allocatedLocations);
     g_hash_table_destroy(tracker->socketStats);
 
+    if (tracker->heartbeatFile) {
+        fclose(tracker->heartbeatFile);
+    }
+
     MAGIC_CLEAR(tracker);
     g_free(tracker);
 }
@@ -276,31 +350,28 @@ void tracker_addOutputBytes(Tracker* tracker, Packet* packet, gint handle) {
     }
 }
 
-void tracker_addAllocatedBytes(Tracker* tracker, gpointer location, gsize allocatedBytes) {
+void tracker_addAllocatedBytes(Tracker* tracker, gsize allocatedBytes) {
     MAGIC_ASSERT(tracker);
 
     if(tracker->loginfo & LOG_INFO_FLAGS_RAM) {
         tracker->allocatedBytesTotal += allocatedBytes;
         tracker->allocatedBytesLastInterval += allocatedBytes;
-        g_hash_table_insert(tracker->allocatedLocations, location, GSIZE_TO_POINTER(allocatedBytes));
+        tracker->numAllocations++;
     }
 }
 
-void tracker_removeAllocatedBytes(Tracker* tracker, gpointer location) {
+void tracker_removeAllocatedBytes(Tracker* tracker, gsize allocatedBytes) {
     MAGIC_ASSERT(tracker);
 
     if(tracker->loginfo & LOG_INFO_FLAGS_RAM) {
-        gpointer value = NULL;
-        gboolean exists = g_hash_table_lookup_extended(tracker->allocatedLocations, location, NULL, &value);
-        if(exists) {
-            gboolean b = g_hash_table_remove(tracker->allocatedLocations, location);
-            utility_assert(b);
-            gsize allocatedBytes = GPOINTER_TO_SIZE(value);
-            tracker->allocatedBytesTotal -= allocatedBytes;
-            tracker->deallocatedBytesLastInterval += allocatedBytes;
-        } else {
+        /* a free that we didn't see the allocation of */
+        if (tracker->numAllocations == 0 || allocatedBytes > tracker->allocatedBytesTotal) {
             (tracker->numFailedFrees)++;
+            return;
         }
+        tracker->numAllocations--;
+        tracker->allocatedBytesTotal -= allocatedBytes;
+        tracker->deallocatedBytesLastInterval += allocatedBytes;
     }
 }
 
@@ -356,6 +427,17 @@ void tracker_updateSocketInputBuffer(Tracker* tracker, gint handle, gsize inputB
     }
 }
 
+void tracker_addSocketInputDrop(Tracker* tracker, gint handle) {
+    MAGIC_ASSERT(tracker);
+
+    if(tracker->loginfo & LOG_INFO_FLAGS_SOCKET) {
+        SocketStats* ss = g_hash_table_lookup(tracker->socketStats, &handle);
+        if(ss) {
+            ss->inputDropped++;
+        }
+    }
+}
+
 void tracker_updateSocketOutputBuffer(Tracker* tracker, gint handle, gsize outputBufferLength, gsize outputBufferSize) {
     MAGIC_ASSERT(tracker);
 
@@ -468,7 +550,8 @@ static void _tracker_logSocket(Tracker* tracker, LogLevel level, SimulationTime
         tracker->didLogSocketHeader = TRUE;
         logger_log(logger_getDefault(), level, __FILE__, __FUNCTION__, __LINE__,
                 "[shadow-heartbeat] [socket-header] descriptor-number,protocol-string,hostname:port-peer;"
-                "inbuflen-bytes,inbufsize-bytes,outbuflen-bytes,outbufsize-bytes;recv-bytes,send-bytes;"
+                "inbuflen-bytes,inbufsize-bytes,outbuflen-bytes,outbufsize-bytes,inbufdrop-packets;"
+                "recv-bytes,send-bytes;"
                 "inbound-localhost-counters;outbound-localhost-counters;"
                 "inbound-remote-counters;outbound-remote-counters|..." // for each socket
                 "where counters are: %s", _tracker_getCounterHeaderString());
@@ -509,7 +592,8 @@ static void _tracker_logSocket(Tracker* tracker, LogLevel level, SimulationTime
 
         socketLogCount++;
         g_string_append_printf(msg, "%d,%s,%s:%u;"
-                "%"G_GSIZE_FORMAT",%"G_GSIZE_FORMAT",%"G_GSIZE_FORMAT",%"G_GSIZE_FORMAT";"
+                "%"G_GSIZE_FORMAT",%"G_GSIZE_FORMAT",%"G_GSIZE_FORMAT",%"G_GSIZE_FORMAT","
+                "%"G_GSIZE_FORMAT";"
                 "%"G_GSIZE_FORMAT",%"G_GSIZE_FORMAT";"
                 "%s;%s;%s;%s",
                 ss->handle, /*inet_ntoa((struct in_addr){socket->peerIP})*/
@@ -517,7 +601,7 @@ static void _tracker_logSocket(Tracker* tracker, LogLevel level, SimulationTime
                     ss->type == PLOCAL ? "LOCAL" : "UNKNOWN",
                 ss->peerHostname, ss->peerPort,
                 ss->inputBufferLength, ss->inputBufferSize,
-                ss->outputBufferLength, ss->outputBufferSize,
+                ss->outputBufferLength, ss->outputBufferSize, ss->inputDropped,
                 totalRecvBytes, totalSendBytes,
                 inLocal, outLocal, inRemote, outRemote);
 
@@ -548,7 +632,7 @@ static void _tracker_logSocket(Tracker* tracker, LogLevel level, SimulationTime
 
 static void _tracker_logRAM(Tracker* tracker, LogLevel level, SimulationTime interval) {
     guint seconds = (guint) (interval / SIMTIME_ONE_SECOND);
-    guint numptrs = g_hash_table_size(tracker->allocatedLocations);
+    guint numptrs = tracker->numAllocations;
 
     if(!tracker->didLogRAMHeader) {
         tracker->didLogRAMHeader = TRUE;
@@ -562,22 +646,146 @@ static void _tracker_logRAM(Tracker* tracker, LogLevel level, SimulationTime int
         tracker->allocatedBytesTotal, numptrs, tracker->numFailedFrees);
 }
 
-void tracker_heartbeat(Tracker* tracker, Host* host) {
-    MAGIC_ASSERT(tracker);
+static guint64* _tracker_putCounters(guint64* fields, Counters* c) {
+    utility_assert(c);
 
-    /* check to see if node info is being logged */
-    if(tracker->loginfo & LOG_INFO_FLAGS_NODE) {
-        _tracker_logNode(tracker, tracker->loglevel, tracker->interval);
+    /* the same values, in the same order, as _tracker_getCounterString */
+    *fields++ = c->packets.control + c->packets.controlRetransmit + c->packets.data +
+                c->packets.dataRetransmit;
+    *fields++ = _tracker_sumBytes(&c->bytes);
+    *fields++ = c->packets.control;
+    *fields++ = c->bytes.controlHeader;
+    *fields++ = c->packets.controlRetransmit;
+    *fields++ = c->bytes.controlHeaderRetransmit;
+    *fields++ = c->packets.data;
+    *fields++ = c->bytes.dataHeader;
+    *fields++ = c->bytes.dataPayload;
+    *fields++ = c->packets.dataRetransmit;
+    *fields++ = c->bytes.dataHeaderRetransmit;
+    *fields++ = c->bytes.dataPayloadRetransmit;
+    return fields;
+}
+
+static guint64* _tracker_putIFaceCounters(guint64* fields, IFaceCounters* local,
+                                          IFaceCounters* remote) {
+    fields = _tracker_putCounters(fields, &local->inCounters);
+    fields = _tracker_putCounters(fields, &local->outCounters);
+    fields = _tracker_putCounters(fields, &remote->inCounters);
+    fields = _tracker_putCounters(fields, &remote->outCounters);
+    return fields;
+}
+
+static void _tracker_writeRecord(Tracker* tracker, HeartbeatRecordType type, guint64* fields,
+                                 guint32 numFields) {
+    guint32 header[2] = {type, numFields};
+
+    if (fwrite(header, sizeof(header), 1, tracker->heartbeatFile) != 1 ||
+        fwrite(fields, sizeof(*fields), numFields, tracker->heartbeatFile) != numFields) {
+        warning("error writing to heartbeat file");
     }
+}
 
-    /* check to see if socket buffer info is being logged */
-    if(tracker->loginfo & LOG_INFO_FLAGS_SOCKET) {
-        _tracker_logSocket(tracker, tracker->loglevel, tracker->interval);
+static void _tracker_writeNode(Tracker* tracker, SimulationTime now) {
+    guint64 fields[5 + 4 * HEARTBEAT_COUNTER_FIELDS];
+    guint64* cursor = fields;
+
+    *cursor++ = now;
+    *cursor++ = tracker->interval;
+    *cursor++ = tracker->processingTimeLastInterval;
+    *cursor++ = tracker->numDelayedLastInterval;
+    *cursor++ = tracker->delayTimeLastInterval;
+    cursor = _tracker_putIFaceCounters(cursor, &tracker->local, &tracker->remote);
+
+    utility_assert((gsize)(cursor - fields) == G_N_ELEMENTS(fields));
+    _tracker_writeRecord(tracker, HEARTBEAT_RECORD_NODE, fields, G_N_ELEMENTS(fields));
+}
+
+static void _tracker_writeSocket(Tracker* tracker, SimulationTime now) {
+    SocketStats* ss = NULL;
+    GHashTableIter socketIterator;
+    g_hash_table_iter_init(&socketIterator, tracker->socketStats);
+
+    while (g_hash_table_iter_next(&socketIterator, NULL, (gpointer*)&ss)) {
+        /* the sockets that _tracker_logSocket skips */
+        if (!ss || (ss->type == PTCP && !ss->peerIP)) {
+            continue;
+        }
+
+        guint64 fields[10 + 4 * HEARTBEAT_COUNTER_FIELDS];
+        guint64* cursor = fields;
+
+        *cursor++ = now;
+        *cursor++ = (guint64)ss->handle;
+        *cursor++ = ss->type;
+        *cursor++ = ntohl(ss->peerIP);
+        *cursor++ = ss->peerPort;
+        *cursor++ = ss->inputBufferLength;
+        *cursor++ = ss->inputBufferSize;
+        *cursor++ = ss->outputBufferLength;
+        *cursor++ = ss->outputBufferSize;
+        *cursor++ = ss->inputDropped;
+        cursor = _tracker_putIFaceCounters(cursor, &ss->local, &ss->remote);
+
+        utility_assert((gsize)(cursor - fields) == G_N_ELEMENTS(fields));
+        _tracker_writeRecord(tracker, HEARTBEAT_RECORD_SOCKET, fields, G_N_ELEMENTS(fields));
+
+        if (ss->removeAfterNextLog) {
+            g_hash_table_iter_remove(&socketIterator);
+        }
     }
+}
 
-    /* check to see if ram info is being logged */
-    if(tracker->loginfo & LOG_INFO_FLAGS_RAM) {
-        _tracker_logRAM(tracker, tracker->loglevel, tracker->interval);
+static void _tracker_writeRAM(Tracker* tracker, SimulationTime now) {
+    guint64 fields[] = {
+        now,
+        tracker->interval,
+        tracker->allocatedBytesLastInterval,
+        tracker->deallocatedBytesLastInterval,
+        tracker->allocatedBytesTotal,
+        tracker->numAllocations,
+        tracker->numFailedFrees,
+    };
+
+    _tracker_writeRecord(tracker, HEARTBEAT_RECORD_RAM, fields, G_N_ELEMENTS(fields));
+}
+
+static void _tracker_writeHeartbeat(Tracker* tracker) {
+    SimulationTime now = worker_getCurrentTime();
+
+    if (tracker->loginfo & LOG_INFO_FLAGS_NODE) {
+        _tracker_writeNode(tracker, now);
+    }
+
+    if (tracker->loginfo & LOG_INFO_FLAGS_SOCKET) {
+        _tracker_writeSocket(tracker, now);
+    }
+
+    if (tracker->loginfo & LOG_INFO_FLAGS_RAM) {
+        _tracker_writeRAM(tracker, now);
+    }
+}
+
+void tracker_heartbeat(Tracker* tracker, Host* host) {
+    MAGIC_ASSERT(tracker);
+
+    if (tracker->heartbeatFile) {
+        /* copy the counters out as they are, without formatting them */
+        _tracker_writeHeartbeat(tracker);
+    } else {
+        /* check to see if node info is being logged */
+        if (tracker->loginfo & LOG_INFO_FLAGS_NODE) {
+            _tracker_logNode(tracker, tracker->loglevel, tracker->interval);
+        }
+
+        /* check to see if socket buffer info is being logged */
+        if (tracker->loginfo & LOG_INFO_FLAGS_SOCKET) {
+            _tracker_logSocket(tracker, tracker->loglevel, tracker->interval);
+        }
+
+        /* check to see if ram info is being logged */
+        if (tracker->loginfo & LOG_INFO_FLAGS_RAM) {
+            _tracker_logRAM(tracker, tracker->loglevel, tracker->interval);
+        }
     }
 
     /* clear interval stats */
@@ -598,12 +806,25 @@ void tracker_heartbeat(Tracker* tracker, Host* host) {
         if(ss) {
             memset(&ss->local, 0, sizeof(IFaceCounters));
             memset(&ss->remote, 0, sizeof(IFaceCounters));
+            ss->inputDropped = 0;
         }
     }
 
-    /* schedule the next heartbeat */
     tracker->lastHeartbeat = worker_getCurrentTime();
-    Task* heartbeatTask = task_new(tracker_heartbeatTask, tracker, NULL, NULL, NULL);
-    worker_scheduleTask(heartbeatTask, host, tracker->interval);
-    task_unref(heartbeatTask);
+    tracker->nextHeartbeat = tracker->lastHeartbeat + tracker->interval;
+}
+
+SimulationTime tracker_heartbeatIfDue(Tracker* tracker, Host* host, SimulationTime time) {
+    MAGIC_ASSERT(tracker);
+
+    SimulationTime now = worker_getCurrentTime();
+
+    /* one heartbeat for each interval, even if no round started in some of them */
+    while (tracker->nextHeartbeat <= time) {
+        worker_setCurrentTime(tracker->nextHeartbeat);
+        tracker_heartbeat(tracker, host);
+    }
+
+    worker_setCurrentTime(now);
+    return tracker->nextHeartbeat;
 }
@@ -11,28 +11,37 @@
 #include <netinet/in.h>
 
 #include "lib/logger/log_level.h"
+#include "main/bindings/c/bindings-opaque.h"
 #include "main/core/support/definitions.h"
 #include "main/host/protocol.h"
 #include "main/host/tracker_types.h"
 #include "main/routing/packet.minimal.h"
 
-Tracker* tracker_new(Host* host, SimulationTime interval, LogLevel loglevel, LogInfoFlags loginfo);
+Tracker* tracker_new(Host* host, SimulationTime interval, LogLevel loglevel, LogInfoFlags loginfo,
+                     LogFormat format);
 void tracker_free(Tracker* tracker);
+/* Opens the heartbeat file if needed and starts the periodic heartbeats. */
+void tracker_start(Tracker* tracker, Host* host);
 
 void tracker_addProcessingTime(Tracker* tracker, SimulationTime processingTime);
 void tracker_addVirtualProcessingDelay(Tracker* tracker, SimulationTime delay);
 void tracker_addInputBytes(Tracker* tracker, Packet* packet, gint handle);
 void tracker_addOutputBytes(Tracker* tracker, Packet* packet, gint handle);
-void tracker_addAllocatedBytes(Tracker* tracker, gpointer location, gsize allocatedBytes);
-void tracker_removeAllocatedBytes(Tracker* tracker, gpointer location);
+/* Callers pass the size of an allocation again when it's freed, since the tracker
+ * doesn't remember each allocation. */
+void tracker_addAllocatedBytes(Tracker* tracker, gsize allocatedBytes);
+void tracker_removeAllocatedBytes(Tracker* tracker, gsize allocatedBytes);
 void tracker_addSocket(Tracker* tracker, gint handle, ProtocolType type, gsize inputBufferSize, gsize outputBufferSize);
 void tracker_updateSocketPeer(Tracker* tracker, gint handle, in_addr_t peerIP, in_port_t peerPort);
 void tracker_updateSocketInputBuffer(Tracker* tracker, gint handle, gsize inputBufferLength, gsize inputBufferSize);
+void tracker_addSocketInputDrop(Tracker* tracker, gint handle);
 void tracker_updateSocketOutputBuffer(Tracker* tracker, gint handle, gsize outputBufferLength, gsize outputBufferSize);
 void tracker_removeSocket(Tracker* tracker, gint handle);
+/* Logs the statistics since the last heartbeat, as of the current time. */
 void tracker_heartbeat(Tracker* tracker, Host* host);
-static inline void tracker_heartbeatTask(Host* host, gpointer tracker, gpointer userData) {
-    tracker_heartbeat(tracker, host);
-}
+/* Logs the heartbeats that are due at or before the time, each as of the time it was
+ * due, and returns the time of the next one. The workers call this between rounds,
+ * so the heartbeats don't need events of their own. */
+SimulationTime tracker_heartbeatIfDue(Tracker* tracker, Host* host, SimulationTime time);
 
 #endif /* SHD_TRACKER_H_ */
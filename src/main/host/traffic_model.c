@@ -0,0 +1,522 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/host/traffic_model.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "lib/logger/logger.h"
+#include "main/core/work/task.h"
+#include "main/core/worker.h"
+#include "main/host/descriptor/compat_socket.h"
+#include "main/host/descriptor/descriptor.h"
+#include "main/host/descriptor/socket.h"
+#include "main/host/host.h"
+#include "main/host/status_listener.h"
+#include "main/routing/address.h"
+#include "main/routing/dns.h"
+#include "main/routing/topology.h"
+#include "main/utility/random.h"
+#include "main/utility/utility.h"
+
+/* the client's upload and download sizes, as big-endian 64-bit integers */
+#define TRAFFIC_MODEL_HEADER_LENGTH 16
+/* how much data we move per call into the socket */
+#define TRAFFIC_MODEL_CHUNK_LENGTH 65536
+
+/* what we send; the contents of the streams don't matter */
+static const gchar _trafficModelZeros[TRAFFIC_MODEL_CHUNK_LENGTH] = {0};
+/* where we put what we receive, which we throw away */
+static __thread gchar _trafficModelSink[TRAFFIC_MODEL_CHUNK_LENGTH];
+
+typedef struct _TrafficModelStream TrafficModelStream;
+struct _TrafficModelStream {
+    TrafficModel* model;
+    TCP* tcp;
+    gboolean isClient;
+    /* wakes us up when the socket becomes readable or writable */
+    StatusListener* listener;
+    /* so we only have one step scheduled at a time */
+    gboolean stepPending;
+
+    gchar header[TRAFFIC_MODEL_HEADER_LENGTH];
+    gsize headerOffset;
+    guint64 sendRemaining;
+    guint64 receiveRemaining;
+};
+
+struct _TrafficModel {
+    Host* host;
+    TrafficModelParameters* params;
+
+    /* every socket we own, each holding a reference, mapped to the stream we are
+     * running on it. sockets that aren't running a stream, like the listener and
+     * sockets that are closing, map to NULL. */
+    GHashTable* sockets;
+
+    /* only servers listen */
+    TCP* listener;
+    StatusListener* acceptListener;
+    gboolean acceptPending;
+
+    /* only clients move between states */
+    guint state;
+    /* the peer's address, in network byte order, once we have started */
+    in_addr_t peerIP;
+
+    guint64 nStreamsCompleted;
+    guint64 nStreamsFailed;
+
+    MAGIC_DECLARE;
+};
+
+void trafficmodelparameters_free(TrafficModelParameters* params) {
+    if (!params) {
+        return;
+    }
+    for (guint i = 0; i < params->nStates; i++) {
+        g_free(params->states[i].nextWeights);
+    }
+    g_free(params->states);
+    g_free(params->peerHostname);
+    g_free(params);
+}
+
+static void _trafficmodelstream_free(TrafficModelStream* stream) {
+    if (!stream) {
+        return;
+    }
+
+    descriptor_removeListener((LegacyDescriptor*)stream->tcp, stream->listener);
+    statuslistener_unref(stream->listener);
+    descriptor_unref(stream->tcp);
+    g_free(stream);
+}
+
+/* Replaces the stream the socket maps to, freeing the old one. */
+static void _trafficmodel_setStream(TrafficModel* model, TCP* tcp, TrafficModelStream* stream) {
+    /* the table drops its old reference to the key when we replace it */
+    descriptor_ref(tcp);
+    g_hash_table_replace(model->sockets, tcp, stream);
+}
+
+static void _trafficmodel_runNextStreamTask(Host* host, gpointer unused1, gpointer unused2);
+
+static void _trafficmodel_scheduleNextStream(TrafficModel* model) {
+    worker_scheduleCallback(_trafficmodel_runNextStreamTask, NULL, NULL, NULL, NULL, model->host,
+                            model->params->states[model->state].pause);
+}
+
+/* Does the bookkeeping for a stream that ended, whether or not it finished. */
+static void _trafficmodel_endStream(TrafficModel* model, TrafficModelStream* stream,
+                                    gboolean completed) {
+    if (completed) {
+        model->nStreamsCompleted++;
+    } else {
+        model->nStreamsFailed++;
+        trace("traffic model stream on %s failed", host_getName(model->host));
+    }
+
+    if (stream->isClient) {
+        _trafficmodel_scheduleNextStream(model);
+    }
+}
+
+static void _trafficmodel_closeStream(TrafficModel* model, TrafficModelStream* stream,
+                                      gboolean completed) {
+    TCP* tcp = stream->tcp;
+    _trafficmodel_endStream(model, stream, completed);
+
+    /* we keep our reference until the socket finishes closing and deregisters */
+    _trafficmodel_setStream(model, tcp, NULL);
+    descriptor_close((LegacyDescriptor*)tcp, model->host);
+}
+
+/* Moves as much data as the socket allows. Returns a negative errno if the stream
+ * failed, 1 if it has nothing left to do, and 0 if it has to wait. */
+static gint _trafficmodelstream_transfer(TrafficModelStream* stream, Host* host) {
+    TCP* tcp = stream->tcp;
+
+    while (stream->headerOffset < TRAFFIC_MODEL_HEADER_LENGTH) {
+        gchar* header = stream->header + stream->headerOffset;
+        gsize length = TRAFFIC_MODEL_HEADER_LENGTH - stream->headerOffset;
+        gssize result = stream->isClient ? tcp_sendShadowData(tcp, host, header, length)
+                                         : tcp_receiveShadowData(tcp, host, header, length);
+        if (result == -EWOULDBLOCK) {
+            return 0;
+        } else if (result <= 0) {
+            /* the client hung up before it told us what it wants */
+            return result < 0 ? (gint)result : -ECONNRESET;
+        }
+        stream->headerOffset += result;
+
+        if (!stream->isClient && stream->headerOffset == TRAFFIC_MODEL_HEADER_LENGTH) {
+            guint64 upload = 0, download = 0;
+            memcpy(&upload, stream->header, sizeof(upload));
+            memcpy(&download, stream->header + sizeof(upload), sizeof(download));
+            stream->receiveRemaining = GUINT64_FROM_BE(upload);
+            stream->sendRemaining = GUINT64_FROM_BE(download);
+        }
+    }
+
+    while (stream->sendRemaining > 0) {
+        gsize length = MIN(stream->sendRemaining, TRAFFIC_MODEL_CHUNK_LENGTH);
+        gssize result = tcp_sendShadowData(tcp, host, _trafficModelZeros, length);
+        if (result == -EWOULDBLOCK) {
+            /* we may still be able to receive */
+            break;
+        } else if (result < 0) {
+            return (gint)result;
+        }
+        stream->sendRemaining -= result;
+    }
+
+    while (stream->receiveRemaining > 0) {
+        gsize length = MIN(stream->receiveRemaining, TRAFFIC_MODEL_CHUNK_LENGTH);
+        gssize result = tcp_receiveShadowData(tcp, host, _trafficModelSink, length);
+        if (result == -EWOULDBLOCK) {
+            break;
+        } else if (result <= 0) {
+            /* the peer hung up before it sent everything */
+            return result < 0 ? (gint)result : -ECONNRESET;
+        }
+        stream->receiveRemaining -= result;
+    }
+
+    return (stream->sendRemaining == 0 && stream->receiveRemaining == 0) ? 1 : 0;
+}
+
+static void _trafficmodel_stepStream(TrafficModel* model, TrafficModelStream* stream) {
+    gint error = tcp_getConnectionError(stream->tcp);
+    if (error == -EALREADY) {
+        /* still connecting; we'll be notified when it becomes writable */
+        return;
+    } else if (error < 0 && error != -EISCONN) {
+        _trafficmodel_closeStream(model, stream, FALSE);
+        return;
+    }
+
+    gint result = _trafficmodelstream_transfer(stream, model->host);
+    if (result != 0) {
+        _trafficmodel_closeStream(model, stream, result > 0);
+    }
+}
+
+static void _trafficmodel_runStepTask(Host* host, gpointer voidTcp, gpointer unused) {
+    TrafficModel* model = host_getTrafficModel(host);
+    if (!model) {
+        return;
+    }
+
+    /* the stream may have ended since we were scheduled */
+    TrafficModelStream* stream = g_hash_table_lookup(model->sockets, voidTcp);
+    if (stream) {
+        stream->stepPending = FALSE;
+        _trafficmodel_stepStream(model, stream);
+    }
+}
+
+static void _trafficmodelstream_scheduleStep(TrafficModelStream* stream) {
+    if (stream->stepPending) {
+        return;
+    }
+
+    /* we step in a task, so that whatever changed the socket's status finishes first */
+    descriptor_ref(stream->tcp);
+    worker_scheduleCallback(_trafficmodel_runStepTask, stream->tcp, NULL, descriptor_unref, NULL,
+                            stream->model->host, 0);
+
+    stream->stepPending = TRUE;
+}
+
+static void _trafficmodelstream_notifyStatusChanged(void* voidStream, void* unused) {
+    _trafficmodelstream_scheduleStep(voidStream);
+}
+
+/* Starts a stream on a connected or connecting socket. */
+static void _trafficmodel_startStream(TrafficModel* model, TCP* tcp, gboolean isClient,
+                                      guint64 sendBytes, guint64 receiveBytes) {
+    TrafficModelStream* stream = g_new0(TrafficModelStream, 1);
+    stream->model = model;
+    descriptor_ref(tcp);
+    stream->tcp = tcp;
+    stream->isClient = isClient;
+
+    if (isClient) {
+        guint64 upload = GUINT64_TO_BE(sendBytes);
+        guint64 download = GUINT64_TO_BE(receiveBytes);
+        memcpy(stream->header, &upload, sizeof(upload));
+        memcpy(stream->header + sizeof(upload), &download, sizeof(download));
+        stream->sendRemaining = sendBytes;
+        stream->receiveRemaining = receiveBytes;
+    }
+
+    /* the listener doesn't hold a reference to the stream, since we remove it before
+     * we free the stream */
+    stream->listener =
+        statuslistener_new(_trafficmodelstream_notifyStatusChanged, stream, NULL, NULL, NULL);
+    statuslistener_setMonitorStatus(stream->listener,
+                                    STATUS_DESCRIPTOR_READABLE | STATUS_DESCRIPTOR_WRITABLE,
+                                    SLF_OFF_TO_ON);
+    descriptor_addListener((LegacyDescriptor*)tcp, stream->listener);
+
+    _trafficmodel_setStream(model, tcp, stream);
+
+    /* the socket may already be readable or writable, which we wouldn't hear about */
+    _trafficmodelstream_scheduleStep(stream);
+}
+
+static TCP* _trafficmodel_newSocket(TrafficModel* model) {
+    Host* host = model->host;
+    TCP* tcp = tcp_new(
+        host, host_getConfiguredRecvBufSize(host), host_getConfiguredSendBufSize(host));
+    socket_setHostOwned((Socket*)tcp, TRUE);
+
+    /* the table takes the initial reference */
+    g_hash_table_insert(model->sockets, tcp, NULL);
+    return tcp;
+}
+
+/* Like bind(), with a port of 0 for an ephemeral port. */
+static gint _trafficmodel_bind(TrafficModel* model, TCP* tcp, in_addr_t ip, in_port_t port,
+                               in_addr_t peerIP, in_port_t peerPort) {
+    Host* host = model->host;
+
+    if (port == 0) {
+        port = host_getRandomFreePort(host, PTCP, ip, peerIP, peerPort);
+        if (port == 0) {
+            return -EADDRINUSE;
+        }
+    }
+
+    if (!host_isInterfaceAvailable(host, PTCP, ip, port, peerIP, peerPort, FALSE)) {
+        return -EADDRINUSE;
+    }
+
+    socket_setPeerName((Socket*)tcp, peerIP, peerPort);
+    socket_setSocketName((Socket*)tcp, ip, port);
+
+    CompatSocket compatSocket = compatsocket_fromLegacySocket((Socket*)tcp);
+    host_associateInterface(host, &compatSocket, ip);
+    return 0;
+}
+
+static void _trafficmodel_startClientStream(TrafficModel* model) {
+    TrafficModelParameters* params = model->params;
+    TrafficModelStateParameters* state = &params->states[model->state];
+
+    Host* host = model->host;
+    TCP* tcp = _trafficmodel_newSocket(model);
+    gint result =
+        _trafficmodel_bind(model, tcp, host_getDefaultIP(host), 0, model->peerIP, params->port);
+    if (result == 0) {
+        result = socket_connectToPeer((Socket*)tcp, host, model->peerIP, params->port, AF_INET);
+    }
+
+    if (result != 0 && result != -EINPROGRESS) {
+        /* trying again right away would probably fail the same way, possibly without
+         * time moving forward, so we give up */
+        warning("traffic model on host %s could not connect to %s: %s",
+                host_getName(host), params->peerHostname, g_strerror(-result));
+        model->nStreamsFailed++;
+        descriptor_close((LegacyDescriptor*)tcp, host);
+        return;
+    }
+
+    _trafficmodel_startStream(model, tcp, TRUE, state->sendBytes, state->receiveBytes);
+}
+
+/* Picks the client's next state at random, according to the weights of its current
+ * state. It stays where it is if all the weights are 0. */
+static void _trafficmodel_moveToNextState(TrafficModel* model) {
+    TrafficModelParameters* params = model->params;
+    const gdouble* weights = params->states[model->state].nextWeights;
+
+    gdouble total = 0;
+    for (guint i = 0; i < params->nStates; i++) {
+        total += weights[i];
+    }
+    if (total <= 0) {
+        return;
+    }
+
+    gdouble point = random_nextDouble(host_getRandom(model->host)) * total;
+    for (guint i = 0; i < params->nStates; i++) {
+        if (weights[i] <= 0) {
+            continue;
+        }
+        /* rounding may leave us past the end, so we settle for the last state we could
+         * move to */
+        model->state = i;
+        if (point < weights[i]) {
+            break;
+        }
+        point -= weights[i];
+    }
+}
+
+static void _trafficmodel_runNextStreamTask(Host* host, gpointer unused1, gpointer unused2) {
+    TrafficModel* model = host_getTrafficModel(host);
+    if (model) {
+        _trafficmodel_moveToNextState(model);
+        _trafficmodel_startClientStream(model);
+    }
+}
+
+static void _trafficmodel_runAcceptTask(Host* host, gpointer unused1, gpointer unused2) {
+    TrafficModel* model = host_getTrafficModel(host);
+    if (!model || !model->listener) {
+        return;
+    }
+    model->acceptPending = FALSE;
+
+    while (TRUE) {
+        TCP* child = NULL;
+        gint result = tcp_acceptServerChild(model->listener, &child);
+
+        if (result == 0) {
+            /* the client tells us how much to send once it's connected */
+            _trafficmodel_startStream(model, child, FALSE, 0, 0);
+        } else if (result == -ECONNABORTED) {
+            /* the child is still ours, and will deregister once it's closed */
+            model->nStreamsFailed++;
+        } else {
+            break;
+        }
+    }
+}
+
+static void _trafficmodel_notifyAcceptable(void* voidModel, void* unused) {
+    TrafficModel* model = voidModel;
+    MAGIC_ASSERT(model);
+
+    if (model->acceptPending) {
+        return;
+    }
+
+    worker_scheduleCallback(_trafficmodel_runAcceptTask, NULL, NULL, NULL, NULL, model->host, 0);
+
+    model->acceptPending = TRUE;
+}
+
+static void _trafficmodel_startServer(TrafficModel* model) {
+    TCP* tcp = _trafficmodel_newSocket(model);
+
+    gint result = _trafficmodel_bind(model, tcp, htonl(INADDR_ANY), model->params->port, 0, 0);
+    if (result != 0) {
+        warning("traffic model on host %s could not bind to port %u: %s",
+                host_getName(model->host), ntohs(model->params->port), g_strerror(-result));
+        descriptor_close((LegacyDescriptor*)tcp, model->host);
+        return;
+    }
+
+    tcp_enterServerMode(tcp, model->host, SOMAXCONN);
+    model->listener = tcp;
+
+    /* the listener doesn't hold a reference to the model, since we remove it before
+     * we free the model */
+    model->acceptListener =
+        statuslistener_new(_trafficmodel_notifyAcceptable, model, NULL, NULL, NULL);
+    statuslistener_setMonitorStatus(
+        model->acceptListener, STATUS_DESCRIPTOR_READABLE, SLF_OFF_TO_ON);
+    descriptor_addListener((LegacyDescriptor*)tcp, model->acceptListener);
+}
+
+static void _trafficmodel_runStartTask(Host* host, gpointer unused1, gpointer unused2) {
+    TrafficModel* model = host_getTrafficModel(host);
+    if (!model) {
+        return;
+    }
+
+    host_activate(host);
+
+    if (!model->params->peerHostname) {
+        _trafficmodel_startServer(model);
+        return;
+    }
+
+    Address* peer = dns_resolveNameToAddress(worker_getDNS(), model->params->peerHostname);
+    if (!peer || !topology_isRoutable(worker_getTopology(), host_getDefaultAddress(host), peer)) {
+        warning("traffic model on host %s has no route to its peer %s", host_getName(host),
+                model->params->peerHostname);
+        return;
+    }
+    model->peerIP = (in_addr_t)address_toNetworkIP(peer);
+
+    _trafficmodel_startClientStream(model);
+}
+
+TrafficModel* trafficmodel_new(Host* host, TrafficModelParameters* params) {
+    utility_assert(params);
+    utility_assert(params->peerHostname == NULL || params->nStates > 0);
+
+    TrafficModel* model = g_new0(TrafficModel, 1);
+    MAGIC_INIT(model);
+
+    model->host = host;
+    model->params = params;
+    model->sockets = g_hash_table_new_full(g_direct_hash, g_direct_equal, descriptor_unref,
+                                           (GDestroyNotify)_trafficmodelstream_free);
+
+    return model;
+}
+
+void trafficmodel_free(TrafficModel* model) {
+    MAGIC_ASSERT(model);
+
+    info("traffic model on host %s completed %" G_GUINT64_FORMAT " streams, and %" G_GUINT64_FORMAT
+         " failed",
+         host_getName(model->host), model->nStreamsCompleted, model->nStreamsFailed);
+
+    if (model->acceptListener) {
+        descriptor_removeListener((LegacyDescriptor*)model->listener, model->acceptListener);
+        statuslistener_unref(model->acceptListener);
+    }
+
+    /* servers and their children refer to each other, so break those cycles first,
+     * like a process does with its descriptor table */
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, model->sockets);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        descriptor_shutdownHelper(key);
+    }
+    g_hash_table_destroy(model->sockets);
+
+    trafficmodelparameters_free(model->params);
+
+    MAGIC_CLEAR(model);
+    g_free(model);
+}
+
+void trafficmodel_schedule(TrafficModel* model) {
+    MAGIC_ASSERT(model);
+
+    SimulationTime now = worker_getCurrentTime();
+    SimulationTime startTime = model->params->startTime;
+    SimulationTime startDelay = startTime <= now ? 1 : startTime - now;
+
+    worker_scheduleCallback(_trafficmodel_runStartTask, NULL, NULL, NULL, NULL, model->host,
+                            startDelay);
+}
+
+void trafficmodel_registerSocket(TrafficModel* model, TCP* tcp) {
+    MAGIC_ASSERT(model);
+    g_hash_table_insert(model->sockets, tcp, NULL);
+}
+
+void trafficmodel_deregisterSocket(TrafficModel* model, TCP* tcp) {
+    MAGIC_ASSERT(model);
+
+    /* the socket closed under a stream that was still running, e.g. after a reset */
+    TrafficModelStream* stream = g_hash_table_lookup(model->sockets, tcp);
+    if (stream) {
+        _trafficmodel_endStream(model, stream, FALSE);
+    }
+
+    g_hash_table_remove(model->sockets, tcp);
+}
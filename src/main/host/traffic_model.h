@@ -0,0 +1,32 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_TRAFFIC_MODEL_H_
+#define SHD_TRAFFIC_MODEL_H_
+
+#include <glib.h>
+#include <netinet/in.h>
+
+#include "main/core/support/definitions.h"
+#include "main/host/descriptor/tcp.h"
+#include "main/host/traffic_model_types.h"
+
+void trafficmodelparameters_free(TrafficModelParameters* params);
+
+/* Takes ownership of params. */
+TrafficModel* trafficmodel_new(Host* host, TrafficModelParameters* params);
+/* Closes all of the model's sockets. */
+void trafficmodel_free(TrafficModel* model);
+
+/* Schedules the model to start at its start time. */
+void trafficmodel_schedule(TrafficModel* model);
+
+/* Takes ownership of the initial reference to a socket that a server the model owns
+ * just created for a new connection. */
+void trafficmodel_registerSocket(TrafficModel* model, TCP* tcp);
+/* Drops the model's reference to a socket that has closed. */
+void trafficmodel_deregisterSocket(TrafficModel* model, TCP* tcp);
+
+#endif /* SHD_TRAFFIC_MODEL_H_ */
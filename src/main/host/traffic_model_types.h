@@ -0,0 +1,44 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_TRAFFIC_MODEL_TYPES_H_
+#define SHD_TRAFFIC_MODEL_TYPES_H_
+
+#include <glib.h>
+#include <netinet/in.h>
+
+#include "main/core/support/definitions.h"
+
+/* Generates TCP traffic on a host without running a process. A model either serves
+ * streams on a port, or is a client that moves through a Markov chain of states,
+ * opening one stream to its peer in each state and then pausing before it moves on.
+ * Each client stream starts with a header telling the server how many bytes the
+ * client will upload and how many it wants to download, so any model server can
+ * serve any model client. Everything runs in tasks on the host's worker thread. */
+typedef struct _TrafficModel TrafficModel;
+
+typedef struct _TrafficModelStateParameters TrafficModelStateParameters;
+struct _TrafficModelStateParameters {
+    /* bytes the client uploads to and downloads from the server in this state */
+    guint64 sendBytes;
+    guint64 receiveBytes;
+    /* how long the client waits after the stream before it moves to the next state */
+    SimulationTime pause;
+    /* relative weights of moving to each state, one per state */
+    gdouble* nextWeights;
+};
+
+typedef struct _TrafficModelParameters TrafficModelParameters;
+struct _TrafficModelParameters {
+    /* in network byte order */
+    in_port_t port;
+    /* the host to connect to, or NULL to serve streams on the port instead */
+    gchar* peerHostname;
+    SimulationTime startTime;
+    guint nStates;
+    TrafficModelStateParameters* states;
+};
+
+#endif /* SHD_TRAFFIC_MODEL_TYPES_H_ */
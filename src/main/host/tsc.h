@@ -14,6 +14,10 @@ typedef struct _Tsc {
     uint64_t cyclesPerSecond;
 } Tsc;
 
+// The frequency of the emulated timestamp counter. FIXME: This should be the
+// emulated CPU's frequency.
+#define TSC_EMULATED_CYCLES_PER_SECOND 2000000000UL
+
 // Initializes a Tsc heuristically by measuring on the host system. FIXME:
 // should be able to do this more efficiently and accurately by querying the
 // CPU.
@@ -29,6 +33,12 @@ void Tsc_emulateRdtsc(const Tsc* tsc, struct user_regs_struct* regs,
 void Tsc_emulateRdtscp(const Tsc* tsc, struct user_regs_struct* regs,
                        uint64_t nanos);
 
+// The value of the timestamp counter at time `nanos`. This is header-only so
+// that the shim can use it too.
+static inline uint64_t Tsc_nanosToCycles(const Tsc* tsc, uint64_t nanos) {
+    return (uint64_t)((unsigned __int128)nanos * tsc->cyclesPerSecond / 1000000000);
+}
+
 // Whether `buf` begins with an rdtsc instruction.
 static inline bool isRdtsc(const uint8_t* buf) {
     return buf[0] == 0x0f && buf[1] == 0x31;
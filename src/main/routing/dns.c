@@ -14,11 +14,20 @@
 #include <unistd.h>
 
 #include "lib/logger/logger.h"
+#include "lib/shim/shim_hosts_table.h"
 #include "main/core/support/definitions.h"
 #include "main/routing/address.h"
 #include "main/routing/dns.h"
 #include "main/utility/utility.h"
 
+/* a file that we write lazily from the address mappings */
+typedef struct _DNSFile DNSFile;
+struct _DNSFile {
+    int filenum;
+    char* path;
+    bool isStale;
+};
+
 struct _DNS {
     GMutex lock;
 
@@ -29,11 +38,18 @@ struct _DNS {
     GHashTable* addressByIP;
     GHashTable* addressByName;
 
-    struct {
-        int filenum;
-        char* path;
-        bool isStale;
-    } hosts;
+    /* the hosts file, in the format of /etc/hosts. hosts that register after it's
+     * written are appended to it, so that it keeps its path. */
+    DNSFile hosts;
+    /* the number of host lines in the hosts file, and how many of them are for
+     * hosts that have since deregistered */
+    guint hostsNumLines;
+    guint hostsNumRemovedLines;
+    /* the names of the deregistered hosts, which would shadow the new line if
+     * they registered again */
+    GHashTable* hostsRemovedNames;
+    /* the same mappings in the format of lib/shim/shim_hosts_table.h */
+    DNSFile hostsTable;
 
     MAGIC_DECLARE;
 };
@@ -122,6 +138,8 @@ static in_addr_t _dns_generateIP(DNS* dns) {
     return ip;
 }
 
+static bool _dns_appendHostLine(DNS* dns, Address* address);
+
 Address* dns_register(DNS* dns, GQuark id, gchar* name, gchar* requestedIP) {
     MAGIC_ASSERT(dns);
     utility_assert(name);
@@ -155,8 +173,14 @@ Address* dns_register(DNS* dns, GQuark id, gchar* name, gchar* requestedIP) {
         address_ref(address);
     }
 
-    /* Any existing hosts file needs to be (lazily) updated. */
-    dns->hosts.isStale = true;
+    /* Add the host to an existing hosts file, unless a line for a host that had
+     * the same name would come first. The hosts table is (lazily) rewritten. */
+    if (!isLocal && dns->hosts.path && !dns->hosts.isStale &&
+        (g_hash_table_contains(dns->hostsRemovedNames, name) ||
+         !_dns_appendHostLine(dns, address))) {
+        dns->hosts.isStale = true;
+    }
+    dns->hostsTable.isStale = true;
 
     g_mutex_unlock(&dns->lock);
 
@@ -172,8 +196,16 @@ void dns_deregister(DNS* dns, Address* address) {
         g_hash_table_remove(dns->addressByIP, GUINT_TO_POINTER(address_toNetworkIP(address)));
         g_hash_table_remove(dns->addressByName, address_toHostName(address));
 
-        /* Any existing hosts file needs to be (lazily) updated. */
-        dns->hosts.isStale = true;
+        /* The line in an existing hosts file is left in place until most of its
+         * lines are for removed hosts. The hosts table is (lazily) rewritten. */
+        if (dns->hosts.path && !dns->hosts.isStale) {
+            g_hash_table_add(dns->hostsRemovedNames, g_strdup(address_toHostName(address)));
+            dns->hostsNumRemovedLines++;
+            if (2 * dns->hostsNumRemovedLines > dns->hostsNumLines) {
+                dns->hosts.isStale = true;
+            }
+        }
+        dns->hostsTable.isStale = true;
 
         g_mutex_unlock(&dns->lock);
     }
@@ -199,33 +231,66 @@ Address* dns_resolveNameToAddress(DNS* dns, const gchar* name) {
     return result;
 }
 
-static void _dns_cleanupHostsFile(DNS* dns) {
-    MAGIC_ASSERT(dns);
-
-    if(dns->hosts.filenum > 0) {
-        close(dns->hosts.filenum);
-        dns->hosts.filenum = 0;
+static void _dns_cleanupFile(DNSFile* file) {
+    if(file->filenum > 0) {
+        close(file->filenum);
+        file->filenum = 0;
     }
 
-    if(dns->hosts.path) {
-        if (unlink(dns->hosts.path) < 0) {
-            debug("unlink unable to remove hosts file at '%s', error %i: %s", dns->hosts.path,
-                  errno, strerror(errno));
+    if(file->path) {
+        if (unlink(file->path) < 0) {
+            debug("unlink unable to remove hosts file at '%s', error %i: %s", file->path, errno,
+                  strerror(errno));
         }
-        free(dns->hosts.path);
-        dns->hosts.path = NULL;
+        free(file->path);
+        file->path = NULL;
     }
 }
 
-static char* _dns_getHostsPath(DNS* dns) {
+static char* _dns_getHostsPath(const char* kind) {
     char* abspath = NULL;
-    if (asprintf(&abspath, "/tmp/shadow-%i-hosts-XXXXXX", (int)getpid()) < 0) {
+    if (asprintf(&abspath, "/tmp/shadow-%i-%s-XXXXXX", (int)getpid(), kind) < 0) {
         utility_panic("asprintf could not allocate string for hosts file");
         abort();
     }
     return abspath;
 }
 
+/* Writes `len` bytes of `data` at the end of `file`. */
+static bool _dns_writeToFile(DNSFile* file, const void* data, size_t len) {
+    size_t amt = 0;
+    while(amt < len) {
+        ssize_t ret = write(file->filenum, &((const char*)data)[amt], len - amt);
+        if(ret < 0 && errno != EAGAIN) {
+            warning("Unable to write to temp hosts file, write() error %i: %s", errno, strerror(errno));
+            return false;
+        } else if(ret >= 0) {
+            amt += (size_t)ret;
+        }
+    }
+    return true;
+}
+
+/* Creates a new temp file for `file` and writes `len` bytes of `data` to it. */
+static bool _dns_writeNewFile(DNSFile* file, const char* kind, const void* data, size_t len) {
+    utility_assert(!file->path);
+
+    file->path = _dns_getHostsPath(kind);
+    file->filenum = mkstemp(file->path);
+    if(file->filenum < 0) {
+        warning("Unable create temp hosts file, mkstemp() error %i: %s", errno, strerror(errno));
+        return false;
+    }
+
+    if (!_dns_writeToFile(file, data, len)) {
+        return false;
+    }
+
+    info("Wrote new %s file of size %zu bytes at path '%s'", kind, len, file->path);
+    file->isStale = false;
+    return true;
+}
+
 static void _dns_writeHostLine(gpointer key, gpointer value, gpointer data) {
     gchar* name = key;
     Address* address = value;
@@ -235,55 +300,130 @@ static void _dns_writeHostLine(gpointer key, gpointer value, gpointer data) {
 
 static bool _dns_writeNewHostsFile(DNS* dns) {
     MAGIC_ASSERT(dns);
-    utility_assert(!dns->hosts.path);
-
-    dns->hosts.path = _dns_getHostsPath(dns);
-    dns->hosts.filenum = mkstemp(dns->hosts.path);
-    if(dns->hosts.filenum < 0) {
-        warning("Unable create temp hosts file, mkstemp() error %i: %s", errno, strerror(errno));
-        return false;
-    }
 
     GString* buf = g_string_new("127.0.0.1 localhost\n");
     g_hash_table_foreach(dns->addressByName, _dns_writeHostLine, buf);
 
     trace("Hosts file string buffer is %zu bytes.", buf->len);
 
-    size_t amt = 0;
-    while(amt < buf->len) {
-        ssize_t ret = write(dns->hosts.filenum, &buf->str[amt], buf->len-amt);
-        if(ret < 0 && errno != EAGAIN) {
-            warning("Unable to write to temp hosts file, write() error %i: %s", errno, strerror(errno));
-            g_string_free(buf, TRUE);
-            return false;
-        } else if(ret >= 0) {
-            amt += (size_t)ret;
+    bool success = _dns_writeNewFile(&dns->hosts, "hosts", buf->str, buf->len);
+    g_string_free(buf, TRUE);
+
+    dns->hostsNumLines = g_hash_table_size(dns->addressByName);
+    dns->hostsNumRemovedLines = 0;
+    g_hash_table_remove_all(dns->hostsRemovedNames);
+
+    return success;
+}
+
+/* Adds the line for a newly registered host at the end of the existing hosts file. */
+static bool _dns_appendHostLine(DNS* dns, Address* address) {
+    MAGIC_ASSERT(dns);
+    utility_assert(dns->hosts.path);
+
+    GString* buf = g_string_new(NULL);
+    _dns_writeHostLine(address_toHostName(address), address, buf);
+    bool success = _dns_writeToFile(&dns->hosts, buf->str, buf->len);
+    g_string_free(buf, TRUE);
+
+    if (success) {
+        dns->hostsNumLines++;
+    }
+    return success;
+}
+
+static void _dns_addHostsTableEntry(ShimHostsTableHeader* table, GString* names, const gchar* name,
+                                    in_addr_t netIP) {
+    size_t len = strlen(name);
+    uint32_t hash = shimhoststable_hash(name, len);
+    ShimHostsTableEntry* buckets = shimhoststable_buckets(table);
+    uint32_t mask = table->num_buckets - 1;
+
+    /* the names aren't in the table yet, so we can't use shimhoststable_find() */
+    uint32_t i = hash & mask;
+    while (buckets[i].name_offset != 0) {
+        if (buckets[i].hash == hash && buckets[i].name_len == len &&
+            memcmp(&names->str[buckets[i].name_offset], name, len) == 0) {
+            /* names are unique in addressByName, but "localhost" could also be registered */
+            return;
         }
+        i = (i + 1) & mask;
     }
 
-    info("Wrote new hosts file of size %zu bytes at path '%s'", amt, dns->hosts.path);
-    dns->hosts.isStale = false;
-    g_string_free(buf, TRUE);
-    return true;
+    buckets[i] = (ShimHostsTableEntry){
+        .hash = hash,
+        .name_offset = (uint32_t)names->len,
+        .name_len = (uint32_t)len,
+        .addr = netIP,
+    };
+    /* includes the NUL */
+    g_string_append_len(names, name, len + 1);
+    table->num_names++;
+    table->names_size = (uint32_t)names->len;
 }
 
-gchar* dns_getHostsFilePath(DNS* dns) {
+static bool _dns_writeNewHostsTable(DNS* dns) {
+    MAGIC_ASSERT(dns);
+
+    /* at least twice as many buckets as names, including localhost */
+    guint numNames = g_hash_table_size(dns->addressByName) + 1;
+    uint32_t numBuckets = 2;
+    while (numBuckets < 2 * numNames) {
+        numBuckets *= 2;
+    }
+
+    gsize tableSize = shimhoststable_size(numBuckets, 0);
+    ShimHostsTableHeader* table = g_malloc0(tableSize);
+    *table = (ShimHostsTableHeader){
+        .magic = SHIM_HOSTS_TABLE_MAGIC,
+        .version = SHIM_HOSTS_TABLE_VERSION,
+        .num_buckets = numBuckets,
+    };
+
+    /* name offset 0 is reserved for empty buckets */
+    GString* names = g_string_new(NULL);
+    g_string_append_c(names, '\0');
+    table->names_size = (uint32_t)names->len;
+
+    _dns_addHostsTableEntry(table, names, "localhost", address_stringToIP("127.0.0.1"));
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, dns->addressByName);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        _dns_addHostsTableEntry(table, names, key, address_toNetworkIP(value));
+    }
+
+    /* the names follow the buckets */
+    table = g_realloc(table, tableSize + names->len);
+    memcpy(((char*)table) + tableSize, names->str, names->len);
+
+    bool success =
+        _dns_writeNewFile(&dns->hostsTable, "hosts-table", table, tableSize + names->len);
+
+    g_string_free(names, TRUE);
+    g_free(table);
+    return success;
+}
+
+/* Returns a copy of the path to `file`, first writing a new one with `writeFunc` if needed. */
+static char* _dns_getFilePath(DNS* dns, DNSFile* file, bool (*writeFunc)(DNS*)) {
     MAGIC_ASSERT(dns);
 
     char* path = NULL;
 
     g_mutex_lock(&dns->lock);
 
-    if(dns->hosts.isStale || !dns->hosts.path) {
-        _dns_cleanupHostsFile(dns);
-        if(!_dns_writeNewHostsFile(dns)) {
+    if(file->isStale || !file->path) {
+        _dns_cleanupFile(file);
+        if(!writeFunc(dns)) {
             warning("Unable to create hosts file; expect networking errors.");
-            _dns_cleanupHostsFile(dns);
+            _dns_cleanupFile(file);
         }
     }
 
-    if(dns->hosts.path) {
-        path = strdup(dns->hosts.path);
+    if(file->path) {
+        path = strdup(file->path);
     }
 
     g_mutex_unlock(&dns->lock);
@@ -291,6 +431,14 @@ gchar* dns_getHostsFilePath(DNS* dns) {
     return path;
 }
 
+gchar* dns_getHostsFilePath(DNS* dns) {
+    return _dns_getFilePath(dns, &dns->hosts, _dns_writeNewHostsFile);
+}
+
+gchar* dns_getHostsTablePath(DNS* dns) {
+    return _dns_getFilePath(dns, &dns->hostsTable, _dns_writeNewHostsTable);
+}
+
 DNS* dns_new() {
     DNS* dns = g_new0(DNS, 1);
     MAGIC_INIT(dns);
@@ -299,6 +447,7 @@ DNS* dns_new() {
 
     dns->addressByIP = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) address_unref);
     dns->addressByName = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) address_unref);
+    dns->hostsRemovedNames = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     /* 11.0.0.0 -- 100.0.0.0 is the longest available unrestricted range */
     dns->ipAddressCounter = ntohl(address_stringToIP("11.0.0.0"));
@@ -309,10 +458,12 @@ DNS* dns_new() {
 void dns_free(DNS* dns) {
     MAGIC_ASSERT(dns);
 
-    _dns_cleanupHostsFile(dns);
+    _dns_cleanupFile(&dns->hosts);
+    _dns_cleanupFile(&dns->hostsTable);
 
     g_hash_table_destroy(dns->addressByIP);
     g_hash_table_destroy(dns->addressByName);
+    g_hash_table_destroy(dns->hostsRemovedNames);
 
     g_mutex_clear(&(dns->lock));
 
@@ -33,4 +33,9 @@ Address* dns_resolveNameToAddress(DNS* dns, const gchar* name);
  * invalid, a new file is created upon a subsequent call to this function. */
 gchar* dns_getHostsFilePath(DNS* dns);
 
+/* Like dns_getHostsFilePath(), but the file contains a hash table in the
+ * format described in lib/shim/shim_hosts_table.h, so that the shim can map it
+ * and resolve names without parsing it. */
+gchar* dns_getHostsTablePath(DNS* dns);
+
 #endif /* SHD_DNS_H_ */
@@ -0,0 +1,274 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/routing/fluid_flows.h"
+
+#include <math.h>
+
+#include "lib/logger/logger.h"
+#include "main/host/host.h"
+#include "main/host/network_interface.h"
+#include "main/utility/utility.h"
+
+/* shares below this many KiB/s are treated as used up */
+#define FLUID_FLOWS_EPSILON 1e-6
+
+typedef struct _FluidFlowsLink FluidFlowsLink;
+struct _FluidFlowsLink {
+    gdouble capacity;
+    /* while computing the shares */
+    gdouble remaining;
+    guint nGrowing;
+    /* the bandwidth the flows took from the link at the last change we handed out */
+    guint64 lastLoad;
+};
+
+/* each host has an upstream and a downstream link */
+typedef struct _FluidFlowsHost FluidFlowsHost;
+struct _FluidFlowsHost {
+    Host* host;
+    FluidFlowsLink up;
+    FluidFlowsLink down;
+};
+
+typedef struct _FluidFlow FluidFlow;
+struct _FluidFlow {
+    guint sourceIndex;
+    guint destinationIndex;
+    gdouble rate;
+    SimulationTime startTime;
+    SimulationTime stopTime;
+    /* while computing the shares */
+    gdouble share;
+    gboolean isGrowing;
+};
+
+struct _FluidFlows {
+    GArray* flows;
+    GArray* hosts;
+    /* Host* to its index in hosts */
+    GHashTable* hostIndices;
+    MAGIC_DECLARE;
+};
+
+FluidFlows* fluidflows_new(void) {
+    FluidFlows* flows = g_new0(FluidFlows, 1);
+    MAGIC_INIT(flows);
+
+    flows->flows = g_array_new(FALSE, FALSE, sizeof(FluidFlow));
+    flows->hosts = g_array_new(FALSE, FALSE, sizeof(FluidFlowsHost));
+    flows->hostIndices = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    return flows;
+}
+
+void fluidflows_free(FluidFlows* flows) {
+    MAGIC_ASSERT(flows);
+
+    g_array_free(flows->flows, TRUE);
+    g_array_free(flows->hosts, TRUE);
+    g_hash_table_destroy(flows->hostIndices);
+
+    MAGIC_CLEAR(flows);
+    g_free(flows);
+}
+
+static guint _fluidflows_getHostIndex(FluidFlows* flows, Host* host) {
+    gpointer index = NULL;
+    if (g_hash_table_lookup_extended(flows->hostIndices, host, NULL, &index)) {
+        return GPOINTER_TO_UINT(index);
+    }
+
+    /* the hosts are set up by now, so their interfaces know their bandwidth */
+    NetworkInterface* interface = host_lookupInterface(host, host_getDefaultIP(host));
+    utility_assert(interface);
+
+    FluidFlowsHost fluidHost = {
+        .host = host,
+        .up = {.capacity = networkinterface_getSpeedUpKiBps(interface)},
+        .down = {.capacity = networkinterface_getSpeedDownKiBps(interface)},
+    };
+
+    guint newIndex = flows->hosts->len;
+    g_array_append_val(flows->hosts, fluidHost);
+    g_hash_table_insert(flows->hostIndices, host, GUINT_TO_POINTER(newIndex));
+    return newIndex;
+}
+
+void fluidflows_add(FluidFlows* flows, Host* source, Host* destination, guint64 rateKiBps,
+                    SimulationTime startTime, SimulationTime stopTime) {
+    MAGIC_ASSERT(flows);
+    utility_assert(source != destination);
+    utility_assert(stopTime == 0 || stopTime > startTime);
+
+    FluidFlow flow = {
+        .sourceIndex = _fluidflows_getHostIndex(flows, source),
+        .destinationIndex = _fluidflows_getHostIndex(flows, destination),
+        .rate = (gdouble)rateKiBps,
+        .startTime = startTime,
+        .stopTime = stopTime,
+    };
+    g_array_append_val(flows->flows, flow);
+}
+
+guint fluidflows_getNumFlows(FluidFlows* flows) {
+    MAGIC_ASSERT(flows);
+    return flows->flows->len;
+}
+
+static gboolean _fluidflows_isActive(FluidFlow* flow, SimulationTime time) {
+    return flow->startTime <= time && (flow->stopTime == 0 || time < flow->stopTime);
+}
+
+static gboolean _fluidflows_isSaturated(FluidFlowsLink* link) {
+    return link->remaining <= FLUID_FLOWS_EPSILON;
+}
+
+/* Computes the max-min fair share of the flows that are active at the time, by
+ * growing every flow's share at the same pace until it reaches its rate or one of
+ * its links runs out. Each link also grows a share for the host's own packets,
+ * which never reaches a rate. */
+static void _fluidflows_computeShares(FluidFlows* flows, SimulationTime time) {
+    for (guint i = 0; i < flows->hosts->len; i++) {
+        FluidFlowsHost* fluidHost = &g_array_index(flows->hosts, FluidFlowsHost, i);
+        fluidHost->up.remaining = fluidHost->up.capacity;
+        fluidHost->down.remaining = fluidHost->down.capacity;
+    }
+
+    for (guint i = 0; i < flows->flows->len; i++) {
+        FluidFlow* flow = &g_array_index(flows->flows, FluidFlow, i);
+        flow->share = 0;
+        flow->isGrowing = _fluidflows_isActive(flow, time) && flow->rate > 0;
+    }
+
+    while (TRUE) {
+        for (guint i = 0; i < flows->hosts->len; i++) {
+            FluidFlowsHost* fluidHost = &g_array_index(flows->hosts, FluidFlowsHost, i);
+            fluidHost->up.nGrowing = 0;
+            fluidHost->down.nGrowing = 0;
+        }
+
+        /* no flow may grow past its rate */
+        gdouble step = INFINITY;
+        for (guint i = 0; i < flows->flows->len; i++) {
+            FluidFlow* flow = &g_array_index(flows->flows, FluidFlow, i);
+            if (flow->isGrowing) {
+                g_array_index(flows->hosts, FluidFlowsHost, flow->sourceIndex).up.nGrowing++;
+                g_array_index(flows->hosts, FluidFlowsHost, flow->destinationIndex).down.nGrowing++;
+                step = MIN(step, flow->rate - flow->share);
+            }
+        }
+
+        if (isinf(step)) {
+            /* nothing is growing */
+            break;
+        }
+
+        /* and no link may give out more than it has, counting the host's own share */
+        for (guint i = 0; i < flows->hosts->len; i++) {
+            FluidFlowsHost* fluidHost = &g_array_index(flows->hosts, FluidFlowsHost, i);
+            if (fluidHost->up.nGrowing > 0) {
+                step = MIN(step, fluidHost->up.remaining / (fluidHost->up.nGrowing + 1));
+            }
+            if (fluidHost->down.nGrowing > 0) {
+                step = MIN(step, fluidHost->down.remaining / (fluidHost->down.nGrowing + 1));
+            }
+        }
+
+        for (guint i = 0; i < flows->hosts->len; i++) {
+            FluidFlowsHost* fluidHost = &g_array_index(flows->hosts, FluidFlowsHost, i);
+            if (fluidHost->up.nGrowing > 0) {
+                fluidHost->up.remaining -= step * (fluidHost->up.nGrowing + 1);
+            }
+            if (fluidHost->down.nGrowing > 0) {
+                fluidHost->down.remaining -= step * (fluidHost->down.nGrowing + 1);
+            }
+        }
+
+        for (guint i = 0; i < flows->flows->len; i++) {
+            FluidFlow* flow = &g_array_index(flows->flows, FluidFlow, i);
+            if (!flow->isGrowing) {
+                continue;
+            }
+
+            flow->share += step;
+
+            FluidFlowsHost* source =
+                &g_array_index(flows->hosts, FluidFlowsHost, flow->sourceIndex);
+            FluidFlowsHost* destination =
+                &g_array_index(flows->hosts, FluidFlowsHost, flow->destinationIndex);
+            if (flow->rate - flow->share <= FLUID_FLOWS_EPSILON ||
+                _fluidflows_isSaturated(&source->up) ||
+                _fluidflows_isSaturated(&destination->down)) {
+                flow->isGrowing = FALSE;
+            }
+        }
+    }
+}
+
+static gint _fluidflows_compareTimes(gconstpointer a, gconstpointer b) {
+    SimulationTime timeA = *(const SimulationTime*)a;
+    SimulationTime timeB = *(const SimulationTime*)b;
+    return timeA < timeB ? -1 : timeA > timeB ? +1 : 0;
+}
+
+void fluidflows_apply(FluidFlows* flows) {
+    MAGIC_ASSERT(flows);
+
+    /* the shares can only change when a flow starts or stops */
+    GArray* times = g_array_new(FALSE, FALSE, sizeof(SimulationTime));
+    for (guint i = 0; i < flows->flows->len; i++) {
+        FluidFlow* flow = &g_array_index(flows->flows, FluidFlow, i);
+        g_array_append_val(times, flow->startTime);
+        if (flow->stopTime != 0) {
+            g_array_append_val(times, flow->stopTime);
+        }
+    }
+    g_array_sort(times, _fluidflows_compareTimes);
+
+    guint nChanges = 0;
+    for (guint t = 0; t < times->len; t++) {
+        SimulationTime time = g_array_index(times, SimulationTime, t);
+        if (t > 0 && time == g_array_index(times, SimulationTime, t - 1)) {
+            continue;
+        }
+
+        _fluidflows_computeShares(flows, time);
+
+        /* the links add up the shares of their flows */
+        gdouble* upLoads = g_new0(gdouble, flows->hosts->len);
+        gdouble* downLoads = g_new0(gdouble, flows->hosts->len);
+        for (guint i = 0; i < flows->flows->len; i++) {
+            FluidFlow* flow = &g_array_index(flows->flows, FluidFlow, i);
+            upLoads[flow->sourceIndex] += flow->share;
+            downLoads[flow->destinationIndex] += flow->share;
+        }
+
+        for (guint i = 0; i < flows->hosts->len; i++) {
+            FluidFlowsHost* fluidHost = &g_array_index(flows->hosts, FluidFlowsHost, i);
+            guint64 upLoad = (guint64)upLoads[i];
+            guint64 downLoad = (guint64)downLoads[i];
+
+            if (upLoad == fluidHost->up.lastLoad && downLoad == fluidHost->down.lastLoad) {
+                continue;
+            }
+            fluidHost->up.lastLoad = upLoad;
+            fluidHost->down.lastLoad = downLoad;
+
+            NetworkInterface* interface =
+                host_lookupInterface(fluidHost->host, host_getDefaultIP(fluidHost->host));
+            networkinterface_addBackgroundLoad(interface, time, upLoad, downLoad);
+            nChanges++;
+        }
+
+        g_free(upLoads);
+        g_free(downLoads);
+    }
+
+    g_array_free(times, TRUE);
+
+    info("%u background flows change the bandwidth of %u hosts %u times", flows->flows->len,
+         flows->hosts->len, nChanges);
+}
@@ -0,0 +1,36 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_FLUID_FLOWS_H_
+#define SHD_FLUID_FLOWS_H_
+
+#include <glib.h>
+
+#include "main/core/support/definitions.h"
+
+/* A fluid model of aggregate background traffic. Each flow takes a share of the
+ * upstream bandwidth of its source host and the downstream bandwidth of its
+ * destination host, without sending any packets. The shares are max-min fair,
+ * capped at each flow's rate, and each link keeps one fair share back for the
+ * packets of the host's own sockets, so that they see the contention without
+ * ever being starved. The shares only change when flows start or stop, so they
+ * are all computed before the simulation starts, and the hosts' interfaces apply
+ * them to their token buckets at those times. */
+typedef struct _FluidFlows FluidFlows;
+
+FluidFlows* fluidflows_new(void);
+void fluidflows_free(FluidFlows* flows);
+
+/* A stopTime of 0 means that the flow never stops. */
+void fluidflows_add(FluidFlows* flows, Host* source, Host* destination, guint64 rateKiBps,
+                    SimulationTime startTime, SimulationTime stopTime);
+guint fluidflows_getNumFlows(FluidFlows* flows);
+
+/* Computes the shares for every period between flow starts and stops, and hands
+ * the hosts' default interfaces the bandwidth they lose to the flows. Must be
+ * called once, after the hosts are set up and before they boot. */
+void fluidflows_apply(FluidFlows* flows);
+
+#endif /* SHD_FLUID_FLOWS_H_ */
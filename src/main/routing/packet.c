@@ -4,9 +4,9 @@
  * See LICENSE for licensing information
  */
 
-#include <assert.h>
 #include <netinet/in.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "lib/logger/log_level.h"
 #include "lib/logger/logger.h"
@@ -15,23 +15,9 @@
 #include "main/routing/address.h"
 #include "main/routing/packet.h"
 #include "main/routing/payload.h"
+#include "main/utility/object_pool.h"
 #include "main/utility/utility.h"
 
-/* g_memdup() is deprecated due to a security issue and has been replaced
- * by g_memdup2(), but not all of our supported platforms support this yet.
- * https://gitlab.gnome.org/GNOME/glib/-/issues/2319
- */
-
-#ifdef HAS_MEMDUP2
-#define compat_static_g_memdup g_memdup2
-#else
-#define compat_static_g_memdup(mem, byte_size)                                                     \
-    ({                                                                                             \
-        static_assert(byte_size < UINT_MAX, "g_memdup() overflow");                                \
-        g_memdup(mem, byte_size);                                                                  \
-    })
-#endif
-
 /* thread-safe structure representing a data/network packet */
 
 typedef struct _PacketLocalHeader PacketLocalHeader;
@@ -51,19 +37,36 @@ struct _PacketUDPHeader {
     in_port_t destinationPort;
 };
 
-/* packets are guaranteed not to be shared across hosts */
-struct _Packet {
-    guint referenceCount;
+/* the part of a packet that stays the same from hop to hop, which copies of the
+ * packet share until one of them changes it */
+typedef struct _PacketData PacketData;
+struct _PacketData {
+    /* copies of a packet may be held by different hosts, so this is atomic */
+    gint referenceCount;
 
     /* id of the host that created the packet */
     guint hostID;
     /* id of the packet created on the host given by hostID */
     guint64 packetID;
 
+    /* which of the headers is valid, or PNONE if none of them are yet */
     ProtocolType protocol;
-    gpointer header;
+    union {
+        PacketLocalHeader local;
+        PacketUDPHeader udp;
+        PacketTCPHeader tcp;
+    } header;
     Payload* payload;
 
+    MAGIC_DECLARE;
+};
+
+/* packets are guaranteed not to be shared across hosts */
+struct _Packet {
+    guint referenceCount;
+
+    PacketData* data;
+
     /* tracks application priority so we flush packets from the interface to
      * the wire in the order intended by the application. this is used in
      * the default FIFO network interface scheduling discipline.
@@ -72,11 +75,24 @@ struct _Packet {
     gdouble priority;
 
     PacketDeliveryStatusFlags allStatus;
+    /* every status in the order they were added, which we only keep (and allocate)
+     * when logging them at the trace level */
     GQueue* orderedStatus;
 
+    /* the packets following this one if it is a super-packet, or NULL */
+    GPtrArray* segments;
+
+    /* our link in the PacketQueue we are in, if isQueued */
+    Packet* queueNext;
+    gboolean isQueued;
+
     MAGIC_DECLARE;
 };
 
+/* packets are copied for every hop, so reuse their memory */
+static ObjectPool _packetPool = OBJECTPOOL_INIT(Packet);
+static ObjectPool _packetDataPool = OBJECTPOOL_INIT(PacketData);
+
 const gchar* protocol_toString(ProtocolType type) {
     switch (type) {
         case PLOCAL: return "LOCAL";
@@ -86,18 +102,62 @@ const gchar* protocol_toString(ProtocolType type) {
     }
 }
 
+static PacketData* _packetdata_new(void) {
+    PacketData* data = objectpool_alloc0(&_packetDataPool);
+    MAGIC_INIT(data);
+    data->referenceCount = 1;
+    return data;
+}
+
+static void _packetdata_unref(PacketData* data) {
+    MAGIC_ASSERT(data);
+    if (g_atomic_int_dec_and_test(&data->referenceCount)) {
+        if (data->payload) {
+            payload_unref(data->payload);
+        }
+        MAGIC_CLEAR(data);
+        objectpool_free(&_packetDataPool, data);
+    }
+}
+
+/* Returns the packet's data for writing, first giving the packet a copy of its own
+ * if the data is shared with other copies of the packet. */
+static PacketData* _packet_getWritableData(Packet* packet) {
+    PacketData* data = packet->data;
+    MAGIC_ASSERT(data);
+
+    /* if we hold the only reference, nobody else can get one */
+    if (g_atomic_int_get(&data->referenceCount) == 1) {
+        return data;
+    }
+
+    PacketData* copy = _packetdata_new();
+    copy->hostID = data->hostID;
+    copy->packetID = data->packetID;
+    copy->protocol = data->protocol;
+    copy->header = data->header;
+    if (data->payload) {
+        copy->payload = data->payload;
+        payload_ref(copy->payload);
+    }
+
+    _packetdata_unref(data);
+    packet->data = copy;
+    return copy;
+}
+
 Packet* packet_new(Host* host) {
-    Packet* packet = g_new0(Packet, 1);
+    Packet* packet = objectpool_alloc0(&_packetPool);
     MAGIC_INIT(packet);
 
     packet->referenceCount = 1;
 
-    packet->hostID = host_getID(host);
-    packet->packetID = host_getNewPacketID(host);
-
-    packet->orderedStatus = g_queue_new();
+    packet->data = _packetdata_new();
+    packet->data->hostID = host_getID(host);
+    packet->data->packetID = host_getNewPacketID(host);
 
     worker_count_allocation(Packet);
+    worker_addGauge(WORKER_GAUGE_PACKETS, 1);
     return packet;
 }
 
@@ -106,31 +166,62 @@ void packet_setPayload(Packet* packet, Thread* thread, PluginVirtualPtr payload,
     MAGIC_ASSERT(packet);
     utility_assert(thread);
     utility_assert(payload.val);
-    utility_assert(!packet->payload);
+    utility_assert(!packet->data->payload);
 
     /* the payload starts with 1 ref, which we hold */
-    packet->payload = payload_new(thread, payload, payloadLength);
+    _packet_getWritableData(packet)->payload = payload_new(thread, payload, payloadLength);
     /* application data needs a priority ordering for FIFO onto the wire */
     packet->priority = host_getNextPacketPriority(thread_getHost(thread));
 }
 
-/* copy everything except the payload.
- * the payload will point to the same payload as the original packet.
- * the payload is protected so it is safe to send the copied packet to a different host. */
+void packet_setPayloadFromIov(Packet* packet, Thread* thread, const struct iovec* iov,
+                              size_t iovlen, gsize offset, gsize payloadLength) {
+    MAGIC_ASSERT(packet);
+    utility_assert(thread);
+    utility_assert(!packet->data->payload);
+
+    _packet_getWritableData(packet)->payload =
+        payload_newFromIov(thread, iov, iovlen, offset, payloadLength);
+    packet->priority = host_getNextPacketPriority(thread_getHost(thread));
+}
+
+void packet_setPayloadFromShadow(Packet* packet, Host* host, const void* payload,
+                                 gsize payloadLength) {
+    MAGIC_ASSERT(packet);
+    utility_assert(host);
+    utility_assert(payload);
+    utility_assert(!packet->data->payload);
+
+    _packet_getWritableData(packet)->payload = payload_newFromShadow(payload, payloadLength);
+    packet->priority = host_getNextPacketPriority(host);
+}
+
+void packet_setPayloadSlice(Packet* packet, Host* host, Payload* payload, gsize offset,
+                            gsize payloadLength) {
+    MAGIC_ASSERT(packet);
+    utility_assert(host);
+    utility_assert(payload);
+    utility_assert(!packet->data->payload);
+
+    _packet_getWritableData(packet)->payload = payload_newSlice(payload, offset, payloadLength);
+    packet->priority = host_getNextPacketPriority(host);
+}
+
+/* copy everything except the segments.
+ * the copy shares the original's header and payload until either of them changes
+ * its header, so it is safe to send the copied packet to a different host. */
 Packet* packet_copy(Packet* packet) {
     MAGIC_ASSERT(packet);
 
-    Packet* copy = g_new0(Packet, 1);
+    Packet* copy = objectpool_alloc0(&_packetPool);
     MAGIC_INIT(copy);
 
     copy->referenceCount = 1;
 
-    copy->hostID = packet->hostID;
-    copy->packetID = packet->packetID;
+    copy->data = packet->data;
+    g_atomic_int_inc(&copy->data->referenceCount);
 
-    if(packet->payload) {
-        copy->payload = packet->payload;
-        payload_ref(packet->payload);
+    if(packet->data->payload) {
         copy->priority = packet->priority;
     }
 
@@ -141,69 +232,28 @@ Packet* packet_copy(Packet* packet) {
         copy->orderedStatus = g_queue_copy(packet->orderedStatus);
     }
 
-    copy->protocol = packet->protocol;
-    if(packet->header) {
-        switch (packet->protocol) {
-            case PLOCAL: {
-                copy->header = compat_static_g_memdup(packet->header, sizeof(PacketLocalHeader));
-                break;
-            }
-
-            case PUDP: {
-                copy->header = compat_static_g_memdup(packet->header, sizeof(PacketUDPHeader));
-                break;
-            }
-
-            case PTCP: {
-                copy->header = compat_static_g_memdup(packet->header, sizeof(PacketTCPHeader));
-
-                PacketTCPHeader* packetHeader = (PacketTCPHeader*)packet->header;
-                PacketTCPHeader* copyHeader = (PacketTCPHeader*)copy->header;
-
-                copyHeader->selectiveACKs = NULL;
-
-                if(packetHeader->selectiveACKs) {
-                    /* g_list_copy is shallow, but we store integers in the data pointers, so its OK here */
-                    copyHeader->selectiveACKs = g_list_copy(packetHeader->selectiveACKs);
-                }
-                break;
-            }
-
-            default: {
-                utility_panic("unrecognized protocol");
-                break;
-            }
-        }
-    }
-
     worker_count_allocation(Packet);
+    worker_addGauge(WORKER_GAUGE_PACKETS, 1);
     return copy;
 }
 
 static void _packet_free(Packet* packet) {
     MAGIC_ASSERT(packet);
+    utility_assert(!packet->isQueued);
 
-    if(packet->protocol == PTCP) {
-        PacketTCPHeader* header = (PacketTCPHeader*)packet->header;
-        if(header->selectiveACKs) {
-            g_list_free(header->selectiveACKs);
-        }
-    }
-
-    if(packet->header) {
-        g_free(packet->header);
-    }
-    if(packet->payload) {
-        payload_unref(packet->payload);
-    }
+    _packetdata_unref(packet->data);
     if(packet->orderedStatus) {
         g_queue_free(packet->orderedStatus);
     }
+    if(packet->segments) {
+        g_ptr_array_unref(packet->segments);
+    }
 
     MAGIC_CLEAR(packet);
-    g_free(packet);
+    objectpool_free(&_packetPool, packet);
 
     worker_count_deallocation(Packet);
+    worker_addGauge(WORKER_GAUGE_PACKETS, -1);
 }
 
 void packet_ref(Packet* packet) {
@@ -220,6 +270,108 @@ void packet_unref(Packet* packet) {
     }
 }
 
+void packetqueue_push(PacketQueue* queue, Packet* packet) {
+    utility_assert(queue);
+    MAGIC_ASSERT(packet);
+    utility_assert(!packet->isQueued);
+
+    packet->isQueued = TRUE;
+    packet->queueNext = NULL;
+    if (queue->tail) {
+        queue->tail->queueNext = packet;
+    } else {
+        queue->head = packet;
+    }
+    queue->tail = packet;
+    queue->length++;
+}
+
+Packet* packetqueue_pop(PacketQueue* queue) {
+    utility_assert(queue);
+
+    Packet* packet = queue->head;
+    if (!packet) {
+        return NULL;
+    }
+
+    queue->head = packet->queueNext;
+    if (!queue->head) {
+        queue->tail = NULL;
+    }
+    queue->length--;
+
+    packet->queueNext = NULL;
+    packet->isQueued = FALSE;
+    return packet;
+}
+
+Packet* packetqueue_peek(const PacketQueue* queue) {
+    utility_assert(queue);
+    return queue->head;
+}
+
+gboolean packetqueue_isEmpty(const PacketQueue* queue) {
+    utility_assert(queue);
+    return queue->head == NULL;
+}
+
+void packetqueue_clear(PacketQueue* queue) {
+    Packet* packet = NULL;
+    while ((packet = packetqueue_pop(queue)) != NULL) {
+        packet_unref(packet);
+    }
+}
+
+gboolean packet_isQueued(const Packet* packet) {
+    MAGIC_ASSERT(packet);
+    return packet->isQueued;
+}
+
+void packet_appendSegment(Packet* packet, Packet* segment) {
+    MAGIC_ASSERT(packet);
+    MAGIC_ASSERT(segment);
+    utility_assert(packet != segment);
+    utility_assert(!segment->segments);
+
+    if(!packet->segments) {
+        packet->segments = g_ptr_array_new_with_free_func(packet_unrefTaskFreeFunc);
+    }
+
+    packet_ref(segment);
+    g_ptr_array_add(packet->segments, segment);
+}
+
+guint packet_getNumSegments(const Packet* packet) {
+    MAGIC_ASSERT(packet);
+    return 1 + (packet->segments ? packet->segments->len : 0);
+}
+
+Packet* packet_getSegment(Packet* packet, guint index) {
+    MAGIC_ASSERT(packet);
+    if(index == 0) {
+        return packet;
+    }
+    utility_assert(packet->segments && index <= packet->segments->len);
+    return g_ptr_array_index(packet->segments, index - 1);
+}
+
+void packet_stealSegments(Packet* packet, GQueue* queue) {
+    MAGIC_ASSERT(packet);
+    utility_assert(queue);
+
+    if(!packet->segments) {
+        return;
+    }
+
+    /* the queue takes over our references */
+    for(guint i = 0; i < packet->segments->len; i++) {
+        g_queue_push_tail(queue, g_ptr_array_index(packet->segments, i));
+    }
+    g_ptr_array_set_free_func(packet->segments, NULL);
+    g_ptr_array_unref(packet->segments);
+    packet->segments = NULL;
+}
+
 void packet_setPriority(Packet *packet, double value) {
    packet->priority = value;
 }
@@ -232,11 +384,11 @@ gint packet_compareTCPSequence(Packet* packet1, Packet* packet2, gpointer user_d
      * at once or a deadlock will occur */
     guint sequence1 = 0, sequence2 = 0;
 
-    utility_assert(packet1->protocol == PTCP);
-    sequence1 = ((PacketTCPHeader*)(packet1->header))->sequence;
+    utility_assert(packet1->data->protocol == PTCP);
+    sequence1 = packet1->data->header.tcp.sequence;
 
-    utility_assert(packet2->protocol == PTCP);
-    sequence2 = ((PacketTCPHeader*)(packet2->header))->sequence;
+    utility_assert(packet2->data->protocol == PTCP);
+    sequence2 = packet2->data->header.tcp.sequence;
 
     return sequence1 < sequence2 ? -1 : sequence1 > sequence2 ? 1 : 0;
 }
@@ -244,28 +396,29 @@ gint packet_compareTCPSequence(Packet* packet1, Packet* packet2, gpointer user_d
 void packet_setLocal(Packet* packet, enum ProtocolLocalFlags flags,
         gint sourceDescriptorHandle, gint destinationDescriptorHandle, in_port_t port) {
     MAGIC_ASSERT(packet);
-    utility_assert(!(packet->header) && packet->protocol == PNONE);
+    utility_assert(packet->data->protocol == PNONE);
     utility_assert(port > 0);
 
-    PacketLocalHeader* header = g_new0(PacketLocalHeader, 1);
+    PacketData* data = _packet_getWritableData(packet);
+    PacketLocalHeader* header = &data->header.local;
 
     header->flags = flags;
     header->sourceDescriptorHandle = sourceDescriptorHandle;
     header->destinationDescriptorHandle = destinationDescriptorHandle;
     header->port = port;
 
-    packet->header = header;
-    packet->protocol = PLOCAL;
+    data->protocol = PLOCAL;
 }
 
 void packet_setUDP(Packet* packet, enum ProtocolUDPFlags flags,
         in_addr_t sourceIP, in_port_t sourcePort,
         in_addr_t destinationIP, in_port_t destinationPort) {
     MAGIC_ASSERT(packet);
-    utility_assert(!(packet->header) && packet->protocol == PNONE);
+    utility_assert(packet->data->protocol == PNONE);
     utility_assert(sourceIP && sourcePort && destinationIP && destinationPort);
 
-    PacketUDPHeader* header = g_new0(PacketUDPHeader, 1);
+    PacketData* data = _packet_getWritableData(packet);
+    PacketUDPHeader* header = &data->header.udp;
 
     header->flags = flags;
     header->sourceIP = sourceIP;
@@ -273,18 +426,18 @@ void packet_setUDP(Packet* packet, enum ProtocolUDPFlags flags,
     header->destinationIP = destinationIP;
     header->destinationPort = destinationPort;
 
-    packet->header = header;
-    packet->protocol = PUDP;
+    data->protocol = PUDP;
 }
 
 void packet_setTCP(Packet* packet, enum ProtocolTCPFlags flags,
         in_addr_t sourceIP, in_port_t sourcePort,
         in_addr_t destinationIP, in_port_t destinationPort, guint sequence) {
     MAGIC_ASSERT(packet);
-    utility_assert(!(packet->header) && packet->protocol == PNONE);
+    utility_assert(packet->data->protocol == PNONE);
     utility_assert(sourceIP && sourcePort && destinationIP && destinationPort);
 
-    PacketTCPHeader* header = g_new0(PacketTCPHeader, 1);
+    PacketData* data = _packet_getWritableData(packet);
+    PacketTCPHeader* header = &data->header.tcp;
 
     header->flags = flags;
     header->sourceIP = sourceIP;
@@ -293,27 +446,27 @@ void packet_setTCP(Packet* packet, enum ProtocolTCPFlags flags,
     header->destinationPort = destinationPort;
     header->sequence = sequence;
 
-    packet->header = header;
-    packet->protocol = PTCP;
+    data->protocol = PTCP;
 }
 
-void packet_updateTCP(Packet* packet, guint acknowledgement, GList* selectiveACKs,
-        guint window, SimulationTime timestampValue, SimulationTime timestampEcho) {
+void packet_updateTCP(Packet* packet, guint acknowledgement,
+        const PacketTCPSackBlock* selectiveACKs, guint nSelectiveACKs, guint window,
+        SimulationTime timestampValue, SimulationTime timestampEcho) {
     MAGIC_ASSERT(packet);
-    utility_assert(packet->header && (packet->protocol == PTCP));
+    utility_assert(packet->data->protocol == PTCP);
 
-    PacketTCPHeader* header = (PacketTCPHeader*) packet->header;
+    PacketData* data = _packet_getWritableData(packet);
+    PacketTCPHeader* header = &data->header.tcp;
 
-    if(selectiveACKs && g_list_length(selectiveACKs) > 0) {
-        /* free the old ack list if it exists */
-        if(header->selectiveACKs != NULL) {
-            g_list_free(header->selectiveACKs);
-            header->selectiveACKs = NULL;
-        }
+    if(selectiveACKs && nSelectiveACKs > 0) {
+        /* keep the lowest blocks, they are the ones the sender needs to fill the holes
+         * closest to the cumulative ack */
+        nSelectiveACKs = MIN(nSelectiveACKs, PACKET_TCP_MAX_SACK_BLOCKS);
 
-        /* set the new sacks */
+        /* set the new sacks, replacing the old ones */
         header->flags |= PTCP_SACK;
-        header->selectiveACKs = g_list_copy(selectiveACKs);
+        memcpy(header->selectiveACKs, selectiveACKs, nSelectiveACKs * sizeof(PacketTCPSackBlock));
+        header->nSelectiveACKs = nSelectiveACKs;
     }
 
     header->acknowledgment = acknowledgement;
@@ -324,8 +477,8 @@ void packet_updateTCP(Packet* packet, guint acknowledgement, GList* selectiveACK
 
 guint packet_getPayloadLength(const Packet* packet) {
     MAGIC_ASSERT(packet);
-    if(packet->payload) {
-        return (guint)payload_getLength(packet->payload);
+    if(packet->data->payload) {
+        return (guint)payload_getLength(packet->data->payload);
     } else {
         return 0;
     }
@@ -338,8 +491,21 @@ gdouble packet_getPriority(const Packet* packet) {
 
 guint packet_getHeaderSize(Packet* packet) {
     MAGIC_ASSERT(packet);
-    guint size = packet->protocol == PUDP ? CONFIG_HEADER_SIZE_UDPIPETH :
-            packet->protocol == PTCP ? CONFIG_HEADER_SIZE_TCPIPETH : 0;
+    guint size = packet->data->protocol == PUDP ? CONFIG_HEADER_SIZE_UDPIPETH :
+            packet->data->protocol == PTCP ? CONFIG_HEADER_SIZE_TCPIPETH : 0;
+    return size;
+}
+
+guint64 packet_getTotalSize(Packet* packet) {
+    MAGIC_ASSERT(packet);
+
+    guint64 size = 0;
+    guint n = packet_getNumSegments(packet);
+    for(guint i = 0; i < n; i++) {
+        Packet* segment = packet_getSegment(packet, i);
+        size += (guint64)(packet_getPayloadLength(segment) + packet_getHeaderSize(segment));
+    }
+
     return size;
 }
 
@@ -347,20 +513,20 @@ in_addr_t packet_getDestinationIP(Packet* packet) {
     MAGIC_ASSERT(packet);
     in_addr_t ip = 0;
 
-    switch (packet->protocol) {
+    switch (packet->data->protocol) {
         case PLOCAL: {
             ip = htonl(INADDR_LOOPBACK);
             break;
         }
 
         case PUDP: {
-            PacketUDPHeader* header = packet->header;
+            PacketUDPHeader* header = &packet->data->header.udp;
             ip = header->destinationIP;
             break;
         }
 
         case PTCP: {
-            PacketTCPHeader* header = packet->header;
+            PacketTCPHeader* header = &packet->data->header.tcp;
             ip = header->destinationIP;
             break;
         }
@@ -379,21 +545,21 @@ in_port_t packet_getDestinationPort(Packet* packet) {
 
     in_port_t port = 0;
 
-    switch (packet->protocol) {
+    switch (packet->data->protocol) {
         case PLOCAL: {
-            PacketLocalHeader* header = packet->header;
+            PacketLocalHeader* header = &packet->data->header.local;
             port = header->port;
             break;
         }
 
         case PUDP: {
-            PacketUDPHeader* header = packet->header;
+            PacketUDPHeader* header = &packet->data->header.udp;
             port = header->destinationPort;
             break;
         }
 
         case PTCP: {
-            PacketTCPHeader* header = packet->header;
+            PacketTCPHeader* header = &packet->data->header.tcp;
             port = header->destinationPort;
             break;
         }
@@ -412,20 +578,20 @@ in_addr_t packet_getSourceIP(Packet* packet) {
 
     in_addr_t ip = 0;
 
-    switch (packet->protocol) {
+    switch (packet->data->protocol) {
         case PLOCAL: {
             ip = htonl(INADDR_LOOPBACK);
             break;
         }
 
         case PUDP: {
-            PacketUDPHeader* header = packet->header;
+            PacketUDPHeader* header = &packet->data->header.udp;
             ip = header->sourceIP;
             break;
         }
 
         case PTCP: {
-            PacketTCPHeader* header = packet->header;
+            PacketTCPHeader* header = &packet->data->header.tcp;
             ip = header->sourceIP;
             break;
         }
@@ -444,21 +610,21 @@ in_port_t packet_getSourcePort(Packet* packet) {
 
     in_port_t port = 0;
 
-    switch (packet->protocol) {
+    switch (packet->data->protocol) {
         case PLOCAL: {
-            PacketLocalHeader* header = packet->header;
+            PacketLocalHeader* header = &packet->data->header.local;
             port = header->port;
             break;
         }
 
         case PUDP: {
-            PacketUDPHeader* header = packet->header;
+            PacketUDPHeader* header = &packet->data->header.udp;
             port = header->sourcePort;
             break;
         }
 
         case PTCP: {
-            PacketTCPHeader* header = packet->header;
+            PacketTCPHeader* header = &packet->data->header.tcp;
             port = header->sourcePort;
             break;
         }
@@ -474,51 +640,46 @@ in_port_t packet_getSourcePort(Packet* packet) {
 
 ProtocolType packet_getProtocol(Packet* packet) {
     MAGIC_ASSERT(packet);
-    return packet->protocol;
+    return packet->data->protocol;
 }
 
 gssize packet_copyPayload(const Packet* packet, Thread* thread, gsize payloadOffset,
                           PluginVirtualPtr buffer, gsize bufferLength) {
     MAGIC_ASSERT(packet);
 
-    if(packet->payload) {
-        return payload_getData(packet->payload, thread, payloadOffset, buffer, bufferLength);
+    if(packet->data->payload) {
+        return payload_getData(packet->data->payload, thread, payloadOffset, buffer, bufferLength);
     } else {
         return 0;
     }
 }
 
-guint packet_copyPayloadShadow(Packet* packet, gsize payloadOffset, void* buffer,
-                               gsize bufferLength) {
+gssize packet_copyPayloadIov(const Packet* packet, Thread* thread, gsize payloadOffset,
+                             const struct iovec* iov, size_t iovlen) {
     MAGIC_ASSERT(packet);
 
-    if (packet->payload) {
-        return payload_getDataShadow(packet->payload, payloadOffset, buffer, bufferLength);
+    if (packet->data->payload) {
+        return payload_getDataIov(packet->data->payload, thread, payloadOffset, iov, iovlen);
     } else {
         return 0;
     }
 }
 
-GList* packet_copyTCPSelectiveACKs(Packet* packet) {
+guint packet_copyPayloadShadow(Packet* packet, gsize payloadOffset, void* buffer,
+                               gsize bufferLength) {
     MAGIC_ASSERT(packet);
-    utility_assert(packet->protocol == PTCP);
 
-    PacketTCPHeader* packetHeader = (PacketTCPHeader*)packet->header;
-
-    /* make sure to do a deep copy of all pointers to avoid concurrency issues */
-    GList* selectiveACKsCopy = NULL;
-    if(packetHeader->selectiveACKs) {
-        /* g_list_copy is shallow, but we store integers in the data pointers, so its OK here */
-        selectiveACKsCopy = g_list_copy(packetHeader->selectiveACKs);
+    if (packet->data->payload) {
+        return payload_getDataShadow(packet->data->payload, payloadOffset, buffer, bufferLength);
+    } else {
+        return 0;
     }
-
-    return selectiveACKsCopy;
 }
 
-PacketTCPHeader* packet_getTCPHeader(Packet* packet) {
+const PacketTCPHeader* packet_getTCPHeader(Packet* packet) {
     MAGIC_ASSERT(packet);
-    utility_assert(packet->protocol == PTCP);
-    return (PacketTCPHeader*)packet->header;
+    utility_assert(packet->data->protocol == PTCP);
+    return &packet->data->header.tcp;
 }
 
 static const gchar* _packet_deliveryStatusToAscii(PacketDeliveryStatusFlags status) {
@@ -553,13 +714,13 @@ gchar* packet_toString(Packet* packet) {
     GString* packetString = g_string_new("");
 
     g_string_append_printf(packetString, "packetID=%u:%"G_GUINT64_FORMAT" ",
-            packet->hostID, packet->packetID);
+            packet->data->hostID, packet->data->packetID);
 
-    guint payloadLength = (packet->payload) ? (guint)payload_getLength(packet->payload) : 0;
+    guint payloadLength = (packet->data->payload) ? (guint)payload_getLength(packet->data->payload) : 0;
 
-    switch (packet->protocol) {
+    switch (packet->data->protocol) {
         case PLOCAL: {
-            PacketLocalHeader* header = packet->header;
+            PacketLocalHeader* header = &packet->data->header.local;
             g_string_append_printf(packetString, "%i -> %i bytes=%u",
                     header->sourceDescriptorHandle, header->destinationDescriptorHandle,
                     payloadLength);
@@ -567,7 +728,7 @@ gchar* packet_toString(Packet* packet) {
         }
 
         case PUDP: {
-            PacketUDPHeader* header = packet->header;
+            PacketUDPHeader* header = &packet->data->header.udp;
             gchar* sourceIPString = address_ipToNewString(header->sourceIP);
             gchar* destinationIPString = address_ipToNewString(header->destinationIP);
 
@@ -583,7 +744,7 @@ gchar* packet_toString(Packet* packet) {
         }
 
         case PTCP: {
-            PacketTCPHeader* header = packet->header;
+            PacketTCPHeader* header = &packet->data->header.tcp;
             gchar* sourceIPString = address_ipToNewString(header->sourceIP);
             gchar* destinationIPString = address_ipToNewString(header->destinationIP);
 
@@ -593,26 +754,17 @@ gchar* packet_toString(Packet* packet) {
                     destinationIPString, ntohs(header->destinationPort),
                     header->sequence, header->acknowledgment);
 
-            // Instead of printing out entire list of SACK, print out ranges to save space
-            gint firstSack = -1;
-            gint lastSack = -1;
-            for(GList *iter = header->selectiveACKs; iter; iter = g_list_next(iter)) {
-                gint seq = GPOINTER_TO_INT(iter->data);
-                if(firstSack == -1) {
-                    firstSack = seq;
-                } else if(lastSack == -1 || seq == lastSack + 1) {
-                    lastSack = seq;
-                } else {
-                    g_string_append_printf(packetString, "%d-%d ", firstSack, lastSack);
-                    firstSack = seq;
-                    lastSack = -1;
-                }
-            }
-
-            if(firstSack != -1) {
-                g_string_append_printf(packetString, "%d", firstSack);
-                if(lastSack != -1) {
-                    g_string_append_printf(packetString,"-%d", lastSack);
+            if(header->nSelectiveACKs > 0) {
+                for(guint i = 0; i < header->nSelectiveACKs; i++) {
+                    const PacketTCPSackBlock* block = &header->selectiveACKs[i];
+                    if(i > 0) {
+                        g_string_append_printf(packetString, " ");
+                    }
+                    /* print the inclusive range to match the sequence numbers */
+                    g_string_append_printf(packetString, "%u", block->begin);
+                    if(block->end - block->begin > 1) {
+                        g_string_append_printf(packetString, "-%u", block->end - 1);
+                    }
                 }
             } else {
                 g_string_append_printf(packetString, "NA");
@@ -653,7 +805,7 @@ gchar* packet_toString(Packet* packet) {
         }
     }
     
-    guint statusLength = g_queue_get_length(packet->orderedStatus);
+    guint statusLength = packet->orderedStatus ? g_queue_get_length(packet->orderedStatus) : 0;
     if(statusLength > 0) {
         g_string_append_printf(packetString, " status=");
     }
@@ -684,6 +836,9 @@ void packet_addDeliveryStatus(Packet* packet, PacketDeliveryStatusFlags status)
 
     gboolean skipDebug = worker_isFiltered(LOGLEVEL_TRACE);
     if(!skipDebug) {
+        if(!packet->orderedStatus) {
+            packet->orderedStatus = g_queue_new();
+        }
         g_queue_push_tail(packet->orderedStatus, GUINT_TO_POINTER(status));
         gchar* packetStr = packet_toString(packet);
         info("[%s] %s", _packet_deliveryStatusToAscii(status), packetStr);
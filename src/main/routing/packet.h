@@ -9,6 +9,7 @@
 
 #include <glib.h>
 #include <netinet/in.h>
+#include <sys/uio.h>
 
 #include "main/routing/packet.minimal.h"
 
@@ -16,6 +17,17 @@
 #include "main/host/protocol.h"
 #include "main/host/syscall_types.h"
 #include "main/host/thread.h"
+#include "main/routing/payload.h"
+
+/* The most selective ACK blocks that a TCP header will carry. */
+#define PACKET_TCP_MAX_SACK_BLOCKS 8
+
+/* A block of selectively acknowledged sequence numbers [begin, end). */
+typedef struct _PacketTCPSackBlock PacketTCPSackBlock;
+struct _PacketTCPSackBlock {
+    guint begin;
+    guint end;
+};
 
 typedef struct _PacketTCPHeader PacketTCPHeader;
 struct _PacketTCPHeader {
@@ -26,7 +38,9 @@ struct _PacketTCPHeader {
     in_port_t destinationPort;
     guint sequence;
     guint acknowledgment;
-    GList* selectiveACKs;
+    /* sorted in increasing order and never overlapping */
+    PacketTCPSackBlock selectiveACKs[PACKET_TCP_MAX_SACK_BLOCKS];
+    guint nSelectiveACKs;
     guint window;
     SimulationTime timestampValue;
     SimulationTime timestampEcho;
@@ -37,8 +51,44 @@ const gchar* protocol_toString(ProtocolType type);
 Packet* packet_new(Host* host);
 void packet_setPayload(Packet* packet, Thread* thread, PluginVirtualPtr payload,
                        gsize payloadLength);
+/* Like packet_setPayload, for data that is already in Shadow's memory. */
+void packet_setPayloadFromShadow(Packet* packet, Host* host, const void* payload,
+                                 gsize payloadLength);
+/* Like packet_setPayload, but the payload is a slice of the payloadLength bytes
+ * starting at offset into an existing payload, which is not copied. */
+void packet_setPayloadSlice(Packet* packet, Host* host, Payload* payload, gsize offset,
+                            gsize payloadLength);
+/* Like packet_setPayload, gathering payloadLength bytes starting at offset into
+ * the plugin's buffers described by iov. */
+void packet_setPayloadFromIov(Packet* packet, Thread* thread, const struct iovec* iov,
+                              size_t iovlen, gsize offset, gsize payloadLength);
 Packet* packet_copy(Packet* packet);
 
+/* A super-packet is a packet that carries the packets that followed it out of
+ * the same socket, so that they travel through the interfaces and routers as a
+ * single unit. Each segment remains a complete packet with its own headers, and
+ * the receiving interface splits them up again before handing them to the
+ * socket. A segment can't itself carry segments. */
+void packet_appendSegment(Packet* packet, Packet* segment);
+/* The number of packets in the super-packet, including this one. */
+guint packet_getNumSegments(const Packet* packet);
+/* Index 0 is the packet itself. */
+Packet* packet_getSegment(Packet* packet, guint index);
+/* Moves the references to the segments following this packet onto the tail of
+ * the queue, leaving this packet as a regular packet. */
+void packet_stealSegments(Packet* packet, GQueue* queue);
+
+/* Adds the packet to the tail, taking over the caller's reference to it. */
+void packetqueue_push(PacketQueue* queue, Packet* packet);
+/* Removes the head and returns the queue's reference to it, or NULL if empty. */
+Packet* packetqueue_pop(PacketQueue* queue);
+Packet* packetqueue_peek(const PacketQueue* queue);
+gboolean packetqueue_isEmpty(const PacketQueue* queue);
+/* Removes and unrefs every packet. */
+void packetqueue_clear(PacketQueue* queue);
+/* TRUE if the packet is in a PacketQueue. */
+gboolean packet_isQueued(const Packet* packet);
+
 void packet_ref(Packet* packet);
 void packet_unref(Packet* packet);
 static inline void packet_unrefTaskFreeFunc(gpointer packet) { packet_unref(packet); }
@@ -54,12 +104,14 @@ void packet_setTCP(Packet* packet, enum ProtocolTCPFlags flags,
         in_addr_t sourceIP, in_port_t sourcePort,
         in_addr_t destinationIP, in_port_t destinationPort, guint sequence);
 
-void packet_updateTCP(Packet* packet, guint acknowledgement, GList* selectiveACKs,
-        guint window, SimulationTime timestampValue, SimulationTime timestampEcho);
+void packet_updateTCP(Packet* packet, guint acknowledgement,
+        const PacketTCPSackBlock* selectiveACKs, guint nSelectiveACKs, guint window, SimulationTime timestampValue, SimulationTime timestampEcho);
 
 guint packet_getPayloadLength(const Packet* packet);
 gdouble packet_getPriority(const Packet* packet);
 guint packet_getHeaderSize(Packet* packet);
+/* Header and payload bytes of this packet and all of its segments. */
+guint64 packet_getTotalSize(Packet* packet);
 
 in_addr_t packet_getDestinationIP(Packet* packet);
 in_port_t packet_getDestinationPort(Packet* packet);
@@ -69,10 +121,13 @@ ProtocolType packet_getProtocol(Packet* packet);
 
 gssize packet_copyPayload(const Packet* packet, Thread* thread, gsize payloadOffset,
                           PluginVirtualPtr buffer, gsize bufferLength);
+/* Like packet_copyPayload, scattering the payload across the plugin's buffers
+ * described by iov. */
+gssize packet_copyPayloadIov(const Packet* packet, Thread* thread, gsize payloadOffset,
+                             const struct iovec* iov, size_t iovlen);
 guint packet_copyPayloadShadow(Packet* packet, gsize payloadOffset, void* buffer,
                                gsize bufferLength);
-GList* packet_copyTCPSelectiveACKs(Packet* packet);
-PacketTCPHeader* packet_getTCPHeader(Packet* packet);
+const PacketTCPHeader* packet_getTCPHeader(Packet* packet);
 gint packet_compareTCPSequence(Packet* packet1, Packet* packet2, gpointer user_data);
 
 void packet_addDeliveryStatus(Packet* packet, PacketDeliveryStatusFlags status);
@@ -7,6 +7,8 @@
 #ifndef SHD_PACKET_MINIMAL_H_
 #define SHD_PACKET_MINIMAL_H_
 
+#include <stddef.h>
+
 typedef struct _Packet Packet;
 
 typedef enum _PacketDeliveryStatusFlags PacketDeliveryStatusFlags;
@@ -36,4 +38,17 @@ enum _PacketDeliveryStatusFlags {
 
 typedef struct _PacketTCPHeader PacketTCPHeader;
 
+/* A FIFO of packets that is linked through the packets themselves, so that
+ * queueing never allocates. A packet can be in only one PacketQueue at a time,
+ * and the queue holds a reference to each of its packets. */
+typedef struct _PacketQueue PacketQueue;
+struct _PacketQueue {
+    Packet* head;
+    Packet* tail;
+    unsigned int length;
+};
+
+#define PACKET_QUEUE_INIT                                                                          \
+    { NULL, NULL, 0 }
+
 #endif
\ No newline at end of file
@@ -54,9 +54,20 @@ gdouble path_getReliability(Path* path) {
     return path->reliability;
 }
 
-void path_incrementPacketCount(Path* path) {
+void path_update(Path* path, gdouble latency, gdouble reliability) {
     MAGIC_ASSERT(path);
-    path->packetCount++;
+    path->latency = latency;
+    path->reliability = reliability;
+}
+
+void path_addPacketCount(Path* path, guint64 count) {
+    MAGIC_ASSERT(path);
+    __atomic_fetch_add(&path->packetCount, count, __ATOMIC_RELAXED);
+}
+
+guint64 path_getPacketCount(Path* path) {
+    MAGIC_ASSERT(path);
+    return __atomic_load_n(&path->packetCount, __ATOMIC_RELAXED);
 }
 
 gchar* path_toString(Path* path) {
@@ -16,8 +16,12 @@ void path_free(Path* path);
 
 gdouble path_getLatency(Path* path);
 gdouble path_getReliability(Path* path);
+/* changes the path's properties when the network graph changes, keeping its packet count */
+void path_update(Path* path, gdouble latency, gdouble reliability);
 
-void path_incrementPacketCount(Path* path);
+/* safe to call concurrently from any number of threads */
+void path_addPacketCount(Path* path, guint64 count);
+guint64 path_getPacketCount(Path* path);
 
 gchar* path_toString(Path* path);
 
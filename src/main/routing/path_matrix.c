@@ -0,0 +1,294 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/routing/path_matrix.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lib/logger/logger.h"
+#include "main/utility/utility.h"
+
+#define PATHMATRIX_FILE_MAGIC "SHDPATHS"
+#define PATHMATRIX_FILE_VERSION 1
+
+/* the file holds this header, followed by the nVertices graph vertex indices,
+ * then the nVertices x nVertices latency and reliability tables */
+typedef struct _PathMatrixFileHeader PathMatrixFileHeader;
+struct _PathMatrixFileHeader {
+    gchar magic[8];
+    guint32 version;
+    guint32 nVertices;
+    gint64 nGraphVertices;
+};
+
+struct _PathMatrix {
+    /* maps a graph vertex index to its row and column in the matrix, or -1 */
+    gint* positions;
+    gint64 nGraphVertices;
+
+    /* maps a row or column back to the graph vertex index */
+    gint64* vertexIndices;
+    guint nVertices;
+
+    /* nVertices x nVertices tables in row-major order, indexed by [src][dst].
+     * floats keep the tables small enough to stay in cache for a few thousand
+     * vertices. a negative latency marks a path that has not been set. */
+    gfloat* latencies;
+    gfloat* reliabilities;
+    guint64* packetCounts;
+
+    /* if the matrix was loaded from a file, the tables point into its read-only mapping,
+     * so that simulations that run at the same time from the same file share one copy of
+     * them in the page cache */
+    GMappedFile* mappedFile;
+
+    MAGIC_DECLARE;
+};
+
+/* Returns a matrix whose latency and reliability tables are not allocated yet. */
+static PathMatrix* _pathmatrix_newWithoutTables(gint64 nGraphVertices,
+                                                const gint64* vertexIndices, guint nVertices) {
+    utility_assert(nGraphVertices >= 0);
+    utility_assert(vertexIndices || nVertices == 0);
+
+    PathMatrix* matrix = g_new0(PathMatrix, 1);
+    MAGIC_INIT(matrix);
+
+    matrix->nGraphVertices = nGraphVertices;
+    matrix->positions = g_new(gint, MAX(nGraphVertices, 1));
+    for (gint64 i = 0; i < nGraphVertices; i++) {
+        matrix->positions[i] = -1;
+    }
+
+    matrix->nVertices = nVertices;
+    matrix->vertexIndices = g_new(gint64, MAX(nVertices, 1));
+    for (guint i = 0; i < nVertices; i++) {
+        utility_assert(vertexIndices[i] >= 0 && vertexIndices[i] < nGraphVertices);
+        matrix->vertexIndices[i] = vertexIndices[i];
+        matrix->positions[vertexIndices[i]] = (gint)i;
+    }
+
+    gsize nEntries = MAX((gsize)nVertices * (gsize)nVertices, 1);
+    matrix->packetCounts = g_new0(guint64, nEntries);
+
+    return matrix;
+}
+
+PathMatrix* pathmatrix_new(gint64 nGraphVertices, const gint64* vertexIndices, guint nVertices) {
+    PathMatrix* matrix = _pathmatrix_newWithoutTables(nGraphVertices, vertexIndices, nVertices);
+
+    gsize nEntries = MAX((gsize)nVertices * (gsize)nVertices, 1);
+    matrix->latencies = g_new(gfloat, nEntries);
+    matrix->reliabilities = g_new0(gfloat, nEntries);
+    for (gsize i = 0; i < nEntries; i++) {
+        matrix->latencies[i] = -1.0f;
+    }
+
+    return matrix;
+}
+
+void pathmatrix_free(PathMatrix* matrix) {
+    MAGIC_ASSERT(matrix);
+
+    g_free(matrix->positions);
+    g_free(matrix->vertexIndices);
+    if (matrix->mappedFile) {
+        g_mapped_file_unref(matrix->mappedFile);
+    } else {
+        g_free(matrix->latencies);
+        g_free(matrix->reliabilities);
+    }
+    g_free(matrix->packetCounts);
+
+    MAGIC_CLEAR(matrix);
+    g_free(matrix);
+}
+
+static gsize _pathmatrix_getFileSize(guint nVertices) {
+    gsize nEntries = (gsize)nVertices * (gsize)nVertices;
+    return sizeof(PathMatrixFileHeader) + (nVertices * sizeof(gint64)) +
+           (2 * nEntries * sizeof(gfloat));
+}
+
+PathMatrix* pathmatrix_newFromFile(const gchar* filePath, gint64 nGraphVertices,
+                                   const gint64* vertexIndices, guint nVertices) {
+    utility_assert(filePath);
+    utility_assert(vertexIndices || nVertices == 0);
+
+    if (!g_file_test(filePath, G_FILE_TEST_IS_REGULAR)) {
+        return NULL;
+    }
+
+    GError* error = NULL;
+    GMappedFile* mappedFile = g_mapped_file_new(filePath, FALSE, &error);
+    if (!mappedFile) {
+        warning("unable to map path matrix file '%s': %s", filePath, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    const gchar* contents = g_mapped_file_get_contents(mappedFile);
+    gsize length = g_mapped_file_get_length(mappedFile);
+
+    PathMatrixFileHeader header = {0};
+    if (length >= sizeof(header)) {
+        memcpy(&header, contents, sizeof(header));
+    }
+
+    if (length < sizeof(header) ||
+        memcmp(header.magic, PATHMATRIX_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != PATHMATRIX_FILE_VERSION || header.nVertices != nVertices ||
+        header.nGraphVertices != nGraphVertices || length != _pathmatrix_getFileSize(nVertices)) {
+        warning("ignoring path matrix file '%s' with an unexpected format", filePath);
+        g_mapped_file_unref(mappedFile);
+        return NULL;
+    }
+
+    const gchar* position = contents + sizeof(header);
+    gsize indicesSize = nVertices * sizeof(gint64);
+    if (nVertices > 0 && memcmp(position, vertexIndices, indicesSize) != 0) {
+        warning("ignoring path matrix file '%s' that covers different vertices", filePath);
+        g_mapped_file_unref(mappedFile);
+        return NULL;
+    }
+    position += indicesSize;
+
+    PathMatrix* matrix =
+        _pathmatrix_newWithoutTables(nGraphVertices, vertexIndices, nVertices);
+
+    /* the mapping is page aligned and the header and indices are multiples of 8 bytes, so
+     * the tables are suitably aligned to be used in place. they are never written. */
+    gsize tableSize = (gsize)nVertices * (gsize)nVertices * sizeof(gfloat);
+    matrix->latencies = (gfloat*)position;
+    position += tableSize;
+    matrix->reliabilities = (gfloat*)position;
+    matrix->mappedFile = mappedFile;
+
+    return matrix;
+}
+
+gboolean pathmatrix_writeFile(PathMatrix* matrix, const gchar* filePath) {
+    MAGIC_ASSERT(matrix);
+    utility_assert(filePath);
+
+    gsize length = _pathmatrix_getFileSize(matrix->nVertices);
+    gchar* contents = g_malloc(length);
+
+    PathMatrixFileHeader header = {0};
+    memcpy(header.magic, PATHMATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = PATHMATRIX_FILE_VERSION;
+    header.nVertices = matrix->nVertices;
+    header.nGraphVertices = matrix->nGraphVertices;
+
+    gchar* position = contents;
+    memcpy(position, &header, sizeof(header));
+    position += sizeof(header);
+
+    gsize indicesSize = matrix->nVertices * sizeof(gint64);
+    memcpy(position, matrix->vertexIndices, indicesSize);
+    position += indicesSize;
+
+    gsize tableSize = (gsize)matrix->nVertices * (gsize)matrix->nVertices * sizeof(gfloat);
+    memcpy(position, matrix->latencies, tableSize);
+    position += tableSize;
+    memcpy(position, matrix->reliabilities, tableSize);
+
+    /* writes to a temporary file and renames it into place */
+    GError* error = NULL;
+    gboolean success = g_file_set_contents(filePath, contents, (gssize)length, &error);
+    if (!success) {
+        warning("unable to write path matrix file '%s': %s", filePath, error->message);
+        g_error_free(error);
+    }
+
+    g_free(contents);
+    return success;
+}
+
+static gint _pathmatrix_getPosition(PathMatrix* matrix, gint64 vertexIndex) {
+    if (vertexIndex < 0 || vertexIndex >= matrix->nGraphVertices) {
+        return -1;
+    }
+    return matrix->positions[vertexIndex];
+}
+
+/* returns -1 if either vertex is not in the matrix */
+static gssize _pathmatrix_getEntry(PathMatrix* matrix, gint64 srcVertexIndex,
+                                   gint64 dstVertexIndex) {
+    gint srcPosition = _pathmatrix_getPosition(matrix, srcVertexIndex);
+    gint dstPosition = _pathmatrix_getPosition(matrix, dstVertexIndex);
+    if (srcPosition < 0 || dstPosition < 0) {
+        return -1;
+    }
+    return (gssize)srcPosition * (gssize)matrix->nVertices + (gssize)dstPosition;
+}
+
+guint pathmatrix_getSize(PathMatrix* matrix) {
+    MAGIC_ASSERT(matrix);
+    return matrix->nVertices;
+}
+
+gint64 pathmatrix_getVertexIndex(PathMatrix* matrix, guint position) {
+    MAGIC_ASSERT(matrix);
+    utility_assert(position < matrix->nVertices);
+    return matrix->vertexIndices[position];
+}
+
+gboolean pathmatrix_containsVertex(PathMatrix* matrix, gint64 vertexIndex) {
+    MAGIC_ASSERT(matrix);
+    return _pathmatrix_getPosition(matrix, vertexIndex) >= 0;
+}
+
+void pathmatrix_setPath(PathMatrix* matrix, gint64 srcVertexIndex, gint64 dstVertexIndex,
+                        gdouble latency, gdouble reliability) {
+    MAGIC_ASSERT(matrix);
+    utility_assert(latency >= 0);
+    utility_assert(!matrix->mappedFile);
+
+    gssize entry = _pathmatrix_getEntry(matrix, srcVertexIndex, dstVertexIndex);
+    utility_assert(entry >= 0);
+
+    matrix->latencies[entry] = (gfloat)latency;
+    matrix->reliabilities[entry] = (gfloat)reliability;
+}
+
+gboolean pathmatrix_getPath(PathMatrix* matrix, gint64 srcVertexIndex, gint64 dstVertexIndex,
+                            gdouble* latencyOut, gdouble* reliabilityOut) {
+    MAGIC_ASSERT(matrix);
+
+    gssize entry = _pathmatrix_getEntry(matrix, srcVertexIndex, dstVertexIndex);
+    if (entry < 0 || matrix->latencies[entry] < 0) {
+        return FALSE;
+    }
+
+    if (latencyOut) {
+        *latencyOut = (gdouble)matrix->latencies[entry];
+    }
+    if (reliabilityOut) {
+        *reliabilityOut = (gdouble)matrix->reliabilities[entry];
+    }
+    return TRUE;
+}
+
+void pathmatrix_addPacketCount(PathMatrix* matrix, gint64 srcVertexIndex,
+                               gint64 dstVertexIndex, guint64 count) {
+    MAGIC_ASSERT(matrix);
+
+    gssize entry = _pathmatrix_getEntry(matrix, srcVertexIndex, dstVertexIndex);
+    utility_assert(entry >= 0);
+
+    __atomic_fetch_add(&matrix->packetCounts[entry], count, __ATOMIC_RELAXED);
+}
+
+guint64 pathmatrix_getPacketCount(PathMatrix* matrix, gint64 srcVertexIndex,
+                                  gint64 dstVertexIndex) {
+    MAGIC_ASSERT(matrix);
+
+    gssize entry = _pathmatrix_getEntry(matrix, srcVertexIndex, dstVertexIndex);
+    utility_assert(entry >= 0);
+
+    return __atomic_load_n(&matrix->packetCounts[entry], __ATOMIC_RELAXED);
+}
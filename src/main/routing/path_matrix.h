@@ -0,0 +1,49 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_PATH_MATRIX_H_
+#define SHD_PATH_MATRIX_H_
+
+#include <glib.h>
+
+/* A dense table of the latency and reliability of the paths between every pair
+ * of a fixed set of graph vertices. Each row may be filled by a different
+ * thread, and once filled the table is read-only, so lookups need no locking. */
+typedef struct _PathMatrix PathMatrix;
+
+/* vertexIndices holds the nVertices graph vertex indices that the matrix covers,
+ * all of which must be less than nGraphVertices */
+PathMatrix* pathmatrix_new(gint64 nGraphVertices, const gint64* vertexIndices, guint nVertices);
+void pathmatrix_free(PathMatrix* matrix);
+
+/* Loads a matrix previously saved with pathmatrix_writeFile. Returns NULL if the
+ * file does not exist, or if it is malformed or does not cover exactly the given
+ * vertices. Packet counts are not saved, so they start at zero. The paths are read
+ * from a read-only mapping of the file, so they can't be set. */
+PathMatrix* pathmatrix_newFromFile(const gchar* filePath, gint64 nGraphVertices,
+                                   const gint64* vertexIndices, guint nVertices);
+/* Saves the vertices, latencies, and reliabilities to the file in a binary
+ * format that can be mapped directly into memory. The file is replaced
+ * atomically so that concurrent readers never see a partial file. */
+gboolean pathmatrix_writeFile(PathMatrix* matrix, const gchar* filePath);
+
+guint pathmatrix_getSize(PathMatrix* matrix);
+/* returns the graph vertex index of the vertex at the given row or column */
+gint64 pathmatrix_getVertexIndex(PathMatrix* matrix, guint position);
+gboolean pathmatrix_containsVertex(PathMatrix* matrix, gint64 vertexIndex);
+
+void pathmatrix_setPath(PathMatrix* matrix, gint64 srcVertexIndex, gint64 dstVertexIndex,
+                        gdouble latency, gdouble reliability);
+/* returns FALSE if either vertex is not in the matrix or no path was set between them */
+gboolean pathmatrix_getPath(PathMatrix* matrix, gint64 srcVertexIndex, gint64 dstVertexIndex,
+                            gdouble* latencyOut, gdouble* reliabilityOut);
+
+/* safe to call concurrently from any number of threads */
+void pathmatrix_addPacketCount(PathMatrix* matrix, gint64 srcVertexIndex,
+                               gint64 dstVertexIndex, guint64 count);
+guint64 pathmatrix_getPacketCount(PathMatrix* matrix, gint64 srcVertexIndex,
+                                  gint64 dstVertexIndex);
+
+#endif /* SHD_PATH_MATRIX_H_ */
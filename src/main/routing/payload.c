@@ -13,34 +13,128 @@
 #include "main/core/worker.h"
 #include "main/utility/utility.h"
 
-/* packet payloads may be shared across hosts, so we must lock access to them */
+/* the source of the bytes of elided payloads, written in chunks of this size */
+static const gchar _payloadZeros[64 * 1024];
+
+/* packet payloads may be shared across hosts. the data is never modified after the payload
+ * is created, so only the reference count needs to be safe to update from multiple threads. */
 struct _Payload {
-    GMutex lock;
-    guint referenceCount;
-    gpointer data;
+    gint referenceCount;
     gsize length;
+    /* points at our own storage, or into the parent's if we are a slice of it. NULL if the
+     * bytes were elided, in which case they read as zeros. */
+    const gchar* data;
+    /* the payload we are a slice of, which we hold a reference to */
+    Payload* parent;
     MAGIC_DECLARE;
+    /* the payload bytes are stored inline, so a payload is a single allocation */
+    gchar storage[];
 };
 
-Payload* payload_new(Thread* thread, PluginVirtualPtr data, gsize dataLength) {
-    Payload* payload = g_new0(Payload, 1);
+static Payload* _payload_alloc(gsize dataLength) {
+    Payload* payload = g_malloc(sizeof(Payload) + dataLength);
+    memset(payload, 0, sizeof(Payload));
     MAGIC_INIT(payload);
+    payload->data = payload->storage;
+    payload->referenceCount = 1;
+    return payload;
+}
+
+Payload* payload_new(Thread* thread, PluginVirtualPtr data, gsize dataLength) {
+    struct iovec iov = {.iov_base = (void*)data.val, .iov_len = data.val ? dataLength : 0};
+    return payload_newFromIov(thread, &iov, 1, 0, iov.iov_len);
+}
 
-    if (data.val && dataLength > 0) {
-        payload->data = g_malloc0(dataLength);
-        if (process_readPtr(thread_getProcess(thread), payload->data, data, dataLength) != 0) {
-            warning("Couldn't read data for packet");
-            g_free(payload);
-            return NULL;
+/* Returns a payload of dataLength bytes that are never stored, for processes that only care
+ * about how many bytes they send. */
+static Payload* _payload_newElided(gsize dataLength) {
+    Payload* payload = _payload_alloc(0);
+    payload->data = NULL;
+    payload->length = dataLength;
+
+    worker_count_allocation(Payload);
+    worker_addGauge(WORKER_GAUGE_PAYLOADS, 1);
+
+    return payload;
+}
+
+Payload* payload_newFromIov(Thread* thread, const struct iovec* iov, size_t iovlen, gsize offset,
+                            gsize dataLength) {
+    if (process_isElidingPayloads(thread_getProcess(thread))) {
+        return _payload_newElided(dataLength);
+    }
+
+    /* the data is filled in right away, so don't waste a pass over it zeroing it first */
+    Payload* payload = _payload_alloc(dataLength);
+
+    /* gather the plugin buffers straight into place, in one transfer when they aren't mapped */
+    PluginVirtualPtr* srcs = g_new(PluginVirtualPtr, iovlen);
+    size_t* lens = g_new(size_t, iovlen);
+    size_t count = 0;
+    for (size_t i = 0; i < iovlen && payload->length < dataLength; i++) {
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
         }
-        utility_assert(payload->data != NULL);
+
+        gsize copyLength = MIN(iov[i].iov_len - offset, dataLength - payload->length);
+        srcs[count] = (PluginVirtualPtr){.val = (uint64_t)iov[i].iov_base + offset};
+        lens[count] = copyLength;
+        count++;
+        payload->length += copyLength;
+        offset = 0;
+    }
+    utility_assert(payload->length == dataLength);
+
+    int err = process_readPtrs(thread_getProcess(thread), payload->storage, srcs, lens, count);
+    g_free(srcs);
+    g_free(lens);
+    if (err != 0) {
+        warning("Couldn't read data for packet");
+        MAGIC_CLEAR(payload);
+        g_free(payload);
+        return NULL;
+    }
+
+    worker_count_allocation(Payload);
+    worker_addGauge(WORKER_GAUGE_PAYLOADS, 1);
+    worker_addGauge(WORKER_GAUGE_PAYLOAD_BYTES, payload->length);
+
+    return payload;
+}
+
+Payload* payload_newFromShadow(const void* data, gsize dataLength) {
+    if (!data) {
+        dataLength = 0;
+    }
+
+    Payload* payload = _payload_alloc(dataLength);
+
+    if (dataLength > 0) {
+        memcpy(payload->storage, data, dataLength);
         payload->length = dataLength;
     }
 
-    g_mutex_init(&(payload->lock));
-    payload->referenceCount = 1;
+    worker_count_allocation(Payload);
+    worker_addGauge(WORKER_GAUGE_PAYLOADS, 1);
+    worker_addGauge(WORKER_GAUGE_PAYLOAD_BYTES, payload->length);
+
+    return payload;
+}
 
+Payload* payload_newSlice(Payload* parent, gsize offset, gsize dataLength) {
+    MAGIC_ASSERT(parent);
+    utility_assert(offset + dataLength <= parent->length);
+
+    Payload* payload = _payload_alloc(0);
+    payload_ref(parent);
+    payload->parent = parent;
+    payload->data = parent->data ? parent->data + offset : NULL;
+    payload->length = dataLength;
+
+    /* the bytes are counted by the parent */
     worker_count_allocation(Payload);
+    worker_addGauge(WORKER_GAUGE_PAYLOADS, 1);
 
     return payload;
 }
@@ -48,10 +142,11 @@ Payload* payload_new(Thread* thread, PluginVirtualPtr data, gsize dataLength) {
 static void _payload_free(Payload* payload) {
     MAGIC_ASSERT(payload);
 
-    g_mutex_clear(&(payload->lock));
-
-    if(payload->data) {
-        g_free(payload->data);
+    worker_addGauge(WORKER_GAUGE_PAYLOADS, -1);
+    if (payload->parent) {
+        payload_unref(payload->parent);
+    } else if (payload->data) {
+        worker_addGauge(WORKER_GAUGE_PAYLOAD_BYTES, -(gint64)payload->length);
     }
 
     MAGIC_CLEAR(payload);
@@ -60,82 +155,82 @@ static void _payload_free(Payload* payload) {
     worker_count_deallocation(Payload);
 }
 
-static void _payload_lock(Payload* payload) {
-    MAGIC_ASSERT(payload);
-    g_mutex_lock(&(payload->lock));
-}
-
-static void _payload_unlock(Payload* payload) {
-    MAGIC_ASSERT(payload);
-    g_mutex_unlock(&(payload->lock));
-}
-
 void payload_ref(Payload* payload) {
     MAGIC_ASSERT(payload);
-    _payload_lock(payload);
-    (payload->referenceCount)++;
-    _payload_unlock(payload);
+    g_atomic_int_inc(&(payload->referenceCount));
 }
 
 void payload_unref(Payload* payload) {
     MAGIC_ASSERT(payload);
-    _payload_lock(payload);
-    (payload->referenceCount)--;
-    gboolean needsFree = (payload->referenceCount == 0) ? TRUE : FALSE;
-    _payload_unlock(payload);
-    if(needsFree) {
+    if(g_atomic_int_dec_and_test(&(payload->referenceCount))) {
         _payload_free(payload);
     }
 }
 
 gsize payload_getLength(Payload* payload) {
     MAGIC_ASSERT(payload);
-    _payload_lock(payload);
-    gsize length = payload->length;
-    _payload_unlock(payload);
-    return length;
+    return payload->length;
 }
 
 gssize payload_getData(Payload* payload, Thread* thread, gsize offset, PluginVirtualPtr destBuffer,
                        gsize destBufferLength) {
     MAGIC_ASSERT(payload);
-
-    _payload_lock(payload);
-
     utility_assert(offset <= payload->length);
 
     gssize targetLength = payload->length - offset;
     gssize copyLength = MIN(targetLength, destBufferLength);
 
-    if (copyLength > 0) {
+    if (copyLength > 0 && payload->data) {
         int err = process_writePtr(
             thread_getProcess(thread), destBuffer, payload->data + offset, copyLength);
         if (err) {
             return -err;
         }
+    } else if (copyLength > 0) {
+        for (gssize written = 0; written < copyLength; written += sizeof(_payloadZeros)) {
+            PluginVirtualPtr dst = {.val = destBuffer.val + written};
+            int err = process_writePtr(thread_getProcess(thread), dst, _payloadZeros,
+                                       MIN((gsize)(copyLength - written), sizeof(_payloadZeros)));
+            if (err) {
+                return -err;
+            }
+        }
     }
 
-    _payload_unlock(payload);
-
     return copyLength;
 }
 
-gsize payload_getDataShadow(Payload* payload, gsize offset, void* destBuffer,
-                            gsize destBufferLength) {
+gssize payload_getDataIov(Payload* payload, Thread* thread, gsize offset, const struct iovec* iov,
+                          size_t iovlen) {
     MAGIC_ASSERT(payload);
+    utility_assert(offset <= payload->length);
+
+    gsize copied = 0;
+    for (size_t i = 0; i < iovlen && offset + copied < payload->length; i++) {
+        PluginVirtualPtr dst = {.val = (uint64_t)iov[i].iov_base};
+        gssize rv = payload_getData(payload, thread, offset + copied, dst, iov[i].iov_len);
+        if (rv < 0) {
+            return rv;
+        }
+        copied += rv;
+    }
 
-    _payload_lock(payload);
+    return copied;
+}
 
+gsize payload_getDataShadow(Payload* payload, gsize offset, void* destBuffer,
+                            gsize destBufferLength) {
+    MAGIC_ASSERT(payload);
     utility_assert(offset <= payload->length);
 
     gsize targetLength = payload->length - offset;
     gsize copyLength = MIN(targetLength, destBufferLength);
 
-    if(copyLength > 0) {
+    if (copyLength > 0 && payload->data) {
         memcpy(destBuffer, payload->data + offset, copyLength);
+    } else if (copyLength > 0) {
+        memset(destBuffer, 0, copyLength);
     }
 
-    _payload_unlock(payload);
-
     return copyLength;
 }
@@ -8,6 +8,7 @@
 #define SRC_MAIN_ROUTING_SHD_PAYLOAD_H_
 
 #include <glib.h>
+#include <sys/uio.h>
 
 #include "main/host/syscall_types.h"
 #include "main/host/thread.h"
@@ -15,6 +16,15 @@
 typedef struct _Payload Payload;
 
 Payload* payload_new(Thread* thread, PluginVirtualPtr data, gsize dataLength);
+/* Like payload_new, but copies data that is already in Shadow's memory. */
+Payload* payload_newFromShadow(const void* data, gsize dataLength);
+/* Like payload_new, but gathers dataLength bytes starting at offset into the
+ * plugin's buffers described by iov. */
+Payload* payload_newFromIov(Thread* thread, const struct iovec* iov, size_t iovlen, gsize offset,
+                            gsize dataLength);
+/* Returns a payload holding the dataLength bytes starting at offset into parent,
+ * without copying them. The slice holds a reference to parent. */
+Payload* payload_newSlice(Payload* parent, gsize offset, gsize dataLength);
 
 void payload_ref(Payload* payload);
 void payload_unref(Payload* payload);
@@ -22,6 +32,10 @@ void payload_unref(Payload* payload);
 gsize payload_getLength(Payload* payload);
 gssize payload_getData(Payload* payload, Thread* thread, gsize offset, PluginVirtualPtr destBuffer,
                        gsize destBufferLength);
+/* Like payload_getData, but scatters the data across the plugin's buffers
+ * described by iov, in order. */
+gssize payload_getDataIov(Payload* payload, Thread* thread, gsize offset, const struct iovec* iov,
+                          size_t iovlen);
 
 gsize payload_getDataShadow(Payload* payload, gsize offset, void* destBuffer,
                             gsize destBufferLength);
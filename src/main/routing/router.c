@@ -20,6 +20,7 @@
 #include "main/routing/router_queue_codel.h"
 #include "main/routing/router_queue_single.h"
 #include "main/routing/router_queue_static.h"
+#include "main/utility/tracepoint.h"
 #include "main/utility/utility.h"
 
 struct _Router {
@@ -108,10 +109,17 @@ void router_enqueue(Router* router, Host* host, Packet* packet) {
 
     gboolean wasQueued = router->queueHooks->enqueue(router->queueManager, packet);
 
-    if(wasQueued) {
-        packet_addDeliveryStatus(packet, PDS_ROUTER_ENQUEUED);
+    if (wasQueued) {
+        TRACEPOINT(router_enqueue, host_getID(host), packet_getTotalSize(packet));
     } else {
-        packet_addDeliveryStatus(packet, PDS_ROUTER_DROPPED);
+        TRACEPOINT(router_drop, host_getID(host), packet_getTotalSize(packet));
+    }
+
+    /* a super-packet is queued or dropped as a whole */
+    guint nSegments = packet_getNumSegments(packet);
+    for(guint i = 0; i < nSegments; i++) {
+        packet_addDeliveryStatus(packet_getSegment(packet, i),
+                                 wasQueued ? PDS_ROUTER_ENQUEUED : PDS_ROUTER_DROPPED);
     }
 
     /* notify the netiface that we have a new packet so it can dequeue it. */
@@ -125,8 +133,16 @@ Packet* router_dequeue(Router* router) {
 
     Packet* packet = router->queueHooks->dequeue(router->queueManager);
     if(packet) {
-        packet_addDeliveryStatus(packet, PDS_ROUTER_DEQUEUED);
+        guint nSegments = packet_getNumSegments(packet);
+        for(guint i = 0; i < nSegments; i++) {
+            packet_addDeliveryStatus(packet_getSegment(packet, i), PDS_ROUTER_DEQUEUED);
+        }
     }
 
     return packet;
 }
+
+Packet* router_peek(Router* router) {
+    MAGIC_ASSERT(router);
+    return router->queueHooks->peek(router->queueManager);
+}
@@ -28,6 +28,8 @@
 #include "main/core/worker.h"
 #include "main/routing/packet.h"
 #include "main/routing/router.h"
+#include "main/routing/router_queue_ring.h"
+#include "main/utility/tracepoint.h"
 #include "main/utility/utility.h"
 
 /* hard limit of queue size, in number of packets. this is recommended to be
@@ -53,16 +55,10 @@ enum _CoDelMode {
     CODEL_MODE_DROP, // under bad conditions, we occasionally drop packets
 };
 
-typedef struct _CoDelEntry CoDelEntry;
-struct _CoDelEntry {
-    Packet* packet;
-    SimulationTime enqueueTS;
-};
-
 typedef struct _QueueManagerCoDel QueueManagerCoDel;
 struct _QueueManagerCoDel {
     /* the queue holding the packets and timestamps */
-    GQueue* entries;
+    RouterQueueRing entries;
     /* total amount of bytes stored */
     guint64 totalSize;
 
@@ -82,7 +78,7 @@ static QueueManagerCoDel* _routerqueuecodel_new() {
     QueueManagerCoDel* queueManager = g_new0(QueueManagerCoDel, 1);
 
     queueManager->mode = CODEL_MODE_STORE;
-    queueManager->entries = g_queue_new();
+    routerqueuering_init(&queueManager->entries);
 
     return queueManager;
 }
@@ -90,38 +86,24 @@ static QueueManagerCoDel* _routerqueuecodel_new() {
 static void _routerqueuecodel_free(QueueManagerCoDel* queueManager) {
     utility_assert(queueManager);
 
-    if(queueManager->entries) {
-        while(!g_queue_is_empty(queueManager->entries)) {
-            CoDelEntry* entry = g_queue_pop_head(queueManager->entries);
-            if(entry) {
-                if(entry->packet) {
-                    packet_unref(entry->packet);
-                }
-                g_free(entry);
-            }
-        }
-        g_queue_free(queueManager->entries);
-    }
+    routerqueuering_clear(&queueManager->entries);
 
     g_free(queueManager);
 }
 
 static inline guint64 _routerqueuecodel_getPacketLength(Packet* packet) {
-    return (guint64)(packet_getPayloadLength(packet) + packet_getHeaderSize(packet));
+    /* includes the segments of super-packets */
+    return packet_getTotalSize(packet);
 }
 
 static gboolean _routerqueuecodel_enqueue(QueueManagerCoDel* queueManager, Packet* packet) {
     utility_assert(queueManager);
     utility_assert(packet);
 
-    if(g_queue_get_length(queueManager->entries) < CODEL_PARAM_QUEUE_SIZE_LIMIT) {
+    if(routerqueuering_getLength(&queueManager->entries) < CODEL_PARAM_QUEUE_SIZE_LIMIT) {
         /* we will store the packet */
         packet_ref(packet);
-
-        CoDelEntry* entry = g_new0(CoDelEntry, 1);
-        entry->packet = packet;
-        entry->enqueueTS = worker_getCurrentTime();
-        g_queue_push_tail(queueManager->entries, entry);
+        routerqueuering_push(&queueManager->entries, packet, worker_getCurrentTime());
 
         guint64 length = _routerqueuecodel_getPacketLength(packet);
         queueManager->totalSize += length;
@@ -136,7 +118,14 @@ static gboolean _routerqueuecodel_enqueue(QueueManagerCoDel* queueManager, Packe
 }
 
 static void _routerqueuecodel_drop(Packet* packet) {
-    packet_addDeliveryStatus(packet, PDS_ROUTER_DROPPED);
+    /* the router belongs to the host that is dequeuing from it */
+    TRACEPOINT(router_drop, host_getID(worker_getActiveHost()), packet_getTotalSize(packet));
+
+    /* a super-packet is dropped as a whole */
+    guint nSegments = packet_getNumSegments(packet);
+    for(guint i = 0; i < nSegments; i++) {
+        packet_addDeliveryStatus(packet_getSegment(packet, i), PDS_ROUTER_DROPPED);
+    }
 #ifdef DEBUG
     gchar* pString = packet_toString(packet);
     trace("Router dropped packet %s", pString);
@@ -151,11 +140,10 @@ static Packet* _routerqueuecodel_dequeueHelper(QueueManagerCoDel* queueManager,
     Packet* packet = NULL;
     SimulationTime ts = 0;
 
-    CoDelEntry* entry = g_queue_pop_head(queueManager->entries);
-    if(entry) {
-        packet = entry->packet;
-        ts = entry->enqueueTS;
-        g_free(entry);
+    RouterQueueEntry entry;
+    if(routerqueuering_pop(&queueManager->entries, &entry)) {
+        packet = entry.packet;
+        ts = entry.enqueueTS;
     }
 
     if(packet == NULL) {
@@ -269,7 +257,7 @@ static Packet* _routerqueuecodel_dequeue(QueueManagerCoDel* queueManager) {
 static Packet* _routerqueuecodel_peek(QueueManagerCoDel* queueManager) {
     utility_assert(queueManager);
 
-    CoDelEntry* entry = g_queue_peek_head(queueManager->entries);
+    const RouterQueueEntry* entry = routerqueuering_peek(&queueManager->entries);
 
     if(entry && entry->packet) {
         return entry->packet;
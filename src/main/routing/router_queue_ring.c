@@ -0,0 +1,87 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/routing/router_queue_ring.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include "main/routing/packet.h"
+#include "main/utility/utility.h"
+
+#define ROUTERQUEUERING_MIN_CAPACITY 32
+
+void routerqueuering_init(RouterQueueRing* ring) {
+    utility_assert(ring);
+    memset(ring, 0, sizeof(RouterQueueRing));
+}
+
+void routerqueuering_clear(RouterQueueRing* ring) {
+    utility_assert(ring);
+
+    RouterQueueEntry entry;
+    while (routerqueuering_pop(ring, &entry)) {
+        packet_unref(entry.packet);
+    }
+
+    g_free(ring->entries);
+    routerqueuering_init(ring);
+}
+
+static void _routerqueuering_grow(RouterQueueRing* ring) {
+    guint capacity = ring->capacity ? ring->capacity * 2 : ROUTERQUEUERING_MIN_CAPACITY;
+    utility_assert(capacity > ring->capacity);
+
+    RouterQueueEntry* entries = g_new(RouterQueueEntry, capacity);
+
+    /* unwrap the old entries to the front of the new buffer */
+    guint headCount = MIN(ring->length, ring->capacity - ring->head);
+    if (headCount > 0) {
+        memcpy(entries, &ring->entries[ring->head], headCount * sizeof(RouterQueueEntry));
+    }
+    if (ring->length > headCount) {
+        memcpy(&entries[headCount], ring->entries,
+               (ring->length - headCount) * sizeof(RouterQueueEntry));
+    }
+
+    g_free(ring->entries);
+    ring->entries = entries;
+    ring->capacity = capacity;
+    ring->head = 0;
+}
+
+void routerqueuering_push(RouterQueueRing* ring, Packet* packet, SimulationTime enqueueTS) {
+    utility_assert(ring);
+    utility_assert(packet);
+
+    if (ring->length == ring->capacity) {
+        _routerqueuering_grow(ring);
+    }
+
+    RouterQueueEntry* entry = &ring->entries[(ring->head + ring->length) & (ring->capacity - 1)];
+    entry->packet = packet;
+    entry->enqueueTS = enqueueTS;
+    ring->length++;
+}
+
+gboolean routerqueuering_pop(RouterQueueRing* ring, RouterQueueEntry* entry) {
+    utility_assert(ring);
+    utility_assert(entry);
+
+    if (ring->length == 0) {
+        return FALSE;
+    }
+
+    *entry = ring->entries[ring->head];
+    ring->head = (ring->head + 1) & (ring->capacity - 1);
+    ring->length--;
+
+    return TRUE;
+}
+
+const RouterQueueEntry* routerqueuering_peek(const RouterQueueRing* ring) {
+    utility_assert(ring);
+    return ring->length > 0 ? &ring->entries[ring->head] : NULL;
+}
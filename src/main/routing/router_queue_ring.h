@@ -0,0 +1,47 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SRC_MAIN_ROUTING_ROUTER_QUEUE_RING_H_
+#define SRC_MAIN_ROUTING_ROUTER_QUEUE_RING_H_
+
+#include <glib.h>
+
+#include "main/core/support/definitions.h"
+#include "main/routing/packet.minimal.h"
+
+typedef struct _RouterQueueEntry RouterQueueEntry;
+struct _RouterQueueEntry {
+    Packet* packet;
+    SimulationTime enqueueTS;
+};
+
+/* A FIFO of packet entries stored inline in a power-of-two ring buffer that
+ * doubles when full, so pushing and popping only allocate when it grows.
+ * The ring is meant to be embedded in the queue manager that uses it. */
+typedef struct _RouterQueueRing RouterQueueRing;
+struct _RouterQueueRing {
+    RouterQueueEntry* entries;
+    guint capacity;
+    guint head;
+    guint length;
+};
+
+void routerqueuering_init(RouterQueueRing* ring);
+/* Unrefs the packets that are still queued and frees the buffer. */
+void routerqueuering_clear(RouterQueueRing* ring);
+
+/* The ring takes ownership of the caller's packet reference. */
+void routerqueuering_push(RouterQueueRing* ring, Packet* packet, SimulationTime enqueueTS);
+/* Removes the head entry and stores it in entry, transferring the packet
+ * reference to the caller. Returns FALSE if the ring is empty. */
+gboolean routerqueuering_pop(RouterQueueRing* ring, RouterQueueEntry* entry);
+/* Returns the head entry, or NULL if the ring is empty. */
+const RouterQueueEntry* routerqueuering_peek(const RouterQueueRing* ring);
+
+static inline guint routerqueuering_getLength(const RouterQueueRing* ring) {
+    return ring->length;
+}
+
+#endif /* SRC_MAIN_ROUTING_ROUTER_QUEUE_RING_H_ */
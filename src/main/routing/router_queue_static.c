@@ -9,20 +9,21 @@
 
 #include "main/routing/packet.h"
 #include "main/routing/router.h"
+#include "main/routing/router_queue_ring.h"
 #include "main/utility/utility.h"
 
 #define STATIC_PARAM_MAXSIZE 1024000
 
 typedef struct _QueueManagerStatic QueueManagerStatic;
 struct _QueueManagerStatic {
-    GQueue* packets;
+    RouterQueueRing packets;
     guint64 totalSize;
 };
 
 static QueueManagerStatic* _routerqueuestatic_new() {
     QueueManagerStatic* queueManager = g_new0(QueueManagerStatic, 1);
 
-    queueManager->packets = g_queue_new();
+    routerqueuering_init(&queueManager->packets);
 
     return queueManager;
 }
@@ -30,15 +31,14 @@ static QueueManagerStatic* _routerqueuestatic_new() {
 static void _routerqueuestatic_free(QueueManagerStatic* queueManager) {
     utility_assert(queueManager);
 
-    if(queueManager->packets) {
-        g_queue_free_full(queueManager->packets, (GDestroyNotify)packet_unref);
-    }
+    routerqueuering_clear(&queueManager->packets);
 
     g_free(queueManager);
 }
 
 static inline guint64 _routerqueuestatic_getPacketLength(Packet* packet) {
-    return (guint64)(packet_getPayloadLength(packet) + packet_getHeaderSize(packet));
+    /* includes the segments of super-packets */
+    return packet_getTotalSize(packet);
 }
 
 static gboolean _routerqueuestatic_enqueue(QueueManagerStatic* queueManager, Packet* packet) {
@@ -50,7 +50,8 @@ static gboolean _routerqueuestatic_enqueue(QueueManagerStatic* queueManager, Pac
     if(queueManager->totalSize + length < (guint64)STATIC_PARAM_MAXSIZE) {
         /* we will queue the packet */
         packet_ref(packet);
-        g_queue_push_tail(queueManager->packets, packet);
+        /* the static queue doesn't use the enqueue time */
+        routerqueuering_push(&queueManager->packets, packet, 0);
         queueManager->totalSize += length;
         return TRUE;
     } else {
@@ -62,10 +63,12 @@ static gboolean _routerqueuestatic_enqueue(QueueManagerStatic* queueManager, Pac
 static Packet* _routerqueuestatic_dequeue(QueueManagerStatic* queueManager) {
     utility_assert(queueManager);
 
-    /* this call transfers the reference that we were holding to the caller */
-    Packet* packet = g_queue_pop_head(queueManager->packets);
+    Packet* packet = NULL;
+    RouterQueueEntry entry;
 
-    if(packet) {
+    /* this call transfers the reference that we were holding to the caller */
+    if(routerqueuering_pop(&queueManager->packets, &entry)) {
+        packet = entry.packet;
         guint64 length = _routerqueuestatic_getPacketLength(packet);
         utility_assert(length <= queueManager->totalSize);
         queueManager->totalSize -= length;
@@ -76,7 +79,8 @@ static Packet* _routerqueuestatic_dequeue(QueueManagerStatic* queueManager) {
 
 static Packet* _routerqueuestatic_peek(QueueManagerStatic* queueManager) {
     utility_assert(queueManager);
-    return g_queue_peek_head(queueManager->packets);
+    const RouterQueueEntry* entry = routerqueuering_peek(&queueManager->packets);
+    return entry ? entry->packet : NULL;
 }
 
 static const struct _QueueManagerHooks _routerqueuestatic_hooks = {
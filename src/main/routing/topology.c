@@ -10,6 +10,7 @@
 #include <inttypes.h>
 #include <math.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -19,16 +20,40 @@
 #include "main/core/worker.h"
 #include "main/routing/address.h"
 #include "main/routing/path.h"
+#include "main/routing/path_matrix.h"
 #include "main/routing/topology.h"
+#include "main/utility/perf_timer.h"
 #include "main/utility/random.h"
 #include "main/utility/utility.h"
 
+typedef struct _TopologyPrecompute TopologyPrecompute;
+typedef struct _TopologyAdjacency TopologyAdjacency;
+typedef struct _TopologyVertex TopologyVertex;
+typedef struct _TopologyEdge TopologyEdge;
+typedef struct _TopologyVertexGroup TopologyVertexGroup;
+
 struct _Topology {
     /* the imported igraph graph data - operations on it after initializations
      * MUST be locked in cases where igraph is not thread-safe! */
     igraph_t graph;
     GMutex graphLock;
 
+    /* the vertex and edge attributes, indexed like the graph's vertices and edges.
+     * they are parsed once after the graph is checked, and igraph's own attribute
+     * tables are freed, so reading them needs neither the graph lock nor any parsing */
+    TopologyVertex* vertices;
+    TopologyEdge* edges;
+    /* the strings the vertices point to */
+    GStringChunk* attributeStrings;
+
+    /* the vertices that hosts are attached to, indexed by the attach hints. the code
+     * tables are keyed by the lowercase code, and the ip table by the usable ip
+     * addresses. each maps to a TopologyVertexGroup. */
+    TopologyVertexGroup* allVertices;
+    GHashTable* verticesByCitycode;
+    GHashTable* verticesByCountrycode;
+    GHashTable* verticesByIP;
+
     /* the edge weights currently used when computing shortest paths.
      * this is protected by its own lock */
     igraph_vector_t* edgeWeights;
@@ -45,9 +70,30 @@ struct _Topology {
      * store a cache table for every connected address
      * fromAddress->toAddress->Path* */
     GHashTable* pathCache;
+    /* the number of paths in pathCache. written while holding the write lock, but may be
+     * read without the lock using a relaxed atomic load */
+    gsize numCachedPaths;
     gdouble minimumPathLatency;
     GRWLock pathCacheLock;
 
+    /* if set, the paths between all vertices with attached hosts, computed once after
+     * all hosts were attached. it is read-only and replaces the path cache. */
+    PathMatrix* pathMatrix;
+
+    /* only set while the path cache is being filled in parallel */
+    TopologyPrecompute* precompute;
+
+    /* only set once edge changes were applied. the edges as they are now, kept up to
+     * date by each change, and vertexID->vertexIndex (stored as pointer) for the vertices
+     * named by the changes */
+    TopologyAdjacency* adjacency;
+    GHashTable* vertexIndexByID;
+    /* incremented each time edge changes are applied */
+    guint epoch;
+
+    /* the SHA-256 checksum of the gml file contents, used to key saved path matrices */
+    gchar* graphChecksum;
+
     /******/
     /* START - items protected by a global topology lock */
     GMutex topologyLock;
@@ -84,6 +130,24 @@ struct _Topology {
     MAGIC_DECLARE;
 };
 
+struct _TopologyVertex {
+    gint64 id;
+    /* in bits per second */
+    guint64 bandwidthDown;
+    guint64 bandwidthUp;
+    /* INADDR_NONE if the vertex has no valid ip_address */
+    in_addr_t ip;
+    /* NULL if the vertex doesn't have them */
+    const gchar* ipAddress;
+    const gchar* citycode;
+    const gchar* countrycode;
+};
+
+struct _TopologyEdge {
+    gint64 latencyNs;
+    gdouble packetLoss;
+};
+
 typedef enum _VertexAttribute VertexAttribute;
 enum _VertexAttribute {
     VERTEX_ATTR_ID=2,
@@ -103,29 +167,24 @@ enum _EdgeAttribute {
     EDGE_ATTR_LABEL=15
 };
 
-typedef struct _AttachHelper AttachHelper;
-struct _AttachHelper {
-    /* these are ordered by preference, more specific is better */
-    GQueue* candidatesCity;
-    GQueue* candidatesCountry;
-    GQueue* candidatesAll;
-
-    guint numIPsCity;
-    guint numIPsCountry;
-    guint numIPsAll;
-
-    gchar* ipAddressHint;
-    gchar* citycodeHint;
-    gchar* countrycodeHint;
-
-    in_addr_t requestedIP;
-    gboolean requestedIPIsUsable;
+/* a set of vertices that hosts may be attached to, such as those with one city code */
+struct _TopologyVertexGroup {
+    /* the vertex indices in vertex order, from which random choices are made */
+    GArray* vertexIndices;
+    /* the vertices sorted by ip, and then by vertex index, for longest prefix matching */
+    GArray* verticesByIP;
+    /* how many of the vertices have an ip address that a host could use */
+    guint numUsableIPs;
+};
 
-    gboolean foundExactIPMatch;
+typedef struct _TopologyVertexIP TopologyVertexIP;
+struct _TopologyVertexIP {
+    in_addr_t ip;
+    igraph_integer_t vertexIndex;
 };
 
-typedef gboolean (*EdgeNotifyFunc)(Topology* top, igraph_integer_t edgeIndex, gpointer userData);
-typedef gboolean (*VertexNotifyFunc)(Topology* top, igraph_integer_t vertexIndex, gpointer userData);
+/* checks the vertex or edge with the given index */
+typedef gboolean (*ElementCheckFunc)(Topology* top, igraph_integer_t index, gpointer userData);
 
 #if 1//!defined(IGRAPH_THREAD_SAFE) || (defined(IGRAPH_THREAD_SAFE) && IGRAPH_THREAD_SAFE == 0)
 static void _topology_initGraphLock(GMutex* graphLockPtr) {
@@ -334,11 +393,24 @@ static gboolean _topology_loadGraph(Topology* top, const gchar* graphPath) {
     igraph_attribute_table_t* oldHandler = igraph_i_set_attribute_table(&igraph_cattribute_table);
 #endif
 
-    /* get the file */
-    FILE* graphFile = fopen(graphPath, "r");
+    /* read the whole file once, so we can checksum it and parse it from memory */
+    gchar* graphContents = NULL;
+    gsize graphLength = 0;
+    GError* fileError = NULL;
+    if(!g_file_get_contents(graphPath, &graphContents, &graphLength, &fileError)) {
+        error("unable to read graph file path '%s': %s", graphPath, fileError->message);
+        g_error_free(fileError);
+        return FALSE;
+    }
+
+    top->graphChecksum =
+        g_compute_checksum_for_data(G_CHECKSUM_SHA256, (const guchar*)graphContents, graphLength);
+
+    FILE* graphFile = fmemopen(graphContents, graphLength, "r");
     if(!graphFile) {
-        error("fopen returned NULL while attempting to open graph file path '%s', error %i: %s",
+        error("fmemopen returned NULL while attempting to read graph file path '%s', error %i: %s",
               graphPath, errno, strerror(errno));
+        g_free(graphContents);
         return FALSE;
     }
 
@@ -348,6 +420,7 @@ static gboolean _topology_loadGraph(Topology* top, const gchar* graphPath) {
     _topology_unlockGraph(top);
 
     fclose(graphFile);
+    g_free(graphContents);
 
     if(result != IGRAPH_SUCCESS) {
         error("igraph_read_graph_gml return non-success code %i", result);
@@ -359,6 +432,22 @@ static gboolean _topology_loadGraph(Topology* top, const gchar* graphPath) {
     return TRUE;
 }
 
+static gint64 _topology_getVertexID(Topology* top, igraph_integer_t vertexIndex) {
+    utility_assert(vertexIndex >= 0 && vertexIndex < top->vertexCount);
+    return top->vertices[vertexIndex].id;
+}
+
+/* in milliseconds, like the rest of the topology code assumes */
+static gdouble _topology_getEdgeLatency(Topology* top, igraph_integer_t edgeIndex) {
+    utility_assert(edgeIndex >= 0 && edgeIndex < top->edgeCount);
+    return (gdouble)top->edges[edgeIndex].latencyNs / 1000000.0;
+}
+
+static gdouble _topology_getEdgeReliability(Topology* top, igraph_integer_t edgeIndex) {
+    utility_assert(edgeIndex >= 0 && edgeIndex < top->edgeCount);
+    return 1.0 - top->edges[edgeIndex].packetLoss;
+}
+
 /* @warning top->graphLock must be held when calling this function!! */
 static gint _topology_getEdgeHelper(Topology* top,
         igraph_integer_t fromVertexIndex, igraph_integer_t toVertexIndex,
@@ -386,14 +475,10 @@ static gint _topology_getEdgeHelper(Topology* top,
 
     /* get edge properties from graph */
     if(edgeLatencyOut) {
-        gdouble found = _topology_findEdgeAttributeStringTimeMs(top, edgeIndex, EDGE_ATTR_LATENCY, edgeLatencyOut);
-        utility_assert(found);
+        *edgeLatencyOut = _topology_getEdgeLatency(top, edgeIndex);
     }
     if(edgeReliabilityOut) {
-        gdouble edgePacketLoss;
-        gdouble found = _topology_findEdgeAttributeDouble(top, edgeIndex, EDGE_ATTR_PACKETLOSS, &edgePacketLoss);
-        utility_assert(found);
-        *edgeReliabilityOut = (1.0f - edgePacketLoss);
+        *edgeReliabilityOut = _topology_getEdgeReliability(top, edgeIndex);
     }
     if(edgeIndexOut) {
         *edgeIndexOut = edgeIndex;
@@ -828,62 +913,82 @@ static gboolean _topology_checkGraphVerticesHelperHook(Topology* top, igraph_int
     return isSuccess;
 }
 
-static igraph_integer_t _topology_iterateAllVertices(Topology* top, VertexNotifyFunc hook, gpointer userData) {
-    MAGIC_ASSERT(top);
-    utility_assert(hook);
-
-    gboolean isSuccess = TRUE;
+typedef struct _TopologyCheckWork TopologyCheckWork;
+struct _TopologyCheckWork {
+    Topology* top;
+    ElementCheckFunc hook;
+    igraph_integer_t count;
+    /* the first index of the next chunk that needs to be checked, shared by all threads */
+    gint nextIndex;
+    /* cleared by any thread whose hook fails */
+    gint isSuccess;
+};
 
-    /* we will iterate through the vertices */
-    igraph_vit_t vertexIterator;
-    gint result = igraph_vit_create(&top->graph, igraph_vss_all(), &vertexIterator);
-    if(result != IGRAPH_SUCCESS) {
-        error("igraph_vit_create return non-success code %i", result);
-        return -1;
-    }
+/* The threads take this many vertices or edges at a time. The hooks only read the graph,
+ * so the threads share the graph lock that the calling thread holds. */
+#define TOPOLOGY_CHECK_CHUNK 1024
 
-    /* count the vertices as we iterate */
-    igraph_integer_t vertexCount = 0;
-    while (!IGRAPH_VIT_END(vertexIterator)) {
-        long int vertexIndex = IGRAPH_VIT_GET(vertexIterator);
+static void* _topology_checkInParallelThread(void* voidWork) {
+    TopologyCheckWork* work = voidWork;
 
-        /* call the hook function for each edge */
-        if(!hook(top, (igraph_integer_t) vertexIndex, userData)) {
-            isSuccess = FALSE;
+    gint start;
+    while((start = g_atomic_int_add(&work->nextIndex, TOPOLOGY_CHECK_CHUNK)) < work->count) {
+        gint end = MIN(start + TOPOLOGY_CHECK_CHUNK, (gint)work->count);
+        for(gint index = start; index < end; index++) {
+            if(!work->hook(work->top, (igraph_integer_t)index, NULL)) {
+                g_atomic_int_set(&work->isSuccess, FALSE);
+            }
         }
-
-        vertexCount++;
-        IGRAPH_VIT_NEXT(vertexIterator);
     }
 
-    /* clean up */
-    igraph_vit_destroy(&vertexIterator);
+    return NULL;
+}
 
-    if(isSuccess) {
-        return vertexCount;
-    } else {
-        warning("we had a problem validating vertex attributes");
-        return -1;
+/* Calls the hook for every index below count, split over nThreads threads. Returns
+ * FALSE if the hook failed for any of them. */
+static gboolean _topology_checkInParallel(Topology* top, ElementCheckFunc hook,
+                                          igraph_integer_t count, guint nThreads) {
+    TopologyCheckWork work = {
+        .top = top,
+        .hook = hook,
+        .count = count,
+        .nextIndex = 0,
+        .isSuccess = TRUE,
+    };
+
+    /* no more threads than there are chunks */
+    nThreads = MAX(MIN(nThreads, (guint)(count / TOPOLOGY_CHECK_CHUNK) + 1), 1);
+
+    pthread_t* threads = g_new0(pthread_t, nThreads);
+    for(guint i = 0; i < nThreads; i++) {
+        int rv = pthread_create(&threads[i], NULL, _topology_checkInParallelThread, &work);
+        if(rv != 0) {
+            utility_panic("pthread_create: %s", g_strerror(rv));
+        }
+    }
+    for(guint i = 0; i < nThreads; i++) {
+        int rv = pthread_join(threads[i], NULL);
+        if(rv != 0) {
+            utility_panic("pthread_join: %s", g_strerror(rv));
+        }
     }
+    g_free(threads);
+
+    return g_atomic_int_get(&work.isSuccess);
 }
 
-static gboolean _topology_checkGraphVertices(Topology* top) {
+static gboolean _topology_checkGraphVertices(Topology* top, guint nThreads) {
     MAGIC_ASSERT(top);
 
     info("checking graph vertices...");
 
-    igraph_integer_t vertexCount = _topology_iterateAllVertices(top, _topology_checkGraphVerticesHelperHook, NULL);
-    if(vertexCount < 0) {
-        /* there was some kind of error */
+    top->vertexCount = igraph_vcount(&top->graph);
+    if(!_topology_checkInParallel(
+           top, _topology_checkGraphVerticesHelperHook, top->vertexCount, nThreads)) {
         warning("unable to validate graph vertices");
         return FALSE;
     }
 
-    top->vertexCount = igraph_vcount(&top->graph);
-    if(top->vertexCount != vertexCount) {
-        warning("igraph_vcount %d does not match iterator count %d", top->vertexCount, vertexCount);
-    }
-
     info("%u graph vertices ok", (guint)top->vertexCount);
 
     return TRUE;
@@ -976,75 +1081,103 @@ static gboolean _topology_checkGraphEdgesHelperHook(Topology* top, igraph_intege
     return isSuccess;
 }
 
-static igraph_integer_t _topology_iterateAllEdges(Topology* top, EdgeNotifyFunc hook, gpointer userData) {
+static gboolean _topology_checkGraphEdges(Topology* top, guint nThreads) {
     MAGIC_ASSERT(top);
-    utility_assert(hook);
 
-    gboolean isSuccess = TRUE;
+    info("checking graph edges...");
 
-    /* we will iterate through the edges */
-    igraph_eit_t edgeIterator;
-    gint result = igraph_eit_create(&top->graph, igraph_ess_all(IGRAPH_EDGEORDER_ID), &edgeIterator);
-    if(result != IGRAPH_SUCCESS) {
-        error("igraph_eit_create return non-success code %i", result);
-        return -1;
+    top->edgeCount = igraph_ecount(&top->graph);
+    if(!_topology_checkInParallel(
+           top, _topology_checkGraphEdgesHelperHook, top->edgeCount, nThreads)) {
+        warning("unable to validate graph edges");
+        return FALSE;
     }
 
-    /* count the edges as we iterate */
-    igraph_integer_t edgeCount = 0;
-    while (!IGRAPH_EIT_END(edgeIterator)) {
-        long int edgeIndex = IGRAPH_EIT_GET(edgeIterator);
-
-        /* call the hook function for each edge */
-        if(!hook(top, (igraph_integer_t) edgeIndex, userData)) {
-            isSuccess = FALSE;
-        }
+    info("%u graph edges ok", (guint)top->edgeCount);
 
-        edgeCount++;
-        IGRAPH_EIT_NEXT(edgeIterator);
-    }
+    return TRUE;
+}
 
-    igraph_eit_destroy(&edgeIterator);
+/* A graph that passed validation is marked with a file in the path cache directory, keyed
+ * by the graph and by whether we use shortest paths, which the checks depend on. */
+static gchar* _topology_getValidatedFilePath(Topology* top, const gchar* cacheDirectory) {
+    utility_assert(top->graphChecksum);
 
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (const guchar*)top->graphChecksum, strlen(top->graphChecksum));
 
-    if(isSuccess) {
-        return edgeCount;
-    } else {
-        warning("we had a problem validating edge attributes");
-        return -1;
-    }
-}
+    guint8 useShortestPath = top->useShortestPath ? 1 : 0;
+    g_checksum_update(checksum, &useShortestPath, sizeof(useShortestPath));
 
-static gboolean _topology_checkGraphEdges(Topology* top) {
-    MAGIC_ASSERT(top);
+    gchar* fileName =
+        g_strdup_printf("shadow-topology-%s.validated", g_checksum_get_string(checksum));
+    gchar* filePath = g_build_filename(cacheDirectory, fileName, NULL);
 
-    info("checking graph edges...");
+    g_free(fileName);
+    g_checksum_free(checksum);
+    return filePath;
+}
 
-    igraph_integer_t edgeCount = _topology_iterateAllEdges(top, _topology_checkGraphEdgesHelperHook, NULL);
-    if(edgeCount < 0) {
-        /* there was some kind of error */
-        warning("unable to validate graph edges");
+/* The marker holds whether the graph is complete, which is the only property that the
+ * checks compute rather than just verify. The rest is read from the graph again. */
+static gboolean _topology_loadValidatedFile(Topology* top, const gchar* filePath) {
+    gchar* contents = NULL;
+    if(!g_file_get_contents(filePath, &contents, NULL, NULL)) {
         return FALSE;
     }
 
-    top->edgeCount = igraph_ecount(&top->graph);
-    if(top->edgeCount != edgeCount) {
-        warning("igraph_vcount %d does not match iterator count %d", top->edgeCount, edgeCount);
+    gboolean isValid = TRUE;
+    if(g_str_equal(contents, "complete=1\n")) {
+        top->isComplete = TRUE;
+    } else if(g_str_equal(contents, "complete=0\n")) {
+        top->isComplete = FALSE;
+    } else {
+        warning("ignoring unexpected contents of topology validation marker '%s'", filePath);
+        isValid = FALSE;
     }
+    g_free(contents);
 
-    info("%u graph edges ok", (guint)top->edgeCount);
+    if(isValid) {
+        /* validation fails unless all of these hold */
+        top->isDirected = igraph_is_directed(&top->graph);
+        top->isConnected = TRUE;
+        top->clusterCount = 1;
+        top->vertexCount = igraph_vcount(&top->graph);
+        top->edgeCount = igraph_ecount(&top->graph);
+    }
+    return isValid;
+}
 
-    return TRUE;
+static void _topology_writeValidatedFile(Topology* top, const gchar* filePath) {
+    const gchar* contents = top->isComplete ? "complete=1\n" : "complete=0\n";
+    GError* error = NULL;
+    if(g_file_set_contents(filePath, contents, -1, &error)) {
+        info("saved the topology validation marker to '%s' for later simulations", filePath);
+    } else {
+        warning("unable to save the topology validation marker: %s", error->message);
+        g_error_free(error);
+    }
 }
 
-static gboolean _topology_checkGraph(Topology* top) {
+static gboolean _topology_checkGraph(Topology* top, guint nThreads,
+                                     const gchar* cacheDirectory) {
     gboolean isSuccess = FALSE;
+    nThreads = MAX(nThreads, 1);
 
     g_mutex_lock(&(top->topologyLock));
     _topology_lockGraph(top);
 
-    if(!_topology_checkGraphProperties(top) || !_topology_checkGraphVertices(top) ||
-            !_topology_checkGraphEdges(top)) {
+    gchar* validatedFilePath =
+        cacheDirectory ? _topology_getValidatedFilePath(top, cacheDirectory) : NULL;
+
+    if(validatedFilePath && _topology_loadValidatedFile(top, validatedFilePath)) {
+        isSuccess = TRUE;
+        info("skipped validating the topology, which was validated by an earlier simulation "
+             "according to '%s'",
+             validatedFilePath);
+    } else if(!_topology_checkGraphProperties(top) ||
+              !_topology_checkGraphVertices(top, nThreads) ||
+              !_topology_checkGraphEdges(top, nThreads)) {
         isSuccess = FALSE;
     } else {
         isSuccess = TRUE;
@@ -1054,14 +1187,89 @@ static gboolean _topology_checkGraph(Topology* top) {
              top->clusterCount == 1 ? "cluster" : "clusters", (guint)top->vertexCount,
              top->vertexCount == 1 ? "vertex" : "vertices", (guint)top->edgeCount,
              top->edgeCount == 1 ? "edge" : "edges");
+
+        if(validatedFilePath) {
+            _topology_writeValidatedFile(top, validatedFilePath);
+        }
     }
 
+    g_free(validatedFilePath);
+
     _topology_unlockGraph(top);
     g_mutex_unlock(&(top->topologyLock));
 
     return isSuccess;
 }
 
+/* Parses the attributes of every vertex and edge into top->vertices and top->edges, and
+ * then frees igraph's attribute tables, which hold each value as a string or a double
+ * in a vector per attribute. The graph must already have been checked. */
+static gboolean _topology_compactAttributes(Topology* top) {
+    MAGIC_ASSERT(top);
+
+    _topology_lockGraph(top);
+
+    top->vertices = g_new0(TopologyVertex, top->vertexCount);
+    top->edges = g_new0(TopologyEdge, top->edgeCount);
+    top->attributeStrings = g_string_chunk_new(4096);
+
+    const gchar* bandwidthDownKey = _topology_vertexAttributeToString(VERTEX_ATTR_BANDWIDTHDOWN);
+    const gchar* bandwidthUpKey = _topology_vertexAttributeToString(VERTEX_ATTR_BANDWIDTHUP);
+
+    for (igraph_integer_t vertexIndex = 0; vertexIndex < top->vertexCount; vertexIndex++) {
+        TopologyVertex* vertex = &top->vertices[vertexIndex];
+
+        gdouble id;
+        gboolean found = _topology_findVertexAttributeDouble(top, vertexIndex, VERTEX_ATTR_ID, &id);
+        utility_assert(found);
+        vertex->id = (gint64)id;
+
+        /* the check already made sure these are positive */
+        vertex->bandwidthDown =
+            (guint64)parse_bandwidth(VAS(&top->graph, bandwidthDownKey, vertexIndex));
+        vertex->bandwidthUp =
+            (guint64)parse_bandwidth(VAS(&top->graph, bandwidthUpKey, vertexIndex));
+
+        const gchar* value = NULL;
+        vertex->ip = INADDR_NONE;
+        if (_topology_findVertexAttributeString(
+                top, vertexIndex, VERTEX_ATTR_IP_ADDRESS, &value)) {
+            vertex->ipAddress = g_string_chunk_insert_const(top->attributeStrings, value);
+            vertex->ip = address_stringToIP(value);
+        }
+        if (_topology_findVertexAttributeString(top, vertexIndex, VERTEX_ATTR_CITYCODE, &value)) {
+            vertex->citycode = g_string_chunk_insert_const(top->attributeStrings, value);
+        }
+        if (_topology_findVertexAttributeString(
+                top, vertexIndex, VERTEX_ATTR_COUNTRYCODE, &value)) {
+            vertex->countrycode = g_string_chunk_insert_const(top->attributeStrings, value);
+        }
+    }
+
+    const gchar* latencyKey = _topology_edgeAttributeToString(EDGE_ATTR_LATENCY);
+
+    for (igraph_integer_t edgeIndex = 0; edgeIndex < top->edgeCount; edgeIndex++) {
+        TopologyEdge* edge = &top->edges[edgeIndex];
+
+        edge->latencyNs = parse_time_nanosec(EAS(&top->graph, latencyKey, edgeIndex));
+        utility_assert(edge->latencyNs > 0);
+
+        gboolean found = _topology_findEdgeAttributeDouble(
+            top, edgeIndex, EDGE_ATTR_PACKETLOSS, &edge->packetLoss);
+        utility_assert(found);
+    }
+
+    /* nothing reads the attributes from igraph from now on */
+    igraph_cattribute_remove_all(&top->graph, TRUE, TRUE, TRUE);
+
+    _topology_unlockGraph(top);
+
+    info("converted the attributes of %u vertices and %u edges", (guint)top->vertexCount,
+         (guint)top->edgeCount);
+
+    return TRUE;
+}
+
 static gboolean _topology_extractEdgeWeights(Topology* top) {
     MAGIC_ASSERT(top);
 
@@ -1096,16 +1304,12 @@ static gboolean _topology_extractEdgeWeights(Topology* top) {
         return FALSE;
     }
 
-    /* get the latency string for each edge and convert it to a number */
+    /* the latency of each edge is its weight */
     long edgeCounter = 0;
     while (!IGRAPH_EIT_END(edgeIterator)) {
         igraph_integer_t edgeIndex = IGRAPH_EIT_GET(edgeIterator);
 
-        gdouble edgeLatency = 0.0;
-        gboolean found = _topology_findEdgeAttributeStringTimeMs(
-            top, edgeIndex, EDGE_ATTR_LATENCY, &edgeLatency);
-        utility_assert(found);
-        igraph_vector_set(top->edgeWeights, edgeCounter, edgeLatency);
+        igraph_vector_set(top->edgeWeights, edgeCounter, _topology_getEdgeLatency(top, edgeIndex));
 
         edgeCounter++;
         IGRAPH_EIT_NEXT(edgeIterator);
@@ -1146,6 +1350,7 @@ static void _topology_clearCache(Topology* top) {
         g_hash_table_destroy(top->pathCache);
         top->pathCache = NULL;
     }
+    __atomic_store_n(&top->numCachedPaths, 0, __ATOMIC_RELAXED);
     g_rw_lock_writer_unlock(&(top->pathCacheLock));
 
     /* lock the read on the shortest path info */
@@ -1248,7 +1453,9 @@ static void _topology_storePathInCache(Topology* top, gboolean isDirectPath,
 
     /* store it in the cache. don't bother storing the path for the reverse direction,
      * because we can check both directions for this cached path later. */
-    g_hash_table_replace(srcCache, GINT_TO_POINTER(dstVertexIndex), path);
+    if (g_hash_table_replace(srcCache, GINT_TO_POINTER(dstVertexIndex), path)) {
+        __atomic_store_n(&top->numCachedPaths, top->numCachedPaths + 1, __ATOMIC_RELAXED);
+    }
 
     /* track the minimum network latency in the entire graph */
     if(top->minimumPathLatency == 0 || latencyMS < top->minimumPathLatency) {
@@ -1317,14 +1524,12 @@ static gboolean _topology_computePathProperties(Topology* top, igraph_integer_t
 
     _topology_lockGraph(top);
 
-    gboolean found = _topology_findVertexAttributeDouble(top, srcVertexIndex, VERTEX_ATTR_ID, &srcID);
-    utility_assert(found);
+    srcID = _topology_getVertexID(top, srcVertexIndex);
     g_string_printf(pathStringBuffer, "%li", (long)srcID);
 
     /* get destination properties */
     targetVertexIndex = (igraph_integer_t) igraph_vector_tail(resultPathVertices);
-    found = _topology_findVertexAttributeDouble(top, targetVertexIndex, VERTEX_ATTR_ID, &dstID);
-    utility_assert(found);
+    dstID = _topology_getVertexID(top, targetVertexIndex);
 
     /* the source is in the first position only if we have more than one vertex */
     if(nVertices > 1) {
@@ -1343,9 +1548,7 @@ static gboolean _topology_computePathProperties(Topology* top, igraph_integer_t
         /* get the edge */
         toVertexIndex = igraph_vector_e(resultPathVertices, i);
 
-        double toID;
-        gboolean found = _topology_findVertexAttributeDouble(top, toVertexIndex, VERTEX_ATTR_ID, &toID);
-        utility_assert(found);
+        double toID = _topology_getVertexID(top, toVertexIndex);
 
         igraph_real_t edgeLatency = 0, edgeReliability = 0;
         igraph_integer_t edgeIndex = 0;
@@ -1437,7 +1640,6 @@ static gboolean _topology_computeShortestPathToSelf(Topology* top, igraph_intege
     igraph_real_t oppositeVertexIndexOfMinLatencyEdge = -1;
     gboolean isDirectPath = FALSE;
     gint result = 0;
-    gboolean found = FALSE;
 
     /* iterate over all outgoing edges from vertex, get the shortest, and use it twice */
     _topology_lockGraph(top);
@@ -1465,21 +1667,17 @@ static gboolean _topology_computeShortestPathToSelf(Topology* top, igraph_intege
 
 #ifdef USE_PERF_TIMERS
     /* time the shortest path loop */
-    GTimer* pathTimer = g_timer_new();
+    PerfTimer pathTimer = PERFTIMER_INIT;
+    perftimer_start(&pathTimer);
 #endif
 
     /* keep the min latency and packetloss while iterating */
     while (!IGRAPH_EIT_END(edgeIterator)) {
         igraph_integer_t edgeIndex = IGRAPH_EIT_GET(edgeIterator);
 
-        igraph_real_t edgeLatency = 0.0f;
-        igraph_real_t edgePacketLoss = 0.0f;
+        igraph_real_t edgeLatency = _topology_getEdgeLatency(top, edgeIndex);
         gboolean edgeIsDirect = FALSE;
 
-        /* latency and packet loss are required attributes on edges */
-        found = _topology_findEdgeAttributeStringTimeMs(top, edgeIndex, EDGE_ATTR_LATENCY, &edgeLatency);
-        utility_assert(found);
-
         igraph_integer_t oppositeVertexIndex = -1;
         if (!_topology_getOppositeVertex(&top->graph, edgeIndex, vertexIndex,
                                          &oppositeVertexIndex)) {
@@ -1499,9 +1697,7 @@ static gboolean _topology_computeShortestPathToSelf(Topology* top, igraph_intege
         if (minLatency == -1 || edgeLatency < minLatency) {
             minLatency = edgeLatency;
 
-            found = _topology_findEdgeAttributeDouble(top, edgeIndex, EDGE_ATTR_PACKETLOSS, &edgePacketLoss);
-            utility_assert(found);
-            reliabilityOfMinLatencyEdge = 1.0f - edgePacketLoss;
+            reliabilityOfMinLatencyEdge = _topology_getEdgeReliability(top, edgeIndex);
 
             oppositeVertexIndexOfMinLatencyEdge = oppositeVertexIndex;
             isDirectPath = edgeIsDirect;
@@ -1522,8 +1718,7 @@ static gboolean _topology_computeShortestPathToSelf(Topology* top, igraph_intege
 
 #ifdef USE_PERF_TIMERS
     /* track the time spent running the algorithm */
-    gdouble elapsedSeconds = g_timer_elapsed(pathTimer, NULL);
-    g_timer_destroy(pathTimer);
+    gdouble elapsedSeconds = perftimer_elapsed(&pathTimer);
 #endif
 
     igraph_eit_destroy(&edgeIterator);
@@ -1536,13 +1731,7 @@ static gboolean _topology_computeShortestPathToSelf(Topology* top, igraph_intege
     top->selfPathCount++;
     g_mutex_unlock(&top->topologyLock);
 
-    _topology_lockGraph(top);
-
-    double targetID;
-    found = _topology_findVertexAttributeDouble(top, oppositeVertexIndexOfMinLatencyEdge, VERTEX_ATTR_ID, &targetID);
-    utility_assert(found);
-
-    _topology_unlockGraph(top);
+    gint64 targetID = _topology_getVertexID(top, oppositeVertexIndexOfMinLatencyEdge);
 
     igraph_real_t latency = minLatency;
     igraph_real_t reliability = reliabilityOfMinLatencyEdge;
@@ -1581,15 +1770,8 @@ static gboolean _topology_computeSourcePaths(Topology* top, igraph_integer_t src
     utility_assert(srcVertexIndex >= 0);
     utility_assert(dstVertexIndex >= 0);
 
-    gboolean found;
-    _topology_lockGraph(top);
-    double srcID;
-    found = _topology_findVertexAttributeDouble(top, srcVertexIndex, VERTEX_ATTR_ID, &srcID);
-    utility_assert(found);
-    double dstID;
-    found = _topology_findVertexAttributeDouble(top, dstVertexIndex, VERTEX_ATTR_ID, &dstID);
-    utility_assert(found);
-    _topology_unlockGraph(top);
+    gint64 srcID = _topology_getVertexID(top, srcVertexIndex);
+    gint64 dstID = _topology_getVertexID(top, dstVertexIndex);
 
     debug("requested path between source vertex %li (%li) and destination vertex %li (%li)",
           (glong)srcVertexIndex, (long)srcID, (glong)dstVertexIndex, (long)dstID);
@@ -1673,7 +1855,8 @@ static gboolean _topology_computeSourcePaths(Topology* top, igraph_integer_t src
 
 #ifdef USE_PERF_TIMERS
     /* time the dijkstra algorithm */
-    GTimer* pathTimer = g_timer_new();
+    PerfTimer pathTimer = PERFTIMER_INIT;
+    perftimer_start(&pathTimer);
 #endif
 
     /* run dijkstra's shortest path algorithm */
@@ -1702,16 +1885,12 @@ static gboolean _topology_computeSourcePaths(Topology* top, igraph_integer_t src
 
 #ifdef USE_PERF_TIMERS
     /* track the time spent running the algorithm */
-    gdouble elapsedSeconds = g_timer_elapsed(pathTimer, NULL);
+    gdouble elapsedSeconds = perftimer_elapsed(&pathTimer);
 #endif
 
     g_rw_lock_reader_unlock(&(top->edgeWeightsLock));
     _topology_unlockGraph(top);
 
-#ifdef USE_PERF_TIMERS
-    g_timer_destroy(pathTimer);
-#endif
-
     g_mutex_lock(&top->topologyLock);
 #ifdef USE_PERF_TIMERS
     top->shortestPathTotalTime += elapsedSeconds;
@@ -1759,11 +1938,7 @@ static gboolean _topology_computeSourcePaths(Topology* top, igraph_integer_t src
                     pathStringBuffer, &pathLatency, &pathReliability, &pathTargetIndex);
 
             if(isSuccess) {
-                double targetID;
-                _topology_lockGraph(top);
-                found = _topology_findVertexAttributeDouble(top, pathTargetIndex, VERTEX_ATTR_ID, &targetID);
-                utility_assert(found);
-                _topology_unlockGraph(top);
+                gint64 targetID = _topology_getVertexID(top, pathTargetIndex);
 
                 GString* logMessage = g_string_new(NULL);
 
@@ -1825,17 +2000,11 @@ static gboolean _topology_lookupDirectPath(Topology* top, igraph_integer_t srcVe
 
     igraph_real_t totalLatency = 0.0, totalReliability = 1.0;
     igraph_real_t edgeLatency = 0.0, edgeReliability = 1.0;
-    gboolean found;
-    double srcID;
-    double dstID;
+    gint64 srcID = _topology_getVertexID(top, srcVertexIndex);
+    gint64 dstID = _topology_getVertexID(top, dstVertexIndex);
 
     _topology_lockGraph(top);
 
-    found = _topology_findVertexAttributeDouble(top, srcVertexIndex, VERTEX_ATTR_ID, &srcID);
-    utility_assert(found);
-    found = _topology_findVertexAttributeDouble(top, dstVertexIndex, VERTEX_ATTR_ID, &dstID);
-    utility_assert(found);
-
     gint result = _topology_getEdgeHelper(top, srcVertexIndex, dstVertexIndex, NULL, &edgeLatency, &edgeReliability);
 
     if(result != IGRAPH_SUCCESS) {
@@ -1865,16 +2034,8 @@ static void _topology_logAllCachedPathsHelper2(gpointer dstIndexKey, Path* path,
         igraph_integer_t srcVertexIndex = (igraph_integer_t)path_getSrcVertexIndex(path);
         igraph_integer_t dstVertexIndex = (igraph_integer_t)path_getDstVertexIndex(path);
 
-        gboolean found;
-        double srcID;
-        double dstID;
-
-        _topology_lockGraph(top);
-        found = _topology_findVertexAttributeDouble(top, srcVertexIndex, VERTEX_ATTR_ID, &srcID);
-        utility_assert(found);
-        found = _topology_findVertexAttributeDouble(top, dstVertexIndex, VERTEX_ATTR_ID, &dstID);
-        utility_assert(found);
-        _topology_unlockGraph(top);
+        gint64 srcID = _topology_getVertexID(top, srcVertexIndex);
+        gint64 dstID = _topology_getVertexID(top, dstVertexIndex);
 
         /* log this at debug level so we don't spam the message level logs */
         debug("Found path %li%s%li in cache: %s", (long)srcID, top->isDirected ? "->" : "<->", (long)dstID,
@@ -1897,321 +2058,1681 @@ static void _topology_logAllCachedPaths(Topology* top) {
     }
 }
 
-static Path* _topology_getPathEntry(Topology* top, Address* srcAddress, Address* dstAddress) {
-    MAGIC_ASSERT(top);
+/* a read-only copy of the graph edges in compressed sparse row form, so that paths
+ * can be computed from many threads without holding the graph lock */
+struct _TopologyAdjacency {
+    igraph_integer_t vertexCount;
+    /* the edges leaving vertex v are at positions offsets[v] to offsets[v+1]-1 */
+    glong* offsets;
+    igraph_integer_t* targets;
+    igraph_integer_t* edgeIndices;
+    igraph_real_t* latencies;
+    igraph_real_t* reliabilities;
+    /* only set for dense graphs when computing shortest paths: the latency and reliability
+     * of the shortest edge from u to v at position u * vertexCount + v, with INFINITY
+     * latency if there is none, so that dijkstra can relax a whole row at once */
+    igraph_real_t* denseLatencies;
+    igraph_real_t* denseReliabilities;
+};
 
-    /* get connected points */
-    igraph_integer_t srcVertexIndex = _topology_getConnectedVertexIndex(top, srcAddress);
-    if(srcVertexIndex < 0) {
-        error("invalid vertex %i, source address %s is not connected to topology",
-              (gint)srcVertexIndex, address_toString(srcAddress));
-        return FALSE;
-    }
-    igraph_integer_t dstVertexIndex = _topology_getConnectedVertexIndex(top, dstAddress);
-    if(dstVertexIndex < 0) {
-        error("invalid vertex %i, destination address %s is not connected to topology",
-              (gint)dstVertexIndex, address_toString(dstAddress));
-        return FALSE;
+/* the dense rows take 2 * 8 * vertexCount^2 bytes, 64 MiB at this size */
+#define TOPOLOGY_DENSE_MAX_VERTICES 2048
+
+static void _topologyadjacency_free(TopologyAdjacency* adjacency) {
+    if(adjacency) {
+        g_free(adjacency->offsets);
+        g_free(adjacency->targets);
+        g_free(adjacency->edgeIndices);
+        g_free(adjacency->latencies);
+        g_free(adjacency->reliabilities);
+        g_free(adjacency->denseLatencies);
+        g_free(adjacency->denseReliabilities);
+        g_free(adjacency);
     }
+}
 
-    /* check for a cache hit */
-    Path* path = _topology_getPathFromCache(top, srcVertexIndex, dstVertexIndex);
-    if(!path && !top->isDirected) {
-        path = _topology_getPathFromCache(top, dstVertexIndex, srcVertexIndex);
+/* sets the dense entry from u to v to the first of the shortest edges between them, the
+ * one dijkstra would relax v with when scanning u's edges in order */
+static void _topologyadjacency_setDensePair(TopologyAdjacency* adjacency, igraph_integer_t u,
+                                            igraph_integer_t v) {
+    glong position = (glong)u * adjacency->vertexCount + v;
+    adjacency->denseLatencies[position] = INFINITY;
+    adjacency->denseReliabilities[position] = 0;
+    for(glong i = adjacency->offsets[u]; i < adjacency->offsets[u + 1]; i++) {
+        if(adjacency->targets[i] == v &&
+           adjacency->latencies[i] < adjacency->denseLatencies[position]) {
+            adjacency->denseLatencies[position] = adjacency->latencies[i];
+            adjacency->denseReliabilities[position] = adjacency->reliabilities[i];
+        }
     }
+}
 
-    if(!path) {
-        /* cache miss, lets find the path */
-        gboolean success = FALSE;
+static void _topologyadjacency_buildDense(TopologyAdjacency* adjacency) {
+    igraph_integer_t vertexCount = adjacency->vertexCount;
+    glong nPairs = (glong)vertexCount * vertexCount;
+    adjacency->denseLatencies = g_new(igraph_real_t, nPairs);
+    adjacency->denseReliabilities = g_new0(igraph_real_t, nPairs);
+    for(glong i = 0; i < nPairs; i++) {
+        adjacency->denseLatencies[i] = INFINITY;
+    }
+
+    for(igraph_integer_t u = 0; u < vertexCount; u++) {
+        igraph_real_t* latencies = &adjacency->denseLatencies[(glong)u * vertexCount];
+        igraph_real_t* reliabilities = &adjacency->denseReliabilities[(glong)u * vertexCount];
+        for(glong i = adjacency->offsets[u]; i < adjacency->offsets[u + 1]; i++) {
+            igraph_integer_t v = adjacency->targets[i];
+            if(adjacency->latencies[i] < latencies[v]) {
+                latencies[v] = adjacency->latencies[i];
+                reliabilities[v] = adjacency->reliabilities[i];
+            }
+        }
+    }
+}
 
-        gboolean found;
-        double srcID;
-        double dstID;
+static TopologyAdjacency* _topology_buildAdjacency(Topology* top) {
+    MAGIC_ASSERT(top);
 
-        _topology_lockGraph(top);
-        found = _topology_findVertexAttributeDouble(top, srcVertexIndex, VERTEX_ATTR_ID, &srcID);
-        utility_assert(found);
-        found = _topology_findVertexAttributeDouble(top, dstVertexIndex, VERTEX_ATTR_ID, &dstID);
-        utility_assert(found);
-        _topology_unlockGraph(top);
+    _topology_lockGraph(top);
 
-        gboolean verticesAreAdjacent = _topology_verticesAreAdjacent(top, srcVertexIndex, dstVertexIndex);
+    igraph_integer_t vertexCount = top->vertexCount;
+    igraph_integer_t edgeCount = top->edgeCount;
 
-        debug("We need a path between node %s at %li (vertex %i) and "
-              "node %s at %li (vertex %i), topology properties are: "
-              "isComplete=%s, useShortestPath=%s, verticesAreAdjacent=%s",
-              address_toString(srcAddress), (long)srcID, (gint)srcVertexIndex,
-              address_toString(dstAddress), (long)dstID, (gint)dstVertexIndex,
-              top->isComplete ? "True" : "False", top->useShortestPath ? "True" : "False",
-              verticesAreAdjacent ? "True" : "False");
+    igraph_integer_t* edgeFrom = g_new(igraph_integer_t, MAX(edgeCount, 1));
+    igraph_integer_t* edgeTo = g_new(igraph_integer_t, MAX(edgeCount, 1));
+    igraph_real_t* edgeLatency = g_new(igraph_real_t, MAX(edgeCount, 1));
+    igraph_real_t* edgeReliability = g_new(igraph_real_t, MAX(edgeCount, 1));
 
-        if (!top->useShortestPath) {
-            utility_assert(top->isComplete);
-            /* use the edge between src and dst as the path */
-            success = _topology_lookupDirectPath(top, srcVertexIndex, dstVertexIndex);
+    TopologyAdjacency* adjacency = g_new0(TopologyAdjacency, 1);
+    adjacency->vertexCount = vertexCount;
+    adjacency->offsets = g_new0(glong, vertexCount + 1);
 
-            if(success) {
-                debug("We found a direct path between node %s at %li (vertex %i) and "
-                      "node %s at %li (vertex %i), and stored the path in the cache.",
-                      address_toString(srcAddress), (long)srcID, (gint)srcVertexIndex,
-                      address_toString(dstAddress), (long)dstID, (gint)dstVertexIndex);
-            }
-        } else {
-            success = _topology_computeSourcePaths(top, srcVertexIndex, dstVertexIndex);
+    /* first pass: read the edges in edge id order and count the out-degree of each vertex */
+    for(igraph_integer_t edgeIndex = 0; edgeIndex < edgeCount; edgeIndex++) {
+        gint result = igraph_edge(&top->graph, edgeIndex, &edgeFrom[edgeIndex], &edgeTo[edgeIndex]);
+        if(result != IGRAPH_SUCCESS) {
+            error("igraph_edge return non-success code %i", result);
+            _topology_unlockGraph(top);
+            g_free(edgeFrom);
+            g_free(edgeTo);
+            g_free(edgeLatency);
+            g_free(edgeReliability);
+            _topologyadjacency_free(adjacency);
+            return NULL;
         }
 
-        if(success) {
-            path = _topology_getPathFromCache(top, srcVertexIndex, dstVertexIndex);
-            if(!path) {
-                path = _topology_getPathFromCache(top, dstVertexIndex, srcVertexIndex);
-            }
+        edgeLatency[edgeIndex] = _topology_getEdgeLatency(top, edgeIndex);
+        edgeReliability[edgeIndex] = _topology_getEdgeReliability(top, edgeIndex);
+
+        adjacency->offsets[edgeFrom[edgeIndex] + 1]++;
+        if(!top->isDirected && edgeFrom[edgeIndex] != edgeTo[edgeIndex]) {
+            adjacency->offsets[edgeTo[edgeIndex] + 1]++;
         }
+    }
 
-        if(!path) {
-            /* some error finding the path */
-            utility_panic("unable to find path between node %s at %li (vertex %i) "
-                          "and node %s at %li (vertex %i)",
-                          address_toString(srcAddress), (long)srcID, (gint)srcVertexIndex,
-                          address_toString(dstAddress), (long)dstID, (gint)dstVertexIndex);
+    _topology_unlockGraph(top);
+
+    for(igraph_integer_t v = 0; v < vertexCount; v++) {
+        adjacency->offsets[v + 1] += adjacency->offsets[v];
+    }
+
+    glong nEntries = adjacency->offsets[vertexCount];
+    adjacency->targets = g_new(igraph_integer_t, MAX(nEntries, 1));
+    adjacency->edgeIndices = g_new(igraph_integer_t, MAX(nEntries, 1));
+    adjacency->latencies = g_new(igraph_real_t, MAX(nEntries, 1));
+    adjacency->reliabilities = g_new(igraph_real_t, MAX(nEntries, 1));
+
+    /* second pass: fill in the edges, keeping each vertex's edges in edge id order */
+    glong* next = g_new(glong, vertexCount + 1);
+    memcpy(next, adjacency->offsets, sizeof(glong) * (vertexCount + 1));
+    for(igraph_integer_t edgeIndex = 0; edgeIndex < edgeCount; edgeIndex++) {
+        glong position = next[edgeFrom[edgeIndex]]++;
+        adjacency->targets[position] = edgeTo[edgeIndex];
+        adjacency->edgeIndices[position] = edgeIndex;
+        adjacency->latencies[position] = edgeLatency[edgeIndex];
+        adjacency->reliabilities[position] = edgeReliability[edgeIndex];
+
+        if(!top->isDirected && edgeFrom[edgeIndex] != edgeTo[edgeIndex]) {
+            position = next[edgeTo[edgeIndex]]++;
+            adjacency->targets[position] = edgeFrom[edgeIndex];
+            adjacency->edgeIndices[position] = edgeIndex;
+            adjacency->latencies[position] = edgeLatency[edgeIndex];
+            adjacency->reliabilities[position] = edgeReliability[edgeIndex];
         }
     }
 
+    g_free(next);
+    g_free(edgeFrom);
+    g_free(edgeTo);
+    g_free(edgeLatency);
+    g_free(edgeReliability);
 
-    return path;
+    /* in a graph with edges between most pairs of vertices, such as a complete graph,
+     * scanning a row of a matrix is cheaper than maintaining a heap of the edges */
+    if(top->useShortestPath && vertexCount <= TOPOLOGY_DENSE_MAX_VERTICES &&
+       2 * nEntries >= (glong)vertexCount * vertexCount) {
+        _topologyadjacency_buildDense(adjacency);
+    }
+
+    return adjacency;
 }
 
-void topology_incrementPathPacketCounter(Topology* top, Address* srcAddress, Address* dstAddress) {
-    MAGIC_ASSERT(top);
+typedef struct _TopologyHeapEntry TopologyHeapEntry;
+struct _TopologyHeapEntry {
+    igraph_real_t latency;
+    igraph_integer_t vertexIndex;
+};
 
-    Path* path = _topology_getPathEntry(top, srcAddress, dstAddress);
-    if(path != NULL) {
-        path_incrementPacketCount(path);
-    } else {
-        utility_panic("unable to find path between node %s and node %s",
-                      address_toString(srcAddress), address_toString(dstAddress));
+static void _topology_heapPush(TopologyHeapEntry* heap, glong* heapSize, igraph_real_t latency,
+                               igraph_integer_t vertexIndex) {
+    glong i = (*heapSize)++;
+    while(i > 0 && heap[(i - 1) / 2].latency > latency) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
     }
+    heap[i].latency = latency;
+    heap[i].vertexIndex = vertexIndex;
 }
 
-gdouble topology_getLatency(Topology* top, Address* srcAddress, Address* dstAddress) {
-    MAGIC_ASSERT(top);
+static TopologyHeapEntry _topology_heapPop(TopologyHeapEntry* heap, glong* heapSize) {
+    TopologyHeapEntry head = heap[0];
+    TopologyHeapEntry last = heap[--(*heapSize)];
+    glong i = 0;
+    while(TRUE) {
+        glong child = 2 * i + 1;
+        if(child >= *heapSize) {
+            break;
+        }
+        if(child + 1 < *heapSize && heap[child + 1].latency < heap[child].latency) {
+            child++;
+        }
+        if(heap[child].latency >= last.latency) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return head;
+}
 
-    Path* path = _topology_getPathEntry(top, srcAddress, dstAddress);
+/* scratch space used by one thread while it computes shortest paths */
+typedef struct _TopologyPathSearch TopologyPathSearch;
+struct _TopologyPathSearch {
+    igraph_real_t* latencies;
+    igraph_real_t* reliabilities;
+    gboolean* isDone;
+    /* only one of these is set, depending on whether the adjacency is dense */
+    TopologyHeapEntry* heap;
+    igraph_real_t* tentativeLatencies;
+};
 
-    if(path != NULL) {
-        return path_getLatency(path);
+static TopologyPathSearch* _topologypathsearch_new(TopologyAdjacency* adjacency) {
+    TopologyPathSearch* search = g_new0(TopologyPathSearch, 1);
+    search->latencies = g_new(igraph_real_t, MAX(adjacency->vertexCount, 1));
+    search->reliabilities = g_new(igraph_real_t, MAX(adjacency->vertexCount, 1));
+    search->isDone = g_new(gboolean, MAX(adjacency->vertexCount, 1));
+    if(adjacency->denseLatencies) {
+        search->tentativeLatencies = g_new(igraph_real_t, MAX(adjacency->vertexCount, 1));
     } else {
-        return (gdouble) -1;
+        /* dijkstra with lazy deletion adds at most one heap entry per edge */
+        search->heap = g_new(TopologyHeapEntry, adjacency->offsets[adjacency->vertexCount] + 1);
     }
+    return search;
 }
 
-gdouble topology_getReliability(Topology* top, Address* srcAddress, Address* dstAddress) {
-    MAGIC_ASSERT(top);
-
-    Path* path = _topology_getPathEntry(top, srcAddress, dstAddress);
-
-    if(path != NULL) {
-        return path_getReliability(path);
-    } else {
-        return (gdouble) -1;
+static void _topologypathsearch_free(TopologyPathSearch* search) {
+    if(search) {
+        g_free(search->latencies);
+        g_free(search->reliabilities);
+        g_free(search->isDone);
+        g_free(search->heap);
+        g_free(search->tentativeLatencies);
+        g_free(search);
     }
 }
 
-gboolean topology_isRoutable(Topology* top, Address* srcAddress, Address* dstAddress) {
+/* same as _topology_computeShortestPathToSelf: use the self-loop or the shortest
+ * outgoing edge twice, whichever is shorter */
+static void _topology_findSelfPath(TopologyAdjacency* adjacency, igraph_integer_t vertexIndex,
+                                   igraph_real_t* latencyOut, igraph_real_t* reliabilityOut,
+                                   gboolean* isDirectOut) {
+    igraph_real_t minLatency = -1.0f;
+    igraph_real_t reliability = 0.0f;
+    gboolean isDirectPath = FALSE;
+
+    for(glong i = adjacency->offsets[vertexIndex]; i < adjacency->offsets[vertexIndex + 1]; i++) {
+        gboolean isDirect = (adjacency->targets[i] == vertexIndex);
+        igraph_real_t latency = isDirect ? adjacency->latencies[i] : 2 * adjacency->latencies[i];
+
+        if(minLatency == -1 || latency < minLatency) {
+            minLatency = latency;
+            reliability = isDirect ? adjacency->reliabilities[i] :
+                                     adjacency->reliabilities[i] * adjacency->reliabilities[i];
+            isDirectPath = isDirect;
+        }
+    }
+
+    /* if the vertex had no edges */
+    if(minLatency == -1) {
+        minLatency = 0;
+        isDirectPath = TRUE;
+    }
+
+    *latencyOut = minLatency;
+    *reliabilityOut = reliability;
+    *isDirectOut = isDirectPath;
+}
+
+/* dijkstra without a heap: each step scans for the closest vertex that isn't done and
+ * relaxes its whole row of the dense matrix. the loops have no data-dependent branches,
+ * so that the compiler can vectorize them. */
+static void _topology_searchShortestPathsDense(TopologyAdjacency* adjacency,
+                                               TopologyPathSearch* search,
+                                               igraph_integer_t srcVertexIndex) {
+    igraph_integer_t vertexCount = adjacency->vertexCount;
+    /* the vertices that are done have a tentative latency of -INFINITY, so that relaxing
+     * never changes them, and the ones that weren't reached yet have INFINITY */
+    igraph_real_t* tentative = search->tentativeLatencies;
+    igraph_real_t* reliabilities = search->reliabilities;
+
+    for(igraph_integer_t v = 0; v < vertexCount; v++) {
+        search->latencies[v] = -1;
+        reliabilities[v] = 0;
+        tentative[v] = INFINITY;
+    }
+    tentative[srcVertexIndex] = 0;
+    reliabilities[srcVertexIndex] = 1;
+
+    while(TRUE) {
+        igraph_integer_t u = -1;
+        igraph_real_t latency = INFINITY;
+        for(igraph_integer_t v = 0; v < vertexCount; v++) {
+            gboolean isCloser = tentative[v] < latency && tentative[v] != -INFINITY;
+            u = isCloser ? v : u;
+            latency = isCloser ? tentative[v] : latency;
+        }
+        if(u == -1) {
+            /* the remaining vertices are unreachable */
+            break;
+        }
+
+        search->latencies[u] = latency;
+        tentative[u] = -INFINITY;
+
+        const igraph_real_t* rowLatencies = &adjacency->denseLatencies[(glong)u * vertexCount];
+        const igraph_real_t* rowReliabilities =
+            &adjacency->denseReliabilities[(glong)u * vertexCount];
+        igraph_real_t reliability = reliabilities[u];
+        for(igraph_integer_t v = 0; v < vertexCount; v++) {
+            igraph_real_t candidate = latency + rowLatencies[v];
+            gboolean isShorter = candidate < tentative[v];
+            tentative[v] = isShorter ? candidate : tentative[v];
+            reliabilities[v] = isShorter ? reliability * rowReliabilities[v] : reliabilities[v];
+        }
+    }
+}
+
+/* runs dijkstra from srcVertexIndex. afterwards, the latency and reliability of the shortest
+ * path to each vertex are in the search arrays, with a latency of -1 if it is unreachable. */
+static void _topology_searchShortestPaths(TopologyAdjacency* adjacency, TopologyPathSearch* search,
+                                          igraph_integer_t srcVertexIndex) {
+    if(adjacency->denseLatencies) {
+        _topology_searchShortestPathsDense(adjacency, search, srcVertexIndex);
+        return;
+    }
+
+    for(igraph_integer_t v = 0; v < adjacency->vertexCount; v++) {
+        search->latencies[v] = -1;
+        search->reliabilities[v] = 0;
+        search->isDone[v] = FALSE;
+    }
+
+    glong heapSize = 0;
+    search->latencies[srcVertexIndex] = 0;
+    search->reliabilities[srcVertexIndex] = 1;
+    _topology_heapPush(search->heap, &heapSize, 0, srcVertexIndex);
+
+    while(heapSize > 0) {
+        TopologyHeapEntry entry = _topology_heapPop(search->heap, &heapSize);
+        igraph_integer_t u = entry.vertexIndex;
+        if(search->isDone[u]) {
+            continue;
+        }
+        search->isDone[u] = TRUE;
+
+        for(glong i = adjacency->offsets[u]; i < adjacency->offsets[u + 1]; i++) {
+            igraph_integer_t v = adjacency->targets[i];
+            igraph_real_t latency = search->latencies[u] + adjacency->latencies[i];
+            if(!search->isDone[v] && (search->latencies[v] == -1 || latency < search->latencies[v])) {
+                search->latencies[v] = latency;
+                search->reliabilities[v] = search->reliabilities[u] * adjacency->reliabilities[i];
+                _topology_heapPush(search->heap, &heapSize, latency, v);
+            }
+        }
+    }
+}
+
+static void _topology_fillSelfPath(Topology* top, TopologyAdjacency* adjacency,
+                                   igraph_integer_t vertexIndex) {
+    igraph_real_t latency = 0, reliability = 0;
+    gboolean isDirect = FALSE;
+    _topology_findSelfPath(adjacency, vertexIndex, &latency, &reliability, &isDirect);
+    pathmatrix_setPath(top->pathMatrix, vertexIndex, vertexIndex, latency, reliability);
+}
+
+static void _topology_fillDirectPaths(Topology* top, TopologyAdjacency* adjacency,
+                                      igraph_integer_t srcVertexIndex) {
+    /* same as _topology_lookupDirectPath: use the first edge between each pair */
+    for(glong i = adjacency->offsets[srcVertexIndex]; i < adjacency->offsets[srcVertexIndex + 1]; i++) {
+        igraph_integer_t dstVertexIndex = adjacency->targets[i];
+        if(pathmatrix_containsVertex(top->pathMatrix, dstVertexIndex) &&
+           !pathmatrix_getPath(top->pathMatrix, srcVertexIndex, dstVertexIndex, NULL, NULL)) {
+            pathmatrix_setPath(top->pathMatrix, srcVertexIndex, dstVertexIndex,
+                               adjacency->latencies[i], adjacency->reliabilities[i]);
+        }
+    }
+}
+
+static void _topology_fillShortestPaths(Topology* top, TopologyAdjacency* adjacency,
+                                        TopologyPathSearch* search, igraph_integer_t srcVertexIndex) {
+    _topology_searchShortestPaths(adjacency, search, srcVertexIndex);
+
+    guint size = pathmatrix_getSize(top->pathMatrix);
+    for(guint position = 0; position < size; position++) {
+        igraph_integer_t dstVertexIndex = (igraph_integer_t)pathmatrix_getVertexIndex(top->pathMatrix, position);
+        if(dstVertexIndex == srcVertexIndex || search->latencies[dstVertexIndex] == -1) {
+            /* self paths are handled separately, and unreachable paths are left unset */
+            continue;
+        }
+
+        igraph_real_t latency = search->latencies[dstVertexIndex];
+        if(latency == 0) {
+            /* same as _topology_computeSourcePaths */
+            latency = 1;
+        }
+        pathmatrix_setPath(top->pathMatrix, srcVertexIndex, dstVertexIndex, latency,
+                           search->reliabilities[dstVertexIndex]);
+    }
+}
+
+typedef struct _TopologyPathMatrixWork TopologyPathMatrixWork;
+struct _TopologyPathMatrixWork {
+    Topology* top;
+    TopologyAdjacency* adjacency;
+    /* the next matrix row that needs to be filled, shared by all threads */
+    gint nextPosition;
+};
+
+static void* _topology_fillPathMatrixThread(void* voidWork) {
+    TopologyPathMatrixWork* work = voidWork;
+    Topology* top = work->top;
+    TopologyAdjacency* adjacency = work->adjacency;
+
+    TopologyPathSearch* search = top->useShortestPath ? _topologypathsearch_new(adjacency) : NULL;
+
+    guint size = pathmatrix_getSize(top->pathMatrix);
+    gint position;
+    while((position = g_atomic_int_add(&work->nextPosition, 1)) < (gint)size) {
+        igraph_integer_t srcVertexIndex = (igraph_integer_t)pathmatrix_getVertexIndex(top->pathMatrix, position);
+        if(top->useShortestPath) {
+            _topology_fillSelfPath(top, adjacency, srcVertexIndex);
+            _topology_fillShortestPaths(top, adjacency, search, srcVertexIndex);
+        } else {
+            _topology_fillDirectPaths(top, adjacency, srcVertexIndex);
+        }
+    }
+
+    _topologypathsearch_free(search);
+
+    return NULL;
+}
+
+/* state shared by all threads while they fill the path cache in parallel */
+struct _TopologyPrecompute {
+    TopologyAdjacency* adjacency;
+    /* the vertices with attached hosts, and a vertexCount-sized lookup of the same */
+    igraph_integer_t* vertexIndices;
+    guint nVertices;
+    gboolean* isTarget;
+    /* the next source vertex that needs its paths computed */
+    gint nextPosition;
+    GTimer* wallTimer;
+};
+
+static void _topology_cacheSourcePaths(Topology* top, TopologyPrecompute* precompute,
+                                       TopologyPathSearch* search, igraph_integer_t srcVertexIndex) {
+    MAGIC_ASSERT(top);
+    TopologyAdjacency* adjacency = precompute->adjacency;
+
+    if(!top->useShortestPath) {
+        /* same as _topology_lookupDirectPath. the cache keeps the first edge between each
+         * pair since it never replaces an existing entry. */
+        for(glong i = adjacency->offsets[srcVertexIndex]; i < adjacency->offsets[srcVertexIndex + 1]; i++) {
+            igraph_integer_t dstVertexIndex = adjacency->targets[i];
+            if(precompute->isTarget[dstVertexIndex]) {
+                _topology_storePathInCache(top, TRUE, srcVertexIndex, dstVertexIndex,
+                                           adjacency->latencies[i], adjacency->reliabilities[i]);
+            }
+        }
+        return;
+    }
+
+#ifdef USE_PERF_TIMERS
+    /* time the shortest path search */
+    PerfTimer pathTimer = PERFTIMER_INIT;
+    perftimer_start(&pathTimer);
+#endif
+
+    igraph_real_t selfLatency = 0, selfReliability = 0;
+    gboolean selfIsDirect = FALSE;
+    _topology_findSelfPath(adjacency, srcVertexIndex, &selfLatency, &selfReliability, &selfIsDirect);
+    _topology_searchShortestPaths(adjacency, search, srcVertexIndex);
+
+#ifdef USE_PERF_TIMERS
+    gdouble elapsedSeconds = perftimer_elapsed(&pathTimer);
+#endif
+
+    g_mutex_lock(&top->topologyLock);
+#ifdef USE_PERF_TIMERS
+    top->shortestPathTotalTime += elapsedSeconds;
+#endif
+    top->shortestPathCount++;
+    top->selfPathCount++;
+    g_mutex_unlock(&top->topologyLock);
+
+    _topology_storePathInCache(top, selfIsDirect, srcVertexIndex, srcVertexIndex, selfLatency, selfReliability);
+
+    for(guint position = 0; position < precompute->nVertices; position++) {
+        igraph_integer_t dstVertexIndex = precompute->vertexIndices[position];
+        if(dstVertexIndex == srcVertexIndex || search->latencies[dstVertexIndex] == -1) {
+            /* unreachable paths are left out, as in _topology_computeSourcePaths */
+            continue;
+        }
+
+        igraph_real_t latency = search->latencies[dstVertexIndex];
+        if(latency == 0) {
+            /* same as _topology_computeSourcePaths */
+            latency = 1;
+        }
+        _topology_storePathInCache(top, FALSE, srcVertexIndex, dstVertexIndex, latency,
+                                   search->reliabilities[dstVertexIndex]);
+    }
+}
+
+void topology_startPrecomputingPaths(Topology* top) {
+    MAGIC_ASSERT(top);
+    utility_assert(top->precompute == NULL);
+
+    if(top->pathMatrix) {
+        info("not precomputing the path cache since the path matrix is used instead");
+        return;
+    }
+
+    TopologyAdjacency* adjacency = _topology_buildAdjacency(top);
+    if(!adjacency) {
+        utility_panic("unable to read the topology edges to precompute paths");
+    }
+
+    TopologyPrecompute* precompute = g_new0(TopologyPrecompute, 1);
+    precompute->adjacency = adjacency;
+    precompute->isTarget = g_new0(gboolean, MAX(adjacency->vertexCount, 1));
+
+    GQueue* attachedTargets = _topology_getUniqueVertexTargets(top);
+    precompute->nVertices = g_queue_get_length(attachedTargets);
+    precompute->vertexIndices = g_new(igraph_integer_t, MAX(precompute->nVertices, 1));
+    for(guint i = 0; i < precompute->nVertices; i++) {
+        // Note that the pointer can be NULL because 0 is a valid vertex index.
+        igraph_integer_t vertexIndex = (igraph_integer_t)GPOINTER_TO_INT(g_queue_pop_head(attachedTargets));
+        utility_assert(vertexIndex >= 0 && vertexIndex < adjacency->vertexCount);
+        precompute->vertexIndices[i] = vertexIndex;
+        precompute->isTarget[vertexIndex] = TRUE;
+    }
+    g_queue_free(attachedTargets);
+
+    info("precomputing the %s paths from all %u vertices with attached hosts",
+         top->useShortestPath ? "shortest" : "direct", precompute->nVertices);
+
+    precompute->wallTimer = g_timer_new();
+    top->precompute = precompute;
+}
+
+void topology_precomputePaths(Topology* top) {
+    MAGIC_ASSERT(top);
+
+    TopologyPrecompute* precompute = top->precompute;
+    if(!precompute) {
+        return;
+    }
+
+    TopologyPathSearch* search =
+        top->useShortestPath ? _topologypathsearch_new(precompute->adjacency) : NULL;
+
+    gint position;
+    while((position = g_atomic_int_add(&precompute->nextPosition, 1)) < (gint)precompute->nVertices) {
+        _topology_cacheSourcePaths(top, precompute, search, precompute->vertexIndices[position]);
+    }
+
+    _topologypathsearch_free(search);
+}
+
+void topology_finishPrecomputingPaths(Topology* top) {
+    MAGIC_ASSERT(top);
+
+    TopologyPrecompute* precompute = top->precompute;
+    if(!precompute) {
+        return;
+    }
+    top->precompute = NULL;
+
+    gdouble elapsedSeconds = g_timer_elapsed(precompute->wallTimer, NULL);
+    g_timer_destroy(precompute->wallTimer);
+
+    g_mutex_lock(&top->topologyLock);
+#ifdef USE_PERF_TIMERS
+    info("precomputed paths from %u vertices in %f seconds, spent %f seconds computing %u "
+         "shortest paths in total",
+         precompute->nVertices, elapsedSeconds, top->shortestPathTotalTime, top->shortestPathCount);
+#else
+    info("precomputed paths from %u vertices in %f seconds, computed %u shortest paths in total",
+         precompute->nVertices, elapsedSeconds, top->shortestPathCount);
+#endif
+    g_mutex_unlock(&top->topologyLock);
+
+    _topologyadjacency_free(precompute->adjacency);
+    g_free(precompute->vertexIndices);
+    g_free(precompute->isTarget);
+    g_free(precompute);
+}
+
+static gboolean _topology_getPathFromMatrixAt(Topology* top, Address* srcAddress,
+                                              igraph_integer_t srcVertexIndex, Address* dstAddress,
+                                              igraph_integer_t dstVertexIndex, gdouble* latencyOut,
+                                              gdouble* reliabilityOut) {
+    MAGIC_ASSERT(top);
+
+    if(!pathmatrix_getPath(top->pathMatrix, srcVertexIndex, dstVertexIndex, latencyOut, reliabilityOut)) {
+        utility_panic("unable to find path between node %s at vertex %i and node %s at vertex %i "
+                      "in the path matrix",
+                      address_toString(srcAddress), (gint)srcVertexIndex,
+                      address_toString(dstAddress), (gint)dstVertexIndex);
+    }
+
+    return TRUE;
+}
+
+static gboolean _topology_getPathFromMatrix(Topology* top, Address* srcAddress, Address* dstAddress,
+                                            gdouble* latencyOut, gdouble* reliabilityOut) {
+    MAGIC_ASSERT(top);
+
+    igraph_integer_t srcVertexIndex = _topology_getConnectedVertexIndex(top, srcAddress);
+    if(srcVertexIndex < 0) {
+        error("invalid vertex %i, source address %s is not connected to topology",
+              (gint)srcVertexIndex, address_toString(srcAddress));
+        return FALSE;
+    }
+    igraph_integer_t dstVertexIndex = _topology_getConnectedVertexIndex(top, dstAddress);
+    if(dstVertexIndex < 0) {
+        error("invalid vertex %i, destination address %s is not connected to topology",
+              (gint)dstVertexIndex, address_toString(dstAddress));
+        return FALSE;
+    }
+
+    return _topology_getPathFromMatrixAt(top, srcAddress, srcVertexIndex, dstAddress,
+                                         dstVertexIndex, latencyOut, reliabilityOut);
+}
+
+/* fills the already allocated top->pathMatrix from the graph using nThreads threads */
+static void _topology_fillPathMatrix(Topology* top, guint nThreads) {
+    TopologyAdjacency* adjacency = _topology_buildAdjacency(top);
+    if(!adjacency) {
+        utility_panic("unable to read the topology edges to compute the path matrix");
+    }
+
+    info("computing the %s paths between all %u vertices with attached hosts using %u threads",
+         top->useShortestPath ? "shortest" : "direct", pathmatrix_getSize(top->pathMatrix),
+         nThreads);
+
+    TopologyPathMatrixWork work = {
+        .top = top,
+        .adjacency = adjacency,
+        .nextPosition = 0,
+    };
+
+    pthread_t* threads = g_new0(pthread_t, nThreads);
+    for(guint i = 0; i < nThreads; i++) {
+        int rv = pthread_create(&threads[i], NULL, _topology_fillPathMatrixThread, &work);
+        if(rv != 0) {
+            utility_panic("pthread_create: %s", g_strerror(rv));
+        }
+    }
+    for(guint i = 0; i < nThreads; i++) {
+        int rv = pthread_join(threads[i], NULL);
+        if(rv != 0) {
+            utility_panic("pthread_join: %s", g_strerror(rv));
+        }
+    }
+    g_free(threads);
+
+    _topologyadjacency_free(adjacency);
+}
+
+/* The file name is keyed by everything that affects the matrix contents, so that a
+ * changed graph or host layout never loads stale paths. */
+static gchar* _topology_getPathMatrixFilePath(Topology* top, const gchar* cacheDirectory,
+                                              const gint64* vertexIndices, guint nVertices) {
+    utility_assert(top->graphChecksum);
+
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (const guchar*)top->graphChecksum, strlen(top->graphChecksum));
+
+    guint8 useShortestPath = top->useShortestPath ? 1 : 0;
+    g_checksum_update(checksum, &useShortestPath, sizeof(useShortestPath));
+    g_checksum_update(checksum, (const guchar*)&nVertices, sizeof(nVertices));
+    if(nVertices > 0) {
+        g_checksum_update(checksum, (const guchar*)vertexIndices, nVertices * sizeof(gint64));
+    }
+
+    gchar* fileName = g_strdup_printf("shadow-paths-%s.cache", g_checksum_get_string(checksum));
+    gchar* filePath = g_build_filename(cacheDirectory, fileName, NULL);
+
+    g_free(fileName);
+    g_checksum_free(checksum);
+    return filePath;
+}
+
+void topology_computePathMatrix(Topology* top, guint nThreads, const gchar* cacheDirectory) {
+    MAGIC_ASSERT(top);
+    utility_assert(top->pathMatrix == NULL);
+    nThreads = MAX(nThreads, 1);
+
+    /* the matrix only covers vertices that have hosts attached to them */
+    GQueue* attachedTargets = _topology_getUniqueVertexTargets(top);
+    guint nTargets = g_queue_get_length(attachedTargets);
+    gint64* vertexIndices = g_new(gint64, MAX(nTargets, 1));
+    for(guint i = 0; i < nTargets; i++) {
+        // Note that the pointer can be NULL because 0 is a valid vertex index.
+        vertexIndices[i] = (gint64)GPOINTER_TO_INT(g_queue_pop_head(attachedTargets));
+    }
+    g_queue_free(attachedTargets);
+
+    /* we assume that vertex indices increase from 0, check that here */
+    utility_assert(igraph_vcount(&top->graph) == top->vertexCount);
+
+    GTimer* pathTimer = g_timer_new();
+    gchar* cacheFilePath = NULL;
+
+    if(cacheDirectory) {
+        cacheFilePath =
+            _topology_getPathMatrixFilePath(top, cacheDirectory, vertexIndices, nTargets);
+        top->pathMatrix = pathmatrix_newFromFile(
+            cacheFilePath, (gint64)top->vertexCount, vertexIndices, nTargets);
+    }
+
+    if(top->pathMatrix) {
+        info("loaded the paths between all %u vertices with attached hosts from '%s'", nTargets,
+             cacheFilePath);
+    } else {
+        top->pathMatrix = pathmatrix_new((gint64)top->vertexCount, vertexIndices, nTargets);
+        _topology_fillPathMatrix(top, nThreads);
+
+        g_mutex_lock(&top->topologyLock);
+        if(top->useShortestPath) {
+            top->shortestPathCount += nTargets;
+            top->selfPathCount += nTargets;
+        }
+        g_mutex_unlock(&top->topologyLock);
+
+        if(cacheFilePath && pathmatrix_writeFile(top->pathMatrix, cacheFilePath)) {
+            info("saved the path matrix to '%s' for later simulations", cacheFilePath);
+        }
+    }
+
+    g_free(vertexIndices);
+    g_free(cacheFilePath);
+
+    gdouble elapsedSeconds = g_timer_elapsed(pathTimer, NULL);
+    g_timer_destroy(pathTimer);
+
+    /* track the minimum network latency in the entire graph */
+    gdouble minimumPathLatency = 0;
+    for(guint i = 0; i < nTargets; i++) {
+        for(guint j = 0; j < nTargets; j++) {
+            gdouble latency = 0;
+            if(pathmatrix_getPath(top->pathMatrix, pathmatrix_getVertexIndex(top->pathMatrix, i),
+                                  pathmatrix_getVertexIndex(top->pathMatrix, j), &latency, NULL) &&
+               latency > 0 && (minimumPathLatency == 0 || latency < minimumPathLatency)) {
+                minimumPathLatency = latency;
+            }
+        }
+    }
+
+    g_rw_lock_writer_lock(&(top->pathCacheLock));
+    top->minimumPathLatency = minimumPathLatency;
+    g_rw_lock_writer_unlock(&(top->pathCacheLock));
+
+#ifdef USE_PERF_TIMERS
+    g_mutex_lock(&top->topologyLock);
+    top->shortestPathTotalTime += elapsedSeconds;
+    g_mutex_unlock(&top->topologyLock);
+#endif
+
+    info("set up path matrix for %u vertices in %f seconds, minimum path latency is %f ms",
+         nTargets, elapsedSeconds, minimumPathLatency);
+}
+
+static void _topology_buildVertexIndexByID(Topology* top) {
+    MAGIC_ASSERT(top);
+
+    /* the keys point at the IDs in top->vertices */
+    top->vertexIndexByID = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+    for(igraph_integer_t vertexIndex = 0; vertexIndex < top->vertexCount; vertexIndex++) {
+        g_hash_table_replace(top->vertexIndexByID, &top->vertices[vertexIndex].id,
+                             GINT_TO_POINTER(vertexIndex));
+    }
+}
+
+/* looks up the vertices and the edge that change refers to, returning FALSE if there is no
+ * such edge */
+static gboolean _topology_findChangedEdge(Topology* top, const TopologyEdgeChange* change,
+                                          igraph_integer_t* srcVertexIndexOut,
+                                          igraph_integer_t* dstVertexIndexOut,
+                                          igraph_integer_t* edgeIndexOut) {
+    MAGIC_ASSERT(top);
+
+    if(!top->vertexIndexByID) {
+        _topology_buildVertexIndexByID(top);
+    }
+
+    gpointer srcPtr = NULL, dstPtr = NULL;
+    if(!g_hash_table_lookup_extended(top->vertexIndexByID, &change->srcVertexID, NULL, &srcPtr) ||
+       !g_hash_table_lookup_extended(top->vertexIndexByID, &change->dstVertexID, NULL, &dstPtr)) {
+        return FALSE;
+    }
+
+    igraph_integer_t edgeIndex = -1;
+    _topology_lockGraph(top);
+    gint result = _topology_getEdgeHelper(top, (igraph_integer_t)GPOINTER_TO_INT(srcPtr),
+                                          (igraph_integer_t)GPOINTER_TO_INT(dstPtr), &edgeIndex,
+                                          NULL, NULL);
+    _topology_unlockGraph(top);
+
+    if(result != IGRAPH_SUCCESS || edgeIndex < 0) {
+        return FALSE;
+    }
+
+    *srcVertexIndexOut = (igraph_integer_t)GPOINTER_TO_INT(srcPtr);
+    *dstVertexIndexOut = (igraph_integer_t)GPOINTER_TO_INT(dstPtr);
+    *edgeIndexOut = edgeIndex;
+    return TRUE;
+}
+
+gboolean topology_isValidEdgeChange(Topology* top, const TopologyEdgeChange* change) {
+    MAGIC_ASSERT(top);
+    igraph_integer_t srcVertexIndex = -1, dstVertexIndex = -1, edgeIndex = -1;
+    return change->packetLoss <= 1.0 &&
+           _topology_findChangedEdge(top, change, &srcVertexIndex, &dstVertexIndex, &edgeIndex);
+}
+
+/* writes the edge's new properties to the edges, the edge weights, and the adjacency */
+static void _topology_setEdgeProperties(Topology* top, igraph_integer_t srcVertexIndex,
+                                        igraph_integer_t dstVertexIndex,
+                                        igraph_integer_t edgeIndex, igraph_real_t latency,
+                                        igraph_real_t reliability) {
+    MAGIC_ASSERT(top);
+
+    top->edges[edgeIndex].latencyNs = (gint64)llround(latency * 1000000.0);
+    top->edges[edgeIndex].packetLoss = 1.0 - reliability;
+
+    g_rw_lock_writer_lock(&(top->edgeWeightsLock));
+    igraph_vector_set(top->edgeWeights, edgeIndex, latency);
+    g_rw_lock_writer_unlock(&(top->edgeWeightsLock));
+
+    TopologyAdjacency* adjacency = top->adjacency;
+    igraph_integer_t rows[2] = {srcVertexIndex, dstVertexIndex};
+    for(gint r = 0; r < 2; r++) {
+        for(glong i = adjacency->offsets[rows[r]]; i < adjacency->offsets[rows[r] + 1]; i++) {
+            if(adjacency->edgeIndices[i] == edgeIndex) {
+                adjacency->latencies[i] = latency;
+                adjacency->reliabilities[i] = reliability;
+            }
+        }
+    }
+    if(adjacency->denseLatencies) {
+        _topologyadjacency_setDensePair(adjacency, srcVertexIndex, dstVertexIndex);
+        _topologyadjacency_setDensePair(adjacency, dstVertexIndex, srcVertexIndex);
+    }
+}
+
+/* Marks the sources whose shortest paths may change when the latency of the edge between
+ * vertices u and v changes from oldLatency to newLatency, or when its reliability changes.
+ * uLatencies and vLatencies are the path latencies from u and v before the change. In an
+ * undirected graph a source's paths can only change if the edge is on one of its shortest
+ * paths, or if the new latency makes a path through the edge shorter than the current one. */
+static void _topology_markAffectedSources(igraph_integer_t vertexCount,
+                                          const igraph_real_t* uLatencies,
+                                          const igraph_real_t* vLatencies, igraph_real_t oldLatency,
+                                          igraph_real_t newLatency, gboolean* isAffected) {
+    for(igraph_integer_t s = 0; s < vertexCount; s++) {
+        igraph_real_t du = uLatencies[s], dv = vLatencies[s];
+        if(isAffected[s] || du == -1 || dv == -1) {
+            continue;
+        }
+
+        /* allow for rounding in the sums of the latencies */
+        igraph_real_t epsilon = 1e-9 * MAX(1.0, MAX(du, dv));
+        gboolean isOnShortestPath =
+            fabs(du + oldLatency - dv) <= epsilon || fabs(dv + oldLatency - du) <= epsilon;
+        gboolean isNowShorter = newLatency < oldLatency && (du + newLatency < dv + epsilon ||
+                                                            dv + newLatency < du + epsilon);
+
+        isAffected[s] = isOnShortestPath || isNowShorter;
+    }
+}
+
+static void _topology_trackMinimumLatency(igraph_real_t latency, gdouble* minimumLatency) {
+    if(latency > 0 && (*minimumLatency == 0 || latency < *minimumLatency)) {
+        *minimumLatency = latency;
+    }
+}
+
+/* recomputes the paths in the matrix row of an affected source */
+static void _topology_updateMatrixPaths(Topology* top, TopologyPathSearch* search,
+                                        igraph_integer_t srcVertexIndex, gdouble* minimumLatency) {
+    _topology_fillSelfPath(top, top->adjacency, srcVertexIndex);
+    _topology_fillShortestPaths(top, top->adjacency, search, srcVertexIndex);
+
+    guint size = pathmatrix_getSize(top->pathMatrix);
+    for(guint position = 0; position < size; position++) {
+        gdouble latency = 0;
+        if(pathmatrix_getPath(top->pathMatrix, srcVertexIndex,
+                              pathmatrix_getVertexIndex(top->pathMatrix, position), &latency,
+                              NULL)) {
+            _topology_trackMinimumLatency(latency, minimumLatency);
+        }
+    }
+}
+
+/* recomputes the cached paths that start or, in an undirected graph, end at an affected
+ * source. the pathCache write lock must be held. */
+static void _topology_updateCachedPaths(Topology* top, TopologyPathSearch* search,
+                                        igraph_integer_t vertexIndex, gdouble* minimumLatency) {
+    if(!top->pathCache) {
+        return;
+    }
+
+    GPtrArray* paths = g_ptr_array_new();
+
+    GHashTable* srcCache = g_hash_table_lookup(top->pathCache, GINT_TO_POINTER(vertexIndex));
+    if(srcCache) {
+        GHashTableIter iter;
+        gpointer path = NULL;
+        g_hash_table_iter_init(&iter, srcCache);
+        while(g_hash_table_iter_next(&iter, NULL, &path)) {
+            g_ptr_array_add(paths, path);
+        }
+    }
+
+    if(!top->isDirected) {
+        /* undirected paths are only stored in one direction */
+        GHashTableIter iter;
+        gpointer key = NULL, otherCache = NULL;
+        g_hash_table_iter_init(&iter, top->pathCache);
+        while(g_hash_table_iter_next(&iter, &key, &otherCache)) {
+            Path* path = g_hash_table_lookup(otherCache, GINT_TO_POINTER(vertexIndex));
+            if(GPOINTER_TO_INT(key) != vertexIndex && path) {
+                g_ptr_array_add(paths, path);
+            }
+        }
+    }
+
+    if(paths->len == 0) {
+        g_ptr_array_free(paths, TRUE);
+        return;
+    }
+
+    igraph_real_t selfLatency = 0, selfReliability = 0;
+    gboolean selfIsDirect = FALSE;
+    _topology_findSelfPath(top->adjacency, vertexIndex, &selfLatency, &selfReliability,
+                           &selfIsDirect);
+    _topology_searchShortestPaths(top->adjacency, search, vertexIndex);
+
+    for(guint i = 0; i < paths->len; i++) {
+        Path* path = g_ptr_array_index(paths, i);
+        igraph_integer_t otherVertexIndex = (igraph_integer_t)path_getSrcVertexIndex(path);
+        if(otherVertexIndex == vertexIndex) {
+            otherVertexIndex = (igraph_integer_t)path_getDstVertexIndex(path);
+        }
+
+        igraph_real_t latency = selfLatency, reliability = selfReliability;
+        if(otherVertexIndex != vertexIndex) {
+            latency = search->latencies[otherVertexIndex];
+            reliability = search->reliabilities[otherVertexIndex];
+            /* an edge can't become unreachable, only slower or lossier */
+            utility_assert(latency != -1);
+            if(latency == 0) {
+                /* same as _topology_computeSourcePaths */
+                latency = 1;
+            }
+        }
+
+        path_update(path, latency, reliability);
+        _topology_trackMinimumLatency(latency, minimumLatency);
+    }
+
+    g_ptr_array_free(paths, TRUE);
+}
+
+/* updates the direct path along a changed edge, which is the only path that uses the edge
+ * when we don't route along shortest paths */
+static void _topology_updateDirectPath(Topology* top, igraph_integer_t srcVertexIndex,
+                                       igraph_integer_t dstVertexIndex, igraph_real_t latency,
+                                       igraph_real_t reliability, gdouble* minimumLatency) {
+    if(top->pathMatrix) {
+        if(pathmatrix_containsVertex(top->pathMatrix, srcVertexIndex) &&
+           pathmatrix_containsVertex(top->pathMatrix, dstVertexIndex)) {
+            pathmatrix_setPath(top->pathMatrix, srcVertexIndex, dstVertexIndex, latency, reliability);
+            if(!top->isDirected) {
+                pathmatrix_setPath(top->pathMatrix, dstVertexIndex, srcVertexIndex, latency,
+                                   reliability);
+            }
+        }
+    } else if(top->pathCache) {
+        GHashTable* srcCache = g_hash_table_lookup(top->pathCache, GINT_TO_POINTER(srcVertexIndex));
+        Path* path = srcCache ? g_hash_table_lookup(srcCache, GINT_TO_POINTER(dstVertexIndex)) : NULL;
+        if(!path && !top->isDirected) {
+            GHashTable* dstCache = g_hash_table_lookup(top->pathCache, GINT_TO_POINTER(dstVertexIndex));
+            path = dstCache ? g_hash_table_lookup(dstCache, GINT_TO_POINTER(srcVertexIndex)) : NULL;
+        }
+        if(path) {
+            path_update(path, latency, reliability);
+        }
+    }
+
+    _topology_trackMinimumLatency(latency, minimumLatency);
+}
+
+gboolean topology_applyEdgeChanges(Topology* top, const TopologyEdgeChange* changes,
+                                   guint nChanges) {
+    MAGIC_ASSERT(top);
+
+    if(nChanges == 0) {
+        return TRUE;
+    }
+
+    GTimer* changeTimer = g_timer_new();
+
+    if(!top->adjacency) {
+        top->adjacency = _topology_buildAdjacency(top);
+        if(!top->adjacency) {
+            utility_panic("unable to read the topology edges to apply edge changes");
+        }
+    }
+    TopologyAdjacency* adjacency = top->adjacency;
+    igraph_integer_t vertexCount = adjacency->vertexCount;
+
+    TopologyPathSearch* search = top->useShortestPath ? _topologypathsearch_new(adjacency) : NULL;
+    igraph_real_t* uLatencies = top->useShortestPath ? g_new(igraph_real_t, MAX(vertexCount, 1)) : NULL;
+    gboolean* isAffected = g_new0(gboolean, MAX(vertexCount, 1));
+    gdouble minimumLatency = 0;
+    gboolean isSuccess = TRUE;
+
+    g_rw_lock_writer_lock(&(top->pathCacheLock));
+
+    for(guint i = 0; i < nChanges; i++) {
+        const TopologyEdgeChange* change = &changes[i];
+
+        igraph_integer_t u = -1, v = -1, edgeIndex = -1;
+        if(change->packetLoss > 1.0 || !_topology_findChangedEdge(top, change, &u, &v, &edgeIndex)) {
+            warning("ignoring change to the edge between vertex ids %" G_GINT64_FORMAT
+                    " and %" G_GINT64_FORMAT ", which is not a valid edge",
+                    change->srcVertexID, change->dstVertexID);
+            isSuccess = FALSE;
+            continue;
+        }
+
+        igraph_real_t oldLatency = 0, oldReliability = 0;
+        for(glong j = adjacency->offsets[u]; j < adjacency->offsets[u + 1]; j++) {
+            if(adjacency->edgeIndices[j] == edgeIndex) {
+                oldLatency = adjacency->latencies[j];
+                oldReliability = adjacency->reliabilities[j];
+                break;
+            }
+        }
+
+        igraph_real_t latency =
+            change->latencyNs >= 0 ? (igraph_real_t)change->latencyNs / 1000000.0 : oldLatency;
+        igraph_real_t reliability =
+            change->packetLoss >= 0 ? 1.0 - change->packetLoss : oldReliability;
+
+        if(!top->useShortestPath) {
+            _topology_setEdgeProperties(top, u, v, edgeIndex, latency, reliability);
+            _topology_updateDirectPath(top, u, v, latency, reliability, &minimumLatency);
+            continue;
+        }
+
+        if(top->isDirected) {
+            /* the reverse paths would need another search, so recompute everything */
+            for(igraph_integer_t s = 0; s < vertexCount; s++) {
+                isAffected[s] = TRUE;
+            }
+        } else {
+            /* find the affected sources using the paths from before this change */
+            _topology_searchShortestPaths(adjacency, search, u);
+            memcpy(uLatencies, search->latencies, sizeof(igraph_real_t) * vertexCount);
+            _topology_searchShortestPaths(adjacency, search, v);
+            _topology_markAffectedSources(vertexCount, uLatencies, search->latencies, oldLatency,
+                                          latency, isAffected);
+        }
+
+        _topology_setEdgeProperties(top, u, v, edgeIndex, latency, reliability);
+    }
+
+    /* recompute the affected sources once, with all of the changes applied */
+    guint nAffected = 0;
+    if(top->useShortestPath) {
+        for(igraph_integer_t s = 0; s < vertexCount; s++) {
+            if(!isAffected[s]) {
+                continue;
+            }
+            nAffected++;
+
+            if(top->pathMatrix) {
+                if(pathmatrix_containsVertex(top->pathMatrix, s)) {
+                    _topology_updateMatrixPaths(top, search, s, &minimumLatency);
+                }
+            } else {
+                _topology_updateCachedPaths(top, search, s, &minimumLatency);
+            }
+        }
+    }
+
+    /* paths that got faster lower the time that workers can run ahead */
+    gboolean wasUpdated = FALSE;
+    if(minimumLatency > 0 &&
+       (top->minimumPathLatency == 0 || minimumLatency < top->minimumPathLatency)) {
+        top->minimumPathLatency = minimumLatency;
+        wasUpdated = TRUE;
+    }
+
+    __atomic_store_n(&top->epoch, top->epoch + 1, __ATOMIC_RELAXED);
+
+    g_rw_lock_writer_unlock(&(top->pathCacheLock));
+
+    g_free(isAffected);
+    g_free(uLatencies);
+    _topologypathsearch_free(search);
+
+    info("applied %u edge changes in %f seconds, recomputing the paths from %u affected "
+         "vertices%s",
+         nChanges, g_timer_elapsed(changeTimer, NULL), nAffected,
+         wasUpdated ? ", which lowered the minimum path latency" : "");
+    g_timer_destroy(changeTimer);
+
+    return isSuccess;
+}
+
+guint topology_getEpoch(Topology* top) {
+    MAGIC_ASSERT(top);
+    return __atomic_load_n(&top->epoch, __ATOMIC_RELAXED);
+}
+
+gsize topology_getNumCachedPaths(Topology* top) {
+    MAGIC_ASSERT(top);
+    if (top->pathMatrix) {
+        guint size = pathmatrix_getSize(top->pathMatrix);
+        return (gsize)size * size;
+    }
+    return __atomic_load_n(&top->numCachedPaths, __ATOMIC_RELAXED);
+}
+
+gdouble topology_getMinimumPathLatency(Topology* top) {
+    MAGIC_ASSERT(top);
+    g_rw_lock_reader_lock(&(top->pathCacheLock));
+    gdouble latency = top->minimumPathLatency;
+    g_rw_lock_reader_unlock(&(top->pathCacheLock));
+    return latency;
+}
+
+static void _topology_logAllMatrixPaths(Topology* top) {
+    MAGIC_ASSERT(top);
+
+    guint size = pathmatrix_getSize(top->pathMatrix);
+    for(guint i = 0; i < size; i++) {
+        for(guint j = 0; j < size; j++) {
+            gint64 srcVertexIndex = pathmatrix_getVertexIndex(top->pathMatrix, i);
+            gint64 dstVertexIndex = pathmatrix_getVertexIndex(top->pathMatrix, j);
+
+            gdouble latency = 0, reliability = 0;
+            guint64 packetCount = pathmatrix_getPacketCount(top->pathMatrix, srcVertexIndex, dstVertexIndex);
+            if(packetCount == 0 ||
+               !pathmatrix_getPath(top->pathMatrix, srcVertexIndex, dstVertexIndex, &latency, &reliability)) {
+                continue;
+            }
+
+            gint64 srcID = _topology_getVertexID(top, srcVertexIndex);
+            gint64 dstID = _topology_getVertexID(top, dstVertexIndex);
+
+            /* log this at debug level so we don't spam the message level logs */
+            debug("Found path %li%s%li in matrix: SourceIndex=%" G_GINT64_FORMAT
+                  " DestinationIndex=%" G_GINT64_FORMAT " Latency=%f Reliability=%f "
+                  "PacketCount=%" G_GUINT64_FORMAT,
+                  (long)srcID, top->isDirected ? "->" : "<->", (long)dstID, srcVertexIndex,
+                  dstVertexIndex, latency, reliability, packetCount);
+        }
+    }
+}
+
+static Path* _topology_getPathEntryAt(Topology* top, Address* srcAddress,
+                                      igraph_integer_t srcVertexIndex, Address* dstAddress,
+                                      igraph_integer_t dstVertexIndex) {
+    MAGIC_ASSERT(top);
+
+    /* check for a cache hit */
+    Path* path = _topology_getPathFromCache(top, srcVertexIndex, dstVertexIndex);
+    if(!path && !top->isDirected) {
+        path = _topology_getPathFromCache(top, dstVertexIndex, srcVertexIndex);
+    }
+
+    if(!path) {
+        /* cache miss, lets find the path */
+        gboolean success = FALSE;
+
+        gint64 srcID = _topology_getVertexID(top, srcVertexIndex);
+        gint64 dstID = _topology_getVertexID(top, dstVertexIndex);
+
+        gboolean verticesAreAdjacent = _topology_verticesAreAdjacent(top, srcVertexIndex, dstVertexIndex);
+
+        debug("We need a path between node %s at %li (vertex %i) and "
+              "node %s at %li (vertex %i), topology properties are: "
+              "isComplete=%s, useShortestPath=%s, verticesAreAdjacent=%s",
+              address_toString(srcAddress), (long)srcID, (gint)srcVertexIndex,
+              address_toString(dstAddress), (long)dstID, (gint)dstVertexIndex,
+              top->isComplete ? "True" : "False", top->useShortestPath ? "True" : "False",
+              verticesAreAdjacent ? "True" : "False");
+
+        if (!top->useShortestPath) {
+            utility_assert(top->isComplete);
+            /* use the edge between src and dst as the path */
+            success = _topology_lookupDirectPath(top, srcVertexIndex, dstVertexIndex);
+
+            if(success) {
+                debug("We found a direct path between node %s at %li (vertex %i) and "
+                      "node %s at %li (vertex %i), and stored the path in the cache.",
+                      address_toString(srcAddress), (long)srcID, (gint)srcVertexIndex,
+                      address_toString(dstAddress), (long)dstID, (gint)dstVertexIndex);
+            }
+        } else {
+            success = _topology_computeSourcePaths(top, srcVertexIndex, dstVertexIndex);
+        }
+
+        if(success) {
+            path = _topology_getPathFromCache(top, srcVertexIndex, dstVertexIndex);
+            if(!path) {
+                path = _topology_getPathFromCache(top, dstVertexIndex, srcVertexIndex);
+            }
+        }
+
+        if(!path) {
+            /* some error finding the path */
+            utility_panic("unable to find path between node %s at %li (vertex %i) "
+                          "and node %s at %li (vertex %i)",
+                          address_toString(srcAddress), (long)srcID, (gint)srcVertexIndex,
+                          address_toString(dstAddress), (long)dstID, (gint)dstVertexIndex);
+        }
+    }
+
+
+    return path;
+}
+
+static Path* _topology_getPathEntry(Topology* top, Address* srcAddress, Address* dstAddress) {
     MAGIC_ASSERT(top);
-    return (topology_getLatency(top, srcAddress, dstAddress) > -1) ? TRUE : FALSE;
+
+    /* get connected points */
+    igraph_integer_t srcVertexIndex = _topology_getConnectedVertexIndex(top, srcAddress);
+    if(srcVertexIndex < 0) {
+        error("invalid vertex %i, source address %s is not connected to topology",
+              (gint)srcVertexIndex, address_toString(srcAddress));
+        return FALSE;
+    }
+    igraph_integer_t dstVertexIndex = _topology_getConnectedVertexIndex(top, dstAddress);
+    if(dstVertexIndex < 0) {
+        error("invalid vertex %i, destination address %s is not connected to topology",
+              (gint)dstVertexIndex, address_toString(dstAddress));
+        return FALSE;
+    }
+
+    return _topology_getPathEntryAt(top, srcAddress, srcVertexIndex, dstAddress, dstVertexIndex);
 }
 
-static gboolean _topology_findAttachmentVertexHelperHook(Topology* top, igraph_integer_t vertexIndex, AttachHelper* ah) {
+gboolean topology_getPathAt(Topology* top, Address* srcAddress, gint srcVertexIndex,
+                            Address* dstAddress, gint dstVertexIndex, gdouble* latencyOut,
+                            gdouble* reliabilityOut) {
     MAGIC_ASSERT(top);
-    utility_assert(ah);
+    utility_assert(srcVertexIndex >= 0 && dstVertexIndex >= 0);
 
-    /* @warning: make sure we hold the graph lock when iterating with this helper
-     * @todo: this could be made much more efficient */
+    if(top->pathMatrix) {
+        return _topology_getPathFromMatrixAt(top, srcAddress, srcVertexIndex, dstAddress,
+                                             dstVertexIndex, latencyOut, reliabilityOut);
+    }
+
+    Path* path = _topology_getPathEntryAt(top, srcAddress, srcVertexIndex, dstAddress,
+                                          dstVertexIndex);
+    if(path == NULL) {
+        return FALSE;
+    }
+    if(latencyOut) {
+        *latencyOut = path_getLatency(path);
+    }
+    if(reliabilityOut) {
+        *reliabilityOut = path_getReliability(path);
+    }
+    return TRUE;
+}
 
-    double id;
-    gboolean idFound = _topology_findVertexAttributeDouble(top, vertexIndex, VERTEX_ATTR_ID, &id);
-    utility_assert(idFound);
+void topology_addPathPacketCountAt(Topology* top, Address* srcAddress, gint srcVertexIndex,
+                                   Address* dstAddress, gint dstVertexIndex, guint64 count) {
+    MAGIC_ASSERT(top);
+    utility_assert(srcVertexIndex >= 0 && dstVertexIndex >= 0);
 
-    const gchar* ipStr = NULL;
-    const gchar* citycodeStr = NULL;
-    const gchar* countrycodeStr = NULL;
+    if(top->pathMatrix) {
+        pathmatrix_addPacketCount(top->pathMatrix, srcVertexIndex, dstVertexIndex, count);
+        return;
+    }
 
-    gboolean ipFound = _topology_findVertexAttributeString(top, vertexIndex, VERTEX_ATTR_IP_ADDRESS, &ipStr);
-    gboolean citycodeFound = _topology_findVertexAttributeString(top, vertexIndex, VERTEX_ATTR_CITYCODE, &citycodeStr);
-    gboolean countrycodeFound = _topology_findVertexAttributeString(top, vertexIndex, VERTEX_ATTR_COUNTRYCODE, &countrycodeStr);
+    Path* path = _topology_getPathEntryAt(top, srcAddress, srcVertexIndex, dstAddress,
+                                          dstVertexIndex);
+    if(path != NULL) {
+        path_addPacketCount(path, count);
+    } else {
+        utility_panic("unable to find path between node %s and node %s",
+                      address_toString(srcAddress), address_toString(dstAddress));
+    }
+}
 
-    gboolean citycodeMatches = citycodeFound && ah->citycodeHint && !g_ascii_strcasecmp(citycodeStr, ah->citycodeHint);
-    gboolean countrycodeMatches = countrycodeFound && ah->countrycodeHint && !g_ascii_strcasecmp(countrycodeStr, ah->countrycodeHint);
+void topology_incrementPathPacketCounter(Topology* top, Address* srcAddress, Address* dstAddress) {
+    MAGIC_ASSERT(top);
 
-    /* get the ip address of the vertex if there is one */
-    gboolean vertexHasUsableIP = FALSE;
-    in_addr_t vertexIP = INADDR_NONE;
-    if(ipFound) {
-        in_addr_t ip = address_stringToIP(ipStr);
-        if(ip != INADDR_NONE && ip != INADDR_ANY && ip != INADDR_LOOPBACK) {
-            vertexHasUsableIP = TRUE;
-            vertexIP = ip;
+    if(top->pathMatrix) {
+        if(_topology_getPathFromMatrix(top, srcAddress, dstAddress, NULL, NULL)) {
+            pathmatrix_addPacketCount(top->pathMatrix,
+                                      _topology_getConnectedVertexIndex(top, srcAddress),
+                                      _topology_getConnectedVertexIndex(top, dstAddress), 1);
+        } else {
+            utility_panic("unable to find path between node %s and node %s",
+                          address_toString(srcAddress), address_toString(dstAddress));
         }
+        return;
     }
 
-    /* check for exact IP address match */
-    if(ah->requestedIPIsUsable && vertexHasUsableIP) {
-        if(vertexIP == ah->requestedIP) {
-            if(!ah->foundExactIPMatch) {
-                /* first time we found a match, clear all queues to make sure we only
-                 * select from the matching IP vertices */
-                g_queue_clear(ah->candidatesCity);
-                g_queue_clear(ah->candidatesCountry);
-                g_queue_clear(ah->candidatesAll);
-            }
-            ah->foundExactIPMatch = TRUE;
-            g_queue_push_tail(ah->candidatesAll, GINT_TO_POINTER(vertexIndex));
-            if(vertexHasUsableIP) {
-                ah->numIPsAll++;
-            }
-        }
+    Path* path = _topology_getPathEntry(top, srcAddress, dstAddress);
+    if(path != NULL) {
+        path_addPacketCount(path, 1);
+    } else {
+        utility_panic("unable to find path between node %s and node %s",
+                      address_toString(srcAddress), address_toString(dstAddress));
     }
+}
 
-    /* if it matches the requested IP exactly, we ignore other the filters */
-    if(ah->foundExactIPMatch) {
-        return TRUE;
+gdouble topology_getLatency(Topology* top, Address* srcAddress, Address* dstAddress) {
+    MAGIC_ASSERT(top);
+
+    if(top->pathMatrix) {
+        gdouble latency = 0;
+        if(_topology_getPathFromMatrix(top, srcAddress, dstAddress, &latency, NULL)) {
+            return latency;
+        } else {
+            return (gdouble) -1;
+        }
     }
 
-    g_queue_push_tail(ah->candidatesAll, GINT_TO_POINTER(vertexIndex));
-    if(vertexHasUsableIP) {
-        ah->numIPsAll++;
+    Path* path = _topology_getPathEntry(top, srcAddress, dstAddress);
+
+    if(path != NULL) {
+        return path_getLatency(path);
+    } else {
+        return (gdouble) -1;
     }
+}
+
+gdouble topology_getReliability(Topology* top, Address* srcAddress, Address* dstAddress) {
+    MAGIC_ASSERT(top);
 
-    if(citycodeMatches && ah->candidatesCity) {
-        g_queue_push_tail(ah->candidatesCity, GINT_TO_POINTER(vertexIndex));
-        if(vertexHasUsableIP) {
-            ah->numIPsCity++;
+    if(top->pathMatrix) {
+        gdouble reliability = 0;
+        if(_topology_getPathFromMatrix(top, srcAddress, dstAddress, NULL, &reliability)) {
+            return reliability;
+        } else {
+            return (gdouble) -1;
         }
     }
 
-    if(countrycodeMatches && ah->candidatesCountry) {
-        g_queue_push_tail(ah->candidatesCountry, GINT_TO_POINTER(vertexIndex));
-        if(vertexHasUsableIP) {
-            ah->numIPsCountry++;
-        }
+    Path* path = _topology_getPathEntry(top, srcAddress, dstAddress);
+
+    if(path != NULL) {
+        return path_getReliability(path);
+    } else {
+        return (gdouble) -1;
     }
+}
 
-    return TRUE;
+gboolean topology_isRoutable(Topology* top, Address* srcAddress, Address* dstAddress) {
+    MAGIC_ASSERT(top);
+    return (topology_getLatency(top, srcAddress, dstAddress) > -1) ? TRUE : FALSE;
 }
 
-static igraph_integer_t* _topology_getLongestPrefixMatch(Topology* top, GQueue* vertexSet, in_addr_t ip) {
+/* returns the minimum latency in milliseconds of the edges incident to vertexIndex in
+ * the given direction, or -1 if there are no such edges. the caller must hold the
+ * graph lock. */
+static igraph_real_t _topology_getMinIncidentEdgeLatency(Topology* top, igraph_integer_t vertexIndex,
+                                                         igraph_neimode_t mode) {
     MAGIC_ASSERT(top);
-    utility_assert(vertexSet);
 
-    /* @warning: this empties the candidate queue */
+    igraph_es_t edgeSelector;
+    gint result = igraph_es_incident(&edgeSelector, vertexIndex, mode);
+    if(result != IGRAPH_SUCCESS) {
+        error("igraph_es_incident return non-success code %i", result);
+        return -1;
+    }
 
-    in_addr_t bestMatch = 0;
-    in_addr_t bestIP = 0;
-    igraph_integer_t* bestVertexIndexPtr = GINT_TO_POINTER(-1);
+    igraph_eit_t edgeIterator;
+    result = igraph_eit_create(&top->graph, edgeSelector, &edgeIterator);
+    if(result != IGRAPH_SUCCESS) {
+        error("igraph_eit_create return non-success code %i", result);
+        igraph_es_destroy(&edgeSelector);
+        return -1;
+    }
 
-    while(!g_queue_is_empty(vertexSet)) {
-        igraph_integer_t* vertexIndexPtr = g_queue_pop_head(vertexSet);
-        igraph_integer_t vertexIndex = (igraph_integer_t) GPOINTER_TO_INT(vertexIndexPtr);
-        _topology_lockGraph(top);
-        const gchar* attrString = _topology_vertexAttributeToString(VERTEX_ATTR_IP_ADDRESS);
-        const gchar* ipStr = VAS(&top->graph, attrString, vertexIndex);
-        _topology_unlockGraph(top);
-        in_addr_t vertexIP = address_stringToIP(ipStr);
+    igraph_real_t minLatency = -1;
+    while (!IGRAPH_EIT_END(edgeIterator)) {
+        igraph_integer_t edgeIndex = IGRAPH_EIT_GET(edgeIterator);
 
-        in_addr_t match = ~(vertexIP ^ ip);
-        if(match > bestMatch || bestMatch == 0) {
-            bestMatch = match;
-            bestIP = vertexIP;
-            bestVertexIndexPtr = vertexIndexPtr;
+        igraph_real_t edgeLatency = _topology_getEdgeLatency(top, edgeIndex);
+
+        if (minLatency == -1 || edgeLatency < minLatency) {
+            minLatency = edgeLatency;
         }
+
+        IGRAPH_EIT_NEXT(edgeIterator);
     }
 
-    return bestVertexIndexPtr;
+    igraph_eit_destroy(&edgeIterator);
+    igraph_es_destroy(&edgeSelector);
+
+    return minLatency;
 }
 
-static igraph_integer_t _topology_findAttachmentVertex(Topology* top, Random* randomSourcePool, in_addr_t nodeIP,
-        gchar* ipAddressHint, gchar* citycodeHint, gchar* countrycodeHint) {
+gdouble topology_getMinIncomingLatency(Topology* top, Address* address) {
     MAGIC_ASSERT(top);
 
-    igraph_integer_t vertexIndex = (igraph_integer_t) -1;
-    igraph_integer_t* vertexIndexPtr = GINT_TO_POINTER(-1);
+    igraph_integer_t vertexIndex = _topology_getConnectedVertexIndex(top, address);
+    if(vertexIndex < 0) {
+        error("invalid vertex %i, address %s is not connected to topology",
+              (gint)vertexIndex, address_toString(address));
+        return (gdouble) -1;
+    }
 
-    AttachHelper* ah = g_new0(AttachHelper, 1);
-    ah->ipAddressHint = ipAddressHint;
-    ah->citycodeHint = citycodeHint;
-    ah->countrycodeHint = countrycodeHint;
+    _topology_lockGraph(top);
 
-    if(ipAddressHint) {
-        in_addr_t ip = address_stringToIP(ipAddressHint);
-        if(ip != INADDR_NONE && ip != INADDR_ANY && ip != INADDR_LOOPBACK) {
-            ah->requestedIPIsUsable = TRUE;
-            ah->requestedIP = ip;
-        }
+    /* any path from another vertex must end with one of the incoming edges, and a path
+     * between hosts attached to this vertex is either the self-loop (an incoming edge) or
+     * the shortest outgoing edge used twice; see _topology_computeShortestPathToSelf */
+    igraph_real_t minInLatency = _topology_getMinIncidentEdgeLatency(top, vertexIndex, IGRAPH_IN);
+    igraph_real_t minOutLatency = _topology_getMinIncidentEdgeLatency(top, vertexIndex, IGRAPH_OUT);
+
+    _topology_unlockGraph(top);
+
+    igraph_real_t minLatency = minInLatency;
+    if (minOutLatency != -1 && (minLatency == -1 || 2 * minOutLatency < minLatency)) {
+        minLatency = 2 * minOutLatency;
     }
 
-    ah->candidatesCity = g_queue_new();
-    ah->candidatesCountry = g_queue_new();
-    ah->candidatesAll = g_queue_new();
+    debug("minimum incoming latency for address %s at vertex %i is %f ms",
+          address_toString(address), (gint)vertexIndex, (gdouble)minLatency);
+
+    return (gdouble)minLatency;
+}
+
+gdouble topology_getMinOutgoingLatency(Topology* top, Address* address) {
+    MAGIC_ASSERT(top);
+
+    igraph_integer_t vertexIndex = _topology_getConnectedVertexIndex(top, address);
+    if(vertexIndex < 0) {
+        error("invalid vertex %i, address %s is not connected to topology",
+              (gint)vertexIndex, address_toString(address));
+        return (gdouble) -1;
+    }
 
-    /* go through the vertices to see which ones match our hint filters */
+    /* every path, including one back to this vertex, starts with one of the outgoing edges */
     _topology_lockGraph(top);
-    _topology_iterateAllVertices(top, (VertexNotifyFunc) _topology_findAttachmentVertexHelperHook, ah);
+    igraph_real_t minLatency = _topology_getMinIncidentEdgeLatency(top, vertexIndex, IGRAPH_OUT);
     _topology_unlockGraph(top);
 
+    debug("minimum outgoing latency for address %s at vertex %i is %f ms",
+          address_toString(address), (gint)vertexIndex, (gdouble)minLatency);
+
+    return (gdouble)minLatency;
+}
+
+static gboolean _topology_isUsableIP(in_addr_t ip) {
+    return ip != INADDR_NONE && ip != INADDR_ANY && ip != INADDR_LOOPBACK;
+}
+
+static TopologyVertexGroup* _topologyvertexgroup_new(void) {
+    TopologyVertexGroup* group = g_new0(TopologyVertexGroup, 1);
+    group->vertexIndices = g_array_new(FALSE, FALSE, sizeof(igraph_integer_t));
+    group->verticesByIP = g_array_new(FALSE, FALSE, sizeof(TopologyVertexIP));
+    return group;
+}
+
+static void _topologyvertexgroup_free(TopologyVertexGroup* group) {
+    if(group) {
+        g_array_free(group->vertexIndices, TRUE);
+        g_array_free(group->verticesByIP, TRUE);
+        g_free(group);
+    }
+}
+
+static void _topologyvertexgroup_add(TopologyVertexGroup* group, const TopologyVertex* vertex,
+                                     igraph_integer_t vertexIndex) {
+    g_array_append_val(group->vertexIndices, vertexIndex);
+    TopologyVertexIP vertexIP = {.ip = vertex->ip, .vertexIndex = vertexIndex};
+    g_array_append_val(group->verticesByIP, vertexIP);
+    if(_topology_isUsableIP(vertex->ip)) {
+        group->numUsableIPs++;
+    }
+}
+
+static gint _topologyvertexgroup_compareIP(gconstpointer a, gconstpointer b) {
+    const TopologyVertexIP* vertexA = a;
+    const TopologyVertexIP* vertexB = b;
+    if(vertexA->ip != vertexB->ip) {
+        return vertexA->ip < vertexB->ip ? -1 : 1;
+    }
+    return vertexA->vertexIndex < vertexB->vertexIndex ? -1 : 1;
+}
+
+static void _topologyvertexgroup_sortHelper(gpointer key, TopologyVertexGroup* group,
+                                            gpointer userData) {
+    g_array_sort(group->verticesByIP, _topologyvertexgroup_compareIP);
+}
+
+/* the group of key in table, creating it if it doesn't exist yet. the table takes
+ * ownership of key, which is freed with freeKey if the group already exists. */
+static TopologyVertexGroup* _topology_getVertexGroup(GHashTable* table, gpointer key,
+                                                     GDestroyNotify freeKey) {
+    TopologyVertexGroup* group = g_hash_table_lookup(table, key);
+    if(!group) {
+        group = _topologyvertexgroup_new();
+        g_hash_table_insert(table, key, group);
+    } else if(freeKey) {
+        freeKey(key);
+    }
+    return group;
+}
+
+/* sorts the vertices into the groups that topology_attach chooses from, so that attaching
+ * a host doesn't have to check the hints against every vertex */
+static void _topology_buildAttachIndex(Topology* top) {
+    MAGIC_ASSERT(top);
+
+    top->allVertices = _topologyvertexgroup_new();
+    top->verticesByCitycode = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify)_topologyvertexgroup_free);
+    top->verticesByCountrycode = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify)_topologyvertexgroup_free);
+    top->verticesByIP = g_hash_table_new_full(
+        g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_topologyvertexgroup_free);
+
+    for(igraph_integer_t vertexIndex = 0; vertexIndex < top->vertexCount; vertexIndex++) {
+        const TopologyVertex* vertex = &top->vertices[vertexIndex];
+
+        _topologyvertexgroup_add(top->allVertices, vertex, vertexIndex);
+        if(vertex->citycode) {
+            gchar* key = g_ascii_strdown(vertex->citycode, -1);
+            _topologyvertexgroup_add(
+                _topology_getVertexGroup(top->verticesByCitycode, key, g_free), vertex,
+                vertexIndex);
+        }
+        if(vertex->countrycode) {
+            gchar* key = g_ascii_strdown(vertex->countrycode, -1);
+            _topologyvertexgroup_add(
+                _topology_getVertexGroup(top->verticesByCountrycode, key, g_free), vertex,
+                vertexIndex);
+        }
+        if(_topology_isUsableIP(vertex->ip)) {
+            _topologyvertexgroup_add(
+                _topology_getVertexGroup(top->verticesByIP, GUINT_TO_POINTER(vertex->ip), NULL),
+                vertex, vertexIndex);
+        }
+    }
+
+    _topologyvertexgroup_sortHelper(NULL, top->allVertices, NULL);
+    g_hash_table_foreach(top->verticesByCitycode, (GHFunc)_topologyvertexgroup_sortHelper, NULL);
+    g_hash_table_foreach(
+        top->verticesByCountrycode, (GHFunc)_topologyvertexgroup_sortHelper, NULL);
+    g_hash_table_foreach(top->verticesByIP, (GHFunc)_topologyvertexgroup_sortHelper, NULL);
+
+    info("indexed %u vertices by %u city codes, %u country codes, and %u ip addresses",
+         (guint)top->vertexCount, g_hash_table_size(top->verticesByCitycode),
+         g_hash_table_size(top->verticesByCountrycode), g_hash_table_size(top->verticesByIP));
+}
+
+static TopologyVertexGroup* _topology_lookupCodeGroup(GHashTable* table, const gchar* code) {
+    if(!code) {
+        return NULL;
+    }
+    gchar* key = g_ascii_strdown(code, -1);
+    TopologyVertexGroup* group = g_hash_table_lookup(table, key);
+    g_free(key);
+    return group;
+}
+
+/* the vertex whose ip shares the longest prefix with ip, i.e., the one with the smallest
+ * ip ^ vertexIP. of the vertices with the same ip, the first in vertex order wins, except
+ * when the best vertex shares no bits with ip, in which case the last one does. */
+static igraph_integer_t _topology_getLongestPrefixMatch(TopologyVertexGroup* group,
+                                                        in_addr_t ip) {
+    GArray* verticesByIP = group->verticesByIP;
+    utility_assert(verticesByIP->len > 0);
+
+    /* walk down the bits like in a binary trie. the vertices in [low, high) share the bits
+     * above the current one, so the ones with the current bit set come last in the range */
+    guint low = 0, high = verticesByIP->len;
+    for(gint bit = 31; bit >= 0; bit--) {
+        in_addr_t mask = ((in_addr_t)1) << bit;
+
+        guint splitLow = low, splitHigh = high;
+        while(splitLow < splitHigh) {
+            guint mid = splitLow + (splitHigh - splitLow) / 2;
+            if(g_array_index(verticesByIP, TopologyVertexIP, mid).ip & mask) {
+                splitHigh = mid;
+            } else {
+                splitLow = mid + 1;
+            }
+        }
+
+        /* follow the bit of ip if any vertex has it, otherwise the other one */
+        if(ip & mask) {
+            if(splitLow < high) {
+                low = splitLow;
+            }
+        } else if(splitLow > low) {
+            high = splitLow;
+        }
+    }
+
+    guint best = low;
+    if((g_array_index(verticesByIP, TopologyVertexIP, best).ip ^ ip) == (in_addr_t)-1) {
+        best = verticesByIP->len - 1;
+    }
+
+    return g_array_index(verticesByIP, TopologyVertexIP, best).vertexIndex;
+}
+
+static igraph_integer_t _topology_findAttachmentVertex(Topology* top, Random* randomSourcePool,
+        gchar* ipAddressHint, gchar* citycodeHint, gchar* countrycodeHint) {
+    MAGIC_ASSERT(top);
+
+    in_addr_t requestedIP = 0;
+    gboolean requestedIPIsUsable = FALSE;
+    if(ipAddressHint) {
+        in_addr_t ip = address_stringToIP(ipAddressHint);
+        if(_topology_isUsableIP(ip)) {
+            requestedIPIsUsable = TRUE;
+            requestedIP = ip;
+        }
+    }
+
     /* the logic here is to try and find the most specific match following the hints.
      * we always use exact IP hint matches, and otherwise use it to select the best possible
      * match from the final set of candidates. the code hints are used to filter
      * all vertices down to a smaller set. if that smaller set is empty, then we fall back to the
      * complete vertex set.
      */
-    GQueue* candidates = NULL;
+    TopologyVertexGroup* exactMatches =
+        requestedIPIsUsable ? g_hash_table_lookup(top->verticesByIP, GUINT_TO_POINTER(requestedIP))
+                            : NULL;
+    TopologyVertexGroup* cityMatches =
+        _topology_lookupCodeGroup(top->verticesByCitycode, citycodeHint);
+    TopologyVertexGroup* countryMatches =
+        _topology_lookupCodeGroup(top->verticesByCountrycode, countrycodeHint);
+
+    TopologyVertexGroup* candidates = NULL;
     gboolean useLongestPrefixMatching = FALSE;
 
-    if(g_queue_get_length(ah->candidatesCity) > 0) {
-        candidates = ah->candidatesCity;
-        useLongestPrefixMatching = (ah->requestedIPIsUsable && ah->numIPsCity > 0);
-    } else if(g_queue_get_length(ah->candidatesCountry) > 0) {
-        candidates = ah->candidatesCountry;
-        useLongestPrefixMatching = (ah->requestedIPIsUsable && ah->numIPsCountry > 0);
+    if(exactMatches) {
+        candidates = exactMatches;
+    } else if(cityMatches) {
+        candidates = cityMatches;
+        useLongestPrefixMatching = (requestedIPIsUsable && candidates->numUsableIPs > 0);
+    } else if(countryMatches) {
+        candidates = countryMatches;
+        useLongestPrefixMatching = (requestedIPIsUsable && candidates->numUsableIPs > 0);
     } else {
-        candidates = ah->candidatesAll;
-        useLongestPrefixMatching = (ipAddressHint && ah->numIPsAll > 0);
+        candidates = top->allVertices;
+        useLongestPrefixMatching = (ipAddressHint && candidates->numUsableIPs > 0);
     }
 
-    guint numCandidates = g_queue_get_length(candidates);
+    guint numCandidates = candidates->vertexIndices->len;
     utility_assert(numCandidates > 0);
 
     /* if our candidate list has vertices with non-zero IPs, use longest prefix matching
      * to select the closest one to the requested IP; otherwise, grab a random candidate */
-    if(useLongestPrefixMatching && !ah->foundExactIPMatch) {
-        vertexIndexPtr = _topology_getLongestPrefixMatch(top, candidates, ah->requestedIP);
+    igraph_integer_t vertexIndex = (igraph_integer_t) -1;
+    if(useLongestPrefixMatching) {
+        vertexIndex = _topology_getLongestPrefixMatch(candidates, requestedIP);
     } else {
         gdouble randomDouble = random_nextDouble(randomSourcePool);
         gint indexRange = numCandidates - 1;
         gint chosenIndex = (gint) round((gdouble)(indexRange * randomDouble));
-        while(chosenIndex >= 0) {
-            vertexIndexPtr = g_queue_pop_head(candidates);
-            chosenIndex--;
-        }
+        vertexIndex = g_array_index(candidates->vertexIndices, igraph_integer_t, chosenIndex);
     }
 
     /* make sure the vertex we found is legitimate */
-    utility_assert(vertexIndexPtr != GINT_TO_POINTER(-1));
-    vertexIndex = (igraph_integer_t) GPOINTER_TO_INT(vertexIndexPtr);
     utility_assert(vertexIndex > (igraph_integer_t) -1);
 
-    /* clean up */
-    if(ah->candidatesCity) {
-        g_queue_free(ah->candidatesCity);
-    }
-    if(ah->candidatesCountry) {
-        g_queue_free(ah->candidatesCountry);
-    }
-    if(ah->candidatesAll) {
-        g_queue_free(ah->candidatesAll);
-    }
-    g_free(ah);
-
     return vertexIndex;
 }
 
@@ -2222,8 +3743,8 @@ void topology_attach(Topology* top, Address* address, Random* randomSourcePool,
     utility_assert(address);
 
     in_addr_t nodeIP = address_toNetworkIP(address);
-    igraph_integer_t vertexIndex = _topology_findAttachmentVertex(top, randomSourcePool, nodeIP,
-            ipAddressHint, citycodeHint, countrycodeHint);
+    igraph_integer_t vertexIndex = _topology_findAttachmentVertex(
+        top, randomSourcePool, ipAddressHint, citycodeHint, countrycodeHint);
 
     /* attach it, i.e. store the mapping so we can route later */
     g_rw_lock_writer_lock(&(top->virtualIPLock));
@@ -2231,44 +3752,25 @@ void topology_attach(Topology* top, Address* address, Random* randomSourcePool,
     g_hash_table_replace(top->verticesWithAttachedHosts, GUINT_TO_POINTER(vertexIndex), GINT_TO_POINTER(vertexIndex));
     g_rw_lock_writer_unlock(&(top->virtualIPLock));
 
-    double id = -1;
-    const gchar* ipStr = NULL;
-    const gchar* citycodeStr = NULL;
-    const gchar* countrycodeStr = NULL;
-    gboolean found;
-
-    _topology_lockGraph(top);
+    const TopologyVertex* vertex = &top->vertices[vertexIndex];
 
-    /* give them the default cluster bandwidths if they asked */
+    /* give them the default cluster bandwidths if they asked.
+     * the vertices store bits-per-second, but shadow works with KiB/s */
+    /* TODO: use bits or bytes everywhere within Shadow (see also: _controller_registerHostCallback()) */
     if(bwUpOut) {
-        guint64 bandwidthUp;
-        found = _topology_findVertexAttributeStringBandwidth(top, vertexIndex, VERTEX_ATTR_BANDWIDTHUP, &bandwidthUp);
-        utility_assert(found);
-        *bwUpOut = bandwidthUp;
+        *bwUpOut = vertex->bandwidthUp / (8 * 1024);
     }
     if(bwDownOut) {
-        guint64 bandwidthDown;
-        found = _topology_findVertexAttributeStringBandwidth(top, vertexIndex, VERTEX_ATTR_BANDWIDTHDOWN, &bandwidthDown);
-        utility_assert(found);
-        *bwDownOut = bandwidthDown;
+        *bwDownOut = vertex->bandwidthDown / (8 * 1024);
     }
 
-    found = _topology_findVertexAttributeDouble(top, vertexIndex, VERTEX_ATTR_ID, &id);
-    utility_assert(found);
-
-    /* these may fail and not set the string value if the vertex does not have the attribute.
+    /* the strings are NULL if the vertex does not have the attribute.
      * that's ok though, glib will print null in its place in the format string below. */
-    _topology_findVertexAttributeString(top, vertexIndex, VERTEX_ATTR_IP_ADDRESS, &ipStr);
-    _topology_findVertexAttributeString(top, vertexIndex, VERTEX_ATTR_CITYCODE, &citycodeStr);
-    _topology_findVertexAttributeString(top, vertexIndex, VERTEX_ATTR_COUNTRYCODE, &countrycodeStr);
-
-    _topology_unlockGraph(top);
-
     info("attached address '%s' to vertex %li ('%li') "
          "with attributes (ip=%s, citycode=%s, countrycode=%s) "
          "using hints (ip=%s, citycode=%s, countrycode=%s)",
-         address_toHostIPString(address), (glong)vertexIndex, (long)id, ipStr, citycodeStr,
-         countrycodeStr, ipAddressHint, citycodeHint, countrycodeHint);
+         address_toHostIPString(address), (glong)vertexIndex, (long)vertex->id, vertex->ipAddress,
+         vertex->citycode, vertex->countrycode, ipAddressHint, citycodeHint, countrycodeHint);
 }
 
 void topology_detach(Topology* top, Address* address) {
@@ -2285,6 +3787,11 @@ void topology_free(Topology* top) {
 
     /* log all of the paths that we looked up for post analysis */
     _topology_logAllCachedPaths(top);
+    if(top->pathMatrix) {
+        _topology_logAllMatrixPaths(top);
+        pathmatrix_free(top->pathMatrix);
+        top->pathMatrix = NULL;
+    }
 
     /* clear the virtual ip table */
     g_rw_lock_writer_lock(&(top->virtualIPLock));
@@ -2299,6 +3806,13 @@ void topology_free(Topology* top) {
     g_rw_lock_writer_unlock(&(top->virtualIPLock));
     g_rw_lock_clear(&(top->virtualIPLock));
 
+    _topologyadjacency_free(top->adjacency);
+    top->adjacency = NULL;
+    if(top->vertexIndexByID) {
+        g_hash_table_destroy(top->vertexIndexByID);
+        top->vertexIndexByID = NULL;
+    }
+
     /* this functions grabs and releases the pathCache write lock */
     _topology_clearCache(top);
     g_rw_lock_clear(&(top->pathCacheLock));
@@ -2319,13 +3833,33 @@ void topology_free(Topology* top) {
     _topology_unlockGraph(top);
     _topology_clearGraphLock(&(top->graphLock));
 
+    _topologyvertexgroup_free(top->allVertices);
+    if(top->verticesByCitycode) {
+        g_hash_table_destroy(top->verticesByCitycode);
+    }
+    if(top->verticesByCountrycode) {
+        g_hash_table_destroy(top->verticesByCountrycode);
+    }
+    if(top->verticesByIP) {
+        g_hash_table_destroy(top->verticesByIP);
+    }
+
+    g_free(top->vertices);
+    g_free(top->edges);
+    if(top->attributeStrings) {
+        g_string_chunk_free(top->attributeStrings);
+    }
+
     g_mutex_clear(&(top->topologyLock));
 
+    g_free(top->graphChecksum);
+
     MAGIC_CLEAR(top);
     g_free(top);
 }
 
-Topology* topology_new(const gchar* graphPath, gboolean useShortestPath) {
+Topology* topology_new(const gchar* graphPath, gboolean useShortestPath, guint nThreads,
+                       const gchar* cacheDirectory) {
     utility_assert(graphPath);
     Topology* top = g_new0(Topology, 1);
     MAGIC_INIT(top);
@@ -2340,15 +3874,94 @@ Topology* topology_new(const gchar* graphPath, gboolean useShortestPath) {
     g_rw_lock_init(&(top->virtualIPLock));
     g_rw_lock_init(&(top->pathCacheLock));
 
-    /* first read in the graph and make sure its formed correctly,
-     * then setup our edge weights for shortest path */
-    if(!_topology_loadGraph(top, graphPath) || !_topology_checkGraph(top) ||
-            !_topology_extractEdgeWeights(top)) {
+    /* first read in the graph and make sure its formed correctly, then convert its
+     * attributes and setup our edge weights for shortest path */
+    if(!_topology_loadGraph(top, graphPath) ||
+            !_topology_checkGraph(top, nThreads, cacheDirectory) ||
+            !_topology_compactAttributes(top) || !_topology_extractEdgeWeights(top)) {
         topology_free(top);
         error("we failed to create the simulation topology because we were unable to validate the "
               "topology gml file");
         return NULL;
     }
 
+    _topology_buildAttachIndex(top);
+
     return top;
 }
+
+gint topology_getAttachedVertex(Topology* top, Address* address) {
+    MAGIC_ASSERT(top);
+    return (gint)_topology_getConnectedVertexIndex(top, address);
+}
+
+gint64 topology_getAttachedVertexID(Topology* top, Address* address) {
+    MAGIC_ASSERT(top);
+
+    igraph_integer_t vertexIndex = _topology_getConnectedVertexIndex(top, address);
+    if (vertexIndex < 0) {
+        return -1;
+    }
+
+    return _topology_getVertexID(top, vertexIndex);
+}
+
+static void _topology_writePathPacketCount(Topology* top, FILE* file, gint64 srcVertexIndex,
+                                           gint64 dstVertexIndex, guint64 packetCount) {
+    if (packetCount == 0) {
+        return;
+    }
+
+    gint64 srcID = _topology_getVertexID(top, srcVertexIndex);
+    gint64 dstID = _topology_getVertexID(top, dstVertexIndex);
+
+    fprintf(file, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GUINT64_FORMAT "\n", srcID,
+            dstID, packetCount);
+}
+
+gboolean topology_writePathPacketCounts(Topology* top, const gchar* filePath) {
+    MAGIC_ASSERT(top);
+
+    FILE* file = fopen(filePath, "w");
+    if (!file) {
+        warning("Unable to open path packet count file '%s': %s", filePath, g_strerror(errno));
+        return FALSE;
+    }
+
+    if (top->pathMatrix) {
+        guint size = pathmatrix_getSize(top->pathMatrix);
+        for (guint i = 0; i < size; i++) {
+            for (guint j = 0; j < size; j++) {
+                gint64 srcVertexIndex = pathmatrix_getVertexIndex(top->pathMatrix, i);
+                gint64 dstVertexIndex = pathmatrix_getVertexIndex(top->pathMatrix, j);
+                _topology_writePathPacketCount(
+                    top, file, srcVertexIndex, dstVertexIndex,
+                    pathmatrix_getPacketCount(top->pathMatrix, srcVertexIndex, dstVertexIndex));
+            }
+        }
+    } else {
+        g_rw_lock_reader_lock(&(top->pathCacheLock));
+        if (top->pathCache) {
+            GHashTableIter srcIter;
+            gpointer sourceCache = NULL;
+            g_hash_table_iter_init(&srcIter, top->pathCache);
+            while (g_hash_table_iter_next(&srcIter, NULL, &sourceCache)) {
+                GHashTableIter dstIter;
+                gpointer path = NULL;
+                g_hash_table_iter_init(&dstIter, sourceCache);
+                while (g_hash_table_iter_next(&dstIter, NULL, &path)) {
+                    _topology_writePathPacketCount(top, file, path_getSrcVertexIndex(path),
+                                                   path_getDstVertexIndex(path),
+                                                   path_getPacketCount(path));
+                }
+            }
+        }
+        g_rw_lock_reader_unlock(&(top->pathCacheLock));
+    }
+
+    if (fclose(file) != 0) {
+        warning("Unable to write path packet count file '%s': %s", filePath, g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -14,7 +14,23 @@
 
 typedef struct _Topology Topology;
 
-Topology* topology_new(const gchar* graphPath, gboolean useShortestPath);
+/* A change to the latency or packet loss of the graph edge between two vertices, which are
+ * named by their id attributes. */
+typedef struct _TopologyEdgeChange TopologyEdgeChange;
+struct _TopologyEdgeChange {
+    gint64 srcVertexID;
+    gint64 dstVertexID;
+    /* the new latency in nanoseconds, or -1 to keep the current latency */
+    gint64 latencyNs;
+    /* the new packet loss, or a negative value to keep the current packet loss */
+    gdouble packetLoss;
+};
+
+/* Loads and validates the graph, checking its vertices and edges with nThreads threads.
+ * If cacheDirectory is not NULL, a graph that was validated by an earlier simulation with
+ * the same cacheDirectory isn't validated again. */
+Topology* topology_new(const gchar* graphPath, gboolean useShortestPath, guint nThreads,
+                       const gchar* cacheDirectory);
 void topology_free(Topology* top);
 
 void topology_attach(Topology* top, Address* address, Random* randomSourcePool, gchar* ipHint,
@@ -27,4 +43,72 @@ gdouble topology_getLatency(Topology* top, Address* srcAddress, Address* dstAddr
 gdouble topology_getReliability(Topology* top, Address* srcAddress, Address* dstAddress);
 void topology_incrementPathPacketCounter(Topology* top, Address* srcAddress, Address* dstAddress);
 
+/* Like the functions above, for addresses that are attached at the given vertices, as
+ * returned by topology_getAttachedVertex, which saves looking the vertices up again.
+ * topology_getPathAt returns FALSE if there is no path, and otherwise writes the path's
+ * latency and reliability to the outputs that aren't NULL. topology_addPathPacketCountAt
+ * counts count packets sent on the path at once. */
+gboolean topology_getPathAt(Topology* top, Address* srcAddress, gint srcVertexIndex,
+                            Address* dstAddress, gint dstVertexIndex, gdouble* latencyOut,
+                            gdouble* reliabilityOut);
+void topology_addPathPacketCountAt(Topology* top, Address* srcAddress, gint srcVertexIndex,
+                                   Address* dstAddress, gint dstVertexIndex, guint64 count);
+
+/* Computes the paths between all vertices that have hosts attached, using nThreads
+ * threads, and stores them in a dense matrix that is used for all later path lookups.
+ * If cacheDirectory is non-NULL, a matrix saved there by an earlier run with the same
+ * graph, routing mode, and attached vertices is loaded instead, and a newly computed
+ * matrix is saved there for later runs.
+ * Must be called at most once, after all hosts are attached and before any path lookups. */
+void topology_computePathMatrix(Topology* top, guint nThreads, const gchar* cacheDirectory);
+/* Computes the paths from every vertex that has hosts attached and stores them in the path
+ * cache, so that workers don't stall on computing them lazily once the simulation starts. Call
+ * topology_startPrecomputingPaths from a single thread after all hosts are attached, then
+ * topology_precomputePaths from any number of threads at once to share the work, and then
+ * topology_finishPrecomputingPaths from a single thread once they have all returned. */
+void topology_startPrecomputingPaths(Topology* top);
+void topology_precomputePaths(Topology* top);
+void topology_finishPrecomputingPaths(Topology* top);
+
+/* Returns FALSE if change doesn't name an edge of the graph or has a packet loss above 1. */
+gboolean topology_isValidEdgeChange(Topology* top, const TopologyEdgeChange* change);
+/* Applies the changes in order, and updates the paths that were already computed, in the path
+ * matrix if it is used or else in the path cache, while keeping their packet counts. Only the
+ * paths from the vertices whose shortest paths could have changed are recomputed. Must be called
+ * while no other thread uses the topology, such as in between rounds. Returns FALSE if any of the
+ * changes were invalid, which are skipped. */
+gboolean topology_applyEdgeChanges(Topology* top, const TopologyEdgeChange* changes,
+                                   guint nChanges);
+/* Returns a number that changes each time edge changes are applied, so that callers that keep
+ * copies of path properties know when to look them up again. */
+guint topology_getEpoch(Topology* top);
+
+/* Returns the number of paths that are cached, or that are stored in the path matrix if it is
+ * used. Can be called while other threads use the topology, in which case the number may be
+ * slightly out of date. */
+gsize topology_getNumCachedPaths(Topology* top);
+
+/* Returns the minimum latency in milliseconds of the paths computed so far, or 0 if none. */
+gdouble topology_getMinimumPathLatency(Topology* top);
+
+/* Returns a lower bound in milliseconds on the latency of any path that ends at the vertex
+ * where address is attached, or -1 if the address is not attached or the vertex has no edges. */
+gdouble topology_getMinIncomingLatency(Topology* top, Address* address);
+
+/* Returns a lower bound in milliseconds on the latency of any path that starts at the vertex
+ * where address is attached, or -1 if the address is not attached or the vertex has no edges. */
+gdouble topology_getMinOutgoingLatency(Topology* top, Address* address);
+
+/* Returns the index of the vertex where address is attached, or -1 if it is not attached.
+ * Hosts attached to the same vertex have the shortest paths between them. */
+gint topology_getAttachedVertex(Topology* top, Address* address);
+
+/* Returns the id attribute of the vertex where address is attached, or -1 if it is not
+ * attached. Unlike the vertex index, the id is the same in every run with the same graph. */
+gint64 topology_getAttachedVertexID(Topology* top, Address* address);
+
+/* Writes a line "<source id> <destination id> <packets>" for each path that carried packets so
+ * far, using the vertex id attributes. Returns FALSE if the file could not be written. */
+gboolean topology_writePathPacketCounts(Topology* top, const gchar* filePath);
+
 #endif /* SHD_TOPOLOGY_H_ */
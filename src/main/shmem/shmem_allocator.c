@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 
 #include <pthread.h>
 
@@ -19,6 +20,13 @@
 #define SHD_SHMEM_ALLOCATOR_CUTOVER_NBYTES                                     \
     (SHD_SHMEM_ALLOCATOR_POOL_NBYTES / 2 - sizeof(BuddyControlBlock))
 
+// Each thread caches little blocks of a few distinct sizes for the global
+// allocator, so that the common pattern of allocating the same few block sizes
+// for every new plugin thread only takes the allocator lock once per batch.
+#define SHD_SHMEM_MAGAZINE_NSIZES 4
+#define SHD_SHMEM_MAGAZINE_NBLOCKS 32
+#define SHD_SHMEM_MAGAZINE_BATCH 16
+
 typedef struct _ShMemFileNode {
     struct _ShMemFileNode *prv, *nxt;
     ShMemFile shmf;
@@ -105,8 +113,16 @@ struct _ShMemAllocator {
     ShMemFileNode* big_alloc_nodes;
     ShMemPoolNode* little_alloc_nodes;
     pthread_mutex_t mtx;
+    // Written while holding mtx, and read with relaxed atomic loads by
+    // shmemallocator_getStats().
+    ShMemAllocatorStats stats;
 };
 
+// Adds `delta` to a stat. The caller must hold the allocator lock.
+static void _shmemallocator_addStat(size_t* stat, ssize_t delta) {
+    __atomic_store_n(stat, *stat + delta, __ATOMIC_RELAXED);
+}
+
 struct _ShMemSerializer {
     ShMemFileNode* nodes;
     pthread_mutex_t mtx;
@@ -115,12 +131,26 @@ struct _ShMemSerializer {
 static ShMemAllocator* _global_allocator = NULL;
 static ShMemSerializer* _global_serializer = NULL;
 
+typedef struct _ShMemMagazine {
+    size_t nbytes; // the size of every cached block, or 0 if the slot is unused
+    size_t nblocks;
+    void* blocks[SHD_SHMEM_MAGAZINE_NBLOCKS];
+} ShMemMagazine;
+
+static __thread ShMemMagazine _magazines[SHD_SHMEM_MAGAZINE_NSIZES];
+static __thread bool _magazinesRegistered = false;
+static pthread_key_t _magazinesKey;
+static pthread_once_t _magazinesKeyOnce = PTHREAD_ONCE_INIT;
+
 /*
  * hook used to cleanup at exit.
  */
 static void _shmemallocator_destroyGlobal() {
     assert(_global_allocator);
-    shmemallocator_destroy(_global_allocator);
+    ShMemAllocator* allocator = _global_allocator;
+    // Any blocks still cached by other threads are released with their pools.
+    _global_allocator = NULL;
+    shmemallocator_destroy(allocator);
 }
 
 ShMemAllocator* shmemallocator_getGlobal() {
@@ -207,6 +237,38 @@ void shmemallocator_destroyNoShmDelete(ShMemAllocator* allocator) {
     free(allocator);
 }
 
+void shmemallocator_setUseHugePages(bool useHugePages) {
+    shmemfile_setUseHugePages(useHugePages);
+}
+
+static void _shmemfilenode_countHugePages(const ShMemFileNode* file_nodes, size_t* total_nbytes,
+                                          size_t* huge_nbytes) {
+    const ShMemFileNode* node = file_nodes;
+
+    if (node) {
+        do {
+            *total_nbytes += node->shmf.nbytes;
+            *huge_nbytes += shmemfile_hugePageNBytes(&node->shmf);
+            node = node->nxt;
+        } while (node != file_nodes);
+    }
+}
+
+void shmemallocator_logHugePageCoverage(ShMemAllocator* allocator) {
+    assert(allocator);
+
+    size_t total_nbytes = 0, huge_nbytes = 0;
+
+    pthread_mutex_lock(&allocator->mtx);
+    _shmemfilenode_countHugePages(
+        (const ShMemFileNode*)allocator->little_alloc_nodes, &total_nbytes, &huge_nbytes);
+    _shmemfilenode_countHugePages(allocator->big_alloc_nodes, &total_nbytes, &huge_nbytes);
+    pthread_mutex_unlock(&allocator->mtx);
+
+    info("Shared memory huge page coverage: %zu of %zu mapped bytes (%.1f%%)", huge_nbytes,
+         total_nbytes, total_nbytes ? 100.0 * huge_nbytes / total_nbytes : 0.0);
+}
+
 static ShMemBlock _shmemallocator_bigAlloc(ShMemAllocator* allocator,
                                            size_t nbytes) {
     ShMemBlock blk;
@@ -222,6 +284,7 @@ static ShMemBlock _shmemallocator_bigAlloc(ShMemAllocator* allocator,
         if (file_node) {
             blk.p = shmf.p;
             blk.nbytes = nbytes;
+            _shmemallocator_addStat(&allocator->stats.big_alloc_nbytes, shmf.nbytes);
 
             // create a new node to track
             file_node->shmf = shmf;
@@ -251,6 +314,10 @@ static ShMemBlock _shmemallocator_littleAlloc(ShMemAllocator* allocator,
 
     if (allocator->little_alloc_nodes == NULL) {
         allocator->little_alloc_nodes = _shmempoolnode_create();
+        if (allocator->little_alloc_nodes == NULL) {
+            return blk;
+        }
+        _shmemallocator_addStat(&allocator->stats.npools, 1);
     }
 
     ShMemPoolNode* pool_node = allocator->little_alloc_nodes;
@@ -279,15 +346,80 @@ static ShMemBlock _shmemallocator_littleAlloc(ShMemAllocator* allocator,
         old_head->prv = new_head;
 
         allocator->little_alloc_nodes = (ShMemPoolNode*)new_head;
+        _shmemallocator_addStat(&allocator->stats.npools, 1);
 
         return _shmemallocator_littleAlloc(allocator, nbytes);
     } else {
         blk.p = p;
         blk.nbytes = nbytes;
+        _shmemallocator_addStat(&allocator->stats.little_alloc_nbytes, nbytes);
         return blk;
     }
 }
 
+static void _shmemallocator_littleFree(ShMemAllocator* allocator, ShMemBlock* blk);
+
+// Returns blocks from the end of the magazine to the allocator until at most
+// `nblocks` remain. The caller must hold the allocator lock.
+static void _shmemmagazine_drain(ShMemMagazine* mag, ShMemAllocator* allocator, size_t nblocks) {
+    while (mag->nblocks > nblocks) {
+        ShMemBlock blk = {.p = mag->blocks[--mag->nblocks], .nbytes = mag->nbytes};
+        _shmemallocator_littleFree(allocator, &blk);
+    }
+}
+
+// Called when a thread that has used its magazines exits.
+static void _shmemmagazine_destroyThreadMagazines(void* unused) {
+    ShMemAllocator* allocator = _global_allocator;
+    if (!allocator) {
+        // The allocator, and all of the blocks in its pools, are already gone.
+        return;
+    }
+
+    pthread_mutex_lock(&allocator->mtx);
+    for (int i = 0; i < SHD_SHMEM_MAGAZINE_NSIZES; i++) {
+        _shmemmagazine_drain(&_magazines[i], allocator, 0);
+        _magazines[i].nbytes = 0;
+    }
+    pthread_mutex_unlock(&allocator->mtx);
+}
+
+static void _shmemmagazine_createKey() {
+    pthread_key_create(&_magazinesKey, _shmemmagazine_destroyThreadMagazines);
+}
+
+// Returns this thread's magazine for blocks of `nbytes`, claiming an empty
+// slot if there isn't one yet. Returns NULL if all of the slots are in use by
+// other sizes.
+static ShMemMagazine* _shmemmagazine_get(size_t nbytes) {
+    if (!_magazinesRegistered) {
+        // Register for a callback at thread exit, which needs a non-NULL value.
+        pthread_once(&_magazinesKeyOnce, _shmemmagazine_createKey);
+        pthread_setspecific(_magazinesKey, &_magazinesRegistered);
+        _magazinesRegistered = true;
+    }
+
+    ShMemMagazine* empty = NULL;
+    for (int i = 0; i < SHD_SHMEM_MAGAZINE_NSIZES; i++) {
+        if (_magazines[i].nbytes == nbytes) {
+            return &_magazines[i];
+        }
+        if (!empty && _magazines[i].nblocks == 0) {
+            empty = &_magazines[i];
+        }
+    }
+
+    if (empty) {
+        empty->nbytes = nbytes;
+    }
+    return empty;
+}
+
+static bool _shmemmagazine_isUsable(ShMemAllocator* allocator, size_t nbytes) {
+    // The magazines are only valid for the lifetime of the global allocator.
+    return allocator == _global_allocator && nbytes <= SHD_SHMEM_ALLOCATOR_CUTOVER_NBYTES;
+}
+
 ShMemBlock shmemallocator_alloc(ShMemAllocator* allocator, size_t nbytes) {
     assert(allocator);
 
@@ -298,6 +430,29 @@ ShMemBlock shmemallocator_alloc(ShMemAllocator* allocator, size_t nbytes) {
         return blk;
     }
 
+    ShMemMagazine* mag =
+        _shmemmagazine_isUsable(allocator, nbytes) ? _shmemmagazine_get(nbytes) : NULL;
+    if (mag) {
+        if (mag->nblocks == 0) {
+            // Refill the magazine with a batch of blocks under a single lock.
+            pthread_mutex_lock(&allocator->mtx);
+            while (mag->nblocks < SHD_SHMEM_MAGAZINE_BATCH) {
+                ShMemBlock fresh = _shmemallocator_littleAlloc(allocator, nbytes);
+                if (fresh.p == NULL) {
+                    break;
+                }
+                mag->blocks[mag->nblocks++] = fresh.p;
+            }
+            pthread_mutex_unlock(&allocator->mtx);
+        }
+
+        if (mag->nblocks > 0) {
+            blk.p = mag->blocks[--mag->nblocks];
+            blk.nbytes = nbytes;
+        }
+        return blk;
+    }
+
     pthread_mutex_lock(&allocator->mtx);
 
     if (nbytes > SHD_SHMEM_ALLOCATOR_CUTOVER_NBYTES) {
@@ -337,6 +492,7 @@ static void _shmemallocator_bigFree(ShMemAllocator* allocator,
 
     needle->prv->nxt = needle->nxt;
     needle->nxt->prv = needle->prv;
+    _shmemallocator_addStat(&allocator->stats.big_alloc_nbytes, -(ssize_t)needle->shmf.nbytes);
     shmemfile_free(&needle->shmf);
     free(needle);
 }
@@ -350,11 +506,39 @@ static void _shmemallocator_littleFree(ShMemAllocator* allocator,
 
     buddy_free(blk->p, pool_node->meta, pool_node->file_node.shmf.p,
                SHD_SHMEM_ALLOCATOR_POOL_NBYTES);
+    _shmemallocator_addStat(&allocator->stats.little_alloc_nbytes, -(ssize_t)blk->nbytes);
+}
+
+ShMemAllocatorStats shmemallocator_getStats(ShMemAllocator* allocator) {
+    assert(allocator);
+
+    size_t npools = __atomic_load_n(&allocator->stats.npools, __ATOMIC_RELAXED);
+    return (ShMemAllocatorStats){
+        .npools = npools,
+        .pool_nbytes = npools * SHD_SHMEM_ALLOCATOR_POOL_NBYTES,
+        .little_alloc_nbytes =
+            __atomic_load_n(&allocator->stats.little_alloc_nbytes, __ATOMIC_RELAXED),
+        .big_alloc_nbytes = __atomic_load_n(&allocator->stats.big_alloc_nbytes, __ATOMIC_RELAXED),
+    };
 }
 
 void shmemallocator_free(ShMemAllocator* allocator, ShMemBlock* blk) {
     assert(allocator && blk);
 
+    ShMemMagazine* mag =
+        _shmemmagazine_isUsable(allocator, blk->nbytes) ? _shmemmagazine_get(blk->nbytes) : NULL;
+    if (mag) {
+        if (mag->nblocks == SHD_SHMEM_MAGAZINE_NBLOCKS) {
+            // Return a batch of blocks to the allocator under a single lock.
+            pthread_mutex_lock(&allocator->mtx);
+            _shmemmagazine_drain(
+                mag, allocator, SHD_SHMEM_MAGAZINE_NBLOCKS - SHD_SHMEM_MAGAZINE_BATCH);
+            pthread_mutex_unlock(&allocator->mtx);
+        }
+        mag->blocks[mag->nblocks++] = blk->p;
+        return;
+    }
+
     pthread_mutex_lock(&allocator->mtx);
 
     if (blk->nbytes > SHD_SHMEM_ALLOCATOR_CUTOVER_NBYTES) {
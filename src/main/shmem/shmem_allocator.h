@@ -100,6 +100,52 @@ void shmemallocator_destroy(ShMemAllocator* allocator);
  */
 void shmemallocator_destroyNoShmDelete(ShMemAllocator* allocator);
 
+/*
+ * Sets whether shared memory files that are at least a huge page long are
+ * mapped so that the kernel can back them with transparent huge pages. This
+ * applies to every file allocated by an allocator or mapped by a serializer in
+ * this process after the call.
+ *
+ * THREAD SAFETY: not thread-safe; should be called before any allocator or
+ * serializer is used.
+ */
+void shmemallocator_setUseHugePages(bool useHugePages);
+
+/*
+ * Logs how much of the memory currently mapped by this allocator is backed by
+ * huge pages.
+ *
+ * THREAD SAFETY: thread-safe; can be called by two threads in parallel on the
+ * same allocator object.
+ *
+ * PRE: allocator is non-null and points to a valid allocator created by
+ * shmemallocator_create().
+ */
+void shmemallocator_logHugePageCoverage(ShMemAllocator* allocator);
+
+typedef struct _ShMemAllocatorStats {
+    // number of pools that little blocks are allocated from
+    size_t npools;
+    // bytes mapped for the pools
+    size_t pool_nbytes;
+    // bytes of little blocks allocated from the pools, including blocks cached
+    // by threads for reuse
+    size_t little_alloc_nbytes;
+    // bytes mapped for big blocks, which each get their own file
+    size_t big_alloc_nbytes;
+} ShMemAllocatorStats;
+
+/*
+ * Returns how much shared memory the allocator is using.
+ *
+ * THREAD SAFETY: thread-safe, and doesn't take the allocator lock, so the
+ * values may be slightly out of date while other threads use the allocator.
+ *
+ * PRE: allocator is non-null and points to a valid allocator created by
+ * shmemallocator_create().
+ */
+ShMemAllocatorStats shmemallocator_getStats(ShMemAllocator* allocator);
+
 /*
  * Semantically similar to malloc(nbytes), except the memory allocated will
  * live in shared memory.  The allocator will try to fit the request into
@@ -7,8 +7,10 @@
  * Public function.
  *
  * Cleans up orphaned shared memory files that are no longer mapped by a
- * shadow process. This function should never fail or crash, but is not
- * guaranteed to reclaim all possible orphans.
+ * shadow process. Only older versions of shadow created named files; the
+ * anonymous files that it creates now go away with the process. This
+ * function should never fail or crash, but is not guaranteed to reclaim all
+ * possible orphans.
  */
 void shmemcleanup_tryCleanup();
 
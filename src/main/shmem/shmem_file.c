@@ -3,13 +3,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -21,22 +21,32 @@
 #include "main/shmem/shmem_util.h"
 
 static const char* SHADOW_PREFIX = "shadow_shmemfile";
-static const char PID_DELIM = '-';
+// Separates the /proc path of a file's name from its unique suffix.
+static const char NAME_SUFFIX_DELIM = ':';
 
-const static int SHMEM_PERMISSION_BITS = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+// Size of a transparent huge page on the architectures we support.
+#define SHMEM_HUGE_PAGE_NBYTES ((size_t)2 << 20)
 
-static void _shmemfile_getName(size_t nbytes, char* str) {
+static bool _useHugePages = false;
+
+static void _shmemfile_getName(int fd, size_t nbytes, char* str) {
     assert(str != NULL && nbytes >= 3);
 
-    struct timespec ts = {0};
-    clock_gettime(CLOCK_MONOTONIC, &ts);
+    static atomic_ullong nextId = 0;
+
+    snprintf(str, MIN(SHD_SHMEM_FILE_NAME_NBYTES, nbytes), "/proc/%" PRId64 "/fd/%d%c%llu",
+             (int64_t)getpid(), fd, NAME_SUFFIX_DELIM, atomic_fetch_add(&nextId, 1));
+}
 
-    pid_t pid = getpid();
+// Writes the path that the file can be opened through into path.
+static void _shmemfile_getPath(const char* name, char* path) {
+    strncpy(path, name, SHD_SHMEM_FILE_NAME_NBYTES - 1);
+    path[SHD_SHMEM_FILE_NAME_NBYTES - 1] = '\0';
 
-    snprintf(str, MIN(SHD_SHMEM_FILE_NAME_NBYTES, nbytes),
-             "/%s_%llu.%llu%c%" PRId64, SHADOW_PREFIX,
-             (unsigned long long)ts.tv_sec, (unsigned long long)ts.tv_nsec,
-             PID_DELIM, (int64_t)pid);
+    char* delim = strchr(path, NAME_SUFFIX_DELIM);
+    if (delim) {
+        *delim = '\0';
+    }
 }
 
 bool shmemfile_nameHasShadowPrefix(const char* name) {
@@ -72,6 +82,86 @@ static size_t _shmemfile_systemPageNBytes() {
     return (size_t)sysconf(_SC_PAGESIZE);
 }
 
+void shmemfile_setUseHugePages(bool useHugePages) { _useHugePages = useHugePages; }
+
+// Maps the whole file. When huge pages are enabled and the file is big enough,
+// the mapping is aligned to a huge page boundary and marked as eligible for
+// transparent huge pages; the kernel can only back a shared mapping with huge
+// pages where both the address and the file offset are huge page aligned.
+static void* _shmemfile_mmap(int fd, size_t nbytes) {
+    if (!_useHugePages || nbytes < SHMEM_HUGE_PAGE_NBYTES) {
+        return mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    // Reserve enough address space to contain an aligned mapping of the file.
+    size_t reservedNBytes = nbytes + SHMEM_HUGE_PAGE_NBYTES;
+    uint8_t* reserved =
+        mmap(NULL, reservedNBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    uint8_t* aligned =
+        (uint8_t*)_shmemfile_roundUpToMultiple((size_t)reserved, SHMEM_HUGE_PAGE_NBYTES);
+    void* p = mmap(aligned, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    if (p == MAP_FAILED) {
+        int err = errno;
+        munmap(reserved, reservedNBytes);
+        errno = err;
+        return MAP_FAILED;
+    }
+
+    // Give back the unused parts of the reservation.
+    if (aligned > reserved) {
+        munmap(reserved, aligned - reserved);
+    }
+    size_t tailNBytes = (reserved + reservedNBytes) - (aligned + nbytes);
+    if (tailNBytes > 0) {
+        munmap(aligned + nbytes, tailNBytes);
+    }
+
+    if (madvise(p, nbytes, MADV_HUGEPAGE) != 0) {
+        static bool warned = false;
+        if (!warned) {
+            warning("madvise(MADV_HUGEPAGE) failed, shared memory will use regular pages: %s",
+                    strerror(errno));
+            warned = true;
+        }
+    }
+
+    return p;
+}
+
+size_t shmemfile_hugePageNBytes(const ShMemFile* shmf) {
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL) {
+        return 0;
+    }
+
+    size_t hugeNBytes = 0;
+    bool inMapping = false;
+    char line[512];
+
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        unsigned long start = 0, end = 0;
+        unsigned long kb = 0;
+
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            // The header line of the next mapping.
+            if (inMapping) {
+                break;
+            }
+            inMapping = (start == (unsigned long)shmf->p);
+        } else if (inMapping && sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1) {
+            hugeNBytes = (size_t)kb * 1024;
+            break;
+        }
+    }
+
+    fclose(smaps);
+    return hugeNBytes;
+}
+
 int shmemfile_alloc(size_t nbytes, ShMemFile* shmf) {
     if (nbytes == 0 || nbytes % _shmemfile_systemPageNBytes() != 0) {
         panic("ShMemFile size must be a positive multiple of %zu but requested "
@@ -87,19 +177,18 @@ int shmemfile_alloc(size_t nbytes, ShMemFile* shmf) {
     }
 
     memset(shmf, 0, sizeof(ShMemFile));
-
-    _shmemfile_getName(SHD_SHMEM_FILE_NAME_NBYTES, shmf->name);
+    shmf->fd = -1;
 
     bool bad = false;
 
-    int fd =
-        shm_open(shmf->name, O_RDWR | O_CREAT | O_EXCL, SHMEM_PERMISSION_BITS);
+    // The file goes away with its last descriptor and mapping, so there is nothing
+    // to clean up if we crash.
+    int fd = memfd_create(SHADOW_PREFIX, MFD_CLOEXEC);
 
     if (fd >= 0) {
         int rc = ftruncate(fd, nbytes);
         if (rc == 0) {
-            void* p =
-                mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            void* p = _shmemfile_mmap(fd, nbytes);
 
             if (p != MAP_FAILED) {
                 shmf->p = p;
@@ -114,15 +203,16 @@ int shmemfile_alloc(size_t nbytes, ShMemFile* shmf) {
             bad = true;
         }
 
-        close(fd);
-
         if (bad) {
-            rc = shm_unlink(shmf->name);
-            assert(rc == 0);
+            close(fd);
+        } else {
+            // Other processes open the file through our descriptor.
+            shmf->fd = fd;
+            _shmemfile_getName(fd, SHD_SHMEM_FILE_NAME_NBYTES, shmf->name);
         }
     } else {
         bad = true;
-        panic("error on shm_open: %s", strerror(errno));
+        panic("error on memfd_create: %s", strerror(errno));
     }
 
     return -1 * (bad);
@@ -143,18 +233,20 @@ int shmemfile_map(const char* name, size_t nbytes, ShMemFile* shmf) {
         return -1;
     }
 
-    int rc = 0;
     memset(shmf, 0, sizeof(ShMemFile));
-    strncpy(shmf->name, name, SHD_SHMEM_FILE_NAME_NBYTES);
+    shmf->fd = -1;
+    strncpy(shmf->name, name, SHD_SHMEM_FILE_NAME_NBYTES - 1);
+
+    char path[SHD_SHMEM_FILE_NAME_NBYTES];
+    _shmemfile_getPath(name, path);
 
     bool bad = false;
 
-    int fd = shm_open(shmf->name, O_RDWR, SHMEM_PERMISSION_BITS);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
 
     if (fd >= 0) {
 
-        void* p = mmap(NULL, nbytes, PROT_READ | PROT_WRITE,
-                       MAP_SHARED, fd, 0);
+        void* p = _shmemfile_mmap(fd, nbytes);
 
         if (p != MAP_FAILED) {
             shmf->p = p;
@@ -165,14 +257,9 @@ int shmemfile_map(const char* name, size_t nbytes, ShMemFile* shmf) {
         }
 
         close(fd);
-
-        if (bad) {
-            rc = shm_unlink(shmf->name);
-            assert(rc == 0);
-        }
     } else {
         bad = true;
-        panic("error on shm_open: %s", strerror(errno));
+        panic("error on open of %s: %s", path, strerror(errno));
     }
 
     return -1 * (bad);
@@ -189,10 +276,11 @@ int shmemfile_unmap(ShMemFile* shmf) {
 int shmemfile_free(ShMemFile* shmf) {
     int rc = shmemfile_unmap(shmf);
     if (rc == 0) {
-        rc = shm_unlink(shmf->name);
+        rc = close(shmf->fd);
         if (rc) {
-            panic("error on shm_unlink of %s: %s", shmf->name, strerror(errno));
+            panic("error on close of %s: %s", shmf->name, strerror(errno));
         }
+        shmf->fd = -1;
     }
 
     return rc;
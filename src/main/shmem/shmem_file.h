@@ -10,9 +10,14 @@
 
 #define SHD_SHMEM_FILE_NAME_NBYTES (NAME_MAX < 256 ? NAME_MAX : 256)
 
+// Files are anonymous memfds. Other processes map them through the file's name,
+// which is the /proc path of the owner's descriptor followed by a suffix that
+// keeps names unique when the descriptor number is reused.
 typedef struct _ShMemFile {
     void *p;
     size_t nbytes;
+    // The memfd, which only the process that allocated the file keeps open.
+    int fd;
     char name[SHD_SHMEM_FILE_NAME_NBYTES];
 } ShMemFile;
 
@@ -21,9 +26,15 @@ typedef struct _ShMemFile {
 extern "C" {
 #endif
 
+// For the named files in /dev/shm that older versions of shadow created.
 bool shmemfile_nameHasShadowPrefix(const char *name);
 pid_t shmemfile_pidFromName(const char *name);
 
+// Whether files that are at least a huge page long should be mapped so that
+// they can be backed by transparent huge pages. Affects files allocated or
+// mapped after the call.
+void shmemfile_setUseHugePages(bool useHugePages);
+
 int shmemfile_alloc(size_t nbytes, ShMemFile *shmf);
 
 int shmemfile_map(const char *name, size_t nbytes, ShMemFile *shmf);
@@ -33,6 +44,9 @@ int shmemfile_free(ShMemFile *shmf);
 
 size_t shmemfile_goodSizeNBytes(size_t requested_nbytes);
 
+// How many bytes of the file's mapping are currently backed by huge pages.
+size_t shmemfile_hugePageNBytes(const ShMemFile *shmf);
+
 #ifdef __cplusplus
 }
 #endif
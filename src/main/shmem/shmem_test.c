@@ -1,15 +1,20 @@
+#include "lib/shim/ipc.h"
+#include "lib/shim/shim_event.h"
 #include "main/shmem/buddy.h"
 #include "main/shmem/shmem_allocator.h"
 #include "main/shmem/shmem_file.h"
 #include "main/shmem/shmem_util.h"
 
+#include <getopt.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <glib.h>
 #include <sys/types.h>
@@ -536,6 +541,251 @@ static void shmemallocator_auxTestForkExec(int argc, char **argv) {
     exit(rc);
 }
 
+/*
+ * Throughput benchmark, run with `shd-shmem-test BENCHMARK [options]` (or
+ * `make benchmark-shmem`) rather than as a test. For each thread count, a
+ * child process runs that many threads against the global allocator, the way
+ * Shadow's workers use it. Each thread holds a window of live blocks, and
+ * repeatedly replaces a random one: it frees the old block, allocates a new one
+ * of the size of an IPC channel, a ShimSharedMem, or a payload between the
+ * payload bounds, serializes it, and deserializes it both with the global
+ * serializer (as the shim does) and with the allocator (as Shadow does for
+ * blocks that come back). Every call counts as one op. Once the threads have
+ * exited, it compares the bytes of the blocks still live with the bytes mapped
+ * for the pools, which gives the fragmentation of the pools.
+ */
+
+static const char* benchmark_key = "BENCHMARK";
+
+typedef struct _ShMemBenchmarkArgs {
+    size_t ncycles;
+    size_t nlive;
+    size_t payloadMinNBytes;
+    size_t payloadMaxNBytes;
+} ShMemBenchmarkArgs;
+
+typedef struct _ShMemBenchmarkThread {
+    const ShMemBenchmarkArgs* args;
+    pthread_barrier_t* barrier;
+    unsigned int seed;
+    ShMemBlock* live;
+    size_t nops;
+} ShMemBenchmarkThread;
+
+static size_t _shmembenchmark_nextSize(ShMemBenchmarkThread* thread) {
+    // Most of the blocks that Shadow allocates are for new threads, which each
+    // get an IPC channel and a ShimSharedMem; the rest hold syscall payloads.
+    int r = rand_r(&thread->seed) % 10;
+    if (r < 4) {
+        return ipcData_nbytes();
+    } else if (r < 8) {
+        return sizeof(ShimSharedMem);
+    }
+    const ShMemBenchmarkArgs* args = thread->args;
+    size_t range = args->payloadMaxNBytes - args->payloadMinNBytes + 1;
+    return args->payloadMinNBytes + ((size_t)rand_r(&thread->seed) % range);
+}
+
+static void* _shmembenchmark_runThread(void* arg) {
+    ShMemBenchmarkThread* thread = arg;
+    const ShMemBenchmarkArgs* args = thread->args;
+    ShMemSerializer* serializer = shmemserializer_getGlobal();
+
+    pthread_barrier_wait(thread->barrier);
+
+    for (size_t i = 0; i < args->ncycles; i++) {
+        ShMemBlock* slot = &thread->live[rand_r(&thread->seed) % args->nlive];
+        if (slot->p) {
+            shmemallocator_globalFree(slot);
+            thread->nops++;
+        }
+
+        size_t nbytes = _shmembenchmark_nextSize(thread);
+        ShMemBlock blk = shmemallocator_globalAlloc(nbytes);
+        if (!blk.p) {
+            fprintf(stderr, "allocating %zu bytes failed\n", nbytes);
+            exit(EXIT_FAILURE);
+        }
+        ((char*)blk.p)[0] = (char)i;
+
+        ShMemBlockSerialized serial = shmemallocator_globalBlockSerialize(&blk);
+        ShMemBlock shimBlk = shmemserializer_blockDeserialize(serializer, &serial);
+        ShMemBlock shadowBlk = shmemallocator_globalBlockDeserialize(&serial);
+        if (((char*)shimBlk.p)[0] != (char)i || shadowBlk.p != blk.p) {
+            fprintf(stderr, "deserializing a block of %zu bytes failed\n", nbytes);
+            exit(EXIT_FAILURE);
+        }
+        thread->nops += 4;
+
+        *slot = blk;
+    }
+
+    return NULL;
+}
+
+// Runs the benchmark with nthreads threads, and prints the results as a JSON
+// object, also appending it to the output file if there is one.
+static void _shmembenchmark_run(const ShMemBenchmarkArgs* args, size_t nthreads,
+                                const char* outputPath) {
+    ShMemBenchmarkThread* threads = calloc(nthreads, sizeof(ShMemBenchmarkThread));
+    pthread_t* handles = calloc(nthreads, sizeof(pthread_t));
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, nthreads + 1);
+
+    for (size_t i = 0; i < nthreads; i++) {
+        threads[i].args = args;
+        threads[i].barrier = &barrier;
+        threads[i].seed = (unsigned int)i + 1;
+        threads[i].live = calloc(args->nlive, sizeof(ShMemBlock));
+        if (pthread_create(&handles[i], NULL, _shmembenchmark_runThread, &threads[i]) != 0) {
+            fprintf(stderr, "creating a benchmark thread failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct timespec start, end;
+    pthread_barrier_wait(&barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < nthreads; i++) {
+        pthread_join(handles[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // The threads' cached blocks went back to the pools when they exited, so the
+    // pools now only hold the live blocks.
+    size_t nops = 0, liveNBytes = 0;
+    for (size_t i = 0; i < nthreads; i++) {
+        nops += threads[i].nops;
+        for (size_t j = 0; j < args->nlive; j++) {
+            liveNBytes += threads[i].live[j].nbytes;
+        }
+    }
+    ShMemAllocatorStats stats = shmemallocator_getStats(shmemallocator_getGlobal());
+    double fragmentation =
+        stats.pool_nbytes ? 1.0 - ((double)liveNBytes) / stats.pool_nbytes : 0.0;
+
+    char line[1024];
+    snprintf(line, sizeof(line),
+             "{\"benchmark\": \"shmem\", \"threads\": %zu, \"cycles_per_thread\": %zu, "
+             "\"live_blocks_per_thread\": %zu, \"payload_min_bytes\": %zu, "
+             "\"payload_max_bytes\": %zu, \"seconds\": %f, \"ops\": %zu, "
+             "\"ops_per_second\": %f, \"live_bytes\": %zu, \"pools\": %zu, "
+             "\"pool_bytes\": %zu, \"little_alloc_bytes\": %zu, \"big_alloc_bytes\": %zu, "
+             "\"fragmentation\": %f}\n",
+             nthreads, args->ncycles, args->nlive, args->payloadMinNBytes,
+             args->payloadMaxNBytes, seconds, nops, nops / seconds, liveNBytes, stats.npools,
+             stats.pool_nbytes, stats.little_alloc_nbytes, stats.big_alloc_nbytes,
+             fragmentation);
+    fputs(line, stdout);
+    if (outputPath) {
+        FILE* output = fopen(outputPath, "a");
+        if (!output) {
+            fprintf(stderr, "opening %s failed\n", outputPath);
+            exit(EXIT_FAILURE);
+        }
+        fputs(line, output);
+        fclose(output);
+    }
+
+    for (size_t i = 0; i < nthreads; i++) {
+        for (size_t j = 0; j < args->nlive; j++) {
+            if (threads[i].live[j].p) {
+                shmemallocator_globalFree(&threads[i].live[j]);
+            }
+        }
+        free(threads[i].live);
+    }
+    pthread_barrier_destroy(&barrier);
+    free(handles);
+    free(threads);
+}
+
+static void shmemallocator_benchmark(int argc, char** argv) {
+    ShMemBenchmarkArgs args = {
+        .ncycles = 100000,
+        .nlive = 256,
+        .payloadMinNBytes = 64 * 1024,
+        .payloadMaxNBytes = 1024 * 1024,
+    };
+    const char* threadCounts = "1,2,4,8,16";
+    const char* outputPath = NULL;
+
+    static const struct option options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"cycles", required_argument, NULL, 'c'},
+        {"live", required_argument, NULL, 'l'},
+        {"payload-min", required_argument, NULL, 'm'},
+        {"payload-max", required_argument, NULL, 'M'},
+        {"output", required_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0},
+    };
+
+    // skip the BENCHMARK argument
+    int opt;
+    while ((opt = getopt_long(argc - 1, argv + 1, "", options, NULL)) != -1) {
+        switch (opt) {
+            case 't':
+                threadCounts = optarg;
+                break;
+            case 'c':
+                args.ncycles = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                args.nlive = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                args.payloadMinNBytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'M':
+                args.payloadMaxNBytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            default:
+                fprintf(stderr,
+                        "usage: %s %s [--threads N,...] [--cycles N] [--live N] "
+                        "[--payload-min BYTES] [--payload-max BYTES] [--output FILE]\n",
+                        argv[0], benchmark_key);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (args.nlive == 0 || args.payloadMinNBytes == 0 ||
+        args.payloadMaxNBytes < args.payloadMinNBytes) {
+        fprintf(stderr, "invalid benchmark arguments\n");
+        exit(EXIT_FAILURE);
+    }
+
+    gchar** counts = g_strsplit(threadCounts, ",", -1);
+    for (gchar** count = counts; *count; count++) {
+        size_t nthreads = strtoul(*count, NULL, 10);
+        if (nthreads == 0) {
+            continue;
+        }
+
+        // Each run gets a fresh global allocator in its own process, so that the
+        // pools of earlier runs don't count toward its fragmentation.
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            _shmembenchmark_run(&args, nthreads, outputPath);
+            fflush(stdout);
+            exit(EXIT_SUCCESS);
+        }
+
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "the benchmark with %zu threads failed\n", nthreads);
+            exit(EXIT_FAILURE);
+        }
+    }
+    g_strfreev(counts);
+
+    exit(EXIT_SUCCESS);
+}
+
 int main(int argc, char** argv) {
 
     if (argc > 2) {
@@ -544,6 +794,10 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (argc > 1 && strcmp(argv[1], benchmark_key) == 0) {
+        shmemallocator_benchmark(argc, argv);
+    }
+
     g_test_init(&argc, &argv, NULL);
     g_test_set_nonfatal_assertions();
 
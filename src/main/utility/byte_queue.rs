@@ -6,22 +6,36 @@
 /*!
 A shared buffer that is composed of several chunks. The buffer can be read
 and written and guarantees it will not allow reading more than was written.
-Its basically a linked queue that is written (and grows) at the front and
-read (and shrinks) from the back. As data is written, new chunks are created
-automatically. As data is read, old chunks are freed automatically.
+Its basically a queue of chunks that is written (and grows) at the back and
+read (and shrinks) from the front. As data is written, new chunks are added
+automatically. As data is read, old chunks are removed automatically and kept
+for reuse, so that a buffer with a steady stream of data doesn't allocate.
+
+The data can also be accessed in place using [`ByteQueue::readable_slices`]
+and [`ByteQueue::writable_slice`], so that callers can copy directly between
+the queue and plugin memory without an intermediate buffer.
 */
 
-use std::collections::LinkedList;
+use std::collections::VecDeque;
 use std::io::Read;
 
+/// The maximum number of empty chunks that we keep around for reuse.
+const MAX_UNUSED_CHUNKS: usize = 4;
+
 struct ByteChunk {
-    buf: Vec<u8>,
+    buf: Box<[u8]>,
+    /// Number of bytes of `buf` that were written.
+    len: usize,
 }
 
 /// A queue of byte chunks.
 pub struct ByteQueue {
-    chunks: LinkedList<ByteChunk>,
-    tail_read_offset: usize,
+    /// The oldest chunk is at the front and the newest is at the back.
+    chunks: VecDeque<ByteChunk>,
+    /// Empty chunks that can be reused.
+    unused_chunks: Vec<ByteChunk>,
+    /// Number of bytes that were already read from the front chunk.
+    front_read_offset: usize,
     length: usize,
     chunk_capacity: usize,
 }
@@ -29,16 +43,19 @@ pub struct ByteQueue {
 impl ByteChunk {
     fn new(capacity: usize) -> ByteChunk {
         ByteChunk {
-            buf: Vec::with_capacity(capacity),
+            buf: vec![0; capacity].into_boxed_slice(),
+            len: 0,
         }
     }
 }
 
 impl ByteQueue {
     pub fn new(chunk_capacity: usize) -> ByteQueue {
+        assert!(chunk_capacity > 0);
         ByteQueue {
-            chunks: LinkedList::new(),
-            tail_read_offset: 0,
+            chunks: VecDeque::new(),
+            unused_chunks: Vec::new(),
+            front_read_offset: 0,
             length: 0,
             chunk_capacity,
         }
@@ -53,40 +70,28 @@ impl ByteQueue {
         self.len() == 0
     }
 
-    /// Push bytes to the head of the queue.
+    /// Push bytes to the back of the queue.
     /// Returns an error iff `src` returns an error; i.e. this is infallible for
     /// an infallible `src` such as a slice.
     pub fn push<R: Read>(&mut self, src: R) -> std::io::Result<usize> {
-        // create new buffer head lazily as opposed to proactively
-        if self.chunks.is_empty() {
-            self.create_new_head();
-        }
-
         let mut total_written = 0;
         let mut src = src;
 
         // while there are bytes to copy
         loop {
-            let head = &mut self.chunks.front_mut().unwrap().buf;
-            let head_space = head.capacity() - head.len();
-
-            // if we have no space, allocate a new chunk at head
-            if head_space == 0 {
-                self.create_new_head();
-                continue;
-            }
-
-            let written = src.by_ref().take(head_space as u64).read_to_end(head)?;
-            self.length += written;
+            let written = match src.read(self.writable_slice()) {
+                Ok(x) => x,
+                Err(e) if e.kind() == std::io::ErrorKind::Interrupted => continue,
+                Err(e) => {
+                    self.commit(0);
+                    return Err(e);
+                }
+            };
+            self.commit(written);
             total_written += written;
 
             if written == 0 {
                 // End of the reader
-                if head.len() == 0 {
-                    // We created an empty head but ended up not reading any
-                    // data into it.
-                    self.chunks.pop_front();
-                }
                 return Ok(total_written);
             }
         }
@@ -100,26 +105,19 @@ impl ByteQueue {
         let mut dst = dst;
 
         loop {
-            let back = match self.chunks.back() {
+            let front = match self.readable_slices().next() {
                 Some(x) => x,
                 None => {
                     // No more data to copy
                     return Ok(total_copied);
                 }
             };
-            debug_assert_ne!(self.get_available_bytes_tail(), 0);
 
             // copy bytes to dst
-            let copied = dst.write(&back.buf[self.tail_read_offset..])?;
-            self.tail_read_offset += copied;
-            self.length -= copied;
+            let copied = dst.write(front)?;
+            self.consume(copied);
             total_copied += copied;
 
-            // proactively destroy old tail
-            if self.get_available_bytes_tail() == 0 {
-                self.destroy_old_tail();
-            }
-
             if copied == 0 {
                 // Writer EOF
                 return Ok(total_copied);
@@ -127,25 +125,96 @@ impl ByteQueue {
         }
     }
 
-    fn create_new_head(&mut self) {
-        if self.chunks.is_empty() {
-            // this will also be the tail
-            self.tail_read_offset = 0;
+    /// The bytes in the queue, in order, as contiguous slices. None of the
+    /// slices are empty.
+    pub fn readable_slices(&self) -> impl Iterator<Item = &[u8]> {
+        let front_read_offset = self.front_read_offset;
+        self.chunks
+            .iter()
+            .enumerate()
+            .map(move |(i, chunk)| {
+                let start = if i == 0 { front_read_offset } else { 0 };
+                &chunk.buf[start..chunk.len]
+            })
+            .filter(|x| !x.is_empty())
+    }
+
+    /// Removes `n` bytes from the front of the queue, for example after
+    /// copying them out of [`ByteQueue::readable_slices`].
+    pub fn consume(&mut self, n: usize) {
+        assert!(n <= self.length);
+        let mut n = n;
+
+        while n > 0 {
+            let front = self.chunks.front().unwrap();
+            let available = front.len - self.front_read_offset;
+            let consumed = std::cmp::min(n, available);
+
+            self.front_read_offset += consumed;
+            self.length -= consumed;
+            n -= consumed;
+
+            // proactively remove the old front
+            if consumed == available {
+                self.recycle_front();
+            }
         }
+    }
+
+    /// Returns the unused space at the back of the queue, adding a chunk if
+    /// needed. The returned slice is never empty. Bytes that were written to it
+    /// must be added to the queue with [`ByteQueue::commit`] before any other
+    /// call that modifies the queue.
+    pub fn writable_slice(&mut self) -> &mut [u8] {
+        // create new chunks lazily as opposed to proactively
+        let needs_chunk = match self.chunks.back() {
+            Some(back) => back.len == back.buf.len(),
+            None => true,
+        };
+        if needs_chunk {
+            self.add_back();
+        }
+
+        let back = self.chunks.back_mut().unwrap();
+        &mut back.buf[back.len..]
+    }
 
-        self.chunks.push_front(ByteChunk::new(self.chunk_capacity));
+    /// Adds `n` bytes that were written to [`ByteQueue::writable_slice`] to
+    /// the back of the queue.
+    pub fn commit(&mut self, n: usize) {
+        let back = self.chunks.back_mut().unwrap();
+        assert!(back.len + n <= back.buf.len());
+        back.len += n;
+        self.length += n;
+
+        if back.len == 0 {
+            // We added an empty chunk but ended up not writing any data into it.
+            let chunk = self.chunks.pop_back().unwrap();
+            self.unused_chunks.push(chunk);
+        }
     }
 
-    fn destroy_old_tail(&mut self) {
-        self.chunks.pop_back();
-        self.tail_read_offset = 0;
+    fn add_back(&mut self) {
+        if self.chunks.is_empty() {
+            // this will also be the front
+            self.front_read_offset = 0;
+        }
+
+        let chunk_capacity = self.chunk_capacity;
+        let chunk = self
+            .unused_chunks
+            .pop()
+            .unwrap_or_else(|| ByteChunk::new(chunk_capacity));
+        self.chunks.push_back(chunk);
     }
 
-    fn get_available_bytes_tail(&self) -> usize {
-        match self.chunks.len() {
-            0 => 0,
-            1 => self.chunks.front().unwrap().buf.len() - self.tail_read_offset,
-            _ => self.chunk_capacity - self.tail_read_offset,
+    fn recycle_front(&mut self) {
+        let mut chunk = self.chunks.pop_front().unwrap();
+        self.front_read_offset = 0;
+
+        if self.unused_chunks.len() < MAX_UNUSED_CHUNKS {
+            chunk.len = 0;
+            self.unused_chunks.push(chunk);
         }
     }
 }
@@ -208,6 +277,63 @@ mod export {
         let dst = unsafe { slice::from_raw_parts_mut(dst, len) };
         bq.pop(dst).unwrap()
     }
+
+    /// Returns the first contiguous run of bytes in the queue and stores its
+    /// length in `len`, or returns NULL if the queue is empty. The bytes stay
+    /// in the queue until they are removed with `bytequeue_consume`.
+    #[no_mangle]
+    pub extern "C" fn bytequeue_peekReadable(
+        bq: *mut ByteQueue,
+        len: *mut libc::size_t,
+    ) -> *const std::os::raw::c_uchar {
+        assert!(!bq.is_null());
+        assert!(!len.is_null());
+        let bq = unsafe { &mut *bq };
+        let len = unsafe { &mut *len };
+
+        match bq.readable_slices().next() {
+            Some(x) => {
+                *len = x.len();
+                x.as_ptr()
+            }
+            None => {
+                *len = 0;
+                std::ptr::null()
+            }
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn bytequeue_consume(bq: *mut ByteQueue, len: libc::size_t) {
+        assert!(!bq.is_null());
+        let bq = unsafe { &mut *bq };
+        bq.consume(len);
+    }
+
+    /// Returns the unused space at the back of the queue and stores its
+    /// (non-zero) length in `len`. Must be followed by `bytequeue_commitWritten`
+    /// with the number of bytes that were written to it.
+    #[no_mangle]
+    pub extern "C" fn bytequeue_reserveWritable(
+        bq: *mut ByteQueue,
+        len: *mut libc::size_t,
+    ) -> *mut std::os::raw::c_uchar {
+        assert!(!bq.is_null());
+        assert!(!len.is_null());
+        let bq = unsafe { &mut *bq };
+        let len = unsafe { &mut *len };
+
+        let space = bq.writable_slice();
+        *len = space.len();
+        space.as_mut_ptr()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn bytequeue_commitWritten(bq: *mut ByteQueue, len: libc::size_t) {
+        assert!(!bq.is_null());
+        let bq = unsafe { &mut *bq };
+        bq.commit(len);
+    }
 }
 
 #[cfg(test)]
@@ -244,4 +370,64 @@ mod tests {
         assert_eq!(dst2, [9, 10, 11, 12, 13, 51, 52, 53, 0, 0]);
         assert_eq!(bq.length, 0);
     }
+
+    #[test]
+    fn test_bytequeue_recycles_chunks() {
+        let chunk_size = 4;
+        let mut bq = ByteQueue::new(chunk_size);
+
+        let src = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10];
+        let mut dst = [0; 10];
+
+        for _ in 0..3 {
+            assert_eq!(bq.push(&src[..]).unwrap(), src.len());
+            assert_eq!(bq.pop(&mut dst[..]).unwrap(), src.len());
+            assert_eq!(dst, src);
+            assert!(bq.chunks.is_empty());
+        }
+
+        // the drained chunks were kept rather than freed
+        assert_eq!(bq.unused_chunks.len(), 3);
+    }
+
+    #[test]
+    fn test_bytequeue_slices() {
+        let chunk_size = 4;
+        let mut bq = ByteQueue::new(chunk_size);
+
+        // write in place
+        let space = bq.writable_slice();
+        assert_eq!(space.len(), chunk_size);
+        space[..3].copy_from_slice(&[1, 2, 3]);
+        bq.commit(3);
+
+        let space = bq.writable_slice();
+        assert_eq!(space.len(), 1);
+        space[0] = 4;
+        bq.commit(1);
+
+        bq.push(&[5, 6][..]).unwrap();
+
+        // an empty commit doesn't leave an empty chunk behind
+        bq.writable_slice();
+        bq.commit(0);
+        assert_eq!(bq.chunks.len(), 2);
+
+        let slices: Vec<&[u8]> = bq.readable_slices().collect();
+        assert_eq!(slices, vec![&[1, 2, 3, 4][..], &[5, 6][..]]);
+
+        bq.consume(3);
+        let slices: Vec<&[u8]> = bq.readable_slices().collect();
+        assert_eq!(slices, vec![&[4][..], &[5, 6][..]]);
+
+        bq.consume(2);
+        assert_eq!(bq.len(), 1);
+        assert_eq!(bq.chunks.len(), 1);
+        let slices: Vec<&[u8]> = bq.readable_slices().collect();
+        assert_eq!(slices, vec![&[6][..]]);
+
+        bq.consume(1);
+        assert!(bq.is_empty());
+        assert_eq!(bq.readable_slices().count(), 0);
+    }
 }
@@ -11,6 +11,10 @@ count for that key increases. The state of the counter can be extracted by conve
 to a string, which lists the counts for all keys sorted with the heaviest hitters first.
 Currently, only String types are supported, but we may eventually support counting
 generic types.
+
+For counts that are updated on hot paths, an `IndexedCounter` is keyed by small integers
+instead, so that updating it doesn't need to hash a string. Its counts are moved to a
+`Counter` when they need to be named, e.g., for logging.
 */
 
 use std::collections::HashMap;
@@ -87,6 +91,31 @@ impl Counter {
         }
     }
 
+    /// Add all values for all keys in `other` to this counter, with `prefix` prepended to
+    /// each key.
+    pub fn add_counter_with_prefix(&mut self, other: &Counter, prefix: &str) {
+        let mut key = String::from(prefix);
+        for (other_key, val) in other.items.iter() {
+            key.truncate(prefix.len());
+            key.push_str(other_key);
+            self.add_value(&key, *val);
+        }
+    }
+
+    /// Returns one `key value` line for each key, sorted by key. If the keys are lists of
+    /// frames separated by ';', this is the "folded stacks" format that flame graph tools
+    /// read.
+    pub fn to_folded_string(&self) -> String {
+        let mut item_vec = Vec::from_iter(&self.items);
+        item_vec.sort_by(|&(key_a, _), &(key_b, _)| key_a.cmp(&key_b));
+
+        let mut string = String::new();
+        for (key, val) in item_vec {
+            string.push_str(&format!("{} {}\n", key, val));
+        }
+        string
+    }
+
     /// Subtract all values for all keys in `other` from this counter.
     pub fn sub_counter(&mut self, other: &Counter) {
         for (key, val) in other.items.iter() {
@@ -167,6 +196,51 @@ impl Sub for Counter {
     }
 }
 
+/// A counter keyed by small integer indices, such as syscall numbers or registered type
+/// ids. Updating a value is an array access, so this is cheap enough to keep enabled on
+/// hot paths.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct IndexedCounter {
+    items: Vec<i64>,
+}
+
+impl IndexedCounter {
+    /// Initializes a new counter where every index has a value of 0.
+    pub fn new() -> IndexedCounter {
+        IndexedCounter { items: Vec::new() }
+    }
+
+    /// Increment the counter value by the given value for the given index.
+    /// Returns the value of the counter after it was incremented.
+    pub fn add_value(&mut self, index: usize, value: i64) -> i64 {
+        if index >= self.items.len() {
+            self.items.resize(index + 1, 0);
+        }
+        self.items[index] += value;
+        self.items[index]
+    }
+
+    /// Returns the counter value for the given index.
+    pub fn get_value(&self, index: usize) -> i64 {
+        self.items.get(index).copied().unwrap_or(0)
+    }
+
+    /// Add all non-zero values to `counter`, using `name` to get the key for each index,
+    /// and reset them to 0.
+    pub fn drain_into<'a>(
+        &mut self,
+        counter: &mut Counter,
+        mut name: impl FnMut(usize) -> &'a str,
+    ) {
+        for (index, val) in self.items.iter_mut().enumerate() {
+            if *val != 0 {
+                counter.add_value(name(index), *val);
+                *val = 0;
+            }
+        }
+    }
+}
+
 mod export {
     use super::*;
     use std::ffi::CStr;
@@ -229,6 +303,23 @@ mod export {
         counter.add_counter(other)
     }
 
+    #[no_mangle]
+    pub extern "C" fn counter_add_counter_with_prefix(
+        counter: *mut Counter,
+        other: *mut Counter,
+        prefix: *const c_char,
+    ) {
+        assert!(!counter.is_null());
+        assert!(!other.is_null());
+        assert!(!prefix.is_null());
+
+        let counter = unsafe { &mut *counter };
+        let other = unsafe { &mut *other };
+        let prefix = unsafe { CStr::from_ptr(prefix) };
+
+        counter.add_counter_with_prefix(other, &prefix.to_string_lossy())
+    }
+
     #[no_mangle]
     pub extern "C" fn counter_sub_counter(counter: *mut Counter, other: *mut Counter) {
         assert!(!counter.is_null());
@@ -254,6 +345,19 @@ mod export {
         counter == other
     }
 
+    #[no_mangle]
+    pub extern "C" fn indexedcounter_add_value(
+        counter: *mut IndexedCounter,
+        index: usize,
+        value: i64,
+    ) -> i64 {
+        assert!(!counter.is_null());
+
+        let counter = unsafe { &mut *counter };
+
+        counter.add_value(index, value)
+    }
+
     /// Creates a new string representation of the counter, e.g., for logging.
     /// The returned string must be free'd by passing it to counter_free_string.
     #[no_mangle]
@@ -267,7 +371,22 @@ mod export {
         CString::new(string).unwrap().into_raw()
     }
 
-    /// Frees a string previously returned from counter_alloc_string.
+    /// Creates a new string with one `key value` line per key, in the folded stacks format
+    /// used by flame graph tools. The returned string must be free'd by passing it to
+    /// counter_free_string.
+    #[no_mangle]
+    pub extern "C" fn counter_alloc_folded_string(counter: *mut Counter) -> *mut c_char {
+        assert!(!counter.is_null());
+
+        let counter = unsafe { &mut *counter };
+        let string = counter.to_folded_string();
+
+        // Transfer ownership back to caller
+        CString::new(string).unwrap().into_raw()
+    }
+
+    /// Frees a string previously returned from counter_alloc_string or
+    /// counter_alloc_folded_string.
     #[no_mangle]
     pub extern "C" fn counter_free_string(counter: *mut Counter, ptr: *mut c_char) {
         assert!(!counter.is_null());
@@ -418,6 +537,56 @@ mod tests {
         assert_eq!(counter_a, counter_sum);
     }
 
+    #[test]
+    fn test_add_counter_with_prefix() {
+        let mut counter_a = Counter::new();
+        counter_a.set_value("host;read", 100);
+
+        let mut counter_b = Counter::new();
+        counter_b.set_value("read", 50);
+        counter_b.set_value("write", 2);
+
+        counter_a.add_counter_with_prefix(&counter_b, "host;");
+
+        assert_eq!(counter_a.get_value("host;read"), 150);
+        assert_eq!(counter_a.get_value("host;write"), 2);
+        assert_eq!(counter_a.get_value("read"), 0);
+    }
+
+    #[test]
+    fn test_to_folded_string() {
+        let mut counter = Counter::new();
+        assert_eq!(counter.to_folded_string(), String::new());
+        counter.add_value("b;write", 5);
+        counter.add_value("a;read", 7);
+        counter.add_value("b;read", 1);
+        assert_eq!(
+            counter.to_folded_string(),
+            String::from("a;read 7\nb;read 1\nb;write 5\n")
+        );
+    }
+
+    #[test]
+    fn test_indexed_counter() {
+        let mut indexed = IndexedCounter::new();
+        assert_eq!(indexed.get_value(3), 0);
+        assert_eq!(indexed.add_value(3, 2), 2);
+        assert_eq!(indexed.add_value(3, 2), 4);
+        assert_eq!(indexed.add_value(0, 1), 1);
+        assert_eq!(indexed.get_value(1), 0);
+
+        let names = ["read", "write", "close", "open"];
+        let mut counter = Counter::new();
+        counter.set_value("open", 1);
+        indexed.drain_into(&mut counter, |i| names[i]);
+
+        assert_eq!(counter.get_value("read"), 1);
+        assert_eq!(counter.get_value("open"), 5);
+        assert_eq!(counter.get_value("write"), 0);
+        assert_eq!(indexed.get_value(3), 0);
+        assert_eq!(indexed.get_value(0), 0);
+    }
+
     #[test]
     fn test_sub_counter() {
         let mut counter_a = Counter::new();
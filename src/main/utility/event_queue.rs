@@ -1,28 +1,121 @@
 use atomic_refcell::AtomicRefCell;
 use log::*;
+use std::cell::RefCell;
+use std::collections::VecDeque;
+use std::mem::{ManuallyDrop, MaybeUninit};
 use std::sync::{Arc, Weak};
 
+/// The number of words of captured state that an event can store without boxing. This fits the
+/// closures that notify a listener: an `Arc` to the listener plus a small message.
+const INLINE_EVENT_WORDS: usize = 4;
+
+type InlineStorage = [MaybeUninit<usize>; INLINE_EVENT_WORDS];
+
+/// A closure stored in place, along with the functions that know its type.
+struct InlineEvent {
+    storage: InlineStorage,
+    call: unsafe fn(*mut InlineStorage, &mut EventQueue),
+    drop: unsafe fn(*mut InlineStorage),
+}
+
+impl InlineEvent {
+    fn fits<F>() -> bool {
+        std::mem::size_of::<F>() <= std::mem::size_of::<InlineStorage>()
+            && std::mem::align_of::<F>() <= std::mem::align_of::<InlineStorage>()
+    }
+
+    /// The caller must check that `F` `fits()`.
+    fn new<F: FnOnce(&mut EventQueue) + 'static>(f: F) -> Self {
+        debug_assert!(Self::fits::<F>());
+
+        unsafe fn call<F: FnOnce(&mut EventQueue)>(
+            storage: *mut InlineStorage,
+            event_queue: &mut EventQueue,
+        ) {
+            let f = std::ptr::read(storage as *mut F);
+            (f)(event_queue)
+        }
+
+        unsafe fn drop<F>(storage: *mut InlineStorage) {
+            std::ptr::drop_in_place(storage as *mut F)
+        }
+
+        let mut storage: InlineStorage = [MaybeUninit::uninit(); INLINE_EVENT_WORDS];
+        unsafe { std::ptr::write(storage.as_mut_ptr() as *mut F, f) };
+
+        Self {
+            storage,
+            call: call::<F>,
+            drop: drop::<F>,
+        }
+    }
+
+    fn run(self, event_queue: &mut EventQueue) {
+        // the closure is moved out by `call`, so don't drop it again
+        let mut event = ManuallyDrop::new(self);
+        unsafe { (event.call)(&mut event.storage, event_queue) }
+    }
+}
+
+impl Drop for InlineEvent {
+    fn drop(&mut self) {
+        unsafe { (self.drop)(&mut self.storage) }
+    }
+}
+
+enum Event {
+    Inline(InlineEvent),
+    Boxed(Box<dyn FnOnce(&mut EventQueue)>),
+}
+
+thread_local! {
+    /// Empty event buffers that we can reuse, so that creating an event queue doesn't allocate.
+    static SPARE_EVENT_BUFFERS: RefCell<Vec<VecDeque<Event>>> = RefCell::new(Vec::new());
+}
+
+/// The most event buffers we keep per thread. Queues are only nested a few levels deep.
+const MAX_SPARE_EVENT_BUFFERS: usize = 4;
+
 /// A queue of events (functions/closures) which when run can add their own events to the queue.
-pub struct EventQueue(std::collections::VecDeque<Box<dyn FnOnce(&mut Self)>>);
+/// Small closures such as listener notifications are stored in the queue itself rather than
+/// boxed, and the queue's buffer is reused by the next queue on the same thread, so adding
+/// and running these events doesn't allocate.
+pub struct EventQueue(VecDeque<Event>);
 
 impl EventQueue {
     /// Create an empty event queue.
     pub fn new() -> Self {
-        Self(std::collections::VecDeque::new())
+        let buffer = SPARE_EVENT_BUFFERS
+            .try_with(|spare| spare.borrow_mut().pop())
+            .ok()
+            .flatten();
+        Self(buffer.unwrap_or_else(VecDeque::new))
     }
 
     /// Add an event to the queue.
     pub fn add(&mut self, f: impl FnOnce(&mut Self) + 'static) {
-        self.0.push_back(Box::new(f));
+        self.push(f)
+    }
+
+    fn push<F: FnOnce(&mut Self) + 'static>(&mut self, f: F) {
+        let event = if InlineEvent::fits::<F>() {
+            Event::Inline(InlineEvent::new(f))
+        } else {
+            Event::Boxed(Box::new(f))
+        };
+        self.0.push_back(event);
     }
 
     /// Process all of the events in the queue (and any new events that are generated).
     pub fn run(&mut self) {
         // loop until there are no more events
         let mut count = 0;
-        while let Some(f) = self.0.pop_front() {
+        while let Some(event) = self.0.pop_front() {
             // run the event and allow it to add new events
-            (f)(self);
+            match event {
+                Event::Inline(f) => f.run(self),
+                Event::Boxed(f) => (f)(self),
+            }
 
             count += 1;
             if count == 200 {
@@ -46,69 +139,65 @@ impl EventQueue {
     }
 }
 
+impl Drop for EventQueue {
+    fn drop(&mut self) {
+        // drop any events that didn't run before giving the buffer back
+        let mut buffer = std::mem::take(&mut self.0);
+        buffer.clear();
+
+        if buffer.capacity() == 0 {
+            return;
+        }
+
+        // the thread-local may already be gone if the thread is exiting
+        let _ = SPARE_EVENT_BUFFERS.try_with(|spare| {
+            let mut spare = spare.borrow_mut();
+            if spare.len() < MAX_SPARE_EVENT_BUFFERS {
+                spare.push(buffer);
+            }
+        });
+    }
+}
+
 #[derive(Clone, Copy, PartialEq, PartialOrd)]
 struct HandleId(u32);
 
 /// A handle allows you to stop listening for events.
-pub struct Handle<T> {
+pub struct Handle<L> {
     id: HandleId,
-    source: Weak<AtomicRefCell<EventSourceInner<T>>>,
+    source: Weak<AtomicRefCell<ListenerSet<L>>>,
 }
 
-impl<T> Handle<T> {
-    fn new(id: HandleId, source: Weak<AtomicRefCell<EventSourceInner<T>>>) -> Self {
+impl<L> Handle<L> {
+    fn new(id: HandleId, source: Weak<AtomicRefCell<ListenerSet<L>>>) -> Self {
         Self { id, source }
     }
 
     pub fn stop_listening(self) {}
 }
 
-impl<T> Drop for Handle<T> {
+impl<L> Drop for Handle<L> {
     fn drop(&mut self) {
         if let Some(x) = self.source.upgrade() {
-            x.borrow_mut().remove_listener(self.id);
+            x.borrow_mut().remove(self.id);
         }
     }
 }
 
-pub struct EventSource<T> {
-    inner: Arc<AtomicRefCell<EventSourceInner<T>>>,
-}
-
-impl<T: Clone + Copy + 'static> EventSource<T> {
-    pub fn new() -> Self {
-        Self {
-            inner: Arc::new(AtomicRefCell::new(EventSourceInner::new())),
-        }
-    }
-
-    pub fn add_listener(
-        &mut self,
-        notify_fn: impl Fn(T, &mut EventQueue) + Send + Sync + 'static,
-    ) -> Handle<T> {
-        let inner_ref = Arc::downgrade(&Arc::clone(&self.inner));
-        self.inner.borrow_mut().add_listener(inner_ref, notify_fn)
-    }
-
-    pub fn notify_listeners(&mut self, message: T, event_queue: &mut EventQueue) {
-        for (_, l) in &self.inner.borrow().listeners {
-            let l_clone = l.clone();
-            event_queue.add(move |event_queue| (l_clone)(message, event_queue));
-        }
-    }
-}
-
-struct EventSourceInner<T> {
-    listeners: std::vec::Vec<(HandleId, Arc<Box<dyn Fn(T, &mut EventQueue) + Send + Sync>>)>,
+/// A set of listeners of type `L`, where each listener is removed when its `Handle` is dropped.
+/// Listeners are kept in the order they were added.
+pub struct ListenerSet<L> {
+    listeners: std::vec::Vec<(HandleId, L)>,
     next_id: std::num::Wrapping<u32>,
 }
 
-impl<T> EventSourceInner<T> {
-    pub fn new() -> Self {
-        Self {
+impl<L> ListenerSet<L> {
+    /// Create an empty set that handles can refer to.
+    pub fn new_shared() -> Arc<AtomicRefCell<Self>> {
+        Arc::new(AtomicRefCell::new(Self {
             listeners: std::vec::Vec::new(),
             next_id: std::num::Wrapping(0),
-        }
+        }))
     }
 
     fn get_unused_id(&mut self) -> HandleId {
@@ -125,25 +214,63 @@ impl<T> EventSourceInner<T> {
         handle_id
     }
 
-    pub fn add_listener(
-        &mut self,
-        inner: std::sync::Weak<AtomicRefCell<Self>>,
-        notify_fn: impl Fn(T, &mut EventQueue) + Send + Sync + 'static,
-    ) -> Handle<T> {
+    /// Add a listener to `set`, which stays until the returned handle is dropped.
+    pub fn add(set: &Arc<AtomicRefCell<Self>>, listener: L) -> Handle<L> {
+        let mut inner = set.borrow_mut();
+        let handle_id = inner.get_unused_id();
+        inner.listeners.push((handle_id, listener));
+        Handle::new(handle_id, Arc::downgrade(set))
+    }
+
+    /// Add a listener that is removed with `retain` rather than through a handle.
+    pub fn add_unhandled(&mut self, listener: L) {
         let handle_id = self.get_unused_id();
+        self.listeners.push((handle_id, listener));
+    }
 
-        self.listeners
-            .push((handle_id, Arc::new(Box::new(notify_fn))));
+    /// Keep only the listeners for which the function returns true.
+    pub fn retain(&mut self, mut f: impl FnMut(&L) -> bool) {
+        self.listeners.retain(|(_, l)| f(l));
+    }
 
-        Handle::new(handle_id, inner)
+    pub fn iter(&self) -> impl Iterator<Item = &L> {
+        self.listeners.iter().map(|(_, l)| l)
     }
 
-    pub fn remove_listener(&mut self, id: HandleId) {
+    fn remove(&mut self, id: HandleId) {
         self.listeners
             .remove(self.listeners.iter().position(|x| x.0 == id).unwrap());
     }
 }
 
+pub type ListenerFn<T> = Arc<dyn Fn(T, &mut EventQueue) + Send + Sync>;
+
+pub struct EventSource<T> {
+    inner: Arc<AtomicRefCell<ListenerSet<ListenerFn<T>>>>,
+}
+
+impl<T: Clone + Copy + 'static> EventSource<T> {
+    pub fn new() -> Self {
+        Self {
+            inner: ListenerSet::new_shared(),
+        }
+    }
+
+    pub fn add_listener(
+        &mut self,
+        notify_fn: impl Fn(T, &mut EventQueue) + Send + Sync + 'static,
+    ) -> Handle<ListenerFn<T>> {
+        ListenerSet::add(&self.inner, Arc::new(notify_fn))
+    }
+
+    pub fn notify_listeners(&mut self, message: T, event_queue: &mut EventQueue) {
+        for l in self.inner.borrow().iter() {
+            let l_clone = Arc::clone(l);
+            event_queue.add(move |event_queue| (l_clone)(message, event_queue));
+        }
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -169,4 +296,43 @@ mod tests {
 
         assert_eq!(*counter.borrow(), 4);
     }
+
+    #[test]
+    fn test_eventqueue_inline_and_boxed() {
+        let log = Arc::new(AtomicRefCell::new(Vec::new()));
+
+        let small = Arc::clone(&log);
+        let large = Arc::clone(&log);
+        let large_data = [7u64; 16];
+
+        EventQueue::queue_and_run(|queue| {
+            queue.add(move |queue| {
+                small.borrow_mut().push(1);
+                // events can queue more events while running
+                let nested = Arc::clone(&small);
+                queue.add(move |_| nested.borrow_mut().push(3));
+            });
+            // too large to store inline
+            queue.add(move |_| {
+                assert_eq!(large_data.len(), 16);
+                large.borrow_mut().push(2);
+            });
+        });
+
+        assert_eq!(*log.borrow(), vec![1, 2, 3]);
+    }
+
+    #[test]
+    fn test_eventqueue_drops_unrun_events() {
+        let value = Arc::new(());
+
+        let mut queue = EventQueue::new();
+        let clone = Arc::clone(&value);
+        queue.add(move |_| drop(clone));
+        assert_eq!(Arc::strong_count(&value), 2);
+
+        // dropping the queue drops the closure without running it
+        drop(queue);
+        assert_eq!(Arc::strong_count(&value), 1);
+    }
 }
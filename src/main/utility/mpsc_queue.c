@@ -0,0 +1,92 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include <glib.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "main/utility/mpsc_queue.h"
+#include "main/utility/utility.h"
+
+typedef struct _MPSCQueueNode MPSCQueueNode;
+struct _MPSCQueueNode {
+    MPSCQueueNode* next;
+    gpointer data;
+};
+
+struct _MPSCQueue {
+    /* producers push onto the head of this stack of nodes; the consumer swaps
+     * out the whole stack at once, so there is no ABA problem to worry about */
+    _Atomic(MPSCQueueNode*) head;
+    GDestroyNotify freeFunc;
+};
+
+MPSCQueue* mpscqueue_new(GDestroyNotify freeFunc) {
+    MPSCQueue* q = g_new0(MPSCQueue, 1);
+    atomic_init(&q->head, NULL);
+    q->freeFunc = freeFunc;
+    return q;
+}
+
+static void _mpscqueue_freeItem(gpointer data, gpointer userData) {
+    MPSCQueue* q = userData;
+    if (q->freeFunc) {
+        q->freeFunc(data);
+    }
+}
+
+void mpscqueue_free(MPSCQueue* q) {
+    utility_assert(q);
+    mpscqueue_drain(q, _mpscqueue_freeItem, q);
+    g_free(q);
+}
+
+void mpscqueue_push(MPSCQueue* q, gpointer data) {
+    utility_assert(q);
+
+    MPSCQueueNode* node = g_new(MPSCQueueNode, 1);
+    node->data = data;
+    node->next = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    /* on failure, node->next is updated to the current head and we try again */
+    while (!atomic_compare_exchange_weak_explicit(
+        &q->head, &node->next, node, memory_order_release, memory_order_relaxed)) {
+    }
+}
+
+gsize mpscqueue_drain(MPSCQueue* q, GFunc func, gpointer userData) {
+    utility_assert(q);
+
+    if (atomic_load_explicit(&q->head, memory_order_relaxed) == NULL) {
+        return 0;
+    }
+
+    MPSCQueueNode* node = atomic_exchange_explicit(&q->head, NULL, memory_order_acquire);
+
+    /* the stack is in LIFO order, reverse it so we drain in push order */
+    MPSCQueueNode* reversed = NULL;
+    while (node != NULL) {
+        MPSCQueueNode* next = node->next;
+        node->next = reversed;
+        reversed = node;
+        node = next;
+    }
+
+    gsize count = 0;
+    while (reversed != NULL) {
+        MPSCQueueNode* next = reversed->next;
+        func(reversed->data, userData);
+        g_free(reversed);
+        reversed = next;
+        count++;
+    }
+
+    return count;
+}
+
+gboolean mpscqueue_isEmpty(MPSCQueue* q) {
+    utility_assert(q);
+    return atomic_load_explicit(&q->head, memory_order_relaxed) == NULL;
+}
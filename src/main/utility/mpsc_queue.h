@@ -0,0 +1,31 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_MPSC_QUEUE_H_
+#define SHD_MPSC_QUEUE_H_
+
+#include <glib.h>
+
+/* A lock-free multi-producer, single-consumer queue. Any thread may push
+ * without taking a lock, while a single consumer thread removes all of the
+ * queued items at once with mpscqueue_drain. Items are drained in the order in
+ * which they were pushed. */
+typedef struct _MPSCQueue MPSCQueue;
+
+MPSCQueue* mpscqueue_new(GDestroyNotify freeFunc);
+void mpscqueue_free(MPSCQueue* q);
+
+/* Safe to call concurrently from any number of threads. */
+void mpscqueue_push(MPSCQueue* q, gpointer data);
+
+/* Must only be called by one thread at a time. Calls func(data, userData) for
+ * each item that was pushed before the drain started, and returns the number
+ * of items drained. */
+gsize mpscqueue_drain(MPSCQueue* q, GFunc func, gpointer userData);
+
+/* This is only a hint when other threads are pushing concurrently. */
+gboolean mpscqueue_isEmpty(MPSCQueue* q);
+
+#endif /* SHD_MPSC_QUEUE_H_ */
@@ -0,0 +1,177 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/utility/object_pool.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "main/utility/utility.h"
+
+/* the number of blocks moved between a thread cache and the shared stock at once */
+#define OBJECTPOOL_BATCH_SIZE 64
+/* a thread cache holding more than this many blocks gives a batch back to the stock */
+#define OBJECTPOOL_MAX_CACHED (2 * OBJECTPOOL_BATCH_SIZE)
+/* the stock frees batches it receives beyond this, so memory doesn't grow without bound */
+#define OBJECTPOOL_MAX_BATCHES 1024
+/* the number of distinct pools a thread can cache blocks for */
+#define OBJECTPOOL_MAX_POOLS 8
+
+/* Free blocks are linked together through their first bytes. The first block of a batch
+ * in the shared stock also links to the next batch. */
+typedef struct _ObjectPoolBlock ObjectPoolBlock;
+struct _ObjectPoolBlock {
+    ObjectPoolBlock* next;
+    ObjectPoolBlock* nextBatch;
+};
+
+typedef struct _ObjectPoolCache ObjectPoolCache;
+struct _ObjectPoolCache {
+    ObjectPool* pool;
+    ObjectPoolBlock* head;
+    guint count;
+};
+
+static __thread ObjectPoolCache _threadCaches[OBJECTPOOL_MAX_POOLS];
+static __thread guint _nThreadCaches = 0;
+
+static pthread_key_t _threadExitKey;
+static pthread_once_t _threadExitKeyOnce = PTHREAD_ONCE_INIT;
+
+static void _objectpool_freeBlocks(ObjectPoolBlock* head) {
+    while (head) {
+        ObjectPoolBlock* next = head->next;
+        g_free(head);
+        head = next;
+    }
+}
+
+/* takes ownership of a batch of exactly OBJECTPOOL_BATCH_SIZE blocks */
+static void _objectpool_pushBatch(ObjectPool* pool, ObjectPoolBlock* batch) {
+    g_mutex_lock(&pool->lock);
+    if (pool->nBatches < OBJECTPOOL_MAX_BATCHES) {
+        batch->nextBatch = pool->batches;
+        pool->batches = batch;
+        pool->nBatches++;
+        batch = NULL;
+    }
+    g_mutex_unlock(&pool->lock);
+
+    if (batch) {
+        _objectpool_freeBlocks(batch);
+    }
+}
+
+/* returns a batch of OBJECTPOOL_BATCH_SIZE blocks, or NULL if the stock is empty */
+static ObjectPoolBlock* _objectpool_popBatch(ObjectPool* pool) {
+    g_mutex_lock(&pool->lock);
+    ObjectPoolBlock* batch = pool->batches;
+    if (batch) {
+        pool->batches = batch->nextBatch;
+        pool->nBatches--;
+    }
+    g_mutex_unlock(&pool->lock);
+    return batch;
+}
+
+/* moves OBJECTPOOL_BATCH_SIZE blocks from the front of the cache to the stock */
+static void _objectpool_releaseBatch(ObjectPoolCache* cache) {
+    utility_assert(cache->count >= OBJECTPOOL_BATCH_SIZE);
+
+    ObjectPoolBlock* batch = cache->head;
+    ObjectPoolBlock* last = batch;
+    for (guint i = 1; i < OBJECTPOOL_BATCH_SIZE; i++) {
+        last = last->next;
+    }
+
+    cache->head = last->next;
+    cache->count -= OBJECTPOOL_BATCH_SIZE;
+    last->next = NULL;
+
+    _objectpool_pushBatch(cache->pool, batch);
+}
+
+static void _objectpool_onThreadExit(void* unused) {
+    for (guint i = 0; i < _nThreadCaches; i++) {
+        ObjectPoolCache* cache = &_threadCaches[i];
+        while (cache->count >= OBJECTPOOL_BATCH_SIZE) {
+            _objectpool_releaseBatch(cache);
+        }
+        _objectpool_freeBlocks(cache->head);
+        cache->head = NULL;
+        cache->count = 0;
+    }
+    _nThreadCaches = 0;
+}
+
+static void _objectpool_createThreadExitKey(void) {
+    int rv = pthread_key_create(&_threadExitKey, _objectpool_onThreadExit);
+    if (rv != 0) {
+        utility_panic("pthread_key_create: %s", g_strerror(rv));
+    }
+}
+
+static ObjectPoolCache* _objectpool_getThreadCache(ObjectPool* pool) {
+    for (guint i = 0; i < _nThreadCaches; i++) {
+        if (_threadCaches[i].pool == pool) {
+            return &_threadCaches[i];
+        }
+    }
+
+    if (_nThreadCaches == 0) {
+        /* the value only needs to be non-NULL for the exit handler to run */
+        pthread_once(&_threadExitKeyOnce, _objectpool_createThreadExitKey);
+        pthread_setspecific(_threadExitKey, _threadCaches);
+    }
+
+    if (_nThreadCaches >= OBJECTPOOL_MAX_POOLS) {
+        utility_panic("too many object pools, increase OBJECTPOOL_MAX_POOLS");
+    }
+
+    ObjectPoolCache* cache = &_threadCaches[_nThreadCaches++];
+    *cache = (ObjectPoolCache){.pool = pool, .head = NULL, .count = 0};
+    return cache;
+}
+
+gpointer objectpool_alloc0(ObjectPool* pool) {
+    utility_assert(pool);
+    utility_assert(pool->objectSize >= sizeof(ObjectPoolBlock));
+
+    ObjectPoolCache* cache = _objectpool_getThreadCache(pool);
+
+    if (!cache->head) {
+        cache->head = _objectpool_popBatch(pool);
+        cache->count = cache->head ? OBJECTPOOL_BATCH_SIZE : 0;
+    }
+
+    ObjectPoolBlock* block = cache->head;
+    if (!block) {
+        return g_malloc0(pool->objectSize);
+    }
+
+    cache->head = block->next;
+    cache->count--;
+
+    memset(block, 0, pool->objectSize);
+    return block;
+}
+
+void objectpool_free(ObjectPool* pool, gpointer object) {
+    utility_assert(pool);
+    if (!object) {
+        return;
+    }
+
+    ObjectPoolCache* cache = _objectpool_getThreadCache(pool);
+
+    ObjectPoolBlock* block = object;
+    block->next = cache->head;
+    cache->head = block;
+    cache->count++;
+
+    if (cache->count > OBJECTPOOL_MAX_CACHED) {
+        _objectpool_releaseBatch(cache);
+    }
+}
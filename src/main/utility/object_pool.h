@@ -0,0 +1,38 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_OBJECT_POOL_H_
+#define SHD_OBJECT_POOL_H_
+
+#include <glib.h>
+
+/* A pool of fixed-size memory blocks for objects that are allocated and freed at a high
+ * rate. Each thread keeps its own cache of free blocks, so most allocations and frees take
+ * no locks. Blocks move between a thread's cache and the pool's shared stock in batches, so
+ * blocks that are freed by a different thread than the one that allocated them, such as
+ * events sent to a host on another worker, are still reused. Blocks cached by a thread are
+ * released when the thread exits.
+ *
+ * Pools are meant to be defined statically, one per object type:
+ *     static ObjectPool _eventPool = OBJECTPOOL_INIT(Event);
+ */
+typedef struct _ObjectPool ObjectPool;
+struct _ObjectPool {
+    gsize objectSize;
+    /* protects the stock of batches */
+    GMutex lock;
+    gpointer batches;
+    guint nBatches;
+};
+
+#define OBJECTPOOL_INIT(type)                                                                      \
+    { .objectSize = sizeof(type), .batches = NULL, .nBatches = 0 }
+
+/* Returns a zeroed block of pool->objectSize bytes. */
+gpointer objectpool_alloc0(ObjectPool* pool);
+/* Returns a block allocated from the same pool. May be called from any thread. */
+void objectpool_free(ObjectPool* pool, gpointer object);
+
+#endif /* SHD_OBJECT_POOL_H_ */
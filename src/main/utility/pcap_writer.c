@@ -6,16 +6,213 @@
 #include "main/utility/pcap_writer.h"
 
 #include <stdio.h>
+#include <string.h>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "lib/logger/logger.h"
+#include "main/core/support/config_handlers.h"
 #include "main/core/support/definitions.h"
 #include "main/core/worker.h"
 #include "main/host/host.h"
+#include "main/utility/utility.h"
+
+/* Records are collected in memory and written to the file in large chunks, so
+ * that capturing a packet doesn't cost a series of small writes. */
+#define PCAP_WRITER_BUFFER_SIZE (1024 * 1024)
+
+/* With compression, the most chunks of a writer that may wait for the compression
+ * threads before the worker that fills them waits too. */
+#define PCAP_WRITER_MAX_PENDING_CHUNKS 4
+
+static gint _compressionLevel = 0;
+ADD_CONFIG_HANDLER(config_getPcapCompressionLevel, _compressionLevel)
+
+static guint _compressionThreads = 2;
+ADD_CONFIG_HANDLER(config_getPcapCompressionThreads, _compressionThreads)
+
+/* the ethernet, IP, and TCP headers that we write for each packet */
+#define PCAP_ETH_HEADER_SIZE 14
+#define PCAP_IP_HEADER_SIZE 20
+#define PCAP_TCP_HEADER_SIZE 32
+#define PCAP_PACKET_HEADERS_SIZE                                                                   \
+    (PCAP_ETH_HEADER_SIZE + PCAP_IP_HEADER_SIZE + PCAP_TCP_HEADER_SIZE)
+
+/* the pcap record header, followed by the packet headers */
+#define PCAP_RECORD_HEADER_SIZE (16 + PCAP_PACKET_HEADERS_SIZE)
 
 struct _PCapWriter {
     FILE *pcapFile;
+
+    /* the largest number of bytes of each packet that we save */
+    guint32 captureSize;
+
+    /* records that haven't been written to the file yet */
+    guint8* buffer;
+    gsize bufferLength;
+
+    /* if set, each full buffer is handed to the compression threads as a chunk, which
+     * they compress into its own zstd frame and append to the file */
+    gboolean isCompressed;
+    /* the chunks that the compression threads haven't written yet, in order, and
+     * whether one of the threads is currently working through them. protected by lock;
+     * cond is signaled whenever a chunk has been written. */
+    GMutex lock;
+    GCond cond;
+    GQueue* pendingChunks;
+    gboolean isQueued;
 };
 
+typedef struct _PCapChunk PCapChunk;
+struct _PCapChunk {
+    guint8* data;
+    gsize length;
+};
+
+/* the compression threads, which all writers share */
+static GThreadPool* _compressionPool = NULL;
+
+#ifdef USE_ZSTD
+/* each compression thread's context and output buffer, which live as long as the thread */
+static __thread ZSTD_CCtx* _compressionContext = NULL;
+static __thread guint8* _compressionBuffer = NULL;
+
+/* Compresses the chunk into a single frame, so that the frames of a file decode as
+ * one stream, and writes it to the file. Runs on a compression thread. */
+static void _pcapwriter_compressChunk(PCapWriter* pcap, PCapChunk* chunk) {
+    gsize bound = ZSTD_compressBound(PCAP_WRITER_BUFFER_SIZE);
+    if (!_compressionContext) {
+        _compressionContext = ZSTD_createCCtx();
+        _compressionBuffer = g_malloc(bound);
+    }
+
+    gsize length = ZSTD_compressCCtx(_compressionContext, _compressionBuffer, bound, chunk->data,
+                                     chunk->length, _compressionLevel);
+    if (ZSTD_isError(length)) {
+        warning("error compressing PCAP data: %s", ZSTD_getErrorName(length));
+        return;
+    }
+
+    if (fwrite(_compressionBuffer, 1, length, pcap->pcapFile) != length) {
+        warning("error writing to PCAP file");
+    }
+}
+#endif
+
+/* Writes the writer's pending chunks in order. Runs on a compression thread, which
+ * only one of at a time does for each writer. */
+static void _pcapwriter_runCompressionTask(gpointer data, gpointer unused) {
+    PCapWriter* pcap = data;
+
+    g_mutex_lock(&pcap->lock);
+    while (!g_queue_is_empty(pcap->pendingChunks)) {
+        PCapChunk* chunk = g_queue_peek_head(pcap->pendingChunks);
+        g_mutex_unlock(&pcap->lock);
+
+#ifdef USE_ZSTD
+        _pcapwriter_compressChunk(pcap, chunk);
+#endif
+
+        g_mutex_lock(&pcap->lock);
+        /* the chunk only leaves the queue once it's written, so that waiting for the
+         * queue to drain also waits for the write */
+        g_queue_pop_head(pcap->pendingChunks);
+        g_free(chunk->data);
+        g_free(chunk);
+        g_cond_broadcast(&pcap->cond);
+    }
+    pcap->isQueued = FALSE;
+    g_cond_broadcast(&pcap->cond);
+    g_mutex_unlock(&pcap->lock);
+}
+
+static void _pcapwriter_startCompressionPool() {
+    static GMutex poolLock;
+    g_mutex_lock(&poolLock);
+    if (!_compressionPool) {
+        GError* error = NULL;
+        _compressionPool = g_thread_pool_new(_pcapwriter_runCompressionTask, NULL,
+                                             MAX(_compressionThreads, 1), FALSE, &error);
+        if (!_compressionPool) {
+            utility_panic("unable to start the PCAP compression threads: %s", error->message);
+        }
+    }
+    g_mutex_unlock(&poolLock);
+}
+
+/* Hands the buffer to the compression threads, and gives the writer a new one. Waits
+ * if the threads are too far behind this writer. */
+static void _pcapwriter_queueChunk(PCapWriter* pcap) {
+    PCapChunk* chunk = g_new0(PCapChunk, 1);
+    chunk->data = pcap->buffer;
+    chunk->length = pcap->bufferLength;
+
+    pcap->buffer = g_malloc(PCAP_WRITER_BUFFER_SIZE);
+    pcap->bufferLength = 0;
+
+    g_mutex_lock(&pcap->lock);
+    while (g_queue_get_length(pcap->pendingChunks) >= PCAP_WRITER_MAX_PENDING_CHUNKS) {
+        g_cond_wait(&pcap->cond, &pcap->lock);
+    }
+    g_queue_push_tail(pcap->pendingChunks, chunk);
+    gboolean needsTask = !pcap->isQueued;
+    pcap->isQueued = TRUE;
+    g_mutex_unlock(&pcap->lock);
+
+    if (needsTask) {
+        g_thread_pool_push(_compressionPool, pcap, NULL);
+    }
+}
+
+/* Waits until the compression threads have written all of the writer's chunks. */
+static void _pcapwriter_awaitChunks(PCapWriter* pcap) {
+    g_mutex_lock(&pcap->lock);
+    while (pcap->isQueued) {
+        g_cond_wait(&pcap->cond, &pcap->lock);
+    }
+    g_mutex_unlock(&pcap->lock);
+}
+
+static void _pcapwriter_flush(PCapWriter* pcap) {
+    if (pcap->bufferLength > 0) {
+        if (pcap->isCompressed) {
+            _pcapwriter_queueChunk(pcap);
+            return;
+        }
+        if (fwrite(pcap->buffer, 1, pcap->bufferLength, pcap->pcapFile) != pcap->bufferLength) {
+            warning("error writing to PCAP file");
+        }
+        pcap->bufferLength = 0;
+    }
+}
+
+/* Copies the bytes into the buffer, flushing it whenever it's full. */
+static void _pcapwriter_append(PCapWriter* pcap, gconstpointer data, gsize length) {
+    if (pcap->bufferLength + length > PCAP_WRITER_BUFFER_SIZE) {
+        _pcapwriter_flush(pcap);
+    }
+
+    /* only a capture size above the buffer size needs more than one buffer */
+    while (length > 0) {
+        gsize n = MIN(length, PCAP_WRITER_BUFFER_SIZE - pcap->bufferLength);
+        memcpy(pcap->buffer + pcap->bufferLength, data, n);
+        pcap->bufferLength += n;
+        data = (const guint8*)data + n;
+        length -= n;
+        if (pcap->bufferLength == PCAP_WRITER_BUFFER_SIZE) {
+            _pcapwriter_flush(pcap);
+        }
+    }
+}
+
+#define PCAP_PUT(cursor, value)                                                                    \
+    do {                                                                                           \
+        memcpy((cursor), &(value), sizeof(value));                                                 \
+        (cursor) += sizeof(value);                                                                 \
+    } while (0)
+
 static void _pcapwriter_writeHeader(PCapWriter* pcap) {
     guint32 magic_number;   /* magic number */
     guint16 version_major;  /* major version number */
@@ -30,16 +227,28 @@ static void _pcapwriter_writeHeader(PCapWriter* pcap) {
     version_minor = 4;
     thiszone = 0;
     sigfigs = 0;
-    snaplen = 65535;
+    snaplen = pcap->captureSize;
     network = 1;
 
-    fwrite(&magic_number, 1, sizeof(magic_number), pcap->pcapFile);
-    fwrite(&version_major, 1, sizeof(version_major), pcap->pcapFile);
-    fwrite(&version_minor, 1, sizeof(version_minor), pcap->pcapFile);
-    fwrite(&thiszone, 1, sizeof(thiszone), pcap->pcapFile);
-    fwrite(&sigfigs, 1, sizeof(sigfigs), pcap->pcapFile);
-    fwrite(&snaplen, 1, sizeof(snaplen), pcap->pcapFile);
-    fwrite(&network, 1, sizeof(network), pcap->pcapFile);
+    guint8 header[24];
+    guint8* cursor = header;
+
+    PCAP_PUT(cursor, magic_number);
+    PCAP_PUT(cursor, version_major);
+    PCAP_PUT(cursor, version_minor);
+    PCAP_PUT(cursor, thiszone);
+    PCAP_PUT(cursor, sigfigs);
+    PCAP_PUT(cursor, snaplen);
+    PCAP_PUT(cursor, network);
+
+    _pcapwriter_append(pcap, header, sizeof(header));
+}
+
+guint pcapwriter_getMaxPayloadLength(PCapWriter* pcap) {
+    if (!pcap) {
+        return 0;
+    }
+    return pcap->captureSize - PCAP_PACKET_HEADERS_SIZE;
 }
 
 void pcapwriter_writePacket(PCapWriter* pcap, PCapPacket* packet) {
@@ -57,28 +266,35 @@ void pcapwriter_writePacket(PCapWriter* pcap, PCapPacket* packet) {
     ts_sec = now / SIMTIME_ONE_SECOND;
     ts_usec = (now % SIMTIME_ONE_SECOND) / SIMTIME_ONE_MICROSECOND;
 
-    /* get the header and payload lengths */
+    /* get the header and payload lengths; we only save as much of the payload
+     * as we were given, up to the capture size */
     guint headerSize = packet->headerSize;
     guint payloadLength = packet->payloadLength;
-    incl_len = headerSize + payloadLength;
+    guint capturedLength = packet->payload ? packet->capturedPayloadLength : 0;
+    capturedLength = MIN(capturedLength, MIN(payloadLength, pcapwriter_getMaxPayloadLength(pcap)));
+    incl_len = PCAP_PACKET_HEADERS_SIZE + capturedLength;
     orig_len = headerSize + payloadLength;
 
-    /* write the PCAP packet header to the pcap file */
-    fwrite(&ts_sec, sizeof(ts_sec), 1, pcap->pcapFile);
-    fwrite(&ts_usec, sizeof(ts_usec), 1, pcap->pcapFile);
-    fwrite(&incl_len, sizeof(incl_len), 1, pcap->pcapFile);
-    fwrite(&orig_len, sizeof(orig_len), 1, pcap->pcapFile);
+    /* assemble the record header and packet headers before copying them out */
+    guint8 record[PCAP_RECORD_HEADER_SIZE];
+    guint8* cursor = record;
 
-    /* write the ethernet header */
+    /* the PCAP packet header */
+    PCAP_PUT(cursor, ts_sec);
+    PCAP_PUT(cursor, ts_usec);
+    PCAP_PUT(cursor, incl_len);
+    PCAP_PUT(cursor, orig_len);
+
+    /* the ethernet header */
     guint8 destinationMAC[6] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB};
     guint8 sourceMAC[6] = {0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6};
     guint16 type = htons(0x0800);
 
-    fwrite(destinationMAC, 1, sizeof(destinationMAC), pcap->pcapFile);
-    fwrite(sourceMAC, 1, sizeof(sourceMAC), pcap->pcapFile);
-    fwrite(&type, 1, sizeof(type), pcap->pcapFile);
+    PCAP_PUT(cursor, destinationMAC);
+    PCAP_PUT(cursor, sourceMAC);
+    PCAP_PUT(cursor, type);
 
-    /* write the IP header */
+    /* the IP header */
     guint8 versionAndHeaderLength = 0x45;
     guint8 fields = 0x00;
     guint16 totalLength = htons(orig_len - 14);
@@ -90,19 +306,18 @@ void pcapwriter_writePacket(PCapWriter* pcap, PCapPacket* packet) {
     guint32 sourceIP = packet->srcIP;
     guint32 destinationIP = packet->dstIP;
 
-    fwrite(&versionAndHeaderLength, 1, sizeof(versionAndHeaderLength), pcap->pcapFile);
-    fwrite(&fields, 1, sizeof(fields), pcap->pcapFile);
-    fwrite(&totalLength, 1, sizeof(totalLength), pcap->pcapFile);
-    fwrite(&identification, 1, sizeof(identification), pcap->pcapFile);
-    fwrite(&flagsAndFragment, 1, sizeof(flagsAndFragment), pcap->pcapFile);
-    fwrite(&timeToLive, 1, sizeof(timeToLive), pcap->pcapFile);
-    fwrite(&protocol, 1, sizeof(protocol), pcap->pcapFile);
-    fwrite(&headerChecksum, 1, sizeof(headerChecksum), pcap->pcapFile);
-    fwrite(&sourceIP, 1, sizeof(sourceIP), pcap->pcapFile);
-    fwrite(&destinationIP, 1, sizeof(destinationIP), pcap->pcapFile);
-
+    PCAP_PUT(cursor, versionAndHeaderLength);
+    PCAP_PUT(cursor, fields);
+    PCAP_PUT(cursor, totalLength);
+    PCAP_PUT(cursor, identification);
+    PCAP_PUT(cursor, flagsAndFragment);
+    PCAP_PUT(cursor, timeToLive);
+    PCAP_PUT(cursor, protocol);
+    PCAP_PUT(cursor, headerChecksum);
+    PCAP_PUT(cursor, sourceIP);
+    PCAP_PUT(cursor, destinationIP);
 
-    /* write the TCP header */
+    /* the TCP header */
     guint16 sourcePort = packet->srcPort;
     guint16 destinationPort = packet->dstPort;
     guint32 sequence = htonl(packet->seq);
@@ -120,25 +335,54 @@ void pcapwriter_writePacket(PCapWriter* pcap, PCapPacket* packet) {
     guint16 tcpChecksum = 0x0000;
     guint8 options[14] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-    fwrite(&sourcePort, 1, sizeof(sourcePort), pcap->pcapFile);
-    fwrite(&destinationPort, 1, sizeof(destinationPort), pcap->pcapFile);
-    fwrite(&sequence, 1, sizeof(sequence), pcap->pcapFile);
-    fwrite(&acknowledgement, 1, sizeof(acknowledgement), pcap->pcapFile);
-    fwrite(&headerLength, 1, sizeof(headerLength), pcap->pcapFile);
-    fwrite(&tcpFlags, 1, sizeof(tcpFlags), pcap->pcapFile);
-    fwrite(&window, 1, sizeof(window), pcap->pcapFile);
-    fwrite(&tcpChecksum, 1, sizeof(tcpChecksum), pcap->pcapFile);
-    fwrite(options, 1, sizeof(options), pcap->pcapFile);
+    PCAP_PUT(cursor, sourcePort);
+    PCAP_PUT(cursor, destinationPort);
+    PCAP_PUT(cursor, sequence);
+    PCAP_PUT(cursor, acknowledgement);
+    PCAP_PUT(cursor, headerLength);
+    PCAP_PUT(cursor, tcpFlags);
+    PCAP_PUT(cursor, window);
+    PCAP_PUT(cursor, tcpChecksum);
+    PCAP_PUT(cursor, options);
 
-    /* write payload data */
-    if(payloadLength > 0 && packet->payload) {
-        fwrite(packet->payload, 1, payloadLength, pcap->pcapFile);
+    utility_assert(cursor == record + sizeof(record));
+
+    _pcapwriter_append(pcap, record, sizeof(record));
+
+    /* the payload data */
+    if (capturedLength > 0) {
+        _pcapwriter_append(pcap, packet->payload, capturedLength);
     }
 }
 
-PCapWriter* pcapwriter_new(Host* host, gchar* pcapDirectory, gchar* pcapFilename) {
+PCapWriter* pcapwriter_new(Host* host, gchar* pcapDirectory, gchar* pcapFilename,
+                           guint32 captureSize) {
     PCapWriter* pcap = g_new0(PCapWriter, 1);
 
+    /* we always save the packet headers */
+    pcap->captureSize = MAX(captureSize, PCAP_PACKET_HEADERS_SIZE);
+    pcap->buffer = g_malloc(PCAP_WRITER_BUFFER_SIZE);
+
+    if (_compressionLevel > 0) {
+#ifdef USE_ZSTD
+        pcap->isCompressed = TRUE;
+#else
+        static gsize warned = 0;
+        if (g_once_init_enter(&warned)) {
+            warning("Shadow was built without zstd, so PCAP files are written uncompressed; "
+                    "build it with --use-zstd to compress them");
+            g_once_init_leave(&warned, 1);
+        }
+#endif
+    }
+
+    if (pcap->isCompressed) {
+        g_mutex_init(&pcap->lock);
+        g_cond_init(&pcap->cond);
+        pcap->pendingChunks = g_queue_new();
+        _pcapwriter_startCompressionPool();
+    }
+
     /* open the PCAP file for writing */
     GString *filename = g_string_new("");
     if (pcapDirectory) {
@@ -161,11 +405,16 @@ PCapWriter* pcapwriter_new(Host* host, gchar* pcapDirectory, gchar* pcapFilename
     if (!g_str_has_suffix(filename->str, ".pcap")) {
         g_string_append(filename, ".pcap");
     }
+    if (pcap->isCompressed) {
+        g_string_append(filename, ".zst");
+    }
 
     pcap->pcapFile = fopen(filename->str, "w");
     if(!pcap->pcapFile) {
         warning("error trying to open PCAP file '%s' for writing", filename->str);
     } else {
+        /* we do our own buffering */
+        setvbuf(pcap->pcapFile, NULL, _IONBF, 0);
         _pcapwriter_writeHeader(pcap);
     }
 
@@ -173,7 +422,34 @@ PCapWriter* pcapwriter_new(Host* host, gchar* pcapDirectory, gchar* pcapFilename
 }
 
 void pcapwriter_free(PCapWriter* pcap) {
-    if(pcap && pcap->pcapFile) {
+    if (!pcap) {
+        return;
+    }
+
+    if (pcap->pcapFile) {
+        _pcapwriter_flush(pcap);
+        if (pcap->isCompressed) {
+            _pcapwriter_awaitChunks(pcap);
+        }
         fclose(pcap->pcapFile);
     }
+
+    if (pcap->isCompressed) {
+        g_queue_free(pcap->pendingChunks);
+        g_mutex_clear(&pcap->lock);
+        g_cond_clear(&pcap->cond);
+    }
+
+    g_free(pcap->buffer);
+    g_free(pcap);
+}
+
+void pcapwriter_flush(PCapWriter* pcap) {
+    if (pcap && pcap->pcapFile) {
+        _pcapwriter_flush(pcap);
+        if (pcap->isCompressed) {
+            _pcapwriter_awaitChunks(pcap);
+        }
+        fflush(pcap->pcapFile);
+    }
 }
@@ -44,11 +44,23 @@ struct _PCapPacket {
     guint16 win;
     guint headerSize;
     guint payloadLength;
+    /* the first capturedPayloadLength bytes of the payload, which may be fewer
+     * than payloadLength */
     gpointer payload;
+    guint capturedPayloadLength;
 };
 
-PCapWriter* pcapwriter_new(Host* host, gchar* pcapDirectory, gchar* pcapFilename);
+/* Opens a pcap file that saves at most captureSize bytes of each packet. Packets
+ * are buffered and written to the file in large chunks, and any remaining packets
+ * are written when the writer is freed. */
+PCapWriter* pcapwriter_new(Host* host, gchar* pcapDirectory, gchar* pcapFilename,
+                           guint32 captureSize);
 void pcapwriter_free(PCapWriter* pcap);
+/* Writes the buffered packets to the file. */
+void pcapwriter_flush(PCapWriter* pcap);
+/* The number of payload bytes that are saved for each packet; callers only need
+ * to copy this much of the payload into the PCapPacket. */
+guint pcapwriter_getMaxPayloadLength(PCapWriter* pcap);
 void pcapwriter_writePacket(PCapWriter* pcap, PCapPacket* packet);
 
 #endif /* SHD_PCAP_WRITER_H_ */
@@ -0,0 +1,28 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/utility/perf_timer.h"
+
+#include <pthread.h>
+
+#include "main/host/tsc.h"
+
+static uint64_t _cyclesPerSecond = 0;
+static pthread_once_t _calibrateOnce = PTHREAD_ONCE_INIT;
+
+static void _perftimer_calibrate() { _cyclesPerSecond = Tsc_measure().cyclesPerSecond; }
+
+uint64_t perftimer_getCyclesPerSecond() {
+    pthread_once(&_calibrateOnce, _perftimer_calibrate);
+    return _cyclesPerSecond;
+}
+
+double perftimer_elapsed(const PerfTimer* timer) {
+    uint64_t cycles = timer->elapsedCycles;
+    if (timer->running) {
+        cycles += __rdtsc() - timer->startCycles;
+    }
+    return ((double)cycles) / perftimer_getCyclesPerSecond();
+}
@@ -0,0 +1,77 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SRC_MAIN_UTILITY_PERF_TIMER_H_
+#define SRC_MAIN_UTILITY_PERF_TIMER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+// A stopwatch for the USE_PERF_TIMERS instrumentation, like GTimer, but read from the
+// timestamp counter instead of clock_gettime, so that starting and stopping it takes a few
+// nanoseconds. It's a plain value that needs no allocation; PERFTIMER_INIT is a stopped
+// timer with no elapsed time. The counter is converted to seconds with the frequency that
+// Tsc_measure() calibrates, once per process, the first time it's needed.
+typedef struct _PerfTimer PerfTimer;
+struct _PerfTimer {
+    // the counter when the timer was last continued, if it's running
+    uint64_t startCycles;
+    uint64_t elapsedCycles;
+    bool running;
+};
+
+#define PERFTIMER_INIT ((PerfTimer){0})
+
+// Resets the elapsed time to zero and starts the timer, like g_timer_start.
+static inline void perftimer_start(PerfTimer* timer) {
+    timer->elapsedCycles = 0;
+    timer->running = true;
+    timer->startCycles = __rdtsc();
+}
+
+// Starts a stopped timer without resetting its elapsed time, like g_timer_continue.
+static inline void perftimer_continue(PerfTimer* timer) {
+    timer->running = true;
+    timer->startCycles = __rdtsc();
+}
+
+// Stops a running timer, adding the time since it was started to its elapsed time.
+static inline void perftimer_stop(PerfTimer* timer) {
+    timer->elapsedCycles += __rdtsc() - timer->startCycles;
+    timer->running = false;
+}
+
+// Returns the seconds that the timer has been running, including the current interval if
+// it's running now, like g_timer_elapsed.
+double perftimer_elapsed(const PerfTimer* timer);
+
+// Returns the frequency of the timestamp counter, measuring it on the first call.
+uint64_t perftimer_getCyclesPerSecond(void);
+
+static inline void _perftimer_stopScope(PerfTimer** timer) {
+    if (*timer) {
+        perftimer_stop(*timer);
+    }
+}
+
+static inline PerfTimer* _perftimer_continueScope(PerfTimer* timer) {
+    if (timer) {
+        perftimer_continue(timer);
+    }
+    return timer;
+}
+
+#ifdef USE_PERF_TIMERS
+// Continues the timer, which may be NULL, and stops it when the enclosing block exits.
+#define PERFTIMER_SCOPE(timer)                                                                 \
+    PerfTimer* _perfTimerScope __attribute__((cleanup(_perftimer_stopScope), unused)) =        \
+        _perftimer_continueScope(timer)
+#else
+// the timers don't exist, and the argument isn't evaluated
+#define PERFTIMER_SCOPE(timer)
+#endif
+
+#endif /* SRC_MAIN_UTILITY_PERF_TIMER_H_ */
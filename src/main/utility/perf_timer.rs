@@ -1,40 +1,94 @@
-use std::time::{Duration, Instant};
+use crate::cshadow;
+use std::time::Duration;
 
-/// Intended as a drop-in-replacement for glib's GTimer.
+/// Intended as a drop-in-replacement for glib's GTimer. Like the C `PerfTimer`, it reads the
+/// timestamp counter instead of the clock, so starting and stopping it only takes a few
+/// nanoseconds.
 pub struct PerfTimer {
-    start_time: Option<Instant>,
-    elapsed: Duration,
+    start_cycles: Option<u64>,
+    elapsed_cycles: u64,
+}
+
+fn now_cycles() -> u64 {
+    unsafe { core::arch::x86_64::_rdtsc() }
+}
+
+fn cycles_to_duration(cycles: u64) -> Duration {
+    // measured once, by the C side
+    let cycles_per_second = unsafe { cshadow::perftimer_getCyclesPerSecond() };
+    let nanos = u128::from(cycles) * 1_000_000_000 / u128::from(cycles_per_second);
+    Duration::from_nanos(nanos as u64)
 }
 
 impl PerfTimer {
     /// Create timer, which starts running.
     pub fn new() -> Self {
         Self {
-            start_time: Some(Instant::now()),
-            elapsed: Duration::new(0, 0),
+            start_cycles: Some(now_cycles()),
+            elapsed_cycles: 0,
         }
     }
 
     /// Start the timer, which must not already be running.
     pub fn start(&mut self) {
-        debug_assert!(self.start_time.is_none());
-        self.start_time = Some(Instant::now());
+        debug_assert!(self.start_cycles.is_none());
+        self.start_cycles = Some(now_cycles());
     }
 
     /// Stop the timer, which must already be running.
     pub fn stop(&mut self) {
-        debug_assert!(self.start_time.is_some());
-        if let Some(t) = self.start_time.take() {
-            self.elapsed += Instant::now().duration_since(t)
+        debug_assert!(self.start_cycles.is_some());
+        if let Some(t) = self.start_cycles.take() {
+            self.elapsed_cycles += now_cycles().wrapping_sub(t);
         }
     }
 
+    /// Start the timer, which must not already be running, and stop it when the returned
+    /// guard is dropped.
+    pub fn scope(&mut self) -> PerfTimerScope<'_> {
+        self.start();
+        PerfTimerScope { timer: self }
+    }
+
     /// Total time elapsed while the timer has been running.
     pub fn elapsed(&self) -> Duration {
-        let mut e = self.elapsed;
-        if let Some(t) = self.start_time.as_ref() {
-            e += Instant::now().duration_since(*t)
+        let mut e = self.elapsed_cycles;
+        if let Some(t) = self.start_cycles {
+            e += now_cycles().wrapping_sub(t);
+        }
+        cycles_to_duration(e)
+    }
+}
+
+/// Stops its timer when dropped. See [`PerfTimer::scope`].
+pub struct PerfTimerScope<'a> {
+    timer: &'a mut PerfTimer,
+}
+
+impl Drop for PerfTimerScope<'_> {
+    fn drop(&mut self) {
+        self.timer.stop();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_scope() {
+        let mut timer = PerfTimer::new();
+        timer.stop();
+        let before = timer.elapsed();
+
+        {
+            let _scope = timer.scope();
+            std::thread::sleep(Duration::from_millis(10));
         }
-        e
+        let after = timer.elapsed();
+
+        // the timer is stopped again, so its elapsed time doesn't change
+        assert!(after >= before + Duration::from_millis(5));
+        assert_eq!(timer.elapsed(), after);
     }
 }
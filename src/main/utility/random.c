@@ -12,18 +12,56 @@
 #include "main/utility/random.h"
 #include "main/utility/utility.h"
 
+/* ChaCha with 8 rounds is plenty for simulation, and more than twice as fast as
+ * the 20 rounds used for cryptography */
+#define CHACHA_ROUNDS 8
+#define CHACHA_BLOCK_WORDS 16
+#define CHACHA_BLOCK_BYTES (CHACHA_BLOCK_WORDS * sizeof(guint32))
+/* how many blocks we generate at a time, so the compiler can interleave them */
+#define CHACHA_PARALLEL_BLOCKS 4
+#define CHACHA_BUFFER_BYTES (CHACHA_PARALLEL_BLOCKS * CHACHA_BLOCK_BYTES)
+
 struct _Random {
     guint seedState;
     guint initialSeed;
+
+    /* the bytes come from a ChaCha keystream, keyed by the seed, with the stream
+     * in the nonce and a 64-bit block counter */
+    guint32 key[8];
+    guint64 stream;
+    guint64 counter;
+    /* keystream that hasn't been returned yet */
+    guint8 buffer[CHACHA_BUFFER_BYTES];
+    gsize bufferOffset;
 };
 
-Random* random_new(guint seed) {
+static guint64 _random_splitmix64(guint64* state) {
+    guint64 z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+Random* random_newStream(guint seed, guint64 stream) {
     Random* random = g_new0(Random, 1);
     random->initialSeed = seed;
     random->seedState = seed;
+
+    /* spread the seed over the whole key */
+    guint64 keyState = seed;
+    for (gint i = 0; i < 8; i += 2) {
+        guint64 k = _random_splitmix64(&keyState);
+        random->key[i] = (guint32)k;
+        random->key[i + 1] = (guint32)(k >> 32);
+    }
+    random->stream = stream;
+    random->bufferOffset = CHACHA_BUFFER_BYTES;
+
     return random;
 }
 
+Random* random_new(guint seed) { return random_newStream(seed, 0); }
+
 void random_free(Random* random) {
     utility_assert(random);
     g_free(random);
@@ -50,13 +88,99 @@ guint random_nextUInt(Random* random) {
     return (guint)randomUint;
 }
 
+guint32 random_getThreshold(gdouble probability) {
+    /* random_nextDouble divides by RAND_MAX, so start from the product and correct for
+     * its rounding. negative probabilities are treated like 0. */
+    gint64 threshold = (gint64)(probability * (gdouble)RAND_MAX);
+    threshold = CLAMP(threshold, 0, RAND_MAX);
+    while (threshold < RAND_MAX &&
+           (gdouble)(threshold + 1) / (gdouble)RAND_MAX <= probability) {
+        threshold++;
+    }
+    while (threshold > 0 && (gdouble)threshold / (gdouble)RAND_MAX > probability) {
+        threshold--;
+    }
+    return (guint32)threshold;
+}
+
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA_QUARTERROUND(x, a, b, c, d)                                                    \
+    do {                                                                                      \
+        x[a] += x[b];                                                                         \
+        x[d] = CHACHA_ROTL(x[d] ^ x[a], 16);                                                  \
+        x[c] += x[d];                                                                         \
+        x[b] = CHACHA_ROTL(x[b] ^ x[c], 12);                                                  \
+        x[a] += x[b];                                                                         \
+        x[d] = CHACHA_ROTL(x[d] ^ x[a], 8);                                                   \
+        x[c] += x[d];                                                                         \
+        x[b] = CHACHA_ROTL(x[b] ^ x[c], 7);                                                   \
+    } while (0)
+
+/* Writes the next CHACHA_PARALLEL_BLOCKS blocks of the keystream to out. The
+ * blocks are independent, so we compute them side by side in the same loop to
+ * let the compiler vectorize across them. */
+static void _random_chachaBlocks(Random* random, guint8* out) {
+    guint32 x[CHACHA_PARALLEL_BLOCKS][CHACHA_BLOCK_WORDS];
+    guint32 in[CHACHA_PARALLEL_BLOCKS][CHACHA_BLOCK_WORDS];
+
+    for (gint b = 0; b < CHACHA_PARALLEL_BLOCKS; b++) {
+        guint64 counter = random->counter + b;
+        /* "expand 32-byte k" */
+        in[b][0] = 0x61707865;
+        in[b][1] = 0x3320646e;
+        in[b][2] = 0x79622d32;
+        in[b][3] = 0x6b206574;
+        memcpy(&in[b][4], random->key, sizeof(random->key));
+        in[b][12] = (guint32)counter;
+        in[b][13] = (guint32)(counter >> 32);
+        in[b][14] = (guint32)random->stream;
+        in[b][15] = (guint32)(random->stream >> 32);
+    }
+    random->counter += CHACHA_PARALLEL_BLOCKS;
+    memcpy(x, in, sizeof(x));
+
+    for (gint i = 0; i < CHACHA_ROUNDS; i += 2) {
+        for (gint b = 0; b < CHACHA_PARALLEL_BLOCKS; b++) {
+            CHACHA_QUARTERROUND(x[b], 0, 4, 8, 12);
+            CHACHA_QUARTERROUND(x[b], 1, 5, 9, 13);
+            CHACHA_QUARTERROUND(x[b], 2, 6, 10, 14);
+            CHACHA_QUARTERROUND(x[b], 3, 7, 11, 15);
+            CHACHA_QUARTERROUND(x[b], 0, 5, 10, 15);
+            CHACHA_QUARTERROUND(x[b], 1, 6, 11, 12);
+            CHACHA_QUARTERROUND(x[b], 2, 7, 8, 13);
+            CHACHA_QUARTERROUND(x[b], 3, 4, 9, 14);
+        }
+    }
+
+    for (gint b = 0; b < CHACHA_PARALLEL_BLOCKS; b++) {
+        for (gint i = 0; i < CHACHA_BLOCK_WORDS; i++) {
+            guint32 word = GUINT32_TO_LE(x[b][i] + in[b][i]);
+            memcpy(out + b * CHACHA_BLOCK_BYTES + i * sizeof(guint32), &word, sizeof(word));
+        }
+    }
+}
+
 void random_nextNBytes(Random* random, void* buffer, gsize nbytes) {
     utility_assert(random);
-    gsize offset = 0;
-    while(offset < nbytes) {
-        guint randUInt = random_nextUInt(random);
-        gsize n = MIN((nbytes - offset), sizeof(guint));
-        memmove(buffer + offset, &randUInt, n);
-        offset += n;
+    guint8* out = buffer;
+
+    /* use up what's left of the keystream we already generated */
+    gsize n = MIN(nbytes, CHACHA_BUFFER_BYTES - random->bufferOffset);
+    memcpy(out, &random->buffer[random->bufferOffset], n);
+    random->bufferOffset += n;
+    out += n;
+    nbytes -= n;
+
+    /* write whole blocks straight to the caller's buffer */
+    while (nbytes >= CHACHA_BUFFER_BYTES) {
+        _random_chachaBlocks(random, out);
+        out += CHACHA_BUFFER_BYTES;
+        nbytes -= CHACHA_BUFFER_BYTES;
+    }
+
+    if (nbytes > 0) {
+        _random_chachaBlocks(random, random->buffer);
+        memcpy(out, random->buffer, nbytes);
+        random->bufferOffset = nbytes;
     }
 }
@@ -21,6 +21,16 @@ typedef struct _Random Random;
  */
 Random* random_new(guint seed);
 
+/**
+ * Create a new random source like random_new, but whose bytes come from the
+ * given stream. Sources with the same seed and different streams return
+ * independent bytes from random_nextNBytes.
+ * @param seed
+ * @param stream
+ * @return a pointer to the new random source
+ */
+Random* random_newStream(guint seed, guint64 stream);
+
 /**
  * Frees the memory allocated for the random source.
  * @param random the random source
@@ -44,7 +54,19 @@ gdouble random_nextDouble(Random* random);
 guint random_nextUInt(Random* random);
 
 /**
- * Gets the next nbytes in the range [0, RAND_MAX] from the random source.
+ * Gets the threshold for a random event with the given probability, such that
+ * random_rand() <= threshold exactly when random_nextDouble() <= probability would
+ * have been true for the same state. This avoids the floating point math when the
+ * same probability is tested many times.
+ * @param probability the probability of the event, in the range [0,1]
+ * @return the largest value from random_rand for which the event happens
+ */
+guint32 random_getThreshold(gdouble probability);
+
+/**
+ * Gets the next nbytes from the random source. The bytes come from a ChaCha8
+ * keystream, which is independent of the values returned by the other
+ * functions.
  * @param random the random source
  * @param buffer the buffer to copy the random bytes to
  * @param nbytes number of bytes to copy to the buffer
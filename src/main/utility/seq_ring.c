@@ -0,0 +1,194 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "main/utility/seq_ring.h"
+#include "main/utility/utility.h"
+
+#define SEQRING_MIN_CAPACITY 16
+
+struct _SeqRing {
+    /* a power of two number of slots, NULL for any sequence without an item */
+    gpointer* slots;
+    guint capacity;
+    /* the slot holding the item for sequence number base */
+    guint head;
+    /* the lowest sequence number in the ring, valid only if length > 0 */
+    guint base;
+    /* the number of sequence numbers from base to the highest one in the ring,
+     * so the slots outside of [head, head+span) are always NULL */
+    guint span;
+    /* the number of items in the ring */
+    guint length;
+    GDestroyNotify freeFunc;
+};
+
+static inline gpointer* _seqring_slot(SeqRing* ring, guint sequence) {
+    return &ring->slots[(ring->head + (sequence - ring->base)) & (ring->capacity - 1)];
+}
+
+static inline gboolean _seqring_inSpan(SeqRing* ring, guint sequence) {
+    return ring->length > 0 && sequence >= ring->base && sequence - ring->base < ring->span;
+}
+
+/* make room for at least needed slots, keeping the items in sequence order */
+static void _seqring_reserve(SeqRing* ring, guint needed) {
+    if (needed <= ring->capacity) {
+        return;
+    }
+
+    guint capacity = MAX(ring->capacity, SEQRING_MIN_CAPACITY);
+    while (capacity < needed) {
+        utility_assert(capacity <= G_MAXUINT / 2);
+        capacity *= 2;
+    }
+
+    gpointer* slots = g_new0(gpointer, capacity);
+    for (guint i = 0; i < ring->span; i++) {
+        slots[i] = *_seqring_slot(ring, ring->base + i);
+    }
+
+    g_free(ring->slots);
+    ring->slots = slots;
+    ring->capacity = capacity;
+    ring->head = 0;
+}
+
+/* shrink the span so that it starts and ends on an item */
+static void _seqring_trim(SeqRing* ring) {
+    if (ring->length == 0) {
+        ring->head = 0;
+        ring->span = 0;
+        return;
+    }
+
+    while (*_seqring_slot(ring, ring->base) == NULL) {
+        ring->head = (ring->head + 1) & (ring->capacity - 1);
+        ring->base++;
+        ring->span--;
+    }
+
+    while (*_seqring_slot(ring, ring->base + ring->span - 1) == NULL) {
+        ring->span--;
+    }
+}
+
+SeqRing* seqring_new(GDestroyNotify freeFunc) {
+    SeqRing* ring = g_new0(SeqRing, 1);
+    ring->freeFunc = freeFunc;
+    return ring;
+}
+
+void seqring_free(SeqRing* ring) {
+    utility_assert(ring);
+
+    if (ring->freeFunc) {
+        for (guint i = 0; ring->length > 0 && i < ring->span; i++) {
+            gpointer data = *_seqring_slot(ring, ring->base + i);
+            if (data) {
+                ring->freeFunc(data);
+            }
+        }
+    }
+
+    g_free(ring->slots);
+    g_free(ring);
+}
+
+guint seqring_getLength(SeqRing* ring) {
+    utility_assert(ring);
+    return ring->length;
+}
+
+gboolean seqring_isEmpty(SeqRing* ring) {
+    utility_assert(ring);
+    return ring->length == 0;
+}
+
+gpointer seqring_get(SeqRing* ring, guint sequence) {
+    utility_assert(ring);
+    return _seqring_inSpan(ring, sequence) ? *_seqring_slot(ring, sequence) : NULL;
+}
+
+void seqring_insert(SeqRing* ring, guint sequence, gpointer data) {
+    utility_assert(ring);
+    utility_assert(data);
+
+    if (ring->length == 0) {
+        ring->head = 0;
+        ring->base = sequence;
+        ring->span = 0;
+    }
+
+    if (sequence < ring->base) {
+        /* grow the span down to the new lowest sequence */
+        guint distance = ring->base - sequence;
+        _seqring_reserve(ring, ring->span + distance);
+        ring->head = (ring->head - distance) & (ring->capacity - 1);
+        ring->base = sequence;
+        ring->span += distance;
+    } else if (sequence - ring->base >= ring->span) {
+        /* grow the span up to the new highest sequence */
+        _seqring_reserve(ring, sequence - ring->base + 1);
+        ring->span = sequence - ring->base + 1;
+    }
+
+    gpointer* slot = _seqring_slot(ring, sequence);
+    utility_assert(*slot == NULL);
+    *slot = data;
+    ring->length++;
+}
+
+gpointer seqring_steal(SeqRing* ring, guint sequence) {
+    utility_assert(ring);
+
+    if (!_seqring_inSpan(ring, sequence)) {
+        return NULL;
+    }
+
+    gpointer* slot = _seqring_slot(ring, sequence);
+    gpointer data = *slot;
+    if (data) {
+        *slot = NULL;
+        ring->length--;
+        _seqring_trim(ring);
+    }
+
+    return data;
+}
+
+guint seqring_stealRange(SeqRing* ring, guint begin, guint end, GFunc func, gpointer userData) {
+    utility_assert(ring);
+
+    if (ring->length == 0) {
+        return 0;
+    }
+
+    /* only visit the part of the range that can hold items */
+    guint64 low = MAX(begin, ring->base);
+    guint64 high = MIN((guint64)end, (guint64)ring->base + ring->span);
+
+    guint count = 0;
+    for (guint64 sequence = low; sequence < high; sequence++) {
+        gpointer* slot = _seqring_slot(ring, (guint)sequence);
+        gpointer data = *slot;
+        if (data) {
+            *slot = NULL;
+            ring->length--;
+            count++;
+            if (func) {
+                func(data, userData);
+            }
+        }
+    }
+
+    if (count > 0) {
+        _seqring_trim(ring);
+    }
+
+    return count;
+}
@@ -0,0 +1,39 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_SEQ_RING_H_
+#define SHD_SEQ_RING_H_
+
+#include <glib.h>
+
+/* A map from sequence numbers to non-NULL items, stored in a circular array
+ * indexed by the distance from the lowest sequence number in the ring. Lookups,
+ * inserts, and removals are O(1), and ranges are visited in sequence order, so
+ * this suits a window of sequence numbers that moves forward over time. Memory
+ * use is proportional to the distance between the lowest and highest sequence
+ * numbers that are stored. */
+typedef struct _SeqRing SeqRing;
+
+SeqRing* seqring_new(GDestroyNotify freeFunc);
+/* Calls freeFunc on every item still in the ring. */
+void seqring_free(SeqRing* ring);
+
+/* Returns the number of items in the ring. */
+guint seqring_getLength(SeqRing* ring);
+gboolean seqring_isEmpty(SeqRing* ring);
+
+/* Returns the item stored at sequence, or NULL if there is none. */
+gpointer seqring_get(SeqRing* ring, guint sequence);
+/* Stores data at sequence, which must not already hold an item. */
+void seqring_insert(SeqRing* ring, guint sequence, gpointer data);
+/* Removes and returns the item at sequence without calling freeFunc on it, or
+ * returns NULL if there is none. */
+gpointer seqring_steal(SeqRing* ring, guint sequence);
+/* Removes every item in the half-open range [begin, end) in increasing sequence
+ * order, calling func(data, userData) on each instead of freeFunc. Returns the
+ * number of items removed. func must not modify the ring. */
+guint seqring_stealRange(SeqRing* ring, guint begin, guint end, GFunc func, gpointer userData);
+
+#endif /* SHD_SEQ_RING_H_ */
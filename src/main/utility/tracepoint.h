@@ -0,0 +1,30 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SRC_MAIN_UTILITY_TRACEPOINT_H_
+#define SRC_MAIN_UTILITY_TRACEPOINT_H_
+
+// Static tracepoints (USDT probes) for tools like bpftrace and perf, e.g.
+//
+//     bpftrace -e 'usdt:/path/to/shadow:shadow:worker_send_packet { @[arg0] = count(); }'
+//
+// When Shadow is built with `--use-tracepoints`, each one compiles to a nop instruction
+// and a note in the binary that the tools use to find it, so they cost next to nothing
+// until a tool attaches. Otherwise they compile to nothing, and their arguments aren't
+// evaluated, so the arguments must not have side effects.
+
+#ifdef USE_TRACEPOINTS
+
+#include <sys/sdt.h>
+
+#define TRACEPOINT(name, ...) STAP_PROBEV(shadow, name, ##__VA_ARGS__)
+
+#else
+
+#define TRACEPOINT(name, ...) ((void)0)
+
+#endif
+
+#endif /* SRC_MAIN_UTILITY_TRACEPOINT_H_ */
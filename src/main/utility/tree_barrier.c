@@ -0,0 +1,150 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include "main/utility/tree_barrier.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "main/utility/utility.h"
+
+/* how many threads or child nodes arrive at each node */
+#define TREE_BARRIER_FANOUT 4
+/* how many times a waiting thread checks for its release before it sleeps */
+#define TREE_BARRIER_SPINS 4096
+#define TREE_BARRIER_CACHE_LINE 64
+
+typedef struct _TreeBarrierNode TreeBarrierNode;
+struct _TreeBarrierNode {
+    /* how many threads or child nodes arrive here in each round */
+    guint count;
+    /* how many have arrived in the current round */
+    guint arrived;
+    /* the index of the parent node, or -1 at the root */
+    gint parent;
+} __attribute__((aligned(TREE_BARRIER_CACHE_LINE)));
+
+struct _TreeBarrier {
+    guint nThreads;
+    /* the leaves come first, then each level up to the root */
+    TreeBarrierNode* nodes;
+    guint nNodes;
+    /* the round, which the last thread to arrive increments to release the others */
+    guint32 generation __attribute__((aligned(TREE_BARRIER_CACHE_LINE)));
+    /* how many threads are sleeping on the generation */
+    guint sleepers;
+};
+
+static void* _treebarrier_alloc(gsize size) {
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, TREE_BARRIER_CACHE_LINE, size) != 0) {
+        utility_panic("posix_memalign: out of memory");
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+TreeBarrier* treebarrier_new(guint nThreads) {
+    utility_assert(nThreads > 0);
+
+    /* count the nodes of each level, from the leaves up to a single root */
+    guint levelSize = (nThreads + TREE_BARRIER_FANOUT - 1) / TREE_BARRIER_FANOUT;
+    guint nNodes = levelSize;
+    while (levelSize > 1) {
+        levelSize = (levelSize + TREE_BARRIER_FANOUT - 1) / TREE_BARRIER_FANOUT;
+        nNodes += levelSize;
+    }
+
+    TreeBarrier* barrier = _treebarrier_alloc(sizeof(TreeBarrier));
+    barrier->nThreads = nThreads;
+    barrier->nodes = _treebarrier_alloc(nNodes * sizeof(TreeBarrierNode));
+    barrier->nNodes = nNodes;
+
+    for (guint i = 0; i < nThreads; i++) {
+        barrier->nodes[i / TREE_BARRIER_FANOUT].count++;
+    }
+
+    /* link each level to the one above it */
+    guint levelStart = 0;
+    levelSize = (nThreads + TREE_BARRIER_FANOUT - 1) / TREE_BARRIER_FANOUT;
+    while (levelSize > 1) {
+        guint parentStart = levelStart + levelSize;
+        for (guint i = 0; i < levelSize; i++) {
+            barrier->nodes[levelStart + i].parent = parentStart + i / TREE_BARRIER_FANOUT;
+            barrier->nodes[parentStart + i / TREE_BARRIER_FANOUT].count++;
+        }
+        levelStart = parentStart;
+        levelSize = (levelSize + TREE_BARRIER_FANOUT - 1) / TREE_BARRIER_FANOUT;
+    }
+    utility_assert(levelStart == nNodes - 1);
+    barrier->nodes[levelStart].parent = -1;
+
+    return barrier;
+}
+
+void treebarrier_free(TreeBarrier* barrier) {
+    utility_assert(barrier);
+    free(barrier->nodes);
+    free(barrier);
+}
+
+static void _treebarrier_wait(TreeBarrier* barrier, guint32 generation) {
+    for (gint i = 0; i < TREE_BARRIER_SPINS; i++) {
+        if (__atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE) != generation) {
+            return;
+        }
+    }
+
+    /* the releaser only makes the wake syscall if it sees a sleeper, so count ourselves
+     * before checking the generation again */
+    __atomic_add_fetch(&barrier->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&barrier->generation, __ATOMIC_SEQ_CST) == generation) {
+        if (syscall(SYS_futex, &barrier->generation, FUTEX_WAIT_PRIVATE, generation, NULL, NULL,
+                    0) != 0 &&
+            errno != EAGAIN && errno != EINTR) {
+            utility_panic("futex wait: %s", g_strerror(errno));
+        }
+    }
+    __atomic_sub_fetch(&barrier->sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+void treebarrier_await(TreeBarrier* barrier, guint threadID, TreeBarrierFunc func,
+                       gpointer data) {
+    utility_assert(barrier);
+    utility_assert(threadID < barrier->nThreads);
+
+    /* can't change until we arrive */
+    guint32 generation = __atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE);
+
+    gint index = threadID / TREE_BARRIER_FANOUT;
+    while (index >= 0) {
+        TreeBarrierNode* node = &barrier->nodes[index];
+        if (__atomic_add_fetch(&node->arrived, 1, __ATOMIC_ACQ_REL) < node->count) {
+            _treebarrier_wait(barrier, generation);
+            return;
+        }
+        /* we're the last to arrive here, and nobody else will until we release them */
+        __atomic_store_n(&node->arrived, 0, __ATOMIC_RELAXED);
+        index = node->parent;
+    }
+
+    /* we're the last to arrive at the root, so everyone else is waiting */
+    if (func) {
+        func(data);
+    }
+
+    __atomic_store_n(&barrier->generation, generation + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&barrier->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        if (syscall(SYS_futex, &barrier->generation, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0) <
+            0) {
+            utility_panic("futex wake: %s", g_strerror(errno));
+        }
+    }
+}
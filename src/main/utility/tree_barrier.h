@@ -0,0 +1,31 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#ifndef SHD_TREE_BARRIER_H_
+#define SHD_TREE_BARRIER_H_
+
+#include <glib.h>
+
+/* A reusable barrier for a fixed set of threads. Arrivals are counted in a tree
+ * of counters on separate cache lines, so that the threads don't all contend on
+ * one lock, and the last thread to arrive runs a function on behalf of all of
+ * them before any of them are released. Waiting threads spin for a while before
+ * they sleep, so each thread should have a CPU of its own. */
+typedef struct _TreeBarrier TreeBarrier;
+
+typedef void (*TreeBarrierFunc)(gpointer data);
+
+TreeBarrier* treebarrier_new(guint nThreads);
+void treebarrier_free(TreeBarrier* barrier);
+
+/* Blocks until all nThreads threads have called this, each with a different
+ * threadID below nThreads. The last to arrive calls func(data), if func isn't
+ * NULL, and every thread returns once it has. Everything the threads wrote
+ * before arriving is visible to func, and everything func wrote is visible to
+ * the threads once they return. */
+void treebarrier_await(TreeBarrier* barrier, guint threadID, TreeBarrierFunc func,
+                       gpointer data);
+
+#endif /* SHD_TREE_BARRIER_H_ */
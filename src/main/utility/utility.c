@@ -6,12 +6,16 @@
 
 #include <errno.h>
 #include <execinfo.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
+#include <limits.h>
+#include <linux/fs.h>
 #include <netinet/in.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -191,92 +195,221 @@ gboolean utility_removeAll(const gchar* path) {
     return isSuccess;
 }
 
-/* destructive copy that will remove dst path if it exists */
-gboolean utility_copyAll(const gchar* srcPath, const gchar* dstPath) {
-    if(!dstPath || !srcPath || !g_file_test(srcPath, G_FILE_TEST_EXISTS)) {
+/* the number of threads that copy files at the same time in utility_copyAll() */
+#define UTILITY_COPY_THREADS 8
+
+typedef struct _UtilityCopyJob UtilityCopyJob;
+struct _UtilityCopyJob {
+    gchar* srcPath;
+    gchar* dstPath;
+    mode_t mode;
+};
+
+/* Copies the contents of a regular file. We first try to clone the file, which shares
+ * its blocks with the source until either is written on filesystems that support
+ * reflinks (e.g., btrfs and xfs). Otherwise the kernel copies the data, which avoids
+ * moving it through our address space. */
+static gboolean _utility_copyFileContents(const gchar* srcPath, const gchar* dstPath,
+                                          mode_t mode) {
+    int srcFd = open(srcPath, O_RDONLY | O_CLOEXEC);
+    if (srcFd < 0) {
+        warning("unable to open file '%s': error %i: %s", srcPath, errno, strerror(errno));
         return FALSE;
     }
 
-    /* if destination already exists, delete it */
-    if(g_file_test(dstPath, G_FILE_TEST_EXISTS) && !utility_removeAll(dstPath)) {
-        return FALSE;
-    }
-
-    /* get file/dir mode */
-    struct stat statbuf;
-    memset(&statbuf, 0, sizeof(struct stat));
-    if(g_lstat(srcPath, &statbuf) != 0) {
-        warning("unable to stat src path '%s': error %i: %s", srcPath, errno, strerror(errno));
+    int dstFd = open(dstPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode & 0777);
+    if (dstFd < 0) {
+        warning("unable to create file '%s': error %i: %s", dstPath, errno, strerror(errno));
+        close(srcFd);
         return FALSE;
     }
 
-    /* now create the dir or copy the file */
-    if(g_file_test(srcPath, G_FILE_TEST_IS_DIR)) {
-        /* create new dir with same mode as the old */
-        if(g_mkdir(dstPath, statbuf.st_mode) != 0) {
-            warning("unable to make dst path '%s': error %i: %s", dstPath, errno, strerror(errno));
-            return FALSE;
-        } else {
-            /* now recurse into this directory */
-            GError* err = NULL;
-            GDir* dir = g_dir_open(srcPath, 0, &err);
+    gboolean isSuccess = TRUE;
 
-            if(err) {
-                warning("unable to open directory '%s': error %i: %s", srcPath, err->code, err->message);
-                return FALSE;
-            } else {
-                gboolean isSuccess = TRUE;
-
-                const gchar* entry = NULL;
-                while((entry = g_dir_read_name(dir)) != NULL) {
-                    gchar* srcChildPath = g_build_filename(srcPath, entry, NULL);
-                    gchar* dstChildPath = g_build_filename(dstPath, entry, NULL);
-                    isSuccess = utility_copyAll(srcChildPath, dstChildPath);
-                    g_free(srcChildPath);
-                    g_free(dstChildPath);
-                    if(!isSuccess) {
-                        break;
-                    }
-                }
+    if (ioctl(dstFd, FICLONE, srcFd) == 0) {
+        trace("cloned path '%s' to '%s'", srcPath, dstPath);
+    } else {
+        gboolean useReadWrite = FALSE;
+
+        while (TRUE) {
+            ssize_t n = copy_file_range(srcFd, NULL, dstFd, NULL, SSIZE_MAX, 0);
+            if (n == 0) {
+                break;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                                 errno == EOPNOTSUPP)) {
+                /* the kernel or filesystem can't do it; copy_file_range() advanced
+                 * the file offsets, so we continue from wherever it stopped */
+                useReadWrite = TRUE;
+                break;
+            } else if (n < 0) {
+                warning("unable to copy file '%s' to '%s': error %i: %s", srcPath, dstPath,
+                        errno, strerror(errno));
+                isSuccess = FALSE;
+                break;
+            }
+        }
 
-                g_dir_close(dir);
+        while (useReadWrite) {
+            gchar buf[65536];
+            ssize_t n = read(srcFd, buf, sizeof(buf));
+            if (n == 0) {
+                break;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0) {
+                warning("unable to read file '%s': error %i: %s", srcPath, errno,
+                        strerror(errno));
+                isSuccess = FALSE;
+                break;
+            }
 
-                if(!isSuccess) {
-                    return FALSE;
+            ssize_t written = 0;
+            while (written < n) {
+                ssize_t w = write(dstFd, buf + written, n - written);
+                if (w < 0 && errno == EINTR) {
+                    continue;
+                } else if (w < 0) {
+                    warning("unable to write file '%s': error %i: %s", dstPath, errno,
+                            strerror(errno));
+                    isSuccess = FALSE;
+                    break;
                 }
+                written += w;
             }
-        }
-    } else {
-        gchar* srcContents = NULL;
-        gsize srcLength = 0;
-        GError* err = NULL;
-
-        gboolean isSuccess = g_file_get_contents(srcPath, &srcContents, &srcLength, &err);
 
-        if(isSuccess && !err) {
-            isSuccess = g_file_set_contents(dstPath, srcContents, (gssize)srcLength, &err);
-            if(isSuccess & !err) {
-                debug("copied path '%s' to '%s'", srcPath, dstPath);
+            if (!isSuccess) {
+                break;
             }
         }
 
-        if(srcContents) {
-            g_free(srcContents);
+        if (isSuccess) {
+            debug("copied path '%s' to '%s'", srcPath, dstPath);
         }
+    }
 
-        if(err) {
-            warning("unable to read file '%s': error %i: %s", srcPath, err->code, err->message);
+    /* the mode given to open() is masked by the umask */
+    if (isSuccess && fchmod(dstFd, mode) != 0) {
+        warning("unable to chmod dst path '%s': error %i: %s", dstPath, errno, strerror(errno));
+        isSuccess = FALSE;
+    }
+
+    close(srcFd);
+    if (close(dstFd) != 0) {
+        warning("unable to close file '%s': error %i: %s", dstPath, errno, strerror(errno));
+        isSuccess = FALSE;
+    }
+
+    return isSuccess;
+}
+
+static void _utility_copyJobFree(UtilityCopyJob* job) {
+    g_free(job->srcPath);
+    g_free(job->dstPath);
+    g_free(job);
+}
+
+static void _utility_runCopyJob(UtilityCopyJob* job, gint* failed) {
+    if (!g_atomic_int_get(failed) &&
+        !_utility_copyFileContents(job->srcPath, job->dstPath, job->mode)) {
+        g_atomic_int_set(failed, TRUE);
+    }
+    _utility_copyJobFree(job);
+}
+
+/* Creates the directories under dstPath, and queues the files to be copied in the pool. */
+static gboolean _utility_copyAll(const gchar* srcPath, const gchar* dstPath, GThreadPool* pool,
+                                 gint* failed) {
+    /* get file/dir mode */
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(struct stat));
+    if(g_stat(srcPath, &statbuf) != 0) {
+        warning("unable to stat src path '%s': error %i: %s", srcPath, errno, strerror(errno));
+        return FALSE;
+    }
+
+    if (!S_ISDIR(statbuf.st_mode)) {
+        UtilityCopyJob* job = g_new0(UtilityCopyJob, 1);
+        job->srcPath = g_strdup(srcPath);
+        job->dstPath = g_strdup(dstPath);
+        job->mode = statbuf.st_mode & 07777;
+
+        GError* err = NULL;
+        if (!g_thread_pool_push(pool, job, &err)) {
+            warning("unable to queue copy of '%s': %s", srcPath, err->message);
             g_error_free(err);
+            _utility_copyJobFree(job);
             return FALSE;
         }
+        return TRUE;
     }
 
+    /* create new dir with same mode as the old */
+    if(g_mkdir(dstPath, statbuf.st_mode) != 0) {
+        warning("unable to make dst path '%s': error %i: %s", dstPath, errno, strerror(errno));
+        return FALSE;
+    }
     if(g_chmod(dstPath, statbuf.st_mode) != 0) {
         warning("unable to chmod dst path '%s': error %i: %s", dstPath, errno, strerror(errno));
         return FALSE;
     }
 
-    return TRUE;
+    /* now recurse into this directory */
+    GError* err = NULL;
+    GDir* dir = g_dir_open(srcPath, 0, &err);
+
+    if(err) {
+        warning("unable to open directory '%s': error %i: %s", srcPath, err->code, err->message);
+        g_error_free(err);
+        return FALSE;
+    }
+
+    gboolean isSuccess = TRUE;
+
+    const gchar* entry = NULL;
+    while(isSuccess && !g_atomic_int_get(failed) && (entry = g_dir_read_name(dir)) != NULL) {
+        gchar* srcChildPath = g_build_filename(srcPath, entry, NULL);
+        gchar* dstChildPath = g_build_filename(dstPath, entry, NULL);
+        isSuccess = _utility_copyAll(srcChildPath, dstChildPath, pool, failed);
+        g_free(srcChildPath);
+        g_free(dstChildPath);
+    }
+
+    g_dir_close(dir);
+
+    return isSuccess;
+}
+
+/* destructive copy that will remove dst path if it exists. files are copied in parallel,
+ * and are cloned rather than copied where the filesystem supports it. */
+gboolean utility_copyAll(const gchar* srcPath, const gchar* dstPath) {
+    if(!dstPath || !srcPath || !g_file_test(srcPath, G_FILE_TEST_EXISTS)) {
+        return FALSE;
+    }
+
+    /* if destination already exists, delete it */
+    if(g_file_test(dstPath, G_FILE_TEST_EXISTS) && !utility_removeAll(dstPath)) {
+        return FALSE;
+    }
+
+    gint failed = FALSE;
+
+    GError* err = NULL;
+    GThreadPool* pool = g_thread_pool_new(
+        (GFunc)_utility_runCopyJob, &failed, UTILITY_COPY_THREADS, FALSE, &err);
+    if (!pool) {
+        warning("unable to create copy threads: %s", err->message);
+        g_error_free(err);
+        return FALSE;
+    }
+
+    gboolean isSuccess = _utility_copyAll(srcPath, dstPath, pool, &failed);
+
+    /* wait for the queued files to be copied */
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    return isSuccess && !failed;
 }
 
 GString* utility_getFileContents(const gchar* fileName) {
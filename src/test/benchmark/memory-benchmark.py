@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+
+'''
+Measures how much memory Shadow itself uses per simulated host, in three
+simulations, each at every host count in --hosts:
+
+idle: hosts whose process only sleeps.
+conn: half of the hosts are clients that each hold --connections idle TCP
+      connections to a server on one of the other hosts.
+full: like conn, but the clients fill the send buffer of every connection,
+      and the servers never read, so their receive buffers fill too.
+
+Once the connections are set up, the processes sleep until --stop-time. For
+each run, it records the peak RSS of the shadow process, the shared memory of
+its ShMemAllocator from the last manager heartbeat, and the objects it
+allocated of each type from its object counters. It appends one JSON object
+per line to the output file. From the build directory:
+$ make benchmark-memory
+'''
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+PORT = 8080
+
+CONFIG_TEMPLATE = '''general:
+  stop_time: {stop_time}
+experimental:
+  use_object_counters: true
+network:
+  graph:
+    type: 1_gbit_switch
+hosts:
+{hosts}'''
+
+HOST_TEMPLATE = '''  {name}:
+    quantity: {quantity}
+    processes:
+    - path: {benchmark}
+      args: {args}
+      start_time: {start_time}
+'''
+
+SHMEM_RE = re.compile(r'manager heartbeat at simtime .* shmem-pools=(\d+) '
+                      r'shmem-pool-bytes=(\d+) shmem-used-bytes=(\d+) shmem-big-bytes=(\d+)')
+RSS_RE = re.compile(r'ru_maxrss=([0-9.]+) GiB')
+OBJECTS_RE = re.compile(r'Global allocated object counts: \{(.*)\}')
+
+
+def parse_log(path):
+    '''Returns the last memory statistics that shadow logged.'''
+    shmem, rss, objects = None, None, None
+    with open(path) as log:
+        for line in log:
+            match = SHMEM_RE.search(line)
+            if match:
+                shmem = [int(x) for x in match.groups()]
+            match = RSS_RE.search(line)
+            if match:
+                rss = float(match.group(1))
+            match = OBJECTS_RE.search(line)
+            if match:
+                objects = {}
+                for item in match.group(1).split(', '):
+                    if item:
+                        name, count = item.rsplit(':', 1)
+                        objects[name] = int(count)
+
+    if shmem is None or rss is None or objects is None:
+        raise RuntimeError('missing heartbeat or object counts in {}'.format(path))
+
+    return {
+        # shadow logs the peak RSS in GiB
+        'max_rss_bytes': int(rss * 1024**3),
+        'shmem_pools': shmem[0],
+        'shmem_pool_bytes': shmem[1],
+        'shmem_used_bytes': shmem[2],
+        'shmem_big_bytes': shmem[3],
+        'allocated_objects': objects,
+    }
+
+
+def run_shadow(args, name, hosts):
+    '''Returns the memory statistics of one simulation.'''
+    run_dir = os.path.abspath(os.path.join(args.work_dir, name))
+    os.makedirs(run_dir, exist_ok=True)
+
+    config_path = os.path.join(run_dir, 'shadow.yaml')
+    with open(config_path, 'w') as f:
+        f.write(CONFIG_TEMPLATE.format(stop_time=args.stop_time, hosts=hosts))
+
+    # shadow won't overwrite the data of an earlier run
+    data_dir = os.path.join(run_dir, 'shadow.data')
+    shutil.rmtree(data_dir, ignore_errors=True)
+    command = [os.path.abspath(args.shadow), '--data-directory', data_dir,
+               '--log-level', 'info', '--interpose-method', args.interpose_method,
+               config_path]
+
+    print('running {}'.format(name), file=sys.stderr)
+
+    log_path = os.path.join(run_dir, 'shadow.log')
+    with open(log_path, 'w') as log:
+        returncode = subprocess.call(command, cwd=run_dir, stdout=log, stderr=subprocess.STDOUT)
+
+    if returncode != 0:
+        raise RuntimeError('shadow failed in {}, see its shadow.log'.format(run_dir))
+    return parse_log(log_path)
+
+
+def host_config(args, name, quantity, benchmark_args, start_time):
+    return HOST_TEMPLATE.format(name=name, quantity=quantity,
+                                benchmark=os.path.abspath(args.benchmark),
+                                args=benchmark_args, start_time=start_time)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--shadow', required=True, help='path to the shadow binary')
+    parser.add_argument('--benchmark', required=True,
+                        help='path to the test-memory-benchmark binary')
+    parser.add_argument('--output', default='memory-benchmark.json',
+                        help='file to append the results to, one JSON object per line')
+    parser.add_argument('--work-dir', default='memory-benchmark.data',
+                        help='directory for the configs and data of each run')
+    parser.add_argument('--interpose-method', default='preload', help='interpose method')
+    parser.add_argument('--hosts', default='10,100,1000',
+                        help='comma-separated numbers of hosts to simulate')
+    parser.add_argument('--connections', type=int, default=1000,
+                        help='connections that each client holds open')
+    parser.add_argument('--stop-time', type=int, default=30,
+                        help='simulated seconds to run each simulation')
+    parser.add_argument('--skip', choices=['idle', 'conn', 'full'], action='append', default=[],
+                        help='skip one of the benchmarks')
+    args = parser.parse_args()
+
+    os.makedirs(args.work_dir, exist_ok=True)
+    host_counts = [int(x) for x in args.hosts.split(',')]
+
+    results = []
+
+    for hosts in host_counts:
+        for benchmark in ['idle', 'conn', 'full']:
+            if benchmark in args.skip:
+                continue
+
+            if benchmark == 'idle':
+                nhosts = hosts
+                connections = 0
+                config = host_config(args, 'host', hosts, 'idle', 1)
+            else:
+                # a client and a server for each pair of hosts
+                pairs = max(hosts // 2, 1)
+                connections = pairs * args.connections
+                fill = 1 if benchmark == 'full' else 0
+                config = host_config(args, 'server', pairs, 'server {}'.format(PORT), 1)
+                config += host_config(args, 'client', pairs,
+                                      'client {} {} {}'.format(PORT, args.connections, fill), 2)
+                nhosts = pairs * 2
+
+            stats = run_shadow(args, '{}-{}'.format(benchmark, nhosts), config)
+            result = {
+                'benchmark': benchmark,
+                'interpose_method': args.interpose_method,
+                'hosts': nhosts,
+                'connections': connections,
+                'max_rss_bytes_per_host': stats['max_rss_bytes'] / nhosts,
+            }
+            if connections:
+                result['max_rss_bytes_per_connection'] = stats['max_rss_bytes'] / connections
+            result.update(stats)
+            results.append(result)
+
+    with open(args.output, 'a') as f:
+        for result in results:
+            f.write(json.dumps(result, sort_keys=True) + '\n')
+            print(json.dumps(result, sort_keys=True))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+
+'''
+Measures what each syscall costs a plugin under each interpose method.
+
+Time inside Shadow is simulated, so the plugin can't time itself. For each
+configuration, this runs test-syscall-benchmark in Shadow twice, once with
+--iterations and once with 0 iterations, and divides the difference in wall
+time by the number of iterations. Each measurement is the fastest of --repeat
+runs.
+
+It sweeps the interpose method, experimental.preload_spin_max (which only
+applies to the preload and hybrid methods), experimental.use_cpu_pinning, and
+experimental.use_shim_syscall_handler. With the shim syscall handler, getpid
+and clock_gettime are answered in the plugin by the shim, and without it they
+make the full round trip to Shadow's syscall handler, like the other syscalls.
+
+Each measurement appends one JSON object per line to the output file, and a
+summary table is printed when the sweep is done. From the build directory:
+$ make benchmark-syscalls
+'''
+
+import argparse
+import itertools
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+SYSCALLS = ['getpid', 'clock_gettime', 'pipe_write', 'tcp_send', 'epoll_wait']
+
+CONFIG_TEMPLATE = '''general:
+  stop_time: 3600
+network:
+  graph:
+    type: 1_gbit_switch
+hosts:
+  bench:
+    processes:
+    - path: {benchmark}
+      args: {syscall} {iterations}
+      start_time: 1
+'''
+
+
+def comma_list(convert):
+    return lambda value: [convert(v) for v in value.split(',')]
+
+
+def parse_bool(value):
+    if value not in ('true', 'false'):
+        raise argparse.ArgumentTypeError('expected true or false')
+    return value == 'true'
+
+
+def run_shadow(args, name, syscall, iterations, options):
+    '''Returns the wall time in seconds of one simulation.'''
+    run_dir = os.path.join(args.work_dir, name)
+    os.makedirs(run_dir, exist_ok=True)
+
+    config_path = os.path.join(run_dir, 'shadow.yaml')
+    with open(config_path, 'w') as f:
+        f.write(CONFIG_TEMPLATE.format(benchmark=os.path.abspath(args.benchmark),
+                                       syscall=syscall, iterations=iterations))
+
+    # shadow won't overwrite the data of an earlier run
+    data_dir = os.path.join(run_dir, 'shadow.data')
+    shutil.rmtree(data_dir, ignore_errors=True)
+    command = [os.path.abspath(args.shadow), '--data-directory', data_dir,
+               '--log-level', 'warning'] + options + [config_path]
+
+    start = time.monotonic()
+    with open(os.path.join(run_dir, 'shadow.log'), 'w') as log:
+        result = subprocess.run(command, cwd=run_dir, stdout=log, stderr=subprocess.STDOUT)
+    wall_seconds = time.monotonic() - start
+
+    if result.returncode != 0:
+        raise RuntimeError('shadow failed in {}, see its shadow.log'.format(run_dir))
+    return wall_seconds
+
+
+def measure(args, method, spin_max, pinning, shim_handler, syscall):
+    options = ['--interpose-method', method,
+               '--use-cpu-pinning', str(pinning).lower(),
+               '--use-shim-syscall-handler', str(shim_handler).lower()]
+    if spin_max is not None:
+        options += ['--preload-spin-max', str(spin_max)]
+
+    name = '{}-spin{}-pin{}-shim{}-{}'.format(method, spin_max, int(pinning), int(shim_handler),
+                                              syscall)
+    print('running {}'.format(name), file=sys.stderr)
+
+    loaded = min(run_shadow(args, name, syscall, args.iterations, options)
+                 for _ in range(args.repeat))
+    empty = min(run_shadow(args, name, syscall, 0, options) for _ in range(args.repeat))
+
+    return {
+        'syscall': syscall,
+        'interpose_method': method,
+        'preload_spin_max': spin_max,
+        'use_cpu_pinning': pinning,
+        'use_shim_syscall_handler': shim_handler,
+        'iterations': args.iterations,
+        'wall_seconds': loaded,
+        'baseline_wall_seconds': empty,
+        'ns_per_syscall': max(0.0, loaded - empty) * 1e9 / args.iterations,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--shadow', required=True, help='path to the shadow binary')
+    parser.add_argument('--benchmark', required=True,
+                        help='path to the test-syscall-benchmark binary')
+    parser.add_argument('--output', default='syscall-benchmark.json',
+                        help='file to append the results to, one JSON object per line')
+    parser.add_argument('--work-dir', default='syscall-benchmark.data',
+                        help='directory for the configs and data of each run')
+    parser.add_argument('--syscalls', type=comma_list(str), default=SYSCALLS,
+                        help='comma-separated syscalls, from: {}'.format(', '.join(SYSCALLS)))
+    parser.add_argument('--interpose-method', type=comma_list(str),
+                        default=['preload', 'ptrace', 'hybrid'],
+                        help='comma-separated interpose methods')
+    parser.add_argument('--preload-spin-max', type=comma_list(int), default=[0, 1000, 10000],
+                        help='comma-separated values of experimental.preload_spin_max')
+    parser.add_argument('--use-cpu-pinning', type=comma_list(parse_bool),
+                        default=[False, True], help='comma-separated true/false')
+    parser.add_argument('--use-shim-syscall-handler', type=comma_list(parse_bool),
+                        default=[True, False], help='comma-separated true/false')
+    parser.add_argument('--iterations', type=int, default=1000000,
+                        help='syscalls to make in each timed run')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='runs of each configuration to take the fastest of')
+    args = parser.parse_args()
+
+    for syscall in args.syscalls:
+        if syscall not in SYSCALLS:
+            parser.error('unknown syscall {}'.format(syscall))
+
+    os.makedirs(args.work_dir, exist_ok=True)
+
+    results = []
+    for method in args.interpose_method:
+        # ptrace doesn't use the preload IPC channel, so the spin count doesn't matter
+        spin_values = [None] if method == 'ptrace' else args.preload_spin_max
+        for spin_max, pinning, shim_handler, syscall in itertools.product(
+                spin_values, args.use_cpu_pinning, args.use_shim_syscall_handler,
+                args.syscalls):
+            result = measure(args, method, spin_max, pinning, shim_handler, syscall)
+            results.append(result)
+            with open(args.output, 'a') as f:
+                f.write(json.dumps(result, sort_keys=True) + '\n')
+
+    print('{:<8} {:>6} {:>4} {:>5} {:<14} {:>12}'.format('method', 'spin', 'pin', 'shim',
+                                                      'syscall', 'ns/syscall'))
+    for r in results:
+        print('{:<8} {:>6} {:>4} {:>5} {:<14} {:>12.0f}'.format(
+            r['interpose_method'], str(r['preload_spin_max']), str(r['use_cpu_pinning']),
+            str(r['use_shim_syscall_handler']), r['syscall'], r['ns_per_syscall']))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
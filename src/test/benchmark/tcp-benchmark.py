@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+
+'''
+Measures how much CPU time Shadow's TCP stack costs, in two simulations:
+
+bulk: one connection sends --bytes over a path with --bulk-bandwidth and
+      --bulk-latency each way, which keeps many segments in flight.
+conn: a client makes --connections short connections to one server, at most
+      --parallel at a time, each exchanging one byte each way.
+
+For each, it records the CPU time of Shadow, including its plugin processes,
+per simulated GB transferred and per connection. It appends one JSON object per
+line to the output file. From the build directory:
+$ make benchmark-tcp
+'''
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+PORT = 8080
+
+CONFIG_TEMPLATE = '''general:
+  stop_time: {stop_time}
+network:
+  graph:
+    type: gml
+    inline: |
+      graph [
+        directed 0
+        node [
+          id 0
+          bandwidth_down "{bandwidth}"
+          bandwidth_up "{bandwidth}"
+        ]
+        edge [
+          source 0
+          target 0
+          latency "{latency}"
+          packet_loss 0.0
+        ]
+      ]
+hosts:
+  server:
+    processes:
+    - path: {benchmark}
+      args: {server_args}
+      start_time: 1
+  client:
+    processes:
+    - path: {benchmark}
+      args: {client_args}
+      start_time: 2
+'''
+
+
+def run_shadow(args, name, bandwidth, latency, server_args, client_args):
+    '''Returns the CPU and wall seconds of one simulation.'''
+    run_dir = os.path.join(args.work_dir, name)
+    os.makedirs(run_dir, exist_ok=True)
+
+    config_path = os.path.join(run_dir, 'shadow.yaml')
+    with open(config_path, 'w') as f:
+        f.write(CONFIG_TEMPLATE.format(stop_time=args.stop_time, bandwidth=bandwidth,
+                                       latency=latency,
+                                       benchmark=os.path.abspath(args.benchmark),
+                                       server_args=server_args, client_args=client_args))
+
+    # shadow won't overwrite the data of an earlier run
+    data_dir = os.path.join(run_dir, 'shadow.data')
+    shutil.rmtree(data_dir, ignore_errors=True)
+    command = [os.path.abspath(args.shadow), '--data-directory', data_dir,
+               '--log-level', 'warning', '--interpose-method', args.interpose_method,
+               config_path]
+
+    print('running {}'.format(name), file=sys.stderr)
+
+    start = time.monotonic()
+    with open(os.path.join(run_dir, 'shadow.log'), 'w') as log:
+        proc = subprocess.Popen(command, cwd=run_dir, stdout=log, stderr=subprocess.STDOUT)
+        # the child's usage includes the plugins, which shadow waits for
+        _, status, usage = os.wait4(proc.pid, 0)
+        proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+    wall_seconds = time.monotonic() - start
+
+    if proc.returncode != 0:
+        raise RuntimeError('shadow failed in {}, see its shadow.log'.format(run_dir))
+    return usage.ru_utime + usage.ru_stime, wall_seconds
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--shadow', required=True, help='path to the shadow binary')
+    parser.add_argument('--benchmark', required=True,
+                        help='path to the test-tcp-benchmark binary')
+    parser.add_argument('--output', default='tcp-benchmark.json',
+                        help='file to append the results to, one JSON object per line')
+    parser.add_argument('--work-dir', default='tcp-benchmark.data',
+                        help='directory for the configs and data of each run')
+    parser.add_argument('--interpose-method', default='preload', help='interpose method')
+    parser.add_argument('--bytes', type=int, default=1000**3,
+                        help='bytes to send in the bulk transfer')
+    parser.add_argument('--bulk-bandwidth', default='10 Gbit',
+                        help='bandwidth of the hosts in the bulk transfer')
+    parser.add_argument('--bulk-latency', default='100 ms',
+                        help='one-way latency between the hosts in the bulk transfer')
+    parser.add_argument('--connections', type=int, default=10000,
+                        help='connections to make in the connection benchmark')
+    parser.add_argument('--parallel', type=int, default=10000,
+                        help='connections to have open at once')
+    parser.add_argument('--stop-time', type=int, default=3600,
+                        help='simulated seconds to allow each simulation')
+    parser.add_argument('--skip', choices=['bulk', 'conn'], action='append', default=[],
+                        help='skip one of the benchmarks')
+    args = parser.parse_args()
+
+    os.makedirs(args.work_dir, exist_ok=True)
+
+    results = []
+
+    if 'bulk' not in args.skip:
+        cpu, wall = run_shadow(args, 'bulk', args.bulk_bandwidth, args.bulk_latency,
+                               'bulk-server {}'.format(PORT),
+                               'bulk-client server {} {}'.format(PORT, args.bytes))
+        gb = args.bytes / 1000**3
+        results.append({
+            'benchmark': 'bulk',
+            'interpose_method': args.interpose_method,
+            'bytes': args.bytes,
+            'bandwidth': args.bulk_bandwidth,
+            'latency': args.bulk_latency,
+            'cpu_seconds': cpu,
+            'wall_seconds': wall,
+            'cpu_seconds_per_gb': cpu / gb,
+        })
+
+    if 'conn' not in args.skip:
+        cpu, wall = run_shadow(args, 'conn', '1 Gbit', '10 ms',
+                               'conn-server {} {}'.format(PORT, args.connections),
+                               'conn-client server {} {} {}'.format(PORT, args.connections,
+                                                                    args.parallel))
+        results.append({
+            'benchmark': 'conn',
+            'interpose_method': args.interpose_method,
+            'connections': args.connections,
+            'parallel': args.parallel,
+            'cpu_seconds': cpu,
+            'wall_seconds': wall,
+            'cpu_ms_per_connection': cpu * 1000 / args.connections,
+        })
+
+    with open(args.output, 'a') as f:
+        for result in results:
+            f.write(json.dumps(result, sort_keys=True) + '\n')
+            print(json.dumps(result, sort_keys=True))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
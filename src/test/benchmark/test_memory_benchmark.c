@@ -0,0 +1,159 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+/* Holds simulated state open for memory-benchmark.py to measure.
+ *
+ * usage:
+ *   test-memory-benchmark idle
+ *   test-memory-benchmark server PORT
+ *   test-memory-benchmark client PORT CONNECTIONS FILL
+ *
+ * The idle mode does nothing. The server accepts connections and never reads
+ * from them. The client runs on a host named clientN, and makes CONNECTIONS
+ * connections to the server on serverN. If FILL is 1, it then writes to each
+ * connection until the write would block, which fills its send buffer and the
+ * server's receive buffer. Every mode then sleeps until Shadow stops it, waking
+ * once a second so that Shadow keeps logging its heartbeat. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define FILL_WRITE_SIZE (64 * 1024)
+#define MAX_EVENTS 1024
+#define LISTEN_BACKLOG 16384
+
+#define CHECK(cond)                                                                           \
+    do {                                                                                      \
+        if (!(cond)) {                                                                        \
+            fprintf(stderr, "%s:%d: '%s' failed: %s\n", __FILE__, __LINE__, #cond,            \
+                    strerror(errno));                                                         \
+            exit(EXIT_FAILURE);                                                               \
+        }                                                                                     \
+    } while (0)
+
+static void _sleep_forever(void) {
+    for (;;) {
+        sleep(1);
+    }
+}
+
+static void _server(int port) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(listener >= 0);
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY), .sin_port = htons(port)};
+    CHECK(bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(listener, LISTEN_BACKLOG) == 0);
+
+    /* keep every connection open, without reading from it */
+    for (;;) {
+        CHECK(accept(listener, NULL, NULL) >= 0);
+    }
+}
+
+/* Returns the address of the server with the same number as this client's host. */
+static struct sockaddr_in _resolve_server(int port) {
+    char hostname[256];
+    CHECK(gethostname(hostname, sizeof(hostname)) == 0);
+    CHECK(strncmp(hostname, "client", 6) == 0);
+
+    char server[256];
+    snprintf(server, sizeof(server), "server%s", hostname + 6);
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo* info = NULL;
+    int rv = getaddrinfo(server, NULL, &hints, &info);
+    if (rv != 0) {
+        fprintf(stderr, "getaddrinfo(%s): %s\n", server, gai_strerror(rv));
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in addr = *(struct sockaddr_in*)info->ai_addr;
+    addr.sin_port = htons(port);
+    freeaddrinfo(info);
+    return addr;
+}
+
+static void _client(int port, long connections, int fill) {
+    struct sockaddr_in addr = _resolve_server(port);
+
+    int epfd = epoll_create1(0);
+    CHECK(epfd >= 0);
+
+    int* fds = calloc(connections, sizeof(*fds));
+    CHECK(fds != NULL);
+
+    for (long i = 0; i < connections; i++) {
+        fds[i] = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        CHECK(fds[i] >= 0);
+        int rv = connect(fds[i], (struct sockaddr*)&addr, sizeof(addr));
+        CHECK(rv == 0 || errno == EINPROGRESS);
+
+        struct epoll_event ev = {.events = EPOLLOUT, .data.fd = fds[i]};
+        CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev) == 0);
+    }
+
+    /* wait until every connection is established */
+    long established = 0;
+    struct epoll_event events[MAX_EVENTS];
+    while (established < connections) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        CHECK(n >= 0);
+
+        for (int i = 0; i < n; i++) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            CHECK(getsockopt(events[i].data.fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0);
+            CHECK(error == 0);
+            CHECK(epoll_ctl(epfd, EPOLL_CTL_DEL, events[i].data.fd, NULL) == 0);
+            established++;
+        }
+    }
+
+    unsigned long long written = 0;
+    if (fill) {
+        static char buf[FILL_WRITE_SIZE];
+        memset(buf, 'x', sizeof(buf));
+
+        for (long i = 0; i < connections; i++) {
+            ssize_t n;
+            while ((n = write(fds[i], buf, sizeof(buf))) > 0) {
+                written += n;
+            }
+            CHECK(errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    printf("established %ld connections, wrote %llu bytes\n", established, written);
+    fflush(stdout);
+    close(epfd);
+    _sleep_forever();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 2 && !strcmp(argv[1], "idle")) {
+        _sleep_forever();
+    } else if (argc == 3 && !strcmp(argv[1], "server")) {
+        _server(atoi(argv[2]));
+    } else if (argc == 5 && !strcmp(argv[1], "client")) {
+        _client(atoi(argv[2]), strtol(argv[3], NULL, 10), atoi(argv[4]));
+    } else {
+        fprintf(stderr, "usage: %s idle | server PORT | client PORT CONNECTIONS FILL\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
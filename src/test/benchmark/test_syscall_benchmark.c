@@ -0,0 +1,151 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+/* Makes the same syscall in a tight loop, so that syscall-benchmark.py can time
+ * it. Time inside Shadow is simulated, so the harness measures the wall time of
+ * the whole simulation instead, and subtracts a run with 0 iterations.
+ *
+ * usage: test-syscall-benchmark SYSCALL ITERATIONS */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* how often the pipe and socket benchmarks drain what they've written, so
+ * that the writes never block */
+#define DRAIN_INTERVAL 1024
+
+#define CHECK(cond)                                                                           \
+    do {                                                                                      \
+        if (!(cond)) {                                                                        \
+            fprintf(stderr, "%s:%d: '%s' failed: %s\n", __FILE__, __LINE__, #cond,            \
+                    strerror(errno));                                                         \
+            exit(EXIT_FAILURE);                                                               \
+        }                                                                                     \
+    } while (0)
+
+static void _drain(int fd, size_t nbytes) {
+    char buf[DRAIN_INTERVAL];
+    while (nbytes > 0) {
+        ssize_t n = read(fd, buf, nbytes < sizeof(buf) ? nbytes : sizeof(buf));
+        CHECK(n > 0);
+        nbytes -= n;
+    }
+}
+
+static void _bench_getpid(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        /* libc may cache the pid, so make the syscall directly */
+        syscall(SYS_getpid);
+    }
+}
+
+static void _bench_clock_gettime(long iterations) {
+    struct timespec ts;
+    for (long i = 0; i < iterations; i++) {
+        CHECK(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+    }
+}
+
+static void _bench_pipe_write(long iterations) {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+
+    char byte = 0;
+    for (long i = 0; i < iterations; i++) {
+        CHECK(write(fds[1], &byte, 1) == 1);
+        if ((i + 1) % DRAIN_INTERVAL == 0) {
+            _drain(fds[0], DRAIN_INTERVAL);
+        }
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void _bench_tcp_send(long iterations) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(listener >= 0);
+
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addrlen = sizeof(addr);
+    CHECK(bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(getsockname(listener, (struct sockaddr*)&addr, &addrlen) == 0);
+    CHECK(listen(listener, 1) == 0);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(client >= 0);
+    CHECK(connect(client, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    int server = accept(listener, NULL, NULL);
+    CHECK(server >= 0);
+
+    char byte = 0;
+    for (long i = 0; i < iterations; i++) {
+        CHECK(send(client, &byte, 1, 0) == 1);
+        if ((i + 1) % DRAIN_INTERVAL == 0) {
+            _drain(server, DRAIN_INTERVAL);
+        }
+    }
+
+    close(server);
+    close(client);
+    close(listener);
+}
+
+static void _bench_epoll_wait(long iterations) {
+    int epfd = epoll_create1(0);
+    CHECK(epfd >= 0);
+
+    /* wait on a pipe that never becomes readable */
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fds[0]};
+    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev) == 0);
+
+    for (long i = 0; i < iterations; i++) {
+        CHECK(epoll_wait(epfd, &ev, 1, 0) == 0);
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    close(epfd);
+}
+
+static const struct {
+    const char* name;
+    void (*run)(long iterations);
+} _benchmarks[] = {
+    {"getpid", _bench_getpid},
+    {"clock_gettime", _bench_clock_gettime},
+    {"pipe_write", _bench_pipe_write},
+    {"tcp_send", _bench_tcp_send},
+    {"epoll_wait", _bench_epoll_wait},
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s SYSCALL ITERATIONS\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    long iterations = strtol(argv[2], NULL, 10);
+
+    for (size_t i = 0; i < sizeof(_benchmarks) / sizeof(_benchmarks[0]); i++) {
+        if (!strcmp(argv[1], _benchmarks[i].name)) {
+            _benchmarks[i].run(iterations);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    fprintf(stderr, "unknown syscall benchmark '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+}
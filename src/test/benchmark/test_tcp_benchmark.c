@@ -0,0 +1,233 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+/* Generates TCP load for tcp-benchmark.py.
+ *
+ * usage:
+ *   test-tcp-benchmark bulk-server PORT
+ *   test-tcp-benchmark bulk-client SERVER PORT BYTES
+ *   test-tcp-benchmark conn-server PORT CONNECTIONS
+ *   test-tcp-benchmark conn-client SERVER PORT CONNECTIONS PARALLEL
+ *
+ * The bulk client sends BYTES to the bulk server over one connection. The
+ * connection client makes CONNECTIONS short connections to the connection
+ * server, at most PARALLEL at a time, each exchanging one byte each way. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BULK_WRITE_SIZE (64 * 1024)
+#define MAX_EVENTS 1024
+/* large enough that the connection benchmark can have all its connections pending */
+#define LISTEN_BACKLOG 16384
+
+#define CHECK(cond)                                                                           \
+    do {                                                                                      \
+        if (!(cond)) {                                                                        \
+            fprintf(stderr, "%s:%d: '%s' failed: %s\n", __FILE__, __LINE__, #cond,            \
+                    strerror(errno));                                                         \
+            exit(EXIT_FAILURE);                                                               \
+        }                                                                                     \
+    } while (0)
+
+static int _listen(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY), .sin_port = htons(port)};
+    CHECK(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(fd, LISTEN_BACKLOG) == 0);
+    return fd;
+}
+
+static struct sockaddr_in _resolve(const char* name, int port) {
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo* info = NULL;
+    int rv = getaddrinfo(name, NULL, &hints, &info);
+    if (rv != 0) {
+        fprintf(stderr, "getaddrinfo(%s): %s\n", name, gai_strerror(rv));
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in addr = *(struct sockaddr_in*)info->ai_addr;
+    addr.sin_port = htons(port);
+    freeaddrinfo(info);
+    return addr;
+}
+
+static void _bulk_server(int port) {
+    int listener = _listen(port);
+    int fd = accept(listener, NULL, NULL);
+    CHECK(fd >= 0);
+
+    static char buf[BULK_WRITE_SIZE];
+    unsigned long long total = 0;
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        total += n;
+    }
+    CHECK(n == 0);
+
+    printf("received %llu bytes\n", total);
+    close(fd);
+    close(listener);
+}
+
+static void _bulk_client(const char* server, int port, unsigned long long bytes) {
+    struct sockaddr_in addr = _resolve(server, port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    CHECK(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+
+    static char buf[BULK_WRITE_SIZE];
+    memset(buf, 'x', sizeof(buf));
+    unsigned long long remaining = bytes;
+    while (remaining > 0) {
+        size_t len = remaining < sizeof(buf) ? remaining : sizeof(buf);
+        ssize_t n = write(fd, buf, len);
+        CHECK(n > 0);
+        remaining -= n;
+    }
+
+    printf("sent %llu bytes\n", bytes);
+    close(fd);
+}
+
+static void _conn_server(int port, long connections) {
+    int listener = _listen(port);
+    CHECK(fcntl(listener, F_SETFL, O_NONBLOCK) == 0);
+
+    int epfd = epoll_create1(0);
+    CHECK(epfd >= 0);
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = listener};
+    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev) == 0);
+
+    long served = 0;
+    struct epoll_event events[MAX_EVENTS];
+    while (served < connections) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        CHECK(n >= 0);
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listener) {
+                int conn;
+                while ((conn = accept4(listener, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+                    ev = (struct epoll_event){.events = EPOLLIN, .data.fd = conn};
+                    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, conn, &ev) == 0);
+                }
+                CHECK(errno == EAGAIN || errno == EWOULDBLOCK);
+                continue;
+            }
+
+            /* echo the request byte, then hang up */
+            char byte;
+            ssize_t rv = read(fd, &byte, 1);
+            if (rv < 0 && errno == EAGAIN) {
+                continue;
+            }
+            if (rv == 1) {
+                CHECK(write(fd, &byte, 1) == 1);
+            }
+            CHECK(epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL) == 0);
+            close(fd);
+            served++;
+        }
+    }
+
+    printf("served %ld connections\n", served);
+    close(epfd);
+    close(listener);
+}
+
+static int _conn_open(int epfd, const struct sockaddr_in* addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    CHECK(fd >= 0);
+    int rv = connect(fd, (const struct sockaddr*)addr, sizeof(*addr));
+    CHECK(rv == 0 || errno == EINPROGRESS);
+
+    /* send the request once the connection is established */
+    struct epoll_event ev = {.events = EPOLLOUT, .data.fd = fd};
+    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0);
+    return fd;
+}
+
+static void _conn_client(const char* server, int port, long connections, long parallel) {
+    struct sockaddr_in addr = _resolve(server, port);
+
+    int epfd = epoll_create1(0);
+    CHECK(epfd >= 0);
+
+    long opened = 0, finished = 0;
+    for (; opened < connections && opened < parallel; opened++) {
+        _conn_open(epfd, &addr);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (finished < connections) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        CHECK(n >= 0);
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            char byte = 'x';
+
+            if (events[i].events & EPOLLOUT) {
+                CHECK(write(fd, &byte, 1) == 1);
+                struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+                CHECK(epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0);
+                continue;
+            }
+
+            ssize_t rv = read(fd, &byte, 1);
+            if (rv < 0 && errno == EAGAIN) {
+                continue;
+            }
+            CHECK(rv == 1);
+            CHECK(epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL) == 0);
+            close(fd);
+            finished++;
+
+            if (opened < connections) {
+                _conn_open(epfd, &addr);
+                opened++;
+            }
+        }
+    }
+
+    printf("finished %ld connections\n", finished);
+    close(epfd);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && !strcmp(argv[1], "bulk-server")) {
+        _bulk_server(atoi(argv[2]));
+    } else if (argc == 5 && !strcmp(argv[1], "bulk-client")) {
+        _bulk_client(argv[2], atoi(argv[3]), strtoull(argv[4], NULL, 10));
+    } else if (argc == 4 && !strcmp(argv[1], "conn-server")) {
+        _conn_server(atoi(argv[2]), strtol(argv[3], NULL, 10));
+    } else if (argc == 6 && !strcmp(argv[1], "conn-client")) {
+        _conn_client(argv[2], atoi(argv[3]), strtol(argv[4], NULL, 10),
+                     strtol(argv[5], NULL, 10));
+    } else {
+        fprintf(stderr,
+                "usage: %s bulk-server PORT | bulk-client SERVER PORT BYTES | "
+                "conn-server PORT CONNECTIONS | conn-client SERVER PORT CONNECTIONS PARALLEL\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
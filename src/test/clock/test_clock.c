@@ -0,0 +1,106 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include <dlfcn.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test/test_common.h"
+#include "test/test_glib_helpers.h"
+
+// How far apart two readings of the clock may be.
+#define TOLERANCE_SECONDS 1
+
+// Seconds from the Unix epoch to the start of the simulation (January 1st 2000).
+#define SIMULATION_START_SECONDS 946684800L
+
+typedef int (*ClockGettimeFn)(clockid_t, struct timespec*);
+typedef int (*GettimeofdayFn)(struct timeval*, struct timezone*);
+typedef time_t (*TimeFn)(time_t*);
+
+// Looks up `name` in the vDSO, so that we call it directly rather than through
+// libc's wrappers, which Shadow interposes on by other means.
+static void* _vdso_function(const char* name) {
+    void* vdso = dlopen("linux-vdso.so.1", RTLD_LAZY | RTLD_NOLOAD);
+    if (!vdso) {
+        return NULL;
+    }
+    void* fn = dlsym(vdso, name);
+    dlclose(vdso);
+    return fn;
+}
+
+// Returns the real-time clock in seconds, as answered by the syscall itself.
+static time_t _syscall_seconds() {
+    struct timespec ts = {0};
+    assert_nonneg_errno(syscall(SYS_clock_gettime, CLOCK_REALTIME, &ts));
+    return ts.tv_sec;
+}
+
+static void _check_seconds(time_t seconds) {
+    g_assert_cmpint(labs(seconds - _syscall_seconds()), <=, TOLERANCE_SECONDS);
+    if (running_in_shadow()) {
+        // The simulation doesn't last a day.
+        g_assert_cmpint(seconds, >=, SIMULATION_START_SECONDS);
+        g_assert_cmpint(seconds, <, SIMULATION_START_SECONDS + 24 * 60 * 60);
+    }
+}
+
+static void _test_vdso_clock_gettime() {
+    ClockGettimeFn fn = _vdso_function("__vdso_clock_gettime");
+    if (!fn) {
+        g_test_skip("No __vdso_clock_gettime");
+        return;
+    }
+    struct timespec ts = {0};
+    g_assert_cmpint(fn(CLOCK_REALTIME, &ts), ==, 0);
+    _check_seconds(ts.tv_sec);
+
+    // The monotonic clock must not go backwards across calls.
+    struct timespec t0 = {0}, t1 = {0};
+    g_assert_cmpint(fn(CLOCK_MONOTONIC, &t0), ==, 0);
+    usleep(1000);
+    g_assert_cmpint(fn(CLOCK_MONOTONIC, &t1), ==, 0);
+    g_assert_true(t1.tv_sec > t0.tv_sec ||
+                  (t1.tv_sec == t0.tv_sec && t1.tv_nsec >= t0.tv_nsec + 1000000));
+}
+
+static void _test_vdso_gettimeofday() {
+    GettimeofdayFn fn = _vdso_function("__vdso_gettimeofday");
+    if (!fn) {
+        g_test_skip("No __vdso_gettimeofday");
+        return;
+    }
+    struct timeval tv = {0};
+    g_assert_cmpint(fn(&tv, NULL), ==, 0);
+    _check_seconds(tv.tv_sec);
+}
+
+static void _test_vdso_time() {
+    TimeFn fn = _vdso_function("__vdso_time");
+    if (!fn) {
+        g_test_skip("No __vdso_time");
+        return;
+    }
+    time_t t = 0;
+    time_t rv = fn(&t);
+    g_assert_cmpint(rv, ==, t);
+    _check_seconds(rv);
+}
+
+int main(int argc, char* argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/clock/vdso_clock_gettime", _test_vdso_clock_gettime);
+    g_test_add_func("/clock/vdso_gettimeofday", _test_vdso_gettimeofday);
+    g_test_add_func("/clock/vdso_time", _test_vdso_time);
+
+    g_test_run();
+    return 0;
+}
@@ -17,3 +17,11 @@ foreach(LOOPIDX RANGE 1 10)
         ${CMAKE_BINARY_DIR}/determinism2b-shadow-${METHOD}.data/hosts/peer${LOOPIDX}/peer${LOOPIDX}.test-phold.1000.stdout
     )
 endforeach(LOOPIDX)
+
+## the event digests should match as well
+foreach(DIGEST_FILE determinism-digest.csv determinism-host-digests.csv)
+    exec_diff_check(
+        ${CMAKE_BINARY_DIR}/determinism2a-shadow-${METHOD}.data/${DIGEST_FILE}
+        ${CMAKE_BINARY_DIR}/determinism2b-shadow-${METHOD}.data/${DIGEST_FILE}
+    )
+endforeach(DIGEST_FILE)
@@ -254,6 +254,219 @@ static void _futex_wait_bitset_test() {
     _wait_for_condition(&arg[4].child_finished);
 }
 
+// Returns once the thread `tid` of this process is (most likely) blocked in a
+// futex wait. Natively we check that the thread is sleeping; in Shadow the
+// thread runs until it blocks as soon as we give up the CPU.
+static void _wait_until_blocked(pid_t tid) {
+    if (running_in_shadow()) {
+        usleep(1);
+        return;
+    }
+
+    char path[64] = {0};
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    while (1) {
+        FILE* f = fopen(path, "r");
+        g_assert_nonnull(f);
+        char state = 0;
+        int rv = fscanf(f, "%*d (%*[^)]) %c", &state);
+        fclose(f);
+        g_assert_cmpint(rv, ==, 1);
+        if (state == 'S') {
+            return;
+        }
+        usleep(1);
+    }
+}
+
+typedef struct {
+    bool child_started;
+    bool child_finished;
+    pid_t tid;
+    int* futex;
+    uint32_t bitset;
+    // Where to record the order in which the children returned.
+    int* order;
+    int* num_finished;
+    int id;
+} FutexWaiterArg;
+
+// Waits on `futex` with `bitset` until the futex word becomes AVAILABLE.
+static void* _futex_waiter(void* void_arg) {
+    FutexWaiterArg* arg = void_arg;
+    arg->tid = syscall(SYS_gettid);
+    _set_condition(&arg->child_started);
+    while (__atomic_load_n(arg->futex, __ATOMIC_ACQUIRE) != AVAILABLE) {
+        long rv = syscall(SYS_futex, arg->futex, FUTEX_WAIT_BITSET, UNAVAILABLE, NULL, NULL,
+                          arg->bitset);
+        assert_true_errno(rv == 0 || errno == EAGAIN);
+    }
+    if (arg->order) {
+        int i = __atomic_fetch_add(arg->num_finished, 1, __ATOMIC_ACQ_REL);
+        arg->order[i] = arg->id;
+    }
+    _set_condition(&arg->child_finished);
+    return NULL;
+}
+
+static pthread_t _start_futex_waiter(FutexWaiterArg* arg) {
+    pthread_t child = {0};
+    assert_nonneg_errno(pthread_create(&child, NULL, _futex_waiter, arg));
+    _wait_for_condition(&arg->child_started);
+    _wait_until_blocked(arg->tid);
+    return child;
+}
+
+static void _futex_wait_bitset_mask_test() {
+    int futex = UNAVAILABLE;
+    FutexWaiterArg arg[2] = {
+        {.futex = &futex, .bitset = 0x0f0},
+        {.futex = &futex, .bitset = 0xf00},
+    };
+    pthread_t child[2];
+    for (int i = 0; i < 2; ++i) {
+        child[i] = _start_futex_waiter(&arg[i]);
+    }
+
+    __atomic_store_n(&futex, AVAILABLE, __ATOMIC_RELEASE);
+
+    // Disjoint with both masks.
+    g_assert_cmpint(
+        syscall(SYS_futex, &futex, FUTEX_WAKE_BITSET, INT_MAX, NULL, NULL, 0x00f), ==, 0);
+
+    // Overlaps only the first mask, in a single bit.
+    g_assert_cmpint(
+        syscall(SYS_futex, &futex, FUTEX_WAKE_BITSET, INT_MAX, NULL, NULL, 0x011), ==, 1);
+    assert_nonneg_errno(pthread_join(child[0], NULL));
+    g_assert_false(_get_condition(&arg[1].child_finished));
+
+    // Overlaps the second mask, and the first one whose waiter is gone.
+    g_assert_cmpint(
+        syscall(SYS_futex, &futex, FUTEX_WAKE_BITSET, INT_MAX, NULL, NULL, 0x810), ==, 1);
+    assert_nonneg_errno(pthread_join(child[1], NULL));
+
+    // A waiter needs at least one bit.
+    g_assert_cmpint(
+        syscall(SYS_futex, &futex, FUTEX_WAIT_BITSET, AVAILABLE, NULL, NULL, 0), ==, -1);
+    assert_errno_is(EINVAL);
+}
+
+static void _futex_wake_order_test() {
+    int futex = UNAVAILABLE;
+    int order[3] = {0};
+    int num_finished = 0;
+    FutexWaiterArg arg[3];
+    pthread_t child[3];
+
+    // Block the children one after the other.
+    for (int i = 0; i < 3; ++i) {
+        arg[i] = (FutexWaiterArg){.futex = &futex,
+                                  .bitset = FUTEX_BITSET_MATCH_ANY,
+                                  .order = order,
+                                  .num_finished = &num_finished,
+                                  .id = i};
+        child[i] = _start_futex_waiter(&arg[i]);
+    }
+
+    __atomic_store_n(&futex, AVAILABLE, __ATOMIC_RELEASE);
+
+    // Each wake-up should go to the thread that has waited the longest.
+    for (int i = 0; i < 3; ++i) {
+        g_assert_cmpint(syscall(SYS_futex, &futex, FUTEX_WAKE, 1, NULL, NULL, 0), ==, 1);
+        assert_nonneg_errno(pthread_join(child[i], NULL));
+        g_assert_cmpint(__atomic_load_n(&num_finished, __ATOMIC_ACQUIRE), ==, i + 1);
+        g_assert_cmpint(order[i], ==, i);
+    }
+}
+
+static void _futex_wake_op_test() {
+    int futex1 = UNAVAILABLE;
+    int futex2 = UNAVAILABLE;
+    FutexWaiterArg arg[2] = {
+        {.futex = &futex1, .bitset = FUTEX_BITSET_MATCH_ANY},
+        {.futex = &futex2, .bitset = FUTEX_BITSET_MATCH_ANY},
+    };
+    pthread_t child[2];
+    for (int i = 0; i < 2; ++i) {
+        child[i] = _start_futex_waiter(&arg[i]);
+    }
+
+    __atomic_store_n(&futex1, AVAILABLE, __ATOMIC_RELEASE);
+
+    // futex2 is UNAVAILABLE(0) before the add, so the comparison holds and
+    // the waiters on both words are woken.
+    long rv = syscall(SYS_futex, &futex1, FUTEX_WAKE_OP, 1, (void*)1, &futex2,
+                      FUTEX_OP(FUTEX_OP_ADD, 1, FUTEX_OP_CMP_EQ, 0));
+    g_assert_cmpint(rv, ==, 2);
+    g_assert_cmpint(__atomic_load_n(&futex2, __ATOMIC_ACQUIRE), ==, AVAILABLE);
+    assert_nonneg_errno(pthread_join(child[0], NULL));
+    assert_nonneg_errno(pthread_join(child[1], NULL));
+
+    // The operation is applied even when the comparison fails.
+    rv = syscall(SYS_futex, &futex1, FUTEX_WAKE_OP, 1, (void*)1, &futex2,
+                 FUTEX_OP(FUTEX_OP_ADD, 1, FUTEX_OP_CMP_EQ, 0));
+    g_assert_cmpint(rv, ==, 0);
+    g_assert_cmpint(futex2, ==, 2);
+
+    // Shifted operand: futex2 |= 1 << 4, compared against the old value 2.
+    rv = syscall(SYS_futex, &futex1, FUTEX_WAKE_OP, 1, (void*)1, &futex2,
+                 FUTEX_OP((FUTEX_OP_OR | FUTEX_OP_OPARG_SHIFT), 4, FUTEX_OP_CMP_GT, 1));
+    g_assert_cmpint(rv, ==, 0);
+    g_assert_cmpint(futex2, ==, 0x12);
+
+    // Negative operands are sign-extended.
+    rv = syscall(SYS_futex, &futex1, FUTEX_WAKE_OP, 1, (void*)1, &futex2,
+                 FUTEX_OP(FUTEX_OP_SET, -1 & 0xfff, FUTEX_OP_CMP_LT, 0));
+    g_assert_cmpint(rv, ==, 0);
+    g_assert_cmpint(futex2, ==, -1);
+}
+
+static void _futex_cmp_requeue_stale_test() {
+    int futex1 = AVAILABLE;
+    int futex2 = UNAVAILABLE;
+    long rv = syscall(SYS_futex, &futex1, FUTEX_CMP_REQUEUE, 1, (void*)INT_MAX, &futex2,
+                      UNAVAILABLE);
+    g_assert_cmpint(rv, ==, -1);
+    assert_errno_is(EAGAIN);
+
+    // Nobody is waiting when the value does match.
+    rv = syscall(
+        SYS_futex, &futex1, FUTEX_CMP_REQUEUE, 1, (void*)INT_MAX, &futex2, AVAILABLE);
+    g_assert_cmpint(rv, ==, 0);
+}
+
+static void _futex_requeue_test(bool compare) {
+    int futex1 = UNAVAILABLE;
+    int futex2 = UNAVAILABLE;
+    FutexWaiterArg arg[3];
+    pthread_t child[3];
+    for (int i = 0; i < 3; ++i) {
+        arg[i] = (FutexWaiterArg){.futex = &futex1, .bitset = FUTEX_BITSET_MATCH_ANY};
+        child[i] = _start_futex_waiter(&arg[i]);
+    }
+
+    __atomic_store_n(&futex1, AVAILABLE, __ATOMIC_RELEASE);
+
+    // Linux wakes one waiter and moves the other two to futex2. Shadow wakes all
+    // three instead, since its waiters stay on the futex they waited on. Either
+    // way every waiter is accounted for.
+    long rv = syscall(SYS_futex, &futex1, compare ? FUTEX_CMP_REQUEUE : FUTEX_REQUEUE, 1,
+                      (void*)INT_MAX, &futex2, AVAILABLE);
+    g_assert_cmpint(rv, ==, 3);
+
+    // Wakes the requeued waiters natively; a no-op in Shadow.
+    rv = syscall(SYS_futex, &futex2, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    g_assert_cmpint(rv, ==, running_in_shadow() ? 0 : 2);
+
+    for (int i = 0; i < 3; ++i) {
+        assert_nonneg_errno(pthread_join(child[i], NULL));
+    }
+}
+
+static void _futex_requeue_wakes_test() { _futex_requeue_test(false); }
+
+static void _futex_cmp_requeue_wakes_test() { _futex_requeue_test(true); }
+
 // Note: this test roughly follows the example at the end of `man 2 futex`
 
 #define PTR_TO_INT(p) ((int)(long)(p))
@@ -379,11 +592,13 @@ int main(int argc, char** argv) {
     g_test_add_func("/futex/wake_stress", _futex_stress_test);
     g_test_add_func("/futex/wait_timeout", _futex_wait_timeout_test);
     g_test_add_func("/futex/wait_bitset_timeout", _futex_wait_bitset_timeout_test);
-
-    if (!running_in_shadow()) {
-        // TODO: implement FUTEX_WAKE_BITSET in Shadow.
-        g_test_add_func("/futex/wait_bitset", _futex_wait_bitset_test);
-    }
+    g_test_add_func("/futex/wait_bitset", _futex_wait_bitset_test);
+    g_test_add_func("/futex/wait_bitset_mask", _futex_wait_bitset_mask_test);
+    g_test_add_func("/futex/wake_order", _futex_wake_order_test);
+    g_test_add_func("/futex/wake_op", _futex_wake_op_test);
+    g_test_add_func("/futex/cmp_requeue_stale", _futex_cmp_requeue_stale_test);
+    g_test_add_func("/futex/requeue_wakes", _futex_requeue_wakes_test);
+    g_test_add_func("/futex/cmp_requeue_wakes", _futex_cmp_requeue_wakes_test);
 
     g_test_run();
 }
@@ -0,0 +1,133 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+// Measures the round-trip latency of handing control back and forth between two
+// threads, the way Shadow and a plugin thread do for every syscall. It compares the
+// shim IPC channel (BinarySpinningSem over shadow_sem) at a few spin settings against
+// a bare FUTEX_WAIT/FUTEX_WAKE protocol on a single state word, which is the least
+// that any futex-based handoff can do.
+//
+// Usage: test-ipc-latency [round trips]
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/shim/ipc.h"
+
+typedef struct _Benchmark {
+    struct IPCData* ipc;
+    // For the bare futex protocol: 0 while the plugin side has control, 1 while the
+    // shadow side has control.
+    uint32_t turn;
+    long roundTrips;
+} Benchmark;
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void* _ipc_shadow_side(void* arg) {
+    Benchmark* b = arg;
+    ShimEvent ev = {0};
+    for (long i = 0; i < b->roundTrips; i++) {
+        shimevent_recvEventFromPlugin(b->ipc, &ev);
+        ev.event_id = SHD_SHIM_EVENT_SYSCALL_COMPLETE;
+        shimevent_sendEventToPlugin(b->ipc, &ev);
+    }
+    return NULL;
+}
+
+static void _ipc_plugin_side(Benchmark* b) {
+    ShimEvent ev = {.event_id = SHD_SHIM_EVENT_SYSCALL};
+    for (long i = 0; i < b->roundTrips; i++) {
+        shimevent_sendEventToShadow(b->ipc, &ev);
+        shimevent_recvEventFromShadow(b->ipc, &ev, true);
+    }
+}
+
+static void _futex_wait_for(uint32_t* word, uint32_t value) {
+    while (__atomic_load_n(word, __ATOMIC_ACQUIRE) != value) {
+        syscall(SYS_futex, word, FUTEX_WAIT, value ^ 1, NULL, NULL, 0);
+    }
+}
+
+static void _futex_give(uint32_t* word, uint32_t value) {
+    __atomic_store_n(word, value, __ATOMIC_RELEASE);
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static void* _futex_shadow_side(void* arg) {
+    Benchmark* b = arg;
+    for (long i = 0; i < b->roundTrips; i++) {
+        _futex_wait_for(&b->turn, 1);
+        _futex_give(&b->turn, 0);
+    }
+    return NULL;
+}
+
+static void _futex_plugin_side(Benchmark* b) {
+    for (long i = 0; i < b->roundTrips; i++) {
+        _futex_give(&b->turn, 1);
+        _futex_wait_for(&b->turn, 0);
+    }
+}
+
+static double _run(Benchmark* b, void* (*shadowSide)(void*), void (*pluginSide)(Benchmark*)) {
+    pthread_t thread;
+    int rv = pthread_create(&thread, NULL, shadowSide, b);
+    if (rv != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(rv));
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t start = _now_ns();
+    pluginSide(b);
+    uint64_t end = _now_ns();
+
+    pthread_join(thread, NULL);
+    return (double)(end - start) / (double)b->roundTrips;
+}
+
+int main(int argc, char* argv[]) {
+    long roundTrips = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+    if (roundTrips <= 0) {
+        fprintf(stderr, "invalid number of round trips\n");
+        return EXIT_FAILURE;
+    }
+
+    // The channel lives in shared memory in Shadow; map it the same way here.
+    struct IPCData* ipc =
+        mmap(NULL, ipcData_nbytes(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ipc == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    const ssize_t spinSettings[] = {0, 8096, -1};
+    for (size_t i = 0; i < sizeof(spinSettings) / sizeof(spinSettings[0]); i++) {
+        ipcData_init(ipc, spinSettings[i]);
+        Benchmark b = {.ipc = ipc, .roundTrips = roundTrips};
+        printf("shim ipc, spin_max=%zd: %.0f ns per round trip\n", spinSettings[i],
+               _run(&b, _ipc_shadow_side, _ipc_plugin_side));
+    }
+
+    Benchmark b = {.turn = 0, .roundTrips = roundTrips};
+    printf("bare futex word: %.0f ns per round trip\n",
+           _run(&b, _futex_shadow_side, _futex_plugin_side));
+
+    munmap(ipc, ipcData_nbytes());
+    return EXIT_SUCCESS;
+}
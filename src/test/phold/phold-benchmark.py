@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+
+'''
+Runs phold simulations over a sweep of host counts, message loads, parallelism,
+scheduler policies, and interpose methods, and records how fast Shadow ran each
+of them.
+
+Each run appends one JSON object per line to the output file, with the run's
+configuration, its wall time, the number of events the workers processed, the
+events processed per wall second, and the real-time factor (simulated seconds
+per wall second). Given the results of an earlier run with --baseline, the
+script reports any configuration that got slower by more than --tolerance, and
+exits with status 1 if there are any.
+
+This is a benchmark rather than a test, so it isn't run by ctest. From the build
+directory:
+$ make benchmark-phold
+
+or to run a single configuration directly:
+$ phold-benchmark.py --shadow src/main/shadow --phold src/test/phold/test-phold \\
+      --hosts 1000 --parallelism 8 --scheduler-policy steal --interpose-method preload
+'''
+
+import argparse
+import csv
+import itertools
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+CONFIG_TEMPLATE = '''general:
+  stop_time: {stop_time}
+network:
+  graph:
+    type: gml
+    inline: |
+      graph [
+        directed 0
+        node [
+          id 0
+          country_code "US"
+          bandwidth_down "81920 Kibit"
+          bandwidth_up "81920 Kibit"
+        ]
+        edge [
+          source 0
+          target 0
+          latency "50 ms"
+          packet_loss 0.0
+        ]
+      ]
+hosts:
+  peer:
+    quantity: {hosts}
+    processes:
+    - path: {phold}
+      args: loglevel=info basename=peer quantity={hosts} msgload={msgload} cpuload=1 size=1
+        weightsfilepath={weights} runtime={runtime}
+      start_time: 1
+'''
+
+# the phold processes start at 1 second, and stop a second before the simulation does
+START_TIME = 1
+
+
+def comma_list(convert):
+    return lambda value: [convert(v) for v in value.split(',')]
+
+
+def run_key(run):
+    return (run['hosts'], run['msgload'], run['parallelism'], run['scheduler_policy'],
+            run['interpose_method'])
+
+
+def count_events(round_stats_path):
+    '''Sums the per-worker event counts in a round-stats.csv file.'''
+    events = 0
+    with open(round_stats_path) as f:
+        for row in csv.DictReader(f):
+            events += sum(int(v) for k, v in row.items() if k.endswith('-events-count'))
+    return events
+
+
+def run_one(args, hosts, msgload, parallelism, policy, method):
+    name = 'phold-h{}-m{}-p{}-{}-{}'.format(hosts, msgload, parallelism, policy, method)
+    run_dir = os.path.join(args.work_dir, name)
+    os.makedirs(run_dir, exist_ok=True)
+
+    # phold needs one weight per host
+    weights_path = os.path.join(run_dir, 'weights.txt')
+    with open(weights_path, 'w') as f:
+        f.write('1.0\n' * hosts)
+
+    config_path = os.path.join(run_dir, 'shadow.yaml')
+    with open(config_path, 'w') as f:
+        f.write(CONFIG_TEMPLATE.format(stop_time=args.stop_time, hosts=hosts, msgload=msgload,
+                                       phold=os.path.abspath(args.phold),
+                                       weights=os.path.abspath(weights_path),
+                                       runtime=args.stop_time - START_TIME - 1))
+
+    # shadow won't overwrite the data of an earlier run
+    data_dir = os.path.join(run_dir, 'shadow.data')
+    shutil.rmtree(data_dir, ignore_errors=True)
+    command = [os.path.abspath(args.shadow),
+               '--data-directory', data_dir,
+               '--parallelism', str(parallelism),
+               '--scheduler-policy', policy,
+               '--interpose-method', method,
+               '--use-round-stats', 'true',
+               '--log-level', 'warning',
+               config_path]
+
+    print('running {}'.format(name), file=sys.stderr)
+
+    start = time.monotonic()
+    with open(os.path.join(run_dir, 'shadow.log'), 'w') as log:
+        result = subprocess.run(command, cwd=run_dir, stdout=log, stderr=subprocess.STDOUT)
+    wall_seconds = time.monotonic() - start
+
+    run = {
+        'hosts': hosts,
+        'msgload': msgload,
+        'parallelism': parallelism,
+        'scheduler_policy': policy,
+        'interpose_method': method,
+        'stop_time': args.stop_time,
+        'return_code': result.returncode,
+        'wall_seconds': wall_seconds,
+        'events': None,
+        'events_per_second': None,
+        'real_time_factor': args.stop_time / wall_seconds,
+    }
+
+    round_stats_path = os.path.join(data_dir, 'round-stats.csv')
+    if result.returncode == 0 and os.path.exists(round_stats_path):
+        run['events'] = count_events(round_stats_path)
+        run['events_per_second'] = run['events'] / wall_seconds
+
+    return run
+
+
+def check_regressions(runs, baseline_path, tolerance):
+    '''Returns a description of each run that was slower than its baseline.'''
+    baseline = {}
+    with open(baseline_path) as f:
+        for line in f:
+            if line.strip():
+                run = json.loads(line)
+                baseline[run_key(run)] = run
+
+    regressions = []
+    for run in runs:
+        old = baseline.get(run_key(run))
+        if old is None or not old['events_per_second']:
+            continue
+        if not run['events_per_second']:
+            regressions.append('{}: failed with return code {}'.format(
+                run_key(run), run['return_code']))
+        elif run['events_per_second'] < old['events_per_second'] * (1 - tolerance):
+            regressions.append('{}: {:.0f} events/s, down from {:.0f}'.format(
+                run_key(run), run['events_per_second'], old['events_per_second']))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--shadow', required=True, help='path to the shadow binary')
+    parser.add_argument('--phold', required=True, help='path to the test-phold binary')
+    parser.add_argument('--output', default='phold-benchmark.json',
+                        help='file to append the results to, one JSON object per line')
+    parser.add_argument('--work-dir', default='phold-benchmark.data',
+                        help='directory for the configs and data of each run')
+    parser.add_argument('--hosts', type=comma_list(int), default=[100, 1000, 10000],
+                        help='comma-separated host counts')
+    parser.add_argument('--msgload', type=comma_list(int), default=[1, 10],
+                        help='comma-separated numbers of messages each host keeps in flight')
+    parser.add_argument('--parallelism', type=comma_list(int), default=[1, 2, 4, 8, 16, 32, 64],
+                        help='comma-separated worker thread counts')
+    parser.add_argument('--scheduler-policy', type=comma_list(str), default=['host', 'steal'],
+                        help='comma-separated scheduler policies')
+    parser.add_argument('--interpose-method', type=comma_list(str),
+                        default=['preload', 'ptrace', 'hybrid'],
+                        help='comma-separated interpose methods')
+    parser.add_argument('--stop-time', type=int, default=10,
+                        help='simulated seconds to run each simulation for')
+    parser.add_argument('--baseline', help='results of an earlier run to compare against')
+    parser.add_argument('--tolerance', type=float, default=0.1,
+                        help='fraction that events per second can drop before it is reported')
+    args = parser.parse_args()
+
+    if args.stop_time < START_TIME + 2:
+        parser.error('--stop-time must be at least {}'.format(START_TIME + 2))
+
+    os.makedirs(args.work_dir, exist_ok=True)
+
+    runs = []
+    for hosts, msgload, parallelism, policy, method in itertools.product(
+            args.hosts, args.msgload, args.parallelism, args.scheduler_policy,
+            args.interpose_method):
+        run = run_one(args, hosts, msgload, parallelism, policy, method)
+        runs.append(run)
+        with open(args.output, 'a') as f:
+            f.write(json.dumps(run, sort_keys=True) + '\n')
+
+    if args.baseline:
+        regressions = check_regressions(runs, args.baseline, args.tolerance)
+        for regression in regressions:
+            print('regression: {}'.format(regression), file=sys.stderr)
+        if regressions:
+            return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
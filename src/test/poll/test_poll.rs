@@ -12,6 +12,12 @@ enum PollFn {
     PPoll,
 }
 
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+enum SelectFn {
+    Select,
+    PSelect,
+}
+
 const TEST_STR: &[u8; 4] = b"test";
 
 fn fd_write(fd: i32) -> Result<(), String> {
@@ -146,6 +152,95 @@ fn test_regular_file() -> Result<(), String> {
     })
 }
 
+/// Calls select or pselect with only a read set, which it returns the result of.
+fn call_select(
+    select_fn: SelectFn,
+    nfds: libc::c_int,
+    readfds: &mut libc::fd_set,
+    timeout_ms: i64,
+) -> libc::c_int {
+    match select_fn {
+        SelectFn::Select => {
+            let mut timeout = libc::timeval {
+                tv_sec: 0,
+                tv_usec: timeout_ms * 1000, // millis to micros
+            };
+            unsafe {
+                libc::select(
+                    nfds,
+                    readfds,
+                    std::ptr::null_mut(),
+                    std::ptr::null_mut(),
+                    &mut timeout,
+                )
+            }
+        }
+        SelectFn::PSelect => {
+            let timeout = libc::timespec {
+                tv_sec: 0,
+                tv_nsec: timeout_ms * 1000000, // millis to nanos
+            };
+            unsafe {
+                libc::pselect(
+                    nfds,
+                    readfds,
+                    std::ptr::null_mut(),
+                    std::ptr::null_mut(),
+                    &timeout,
+                    std::ptr::null(),
+                )
+            }
+        }
+    }
+}
+
+fn test_select_pipe(select_fn: SelectFn) -> Result<(), String> {
+    /* Create a set of pipefds */
+    let (pfd_read, pfd_write) = nix::unistd::pipe().map_err(|e| e.to_string())?;
+
+    test_utils::run_and_close_fds(&[pfd_read, pfd_write], || {
+        let mut readfds = unsafe { std::mem::zeroed::<libc::fd_set>() };
+
+        /* First make sure there's nothing there */
+        unsafe { libc::FD_SET(pfd_read, &mut readfds) };
+        let ready = call_select(select_fn, pfd_read + 1, &mut readfds, 100);
+        test_utils::result_assert_eq(ready, 0, "pipe was marked readable")?;
+        test_utils::result_assert(
+            !unsafe { libc::FD_ISSET(pfd_read, &readfds) },
+            "pipe was left in the read set",
+        )?;
+
+        /* Now put information in pipe to be read */
+        fd_write(pfd_write)?;
+
+        /* Check again, should be something to read */
+        unsafe { libc::FD_SET(pfd_read, &mut readfds) };
+        let ready = call_select(select_fn, pfd_read + 1, &mut readfds, 100);
+        test_utils::result_assert_eq(ready, 1, "pipe was not marked readable")?;
+        test_utils::result_assert(
+            unsafe { libc::FD_ISSET(pfd_read, &readfds) },
+            "pipe was not left in the read set",
+        )?;
+
+        /* Make sure we got what expected back */
+        fd_read_cmp(pfd_read)
+    })
+}
+
+fn test_select_bad_fd(select_fn: SelectFn) -> Result<(), String> {
+    // A fd that was just closed isn't open
+    let fd = get_pollable_fd()?;
+    test_utils::run_and_close_fds(&[fd], || Ok(()))?;
+
+    let mut readfds = unsafe { std::mem::zeroed::<libc::fd_set>() };
+    unsafe { libc::FD_SET(fd, &mut readfds) };
+    test_utils::check_system_call!(
+        || { call_select(select_fn, fd + 1, &mut readfds, 0) },
+        &[libc::EBADF]
+    )?;
+    Ok(())
+}
+
 fn get_pollable_fd() -> Result<libc::c_int, String> {
     // Get an fd we can poll
     let fd = test_utils::check_system_call!(
@@ -283,6 +378,21 @@ fn main() -> Result<(), String> {
         ),
     ];
 
+    for &select_fn in [SelectFn::Select, SelectFn::PSelect].iter() {
+        tests.extend(vec![
+            test_utils::ShadowTest::new(
+                &format!("test_select_pipe <fn={:?}>", select_fn),
+                move || test_select_pipe(select_fn),
+                set![TestEnv::Libc, TestEnv::Shadow],
+            ),
+            test_utils::ShadowTest::new(
+                &format!("test_select_bad_fd <fn={:?}>", select_fn),
+                move || test_select_bad_fd(select_fn),
+                set![TestEnv::Libc, TestEnv::Shadow],
+            ),
+        ]);
+    }
+
     // For each combination of args, test both poll and ppoll
     for &poll_fn in [PollFn::Poll, PollFn::PPoll].iter() {
         for &pfd_null in [true, false].iter() {
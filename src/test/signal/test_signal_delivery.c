@@ -0,0 +1,276 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+#include <errno.h>
+#include <glib.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test/test_common.h"
+#include "test/test_glib_helpers.h"
+
+// The target publishes its pid here once it's ready for signals from the sender.
+#define PID_FILE "signal-target.pid"
+
+// How far a timer may be off, in milliseconds.
+#define TOLERANCE_MS 50
+
+static volatile sig_atomic_t _usr1_count = 0;
+static volatile sig_atomic_t _usr2_count = 0;
+static volatile sig_atomic_t _alrm_count = 0;
+
+static void _handler(int signum) {
+    switch (signum) {
+        case SIGUSR1: _usr1_count++; break;
+        case SIGUSR2: _usr2_count++; break;
+        case SIGALRM: _alrm_count++; break;
+    }
+}
+
+static void _install_handler(int signum) {
+    // Without SA_RESTART, so that interrupted syscalls fail with EINTR.
+    struct sigaction action = {.sa_handler = _handler};
+    sigemptyset(&action.sa_mask);
+    assert_nonneg_errno(sigaction(signum, &action, NULL));
+}
+
+static long _now_ms() {
+    struct timespec ts = {0};
+    assert_nonneg_errno(clock_gettime(CLOCK_MONOTONIC, &ts));
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static long _timeval_ms(const struct timeval* tv) { return tv->tv_sec * 1000 + tv->tv_usec / 1000; }
+
+static struct itimerval _itimerval_ms(long value_ms, long interval_ms) {
+    return (struct itimerval){
+        .it_value = {.tv_sec = value_ms / 1000, .tv_usec = (value_ms % 1000) * 1000},
+        .it_interval = {.tv_sec = interval_ms / 1000, .tv_usec = (interval_ms % 1000) * 1000},
+    };
+}
+
+// Sleeps for `ms` milliseconds, and returns nanosleep's result.
+static int _sleep_ms(long ms) {
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+    return nanosleep(&ts, NULL);
+}
+
+// Sleeps for up to `ms` milliseconds, expecting a signal to interrupt the sleep
+// after about `expected_ms`.
+static void _sleep_until_interrupted(long ms, long expected_ms) {
+    long start = _now_ms();
+    g_assert_cmpint(_sleep_ms(ms), ==, -1);
+    assert_errno_is(EINTR);
+    g_assert_cmpint(labs(_now_ms() - start - expected_ms), <=, TOLERANCE_MS);
+}
+
+static void _assert_timer_ms(const struct itimerval* tv, long value_ms, long interval_ms) {
+    g_assert_cmpint(labs(_timeval_ms(&tv->it_value) - value_ms), <=, TOLERANCE_MS);
+    g_assert_cmpint(_timeval_ms(&tv->it_interval), ==, interval_ms);
+}
+
+static void _test_alarm_remaining() {
+    g_assert_cmpint(alarm(5), ==, 0);
+    // Re-arming returns the seconds that were left, rounded.
+    g_assert_cmpint(alarm(3), ==, 5);
+    // Disarming too.
+    g_assert_cmpint(alarm(0), ==, 3);
+    g_assert_cmpint(alarm(0), ==, 0);
+}
+
+static void _test_alarm_fires() {
+    int count = _alrm_count;
+    g_assert_cmpint(alarm(1), ==, 0);
+    _sleep_until_interrupted(5000, 1000);
+    g_assert_cmpint(_alrm_count, ==, count + 1);
+}
+
+static void _test_setitimer_remaining_and_disarm() {
+    int count = _alrm_count;
+    struct itimerval value = _itimerval_ms(2000, 0);
+    struct itimerval old = _itimerval_ms(1, 1);
+    assert_nonneg_errno(setitimer(ITIMER_REAL, &value, &old));
+    _assert_timer_ms(&old, 0, 0);
+
+    g_assert_cmpint(_sleep_ms(500), ==, 0);
+    struct itimerval curr = {0};
+    assert_nonneg_errno(getitimer(ITIMER_REAL, &curr));
+    _assert_timer_ms(&curr, 1500, 0);
+
+    // Disarm it, and check that it never fires.
+    value = _itimerval_ms(0, 0);
+    assert_nonneg_errno(setitimer(ITIMER_REAL, &value, &old));
+    _assert_timer_ms(&old, 1500, 0);
+    g_assert_cmpint(_sleep_ms(2000), ==, 0);
+    g_assert_cmpint(_alrm_count, ==, count);
+
+    assert_nonneg_errno(getitimer(ITIMER_REAL, &curr));
+    _assert_timer_ms(&curr, 0, 0);
+}
+
+static void _test_setitimer_interval() {
+    int count = _alrm_count;
+    struct itimerval value = _itimerval_ms(100, 100);
+    assert_nonneg_errno(setitimer(ITIMER_REAL, &value, NULL));
+
+    // Each expiration re-arms the timer with the interval.
+    for (int i = 1; i <= 3; i++) {
+        _sleep_until_interrupted(1000, 100);
+        g_assert_cmpint(_alrm_count, ==, count + i);
+    }
+
+    struct itimerval old = {0};
+    value = _itimerval_ms(0, 0);
+    assert_nonneg_errno(setitimer(ITIMER_REAL, &value, &old));
+    g_assert_cmpint(_timeval_ms(&old.it_interval), ==, 100);
+    g_assert_cmpint(_sleep_ms(300), ==, 0);
+    g_assert_cmpint(_alrm_count, ==, count + 3);
+}
+
+static void _test_setitimer_rearm() {
+    int count = _alrm_count;
+    struct itimerval value = _itimerval_ms(1000, 0);
+    assert_nonneg_errno(setitimer(ITIMER_REAL, &value, NULL));
+
+    // Re-arming replaces the earlier expiration rather than adding one.
+    struct itimerval old = {0};
+    value = _itimerval_ms(200, 0);
+    assert_nonneg_errno(setitimer(ITIMER_REAL, &value, &old));
+    _assert_timer_ms(&old, 1000, 0);
+
+    _sleep_until_interrupted(2000, 200);
+    g_assert_cmpint(_sleep_ms(1500), ==, 0);
+    g_assert_cmpint(_alrm_count, ==, count + 1);
+}
+
+static void _publish_pid() {
+    FILE* f = fopen(PID_FILE ".tmp", "w");
+    assert_nonnull_errno(f);
+    fprintf(f, "%d\n", (int)getpid());
+    assert_true_errno(fclose(f) == 0);
+    // Renaming makes the whole file appear at once.
+    assert_nonneg_errno(rename(PID_FILE ".tmp", PID_FILE));
+}
+
+static pid_t _read_target_pid() {
+    while (1) {
+        FILE* f = fopen(PID_FILE, "r");
+        if (f) {
+            int pid = 0;
+            int rv = fscanf(f, "%d", &pid);
+            fclose(f);
+            g_assert_cmpint(rv, ==, 1);
+            return pid;
+        }
+        g_assert_cmpint(errno, ==, ENOENT);
+        usleep(10000);
+    }
+}
+
+static int _run_target() {
+    _install_handler(SIGUSR1);
+    _install_handler(SIGUSR2);
+    _install_handler(SIGALRM);
+
+    // Timers first, while the sender is still waiting for our pid.
+    _test_alarm_remaining();
+    _test_alarm_fires();
+    _test_setitimer_remaining_and_disarm();
+    _test_setitimer_interval();
+    _test_setitimer_rearm();
+
+    _publish_pid();
+
+    // The sender interrupts a sleep with SIGUSR1 after 1 second...
+    g_assert_cmpint(_sleep_ms(10000), ==, -1);
+    assert_errno_is(EINTR);
+    g_assert_cmpint(_usr1_count, ==, 1);
+
+    // ...then a blocked read with SIGUSR2 after another second.
+    int fds[2];
+    assert_nonneg_errno(pipe(fds));
+    char c;
+    g_assert_cmpint(read(fds[0], &c, 1), ==, -1);
+    assert_errno_is(EINTR);
+    g_assert_cmpint(_usr2_count, ==, 1);
+    g_assert_cmpint(_usr1_count, ==, 1);
+    close(fds[0]);
+    close(fds[1]);
+
+    // Stopping and continuing us must not interrupt this sleep.
+    g_assert_cmpint(_sleep_ms(3000), ==, 0);
+    g_assert_cmpint(_usr1_count, ==, 1);
+    g_assert_cmpint(_usr2_count, ==, 1);
+
+    return EXIT_SUCCESS;
+}
+
+static int _run_sender() {
+    pid_t target = _read_target_pid();
+    assert_nonneg_errno(kill(target, 0));
+
+    g_assert_cmpint(_sleep_ms(1000), ==, 0);
+    assert_nonneg_errno(kill(target, SIGUSR1));
+
+    g_assert_cmpint(_sleep_ms(1000), ==, 0);
+    assert_nonneg_errno(kill(target, SIGUSR2));
+
+    // SIGSTOP and SIGCONT aren't queued for the target's shim. Shadow refuses
+    // to send them natively, since they'd disrupt its control of the target.
+    g_assert_cmpint(_sleep_ms(1000), ==, 0);
+    for (int i = 0; i < 2; i++) {
+        int sig = (i == 0) ? SIGSTOP : SIGCONT;
+        if (running_in_shadow()) {
+            g_assert_cmpint(kill(target, sig), ==, -1);
+            assert_errno_is(ENOSYS);
+        } else {
+            assert_nonneg_errno(kill(target, sig));
+        }
+    }
+
+    // SIGKILL is never queued either, and must take effect at once. Shadow
+    // doesn't emulate fork, and can't yet notice a process that's killed while
+    // it's blocked, so this only runs natively.
+    if (!running_in_shadow()) {
+        pid_t child = fork();
+        assert_nonneg_errno(child);
+        if (child == 0) {
+            while (1) {
+                pause();
+            }
+        }
+        assert_nonneg_errno(kill(child, SIGKILL));
+        int status = 0;
+        g_assert_cmpint(waitpid(child, &status, 0), ==, child);
+        g_assert_true(WIFSIGNALED(status));
+        g_assert_cmpint(WTERMSIG(status), ==, SIGKILL);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s target|sender\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!strcmp(argv[1], "target")) {
+        return _run_target();
+    } else if (!strcmp(argv[1], "sender")) {
+        return _run_sender();
+    }
+
+    fprintf(stderr, "unknown role '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+}
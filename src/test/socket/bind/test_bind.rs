@@ -111,6 +111,11 @@ fn get_tests() -> Vec<test_utils::ShadowTest<(), String>> {
                     move || test_double_bind_address(sock_type, flag),
                     set![TestEnv::Libc, TestEnv::Shadow],
                 ),
+                test_utils::ShadowTest::new(
+                    &append_args("test_double_bind_reuseport"),
+                    move || test_double_bind_reuseport(sock_type, flag),
+                    set![TestEnv::Libc, TestEnv::Shadow],
+                ),
                 test_utils::ShadowTest::new(
                     &append_args("test_double_bind_loopback_and_any"),
                     move || {
@@ -396,6 +401,52 @@ fn test_double_bind_address(sock_type: libc::c_int, flag: libc::c_int) -> Result
     })
 }
 
+// test binding two sockets that set SO_REUSEPORT to the same address, and then a third that doesn't
+fn test_double_bind_reuseport(sock_type: libc::c_int, flag: libc::c_int) -> Result<(), String> {
+    let fd1 = unsafe { libc::socket(libc::AF_INET, sock_type | flag, 0) };
+    assert!(fd1 >= 0);
+    let fd2 = unsafe { libc::socket(libc::AF_INET, sock_type | flag, 0) };
+    assert!(fd2 >= 0);
+    let fd3 = unsafe { libc::socket(libc::AF_INET, sock_type | flag, 0) };
+    assert!(fd3 >= 0);
+
+    let addr = libc::sockaddr_in {
+        sin_family: libc::AF_INET as u16,
+        sin_port: 11111u16.to_be(),
+        sin_addr: libc::in_addr {
+            s_addr: libc::INADDR_LOOPBACK.to_be(),
+        },
+        sin_zero: [0; 8],
+    };
+
+    let enable: libc::c_int = 1;
+    for &fd in [fd1, fd2].iter() {
+        let rv = unsafe {
+            libc::setsockopt(
+                fd,
+                libc::SOL_SOCKET,
+                libc::SO_REUSEPORT,
+                &enable as *const libc::c_int as *const libc::c_void,
+                std::mem::size_of_val(&enable) as u32,
+            )
+        };
+        assert_eq!(rv, 0);
+    }
+
+    let args = |fd| BindArguments {
+        fd,
+        addr: Some(LibcSockAddr::In(addr)),
+        addr_len: std::mem::size_of_val(&addr) as u32,
+    };
+
+    test_utils::run_and_close_fds(&[fd1, fd2, fd3], || {
+        check_bind_call(&args(fd1), None)?;
+        check_bind_call(&args(fd2), None)?;
+        check_bind_call(&args(fd3), Some(libc::EADDRINUSE))?;
+        Ok(())
+    })
+}
+
 // test binding two sockets to the same address, but using both 'loopback' and 'any' interfaces
 fn test_double_bind_loopback_and_any(
     reverse: bool,
@@ -66,6 +66,11 @@ fn get_tests() -> Vec<test_utils::ShadowTest<(), String>> {
             test_invalid_sock_type,
             set![TestEnv::Libc, TestEnv::Shadow],
         ),
+        test_utils::ShadowTest::new(
+            "test_full_backlog",
+            test_full_backlog,
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ),
     ];
 
     // optionally bind to an address before listening
@@ -108,7 +113,7 @@ fn get_tests() -> Vec<test_utils::ShadowTest<(), String>> {
                     test_utils::ShadowTest::new(
                         &append_args("test_listen_twice"),
                         move || test_listen_twice(sock_type, flag, bind),
-                        set![TestEnv::Libc],
+                        set![TestEnv::Libc, TestEnv::Shadow],
                     ),
                     test_utils::ShadowTest::new(
                         &append_args("test_after_close"),
@@ -297,6 +302,144 @@ fn test_after_close(
     check_listen_call(&args, Some(libc::EBADF))
 }
 
+/// Test that a SYN to a listening socket with a full accept queue is dropped, and that the client
+/// retransmits it once the server accepts a connection.
+fn test_full_backlog() -> Result<(), String> {
+    let server = unsafe { libc::socket(libc::AF_INET, libc::SOCK_STREAM, 0) };
+    assert!(server >= 0);
+
+    bind_fd(
+        server,
+        BindAddress {
+            address: libc::INADDR_LOOPBACK.to_be(),
+            port: 0u16.to_be(),
+        },
+    );
+
+    let mut addr: libc::sockaddr_in = unsafe { std::mem::zeroed() };
+    let mut addr_len = std::mem::size_of_val(&addr) as libc::socklen_t;
+    let rv = unsafe {
+        libc::getsockname(
+            server,
+            &mut addr as *mut libc::sockaddr_in as *mut libc::sockaddr,
+            &mut addr_len,
+        )
+    };
+    assert_eq!(rv, 0);
+
+    // Like Linux, allow one more waiting connection than the backlog. Listening a second time
+    // lowers the backlog.
+    check_listen_call(
+        &ListenArguments {
+            fd: server,
+            backlog: 10,
+        },
+        None,
+    )?;
+    check_listen_call(
+        &ListenArguments {
+            fd: server,
+            backlog: 1,
+        },
+        None,
+    )?;
+
+    let clients: Vec<libc::c_int> = (0..3)
+        .map(|_| unsafe { libc::socket(libc::AF_INET, libc::SOCK_STREAM | libc::SOCK_NONBLOCK, 0) })
+        .collect();
+    assert!(clients.iter().all(|&fd| fd >= 0));
+
+    let mut fds = clients.clone();
+    fds.push(server);
+
+    test_utils::run_and_close_fds(&fds, || {
+        for &client in &clients {
+            let rv = unsafe {
+                libc::connect(
+                    client,
+                    &addr as *const libc::sockaddr_in as *const libc::sockaddr,
+                    addr_len,
+                )
+            };
+            assert_eq!(rv, -1);
+            assert_eq!(test_utils::get_errno(), libc::EINPROGRESS);
+        }
+
+        // The first two connections are queued, and the third SYN is dropped.
+        check_connected(clients[0], 100)?;
+        check_connected(clients[1], 100)?;
+        if wait_writable(clients[2], 100) {
+            return Err("The third connection was established with a full backlog".into());
+        }
+
+        // Once there's room again, the retransmitted SYN gets through.
+        let mut accepted = vec![accept_fd(server)?];
+        check_connected(clients[2], 5000)?;
+        accepted.push(accept_fd(server)?);
+        accepted.push(accept_fd(server)?);
+
+        for fd in accepted {
+            assert_eq!(unsafe { libc::close(fd) }, 0);
+        }
+        Ok(())
+    })
+}
+
+/// Returns whether the fd becomes writable within `timeout_ms`.
+fn wait_writable(fd: libc::c_int, timeout_ms: libc::c_int) -> bool {
+    let mut pfd = libc::pollfd {
+        fd: fd,
+        events: libc::POLLOUT,
+        revents: 0,
+    };
+    let rv = unsafe { libc::poll(&mut pfd, 1, timeout_ms) };
+    assert!(rv >= 0);
+    rv == 1 && pfd.revents & libc::POLLOUT != 0
+}
+
+/// Checks that the non-blocking connect on the fd succeeds within `timeout_ms`.
+fn check_connected(fd: libc::c_int, timeout_ms: libc::c_int) -> Result<(), String> {
+    if !wait_writable(fd, timeout_ms) {
+        return Err(format!(
+            "fd {} did not connect within {} ms",
+            fd, timeout_ms
+        ));
+    }
+
+    let mut error: libc::c_int = 0;
+    let mut error_len = std::mem::size_of_val(&error) as libc::socklen_t;
+    let rv = unsafe {
+        libc::getsockopt(
+            fd,
+            libc::SOL_SOCKET,
+            libc::SO_ERROR,
+            &mut error as *mut libc::c_int as *mut libc::c_void,
+            &mut error_len,
+        )
+    };
+    assert_eq!(rv, 0);
+    if error != 0 {
+        return Err(format!(
+            "fd {} failed to connect: {}",
+            fd,
+            test_utils::get_errno_message(error)
+        ));
+    }
+    Ok(())
+}
+
+/// Accepts a waiting connection on the listening fd.
+fn accept_fd(fd: libc::c_int) -> Result<libc::c_int, String> {
+    let rv = unsafe { libc::accept(fd, std::ptr::null_mut(), std::ptr::null_mut()) };
+    if rv < 0 {
+        return Err(format!(
+            "accept failed: {}",
+            test_utils::get_errno_message(test_utils::get_errno())
+        ));
+    }
+    Ok(rv)
+}
+
 /// Bind the fd to the address.
 fn bind_fd(fd: libc::c_int, bind: BindAddress) {
     let addr = libc::sockaddr_in {
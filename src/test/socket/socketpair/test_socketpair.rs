@@ -62,7 +62,7 @@ fn get_tests() -> Vec<test_utils::ShadowTest<Option<[libc::c_int; 2]>, String>>
 
     // tests to repeat for different socket options
     for &domain in [libc::AF_UNIX, libc::AF_LOCAL, libc::AF_INET].iter() {
-        for &sock_type in [libc::SOCK_STREAM, libc::SOCK_DGRAM].iter() {
+        for &sock_type in [libc::SOCK_STREAM, libc::SOCK_DGRAM, libc::SOCK_SEQPACKET].iter() {
             for &flag in [0, libc::SOCK_NONBLOCK, libc::SOCK_CLOEXEC].iter() {
                 for &protocol in [0, libc::IPPROTO_TCP, libc::IPPROTO_UDP].iter() {
                     // add details to the test names to avoid duplicates
@@ -92,9 +92,58 @@ fn get_tests() -> Vec<test_utils::ShadowTest<Option<[libc::c_int; 2]>, String>>
         }
     }
 
+    for &sock_type in [libc::SOCK_STREAM, libc::SOCK_DGRAM, libc::SOCK_SEQPACKET].iter() {
+        tests.push(test_utils::ShadowTest::new(
+            &format!("test_message_boundaries <type={}>", sock_type),
+            move || test_message_boundaries(sock_type),
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ));
+    }
+
     tests
 }
 
+/// Test that datagram and seqpacket sockets keep message boundaries, and that stream sockets
+/// don't.
+fn test_message_boundaries(sock_type: libc::c_int) -> Result<Option<[libc::c_int; 2]>, String> {
+    let mut fds = [-1; 2];
+    let rv = unsafe { libc::socketpair(libc::AF_UNIX, sock_type, 0, fds.as_mut_ptr()) };
+    test_utils::result_assert_eq(rv, 0, "socketpair() failed")?;
+
+    let write =
+        |buf: &[u8]| unsafe { libc::write(fds[0], buf.as_ptr() as *const libc::c_void, buf.len()) };
+    let read = |buf: &mut [u8]| unsafe {
+        libc::read(fds[1], buf.as_mut_ptr() as *mut libc::c_void, buf.len())
+    };
+
+    test_utils::result_assert_eq(write(b"hello"), 5, "Unexpected write size")?;
+    test_utils::result_assert_eq(write(b"world!"), 6, "Unexpected write size")?;
+
+    let mut buf = [0u8; 32];
+    if sock_type == libc::SOCK_STREAM {
+        test_utils::result_assert_eq(read(&mut buf), 11, "Unexpected read size")?;
+        test_utils::result_assert_eq(&buf[..11], &b"helloworld!"[..], "Unexpected data")?;
+    } else {
+        test_utils::result_assert_eq(read(&mut buf), 5, "Unexpected read size")?;
+        test_utils::result_assert_eq(&buf[..5], &b"hello"[..], "Unexpected data")?;
+
+        // the rest of a message that doesn't fit is discarded
+        test_utils::result_assert_eq(read(&mut buf[..4]), 4, "Unexpected read size")?;
+        test_utils::result_assert_eq(&buf[..4], &b"worl"[..], "Unexpected data")?;
+
+        test_utils::result_assert_eq(write(b"again"), 5, "Unexpected write size")?;
+        test_utils::result_assert_eq(read(&mut buf), 5, "Unexpected read size")?;
+        test_utils::result_assert_eq(&buf[..5], &b"again"[..], "Unexpected data")?;
+    }
+
+    for &fd in fds.iter() {
+        let rv = unsafe { libc::close(fd) };
+        test_utils::result_assert_eq(rv, 0, "close() failed")?;
+    }
+
+    Ok(None)
+}
+
 /// Test socketpair with a null fd array.
 fn test_null_fds() -> Result<Option<[libc::c_int; 2]>, String> {
     // socketpair() may mutate fds
@@ -133,6 +182,11 @@ fn test_arguments(
     // linux only supports socketpair for the following domains
     if ![libc::AF_UNIX, libc::AF_LOCAL, libc::AF_TIPC].contains(&domain) {
         expected_errnos.push(libc::EOPNOTSUPP);
+
+        // linux checks that the domain supports seqpacket sockets first
+        if sock_type == libc::SOCK_SEQPACKET {
+            expected_errnos.push(libc::ESOCKTNOSUPPORT);
+        }
     }
 
     // does not support protocols other than the default
@@ -0,0 +1,394 @@
+/*
+ * The Shadow Simulator
+ * See LICENSE for licensing information
+ */
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+use test_utils::set;
+use test_utils::TestEnvironment as TestEnv;
+
+fn main() -> Result<(), String> {
+    // should we restrict the tests we run?
+    let filter_shadow_passing = std::env::args().any(|x| x == "--shadow-passing");
+    let filter_libc_passing = std::env::args().any(|x| x == "--libc-passing");
+    // should we summarize the results rather than exit on a failed test
+    let summarize = std::env::args().any(|x| x == "--summarize");
+
+    let mut tests = get_tests();
+    if filter_shadow_passing {
+        tests = tests
+            .into_iter()
+            .filter(|x| x.passing(TestEnv::Shadow))
+            .collect()
+    }
+    if filter_libc_passing {
+        tests = tests
+            .into_iter()
+            .filter(|x| x.passing(TestEnv::Libc))
+            .collect()
+    }
+
+    test_utils::run_tests(&tests, summarize)?;
+
+    println!("Success.");
+    Ok(())
+}
+
+fn get_tests() -> Vec<test_utils::ShadowTest<(), String>> {
+    let tests: Vec<test_utils::ShadowTest<_, _>> = vec![
+        test_utils::ShadowTest::new(
+            "test_tee_same_pipe",
+            test_tee_same_pipe,
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ),
+        test_utils::ShadowTest::new(
+            "test_tee_partial",
+            test_tee_partial,
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ),
+        test_utils::ShadowTest::new(
+            "test_splice_partial",
+            test_splice_partial,
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ),
+        test_utils::ShadowTest::new(
+            "test_splice_nonblock",
+            test_splice_nonblock,
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ),
+        // shadow's pipes don't notice that their read end was closed
+        test_utils::ShadowTest::new(
+            "test_splice_epipe_pipe",
+            test_splice_epipe_pipe,
+            set![TestEnv::Libc],
+        ),
+        test_utils::ShadowTest::new(
+            "test_splice_epipe_tcp",
+            test_splice_epipe_tcp,
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ),
+        test_utils::ShadowTest::new(
+            "test_sendfile_partial",
+            test_sendfile_partial,
+            set![TestEnv::Libc, TestEnv::Shadow],
+        ),
+    ];
+
+    tests
+}
+
+fn pipe() -> Result<(libc::c_int, libc::c_int), String> {
+    let mut fds = [0 as libc::c_int; 2];
+    test_utils::check_system_call!(|| { unsafe { libc::pipe(fds.as_mut_ptr()) } }, &[])?;
+    Ok((fds[0], fds[1]))
+}
+
+fn write(fd: libc::c_int, buf: &[u8]) -> Result<libc::ssize_t, String> {
+    test_utils::check_system_call!(
+        || { unsafe { libc::write(fd, buf.as_ptr() as *const libc::c_void, buf.len()) } },
+        &[]
+    )
+}
+
+fn read(fd: libc::c_int, buf: &mut [u8]) -> Result<libc::ssize_t, String> {
+    test_utils::check_system_call!(
+        || { unsafe { libc::read(fd, buf.as_mut_ptr() as *mut libc::c_void, buf.len()) } },
+        &[]
+    )
+}
+
+/// tee needs two different pipes, and the ends of one pipe don't count.
+fn test_tee_same_pipe() -> Result<(), String> {
+    let (read_fd, write_fd) = pipe()?;
+
+    test_utils::run_and_close_fds(&[write_fd, read_fd], || {
+        write(write_fd, &[1u8, 2, 3, 4])?;
+
+        test_utils::check_system_call!(
+            || { unsafe { libc::tee(read_fd, write_fd, 4, 0) } },
+            &[libc::EINVAL]
+        )?;
+
+        // nothing was copied into the pipe
+        let mut buf = [0u8; 8];
+        let rv = read(read_fd, &mut buf)?;
+        test_utils::result_assert_eq(rv, 4, "Expected to read 4 bytes")?;
+
+        Ok(())
+    })
+}
+
+/// tee copies what the input has, up to len, without consuming it.
+fn test_tee_partial() -> Result<(), String> {
+    let (in_read, in_write) = pipe()?;
+    let (out_read, out_write) = pipe()?;
+
+    test_utils::run_and_close_fds(&[in_read, in_write, out_read, out_write], || {
+        let data = [1u8, 2, 3, 4, 5, 6, 7, 8, 9, 10];
+        write(in_write, &data)?;
+
+        let rv = test_utils::check_system_call!(
+            || { unsafe { libc::tee(in_read, out_write, 100, 0) } },
+            &[]
+        )?;
+        test_utils::result_assert_eq(rv, 10, "Expected to tee 10 bytes")?;
+
+        let rv = test_utils::check_system_call!(
+            || { unsafe { libc::tee(in_read, out_write, 4, 0) } },
+            &[]
+        )?;
+        test_utils::result_assert_eq(rv, 4, "Expected to tee 4 bytes")?;
+
+        let mut buf = [0u8; 20];
+        let rv = read(out_read, &mut buf)?;
+        test_utils::result_assert_eq(rv, 14, "Expected to read 14 bytes")?;
+        test_utils::result_assert_eq(&buf[..10], &data[..], "First copy differs")?;
+        test_utils::result_assert_eq(&buf[10..14], &data[..4], "Second copy differs")?;
+
+        let rv = read(in_read, &mut buf)?;
+        test_utils::result_assert_eq(rv, 10, "Expected the input to still have 10 bytes")?;
+
+        Ok(())
+    })
+}
+
+/// splice moves what the input has, up to len, and removes it from the input.
+fn test_splice_partial() -> Result<(), String> {
+    let (in_read, in_write) = pipe()?;
+    let (out_read, out_write) = pipe()?;
+
+    test_utils::run_and_close_fds(&[in_read, in_write, out_read, out_write], || {
+        let data = [1u8, 2, 3, 4, 5, 6, 7, 8, 9, 10];
+        write(in_write, &data)?;
+
+        let splice = |len| unsafe {
+            libc::splice(
+                in_read,
+                std::ptr::null_mut(),
+                out_write,
+                std::ptr::null_mut(),
+                len,
+                0,
+            )
+        };
+
+        let rv = test_utils::check_system_call!(|| splice(4), &[])?;
+        test_utils::result_assert_eq(rv, 4, "Expected to splice 4 bytes")?;
+
+        let rv = test_utils::check_system_call!(|| splice(100), &[])?;
+        test_utils::result_assert_eq(rv, 6, "Expected to splice the other 6 bytes")?;
+
+        let mut buf = [0u8; 20];
+        let rv = read(out_read, &mut buf)?;
+        test_utils::result_assert_eq(rv, 10, "Expected to read 10 bytes")?;
+        test_utils::result_assert_eq(&buf[..10], &data[..], "Spliced data differs")?;
+
+        Ok(())
+    })
+}
+
+/// SPLICE_F_NONBLOCK makes splice and tee return EAGAIN instead of waiting for data, even
+/// though the pipes are blocking.
+fn test_splice_nonblock() -> Result<(), String> {
+    let (in_read, in_write) = pipe()?;
+    let (out_read, out_write) = pipe()?;
+
+    test_utils::run_and_close_fds(&[in_read, in_write, out_read, out_write], || {
+        test_utils::check_system_call!(
+            || unsafe {
+                libc::splice(
+                    in_read,
+                    std::ptr::null_mut(),
+                    out_write,
+                    std::ptr::null_mut(),
+                    4,
+                    libc::SPLICE_F_NONBLOCK,
+                )
+            },
+            &[libc::EAGAIN]
+        )?;
+
+        test_utils::check_system_call!(
+            || { unsafe { libc::tee(in_read, out_write, 4, libc::SPLICE_F_NONBLOCK) } },
+            &[libc::EAGAIN]
+        )?;
+
+        Ok(())
+    })
+}
+
+static SIGPIPE_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+extern "C" fn count_sigpipe(_signum: libc::c_int) {
+    SIGPIPE_COUNT.fetch_add(1, Ordering::SeqCst);
+}
+
+/// Splices 4 bytes from a new pipe into out_fd, which nothing reads from, and checks that
+/// it fails with EPIPE and raises SIGPIPE.
+fn check_splice_epipe(out_fd: libc::c_int) -> Result<(), String> {
+    let (in_read, in_write) = pipe()?;
+
+    // the rust runtime ignores SIGPIPE
+    let old_handler = unsafe { libc::signal(libc::SIGPIPE, count_sigpipe as libc::sighandler_t) };
+    test_utils::result_assert(old_handler != libc::SIG_ERR, "Couldn't handle SIGPIPE")?;
+    SIGPIPE_COUNT.store(0, Ordering::SeqCst);
+
+    let rv = test_utils::run_and_close_fds(&[in_read, in_write], || {
+        write(in_write, &[1u8, 2, 3, 4])?;
+
+        test_utils::check_system_call!(
+            || unsafe {
+                libc::splice(
+                    in_read,
+                    std::ptr::null_mut(),
+                    out_fd,
+                    std::ptr::null_mut(),
+                    4,
+                    0,
+                )
+            },
+            &[libc::EPIPE]
+        )?;
+
+        test_utils::result_assert_eq(
+            SIGPIPE_COUNT.load(Ordering::SeqCst),
+            1,
+            "Expected one SIGPIPE",
+        )?;
+
+        // the data is still in the input
+        let mut buf = [0u8; 8];
+        let rv = read(in_read, &mut buf)?;
+        test_utils::result_assert_eq(rv, 4, "Expected the input to still have 4 bytes")?;
+
+        Ok(())
+    });
+
+    unsafe { libc::signal(libc::SIGPIPE, old_handler) };
+    rv
+}
+
+/// Splicing into a pipe whose read end is closed fails with EPIPE and raises SIGPIPE.
+fn test_splice_epipe_pipe() -> Result<(), String> {
+    let (out_read, out_write) = pipe()?;
+    test_utils::check_system_call!(|| { unsafe { libc::close(out_read) } }, &[])?;
+
+    test_utils::run_and_close_fds(&[out_write], || check_splice_epipe(out_write))
+}
+
+/// Splicing into a TCP socket that was shut down for writing fails with EPIPE and raises
+/// SIGPIPE.
+fn test_splice_epipe_tcp() -> Result<(), String> {
+    let (fd_client, fd_server) = setup_stream_sockets()?;
+
+    test_utils::run_and_close_fds(&[fd_client, fd_server], || {
+        test_utils::check_system_call!(
+            || { unsafe { libc::shutdown(fd_client, libc::SHUT_WR) } },
+            &[]
+        )?;
+        check_splice_epipe(fd_client)
+    })
+}
+
+/// Generate a pair of connected TCP sockets.
+fn setup_stream_sockets() -> Result<(libc::c_int, libc::c_int), String> {
+    let fd_client = test_utils::check_system_call!(
+        || { unsafe { libc::socket(libc::AF_INET, libc::SOCK_STREAM, 0) } },
+        &[]
+    )?;
+    let fd_listener = test_utils::check_system_call!(
+        || { unsafe { libc::socket(libc::AF_INET, libc::SOCK_STREAM, 0) } },
+        &[]
+    )?;
+
+    test_utils::check_system_call!(|| { unsafe { libc::listen(fd_listener, 10) } }, &[])?;
+
+    // get the listener address
+    let mut addr: libc::sockaddr_in = unsafe { std::mem::zeroed() };
+    let mut addr_len = std::mem::size_of_val(&addr) as u32;
+    test_utils::check_system_call!(
+        || unsafe {
+            libc::getsockname(
+                fd_listener,
+                &mut addr as *mut libc::sockaddr_in as *mut libc::sockaddr,
+                &mut addr_len,
+            )
+        },
+        &[]
+    )?;
+
+    // connect the client socket to the listener address
+    test_utils::check_system_call!(
+        || unsafe {
+            libc::connect(
+                fd_client,
+                &addr as *const libc::sockaddr_in as *const libc::sockaddr,
+                std::mem::size_of_val(&addr) as u32,
+            )
+        },
+        &[]
+    )?;
+
+    let fd_server = test_utils::check_system_call!(
+        || unsafe { libc::accept(fd_listener, std::ptr::null_mut(), std::ptr::null_mut()) },
+        &[]
+    )?;
+
+    // close the listening socket
+    test_utils::check_system_call!(|| { unsafe { libc::close(fd_listener) } }, &[])?;
+
+    Ok((fd_client, fd_server))
+}
+
+/// sendfile sends what the file has from the offset, up to count, and only moves the file
+/// position if it isn't given an offset.
+fn test_sendfile_partial() -> Result<(), String> {
+    let path = std::ffi::CString::new("test_splice_sendfile").unwrap();
+    let file_fd = test_utils::check_system_call!(
+        || unsafe {
+            libc::open(
+                path.as_ptr(),
+                libc::O_RDWR | libc::O_CREAT | libc::O_TRUNC,
+                0o600,
+            )
+        },
+        &[]
+    )?;
+    unsafe { libc::unlink(path.as_ptr()) };
+
+    let (out_read, out_write) = pipe()?;
+
+    test_utils::run_and_close_fds(&[file_fd, out_read, out_write], || {
+        let data = [1u8, 2, 3, 4, 5, 6, 7, 8, 9, 10];
+        write(file_fd, &data)?;
+
+        // from an offset, which is advanced instead of the file position
+        let mut offset: libc::off_t = 6;
+        let rv = test_utils::check_system_call!(
+            || { unsafe { libc::sendfile(out_write, file_fd, &mut offset, 100) } },
+            &[]
+        )?;
+        test_utils::result_assert_eq(rv, 4, "Expected to send the last 4 bytes")?;
+        test_utils::result_assert_eq(offset, 10, "Expected the offset to advance")?;
+
+        // from the file position
+        let pos = unsafe { libc::lseek(file_fd, 2, libc::SEEK_SET) };
+        test_utils::result_assert_eq(pos, 2, "Couldn't seek")?;
+        let rv = test_utils::check_system_call!(
+            || { unsafe { libc::sendfile(out_write, file_fd, std::ptr::null_mut(), 3) } },
+            &[]
+        )?;
+        test_utils::result_assert_eq(rv, 3, "Expected to send 3 bytes")?;
+        let pos = unsafe { libc::lseek(file_fd, 0, libc::SEEK_CUR) };
+        test_utils::result_assert_eq(pos, 5, "Expected the file position to advance")?;
+
+        let mut buf = [0u8; 20];
+        let rv = read(out_read, &mut buf)?;
+        test_utils::result_assert_eq(rv, 7, "Expected to read 7 bytes")?;
+        test_utils::result_assert_eq(&buf[..4], &data[6..], "Data from the offset differs")?;
+        test_utils::result_assert_eq(&buf[4..7], &data[2..5], "Data from the position differs")?;
+
+        Ok(())
+    })
+}
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+
+'''
+Measures how fast Shadow runs the Tor network of the tor-minimal test with
+more tor clients. For each number of clients in --clients and each interpose
+method in --interpose-methods, it runs tor-minimal.yaml with the torclient host
+replaced by that many copies of it. Each copy runs tor and a tgen client that
+downloads 10 files of 1 MiB through the network, alongside the authority,
+relays, exits, bridge client, and hidden service of the test.
+
+For each run, it records the wall seconds per simulated minute, the syscalls
+that Shadow handled per wall second, the peak RSS of the shadow process, and
+the number of tgen streams that succeeded. It appends one JSON object per line
+to the output file. It needs tor and tgen in ~/.local/bin, like the test. From
+the build directory:
+$ make benchmark-tor
+'''
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+SYSCALLS_RE = re.compile(r'Global syscall counts: \{(.*)\}')
+RSS_RE = re.compile(r'ru_maxrss=([0-9.]+) GiB')
+STOP_TIME_RE = re.compile(r'^  stop_time: (\d+) min$', re.MULTILINE)
+
+
+def make_run_dir(args, run_dir, clients):
+    '''Sets up the config, conf directory, and data template for a run with the given number
+    of tor clients, and returns the path of the config.'''
+    shutil.rmtree(run_dir, ignore_errors=True)
+    os.makedirs(run_dir)
+
+    # the torrc files include the conf directory by a path relative to each host's directory
+    shutil.copytree(os.path.join(args.test_dir, 'conf'), os.path.join(run_dir, 'conf'))
+
+    template_dir = os.path.join(run_dir, 'shadow.data.template')
+    shutil.copytree(os.path.join(args.test_dir, 'shadow.data.template'), template_dir)
+    # tor won't run the hidden service unless only its user can access the directory
+    os.chmod(os.path.join(template_dir, 'hosts', 'hiddenserver', 'hs'), 0o700)
+
+    with open(os.path.join(args.source_dir, 'tor-minimal.yaml')) as f:
+        config = f.read()
+
+    # hosts with a quantity above 1 are named torclient1, torclient2, and so on, and each
+    # needs its own copy of the torclient template
+    if clients > 1:
+        hosts_dir = os.path.join(template_dir, 'hosts')
+        for i in range(1, clients + 1):
+            shutil.copytree(os.path.join(hosts_dir, 'torclient'),
+                            os.path.join(hosts_dir, 'torclient{}'.format(i)))
+    config = config.replace('  torclient:\n', '  torclient:\n    quantity: {}\n'.format(clients))
+
+    config_path = os.path.join(run_dir, 'shadow.yaml')
+    with open(config_path, 'w') as f:
+        f.write(config)
+    return config_path
+
+
+def parse_log(path):
+    '''Returns the syscall count and peak RSS that shadow logged.'''
+    syscalls, rss = None, None
+    with open(path) as log:
+        for line in log:
+            match = SYSCALLS_RE.search(line)
+            if match:
+                syscalls = 0
+                for item in match.group(1).split(', '):
+                    if item:
+                        syscalls += int(item.rsplit(':', 1)[1])
+            match = RSS_RE.search(line)
+            if match:
+                rss = float(match.group(1))
+
+    if syscalls is None or rss is None:
+        raise RuntimeError('missing syscall counts or heartbeat in {}'.format(path))
+    # shadow logs the peak RSS in GiB
+    return syscalls, int(rss * 1024**3)
+
+
+def count_streams(data_dir):
+    '''Returns the number of tgen streams that succeeded, as verify.sh counts them.'''
+    count = 0
+    for root, _, files in os.walk(os.path.join(data_dir, 'hosts')):
+        for name in files:
+            if '.tgen.' in name and name.endswith('.stdout'):
+                with open(os.path.join(root, name), errors='replace') as f:
+                    count += sum(1 for line in f if 'stream-success' in line)
+    return count
+
+
+def run_shadow(args, clients, interpose_method):
+    '''Returns the results of one simulation.'''
+    name = '{}-{}'.format(interpose_method, clients)
+    run_dir = os.path.abspath(os.path.join(args.work_dir, name))
+    config_path = make_run_dir(args, run_dir, clients)
+
+    with open(config_path) as f:
+        stop_minutes = int(STOP_TIME_RE.search(f.read()).group(1))
+
+    data_dir = os.path.join(run_dir, 'shadow.data')
+    command = [os.path.abspath(args.shadow), '--data-directory', data_dir,
+               '--template-directory', 'shadow.data.template',
+               '--log-level', 'info', '--interpose-method', interpose_method,
+               '--parallelism', str(args.parallelism), '--use-syscall-counters', 'true',
+               config_path]
+
+    print('running {}'.format(name), file=sys.stderr)
+
+    log_path = os.path.join(run_dir, 'shadow.log')
+    start = time.monotonic()
+    with open(log_path, 'w') as log:
+        returncode = subprocess.call(command, cwd=run_dir, stdout=log, stderr=subprocess.STDOUT)
+    wall_seconds = time.monotonic() - start
+
+    if returncode != 0:
+        raise RuntimeError('shadow failed in {}, see its shadow.log'.format(run_dir))
+
+    syscalls, max_rss_bytes = parse_log(log_path)
+    return {
+        'benchmark': 'tor',
+        'interpose_method': interpose_method,
+        'clients': clients,
+        'parallelism': args.parallelism,
+        'wall_seconds': wall_seconds,
+        'wall_seconds_per_sim_minute': wall_seconds / stop_minutes,
+        'syscalls': syscalls,
+        'syscalls_per_second': syscalls / wall_seconds,
+        'max_rss_bytes': max_rss_bytes,
+        'tgen_streams': count_streams(data_dir),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--shadow', required=True, help='path to the shadow binary')
+    parser.add_argument('--source-dir', default=os.path.dirname(os.path.abspath(__file__)),
+                        help='source directory of the tor-minimal test')
+    parser.add_argument('--test-dir', required=True,
+                        help='build directory of the tor-minimal test, with its conf and '
+                        'shadow.data.template directories')
+    parser.add_argument('--output', default='tor-benchmark.json',
+                        help='file to append the results to, one JSON object per line')
+    parser.add_argument('--work-dir', default='tor-benchmark.data',
+                        help='directory for the configs and data of each run')
+    parser.add_argument('--clients', default='1,10,100',
+                        help='comma-separated numbers of tor clients to simulate')
+    parser.add_argument('--interpose-methods', default='ptrace,preload',
+                        help='comma-separated interpose methods')
+    parser.add_argument('--parallelism', type=int, default=2, help='worker threads')
+    args = parser.parse_args()
+
+    os.makedirs(args.work_dir, exist_ok=True)
+
+    results = []
+    for clients in [int(x) for x in args.clients.split(',')]:
+        for interpose_method in args.interpose_methods.split(','):
+            results.append(run_shadow(args, clients, interpose_method))
+
+    with open(args.output, 'a') as f:
+        for result in results:
+            f.write(json.dumps(result, sort_keys=True) + '\n')
+            print(json.dumps(result, sort_keys=True))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
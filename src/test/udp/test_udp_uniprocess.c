@@ -4,6 +4,7 @@
 #include <glib.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -12,10 +13,15 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "test/test_glib_helpers.h"
 
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
 static void test_create_socket() {
     int sock;
     assert_nonneg_errno(sock = socket(AF_INET, SOCK_DGRAM, 0));
@@ -138,6 +144,184 @@ static void test_echo() {
     assert_nonneg_errno(close(client_sock));
 }
 
+static void test_sendmmsg_recvmmsg() {
+    int client_sock, server_sock;
+    struct sockaddr_in addr = {0};
+    _udp_socketpair(&client_sock, &server_sock, &addr);
+
+    enum { NUM_MSGS = 3 };
+    char client_bufs[NUM_MSGS][16];
+    struct iovec client_iovs[NUM_MSGS];
+    struct mmsghdr client_msgs[NUM_MSGS];
+    memset(client_msgs, 0, sizeof(client_msgs));
+
+    for (int i = 0; i < NUM_MSGS; i++) {
+        /* each message has a different length and contents */
+        memset(client_bufs[i], 'a' + i, sizeof(client_bufs[i]));
+        client_iovs[i] = (struct iovec){.iov_base = client_bufs[i], .iov_len = 4 + i};
+        client_msgs[i].msg_hdr.msg_name = &addr;
+        client_msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+        client_msgs[i].msg_hdr.msg_iov = &client_iovs[i];
+        client_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int sent;
+    assert_nonneg_errno(sent = sendmmsg(client_sock, client_msgs, NUM_MSGS, 0));
+    g_assert_cmpint(sent, ==, NUM_MSGS);
+    for (int i = 0; i < NUM_MSGS; i++) {
+        g_assert_cmpint(client_msgs[i].msg_len, ==, 4 + i);
+    }
+
+    char server_bufs[NUM_MSGS + 1][16];
+    struct iovec server_iovs[NUM_MSGS + 1];
+    struct sockaddr_in server_addrs[NUM_MSGS + 1];
+    struct mmsghdr server_msgs[NUM_MSGS + 1];
+    memset(server_msgs, 0, sizeof(server_msgs));
+
+    for (int i = 0; i < NUM_MSGS + 1; i++) {
+        server_iovs[i] =
+            (struct iovec){.iov_base = server_bufs[i], .iov_len = sizeof(server_bufs[i])};
+        server_msgs[i].msg_hdr.msg_name = &server_addrs[i];
+        server_msgs[i].msg_hdr.msg_namelen = sizeof(server_addrs[i]);
+        server_msgs[i].msg_hdr.msg_iov = &server_iovs[i];
+        server_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* we get the messages that are ready, without waiting for a fourth */
+    int recvd;
+    assert_nonneg_errno(
+        recvd = recvmmsg(server_sock, server_msgs, NUM_MSGS + 1, MSG_WAITFORONE, NULL));
+    g_assert_cmpint(recvd, ==, NUM_MSGS);
+
+    for (int i = 0; i < NUM_MSGS; i++) {
+        g_assert_cmpmem(server_bufs[i], server_msgs[i].msg_len, client_bufs[i], 4 + i);
+        g_assert_cmpint(server_msgs[i].msg_hdr.msg_namelen, ==, sizeof(server_addrs[i]));
+        g_assert_cmpint(server_addrs[i].sin_family, ==, AF_INET);
+    }
+
+    assert_nonneg_errno(close(server_sock));
+    assert_nonneg_errno(close(client_sock));
+}
+
+static void test_sendmsg_recvmsg_iov() {
+    int client_sock, server_sock;
+    struct sockaddr_in addr = {0};
+    _udp_socketpair(&client_sock, &server_sock, &addr);
+
+    /* two datagrams, each gathered from several buffers, one of them empty */
+    char a[] = "hello", b[] = ", ", c[] = "world", d[] = "0123456789";
+    struct iovec client_iovs[2][3] = {
+        {{.iov_base = a, .iov_len = 5},
+         {.iov_base = b, .iov_len = 2},
+         {.iov_base = c, .iov_len = 5}},
+        {{.iov_base = d, .iov_len = 10},
+         {.iov_base = NULL, .iov_len = 0},
+         {.iov_base = a, .iov_len = 5}},
+    };
+    const char* expected[2] = {"hello, world", "0123456789hello"};
+
+    for (int i = 0; i < 2; i++) {
+        struct msghdr msg = {.msg_name = &addr,
+                             .msg_namelen = sizeof(addr),
+                             .msg_iov = client_iovs[i],
+                             .msg_iovlen = 3};
+        ssize_t sent;
+        assert_nonneg_errno(sent = sendmsg(client_sock, &msg, 0));
+        g_assert_cmpint(sent, ==, strlen(expected[i]));
+    }
+
+    /* the first datagram is scattered over the buffers in order, and doesn't
+     * run into the second one even though there's room for it */
+    char x[4], y[16], z[16];
+    memset(z, 0, sizeof(z));
+    struct iovec server_iovs[3] = {{.iov_base = x, .iov_len = sizeof(x)},
+                                   {.iov_base = NULL, .iov_len = 0},
+                                   {.iov_base = y, .iov_len = sizeof(y)}};
+    struct sockaddr_in from = {0};
+    struct msghdr server_msg = {.msg_name = &from,
+                                .msg_namelen = sizeof(from),
+                                .msg_iov = server_iovs,
+                                .msg_iovlen = 3};
+    ssize_t recvd;
+    assert_nonneg_errno(recvd = recvmsg(server_sock, &server_msg, 0));
+    g_assert_cmpint(recvd, ==, strlen(expected[0]));
+    g_assert_cmpmem(x, sizeof(x), expected[0], sizeof(x));
+    g_assert_cmpmem(y, recvd - sizeof(x), expected[0] + sizeof(x), recvd - sizeof(x));
+    g_assert_cmpint(server_msg.msg_namelen, ==, sizeof(from));
+    g_assert_cmpint(from.sin_family, ==, AF_INET);
+
+    /* buffers too small for the second datagram get its start, and the rest
+     * of it is dropped rather than left for the next receive */
+    server_iovs[0] = (struct iovec){.iov_base = x, .iov_len = sizeof(x)};
+    server_iovs[1] = (struct iovec){.iov_base = z, .iov_len = 3};
+    server_msg = (struct msghdr){.msg_iov = server_iovs, .msg_iovlen = 2};
+    assert_nonneg_errno(recvd = recvmsg(server_sock, &server_msg, 0));
+    g_assert_cmpint(recvd, ==, sizeof(x) + 3);
+    g_assert_cmpmem(x, sizeof(x), expected[1], sizeof(x));
+    g_assert_cmpmem(z, 3, expected[1] + sizeof(x), 3);
+    g_assert_cmpint(z[3], ==, 0);
+
+    server_iovs[0] = (struct iovec){.iov_base = y, .iov_len = sizeof(y)};
+    server_msg = (struct msghdr){.msg_iov = server_iovs, .msg_iovlen = 1};
+    g_assert_cmpint(recvmsg(server_sock, &server_msg, MSG_DONTWAIT), ==, -1);
+    assert_errno_is(EAGAIN);
+
+    assert_nonneg_errno(close(server_sock));
+    assert_nonneg_errno(close(client_sock));
+}
+
+static void test_udp_segment() {
+    int client_sock, server_sock;
+    struct sockaddr_in addr = {0};
+    _udp_socketpair(&client_sock, &server_sock, &addr);
+
+    char client_buf[250];
+    for (int i = 0; i < sizeof(client_buf); i++) {
+        client_buf[i] = (char)i;
+    }
+
+    const uint16_t segment_size = 100;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(segment_size))];
+    } control = {0};
+
+    struct iovec iov = {.iov_base = client_buf, .iov_len = sizeof(client_buf)};
+    struct msghdr msg = {.msg_name = &addr,
+                         .msg_namelen = sizeof(addr),
+                         .msg_iov = &iov,
+                         .msg_iovlen = 1,
+                         .msg_control = control.buf,
+                         .msg_controllen = sizeof(control.buf)};
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(segment_size));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+
+    ssize_t sent;
+    assert_nonneg_errno(sent = sendmsg(client_sock, &msg, 0));
+    g_assert_cmpint(sent, ==, sizeof(client_buf));
+
+    /* the buffer arrives as separate datagrams of at most the segment size */
+    size_t offset = 0;
+    while (offset < sizeof(client_buf)) {
+        char server_buf[sizeof(client_buf)];
+        struct iovec server_iov = {.iov_base = server_buf, .iov_len = sizeof(server_buf)};
+        struct msghdr server_msg = {.msg_iov = &server_iov, .msg_iovlen = 1};
+
+        ssize_t recvd;
+        assert_nonneg_errno(recvd = recvmsg(server_sock, &server_msg, 0));
+        g_assert_cmpint(recvd, ==, MIN(segment_size, sizeof(client_buf) - offset));
+        g_assert_cmpmem(server_buf, recvd, client_buf + offset, recvd);
+        offset += recvd;
+    }
+
+    assert_nonneg_errno(close(server_sock));
+    assert_nonneg_errno(close(client_sock));
+}
+
 int main(int argc, char* argv[]) {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/udp_uniprocess/create_socket", test_create_socket);
@@ -145,6 +329,9 @@ int main(int argc, char* argv[]) {
     g_test_add_func("/udp_uniprocess/getaddrinfo", test_getaddrinfo);
     g_test_add_func("/udp_uniprocess/sendto_one_byte", test_sendto_one_byte);
     g_test_add_func("/udp_uniprocess/echo", test_echo);
+    g_test_add_func("/udp_uniprocess/sendmmsg_recvmmsg", test_sendmmsg_recvmmsg);
+    g_test_add_func("/udp_uniprocess/sendmsg_recvmsg_iov", test_sendmsg_recvmsg_iov);
+    g_test_add_func("/udp_uniprocess/udp_segment", test_udp_segment);
     g_test_run();
     return EXIT_SUCCESS;
 }
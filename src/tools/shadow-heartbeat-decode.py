@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+
+'''
+Convert a host's heartbeat statistics that were written with
+`host_defaults.heartbeat_log_format: binary` to CSV.
+
+The binary format is described next to `HEARTBEAT_FILE_MAGIC` in
+src/main/host/tracker.c.
+'''
+
+import argparse
+import csv
+import socket
+import struct
+import sys
+
+MAGIC = b'SHADOWHB'
+VERSION = 2
+
+RECORD_HEADER = struct.Struct('<II')
+FIELD = struct.Struct('<Q')
+
+COUNTERS = [
+    'packets-total', 'bytes-total',
+    'packets-control', 'bytes-control-header',
+    'packets-control-retrans', 'bytes-control-header-retrans',
+    'packets-data', 'bytes-data-header', 'bytes-data-payload',
+    'packets-data-retrans', 'bytes-data-header-retrans', 'bytes-data-payload-retrans',
+]
+
+IFACE_COUNTERS = ['{}-{}'.format(direction, counter)
+                  for direction in ['inbound-localhost', 'outbound-localhost',
+                                    'inbound-remote', 'outbound-remote']
+                  for counter in COUNTERS]
+
+# record type: (name, columns)
+RECORD_TYPES = {
+    1: ('node', ['time-nanoseconds', 'interval-nanoseconds', 'processing-nanoseconds',
+                 'delayed-count', 'delay-nanoseconds'] + IFACE_COUNTERS),
+    2: ('socket', ['time-nanoseconds', 'descriptor-number', 'protocol', 'peer-ip', 'peer-port',
+                   'inbuflen-bytes', 'inbufsize-bytes', 'outbuflen-bytes',
+                   'outbufsize-bytes', 'inbufdrop-packets'] + IFACE_COUNTERS),
+    3: ('ram', ['time-nanoseconds', 'interval-nanoseconds', 'alloc-bytes', 'dealloc-bytes',
+                'total-bytes', 'pointers-count', 'failfree-count']),
+}
+
+# the values of `ProtocolType` in src/main/host/protocol.h
+PROTOCOLS = {0: 'UNKNOWN', 1: 'LOCAL', 2: 'TCP', 3: 'UDP'}
+
+
+def read_exact(inf, n):
+    data = inf.read(n)
+    if len(data) != n:
+        raise EOFError('truncated heartbeat record')
+    return data
+
+
+def decode(inf, outf, record_name):
+    header = inf.read(len(MAGIC) + 4)
+    if len(header) < len(MAGIC) + 4 or header[:len(MAGIC)] != MAGIC:
+        raise ValueError('not a binary heartbeat file')
+    version, = struct.unpack('<I', header[len(MAGIC):])
+    if version != VERSION:
+        raise ValueError('unsupported heartbeat file version {}'.format(version))
+
+    columns = next(c for (name, c) in RECORD_TYPES.values() if name == record_name)
+
+    writer = csv.writer(outf, lineterminator='\n')
+    writer.writerow(columns)
+
+    while True:
+        record_header = inf.read(RECORD_HEADER.size)
+        if not record_header:
+            break
+        if len(record_header) != RECORD_HEADER.size:
+            raise EOFError('truncated heartbeat record')
+
+        record_type, num_fields = RECORD_HEADER.unpack(record_header)
+        data = read_exact(inf, num_fields * FIELD.size)
+
+        if record_type not in RECORD_TYPES:
+            raise ValueError('unknown heartbeat record type {}'.format(record_type))
+
+        name, _ = RECORD_TYPES[record_type]
+        if name != record_name:
+            continue
+
+        # newer versions may add fields to the end of a record
+        if num_fields < len(columns):
+            raise ValueError('{} record has {} fields, expected {}'.format(
+                name, num_fields, len(columns)))
+
+        fields = list(struct.unpack('<{}Q'.format(len(columns)), data[:len(columns) * FIELD.size]))
+
+        if name == 'socket':
+            fields[2] = PROTOCOLS.get(fields[2], 'UNKNOWN')
+            fields[3] = socket.inet_ntoa(struct.pack('!I', fields[3]))
+
+        writer.writerow(fields)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Convert a binary shadow heartbeat file to CSV.')
+    parser.add_argument('heartbeatfile', nargs='?', default='-',
+                        help='the host\'s heartbeat.bin file, or "-" to read from stdin (default)')
+    parser.add_argument('--type', default='node',
+                        choices=[name for (name, _) in RECORD_TYPES.values()],
+                        help='which heartbeat statistics to print (default: node)')
+    args = parser.parse_args()
+
+    inf = sys.stdin.buffer if args.heartbeatfile == '-' else open(args.heartbeatfile, 'rb')
+
+    try:
+        decode(inf, sys.stdout, args.type)
+    except BrokenPipeError:
+        pass
+    except (EOFError, ValueError) as e:
+        print('error: {}'.format(e), file=sys.stderr)
+        exit(1)
+    finally:
+        if inf is not sys.stdin.buffer:
+            inf.close()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+
+'''
+Decode a shadow log that was written with `experimental.log_format: binary`,
+and print it in the same text format that shadow uses by default.
+
+The binary format is described next to `BINARY_LOG_TAG_RECORD` in
+src/main/core/logger/shadow_logger.rs.
+'''
+
+import argparse
+import struct
+import sys
+
+MAGIC = b'SHADOWLG'
+VERSION = 1
+
+TAG_STRING = 1
+TAG_RECORD = 2
+
+LEVELS = {1: 'ERROR', 2: 'WARN', 3: 'INFO', 4: 'DEBUG', 5: 'TRACE'}
+
+STRING_HEADER = struct.Struct('<II')
+RECORD_HEADER = struct.Struct('<QQBIIIIII')
+
+NO_SIM_TIME = 2**64 - 1
+
+
+def format_time(nanos, digits):
+    secs, nanos = divmod(nanos, 1000000000)
+    mins, secs = divmod(secs, 60)
+    hours, mins = divmod(mins, 60)
+    fraction = nanos // 10**(9 - digits)
+    return '{:02}:{:02}:{:02}.{:0{}}'.format(hours, mins, secs, fraction, digits)
+
+
+def read_exact(inf, n):
+    data = inf.read(n)
+    if len(data) != n:
+        raise EOFError('truncated log entry')
+    return data
+
+
+def decode(inf, outf):
+    header = inf.read(len(MAGIC) + 4)
+    if len(header) < len(MAGIC) + 4 or header[:len(MAGIC)] != MAGIC:
+        raise ValueError('not a binary shadow log')
+    version, = struct.unpack('<I', header[len(MAGIC):])
+    if version != VERSION:
+        raise ValueError('unsupported binary log version {}'.format(version))
+
+    strings = {0: 'n/a'}
+
+    while True:
+        tag = inf.read(1)
+        if not tag:
+            break
+
+        if tag[0] == TAG_STRING:
+            string_id, length = STRING_HEADER.unpack(read_exact(inf, STRING_HEADER.size))
+            strings[string_id] = read_exact(inf, length).decode('utf-8', 'replace')
+        elif tag[0] == TAG_RECORD:
+            (wall_time, sim_time, level, thread_id, host_id, file_id, line, module_id,
+             length) = RECORD_HEADER.unpack(read_exact(inf, RECORD_HEADER.size))
+            message = read_exact(inf, length).decode('utf-8', 'replace')
+
+            outf.write('{} [{}] {} [{}] [{}] [{}:{}] [{}] {}\n'.format(
+                format_time(wall_time * 1000, 6),
+                strings[thread_id],
+                format_time(sim_time, 9) if sim_time != NO_SIM_TIME else 'n/a',
+                LEVELS.get(level, str(level)),
+                strings[host_id],
+                strings[file_id],
+                line if line != 0 else 'n/a',
+                strings[module_id],
+                message))
+        else:
+            raise ValueError('unknown binary log entry type {}'.format(tag[0]))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Convert a binary shadow log to the text log format.')
+    parser.add_argument('logfile', nargs='?', default='-',
+                        help='the binary log file, or "-" to read from stdin (default)')
+    args = parser.parse_args()
+
+    inf = sys.stdin.buffer if args.logfile == '-' else open(args.logfile, 'rb')
+
+    try:
+        decode(inf, sys.stdout)
+    except BrokenPipeError:
+        pass
+    except (EOFError, ValueError) as e:
+        print('error: {}'.format(e), file=sys.stderr)
+        exit(1)
+    finally:
+        if inf is not sys.stdin.buffer:
+            inf.close()
+
+
+if __name__ == '__main__':
+    main()
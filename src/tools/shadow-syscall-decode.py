@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+
+'''
+Print the syscalls that a process recorded with
+`hosts.<hostname>.processes[*].trace_syscalls` enabled, in a format similar to
+strace's, or summarize them by syscall.
+
+The binary format is described next to `SYSCALL_TRACE_FILE_MAGIC` in
+src/main/host/syscall_handler.c.
+'''
+
+import argparse
+import errno
+import os
+import re
+import struct
+import sys
+
+MAGIC = b'SHADOWSC'
+VERSION = 1
+
+RECORD = struct.Struct('<QQQQ6QQQ')
+
+# the values of `SysCallReturnState` in src/main/host/syscall_types.h
+STATE_DONE = 0
+STATE_BLOCK = 1
+STATE_NATIVE = 2
+STATE_MASK = 0xff
+RESUMED = 1 << 8
+INTERRUPTED = 1 << 9
+
+# the syscalls that only shadow's shim makes, from src/main/host/syscall_numbers.h
+SHADOW_SYSCALLS = {
+    1000: 'shadow_set_ptrace_allow_native_syscalls',
+    1001: 'shadow_get_ipc_blk',
+    1002: 'shadow_get_shm_blk',
+    1003: 'shadow_hostname_to_addr_ipv4',
+}
+
+UNISTD_HEADERS = [
+    '/usr/include/x86_64-linux-gnu/asm/unistd_64.h',
+    '/usr/include/asm/unistd_64.h',
+]
+
+
+def load_syscall_names():
+    names = dict(SHADOW_SYSCALLS)
+    for path in UNISTD_HEADERS:
+        if os.path.exists(path):
+            with open(path) as f:
+                for line in f:
+                    m = re.match(r'#define __NR_(\w+)\s+(\d+)', line)
+                    if m:
+                        names[int(m.group(2))] = m.group(1)
+            break
+    return names
+
+
+def read_records(inf):
+    header = inf.read(len(MAGIC) + 4)
+    if len(header) < len(MAGIC) + 4 or header[:len(MAGIC)] != MAGIC:
+        raise ValueError('not a syscall trace file')
+    version, = struct.unpack('<I', header[len(MAGIC):])
+    if version != VERSION:
+        raise ValueError('unsupported syscall trace file version {}'.format(version))
+
+    while True:
+        data = inf.read(RECORD.size)
+        if not data:
+            break
+        if len(data) != RECORD.size:
+            raise EOFError('truncated syscall record')
+        yield RECORD.unpack(data)
+
+
+def signed(value):
+    return value - (1 << 64) if value >= (1 << 63) else value
+
+
+def format_result(retval):
+    retval = signed(retval)
+    if -4096 < retval < 0:
+        name = errno.errorcode.get(-retval, str(-retval))
+        return '-1 {} ({})'.format(name, os.strerror(-retval))
+    if retval > 0xffff:
+        return hex(retval)
+    return str(retval)
+
+
+def print_trace(inf, outf, names):
+    for record in read_records(inf):
+        (sim_time, wall_ns, tid, number) = record[:4]
+        args = record[4:10]
+        (retval, outcome) = record[10:]
+
+        name = names.get(number, 'syscall_{}'.format(number))
+        state = outcome & STATE_MASK
+        prefix = '{}.{:09d} [{}] '.format(sim_time // 10**9, sim_time % 10**9, tid)
+
+        if outcome & RESUMED:
+            call = '<... {} resumed>'.format(name)
+        else:
+            call = '{}({})'.format(name, ', '.join(hex(a) for a in args))
+
+        if outcome & INTERRUPTED:
+            result = ' = -1 EINTR (interrupted by a signal)'
+        elif state == STATE_BLOCK:
+            result = ' <unfinished ...>'
+        elif state == STATE_NATIVE:
+            result = ' = ? <native>'
+        else:
+            result = ' = ' + format_result(retval)
+
+        outf.write('{}{}{} <{:.6f}>\n'.format(prefix, call, result, wall_ns / 1e9))
+
+
+def print_summary(inf, outf, names):
+    # syscall number: [calls, errors, blocked, native, wall nanoseconds]
+    stats = {}
+    for record in read_records(inf):
+        (wall_ns, number) = (record[1], record[3])
+        (retval, outcome) = record[10:]
+        state = outcome & STATE_MASK
+
+        entry = stats.setdefault(number, [0, 0, 0, 0, 0])
+        entry[4] += wall_ns
+        # a call that blocked is counted once, when it completes
+        if state == STATE_BLOCK:
+            if not outcome & RESUMED:
+                entry[2] += 1
+            continue
+        entry[0] += 1
+        if state == STATE_NATIVE:
+            entry[3] += 1
+        elif -4096 < signed(retval) < 0:
+            entry[1] += 1
+
+    total_ns = sum(entry[4] for entry in stats.values()) or 1
+
+    outf.write('{:>7} {:>12} {:>11} {:>9} {:>9} {:>9} {:>9} {}\n'.format(
+        '% time', 'seconds', 'usecs/call', 'calls', 'errors', 'blocked', 'native', 'syscall'))
+    for number, entry in sorted(stats.items(), key=lambda item: -item[1][4]):
+        (calls, errors, blocked, native, wall_ns) = entry
+        outf.write('{:>7.2f} {:>12.6f} {:>11.0f} {:>9} {:>9} {:>9} {:>9} {}\n'.format(
+            100.0 * wall_ns / total_ns, wall_ns / 1e9, wall_ns / 1e3 / max(calls, 1), calls,
+            errors, blocked, native, names.get(number, 'syscall_{}'.format(number))))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Print or summarize a binary shadow syscall trace.')
+    parser.add_argument('tracefile', nargs='?', default='-',
+                        help='the process\'s syscalls.bin file, or "-" to read from stdin '
+                             '(default)')
+    parser.add_argument('--summary', action='store_true',
+                        help='print the number of calls, errors, and the wall time that shadow '
+                             'spent handling each syscall, instead of each call')
+    args = parser.parse_args()
+
+    inf = sys.stdin.buffer if args.tracefile == '-' else open(args.tracefile, 'rb')
+    names = load_syscall_names()
+
+    try:
+        if args.summary:
+            print_summary(inf, sys.stdout, names)
+        else:
+            print_trace(inf, sys.stdout, names)
+    except BrokenPipeError:
+        pass
+    except (EOFError, ValueError) as e:
+        print('error: {}'.format(e), file=sys.stderr)
+        exit(1)
+    finally:
+        if inf is not sys.stdin.buffer:
+            inf.close()
+
+
+if __name__ == '__main__':
+    main()